@@ -42,6 +42,7 @@
 #endif
 #include "sort-util.h"
 #include "special.h"
+#include "stdio-util.h"
 #include "strv.h"
 #include "strxcpyx.h"
 #include "terminal-util.h"
@@ -329,7 +330,35 @@ static void free_host_info(struct host_info *hi) {
 
 DEFINE_TRIVIAL_CLEANUP_FUNC(struct host_info *, free_host_info);
 
-static int acquire_time_data(sd_bus *bus, struct unit_times **out) {
+static int unit_times_finalize(struct unit_times *t, const struct boot_times *boot_times, const char *id) {
+        assert(t);
+        assert(boot_times);
+        assert(id);
+
+        subtract_timestamp(&t->activating, boot_times->reverse_offset);
+        subtract_timestamp(&t->activated, boot_times->reverse_offset);
+        subtract_timestamp(&t->deactivating, boot_times->reverse_offset);
+        subtract_timestamp(&t->deactivated, boot_times->reverse_offset);
+
+        if (t->activated >= t->activating)
+                t->time = t->activated - t->activating;
+        else if (t->deactivated >= t->activating)
+                t->time = t->deactivated - t->activating;
+        else
+                t->time = 0;
+
+        if (t->activating == 0)
+                return 0;
+
+        t->name = strdup(id);
+        if (!t->name)
+                return log_oom();
+
+        t->has_data = true;
+        return 1;
+}
+
+static int acquire_time_data_per_unit(sd_bus *bus, const struct boot_times *boot_times, struct unit_times **out) {
         static const struct bus_properties_map property_map[] = {
                 { "InactiveExitTimestampMonotonic",  "t", NULL, offsetof(struct unit_times, activating)   },
                 { "ActiveEnterTimestampMonotonic",   "t", NULL, offsetof(struct unit_times, activated)    },
@@ -340,15 +369,10 @@ static int acquire_time_data(sd_bus *bus, struct unit_times **out) {
         _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
         _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
         _cleanup_(unit_times_freep) struct unit_times *unit_times = NULL;
-        struct boot_times *boot_times = NULL;
         size_t allocated = 0, c = 0;
         UnitInfo u;
         int r;
 
-        r = acquire_boot_times(bus, &boot_times);
-        if (r < 0)
-                return r;
-
         r = sd_bus_call_method(
                         bus,
                         "org.freedesktop.systemd1",
@@ -389,28 +413,85 @@ static int acquire_time_data(sd_bus *bus, struct unit_times **out) {
                         return log_error_errno(r, "Failed to get timestamp properties of unit %s: %s",
                                                u.id, bus_error_message(&error, r));
 
-                subtract_timestamp(&t->activating, boot_times->reverse_offset);
-                subtract_timestamp(&t->activated, boot_times->reverse_offset);
-                subtract_timestamp(&t->deactivating, boot_times->reverse_offset);
-                subtract_timestamp(&t->deactivated, boot_times->reverse_offset);
+                r = unit_times_finalize(t, boot_times, u.id);
+                if (r < 0)
+                        return r;
+                if (r > 0)
+                        c++;
+        }
+        if (r < 0)
+                return bus_log_parse_error(r);
 
-                if (t->activated >= t->activating)
-                        t->time = t->activated - t->activating;
-                else if (t->deactivated >= t->activating)
-                        t->time = t->deactivated - t->activating;
-                else
-                        t->time = 0;
+        *out = TAKE_PTR(unit_times);
+        return c;
+}
 
-                if (t->activating == 0)
-                        continue;
+static int acquire_time_data(sd_bus *bus, struct unit_times **out) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+        _cleanup_(unit_times_freep) struct unit_times *unit_times = NULL;
+        struct boot_times *boot_times = NULL;
+        size_t allocated = 0, c = 0;
+        const char *id;
+        int r;
+
+        r = acquire_boot_times(bus, &boot_times);
+        if (r < 0)
+                return r;
 
-                t->name = strdup(u.id);
-                if (!t->name)
+        /* Fetch the timestamps of all units with a single call. Only if the manager is too old to know
+         * this method, or an older bus policy refuses it, fall back to querying the properties of each
+         * unit individually, which remain readable for everybody. */
+        r = sd_bus_call_method(
+                        bus,
+                        "org.freedesktop.systemd1",
+                        "/org/freedesktop/systemd1",
+                        "org.freedesktop.systemd1.Manager",
+                        "ListUnitsTimestamps",
+                        &error, &reply,
+                        NULL);
+        if (r < 0) {
+                if (!sd_bus_error_has_name(&error, SD_BUS_ERROR_UNKNOWN_METHOD) &&
+                    !sd_bus_error_has_name(&error, SD_BUS_ERROR_ACCESS_DENIED))
+                        return log_error_errno(r, "Failed to list unit timestamps: %s", bus_error_message(&error, r));
+
+                log_debug("Cannot use ListUnitsTimestamps() (%s), querying units individually.", bus_error_message(&error, r));
+                return acquire_time_data_per_unit(bus, boot_times, out);
+        }
+
+        r = sd_bus_message_enter_container(reply, SD_BUS_TYPE_ARRAY, "(stttt)");
+        if (r < 0)
+                return bus_log_parse_error(r);
+
+        for (;;) {
+                struct unit_times *t;
+
+                if (!GREEDY_REALLOC0(unit_times, allocated, c + 2))
                         return log_oom();
 
-                t->has_data = true;
-                c++;
+                unit_times[c + 1].has_data = false;
+                t = &unit_times[c];
+                t->name = NULL;
+
+                r = sd_bus_message_read(reply, "(stttt)",
+                                        &id,
+                                        &t->activating,
+                                        &t->activated,
+                                        &t->deactivating,
+                                        &t->deactivated);
+                if (r < 0)
+                        return bus_log_parse_error(r);
+                if (r == 0)
+                        break;
+
+                r = unit_times_finalize(t, boot_times, id);
+                if (r < 0)
+                        return r;
+                if (r > 0)
+                        c++;
         }
+
+        r = sd_bus_message_exit_container(reply);
         if (r < 0)
                 return bus_log_parse_error(r);
 
@@ -1125,6 +1206,84 @@ static int analyze_blame(int argc, char *argv[], void *userdata) {
         return table_print(table, NULL);
 }
 
+static int analyze_generator_blame(int argc, char *argv[], void *userdata) {
+        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+        _cleanup_(table_unrefp) Table *table = NULL;
+        uint64_t start, finish;
+        const char *name;
+        TableCell *cell;
+        int32_t status;
+        int r;
+
+        r = acquire_bus(&bus, NULL);
+        if (r < 0)
+                return log_error_errno(r, "Failed to create bus connection: %m");
+
+        r = sd_bus_get_property(
+                        bus,
+                        "org.freedesktop.systemd1",
+                        "/org/freedesktop/systemd1",
+                        "org.freedesktop.systemd1.Manager",
+                        "GeneratorTimings",
+                        &error,
+                        &reply,
+                        "a(stti)");
+        if (r < 0)
+                return log_error_errno(r, "Failed to get generator timings: %s", bus_error_message(&error, r));
+
+        table = table_new("time", "generator", "result");
+        if (!table)
+                return log_oom();
+
+        table_set_header(table, false);
+
+        assert_se(cell = table_get_cell(table, 0, 0));
+        r = table_set_align_percent(table, cell, 100);
+        if (r < 0)
+                return r;
+
+        r = table_set_sort(table, (size_t) 0, (size_t) SIZE_MAX);
+        if (r < 0)
+                return r;
+
+        r = table_set_reverse(table, 0, true);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_enter_container(reply, SD_BUS_TYPE_ARRAY, "(stti)");
+        if (r < 0)
+                return bus_log_parse_error(r);
+
+        while ((r = sd_bus_message_read(reply, "(stti)", &name, &start, &finish, &status)) > 0) {
+                char result[STRLEN("exit status ") + DECIMAL_STR_MAX(int32_t)] = "";
+
+                if (status > 0)
+                        xsprintf(result, "exit status %" PRIi32, status);
+                else if (status < 0)
+                        strcpy(result, "terminated");
+
+                r = table_add_many(table,
+                                   TABLE_TIMESPAN_MSEC, finish >= start ? finish - start : 0,
+                                   TABLE_STRING, name,
+                                   TABLE_STRING, result);
+                if (r < 0)
+                        return table_log_add_error(r);
+        }
+        if (r < 0)
+                return bus_log_parse_error(r);
+
+        if (table_get_rows(table) <= 1) {
+                log_info("No generator timings available.");
+                return 0;
+        }
+
+        (void) pager_open(arg_pager_flags);
+
+        return table_print(table, NULL);
+}
+
 static int analyze_time(int argc, char *argv[], void *userdata) {
         _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
         _cleanup_free_ char *buf = NULL;
@@ -1396,6 +1555,40 @@ static int dump(int argc, char *argv[], void *userdata) {
         return copy_bytes(fd, STDOUT_FILENO, (uint64_t) -1, 0);
 }
 
+static int dump_trace(int argc, char *argv[], void *userdata) {
+        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
+        int fd = -1;
+        int r;
+
+        r = acquire_bus(&bus, NULL);
+        if (r < 0)
+                return log_error_errno(r, "Failed to create bus connection: %m");
+
+        if (!sd_bus_can_send(bus, SD_BUS_TYPE_UNIX_FD))
+                return log_error_errno(SYNTHETIC_ERRNO(EOPNOTSUPP), "Bus connection does not support file descriptor passing.");
+
+        r = sd_bus_call_method(
+                        bus,
+                        "org.freedesktop.systemd1",
+                        "/org/freedesktop/systemd1",
+                        "org.freedesktop.systemd1.Manager",
+                        "DumpTrace",
+                        &error,
+                        &reply,
+                        NULL);
+        if (r < 0)
+                return log_error_errno(r, "Failed to issue method call DumpTrace: %s", bus_error_message(&error, r));
+
+        r = sd_bus_message_read(reply, "h", &fd);
+        if (r < 0)
+                return bus_log_parse_error(r);
+
+        fflush(stdout);
+        return copy_bytes(fd, STDOUT_FILENO, (uint64_t) -1, 0);
+}
+
 static int cat_config(int argc, char *argv[], void *userdata) {
         char **arg, **list;
         int r;
@@ -1567,7 +1760,7 @@ static int do_unit_files(int argc, char *argv[], void *userdata) {
         if (r < 0)
                 return log_error_errno(r, "lookup_paths_init() failed: %m");
 
-        r = unit_file_build_name_map(&lp, NULL, &unit_ids, &unit_names, NULL);
+        r = unit_file_build_name_map(&lp, NULL, &unit_ids, &unit_names, NULL, NULL);
         if (r < 0)
                 return log_error_errno(r, "unit_file_build_name_map() failed: %m");
 
@@ -2198,10 +2391,12 @@ static int help(int argc, char *argv[], void *userdata) {
                "\nCommands:\n"
                "  [time]                   Print time required to boot the machine\n"
                "  blame                    Print list of running units ordered by time to init\n"
+               "  generator-blame          Print list of generators ordered by execution time\n"
                "  critical-chain [UNIT...] Print a tree of the time critical chain of units\n"
                "  plot                     Output SVG graphic showing service initialization\n"
                "  dot [UNIT...]            Output dependency graph in %s format\n"
                "  dump                     Output state serialization of service manager\n"
+               "  dump-trace               Output trace of service manager operations\n"
                "  cat-config               Show configuration file and drop-ins\n"
                "  unit-files               List files and symlinks for units\n"
                "  unit-paths               List load directories for units\n"
@@ -2426,6 +2621,7 @@ static int run(int argc, char *argv[]) {
                 { "help",              VERB_ANY, VERB_ANY, 0,            help                   },
                 { "time",              VERB_ANY, 1,        VERB_DEFAULT, analyze_time           },
                 { "blame",             VERB_ANY, 1,        0,            analyze_blame          },
+                { "generator-blame",   VERB_ANY, 1,        0,            analyze_generator_blame },
                 { "critical-chain",    VERB_ANY, VERB_ANY, 0,            analyze_critical_chain },
                 { "plot",              VERB_ANY, 1,        0,            analyze_plot           },
                 { "dot",               VERB_ANY, VERB_ANY, 0,            dot                    },
@@ -2438,6 +2634,7 @@ static int run(int argc, char *argv[]) {
                 { "get-log-target",    VERB_ANY, 1,        0,            get_log_target         },
                 { "service-watchdogs", VERB_ANY, 2,        0,            service_watchdogs      },
                 { "dump",              VERB_ANY, 1,        0,            dump                   },
+                { "dump-trace",        VERB_ANY, 1,        0,            dump_trace             },
                 { "cat-config",        2,        VERB_ANY, 0,            cat_config             },
                 { "unit-files",        VERB_ANY, VERB_ANY, 0,            do_unit_files          },
                 { "unit-paths",        1,        1,        0,            dump_unit_paths        },
@@ -0,0 +1,202 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "alloc-util.h"
+#include "arena.h"
+#include "memory-util.h"
+
+/* Chunks start out at a page and double in size from there, up to this limit */
+#define ARENA_CHUNK_SIZE_MAX (256U * 1024U)
+
+/* Allocations larger than this fraction of the chunk size get a chunk of their own, so that they don't leave
+ * most of the current chunk unused */
+#define ARENA_LARGE_FRACTION 4U
+
+struct arena_chunk {
+        struct arena_chunk *next;
+        size_t size, used;
+};
+
+#define CHUNK_HEADER_SIZE ALIGN(sizeof(struct arena_chunk))
+
+static uint8_t* chunk_data(struct arena_chunk *c) {
+        return (uint8_t*) c + CHUNK_HEADER_SIZE;
+}
+
+static struct arena_chunk* chunk_new(size_t size) {
+        struct arena_chunk *c;
+
+        if (size > SIZE_MAX - CHUNK_HEADER_SIZE)
+                return NULL;
+
+        c = malloc(CHUNK_HEADER_SIZE + size);
+        if (!c)
+                return NULL;
+
+        *c = (struct arena_chunk) {
+                .size = size,
+        };
+
+        return c;
+}
+
+void* arena_alloc(Arena *a, size_t size) {
+        struct arena_chunk *c;
+        size_t chunk_size;
+        void *p;
+
+        assert(a);
+
+        if (size > SIZE_MAX - sizeof(void*))
+                return NULL;
+        size = ALIGN(MAX(size, (size_t) 1));
+
+        c = a->chunks;
+        if (c && c->size - c->used >= size) {
+                p = chunk_data(c) + c->used;
+                c->used += size;
+                return a->last = p;
+        }
+
+        chunk_size = c ? MIN(c->size * 2, (size_t) ARENA_CHUNK_SIZE_MAX) : page_size() - CHUNK_HEADER_SIZE;
+
+        if (c && size > chunk_size / ARENA_LARGE_FRACTION) {
+                /* Give large allocations a chunk of their own, behind the current one, which stays in use */
+                struct arena_chunk *large;
+
+                large = chunk_new(size);
+                if (!large)
+                        return NULL;
+
+                large->used = size;
+                large->next = c->next;
+                c->next = large;
+
+                return chunk_data(large);
+        }
+
+        c = chunk_new(MAX(chunk_size, size));
+        if (!c)
+                return NULL;
+
+        c->next = a->chunks;
+        a->chunks = c;
+
+        c->used = size;
+        return a->last = chunk_data(c);
+}
+
+void* arena_alloc0(Arena *a, size_t size) {
+        void *p;
+
+        p = arena_alloc(a, size);
+        if (!p)
+                return NULL;
+
+        return memset(p, 0, size);
+}
+
+void* arena_realloc(Arena *a, void *p, size_t old_size, size_t new_size) {
+        void *q;
+
+        assert(a);
+
+        if (!p)
+                return arena_alloc(a, new_size);
+
+        /* The most recent allocation can be resized in place, if the chunk has room for it */
+        if (p == a->last) {
+                struct arena_chunk *c = a->chunks;
+                size_t offset = (uint8_t*) p - chunk_data(c);
+
+                if (new_size <= c->size - offset) {
+                        c->used = offset + ALIGN(MAX(new_size, (size_t) 1));
+                        return p;
+                }
+        }
+
+        q = arena_alloc(a, new_size);
+        if (!q)
+                return NULL;
+
+        return memcpy(q, p, MIN(old_size, new_size));
+}
+
+void* arena_memdup(Arena *a, const void *p, size_t size) {
+        void *q;
+
+        q = arena_alloc(a, size);
+        if (!q)
+                return NULL;
+
+        memcpy_safe(q, p, size);
+        return q;
+}
+
+char* arena_strndup(Arena *a, const char *s, size_t n) {
+        char *q;
+
+        assert(s || n == 0);
+
+        n = strnlen(s ?: "", n);
+
+        q = arena_alloc(a, n + 1);
+        if (!q)
+                return NULL;
+
+        *((char*) mempcpy(q, s ?: "", n)) = 0;
+        return q;
+}
+
+void* arena_greedy_realloc(Arena *a, void **p, size_t *allocated, size_t need, size_t size) {
+        size_t n;
+        void *q;
+
+        assert(a);
+        assert(p);
+        assert(allocated);
+
+        if (*allocated >= need)
+                return *p;
+
+        if (_unlikely_(need > SIZE_MAX/2)) /* Overflow check */
+                return NULL;
+
+        n = MAX(need * 2, 64 / size);
+        if (size_multiply_overflow(size, n))
+                return NULL;
+
+        q = arena_realloc(a, *p, *allocated * size, n * size);
+        if (!q)
+                return NULL;
+
+        *p = q;
+        *allocated = n;
+        return q;
+}
+
+size_t arena_size(const Arena *a) {
+        size_t n = 0;
+
+        assert(a);
+
+        for (struct arena_chunk *c = a->chunks; c; c = c->next)
+                n += c->size;
+
+        return n;
+}
+
+void arena_done(Arena *a) {
+        struct arena_chunk *c;
+
+        assert(a);
+
+        while ((c = a->chunks)) {
+                a->chunks = c->next;
+                free(c);
+        }
+
+        a->last = NULL;
+}
@@ -0,0 +1,36 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+#include <stddef.h>
+#include <string.h>
+
+#include "macro.h"
+
+/* A bump allocator for many small allocations that are all freed together, e.g. the temporary strings and
+ * arrays built while parsing a file or a document. Memory is handed out from chunks that grow as more is
+ * allocated. Individual allocations cannot be freed, but the most recent one can be grown in place, which
+ * makes GREEDY_REALLOC()-style buffers cheap. Allocations are aligned like ALIGN(). */
+
+struct arena_chunk;
+
+typedef struct Arena {
+        struct arena_chunk *chunks; /* The chunk allocations are made from, followed by the older ones */
+        void *last;                 /* The most recent allocation from that chunk, if any */
+} Arena;
+
+void* arena_alloc(Arena *a, size_t size);
+void* arena_alloc0(Arena *a, size_t size);
+void* arena_realloc(Arena *a, void *p, size_t old_size, size_t new_size);
+void* arena_memdup(Arena *a, const void *p, size_t size);
+char* arena_strndup(Arena *a, const char *s, size_t n);
+static inline char* arena_strdup(Arena *a, const char *s) {
+        return arena_strndup(a, s, strlen(s));
+}
+
+void* arena_greedy_realloc(Arena *a, void **p, size_t *allocated, size_t need, size_t size);
+#define ARENA_GREEDY_REALLOC(a, array, allocated, need)                 \
+        arena_greedy_realloc(a, (void**) &(array), &(allocated), (need), sizeof((array)[0]))
+
+size_t arena_size(const Arena *a);
+
+void arena_done(Arena *a);
@@ -1,6 +1,7 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
 #include <errno.h>
+#include <fcntl.h>
 #include <ftw.h>
 #include <limits.h>
 #include <signal.h>
@@ -1781,6 +1782,85 @@ done:
         return 0;
 }
 
+int cg_parse_keyed_attribute_buffer(char *buf, char **keys, const char **ret_values) {
+        size_t n, i, n_done = 0;
+        char *p, *e;
+
+        assert(buf);
+        assert(ret_values);
+
+        /* Parses the NUL terminated contents of a keyed attribute file in place, see
+         * cg_get_keyed_attribute_buffer() below. */
+
+        n = strv_length(keys);
+        for (i = 0; i < n; i++)
+                ret_values[i] = NULL;
+
+        for (p = buf; *p && n_done < n; p = e) {
+                const char *w = NULL;
+
+                e = p + strcspn(p, NEWLINE);
+                if (*e)
+                        *(e++) = 0;
+
+                for (i = 0; i < n; i++)
+                        if (!ret_values[i]) {
+                                w = first_word(p, keys[i]);
+                                if (w)
+                                        break;
+                        }
+
+                if (w) {
+                        ret_values[i] = w;
+                        n_done++;
+                }
+        }
+
+        return (int) n_done;
+}
+
+int cg_get_keyed_attribute_buffer(
+                const char *controller,
+                const char *path,
+                const char *attribute,
+                char **keys,
+                char *buf,
+                size_t size,
+                const char **ret_values) {
+
+        _cleanup_free_ char *filename = NULL;
+        _cleanup_close_ int fd = -1;
+        ssize_t l;
+        int r;
+
+        assert(buf);
+        assert(size > 1);
+        assert(ret_values);
+
+        /* Like cg_get_keyed_attribute_full() in graceful mode, but reads the attribute file with a single
+         * pread() into the specified buffer, and parses it in place without any further allocations. On
+         * success the entries of 'ret_values' point into the buffer, or are NULL for keys that were not
+         * found, and the number of keys found is returned. Returns -E2BIG if the file doesn't fit into the
+         * buffer. This is meant for small, frequently read files such as cgroup.events or memory.events. */
+
+        r = cg_get_path(controller, path, attribute, &filename);
+        if (r < 0)
+                return r;
+
+        fd = open(filename, O_RDONLY|O_CLOEXEC|O_NOCTTY);
+        if (fd < 0)
+                return -errno;
+
+        l = pread(fd, buf, size - 1, 0);
+        if (l < 0)
+                return -errno;
+        if ((size_t) l >= size - 1)
+                return -E2BIG;
+        buf[l] = 0;
+
+        return cg_parse_keyed_attribute_buffer(buf, keys, ret_values);
+}
+
 int cg_mask_to_string(CGroupMask mask, char **ret) {
         _cleanup_free_ char *s = NULL;
         size_t n = 0, allocated = 0;
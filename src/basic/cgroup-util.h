@@ -206,6 +206,9 @@ static inline int cg_get_keyed_attribute_graceful(
         return cg_get_keyed_attribute_full(controller, path, attribute, keys, ret_values, CG_KEY_MODE_GRACEFUL);
 }
 
+int cg_parse_keyed_attribute_buffer(char *buf, char **keys, const char **ret_values);
+int cg_get_keyed_attribute_buffer(const char *controller, const char *path, const char *attribute, char **keys, char *buf, size_t size, const char **ret_values);
+
 int cg_get_attribute_as_uint64(const char *controller, const char *path, const char *attribute, uint64_t *ret);
 
 int cg_set_access(const char *controller, const char *path, uid_t uid, gid_t gid);
@@ -1,10 +1,12 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
 #include <errno.h>
+#include <fcntl.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "alloc-util.h"
 #include "conf-files.h"
 #include "def.h"
 #include "dirent-util.h"
@@ -19,6 +21,143 @@
 #include "string-util.h"
 #include "strv.h"
 #include "terminal-util.h"
+#include "time-util.h"
+
+/* Long-running programs may list the same directories over and over again, e.g. PID1 for the drop-ins of each unit
+ * and on each reload. Optionally, we hence keep the listings of directories around, and revalidate them with a
+ * single stat() of the directory, comparing its modification time. Only the list of names is cached: the
+ * properties of the files themselves are checked each time, as they may change without the directory's timestamp
+ * changing. */
+
+#define DIR_CACHE_MAX 4096U
+
+/* Don't cache listings of directories modified this recently: timestamps have a limited granularity (up to 2s on
+ * some file systems), hence a modification right after we read the directory might go unnoticed otherwise. */
+#define DIR_CACHE_MIN_AGE_USEC (2 * USEC_PER_SEC)
+
+typedef struct ConfFilesDir {
+        char *path;
+        dev_t dev;
+        ino_t ino;
+        struct timespec mtime;
+        char **names;
+} ConfFilesDir;
+
+static ConfFilesDir* conf_files_dir_free(ConfFilesDir *d) {
+        if (!d)
+                return NULL;
+
+        free(d->path);
+        strv_free(d->names);
+        return mfree(d);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(ConfFilesDir*, conf_files_dir_free);
+
+DEFINE_PRIVATE_HASH_OPS_WITH_VALUE_DESTRUCTOR(dir_cache_hash_ops, char, path_hash_func, path_compare,
+                                              ConfFilesDir, conf_files_dir_free);
+
+static thread_local Hashmap *dir_cache = NULL;
+static thread_local bool dir_cache_enabled = false;
+
+void conf_files_cache_set_enabled(bool b) {
+        dir_cache_enabled = b;
+
+        if (!b)
+                dir_cache = hashmap_free(dir_cache);
+}
+
+void conf_files_cache_flush(void) {
+        dir_cache = hashmap_free(dir_cache);
+}
+
+static void dir_cache_put(const char *dirpath, const struct stat *st, char **names) {
+        _cleanup_(conf_files_dir_freep) ConfFilesDir *d = NULL;
+
+        assert(dirpath);
+        assert(st);
+
+        conf_files_dir_free(hashmap_remove(dir_cache, dirpath));
+
+        if (usec_add(timespec_load(&st->st_mtim), DIR_CACHE_MIN_AGE_USEC) > now(CLOCK_REALTIME))
+                return;
+
+        if (hashmap_size(dir_cache) >= DIR_CACHE_MAX)
+                return;
+
+        d = new(ConfFilesDir, 1);
+        if (!d)
+                return;
+
+        *d = (ConfFilesDir) {
+                .path = strdup(dirpath),
+                .dev = st->st_dev,
+                .ino = st->st_ino,
+                .mtime = st->st_mtim,
+                .names = strv_copy(names),
+        };
+        if (!d->path || !d->names)
+                return;
+
+        if (hashmap_ensure_allocated(&dir_cache, &dir_cache_hash_ops) < 0)
+                return;
+
+        if (hashmap_put(dir_cache, d->path, d) < 0)
+                return;
+
+        TAKE_PTR(d);
+}
+
+static int dir_list_names(const char *dirpath, char ***ret) {
+        _cleanup_closedir_ DIR *dir = NULL;
+        _cleanup_strv_free_ char **names = NULL;
+        struct dirent *de;
+        struct stat st;
+
+        assert(dirpath);
+        assert(ret);
+
+        if (dir_cache_enabled) {
+                ConfFilesDir *d;
+
+                /* Note that we stat before reading the directory, so that any modification that races with us
+                 * will result in a different timestamp the next time. */
+                if (stat(dirpath, &st) < 0)
+                        return -errno;
+
+                d = hashmap_get(dir_cache, dirpath);
+                if (d &&
+                    d->dev == st.st_dev &&
+                    d->ino == st.st_ino &&
+                    timespec_load_nsec(&d->mtime) == timespec_load_nsec(&st.st_mtim)) {
+                        names = strv_copy(d->names);
+                        if (!names)
+                                return -ENOMEM;
+
+                        *ret = TAKE_PTR(names);
+                        return 0;
+                }
+        }
+
+        dir = opendir(dirpath);
+        if (!dir)
+                return -errno;
+
+        /* Make sure we return a non-NULL strv also for empty directories, so that we can cache it */
+        names = new0(char*, 1);
+        if (!names)
+                return -ENOMEM;
+
+        FOREACH_DIRENT(de, dir, return -errno)
+                if (strv_extend(&names, de->d_name) < 0)
+                        return -ENOMEM;
+
+        if (dir_cache_enabled)
+                dir_cache_put(dirpath, &st, names);
+
+        *ret = TAKE_PTR(names);
+        return 0;
+}
 
 static int files_add(
                 Hashmap *h,
@@ -28,9 +167,10 @@ static int files_add(
                 unsigned flags,
                 const char *path) {
 
-        _cleanup_closedir_ DIR *dir = NULL;
+        _cleanup_strv_free_ char **names = NULL;
+        _cleanup_close_ int dir_fd = -1;
         const char *dirpath;
-        struct dirent *de;
+        char **name;
         int r;
 
         assert(h);
@@ -39,50 +179,56 @@ static int files_add(
 
         dirpath = prefix_roota(root, path);
 
-        dir = opendir(dirpath);
-        if (!dir) {
-                if (errno == ENOENT)
-                        return 0;
-
-                return log_debug_errno(errno, "Failed to open directory '%s': %m", dirpath);
-        }
+        r = dir_list_names(dirpath, &names);
+        if (r == -ENOENT)
+                return 0;
+        if (r < 0)
+                return log_debug_errno(r, "Failed to read directory '%s': %m", dirpath);
 
-        FOREACH_DIRENT(de, dir, return -errno) {
+        STRV_FOREACH(name, names) {
+                const char *d_name = *name;
                 struct stat st;
                 char *p, *key;
 
                 /* Does this match the suffix? */
-                if (suffix && !endswith(de->d_name, suffix))
+                if (suffix && !endswith(d_name, suffix))
                         continue;
 
                 /* Has this file already been found in an earlier directory? */
-                if (hashmap_contains(h, de->d_name)) {
-                        log_debug("Skipping overridden file '%s/%s'.", dirpath, de->d_name);
+                if (hashmap_contains(h, d_name)) {
+                        log_debug("Skipping overridden file '%s/%s'.", dirpath, d_name);
                         continue;
                 }
 
                 /* Has this been masked in an earlier directory? */
-                if ((flags & CONF_FILES_FILTER_MASKED) && set_contains(masked, de->d_name)) {
-                        log_debug("File '%s/%s' is masked by previous entry.", dirpath, de->d_name);
+                if ((flags & CONF_FILES_FILTER_MASKED) && set_contains(masked, d_name)) {
+                        log_debug("File '%s/%s' is masked by previous entry.", dirpath, d_name);
                         continue;
                 }
 
                 /* Read file metadata if we shall validate the check for file masks, for node types or whether the node is marked executable. */
-                if (flags & (CONF_FILES_FILTER_MASKED|CONF_FILES_REGULAR|CONF_FILES_DIRECTORY|CONF_FILES_EXECUTABLE))
-                        if (fstatat(dirfd(dir), de->d_name, &st, 0) < 0) {
-                                log_debug_errno(errno, "Failed to stat '%s/%s', ignoring: %m", dirpath, de->d_name);
+                if (flags & (CONF_FILES_FILTER_MASKED|CONF_FILES_REGULAR|CONF_FILES_DIRECTORY|CONF_FILES_EXECUTABLE)) {
+                        if (dir_fd < 0) {
+                                dir_fd = open(dirpath, O_PATH|O_DIRECTORY|O_CLOEXEC);
+                                if (dir_fd < 0)
+                                        return log_debug_errno(errno, "Failed to open directory '%s': %m", dirpath);
+                        }
+
+                        if (fstatat(dir_fd, d_name, &st, 0) < 0) {
+                                log_debug_errno(errno, "Failed to stat '%s/%s', ignoring: %m", dirpath, d_name);
                                 continue;
                         }
+                }
 
                 /* Is this a masking entry? */
                 if ((flags & CONF_FILES_FILTER_MASKED))
                         if (null_or_empty(&st)) {
                                 /* Mark this one as masked */
-                                r = set_put_strdup(masked, de->d_name);
+                                r = set_put_strdup(masked, d_name);
                                 if (r < 0)
                                         return r;
 
-                                log_debug("File '%s/%s' is a mask.", dirpath, de->d_name);
+                                log_debug("File '%s/%s' is a mask.", dirpath, d_name);
                                 continue;
                         }
 
@@ -90,7 +236,7 @@ static int files_add(
                 if (flags & (CONF_FILES_REGULAR|CONF_FILES_DIRECTORY))
                         if (!((flags & CONF_FILES_DIRECTORY) && S_ISDIR(st.st_mode)) &&
                             !((flags & CONF_FILES_REGULAR) && S_ISREG(st.st_mode))) {
-                                log_debug("Ignoring '%s/%s', as it is not a of the right type.", dirpath, de->d_name);
+                                log_debug("Ignoring '%s/%s', as it is not a of the right type.", dirpath, d_name);
                                 continue;
                         }
 
@@ -101,18 +247,18 @@ static int files_add(
                          * executable for us, because if so, such errors are stuff we should log about. */
 
                         if ((st.st_mode & 0111) == 0) { /* not executable */
-                                log_debug("Ignoring '%s/%s', as it is not marked executable.", dirpath, de->d_name);
+                                log_debug("Ignoring '%s/%s', as it is not marked executable.", dirpath, d_name);
                                 continue;
                         }
 
                 if (flags & CONF_FILES_BASENAME) {
-                        p = strdup(de->d_name);
+                        p = strdup(d_name);
                         if (!p)
                                 return -ENOMEM;
 
                         key = p;
                 } else {
-                        p = path_join(dirpath, de->d_name);
+                        p = path_join(dirpath, d_name);
                         if (!p)
                                 return -ENOMEM;
 
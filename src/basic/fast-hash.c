@@ -0,0 +1,105 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include "fast-hash.h"
+#include "unaligned.h"
+
+/*
+ * The construction follows wyhash (https://github.com/wangyi-fudan/wyhash, released into the public domain):
+ * the input is consumed 16 bytes at a time, each half xor-ed with a constant and folded through a 64x64→128
+ * bit multiplication whose halves are xor-ed together. Short inputs are read with overlapping loads, so
+ * there are no byte loops. Output differs between little and big endian machines, which is fine for hash
+ * tables.
+ */
+
+static const uint64_t secret[4] = {
+        UINT64_C(0xa0761d6478bd642f),
+        UINT64_C(0xe7037ed1a0b428db),
+        UINT64_C(0x8ebc6af09c88c6e3),
+        UINT64_C(0x589965cc75374cc3),
+};
+
+static inline void mum(uint64_t *a, uint64_t *b) {
+#ifdef __SIZEOF_INT128__
+        __uint128_t r = (__uint128_t) *a * *b;
+
+        *a = (uint64_t) r;
+        *b = (uint64_t) (r >> 64);
+#else
+        uint64_t ha = *a >> 32, hb = *b >> 32, la = (uint32_t) *a, lb = (uint32_t) *b;
+        uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb, t, lo, c;
+
+        t = rl + (rm0 << 32);
+        c = t < rl;
+        lo = t + (rm1 << 32);
+        c += lo < t;
+
+        *a = lo;
+        *b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+}
+
+static inline uint64_t mix(uint64_t a, uint64_t b) {
+        mum(&a, &b);
+        return a ^ b;
+}
+
+static inline uint64_t read64(const uint8_t *p) {
+        return unaligned_read_le64(p);
+}
+
+static inline uint64_t read32(const uint8_t *p) {
+        return unaligned_read_le32(p);
+}
+
+static inline uint64_t read_upto3(const uint8_t *p, size_t k) {
+        return ((uint64_t) p[0] << 16) | ((uint64_t) p[k >> 1] << 8) | p[k - 1];
+}
+
+uint64_t fast_hash(const void *in, size_t inlen, uint64_t seed) {
+        const uint8_t *p = in;
+        uint64_t a, b;
+        size_t i = inlen;
+
+        seed ^= mix(seed ^ secret[0], secret[1]);
+
+        if (inlen <= 16) {
+                if (inlen >= 4) {
+                        a = (read32(p) << 32) | read32(p + ((inlen >> 3) << 2));
+                        b = (read32(p + inlen - 4) << 32) | read32(p + inlen - 4 - ((inlen >> 3) << 2));
+                } else if (inlen > 0) {
+                        a = read_upto3(p, inlen);
+                        b = 0;
+                } else
+                        a = b = 0;
+        } else {
+                if (i > 48) {
+                        uint64_t see1 = seed, see2 = seed;
+
+                        do {
+                                seed = mix(read64(p) ^ secret[1], read64(p + 8) ^ seed);
+                                see1 = mix(read64(p + 16) ^ secret[2], read64(p + 24) ^ see1);
+                                see2 = mix(read64(p + 32) ^ secret[3], read64(p + 40) ^ see2);
+                                p += 48;
+                                i -= 48;
+                        } while (i > 48);
+
+                        seed ^= see1 ^ see2;
+                }
+
+                while (i > 16) {
+                        seed = mix(read64(p) ^ secret[1], read64(p + 8) ^ seed);
+                        p += 16;
+                        i -= 16;
+                }
+
+                /* The last 16 bytes, possibly overlapping with what was consumed already */
+                a = read64(p + i - 16);
+                b = read64(p + i - 8);
+        }
+
+        a ^= secret[1];
+        b ^= seed;
+        mum(&a, &b);
+
+        return mix(a ^ secret[0] ^ inlen, b ^ secret[1]);
+}
@@ -0,0 +1,14 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/* A fast, seeded, non-cryptographic hash function in the style of wyhash. Unlike siphash24, it is not
+ * designed to withstand hash flooding: only use it for data that cannot be chosen by an attacker. */
+uint64_t fast_hash(const void *in, size_t inlen, uint64_t seed);
+
+static inline uint64_t fast_hash_string(const char *s, uint64_t seed) {
+        return fast_hash(s, strlen(s), seed);
+}
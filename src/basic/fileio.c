@@ -19,6 +19,7 @@
 #include "hexdecoct.h"
 #include "log.h"
 #include "macro.h"
+#include "memory-util.h"
 #include "mkdir.h"
 #include "parse-util.h"
 #include "path-util.h"
@@ -1006,6 +1007,25 @@ static EndOfLineMarker categorize_eol(char c, ReadLineFlags flags) {
 
 DEFINE_TRIVIAL_CLEANUP_FUNC(FILE*, funlockfile);
 
+static int safe_fgetc_unlocked(FILE *f, char *ret) {
+        int k;
+
+        /* Like safe_fgetc(), for streams we hold the lock of already */
+
+        errno = 0;
+        k = getc_unlocked(f);
+        if (k == EOF) {
+                if (ferror(f))
+                        return errno_or_else(EIO);
+
+                *ret = 0;
+                return 0;
+        }
+
+        *ret = k;
+        return 1;
+}
+
 int read_line_full(FILE *f, size_t limit, ReadLineFlags flags, char **ret) {
         size_t n = 0, allocated = 0, count = 0;
         _cleanup_free_ char *buffer = NULL;
@@ -1057,7 +1077,7 @@ int read_line_full(FILE *f, size_t limit, ReadLineFlags flags, char **ret) {
                         if (count >= INT_MAX) /* We couldn't return the counter anymore as "int", hence refuse this */
                                 return -ENOBUFS;
 
-                        r = safe_fgetc(f, &c);
+                        r = safe_fgetc_unlocked(f, &c);
                         if (r < 0)
                                 return r;
                         if (r == 0) /* EOF is definitely EOL */
@@ -1129,6 +1149,129 @@ int read_line_full(FILE *f, size_t limit, ReadLineFlags flags, char **ret) {
         return (int) count;
 }
 
+static int line_reader_fill(LineReader *lr) {
+        size_t k;
+
+        assert(lr);
+
+        if (lr->offset < lr->length)
+                return 1;
+
+        if (!lr->buffer) {
+                lr->buffer = malloc(LINE_READER_BUFFER_SIZE);
+                if (!lr->buffer)
+                        return -ENOMEM;
+        }
+
+        errno = 0;
+        k = fread(lr->buffer, 1, LINE_READER_BUFFER_SIZE, lr->f);
+        lr->offset = 0;
+        lr->length = k;
+        if (k > 0)
+                return 1;
+
+        if (ferror(lr->f))
+                return errno_or_else(EIO);
+
+        return 0;
+}
+
+int line_reader_read(LineReader *lr, size_t limit, ReadLineFlags flags, char **ret) {
+        size_t n = 0, allocated = 0, count = 0;
+        _cleanup_free_ char *buffer = NULL;
+        EndOfLineMarker previous_eol = EOL_NONE;
+        int r;
+
+        assert(lr);
+        assert(lr->f);
+
+        /* Returns the same as read_line_full() would, but looks for the end of the line in whole blocks read
+         * ahead of time, and copies everything in front of it at once. Line endings split between two blocks
+         * are taken care of by looking at the delimiters one by one. */
+
+        if (ret) {
+                if (!GREEDY_REALLOC(buffer, allocated, 1))
+                        return -ENOMEM;
+        }
+
+        for (;;) {
+                const char *p, *e;
+                size_t k, m;
+
+                if (n >= limit)
+                        return -ENOBUFS;
+
+                if (count >= INT_MAX)
+                        return -ENOBUFS;
+
+                r = line_reader_fill(lr);
+                if (r < 0)
+                        return r;
+                if (r == 0) /* EOF is definitely EOL */
+                        break;
+
+                p = lr->buffer + lr->offset;
+                k = lr->length - lr->offset;
+
+                if (previous_eol != EOL_NONE) {
+                        EndOfLineMarker eol;
+
+                        /* The same rules as in read_line_full() apply for which delimiters belong together */
+                        eol = categorize_eol(*p, flags);
+                        if (FLAGS_SET(previous_eol, EOL_ZERO) ||
+                            eol == EOL_NONE ||
+                            (previous_eol & eol) != 0)
+                                break;
+
+                        previous_eol |= eol;
+                        lr->offset++;
+                        count++;
+                        continue;
+                }
+
+                if (FLAGS_SET(flags, READ_LINE_ONLY_NUL))
+                        e = memchr(p, 0, k);
+                else
+                        e = memchr3(p, k, '\n', '\r', 0);
+
+                /* Copy what's in front of the delimiter, but no more than fits into the limits, so that we stop
+                 * at the same place as read_line_full() if we hit them. */
+                m = MIN3(e ? (size_t) (e - p) : k, limit - n, (size_t) INT_MAX - count);
+
+                if (ret) {
+                        if (!GREEDY_REALLOC(buffer, allocated, n + m + 1))
+                                return -ENOMEM;
+
+                        memcpy(buffer + n, p, m);
+                }
+
+                n += m;
+                count += m;
+                lr->offset += m;
+
+                if (e == p + m) {
+                        previous_eol = categorize_eol(*e, flags);
+                        lr->offset++;
+                        count++;
+                }
+        }
+
+        if (ret) {
+                buffer[n] = 0;
+
+                *ret = TAKE_PTR(buffer);
+        }
+
+        return (int) count;
+}
+
+void line_reader_done(LineReader *lr) {
+        assert(lr);
+
+        lr->buffer = mfree(lr->buffer);
+        lr->offset = lr->length = 0;
+}
+
 int safe_fgetc(FILE *f, char *ret) {
         int k;
 
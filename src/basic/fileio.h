@@ -99,6 +99,19 @@ static inline int read_line(FILE *f, size_t limit, char **ret) {
         return read_line_full(f, limit, 0, ret);
 }
 
+/* For reading a whole stream line by line: reads ahead in large blocks instead of going through stdio for every
+ * single character, hence the stream is left at an unspecified position. Not suitable for TTYs. */
+#define LINE_READER_BUFFER_SIZE (16U*1024U)
+
+typedef struct LineReader {
+        FILE *f;
+        char *buffer;
+        size_t offset, length;
+} LineReader;
+
+int line_reader_read(LineReader *lr, size_t limit, ReadLineFlags flags, char **ret);
+void line_reader_done(LineReader *lr);
+
 static inline int read_nul_string(FILE *f, size_t limit, char **ret) {
         return read_line_full(f, limit, READ_LINE_ONLY_NUL, ret);
 }
@@ -2,6 +2,7 @@
 
 #include <string.h>
 
+#include "fast-hash.h"
 #include "hash-funcs.h"
 #include "path-util.h"
 
@@ -14,6 +15,22 @@ DEFINE_HASH_OPS_FULL(string_hash_ops_free_free,
                      char, string_hash_func, string_compare_func, free,
                      char, free);
 
+const struct hash_ops string_hash_ops_cached = {
+        .hash = (hash_func_t) string_hash_func,
+        .compare = (compare_func_t) string_compare_func,
+        .cache_hash = true,
+};
+
+uint64_t string_fast_hash_func(const char *p, uint64_t seed) {
+        return fast_hash_string(p, seed);
+}
+
+const struct hash_ops string_hash_ops_trusted = {
+        .hash = (hash_func_t) string_hash_func,
+        .compare = (compare_func_t) string_compare_func,
+        .fast_hash = (fast_hash_func_t) string_fast_hash_func,
+};
+
 void path_hash_func(const char *q, struct siphash *state) {
         size_t n;
 
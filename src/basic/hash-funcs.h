@@ -6,6 +6,7 @@
 #include "siphash24.h"
 
 typedef void (*hash_func_t)(const void *p, struct siphash *state);
+typedef uint64_t (*fast_hash_func_t)(const void *p, uint64_t seed);
 typedef int (*compare_func_t)(const void *a, const void *b);
 
 struct hash_ops {
@@ -13,6 +14,8 @@ struct hash_ops {
         compare_func_t compare;
         free_func_t free_key;
         free_func_t free_value;
+        bool cache_hash; /* store the hash value with each entry, worth it for long keys */
+        fast_hash_func_t fast_hash; /* if set, used by hashmaps instead of siphash24 and hash */
 };
 
 #define _DEFINE_HASH_OPS(uq, name, type, hash_func, compare_func, free_key_func, free_value_func, scope) \
@@ -77,6 +80,15 @@ void string_hash_func(const char *p, struct siphash *state);
 #define string_compare_func strcmp
 extern const struct hash_ops string_hash_ops;
 extern const struct hash_ops string_hash_ops_free_free;
+/* Like string_hash_ops, but resizing does not rehash the keys, and lookups only compare keys whose hash
+ * value matches. For large hashmaps with long keys. */
+extern const struct hash_ops string_hash_ops_cached;
+
+/* Like string_hash_ops, but uses fast_hash() rather than siphash24. That's considerably faster, but gives up
+ * on the protection against hash flooding. Only for hashmaps whose keys cannot be chosen by an attacker, like
+ * those filled from static tables or configuration. */
+uint64_t string_fast_hash_func(const char *p, uint64_t seed);
+extern const struct hash_ops string_hash_ops_trusted;
 
 void path_hash_func(const char *p, struct siphash *state);
 extern const struct hash_ops path_hash_ops;
@@ -17,6 +17,7 @@
 #include "siphash24.h"
 #include "string-util.h"
 #include "strv.h"
+#include "unaligned.h"
 
 #if ENABLE_DEBUG_HASHMAP
 #include <pthread.h>
@@ -115,6 +116,7 @@ assert_cc(IDX_FIRST == _IDX_ITERATOR_FIRST);
  * All entry types can fit into a ordered_hashmap_entry. */
 struct swap_entries {
         struct ordered_hashmap_entry e[_IDX_SWAP_END - _IDX_SWAP_BEGIN];
+        unsigned hashes[_IDX_SWAP_END - _IDX_SWAP_BEGIN]; /* only used if hashes are cached */
 };
 
 /* Distance from Initial Bucket */
@@ -160,8 +162,8 @@ enum HashmapType {
 };
 
 struct _packed_ indirect_storage {
-        void *storage;                     /* where buckets and DIBs are stored */
-        uint8_t  hash_key[HASH_KEY_SIZE];  /* hash key; changes during resize */
+        void *storage;                     /* where buckets, cached hashes and DIBs are stored */
+        uint8_t  hash_key[HASH_KEY_SIZE];  /* hash key; changes during resize, unless hashes are cached */
 
         unsigned n_entries;                /* number of stored entries */
         unsigned n_buckets;                /* number of buckets */
@@ -282,8 +284,8 @@ _destructor_ static void cleanup_pools(void) {
 
         /* Be nice to valgrind */
 
-        /* The pool is only allocated by the main thread, but the memory can
-         * be passed to other threads. Let's clean up if we are the main thread
+        /* The pools may be allocated by any thread, and the memory can be
+         * passed between threads. Let's clean up if we are the main thread
          * and no other threads are live. */
         /* We build our own is_main_thread() here, which doesn't use C11
          * TLS based caching of the result. That's because valgrind apparently
@@ -335,20 +337,33 @@ static uint8_t *hash_key(HashmapBase *h) {
                                : shared_hash_key;
 }
 
+/* Returns the (truncated) hash value of a key. The initial bucket is the hash value modulo the number of
+ * buckets. */
 static unsigned base_bucket_hash(HashmapBase *h, const void *p) {
         struct siphash state;
-        uint64_t hash;
+
+        if (h->hash_ops->fast_hash)
+                return (unsigned) h->hash_ops->fast_hash(p, unaligned_read_ne64(hash_key(h)));
 
         siphash24_init(&state, hash_key(h));
 
         h->hash_ops->hash(p, &state);
 
-        hash = siphash24_finalize(&state);
-
-        return (unsigned) (hash % n_buckets(h));
+        return (unsigned) siphash24_finalize(&state);
 }
 #define bucket_hash(h, p) base_bucket_hash(HASHMAP_BASE(h), p)
 
+/*
+ * Hashmaps whose hash_ops ask for it store the hash value of each entry next to the DIB, so that resizing
+ * does not need to hash all keys again, and entries whose hash differs from the one looked up are never
+ * compared. This is worth it for long keys like unit names and paths. The hash key of such a hashmap does
+ * not change on resize, since that would invalidate the cached values. Hashmaps with direct storage never
+ * cache hashes.
+ */
+static bool base_caches_hash(HashmapBase *h) {
+        return h->has_indirect && h->hash_ops->cache_hash;
+}
+
 static void base_set_dirty(HashmapBase *h) {
         h->dirty = true;
 }
@@ -407,11 +422,30 @@ static struct hashmap_base_entry *bucket_at_virtual(HashmapBase *h, struct swap_
         assert_not_reached("Invalid index");
 }
 
-static dib_raw_t *dib_raw_ptr(HashmapBase *h) {
-        return (dib_raw_t*)
+static unsigned *hash_cache_ptr(HashmapBase *h) {
+        assert(base_caches_hash(h));
+
+        /* Entries are at least pointer aligned, hence the cached hashes that follow them are aligned too. */
+        return (unsigned*)
                 ((uint8_t*) storage_ptr(h) + hashmap_type_info[h->type].entry_size * n_buckets(h));
 }
 
+static unsigned *bucket_hash_at_virtual(HashmapBase *h, struct swap_entries *swap, unsigned idx) {
+        if (idx < _IDX_SWAP_BEGIN)
+                return hash_cache_ptr(h) + idx;
+
+        if (idx < _IDX_SWAP_END)
+                return &swap->hashes[idx - _IDX_SWAP_BEGIN];
+
+        assert_not_reached("Invalid index");
+}
+
+static dib_raw_t *dib_raw_ptr(HashmapBase *h) {
+        size_t bucket_size = hashmap_type_info[h->type].entry_size + (base_caches_hash(h) ? sizeof(unsigned) : 0);
+
+        return (dib_raw_t*) ((uint8_t*) storage_ptr(h) + bucket_size * n_buckets(h));
+}
+
 static unsigned bucket_distance(HashmapBase *h, unsigned idx, unsigned from) {
         return idx >= from ? idx - from
                            : n_buckets(h) + idx - from;
@@ -436,7 +470,8 @@ static unsigned bucket_calculate_dib(HashmapBase *h, unsigned idx, dib_raw_t raw
          * This returns the correct DIB value by recomputing the hash value in
          * the unlikely case. XXX Hitting this case could be a hint to rehash.
          */
-        initial_bucket = bucket_hash(h, bucket_at(h, idx)->key);
+        initial_bucket = (base_caches_hash(h) ? hash_cache_ptr(h)[idx]
+                                              : bucket_hash(h, bucket_at(h, idx)->key)) % n_buckets(h);
         return bucket_distance(h, idx, initial_bucket);
 }
 
@@ -472,6 +507,9 @@ static void bucket_move_entry(HashmapBase *h, struct swap_entries *swap,
 
         memcpy(e_to, e_from, hashmap_type_info[h->type].entry_size);
 
+        if (base_caches_hash(h))
+                *bucket_hash_at_virtual(h, swap, to) = *bucket_hash_at_virtual(h, swap, from);
+
         if (h->type == HASHMAP_TYPE_ORDERED) {
                 OrderedHashmap *lh = (OrderedHashmap*) h;
                 struct ordered_hashmap_entry *le, *le_to;
@@ -860,11 +898,9 @@ static void hashmap_free_no_clear(HashmapBase *h) {
         assert_se(pthread_mutex_unlock(&hashmap_debug_list_mutex) == 0);
 #endif
 
-        if (h->from_pool) {
-                /* Ensure that the object didn't get migrated between threads. */
-                assert_se(is_main_thread());
+        if (h->from_pool)
                 mempool_free_tile(hashmap_type_info[h->type].mempool, h);
-        } else
+        else
                 free(h);
 }
 
@@ -983,31 +1019,34 @@ static bool hashmap_put_robin_hood(HashmapBase *h, unsigned idx,
 /*
  * Puts an entry into a hashmap, boldly - no check whether key already exists.
  * The caller must place the entry (only its key and value, not link indexes)
- * in swap slot IDX_PUT.
+ * in swap slot IDX_PUT, and pass the hash value of its key.
  * Caller must ensure: the key does not exist yet in the hashmap.
  *                     that resize is not needed if !may_resize.
  * Returns: 1 if entry was put successfully.
  *          -ENOMEM if may_resize==true and resize failed with -ENOMEM.
  *          Cannot return -ENOMEM if !may_resize.
  */
-static int hashmap_base_put_boldly(HashmapBase *h, unsigned idx,
+static int hashmap_base_put_boldly(HashmapBase *h, unsigned hash,
                                    struct swap_entries *swap, bool may_resize) {
         struct ordered_hashmap_entry *new_entry;
         int r;
 
-        assert(idx < n_buckets(h));
-
         new_entry = bucket_at_swap(swap, IDX_PUT);
 
         if (may_resize) {
+                bool keeps_hash_key = base_caches_hash(h);
+
                 r = resize_buckets(h, 1);
                 if (r < 0)
                         return r;
-                if (r > 0)
-                        idx = bucket_hash(h, new_entry->p.b.key);
+                if (r > 0 && !keeps_hash_key)
+                        hash = bucket_hash(h, new_entry->p.b.key);
         }
         assert(n_entries(h) < n_buckets(h));
 
+        if (base_caches_hash(h))
+                *bucket_hash_at_virtual(h, swap, IDX_PUT) = hash;
+
         if (h->type == HASHMAP_TYPE_ORDERED) {
                 OrderedHashmap *lh = (OrderedHashmap*) h;
 
@@ -1027,7 +1066,7 @@ static int hashmap_base_put_boldly(HashmapBase *h, unsigned idx,
                         lh->iterate_list_head = IDX_PUT;
         }
 
-        assert_se(hashmap_put_robin_hood(h, idx, swap) == false);
+        assert_se(hashmap_put_robin_hood(h, hash % n_buckets(h), swap) == false);
 
         n_entries_inc(h);
 #if ENABLE_DEBUG_HASHMAP
@@ -1038,8 +1077,26 @@ static int hashmap_base_put_boldly(HashmapBase *h, unsigned idx,
 
         return 1;
 }
-#define hashmap_put_boldly(h, idx, swap, may_resize) \
-        hashmap_base_put_boldly(HASHMAP_BASE(h), idx, swap, may_resize)
+#define hashmap_put_boldly(h, hash, swap, may_resize) \
+        hashmap_base_put_boldly(HASHMAP_BASE(h), hash, swap, may_resize)
+
+/* Returns the initial bucket of the entry at idx under the current hash key, caching its hash value if
+ * requested. If reuse is true, the cached hash value is still valid. */
+static unsigned bucket_rehash(HashmapBase *h, struct swap_entries *swap, unsigned idx, bool reuse) {
+        unsigned hash, *cached;
+
+        cached = base_caches_hash(h) ? bucket_hash_at_virtual(h, swap, idx) : NULL;
+
+        if (reuse)
+                hash = *cached;
+        else {
+                hash = bucket_hash(h, bucket_at_virtual(h, swap, idx)->key);
+                if (cached)
+                        *cached = hash;
+        }
+
+        return hash % n_buckets(h);
+}
 
 /*
  * Returns 0 if resize is not needed.
@@ -1053,14 +1110,21 @@ static int resize_buckets(HashmapBase *h, unsigned entries_add) {
         const struct hashmap_type_info *hi;
         unsigned idx, optimal_idx;
         unsigned old_n_buckets, new_n_buckets, n_rehashed, new_n_entries;
+        size_t bucket_size;
         uint8_t new_shift;
-        bool rehash_next;
+        bool rehash_next, reuse_hashes;
 
         assert(h);
 
         hi = &hashmap_type_info[h->type];
         new_n_entries = n_entries(h) + entries_add;
 
+        /* The size of a bucket in the indirect storage we are going to have */
+        bucket_size = hi->entry_size + sizeof(dib_raw_t) + (h->hash_ops->cache_hash ? sizeof(unsigned) : 0);
+
+        /* If the hashes are cached already, they stay valid since the hash key does not change */
+        reuse_hashes = base_caches_hash(h);
+
         /* overflow? */
         if (_unlikely_(new_n_entries < entries_add))
                 return -ENOMEM;
@@ -1078,7 +1142,7 @@ static int resize_buckets(HashmapBase *h, unsigned entries_add) {
         if (_unlikely_(new_n_buckets < new_n_entries))
                 return -ENOMEM;
 
-        if (_unlikely_(new_n_buckets > UINT_MAX / (hi->entry_size + sizeof(dib_raw_t))))
+        if (_unlikely_(new_n_buckets > UINT_MAX / bucket_size))
                 return -ENOMEM;
 
         old_n_buckets = n_buckets(h);
@@ -1087,7 +1151,7 @@ static int resize_buckets(HashmapBase *h, unsigned entries_add) {
                 return 0;
 
         new_shift = log2u_round_up(MAX(
-                        new_n_buckets * (hi->entry_size + sizeof(dib_raw_t)),
+                        new_n_buckets * bucket_size,
                         2 * sizeof(struct direct_storage)));
 
         /* Realloc storage (buckets and DIB array). */
@@ -1108,16 +1172,23 @@ static int resize_buckets(HashmapBase *h, unsigned entries_add) {
         /* Get a new hash key. If we've just upgraded to indirect storage,
          * allow reusing a previously generated key. It's still a different key
          * from the shared one that we used for direct storage. */
-        get_hash_key(h->indirect.hash_key, !h->has_indirect);
+        if (!reuse_hashes)
+                get_hash_key(h->indirect.hash_key, !h->has_indirect);
 
         h->has_indirect = true;
         h->indirect.storage = new_storage;
-        h->indirect.n_buckets = (1U << new_shift) /
-                                (hi->entry_size + sizeof(dib_raw_t));
+        h->indirect.n_buckets = (1U << new_shift) / bucket_size;
 
-        old_dibs = (dib_raw_t*)((uint8_t*) new_storage + hi->entry_size * old_n_buckets);
+        old_dibs = (dib_raw_t*)((uint8_t*) new_storage +
+                                (hi->entry_size + (reuse_hashes ? sizeof(unsigned) : 0)) * old_n_buckets);
         new_dibs = dib_raw_ptr(h);
 
+        /* Move the cached hashes to their new place. Overlap is not possible for the same reason as below. */
+        if (reuse_hashes)
+                memcpy(hash_cache_ptr(h),
+                       (uint8_t*) new_storage + hi->entry_size * old_n_buckets,
+                       old_n_buckets * sizeof(unsigned));
+
         /*
          * Move the DIB array to the new place, replacing valid DIB values with
          * DIB_RAW_REHASH to indicate all of the used buckets need rehashing.
@@ -1144,7 +1215,7 @@ static int resize_buckets(HashmapBase *h, unsigned entries_add) {
                 if (new_dibs[idx] != DIB_RAW_REHASH)
                         continue;
 
-                optimal_idx = bucket_hash(h, bucket_at(h, idx)->key);
+                optimal_idx = bucket_rehash(h, &swap, idx, reuse_hashes);
 
                 /*
                  * Not much to do if by luck the entry hashes to its current
@@ -1171,7 +1242,7 @@ static int resize_buckets(HashmapBase *h, unsigned entries_add) {
 
                         /* Did the current entry displace another one? */
                         if (rehash_next)
-                                optimal_idx = bucket_hash(h, bucket_at_swap(&swap, IDX_PUT)->p.b.key);
+                                optimal_idx = bucket_rehash(h, &swap, IDX_PUT, reuse_hashes);
                 } while (rehash_next);
         }
 
@@ -1184,31 +1255,40 @@ static int resize_buckets(HashmapBase *h, unsigned entries_add) {
  * Finds an entry with a matching key
  * Returns: index of the found entry, or IDX_NIL if not found.
  */
-static unsigned base_bucket_scan(HashmapBase *h, unsigned idx, const void *key) {
-        struct hashmap_base_entry *e;
-        unsigned dib, distance;
+static unsigned base_bucket_scan(HashmapBase *h, unsigned hash, const void *key) {
+        compare_func_t compare = h->hash_ops->compare;
+        const unsigned *hashes = base_caches_hash(h) ? hash_cache_ptr(h) : NULL;
         dib_raw_t *dibs = dib_raw_ptr(h);
+        unsigned distance, n = n_buckets(h), idx = hash % n;
 
-        assert(idx < n_buckets(h));
-
+        /*
+         * This is the hottest loop of every lookup, so the bucket count, the DIB store and the compare
+         * function are looked up only once, and the DIB is only ever recalculated for the rare overflow
+         * values. Since the DIBs along the run grow by at most one per bucket, only entries whose DIB
+         * equals the distance may have the same initial bucket as the key; only those are compared, and
+         * if hashes are cached, only if their hash value is the same too.
+         */
         for (distance = 0; ; distance++) {
-                if (dibs[idx] == DIB_RAW_FREE)
+                dib_raw_t raw_dib = dibs[idx];
+                unsigned dib;
+
+                if (raw_dib == DIB_RAW_FREE)
                         return IDX_NIL;
 
-                dib = bucket_calculate_dib(h, idx, dibs[idx]);
+                dib = _likely_(raw_dib < DIB_RAW_OVERFLOW) ? raw_dib : bucket_calculate_dib(h, idx, raw_dib);
 
                 if (dib < distance)
                         return IDX_NIL;
-                if (dib == distance) {
-                        e = bucket_at(h, idx);
-                        if (h->hash_ops->compare(e->key, key) == 0)
-                                return idx;
-                }
+                if (dib == distance &&
+                    (!hashes || hashes[idx] == hash) &&
+                    compare(bucket_at(h, idx)->key, key) == 0)
+                        return idx;
 
-                idx = next_idx(h, idx);
+                if (++idx == n)
+                        idx = 0;
         }
 }
-#define bucket_scan(h, idx, key) base_bucket_scan(HASHMAP_BASE(h), idx, key)
+#define bucket_scan(h, hash, key) base_bucket_scan(HASHMAP_BASE(h), hash, key)
 
 int hashmap_put(Hashmap *h, const void *key, void *value) {
         struct swap_entries swap;
@@ -1601,6 +1681,90 @@ int internal_hashmap_reserve(HashmapBase *h, unsigned entries_add) {
         return 0;
 }
 
+/*
+ * Puts n keys, and unless h is a set the n values alongside, resizing only once
+ * up front. Keys already present with the same value are skipped, as with
+ * hashmap_put() and set_put(). If h is empty and the keys are in strictly
+ * ascending order according to the compare function of h, none of them can be
+ * present yet, and they are put without looking them up first.
+ * Returns: the number of entries put on success.
+ *          -ENOMEM on alloc failure, in which case nothing has been put.
+ *          -EEXIST if a key is present with a different value, in which case
+ *                  the entries before it have been put.
+ */
+int internal_hashmap_put_many(HashmapBase *h, void * const *keys, void * const *values, unsigned n) {
+        bool sorted;
+        unsigned i;
+        int r, k = 0;
+
+        assert(h);
+        assert(keys || n == 0);
+        assert(values || n == 0 || h->type == HASHMAP_TYPE_SET);
+
+        r = resize_buckets(h, n);
+        if (r < 0)
+                return r;
+
+        sorted = n_entries(h) == 0;
+        for (i = 1; sorted && i < n; i++)
+                sorted = h->hash_ops->compare(keys[i - 1], keys[i]) < 0;
+
+        for (i = 0; i < n; i++) {
+                struct swap_entries swap;
+                struct hashmap_base_entry *e;
+                unsigned hash, idx;
+
+                hash = bucket_hash(h, keys[i]);
+
+                if (!sorted) {
+                        idx = bucket_scan(h, hash, keys[i]);
+                        if (idx != IDX_NIL) {
+                                if (h->type == HASHMAP_TYPE_SET ||
+                                    entry_value(h, bucket_at(h, idx)) == values[i])
+                                        continue;
+                                return -EEXIST;
+                        }
+                }
+
+                e = &bucket_at_swap(&swap, IDX_PUT)->p.b;
+                e->key = keys[i];
+                if (h->type != HASHMAP_TYPE_SET)
+                        ((struct plain_hashmap_entry*) e)->value = values[i];
+                assert_se(hashmap_put_boldly(h, hash, &swap, false) == 1);
+                k++;
+        }
+
+        return k;
+}
+
+static int hashmap_base_ensure_put_many(HashmapBase **h, const struct hash_ops *hash_ops, enum HashmapType type,
+                                        void * const *keys, void * const *values, unsigned n  HASHMAP_DEBUG_PARAMS) {
+        int r;
+
+        r = hashmap_base_ensure_allocated(h, hash_ops, type  HASHMAP_DEBUG_PASS_ARGS);
+        if (r < 0)
+                return r;
+
+        return internal_hashmap_put_many(*h, keys, values, n);
+}
+
+int internal_hashmap_ensure_put_many(Hashmap **h, const struct hash_ops *hash_ops,
+                                     void * const *keys, void * const *values, unsigned n  HASHMAP_DEBUG_PARAMS) {
+        return hashmap_base_ensure_put_many((HashmapBase**) h, hash_ops, HASHMAP_TYPE_PLAIN,
+                                            keys, values, n  HASHMAP_DEBUG_PASS_ARGS);
+}
+
+int internal_ordered_hashmap_ensure_put_many(OrderedHashmap **h, const struct hash_ops *hash_ops,
+                                             void * const *keys, void * const *values, unsigned n  HASHMAP_DEBUG_PARAMS) {
+        return hashmap_base_ensure_put_many((HashmapBase**) h, hash_ops, HASHMAP_TYPE_ORDERED,
+                                            keys, values, n  HASHMAP_DEBUG_PASS_ARGS);
+}
+
+int internal_set_ensure_put_many(Set **s, const struct hash_ops *hash_ops, void * const *keys, unsigned n  HASHMAP_DEBUG_PARAMS) {
+        return hashmap_base_ensure_put_many((HashmapBase**) s, hash_ops, HASHMAP_TYPE_SET,
+                                            keys, NULL, n  HASHMAP_DEBUG_PASS_ARGS);
+}
+
 /*
  * The same as hashmap_merge(), but every new item from other is moved to h.
  * Keys already in h are skipped and stay in other.
@@ -1699,6 +1863,12 @@ HashmapBase *internal_hashmap_copy(HashmapBase *h) {
         if (!copy)
                 return NULL;
 
+        r = resize_buckets(copy, n_entries(h));
+        if (r < 0) {
+                internal_hashmap_free(copy, false, false);
+                return NULL;
+        }
+
         switch (h->type) {
         case HASHMAP_TYPE_PLAIN:
         case HASHMAP_TYPE_ORDERED:
@@ -1815,6 +1985,10 @@ int set_put_strdupv(Set *s, char **l) {
 
         assert(s);
 
+        r = set_reserve(s, strv_length(l));
+        if (r < 0)
+                return r;
+
         STRV_FOREACH(i, l) {
                 r = set_put_strdup(s, *i);
                 if (r < 0)
@@ -149,6 +149,23 @@ static inline int ordered_hashmap_put(OrderedHashmap *h, const void *key, void *
 
 int hashmap_put_strdup(Hashmap **h, const char *k, const char *v);
 
+int internal_hashmap_put_many(HashmapBase *h, void * const *keys, void * const *values, unsigned n);
+static inline int hashmap_put_many(Hashmap *h, void * const *keys, void * const *values, unsigned n) {
+        return internal_hashmap_put_many(HASHMAP_BASE(h), keys, values, n);
+}
+static inline int ordered_hashmap_put_many(OrderedHashmap *h, void * const *keys, void * const *values, unsigned n) {
+        return internal_hashmap_put_many(HASHMAP_BASE(h), keys, values, n);
+}
+
+int internal_hashmap_ensure_put_many(Hashmap **h, const struct hash_ops *hash_ops,
+                                     void * const *keys, void * const *values, unsigned n  HASHMAP_DEBUG_PARAMS);
+int internal_ordered_hashmap_ensure_put_many(OrderedHashmap **h, const struct hash_ops *hash_ops,
+                                             void * const *keys, void * const *values, unsigned n  HASHMAP_DEBUG_PARAMS);
+#define hashmap_ensure_put_many(h, ops, keys, values, n) \
+        internal_hashmap_ensure_put_many(h, ops, keys, values, n  HASHMAP_DEBUG_SRC_ARGS)
+#define ordered_hashmap_ensure_put_many(h, ops, keys, values, n) \
+        internal_ordered_hashmap_ensure_put_many(h, ops, keys, values, n  HASHMAP_DEBUG_SRC_ARGS)
+
 int hashmap_update(Hashmap *h, const void *key, void *value);
 static inline int ordered_hashmap_update(OrderedHashmap *h, const void *key, void *value) {
         return hashmap_update(PLAIN_HASHMAP(h), key, value);
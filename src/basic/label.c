@@ -24,6 +24,28 @@ int label_fix_container(const char *path, const char *inside_path, LabelFixFlags
         return 0;
 }
 
+int label_fix_fd(int fd, const char *path, const char *inside_path, LabelFixFlags flags) {
+        int r, q = 0;
+
+        assert(fd >= 0);
+        assert(path);
+        assert(inside_path);
+
+        /* Like label_fix_container(), but operates on an already pinned (O_PATH) fd, and doesn't check for
+         * SELinux policy reloads, see mac_selinux_fix_fd(). */
+
+        r = mac_selinux_fix_fd(fd, path, inside_path, flags);
+        if (mac_smack_use())
+                q = mac_smack_fix_fd(fd, inside_path, flags);
+
+        if (r < 0)
+                return r;
+        if (q < 0)
+                return q;
+
+        return 0;
+}
+
 int symlink_label(const char *old_path, const char *new_path) {
         int r;
 
@@ -0,0 +1,151 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <inttypes.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "log-ring.h"
+#include "log.h"
+#include "macro.h"
+#include "string-util.h"
+
+/* Writers claim a slot by incrementing the head counter, and mark the record as complete by setting its
+ * sequence number to the slot's index plus one last. Readers only use records whose sequence number is what
+ * they expect both before and after copying them out, i.e. which were neither in the process of being
+ * written nor overwritten meanwhile. */
+
+static LogRingRecord *ring = NULL;
+static uint64_t ring_head = 0;  /* Number of records ever put */
+static uint64_t ring_tail = 0;  /* The first record not drained yet */
+static int ring_draining = 0;
+
+static LogRingRecord* log_ring_get(void) {
+        void *p;
+
+        if (_likely_(ring))
+                return ring;
+
+        /* Don't use malloc() here: we might be called in a child after fork(), or when we are out of memory */
+        p = mmap(NULL, LOG_RING_RECORDS * sizeof(LogRingRecord), PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED)
+                return NULL;
+
+        if (!__sync_bool_compare_and_swap(&ring, NULL, p))
+                (void) munmap(p, LOG_RING_RECORDS * sizeof(LogRingRecord));
+
+        return ring;
+}
+
+void log_ring_put(int level, int error, const char *file, int line, const char *func, const char *message) {
+        LogRingRecord *r;
+        uint64_t idx;
+        size_t n;
+
+        if (!log_ring_get())
+                return;
+
+        idx = __sync_fetch_and_add(&ring_head, 1);
+        r = ring + idx % LOG_RING_RECORDS;
+
+        r->seq = 0;
+        __sync_synchronize();
+
+        r->realtime = now(CLOCK_REALTIME);
+        r->level = level;
+        r->error = error;
+        r->file = file;
+        r->line = line;
+        r->func = func;
+
+        n = strnlen(message, LOG_RING_MESSAGE_MAX - 1);
+        memcpy(r->message, message, n);
+        r->message[n] = 0;
+
+        __sync_synchronize();
+        r->seq = idx + 1;
+}
+
+static bool log_ring_read(uint64_t idx, LogRingRecord *ret) {
+        const LogRingRecord *r = ring + idx % LOG_RING_RECORDS;
+
+        if (r->seq != idx + 1)
+                return false;
+
+        __sync_synchronize();
+        memcpy(ret, r, sizeof(LogRingRecord));
+        __sync_synchronize();
+
+        return r->seq == idx + 1 && ret->seq == idx + 1;
+}
+
+static uint64_t log_ring_first(uint64_t head) {
+        return head > LOG_RING_RECORDS ? head - LOG_RING_RECORDS : 0;
+}
+
+bool log_ring_pending(void) {
+        return ring && ring_tail != __atomic_load_n(&ring_head, __ATOMIC_RELAXED);
+}
+
+uint64_t log_ring_drain(log_ring_callback_t callback, void *userdata) {
+        uint64_t head, idx, lost;
+
+        assert(callback);
+
+        /* Hands out all records not drained before, in order. Returns the number of records that were
+         * overwritten before they could be drained. */
+
+        if (!ring)
+                return 0;
+
+        /* Only one at a time, whoever comes second simply leaves it to the first */
+        if (__sync_lock_test_and_set(&ring_draining, 1))
+                return 0;
+
+        head = __atomic_load_n(&ring_head, __ATOMIC_ACQUIRE);
+        idx = MAX(ring_tail, log_ring_first(head));
+        lost = idx - ring_tail;
+
+        for (; idx < head; idx++) {
+                LogRingRecord r;
+
+                if (log_ring_read(idx, &r))
+                        callback(&r, userdata);
+                else
+                        lost++;
+        }
+
+        ring_tail = head;
+        __sync_lock_release(&ring_draining);
+
+        return lost;
+}
+
+void log_ring_dump(FILE *f, const char *prefix) {
+        uint64_t head, idx;
+
+        assert(f);
+
+        if (!ring)
+                return;
+
+        head = __atomic_load_n(&ring_head, __ATOMIC_ACQUIRE);
+        idx = log_ring_first(head);
+
+        fprintf(f, "%sLog ring (%" PRIu64 " records, %" PRIu64 " overwritten):\n",
+                strempty(prefix), head - idx, idx);
+
+        for (; idx < head; idx++) {
+                char ts[FORMAT_TIMESTAMP_MAX];
+                LogRingRecord r;
+
+                if (!log_ring_read(idx, &r))
+                        continue;
+
+                fprintf(f, "%s\t%s <%i> %s:%i %s(): %s\n",
+                        strempty(prefix),
+                        strna(format_timestamp_us(ts, sizeof(ts), r.realtime)),
+                        LOG_PRI(r.level),
+                        strna(r.file), r.line, strna(r.func),
+                        r.message);
+        }
+}
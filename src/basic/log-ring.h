@@ -0,0 +1,34 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "time-util.h"
+
+/* The log ring keeps the most recent log records in memory, for LOG_TARGET_RING. Writing a record does no I/O
+ * and takes no locks, hence debug logging may stay on even in busy daemons. */
+
+#define LOG_RING_RECORDS 4096U
+#define LOG_RING_MESSAGE_MAX 256U
+
+typedef struct LogRingRecord {
+        uint64_t seq;
+        usec_t realtime;
+        int level;
+        int error;
+        const char *file;
+        const char *func;
+        int line;
+        char message[LOG_RING_MESSAGE_MAX];
+} LogRingRecord;
+
+typedef void (*log_ring_callback_t)(const LogRingRecord *r, void *userdata);
+
+void log_ring_put(int level, int error, const char *file, int line, const char *func, const char *message);
+
+bool log_ring_pending(void);
+uint64_t log_ring_drain(log_ring_callback_t callback, void *userdata);
+
+void log_ring_dump(FILE *f, const char *prefix);
@@ -19,6 +19,7 @@
 #include "fd-util.h"
 #include "format-util.h"
 #include "io-util.h"
+#include "log-ring.h"
 #include "log.h"
 #include "macro.h"
 #include "parse-util.h"
@@ -238,6 +239,10 @@ int log_open(void) {
                 return 0;
         }
 
+        /* Keep whatever we have open, so that the ring can be written there when switching back */
+        if (log_target == LOG_TARGET_RING)
+                return 0;
+
         if (log_target != LOG_TARGET_AUTO ||
             getpid_cached() == 1 ||
             isatty(STDERR_FILENO) <= 0) {
@@ -582,7 +587,7 @@ static int write_to_journal(
         return 1;
 }
 
-int log_dispatch_internal(
+static void log_dispatch_targets(
                 int level,
                 int error,
                 const char *file,
@@ -594,18 +599,6 @@ int log_dispatch_internal(
                 const char *extra,
                 char *buffer) {
 
-        assert_raw(buffer);
-
-        if (log_target == LOG_TARGET_NULL)
-                return -ERRNO_VALUE(error);
-
-        /* Patch in LOG_DAEMON facility if necessary */
-        if ((level & LOG_FACMASK) == 0)
-                level |= log_facility;
-
-        if (open_when_needed)
-                (void) log_open();
-
         do {
                 char *e;
                 int k = 0;
@@ -656,6 +649,64 @@ int log_dispatch_internal(
 
                 buffer = e;
         } while (buffer);
+}
+
+static void log_ring_replay_one(const LogRingRecord *r, void *userdata) {
+        char ts[DECIMAL_STR_MAX(usec_t)], buffer[LOG_RING_MESSAGE_MAX];
+
+        /* The message is split at newlines in place, hence copy it */
+        strcpy(buffer, r->message);
+        xsprintf(ts, USEC_FMT, r->realtime);
+
+        log_dispatch_targets(r->level, r->error, r->file, r->line, r->func, NULL, NULL, "LOG_RING_TIMESTAMP=", ts, buffer);
+}
+
+static void log_ring_replay(void) {
+        char buffer[LINE_MAX];
+        uint64_t lost;
+
+        lost = log_ring_drain(log_ring_replay_one, NULL);
+        if (lost == 0)
+                return;
+
+        xsprintf(buffer, "%" PRIu64 " log messages were lost from the log ring.", lost);
+        log_dispatch_targets(LOG_WARNING|log_facility, 0, PROJECT_FILE, __LINE__, __func__, NULL, NULL, NULL, NULL, buffer);
+}
+
+int log_dispatch_internal(
+                int level,
+                int error,
+                const char *file,
+                int line,
+                const char *func,
+                const char *object_field,
+                const char *object,
+                const char *extra_field,
+                const char *extra,
+                char *buffer) {
+
+        assert_raw(buffer);
+
+        if (log_target == LOG_TARGET_NULL)
+                return -ERRNO_VALUE(error);
+
+        /* Patch in LOG_DAEMON facility if necessary */
+        if ((level & LOG_FACMASK) == 0)
+                level |= log_facility;
+
+        if (log_target == LOG_TARGET_RING) {
+                log_ring_put(level, error, file, line, func, buffer);
+                return -ERRNO_VALUE(error);
+        }
+
+        if (open_when_needed)
+                (void) log_open();
+
+        /* If we logged to the ring before, write out what's in there first */
+        if (_unlikely_(log_ring_pending()))
+                log_ring_replay();
+
+        log_dispatch_targets(level, error, file, line, func, object_field, object, extra_field, extra, buffer);
 
         if (open_when_needed)
                 log_close();
@@ -1222,6 +1273,9 @@ bool log_on_console(void) {
                                LOG_TARGET_CONSOLE_PREFIXED))
                 return true;
 
+        if (log_target == LOG_TARGET_RING)
+                return false;
+
         return syslog_fd < 0 && kmsg_fd < 0 && journal_fd < 0;
 }
 
@@ -1233,6 +1287,7 @@ static const char *const log_target_table[_LOG_TARGET_MAX] = {
         [LOG_TARGET_JOURNAL_OR_KMSG] = "journal-or-kmsg",
         [LOG_TARGET_SYSLOG] = "syslog",
         [LOG_TARGET_SYSLOG_OR_KMSG] = "syslog-or-kmsg",
+        [LOG_TARGET_RING] = "ring",
         [LOG_TARGET_AUTO] = "auto",
         [LOG_TARGET_NULL] = "null",
 };
@@ -38,6 +38,40 @@ bool memeqzero(const void *data, size_t length) {
         return memcmp(data, p + i, length) == 0;
 }
 
+void* memchr3(const void *s, size_t n, int a, int b, int c) {
+        const uint8_t *p, *found = NULL;
+
+        /* Returns a pointer to the first occurrence of any of the three bytes. Pass the same byte more than
+         * once to look for fewer. The libc memchr() is vectorized, hence we call it for each byte, each time only
+         * looking in front of the earliest match found so far: with the most frequent byte passed first, the
+         * others are only looked for in what's typically a single line. */
+
+        if (n == 0)
+                return NULL;
+
+        p = memchr(s, a, n);
+        if (p) {
+                found = p;
+                n = p - (const uint8_t*) s;
+        }
+
+        if (b != a && n > 0) {
+                p = memchr(s, b, n);
+                if (p) {
+                        found = p;
+                        n = p - (const uint8_t*) s;
+                }
+        }
+
+        if (c != a && c != b && n > 0) {
+                p = memchr(s, c, n);
+                if (p)
+                        found = p;
+        }
+
+        return (void*) found;
+}
+
 #if !HAVE_EXPLICIT_BZERO
 /*
  * The pointer to memset() is volatile so that compiler must de-reference the pointer and can't assume that
@@ -1,13 +1,14 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
+#include <pthread.h>
 #include <stdint.h>
 #include <stdlib.h>
 
+#include "alloc-util.h"
 #include "env-util.h"
 #include "macro.h"
 #include "memory-util.h"
 #include "mempool.h"
-#include "process-util.h"
 #include "util.h"
 
 struct pool {
@@ -16,7 +17,113 @@ struct pool {
         size_t n_used;
 };
 
+/* Every thread allocating from a mempool gets its own pools and its own freelist, hence allocating and
+ * releasing tiles within one thread needs no locking. A tile released by another thread than the one it was
+ * allocated in is pushed onto the remote freelist of its owner, which the owner picks up once its own freelist
+ * runs dry. When a thread exits, its state is put on the orphan list of the mempool, and adopted by the next
+ * thread that needs one. */
+struct mempool_thread {
+        struct mempool *mempool;
+        struct mempool_thread *next;     /* the next state of the same thread, or the next orphan */
+        struct mempool_thread *all_next;
+        struct pool *first_pool;
+        void *freelist;
+        void *remote_freelist;
+};
+
+/* Each tile is preceded by a pointer to the state it was allocated from */
+#define TILE_HEADER_SIZE ALIGN(sizeof(struct mempool_thread*))
+#define TILE_STRIDE(mp) (TILE_HEADER_SIZE + ALIGN((mp)->tile_size))
+#define TILE_OWNER(p) (*(struct mempool_thread**) ((uint8_t*) (p) - TILE_HEADER_SIZE))
+
+static thread_local struct mempool_thread *thread_states = NULL;
+
+static pthread_mutex_t orphans_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t thread_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t thread_key;
+static bool thread_key_valid = false;
+
+static void mempool_thread_orphan(struct mempool_thread *t) {
+        assert_se(pthread_mutex_lock(&orphans_mutex) == 0);
+        t->next = t->mempool->orphans;
+        t->mempool->orphans = t;
+        assert_se(pthread_mutex_unlock(&orphans_mutex) == 0);
+}
+
+static void mempool_thread_exit(void *p) {
+        struct mempool_thread *t = p, *n;
+
+        /* Tiles released from here on by other destructors of this thread are handed back like those
+         * released by any other thread. */
+        thread_states = NULL;
+
+        for (; t; t = n) {
+                n = t->next;
+                mempool_thread_orphan(t);
+        }
+}
+
+static void thread_key_init(void) {
+        thread_key_valid = pthread_key_create(&thread_key, mempool_thread_exit) == 0;
+}
+
+_destructor_ static void thread_key_done(void) {
+        /* Don't leave a dangling destructor behind when we are part of a shared object that is unloaded */
+        if (thread_key_valid)
+                (void) pthread_key_delete(thread_key);
+}
+
+static struct mempool_thread* mempool_thread_find(struct mempool *mp) {
+        struct mempool_thread *t;
+
+        for (t = thread_states; t; t = t->next)
+                if (t->mempool == mp)
+                        return t;
+
+        return NULL;
+}
+
+static struct mempool_thread* mempool_thread_get(struct mempool *mp) {
+        struct mempool_thread *t;
+
+        t = mempool_thread_find(mp);
+        if (t)
+                return t;
+
+        assert_se(pthread_mutex_lock(&orphans_mutex) == 0);
+        t = mp->orphans;
+        if (t)
+                mp->orphans = t->next;
+        assert_se(pthread_mutex_unlock(&orphans_mutex) == 0);
+
+        if (!t) {
+                t = new0(struct mempool_thread, 1);
+                if (!t)
+                        return NULL;
+
+                t->mempool = mp;
+
+                assert_se(pthread_mutex_lock(&orphans_mutex) == 0);
+                t->all_next = mp->threads;
+                mp->threads = t;
+                assert_se(pthread_mutex_unlock(&orphans_mutex) == 0);
+        }
+
+        /* The key's value is the list head, which is what the destructor gets passed */
+        if (pthread_setspecific(thread_key, t) != 0) {
+                mempool_thread_orphan(t);
+                return NULL;
+        }
+
+        t->next = thread_states;
+        thread_states = t;
+
+        return t;
+}
+
 void* mempool_alloc_tile(struct mempool *mp) {
+        struct mempool_thread *t;
+        uint8_t *tile;
         size_t i;
 
         /* When a tile is released we add it to the list and simply
@@ -25,38 +132,48 @@ void* mempool_alloc_tile(struct mempool *mp) {
         assert(mp->tile_size >= sizeof(void*));
         assert(mp->at_least > 0);
 
-        if (mp->freelist) {
+        t = mempool_thread_get(mp);
+        if (!t)
+                return NULL;
+
+        if (!t->freelist)
+                t->freelist = __sync_lock_test_and_set(&t->remote_freelist, NULL);
+
+        if (t->freelist) {
                 void *r;
 
-                r = mp->freelist;
-                mp->freelist = * (void**) mp->freelist;
+                r = t->freelist;
+                t->freelist = * (void**) t->freelist;
                 return r;
         }
 
-        if (_unlikely_(!mp->first_pool) ||
-            _unlikely_(mp->first_pool->n_used >= mp->first_pool->n_tiles)) {
+        if (_unlikely_(!t->first_pool) ||
+            _unlikely_(t->first_pool->n_used >= t->first_pool->n_tiles)) {
                 size_t size, n;
                 struct pool *p;
 
-                n = mp->first_pool ? mp->first_pool->n_tiles : 0;
+                n = t->first_pool ? t->first_pool->n_tiles : 0;
                 n = MAX(mp->at_least, n * 2);
-                size = PAGE_ALIGN(ALIGN(sizeof(struct pool)) + n*mp->tile_size);
-                n = (size - ALIGN(sizeof(struct pool))) / mp->tile_size;
+                size = PAGE_ALIGN(ALIGN(sizeof(struct pool)) + n*TILE_STRIDE(mp));
+                n = (size - ALIGN(sizeof(struct pool))) / TILE_STRIDE(mp);
 
                 p = malloc(size);
                 if (!p)
                         return NULL;
 
-                p->next = mp->first_pool;
+                p->next = t->first_pool;
                 p->n_tiles = n;
                 p->n_used = 0;
 
-                mp->first_pool = p;
+                t->first_pool = p;
         }
 
-        i = mp->first_pool->n_used++;
+        i = t->first_pool->n_used++;
+
+        tile = ((uint8_t*) t->first_pool) + ALIGN(sizeof(struct pool)) + i*TILE_STRIDE(mp) + TILE_HEADER_SIZE;
+        TILE_OWNER(tile) = t;
 
-        return ((uint8_t*) mp->first_pool) + ALIGN(sizeof(struct pool)) + i*mp->tile_size;
+        return tile;
 }
 
 void* mempool_alloc0_tile(struct mempool *mp) {
@@ -69,32 +186,52 @@ void* mempool_alloc0_tile(struct mempool *mp) {
 }
 
 void mempool_free_tile(struct mempool *mp, void *p) {
-        * (void**) p = mp->freelist;
-        mp->freelist = p;
+        struct mempool_thread *t = TILE_OWNER(p);
+
+        assert(t->mempool == mp);
+
+        if (t == mempool_thread_find(mp)) {
+                * (void**) p = t->freelist;
+                t->freelist = p;
+                return;
+        }
+
+        /* Released by another thread, hand it back to the owner */
+        for (;;) {
+                void *head = __atomic_load_n(&t->remote_freelist, __ATOMIC_RELAXED);
+
+                * (void**) p = head;
+                if (__sync_bool_compare_and_swap(&t->remote_freelist, head, p))
+                        break;
+        }
 }
 
 bool mempool_enabled(void) {
         static int b = -1;
 
-        if (!is_main_thread())
-                return false;
-
-        if (!mempool_use_allowed)
-                b = false;
-        if (b < 0)
-                b = getenv_bool("SYSTEMD_MEMPOOL") != 0;
+        if (b < 0) {
+                assert_se(pthread_once(&thread_key_once, thread_key_init) == 0);
+                b = thread_key_valid && getenv_bool("SYSTEMD_MEMPOOL") != 0;
+        }
 
         return b;
 }
 
 #if VALGRIND
 void mempool_drop(struct mempool *mp) {
-        struct pool *p = mp->first_pool;
-        while (p) {
-                struct pool *n;
-                n = p->next;
-                free(p);
-                p = n;
+        struct mempool_thread *t;
+
+        for (t = mp->threads; t; t = t->all_next) {
+                struct pool *p = t->first_pool;
+                while (p) {
+                        struct pool *n;
+                        n = p->next;
+                        free(p);
+                        p = n;
+                }
+
+                t->first_pool = NULL;
+                t->freelist = t->remote_freelist = NULL;
         }
 }
 #endif
@@ -4,13 +4,13 @@
 #include <stdbool.h>
 #include <stddef.h>
 
-struct pool;
+struct mempool_thread;
 
 struct mempool {
-        struct pool *first_pool;
-        void *freelist;
         size_t tile_size;
         unsigned at_least;
+        struct mempool_thread *threads;  /* all per-thread states ever created */
+        struct mempool_thread *orphans;  /* states left behind by exited threads */
 };
 
 void* mempool_alloc_tile(struct mempool *mp);
@@ -23,7 +23,6 @@ static struct mempool pool_name = { \
         .at_least = alloc_at_least, \
 }
 
-extern const bool mempool_use_allowed;
 bool mempool_enabled(void);
 
 #if VALGRIND
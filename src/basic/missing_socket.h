@@ -36,6 +36,10 @@ struct sockaddr_vm {
 #define SO_BINDTOIFINDEX 62
 #endif
 
+#ifndef SO_PEERPIDFD
+#define SO_PEERPIDFD 77
+#endif
+
 #ifndef SOL_NETLINK
 #define SOL_NETLINK 270
 #endif
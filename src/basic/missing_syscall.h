@@ -6,6 +6,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <signal.h>
+#include <stdint.h>
 #include <sys/syscall.h>
 #include <sys/types.h>
 #include <sys/wait.h>
@@ -568,3 +569,40 @@ static inline int rt_sigqueueinfo(pid_t tgid, int sig, siginfo_t *info) {
         return syscall(__NR_rt_sigqueueinfo, tgid, sig, info);
 }
 #endif
+
+#ifndef AT_RECURSIVE
+#define AT_RECURSIVE 0x8000
+#endif
+
+#if !HAVE_MOUNT_SETATTR
+/* may be (invalid) negative number due to libseccomp, see PR 13319 */
+#  if ! (defined __NR_mount_setattr && __NR_mount_setattr >= 0)
+#    if defined __NR_mount_setattr
+#      undef __NR_mount_setattr
+#    endif
+#    define __NR_mount_setattr 442
+#endif
+
+struct mount_attr {
+        uint64_t attr_set;
+        uint64_t attr_clr;
+        uint64_t propagation;
+        uint64_t userns_fd;
+};
+
+#ifndef MOUNT_ATTR_RDONLY
+#define MOUNT_ATTR_RDONLY      0x00000001
+#define MOUNT_ATTR_NOSUID      0x00000002
+#define MOUNT_ATTR_NODEV       0x00000004
+#define MOUNT_ATTR_NOEXEC      0x00000008
+#endif
+
+static inline int mount_setattr(int dfd, const char *path, unsigned flags, struct mount_attr *attr, size_t size) {
+#ifdef __NR_mount_setattr
+        return syscall(__NR_mount_setattr, dfd, path, flags, attr, size);
+#else
+        errno = ENOSYS;
+        return -1;
+#endif
+}
+#endif
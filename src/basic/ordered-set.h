@@ -34,6 +34,10 @@ static inline int ordered_set_put(OrderedSet *s, void *p) {
         return ordered_hashmap_put((OrderedHashmap*) s, p, p);
 }
 
+static inline int ordered_set_put_many(OrderedSet *s, void * const *p, unsigned n) {
+        return ordered_hashmap_put_many((OrderedHashmap*) s, p, p, n);
+}
+
 static inline unsigned ordered_set_size(OrderedSet *s) {
         return ordered_hashmap_size((OrderedHashmap*) s);
 }
@@ -42,6 +46,10 @@ static inline bool ordered_set_isempty(OrderedSet *s) {
         return ordered_hashmap_isempty((OrderedHashmap*) s);
 }
 
+static inline bool ordered_set_contains(OrderedSet *s, const void *p) {
+        return ordered_hashmap_contains((OrderedHashmap*) s, p);
+}
+
 static inline bool ordered_set_iterate(OrderedSet *s, Iterator *i, void **value) {
         return ordered_hashmap_iterate((OrderedHashmap*) s, i, value, NULL);
 }
@@ -7,7 +7,15 @@
  * priority. Insertion and removal are Θ(log n). Optionally, the caller can
  * provide a pointer to an index which will be kept up-to-date by the prioq.
  *
- * The underlying algorithm used in this implementation is a Heap.
+ * The underlying algorithm used in this implementation is a Heap. Instead of a
+ * compare function, the caller may provide a function returning a 64-bit sort
+ * key for an object. Those keys are then kept in an array of their own, so
+ * that comparisons don't need to look at the objects themselves, and are
+ * recalculated whenever an object is put or reshuffled. Such keyed queues use
+ * a 4-ary Heap, which is shallower than a binary one: looking at the four
+ * children of an item then means looking at half a cache line, rather than at
+ * four objects all over the place, which is why queues with a compare function
+ * stay binary.
  */
 
 #include <errno.h>
@@ -24,30 +32,44 @@ struct prioq_item {
 
 struct Prioq {
         compare_func_t compare_func;
+        prioq_key_func_t key_func;
         unsigned n_items, n_allocated;
 
         struct prioq_item *items;
+        uint64_t *keys; /* only for keyed queues, indexed like items */
 };
 
-Prioq *prioq_new(compare_func_t compare_func) {
+static Prioq *prioq_new_internal(compare_func_t compare_func, prioq_key_func_t key_func) {
         Prioq *q;
 
+        assert(!!compare_func != !!key_func);
+
         q = new(Prioq, 1);
         if (!q)
                 return q;
 
         *q = (Prioq) {
                 .compare_func = compare_func,
+                .key_func = key_func,
         };
 
         return q;
 }
 
+Prioq *prioq_new(compare_func_t compare_func) {
+        return prioq_new_internal(compare_func, NULL);
+}
+
+Prioq *prioq_new_keyed(prioq_key_func_t key_func) {
+        return prioq_new_internal(NULL, key_func);
+}
+
 Prioq* prioq_free(Prioq *q) {
         if (!q)
                 return NULL;
 
         free(q->items);
+        free(q->keys);
         return mfree(q);
 }
 
@@ -64,6 +86,19 @@ int prioq_ensure_allocated(Prioq **q, compare_func_t compare_func) {
         return 0;
 }
 
+int prioq_ensure_allocated_keyed(Prioq **q, prioq_key_func_t key_func) {
+        assert(q);
+
+        if (*q)
+                return 0;
+
+        *q = prioq_new_keyed(key_func);
+        if (!*q)
+                return -ENOMEM;
+
+        return 0;
+}
+
 static void swap(Prioq *q, unsigned j, unsigned k) {
         assert(q);
         assert(j < q->n_items);
@@ -82,10 +117,91 @@ static void swap(Prioq *q, unsigned j, unsigned k) {
                 *q->items[k].idx = k;
 }
 
+static void set_keyed_item(Prioq *q, unsigned j, const struct prioq_item *i, uint64_t key) {
+        assert(q);
+        assert(j < q->n_items);
+
+        q->items[j] = *i;
+        q->keys[j] = key;
+        if (i->idx)
+                *i->idx = j;
+}
+
+static unsigned keyed_shuffle_up(Prioq *q, unsigned idx) {
+        struct prioq_item i;
+        unsigned start = idx;
+        uint64_t key;
+
+        assert(q);
+        assert(idx < q->n_items);
+
+        /* Move parents down into the hole, until the item fits in there */
+        i = q->items[idx];
+        key = q->keys[idx];
+        while (idx > 0) {
+                unsigned k;
+
+                k = (idx-1) / 4;
+
+                if (q->keys[k] <= key)
+                        break;
+
+                set_keyed_item(q, idx, q->items + k, q->keys[k]);
+                idx = k;
+        }
+
+        if (idx != start)
+                set_keyed_item(q, idx, &i, key);
+
+        return idx;
+}
+
+static unsigned keyed_shuffle_down(Prioq *q, unsigned idx) {
+        struct prioq_item i;
+        unsigned start = idx;
+        uint64_t key;
+
+        assert(q);
+        assert(idx < q->n_items);
+
+        /* Move the smallest child up into the hole, as long as it is smaller than the item */
+        i = q->items[idx];
+        key = q->keys[idx];
+        for (;;) {
+                unsigned j, k, s, end;
+
+                j = idx * 4 + 1; /* first child */
+                if (j >= q->n_items)
+                        break;
+
+                end = MIN(j + 4, q->n_items);
+                for (s = j, k = j + 1; k < end; k++)
+                        if (q->keys[k] < q->keys[s])
+                                s = k;
+
+                /* s now points to the smallest child */
+
+                if (q->keys[s] >= key)
+                        /* No move necessary, we're done */
+                        break;
+
+                set_keyed_item(q, idx, q->items + s, q->keys[s]);
+                idx = s;
+        }
+
+        if (idx != start)
+                set_keyed_item(q, idx, &i, key);
+
+        return idx;
+}
+
 static unsigned shuffle_up(Prioq *q, unsigned idx) {
         assert(q);
         assert(idx < q->n_items);
 
+        if (q->key_func)
+                return keyed_shuffle_up(q, idx);
+
         while (idx > 0) {
                 unsigned k;
 
@@ -104,6 +220,9 @@ static unsigned shuffle_up(Prioq *q, unsigned idx) {
 static unsigned shuffle_down(Prioq *q, unsigned idx) {
         assert(q);
 
+        if (q->key_func)
+                return keyed_shuffle_down(q, idx);
+
         for (;;) {
                 unsigned j, k, s;
 
@@ -157,6 +276,17 @@ int prioq_put(Prioq *q, void *data, unsigned *idx) {
                         return -ENOMEM;
 
                 q->items = j;
+
+                if (q->key_func) {
+                        uint64_t *keys;
+
+                        keys = reallocarray(q->keys, n, sizeof(uint64_t));
+                        if (!keys)
+                                return -ENOMEM;
+
+                        q->keys = keys;
+                }
+
                 q->n_allocated = n;
         }
 
@@ -164,6 +294,8 @@ int prioq_put(Prioq *q, void *data, unsigned *idx) {
         i = q->items + k;
         i->data = data;
         i->idx = idx;
+        if (q->key_func)
+                q->keys[k] = q->key_func(data);
 
         if (idx)
                 *idx = k;
@@ -192,8 +324,9 @@ static void remove_item(Prioq *q, struct prioq_item *i) {
 
                 k = i - q->items;
 
-                i->data = l->data;
-                i->idx = l->idx;
+                *i = *l;
+                if (q->key_func)
+                        q->keys[k] = q->keys[q->n_items - 1];
                 if (i->idx)
                         *i->idx = k;
                 q->n_items--;
@@ -254,6 +387,9 @@ int prioq_reshuffle(Prioq *q, void *data, unsigned *idx) {
                 return 0;
 
         k = i - q->items;
+        if (q->key_func)
+                q->keys[k] = q->key_func(data);
+
         k = shuffle_down(q, k);
         shuffle_up(q, k);
         return 1;
@@ -2,6 +2,7 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stdint.h>
 
 #include "hashmap.h"
 #include "macro.h"
@@ -10,10 +11,15 @@ typedef struct Prioq Prioq;
 
 #define PRIOQ_IDX_NULL ((unsigned) -1)
 
+/* Returns the sort key of an object, lower keys first. Called whenever the object is put or reshuffled. */
+typedef uint64_t (*prioq_key_func_t)(const void *data);
+
 Prioq *prioq_new(compare_func_t compare);
+Prioq *prioq_new_keyed(prioq_key_func_t key_func);
 Prioq *prioq_free(Prioq *q);
 DEFINE_TRIVIAL_CLEANUP_FUNC(Prioq*, prioq_free);
 int prioq_ensure_allocated(Prioq **q, compare_func_t compare_func);
+int prioq_ensure_allocated_keyed(Prioq **q, prioq_key_func_t key_func);
 
 int prioq_put(Prioq *q, void *data, unsigned *idx);
 int prioq_remove(Prioq *q, void *data, unsigned *idx);
@@ -628,6 +628,59 @@ int get_process_ppid(pid_t pid, pid_t *_ppid) {
         return 0;
 }
 
+int get_process_start_time(pid_t pid, uint64_t *ret) {
+        _cleanup_free_ char *line = NULL;
+        unsigned long long t;
+        const char *p;
+        int r;
+
+        assert(pid >= 0);
+        assert(ret);
+
+        /* Returns the start time of the process in clock ticks since boot. Together with the PID this
+         * identifies a process, even if the PID is recycled. */
+
+        p = procfs_file_alloca(pid, "stat");
+        r = read_one_line_file(p, &line);
+        if (r == -ENOENT)
+                return -ESRCH;
+        if (r < 0)
+                return r;
+
+        p = strrchr(line, ')');
+        if (!p)
+                return -EIO;
+
+        p++;
+
+        if (sscanf(p, " "
+                   "%*c "  /* state */
+                   "%*u "  /* ppid */
+                   "%*u "  /* pgrp */
+                   "%*u "  /* session */
+                   "%*u "  /* tty_nr */
+                   "%*u "  /* tpgid */
+                   "%*u "  /* flags */
+                   "%*u "  /* minflt */
+                   "%*u "  /* cminflt */
+                   "%*u "  /* majflt */
+                   "%*u "  /* cmajflt */
+                   "%*u "  /* utime */
+                   "%*u "  /* stime */
+                   "%*u "  /* cutime */
+                   "%*u "  /* cstime */
+                   "%*i "  /* priority */
+                   "%*i "  /* nice */
+                   "%*u "  /* num_threads */
+                   "%*u "  /* itrealvalue */
+                   "%llu ", /* starttime */
+                   &t) != 1)
+                return -EIO;
+
+        *ret = (uint64_t) t;
+        return 0;
+}
+
 int get_process_umask(pid_t pid, mode_t *umask) {
         _cleanup_free_ char *m = NULL;
         const char *p;
@@ -645,6 +698,30 @@ int get_process_umask(pid_t pid, mode_t *umask) {
         return parse_mode(m, umask);
 }
 
+int get_process_threads(pid_t pid) {
+        _cleanup_free_ char *t = NULL;
+        const char *p;
+        int n, r;
+
+        assert(pid >= 0);
+
+        p = procfs_file_alloca(pid, "status");
+
+        r = get_proc_field(p, "Threads", WHITESPACE, &t);
+        if (r == -ENOENT)
+                return -ESRCH;
+        if (r < 0)
+                return r;
+
+        r = safe_atoi(t, &n);
+        if (r < 0)
+                return r;
+        if (n <= 0)
+                return -EINVAL;
+
+        return n;
+}
+
 int wait_for_terminate(pid_t pid, siginfo_t *status) {
         siginfo_t dummy;
 
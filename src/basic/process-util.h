@@ -45,7 +45,9 @@ int get_process_cwd(pid_t pid, char **cwd);
 int get_process_root(pid_t pid, char **root);
 int get_process_environ(pid_t pid, char **environ);
 int get_process_ppid(pid_t pid, pid_t *ppid);
+int get_process_start_time(pid_t pid, uint64_t *ret);
 int get_process_umask(pid_t pid, mode_t *umask);
+int get_process_threads(pid_t pid);
 
 int wait_for_terminate(pid_t pid, siginfo_t *status);
 
@@ -0,0 +1,63 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <signal.h>
+
+#include "alloc-util.h"
+#include "log.h"
+#include "pthread-util.h"
+
+static unsigned start_threads(pthread_t *threads, unsigned n, void* (*func)(void *userdata), void *userdata) {
+        sigset_t ss, saved_ss;
+        unsigned i;
+        int r;
+
+        /* New threads inherit our signal mask, and shall leave all signals to the main thread. Except for
+         * SIGBUS, which is synchronous, and which we need to handle when accessing memory mapped files. */
+        assert_se(sigfillset(&ss) >= 0);
+        assert_se(sigdelset(&ss, SIGBUS) >= 0);
+
+        r = pthread_sigmask(SIG_BLOCK, &ss, &saved_ss);
+        if (r > 0) {
+                log_debug_errno(r, "Failed to block signals, not starting threads: %m");
+                return 0;
+        }
+
+        for (i = 0; i < n; i++) {
+                r = pthread_create(threads + i, NULL, func, userdata);
+                if (r > 0) {
+                        log_debug_errno(r, "Failed to start thread, using %u threads: %m", i + 1);
+                        break;
+                }
+        }
+
+        assert_se(pthread_sigmask(SIG_SETMASK, &saved_ss, NULL) == 0);
+
+        return i;
+}
+
+unsigned run_parallel(unsigned n_threads, void* (*func)(void *userdata), void *userdata) {
+        _cleanup_free_ pthread_t *threads = NULL;
+        unsigned n_started = 0, i;
+
+        assert(func);
+
+        /* Runs func in n_threads threads, the calling one included, and waits for all of them to finish. It
+         * has to pick its work items itself, and to do everything if it ends up running alone, since
+         * failing to start threads is not fatal, we just use fewer then. Returns how many threads ran. */
+
+        if (n_threads > 1) {
+                threads = new(pthread_t, n_threads - 1);
+                if (threads)
+                        n_started = start_threads(threads, n_threads - 1, func, userdata);
+                else
+                        log_debug("Failed to allocate thread array, not starting threads.");
+        }
+
+        /* Lend a hand ourselves, and do everything if we couldn't start any threads */
+        (void) func(userdata);
+
+        for (i = 0; i < n_started; i++)
+                assert_se(pthread_join(threads[i], NULL) == 0);
+
+        return n_started + 1;
+}
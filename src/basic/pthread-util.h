@@ -14,3 +14,5 @@ static inline void pthread_mutex_unlock_assertp(pthread_mutex_t **mutexp) {
         if (*mutexp)
                 assert_se(pthread_mutex_unlock(*mutexp) == 0);
 }
+
+unsigned run_parallel(unsigned n_threads, void* (*func)(void *userdata), void *userdata);
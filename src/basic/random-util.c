@@ -22,15 +22,73 @@
 #include "fd-util.h"
 #include "fileio.h"
 #include "io-util.h"
+#include "memory-util.h"
 #include "missing_random.h"
 #include "missing_syscall.h"
 #include "parse-util.h"
+#include "process-util.h"
 #include "random-util.h"
 #include "siphash24.h"
 #include "time-util.h"
 
 static bool srand_called = false;
 
+static thread_local struct {
+        uint8_t data[RANDOM_BUFFER_SIZE];
+        size_t left; /* unused bytes, at the end of data[] */
+        pid_t pid;
+        RandomFlags flags; /* the flags data[] was filled with */
+} random_buffer = {};
+
+static bool random_buffer_suitable(RandomFlags filled, RandomFlags requested) {
+        /* Bytes that may come from the CPU RNG are only good for callers that allow it */
+        if (FLAGS_SET(filled, RANDOM_ALLOW_RDRAND) && !FLAGS_SET(requested, RANDOM_ALLOW_RDRAND))
+                return false;
+
+        /* Callers that insist on an initialized random pool need bytes that were acquired that way too */
+        if ((requested & (RANDOM_BLOCK|RANDOM_MAY_FAIL)) && !(filled & (RANDOM_BLOCK|RANDOM_MAY_FAIL)))
+                return false;
+
+        return true;
+}
+
+static int random_buffer_get(void *p, size_t n, RandomFlags flags) {
+        int r;
+
+        assert(n <= RANDOM_BUFFER_REQUEST_MAX);
+
+        /* Serves small requests (such as UUIDs and 64bit random numbers) from a per-thread buffer, so that
+         * we don't need a syscall for each of them. The buffer is only ever filled with genuine randomness,
+         * and bytes are erased as they are handed out. The buffer is discarded when we notice that we are
+         * in a different process than the one that filled it, so that forked children never return the
+         * same values as their parent. It is also refilled if it was filled with weaker flags than the
+         * caller asks for. */
+
+        flags &= ~(RANDOM_ALLOW_POOL|RANDOM_EXTEND_WITH_PSEUDO);
+
+        if (random_buffer.pid != getpid_cached() ||
+            !random_buffer_suitable(random_buffer.flags, flags)) {
+                explicit_bzero_safe(random_buffer.data, sizeof(random_buffer.data));
+                random_buffer.left = 0;
+        }
+
+        if (random_buffer.left < n) {
+                r = genuine_random_bytes(random_buffer.data, sizeof(random_buffer.data), flags);
+                if (r < 0)
+                        return r;
+
+                random_buffer.left = sizeof(random_buffer.data);
+                random_buffer.pid = getpid_cached();
+                random_buffer.flags = flags;
+        }
+
+        random_buffer.left -= n;
+        memcpy(p, random_buffer.data + random_buffer.left, n);
+        explicit_bzero_safe(random_buffer.data + random_buffer.left, n);
+
+        return 0;
+}
+
 int rdrand(unsigned long *ret) {
 
         /* So, you are a "security researcher", and you wonder why we bother with using raw RDRAND here,
@@ -163,11 +221,18 @@ int genuine_random_bytes(void *p, size_t n, RandomFlags flags) {
          *
          * When generating UUIDs it's fine to use RANDOM_ALLOW_RDRAND but not OK to use
          * RANDOM_EXTEND_WITH_PSEUDO. In fact RANDOM_EXTEND_WITH_PSEUDO is only really fine when invoked via
-         * an "all bets are off" wrapper, such as random_bytes(), see below. */
+         * an "all bets are off" wrapper, such as random_bytes(), see below.
+         *
+         * If RANDOM_ALLOW_POOL is set, small requests may be served from a per-thread buffer of previously
+         * acquired randomness of the same quality, see random_buffer_get() above. */
 
         if (n == 0)
                 return 0;
 
+        if (FLAGS_SET(flags, RANDOM_ALLOW_POOL) && n <= RANDOM_BUFFER_REQUEST_MAX &&
+            random_buffer_get(p, n, flags) >= 0)
+                return 0;
+
         if (FLAGS_SET(flags, RANDOM_ALLOW_RDRAND))
                 /* Try x86-64' RDRAND intrinsic if we have it. We only use it if high quality randomness is
                  * not required, as we don't trust it (who does?). Note that we only do a single iteration of
@@ -376,6 +441,9 @@ void random_bytes(void *p, size_t n) {
          *
          *         • This function will work fine in early boot
          *
+         *         • Small requests are served from a per-thread buffer, to avoid a syscall for each of
+         *           them
+         *
          *         • This function will always succeed
          *
          * What this function won't do:
@@ -392,7 +460,7 @@ void random_bytes(void *p, size_t n) {
          * This function is hence not useful for generating UUIDs or cryptographic key material.
          */
 
-        if (genuine_random_bytes(p, n, RANDOM_EXTEND_WITH_PSEUDO|RANDOM_MAY_FAIL|RANDOM_ALLOW_RDRAND) >= 0)
+        if (genuine_random_bytes(p, n, RANDOM_EXTEND_WITH_PSEUDO|RANDOM_MAY_FAIL|RANDOM_ALLOW_RDRAND|RANDOM_ALLOW_POOL) >= 0)
                 return;
 
         /* If for some reason some user made /dev/urandom unavailable to us, or the kernel has no entropy, use a PRNG instead. */
@@ -10,6 +10,7 @@ typedef enum RandomFlags {
         RANDOM_BLOCK              = 1 << 1, /* Rather block than return crap randomness (only if the kernel supports that) */
         RANDOM_MAY_FAIL           = 1 << 2, /* If we can't get any randomness at all, return early with -ENODATA */
         RANDOM_ALLOW_RDRAND       = 1 << 3, /* Allow usage of the CPU RNG */
+        RANDOM_ALLOW_POOL         = 1 << 4, /* Allow serving small requests from a per-thread buffer, refilled in larger chunks. Never use this for key material. */
 } RandomFlags;
 
 int genuine_random_bytes(void *p, size_t n, RandomFlags flags); /* returns "genuine" randomness, optionally filled up with pseudo random, if not enough is available */
@@ -37,3 +38,7 @@ int rdrand(unsigned long *ret);
 #define RANDOM_POOL_SIZE_MAX (10U*1024U*1024U)
 
 size_t random_pool_size(void);
+
+/* Size of the per-thread buffer used with RANDOM_ALLOW_POOL, and the largest request served from it */
+#define RANDOM_BUFFER_SIZE 512U
+#define RANDOM_BUFFER_REQUEST_MAX 64U
@@ -7,10 +7,38 @@
 
 #include <errno.h>
 #include <sched.h>
+#include <signal.h>
+#include <stdint.h>
 #include <sys/syscall.h>
 
 #include "log.h"
 #include "macro.h"
+#include "missing_sched.h"
+#include "process-util.h"
+
+/* clone3() has the same number on all architectures but alpha */
+#ifndef __NR_clone3
+#  if defined(__alpha__)
+#    define __NR_clone3 545
+#  else
+#    define __NR_clone3 435
+#  endif
+#endif
+
+/* Mirrors struct clone_args as of kernel 5.7, which older kernel headers don't know or define with fewer fields */
+struct raw_clone_args {
+        uint64_t flags;
+        uint64_t pidfd;
+        uint64_t child_tid;
+        uint64_t parent_tid;
+        uint64_t exit_signal;
+        uint64_t stack;
+        uint64_t stack_size;
+        uint64_t tls;
+        uint64_t set_tid;
+        uint64_t set_tid_size;
+        uint64_t cgroup;
+};
 
 /**
  * raw_clone() - uses clone to create a new process with clone flags
@@ -77,3 +105,35 @@ static inline pid_t raw_clone(unsigned long flags) {
 
         return ret;
 }
+
+/**
+ * raw_clone_into_cgroup() - uses clone3 to create a new process directly in a cgroup
+ * @cgroup_fd: A file descriptor referring to a directory in the unified cgroup hierarchy
+ *
+ * Like raw_clone(0), but the new process is created as member of the specified cgroup rather than the caller's, as
+ * if it was migrated there right after the fork, but without the cost of the migration. This requires kernel 5.7 or
+ * newer; callers should fall back to a regular fork and migration if this fails.
+ *
+ * Like raw_clone() this bypasses glibc's fork(): atfork handlers are not run, the allocator's locks are not taken
+ * across the clone, and glibc's idea of the thread ID of the calling thread is not updated in the child. Hence, only
+ * use this in single-threaded processes, and don't use any pthread functions in the child before exec'ing. Our own
+ * PID cache is reset, see getpid_cached().
+ *
+ * Returns: 0 in the child process and the child process id in the parent.
+ */
+static inline pid_t raw_clone_into_cgroup(int cgroup_fd) {
+        struct raw_clone_args args = {
+                .flags = CLONE_INTO_CGROUP,
+                .exit_signal = SIGCHLD,
+                .cgroup = cgroup_fd,
+        };
+        pid_t ret;
+
+        assert(cgroup_fd >= 0);
+
+        ret = (pid_t) syscall(__NR_clone3, &args, sizeof(args));
+        if (ret == 0)
+                reset_cached_pid();
+
+        return ret;
+}
@@ -162,36 +162,28 @@ static int mac_selinux_reload(int seqno) {
 }
 #endif
 
-int mac_selinux_fix_container(const char *path, const char *inside_path, LabelFixFlags flags) {
+int mac_selinux_fix_fd(int fd, const char *path, const char *inside_path, LabelFixFlags flags) {
 
 #if HAVE_SELINUX
         char procfs_path[STRLEN("/proc/self/fd/") + DECIMAL_STR_MAX(int)];
-        _cleanup_freecon_ char* fcon = NULL;
-        _cleanup_close_ int fd = -1;
+        _cleanup_freecon_ char *fcon = NULL, *oldcon = NULL;
         struct stat st;
         int r;
 
+        assert(fd >= 0);
         assert(path);
+        assert(inside_path);
+
+        /* Unlike mac_selinux_fix_container() this doesn't check for policy reloads, as the callbacks
+         * replace 'label_hnd'. This makes it safe to call from multiple threads at once, as long as the
+         * caller checks for policy reloads itself from time to time. */
 
-        /* if mac_selinux_init() wasn't called before we are a NOOP */
         if (!label_hnd)
                 return 0;
 
-        /* Open the file as O_PATH, to pin it while we determine and adjust the label */
-        fd = open(path, O_NOFOLLOW|O_CLOEXEC|O_PATH);
-        if (fd < 0) {
-                if ((flags & LABEL_IGNORE_ENOENT) && errno == ENOENT)
-                        return 0;
-
-                return -errno;
-        }
-
         if (fstat(fd, &st) < 0)
                 return -errno;
 
-        /* Check for policy reload so 'label_hnd' is kept up-to-date by callbacks */
-        (void) avc_netlink_check_nb();
-
         if (selabel_lookup_raw(label_hnd, &fcon, inside_path, st.st_mode) < 0) {
                 r = -errno;
 
@@ -203,9 +195,12 @@ int mac_selinux_fix_container(const char *path, const char *inside_path, LabelFi
         }
 
         xsprintf(procfs_path, "/proc/self/fd/%i", fd);
-        if (setfilecon_raw(procfs_path, fcon) < 0) {
-                _cleanup_freecon_ char *oldcon = NULL;
 
+        /* Most of the time the label is correct already, and reading it is much cheaper than writing it */
+        if (getfilecon_raw(procfs_path, &oldcon) >= 0 && streq(fcon, oldcon))
+                return 0;
+
+        if (setfilecon_raw(procfs_path, fcon) < 0) {
                 r = -errno;
 
                 /* If the FS doesn't support labels, then exit without warning */
@@ -216,10 +211,6 @@ int mac_selinux_fix_container(const char *path, const char *inside_path, LabelFi
                 if (r == -EROFS && (flags & LABEL_IGNORE_EROFS))
                         return 0;
 
-                /* If the old label is identical to the new one, suppress any kind of error */
-                if (getfilecon_raw(procfs_path, &oldcon) >= 0 && streq(fcon, oldcon))
-                        return 0;
-
                 goto fail;
         }
 
@@ -234,6 +225,45 @@ fail:
         return 0;
 }
 
+int mac_selinux_fix_container(const char *path, const char *inside_path, LabelFixFlags flags) {
+
+#if HAVE_SELINUX
+        _cleanup_close_ int fd = -1;
+
+        assert(path);
+
+        /* if mac_selinux_init() wasn't called before we are a NOOP */
+        if (!label_hnd)
+                return 0;
+
+        /* Open the file as O_PATH, to pin it while we determine and adjust the label */
+        fd = open(path, O_NOFOLLOW|O_CLOEXEC|O_PATH);
+        if (fd < 0) {
+                if ((flags & LABEL_IGNORE_ENOENT) && errno == ENOENT)
+                        return 0;
+
+                return -errno;
+        }
+
+        /* Check for policy reload so 'label_hnd' is kept up-to-date by callbacks */
+        (void) avc_netlink_check_nb();
+
+        return mac_selinux_fix_fd(fd, path, inside_path, flags);
+#else
+        return 0;
+#endif
+}
+
+void mac_selinux_check_policy_reload(void) {
+#if HAVE_SELINUX
+        if (!label_hnd)
+                return;
+
+        /* Check for policy reload so 'label_hnd' is kept up-to-date by callbacks */
+        (void) avc_netlink_check_nb();
+#endif
+}
+
 int mac_selinux_apply(const char *path, const char *label) {
 
 #if HAVE_SELINUX
@@ -26,6 +26,8 @@ int mac_selinux_fix_container(const char *path, const char *inside_path, LabelFi
 static inline int mac_selinux_fix(const char *path, LabelFixFlags flags) {
         return mac_selinux_fix_container(path, path, flags);
 }
+int mac_selinux_fix_fd(int fd, const char *path, const char *inside_path, LabelFixFlags flags);
+void mac_selinux_check_policy_reload(void);
 
 int mac_selinux_apply(const char *path, const char *label);
 
@@ -26,6 +26,13 @@ int internal_set_ensure_allocated(Set **s, const struct hash_ops *hash_ops HASHM
 #define set_ensure_allocated(h, ops) internal_set_ensure_allocated(h, ops HASHMAP_DEBUG_SRC_ARGS)
 
 int set_put(Set *s, const void *key);
+
+static inline int set_put_many(Set *s, void * const *keys, unsigned n) {
+        return internal_hashmap_put_many(HASHMAP_BASE(s), keys, NULL, n);
+}
+
+int internal_set_ensure_put_many(Set **s, const struct hash_ops *hash_ops, void * const *keys, unsigned n  HASHMAP_DEBUG_PARAMS);
+#define set_ensure_put_many(s, ops, keys, n) internal_set_ensure_put_many(s, ops, keys, n  HASHMAP_DEBUG_SRC_ARGS)
 /* no set_update */
 /* no set_replace */
 static inline void *set_get(const Set *s, void *key) {
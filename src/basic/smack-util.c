@@ -121,7 +121,7 @@ int mac_smack_apply_pid(pid_t pid, const char *label) {
         return r;
 }
 
-static int smack_fix_fd(int fd , const char *abspath, LabelFixFlags flags) {
+int mac_smack_fix_fd(int fd, const char *abspath, LabelFixFlags flags) {
         char procfs_path[STRLEN("/proc/self/fd/") + DECIMAL_STR_MAX(int)];
         const char *label;
         struct stat st;
@@ -203,7 +203,7 @@ int mac_smack_fix_at(int dirfd, const char *path, LabelFixFlags flags) {
                 path = p;
         }
 
-        return smack_fix_fd(fd, path, flags);
+        return mac_smack_fix_fd(fd, path, flags);
 }
 
 int mac_smack_fix_container(const char *path, const char *inside_path, LabelFixFlags flags) {
@@ -228,7 +228,7 @@ int mac_smack_fix_container(const char *path, const char *inside_path, LabelFixF
                 return -errno;
         }
 
-        return smack_fix_fd(fd, inside_path, flags);
+        return mac_smack_fix_fd(fd, inside_path, flags);
 }
 
 int mac_smack_copy(const char *dest, const char *src) {
@@ -282,6 +282,10 @@ int mac_smack_fix_at(int dirfd, const char *path, LabelFixFlags flags) {
         return 0;
 }
 
+int mac_smack_fix_fd(int fd, const char *abspath, LabelFixFlags flags) {
+        return 0;
+}
+
 int mac_smack_copy(const char *dest, const char *src) {
         return 0;
 }
@@ -0,0 +1,128 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include "alloc-util.h"
+#include "hashmap.h"
+#include "string-pool.h"
+
+typedef struct StringPoolEntry {
+        unsigned n_ref;
+        char s[];
+} StringPoolEntry;
+
+struct StringPool {
+        /* interned string → StringPoolEntry, the key points into the entry */
+        Hashmap *strings;
+};
+
+StringPool* string_pool_free(StringPool *p) {
+        if (!p)
+                return NULL;
+
+        /* All references should have been released by now, but don't leak entries if not */
+        hashmap_free_free(p->strings);
+        return mfree(p);
+}
+
+static int string_pool_ensure_allocated(StringPool **p) {
+        StringPool *n;
+
+        assert(p);
+
+        if (*p)
+                return 0;
+
+        n = new0(StringPool, 1);
+        if (!n)
+                return -ENOMEM;
+
+        n->strings = hashmap_new(&string_hash_ops);
+        if (!n->strings) {
+                free(n);
+                return -ENOMEM;
+        }
+
+        *p = n;
+        return 1;
+}
+
+static StringPoolEntry* string_pool_find(StringPool *p, const char *s) {
+        StringPoolEntry *e;
+
+        if (!p)
+                return NULL;
+
+        e = hashmap_get(p->strings, s);
+        if (e)
+                e->n_ref++;
+
+        return e;
+}
+
+int string_pool_intern(StringPool **p, const char *s, const char **ret) {
+        StringPoolEntry *e;
+        size_t l;
+        int r;
+
+        assert(p);
+        assert(s);
+        assert(ret);
+
+        e = string_pool_find(*p, s);
+        if (e) {
+                *ret = e->s;
+                return 0;
+        }
+
+        r = string_pool_ensure_allocated(p);
+        if (r < 0)
+                return r;
+
+        l = strlen(s);
+        e = malloc(offsetof(StringPoolEntry, s) + l + 1);
+        if (!e)
+                return -ENOMEM;
+
+        e->n_ref = 1;
+        memcpy(e->s, s, l + 1);
+
+        r = hashmap_put((*p)->strings, e->s, e);
+        if (r < 0) {
+                free(e);
+                return r;
+        }
+
+        *ret = e->s;
+        return 1;
+}
+
+int string_pool_intern_consume(StringPool **p, char *s, const char **ret) {
+        _cleanup_free_ char *f = s;
+
+        return string_pool_intern(p, f, ret);
+}
+
+const char* string_pool_release(StringPool *p, const char *s) {
+        StringPoolEntry *e;
+
+        if (!s)
+                return NULL;
+
+        assert(p);
+
+        e = hashmap_get(p->strings, s);
+        assert(e);
+        assert(e->s == s);
+        assert(e->n_ref > 0);
+
+        if (--e->n_ref > 0)
+                return NULL;
+
+        assert_se(hashmap_remove(p->strings, s) == e);
+        free(e);
+
+        return NULL;
+}
+
+size_t string_pool_size(StringPool *p) {
+        return p ? hashmap_size(p->strings) : 0;
+}
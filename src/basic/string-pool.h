@@ -0,0 +1,30 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+#include <stddef.h>
+
+#include "macro.h"
+
+/* A pool of interned, immutable, reference counted strings. Interning the same string twice returns the
+ * same pointer, hence strings from the same pool may be compared for equality with ==, and each distinct
+ * string is kept in memory only once, no matter how many objects refer to it.
+ *
+ * Unlike struct strbuf, which is built once and never shrinks, strings are dropped from the pool again when
+ * their last reference is released. */
+
+typedef struct StringPool StringPool;
+
+StringPool* string_pool_free(StringPool *p);
+DEFINE_TRIVIAL_CLEANUP_FUNC(StringPool*, string_pool_free);
+
+/* Returns the interned copy of s in *ret, taking a reference, and allocates the pool if necessary */
+int string_pool_intern(StringPool **p, const char *s, const char **ret);
+
+/* Like string_pool_intern(), but takes possession of s, and frees it if the string is already interned
+ * (also on failure) */
+int string_pool_intern_consume(StringPool **p, char *s, const char **ret);
+
+/* Drops a reference taken by string_pool_intern(). Returns NULL. */
+const char* string_pool_release(StringPool *p, const char *s);
+
+size_t string_pool_size(StringPool *p);
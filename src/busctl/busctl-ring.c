@@ -0,0 +1,254 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "bus-dump.h"
+#include "busctl-ring.h"
+#include "fd-util.h"
+#include "fileio.h"
+#include "util.h"
+
+/* A capture ring file starts with a BusRingHeader, followed by the data area, into which the pcap frames of
+ * the captured messages are written one after the other, each padded to a multiple of 8 bytes. When a frame
+ * doesn't fit at the end of the data area anymore, a frame header with incl_len set to BUS_RING_WRAP is
+ * left there (if there is room for it), and writing continues at the beginning, overwriting the oldest
+ * frames. The header is only updated after a frame is written completely, hence the file is consistent
+ * even if we are killed at any point. Frames are copied as they are, everything else is left for
+ * bus_ring_export_pcap(). */
+
+#define BUS_RING_SIGNATURE "BUSRING1"
+#define BUS_RING_WRAP UINT32_MAX
+
+typedef struct _packed_ BusRingHeader {
+        char signature[8];
+        uint64_t data_size;
+        uint64_t snaplen;
+        uint64_t head;          /* where the next frame is written */
+        uint64_t tail;          /* where the oldest frame starts */
+        uint64_t n_frames;
+        uint64_t n_dropped;     /* number of frames overwritten so far */
+} BusRingHeader;
+
+struct BusRing {
+        BusRingHeader *header;
+        uint8_t *data;
+        size_t mapped;
+};
+
+int bus_ring_new(int fd, uint64_t size, size_t snaplen, BusRing **ret) {
+        _cleanup_(bus_ring_freep) BusRing *ring = NULL;
+        struct stat st;
+        uint64_t total;
+        void *p;
+        int r;
+
+        assert(fd >= 0);
+        assert(snaplen > 0);
+        assert(ret);
+
+        size = size & ~UINT64_C(7);
+        if (size < ALIGN8(sizeof(pcaprec_hdr_t) + snaplen))
+                return -ENOBUFS;
+
+        total = sizeof(BusRingHeader) + size;
+        if (total > SIZE_MAX || total > INT64_MAX)
+                return -EFBIG;
+
+        if (fstat(fd, &st) < 0)
+                return -errno;
+        if (!S_ISREG(st.st_mode))
+                return -EBADFD;
+
+        if (ftruncate(fd, 0) < 0)
+                return -errno;
+
+        /* Allocate the whole file now, so that we never run into SIGBUS for lack of disk space later */
+        r = posix_fallocate(fd, 0, total);
+        if (r > 0)
+                return -r;
+
+        p = mmap(NULL, total, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED)
+                return -errno;
+
+        ring = new(BusRing, 1);
+        if (!ring) {
+                (void) munmap(p, total);
+                return -ENOMEM;
+        }
+
+        *ring = (BusRing) {
+                .header = p,
+                .data = (uint8_t*) p + sizeof(BusRingHeader),
+                .mapped = total,
+        };
+
+        *ring->header = (BusRingHeader) {
+                .signature = BUS_RING_SIGNATURE,
+                .data_size = size,
+                .snaplen = snaplen,
+        };
+
+        *ret = TAKE_PTR(ring);
+        return 0;
+}
+
+BusRing *bus_ring_free(BusRing *ring) {
+        if (!ring)
+                return NULL;
+
+        if (ring->header)
+                (void) munmap(ring->header, ring->mapped);
+
+        return mfree(ring);
+}
+
+/* Returns the size of the frame at the specified offset including padding, or 0 if the data continues at
+ * the beginning of the data area */
+static uint64_t ring_frame_size(const uint8_t *data, uint64_t data_size, uint64_t offset) {
+        const pcaprec_hdr_t *h;
+
+        if (data_size - offset < sizeof(pcaprec_hdr_t))
+                return 0;
+
+        h = (const pcaprec_hdr_t*) (data + offset);
+        if (h->incl_len == BUS_RING_WRAP)
+                return 0;
+
+        return ALIGN8(sizeof(pcaprec_hdr_t) + (uint64_t) h->incl_len);
+}
+
+static void bus_ring_drop_oldest(BusRing *ring) {
+        BusRingHeader *h = ring->header;
+        uint64_t sz;
+
+        assert(h->n_frames > 0);
+
+        sz = ring_frame_size(ring->data, h->data_size, h->tail);
+        if (sz == 0) {
+                h->tail = 0;
+                return;
+        }
+
+        h->tail += sz;
+        h->n_frames--;
+        h->n_dropped++;
+
+        if (h->n_frames == 0)
+                h->tail = h->head;
+}
+
+void bus_ring_put(BusRing *ring, sd_bus_message *m) {
+        BusRingHeader *h;
+        uint64_t sz;
+
+        assert(ring);
+        assert(m);
+
+        h = ring->header;
+        sz = ALIGN8(bus_message_pcap_frame_size(m, h->snaplen));
+        assert(sz <= h->data_size);
+
+        if (h->data_size - h->head < sz) {
+                /* Doesn't fit at the end anymore, everything behind us is lost */
+                while (h->n_frames > 0 && h->tail >= h->head)
+                        bus_ring_drop_oldest(ring);
+
+                if (h->data_size - h->head >= sizeof(pcaprec_hdr_t))
+                        ((pcaprec_hdr_t*) (ring->data + h->head))->incl_len = BUS_RING_WRAP;
+
+                h->head = 0;
+                if (h->n_frames == 0)
+                        h->tail = 0;
+        }
+
+        while (h->n_frames > 0 && h->tail >= h->head && h->tail < h->head + sz)
+                bus_ring_drop_oldest(ring);
+
+        bus_message_pcap_frame_to_memory(m, h->snaplen, ring->data + h->head);
+
+        h->head += sz;
+        h->n_frames++;
+}
+
+int bus_ring_export_pcap(const char *path, FILE *f, uint64_t *ret_n_frames, uint64_t *ret_n_dropped) {
+        _cleanup_close_ int fd = -1;
+        const BusRingHeader *h;
+        const uint8_t *data;
+        uint64_t offset, i;
+        struct stat st;
+        void *p;
+        int r;
+
+        assert(path);
+        assert(f);
+
+        fd = open(path, O_RDONLY|O_CLOEXEC|O_NOCTTY);
+        if (fd < 0)
+                return -errno;
+
+        if (fstat(fd, &st) < 0)
+                return -errno;
+        if (!S_ISREG(st.st_mode))
+                return -EBADFD;
+        if ((uint64_t) st.st_size < sizeof(BusRingHeader) || (uint64_t) st.st_size > SIZE_MAX)
+                return -EBADMSG;
+
+        p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED)
+                return -errno;
+
+        h = p;
+        data = (const uint8_t*) p + sizeof(BusRingHeader);
+
+        if (memcmp(h->signature, BUS_RING_SIGNATURE, sizeof(h->signature)) != 0 ||
+            h->data_size != (uint64_t) st.st_size - sizeof(BusRingHeader) ||
+            h->snaplen <= 0 || h->snaplen > UINT32_MAX ||
+            h->head > h->data_size || h->tail > h->data_size) {
+                r = -EBADMSG;
+                goto finish;
+        }
+
+        r = bus_pcap_header(h->snaplen, f);
+        if (r < 0)
+                goto finish;
+
+        for (i = 0, offset = h->tail; i < h->n_frames; i++) {
+                const pcaprec_hdr_t *frame;
+                uint64_t sz;
+
+                sz = ring_frame_size(data, h->data_size, offset);
+                if (sz == 0) {
+                        offset = 0;
+                        sz = ring_frame_size(data, h->data_size, offset);
+                }
+
+                frame = (const pcaprec_hdr_t*) (data + offset);
+                if (sz == 0 || sz > h->data_size - offset || frame->incl_len > h->snaplen) {
+                        r = -EBADMSG;
+                        goto finish;
+                }
+
+                fwrite(frame, 1, sizeof(pcaprec_hdr_t) + frame->incl_len, f);
+                offset += sz;
+        }
+
+        r = fflush_and_check(f);
+        if (r < 0)
+                goto finish;
+
+        if (ret_n_frames)
+                *ret_n_frames = h->n_frames;
+        if (ret_n_dropped)
+                *ret_n_dropped = h->n_dropped;
+
+        r = 0;
+
+finish:
+        (void) munmap(p, st.st_size);
+        return r;
+}
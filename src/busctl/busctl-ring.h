@@ -0,0 +1,18 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+#include <stdio.h>
+
+#include "sd-bus.h"
+
+#include "macro.h"
+
+typedef struct BusRing BusRing;
+
+int bus_ring_new(int fd, uint64_t size, size_t snaplen, BusRing **ret);
+BusRing *bus_ring_free(BusRing *ring);
+DEFINE_TRIVIAL_CLEANUP_FUNC(BusRing*, bus_ring_free);
+
+void bus_ring_put(BusRing *ring, sd_bus_message *m);
+
+int bus_ring_export_pcap(const char *path, FILE *f, uint64_t *ret_n_frames, uint64_t *ret_n_dropped);
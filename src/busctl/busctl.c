@@ -1,6 +1,8 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
 #include <getopt.h>
+#include <poll.h>
+#include <sys/signalfd.h>
 
 #include "sd-bus.h"
 
@@ -12,6 +14,7 @@
 #include "bus-type.h"
 #include "bus-util.h"
 #include "busctl-introspect.h"
+#include "busctl-ring.h"
 #include "escape.h"
 #include "fd-util.h"
 #include "fileio.h"
@@ -25,6 +28,7 @@
 #include "path-util.h"
 #include "pretty-print.h"
 #include "set.h"
+#include "signal-util.h"
 #include "sort-util.h"
 #include "strv.h"
 #include "terminal-util.h"
@@ -49,6 +53,9 @@ static BusTransport arg_transport = BUS_TRANSPORT_LOCAL;
 static const char *arg_host = NULL;
 static bool arg_user = false;
 static size_t arg_snaplen = 4096;
+static uint64_t arg_ring_size = 0;
+static const char *arg_from_ring = NULL;
+static bool arg_stats = false;
 static bool arg_list = false;
 static bool arg_quiet = false;
 static bool arg_verbose = false;
@@ -1200,15 +1207,23 @@ static int introspect(int argc, char **argv, void *userdata) {
         return 0;
 }
 
-static int message_dump(sd_bus_message *m, FILE *f) {
+static int message_dump(sd_bus_message *m, FILE *f, void *userdata) {
         return sd_bus_message_dump(m, f, SD_BUS_MESSAGE_DUMP_WITH_HEADER);
 }
 
-static int message_pcap(sd_bus_message *m, FILE *f) {
+static int message_pcap(sd_bus_message *m, FILE *f, void *userdata) {
         return bus_message_pcap_frame(m, arg_snaplen, f);
 }
 
-static int message_json(sd_bus_message *m, FILE *f) {
+static int message_ring(sd_bus_message *m, FILE *f, void *userdata) {
+        BusRing *ring = userdata;
+
+        /* Just copy the frame, everything else is left for "capture --from-ring=" */
+        bus_ring_put(ring, m);
+        return 0;
+}
+
+static int message_json(sd_bus_message *m, FILE *f, void *userdata) {
         _cleanup_(json_variant_unrefp) JsonVariant *v = NULL, *w = NULL;
         char e[2];
         int r;
@@ -1244,16 +1259,214 @@ static int message_json(sd_bus_message *m, FILE *f) {
         return 0;
 }
 
-static int monitor(int argc, char **argv, int (*dump)(sd_bus_message *m, FILE *f)) {
+typedef struct MessageStats {
+        char *name;
+        uint64_t n_messages;
+        uint64_t n_bytes;
+} MessageStats;
+
+static MessageStats *message_stats_free(MessageStats *s) {
+        if (!s)
+                return NULL;
+
+        free(s->name);
+        return mfree(s);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(MessageStats*, message_stats_free);
+DEFINE_PRIVATE_HASH_OPS_WITH_VALUE_DESTRUCTOR(message_stats_hash_ops, char, string_hash_func, string_compare_func, MessageStats, message_stats_free);
+
+typedef struct MonitorStats {
+        Hashmap *senders;
+        Hashmap *members;
+        usec_t begin;
+} MonitorStats;
+
+static void monitor_stats_done(MonitorStats *stats) {
+        assert(stats);
+
+        stats->senders = hashmap_free(stats->senders);
+        stats->members = hashmap_free(stats->members);
+}
+
+static int message_stats_add(Hashmap **h, const char *name, sd_bus_message *m) {
+        _cleanup_(message_stats_freep) MessageStats *n = NULL;
+        MessageStats *s;
+        int r;
+
+        assert(h);
+        assert(name);
+        assert(m);
+
+        s = hashmap_get(*h, name);
+        if (!s) {
+                r = hashmap_ensure_allocated(h, &message_stats_hash_ops);
+                if (r < 0)
+                        return r;
+
+                n = new0(MessageStats, 1);
+                if (!n)
+                        return -ENOMEM;
+
+                n->name = strdup(name);
+                if (!n->name)
+                        return -ENOMEM;
+
+                r = hashmap_put(*h, n->name, n);
+                if (r < 0)
+                        return r;
+
+                s = TAKE_PTR(n);
+        }
+
+        s->n_messages++;
+        s->n_bytes += BUS_MESSAGE_SIZE(m);
+
+        return 0;
+}
+
+static int monitor_stats_add(MonitorStats *stats, sd_bus_message *m) {
+        const char *member;
+        int r;
+
+        assert(stats);
+        assert(m);
+
+        /* This only counts what sd-bus parsed anyway, no formatting happens here */
+
+        if (m->member)
+                member = m->interface ? strjoina(m->interface, ".", m->member) : m->member;
+        else if (m->error.name)
+                member = m->error.name;
+        else
+                member = bus_message_type_to_string(m->header->type) ?: "n/a";
+
+        r = message_stats_add(&stats->senders, m->sender ?: "n/a", m);
+        if (r < 0)
+                return r;
+
+        return message_stats_add(&stats->members, member, m);
+}
+
+static int monitor_stats_print_one(Hashmap *h, const char *title, usec_t duration) {
+        _cleanup_(table_unrefp) Table *table = NULL;
+        MessageStats *s;
+        Iterator i;
+        int r;
+
+        table = table_new(title, "messages", "bytes", "rate");
+        if (!table)
+                return log_oom();
+
+        (void) table_set_align_percent(table, TABLE_HEADER_CELL(1), 100);
+        (void) table_set_align_percent(table, TABLE_HEADER_CELL(2), 100);
+        (void) table_set_align_percent(table, TABLE_HEADER_CELL(3), 100);
+
+        HASHMAP_FOREACH(s, h, i) {
+                TableCell *cell;
+
+                r = table_add_many(table,
+                                   TABLE_STRING, s->name,
+                                   TABLE_UINT64, s->n_messages,
+                                   TABLE_SET_ALIGN_PERCENT, 100,
+                                   TABLE_SIZE, s->n_bytes,
+                                   TABLE_SET_ALIGN_PERCENT, 100);
+                if (r < 0)
+                        return table_log_add_error(r);
+
+                r = table_add_cell_stringf(table, &cell, "%.1f/s", (double) s->n_messages * USEC_PER_SEC / MAX(duration, 1U));
+                if (r < 0)
+                        return table_log_add_error(r);
+
+                (void) table_set_align_percent(table, cell, 100);
+        }
+
+        r = table_set_sort(table, (size_t) 1, (size_t) 0, (size_t) -1);
+        if (r < 0)
+                return log_error_errno(r, "Failed to set sort column: %m");
+
+        (void) table_set_reverse(table, 1, true);
+
+        r = table_print(table, stderr);
+        if (r < 0)
+                return log_error_errno(r, "Failed to show table: %m");
+
+        return 0;
+}
+
+static void monitor_stats_print(MonitorStats *stats) {
+        char buf[FORMAT_TIMESPAN_MAX];
+        usec_t duration;
+
+        assert(stats);
+
+        duration = usec_sub_unsigned(now(CLOCK_MONOTONIC), stats->begin);
+
+        fprintf(stderr, "\nMessages per sender in %s:\n", format_timespan(buf, sizeof(buf), duration, USEC_PER_MSEC));
+        (void) monitor_stats_print_one(stats->senders, "sender", duration);
+
+        fprintf(stderr, "\nMessages per member:\n");
+        (void) monitor_stats_print_one(stats->members, "member", duration);
+}
+
+/* Returns > 0 if the bus needs processing, 0 if we received a termination signal */
+static int monitor_wait(sd_bus *bus, int signal_fd) {
+        struct pollfd p[2];
+        int fd, events, r;
+
+        if (signal_fd < 0) {
+                r = sd_bus_wait(bus, (uint64_t) -1);
+                return r < 0 ? r : 1;
+        }
+
+        fd = sd_bus_get_fd(bus);
+        if (fd < 0)
+                return fd;
+
+        events = sd_bus_get_events(bus);
+        if (events < 0)
+                return events;
+
+        p[0] = (struct pollfd) {
+                .fd = fd,
+                .events = events,
+        };
+        p[1] = (struct pollfd) {
+                .fd = signal_fd,
+                .events = POLLIN,
+        };
+
+        if (poll(p, ELEMENTSOF(p), -1) < 0)
+                return errno == EINTR ? 1 : -errno;
+
+        return p[1].revents == 0;
+}
+
+static int monitor(int argc, char **argv, int (*dump)(sd_bus_message *m, FILE *f, void *userdata), void *userdata) {
         _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
         _cleanup_(sd_bus_message_unrefp) sd_bus_message *message = NULL;
         _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+        _cleanup_(monitor_stats_done) MonitorStats stats = {};
+        _cleanup_close_ int signal_fd = -1;
         char **i;
         uint32_t flags = 0;
         const char *unique_name;
         bool is_monitor = false;
         int r;
 
+        if (arg_stats) {
+                sigset_t mask;
+
+                /* Catch termination signals, so that we can show the statistics */
+                assert_se(sigemptyset(&mask) >= 0);
+                assert_se(sigset_add_many(&mask, SIGINT, SIGTERM, -1) >= 0);
+                assert_se(sigprocmask(SIG_BLOCK, &mask, NULL) >= 0);
+
+                signal_fd = signalfd(-1, &mask, SFD_NONBLOCK|SFD_CLOEXEC);
+                if (signal_fd < 0)
+                        return log_error_errno(errno, "Failed to allocate signal fd: %m");
+        }
+
         r = acquire_bus(true, &bus);
         if (r < 0)
                 return r;
@@ -1321,6 +1534,8 @@ static int monitor(int argc, char **argv, int (*dump)(sd_bus_message *m, FILE *f
 
         log_info("Monitoring bus message stream.");
 
+        stats.begin = now(CLOCK_MONOTONIC);
+
         for (;;) {
                 _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
 
@@ -1346,12 +1561,18 @@ static int monitor(int argc, char **argv, int (*dump)(sd_bus_message *m, FILE *f
                 }
 
                 if (m) {
-                        dump(m, stdout);
+                        dump(m, stdout, userdata);
                         fflush(stdout);
 
                         if (sd_bus_message_is_signal(m, "org.freedesktop.DBus.Local", "Disconnected") > 0) {
                                 log_info("Connection terminated, exiting.");
-                                return 0;
+                                break;
+                        }
+
+                        if (arg_stats) {
+                                r = monitor_stats_add(&stats, m);
+                                if (r < 0)
+                                        return log_error_errno(r, "Failed to update statistics: %m");
                         }
 
                         continue;
@@ -1360,14 +1581,54 @@ static int monitor(int argc, char **argv, int (*dump)(sd_bus_message *m, FILE *f
                 if (r > 0)
                         continue;
 
-                r = sd_bus_wait(bus, (uint64_t) -1);
+                r = monitor_wait(bus, signal_fd);
                 if (r < 0)
                         return log_error_errno(r, "Failed to wait for bus: %m");
+                if (r == 0)
+                        break;
         }
+
+        if (arg_stats)
+                monitor_stats_print(&stats);
+
+        return 0;
 }
 
 static int verb_monitor(int argc, char **argv, void *userdata) {
-        return monitor(argc, argv, arg_json != JSON_OFF ? message_json : message_dump);
+        return monitor(argc, argv, arg_json != JSON_OFF ? message_json : message_dump, NULL);
+}
+
+static int capture_ring(int argc, char **argv) {
+        _cleanup_(bus_ring_freep) BusRing *ring = NULL;
+        int r;
+
+        r = bus_ring_new(fileno(stdout), arg_ring_size, arg_snaplen, &ring);
+        if (r == -EBADFD)
+                return log_error_errno(r, "Capturing into a ring buffer requires output to be redirected to a regular file.");
+        if (r == -ENOBUFS)
+                return log_error_errno(r, "Ring buffer too small for messages of the maximum captured length.");
+        if (r < 0)
+                return log_error_errno(r, "Failed to allocate ring buffer: %m");
+
+        return monitor(argc, argv, message_ring, ring);
+}
+
+static int capture_export_ring(int argc, char **argv) {
+        uint64_t n_frames, n_dropped;
+        int r;
+
+        if (argc > 1)
+                return log_error_errno(SYNTHETIC_ERRNO(EINVAL),
+                                       "Services may not be specified when exporting a ring buffer.");
+
+        r = bus_ring_export_pcap(arg_from_ring, stdout, &n_frames, &n_dropped);
+        if (r == -EBADMSG)
+                return log_error_errno(r, "File %s is not a valid ring buffer.", arg_from_ring);
+        if (r < 0)
+                return log_error_errno(r, "Failed to export ring buffer %s: %m", arg_from_ring);
+
+        log_info("Exported %" PRIu64 " messages, %" PRIu64 " older messages were overwritten.", n_frames, n_dropped);
+        return 0;
 }
 
 static int verb_capture(int argc, char **argv, void *userdata) {
@@ -1377,9 +1638,15 @@ static int verb_capture(int argc, char **argv, void *userdata) {
                 return log_error_errno(SYNTHETIC_ERRNO(EINVAL),
                                        "Refusing to write message data to console, please redirect output to a file.");
 
+        if (arg_from_ring)
+                return capture_export_ring(argc, argv);
+
+        if (arg_ring_size > 0)
+                return capture_ring(argc, argv);
+
         bus_pcap_header(arg_snaplen, stdout);
 
-        r = monitor(argc, argv, message_pcap);
+        r = monitor(argc, argv, message_pcap, NULL);
         if (r < 0)
                 return r;
 
@@ -2318,6 +2585,9 @@ static int help(void) {
                "     --activatable         Only show activatable names\n"
                "     --match=MATCH         Only show matching messages\n"
                "     --size=SIZE           Maximum length of captured packet\n"
+               "     --ring-buffer=SIZE    Capture into a ring buffer of this size\n"
+               "     --from-ring=FILE      Convert a ring buffer into a pcap file\n"
+               "     --stats               Show message statistics per sender and member\n"
                "     --list                Don't show tree, but simple object path list\n"
                "  -q --quiet               Don't show method call reply\n"
                "     --verbose             Show result values in long format\n"
@@ -2372,6 +2642,9 @@ static int parse_argv(int argc, char *argv[]) {
                 ARG_WATCH_BIND,
                 ARG_JSON,
                 ARG_DESTINATION,
+                ARG_RING_BUFFER,
+                ARG_FROM_RING,
+                ARG_STATS,
         };
 
         static const struct option options[] = {
@@ -2403,6 +2676,9 @@ static int parse_argv(int argc, char *argv[]) {
                 { "watch-bind",                      required_argument, NULL, ARG_WATCH_BIND                      },
                 { "json",                            required_argument, NULL, ARG_JSON                            },
                 { "destination",                     required_argument, NULL, ARG_DESTINATION                     },
+                { "ring-buffer",                     required_argument, NULL, ARG_RING_BUFFER                     },
+                { "from-ring",                       required_argument, NULL, ARG_FROM_RING                       },
+                { "stats",                           no_argument,       NULL, ARG_STATS                           },
                 {},
         };
 
@@ -2581,6 +2857,20 @@ static int parse_argv(int argc, char *argv[]) {
                         arg_destination = optarg;
                         break;
 
+                case ARG_RING_BUFFER:
+                        r = parse_size(optarg, 1024, &arg_ring_size);
+                        if (r < 0)
+                                return log_error_errno(r, "Failed to parse size '%s': %m", optarg);
+                        break;
+
+                case ARG_FROM_RING:
+                        arg_from_ring = optarg;
+                        break;
+
+                case ARG_STATS:
+                        arg_stats = true;
+                        break;
+
                 case '?':
                         return -EINVAL;
 
@@ -0,0 +1,180 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "sd-bus.h"
+
+#include "alloc-util.h"
+#include "bus-dump.h"
+#include "bus-message.h"
+#include "busctl-ring.h"
+#include "fd-util.h"
+#include "fileio.h"
+#include "fs-util.h"
+#include "tests.h"
+#include "tmpfile-util.h"
+
+/* The global pcap header, see bus_pcap_header() */
+#define PCAP_HEADER_SIZE 24U
+
+static sd_bus_message *make_message(sd_bus *bus, uint32_t serial) {
+        sd_bus_message *m;
+
+        assert_se(sd_bus_message_new_method_call(bus, &m, "foobar.waldo", "/", "foobar.waldo", "Piep") >= 0);
+        assert_se(sd_bus_message_append(m, "u", serial) >= 0);
+        assert_se(sd_bus_message_seal(m, serial, 0) >= 0);
+
+        return m;
+}
+
+static void put(BusRing *ring, sd_bus *bus, uint32_t serial) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+
+        m = make_message(bus, serial);
+        bus_ring_put(ring, m);
+}
+
+/* Exports the ring and checks that it contains the frames of the messages with the specified serials, in
+ * this order, and how many were dropped */
+static void check_export(const char *path, size_t snaplen, size_t message_size,
+                         const uint32_t *serials, size_t n_serials, uint64_t n_dropped) {
+        _cleanup_fclose_ FILE *f = NULL;
+        _cleanup_free_ char *buf = NULL;
+        uint64_t frames, dropped;
+        size_t sz, offset, i;
+
+        assert_se(f = open_memstream_unlocked(&buf, &sz));
+        assert_se(bus_ring_export_pcap(path, f, &frames, &dropped) >= 0);
+        f = safe_fclose(f);
+
+        assert_se(frames == n_serials);
+        assert_se(dropped == n_dropped);
+
+        /* Frames are exported without the padding they have in the ring */
+        assert_se(sz == PCAP_HEADER_SIZE + n_serials * (sizeof(pcaprec_hdr_t) + MIN(message_size, snaplen)));
+
+        for (i = 0, offset = PCAP_HEADER_SIZE; i < n_serials; i++) {
+                pcaprec_hdr_t hdr;
+                struct bus_header bh;
+
+                memcpy(&hdr, buf + offset, sizeof(hdr));
+                assert_se(hdr.orig_len == message_size);
+                assert_se(hdr.incl_len == MIN(message_size, snaplen));
+                offset += sizeof(hdr);
+
+                /* Messages are created in native byte order */
+                memcpy(&bh, buf + offset, sizeof(bh));
+                assert_se(bh.dbus1.serial == serials[i]);
+                offset += hdr.incl_len;
+        }
+
+        assert_se(offset == sz);
+}
+
+static void test_ring(sd_bus *bus, size_t message_size, size_t snaplen) {
+        _cleanup_(unlink_tempfilep) char path[] = "/tmp/test-busctl-ring.XXXXXX";
+        _cleanup_(bus_ring_freep) BusRing *ring = NULL;
+        _cleanup_close_ int fd = -1;
+        size_t frame_size;
+
+        log_info("/* %s(%zu) */", __func__, snaplen);
+
+        /* All messages are of the same size, which is also the largest frame the ring has to hold */
+        assert_se(snaplen <= message_size);
+        frame_size = ALIGN8(sizeof(pcaprec_hdr_t) + snaplen);
+
+        assert_se((fd = mkostemp_safe(path)) >= 0);
+
+        /* Room for three frames, and a wrap marker behind them */
+        assert_se(bus_ring_new(fd, frame_size - 1, snaplen, &ring) == -ENOBUFS);
+        assert_se(bus_ring_new(fd, 3 * frame_size + sizeof(pcaprec_hdr_t), snaplen, &ring) >= 0);
+
+        check_export(path, snaplen, message_size, NULL, 0, 0);
+
+        put(ring, bus, 1);
+        put(ring, bus, 2);
+        check_export(path, snaplen, message_size, (const uint32_t[]) { 1, 2 }, 2, 0);
+
+        put(ring, bus, 3);
+        check_export(path, snaplen, message_size, (const uint32_t[]) { 1, 2, 3 }, 3, 0);
+
+        /* The fourth frame doesn't fit at the end anymore, and overwrites the first one */
+        put(ring, bus, 4);
+        check_export(path, snaplen, message_size, (const uint32_t[]) { 2, 3, 4 }, 3, 1);
+
+        put(ring, bus, 5);
+        check_export(path, snaplen, message_size, (const uint32_t[]) { 3, 4, 5 }, 3, 2);
+
+        /* Now the oldest frame is at the beginning, and the export has to follow the wrap marker */
+        put(ring, bus, 6);
+        check_export(path, snaplen, message_size, (const uint32_t[]) { 4, 5, 6 }, 3, 3);
+
+        /* And around once more, the wrap marker at the end doesn't count as a frame */
+        put(ring, bus, 7);
+        check_export(path, snaplen, message_size, (const uint32_t[]) { 5, 6, 7 }, 3, 4);
+
+        put(ring, bus, 8);
+        put(ring, bus, 9);
+        put(ring, bus, 10);
+        check_export(path, snaplen, message_size, (const uint32_t[]) { 8, 9, 10 }, 3, 7);
+}
+
+static void test_export_invalid(sd_bus *bus) {
+        _cleanup_(unlink_tempfilep) char path[] = "/tmp/test-busctl-ring.XXXXXX";
+        _cleanup_(bus_ring_freep) BusRing *ring = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+        _cleanup_free_ char *buf = NULL;
+        _cleanup_close_ int fd = -1;
+        size_t sz;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(f = open_memstream_unlocked(&buf, &sz));
+
+        assert_se((fd = mkostemp_safe(path)) >= 0);
+        assert_se(bus_ring_export_pcap(path, f, NULL, NULL) == -EBADMSG);
+
+        assert_se(bus_ring_new(fd, 4096, 1024, &ring) >= 0);
+        put(ring, bus, 1);
+        assert_se(bus_ring_export_pcap(path, f, NULL, NULL) >= 0);
+
+        /* Not a ring at all */
+        assert_se(pwrite(fd, "XXXXXXXX", 8, 0) == 8);
+        assert_se(bus_ring_export_pcap(path, f, NULL, NULL) == -EBADMSG);
+        assert_se(pwrite(fd, "BUSRING1", 8, 0) == 8);
+        assert_se(bus_ring_export_pcap(path, f, NULL, NULL) >= 0);
+
+        /* A file of a different size than the header says */
+        assert_se(ftruncate(fd, 4096) >= 0);
+        assert_se(bus_ring_export_pcap(path, f, NULL, NULL) == -EBADMSG);
+
+        assert_se(bus_ring_export_pcap("/dev/null", f, NULL, NULL) == -EBADFD);
+}
+
+int main(int argc, char *argv[]) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+        _cleanup_(sd_bus_unrefp) sd_bus *bus = NULL;
+        _cleanup_close_pair_ int pair[2] = { -1, -1 };
+        size_t message_size;
+
+        test_setup_logging(LOG_DEBUG);
+
+        /* Messages can only be created on a started bus, but they are never sent */
+        assert_se(socketpair(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0, pair) >= 0);
+        assert_se(sd_bus_new(&bus) >= 0);
+        assert_se(sd_bus_set_fd(bus, pair[0], pair[0]) >= 0);
+        TAKE_FD(pair[0]);
+        assert_se(sd_bus_start(bus) >= 0);
+
+        m = make_message(bus, 1);
+        message_size = BUS_MESSAGE_SIZE(m);
+
+        /* Complete messages, and just the beginning of them */
+        test_ring(bus, message_size, message_size);
+        test_ring(bus, message_size, sizeof(struct bus_header) + 4);
+        test_export_invalid(bus);
+
+        return 0;
+}
@@ -15,7 +15,6 @@
 #include "cgroup-show.h"
 #include "cgroup-util.h"
 #include "fd-util.h"
-#include "fileio.h"
 #include "hashmap.h"
 #include "main-func.h"
 #include "missing_sched.h"
@@ -24,6 +23,7 @@
 #include "pretty-print.h"
 #include "process-util.h"
 #include "procfs-util.h"
+#include "rlimit-util.h"
 #include "sort-util.h"
 #include "stdio-util.h"
 #include "strv.h"
@@ -52,6 +52,12 @@ typedef struct Group {
         uint64_t io_input, io_output;
         nsec_t io_timestamp;
         uint64_t io_input_bps, io_output_bps;
+
+        /* The attribute files we read on every iteration, kept open so that we can just pread() them */
+        int pids_fd;
+        int memory_fd;
+        int io_fd;
+        int cpu_fd;
 } Group;
 
 static unsigned arg_depth = 3;
@@ -87,10 +93,80 @@ static Group *group_free(Group *g) {
         if (!g)
                 return NULL;
 
+        safe_close(g->pids_fd);
+        safe_close(g->memory_fd);
+        safe_close(g->io_fd);
+        safe_close(g->cpu_fd);
+
         free(g->path);
         return mfree(g);
 }
 
+static int group_read_attribute(int *fd, const char *controller, const char *path, const char *attribute, char **ret) {
+        _cleanup_free_ char *buf = NULL;
+        size_t allocated = 0, size = 0;
+        int r;
+
+        assert(fd);
+        assert(controller);
+        assert(path);
+        assert(attribute);
+        assert(ret);
+
+        /* Reads an attribute file of a cgroup. The file is opened on first use only, after that we just
+         * read it again from the start. Returns -ENOENT if the cgroup is gone. */
+
+        if (*fd < 0) {
+                _cleanup_free_ char *p = NULL;
+
+                r = cg_get_path(controller, path, attribute, &p);
+                if (r < 0)
+                        return r;
+
+                *fd = open(p, O_RDONLY|O_CLOEXEC|O_NOCTTY);
+                if (*fd < 0)
+                        return -errno;
+        }
+
+        for (;;) {
+                ssize_t n;
+
+                if (!GREEDY_REALLOC(buf, allocated, size + 4096 + 1))
+                        return -ENOMEM;
+
+                n = pread(*fd, buf + size, allocated - size - 1, size);
+                if (n < 0) {
+                        r = -errno;
+
+                        /* Don't keep stale fds of removed cgroups around */
+                        *fd = safe_close(*fd);
+                        return r == -ENODEV ? -ENOENT : r;
+                }
+                if (n == 0)
+                        break;
+
+                size += n;
+        }
+
+        buf[size] = 0;
+
+        *ret = TAKE_PTR(buf);
+        return 0;
+}
+
+static int group_read_attribute_u64(int *fd, const char *controller, const char *path, const char *attribute, uint64_t *ret) {
+        _cleanup_free_ char *v = NULL;
+        int r;
+
+        assert(ret);
+
+        r = group_read_attribute(fd, controller, path, attribute, &v);
+        if (r < 0)
+                return r;
+
+        return safe_atou64(strstrip(v), ret);
+}
+
 static const char *maybe_format_bytes(char *buf, size_t l, bool is_valid, uint64_t t) {
         if (!is_valid)
                 return "-";
@@ -152,6 +228,8 @@ static int process(
                         if (!g)
                                 return -ENOMEM;
 
+                        g->pids_fd = g->memory_fd = g->io_fd = g->cpu_fd = -1;
+
                         g->path = strdup(path);
                         if (!g->path) {
                                 group_free(g);
@@ -202,21 +280,11 @@ static int process(
                         if (r < 0)
                                 return r;
                 } else {
-                        _cleanup_free_ char *p = NULL, *v = NULL;
-
-                        r = cg_get_path(controller, path, "pids.current", &p);
-                        if (r < 0)
-                                return r;
-
-                        r = read_one_line_file(p, &v);
+                        r = group_read_attribute_u64(&g->pids_fd, controller, path, "pids.current", &g->n_tasks);
                         if (r == -ENOENT)
                                 return 0;
                         if (r < 0)
                                 return r;
-
-                        r = safe_atou64(v, &g->n_tasks);
-                        if (r < 0)
-                                return r;
                 }
 
                 if (g->n_tasks > 0)
@@ -229,24 +297,13 @@ static int process(
                         if (r < 0)
                                 return r;
                 } else {
-                        _cleanup_free_ char *p = NULL, *v = NULL;
-
-                        if (all_unified)
-                                r = cg_get_path(controller, path, "memory.current", &p);
-                        else
-                                r = cg_get_path(controller, path, "memory.usage_in_bytes", &p);
-                        if (r < 0)
-                                return r;
-
-                        r = read_one_line_file(p, &v);
+                        r = group_read_attribute_u64(&g->memory_fd, controller, path,
+                                                     all_unified ? "memory.current" : "memory.usage_in_bytes",
+                                                     &g->memory);
                         if (r == -ENOENT)
                                 return 0;
                         if (r < 0)
                                 return r;
-
-                        r = safe_atou64(v, &g->memory);
-                        if (r < 0)
-                                return r;
                 }
 
                 if (g->memory > 0)
@@ -254,35 +311,28 @@ static int process(
 
         } else if ((streq(controller, "io") && all_unified) ||
                    (streq(controller, "blkio") && !all_unified)) {
-                _cleanup_fclose_ FILE *f = NULL;
-                _cleanup_free_ char *p = NULL;
+                _cleanup_strv_free_ char **lines = NULL;
+                _cleanup_free_ char *v = NULL;
                 uint64_t wr = 0, rd = 0;
                 nsec_t timestamp;
+                char **line;
 
-                r = cg_get_path(controller, path, all_unified ? "io.stat" : "blkio.io_service_bytes", &p);
+                r = group_read_attribute(&g->io_fd, controller, path, all_unified ? "io.stat" : "blkio.io_service_bytes", &v);
+                if (r == -ENOENT)
+                        return 0;
                 if (r < 0)
                         return r;
 
-                f = fopen(p, "re");
-                if (!f) {
-                        if (errno == ENOENT)
-                                return 0;
-                        return -errno;
-                }
+                lines = strv_split_newlines(v);
+                if (!lines)
+                        return -ENOMEM;
 
-                for (;;) {
-                        _cleanup_free_ char *line = NULL;
+                STRV_FOREACH(line, lines) {
                         uint64_t k, *q;
                         char *l;
 
-                        r = read_line(f, LONG_LINE_MAX, &line);
-                        if (r < 0)
-                                return r;
-                        if (r == 0)
-                                break;
-
                         /* Trim and skip the device */
-                        l = strstrip(line);
+                        l = strstrip(*line);
                         l += strcspn(l, WHITESPACE);
                         l += strspn(l, WHITESPACE);
 
@@ -346,7 +396,6 @@ static int process(
                 g->io_timestamp = timestamp;
                 g->io_iteration = iteration;
         } else if (STR_IN_SET(controller, "cpu", "cpuacct") || cpu_accounting_is_cheap()) {
-                _cleanup_free_ char *p = NULL, *v = NULL;
                 uint64_t new_usage;
                 nsec_t timestamp;
 
@@ -355,18 +404,37 @@ static int process(
                         if (r < 0)
                                 return r;
                 } else if (all_unified) {
+                        _cleanup_strv_free_ char **lines = NULL;
                         _cleanup_free_ char *val = NULL;
+                        const char *usage = NULL;
+                        char **line;
 
                         if (!streq(controller, "cpu"))
                                 return 0;
 
-                        r = cg_get_keyed_attribute("cpu", path, "cpu.stat", STRV_MAKE("usage_usec"), &val);
-                        if (IN_SET(r, -ENOENT, -ENXIO))
+                        r = group_read_attribute(&g->cpu_fd, "cpu", path, "cpu.stat", &val);
+                        if (r == -ENOENT)
                                 return 0;
                         if (r < 0)
                                 return r;
 
-                        r = safe_atou64(val, &new_usage);
+                        lines = strv_split_newlines(val);
+                        if (!lines)
+                                return -ENOMEM;
+
+                        STRV_FOREACH(line, lines) {
+                                const char *w;
+
+                                w = first_word(*line, "usage_usec");
+                                if (w) {
+                                        usage = w;
+                                        break;
+                                }
+                        }
+                        if (!usage)
+                                return 0;
+
+                        r = safe_atou64(usage, &new_usage);
                         if (r < 0)
                                 return r;
 
@@ -375,19 +443,11 @@ static int process(
                         if (!streq(controller, "cpuacct"))
                                 return 0;
 
-                        r = cg_get_path(controller, path, "cpuacct.usage", &p);
-                        if (r < 0)
-                                return r;
-
-                        r = read_one_line_file(p, &v);
+                        r = group_read_attribute_u64(&g->cpu_fd, controller, path, "cpuacct.usage", &new_usage);
                         if (r == -ENOENT)
                                 return 0;
                         if (r < 0)
                                 return r;
-
-                        r = safe_atou64(v, &new_usage);
-                        if (r < 0)
-                                return r;
                 }
 
                 timestamp = now_nsec(CLOCK_MONOTONIC);
@@ -920,6 +980,9 @@ static int run(int argc, char *argv[]) {
         if (r < 0)
                 return log_error_errno(r, "Failed to determine supported controllers: %m");
 
+        /* We keep a couple of attribute files open for each cgroup */
+        (void) rlimit_nofile_bump(-1);
+
         arg_count = (mask & CGROUP_MASK_PIDS) ? COUNT_PIDS : COUNT_USERSPACE_PROCESSES;
 
         if (arg_recursive_unset && arg_count == COUNT_PIDS)
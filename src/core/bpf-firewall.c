@@ -18,9 +18,12 @@
 #include "bpf-firewall.h"
 #include "bpf-program.h"
 #include "fd-util.h"
+#include "hexdecoct.h"
 #include "ip-address-access.h"
 #include "memory-util.h"
 #include "missing_syscall.h"
+#include "stdio-util.h"
+#include "string-util.h"
 #include "unit.h"
 #include "strv.h"
 #include "virt.h"
@@ -35,6 +38,29 @@ enum {
         ACCESS_DENIED  = 2,
 };
 
+/* The access maps, and the programs built from them alone, only depend on the effective IP access lists of a unit.
+ * Many units usually end up with the very same lists (typically those set on a common slice), hence we share them
+ * among all units with identical lists, so that the LPM tries are created and filled, and the programs verified by
+ * the kernel, only once. Only the accounting maps (and the programs referencing them) are per unit. */
+struct BPFFirewallAccess {
+        unsigned n_ref;
+
+        Manager *manager;
+        char *key;
+
+        int ipv4_allow_map_fd;
+        int ipv6_allow_map_fd;
+        int ipv4_deny_map_fd;
+        int ipv6_deny_map_fd;
+
+        bool allow_any;
+        bool deny_any;
+
+        /* Programs without accounting, shared by all units with IPAccounting= off */
+        BPFProgram *ingress;
+        BPFProgram *egress;
+};
+
 /* Compile instructions for one list of addresses, one direction and one specific verdict on matches. */
 
 static int add_lookup_instructions(
@@ -144,11 +170,10 @@ static int add_instructions_for_ip_any(
 }
 
 static int bpf_firewall_compile_bpf(
-                Unit *u,
+                BPFFirewallAccess *a,
+                int accounting_map_fd,
                 bool is_ingress,
-                BPFProgram **ret,
-                bool ip_allow_any,
-                bool ip_deny_any) {
+                BPFProgram **ret) {
 
         const struct bpf_insn pre_insn[] = {
                 /*
@@ -193,25 +218,11 @@ static int bpf_firewall_compile_bpf(
         };
 
         _cleanup_(bpf_program_unrefp) BPFProgram *p = NULL;
-        int accounting_map_fd, r;
-        bool access_enabled;
+        int r;
 
-        assert(u);
         assert(ret);
 
-        accounting_map_fd = is_ingress ?
-                u->ip_accounting_ingress_map_fd :
-                u->ip_accounting_egress_map_fd;
-
-        access_enabled =
-                u->ipv4_allow_map_fd >= 0 ||
-                u->ipv6_allow_map_fd >= 0 ||
-                u->ipv4_deny_map_fd >= 0 ||
-                u->ipv6_deny_map_fd >= 0 ||
-                ip_allow_any ||
-                ip_deny_any;
-
-        if (accounting_map_fd < 0 && !access_enabled) {
+        if (accounting_map_fd < 0 && !a) {
                 *ret = NULL;
                 return 0;
         }
@@ -224,7 +235,7 @@ static int bpf_firewall_compile_bpf(
         if (r < 0)
                 return r;
 
-        if (access_enabled) {
+        if (a) {
                 /*
                  * The simple rule this function translates into eBPF instructions is:
                  *
@@ -233,37 +244,37 @@ static int bpf_firewall_compile_bpf(
                  * - Otherwise, access will be granted
                  */
 
-                if (u->ipv4_deny_map_fd >= 0) {
-                        r = add_lookup_instructions(p, u->ipv4_deny_map_fd, ETH_P_IP, is_ingress, ACCESS_DENIED);
+                if (a->ipv4_deny_map_fd >= 0) {
+                        r = add_lookup_instructions(p, a->ipv4_deny_map_fd, ETH_P_IP, is_ingress, ACCESS_DENIED);
                         if (r < 0)
                                 return r;
                 }
 
-                if (u->ipv6_deny_map_fd >= 0) {
-                        r = add_lookup_instructions(p, u->ipv6_deny_map_fd, ETH_P_IPV6, is_ingress, ACCESS_DENIED);
+                if (a->ipv6_deny_map_fd >= 0) {
+                        r = add_lookup_instructions(p, a->ipv6_deny_map_fd, ETH_P_IPV6, is_ingress, ACCESS_DENIED);
                         if (r < 0)
                                 return r;
                 }
 
-                if (u->ipv4_allow_map_fd >= 0) {
-                        r = add_lookup_instructions(p, u->ipv4_allow_map_fd, ETH_P_IP, is_ingress, ACCESS_ALLOWED);
+                if (a->ipv4_allow_map_fd >= 0) {
+                        r = add_lookup_instructions(p, a->ipv4_allow_map_fd, ETH_P_IP, is_ingress, ACCESS_ALLOWED);
                         if (r < 0)
                                 return r;
                 }
 
-                if (u->ipv6_allow_map_fd >= 0) {
-                        r = add_lookup_instructions(p, u->ipv6_allow_map_fd, ETH_P_IPV6, is_ingress, ACCESS_ALLOWED);
+                if (a->ipv6_allow_map_fd >= 0) {
+                        r = add_lookup_instructions(p, a->ipv6_allow_map_fd, ETH_P_IPV6, is_ingress, ACCESS_ALLOWED);
                         if (r < 0)
                                 return r;
                 }
 
-                if (ip_allow_any) {
+                if (a->allow_any) {
                         r = add_instructions_for_ip_any(p, ACCESS_ALLOWED);
                         if (r < 0)
                                 return r;
                 }
 
-                if (ip_deny_any) {
+                if (a->deny_any) {
                         r = add_instructions_for_ip_any(p, ACCESS_DENIED);
                         if (r < 0)
                                 return r;
@@ -517,10 +528,181 @@ static int bpf_firewall_prepare_accounting_maps(Unit *u, bool enabled, int *fd_i
         return 0;
 }
 
+static BPFFirewallAccess *bpf_firewall_access_free(BPFFirewallAccess *a) {
+        assert(a);
+
+        if (a->manager && a->key)
+                (void) hashmap_remove_value(a->manager->bpf_firewall_access, a->key, a);
+
+        safe_close(a->ipv4_allow_map_fd);
+        safe_close(a->ipv6_allow_map_fd);
+        safe_close(a->ipv4_deny_map_fd);
+        safe_close(a->ipv6_deny_map_fd);
+
+        bpf_program_unref(a->ingress);
+        bpf_program_unref(a->egress);
+
+        free(a->key);
+        return mfree(a);
+}
+
+DEFINE_PRIVATE_TRIVIAL_REF_FUNC(BPFFirewallAccess, bpf_firewall_access);
+DEFINE_TRIVIAL_UNREF_FUNC(BPFFirewallAccess, bpf_firewall_access, bpf_firewall_access_free);
+DEFINE_TRIVIAL_CLEANUP_FUNC(BPFFirewallAccess*, bpf_firewall_access_unref);
+
+static int bpf_firewall_access_key_append(Unit *u, int verdict, char **key) {
+        IPAddressAccessItem *list, *a;
+        bool found = false;
+        Unit *p;
+
+        assert(u);
+        assert(key);
+
+        /* Serializes the effective list of one verdict in a way that is identical for identical lists. Note that this
+         * mirrors bpf_firewall_prepare_access_maps(): if "any" shows up anywhere on the way up, it's all that
+         * matters. */
+
+        if (!strextend(key, verdict == ACCESS_ALLOWED ? "allow=" : ";deny=", NULL))
+                return -ENOMEM;
+
+        for (p = u; p; p = UNIT_DEREF(p->slice)) {
+                CGroupContext *cc;
+
+                cc = unit_get_cgroup_context(p);
+                if (!cc)
+                        continue;
+
+                list = verdict == ACCESS_ALLOWED ? cc->ip_address_allow : cc->ip_address_deny;
+                if (ip_address_access_item_is_any(list))
+                        return strextend(key, "any", NULL) ? 1 : -ENOMEM;
+        }
+
+        for (p = u; p; p = UNIT_DEREF(p->slice)) {
+                CGroupContext *cc;
+
+                cc = unit_get_cgroup_context(p);
+                if (!cc)
+                        continue;
+
+                list = verdict == ACCESS_ALLOWED ? cc->ip_address_allow : cc->ip_address_deny;
+
+                LIST_FOREACH(items, a, list) {
+                        char prefix[DECIMAL_STR_MAX(int) + 1 + DECIMAL_STR_MAX(unsigned) + 2];
+                        _cleanup_free_ char *hex = NULL;
+
+                        if (!IN_SET(a->family, AF_INET, AF_INET6))
+                                return -EAFNOSUPPORT;
+
+                        hex = hexmem(&a->address, FAMILY_ADDRESS_SIZE(a->family));
+                        if (!hex)
+                                return -ENOMEM;
+
+                        xsprintf(prefix, "%i/%u/", a->family, (unsigned) a->prefixlen);
+
+                        if (!strextend(key, prefix, hex, ",", NULL))
+                                return -ENOMEM;
+
+                        found = true;
+                }
+        }
+
+        return found;
+}
+
+static int bpf_firewall_access_get(Unit *u, BPFFirewallAccess **ret) {
+        _cleanup_(bpf_firewall_access_unrefp) BPFFirewallAccess *a = NULL;
+        _cleanup_free_ char *key = NULL;
+        BPFFirewallAccess *existing;
+        int r, allow, deny;
+
+        assert(u);
+        assert(ret);
+
+        allow = bpf_firewall_access_key_append(u, ACCESS_ALLOWED, &key);
+        if (allow < 0)
+                return allow;
+
+        deny = bpf_firewall_access_key_append(u, ACCESS_DENIED, &key);
+        if (deny < 0)
+                return deny;
+
+        if (allow == 0 && deny == 0) {
+                /* No access lists configured anywhere, nothing to do */
+                *ret = NULL;
+                return 0;
+        }
+
+        existing = hashmap_get(u->manager->bpf_firewall_access, key);
+        if (existing) {
+                *ret = bpf_firewall_access_ref(existing);
+                return 0;
+        }
+
+        r = hashmap_ensure_allocated(&u->manager->bpf_firewall_access, &string_hash_ops);
+        if (r < 0)
+                return r;
+
+        a = new(BPFFirewallAccess, 1);
+        if (!a)
+                return -ENOMEM;
+
+        *a = (BPFFirewallAccess) {
+                .n_ref = 1,
+                .ipv4_allow_map_fd = -1,
+                .ipv6_allow_map_fd = -1,
+                .ipv4_deny_map_fd = -1,
+                .ipv6_deny_map_fd = -1,
+        };
+
+        r = bpf_firewall_prepare_access_maps(u, ACCESS_ALLOWED, &a->ipv4_allow_map_fd, &a->ipv6_allow_map_fd, &a->allow_any);
+        if (r < 0)
+                return log_unit_error_errno(u, r, "Preparation of eBPF allow maps failed: %m");
+
+        r = bpf_firewall_prepare_access_maps(u, ACCESS_DENIED, &a->ipv4_deny_map_fd, &a->ipv6_deny_map_fd, &a->deny_any);
+        if (r < 0)
+                return log_unit_error_errno(u, r, "Preparation of eBPF deny maps failed: %m");
+
+        r = hashmap_put(u->manager->bpf_firewall_access, key, a);
+        if (r < 0)
+                return r;
+
+        a->manager = u->manager;
+        a->key = TAKE_PTR(key);
+
+        *ret = TAKE_PTR(a);
+        return 0;
+}
+
+static int bpf_firewall_access_program(Unit *u, BPFFirewallAccess *a, bool is_ingress, BPFProgram **ret) {
+        BPFProgram **p;
+        int r;
+
+        assert(u);
+        assert(a);
+        assert(ret);
+
+        p = is_ingress ? &a->ingress : &a->egress;
+
+        if (!*p) {
+                r = bpf_firewall_compile_bpf(a, -1, is_ingress, p);
+                if (r < 0)
+                        return r;
+
+                /* Load it right-away, so that all units sharing it share the kernel object, too. If this fails
+                 * we'll try again on attachment, where the error is reported properly. */
+                r = bpf_program_load_kernel(*p, NULL, 0);
+                if (r < 0)
+                        log_unit_debug_errno(u, r, "Failed to load shared %s BPF program, ignoring: %m",
+                                             is_ingress ? "ingress" : "egress");
+        }
+
+        /* Each unit needs its own program object, since attachments are tracked per object */
+        return bpf_program_clone(*p, ret);
+}
+
 int bpf_firewall_compile(Unit *u) {
         CGroupContext *cc;
         int r, supported;
-        bool ip_allow_any = false, ip_deny_any = false;
 
         assert(u);
 
@@ -550,11 +732,7 @@ int bpf_firewall_compile(Unit *u) {
         u->ip_bpf_ingress = bpf_program_unref(u->ip_bpf_ingress);
         u->ip_bpf_egress = bpf_program_unref(u->ip_bpf_egress);
 
-        u->ipv4_allow_map_fd = safe_close(u->ipv4_allow_map_fd);
-        u->ipv4_deny_map_fd = safe_close(u->ipv4_deny_map_fd);
-
-        u->ipv6_allow_map_fd = safe_close(u->ipv6_allow_map_fd);
-        u->ipv6_deny_map_fd = safe_close(u->ipv6_deny_map_fd);
+        u->ip_bpf_access = bpf_firewall_access_unref(u->ip_bpf_access);
 
         if (u->type != UNIT_SLICE) {
                 /* In inner nodes we only do accounting, we do not actually bother with access control. However, leaf
@@ -563,24 +741,33 @@ int bpf_firewall_compile(Unit *u) {
                  * means that all configure IP access rules *will* take effect on processes, even though we never
                  * compile them for inner nodes. */
 
-                r = bpf_firewall_prepare_access_maps(u, ACCESS_ALLOWED, &u->ipv4_allow_map_fd, &u->ipv6_allow_map_fd, &ip_allow_any);
+                r = bpf_firewall_access_get(u, &u->ip_bpf_access);
                 if (r < 0)
-                        return log_unit_error_errno(u, r, "Preparation of eBPF allow maps failed: %m");
-
-                r = bpf_firewall_prepare_access_maps(u, ACCESS_DENIED, &u->ipv4_deny_map_fd, &u->ipv6_deny_map_fd, &ip_deny_any);
-                if (r < 0)
-                        return log_unit_error_errno(u, r, "Preparation of eBPF deny maps failed: %m");
+                        return log_unit_error_errno(u, r, "Preparation of eBPF access maps failed: %m");
         }
 
         r = bpf_firewall_prepare_accounting_maps(u, cc->ip_accounting, &u->ip_accounting_ingress_map_fd, &u->ip_accounting_egress_map_fd);
         if (r < 0)
                 return log_unit_error_errno(u, r, "Preparation of eBPF accounting maps failed: %m");
 
-        r = bpf_firewall_compile_bpf(u, true, &u->ip_bpf_ingress, ip_allow_any, ip_deny_any);
+        if (!cc->ip_accounting && u->ip_bpf_access) {
+                /* Without accounting the programs only depend on the access maps, hence share them too */
+                r = bpf_firewall_access_program(u, u->ip_bpf_access, true, &u->ip_bpf_ingress);
+                if (r < 0)
+                        return log_unit_error_errno(u, r, "Compilation for ingress BPF program failed: %m");
+
+                r = bpf_firewall_access_program(u, u->ip_bpf_access, false, &u->ip_bpf_egress);
+                if (r < 0)
+                        return log_unit_error_errno(u, r, "Compilation for egress BPF program failed: %m");
+
+                return 0;
+        }
+
+        r = bpf_firewall_compile_bpf(u->ip_bpf_access, u->ip_accounting_ingress_map_fd, true, &u->ip_bpf_ingress);
         if (r < 0)
                 return log_unit_error_errno(u, r, "Compilation for ingress BPF program failed: %m");
 
-        r = bpf_firewall_compile_bpf(u, false, &u->ip_bpf_egress, ip_allow_any, ip_deny_any);
+        r = bpf_firewall_compile_bpf(u->ip_bpf_access, u->ip_accounting_egress_map_fd, false, &u->ip_bpf_egress);
         if (r < 0)
                 return log_unit_error_errno(u, r, "Compilation for egress BPF program failed: %m");
 
@@ -756,6 +943,21 @@ int bpf_firewall_read_accounting(int map_fd, uint64_t *ret_bytes, uint64_t *ret_
         if (map_fd < 0)
                 return -EBADF;
 
+        if (ret_packets && ret_bytes) {
+                uint64_t values[2];
+
+                /* Both counters at once, which is a single syscall on kernels supporting batch lookups */
+                assert_cc(MAP_KEY_PACKETS == 0 && MAP_KEY_BYTES == 1);
+
+                r = bpf_map_lookup_array(map_fd, ELEMENTSOF(values), sizeof(uint64_t), values);
+                if (r < 0)
+                        return r;
+
+                *ret_packets = values[MAP_KEY_PACKETS];
+                *ret_bytes = values[MAP_KEY_BYTES];
+                return 0;
+        }
+
         if (ret_packets) {
                 key = MAP_KEY_PACKETS;
                 r = bpf_map_lookup_element(map_fd, &key, &packets);
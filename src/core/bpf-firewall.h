@@ -13,6 +13,8 @@ enum {
 
 int bpf_firewall_supported(void);
 
+BPFFirewallAccess *bpf_firewall_access_unref(BPFFirewallAccess *a);
+
 int bpf_firewall_compile(Unit *u);
 int bpf_firewall_install(Unit *u);
 int bpf_firewall_load_custom(Unit *u);
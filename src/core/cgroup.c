@@ -37,6 +37,12 @@
  * out specific attributes from us. */
 #define LOG_LEVEL_CGROUP_WRITE(r) (IN_SET(abs(r), ENOENT, EROFS, EACCES, EPERM) ? LOG_DEBUG : LOG_WARNING)
 
+/* Large enough for cgroup.events and memory.events, which are read with a single pread() */
+#define CGROUP_EVENTS_BUFFER_SIZE 512
+
+/* How many units may keep their accounting attributes open at the same time */
+#define CGROUP_ACCOUNTING_UNITS_MAX 256U
+
 uint64_t tasks_max_resolve(const TasksMax *tasks_max) {
         if (tasks_max->scale == 0)
                 return tasks_max->value;
@@ -73,14 +79,104 @@ bool unit_has_host_root_cgroup(Unit *u) {
         return unit_has_name(u, SPECIAL_ROOT_SLICE);
 }
 
+static char *cgroup_attribute_key(const char *attribute, const char *value) {
+        /* These attributes take one line per device, and writing one only changes the entry of that device (or the
+         * default, for io.weight), which is selected by the first word. */
+        if (STR_IN_SET(attribute,
+                       "io.weight",
+                       "io.latency",
+                       "io.max",
+                       "blkio.weight_device",
+                       "blkio.throttle.read_bps_device",
+                       "blkio.throttle.write_bps_device"))
+                return strjoin(attribute, " ", strndupa(value, strcspn(value, WHITESPACE)));
+
+        return strdup(attribute);
+}
+
+static void unit_forget_cgroup_attribute(Unit *u, const char *key) {
+        char *old_key;
+
+        free(hashmap_remove2(u->cgroup_attributes, key, (void**) &old_key));
+        free(old_key);
+}
+
+static void unit_remember_cgroup_attribute(Unit *u, char *key, const char *value) {
+        _cleanup_free_ char *k = key, *v = NULL;
+
+        unit_forget_cgroup_attribute(u, k);
+
+        v = strdup(value);
+        if (!v)
+                return;
+
+        if (hashmap_ensure_allocated(&u->cgroup_attributes, &string_hash_ops_free_free) < 0)
+                return;
+
+        if (hashmap_put(u->cgroup_attributes, k, v) < 0)
+                return;
+
+        TAKE_PTR(k);
+        TAKE_PTR(v);
+}
+
+static void unit_flush_cgroup_attributes(Unit *u) {
+        u->cgroup_attributes = hashmap_free(u->cgroup_attributes);
+}
+
+static void unit_seed_cgroup_attributes(Unit *u) {
+        static const struct {
+                const char *key;
+                const char *value;
+        } table[] = {
+                /* The kernel's defaults for a new cgroup on the unified hierarchy, formatted the way we write them */
+                { "cpu.weight",      "100\n"             },
+                { "cpu.max",         "max 100000\n"      },
+                { "io.weight default", "default 100\n"   },
+                { "io.bfq.weight",   "100\n"             },
+                { "memory.min",      "0\n"               },
+                { "memory.low",      "0\n"               },
+                { "memory.high",     "max\n"             },
+                { "memory.max",      "max\n"             },
+                { "memory.swap.max", "max\n"             },
+                { "memory.oom.group", "0"                },
+                { "pids.max",        "max\n"             },
+        };
+        size_t i;
+
+        for (i = 0; i < ELEMENTSOF(table); i++) {
+                char *k;
+
+                k = strdup(table[i].key);
+                if (!k)
+                        return;
+
+                unit_remember_cgroup_attribute(u, k, table[i].value);
+        }
+}
+
 static int set_attribute_and_warn(Unit *u, const char *controller, const char *attribute, const char *value) {
+        _cleanup_free_ char *key = NULL;
         int r;
 
+        key = cgroup_attribute_key(attribute, value);
+        if (key && streq_ptr(hashmap_get(u->cgroup_attributes, key), value))
+                return 0; /* Already set to this value, nothing to do */
+
         r = cg_set_attribute(controller, u->cgroup_path, attribute, value);
-        if (r < 0)
+        if (r < 0) {
                 log_unit_full(u, LOG_LEVEL_CGROUP_WRITE(r), r, "Failed to set '%s' attribute on '%s' to '%.*s': %m",
                               strna(attribute), isempty(u->cgroup_path) ? "/" : u->cgroup_path, (int) strcspn(value, NEWLINE), value);
 
+                /* We don't know what the attribute is set to now */
+                if (key)
+                        unit_forget_cgroup_attribute(u, key);
+                return r;
+        }
+
+        if (key)
+                unit_remember_cgroup_attribute(u, TAKE_PTR(key), value);
+
         return r;
 }
 
@@ -1506,11 +1602,9 @@ CGroupMask unit_get_members_mask(Unit *u) {
         u->cgroup_members_mask = 0;
 
         if (u->type == UNIT_SLICE) {
-                void *v;
                 Unit *member;
-                Iterator i;
 
-                HASHMAP_FOREACH_KEY(v, member, u->dependencies[UNIT_BEFORE], i)
+                UNIT_FOREACH_DEPENDENCY(member, u, UNIT_BEFORE)
                         if (UNIT_DEREF(member->slice) == u)
                                 u->cgroup_members_mask |= unit_get_subtree_mask(member); /* note that this calls ourselves again, for the children */
         }
@@ -1879,6 +1973,15 @@ static int unit_create_cgroup(
                 u->cgroup_enabled_mask = result_mask;
         }
 
+        /* A new cgroup starts out with the kernel's defaults. Otherwise, if controllers were added or removed,
+         * their attributes might have been reset to the defaults behind our back, hence forget what we wrote. */
+        if (created) {
+                unit_flush_cgroup_attributes(u);
+                if (cg_all_unified() > 0)
+                        unit_seed_cgroup_attributes(u);
+        } else if (!u->cgroup_realized || u->cgroup_realized_mask != target_mask)
+                unit_flush_cgroup_attributes(u);
+
         /* Keep track that this is now realized */
         u->cgroup_realized = true;
         u->cgroup_realized_mask = target_mask;
@@ -2159,16 +2262,14 @@ static int unit_realize_cgroup_now_enable(Unit *u, ManagerState state) {
 /* Controllers can only be disabled depth-first, from the leaves of the
  * hierarchy upwards to the unit in question. */
 static int unit_realize_cgroup_now_disable(Unit *u, ManagerState state) {
-        Iterator i;
         Unit *m;
-        void *v;
 
         assert(u);
 
         if (u->type != UNIT_SLICE)
                 return 0;
 
-        HASHMAP_FOREACH_KEY(v, m, u->dependencies[UNIT_BEFORE], i) {
+        UNIT_FOREACH_DEPENDENCY(m, u, UNIT_BEFORE) {
                 CGroupMask target_mask, enable_mask, new_target_mask, new_enable_mask;
                 int r;
 
@@ -2288,12 +2389,14 @@ static int unit_realize_cgroup_now(Unit *u, ManagerState state) {
 unsigned manager_dispatch_cgroup_realize_queue(Manager *m) {
         ManagerState state;
         unsigned n = 0;
+        usec_t trace;
         Unit *i;
         int r;
 
         assert(m);
 
         state = manager_state(m);
+        trace = manager_trace_begin(&m->trace);
 
         while ((i = m->cgroup_realize_queue)) {
                 assert(i->in_cgroup_realize_queue);
@@ -2311,6 +2414,7 @@ unsigned manager_dispatch_cgroup_realize_queue(Manager *m) {
                 n++;
         }
 
+        manager_trace_end(&m->trace, "dispatch-cgroup-realize-queue", NULL, trace);
         return n;
 }
 
@@ -2329,11 +2433,9 @@ static void unit_add_siblings_to_cgroup_realize_queue(Unit *u) {
          * to be realized for the unit itself to be realized too. */
 
         while ((slice = UNIT_DEREF(u->slice))) {
-                Iterator i;
                 Unit *m;
-                void *v;
 
-                HASHMAP_FOREACH_KEY(v, m, slice->dependencies[UNIT_BEFORE], i) {
+                UNIT_FOREACH_DEPENDENCY(m, slice, UNIT_BEFORE) {
 
                         /* Skip units that have a dependency on the slice but aren't actually in it. */
                         if (UNIT_DEREF(m->slice) != slice)
@@ -2386,6 +2488,13 @@ int unit_realize_cgroup(Unit *u) {
         return unit_realize_cgroup_now(u, manager_state(u->manager));
 }
 
+static void unit_close_accounting_fds(Unit *u) {
+        assert(u);
+
+        for (CGroupAccountingFile i = 0; i < _CGROUP_ACCOUNTING_FILE_MAX; i++)
+                u->cgroup_accounting_fds[i] = safe_close(u->cgroup_accounting_fds[i]);
+}
+
 void unit_release_cgroup(Unit *u) {
         assert(u);
 
@@ -2397,6 +2506,11 @@ void unit_release_cgroup(Unit *u) {
                 u->cgroup_path = mfree(u->cgroup_path);
         }
 
+        unit_flush_cgroup_attributes(u);
+
+        unit_close_accounting_fds(u);
+        (void) ordered_set_remove(u->manager->cgroup_accounting_units, u);
+
         if (u->cgroup_control_inotify_wd >= 0) {
                 if (inotify_rm_watch(u->manager->cgroup_inotify_fd, u->cgroup_control_inotify_wd) < 0)
                         log_unit_debug_errno(u, errno, "Failed to remove cgroup control inotify watch %i for %s, ignoring: %m", u->cgroup_control_inotify_wd, u->id);
@@ -2674,7 +2788,8 @@ static void unit_remove_from_cgroup_empty_queue(Unit *u) {
 }
 
 int unit_check_oom(Unit *u) {
-        _cleanup_free_ char *oom_kill = NULL;
+        char buf[CGROUP_EVENTS_BUFFER_SIZE];
+        const char *oom_kill;
         bool increased;
         uint64_t c;
         int r;
@@ -2682,7 +2797,10 @@ int unit_check_oom(Unit *u) {
         if (!u->cgroup_path)
                 return 0;
 
-        r = cg_get_keyed_attribute("memory", u->cgroup_path, "memory.events", STRV_MAKE("oom_kill"), &oom_kill);
+        r = cg_get_keyed_attribute_buffer("memory", u->cgroup_path, "memory.events", STRV_MAKE("oom_kill"),
+                                          buf, sizeof(buf), &oom_kill);
+        if (r == 0)
+                r = -ENXIO;
         if (r < 0)
                 return log_unit_debug_errno(u, r, "Failed to read oom_kill field of memory.events cgroup attribute: %m");
 
@@ -2774,13 +2892,17 @@ static void unit_add_to_cgroup_oom_queue(Unit *u) {
 }
 
 static int unit_check_cgroup_events(Unit *u) {
-        char *values[2] = {};
+        char buf[CGROUP_EVENTS_BUFFER_SIZE];
+        const char *values[2];
         int r;
 
         assert(u);
 
-        r = cg_get_keyed_attribute_graceful(SYSTEMD_CGROUP_CONTROLLER, u->cgroup_path, "cgroup.events",
-                                            STRV_MAKE("populated", "frozen"), values);
+        if (!u->cgroup_path)
+                return 0;
+
+        r = cg_get_keyed_attribute_buffer(SYSTEMD_CGROUP_CONTROLLER, u->cgroup_path, "cgroup.events",
+                                          STRV_MAKE("populated", "frozen"), buf, sizeof(buf), values);
         if (r < 0)
                 return r;
 
@@ -2802,14 +2924,57 @@ static int unit_check_cgroup_events(Unit *u) {
                         unit_frozen(u);
         }
 
-        free(values[0]);
-        free(values[1]);
-
         return 0;
 }
 
+static void unit_add_to_cgroup_events_queue(Unit *u) {
+        assert(u);
+
+        if (u->in_cgroup_events_queue)
+                return;
+
+        LIST_PREPEND(cgroup_events_queue, u->manager->cgroup_events_queue, u);
+        u->in_cgroup_events_queue = true;
+}
+
+static void manager_dispatch_cgroup_events_queue(Manager *m) {
+        Unit *u;
+
+        assert(m);
+
+        /* Process each unit whose cgroup.events changed only once, regardless of how many notifications
+         * we got for it while draining the inotify queue. */
+
+        while ((u = m->cgroup_events_queue)) {
+                assert(u->in_cgroup_events_queue);
+
+                LIST_REMOVE(cgroup_events_queue, m->cgroup_events_queue, u);
+                u->in_cgroup_events_queue = false;
+
+                (void) unit_check_cgroup_events(u);
+        }
+}
+
+static void manager_rescan_cgroup_watches(Manager *m) {
+        Iterator i;
+        Unit *u;
+
+        assert(m);
+
+        /* The inotify queue overflowed, hence we lost track of which cgroups changed. Let's recheck all
+         * units we have watches for, but nothing else. */
+
+        HASHMAP_FOREACH(u, m->cgroup_control_inotify_wd_unit, i)
+                unit_add_to_cgroup_events_queue(u);
+
+        HASHMAP_FOREACH(u, m->cgroup_memory_inotify_wd_unit, i)
+                unit_add_to_cgroup_oom_queue(u);
+}
+
 static int on_cgroup_inotify_event(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
         Manager *m = userdata;
+        bool overflow = false;
+        int r = 0;
 
         assert(s);
         assert(fd >= 0);
@@ -2822,15 +2987,19 @@ static int on_cgroup_inotify_event(sd_event_source *s, int fd, uint32_t revents,
 
                 l = read(fd, &buffer, sizeof(buffer));
                 if (l < 0) {
-                        if (IN_SET(errno, EINTR, EAGAIN))
-                                return 0;
-
-                        return log_error_errno(errno, "Failed to read control group inotify events: %m");
+                        if (!IN_SET(errno, EINTR, EAGAIN))
+                                r = log_error_errno(errno, "Failed to read control group inotify events: %m");
+                        break;
                 }
 
                 FOREACH_INOTIFY_EVENT(e, buffer, l) {
                         Unit *u;
 
+                        metric_inc(m->metrics + MANAGER_METRIC_CGROUP_INOTIFY_EVENTS);
+
+                        if (e->mask & IN_Q_OVERFLOW)
+                                overflow = true;
+
                         if (e->wd < 0)
                                 /* Queue overflow has no watch descriptor */
                                 continue;
@@ -2844,13 +3013,22 @@ static int on_cgroup_inotify_event(sd_event_source *s, int fd, uint32_t revents,
 
                         u = hashmap_get(m->cgroup_control_inotify_wd_unit, INT_TO_PTR(e->wd));
                         if (u)
-                                unit_check_cgroup_events(u);
+                                unit_add_to_cgroup_events_queue(u);
 
                         u = hashmap_get(m->cgroup_memory_inotify_wd_unit, INT_TO_PTR(e->wd));
                         if (u)
                                 unit_add_to_cgroup_oom_queue(u);
                 }
         }
+
+        if (overflow) {
+                metric_inc(m->metrics + MANAGER_METRIC_CGROUP_INOTIFY_OVERFLOWS);
+                log_debug("Control group inotify queue overflowed, rechecking all watched cgroups.");
+                manager_rescan_cgroup_watches(m);
+        }
+
+        manager_dispatch_cgroup_events_queue(m);
+        return r;
 }
 
 static int cg_bpf_mask_supported(CGroupMask *ret) {
@@ -3139,6 +3317,114 @@ int manager_notify_cgroup_empty(Manager *m, const char *cgroup) {
         return 1;
 }
 
+static void unit_touch_accounting_fds(Unit *u) {
+        Manager *m;
+
+        assert(u);
+        assert(u->manager);
+
+        m = u->manager;
+
+        /* Marks the unit as the one whose accounting attributes were read most recently. Only that many units
+         * keep their attributes open, so that a large number of units doesn't use up a large number of fds. Those
+         * read least recently close theirs, and open them again when they are read the next time. */
+
+        (void) ordered_set_remove(m->cgroup_accounting_units, u);
+
+        if (ordered_set_ensure_allocated(&m->cgroup_accounting_units, NULL) < 0 ||
+            ordered_set_put(m->cgroup_accounting_units, u) < 0) {
+                unit_close_accounting_fds(u);
+                return;
+        }
+
+        while (ordered_set_size(m->cgroup_accounting_units) > CGROUP_ACCOUNTING_UNITS_MAX)
+                unit_close_accounting_fds(ordered_set_steal_first(m->cgroup_accounting_units));
+}
+
+static int unit_read_accounting_file(
+                Unit *u,
+                CGroupAccountingFile file,
+                const char *controller,
+                const char *attribute,
+                char **ret) {
+
+        _cleanup_free_ char *buf = NULL;
+        size_t allocated = 0, n = 0;
+        int r;
+
+        assert(u);
+        assert(file >= 0 && file < _CGROUP_ACCOUNTING_FILE_MAX);
+        assert(ret);
+
+        /* Accounting attributes are queried over and over again, e.g. by every "systemctl status" or monitoring
+         * tool polling the bus. Hence, keep the attribute open and re-read it from the start with pread(), which
+         * makes the kernel regenerate its contents, instead of resolving, opening and closing it each time. */
+
+        if (u->cgroup_accounting_fds[file] < 0) {
+                _cleanup_free_ char *path = NULL;
+
+                r = cg_get_path(controller, u->cgroup_path, attribute, &path);
+                if (r < 0)
+                        return r;
+
+                u->cgroup_accounting_fds[file] = open(path, O_RDONLY|O_CLOEXEC|O_NOCTTY);
+                if (u->cgroup_accounting_fds[file] < 0)
+                        return IN_SET(errno, ENOENT, ENXIO) ? -ENODATA : -errno;
+        }
+
+        unit_touch_accounting_fds(u);
+
+        for (;;) {
+                ssize_t k;
+
+                if (!GREEDY_REALLOC(buf, allocated, n + 4096 + 1))
+                        return -ENOMEM;
+
+                k = pread(u->cgroup_accounting_fds[file], buf + n, allocated - n - 1, n);
+                if (k < 0) {
+                        r = errno;
+
+                        /* The cgroup went away under us, don't keep the stale fd around */
+                        u->cgroup_accounting_fds[file] = safe_close(u->cgroup_accounting_fds[file]);
+                        return IN_SET(r, ENOENT, ENODEV, ENXIO) ? -ENODATA : -r;
+                }
+                if (k == 0)
+                        break;
+
+                n += k;
+        }
+
+        buf[n] = 0;
+        *ret = TAKE_PTR(buf);
+        return 0;
+}
+
+static int unit_read_accounting_uint64(
+                Unit *u,
+                CGroupAccountingFile file,
+                const char *controller,
+                const char *attribute,
+                uint64_t *ret) {
+
+        _cleanup_free_ char *value = NULL;
+        int r;
+
+        assert(ret);
+
+        r = unit_read_accounting_file(u, file, controller, attribute, &value);
+        if (r < 0)
+                return r;
+
+        delete_trailing_chars(value, NEWLINE);
+
+        if (streq(value, "max")) {
+                *ret = CGROUP_LIMIT_MAX;
+                return 0;
+        }
+
+        return safe_atou64(value, ret);
+}
+
 int unit_get_memory_current(Unit *u, uint64_t *ret) {
         int r;
 
@@ -3162,7 +3448,8 @@ int unit_get_memory_current(Unit *u, uint64_t *ret) {
         if (r < 0)
                 return r;
 
-        return cg_get_attribute_as_uint64("memory", u->cgroup_path, r > 0 ? "memory.current" : "memory.usage_in_bytes", ret);
+        return unit_read_accounting_uint64(u, CGROUP_ACCOUNTING_FILE_MEMORY,
+                                           "memory", r > 0 ? "memory.current" : "memory.usage_in_bytes", ret);
 }
 
 int unit_get_tasks_current(Unit *u, uint64_t *ret) {
@@ -3182,7 +3469,7 @@ int unit_get_tasks_current(Unit *u, uint64_t *ret) {
         if ((u->cgroup_realized_mask & CGROUP_MASK_PIDS) == 0)
                 return -ENODATA;
 
-        return cg_get_attribute_as_uint64("pids", u->cgroup_path, "pids.current", ret);
+        return unit_read_accounting_uint64(u, CGROUP_ACCOUNTING_FILE_TASKS, "pids", "pids.current", ret);
 }
 
 static int unit_get_cpu_usage_raw(Unit *u, nsec_t *ret) {
@@ -3207,22 +3494,31 @@ static int unit_get_cpu_usage_raw(Unit *u, nsec_t *ret) {
         if (r < 0)
                 return r;
         if (r > 0) {
-                _cleanup_free_ char *val = NULL;
+                _cleanup_free_ char *contents = NULL;
+                const char *val = NULL;
                 uint64_t us;
 
-                r = cg_get_keyed_attribute("cpu", u->cgroup_path, "cpu.stat", STRV_MAKE("usage_usec"), &val);
-                if (IN_SET(r, -ENOENT, -ENXIO))
-                        return -ENODATA;
+                r = unit_read_accounting_file(u, CGROUP_ACCOUNTING_FILE_CPU, "cpu", "cpu.stat", &contents);
                 if (r < 0)
                         return r;
 
+                for (char *line = contents, *next; line && !val; line = next) {
+                        next = strchr(line, '\n');
+                        if (next)
+                                *(next++) = 0;
+
+                        val = first_word(line, "usage_usec");
+                }
+                if (!val)
+                        return -ENODATA;
+
                 r = safe_atou64(val, &us);
                 if (r < 0)
                         return r;
 
                 ns = us * NSEC_PER_USEC;
         } else
-                return cg_get_attribute_as_uint64("cpuacct", u->cgroup_path, "cpuacct.usage", ret);
+                return unit_read_accounting_uint64(u, CGROUP_ACCOUNTING_FILE_CPU, "cpuacct", "cpuacct.usage", ret);
 
         *ret = ns;
         return 0;
@@ -3303,6 +3599,54 @@ int unit_get_ip_accounting(
         return r;
 }
 
+int unit_get_ip_accounting_all(Unit *u, uint64_t ret[static _CGROUP_IP_ACCOUNTING_METRIC_MAX]) {
+        CGroupIPAccountingMetric m;
+        int r, ret_r = 0;
+
+        assert(u);
+        assert(ret);
+
+        /* Like unit_get_ip_accounting(), but retrieves all four counters at once, reading each accounting map only
+         * once. Counters that are not available are set to UINT64_MAX. */
+
+        for (m = 0; m < _CGROUP_IP_ACCOUNTING_METRIC_MAX; m++)
+                ret[m] = UINT64_MAX;
+
+        if (!UNIT_CGROUP_BOOL(u, ip_accounting))
+                return -ENODATA;
+
+        if (u->ip_accounting_ingress_map_fd < 0 && u->ip_accounting_egress_map_fd < 0)
+                return -ENODATA;
+
+        if (u->ip_accounting_ingress_map_fd >= 0) {
+                r = bpf_firewall_read_accounting(u->ip_accounting_ingress_map_fd,
+                                                 ret + CGROUP_IP_INGRESS_BYTES,
+                                                 ret + CGROUP_IP_INGRESS_PACKETS);
+                if (r < 0) {
+                        ret[CGROUP_IP_INGRESS_BYTES] = ret[CGROUP_IP_INGRESS_PACKETS] = UINT64_MAX;
+                        ret_r = r;
+                }
+        }
+
+        if (u->ip_accounting_egress_map_fd >= 0) {
+                r = bpf_firewall_read_accounting(u->ip_accounting_egress_map_fd,
+                                                 ret + CGROUP_IP_EGRESS_BYTES,
+                                                 ret + CGROUP_IP_EGRESS_PACKETS);
+                if (r < 0) {
+                        ret[CGROUP_IP_EGRESS_BYTES] = ret[CGROUP_IP_EGRESS_PACKETS] = UINT64_MAX;
+                        if (ret_r >= 0)
+                                ret_r = r;
+                }
+        }
+
+        /* See unit_get_ip_accounting() */
+        for (m = 0; m < _CGROUP_IP_ACCOUNTING_METRIC_MAX; m++)
+                if (ret[m] != UINT64_MAX)
+                        ret[m] += u->ip_accounting_extra[m];
+
+        return ret_r;
+}
+
 static int unit_get_io_accounting_raw(Unit *u, uint64_t ret[static _CGROUP_IO_ACCOUNTING_METRIC_MAX]) {
         static const char *const field_names[_CGROUP_IO_ACCOUNTING_METRIC_MAX] = {
                 [CGROUP_IO_READ_BYTES]       = "rbytes=",
@@ -3311,8 +3655,7 @@ static int unit_get_io_accounting_raw(Unit *u, uint64_t ret[static _CGROUP_IO_AC
                 [CGROUP_IO_WRITE_OPERATIONS] = "wios=",
         };
         uint64_t acc[_CGROUP_IO_ACCOUNTING_METRIC_MAX] = {};
-        _cleanup_free_ char *path = NULL;
-        _cleanup_fclose_ FILE *f = NULL;
+        _cleanup_free_ char *contents = NULL;
         int r;
 
         assert(u);
@@ -3332,23 +3675,16 @@ static int unit_get_io_accounting_raw(Unit *u, uint64_t ret[static _CGROUP_IO_AC
         if (!FLAGS_SET(u->cgroup_realized_mask, CGROUP_MASK_IO))
                 return -ENODATA;
 
-        r = cg_get_path("io", u->cgroup_path, "io.stat", &path);
+        r = unit_read_accounting_file(u, CGROUP_ACCOUNTING_FILE_IO, "io", "io.stat", &contents);
         if (r < 0)
                 return r;
 
-        f = fopen(path, "re");
-        if (!f)
-                return -errno;
-
-        for (;;) {
-                _cleanup_free_ char *line = NULL;
+        for (char *line = contents, *next; line && *line; line = next) {
                 const char *p;
 
-                r = read_line(f, LONG_LINE_MAX, &line);
-                if (r < 0)
-                        return r;
-                if (r == 0)
-                        break;
+                next = strchr(line, '\n');
+                if (next)
+                        *(next++) = 0;
 
                 p = line;
                 p += strcspn(p, WHITESPACE); /* Skip over device major/minor */
@@ -3524,10 +3860,8 @@ void unit_invalidate_cgroup_bpf(Unit *u) {
          * list of our children includes our own. */
         if (u->type == UNIT_SLICE) {
                 Unit *member;
-                Iterator i;
-                void *v;
 
-                HASHMAP_FOREACH_KEY(v, member, u->dependencies[UNIT_BEFORE], i)
+                UNIT_FOREACH_DEPENDENCY(member, u, UNIT_BEFORE)
                         if (UNIT_DEREF(member->slice) == u)
                                 unit_invalidate_cgroup_bpf(member);
         }
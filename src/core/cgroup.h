@@ -181,6 +181,16 @@ typedef enum CGroupIOAccountingMetric {
         _CGROUP_IO_ACCOUNTING_METRIC_INVALID = -1,
 } CGroupIOAccountingMetric;
 
+/* The cgroup attributes accounting data is read from, which are kept open while the unit's cgroup exists */
+typedef enum CGroupAccountingFile {
+        CGROUP_ACCOUNTING_FILE_MEMORY,
+        CGROUP_ACCOUNTING_FILE_TASKS,
+        CGROUP_ACCOUNTING_FILE_CPU,
+        CGROUP_ACCOUNTING_FILE_IO,
+        _CGROUP_ACCOUNTING_FILE_MAX,
+        _CGROUP_ACCOUNTING_FILE_INVALID = -1,
+} CGroupAccountingFile;
+
 typedef struct Unit Unit;
 typedef struct Manager Manager;
 
@@ -252,6 +262,7 @@ int unit_get_tasks_current(Unit *u, uint64_t *ret);
 int unit_get_cpu_usage(Unit *u, nsec_t *ret);
 int unit_get_io_accounting(Unit *u, CGroupIOAccountingMetric metric, bool allow_cache, uint64_t *ret);
 int unit_get_ip_accounting(Unit *u, CGroupIPAccountingMetric metric, uint64_t *ret);
+int unit_get_ip_accounting_all(Unit *u, uint64_t ret[static _CGROUP_IP_ACCOUNTING_METRIC_MAX]);
 
 int unit_reset_cpu_accounting(Unit *u);
 int unit_reset_ip_accounting(Unit *u);
@@ -1,6 +1,7 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
 #include "core-varlink.h"
+#include "metrics.h"
 #include "mkdir.h"
 #include "user-util.h"
 #include "varlink.h"
@@ -263,12 +264,64 @@ static int vl_method_get_memberships(Varlink *link, JsonVariant *parameters, Var
         return varlink_error(link, "io.systemd.UserDatabase.NoRecordFound", NULL);
 }
 
+static int vl_method_list_metrics(Varlink *link, JsonVariant *parameters, VarlinkMethodFlags flags, void *userdata) {
+        Manager *m = userdata;
+
+        assert(link);
+        assert(m);
+
+        metric_set(m->metrics + MANAGER_METRIC_UNITS, hashmap_size(m->units));
+        metric_set(m->metrics + MANAGER_METRIC_JOBS, hashmap_size(m->jobs));
+
+        return varlink_reply_metrics(link, parameters, m->metrics, ELEMENTSOF(m->metrics));
+}
+
+static int manager_varlink_init_metrics(Manager *m) {
+        _cleanup_(varlink_server_unrefp) VarlinkServer *s = NULL;
+        int r;
+
+        assert(m);
+
+        if (m->metrics_varlink_server)
+                return 0;
+
+        /* The metrics are served on a socket of their own, only accessible to root, unlike the one for
+         * dynamic users, which everybody may talk to */
+
+        r = varlink_server_new(&s, VARLINK_SERVER_ROOT_ONLY);
+        if (r < 0)
+                return log_error_errno(r, "Failed to allocate varlink server object: %m");
+
+        varlink_server_set_userdata(s, m);
+
+        r = varlink_server_bind_method(s, "io.systemd.Metrics.List", vl_method_list_metrics);
+        if (r < 0)
+                return log_error_errno(r, "Failed to register varlink methods: %m");
+
+        r = varlink_server_listen_address(s, "/run/systemd/io.systemd.Metrics", 0600);
+        if (r < 0)
+                return log_error_errno(r, "Failed to bind to varlink socket: %m");
+
+        r = varlink_server_attach_event(s, m->event, SD_EVENT_PRIORITY_NORMAL);
+        if (r < 0)
+                return log_error_errno(r, "Failed to attach varlink connection to event loop: %m");
+
+        m->metrics_varlink_server = TAKE_PTR(s);
+        return 0;
+}
+
 int manager_varlink_init(Manager *m) {
         _cleanup_(varlink_server_unrefp) VarlinkServer *s = NULL;
         int r;
 
         assert(m);
 
+        if (!MANAGER_IS_SYSTEM(m))
+                return 0;
+
+        /* Not having metrics is no reason to not serve dynamic users */
+        (void) manager_varlink_init_metrics(m);
+
         if (m->varlink_server)
                 return 0;
 
@@ -307,4 +360,5 @@ void manager_varlink_done(Manager *m) {
         assert(m);
 
         m->varlink_server = varlink_server_unref(m->varlink_server);
+        m->metrics_varlink_server = varlink_server_unref(m->metrics_varlink_server);
 }
@@ -224,6 +224,40 @@ static int property_get_environment(
         return sd_bus_message_append_strv(reply, l);
 }
 
+static int property_get_generator_timings(
+                sd_bus *bus,
+                const char *path,
+                const char *interface,
+                const char *property,
+                sd_bus_message *reply,
+                void *userdata,
+                sd_bus_error *error) {
+
+        Manager *m = userdata;
+        size_t i;
+        int r;
+
+        assert(bus);
+        assert(reply);
+        assert(m);
+
+        r = sd_bus_message_open_container(reply, 'a', "(stti)");
+        if (r < 0)
+                return r;
+
+        for (i = 0; i < m->n_generator_timings; i++) {
+                r = sd_bus_message_append(reply, "(stti)",
+                                          m->generator_timings[i].name,
+                                          m->generator_timings[i].start,
+                                          m->generator_timings[i].finish,
+                                          (int32_t) m->generator_timings[i].status);
+                if (r < 0)
+                        return r;
+        }
+
+        return sd_bus_message_close_container(reply);
+}
+
 static int property_get_show_status(
                 sd_bus *bus,
                 const char *path,
@@ -651,12 +685,13 @@ static int method_unref_unit(sd_bus_message *message, void *userdata, sd_bus_err
 }
 
 static int reply_unit_info(sd_bus_message *reply, Unit *u) {
-        _cleanup_free_ char *unit_path = NULL, *job_path = NULL;
+        _cleanup_free_ char *job_path = NULL;
+        const char *unit_path;
         Unit *following;
 
         following = unit_following(u);
 
-        unit_path = unit_dbus_path(u);
+        unit_path = unit_dbus_path_cached(u);
         if (!unit_path)
                 return -ENOMEM;
 
@@ -1050,6 +1085,189 @@ static int method_list_units_by_patterns(sd_bus_message *message, void *userdata
         return list_units_filtered(message, userdata, error, states, patterns);
 }
 
+int bus_manager_append_units_accounting(Manager *m, sd_bus_message *reply) {
+        const char *k;
+        Iterator i;
+        Unit *u;
+        int r;
+
+        assert(m);
+        assert(reply);
+
+        /* Appends the accounting counters of all units that currently have a cgroup in one go, so that monitoring
+         * tools don't have to query the properties of each unit one by one. Counters that are not available are
+         * reported as UINT64_MAX, the same way the individual properties do. */
+
+        r = sd_bus_message_open_container(reply, 'a', "(sttttttt)");
+        if (r < 0)
+                return r;
+
+        HASHMAP_FOREACH_KEY(u, k, m->units, i) {
+                uint64_t memory = UINT64_MAX, tasks = UINT64_MAX, io_read = UINT64_MAX, io_write = UINT64_MAX,
+                        ip_ingress = UINT64_MAX, ip_egress = UINT64_MAX;
+                nsec_t cpu = NSEC_INFINITY;
+
+                if (k != u->id)
+                        continue;
+
+                if (!u->cgroup_path)
+                        continue;
+
+                (void) unit_get_memory_current(u, &memory);
+                (void) unit_get_cpu_usage(u, &cpu);
+                (void) unit_get_tasks_current(u, &tasks);
+                (void) unit_get_io_accounting(u, CGROUP_IO_READ_BYTES, false, &io_read);
+                (void) unit_get_io_accounting(u, CGROUP_IO_WRITE_BYTES, false, &io_write);
+                (void) unit_get_ip_accounting(u, CGROUP_IP_INGRESS_BYTES, &ip_ingress);
+                (void) unit_get_ip_accounting(u, CGROUP_IP_EGRESS_BYTES, &ip_egress);
+
+                r = sd_bus_message_append(
+                                reply, "(sttttttt)",
+                                u->id,
+                                memory,
+                                cpu,
+                                tasks,
+                                io_read,
+                                io_write,
+                                ip_ingress,
+                                ip_egress);
+                if (r < 0)
+                        return r;
+        }
+
+        return sd_bus_message_close_container(reply);
+}
+
+static int method_list_units_accounting(sd_bus_message *message, void *userdata, sd_bus_error *error) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+        Manager *m = userdata;
+        int r;
+
+        assert(message);
+        assert(m);
+
+        /* Anyone can call this method */
+
+        r = mac_selinux_access_check(message, "status", error);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_new_method_return(message, &reply);
+        if (r < 0)
+                return r;
+
+        r = bus_manager_append_units_accounting(m, reply);
+        if (r < 0)
+                return r;
+
+        return sd_bus_send(NULL, reply, NULL);
+}
+
+static int method_list_units_ip_accounting(sd_bus_message *message, void *userdata, sd_bus_error *error) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+        Manager *m = userdata;
+        const char *k;
+        Iterator i;
+        Unit *u;
+        int r;
+
+        assert(message);
+        assert(m);
+
+        /* Anyone can call this method */
+
+        r = mac_selinux_access_check(message, "status", error);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_new_method_return(message, &reply);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_open_container(reply, 'a', "(stttt)");
+        if (r < 0)
+                return r;
+
+        /* Returns all four IP accounting counters of all units with IP accounting turned on. Each accounting map
+         * is read only once for both of its counters. */
+
+        HASHMAP_FOREACH_KEY(u, k, m->units, i) {
+                uint64_t v[_CGROUP_IP_ACCOUNTING_METRIC_MAX];
+
+                if (k != u->id)
+                        continue;
+
+                if (unit_get_ip_accounting_all(u, v) == -ENODATA)
+                        continue;
+
+                r = sd_bus_message_append(
+                                reply, "(stttt)",
+                                u->id,
+                                v[CGROUP_IP_INGRESS_BYTES],
+                                v[CGROUP_IP_INGRESS_PACKETS],
+                                v[CGROUP_IP_EGRESS_BYTES],
+                                v[CGROUP_IP_EGRESS_PACKETS]);
+                if (r < 0)
+                        return r;
+        }
+
+        r = sd_bus_message_close_container(reply);
+        if (r < 0)
+                return r;
+
+        return sd_bus_send(NULL, reply, NULL);
+}
+
+static int method_list_units_timestamps(sd_bus_message *message, void *userdata, sd_bus_error *error) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+        Manager *m = userdata;
+        const char *k;
+        Iterator i;
+        Unit *u;
+        int r;
+
+        assert(message);
+        assert(m);
+
+        /* Anyone can call this method */
+
+        r = mac_selinux_access_check(message, "status", error);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_new_method_return(message, &reply);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_open_container(reply, 'a', "(stttt)");
+        if (r < 0)
+                return r;
+
+        /* Returns the monotonic state change timestamps of all units in one go, so that tools like
+         * systemd-analyze don't have to query the properties of each unit one by one. */
+
+        HASHMAP_FOREACH_KEY(u, k, m->units, i) {
+                if (k != u->id)
+                        continue;
+
+                r = sd_bus_message_append(
+                                reply, "(stttt)",
+                                u->id,
+                                u->inactive_exit_timestamp.monotonic,
+                                u->active_enter_timestamp.monotonic,
+                                u->active_exit_timestamp.monotonic,
+                                u->inactive_enter_timestamp.monotonic);
+                if (r < 0)
+                        return r;
+        }
+
+        r = sd_bus_message_close_container(reply);
+        if (r < 0)
+                return r;
+
+        return sd_bus_send(NULL, reply, NULL);
+}
+
 static int method_list_jobs(sd_bus_message *message, void *userdata, sd_bus_error *error) {
         _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
         Manager *m = userdata;
@@ -1205,6 +1423,36 @@ static int method_dump_by_fd(sd_bus_message *message, void *userdata, sd_bus_err
         return dump_impl(message, userdata, error, reply_dump_by_fd);
 }
 
+static int method_dump_trace(sd_bus_message *message, void *userdata, sd_bus_error *error) {
+        _cleanup_free_ char *dump = NULL;
+        _cleanup_close_ int fd = -1;
+        Manager *m = userdata;
+        int r;
+
+        assert(message);
+        assert(m);
+
+        /* Anyone can call this method */
+
+        r = mac_selinux_access_check(message, "status", error);
+        if (r < 0)
+                return r;
+
+        if (!m->trace.enabled)
+                return sd_bus_error_setf(error, SD_BUS_ERROR_NOT_SUPPORTED,
+                                         "Tracing is not enabled, boot with $SYSTEMD_TRACE=1 set to turn it on.");
+
+        r = manager_trace_format(&m->trace, &dump);
+        if (r < 0)
+                return r;
+
+        fd = acquire_data_fd(dump, strlen(dump), 0);
+        if (fd < 0)
+                return fd;
+
+        return sd_bus_reply_method_return(message, "h", fd);
+}
+
 static int method_refuse_snapshot(sd_bus_message *message, void *userdata, sd_bus_error *error) {
         return sd_bus_error_setf(error, SD_BUS_ERROR_NOT_SUPPORTED, "Support for snapshots has been removed.");
 }
@@ -2390,6 +2638,7 @@ const sd_bus_vtable bus_manager_vtable[] = {
         BUS_PROPERTY_DUAL_TIMESTAMP("InitRDGeneratorsFinishTimestamp", offsetof(Manager, timestamps[MANAGER_TIMESTAMP_INITRD_GENERATORS_FINISH]), SD_BUS_VTABLE_PROPERTY_CONST),
         BUS_PROPERTY_DUAL_TIMESTAMP("InitRDUnitsLoadStartTimestamp", offsetof(Manager, timestamps[MANAGER_TIMESTAMP_INITRD_UNITS_LOAD_START]), SD_BUS_VTABLE_PROPERTY_CONST),
         BUS_PROPERTY_DUAL_TIMESTAMP("InitRDUnitsLoadFinishTimestamp", offsetof(Manager, timestamps[MANAGER_TIMESTAMP_INITRD_UNITS_LOAD_FINISH]), SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_PROPERTY("GeneratorTimings", "a(stti)", property_get_generator_timings, 0, 0),
         SD_BUS_WRITABLE_PROPERTY("LogLevel", "s", bus_property_get_log_level, property_set_log_level, 0, 0),
         SD_BUS_WRITABLE_PROPERTY("LogTarget", "s", bus_property_get_log_target, property_set_log_target, 0, 0),
         SD_BUS_PROPERTY("NNames", "u", property_get_hashmap_size, offsetof(Manager, units), 0),
@@ -2726,6 +2975,24 @@ const sd_bus_vtable bus_manager_vtable[] = {
                                  SD_BUS_PARAM(units),
                                  method_list_units_by_names,
                                  SD_BUS_VTABLE_UNPRIVILEGED),
+        SD_BUS_METHOD_WITH_NAMES("ListUnitsAccounting",
+                                 NULL,,
+                                 "a(sttttttt)",
+                                 SD_BUS_PARAM(units),
+                                 method_list_units_accounting,
+                                 SD_BUS_VTABLE_UNPRIVILEGED),
+        SD_BUS_METHOD_WITH_NAMES("ListUnitsIPAccounting",
+                                 NULL,,
+                                 "a(stttt)",
+                                 SD_BUS_PARAM(units),
+                                 method_list_units_ip_accounting,
+                                 SD_BUS_VTABLE_UNPRIVILEGED),
+        SD_BUS_METHOD_WITH_NAMES("ListUnitsTimestamps",
+                                 NULL,,
+                                 "a(stttt)",
+                                 SD_BUS_PARAM(units),
+                                 method_list_units_timestamps,
+                                 SD_BUS_VTABLE_UNPRIVILEGED),
         SD_BUS_METHOD_WITH_NAMES("ListJobs",
                                  NULL,,
                                  "a(usssoo)",
@@ -2754,6 +3021,12 @@ const sd_bus_vtable bus_manager_vtable[] = {
                                  SD_BUS_PARAM(fd),
                                  method_dump_by_fd,
                                  SD_BUS_VTABLE_UNPRIVILEGED),
+        SD_BUS_METHOD_WITH_NAMES("DumpTrace",
+                                 NULL,,
+                                 "h",
+                                 SD_BUS_PARAM(fd),
+                                 method_dump_trace,
+                                 SD_BUS_VTABLE_UNPRIVILEGED),
         SD_BUS_METHOD_WITH_NAMES("CreateSnapshot",
                                  "sb",
                                  SD_BUS_PARAM(name)
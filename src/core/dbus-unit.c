@@ -152,22 +152,20 @@ static int property_get_dependencies(
                 void *userdata,
                 sd_bus_error *error) {
 
-        Hashmap **h = userdata;
-        Iterator j;
-        Unit *u;
-        void *v;
+        UnitDependencyArray **a = userdata;
+        size_t j;
         int r;
 
         assert(bus);
         assert(reply);
-        assert(h);
+        assert(a);
 
         r = sd_bus_message_open_container(reply, 'a', "s");
         if (r < 0)
                 return r;
 
-        HASHMAP_FOREACH_KEY(v, u, *h, j) {
-                r = sd_bus_message_append(reply, "s", u->id);
+        for (j = 0; *a && j < (*a)->n_entries; j++) {
+                r = sd_bus_message_append(reply, "s", (*a)->entries[j].other->id);
                 if (r < 0)
                         return r;
         }
@@ -1557,14 +1555,14 @@ const sd_bus_vtable bus_unit_cgroup_vtable[] = {
 
 static int send_new_signal(sd_bus *bus, void *userdata) {
         _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
-        _cleanup_free_ char *p = NULL;
+        const char *p;
         Unit *u = userdata;
         int r;
 
         assert(bus);
         assert(u);
 
-        p = unit_dbus_path(u);
+        p = unit_dbus_path_cached(u);
         if (!p)
                 return -ENOMEM;
 
@@ -1585,14 +1583,14 @@ static int send_new_signal(sd_bus *bus, void *userdata) {
 }
 
 static int send_changed_signal(sd_bus *bus, void *userdata) {
-        _cleanup_free_ char *p = NULL;
+        const char *p;
         Unit *u = userdata;
         int r;
 
         assert(bus);
         assert(u);
 
-        p = unit_dbus_path(u);
+        p = unit_dbus_path_cached(u);
         if (!p)
                 return -ENOMEM;
 
@@ -1672,14 +1670,14 @@ int bus_unit_send_pending_freezer_message(Unit *u) {
 
 static int send_removed_signal(sd_bus *bus, void *userdata) {
         _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
-        _cleanup_free_ char *p = NULL;
+        const char *p;
         Unit *u = userdata;
         int r;
 
         assert(bus);
         assert(u);
 
-        p = unit_dbus_path(u);
+        p = unit_dbus_path_cached(u);
         if (!p)
                 return -ENOMEM;
 
@@ -479,6 +479,12 @@ static int bus_job_enumerate(sd_bus *bus, const char *path, void *userdata, char
         Iterator i;
         Job *j;
 
+        /* Jobs have no children, hence if one of them is introspected there's nothing to enumerate */
+        if (!object_path_startswith("/org/freedesktop/systemd1/job", path)) {
+                *nodes = NULL;
+                return 0;
+        }
+
         l = new0(char*, hashmap_size(m->jobs)+1);
         if (!l)
                 return -ENOMEM;
@@ -501,16 +507,34 @@ static int bus_job_enumerate(sd_bus *bus, const char *path, void *userdata, char
 static int bus_unit_enumerate(sd_bus *bus, const char *path, void *userdata, char ***nodes, sd_bus_error *error) {
         _cleanup_strv_free_ char **l = NULL;
         Manager *m = userdata;
+        const char *key;
         unsigned k = 0;
         Iterator i;
         Unit *u;
 
+        /* Units have no children either. Without this check, introspecting each of the units in turn
+         * would list all units every single time. */
+        if (!object_path_startswith("/org/freedesktop/systemd1/unit", path)) {
+                *nodes = NULL;
+                return 0;
+        }
+
         l = new0(char*, hashmap_size(m->units)+1);
         if (!l)
                 return -ENOMEM;
 
-        HASHMAP_FOREACH(u, m->units, i) {
-                l[k] = unit_dbus_path(u);
+        HASHMAP_FOREACH_KEY(u, key, m->units, i) {
+                const char *p;
+
+                /* Units are in the hashmap once for each of their names, skip the aliases */
+                if (key != u->id)
+                        continue;
+
+                p = unit_dbus_path_cached(u);
+                if (!p)
+                        return -ENOMEM;
+
+                l[k] = strdup(p);
                 if (!l[k])
                         return -ENOMEM;
 
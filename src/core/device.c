@@ -27,6 +27,16 @@ static const UnitActiveState state_translation_table[_DEVICE_STATE_MAX] = {
         [DEVICE_PLUGGED] = UNIT_ACTIVE,
 };
 
+/* Flush the uevents queued so far right away once there are this many, to bound latency during uevent storms */
+#define DEVICES_PENDING_MAX 1024U
+
+typedef struct DevicePending {
+        char *sysfs;
+        sd_device *dev;
+        DeviceAction action;
+        bool changed; /* whether any of the coalesced events was a change event */
+} DevicePending;
+
 static int device_dispatch_io(sd_device_monitor *monitor, sd_device *dev, void *userdata);
 static void device_update_found_one(Device *d, DeviceFound found, DeviceFound mask);
 
@@ -468,13 +478,11 @@ static bool device_is_bound_by_mounts(Device *d, sd_device *dev) {
 
 static void device_upgrade_mount_deps(Unit *u) {
         Unit *other;
-        Iterator i;
-        void *v;
         int r;
 
         /* Let's upgrade Requires= to BindsTo= on us. (Used when SYSTEMD_MOUNT_DEVICE_BOUND is set) */
 
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_REQUIRED_BY], i) {
+        UNIT_FOREACH_DEPENDENCY(other, u, UNIT_REQUIRED_BY) {
                 if (other->type != UNIT_MOUNT)
                         continue;
 
@@ -799,9 +807,23 @@ static int device_following_set(Unit *u, Set **_set) {
         return 1;
 }
 
+static DevicePending* device_pending_free(DevicePending *p) {
+        if (!p)
+                return NULL;
+
+        sd_device_unref(p->dev);
+        free(p->sysfs);
+        return mfree(p);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(DevicePending*, device_pending_free);
+DEFINE_PRIVATE_HASH_OPS_WITH_VALUE_DESTRUCTOR(device_pending_hash_ops, char, path_hash_func, path_compare, DevicePending, device_pending_free);
+
 static void device_shutdown(Manager *m) {
         assert(m);
 
+        m->device_flush_event_source = sd_event_source_unref(m->device_flush_event_source);
+        m->devices_pending = ordered_hashmap_free(m->devices_pending);
         m->device_monitor = sd_device_monitor_unref(m->device_monitor);
         m->devices_by_sysfs = hashmap_free(m->devices_by_sysfs);
 }
@@ -894,28 +916,14 @@ static void device_propagate_reload_by_sysfs(Manager *m, const char *sysfs) {
         }
 }
 
-static int device_dispatch_io(sd_device_monitor *monitor, sd_device *dev, void *userdata) {
-        Manager *m = userdata;
-        DeviceAction action;
-        const char *sysfs;
+static void device_process_event(Manager *m, sd_device *dev, const char *sysfs, DeviceAction action, bool changed) {
         int r;
 
         assert(m);
         assert(dev);
+        assert(sysfs);
 
-        r = sd_device_get_syspath(dev, &sysfs);
-        if (r < 0) {
-                log_device_error_errno(dev, r, "Failed to get device sys path: %m");
-                return 0;
-        }
-
-        r = device_get_action(dev, &action);
-        if (r < 0) {
-                log_device_error_errno(dev, r, "Failed to get udev action: %m");
-                return 0;
-        }
-
-        if (action == DEVICE_ACTION_CHANGE)
+        if (changed)
                 device_propagate_reload_by_sysfs(m, sysfs);
 
         /* A change event can signal that a device is becoming ready, in particular if
@@ -951,6 +959,138 @@ static int device_dispatch_io(sd_device_monitor *monitor, sd_device *dev, void *
 
                 device_update_found_by_sysfs(m, sysfs, 0, DEVICE_FOUND_UDEV);
         }
+}
+
+static void device_process_pending(Manager *m, DevicePending *p) {
+        assert(m);
+        assert(p);
+
+        device_process_event(m, p->dev, p->sysfs, p->action, p->changed);
+        device_pending_free(p);
+}
+
+static void device_flush_pending(Manager *m) {
+        DevicePending *p;
+
+        assert(m);
+
+        while ((p = ordered_hashmap_steal_first(m->devices_pending)))
+                device_process_pending(m, p);
+}
+
+static int device_dispatch_flush(sd_event_source *source, void *userdata) {
+        Manager *m = userdata;
+
+        assert(m);
+
+        device_flush_pending(m);
+        return 0;
+}
+
+static int device_enqueue_event(Manager *m, sd_device *dev, const char *sysfs, DeviceAction action) {
+        _cleanup_(device_pending_freep) DevicePending *n = NULL;
+        DevicePending *p;
+        int r;
+
+        assert(m);
+        assert(dev);
+        assert(sysfs);
+
+        /* Queues the uevent, to be processed once the event loop has nothing more urgent to do, i.e. usually
+         * once we read everything that is queued on the monitor socket. Consecutive non-remove events for the
+         * same device are coalesced, only the most recent state is processed then. Removals are never merged
+         * with anything, so that they are processed in order. */
+
+        p = ordered_hashmap_get(m->devices_pending, sysfs);
+        if (p && (p->action == DEVICE_ACTION_REMOVE || action == DEVICE_ACTION_REMOVE)) {
+                assert_se(ordered_hashmap_remove(m->devices_pending, sysfs) == p);
+                device_process_pending(m, p);
+                p = NULL;
+        }
+
+        if (p) {
+                sd_device_unref(p->dev);
+                p->dev = sd_device_ref(dev);
+                p->action = action;
+                p->changed = p->changed || action == DEVICE_ACTION_CHANGE;
+                return 0;
+        }
+
+        if (!m->device_flush_event_source) {
+                r = sd_event_add_defer(m->event, &m->device_flush_event_source, device_dispatch_flush, m);
+                if (r < 0)
+                        return r;
+
+                /* Lower than the device monitor, so that we first read everything queued */
+                r = sd_event_source_set_priority(m->device_flush_event_source, SD_EVENT_PRIORITY_NORMAL+5);
+                if (r < 0)
+                        return r;
+
+                (void) sd_event_source_set_description(m->device_flush_event_source, "device-flush");
+        }
+
+        r = ordered_hashmap_ensure_allocated(&m->devices_pending, &device_pending_hash_ops);
+        if (r < 0)
+                return r;
+
+        n = new(DevicePending, 1);
+        if (!n)
+                return -ENOMEM;
+
+        *n = (DevicePending) {
+                .sysfs = strdup(sysfs),
+                .dev = sd_device_ref(dev),
+                .action = action,
+                .changed = action == DEVICE_ACTION_CHANGE,
+        };
+        if (!n->sysfs)
+                return -ENOMEM;
+
+        r = sd_event_source_set_enabled(m->device_flush_event_source, SD_EVENT_ONESHOT);
+        if (r < 0)
+                return r;
+
+        r = ordered_hashmap_put(m->devices_pending, n->sysfs, n);
+        if (r < 0)
+                return r;
+
+        TAKE_PTR(n);
+
+        if (ordered_hashmap_size(m->devices_pending) >= DEVICES_PENDING_MAX)
+                device_flush_pending(m);
+
+        return 0;
+}
+
+static int device_dispatch_io(sd_device_monitor *monitor, sd_device *dev, void *userdata) {
+        Manager *m = userdata;
+        DeviceAction action;
+        const char *sysfs;
+        int r;
+
+        assert(m);
+        assert(dev);
+
+        r = sd_device_get_syspath(dev, &sysfs);
+        if (r < 0) {
+                log_device_error_errno(dev, r, "Failed to get device sys path: %m");
+                return 0;
+        }
+
+        r = device_get_action(dev, &action);
+        if (r < 0) {
+                log_device_error_errno(dev, r, "Failed to get udev action: %m");
+                return 0;
+        }
+
+        r = device_enqueue_event(m, dev, sysfs, action);
+        if (r < 0) {
+                log_device_debug_errno(dev, r, "Failed to queue uevent, processing it right away: %m");
+
+                /* Keep things in order */
+                device_flush_pending(m);
+                device_process_event(m, dev, sysfs, action, action == DEVICE_ACTION_CHANGE);
+        }
 
         return 0;
 }
@@ -67,18 +67,23 @@
 #include "parse-util.h"
 #include "path-util.h"
 #include "process-util.h"
+#include "raw-clone.h"
 #include "rlimit-util.h"
 #include "rm-rf.h"
 #if HAVE_SECCOMP
 #include "seccomp-util.h"
+#else
+typedef struct SeccompProgram SeccompProgram;
 #endif
 #include "securebits-util.h"
 #include "selinux-util.h"
+#include "serialize.h"
 #include "signal-util.h"
 #include "smack-util.h"
 #include "socket-util.h"
 #include "special.h"
 #include "stat-util.h"
+#include "stdio-util.h"
 #include "string-table.h"
 #include "string-util.h"
 #include "strv.h"
@@ -1436,8 +1441,76 @@ static bool skip_seccomp_unavailable(const Unit* u, const char* msg) {
         return true;
 }
 
-static int apply_syscall_filter(const Unit* u, const ExecContext *c, bool needs_ambient_hack) {
-        uint32_t negative_action, default_action, action;
+static void syscall_filter_actions(const ExecContext *c, uint32_t *ret_default_action, uint32_t *ret_action) {
+        uint32_t negative_action;
+
+        negative_action = c->syscall_errno == 0 ? scmp_act_kill_process() : SCMP_ACT_ERRNO(c->syscall_errno);
+
+        if (c->syscall_whitelist) {
+                *ret_default_action = negative_action;
+                *ret_action = SCMP_ACT_ALLOW;
+        } else {
+                *ret_default_action = SCMP_ACT_ALLOW;
+                *ret_action = negative_action;
+        }
+}
+
+static const SeccompProgram *get_syscall_filter_program(Unit *u, const ExecContext *c, bool needs_ambient_hack) {
+        _cleanup_(seccomp_program_freep) SeccompProgram *p = NULL;
+        _cleanup_hashmap_free_ Hashmap *filter = NULL;
+        uint32_t default_action, action;
+        SeccompProgram *found;
+        int r;
+
+        assert(u);
+        assert(c);
+
+        /* Compiles the system call filter in the manager, once for each distinct set of rules, so that the
+         * forked child only has to load the resulting BPF. Returns NULL if that didn't work out, in which case
+         * the child builds the filter on its own. */
+
+        if (!context_has_syscall_filters(c) || !is_seccomp_available())
+                return NULL;
+
+        syscall_filter_actions(c, &default_action, &action);
+
+        if (needs_ambient_hack) {
+                filter = hashmap_copy(c->syscall_filter);
+                if (!filter)
+                        return NULL;
+
+                r = seccomp_filter_set_add(filter, c->syscall_whitelist, syscall_filter_sets + SYSCALL_FILTER_SET_SETUID);
+                if (r < 0)
+                        return NULL;
+        }
+
+        r = seccomp_program_new(default_action, filter ?: c->syscall_filter, action, &p);
+        if (r < 0)
+                return NULL;
+
+        found = set_get(u->manager->seccomp_programs, p);
+        if (found)
+                return found;
+
+        r = seccomp_program_compile(p, false);
+        if (r < 0) {
+                log_unit_debug_errno(u, r, "Failed to compile system call filter, leaving it to the child: %m");
+                return NULL;
+        }
+
+        r = set_ensure_allocated(&u->manager->seccomp_programs, &seccomp_program_hash_ops);
+        if (r < 0)
+                return NULL;
+
+        r = set_put(u->manager->seccomp_programs, p);
+        if (r < 0)
+                return NULL;
+
+        return TAKE_PTR(p);
+}
+
+static int apply_syscall_filter(const Unit* u, const ExecContext *c, bool needs_ambient_hack, const SeccompProgram *program) {
+        uint32_t default_action, action;
         int r;
 
         assert(u);
@@ -1449,15 +1522,11 @@ static int apply_syscall_filter(const Unit* u, const ExecContext *c, bool needs_
         if (skip_seccomp_unavailable(u, "SystemCallFilter="))
                 return 0;
 
-        negative_action = c->syscall_errno == 0 ? scmp_act_kill_process() : SCMP_ACT_ERRNO(c->syscall_errno);
+        /* Compiled by the manager already? Then just load it. */
+        if (program)
+                return seccomp_program_load(program);
 
-        if (c->syscall_whitelist) {
-                default_action = negative_action;
-                action = SCMP_ACT_ALLOW;
-        } else {
-                default_action = SCMP_ACT_ALLOW;
-                action = negative_action;
-        }
+        syscall_filter_actions(c, &default_action, &action);
 
         if (needs_ambient_hack) {
                 r = seccomp_filter_set_add(c->syscall_filter, c->syscall_whitelist, syscall_filter_sets + SYSCALL_FILTER_SET_SETUID);
@@ -3098,6 +3167,8 @@ static int exec_child(
                 size_t n_storage_fds,
                 char **files_env,
                 int user_lookup_fd,
+                bool in_cgroup,
+                const SeccompProgram *syscall_filter_program,
                 int *exit_status) {
 
         _cleanup_strv_free_ char **our_env = NULL, **pass_env = NULL, **accum_env = NULL, **replaced_argv = NULL;
@@ -3304,8 +3375,9 @@ static int exec_child(
                 (void) fd_nonblock(socket_fd, false);
 
         /* Journald will try to look-up our cgroup in order to populate _SYSTEMD_CGROUP and _SYSTEMD_UNIT fields.
-         * Hence we need to migrate to the target cgroup from init.scope before connecting to journald */
-        if (params->cgroup_path) {
+         * Hence we need to migrate to the target cgroup from init.scope before connecting to journald, unless we
+         * were created in it right away. */
+        if (params->cgroup_path && !in_cgroup) {
                 _cleanup_free_ char *p = NULL;
 
                 r = exec_parameters_get_cgroup_path(params, &p);
@@ -3947,7 +4019,7 @@ static int exec_child(
 
                 /* This really should remain the last step before the execve(), to make sure our own code is unaffected
                  * by the filter as little as possible. */
-                r = apply_syscall_filter(unit, context, needs_ambient_hack);
+                r = apply_syscall_filter(unit, context, needs_ambient_hack, syscall_filter_program);
                 if (r < 0) {
                         *exit_status = EXIT_SECCOMP;
                         return log_unit_error_errno(unit, r, "Failed to apply system call filters: %m");
@@ -4034,6 +4106,58 @@ static int exec_child(
 static int exec_context_load_environment(const Unit *unit, const ExecContext *c, char ***l);
 static int exec_context_named_iofds(const ExecContext *c, const ExecParameters *p, int named_iofds[static 3]);
 
+/* Set once clone3() with CLONE_INTO_CGROUP turned out to be unavailable, so that we don't retry it for each spawn */
+static bool clone_into_cgroup_unavailable = false;
+
+static pid_t exec_fork(Unit *unit, const char *cgroup_path, bool *ret_in_cgroup) {
+        _cleanup_close_ int cgroup_fd = -1;
+        _cleanup_free_ char *p = NULL;
+        pid_t pid;
+
+        assert(unit);
+        assert(ret_in_cgroup);
+
+        /* Forks off the child. If all controllers are on the unified hierarchy and the kernel supports it, the child
+         * is created right in its cgroup, which saves both the child and us from migrating it there afterwards.
+         * Each migration is a write to cgroup.procs that takes a global lock in the kernel, which gets contended,
+         * and hence slow, when many processes are spawned at the same time. */
+
+        *ret_in_cgroup = false;
+
+        if (!cgroup_path || clone_into_cgroup_unavailable || cg_all_unified() <= 0)
+                return fork();
+
+        /* clone3() bypasses what glibc's fork() does to keep the child consistent, which only matters if other
+         * threads might hold locks at the moment we clone, see raw_clone_into_cgroup(). We run threads now and
+         * then (e.g. asynchronous_close() or the unit load threads), hence check that none is around. */
+        if (get_process_threads(0) != 1)
+                return fork();
+
+        if (cg_get_path(SYSTEMD_CGROUP_CONTROLLER, cgroup_path, NULL, &p) < 0)
+                return fork();
+
+        cgroup_fd = open(p, O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+        if (cgroup_fd < 0) {
+                log_unit_debug_errno(unit, errno, "Failed to open cgroup %s, not spawning into it directly: %m", p);
+                return fork();
+        }
+
+        pid = raw_clone_into_cgroup(cgroup_fd);
+        if (pid >= 0) {
+                *ret_in_cgroup = true;
+                return pid;
+        }
+
+        if (IN_SET(errno, ENOSYS, E2BIG, EINVAL, EPERM)) {
+                /* Old kernel, or clone3() blocked by seccomp, as some container managers do */
+                log_unit_debug_errno(unit, errno, "clone3() with CLONE_INTO_CGROUP not available, using fork(): %m");
+                clone_into_cgroup_unavailable = true;
+        } else
+                log_unit_debug_errno(unit, errno, "Failed to spawn directly into cgroup %s, using fork(): %m", p);
+
+        return fork();
+}
+
 int exec_spawn(Unit *unit,
                ExecCommand *command,
                const ExecContext *context,
@@ -4045,8 +4169,11 @@ int exec_spawn(Unit *unit,
         int socket_fd, r, named_iofds[3] = { -1, -1, -1 }, *fds = NULL;
         _cleanup_free_ char *subcgroup_path = NULL;
         _cleanup_strv_free_ char **files_env = NULL;
+        const SeccompProgram *syscall_filter_program = NULL;
         size_t n_storage_fds = 0, n_socket_fds = 0;
         _cleanup_free_ char *line = NULL;
+        bool in_cgroup;
+        usec_t trace;
         pid_t pid;
 
         assert(unit);
@@ -4056,6 +4183,8 @@ int exec_spawn(Unit *unit,
         assert(params);
         assert(params->fds || (params->n_socket_fds + params->n_storage_fds <= 0));
 
+        trace = manager_trace_begin(&unit->manager->trace);
+
         if (context->std_input == EXEC_INPUT_SOCKET ||
             context->std_output == EXEC_OUTPUT_SOCKET ||
             context->std_error == EXEC_OUTPUT_SOCKET) {
@@ -4107,7 +4236,15 @@ int exec_spawn(Unit *unit,
                 }
         }
 
-        pid = fork();
+#if HAVE_SECCOMP
+        /* Compiling the system call filter is expensive, do it here once rather than in each child */
+        if (params->flags & EXEC_APPLY_SANDBOXING)
+                syscall_filter_program = get_syscall_filter_program(
+                                unit, context,
+                                (command->flags & EXEC_COMMAND_AMBIENT_MAGIC) && !ambient_capabilities_supported());
+#endif
+
+        pid = exec_fork(unit, subcgroup_path, &in_cgroup);
         if (pid < 0)
                 return log_unit_error_errno(unit, errno, "Failed to fork: %m");
 
@@ -4127,6 +4264,8 @@ int exec_spawn(Unit *unit,
                                n_storage_fds,
                                files_env,
                                unit->manager->user_lookup_fds[1],
+                               in_cgroup,
+                               syscall_filter_program,
                                &exit_status);
 
                 if (r < 0) {
@@ -4150,12 +4289,14 @@ int exec_spawn(Unit *unit,
 
         /* We add the new process to the cgroup both in the child (so that we can be sure that no user code is ever
          * executed outside of the cgroup) and in the parent (so that we can be sure that when we kill the cgroup the
-         * process will be killed too). */
-        if (subcgroup_path)
+         * process will be killed too). Neither is necessary if it was created in the cgroup in the first place. */
+        if (subcgroup_path && !in_cgroup)
                 (void) cg_attach(SYSTEMD_CGROUP_CONTROLLER, subcgroup_path, pid);
 
         exec_status_start(&command->exec_status, pid);
 
+        manager_trace_end(&unit->manager->trace, "exec-spawn", unit->id, trace);
+
         *ret = pid;
         return 0;
 }
@@ -5521,35 +5662,45 @@ int exec_runtime_serialize(const Manager *m, FILE *f, FDSet *fds) {
         assert(fds);
 
         HASHMAP_FOREACH(rt, m->exec_runtime_by_id, i) {
-                fprintf(f, "exec-runtime=%s", rt->id);
+                _cleanup_free_ char *value = NULL;
 
-                if (rt->tmp_dir)
-                        fprintf(f, " tmp-dir=%s", rt->tmp_dir);
+                value = strdup(rt->id);
+                if (!value)
+                        return log_oom();
 
-                if (rt->var_tmp_dir)
-                        fprintf(f, " var-tmp-dir=%s", rt->var_tmp_dir);
+                if (rt->tmp_dir && !strextend(&value, " tmp-dir=", rt->tmp_dir, NULL))
+                        return log_oom();
+
+                if (rt->var_tmp_dir && !strextend(&value, " var-tmp-dir=", rt->var_tmp_dir, NULL))
+                        return log_oom();
 
                 if (rt->netns_storage_socket[0] >= 0) {
+                        char buf[DECIMAL_STR_MAX(int)];
                         int copy;
 
                         copy = fdset_put_dup(fds, rt->netns_storage_socket[0]);
                         if (copy < 0)
                                 return copy;
 
-                        fprintf(f, " netns-socket-0=%i", copy);
+                        xsprintf(buf, "%i", copy);
+                        if (!strextend(&value, " netns-socket-0=", buf, NULL))
+                                return log_oom();
                 }
 
                 if (rt->netns_storage_socket[1] >= 0) {
+                        char buf[DECIMAL_STR_MAX(int)];
                         int copy;
 
                         copy = fdset_put_dup(fds, rt->netns_storage_socket[1]);
                         if (copy < 0)
                                 return copy;
 
-                        fprintf(f, " netns-socket-1=%i", copy);
+                        xsprintf(buf, "%i", copy);
+                        if (!strextend(&value, " netns-socket-1=", buf, NULL))
+                                return log_oom();
                 }
 
-                fputc('\n', f);
+                (void) serialize_item(f, "exec-runtime", value);
         }
 
         return 0;
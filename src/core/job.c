@@ -235,6 +235,7 @@ Job* job_install(Job *j) {
         j->installed = true;
 
         j->manager->n_installed_jobs++;
+        metric_inc(j->manager->metrics + MANAGER_METRIC_JOBS_INSTALLED);
         log_unit_debug(j->unit,
                        "Installed new job %s/%s as %u",
                        j->unit->id, job_type_to_string(j->type), (unsigned) j->id);
@@ -491,9 +492,7 @@ int job_type_merge_and_collapse(JobType *a, JobType b, Unit *u) {
 }
 
 static bool job_is_runnable(Job *j) {
-        Iterator i;
         Unit *other;
-        void *v;
 
         assert(j);
         assert(j->installed);
@@ -515,7 +514,7 @@ static bool job_is_runnable(Job *j) {
         if (j->type == JOB_NOP)
                 return true;
 
-        HASHMAP_FOREACH_KEY(v, other, j->unit->dependencies[UNIT_AFTER], i)
+        UNIT_FOREACH_DEPENDENCY(other, j->unit, UNIT_AFTER)
                 if (other->job && job_compare(j, other->job, UNIT_AFTER) > 0) {
                         log_unit_debug(j->unit,
                                        "starting held back, waiting for: %s",
@@ -523,7 +522,7 @@ static bool job_is_runnable(Job *j) {
                         return false;
                 }
 
-        HASHMAP_FOREACH_KEY(v, other, j->unit->dependencies[UNIT_BEFORE], i)
+        UNIT_FOREACH_DEPENDENCY(other, j->unit, UNIT_BEFORE)
                 if (other->job && job_compare(j, other->job, UNIT_BEFORE) > 0) {
                         log_unit_debug(j->unit,
                                        "stopping held back, waiting for: %s",
@@ -990,12 +989,10 @@ static void job_emit_done_status_message(Unit *u, uint32_t job_id, JobType t, Jo
 
 static void job_fail_dependencies(Unit *u, UnitDependency d) {
         Unit *other;
-        Iterator i;
-        void *v;
 
         assert(u);
 
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[d], i) {
+        UNIT_FOREACH_DEPENDENCY(other, u, d) {
                 Job *j = other->job;
 
                 if (!j)
@@ -1011,8 +1008,6 @@ int job_finish_and_invalidate(Job *j, JobResult result, bool recursive, bool alr
         Unit *u;
         Unit *other;
         JobType t;
-        Iterator i;
-        void *v;
 
         assert(j);
         assert(j->installed);
@@ -1042,8 +1037,14 @@ int job_finish_and_invalidate(Job *j, JobResult result, bool recursive, bool alr
                 goto finish;
         }
 
-        if (IN_SET(result, JOB_FAILED, JOB_INVALID))
+        if (IN_SET(result, JOB_FAILED, JOB_INVALID)) {
                 j->manager->n_failed_jobs++;
+                metric_inc(j->manager->metrics + MANAGER_METRIC_JOBS_FAILED);
+        }
+
+        if (t == JOB_STOP && result == JOB_DONE && !already &&
+            dual_timestamp_is_set(&j->manager->shutdown_start_timestamp))
+                j->manager->n_shutdown_stopped_units++;
 
         job_uninstall(j);
         job_free(j);
@@ -1104,12 +1105,12 @@ int job_finish_and_invalidate(Job *j, JobResult result, bool recursive, bool alr
 
 finish:
         /* Try to start the next jobs that can be started */
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_AFTER], i)
+        UNIT_FOREACH_DEPENDENCY(other, u, UNIT_AFTER)
                 if (other->job) {
                         job_add_to_run_queue(other->job);
                         job_add_to_gc_queue(other->job);
                 }
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_BEFORE], i)
+        UNIT_FOREACH_DEPENDENCY(other, u, UNIT_BEFORE)
                 if (other->job) {
                         job_add_to_run_queue(other->job);
                         job_add_to_gc_queue(other->job);
@@ -1221,6 +1222,9 @@ void job_add_to_dbus_queue(Job *j) {
          * job might just have been created and not yet assigned to a
          * connection/client. */
 
+        if (j->manager->dbus_signal_coalesce_usec > 0 && !j->manager->dbus_unit_queue && !j->manager->dbus_job_queue)
+                j->manager->dbus_queue_since = now(CLOCK_MONOTONIC);
+
         LIST_PREPEND(dbus_queue, j->manager->dbus_job_queue, j);
         j->in_dbus_queue = true;
 }
@@ -1255,7 +1259,7 @@ int job_serialize(Job *j, FILE *f) {
         bus_track_serialize(j->bus_track, f, "subscribed");
 
         /* End marker */
-        fputc('\n', f);
+        (void) serialize_marker(f, "");
         return 0;
 }
 
@@ -1270,7 +1274,7 @@ int job_deserialize(Job *j, FILE *f) {
                 char *l, *v;
                 size_t k;
 
-                r = read_line(f, LONG_LINE_MAX, &line);
+                r = deserialize_read_line(f, &line);
                 if (r < 0)
                         return log_error_errno(r, "Failed to read serialization line: %m");
                 if (r == 0)
@@ -1422,6 +1426,9 @@ void job_shutdown_magic(Job *j) {
         if (!unit_has_name(j->unit, SPECIAL_SHUTDOWN_TARGET))
                 return;
 
+        if (!dual_timestamp_is_set(&j->unit->manager->shutdown_start_timestamp))
+                dual_timestamp_get(&j->unit->manager->shutdown_start_timestamp);
+
         /* In case messages on console has been disabled on boot */
         j->unit->manager->no_console_output = false;
 
@@ -1459,8 +1466,6 @@ int job_get_timeout(Job *j, usec_t *timeout) {
 
 bool job_may_gc(Job *j) {
         Unit *other;
-        Iterator i;
-        void *v;
 
         assert(j);
 
@@ -1489,11 +1494,11 @@ bool job_may_gc(Job *j) {
                 return false;
 
         /* The logic is inverse to job_is_runnable, we cannot GC as long as we block any job. */
-        HASHMAP_FOREACH_KEY(v, other, j->unit->dependencies[UNIT_BEFORE], i)
+        UNIT_FOREACH_DEPENDENCY(other, j->unit, UNIT_BEFORE)
                 if (other->job && job_compare(j, other->job, UNIT_BEFORE) < 0)
                         return false;
 
-        HASHMAP_FOREACH_KEY(v, other, j->unit->dependencies[UNIT_AFTER], i)
+        UNIT_FOREACH_DEPENDENCY(other, j->unit, UNIT_AFTER)
                 if (other->job && job_compare(j, other->job, UNIT_AFTER) < 0)
                         return false;
 
@@ -1540,8 +1545,6 @@ int job_get_before(Job *j, Job*** ret) {
         _cleanup_free_ Job** list = NULL;
         size_t n = 0, n_allocated = 0;
         Unit *other = NULL;
-        Iterator i;
-        void *v;
 
         /* Returns a list of all pending jobs that need to finish before this job may be started. */
 
@@ -1553,7 +1556,7 @@ int job_get_before(Job *j, Job*** ret) {
                 return 0;
         }
 
-        HASHMAP_FOREACH_KEY(v, other, j->unit->dependencies[UNIT_AFTER], i) {
+        UNIT_FOREACH_DEPENDENCY(other, j->unit, UNIT_AFTER) {
                 if (!other->job)
                         continue;
                 if (job_compare(j, other->job, UNIT_AFTER) <= 0)
@@ -1564,7 +1567,7 @@ int job_get_before(Job *j, Job*** ret) {
                 list[n++] = other->job;
         }
 
-        HASHMAP_FOREACH_KEY(v, other, j->unit->dependencies[UNIT_BEFORE], i) {
+        UNIT_FOREACH_DEPENDENCY(other, j->unit, UNIT_BEFORE) {
                 if (!other->job)
                         continue;
                 if (job_compare(j, other->job, UNIT_BEFORE) <= 0)
@@ -1586,15 +1589,13 @@ int job_get_after(Job *j, Job*** ret) {
         _cleanup_free_ Job** list = NULL;
         size_t n = 0, n_allocated = 0;
         Unit *other = NULL;
-        void *v;
-        Iterator i;
 
         assert(j);
         assert(ret);
 
         /* Returns a list of all pending jobs that are waiting for this job to finish. */
 
-        HASHMAP_FOREACH_KEY(v, other, j->unit->dependencies[UNIT_BEFORE], i) {
+        UNIT_FOREACH_DEPENDENCY(other, j->unit, UNIT_BEFORE) {
                 if (!other->job)
                         continue;
 
@@ -1609,7 +1610,7 @@ int job_get_after(Job *j, Job*** ret) {
                 list[n++] = other->job;
         }
 
-        HASHMAP_FOREACH_KEY(v, other, j->unit->dependencies[UNIT_AFTER], i) {
+        UNIT_FOREACH_DEPENDENCY(other, j->unit, UNIT_AFTER) {
                 if (!other->job)
                         continue;
 
@@ -113,11 +113,22 @@ int unit_load_dropin(Unit *u) {
                         return log_oom();
         }
 
-        STRV_FOREACH(f, u->dropin_paths)
-                (void) config_parse(u->id, *f, NULL,
-                                    UNIT_VTABLE(u)->sections,
-                                    config_item_perf_lookup, load_fragment_gperf_lookup,
-                                    0, u);
+        STRV_FOREACH(f, u->dropin_paths) {
+                ConfigFile *c;
+
+                /* The file might have been read ahead already, see unit_load_queue_prefetch() */
+                c = hashmap_get(u->manager->prefetched_config, *f);
+                if (c)
+                        (void) config_parse_file(u->id, c,
+                                                 UNIT_VTABLE(u)->sections,
+                                                 config_item_perf_lookup, load_fragment_gperf_lookup,
+                                                 0, u);
+                else
+                        (void) config_parse(u->id, *f, NULL,
+                                            UNIT_VTABLE(u)->sections,
+                                            config_item_perf_lookup, load_fragment_gperf_lookup,
+                                            0, u);
+        }
 
         u->dropin_mtime = now(CLOCK_REALTIME);
 
@@ -25,6 +25,7 @@
 #include "cgroup-setup.h"
 #include "conf-parser.h"
 #include "cpu-set-util.h"
+#include "dropin.h"
 #include "env-util.h"
 #include "errno-list.h"
 #include "escape.h"
@@ -43,6 +44,7 @@
 #include "parse-util.h"
 #include "path-util.h"
 #include "process-util.h"
+#include "pthread-util.h"
 #if HAVE_SECCOMP
 #include "seccomp-util.h"
 #endif
@@ -1676,7 +1678,7 @@ int config_parse_trigger_unit(
         assert(rvalue);
         assert(data);
 
-        if (!hashmap_isempty(u->dependencies[UNIT_TRIGGERS])) {
+        if (unit_dependency_count(u, UNIT_TRIGGERS) > 0) {
                 log_syntax(unit, LOG_ERR, filename, line, 0, "Multiple units to trigger specified, ignoring: %s", rvalue);
                 return 0;
         }
@@ -4766,7 +4768,8 @@ int unit_load_fragment(Unit *u) {
                                      &u->manager->unit_cache_mtime,
                                      &u->manager->unit_id_map,
                                      &u->manager->unit_name_map,
-                                     &u->manager->unit_path_cache);
+                                     &u->manager->unit_path_cache,
+                                     &u->manager->unit_file_cache);
         if (r < 0)
                 log_error_errno(r, "Failed to rebuild name map: %m");
 
@@ -4781,16 +4784,23 @@ int unit_load_fragment(Unit *u) {
         if (fragment) {
                 /* Open the file, check if this is a mask, otherwise read. */
                 _cleanup_fclose_ FILE *f = NULL;
+                ConfigFile *c;
 
-                /* Try to open the file name. A symlink is OK, for example for linked files or masks. We
-                 * expect that all symlinks within the lookup paths have been already resolved, but we don't
-                 * verify this here. */
-                f = fopen(fragment, "re");
-                if (!f)
-                        return log_unit_notice_errno(u, errno, "Failed to open %s: %m", fragment);
-
-                if (fstat(fileno(f), &st) < 0)
-                        return -errno;
+                /* The file might have been read ahead already, see unit_load_queue_prefetch() */
+                c = hashmap_get(u->manager->prefetched_config, fragment);
+                if (c)
+                        st = c->st;
+                else {
+                        /* Try to open the file name. A symlink is OK, for example for linked files or
+                         * masks. We expect that all symlinks within the lookup paths have been already
+                         * resolved, but we don't verify this here. */
+                        f = fopen(fragment, "re");
+                        if (!f)
+                                return log_unit_notice_errno(u, errno, "Failed to open %s: %m", fragment);
+
+                        if (fstat(fileno(f), &st) < 0)
+                                return -errno;
+                }
 
                 r = free_and_strdup(&u->fragment_path, fragment);
                 if (r < 0)
@@ -4806,10 +4816,16 @@ int unit_load_fragment(Unit *u) {
                         u->fragment_mtime = timespec_load(&st.st_mtim);
 
                         /* Now, parse the file contents */
-                        r = config_parse(u->id, fragment, f,
-                                         UNIT_VTABLE(u)->sections,
-                                         config_item_perf_lookup, load_fragment_gperf_lookup,
-                                         CONFIG_PARSE_ALLOW_INCLUDE, u);
+                        if (c)
+                                r = config_parse_file(u->id, c,
+                                                      UNIT_VTABLE(u)->sections,
+                                                      config_item_perf_lookup, load_fragment_gperf_lookup,
+                                                      CONFIG_PARSE_ALLOW_INCLUDE, u);
+                        else
+                                r = config_parse(u->id, fragment, f,
+                                                 UNIT_VTABLE(u)->sections,
+                                                 config_item_perf_lookup, load_fragment_gperf_lookup,
+                                                 CONFIG_PARSE_ALLOW_INCLUDE, u);
                         if (r == -ENOEXEC)
                                 log_unit_notice_errno(u, r, "Unit configuration has fatal error, unit will not be started.");
                         if (r < 0)
@@ -4855,6 +4871,193 @@ int unit_load_fragment(Unit *u) {
         return 0;
 }
 
+typedef struct PrefetchEntry {
+        char *id;
+        ConfigFile **files;
+        size_t n_files, n_allocated;
+} PrefetchEntry;
+
+typedef struct Prefetch {
+        Manager *manager;
+        PrefetchEntry *entries;
+        size_t n_entries;
+        size_t next_entry;
+} Prefetch;
+
+static int prefetch_file(PrefetchEntry *e, const char *path) {
+        _cleanup_(config_file_freep) ConfigFile *c = NULL;
+        int r;
+
+        /* Errors other than OOM are left to the main thread to run into and report again */
+        r = config_file_read(path, 0, &c);
+        if (r < 0)
+                return r == -ENOMEM ? r : 0;
+
+        if (!GREEDY_REALLOC(e->files, e->n_allocated, e->n_files + 1))
+                return -ENOMEM;
+
+        e->files[e->n_files++] = TAKE_PTR(c);
+        return 0;
+}
+
+static int prefetch_unit(Manager *m, PrefetchEntry *e) {
+        _cleanup_set_free_free_ Set *names = NULL;
+        _cleanup_strv_free_ char **dropins = NULL;
+        const char *fragment = NULL;
+        char **p;
+        int r;
+
+        /* This runs on the prefetch threads, hence must only read from the manager's lookup tables, which
+         * are not modified while the threads are around. */
+
+        r = unit_file_find_fragment(m->unit_id_map, m->unit_name_map, e->id, &fragment, &names);
+        if (r < 0 && r != -ENOENT)
+                return 0;
+
+        if (fragment) {
+                r = prefetch_file(e, fragment);
+                if (r < 0)
+                        return r;
+        }
+
+        /* The unit is always known under its own name, further aliases are only known once its fragment is
+         * loaded, hence we might miss some drop-ins here, which the main thread will then read itself. */
+        r = set_ensure_allocated(&names, &string_hash_ops);
+        if (r < 0)
+                return r;
+
+        r = set_put_strdup(names, e->id);
+        if (r < 0)
+                return r;
+
+        r = unit_file_find_dropin_paths(NULL, m->lookup_paths.search_path, m->unit_path_cache,
+                                        ".d", ".conf", names, &dropins);
+        if (r < 0)
+                return 0;
+
+        STRV_FOREACH(p, dropins) {
+                r = prefetch_file(e, *p);
+                if (r < 0)
+                        return r;
+        }
+
+        return 0;
+}
+
+static void *prefetch_thread(void *userdata) {
+        Prefetch *p = userdata;
+
+        for (;;) {
+                size_t i;
+
+                i = __sync_fetch_and_add(&p->next_entry, 1);
+                if (i >= p->n_entries)
+                        break;
+
+                if (prefetch_unit(p->manager, p->entries + i) < 0)
+                        break;
+        }
+
+        return NULL;
+}
+
+DEFINE_PRIVATE_HASH_OPS_WITH_VALUE_DESTRUCTOR(config_file_hash_ops, char, path_hash_func, path_compare,
+                                              ConfigFile, config_file_free);
+
+int unit_load_queue_prefetch(Manager *m) {
+        Prefetch p = { .manager = m };
+        size_t n_allocated = 0, i, j;
+        unsigned n_threads;
+        Unit *u;
+        int r;
+
+        assert(m);
+
+        /* Reading and splitting up the fragments and drop-ins of the units is independent for each unit,
+         * and only the parsing of the individual settings touches the units. Hence, read the files of all
+         * units in the load queue on threads, and keep them around for unit_load_fragment() and
+         * unit_load_dropin(). Files not read ahead, for example of aliases we didn't know about yet, are
+         * simply read there as before. */
+
+        LIST_FOREACH(load_queue, u, m->load_queue) {
+                if (u->load_prefetched)
+                        continue;
+
+                u->load_prefetched = true;
+
+                if (u->transient || u->load_state != UNIT_STUB)
+                        continue;
+
+                if (!GREEDY_REALLOC0(p.entries, n_allocated, p.n_entries + 1)) {
+                        r = log_oom();
+                        goto finish;
+                }
+
+                p.entries[p.n_entries].id = strdup(u->id);
+                if (!p.entries[p.n_entries].id) {
+                        r = log_oom();
+                        goto finish;
+                }
+
+                p.n_entries++;
+        }
+
+        /* Not worth it for a single unit */
+        if (p.n_entries < 2) {
+                r = 0;
+                goto finish;
+        }
+
+        r = unit_file_build_name_map(&m->lookup_paths,
+                                     &m->unit_cache_mtime,
+                                     &m->unit_id_map,
+                                     &m->unit_name_map,
+                                     &m->unit_path_cache,
+                                     &m->unit_file_cache);
+        if (r < 0)
+                goto finish; /* unit_load_fragment() will complain about this again */
+
+        n_threads = run_parallel(MIN(m->n_unit_load_threads, p.n_entries - 1) + 1, prefetch_thread, &p);
+
+        /* Add to what earlier rounds read ahead, as units queued before are not necessarily loaded yet:
+         * units added to the load queue while loading others are put in front of them. */
+        r = hashmap_ensure_allocated(&m->prefetched_config, &config_file_hash_ops);
+        if (r < 0) {
+                log_oom();
+                goto finish;
+        }
+
+        for (i = 0; i < p.n_entries; i++)
+                for (j = 0; j < p.entries[i].n_files; j++) {
+                        ConfigFile *c = p.entries[i].files[j];
+
+                        /* Top-level drop-ins, such as service.d/, are read once for each unit, and might
+                         * have been read in an earlier round, too. The first copy is kept. */
+                        r = hashmap_put(m->prefetched_config, c->filename, c);
+                        if (r == -ENOMEM) {
+                                log_oom();
+                                goto finish;
+                        }
+                        if (r > 0)
+                                p.entries[i].files[j] = NULL;
+                }
+
+        log_debug("Read config files of %zu units ahead on %u threads.", p.n_entries, n_threads);
+        r = 0;
+
+finish:
+        for (i = 0; i < p.n_entries; i++) {
+                for (j = 0; j < p.entries[i].n_files; j++)
+                        config_file_free(p.entries[i].files[j]);
+
+                free(p.entries[i].files);
+                free(p.entries[i].id);
+        }
+
+        free(p.entries);
+        return r;
+}
+
 void unit_dump_config_items(FILE *f) {
         static const struct {
                 const ConfigParserCallback callback;
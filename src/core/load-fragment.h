@@ -8,9 +8,13 @@
 int parse_crash_chvt(const char *value, int *data);
 int parse_confirm_spawn(const char *value, char **console);
 
+/* Upper limit for UnitLoadThreads= */
+#define UNIT_LOAD_THREADS_MAX 64U
+
 /* Read service data from .desktop file style configuration fragments */
 
 int unit_load_fragment(Unit *u);
+int unit_load_queue_prefetch(Manager *m);
 
 void unit_dump_config_items(FILE *f);
 
@@ -26,6 +26,7 @@
 #include "capability-util.h"
 #include "cgroup-util.h"
 #include "clock-util.h"
+#include "conf-files.h"
 #include "conf-parser.h"
 #include "cpu-set-util.h"
 #include "dbus-manager.h"
@@ -129,6 +130,8 @@ static uint64_t arg_capability_bounding_set;
 static bool arg_no_new_privs;
 static nsec_t arg_timer_slack_nsec;
 static usec_t arg_default_timer_accuracy_usec;
+static usec_t arg_dbus_signal_coalesce_usec;
+static unsigned arg_unit_load_threads;
 static Set* arg_syscall_archs;
 static FILE* arg_serialization;
 static int arg_default_cpu_accounting;
@@ -596,6 +599,8 @@ static int parse_config_file(void) {
 #endif
                 { "Manager", "TimerSlackNSec",               config_parse_nsec,                  0, &arg_timer_slack_nsec                  },
                 { "Manager", "DefaultTimerAccuracySec",      config_parse_sec,                   0, &arg_default_timer_accuracy_usec       },
+                { "Manager", "DBusSignalCoalesceSec",        config_parse_sec,                   0, &arg_dbus_signal_coalesce_usec         },
+                { "Manager", "UnitLoadThreads",              config_parse_unsigned,              0, &arg_unit_load_threads                 },
                 { "Manager", "DefaultStandardOutput",        config_parse_output_restricted,     0, &arg_default_std_output                },
                 { "Manager", "DefaultStandardError",         config_parse_output_restricted,     0, &arg_default_std_error                 },
                 { "Manager", "DefaultTimeoutStartSec",       config_parse_sec,                   0, &arg_default_timeout_start_usec        },
@@ -709,6 +714,8 @@ static void set_manager_settings(Manager *m) {
         m->reboot_watchdog = arg_reboot_watchdog;
         m->kexec_watchdog = arg_kexec_watchdog;
         m->cad_burst_action = arg_cad_burst_action;
+        m->dbus_signal_coalesce_usec = arg_dbus_signal_coalesce_usec;
+        m->n_unit_load_threads = MIN(arg_unit_load_threads, UNIT_LOAD_THREADS_MAX);
 
         manager_set_show_status(m, arg_show_status, "commandline");
         m->status_unit_format = arg_status_unit_format;
@@ -1853,6 +1860,7 @@ static int invoke_main_loop(
                         };
 
                         log_notice("Shutting down.");
+                        manager_log_shutdown_timing(m);
 
                         *ret_reexecute = false;
                         *ret_retval = m->return_value;
@@ -2188,6 +2196,8 @@ static void reset_arguments(void) {
         arg_no_new_privs = false;
         arg_timer_slack_nsec = NSEC_INFINITY;
         arg_default_timer_accuracy_usec = 1 * USEC_PER_MINUTE;
+        arg_dbus_signal_coalesce_usec = 0;
+        arg_unit_load_threads = 0;
 
         arg_syscall_archs = set_free(arg_syscall_archs);
 
@@ -2667,6 +2677,9 @@ int main(int argc, char *argv[]) {
         if (r < 0)
                 goto finish;
 
+        /* We list the same drop-in directories for many units, and again on each reload */
+        conf_files_cache_set_enabled(true);
+
         r = manager_new(arg_system ? UNIT_FILE_SYSTEM : UNIT_FILE_USER,
                         arg_action == ACTION_TEST ? MANAGER_TEST_FULL : 0,
                         &m);
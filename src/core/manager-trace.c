@@ -0,0 +1,134 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include "alloc-util.h"
+#include "env-util.h"
+#include "json.h"
+#include "log.h"
+#include "manager-trace.h"
+#include "process-util.h"
+
+void manager_trace_init(ManagerTrace *t) {
+        int r;
+
+        assert(t);
+
+        *t = (ManagerTrace) {};
+
+        r = getenv_bool("SYSTEMD_TRACE");
+        if (r < 0 && r != -ENXIO)
+                log_debug_errno(r, "Failed to parse $SYSTEMD_TRACE, ignoring: %m");
+
+        t->enabled = r > 0;
+        if (t->enabled)
+                log_debug("Tracing of service manager operations enabled.");
+}
+
+void manager_trace_done(ManagerTrace *t) {
+        size_t i;
+
+        assert(t);
+
+        for (i = 0; i < t->n_events; i++)
+                free(t->events[i].unit);
+
+        t->events = mfree(t->events);
+        t->n_events = t->n_allocated = 0;
+}
+
+void manager_trace_end(ManagerTrace *t, const char *name, const char *unit, usec_t begin) {
+        _cleanup_free_ char *copy = NULL;
+        usec_t n;
+
+        assert(t);
+        assert(name);
+
+        if (begin == 0) /* tracing was off when the operation began */
+                return;
+
+        n = now(CLOCK_MONOTONIC);
+
+        if (t->n_events >= MANAGER_TRACE_EVENTS_MAX) {
+                t->n_dropped++;
+                return;
+        }
+
+        if (unit) {
+                copy = strdup(unit);
+                if (!copy)
+                        goto drop;
+        }
+
+        if (!GREEDY_REALLOC(t->events, t->n_allocated, t->n_events + 1))
+                goto drop;
+
+        t->events[t->n_events++] = (ManagerTraceEvent) {
+                .name = name,
+                .unit = TAKE_PTR(copy),
+                .begin = begin,
+                .duration = usec_sub_unsigned(n, begin),
+        };
+
+        return;
+
+drop:
+        /* Tracing is best-effort, never fail the traced operation because of it */
+        t->n_dropped++;
+}
+
+int manager_trace_format(const ManagerTrace *t, char **ret) {
+        _cleanup_(json_variant_unrefp) JsonVariant *array = NULL, *v = NULL;
+        JsonVariant **events = NULL;
+        size_t i, n = 0;
+        int r;
+
+        assert(t);
+        assert(ret);
+
+        /* Generates a document in the Chrome trace event format, as understood by chrome://tracing and
+         * various other trace viewers. Every recorded operation is a "complete" event with timestamp and
+         * duration in µs of CLOCK_MONOTONIC, i.e. on the same time scale as the monotonic unit timestamps. */
+
+        events = new(JsonVariant*, t->n_events);
+        if (!events)
+                return -ENOMEM;
+
+        for (i = 0; i < t->n_events; i++) {
+                const ManagerTraceEvent *e = t->events + i;
+
+                r = json_build(events + n,
+                               JSON_BUILD_OBJECT(
+                                       JSON_BUILD_PAIR("name", JSON_BUILD_STRING(e->name)),
+                                       JSON_BUILD_PAIR("cat", JSON_BUILD_STRING(e->unit ? "unit" : "manager")),
+                                       JSON_BUILD_PAIR("ph", JSON_BUILD_STRING("X")),
+                                       JSON_BUILD_PAIR("ts", JSON_BUILD_UNSIGNED(e->begin)),
+                                       JSON_BUILD_PAIR("dur", JSON_BUILD_UNSIGNED(e->duration)),
+                                       JSON_BUILD_PAIR("pid", JSON_BUILD_UNSIGNED(getpid_cached())),
+                                       JSON_BUILD_PAIR("tid", JSON_BUILD_UNSIGNED(getpid_cached())),
+                                       JSON_BUILD_PAIR("args", JSON_BUILD_OBJECT(
+                                                                       JSON_BUILD_PAIR("unit", JSON_BUILD_STRING(e->unit))))));
+                if (r < 0)
+                        goto finish;
+
+                n++;
+        }
+
+        r = json_variant_new_array(&array, events, n);
+        if (r < 0)
+                goto finish;
+
+        r = json_build(&v, JSON_BUILD_OBJECT(
+                                       JSON_BUILD_PAIR("traceEvents", JSON_BUILD_VARIANT(array)),
+                                       JSON_BUILD_PAIR("displayTimeUnit", JSON_BUILD_STRING("ms")),
+                                       JSON_BUILD_PAIR("otherData", JSON_BUILD_OBJECT(
+                                                                       JSON_BUILD_PAIR("droppedEvents", JSON_BUILD_UNSIGNED(t->n_dropped))))));
+        if (r < 0)
+                goto finish;
+
+        r = json_variant_format(v, 0, ret);
+
+finish:
+        json_variant_unref_many(events, n);
+        free(events);
+
+        return r;
+}
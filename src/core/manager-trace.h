@@ -0,0 +1,39 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+#include <stdbool.h>
+
+#include "time-util.h"
+
+/* An optional, lightweight record of where PID1 itself spends its time: the phases of manager startup,
+ * load queue and cgroup realization dispatching, transaction building, process spawning and the unit
+ * type callbacks. Enabled with $SYSTEMD_TRACE=1, and exported in the Chrome trace event format. */
+
+/* Upper limit on recorded events, so that a long running manager with tracing on doesn't grow forever */
+#define MANAGER_TRACE_EVENTS_MAX 65536U
+
+typedef struct ManagerTraceEvent {
+        const char *name;   /* static string */
+        char *unit;
+        usec_t begin;
+        usec_t duration;
+} ManagerTraceEvent;
+
+typedef struct ManagerTrace {
+        bool enabled;
+        ManagerTraceEvent *events;
+        size_t n_events, n_allocated;
+        uint64_t n_dropped;
+} ManagerTrace;
+
+void manager_trace_init(ManagerTrace *t);
+void manager_trace_done(ManagerTrace *t);
+
+static inline usec_t manager_trace_begin(const ManagerTrace *t) {
+        /* Returns 0 if tracing is off, which manager_trace_end() then ignores */
+        return t->enabled ? now(CLOCK_MONOTONIC) : 0;
+}
+
+void manager_trace_end(ManagerTrace *t, const char *name, const char *unit, usec_t begin);
+
+int manager_trace_format(const ManagerTrace *t, char **ret);
@@ -3,6 +3,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <linux/kd.h>
+#include <poll.h>
 #include <sys/epoll.h>
 #include <sys/inotify.h>
 #include <sys/ioctl.h>
@@ -29,6 +30,7 @@
 #include "bus-util.h"
 #include "clean-ipc.h"
 #include "clock-util.h"
+#include "conf-files.h"
 #include "core-varlink.h"
 #include "dbus-job.h"
 #include "dbus-manager.h"
@@ -49,7 +51,9 @@
 #include "install.h"
 #include "io-util.h"
 #include "label.h"
+#include "load-fragment.h"
 #include "locale-setup.h"
+#include "log-ring.h"
 #include "log.h"
 #include "macro.h"
 #include "manager.h"
@@ -78,6 +82,7 @@
 #include "transaction.h"
 #include "umask-util.h"
 #include "unit-name.h"
+#include "unit-snapshot.h"
 #include "user-util.h"
 #include "virt.h"
 #include "watchdog.h"
@@ -98,6 +103,9 @@
 /* How many units and jobs to process of the bus queue before returning to the event loop. */
 #define MANAGER_BUS_MESSAGE_BUDGET 100U
 
+/* How many children to reap before returning to the event loop. */
+#define SIGCHLD_BATCH_MAX 64U
+
 static int manager_dispatch_notify_fd(sd_event_source *source, int fd, uint32_t revents, void *userdata);
 static int manager_dispatch_cgroups_agent_fd(sd_event_source *source, int fd, uint32_t revents, void *userdata);
 static int manager_dispatch_signal_fd(sd_event_source *source, int fd, uint32_t revents, void *userdata);
@@ -751,6 +759,17 @@ static int manager_setup_sigchld_event_source(Manager *m) {
         return 0;
 }
 
+static const Metric manager_metrics[_MANAGER_METRIC_MAX] = {
+        [MANAGER_METRIC_UNITS]                    = METRIC_INIT(METRIC_GAUGE,     "units",                    "Units currently loaded into memory"),
+        [MANAGER_METRIC_UNITS_LOADED]             = METRIC_INIT(METRIC_COUNTER,   "units_loaded",             "Units successfully loaded"),
+        [MANAGER_METRIC_JOBS]                     = METRIC_INIT(METRIC_GAUGE,     "jobs",                     "Jobs currently queued"),
+        [MANAGER_METRIC_JOBS_INSTALLED]           = METRIC_INIT(METRIC_COUNTER,   "jobs_installed",           "Jobs installed"),
+        [MANAGER_METRIC_JOBS_FAILED]              = METRIC_INIT(METRIC_COUNTER,   "jobs_failed",              "Jobs that failed"),
+        [MANAGER_METRIC_TRANSACTION_JOBS]         = METRIC_INIT(METRIC_HISTOGRAM, "transaction_jobs",         "Jobs per transaction"),
+        [MANAGER_METRIC_CGROUP_INOTIFY_EVENTS]    = METRIC_INIT(METRIC_COUNTER,   "cgroup_inotify_events",    "Control group inotify events processed"),
+        [MANAGER_METRIC_CGROUP_INOTIFY_OVERFLOWS] = METRIC_INIT(METRIC_COUNTER,   "cgroup_inotify_overflows", "Control group inotify queue overflows"),
+};
+
 int manager_new(UnitFileScope scope, ManagerTestRunFlags test_run_flags, Manager **_m) {
         _cleanup_(manager_freep) Manager *m = NULL;
         int r;
@@ -801,6 +820,8 @@ int manager_new(UnitFileScope scope, ManagerTestRunFlags test_run_flags, Manager
                 .default_oom_policy = OOM_STOP,
         };
 
+        memcpy(m->metrics, manager_metrics, sizeof(m->metrics));
+
 #if ENABLE_EFI
         if (MANAGER_IS_SYSTEM(m) && detect_container() <= 0)
                 boot_timestamps(m->timestamps + MANAGER_TIMESTAMP_USERSPACE,
@@ -808,6 +829,8 @@ int manager_new(UnitFileScope scope, ManagerTestRunFlags test_run_flags, Manager
                                 m->timestamps + MANAGER_TIMESTAMP_LOADER);
 #endif
 
+        manager_trace_init(&m->trace);
+
         /* Prepare log fields we can use for structured logging */
         if (MANAGER_IS_SYSTEM(m)) {
                 m->unit_log_field = "UNIT=";
@@ -830,7 +853,7 @@ int manager_new(UnitFileScope scope, ManagerTestRunFlags test_run_flags, Manager
         if (r < 0)
                 return r;
 
-        r = hashmap_ensure_allocated(&m->units, &string_hash_ops);
+        r = hashmap_ensure_allocated(&m->units, &string_hash_ops_cached);
         if (r < 0)
                 return r;
 
@@ -981,6 +1004,28 @@ static int manager_setup_notify(Manager *m) {
         return 0;
 }
 
+static int manager_setup_unit_snapshot(Manager *m) {
+        _cleanup_free_ char *p = NULL;
+        int r;
+
+        assert(m);
+
+        if (MANAGER_IS_TEST_RUN(m))
+                return 0;
+
+        p = path_join(m->prefix[EXEC_DIRECTORY_RUNTIME], UNIT_SNAPSHOT_FILE);
+        if (!p)
+                return log_oom();
+
+        (void) mkdir_parents_label(p, 0755);
+
+        r = unit_snapshot_writer_new(p, &m->unit_snapshot);
+        if (r < 0)
+                return log_debug_errno(r, "Failed to set up unit state snapshot %s, ignoring: %m", p);
+
+        return 0;
+}
+
 static int manager_setup_cgroups_agent(Manager *m) {
 
         static const union sockaddr_union sa = {
@@ -1134,13 +1179,11 @@ enum {
 
 static void unit_gc_mark_good(Unit *u, unsigned gc_marker) {
         Unit *other;
-        Iterator i;
-        void *v;
 
         u->gc_marker = gc_marker + GC_OFFSET_GOOD;
 
         /* Recursively mark referenced units as GOOD as well */
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_REFERENCES], i)
+        UNIT_FOREACH_DEPENDENCY(other, u, UNIT_REFERENCES)
                 if (other->gc_marker == gc_marker + GC_OFFSET_UNSURE)
                         unit_gc_mark_good(other, gc_marker);
 }
@@ -1148,8 +1191,6 @@ static void unit_gc_mark_good(Unit *u, unsigned gc_marker) {
 static void unit_gc_sweep(Unit *u, unsigned gc_marker) {
         Unit *other;
         bool is_bad;
-        Iterator i;
-        void *v;
 
         assert(u);
 
@@ -1167,7 +1208,7 @@ static void unit_gc_sweep(Unit *u, unsigned gc_marker) {
 
         is_bad = true;
 
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_REFERENCED_BY], i) {
+        UNIT_FOREACH_DEPENDENCY(other, u, UNIT_REFERENCED_BY) {
                 unit_gc_sweep(other, gc_marker);
 
                 if (other->gc_marker == gc_marker + GC_OFFSET_GOOD)
@@ -1332,6 +1373,9 @@ static void manager_clear_jobs_and_units(Manager *m) {
         assert(hashmap_isempty(m->jobs));
         assert(hashmap_isempty(m->units));
 
+        /* The filters of units that changed or went away would pile up otherwise */
+        m->seccomp_programs = set_free(m->seccomp_programs);
+
         m->n_on_console = 0;
         m->n_running_jobs = 0;
         m->n_installed_jobs = 0;
@@ -1361,6 +1405,7 @@ Manager* manager_free(Manager *m) {
 
         exec_runtime_vacuum(m);
         hashmap_free(m->exec_runtime_by_id);
+        hashmap_free(m->bpf_firewall_access);
 
         dynamic_user_vacuum(m, false);
         hashmap_free(m->dynamic_users);
@@ -1373,6 +1418,8 @@ Manager* manager_free(Manager *m) {
 
         prioq_free(m->run_queue);
 
+        unit_snapshot_writer_free(m->unit_snapshot);
+
         set_free(m->startup_units);
         set_free(m->failed_units);
 
@@ -1383,6 +1430,7 @@ Manager* manager_free(Manager *m) {
         sd_event_source_unref(m->time_change_event_source);
         sd_event_source_unref(m->timezone_change_event_source);
         sd_event_source_unref(m->jobs_in_progress_event_source);
+        sd_event_source_unref(m->dbus_queue_event_source);
         sd_event_source_unref(m->run_queue_event_source);
         sd_event_source_unref(m->user_lookup_event_source);
 
@@ -1404,8 +1452,13 @@ Manager* manager_free(Manager *m) {
         strv_free(m->transient_environment);
         strv_free(m->client_environment);
 
+        exec_dir_timings_free(m->generator_timings, m->n_generator_timings);
+        manager_trace_done(&m->trace);
+
         hashmap_free(m->cgroup_unit);
+        ordered_set_free(m->cgroup_accounting_units);
         manager_free_unit_name_maps(m);
+        unit_file_cache_free(m->unit_file_cache);
 
         free(m->switch_root);
         free(m->switch_root_init);
@@ -1506,6 +1559,9 @@ static void manager_catchup(Manager *m) {
                         continue;
 
                 unit_catchup(u);
+
+                /* Units loaded before the snapshot was set up, or while reloading, shall show up there too */
+                unit_update_snapshot(u);
         }
 }
 
@@ -1639,10 +1695,15 @@ static void manager_reloading_stopp(Manager **m) {
 }
 
 int manager_startup(Manager *m, FILE *serialization, FDSet *fds) {
+        usec_t trace;
         int r;
 
         assert(m);
 
+        /* Whatever was listed before (e.g. while parsing the configuration) is read again, in case a directory
+         * changed without its timestamp telling us */
+        conf_files_cache_flush();
+
         /* If we are running in test mode, we still want to run the generators,
          * but we should not touch the real generator directories. */
         r = lookup_paths_init(&m->lookup_paths, m->unit_file_scope,
@@ -1652,9 +1713,11 @@ int manager_startup(Manager *m, FILE *serialization, FDSet *fds) {
                 return log_error_errno(r, "Failed to initialize path lookup table: %m");
 
         dual_timestamp_get(m->timestamps + manager_timestamp_initrd_mangle(MANAGER_TIMESTAMP_GENERATORS_START));
+        trace = manager_trace_begin(&m->trace);
         r = manager_run_environment_generators(m);
         if (r >= 0)
                 r = manager_run_generators(m);
+        manager_trace_end(&m->trace, "generators", NULL, trace);
         dual_timestamp_get(m->timestamps + manager_timestamp_initrd_mangle(MANAGER_TIMESTAMP_GENERATORS_FINISH));
         if (r < 0)
                 return r;
@@ -1674,13 +1737,17 @@ int manager_startup(Manager *m, FILE *serialization, FDSet *fds) {
 
                 /* First, enumerate what we can from all config files */
                 dual_timestamp_get(m->timestamps + manager_timestamp_initrd_mangle(MANAGER_TIMESTAMP_UNITS_LOAD_START));
+                trace = manager_trace_begin(&m->trace);
                 manager_enumerate_perpetual(m);
                 manager_enumerate(m);
+                manager_trace_end(&m->trace, "enumerate", NULL, trace);
                 dual_timestamp_get(m->timestamps + manager_timestamp_initrd_mangle(MANAGER_TIMESTAMP_UNITS_LOAD_FINISH));
 
                 /* Second, deserialize if there is something to deserialize */
                 if (serialization) {
+                        trace = manager_trace_begin(&m->trace);
                         r = manager_deserialize(m, serialization, fds);
+                        manager_trace_end(&m->trace, "deserialize", NULL, trace);
                         if (r < 0)
                                 return log_error_errno(r, "Deserialization failed: %m");
                 }
@@ -1706,6 +1773,8 @@ int manager_startup(Manager *m, FILE *serialization, FDSet *fds) {
                         /* This shouldn't fail, except if things are really broken. */
                         return r;
 
+                (void) manager_setup_unit_snapshot(m);
+
                 /* Connect to the bus if we are good for it */
                 manager_setup_bus(m);
 
@@ -1720,7 +1789,9 @@ int manager_startup(Manager *m, FILE *serialization, FDSet *fds) {
                         log_warning_errno(r, "Failed to set up Varlink server, ignoring: %m");
 
                 /* Third, fire things up! */
+                trace = manager_trace_begin(&m->trace);
                 manager_coldplug(m);
+                manager_trace_end(&m->trace, "coldplug", NULL, trace);
 
                 /* Clean up runtime objects */
                 manager_vacuum(m);
@@ -1746,6 +1817,7 @@ int manager_add_job(
                 Job **ret) {
 
         Transaction *tr;
+        usec_t trace;
         int r;
 
         assert(m);
@@ -1766,6 +1838,8 @@ int manager_add_job(
 
         type = job_type_collapse(type, unit);
 
+        trace = manager_trace_begin(&m->trace);
+
         tr = transaction_new(mode == JOB_REPLACE_IRREVERSIBLY);
         if (!tr)
                 return -ENOMEM;
@@ -1788,10 +1862,14 @@ int manager_add_job(
                         goto tr_abort;
         }
 
+        metric_observe(m->metrics + MANAGER_METRIC_TRANSACTION_JOBS, hashmap_size(tr->jobs));
+
         r = transaction_activate(tr, m, mode, affected_jobs, error);
         if (r < 0)
                 goto tr_abort;
 
+        manager_trace_end(&m->trace, "transaction", unit->id, trace);
+
         log_unit_debug(unit,
                        "Enqueued job %s/%s as %u", unit->id,
                        job_type_to_string(type), (unsigned) tr->anchor_job->id);
@@ -1805,6 +1883,7 @@ int manager_add_job(
 tr_abort:
         transaction_abort(tr);
         transaction_free(tr);
+        manager_trace_end(&m->trace, "transaction", unit->id, trace);
         return r;
 }
 
@@ -1910,10 +1989,8 @@ static int manager_dispatch_target_deps_queue(Manager *m) {
 
                 for (k = 0; k < ELEMENTSOF(deps); k++) {
                         Unit *target;
-                        Iterator i;
-                        void *v;
 
-                        HASHMAP_FOREACH_KEY(v, target, u->dependencies[deps[k]], i) {
+                        UNIT_FOREACH_DEPENDENCY(target, u, deps[k]) {
                                 r = unit_add_default_target_dependency(u, target);
                                 if (r < 0)
                                         return r;
@@ -1925,8 +2002,9 @@ static int manager_dispatch_target_deps_queue(Manager *m) {
 }
 
 unsigned manager_dispatch_load_queue(Manager *m) {
-        Unit *u;
         unsigned n = 0;
+        usec_t trace;
+        Unit *u;
 
         assert(m);
 
@@ -1935,6 +2013,12 @@ unsigned manager_dispatch_load_queue(Manager *m) {
                 return 0;
 
         m->dispatching_load_queue = true;
+        trace = manager_trace_begin(&m->trace);
+
+        /* Units instantiated from the same template tend to expand the same specifiers over and over again,
+         * hence remember the host-wide ones until the queue is empty. If we can't allocate the cache, we
+         * simply do without. */
+        m->specifier_cache = new0(SpecifierCache, 1);
 
         /* Dispatches the load queue. Takes a unit from the queue and
          * tries to load its data until the queue is empty */
@@ -1942,11 +2026,19 @@ unsigned manager_dispatch_load_queue(Manager *m) {
         while ((u = m->load_queue)) {
                 assert(u->in_load_queue);
 
+                /* Read the config files of this and all other queued units ahead, whenever we reach a unit
+                 * that was queued after the last time we did so. */
+                if (m->n_unit_load_threads > 0 && !u->load_prefetched)
+                        (void) unit_load_queue_prefetch(m);
+
                 unit_load(u);
                 n++;
         }
 
+        m->prefetched_config = hashmap_free(m->prefetched_config);
+        m->specifier_cache = specifier_cache_free(m->specifier_cache);
         m->dispatching_load_queue = false;
+        manager_trace_end(&m->trace, "dispatch-load-queue", NULL, trace);
 
         /* Dispatch the units waiting for their target dependencies to be added now, as all targets that we know about
          * should be loaded and have aliases resolved */
@@ -2114,6 +2206,13 @@ void manager_dump(Manager *m, FILE *f, const char *prefix) {
 
         manager_dump_units(m, f, prefix);
         manager_dump_jobs(m, f, prefix);
+
+        if (m->event) {
+                fprintf(f, "%sEvent loop statistics:\n", strempty(prefix));
+                (void) sd_event_dump_statistics(m->event, f);
+        }
+
+        log_ring_dump(f, prefix);
 }
 
 int manager_get_dump_string(Manager *m, char **ret) {
@@ -2185,6 +2284,47 @@ static int manager_dispatch_run_queue(sd_event_source *source, void *userdata) {
         return 1;
 }
 
+static int manager_dispatch_dbus_queue_timer(sd_event_source *source, usec_t usec, void *userdata) {
+        /* Nothing to do here: this only wakes up the event loop, which then dispatches the D-Bus queues */
+        return 0;
+}
+
+static bool manager_dbus_queue_coalescing(Manager *m) {
+        usec_t t;
+        int r;
+
+        assert(m);
+
+        if (m->dbus_signal_coalesce_usec == 0)
+                return false;
+
+        t = usec_add(m->dbus_queue_since, m->dbus_signal_coalesce_usec);
+        if (now(CLOCK_MONOTONIC) >= t)
+                return false;
+
+        /* Still within the window, make sure we wake up when it is over */
+        if (m->dbus_queue_event_source) {
+                r = sd_event_source_set_time(m->dbus_queue_event_source, t);
+                if (r >= 0)
+                        r = sd_event_source_set_enabled(m->dbus_queue_event_source, SD_EVENT_ONESHOT);
+        } else {
+                r = sd_event_add_time(
+                                m->event,
+                                &m->dbus_queue_event_source,
+                                CLOCK_MONOTONIC,
+                                t, 0,
+                                manager_dispatch_dbus_queue_timer, m);
+                if (r >= 0)
+                        (void) sd_event_source_set_description(m->dbus_queue_event_source, "manager-dbus-queue");
+        }
+        if (r < 0) {
+                log_debug_errno(r, "Failed to arm D-Bus queue timer, not coalescing change signals: %m");
+                return false;
+        }
+
+        return true;
+}
+
 static unsigned manager_dispatch_dbus_queue(Manager *m) {
         unsigned n = 0, budget;
         Unit *u;
@@ -2201,6 +2341,11 @@ static unsigned manager_dispatch_dbus_queue(Manager *m) {
                 if (!m->dbus_unit_queue && !m->dbus_job_queue)
                         return 0;
 
+                /* If configured, let's wait a bit more, so that further changes of the same units and jobs
+                 * are covered by the same signal. */
+                if (manager_dbus_queue_coalescing(m))
+                        return 0;
+
                 /* Do we have overly many messages queued at the moment? If so, let's not enqueue more on top, let's
                  * sit this cycle out, and process things in a later cycle when the queues got a bit emptier. */
                 if (manager_bus_n_queued_write(m) > MANAGER_BUS_BUSY_THRESHOLD)
@@ -2316,6 +2461,7 @@ static void manager_invoke_notify_message(
 
         if (UNIT_VTABLE(u)->notify_message) {
                 _cleanup_strv_free_ char **tags = NULL;
+                usec_t trace;
 
                 tags = strv_split(buf, NEWLINE);
                 if (!tags) {
@@ -2323,7 +2469,9 @@ static void manager_invoke_notify_message(
                         return;
                 }
 
+                trace = manager_trace_begin(&u->manager->trace);
                 UNIT_VTABLE(u)->notify_message(u, ucred, tags, fds);
+                manager_trace_end(&u->manager->trace, "notify-message", u->id, trace);
 
         } else if (DEBUG_LOGGING) {
                 _cleanup_free_ char *x = NULL, *y = NULL;
@@ -2494,88 +2642,127 @@ static void manager_invoke_sigchld_event(
         log_unit_debug(u, "Child "PID_FMT" belongs to %s.", si->si_pid, u->id);
         unit_unwatch_pid(u, si->si_pid);
 
-        if (UNIT_VTABLE(u)->sigchld_event)
+        if (UNIT_VTABLE(u)->sigchld_event) {
+                usec_t trace;
+
+                trace = manager_trace_begin(&m->trace);
                 UNIT_VTABLE(u)->sigchld_event(u, si->si_pid, si->si_code, si->si_status);
+                manager_trace_end(&m->trace, "sigchld-event", u->id, trace);
+        }
+}
+
+static void manager_handle_sigchld(Manager *m, const siginfo_t *si) {
+        _cleanup_free_ Unit **array_copy = NULL;
+        _cleanup_free_ char *name = NULL;
+        Unit *u1, *u2, **array;
+
+        assert(m);
+        assert(si);
+
+        (void) get_process_comm(si->si_pid, &name);
+
+        log_debug("Child "PID_FMT" (%s) died (code=%s, status=%i/%s)",
+                  si->si_pid, strna(name),
+                  sigchld_code_to_string(si->si_code),
+                  si->si_status,
+                  strna(si->si_code == CLD_EXITED
+                        ? exit_status_to_string(si->si_status, EXIT_STATUS_FULL)
+                        : signal_to_string(si->si_status)));
+
+        /* Increase the generation counter used for filtering out duplicate unit invocations */
+        m->sigchldgen++;
+
+        /* And now figure out the unit this belongs to, it might be multiple... */
+        u1 = manager_get_unit_by_pid_cgroup(m, si->si_pid);
+        u2 = hashmap_get(m->watch_pids, PID_TO_PTR(si->si_pid));
+        array = hashmap_get(m->watch_pids, PID_TO_PTR(-si->si_pid));
+        if (array) {
+                size_t n = 0;
+
+                /* Count how many entries the array has */
+                while (array[n])
+                        n++;
+
+                /* Make a copy of the array so that we don't trip up on the array changing beneath us */
+                array_copy = newdup(Unit*, array, n+1);
+                if (!array_copy)
+                        log_oom();
+        }
+
+        /* Finally, execute them all. Note that u1, u2 and the array might contain duplicates, but
+         * that's fine, manager_invoke_sigchld_event() will ensure we only invoke the handlers once for
+         * each iteration. */
+        if (u1) {
+                /* We check for oom condition, in case we got SIGCHLD before the oom notification.
+                 * We only do this for the cgroup the PID belonged to. */
+                (void) unit_check_oom(u1);
+
+                manager_invoke_sigchld_event(m, u1, si);
+        }
+        if (u2)
+                manager_invoke_sigchld_event(m, u2, si);
+        if (array_copy)
+                for (size_t i = 0; array_copy[i]; i++)
+                        manager_invoke_sigchld_event(m, array_copy[i], si);
+}
+
+static bool manager_sigchld_should_yield(Manager *m) {
+        assert(m);
+
+        /* The notification and cgroups agent sockets are dispatched before SIGCHLD, so that we learn about
+         * everything a service told us, or that its cgroup ran empty, before we process its exit. Reaping
+         * further children in the same iteration would break that, hence return to the event loop as soon
+         * as there's something to read on either of them. */
+
+        if (m->notify_fd >= 0 && fd_wait_for_event(m->notify_fd, POLLIN, 0) > 0)
+                return true;
+
+        if (m->cgroups_agent_fd >= 0 && fd_wait_for_event(m->cgroups_agent_fd, POLLIN, 0) > 0)
+                return true;
+
+        return false;
 }
 
 static int manager_dispatch_sigchld(sd_event_source *source, void *userdata) {
         Manager *m = userdata;
-        siginfo_t si = {};
+        unsigned n;
         int r;
 
         assert(source);
         assert(m);
 
-        /* First we call waitid() for a PID and do not reap the zombie. That way we can still access /proc/$PID for it
-         * while it is a zombie. */
+        /* Reap a batch of children per event loop iteration: when many services are stopped at once, as
+         * during shutdown, going through the whole event loop for every single one of them adds up. The
+         * batch is limited, so that other events still get their turn. */
 
-        if (waitid(P_ALL, 0, &si, WEXITED|WNOHANG|WNOWAIT) < 0) {
+        for (n = 0; n < SIGCHLD_BATCH_MAX; n++) {
+                siginfo_t si = {};
 
-                if (errno != ECHILD)
-                        log_error_errno(errno, "Failed to peek for child with waitid(), ignoring: %m");
+                if (n > 0 && manager_sigchld_should_yield(m))
+                        break;
 
-                goto turn_off;
-        }
+                /* First we call waitid() for a PID and do not reap the zombie. That way we can still access
+                 * /proc/$PID for it while it is a zombie. */
 
-        if (si.si_pid <= 0)
-                goto turn_off;
-
-        if (IN_SET(si.si_code, CLD_EXITED, CLD_KILLED, CLD_DUMPED)) {
-                _cleanup_free_ Unit **array_copy = NULL;
-                _cleanup_free_ char *name = NULL;
-                Unit *u1, *u2, **array;
-
-                (void) get_process_comm(si.si_pid, &name);
-
-                log_debug("Child "PID_FMT" (%s) died (code=%s, status=%i/%s)",
-                          si.si_pid, strna(name),
-                          sigchld_code_to_string(si.si_code),
-                          si.si_status,
-                          strna(si.si_code == CLD_EXITED
-                                ? exit_status_to_string(si.si_status, EXIT_STATUS_FULL)
-                                : signal_to_string(si.si_status)));
-
-                /* Increase the generation counter used for filtering out duplicate unit invocations */
-                m->sigchldgen++;
-
-                /* And now figure out the unit this belongs to, it might be multiple... */
-                u1 = manager_get_unit_by_pid_cgroup(m, si.si_pid);
-                u2 = hashmap_get(m->watch_pids, PID_TO_PTR(si.si_pid));
-                array = hashmap_get(m->watch_pids, PID_TO_PTR(-si.si_pid));
-                if (array) {
-                        size_t n = 0;
-
-                        /* Count how many entries the array has */
-                        while (array[n])
-                                n++;
-
-                        /* Make a copy of the array so that we don't trip up on the array changing beneath us */
-                        array_copy = newdup(Unit*, array, n+1);
-                        if (!array_copy)
-                                log_oom();
-                }
+                if (waitid(P_ALL, 0, &si, WEXITED|WNOHANG|WNOWAIT) < 0) {
 
-                /* Finally, execute them all. Note that u1, u2 and the array might contain duplicates, but
-                 * that's fine, manager_invoke_sigchld_event() will ensure we only invoke the handlers once for
-                 * each iteration. */
-                if (u1) {
-                        /* We check for oom condition, in case we got SIGCHLD before the oom notification.
-                         * We only do this for the cgroup the PID belonged to. */
-                        (void) unit_check_oom(u1);
+                        if (errno != ECHILD)
+                                log_error_errno(errno, "Failed to peek for child with waitid(), ignoring: %m");
 
-                        manager_invoke_sigchld_event(m, u1, &si);
+                        goto turn_off;
                 }
-                if (u2)
-                        manager_invoke_sigchld_event(m, u2, &si);
-                if (array_copy)
-                        for (size_t i = 0; array_copy[i]; i++)
-                                manager_invoke_sigchld_event(m, array_copy[i], &si);
-        }
 
-        /* And now, we actually reap the zombie. */
-        if (waitid(P_PID, si.si_pid, &si, WEXITED) < 0) {
-                log_error_errno(errno, "Failed to dequeue child, ignoring: %m");
-                return 0;
+                if (si.si_pid <= 0)
+                        goto turn_off;
+
+                if (IN_SET(si.si_code, CLD_EXITED, CLD_KILLED, CLD_DUMPED))
+                        manager_handle_sigchld(m, &si);
+
+                /* And now, we actually reap the zombie. */
+                if (waitid(P_PID, si.si_pid, &si, WEXITED) < 0) {
+                        log_error_errno(errno, "Failed to dequeue child, ignoring: %m");
+                        return 0;
+                }
         }
 
         return 0;
@@ -3172,6 +3359,12 @@ int manager_serialize(
 
         _cleanup_(manager_reloading_stopp) _unused_ Manager *reloading = manager_reloading_start(m);
 
+        /* The binary format is cheaper to write and read, but only versions that know it can read it back. Hence
+         * stick to text unless explicitly asked for binary, and always when switching root, where the other side
+         * might be older. */
+        _cleanup_(serialize_set_binaryp) bool binary_saved =
+                serialize_set_binary(!switching_root && getenv_bool("SYSTEMD_SERIALIZE_BINARY") > 0);
+
         (void) serialize_item_format(f, "current-job-id", "%" PRIu32, m->current_job_id);
         (void) serialize_item_format(f, "n-installed-jobs", "%u", m->n_installed_jobs);
         (void) serialize_item_format(f, "n-failed-jobs", "%u", m->n_failed_jobs);
@@ -3249,15 +3442,14 @@ int manager_serialize(
         if (r < 0)
                 return r;
 
-        (void) fputc('\n', f);
+        (void) serialize_marker(f, "");
 
         HASHMAP_FOREACH_KEY(u, t, m->units, i) {
                 if (u->id != t)
                         continue;
 
                 /* Start marker */
-                fputs(u->id, f);
-                fputc('\n', f);
+                (void) serialize_marker(f, u->id);
 
                 r = unit_serialize(u, f, fds, !switching_root);
                 if (r < 0)
@@ -3303,7 +3495,7 @@ static int manager_deserialize_units(Manager *m, FILE *f, FDSet *fds) {
         for (;;) {
                 _cleanup_free_ char *line = NULL;
                 /* Start marker */
-                r = read_line(f, LONG_LINE_MAX, &line);
+                r = deserialize_read_line(f, &line);
                 if (r < 0)
                         return log_error_errno(r, "Failed to read serialization line: %m");
                 if (r == 0)
@@ -3341,7 +3533,7 @@ int manager_deserialize(Manager *m, FILE *f, FDSet *fds) {
                 _cleanup_free_ char *line = NULL;
                 const char *val, *l;
 
-                r = read_line(f, LONG_LINE_MAX, &line);
+                r = deserialize_read_line(f, &line);
                 if (r < 0)
                         return log_error_errno(r, "Failed to read serialization line: %m");
                 if (r == 0)
@@ -3570,6 +3762,10 @@ int manager_reload(Manager *m) {
         m->uid_refs = hashmap_free(m->uid_refs);
         m->gid_refs = hashmap_free(m->gid_refs);
 
+        /* A reload is explicitly requested to pick up configuration changes, hence don't trust any cached
+         * directory listing, but read everything again */
+        conf_files_cache_flush();
+
         r = lookup_paths_init(&m->lookup_paths, m->unit_file_scope, 0, NULL);
         if (r < 0)
                 log_warning_errno(r, "Failed to initialize path lookup table, ignoring: %m");
@@ -3579,7 +3775,9 @@ int manager_reload(Manager *m) {
 
         lookup_paths_log(&m->lookup_paths);
 
-        /* We flushed out generated files, for which we don't watch mtime, so we should flush the old map. */
+        /* We flushed out generated files, for which we don't watch mtime, so we should flush the old map.
+         * The contents of the lookup directories are kept though, and only directories that changed will
+         * be read again. */
         manager_free_unit_name_maps(m);
 
         /* First, enumerate what we can from kernel and suchlike */
@@ -3870,6 +4068,8 @@ static int manager_run_environment_generators(Manager *m) {
 
 static int manager_run_generators(Manager *m) {
         _cleanup_strv_free_ char **paths = NULL;
+        ExecDirTiming *timings = NULL;
+        size_t n_timings = 0;
         const char *argv[5];
         int r;
 
@@ -3898,8 +4098,22 @@ static int manager_run_generators(Manager *m) {
         argv[4] = NULL;
 
         RUN_WITH_UMASK(0022)
-                (void) execute_directories((const char* const*) paths, DEFAULT_TIMEOUT_USEC, NULL, NULL,
-                                           (char**) argv, m->transient_environment, EXEC_DIR_PARALLEL | EXEC_DIR_IGNORE_ERRORS);
+                r = execute_directories_full((const char* const*) paths, DEFAULT_TIMEOUT_USEC, NULL, NULL,
+                                             (char**) argv, m->transient_environment, EXEC_DIR_PARALLEL | EXEC_DIR_IGNORE_ERRORS,
+                                             &timings, &n_timings);
+
+        /* The timings are there also if the generators didn't finish in time, and tell which ones did */
+        for (size_t i = 0; i < n_timings; i++) {
+                char buf[FORMAT_TIMESPAN_MAX];
+
+                log_debug("Generator %s finished after %s.",
+                          timings[i].name,
+                          format_timespan(buf, sizeof(buf), timings[i].finish - timings[i].start, USEC_PER_MSEC));
+        }
+
+        exec_dir_timings_free(m->generator_timings, m->n_generator_timings);
+        m->generator_timings = TAKE_PTR(timings);
+        m->n_generator_timings = n_timings;
 
         r = 0;
 
@@ -4259,6 +4473,44 @@ int manager_update_failed_units(Manager *m, Unit *u, bool failed) {
         return 0;
 }
 
+void manager_log_shutdown_timing(Manager *m) {
+        _cleanup_free_ char *dump = NULL;
+        char buf[FORMAT_TIMESPAN_MAX];
+        usec_t t;
+        int r;
+
+        assert(m);
+
+        /* Called right before we hand over to systemd-shutdown. Logs how long stopping all units took, and
+         * leaves the trace in /run, if tracing is enabled, where shutdown hooks or the initrd may pick it
+         * up, as the journal is gone by now. */
+
+        if (!dual_timestamp_is_set(&m->shutdown_start_timestamp))
+                return;
+
+        t = usec_sub_unsigned(now(CLOCK_MONOTONIC), m->shutdown_start_timestamp.monotonic);
+
+        log_info("Stopped %u units in %s (%.1f units/s).",
+                 m->n_shutdown_stopped_units,
+                 format_timespan(buf, sizeof(buf), t, USEC_PER_MSEC),
+                 t > 0 ? (double) m->n_shutdown_stopped_units * USEC_PER_SEC / t : 0.0);
+
+        if (!m->trace.enabled)
+                return;
+
+        manager_trace_end(&m->trace, "shutdown", NULL, m->shutdown_start_timestamp.monotonic);
+
+        r = manager_trace_format(&m->trace, &dump);
+        if (r < 0) {
+                log_warning_errno(r, "Failed to format trace, ignoring: %m");
+                return;
+        }
+
+        r = write_string_file("/run/systemd/shutdown-trace.json", dump, WRITE_STRING_FILE_CREATE|WRITE_STRING_FILE_ATOMIC);
+        if (r < 0)
+                log_warning_errno(r, "Failed to write shutdown trace, ignoring: %m");
+}
+
 ManagerState manager_state(Manager *m) {
         Unit *u;
 
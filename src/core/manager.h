@@ -14,8 +14,12 @@
 #include "hashmap.h"
 #include "ip-address-access.h"
 #include "list.h"
+#include "manager-trace.h"
+#include "metrics.h"
+#include "ordered-set.h"
 #include "prioq.h"
 #include "ratelimit.h"
+#include "specifier.h"
 #include "varlink.h"
 
 struct libmnt_monitor;
@@ -114,11 +118,24 @@ typedef enum ManagerTimestamp {
         _MANAGER_TIMESTAMP_INVALID = -1,
 } ManagerTimestamp;
 
+typedef enum ManagerMetric {
+        MANAGER_METRIC_UNITS,
+        MANAGER_METRIC_UNITS_LOADED,
+        MANAGER_METRIC_JOBS,
+        MANAGER_METRIC_JOBS_INSTALLED,
+        MANAGER_METRIC_JOBS_FAILED,
+        MANAGER_METRIC_TRANSACTION_JOBS,
+        MANAGER_METRIC_CGROUP_INOTIFY_EVENTS,
+        MANAGER_METRIC_CGROUP_INOTIFY_OVERFLOWS,
+        _MANAGER_METRIC_MAX,
+} ManagerMetric;
+
 #include "execute.h"
 #include "job.h"
 #include "path-lookup.h"
 #include "show-status.h"
 #include "unit-name.h"
+#include "unit-snapshot.h"
 
 typedef enum ManagerTestRunFlags {
         MANAGER_TEST_NORMAL             = 0,       /* run normally */
@@ -158,6 +175,16 @@ struct Manager {
         LIST_HEAD(Unit, dbus_unit_queue);
         LIST_HEAD(Job, dbus_job_queue);
 
+        /* If non-zero, wait that long after the first entry was added to the queues above before sending
+         * out the change signals, so that more changes of the same units and jobs are coalesced. */
+        usec_t dbus_signal_coalesce_usec;
+        usec_t dbus_queue_since;
+        sd_event_source *dbus_queue_event_source;
+
+        /* Memory-mapped snapshot of the state of all units, for cheap polling by unprivileged clients. Updated
+         * whenever a unit is added to the D-Bus queue. */
+        UnitSnapshotWriter *unit_snapshot;
+
         /* Units to remove */
         LIST_HEAD(Unit, cleanup_queue);
 
@@ -174,6 +201,9 @@ struct Manager {
         /* Units whose memory.event fired */
         LIST_HEAD(Unit, cgroup_oom_queue);
 
+        /* Units whose cgroup.events fired, processed once per inotify wakeup */
+        LIST_HEAD(Unit, cgroup_events_queue);
+
         /* Target units whose default target dependencies haven't been set yet */
         LIST_HEAD(Unit, target_deps_queue);
 
@@ -227,6 +257,21 @@ struct Manager {
         Hashmap *unit_name_map;
         Set *unit_path_cache;
         usec_t unit_cache_mtime;
+        UnitFileCache *unit_file_cache; /* Contents of the lookup directories, kept across reloads */
+
+        /* Config files of queued units, read ahead on threads while dispatching the load queue */
+        unsigned n_unit_load_threads;
+        Hashmap *prefetched_config;
+
+        /* Host-wide specifier values, remembered while dispatching the load queue */
+        SpecifierCache *specifier_cache;
+
+        /* Timings of our own operations, only collected if $SYSTEMD_TRACE=1 is set */
+        ManagerTrace trace;
+
+        /* When the shutdown transaction was activated, and how many units were stopped since */
+        dual_timestamp shutdown_start_timestamp;
+        unsigned n_shutdown_stopped_units;
 
         char **transient_environment;  /* The environment, as determined from config files, kernel cmdline and environment generators */
         char **client_environment;     /* Environment variables created by clients through the bus API */
@@ -237,13 +282,22 @@ struct Manager {
 
         dual_timestamp timestamps[_MANAGER_TIMESTAMP_MAX];
 
+        /* Execution times of the unit generators, from their last invocation */
+        ExecDirTiming *generator_timings;
+        size_t n_generator_timings;
+
         /* Data specific to the device subsystem */
         sd_device_monitor *device_monitor;
         Hashmap *devices_by_sysfs;
+        OrderedHashmap *devices_pending; /* uevents received but not processed yet, by sysfs path */
+        sd_event_source *device_flush_event_source;
 
         /* Data specific to the mount subsystem */
         struct libmnt_monitor *mount_monitor;
         sd_event_source *mount_event_source;
+        Set *mountinfo_entries; /* The mount table as of the last pass, to only process entries that changed */
+        RateLimit mount_ratelimit;
+        sd_event_source *mount_ratelimit_event_source;
 
         /* Data specific to the swap filesystem */
         FILE *proc_swaps;
@@ -280,6 +334,9 @@ struct Manager {
         /* Data specific to the cgroup subsystem */
         Hashmap *cgroup_unit;
         CGroupMask cgroup_supported;
+
+        /* Units with open accounting attribute fds, least recently read first */
+        OrderedSet *cgroup_accounting_units;
         char *cgroup_root;
 
         /* Notifications from cgroups, when the unified hierarchy is used is done via inotify. */
@@ -403,6 +460,12 @@ struct Manager {
         /* ExecRuntime, indexed by their owner unit id */
         Hashmap *exec_runtime_by_id;
 
+        /* BPFFirewallAccess objects, indexed by the access lists they implement */
+        Hashmap *bpf_firewall_access;
+
+        /* System call filters compiled for the services we spawn, indexed by the rules they were compiled from */
+        Set *seccomp_programs;
+
         /* When the user hits C-A-D more than 7 times per 2s, do something immediately... */
         RateLimit ctrl_alt_del_ratelimit;
         EmergencyAction cad_burst_action;
@@ -426,6 +489,10 @@ struct Manager {
         bool honor_device_enumeration;
 
         VarlinkServer *varlink_server;
+        VarlinkServer *metrics_varlink_server;
+
+        /* Exported via io.systemd.Metrics.List */
+        Metric metrics[_MANAGER_METRIC_MAX];
 };
 
 static inline usec_t manager_default_timeout_abort_usec(Manager *m) {
@@ -514,6 +581,8 @@ void manager_flip_auto_status(Manager *m, bool enable, const char *reason);
 
 Set *manager_get_units_requiring_mounts_for(Manager *m, const char *path);
 
+void manager_log_shutdown_timing(Manager *m);
+
 ManagerState manager_state(Manager *m);
 
 int manager_update_failed_units(Manager *m, Unit *u, bool failed);
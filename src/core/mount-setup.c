@@ -1,7 +1,6 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
 #include <errno.h>
-#include <ftw.h>
 #include <stdlib.h>
 #include <sys/mount.h>
 #include <sys/statvfs.h>
@@ -26,6 +25,7 @@
 #include "mountpoint-util.h"
 #include "nulstr-util.h"
 #include "path-util.h"
+#include "relabel.h"
 #include "set.h"
 #include "smack-util.h"
 #include "strv.h"
@@ -358,27 +358,8 @@ int mount_cgroup_controllers(void) {
 }
 
 #if HAVE_SELINUX || ENABLE_SMACK
-static int nftw_cb(
-                const char *fpath,
-                const struct stat *sb,
-                int tflag,
-                struct FTW *ftwbuf) {
-
-        /* No need to label /dev twice in a row... */
-        if (_unlikely_(ftwbuf->level == 0))
-                return FTW_CONTINUE;
-
-        (void) label_fix(fpath, 0);
-
-        /* /run/initramfs is static data and big, no need to
-         * dynamically relabel its contents at boot... */
-        if (_unlikely_(ftwbuf->level == 1 &&
-                      tflag == FTW_D &&
-                      streq(fpath, "/run/initramfs")))
-                return FTW_SKIP_SUBTREE;
-
-        return FTW_CONTINUE;
-};
+/* /run/initramfs is static data and big, no need to dynamically relabel its contents at boot... */
+#define RELABEL_PRUNE STRV_MAKE("/run/initramfs")
 
 static int relabel_cgroup_filesystems(void) {
         int r;
@@ -396,8 +377,7 @@ static int relabel_cgroup_filesystems(void) {
                 if (st.f_flags & ST_RDONLY)
                         (void) mount(NULL, "/sys/fs/cgroup", NULL, MS_REMOUNT, NULL);
 
-                (void) label_fix("/sys/fs/cgroup", 0);
-                (void) nftw("/sys/fs/cgroup", nftw_cb, 64, FTW_MOUNT|FTW_PHYS|FTW_ACTIONRETVAL);
+                (void) relabel_tree("/sys/fs/cgroup", RELABEL_PRUNE, RELABEL_SAME_MOUNT);
 
                 if (st.f_flags & ST_RDONLY)
                         (void) mount(NULL, "/sys/fs/cgroup", NULL, MS_REMOUNT|MS_RDONLY, NULL);
@@ -460,8 +440,7 @@ static int relabel_extra(void) {
                         }
 
                         log_debug("Relabelling additional file/directory '%s'.", line);
-                        (void) label_fix(line, 0);
-                        (void) nftw(line, nftw_cb, 64, FTW_MOUNT|FTW_PHYS|FTW_ACTIONRETVAL);
+                        (void) relabel_tree(line, RELABEL_PRUNE, RELABEL_SAME_MOUNT);
                         c++;
                 }
 
@@ -499,7 +478,7 @@ int mount_setup(bool loaded_policy, bool leave_propagation) {
                 before_relabel = now(CLOCK_MONOTONIC);
 
                 FOREACH_STRING(i, "/dev", "/dev/shm", "/run")
-                        (void) nftw(i, nftw_cb, 64, FTW_MOUNT|FTW_PHYS|FTW_ACTIONRETVAL);
+                        (void) relabel_tree(i, RELABEL_PRUNE, RELABEL_SKIP_TOP|RELABEL_SAME_MOUNT);
 
                 (void) relabel_cgroup_filesystems();
 
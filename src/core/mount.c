@@ -24,6 +24,7 @@
 #include "parse-util.h"
 #include "path-util.h"
 #include "process-util.h"
+#include "ratelimit.h"
 #include "serialize.h"
 #include "special.h"
 #include "string-table.h"
@@ -1662,9 +1663,177 @@ static int mount_setup_unit(
         return 0;
 }
 
-static int mount_load_proc_self_mountinfo(Manager *m, bool set_flags) {
+typedef struct MountinfoEntry {
+        char *what;
+        char *where;
+        char *options;
+        char *fstype;
+} MountinfoEntry;
+
+static MountinfoEntry* mountinfo_entry_free(MountinfoEntry *e) {
+        if (!e)
+                return NULL;
+
+        free(e->what);
+        free(e->where);
+        free(e->options);
+        free(e->fstype);
+
+        return mfree(e);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(MountinfoEntry*, mountinfo_entry_free);
+
+static void mountinfo_entry_hash_func(const MountinfoEntry *e, struct siphash *state) {
+        assert(e);
+
+        string_hash_func(e->what, state);
+        string_hash_func(e->where, state);
+        string_hash_func(strempty(e->options), state);
+        string_hash_func(strempty(e->fstype), state);
+}
+
+static int mountinfo_entry_compare_func(const MountinfoEntry *a, const MountinfoEntry *b) {
+        int r;
+
+        r = strcmp(a->what, b->what);
+        if (r != 0)
+                return r;
+
+        r = strcmp(a->where, b->where);
+        if (r != 0)
+                return r;
+
+        r = strcmp_ptr(a->options, b->options);
+        if (r != 0)
+                return r;
+
+        return strcmp_ptr(a->fstype, b->fstype);
+}
+
+DEFINE_PRIVATE_HASH_OPS_WITH_KEY_DESTRUCTOR(mountinfo_entry_hash_ops, MountinfoEntry, mountinfo_entry_hash_func, mountinfo_entry_compare_func, mountinfo_entry_free);
+
+static int mount_diff_proc_self_mountinfo(
+                Manager *m,
+                struct libmnt_table *table,
+                struct libmnt_iter *iter,
+                Set **ret_dirty) {
+
+        _cleanup_set_free_ Set *entries = NULL, *dirty = NULL;
+        MountinfoEntry *e;
+        bool incremental;
+        int r;
+
+        assert(m);
+        assert(table);
+        assert(iter);
+        assert(ret_dirty);
+
+        /* Compares the mount table with the one from the previous pass, and returns the mount points whose
+         * entries were added, removed or changed in between, so that only those need to be reconciled with
+         * the mount units. Entries that didn't change are moved over from the old table, hence on hosts with
+         * lots of mounts the common case does not allocate anything. Returns 0 if there was no previous pass
+         * to compare with, i.e. if everything needs to be processed. */
+
+        incremental = !!m->mountinfo_entries;
+
+        entries = set_new(&mountinfo_entry_hash_ops);
+        if (!entries)
+                return -ENOMEM;
+
+        for (;;) {
+                _cleanup_(mountinfo_entry_freep) MountinfoEntry *n = NULL;
+                struct libmnt_fs *fs;
+                MountinfoEntry key;
+
+                r = mnt_table_next_fs(table, iter, &fs);
+                if (r == 1)
+                        break;
+                if (r < 0)
+                        return r;
+
+                key = (MountinfoEntry) {
+                        .what = (char*) mnt_fs_get_source(fs),
+                        .where = (char*) mnt_fs_get_target(fs),
+                        .options = (char*) mnt_fs_get_options(fs),
+                        .fstype = (char*) mnt_fs_get_fstype(fs),
+                };
+
+                if (!key.what || !key.where)
+                        continue;
+
+                /* Exact duplicates don't tell us anything new */
+                if (set_contains(entries, &key))
+                        continue;
+
+                e = set_remove(m->mountinfo_entries, &key);
+                if (!e) {
+                        n = new0(MountinfoEntry, 1);
+                        if (!n)
+                                return -ENOMEM;
+
+                        n->what = strdup(key.what);
+                        n->where = strdup(key.where);
+                        if (!n->what || !n->where)
+                                return -ENOMEM;
+
+                        if (key.options) {
+                                n->options = strdup(key.options);
+                                if (!n->options)
+                                        return -ENOMEM;
+                        }
+
+                        if (key.fstype) {
+                                n->fstype = strdup(key.fstype);
+                                if (!n->fstype)
+                                        return -ENOMEM;
+                        }
+
+                        e = n;
+
+                        if (incremental) {
+                                r = set_ensure_allocated(&dirty, &path_hash_ops);
+                                if (r < 0)
+                                        return r;
+
+                                r = set_put_strdup(dirty, e->where);
+                                if (r < 0)
+                                        return r;
+                        }
+                }
+
+                r = set_put(entries, e);
+                if (r < 0) {
+                        if (e != n)
+                                mountinfo_entry_free(e);
+                        return r;
+                }
+
+                TAKE_PTR(n);
+        }
+
+        /* Whatever is left of the old table is gone now */
+        while ((e = set_steal_first(m->mountinfo_entries))) {
+                r = set_ensure_allocated(&dirty, &path_hash_ops);
+                if (r >= 0)
+                        r = set_put_strdup(dirty, e->where);
+                mountinfo_entry_free(e);
+                if (r < 0)
+                        return r;
+        }
+
+        set_free(m->mountinfo_entries);
+        m->mountinfo_entries = TAKE_PTR(entries);
+
+        *ret_dirty = TAKE_PTR(dirty);
+        return incremental;
+}
+
+static int mount_load_proc_self_mountinfo(Manager *m, bool set_flags, Set **ret_dirty) {
         _cleanup_(mnt_free_tablep) struct libmnt_table *table = NULL;
         _cleanup_(mnt_free_iterp) struct libmnt_iter *iter = NULL;
+        _cleanup_set_free_free_ Set *dirty = NULL;
+        bool incremental = false;
         int r;
 
         assert(m);
@@ -1673,6 +1842,18 @@ static int mount_load_proc_self_mountinfo(Manager *m, bool set_flags) {
         if (r < 0)
                 return log_error_errno(r, "Failed to parse /proc/self/mountinfo: %m");
 
+        if (ret_dirty) {
+                r = mount_diff_proc_self_mountinfo(m, table, iter, &dirty);
+                if (r < 0) {
+                        /* Start over with a full pass next time */
+                        m->mountinfo_entries = set_free(m->mountinfo_entries);
+                        return log_error_errno(r, "Failed to compare /proc/self/mountinfo with previous state: %m");
+                }
+
+                incremental = r > 0;
+                mnt_reset_iter(iter, MNT_ITER_FORWARD);
+        }
+
         for (;;) {
                 struct libmnt_fs *fs;
                 const char *device, *path, *options, *fstype;
@@ -1691,18 +1872,28 @@ static int mount_load_proc_self_mountinfo(Manager *m, bool set_flags) {
                 if (!device || !path)
                         continue;
 
+                /* Also process unchanged entries stacked on a changed mount point, so that the flags of the
+                 * mount unit reflect all of them */
+                if (incremental && !set_contains(dirty, path))
+                        continue;
+
                 device_found_node(m, device, DEVICE_FOUND_MOUNT, DEVICE_FOUND_MOUNT);
 
                 (void) mount_setup_unit(m, device, path, options, fstype, set_flags);
         }
 
-        return 0;
+        if (ret_dirty)
+                *ret_dirty = TAKE_PTR(dirty);
+
+        return incremental;
 }
 
 static void mount_shutdown(Manager *m) {
         assert(m);
 
         m->mount_event_source = sd_event_source_unref(m->mount_event_source);
+        m->mount_ratelimit_event_source = sd_event_source_unref(m->mount_ratelimit_event_source);
+        m->mountinfo_entries = set_free(m->mountinfo_entries);
 
         mnt_unref_monitor(m->mount_monitor);
         m->mount_monitor = NULL;
@@ -1805,9 +1996,16 @@ static void mount_enumerate(Manager *m) {
                 }
 
                 (void) sd_event_source_set_description(m->mount_event_source, "mount-monitor-dispatch");
+
+                /* Don't reconcile the mount table more often than this, changes are coalesced in between */
+                m->mount_ratelimit = (RateLimit) { .interval = 1 * USEC_PER_SEC, .burst = 5 };
         }
 
-        r = mount_load_proc_self_mountinfo(m, false);
+        /* We might be called after a reload, with all units just deserialized. Make sure the next pass
+         * looks at all entries again, instead of just at those that changed. */
+        m->mountinfo_entries = set_free(m->mountinfo_entries);
+
+        r = mount_load_proc_self_mountinfo(m, false, NULL);
         if (r < 0)
                 goto fail;
 
@@ -1840,9 +2038,97 @@ static int drain_libmount(Manager *m) {
         return rescan;
 }
 
+static void mount_process_proc_self_mountinfo_one(Mount *mount, Set **gone) {
+        Unit *u = UNIT(mount);
+
+        assert(mount);
+        assert(gone);
+
+        if (!mount_is_mounted(mount)) {
+
+                /* A mount point is not around right now. It
+                 * might be gone, or might never have
+                 * existed. */
+
+                if (mount->from_proc_self_mountinfo &&
+                    mount->parameters_proc_self_mountinfo.what) {
+
+                        /* Remember that this device might just have disappeared */
+                        if (set_ensure_allocated(gone, &path_hash_ops) < 0 ||
+                            set_put_strdup(*gone, mount->parameters_proc_self_mountinfo.what) < 0)
+                                log_oom(); /* we don't care too much about OOM here... */
+                }
+
+                mount->from_proc_self_mountinfo = false;
+                assert_se(update_parameters_proc_self_mountinfo(mount, NULL, NULL, NULL) >= 0);
+
+                switch (mount->state) {
+
+                case MOUNT_MOUNTED:
+                        /* This has just been unmounted by somebody else, follow the state change. */
+                        mount_enter_dead(mount, MOUNT_SUCCESS);
+                        break;
+
+                default:
+                        break;
+                }
+
+        } else if (mount->proc_flags & (MOUNT_PROC_JUST_MOUNTED|MOUNT_PROC_JUST_CHANGED)) {
+
+                /* A mount point was added or changed */
+
+                switch (mount->state) {
+
+                case MOUNT_DEAD:
+                case MOUNT_FAILED:
+
+                        /* This has just been mounted by somebody else, follow the state change, but let's
+                         * generate a new invocation ID for this implicitly and automatically. */
+                        (void) unit_acquire_invocation_id(u);
+                        mount_cycle_clear(mount);
+                        mount_enter_mounted(mount, MOUNT_SUCCESS);
+                        break;
+
+                case MOUNT_MOUNTING:
+                        mount_set_state(mount, MOUNT_MOUNTING_DONE);
+                        break;
+
+                default:
+                        /* Nothing really changed, but let's
+                         * issue an notification call
+                         * nonetheless, in case somebody is
+                         * waiting for this. (e.g. file system
+                         * ro/rw remounts.) */
+                        mount_set_state(mount, mount->state);
+                        break;
+                }
+        }
+
+        /* Reset the flags for later calls */
+        mount->proc_flags = 0;
+}
+
+static bool mount_device_in_use(Manager *m, const char *what) {
+        Unit *u;
+
+        assert(m);
+        assert(what);
+
+        LIST_FOREACH(units_by_type, u, m->units_by_type[UNIT_MOUNT]) {
+                Mount *mount = MOUNT(u);
+
+                if (mount->from_proc_self_mountinfo &&
+                    mount->parameters_proc_self_mountinfo.what &&
+                    path_equal(mount->parameters_proc_self_mountinfo.what, what))
+                        return true;
+        }
+
+        return false;
+}
+
 static int mount_process_proc_self_mountinfo(Manager *m) {
-        _cleanup_set_free_free_ Set *around = NULL, *gone = NULL;
-        const char *what;
+        _cleanup_set_free_free_ Set *dirty = NULL, *gone = NULL;
+        const char *what, *where;
         Iterator i;
         Unit *u;
         int r;
@@ -1853,7 +2139,7 @@ static int mount_process_proc_self_mountinfo(Manager *m) {
         if (r <= 0)
                 return r;
 
-        r = mount_load_proc_self_mountinfo(m, true);
+        r = mount_load_proc_self_mountinfo(m, true, &dirty);
         if (r < 0) {
                 /* Reset flags, just in case, for later calls */
                 LIST_FOREACH(units_by_type, u, m->units_by_type[UNIT_MOUNT])
@@ -1861,88 +2147,43 @@ static int mount_process_proc_self_mountinfo(Manager *m) {
 
                 return 0;
         }
+        if (r > 0 && set_isempty(dirty))
+                return 0; /* Nothing relevant changed */
 
         manager_dispatch_load_queue(m);
 
-        LIST_FOREACH(units_by_type, u, m->units_by_type[UNIT_MOUNT]) {
-                Mount *mount = MOUNT(u);
-
-                if (!mount_is_mounted(mount)) {
-
-                        /* A mount point is not around right now. It
-                         * might be gone, or might never have
-                         * existed. */
-
-                        if (mount->from_proc_self_mountinfo &&
-                            mount->parameters_proc_self_mountinfo.what) {
-
-                                /* Remember that this device might just have disappeared */
-                                if (set_ensure_allocated(&gone, &path_hash_ops) < 0 ||
-                                    set_put_strdup(gone, mount->parameters_proc_self_mountinfo.what) < 0)
-                                        log_oom(); /* we don't care too much about OOM here... */
-                        }
-
-                        mount->from_proc_self_mountinfo = false;
-                        assert_se(update_parameters_proc_self_mountinfo(mount, NULL, NULL, NULL) >= 0);
-
-                        switch (mount->state) {
-
-                        case MOUNT_MOUNTED:
-                                /* This has just been unmounted by somebody else, follow the state change. */
-                                mount_enter_dead(mount, MOUNT_SUCCESS);
-                                break;
-
-                        default:
-                                break;
-                        }
-
-                } else if (mount->proc_flags & (MOUNT_PROC_JUST_MOUNTED|MOUNT_PROC_JUST_CHANGED)) {
-
-                        /* A mount point was added or changed */
-
-                        switch (mount->state) {
+        if (r > 0) {
+                _cleanup_set_free_ Set *units = NULL;
 
-                        case MOUNT_DEAD:
-                        case MOUNT_FAILED:
+                /* Only look at the mount units of mount points that changed. Collect them first, so that we
+                 * process each unit only once, even if different spellings of a path map to it. */
+                SET_FOREACH(where, dirty, i) {
+                        _cleanup_free_ char *e = NULL;
 
-                                /* This has just been mounted by somebody else, follow the state change, but let's
-                                 * generate a new invocation ID for this implicitly and automatically. */
-                                (void) unit_acquire_invocation_id(u);
-                                mount_cycle_clear(mount);
-                                mount_enter_mounted(mount, MOUNT_SUCCESS);
-                                break;
+                        if (unit_name_from_path(where, ".mount", &e) < 0)
+                                continue;
 
-                        case MOUNT_MOUNTING:
-                                mount_set_state(mount, MOUNT_MOUNTING_DONE);
-                                break;
+                        u = manager_get_unit(m, e);
+                        if (!u)
+                                continue;
 
-                        default:
-                                /* Nothing really changed, but let's
-                                 * issue an notification call
-                                 * nonetheless, in case somebody is
-                                 * waiting for this. (e.g. file system
-                                 * ro/rw remounts.) */
-                                mount_set_state(mount, mount->state);
+                        if (set_ensure_allocated(&units, NULL) < 0 ||
+                            set_put(units, u) < 0) {
+                                log_oom();
+                                /* Fall back to a full pass next time */
+                                m->mountinfo_entries = set_free(m->mountinfo_entries);
                                 break;
                         }
                 }
 
-                if (mount_is_mounted(mount) &&
-                    mount->from_proc_self_mountinfo &&
-                    mount->parameters_proc_self_mountinfo.what) {
-                        /* Track devices currently used */
-
-                        if (set_ensure_allocated(&around, &path_hash_ops) < 0 ||
-                            set_put_strdup(around, mount->parameters_proc_self_mountinfo.what) < 0)
-                                log_oom();
-                }
-
-                /* Reset the flags for later calls */
-                mount->proc_flags = 0;
-        }
+                SET_FOREACH(u, units, i)
+                        mount_process_proc_self_mountinfo_one(MOUNT(u), &gone);
+        } else
+                LIST_FOREACH(units_by_type, u, m->units_by_type[UNIT_MOUNT])
+                        mount_process_proc_self_mountinfo_one(MOUNT(u), &gone);
 
         SET_FOREACH(what, gone, i) {
-                if (set_contains(around, what))
+                if (mount_device_in_use(m, what))
                         continue;
 
                 /* Let the device units know that the device is no longer mounted */
@@ -1952,13 +2193,58 @@ static int mount_process_proc_self_mountinfo(Manager *m) {
         return 0;
 }
 
+static int mount_dispatch_ratelimit(sd_event_source *source, usec_t usec, void *userdata) {
+        Manager *m = userdata;
+        int r;
+
+        assert(m);
+
+        r = sd_event_source_set_enabled(m->mount_event_source, SD_EVENT_ON);
+        if (r < 0)
+                log_error_errno(r, "Failed to reenable mount watch: %m");
+
+        return mount_process_proc_self_mountinfo(m);
+}
+
 static int mount_dispatch_io(sd_event_source *source, int fd, uint32_t revents, void *userdata) {
         Manager *m = userdata;
+        usec_t until;
+        int r;
 
         assert(m);
         assert(revents & EPOLLIN);
 
-        return mount_process_proc_self_mountinfo(m);
+        if (ratelimit_below(&m->mount_ratelimit))
+                return mount_process_proc_self_mountinfo(m);
+
+        /* There's a lot of mount churn going on. Stop watching for the rest of the rate limit interval and
+         * then process everything that accumulated in one go. */
+        until = usec_add(m->mount_ratelimit.begin, m->mount_ratelimit.interval);
+
+        if (m->mount_ratelimit_event_source) {
+                r = sd_event_source_set_time(m->mount_ratelimit_event_source, until);
+                if (r >= 0)
+                        r = sd_event_source_set_enabled(m->mount_ratelimit_event_source, SD_EVENT_ONESHOT);
+        } else {
+                r = sd_event_add_time(m->event, &m->mount_ratelimit_event_source, CLOCK_MONOTONIC, until, 0, mount_dispatch_ratelimit, m);
+                if (r >= 0) {
+                        (void) sd_event_source_set_priority(m->mount_ratelimit_event_source, SD_EVENT_PRIORITY_NORMAL-10);
+                        (void) sd_event_source_set_description(m->mount_ratelimit_event_source, "mount-ratelimit");
+                }
+        }
+        if (r < 0) {
+                log_warning_errno(r, "Failed to arm mount rate limit timer, processing mount table changes right away: %m");
+                return mount_process_proc_self_mountinfo(m);
+        }
+
+        r = sd_event_source_set_enabled(m->mount_event_source, SD_EVENT_OFF);
+        if (r < 0) {
+                log_warning_errno(r, "Failed to disable mount watch, processing mount table changes right away: %m");
+                return mount_process_proc_self_mountinfo(m);
+        }
+
+        log_debug("Mount table changes too frequently, delaying processing.");
+        return 0;
 }
 
 static void mount_reset_failed(Unit *u) {
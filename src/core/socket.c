@@ -45,6 +45,9 @@
 #include "unit.h"
 #include "user-util.h"
 
+/* How many connections to accept on an Accept=yes socket per wakeup, before returning to the event loop */
+#define SOCKET_ACCEPT_BATCH_MAX 16U
+
 struct SocketPeer {
         unsigned n_ref;
 
@@ -2305,12 +2308,10 @@ static void socket_enter_running(Socket *s, int cfd) {
         if (cfd < 0) {
                 bool pending = false;
                 Unit *other;
-                Iterator i;
-                void *v;
 
                 /* If there's already a start pending don't bother to
                  * do anything */
-                HASHMAP_FOREACH_KEY(v, other, UNIT(s)->dependencies[UNIT_TRIGGERS], i)
+                UNIT_FOREACH_DEPENDENCY(other, UNIT(s), UNIT_TRIGGERS)
                         if (unit_active_or_pending(other)) {
                                 pending = true;
                                 break;
@@ -2985,14 +2986,28 @@ static int socket_dispatch_io(sd_event_source *source, int fd, uint32_t revents,
         if (p->socket->accept &&
             p->type == SOCKET_SOCKET &&
             socket_address_can_accept(&p->address)) {
+                unsigned n;
 
-                cfd = socket_accept_in_cgroup(p->socket, p, fd);
-                if (cfd == -EAGAIN) /* Spurious accept() */
-                        return 0;
-                if (cfd < 0)
-                        goto fail;
+                /* Under load, more connections are likely queued already. Take a few of them at once, rather
+                 * than going through the event loop for each, but not too many, so that we don't starve
+                 * other event sources. */
+                for (n = 0; n < SOCKET_ACCEPT_BATCH_MAX; n++) {
 
-                socket_apply_socket_options(p->socket, cfd);
+                        /* The previous connection might have made us leave the listening state */
+                        if (p->socket->state != SOCKET_LISTENING)
+                                break;
+
+                        cfd = socket_accept_in_cgroup(p->socket, p, fd);
+                        if (cfd == -EAGAIN) /* Spurious accept(), or no more connections queued */
+                                break;
+                        if (cfd < 0)
+                                goto fail;
+
+                        socket_apply_socket_options(p->socket, cfd);
+                        socket_enter_running(p->socket, cfd);
+                }
+
+                return 0;
         }
 
         socket_enter_running(p->socket, cfd);
@@ -120,7 +120,7 @@ static int timer_add_trigger_dependencies(Timer *t) {
 
         assert(t);
 
-        if (!hashmap_isempty(UNIT(t)->dependencies[UNIT_TRIGGERS]))
+        if (unit_dependency_count(UNIT(t), UNIT_TRIGGERS) > 0)
                 return 0;
 
         r = unit_load_related_unit(UNIT(t), ".service", &x);
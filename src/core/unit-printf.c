@@ -224,7 +224,7 @@ int unit_name_printf(const Unit *u, const char* format, char **ret) {
         assert(format);
         assert(ret);
 
-        return specifier_printf(format, table, u, ret);
+        return specifier_printf_full(format, table, u, u->manager->specifier_cache, ret);
 }
 
 int unit_full_printf(const Unit *u, const char *format, char **ret) {
@@ -296,5 +296,5 @@ int unit_full_printf(const Unit *u, const char *format, char **ret) {
                 {}
         };
 
-        return specifier_printf(format, table, u, ret);
+        return specifier_printf_full(format, table, u, u->manager->specifier_cache, ret);
 }
@@ -105,6 +105,8 @@ Unit *unit_new(Manager *m, size_t size) {
         u->on_failure_job_mode = JOB_REPLACE;
         u->cgroup_control_inotify_wd = -1;
         u->cgroup_memory_inotify_wd = -1;
+        for (CGroupAccountingFile i = 0; i < _CGROUP_ACCOUNTING_FILE_MAX; i++)
+                u->cgroup_accounting_fds[i] = -1;
         u->job_timeout = USEC_INFINITY;
         u->job_running_timeout = USEC_INFINITY;
         u->ref_uid = UID_INVALID;
@@ -115,10 +117,6 @@ Unit *unit_new(Manager *m, size_t size) {
 
         u->ip_accounting_ingress_map_fd = -1;
         u->ip_accounting_egress_map_fd = -1;
-        u->ipv4_allow_map_fd = -1;
-        u->ipv6_allow_map_fd = -1;
-        u->ipv4_deny_map_fd = -1;
-        u->ipv6_deny_map_fd = -1;
 
         u->last_section_private = -1;
 
@@ -330,6 +328,7 @@ int unit_choose_id(Unit *u, const char *name) {
                 return r;
 
         u->id = s;
+        u->dbus_path = mfree(u->dbus_path);
 
         free(u->instance);
         u->instance = i;
@@ -431,6 +430,7 @@ void unit_add_to_load_queue(Unit *u) {
 
         LIST_PREPEND(load_queue, u->manager->load_queue, u);
         u->in_load_queue = true;
+        u->load_prefetched = false;
 }
 
 void unit_add_to_cleanup_queue(Unit *u) {
@@ -456,10 +456,48 @@ void unit_add_to_gc_queue(Unit *u) {
         u->in_gc_queue = true;
 }
 
+void unit_update_snapshot(Unit *u) {
+        UnitSnapshotEntry e = {};
+        UnitSnapshotWriter *w;
+        pid_t pid;
+        int r;
+
+        assert(u);
+
+        w = u->manager->unit_snapshot;
+        if (!w || u->load_state == UNIT_STUB)
+                return;
+
+        if (!u->in_unit_snapshot) {
+                r = unit_snapshot_writer_add(w, &u->unit_snapshot_index);
+                if (r < 0) {
+                        log_unit_debug_errno(u, r, "Failed to add unit to state snapshot, ignoring: %m");
+                        return;
+                }
+
+                u->in_unit_snapshot = true;
+        }
+
+        pid = unit_main_pid(u);
+
+        strncpy(e.id, u->id, sizeof(e.id) - 1);
+        strncpy(e.load_state, unit_load_state_to_string(u->load_state), sizeof(e.load_state) - 1);
+        strncpy(e.active_state, unit_active_state_to_string(unit_active_state(u)), sizeof(e.active_state) - 1);
+        strncpy(e.sub_state, strempty(unit_sub_state_to_string(u)), sizeof(e.sub_state) - 1);
+        e.main_pid = pid > 0 ? (uint32_t) pid : 0;
+        e.state_change_timestamp = u->state_change_timestamp.realtime;
+
+        unit_snapshot_writer_update(w, u->unit_snapshot_index, &e);
+}
+
 void unit_add_to_dbus_queue(Unit *u) {
         assert(u);
         assert(u->type != _UNIT_TYPE_INVALID);
 
+        /* Every state change that is worth a signal is worth updating the snapshot for, and unlike the
+         * signals the snapshot is kept current even if nobody is subscribed, or the unit is queued already. */
+        unit_update_snapshot(u);
+
         if (u->load_state == UNIT_STUB || u->in_dbus_queue)
                 return;
 
@@ -471,6 +509,9 @@ void unit_add_to_dbus_queue(Unit *u) {
                 return;
         }
 
+        if (u->manager->dbus_signal_coalesce_usec > 0 && !u->manager->dbus_unit_queue && !u->manager->dbus_job_queue)
+                u->manager->dbus_queue_since = now(CLOCK_MONOTONIC);
+
         LIST_PREPEND(dbus_queue, u->manager->dbus_unit_queue, u);
         u->in_dbus_queue = true;
 }
@@ -491,25 +532,196 @@ void unit_submit_to_stop_when_unneeded_queue(Unit *u) {
         u->in_stop_when_unneeded_queue = true;
 }
 
-static void bidi_set_free(Unit *u, Hashmap *h) {
+static size_t unit_dependency_array_bisect(const UnitDependencyArray *a, const Unit *other) {
+        size_t lo = 0, hi;
+
+        /* Returns the index of the first entry whose unit is not ordered before 'other' */
+
+        if (!a)
+                return 0;
+
+        hi = a->n_entries;
+        while (lo < hi) {
+                size_t m = lo + (hi - lo) / 2;
+
+                if ((uintptr_t) a->entries[m].other < (uintptr_t) other)
+                        lo = m + 1;
+                else
+                        hi = m;
+        }
+
+        return lo;
+}
+
+UnitDependencyEntry* unit_dependency_find(const Unit *u, UnitDependency d, const Unit *other) {
+        UnitDependencyArray *a;
+        size_t idx;
+
+        assert(u);
+        assert(d >= 0 && d < _UNIT_DEPENDENCY_MAX);
+
+        a = u->dependencies[d];
+        idx = unit_dependency_array_bisect(a, other);
+        if (!a || idx >= a->n_entries || a->entries[idx].other != other)
+                return NULL;
+
+        return a->entries + idx;
+}
+
+static int unit_dependency_reserve(Unit *u, UnitDependency d, size_t n) {
+        UnitDependencyArray *a;
+        size_t need, k;
+
+        assert(u);
+        assert(d >= 0 && d < _UNIT_DEPENDENCY_MAX);
+
+        /* Makes sure that n more entries fit into the array, without further allocations */
+
+        a = u->dependencies[d];
+        need = (a ? a->n_entries : 0) + n;
+        if (a && a->n_allocated >= need)
+                return 0;
+        if (need == 0)
+                return 0;
+
+        k = MAX(need + need / 2, 2U);
+        if (k > (SIZE_MAX - offsetof(UnitDependencyArray, entries)) / sizeof(UnitDependencyEntry))
+                return -ENOMEM;
+
+        a = realloc(a, offsetof(UnitDependencyArray, entries) + k * sizeof(UnitDependencyEntry));
+        if (!a)
+                return -ENOMEM;
+
+        if (!u->dependencies[d])
+                a->n_entries = 0;
+        a->n_allocated = k;
+        u->dependencies[d] = a;
+
+        return 0;
+}
+
+static void unit_dependency_array_insert(UnitDependencyArray *a, size_t idx, Unit *other, UnitDependencyInfo info) {
+        assert(a);
+        assert(idx <= a->n_entries);
+        assert(a->n_entries < a->n_allocated);
+
+        memmove(a->entries + idx + 1, a->entries + idx, (a->n_entries - idx) * sizeof(UnitDependencyEntry));
+        a->entries[idx] = (UnitDependencyEntry) {
+                .other = other,
+                .info = info,
+        };
+        a->n_entries++;
+}
+
+static void unit_dependency_array_remove(UnitDependencyArray *a, size_t idx) {
+        assert(a);
+        assert(idx < a->n_entries);
+
+        memmove(a->entries + idx, a->entries + idx + 1, (a->n_entries - idx - 1) * sizeof(UnitDependencyEntry));
+        a->n_entries--;
+}
+
+static int unit_dependency_put(
+                Unit *u,
+                UnitDependency d,
+                Unit *other,
+                UnitDependencyMask origin_mask,
+                UnitDependencyMask destination_mask) {
+
+        UnitDependencyEntry *e;
+        size_t idx;
+        int r;
+
+        assert(u);
+        assert(other);
+
+        /* Adds the dependency, or ORs the masks into an existing entry. Returns 0 if nothing changed, 1 otherwise. */
+
+        e = unit_dependency_find(u, d, other);
+        if (e) {
+                if (FLAGS_SET(e->info.origin_mask, origin_mask) &&
+                    FLAGS_SET(e->info.destination_mask, destination_mask))
+                        return 0; /* NOP */
+
+                e->info.origin_mask |= origin_mask;
+                e->info.destination_mask |= destination_mask;
+                return 1;
+        }
+
+        r = unit_dependency_reserve(u, d, 1);
+        if (r < 0)
+                return r;
+
+        idx = unit_dependency_array_bisect(u->dependencies[d], other);
+        unit_dependency_array_insert(u->dependencies[d], idx, other,
+                                     (UnitDependencyInfo) {
+                                             .origin_mask = origin_mask,
+                                             .destination_mask = destination_mask,
+                                     });
+        return 1;
+}
+
+static bool unit_dependency_remove(Unit *u, UnitDependency d, Unit *other) {
+        UnitDependencyEntry *e;
+
+        assert(u);
+
+        e = unit_dependency_find(u, d, other);
+        if (!e)
+                return false;
+
+        unit_dependency_array_remove(u->dependencies[d], e - u->dependencies[d]->entries);
+        if (u->dependencies[d]->n_entries == 0)
+                u->dependencies[d] = mfree(u->dependencies[d]);
+
+        return true;
+}
+
+static void unit_dependency_replace(Unit *u, UnitDependency d, Unit *from, Unit *to) {
+        UnitDependencyEntry *e_from, *e_to;
+        UnitDependencyInfo di;
+
+        assert(u);
+        assert(from);
+        assert(to);
+
+        /* Makes the dependency on 'from' a dependency on 'to', merging the masks if the latter already exists.
+         * This never needs to allocate memory. */
+
+        e_from = unit_dependency_find(u, d, from);
+        if (!e_from)
+                return;
+
+        di = e_from->info;
+        unit_dependency_array_remove(u->dependencies[d], e_from - u->dependencies[d]->entries);
+
+        e_to = unit_dependency_find(u, d, to);
+        if (e_to) {
+                e_to->info.origin_mask |= di.origin_mask;
+                e_to->info.destination_mask |= di.destination_mask;
+        } else
+                unit_dependency_array_insert(u->dependencies[d],
+                                             unit_dependency_array_bisect(u->dependencies[d], to),
+                                             to, di);
+}
+
+static void bidi_set_free(Unit *u, UnitDependency d) {
         Unit *other;
-        Iterator i;
-        void *v;
 
         assert(u);
 
-        /* Frees the hashmap and makes sure we are dropped from the inverse pointers */
+        /* Frees the dependency array and makes sure we are dropped from the inverse pointers */
 
-        HASHMAP_FOREACH_KEY(v, other, h, i) {
-                UnitDependency d;
+        UNIT_FOREACH_DEPENDENCY(other, u, d) {
+                UnitDependency k;
 
-                for (d = 0; d < _UNIT_DEPENDENCY_MAX; d++)
-                        hashmap_remove(other->dependencies[d], u);
+                for (k = 0; k < _UNIT_DEPENDENCY_MAX; k++)
+                        (void) unit_dependency_remove(other, k, u);
 
                 unit_add_to_gc_queue(other);
         }
 
-        hashmap_free(h);
+        u->dependencies[d] = mfree(u->dependencies[d]);
 }
 
 static void unit_remove_transient(Unit *u) {
@@ -651,7 +863,7 @@ void unit_free(Unit *u) {
         }
 
         for (d = 0; d < _UNIT_DEPENDENCY_MAX; d++)
-                bidi_set_free(u, u->dependencies[d]);
+                bidi_set_free(u, d);
 
         if (u->on_console)
                 manager_unref_console(u->manager);
@@ -681,6 +893,9 @@ void unit_free(Unit *u) {
         if (u->in_dbus_queue)
                 LIST_REMOVE(dbus_queue, u->manager->dbus_unit_queue, u);
 
+        if (u->in_unit_snapshot)
+                unit_snapshot_writer_remove(u->manager->unit_snapshot, u->unit_snapshot_index);
+
         if (u->in_gc_queue)
                 LIST_REMOVE(gc_queue, u->manager->gc_unit_queue, u);
 
@@ -690,6 +905,12 @@ void unit_free(Unit *u) {
         if (u->in_cgroup_empty_queue)
                 LIST_REMOVE(cgroup_empty_queue, u->manager->cgroup_empty_queue, u);
 
+        if (u->in_cgroup_oom_queue)
+                LIST_REMOVE(cgroup_oom_queue, u->manager->cgroup_oom_queue, u);
+
+        if (u->in_cgroup_events_queue)
+                LIST_REMOVE(cgroup_events_queue, u->manager->cgroup_events_queue, u);
+
         if (u->in_cleanup_queue)
                 LIST_REMOVE(cleanup_queue, u->manager->cleanup_queue, u);
 
@@ -702,10 +923,7 @@ void unit_free(Unit *u) {
         safe_close(u->ip_accounting_ingress_map_fd);
         safe_close(u->ip_accounting_egress_map_fd);
 
-        safe_close(u->ipv4_allow_map_fd);
-        safe_close(u->ipv6_allow_map_fd);
-        safe_close(u->ipv4_deny_map_fd);
-        safe_close(u->ipv6_deny_map_fd);
+        bpf_firewall_access_unref(u->ip_bpf_access);
 
         bpf_program_unref(u->ip_bpf_ingress);
         bpf_program_unref(u->ip_bpf_ingress_installed);
@@ -728,6 +946,7 @@ void unit_free(Unit *u) {
         free(u->source_path);
         strv_free(u->dropin_paths);
         free(u->instance);
+        free(u->dbus_path);
 
         free(u->job_timeout_reboot_arg);
 
@@ -834,6 +1053,7 @@ static int merge_names(Unit *u, Unit *other) {
         set_free_free(other->names);
         other->names = NULL;
         other->id = NULL;
+        other->dbus_path = mfree(other->dbus_path);
 
         SET_FOREACH(t, u->names, i)
                 assert_se(hashmap_replace(u->manager->units, t, u) == 0);
@@ -842,31 +1062,29 @@ static int merge_names(Unit *u, Unit *other) {
 }
 
 static int reserve_dependencies(Unit *u, Unit *other, UnitDependency d) {
-        unsigned n_reserve;
+        size_t n_reserve;
 
         assert(u);
         assert(other);
         assert(d < _UNIT_DEPENDENCY_MAX);
 
         /*
-         * If u does not have this dependency set allocated, there is no need
-         * to reserve anything. In that case other's set will be transferred
-         * as a whole to u by complete_move().
+         * If u does not have this dependency array allocated, there is no need
+         * to reserve anything. In that case other's array will be transferred
+         * as a whole to u by merge_dependencies().
          */
         if (!u->dependencies[d])
                 return 0;
 
         /* merge_dependencies() will skip a u-on-u dependency */
-        n_reserve = hashmap_size(other->dependencies[d]) - !!hashmap_get(other->dependencies[d], u);
+        n_reserve = unit_dependency_count(other, d) - unit_has_dependency(other, d, u);
 
-        return hashmap_reserve(u->dependencies[d], n_reserve);
+        return unit_dependency_reserve(u, d, n_reserve);
 }
 
 static void merge_dependencies(Unit *u, Unit *other, const char *other_id, UnitDependency d) {
-        Iterator i;
+        UnitDependencyEntry *e;
         Unit *back;
-        void *v;
-        int r;
 
         /* Merges all dependencies of type 'd' of the unit 'other' into the deps of the unit 'u' */
 
@@ -875,7 +1093,7 @@ static void merge_dependencies(Unit *u, Unit *other, const char *other_id, UnitD
         assert(d < _UNIT_DEPENDENCY_MAX);
 
         /* Fix backwards pointers. Let's iterate through all dependent units of the other unit. */
-        HASHMAP_FOREACH_KEY(v, back, other->dependencies[d], i) {
+        UNIT_FOREACH_DEPENDENCY(back, other, d) {
                 UnitDependency k;
 
                 /* Let's now iterate through the dependencies of that dependencies of the other units, looking for
@@ -884,46 +1102,32 @@ static void merge_dependencies(Unit *u, Unit *other, const char *other_id, UnitD
                 for (k = 0; k < _UNIT_DEPENDENCY_MAX; k++) {
                         if (back == u) {
                                 /* Do not add dependencies between u and itself. */
-                                if (hashmap_remove(back->dependencies[k], other))
+                                if (unit_dependency_remove(back, k, other))
                                         maybe_warn_about_dependency(u, other_id, k);
                         } else {
-                                UnitDependencyInfo di_u, di_other, di_merged;
-
                                 /* Let's drop this dependency between "back" and "other", and let's create it between
                                  * "back" and "u" instead. Let's merge the bit masks of the dependency we are moving,
                                  * and any such dependency which might already exist */
 
-                                di_other.data = hashmap_get(back->dependencies[k], other);
-                                if (!di_other.data)
-                                        continue; /* dependency isn't set, let's try the next one */
-
-                                di_u.data = hashmap_get(back->dependencies[k], u);
-
-                                di_merged = (UnitDependencyInfo) {
-                                        .origin_mask = di_u.origin_mask | di_other.origin_mask,
-                                        .destination_mask = di_u.destination_mask | di_other.destination_mask,
-                                };
-
-                                r = hashmap_remove_and_replace(back->dependencies[k], other, u, di_merged.data);
-                                if (r < 0)
-                                        log_warning_errno(r, "Failed to remove/replace: back=%s other=%s u=%s: %m", back->id, other_id, u->id);
-                                assert(r >= 0);
-
-                                /* assert_se(hashmap_remove_and_replace(back->dependencies[k], other, u, di_merged.data) >= 0); */
+                                unit_dependency_replace(back, k, other, u);
                         }
                 }
-
         }
 
         /* Also do not move dependencies on u to itself */
-        back = hashmap_remove(other->dependencies[d], u);
-        if (back)
+        if (unit_dependency_remove(other, d, u))
                 maybe_warn_about_dependency(u, other_id, d);
 
-        /* The move cannot fail. The caller must have performed a reservation. */
-        assert_se(hashmap_complete_move(&u->dependencies[d], &other->dependencies[d]) == 0);
+        if (!u->dependencies[d])
+                /* Nothing to merge with, just take over the whole array */
+                u->dependencies[d] = TAKE_PTR(other->dependencies[d]);
+        else {
+                /* This cannot fail. The caller must have performed a reservation. */
+                UNIT_FOREACH_DEPENDENCY_ENTRY(e, other, d)
+                        assert_se(unit_dependency_put(u, d, e->other, e->info.origin_mask, e->info.destination_mask) >= 0);
 
-        other->dependencies[d] = hashmap_free(other->dependencies[d]);
+                other->dependencies[d] = mfree(other->dependencies[d]);
+        }
 }
 
 int unit_merge(Unit *u, Unit *other) {
@@ -1380,16 +1584,15 @@ void unit_dump(Unit *u, FILE *f, const char *prefix) {
                         prefix, yes_no(u->assert_result));
 
         for (d = 0; d < _UNIT_DEPENDENCY_MAX; d++) {
-                UnitDependencyInfo di;
-                Unit *other;
+                UnitDependencyEntry *e;
 
-                HASHMAP_FOREACH_KEY(di.data, other, u->dependencies[d], i) {
+                UNIT_FOREACH_DEPENDENCY_ENTRY(e, u, d) {
                         bool space = false;
 
-                        fprintf(f, "%s\t%s: %s (", prefix, unit_dependency_to_string(d), other->id);
+                        fprintf(f, "%s\t%s: %s (", prefix, unit_dependency_to_string(d), e->other->id);
 
-                        print_unit_dependency_mask(f, "origin", di.origin_mask, &space);
-                        print_unit_dependency_mask(f, "destination", di.destination_mask, &space);
+                        print_unit_dependency_mask(f, "origin", e->info.origin_mask, &space);
+                        print_unit_dependency_mask(f, "destination", e->info.destination_mask, &space);
 
                         fputs(")\n", f);
                 }
@@ -1504,7 +1707,7 @@ int unit_add_default_target_dependency(Unit *u, Unit *target) {
                 return 0;
 
         /* Don't create loops */
-        if (hashmap_get(target->dependencies[UNIT_BEFORE], u))
+        if (unit_has_dependency(target, UNIT_BEFORE, u))
                 return 0;
 
         return unit_add_dependency(target, UNIT_AFTER, u, true, UNIT_DEPENDENCY_DEFAULT);
@@ -1602,6 +1805,7 @@ static int unit_add_startup_units(Unit *u) {
 }
 
 int unit_load(Unit *u) {
+        usec_t trace;
         int r;
 
         assert(u);
@@ -1629,7 +1833,9 @@ int unit_load(Unit *u) {
                 u->fragment_mtime = now(CLOCK_REALTIME);
         }
 
+        trace = manager_trace_begin(&u->manager->trace);
         r = UNIT_VTABLE(u)->load(u);
+        manager_trace_end(&u->manager->trace, "load", u->id, trace);
         if (r < 0)
                 goto fail;
 
@@ -1650,7 +1856,7 @@ int unit_load(Unit *u) {
                 if (r < 0)
                         goto fail;
 
-                if (u->on_failure_job_mode == JOB_ISOLATE && hashmap_size(u->dependencies[UNIT_ON_FAILURE]) > 1) {
+                if (u->on_failure_job_mode == JOB_ISOLATE && unit_dependency_count(u, UNIT_ON_FAILURE) > 1) {
                         log_unit_error(u, "More than one OnFailure= dependencies specified but OnFailureJobMode=isolate set. Refusing.");
                         r = -ENOEXEC;
                         goto fail;
@@ -1661,6 +1867,8 @@ int unit_load(Unit *u) {
 
                 /* We finished loading, let's ensure our parents recalculate the members mask */
                 unit_invalidate_cgroup_members_masks(u);
+
+                metric_inc(u->manager->metrics + MANAGER_METRIC_UNITS_LOADED);
         }
 
         assert((u->load_state != UNIT_MERGED) == !u->merged_into);
@@ -1776,8 +1984,6 @@ bool unit_shall_confirm_spawn(Unit *u) {
 
 static bool unit_verify_deps(Unit *u) {
         Unit *other;
-        Iterator j;
-        void *v;
 
         assert(u);
 
@@ -1786,9 +1992,9 @@ static bool unit_verify_deps(Unit *u) {
          * processing, but do not have any effect afterwards. We don't check BindsTo= dependencies that are not used in
          * conjunction with After= as for them any such check would make things entirely racy. */
 
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_BINDS_TO], j) {
+        UNIT_FOREACH_DEPENDENCY(other, u, UNIT_BINDS_TO) {
 
-                if (!hashmap_contains(u->dependencies[UNIT_AFTER], other))
+                if (!unit_has_dependency(u, UNIT_AFTER, other))
                         continue;
 
                 if (!UNIT_IS_ACTIVE_OR_RELOADING(unit_active_state(other))) {
@@ -1818,6 +2024,8 @@ static bool unit_verify_deps(Unit *u) {
 int unit_start(Unit *u) {
         UnitActiveState state;
         Unit *following;
+        usec_t trace;
+        int r;
 
         assert(u);
 
@@ -1881,7 +2089,11 @@ int unit_start(Unit *u) {
         unit_add_to_dbus_queue(u);
         unit_cgroup_freezer_action(u, FREEZER_THAW);
 
-        return UNIT_VTABLE(u)->start(u);
+        trace = manager_trace_begin(&u->manager->trace);
+        r = UNIT_VTABLE(u)->start(u);
+        manager_trace_end(&u->manager->trace, "start", u->id, trace);
+
+        return r;
 }
 
 bool unit_can_start(Unit *u) {
@@ -1915,6 +2127,8 @@ bool unit_can_isolate(Unit *u) {
 int unit_stop(Unit *u) {
         UnitActiveState state;
         Unit *following;
+        usec_t trace;
+        int r;
 
         assert(u);
 
@@ -1934,7 +2148,11 @@ int unit_stop(Unit *u) {
         unit_add_to_dbus_queue(u);
         unit_cgroup_freezer_action(u, FREEZER_THAW);
 
-        return UNIT_VTABLE(u)->stop(u);
+        trace = manager_trace_begin(&u->manager->trace);
+        r = UNIT_VTABLE(u)->stop(u);
+        manager_trace_end(&u->manager->trace, "stop", u->id, trace);
+
+        return r;
 }
 
 bool unit_can_stop(Unit *u) {
@@ -1957,6 +2175,8 @@ bool unit_can_stop(Unit *u) {
 int unit_reload(Unit *u) {
         UnitActiveState state;
         Unit *following;
+        usec_t trace;
+        int r;
 
         assert(u);
 
@@ -1991,7 +2211,11 @@ int unit_reload(Unit *u) {
 
         unit_cgroup_freezer_action(u, FREEZER_THAW);
 
-        return UNIT_VTABLE(u)->reload(u);
+        trace = manager_trace_begin(&u->manager->trace);
+        r = UNIT_VTABLE(u)->reload(u);
+        manager_trace_end(&u->manager->trace, "reload", u->id, trace);
+
+        return r;
 }
 
 bool unit_can_reload(Unit *u) {
@@ -2000,7 +2224,7 @@ bool unit_can_reload(Unit *u) {
         if (UNIT_VTABLE(u)->can_reload)
                 return UNIT_VTABLE(u)->can_reload(u);
 
-        if (!hashmap_isempty(u->dependencies[UNIT_PROPAGATES_RELOAD_TO]))
+        if (unit_dependency_count(u, UNIT_PROPAGATES_RELOAD_TO) > 0)
                 return true;
 
         return UNIT_VTABLE(u)->reload;
@@ -2028,13 +2252,11 @@ bool unit_is_unneeded(Unit *u) {
 
         for (j = 0; j < ELEMENTSOF(deps); j++) {
                 Unit *other;
-                Iterator i;
-                void *v;
 
                 /* If a dependent unit has a job queued, is active or transitioning, or is marked for
                  * restart, then don't clean this one up. */
 
-                HASHMAP_FOREACH_KEY(v, other, u->dependencies[deps[j]], i) {
+                UNIT_FOREACH_DEPENDENCY(other, u, deps[j]) {
                         if (other->job)
                                 return false;
 
@@ -2065,10 +2287,8 @@ static void check_unneeded_dependencies(Unit *u) {
 
         for (j = 0; j < ELEMENTSOF(deps); j++) {
                 Unit *other;
-                Iterator i;
-                void *v;
 
-                HASHMAP_FOREACH_KEY(v, other, u->dependencies[deps[j]], i)
+                UNIT_FOREACH_DEPENDENCY(other, u, deps[j])
                         unit_submit_to_stop_when_unneeded_queue(other);
         }
 }
@@ -2077,8 +2297,6 @@ static void unit_check_binds_to(Unit *u) {
         _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
         bool stop = false;
         Unit *other;
-        Iterator i;
-        void *v;
         int r;
 
         assert(u);
@@ -2089,7 +2307,7 @@ static void unit_check_binds_to(Unit *u) {
         if (unit_active_state(u) != UNIT_ACTIVE)
                 return;
 
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_BINDS_TO], i) {
+        UNIT_FOREACH_DEPENDENCY(other, u, UNIT_BINDS_TO) {
                 if (other->job)
                         continue;
 
@@ -2125,65 +2343,59 @@ static void unit_check_binds_to(Unit *u) {
 }
 
 static void retroactively_start_dependencies(Unit *u) {
-        Iterator i;
         Unit *other;
-        void *v;
 
         assert(u);
         assert(UNIT_IS_ACTIVE_OR_ACTIVATING(unit_active_state(u)));
 
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_REQUIRES], i)
-                if (!hashmap_get(u->dependencies[UNIT_AFTER], other) &&
+        UNIT_FOREACH_DEPENDENCY(other, u, UNIT_REQUIRES)
+                if (!unit_has_dependency(u, UNIT_AFTER, other) &&
                     !UNIT_IS_ACTIVE_OR_ACTIVATING(unit_active_state(other)))
                         manager_add_job(u->manager, JOB_START, other, JOB_REPLACE, NULL, NULL, NULL);
 
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_BINDS_TO], i)
-                if (!hashmap_get(u->dependencies[UNIT_AFTER], other) &&
+        UNIT_FOREACH_DEPENDENCY(other, u, UNIT_BINDS_TO)
+                if (!unit_has_dependency(u, UNIT_AFTER, other) &&
                     !UNIT_IS_ACTIVE_OR_ACTIVATING(unit_active_state(other)))
                         manager_add_job(u->manager, JOB_START, other, JOB_REPLACE, NULL, NULL, NULL);
 
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_WANTS], i)
-                if (!hashmap_get(u->dependencies[UNIT_AFTER], other) &&
+        UNIT_FOREACH_DEPENDENCY(other, u, UNIT_WANTS)
+                if (!unit_has_dependency(u, UNIT_AFTER, other) &&
                     !UNIT_IS_ACTIVE_OR_ACTIVATING(unit_active_state(other)))
                         manager_add_job(u->manager, JOB_START, other, JOB_FAIL, NULL, NULL, NULL);
 
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_CONFLICTS], i)
+        UNIT_FOREACH_DEPENDENCY(other, u, UNIT_CONFLICTS)
                 if (!UNIT_IS_INACTIVE_OR_DEACTIVATING(unit_active_state(other)))
                         manager_add_job(u->manager, JOB_STOP, other, JOB_REPLACE, NULL, NULL, NULL);
 
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_CONFLICTED_BY], i)
+        UNIT_FOREACH_DEPENDENCY(other, u, UNIT_CONFLICTED_BY)
                 if (!UNIT_IS_INACTIVE_OR_DEACTIVATING(unit_active_state(other)))
                         manager_add_job(u->manager, JOB_STOP, other, JOB_REPLACE, NULL, NULL, NULL);
 }
 
 static void retroactively_stop_dependencies(Unit *u) {
         Unit *other;
-        Iterator i;
-        void *v;
 
         assert(u);
         assert(UNIT_IS_INACTIVE_OR_DEACTIVATING(unit_active_state(u)));
 
         /* Pull down units which are bound to us recursively if enabled */
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_BOUND_BY], i)
+        UNIT_FOREACH_DEPENDENCY(other, u, UNIT_BOUND_BY)
                 if (!UNIT_IS_INACTIVE_OR_DEACTIVATING(unit_active_state(other)))
                         manager_add_job(u->manager, JOB_STOP, other, JOB_REPLACE, NULL, NULL, NULL);
 }
 
 void unit_start_on_failure(Unit *u) {
         Unit *other;
-        Iterator i;
-        void *v;
         int r;
 
         assert(u);
 
-        if (hashmap_size(u->dependencies[UNIT_ON_FAILURE]) <= 0)
+        if (unit_dependency_count(u, UNIT_ON_FAILURE) == 0)
                 return;
 
         log_unit_info(u, "Triggering OnFailure= dependencies.");
 
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_ON_FAILURE], i) {
+        UNIT_FOREACH_DEPENDENCY(other, u, UNIT_ON_FAILURE) {
                 _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
 
                 r = manager_add_job(u->manager, JOB_START, other, u->on_failure_job_mode, NULL, &error, NULL);
@@ -2194,12 +2406,10 @@ void unit_start_on_failure(Unit *u) {
 
 void unit_trigger_notify(Unit *u) {
         Unit *other;
-        Iterator i;
-        void *v;
 
         assert(u);
 
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_TRIGGERED_BY], i)
+        UNIT_FOREACH_DEPENDENCY(other, u, UNIT_TRIGGERED_BY)
                 if (UNIT_VTABLE(other)->trigger_notify)
                         UNIT_VTABLE(other)->trigger_notify(other, u);
 }
@@ -2220,6 +2430,7 @@ static int unit_log_resources(Unit *u) {
         size_t n_message_parts = 0, n_iovec = 0;
         char* message_parts[1 + 2 + 2 + 1], *t;
         nsec_t nsec = NSEC_INFINITY;
+        uint64_t ip_values[_CGROUP_IP_ACCOUNTING_METRIC_MAX];
         CGroupIPAccountingMetric m;
         size_t i;
         int r;
@@ -2333,13 +2544,14 @@ static int unit_log_resources(Unit *u) {
                 }
         }
 
+        (void) unit_get_ip_accounting_all(u, ip_values);
+
         for (m = 0; m < _CGROUP_IP_ACCOUNTING_METRIC_MAX; m++) {
                 char buf[FORMAT_BYTES_MAX] = "";
-                uint64_t value = UINT64_MAX;
+                uint64_t value = ip_values[m];
 
                 assert(ip_fields[m]);
 
-                (void) unit_get_ip_accounting(u, m, &value);
                 if (value == UINT64_MAX)
                         continue;
 
@@ -2935,53 +3147,6 @@ static void maybe_warn_about_dependency(Unit *u, const char *other, UnitDependen
                 log_unit_warning(u, "Dependency %s=%s dropped, merged into %s", unit_dependency_to_string(dependency), strna(other), u->id);
 }
 
-static int unit_add_dependency_hashmap(
-                Hashmap **h,
-                Unit *other,
-                UnitDependencyMask origin_mask,
-                UnitDependencyMask destination_mask) {
-
-        UnitDependencyInfo info;
-        int r;
-
-        assert(h);
-        assert(other);
-        assert(origin_mask < _UNIT_DEPENDENCY_MASK_FULL);
-        assert(destination_mask < _UNIT_DEPENDENCY_MASK_FULL);
-        assert(origin_mask > 0 || destination_mask > 0);
-
-        r = hashmap_ensure_allocated(h, NULL);
-        if (r < 0)
-                return r;
-
-        assert_cc(sizeof(void*) == sizeof(info));
-
-        info.data = hashmap_get(*h, other);
-        if (info.data) {
-                /* Entry already exists. Add in our mask. */
-
-                if (FLAGS_SET(origin_mask, info.origin_mask) &&
-                    FLAGS_SET(destination_mask, info.destination_mask))
-                        return 0; /* NOP */
-
-                info.origin_mask |= origin_mask;
-                info.destination_mask |= destination_mask;
-
-                r = hashmap_update(*h, other, info.data);
-        } else {
-                info = (UnitDependencyInfo) {
-                        .origin_mask = origin_mask,
-                        .destination_mask = destination_mask,
-                };
-
-                r = hashmap_put(*h, other, info.data);
-        }
-        if (r < 0)
-                return r;
-
-        return 1;
-}
-
 int unit_add_dependency(
                 Unit *u,
                 UnitDependency d,
@@ -3052,22 +3217,24 @@ int unit_add_dependency(
                 return log_unit_error_errno(u, SYNTHETIC_ERRNO(EINVAL),
                                             "Requested dependency TriggeredBy=%s refused (%s units cannot trigger other units).", other->id, unit_type_to_string(other->type));
 
-        r = unit_add_dependency_hashmap(u->dependencies + d, other, mask, 0);
+        assert(mask > 0 && mask < _UNIT_DEPENDENCY_MASK_FULL);
+
+        r = unit_dependency_put(u, d, other, mask, 0);
         if (r < 0)
                 return r;
 
         if (inverse_table[d] != _UNIT_DEPENDENCY_INVALID && inverse_table[d] != d) {
-                r = unit_add_dependency_hashmap(other->dependencies + inverse_table[d], u, 0, mask);
+                r = unit_dependency_put(other, inverse_table[d], u, 0, mask);
                 if (r < 0)
                         return r;
         }
 
         if (add_reference) {
-                r = unit_add_dependency_hashmap(u->dependencies + UNIT_REFERENCES, other, mask, 0);
+                r = unit_dependency_put(u, UNIT_REFERENCES, other, mask, 0);
                 if (r < 0)
                         return r;
 
-                r = unit_add_dependency_hashmap(other->dependencies + UNIT_REFERENCED_BY, u, 0, mask);
+                r = unit_dependency_put(other, UNIT_REFERENCED_BY, u, 0, mask);
                 if (r < 0)
                         return r;
         }
@@ -3166,13 +3333,31 @@ int set_unit_path(const char *p) {
         return 0;
 }
 
-char *unit_dbus_path(Unit *u) {
+const char *unit_dbus_path_cached(Unit *u) {
         assert(u);
 
+        /* Returns the object path of the unit, owned by the unit itself. Units are enumerated on the bus
+         * quite often, hence don't escape the name each time. */
+
         if (!u->id)
                 return NULL;
 
-        return unit_dbus_path_from_name(u->id);
+        if (!u->dbus_path)
+                u->dbus_path = unit_dbus_path_from_name(u->id);
+
+        return u->dbus_path;
+}
+
+char *unit_dbus_path(Unit *u) {
+        const char *p;
+
+        assert(u);
+
+        p = unit_dbus_path_cached(u);
+        if (!p)
+                return NULL;
+
+        return strdup(p);
 }
 
 char *unit_dbus_path_invocation_id(Unit *u) {
@@ -3466,6 +3651,7 @@ static const char *const io_accounting_metric_field_last[_CGROUP_IO_ACCOUNTING_M
 };
 
 int unit_serialize(Unit *u, FILE *f, FDSet *fds, bool serialize_jobs) {
+        uint64_t ip_values[_CGROUP_IP_ACCOUNTING_METRIC_MAX];
         CGroupIPAccountingMetric m;
         int r;
 
@@ -3538,28 +3724,25 @@ int unit_serialize(Unit *u, FILE *f, FDSet *fds, bool serialize_jobs) {
 
         bus_track_serialize(u->bus_track, f, "ref");
 
-        for (m = 0; m < _CGROUP_IP_ACCOUNTING_METRIC_MAX; m++) {
-                uint64_t v;
-
-                r = unit_get_ip_accounting(u, m, &v);
-                if (r >= 0)
-                        (void) serialize_item_format(f, ip_accounting_metric_field[m], "%" PRIu64, v);
-        }
+        (void) unit_get_ip_accounting_all(u, ip_values);
+        for (m = 0; m < _CGROUP_IP_ACCOUNTING_METRIC_MAX; m++)
+                if (ip_values[m] != UINT64_MAX)
+                        (void) serialize_item_format(f, ip_accounting_metric_field[m], "%" PRIu64, ip_values[m]);
 
         if (serialize_jobs) {
                 if (u->job) {
-                        fputs("job\n", f);
+                        (void) serialize_marker(f, "job");
                         job_serialize(u->job, f);
                 }
 
                 if (u->nop_job) {
-                        fputs("job\n", f);
+                        (void) serialize_marker(f, "job");
                         job_serialize(u->nop_job, f);
                 }
         }
 
         /* End marker */
-        fputc('\n', f);
+        (void) serialize_marker(f, "");
         return 0;
 }
 
@@ -3599,7 +3782,7 @@ int unit_deserialize(Unit *u, FILE *f, FDSet *fds) {
                 ssize_t m;
                 size_t k;
 
-                r = read_line(f, LONG_LINE_MAX, &line);
+                r = deserialize_read_line(f, &line);
                 if (r < 0)
                         return log_error_errno(r, "Failed to read serialization line: %m");
                 if (r == 0) /* eof */
@@ -3936,7 +4119,7 @@ int unit_deserialize_skip(FILE *f) {
                 _cleanup_free_ char *line = NULL;
                 char *l;
 
-                r = read_line(f, LONG_LINE_MAX, &line);
+                r = deserialize_read_line(f, &line);
                 if (r < 0)
                         return log_error_errno(r, "Failed to read serialization line: %m");
                 if (r == 0)
@@ -4032,7 +4215,11 @@ int unit_coldplug(Unit *u) {
         u->deserialized_refs = strv_free(u->deserialized_refs);
 
         if (UNIT_VTABLE(u)->coldplug) {
+                usec_t trace;
+
+                trace = manager_trace_begin(&u->manager->trace);
                 q = UNIT_VTABLE(u)->coldplug(u);
+                manager_trace_end(&u->manager->trace, "coldplug", u->id, trace);
                 if (q < 0 && r >= 0)
                         r = q;
         }
@@ -4050,8 +4237,13 @@ int unit_coldplug(Unit *u) {
 void unit_catchup(Unit *u) {
         assert(u);
 
-        if (UNIT_VTABLE(u)->catchup)
+        if (UNIT_VTABLE(u)->catchup) {
+                usec_t trace;
+
+                trace = manager_trace_begin(&u->manager->trace);
                 UNIT_VTABLE(u)->catchup(u);
+                manager_trace_end(&u->manager->trace, "catchup", u->id, trace);
+        }
 }
 
 static bool fragment_mtime_newer(const char *path, usec_t mtime, bool path_masked) {
@@ -5042,8 +5234,6 @@ int unit_setup_exec_runtime(Unit *u) {
         ExecRuntime **rt;
         size_t offset;
         Unit *other;
-        Iterator i;
-        void *v;
         int r;
 
         offset = UNIT_VTABLE(u)->exec_runtime_offset;
@@ -5055,7 +5245,7 @@ int unit_setup_exec_runtime(Unit *u) {
                 return 0;
 
         /* Try to get it from somebody else */
-        HASHMAP_FOREACH_KEY(v, other, u->dependencies[UNIT_JOINS_NAMESPACE_OF], i) {
+        UNIT_FOREACH_DEPENDENCY(other, u, UNIT_JOINS_NAMESPACE_OF) {
                 r = exec_runtime_acquire(u->manager, NULL, other->id, false, rt);
                 if (r == 1)
                         return 1;
@@ -5465,6 +5655,8 @@ int unit_fork_and_watch_rm_rf(Unit *u, char **paths, pid_t *ret_pid) {
 }
 
 static void unit_update_dependency_mask(Unit *u, UnitDependency d, Unit *other, UnitDependencyInfo di) {
+        UnitDependencyEntry *e;
+
         assert(u);
         assert(d >= 0);
         assert(d < _UNIT_DEPENDENCY_MAX);
@@ -5472,11 +5664,13 @@ static void unit_update_dependency_mask(Unit *u, UnitDependency d, Unit *other,
 
         if (di.origin_mask == 0 && di.destination_mask == 0) {
                 /* No bit set anymore, let's drop the whole entry */
-                assert_se(hashmap_remove(u->dependencies[d], other));
+                assert_se(unit_dependency_remove(u, d, other));
                 log_unit_debug(u, "lost dependency %s=%s", unit_dependency_to_string(d), other->id);
-        } else
+        } else {
                 /* Mask was reduced, let's update the entry */
-                assert_se(hashmap_update(u->dependencies[d], other, di.data) == 0);
+                assert_se(e = unit_dependency_find(u, d, other));
+                e->info = di;
+        }
 }
 
 void unit_remove_dependencies(Unit *u, UnitDependencyMask mask) {
@@ -5493,13 +5687,13 @@ void unit_remove_dependencies(Unit *u, UnitDependencyMask mask) {
                 bool done;
 
                 do {
-                        UnitDependencyInfo di;
-                        Unit *other;
-                        Iterator i;
+                        UnitDependencyEntry *e;
 
                         done = true;
 
-                        HASHMAP_FOREACH_KEY(di.data, other, u->dependencies[d], i) {
+                        UNIT_FOREACH_DEPENDENCY_ENTRY(e, u, d) {
+                                UnitDependencyInfo di = e->info;
+                                Unit *other = e->other;
                                 UnitDependency q;
 
                                 if ((di.origin_mask & ~mask) == di.origin_mask)
@@ -5513,9 +5707,14 @@ void unit_remove_dependencies(Unit *u, UnitDependencyMask mask) {
                                  * have the right mask set. */
 
                                 for (q = 0; q < _UNIT_DEPENDENCY_MAX; q++) {
+                                        UnitDependencyEntry *f;
                                         UnitDependencyInfo dj;
 
-                                        dj.data = hashmap_get(other->dependencies[q], u);
+                                        f = unit_dependency_find(other, q, u);
+                                        if (!f)
+                                                continue;
+
+                                        dj = f->info;
                                         if ((dj.destination_mask & ~mask) == dj.destination_mask)
                                                 continue;
                                         dj.destination_mask &= ~mask;
@@ -15,6 +15,7 @@
 #include "cgroup.h"
 
 typedef struct UnitRef UnitRef;
+typedef struct BPFFirewallAccess BPFFirewallAccess;
 
 typedef enum KillOperation {
         KILL_TERMINATE,
@@ -85,9 +86,9 @@ typedef enum UnitDependencyMask {
         _UNIT_DEPENDENCY_MASK_FULL         = (1 << 8) - 1,
 } UnitDependencyMask;
 
-/* The Unit's dependencies[] hashmaps use this structure as value. It has the same size as a void pointer, and thus can
- * be stored directly as hashmap value, without any indirection. Note that this stores two masks, as both the origin
- * and the destination of a dependency might have created it. */
+/* The Unit's dependencies[] arrays and the requires_mounts_for hashmap use this structure as value. It has the same
+ * size as a void pointer, and thus can be stored directly as hashmap value, without any indirection. Note that this
+ * stores two masks, as both the origin and the destination of a dependency might have created it. */
 typedef union UnitDependencyInfo {
         void *data;
         struct {
@@ -96,6 +97,19 @@ typedef union UnitDependencyInfo {
         } _packed_;
 } UnitDependencyInfo;
 
+typedef struct UnitDependencyEntry {
+        Unit *other;
+        UnitDependencyInfo info;
+} UnitDependencyEntry;
+
+/* All dependencies of one type, stored inline and sorted by the address of the other unit, so that lookups can be
+ * done with a binary search and iteration doesn't need to chase any pointers. Allocated on first use, freed again
+ * when the last entry is removed. */
+typedef struct UnitDependencyArray {
+        size_t n_entries, n_allocated;
+        UnitDependencyEntry entries[];
+} UnitDependencyArray;
+
 #include "job.h"
 
 struct UnitRef {
@@ -119,12 +133,13 @@ typedef struct Unit {
 
         char *id; /* One name is special because we use it for identification. Points to an entry in the names set */
         char *instance;
+        char *dbus_path; /* The object path for id, escaped on first use */
 
         Set *names;
 
-        /* For each dependency type we maintain a Hashmap whose key is the Unit* object, and the value encodes why the
-         * dependency exists, using the UnitDependencyInfo type */
-        Hashmap *dependencies[_UNIT_DEPENDENCY_MAX];
+        /* For each dependency type we maintain an array of the other Unit* objects, together with a
+         * UnitDependencyInfo that encodes why the dependency exists */
+        UnitDependencyArray *dependencies[_UNIT_DEPENDENCY_MAX];
 
         /* Similar, for RequiresMountsFor= path dependencies. The key is the path, the value the UnitDependencyInfo type */
         Hashmap *requires_mounts_for;
@@ -209,6 +224,9 @@ typedef struct Unit {
         /* cgroup OOM queue */
         LIST_FIELDS(Unit, cgroup_oom_queue);
 
+        /* cgroup.events queue */
+        LIST_FIELDS(Unit, cgroup_events_queue);
+
         /* Target dependencies queue */
         LIST_FIELDS(Unit, target_deps_queue);
 
@@ -269,6 +287,13 @@ typedef struct Unit {
         CGroupMask cgroup_invalidated_mask;        /* A mask specifying controllers which shall be considered invalidated, and require re-realization */
         CGroupMask cgroup_members_mask;            /* A cache for the controllers required by all children of this cgroup (only relevant for slice units) */
 
+        /* The values we last wrote to the attributes of this unit's cgroup, so that writes not changing anything can be
+         * skipped. Per-device attributes are keyed by attribute name and device. */
+        Hashmap *cgroup_attributes;
+
+        /* Fds of the accounting attributes of this unit's cgroup, opened on first use and re-read with pread() */
+        int cgroup_accounting_fds[_CGROUP_ACCOUNTING_FILE_MAX];
+
         /* Inotify watch descriptors for watching cgroup.events and memory.events on cgroupv2 */
         int cgroup_control_inotify_wd;
         int cgroup_memory_inotify_wd;
@@ -280,10 +305,8 @@ typedef struct Unit {
         int ip_accounting_ingress_map_fd;
         int ip_accounting_egress_map_fd;
 
-        int ipv4_allow_map_fd;
-        int ipv6_allow_map_fd;
-        int ipv4_deny_map_fd;
-        int ipv6_deny_map_fd;
+        /* IP access maps, shared among all units with the same effective access lists */
+        BPFFirewallAccess *ip_bpf_access;
 
         BPFProgram *ip_bpf_ingress, *ip_bpf_ingress_installed;
         BPFProgram *ip_bpf_egress, *ip_bpf_egress_installed;
@@ -336,14 +359,20 @@ typedef struct Unit {
         /* Is this a unit that is always running and cannot be stopped? */
         bool perpetual;
 
+        /* Our entry in the manager's unit state snapshot, valid if in_unit_snapshot is set */
+        size_t unit_snapshot_index;
+
         /* Booleans indicating membership of this unit in the various queues */
         bool in_load_queue:1;
+        bool load_prefetched:1;  /* config files read ahead while in the load queue, see unit_load_queue_prefetch() */
         bool in_dbus_queue:1;
+        bool in_unit_snapshot:1;
         bool in_cleanup_queue:1;
         bool in_gc_queue:1;
         bool in_cgroup_realize_queue:1;
         bool in_cgroup_empty_queue:1;
         bool in_cgroup_oom_queue:1;
+        bool in_cgroup_events_queue:1;
         bool in_target_deps_queue:1;
         bool in_stop_when_unneeded_queue:1;
 
@@ -655,8 +684,41 @@ static inline const UnitVTable* UNIT_VTABLE(Unit *u) {
 #define UNIT_HAS_CGROUP_CONTEXT(u) (UNIT_VTABLE(u)->cgroup_context_offset > 0)
 #define UNIT_HAS_KILL_CONTEXT(u) (UNIT_VTABLE(u)->kill_context_offset > 0)
 
+static inline size_t unit_dependency_count(const Unit *u, UnitDependency d) {
+        return u->dependencies[d] ? u->dependencies[d]->n_entries : 0;
+}
+
+static inline Unit* unit_dependency_first(const Unit *u, UnitDependency d) {
+        return u->dependencies[d] ? u->dependencies[d]->entries[0].other : NULL;
+}
+
+UnitDependencyEntry* unit_dependency_find(const Unit *u, UnitDependency d, const Unit *other);
+
+static inline bool unit_has_dependency(const Unit *u, UnitDependency d, const Unit *other) {
+        return unit_dependency_find(u, d, other);
+}
+
+/* Iteration is index based and re-reads the array on each step, hence it stays valid if the array is reallocated or
+ * freed while iterating. Dependencies of the iterated type must not be added or removed from within the loop body
+ * though. */
+#define _UNIT_FOREACH_DEPENDENCY_ENTRY(e, u, d, i)                       \
+        for (size_t i = 0;                                              \
+             (u)->dependencies[d] && i < (u)->dependencies[d]->n_entries && \
+                     ((e) = (u)->dependencies[d]->entries + i, true);   \
+             i++)
+#define UNIT_FOREACH_DEPENDENCY_ENTRY(e, u, d)                           \
+        _UNIT_FOREACH_DEPENDENCY_ENTRY(e, u, d, UNIQ_T(i, UNIQ))
+
+#define _UNIT_FOREACH_DEPENDENCY(o, u, d, i)                             \
+        for (size_t i = 0;                                              \
+             (u)->dependencies[d] && i < (u)->dependencies[d]->n_entries && \
+                     ((o) = (u)->dependencies[d]->entries[i].other, true); \
+             i++)
+#define UNIT_FOREACH_DEPENDENCY(o, u, d)                                 \
+        _UNIT_FOREACH_DEPENDENCY(o, u, d, UNIQ_T(i, UNIQ))
+
 static inline Unit* UNIT_TRIGGER(Unit *u) {
-        return hashmap_first_key(u->dependencies[UNIT_TRIGGERS]);
+        return unit_dependency_first(u, UNIT_TRIGGERS);
 }
 
 Unit *unit_new(Manager *m, size_t size);
@@ -708,6 +770,8 @@ int unit_freezer_state_kernel(Unit *u, FreezerState *ret);
 
 const char* unit_sub_state_to_string(Unit *u);
 
+void unit_update_snapshot(Unit *u);
+
 void unit_dump(Unit *u, FILE *f, const char *prefix);
 
 bool unit_can_reload(Unit *u) _pure_;
@@ -745,6 +809,7 @@ bool unit_job_is_applicable(Unit *u, JobType j);
 
 int set_unit_path(const char *p);
 
+const char *unit_dbus_path_cached(Unit *u);
 char *unit_dbus_path(Unit *u);
 char *unit_dbus_path_invocation_id(Unit *u);
 
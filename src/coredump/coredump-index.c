@@ -0,0 +1,327 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "coredump-index.h"
+#include "escape.h"
+#include "fd-util.h"
+#include "fileio.h"
+#include "io-util.h"
+#include "log.h"
+#include "mkdir.h"
+#include "parse-util.h"
+#include "sort-util.h"
+#include "stdio-util.h"
+#include "string-table.h"
+#include "string-util.h"
+
+/* The index is a text file with one line per coredump, appended to by systemd-coredump right after it
+ * successfully logged the coredump to the journal. The first line carries the CLOCK_REALTIME timestamp
+ * since when the index is maintained, every further line the time of the coredump, a set of flags, and
+ * the C-escaped values of the fields in CoredumpIndexField, all separated by tabs. Missing values are
+ * written as "-".
+ *
+ * Readers take coredumps logged before the timestamp in the header from the journal, hence the index may be
+ * started anew at any time. Writers serialize on a BSD lock on the file. If a coredump cannot be added, the
+ * file is truncated, which makes readers ignore it until the next writer starts a new index, so that the
+ * coredump is found in the journal. Once the index is full, it is started anew right away. Readers don't
+ * take the lock, and simply ignore an incomplete last line. */
+
+#define COREDUMP_INDEX_HEADER "COREDUMP-INDEX "
+
+static const char* const coredump_index_field_table[_COREDUMP_INDEX_FIELD_MAX] = {
+        [COREDUMP_INDEX_PID]      = "COREDUMP_PID",
+        [COREDUMP_INDEX_UID]      = "COREDUMP_UID",
+        [COREDUMP_INDEX_GID]      = "COREDUMP_GID",
+        [COREDUMP_INDEX_SIGNAL]   = "COREDUMP_SIGNAL",
+        [COREDUMP_INDEX_EXE]      = "COREDUMP_EXE",
+        [COREDUMP_INDEX_COMM]     = "COREDUMP_COMM",
+        [COREDUMP_INDEX_FILENAME] = "COREDUMP_FILENAME",
+};
+
+DEFINE_STRING_TABLE_LOOKUP(coredump_index_field, CoredumpIndexField);
+
+static int coredump_index_start(int fd) {
+        char header[STRLEN(COREDUMP_INDEX_HEADER) + DECIMAL_STR_MAX(usec_t) + 1];
+        int r;
+
+        assert(fd >= 0);
+
+        /* The index is valid from now on: anything logged before is not covered by it */
+        xsprintf(header, COREDUMP_INDEX_HEADER USEC_FMT "\n", now(CLOCK_REALTIME));
+
+        r = loop_write(fd, header, strlen(header), false);
+        if (r < 0) {
+                (void) ftruncate(fd, 0);
+                return r;
+        }
+
+        return 0;
+}
+
+int coredump_index_open(const char *path) {
+        _cleanup_close_ int fd = -1;
+        struct stat st;
+        int r;
+
+        assert(path);
+
+        /* Opens the index for appending, and starts a new one if there is none. This needs to be called
+         * before dropping privileges, the returned fd may be used for coredump_index_append() afterwards.
+         * If this fails, the index is invalidated if possible, as the coredump won't make it into it. */
+
+        (void) mkdir_parents_label(path, 0755);
+
+        fd = open(path, O_RDWR|O_CREAT|O_APPEND|O_CLOEXEC|O_NOCTTY|O_NOFOLLOW, 0600);
+        if (fd < 0) {
+                r = -errno;
+                (void) truncate(path, 0);
+                return log_debug_errno(r, "Failed to open coredump index, ignoring: %m");
+        }
+
+        if (flock(fd, LOCK_EX) < 0) {
+                r = log_debug_errno(errno, "Failed to lock coredump index, ignoring: %m");
+                goto invalidate;
+        }
+
+        if (fstat(fd, &st) < 0) {
+                r = log_debug_errno(errno, "Failed to stat coredump index, ignoring: %m");
+                goto invalidate;
+        }
+
+        if (st.st_size == 0) {
+                r = coredump_index_start(fd);
+                if (r < 0) {
+                        log_debug_errno(r, "Failed to initialize coredump index, ignoring: %m");
+                        goto invalidate;
+                }
+        }
+
+        (void) flock(fd, LOCK_UN);
+
+        return TAKE_FD(fd);
+
+invalidate:
+        (void) ftruncate(fd, 0);
+        return r;
+}
+
+int coredump_index_append(int fd, const char *const fields[static _COREDUMP_INDEX_FIELD_MAX], bool in_journal, bool truncated) {
+        char prefix[DECIMAL_STR_MAX(usec_t) + 4];
+        _cleanup_free_ char *line = NULL;
+        CoredumpIndexField f;
+        struct stat st;
+        size_t l;
+        int r;
+
+        assert(fd >= 0);
+        assert(fields);
+
+        xsprintf(prefix, USEC_FMT "\t%s%s%s",
+                 now(CLOCK_REALTIME),
+                 in_journal ? "j" : "",
+                 truncated ? "t" : "",
+                 in_journal || truncated ? "" : "-");
+
+        line = strdup(prefix);
+        if (!line)
+                return log_oom();
+
+        for (f = 0; f < _COREDUMP_INDEX_FIELD_MAX; f++) {
+                _cleanup_free_ char *e = NULL;
+
+                if (fields[f]) {
+                        e = cescape(fields[f]);
+                        if (!e)
+                                return log_oom();
+                }
+
+                if (!strextend(&line, "\t", e ?: "-", NULL))
+                        return log_oom();
+        }
+
+        if (!strextend(&line, "\n", NULL))
+                return log_oom();
+
+        l = strlen(line);
+
+        if (flock(fd, LOCK_EX) < 0) {
+                r = log_warning_errno(errno, "Failed to lock coredump index, invalidating it: %m");
+                goto invalidate;
+        }
+
+        if (fstat(fd, &st) < 0) {
+                r = log_warning_errno(errno, "Failed to stat coredump index: %m");
+                goto invalidate;
+        }
+
+        /* Somebody else gave up on the index since we opened it. The next coredump will start a new one. */
+        if (st.st_size == 0) {
+                r = 0;
+                goto finish;
+        }
+
+        if ((uint64_t) st.st_size + l > COREDUMP_INDEX_SIZE_MAX) {
+                log_debug("Coredump index is full, starting a new one.");
+
+                /* Our coredump was logged before the new index starts, readers find it in the journal */
+                if (ftruncate(fd, 0) < 0) {
+                        r = log_warning_errno(errno, "Failed to truncate coredump index: %m");
+                        goto finish;
+                }
+
+                r = coredump_index_start(fd);
+                if (r < 0)
+                        log_warning_errno(r, "Failed to start new coredump index: %m");
+
+                goto finish;
+        }
+
+        r = loop_write(fd, line, l, false);
+        if (r < 0) {
+                log_warning_errno(r, "Failed to append to coredump index, invalidating it: %m");
+                goto invalidate;
+        }
+
+        goto finish;
+
+invalidate:
+        if (ftruncate(fd, 0) < 0)
+                log_warning_errno(errno, "Failed to truncate coredump index: %m");
+
+finish:
+        (void) flock(fd, LOCK_UN);
+        return r;
+}
+
+void coredump_index_entry_done(CoredumpIndexEntry *e) {
+        CoredumpIndexField f;
+
+        assert(e);
+
+        for (f = 0; f < _COREDUMP_INDEX_FIELD_MAX; f++)
+                e->fields[f] = mfree(e->fields[f]);
+}
+
+void coredump_index_entry_free_many(CoredumpIndexEntry *entries, size_t n) {
+        size_t i;
+
+        assert(entries || n == 0);
+
+        for (i = 0; i < n; i++)
+                coredump_index_entry_done(entries + i);
+
+        free(entries);
+}
+
+int coredump_index_parse_line(const char *p, size_t l, CoredumpIndexEntry *ret) {
+        _cleanup_(coredump_index_entry_done) CoredumpIndexEntry e = {};
+        const char *end = p + l;
+        unsigned i;
+        int r;
+
+        assert(p);
+        assert(ret);
+
+        for (i = 0; i < 2 + _COREDUMP_INDEX_FIELD_MAX; i++) {
+                bool last = i == 2 + _COREDUMP_INDEX_FIELD_MAX - 1;
+                const char *t;
+
+                t = memchr(p, '\t', end - p) ?: end;
+                if (last != (t == end))
+                        return -EBADMSG;
+
+                if (i == 0) {
+                        r = safe_atou64(strndupa(p, t - p), &e.timestamp);
+                        if (r < 0)
+                                return r;
+
+                } else if (i == 1) {
+                        const char *c;
+
+                        for (c = p; c < t; c++)
+                                if (*c == 'j')
+                                        e.in_journal = true;
+                                else if (*c == 't')
+                                        e.truncated = true;
+
+                } else if (t - p != 1 || *p != '-') {
+                        r = cunescape_length(p, t - p, 0, e.fields + i - 2);
+                        if (r < 0)
+                                return r;
+                }
+
+                p = t + 1;
+        }
+
+        *ret = e;
+        e = (CoredumpIndexEntry) {};
+
+        return 0;
+}
+
+static int coredump_index_entry_compare(const CoredumpIndexEntry *a, const CoredumpIndexEntry *b) {
+        return CMP(a->timestamp, b->timestamp);
+}
+
+int coredump_index_load(const char *path, usec_t *ret_since, CoredumpIndexEntry **ret, size_t *ret_n) {
+        CoredumpIndexEntry *entries = NULL;
+        size_t n = 0, n_allocated = 0, size;
+        _cleanup_free_ char *buf = NULL;
+        const char *p, *e;
+        usec_t since;
+        int r;
+
+        assert(path);
+        assert(ret_since);
+        assert(ret);
+        assert(ret_n);
+
+        r = read_full_file(path, &buf, &size);
+        if (r < 0)
+                return r;
+
+        /* An empty or otherwise incomplete file means the index has been invalidated */
+        p = startswith(buf, COREDUMP_INDEX_HEADER);
+        if (!p)
+                return -EBADMSG;
+
+        e = strchr(p, '\n');
+        if (!e)
+                return -EBADMSG;
+
+        r = safe_atou64(strndupa(p, e - p), &since);
+        if (r < 0)
+                return r;
+
+        for (p = e + 1; (e = strchr(p, '\n')); p = e + 1) {
+                CoredumpIndexEntry entry;
+
+                r = coredump_index_parse_line(p, e - p, &entry);
+                if (r < 0) {
+                        log_debug_errno(r, "Failed to parse coredump index line, ignoring: %m");
+                        continue;
+                }
+
+                if (!GREEDY_REALLOC(entries, n_allocated, n + 1)) {
+                        coredump_index_entry_done(&entry);
+                        coredump_index_entry_free_many(entries, n);
+                        return -ENOMEM;
+                }
+
+                entries[n++] = entry;
+        }
+
+        /* Concurrent writers might have appended slightly out of order */
+        typesafe_qsort(entries, n, coredump_index_entry_compare);
+
+        *ret_since = since;
+        *ret = entries;
+        *ret_n = n;
+
+        return 0;
+}
@@ -0,0 +1,45 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+#include <stdbool.h>
+
+#include "macro.h"
+#include "time-util.h"
+
+/* A compact record of the coredumps systemd-coredump logged to the journal, which allows "coredumpctl list"
+ * to skip searching the journal. See coredump-index.c for details. */
+
+#define COREDUMP_INDEX_PATH "/var/lib/systemd/coredump/.index"
+
+/* Once the index grows beyond this, it is started anew */
+#define COREDUMP_INDEX_SIZE_MAX (4U*1024U*1024U)
+
+typedef enum CoredumpIndexField {
+        COREDUMP_INDEX_PID,
+        COREDUMP_INDEX_UID,
+        COREDUMP_INDEX_GID,
+        COREDUMP_INDEX_SIGNAL,
+        COREDUMP_INDEX_EXE,
+        COREDUMP_INDEX_COMM,
+        COREDUMP_INDEX_FILENAME,
+        _COREDUMP_INDEX_FIELD_MAX,
+        _COREDUMP_INDEX_FIELD_INVALID = -1,
+} CoredumpIndexField;
+
+typedef struct CoredumpIndexEntry {
+        usec_t timestamp;
+        char *fields[_COREDUMP_INDEX_FIELD_MAX]; /* values of the COREDUMP_* journal fields, if known */
+        bool in_journal:1;                       /* the core itself is stored in the journal entry */
+        bool truncated:1;
+} CoredumpIndexEntry;
+
+int coredump_index_open(const char *path);
+int coredump_index_append(int fd, const char *const fields[static _COREDUMP_INDEX_FIELD_MAX], bool in_journal, bool truncated);
+
+int coredump_index_parse_line(const char *p, size_t l, CoredumpIndexEntry *ret);
+int coredump_index_load(const char *path, usec_t *ret_since, CoredumpIndexEntry **ret, size_t *ret_n);
+void coredump_index_entry_done(CoredumpIndexEntry *e);
+void coredump_index_entry_free_many(CoredumpIndexEntry *entries, size_t n);
+
+const char* coredump_index_field_to_string(CoredumpIndexField f) _const_;
+CoredumpIndexField coredump_index_field_from_string(const char *s) _pure_;
@@ -1,6 +1,7 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
 #include <errno.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <sys/prctl.h>
 #include <sys/xattr.h>
@@ -23,11 +24,13 @@
 #include "compress.h"
 #include "conf-parser.h"
 #include "copy.h"
+#include "coredump-index.h"
 #include "coredump-vacuum.h"
 #include "dirent-util.h"
 #include "escape.h"
 #include "fd-util.h"
 #include "fileio.h"
+#include "format-util.h"
 #include "fs-util.h"
 #include "io-util.h"
 #include "journal-importer.h"
@@ -66,6 +69,9 @@
  * size. See DATA_SIZE_MAX in journal-importer.h. */
 assert_cc(JOURNAL_SIZE_MAX <= DATA_SIZE_MAX);
 
+/* How much of the core we read at once while copying it to disk */
+#define COPY_CHUNK_SIZE ((size_t) (1024U*1024U))
+
 enum {
         /* We use these as array indexes for our process metadata cache.
          *
@@ -339,6 +345,200 @@ static int make_filename(const Context *context, char **ret) {
         return 0;
 }
 
+typedef struct CompressJob {
+        pthread_t thread;
+        int input_fd;
+        int output_fd;
+        int result;
+} CompressJob;
+
+static void *compress_thread(void *userdata) {
+        CompressJob *j = userdata;
+
+        (void) pthread_setname_np(pthread_self(), "compress");
+
+        j->result = compress_stream(j->input_fd, j->output_fd, UINT64_MAX);
+
+        /* If we failed early, let the other side know it can stop feeding us */
+        j->input_fd = safe_close(j->input_fd);
+
+        return NULL;
+}
+
+static int compress_job_start(CompressJob *j, int output_fd, int *ret_fd) {
+        _cleanup_close_pair_ int pair[2] = { -1, -1 };
+        sigset_t ss, saved_ss;
+        int r, k;
+
+        assert(j);
+        assert(output_fd >= 0);
+        assert(ret_fd);
+
+        /* A socket rather than a pipe, so that we can use MSG_NOSIGNAL and don't get SIGPIPE when the
+         * compressor went away */
+        if (socketpair(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0, pair) < 0)
+                return -errno;
+
+        *j = (CompressJob) {
+                .input_fd = pair[0],
+                .output_fd = output_fd,
+        };
+
+        assert_se(sigfillset(&ss) >= 0);
+
+        r = pthread_sigmask(SIG_BLOCK, &ss, &saved_ss);
+        if (r > 0)
+                return -r;
+
+        r = pthread_create(&j->thread, NULL, compress_thread, j);
+
+        k = pthread_sigmask(SIG_SETMASK, &saved_ss, NULL);
+        if (r > 0)
+                return -r;
+
+        /* Owned by the thread now */
+        pair[0] = -1;
+
+        *ret_fd = TAKE_FD(pair[1]);
+        return k > 0 ? -k : 0;
+}
+
+static int send_all(int fd, const uint8_t *p, size_t n) {
+        while (n > 0) {
+                ssize_t k;
+
+                k = send(fd, p, n, MSG_NOSIGNAL);
+                if (k < 0) {
+                        if (errno == EINTR)
+                                continue;
+
+                        return -errno;
+                }
+
+                p += k;
+                n -= k;
+        }
+
+        return 0;
+}
+
+/* Writes the buffer to the file, seeking over pages that are all zeroes instead of writing them, so that
+ * they become holes. Runs of pages of the same kind are written or skipped at once. */
+static int write_skipping_zero_pages(int fd, const uint8_t *p, size_t n, uint64_t *zeroes) {
+        size_t ps = page_size(), i = 0;
+
+        assert(fd >= 0);
+        assert(p || n == 0);
+        assert(zeroes);
+
+        while (i < n) {
+                size_t j = i;
+                bool zero;
+
+                zero = memeqzero(p + i, MIN(ps, n - i));
+                do
+                        j += MIN(ps, n - j);
+                while (j < n && memeqzero(p + j, MIN(ps, n - j)) == zero);
+
+                if (zero) {
+                        if (lseek(fd, j - i, SEEK_CUR) == (off_t) -1)
+                                return -errno;
+
+                        *zeroes += j - i;
+                } else {
+                        int r;
+
+                        r = loop_write(fd, p + i, j - i, false);
+                        if (r < 0)
+                                return r;
+                }
+
+                i = j;
+        }
+
+        return 0;
+}
+
+/* Copies the core from the kernel to the file, and, if fd_compressed is valid, also compresses it on the way.
+ * The compression runs in a thread of its own, so that we read the core only once, and the two can go on
+ * at the same time. Zero pages leave holes in the uncompressed file. Returns 1 if the core was truncated.
+ * The compression result is returned separately, since we can do without it. */
+static int copy_core(int input_fd, int fd, int fd_compressed, uint64_t max_size, int *ret_compress_result) {
+        _cleanup_close_ int compress_fd = -1;
+        _cleanup_free_ uint8_t *buf = NULL;
+        CompressJob job = { .result = -ENODATA };
+        bool job_started = false;
+        uint64_t total = 0, zeroes = 0;
+        char a[FORMAT_BYTES_MAX], b[FORMAT_BYTES_MAX];
+        int r;
+
+        assert(input_fd >= 0);
+        assert(fd >= 0);
+        assert(ret_compress_result);
+
+        buf = malloc(COPY_CHUNK_SIZE);
+        if (!buf)
+                return -ENOMEM;
+
+        if (fd_compressed >= 0) {
+                r = compress_job_start(&job, fd_compressed, &compress_fd);
+                if (r < 0)
+                        log_warning_errno(r, "Failed to start compression thread, not compressing: %m");
+                else
+                        job_started = true;
+        }
+
+        while (total < max_size) {
+                ssize_t n;
+
+                /* Fill the whole chunk, so that the pages in the buffer line up with the pages in the file */
+                n = loop_read(input_fd, buf, MIN(COPY_CHUNK_SIZE, max_size - total), true);
+                if (n < 0) {
+                        r = n;
+                        goto finish;
+                }
+                if (n == 0)
+                        break;
+
+                if (compress_fd >= 0) {
+                        r = send_all(compress_fd, buf, n);
+                        if (r < 0) {
+                                /* The compressor gave up, it will tell us why */
+                                log_debug_errno(r, "Failed to pass core to compression thread, continuing without: %m");
+                                compress_fd = safe_close(compress_fd);
+                        }
+                }
+
+                r = write_skipping_zero_pages(fd, buf, n, &zeroes);
+                if (r < 0)
+                        goto finish;
+
+                total += n;
+        }
+
+        log_debug("Core is %s, %s of which are zero pages and were not written.",
+                  format_bytes(a, sizeof(a), total), format_bytes(b, sizeof(b), zeroes));
+
+        /* The holes at the end don't count without this */
+        if (ftruncate(fd, total) < 0) {
+                r = -errno;
+                goto finish;
+        }
+
+        r = total >= max_size;
+
+finish:
+        if (job_started) {
+                /* EOF for the compressor */
+                compress_fd = safe_close(compress_fd);
+                assert_se(pthread_join(job.thread, NULL) == 0);
+                safe_close(job.input_fd);
+        }
+
+        *ret_compress_result = job.result;
+        return r;
+}
+
 static int save_external_coredump(
                 const Context *context,
                 int input_fd,
@@ -350,10 +550,14 @@ static int save_external_coredump(
 
         _cleanup_free_ char *fn = NULL, *tmp = NULL;
         _cleanup_close_ int fd = -1;
+#if HAVE_COMPRESSION
+        _cleanup_free_ char *fn_compressed = NULL, *tmp_compressed = NULL;
+        _cleanup_close_ int fd_compressed = -1;
+#endif
         uint64_t rlimit, process_limit, max_size;
+        int r, compress_result = -ENODATA;
         struct stat st;
         uid_t uid;
-        int r;
 
         assert(context);
         assert(ret_filename);
@@ -397,7 +601,24 @@ static int save_external_coredump(
         if (fd < 0)
                 return log_error_errno(fd, "Failed to create temporary file for coredump %s: %m", fn);
 
-        r = copy_bytes(input_fd, fd, max_size, 0);
+#if HAVE_COMPRESSION
+        /* If we will remove the coredump anyway, do not compress. We don't know the size yet, but we
+         * can tell if we are not going to keep it at all. */
+        if (arg_compress && !maybe_remove_external_coredump(NULL, 0)) {
+                fn_compressed = strjoin(fn, COMPRESSED_EXT);
+                if (!fn_compressed)
+                        log_oom();
+                else {
+                        fd_compressed = open_tmpfile_linkable(fn_compressed, O_RDWR|O_CLOEXEC, &tmp_compressed);
+                        if (fd_compressed < 0)
+                                log_error_errno(fd_compressed, "Failed to create temporary file for coredump %s: %m", fn_compressed);
+                }
+        }
+
+        r = copy_core(input_fd, fd, fd_compressed, max_size, &compress_result);
+#else
+        r = copy_core(input_fd, fd, -1, max_size, &compress_result);
+#endif
         if (r < 0) {
                 log_error_errno(r, "Cannot store coredump of %s (%s): %m",
                                 context->meta[META_ARGV_PID], context->meta[META_COMM]);
@@ -411,37 +632,23 @@ static int save_external_coredump(
                            "MESSAGE_ID=" SD_MESSAGE_TRUNCATED_CORE_STR);
 
         if (fstat(fd, &st) < 0) {
-                log_error_errno(errno, "Failed to fstat core file %s: %m", coredump_tmpfile_name(tmp));
+                r = log_error_errno(errno, "Failed to fstat core file %s: %m", coredump_tmpfile_name(tmp));
                 goto fail;
         }
 
         if (lseek(fd, 0, SEEK_SET) == (off_t) -1) {
-                log_error_errno(errno, "Failed to seek on %s: %m", coredump_tmpfile_name(tmp));
+                r = log_error_errno(errno, "Failed to seek on %s: %m", coredump_tmpfile_name(tmp));
                 goto fail;
         }
 
-#if HAVE_XZ || HAVE_LZ4
-        /* If we will remove the coredump anyway, do not compress. */
-        if (arg_compress && !maybe_remove_external_coredump(NULL, st.st_size)) {
-
-                _cleanup_free_ char *fn_compressed = NULL, *tmp_compressed = NULL;
-                _cleanup_close_ int fd_compressed = -1;
-
-                fn_compressed = strjoin(fn, COMPRESSED_EXT);
-                if (!fn_compressed) {
-                        log_oom();
-                        goto uncompressed;
-                }
-
-                fd_compressed = open_tmpfile_linkable(fn_compressed, O_RDWR|O_CLOEXEC, &tmp_compressed);
-                if (fd_compressed < 0) {
-                        log_error_errno(fd_compressed, "Failed to create temporary file for coredump %s: %m", fn_compressed);
-                        goto uncompressed;
-                }
+#if HAVE_COMPRESSION
+        if (fd_compressed >= 0) {
+                /* Too large to keep after all? Then the compressed version is of no use either */
+                if (maybe_remove_external_coredump(NULL, st.st_size))
+                        goto fail_compressed;
 
-                r = compress_stream(fd, fd_compressed, -1);
-                if (r < 0) {
-                        log_error_errno(r, "Failed to compress %s: %m", coredump_tmpfile_name(tmp_compressed));
+                if (compress_result < 0) {
+                        log_error_errno(compress_result, "Failed to compress %s: %m", coredump_tmpfile_name(tmp_compressed));
                         goto fail_compressed;
                 }
 
@@ -464,8 +671,6 @@ static int save_external_coredump(
                 if (tmp_compressed)
                         (void) unlink(tmp_compressed);
         }
-
-uncompressed:
 #endif
 
         r = fix_permissions(fd, tmp, fn, context, uid);
@@ -482,6 +687,10 @@ uncompressed:
 fail:
         if (tmp)
                 (void) unlink(tmp);
+#if HAVE_COMPRESSION
+        if (tmp_compressed)
+                (void) unlink(tmp_compressed);
+#endif
         return r;
 }
 
@@ -721,12 +930,13 @@ static int submit_coredump(
                 struct iovec_wrapper *iovw,
                 int input_fd) {
 
-        _cleanup_close_ int coredump_fd = -1, coredump_node_fd = -1;
+        _cleanup_close_ int coredump_fd = -1, coredump_node_fd = -1, index_fd = -1;
         _cleanup_free_ char *filename = NULL, *coredump_data = NULL;
         _cleanup_free_ char *stacktrace = NULL;
+        const char *stored_filename = NULL;
         char *core_message;
         uint64_t coredump_size = UINT64_MAX;
-        bool truncated = false;
+        bool truncated = false, in_journal = false;
         int r;
 
         assert(context);
@@ -736,6 +946,10 @@ static int submit_coredump(
         /* Vacuum before we write anything again */
         (void) coredump_vacuum(-1, arg_keep_free, arg_max_use);
 
+        /* Open the index while we still may, we'll add the coredump to it once it made it into the journal */
+        if (!context->is_journald)
+                index_fd = coredump_index_open(COREDUMP_INDEX_PATH);
+
         /* Always stream the coredump to disk, if that's possible */
         r = save_external_coredump(context, input_fd,
                                    &filename, &coredump_node_fd, &coredump_fd, &coredump_size, &truncated);
@@ -751,6 +965,7 @@ static int submit_coredump(
                 return r;
         if (r == 0) {
                 (void) iovw_put_string_field(iovw, "COREDUMP_FILENAME=", filename);
+                stored_filename = filename;
 
         } else if (arg_storage == COREDUMP_STORAGE_EXTERNAL)
                 log_info("The core will not be stored: size %"PRIu64" is greater than %"PRIu64" (the configured maximum)",
@@ -808,8 +1023,10 @@ log:
 
                         r = allocate_journal_field(coredump_fd, (size_t) coredump_size, &coredump_data, &sz);
                         if (r >= 0) {
-                                if (iovw_put(iovw, coredump_data, sz) >= 0)
+                                if (iovw_put(iovw, coredump_data, sz) >= 0) {
                                         TAKE_PTR(coredump_data);
+                                        in_journal = true;
+                                }
                         } else
                                 log_warning_errno(r, "Failed to attach the core to the journal entry: %m");
                 } else
@@ -821,6 +1038,20 @@ log:
         if (r < 0)
                 return log_error_errno(r, "Failed to log coredump: %m");
 
+        if (index_fd >= 0) {
+                const char *fields[_COREDUMP_INDEX_FIELD_MAX] = {
+                        [COREDUMP_INDEX_PID]      = context->meta[META_ARGV_PID],
+                        [COREDUMP_INDEX_UID]      = context->meta[META_ARGV_UID],
+                        [COREDUMP_INDEX_GID]      = context->meta[META_ARGV_GID],
+                        [COREDUMP_INDEX_SIGNAL]   = context->meta[META_ARGV_SIGNAL],
+                        [COREDUMP_INDEX_EXE]      = context->meta[META_EXE],
+                        [COREDUMP_INDEX_COMM]     = context->meta[META_COMM],
+                        [COREDUMP_INDEX_FILENAME] = stored_filename,
+                };
+
+                (void) coredump_index_append(index_fd, fields, in_journal, truncated);
+        }
+
         return 0;
 }
 
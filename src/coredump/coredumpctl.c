@@ -14,7 +14,9 @@
 #include "bus-error.h"
 #include "bus-util.h"
 #include "compress.h"
+#include "coredump-index.h"
 #include "def.h"
+#include "env-util.h"
 #include "fd-util.h"
 #include "fs-util.h"
 #include "glob-util.h"
@@ -31,6 +33,7 @@
 #include "rlimit-util.h"
 #include "sigbus.h"
 #include "signal-util.h"
+#include "sort-util.h"
 #include "string-util.h"
 #include "strv.h"
 #include "terminal-util.h"
@@ -364,44 +367,24 @@ static int print_field(FILE* file, sd_journal *j) {
                         continue;                    \
         }
 
-static int print_list(FILE* file, sd_journal *j, int had_legend) {
-        _cleanup_free_ char
-                *mid = NULL, *pid = NULL, *uid = NULL, *gid = NULL,
-                *sgnl = NULL, *exe = NULL, *comm = NULL, *cmdline = NULL,
-                *filename = NULL, *truncated = NULL, *coredump = NULL;
-        const void *d;
-        size_t l;
-        usec_t t;
+static void print_list_line(
+                FILE *file,
+                int had_legend,
+                usec_t t,
+                bool normal_coredump,
+                const char *pid,
+                const char *uid,
+                const char *gid,
+                const char *sgnl,
+                const char *filename,
+                bool in_journal,
+                bool truncated,
+                const char *name) {
+
         char buf[FORMAT_TIMESTAMP_MAX];
-        int r;
         const char *present;
-        bool normal_coredump;
 
         assert(file);
-        assert(j);
-
-        SD_JOURNAL_FOREACH_DATA(j, d, l) {
-                RETRIEVE(d, l, "MESSAGE_ID", mid);
-                RETRIEVE(d, l, "COREDUMP_PID", pid);
-                RETRIEVE(d, l, "COREDUMP_UID", uid);
-                RETRIEVE(d, l, "COREDUMP_GID", gid);
-                RETRIEVE(d, l, "COREDUMP_SIGNAL", sgnl);
-                RETRIEVE(d, l, "COREDUMP_EXE", exe);
-                RETRIEVE(d, l, "COREDUMP_COMM", comm);
-                RETRIEVE(d, l, "COREDUMP_CMDLINE", cmdline);
-                RETRIEVE(d, l, "COREDUMP_FILENAME", filename);
-                RETRIEVE(d, l, "COREDUMP_TRUNCATED", truncated);
-                RETRIEVE(d, l, "COREDUMP", coredump);
-        }
-
-        if (!pid && !uid && !gid && !sgnl && !exe && !comm && !cmdline && !filename) {
-                log_warning("Empty coredump log entry");
-                return -EINVAL;
-        }
-
-        r = sd_journal_get_realtime_usec(j, &t);
-        if (r < 0)
-                return log_error_errno(r, "Failed to get realtime timestamp: %m");
 
         format_timestamp(buf, sizeof(buf), t);
 
@@ -415,8 +398,6 @@ static int print_list(FILE* file, sd_journal *j, int had_legend) {
                         9, "COREFILE",
                            "EXE");
 
-        normal_coredump = streq_ptr(mid, SD_MESSAGE_COREDUMP_STR);
-
         if (filename)
                 if (access(filename, R_OK) == 0)
                         present = "present";
@@ -424,14 +405,14 @@ static int print_list(FILE* file, sd_journal *j, int had_legend) {
                         present = "missing";
                 else
                         present = "error";
-        else if (coredump)
+        else if (in_journal)
                 present = "journal";
         else if (normal_coredump)
                 present = "none";
         else
                 present = "-";
 
-        if (STR_IN_SET(present, "present", "journal") && truncated && parse_boolean(truncated) > 0)
+        if (STR_IN_SET(present, "present", "journal") && truncated)
                 present = "truncated";
 
         fprintf(file, "%-*s %*s %*s %*s %*s %-*s %s\n",
@@ -441,7 +422,51 @@ static int print_list(FILE* file, sd_journal *j, int had_legend) {
                 5, strna(gid),
                 3, normal_coredump ? strna(sgnl) : "-",
                 9, present,
-                strna(exe ?: (comm ?: cmdline)));
+                strna(name));
+}
+
+static int print_list(FILE* file, sd_journal *j, int had_legend) {
+        _cleanup_free_ char
+                *mid = NULL, *pid = NULL, *uid = NULL, *gid = NULL,
+                *sgnl = NULL, *exe = NULL, *comm = NULL, *cmdline = NULL,
+                *filename = NULL, *truncated = NULL, *coredump = NULL;
+        const void *d;
+        size_t l;
+        usec_t t;
+        int r;
+
+        assert(file);
+        assert(j);
+
+        SD_JOURNAL_FOREACH_DATA(j, d, l) {
+                RETRIEVE(d, l, "MESSAGE_ID", mid);
+                RETRIEVE(d, l, "COREDUMP_PID", pid);
+                RETRIEVE(d, l, "COREDUMP_UID", uid);
+                RETRIEVE(d, l, "COREDUMP_GID", gid);
+                RETRIEVE(d, l, "COREDUMP_SIGNAL", sgnl);
+                RETRIEVE(d, l, "COREDUMP_EXE", exe);
+                RETRIEVE(d, l, "COREDUMP_COMM", comm);
+                RETRIEVE(d, l, "COREDUMP_CMDLINE", cmdline);
+                RETRIEVE(d, l, "COREDUMP_FILENAME", filename);
+                RETRIEVE(d, l, "COREDUMP_TRUNCATED", truncated);
+                RETRIEVE(d, l, "COREDUMP", coredump);
+        }
+
+        if (!pid && !uid && !gid && !sgnl && !exe && !comm && !cmdline && !filename) {
+                log_warning("Empty coredump log entry");
+                return -EINVAL;
+        }
+
+        r = sd_journal_get_realtime_usec(j, &t);
+        if (r < 0)
+                return log_error_errno(r, "Failed to get realtime timestamp: %m");
+
+        print_list_line(file, had_legend, t,
+                        streq_ptr(mid, SD_MESSAGE_COREDUMP_STR),
+                        pid, uid, gid, sgnl, filename,
+                        coredump,
+                        truncated && parse_boolean(truncated) > 0,
+                        exe ?: (comm ?: cmdline));
 
         return 0;
 }
@@ -658,6 +683,304 @@ static int print_entry(sd_journal *j, unsigned n_found, bool verb_is_info) {
                 return print_list(stdout, j, n_found);
 }
 
+static int index_add_match(char ***l, const char *match) {
+        _cleanup_free_ char *p = NULL, *m = NULL;
+        const char *e;
+        pid_t pid;
+        int r;
+
+        assert(l);
+        assert(match);
+
+        /* Translates a match the same way add_match() does. Returns 0 if the index doesn't record the field
+         * the match refers to. */
+
+        e = strchr(match, '=');
+        if (e) {
+                if (coredump_index_field_from_string(strndupa(match, e - match)) < 0)
+                        return 0;
+
+                m = strdup(match);
+        } else if (strchr(match, '/')) {
+                r = path_make_absolute_cwd(match, &p);
+                if (r < 0)
+                        return log_error_errno(r, "path_make_absolute_cwd(\"%s\"): %m", match);
+
+                m = strjoin("COREDUMP_EXE=", p);
+        } else if (parse_pid(match, &pid) >= 0)
+                m = strjoin("COREDUMP_PID=", match);
+        else
+                m = strjoin("COREDUMP_COMM=", match);
+        if (!m)
+                return log_oom();
+
+        r = strv_consume(l, TAKE_PTR(m));
+        if (r < 0)
+                return log_oom();
+
+        return 1;
+}
+
+static bool index_entry_matches(const CoredumpIndexEntry *e, char **matches) {
+        CoredumpIndexField f;
+
+        assert(e);
+
+        /* Like in the journal, matches on the same field are alternatives, matches on different fields all
+         * need to be fulfilled */
+        for (f = 0; f < _COREDUMP_INDEX_FIELD_MAX; f++) {
+                bool found = false, good = false;
+                char **m;
+
+                STRV_FOREACH(m, matches) {
+                        const char *v;
+
+                        v = startswith(*m, coredump_index_field_to_string(f));
+                        if (!v || *v != '=')
+                                continue;
+
+                        found = true;
+                        if (streq_ptr(e->fields[f], v + 1)) {
+                                good = true;
+                                break;
+                        }
+                }
+
+                if (found && !good)
+                        return false;
+        }
+
+        return true;
+}
+
+static int index_entry_compare(const CoredumpIndexEntry *a, const CoredumpIndexEntry *b) {
+        return CMP(a->timestamp, b->timestamp);
+}
+
+static int index_entry_from_journal(sd_journal *j, usec_t t, CoredumpIndexEntry *ret) {
+        _cleanup_(coredump_index_entry_done) CoredumpIndexEntry e = {
+                .timestamp = t,
+        };
+        const void *d;
+        size_t l;
+        int r;
+
+        assert(j);
+        assert(ret);
+
+        /* Builds the index entry for a coredump logged before the index was started */
+
+        SD_JOURNAL_FOREACH_DATA(j, d, l) {
+                CoredumpIndexField f;
+                const char *eq, *field;
+
+                eq = memchr(d, '=', l);
+                if (!eq)
+                        continue;
+
+                field = strndupa(d, eq - (const char*) d);
+                eq++;
+
+                if (streq(field, "COREDUMP"))
+                        e.in_journal = true;
+                else if (streq(field, "COREDUMP_TRUNCATED"))
+                        e.truncated = parse_boolean(strndupa(eq, l - (eq - (const char*) d))) > 0;
+                else {
+                        f = coredump_index_field_from_string(field);
+                        if (f < 0)
+                                continue;
+
+                        r = free_and_strndup(e.fields + f, eq, l - (eq - (const char*) d));
+                        if (r < 0)
+                                return log_oom();
+                }
+        }
+
+        *ret = e;
+        e = (CoredumpIndexEntry) {};
+
+        return 0;
+}
+
+static int print_index_entries(const CoredumpIndexEntry *entries, size_t n, usec_t first, char **matches) {
+        unsigned n_found = 0;
+        size_t i;
+
+        assert(entries || n == 0);
+
+        for (i = 0; i < n; i++) {
+                const CoredumpIndexEntry *e = entries + (arg_reverse || arg_one ? n - 1 - i : i);
+
+                /* Skip coredumps whose journal entries have been vacuumed since */
+                if (e->timestamp < first)
+                        continue;
+
+                /* Like focus(), -1 ignores --since and --until */
+                if (!arg_one) {
+                        if (arg_since != USEC_INFINITY && e->timestamp < arg_since)
+                                continue;
+                        if (arg_until != USEC_INFINITY && e->timestamp > arg_until)
+                                continue;
+                }
+
+                if (!index_entry_matches(e, matches))
+                        continue;
+
+                print_list_line(stdout, n_found++, e->timestamp, true,
+                                e->fields[COREDUMP_INDEX_PID],
+                                e->fields[COREDUMP_INDEX_UID],
+                                e->fields[COREDUMP_INDEX_GID],
+                                e->fields[COREDUMP_INDEX_SIGNAL],
+                                e->fields[COREDUMP_INDEX_FILENAME],
+                                e->in_journal,
+                                e->truncated,
+                                e->fields[COREDUMP_INDEX_EXE] ?: e->fields[COREDUMP_INDEX_COMM]);
+
+                if (arg_one)
+                        return 0;
+        }
+
+        if (arg_one)
+                return log_error_errno(SYNTHETIC_ERRNO(ESRCH), "No match found.");
+
+        if (n_found <= 0) {
+                if (!arg_quiet)
+                        log_notice("No coredumps found.");
+                return -ESRCH;
+        }
+
+        return 0;
+}
+
+static int dump_list_from_index(char **matches) {
+        _cleanup_(sd_journal_closep) sd_journal *j = NULL;
+        _cleanup_strv_free_ char **index_matches = NULL;
+        CoredumpIndexEntry *entries = NULL;
+        usec_t since, first = USEC_INFINITY;
+        size_t n = 0, n_allocated;
+        char **match;
+        int r;
+
+        /* Lists coredumps from the index systemd-coredump maintains, instead of reading every coredump entry
+         * in the journal. Returns 0 if the index cannot be used to answer the query, in which case the
+         * journal needs to be searched instead, and 1 on success. */
+
+        r = getenv_bool_secure("SYSTEMD_COREDUMP_INDEX");
+        if (r == 0)
+                return 0;
+        if (r < 0 && r != -ENXIO)
+                log_debug_errno(r, "Failed to parse $SYSTEMD_COREDUMP_INDEX, ignoring: %m");
+
+        STRV_FOREACH(match, matches) {
+                r = index_add_match(&index_matches, *match);
+                if (r <= 0)
+                        return r;
+        }
+
+        r = coredump_index_load(COREDUMP_INDEX_PATH, &since, &entries, &n);
+        if (r < 0) {
+                log_debug_errno(r, "Failed to load coredump index, not using it: %m");
+                return 0;
+        }
+        n_allocated = n;
+
+        r = sd_journal_open(&j, SD_JOURNAL_LOCAL_ONLY);
+        if (r < 0) {
+                log_error_errno(r, "Failed to open journal: %m");
+                goto finish;
+        }
+
+        /* The entries logged by "systemd-coredump --backtrace" are not recorded in the index, as that runs
+         * unprivileged. They are rare, hence we simply don't use the index if there are any. */
+        r = sd_journal_add_match(j, "MESSAGE_ID=" SD_MESSAGE_BACKTRACE_STR, 0);
+        if (r < 0) {
+                log_error_errno(r, "Failed to add match: %m");
+                goto finish;
+        }
+
+        r = sd_journal_next(j);
+        if (r < 0) {
+                log_error_errno(r, "Failed to search journal: %m");
+                goto finish;
+        }
+        if (r > 0) {
+                log_debug("Found backtrace entries in the journal, not using coredump index.");
+                r = 0;
+                goto finish;
+        }
+
+        /* Find the oldest coredump the journal still knows about: anything older in the index has been
+         * vacuumed from the journal. Coredumps logged before the index was started are taken from the
+         * journal. */
+        sd_journal_flush_matches(j);
+
+        r = sd_journal_add_match(j, "MESSAGE_ID=" SD_MESSAGE_COREDUMP_STR, 0);
+        if (r < 0) {
+                log_error_errno(r, "Failed to add match: %m");
+                goto finish;
+        }
+
+        /* We only need to know whether the coredump itself is in the journal */
+        (void) sd_journal_set_data_threshold(j, 4096);
+
+        r = sd_journal_seek_head(j);
+        if (r < 0) {
+                log_error_errno(r, "Failed to seek to head of journal: %m");
+                goto finish;
+        }
+
+        for (;;) {
+                _cleanup_(coredump_index_entry_done) CoredumpIndexEntry e = {};
+                usec_t t;
+
+                r = sd_journal_next(j);
+                if (r < 0) {
+                        log_error_errno(r, "Failed to search journal: %m");
+                        goto finish;
+                }
+                if (r == 0)
+                        break;
+
+                r = sd_journal_get_realtime_usec(j, &t);
+                if (r < 0) {
+                        log_error_errno(r, "Failed to determine timestamp: %m");
+                        goto finish;
+                }
+
+                if (first == USEC_INFINITY)
+                        first = t;
+                if (t >= since)
+                        break;
+
+                r = index_entry_from_journal(j, t, &e);
+                if (r < 0)
+                        goto finish;
+
+                if (!GREEDY_REALLOC(entries, n_allocated, n + 1)) {
+                        r = log_oom();
+                        goto finish;
+                }
+
+                entries[n++] = e;
+                e = (CoredumpIndexEntry) {};
+        }
+
+        /* The entries taken from the journal are older than the ones from the index, move them first */
+        typesafe_qsort(entries, n, index_entry_compare);
+
+        log_debug("Using coredump index.");
+
+        (void) pager_open(arg_pager_flags);
+
+        r = print_index_entries(entries, n, first, index_matches);
+        if (r >= 0)
+                r = 1;
+
+finish:
+        coredump_index_entry_free_many(entries, n);
+        return r;
+}
+
 static int dump_list(int argc, char **argv, void *userdata) {
         _cleanup_(sd_journal_closep) sd_journal *j = NULL;
         unsigned n_found = 0;
@@ -666,6 +989,13 @@ static int dump_list(int argc, char **argv, void *userdata) {
 
         verb_is_info = (argc >= 1 && streq(argv[0], "info"));
 
+        /* The index only has what "list" shows */
+        if (!verb_is_info && !arg_field && !arg_directory && !arg_file) {
+                r = dump_list_from_index(argv + 1);
+                if (r != 0)
+                        return r < 0 ? r : 0;
+        }
+
         r = acquire_journal(&j, argv + 1);
         if (r < 0)
                 return r;
@@ -765,7 +1095,7 @@ static int save_core(sd_journal *j, FILE *file, char **path, bool *unlink_temp)
                 if (access(filename, R_OK) < 0)
                         return log_error_errno(errno, "File \"%s\" is not readable: %m", filename);
 
-                if (path && !endswith(filename, ".xz") && !endswith(filename, ".lz4")) {
+                if (path && !endswith(filename, ".xz") && !endswith(filename, ".lz4") && !endswith(filename, ".zst")) {
                         *path = TAKE_PTR(filename);
 
                         return 0;
@@ -824,7 +1154,7 @@ static int save_core(sd_journal *j, FILE *file, char **path, bool *unlink_temp)
         }
 
         if (filename) {
-#if HAVE_XZ || HAVE_LZ4
+#if HAVE_COMPRESSION
                 _cleanup_close_ int fdf;
 
                 fdf = open(filename, O_RDONLY | O_CLOEXEC);
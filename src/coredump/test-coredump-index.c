@@ -0,0 +1,179 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "coredump-index.h"
+#include "fd-util.h"
+#include "fileio.h"
+#include "io-util.h"
+#include "path-util.h"
+#include "rm-rf.h"
+#include "string-util.h"
+#include "tests.h"
+#include "tmpfile-util.h"
+
+static void test_parse_line(void) {
+        CoredumpIndexEntry e;
+        const char *l;
+
+        log_info("/* %s */", __func__);
+
+        l = "1234\tjt\t42\t0\t5\t11\t/usr/bin/foo\\tbar\tfoo\t-";
+        assert_se(coredump_index_parse_line(l, strlen(l), &e) >= 0);
+        assert_se(e.timestamp == 1234);
+        assert_se(e.in_journal);
+        assert_se(e.truncated);
+        assert_se(streq(e.fields[COREDUMP_INDEX_PID], "42"));
+        assert_se(streq(e.fields[COREDUMP_INDEX_UID], "0"));
+        assert_se(streq(e.fields[COREDUMP_INDEX_GID], "5"));
+        assert_se(streq(e.fields[COREDUMP_INDEX_SIGNAL], "11"));
+        assert_se(streq(e.fields[COREDUMP_INDEX_EXE], "/usr/bin/foo\tbar"));
+        assert_se(streq(e.fields[COREDUMP_INDEX_COMM], "foo"));
+        assert_se(!e.fields[COREDUMP_INDEX_FILENAME]);
+        coredump_index_entry_done(&e);
+
+        l = "5\t\t-\t-\t-\t-\t-\t-\t/var/lib/systemd/coredump/core.foo";
+        assert_se(coredump_index_parse_line(l, strlen(l), &e) >= 0);
+        assert_se(e.timestamp == 5);
+        assert_se(!e.in_journal);
+        assert_se(!e.truncated);
+        assert_se(!e.fields[COREDUMP_INDEX_PID]);
+        assert_se(streq(e.fields[COREDUMP_INDEX_FILENAME], "/var/lib/systemd/coredump/core.foo"));
+        coredump_index_entry_done(&e);
+
+        /* Only the given length counts */
+        l = "5\t\t-\t-\t-\t-\t-\t-\tfoo\tbar";
+        assert_se(coredump_index_parse_line(l, strlen(l) - 4, &e) >= 0);
+        assert_se(streq(e.fields[COREDUMP_INDEX_FILENAME], "foo"));
+        coredump_index_entry_done(&e);
+
+        /* Too few or too many fields */
+        l = "5\t\t-\t-\t-\t-\t-\t-";
+        assert_se(coredump_index_parse_line(l, strlen(l), &e) == -EBADMSG);
+        l = "5\t\t-\t-\t-\t-\t-\t-\t-\t-";
+        assert_se(coredump_index_parse_line(l, strlen(l), &e) == -EBADMSG);
+        assert_se(coredump_index_parse_line("", 0, &e) == -EBADMSG);
+
+        /* Bad timestamp or escaping */
+        l = "xyz\t\t-\t-\t-\t-\t-\t-\t-";
+        assert_se(coredump_index_parse_line(l, strlen(l), &e) < 0);
+        l = "5\t\t-\t-\t-\t-\t\\q\t-\t-";
+        assert_se(coredump_index_parse_line(l, strlen(l), &e) < 0);
+}
+
+static void append(int fd, const char *pid, const char *exe, bool in_journal) {
+        const char *fields[_COREDUMP_INDEX_FIELD_MAX] = {
+                [COREDUMP_INDEX_PID] = pid,
+                [COREDUMP_INDEX_EXE] = exe,
+        };
+
+        assert_se(coredump_index_append(fd, fields, in_journal, false) >= 0);
+}
+
+static void test_load(const char *dir) {
+        _cleanup_free_ char *path = NULL;
+        _cleanup_close_ int fd = -1;
+        CoredumpIndexEntry *entries;
+        usec_t since, since2;
+        size_t n;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(path = path_join(dir, "sub/.index"));
+        assert_se(coredump_index_load(path, &since, &entries, &n) == -ENOENT);
+
+        /* Opening starts the index, and creates the directory */
+        assert_se((fd = coredump_index_open(path)) >= 0);
+        assert_se(coredump_index_load(path, &since, &entries, &n) >= 0);
+        assert_se(since > 0);
+        assert_se(n == 0);
+        free(entries);
+
+        append(fd, "1", "/usr/bin/foo", true);
+        append(fd, "2", "/usr/bin/with\ttab\nand newline", false);
+
+        assert_se(coredump_index_load(path, &since2, &entries, &n) >= 0);
+        assert_se(since2 == since);
+        assert_se(n == 2);
+        assert_se(entries[0].timestamp >= since);
+        assert_se(entries[1].timestamp >= entries[0].timestamp);
+        assert_se(streq(entries[0].fields[COREDUMP_INDEX_PID], "1"));
+        assert_se(streq(entries[0].fields[COREDUMP_INDEX_EXE], "/usr/bin/foo"));
+        assert_se(entries[0].in_journal);
+        assert_se(streq(entries[1].fields[COREDUMP_INDEX_PID], "2"));
+        assert_se(streq(entries[1].fields[COREDUMP_INDEX_EXE], "/usr/bin/with\ttab\nand newline"));
+        assert_se(!entries[1].in_journal);
+        coredump_index_entry_free_many(entries, n);
+
+        /* An incomplete last line and garbage lines are ignored */
+        assert_se(loop_write(fd, "garbage\n12\t", STRLEN("garbage\n12\t"), false) >= 0);
+        assert_se(coredump_index_load(path, &since2, &entries, &n) >= 0);
+        assert_se(n == 2);
+        coredump_index_entry_free_many(entries, n);
+
+        /* An invalidated index can't be used, and the next writer starts a new one */
+        assert_se(ftruncate(fd, 0) >= 0);
+        assert_se(coredump_index_load(path, &since2, &entries, &n) == -EBADMSG);
+        append(fd, "3", NULL, true);
+        assert_se(coredump_index_load(path, &since2, &entries, &n) == -EBADMSG);
+
+        fd = safe_close(fd);
+        assert_se((fd = coredump_index_open(path)) >= 0);
+        assert_se(coredump_index_load(path, &since2, &entries, &n) >= 0);
+        assert_se(since2 >= since);
+        assert_se(n == 0);
+        free(entries);
+}
+
+static void test_full(const char *dir) {
+        _cleanup_free_ char *path = NULL, *filler = NULL;
+        _cleanup_close_ int fd = -1;
+        CoredumpIndexEntry *entries;
+        usec_t since, since2;
+        struct stat st;
+        size_t n;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(path = path_join(dir, ".index-full"));
+        assert_se((fd = coredump_index_open(path)) >= 0);
+        assert_se(coredump_index_load(path, &since, &entries, &n) >= 0);
+        free(entries);
+
+        /* Fill the index up to the limit with a garbage line, which readers ignore */
+        assert_se(fstat(fd, &st) >= 0);
+        assert_se(filler = malloc(COREDUMP_INDEX_SIZE_MAX - st.st_size));
+        memset(filler, 'x', COREDUMP_INDEX_SIZE_MAX - st.st_size - 1);
+        filler[COREDUMP_INDEX_SIZE_MAX - st.st_size - 1] = '\n';
+        assert_se(loop_write(fd, filler, COREDUMP_INDEX_SIZE_MAX - st.st_size, false) >= 0);
+
+        /* The coredump that doesn't fit anymore starts a new index, which doesn't cover it */
+        append(fd, "1", "/usr/bin/foo", true);
+        assert_se(coredump_index_load(path, &since2, &entries, &n) >= 0);
+        assert_se(since2 >= since);
+        assert_se(n == 0);
+        free(entries);
+
+        /* The new index is usable right away */
+        append(fd, "2", "/usr/bin/foo", true);
+        assert_se(coredump_index_load(path, &since2, &entries, &n) >= 0);
+        assert_se(n == 1);
+        assert_se(streq(entries[0].fields[COREDUMP_INDEX_PID], "2"));
+        coredump_index_entry_free_many(entries, n);
+}
+
+int main(int argc, char *argv[]) {
+        _cleanup_(rm_rf_physical_and_freep) char *dir = NULL;
+
+        test_setup_logging(LOG_DEBUG);
+
+        assert_se(mkdtemp_malloc("/tmp/test-coredump-index.XXXXXX", &dir) >= 0);
+
+        test_parse_line();
+        test_load(dir);
+        test_full(dir);
+
+        return 0;
+}
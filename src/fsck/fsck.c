@@ -15,6 +15,7 @@
 #include "sd-device.h"
 
 #include "alloc-util.h"
+#include "blockdev-util.h"
 #include "bus-common-errors.h"
 #include "bus-error.h"
 #include "bus-util.h"
@@ -23,6 +24,7 @@
 #include "fs-util.h"
 #include "fsck-util.h"
 #include "main-func.h"
+#include "mkdir.h"
 #include "parse-util.h"
 #include "path-util.h"
 #include "proc-cmdline.h"
@@ -38,6 +40,11 @@ static bool arg_skip = false;
 static bool arg_force = false;
 static bool arg_show_progress = false;
 static const char *arg_repair = "-a";
+static unsigned arg_max_parallel = 0;
+
+/* The same lock files util-linux' fsck -l takes, so that we interlock with checks started by hand */
+#define FSCK_DISK_LOCK_DIR "/run/fsck"
+#define FSCK_SLOT_LOCK_DIR "/run/systemd/fsck"
 
 static void start_target(const char *target, const char *mode) {
         _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
@@ -104,6 +111,15 @@ static int parse_proc_cmdline_item(const char *key, const char *value, void *dat
                         else
                                 log_warning("Invalid fsck.repair= parameter '%s'. Ignoring.", value);
                 }
+
+        } else if (streq(key, "fsck.max_parallel")) {
+
+                if (proc_cmdline_value_missing(key, value))
+                        return 0;
+
+                r = safe_atou(value, &arg_max_parallel);
+                if (r < 0)
+                        log_warning_errno(r, "Invalid fsck.max_parallel= parameter '%s'. Ignoring.", value);
         }
 
 #if HAVE_SYSV_COMPAT
@@ -245,13 +261,128 @@ static int fsck_progress_socket(void) {
         return TAKE_FD(fd);
 }
 
+static int lock_file(const char *path, const char *what, sd_device *dev) {
+        _cleanup_close_ int fd = -1;
+
+        assert(path);
+
+        fd = open(path, O_RDONLY|O_CREAT|O_CLOEXEC|O_NOCTTY, 0600);
+        if (fd < 0)
+                return -errno;
+
+        if (flock(fd, LOCK_EX|LOCK_NB) >= 0)
+                return TAKE_FD(fd);
+        if (errno != EWOULDBLOCK)
+                return -errno;
+
+        log_device_info(dev, "Waiting for %s.", what);
+
+        if (flock(fd, LOCK_EX) < 0)
+                return -errno;
+
+        return TAKE_FD(fd);
+}
+
+static int lock_disk(sd_device *dev, int *ret_fd) {
+        _cleanup_(sd_device_unrefp) sd_device *disk = NULL;
+        const char *rotational, *sysname, *path;
+        dev_t devnum, whole;
+        int r, fd;
+
+        assert(dev);
+        assert(ret_fd);
+
+        /* Checks of file systems on the same rotating disk would only compete for the disk heads, hence
+         * serialize them, while those on different disks, or on anything that doesn't seek, run in
+         * parallel. Returns 0 if no lock is needed. */
+
+        r = sd_device_get_devnum(dev, &devnum);
+        if (r < 0)
+                return r;
+
+        r = block_get_whole_disk(devnum, &whole);
+        if (r < 0)
+                return r;
+
+        r = sd_device_new_from_devnum(&disk, 'b', whole);
+        if (r < 0)
+                return r;
+
+        if (sd_device_get_sysattr_value(disk, "queue/rotational", &rotational) >= 0 && streq(rotational, "0")) {
+                *ret_fd = -1;
+                return 0;
+        }
+
+        r = sd_device_get_sysname(disk, &sysname);
+        if (r < 0)
+                return r;
+
+        (void) mkdir_p(FSCK_DISK_LOCK_DIR, 0755);
+
+        path = strjoina(FSCK_DISK_LOCK_DIR "/", sysname, ".lock");
+        fd = lock_file(path, "checks of other file systems on the same disk to finish", dev);
+        if (fd < 0)
+                return fd;
+
+        *ret_fd = fd;
+        return 1;
+}
+
+static int lock_slot(sd_device *dev, int *ret_fd) {
+        char path[STRLEN(FSCK_SLOT_LOCK_DIR "/slot") + DECIMAL_STR_MAX(unsigned) + STRLEN(".lock") + 1];
+        unsigned i;
+        int fd;
+
+        assert(dev);
+        assert(ret_fd);
+
+        /* Limits the number of checks running at the same time to fsck.max_parallel=, if set, by handing out
+         * that many lock files. Returns 0 if there's no limit. */
+
+        if (arg_max_parallel == 0) {
+                *ret_fd = -1;
+                return 0;
+        }
+
+        (void) mkdir_p(FSCK_SLOT_LOCK_DIR, 0755);
+
+        for (i = 0; i < arg_max_parallel; i++) {
+                _cleanup_close_ int slot = -1;
+
+                xsprintf(path, FSCK_SLOT_LOCK_DIR "/slot%u.lock", i);
+
+                slot = open(path, O_RDONLY|O_CREAT|O_CLOEXEC|O_NOCTTY, 0600);
+                if (slot < 0)
+                        return -errno;
+
+                if (flock(slot, LOCK_EX|LOCK_NB) >= 0) {
+                        *ret_fd = TAKE_FD(slot);
+                        return 1;
+                }
+                if (errno != EWOULDBLOCK)
+                        return -errno;
+        }
+
+        /* All taken, queue up on one of them */
+        xsprintf(path, FSCK_SLOT_LOCK_DIR "/slot%u.lock", (unsigned) getpid_cached() % arg_max_parallel);
+        fd = lock_file(path, "other file system checks to finish", dev);
+        if (fd < 0)
+                return fd;
+
+        *ret_fd = fd;
+        return 1;
+}
+
 static int run(int argc, char *argv[]) {
         _cleanup_close_pair_ int progress_pipe[2] = { -1, -1 };
         _cleanup_(sd_device_unrefp) sd_device *dev = NULL;
         _cleanup_free_ char *dpath = NULL;
         _cleanup_fclose_ FILE *console = NULL;
+        _cleanup_close_ int disk_lock = -1, slot_lock = -1;
+        char wait_span[FORMAT_TIMESPAN_MAX], check_span[FORMAT_TIMESPAN_MAX];
         const char *device, *type;
-        bool root_directory;
+        bool root_directory, disk_locked;
+        usec_t start, check_start, check_usec;
         struct stat st;
         int r, exit_status;
         pid_t pid;
@@ -338,6 +469,19 @@ static int run(int argc, char *argv[]) {
                 }
         }
 
+        start = now(CLOCK_MONOTONIC);
+
+        r = lock_disk(dev, &disk_lock);
+        if (r < 0)
+                log_device_warning_errno(dev, r, "Failed to lock disk, leaving it to fsck: %m");
+        disk_locked = r >= 0;
+
+        r = lock_slot(dev, &slot_lock);
+        if (r < 0)
+                log_device_warning_errno(dev, r, "Failed to acquire file system check slot, ignoring: %m");
+
+        check_start = now(CLOCK_MONOTONIC);
+
         console = fopen("/dev/console", "we");
         if (console &&
             arg_show_progress &&
@@ -378,8 +522,11 @@ static int run(int argc, char *argv[]) {
                  * Since util-linux v2.25 fsck uses /run/fsck/<diskname>.lock files.
                  * The previous versions use flock for the device and conflict with
                  * udevd, see https://bugs.freedesktop.org/show_bug.cgi?id=79576#c5
+                 *
+                 * If we took that lock ourselves already, fsck must not try again.
                  */
-                cmdline[i++] = "-l";
+                if (!disk_locked)
+                        cmdline[i++] = "-l";
 
                 if (!root_directory)
                         cmdline[i++] = "-M";
@@ -407,6 +554,20 @@ static int run(int argc, char *argv[]) {
         exit_status = wait_for_terminate_and_check("fsck", pid, WAIT_LOG_ABNORMAL);
         if (exit_status < 0)
                 return exit_status;
+
+        /* Let the next check on this disk start right away */
+        disk_lock = safe_close(disk_lock);
+        slot_lock = safe_close(slot_lock);
+
+        check_usec = now(CLOCK_MONOTONIC) - check_start;
+        log_struct(LOG_INFO,
+                   LOG_MESSAGE("Checked %s in %s, after waiting %s for other checks.",
+                               device,
+                               format_timespan(check_span, sizeof(check_span), check_usec, USEC_PER_MSEC),
+                               format_timespan(wait_span, sizeof(wait_span), check_start - start, USEC_PER_MSEC)),
+                   "DEVICE=%s", device,
+                   "FSCK_WAIT_USEC=" USEC_FMT, check_start - start,
+                   "FSCK_USEC=" USEC_FMT, check_usec);
         if ((exit_status & ~FSCK_ERROR_CORRECTED) != FSCK_SUCCESS) {
                 log_error("fsck failed with exit status %i.", exit_status);
 
@@ -4,8 +4,12 @@
 #include "memory-util.h"
 #include "resolved-dns-packet.h"
 
+/* Only check names at the start of the packet, to keep the run time linear */
+#define NAME_OFFSETS_MAX 512U
+
 int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
         _cleanup_(dns_packet_unrefp) DnsPacket *p = NULL;
+        size_t offset;
 
         if (size > DNS_PACKET_SIZE_MAX)
                 return 0;
@@ -21,5 +25,20 @@ int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
         }
         (void) dns_packet_extract(p);
 
+        /* Skipping names must accept and refuse exactly what reading them does */
+        for (offset = DNS_PACKET_HEADER_SIZE; offset < MIN(p->size, NAME_OFFSETS_MAX); offset++) {
+                _cleanup_free_ char *name = NULL;
+                size_t rindex;
+                int r;
+
+                dns_packet_rewind(p, offset);
+                r = dns_packet_read_name(p, &name, true, NULL);
+                rindex = p->rindex;
+
+                dns_packet_rewind(p, offset);
+                assert_se((dns_packet_skip_name(p, true, NULL) >= 0) == (r >= 0));
+                assert_se(p->rindex == rindex);
+        }
+
         return 0;
 }
@@ -139,6 +139,134 @@ static int block_get_size_by_path(const char *path, uint64_t *ret) {
         return block_get_size_by_fd(fd, ret);
 }
 
+static int make_clean_stamp_path(const char *user_name, char **ret) {
+        char *p;
+
+        assert(user_name);
+        assert(ret);
+
+        p = strjoin("/run/systemd/home/", user_name, ".clean");
+        if (!p)
+                return log_oom();
+
+        *ret = p;
+        return 0;
+}
+
+static int format_image_stamp(const struct stat *st, char **ret) {
+        assert(st);
+        assert(ret);
+
+        /* Identifies the precise state of an image file: the ctime is bumped by every write to the file and
+         * cannot be set from userspace, hence if it is unchanged the contents are, too. */
+        if (asprintf(ret, "%" PRIu64 " %" PRIu64 " %" PRIu64 " " NSEC_FMT,
+                     (uint64_t) st->st_dev,
+                     (uint64_t) st->st_ino,
+                     (uint64_t) st->st_size,
+                     timespec_load_nsec(&st->st_ctim)) < 0)
+                return log_oom();
+
+        return 0;
+}
+
+static bool image_unchanged_since_clean(UserRecord *h, const struct stat *st) {
+        _cleanup_free_ char *p = NULL, *stored = NULL, *current = NULL;
+        int r;
+
+        assert(h);
+        assert(st);
+
+        /* Checks whether the image file is exactly in the state it was left in by the last clean
+         * deactivation. The stamp is consumed in any case: if we crash while the home directory is active,
+         * the next activation won't find it and will check the file system. */
+
+        if (make_clean_stamp_path(h->user_name, &p) < 0)
+                return false;
+
+        r = read_one_line_file(p, &stored);
+        if (r < 0) {
+                if (r != -ENOENT)
+                        log_debug_errno(r, "Failed to read clean stamp %s, ignoring: %m", p);
+                return false;
+        }
+
+        if (unlink(p) < 0) {
+                log_debug_errno(errno, "Failed to remove clean stamp %s, not trusting it: %m", p);
+                return false;
+        }
+
+        if (!S_ISREG(st->st_mode))
+                return false;
+
+        if (format_image_stamp(st, &current) < 0)
+                return false;
+
+        return streq(stored, current);
+}
+
+int home_mark_clean_luks(UserRecord *h) {
+        _cleanup_free_ char *p = NULL, *stamp = NULL;
+        const char *ip;
+        struct stat st;
+        int r;
+
+        assert(h);
+
+        /* Called after the file system has been unmounted cleanly and the LUKS device is gone, so that the
+         * next activation can skip the file system check if nobody touched the image in between. We only
+         * do this for image files, block devices don't tell us whether they have been written to. */
+
+        ip = user_record_image_path(h);
+        if (!ip)
+                return 0;
+
+        if (stat(ip, &st) < 0)
+                return log_debug_errno(errno, "Failed to stat image file %s, not marking it clean: %m", ip);
+        if (!S_ISREG(st.st_mode))
+                return 0;
+
+        r = make_clean_stamp_path(h->user_name, &p);
+        if (r < 0)
+                return r;
+
+        r = format_image_stamp(&st, &stamp);
+        if (r < 0)
+                return r;
+
+        r = write_string_file(p, stamp, WRITE_STRING_FILE_CREATE|WRITE_STRING_FILE_ATOMIC|WRITE_STRING_FILE_MKDIR_0755|WRITE_STRING_FILE_MODE_0600);
+        if (r < 0)
+                return log_debug_errno(r, "Failed to write clean stamp %s, ignoring: %m", p);
+
+        log_debug("Marked image file %s as cleanly deactivated.", ip);
+        return 1;
+}
+
+static usec_t home_setup_phase_done(HomeSetup *setup, HomeSetupPhase phase, usec_t since) {
+        usec_t n;
+
+        assert(setup);
+        assert(phase >= 0 && phase < _HOME_SETUP_PHASE_MAX);
+
+        n = now(CLOCK_MONOTONIC);
+        setup->phase_usec[phase] = usec_sub_unsigned(n, since);
+
+        return n;
+}
+
+static void print_phase_summary(HomeSetup *setup) {
+        char buffer1[FORMAT_TIMESPAN_MAX], buffer2[FORMAT_TIMESPAN_MAX], buffer3[FORMAT_TIMESPAN_MAX],
+                buffer4[FORMAT_TIMESPAN_MAX], buffer5[FORMAT_TIMESPAN_MAX];
+
+        assert(setup);
+
+        log_info("Loopback setup took %s, LUKS unlocking took %s, file system check took %s, mounting took %s, refreshing identity took %s.",
+                 format_timespan(buffer1, sizeof(buffer1), setup->phase_usec[HOME_SETUP_PHASE_LOOP], USEC_PER_MSEC),
+                 format_timespan(buffer2, sizeof(buffer2), setup->phase_usec[HOME_SETUP_PHASE_UNLOCK], USEC_PER_MSEC),
+                 format_timespan(buffer3, sizeof(buffer3), setup->phase_usec[HOME_SETUP_PHASE_FSCK], USEC_PER_MSEC),
+                 format_timespan(buffer4, sizeof(buffer4), setup->phase_usec[HOME_SETUP_PHASE_MOUNT], USEC_PER_MSEC),
+                 format_timespan(buffer5, sizeof(buffer5), setup->phase_usec[HOME_SETUP_PHASE_REFRESH], USEC_PER_MSEC));
+}
+
 static int run_fsck(const char *node, const char *fstype) {
         int r, exit_status;
         pid_t fsck_pid;
@@ -1065,8 +1193,12 @@ int home_prepare_luks(
         } else {
                 _cleanup_free_ char *fstype = NULL, *subdir = NULL;
                 _cleanup_close_ int fd = -1;
+                bool clean;
                 const char *ip;
                 struct stat st;
+                usec_t ts;
+
+                ts = now(CLOCK_MONOTONIC);
 
                 ip = force_image_path ?: user_record_image_path(h);
 
@@ -1083,6 +1215,9 @@ int home_prepare_luks(
                 if (!S_ISREG(st.st_mode) && !S_ISBLK(st.st_mode))
                         return log_error_errno(errno, "Image file %s is not a regular file or block device: %m", ip);
 
+                /* Check this before we touch the image in any way, i.e. before the fallocate() below */
+                clean = image_unchanged_since_clean(h, &st);
+
                 r = luks_validate(fd, user_record_user_name_and_realm(h), h->partition_uuid, &found_partition_uuid, &offset, &size);
                 if (r < 0)
                         return log_error_errno(r, "Failed to validate disk label: %m");
@@ -1103,6 +1238,8 @@ int home_prepare_luks(
 
                 log_info("Setting up loopback device %s completed.", loop->node ?: ip);
 
+                ts = home_setup_phase_done(setup, HOME_SETUP_PHASE_LOOP, ts);
+
                 r = luks_setup(loop->node ?: ip,
                                setup->dm_name,
                                h->luks_uuid,
@@ -1125,13 +1262,21 @@ int home_prepare_luks(
                 if (r < 0)
                         goto fail;
 
+                ts = home_setup_phase_done(setup, HOME_SETUP_PHASE_UNLOCK, ts);
+
                 r = fs_validate(setup->dm_node, h->file_system_uuid, &fstype, &found_fs_uuid);
                 if (r < 0)
                         goto fail;
 
-                r = run_fsck(setup->dm_node, fstype);
-                if (r < 0)
-                        goto fail;
+                if (clean)
+                        log_info("Image file was not modified since it was cleanly deactivated, skipping file system check.");
+                else {
+                        r = run_fsck(setup->dm_node, fstype);
+                        if (r < 0)
+                                goto fail;
+                }
+
+                ts = home_setup_phase_done(setup, HOME_SETUP_PHASE_FSCK, ts);
 
                 r = home_unshare_and_mount(setup->dm_node, fstype, user_record_luks_discard(h));
                 if (r < 0)
@@ -1147,6 +1292,8 @@ int home_prepare_luks(
 
                 if (user_record_luks_discard(h))
                         (void) run_fitrim(root_fd);
+
+                (void) home_setup_phase_done(setup, HOME_SETUP_PHASE_MOUNT, ts);
         }
 
         setup->loop = TAKE_PTR(loop);
@@ -1200,6 +1347,7 @@ int home_activate_luks(
         uint64_t host_size, encrypted_size;
         const char *hdo, *hd;
         struct statfs sfs;
+        usec_t ts;
         int r;
 
         assert(h);
@@ -1238,6 +1386,8 @@ int home_activate_luks(
         if (r < 0)
                 return log_error_errno(r, "Failed to get LUKS block device size: %m");
 
+        ts = now(CLOCK_MONOTONIC);
+
         r = home_refresh(
                         h,
                         &setup,
@@ -1252,6 +1402,8 @@ int home_activate_luks(
         if (r < 0)
                 return r;
 
+        (void) home_setup_phase_done(&setup, HOME_SETUP_PHASE_REFRESH, ts);
+
         setup.root_fd = safe_close(setup.root_fd);
 
         r = home_move_mount(user_record_user_name_and_realm(h), hd);
@@ -1271,6 +1423,7 @@ int home_activate_luks(
         log_info("Everything completed.");
 
         print_size_summary(host_size, encrypted_size, &sfs);
+        print_phase_summary(&setup);
 
         *ret_home = TAKE_PTR(new_home);
         return 1;
@@ -652,7 +652,7 @@ static int home_activate(UserRecord *h, UserRecord **ret_home) {
 }
 
 static int home_deactivate(UserRecord *h, bool force) {
-        bool done = false;
+        bool done = false, unmounted = false;
         int r;
 
         assert(h);
@@ -670,7 +670,7 @@ static int home_deactivate(UserRecord *h, bool force) {
                         return log_error_errno(errno, "Failed to unmount %s: %m", user_record_home_directory(h));
 
                 log_info("Unmounting completed.");
-                done = true;
+                done = unmounted = true;
         } else
                 log_info("Directory %s is already unmounted.", user_record_home_directory(h));
 
@@ -680,6 +680,11 @@ static int home_deactivate(UserRecord *h, bool force) {
                         return r;
                 if (r > 0)
                         done = true;
+
+                /* Only if we unmounted the file system synchronously ourselves we know it is in a clean
+                 * state now, and can skip checking it on the next activation. */
+                if (unmounted && !force)
+                        (void) home_mark_clean_luks(h);
         }
 
         if (!done)
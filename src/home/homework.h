@@ -7,9 +7,19 @@
 #include "sd-id128.h"
 
 #include "loop-util.h"
+#include "time-util.h"
 #include "user-record.h"
 #include "user-record-util.h"
 
+typedef enum HomeSetupPhase {
+        HOME_SETUP_PHASE_LOOP,
+        HOME_SETUP_PHASE_UNLOCK,
+        HOME_SETUP_PHASE_FSCK,
+        HOME_SETUP_PHASE_MOUNT,
+        HOME_SETUP_PHASE_REFRESH,
+        _HOME_SETUP_PHASE_MAX,
+} HomeSetupPhase;
+
 typedef struct HomeSetup {
         char *dm_name;
         char *dm_node;
@@ -31,6 +41,9 @@ typedef struct HomeSetup {
 
         uint64_t partition_offset;
         uint64_t partition_size;
+
+        /* How long the individual steps of setting up the home directory took, for the summary we log */
+        usec_t phase_usec[_HOME_SETUP_PHASE_MAX];
 } HomeSetup;
 
 #define HOME_SETUP_INIT                                 \
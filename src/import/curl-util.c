@@ -7,6 +7,7 @@
 #include "curl-util.h"
 #include "fd-util.h"
 #include "locale-util.h"
+#include "parse-util.h"
 #include "string-util.h"
 
 static void curl_glue_check_finished(CurlGlue *g) {
@@ -378,3 +379,73 @@ int curl_parse_http_time(const char *t, usec_t *ret) {
         *ret = (usec_t) v * USEC_PER_SEC;
         return 0;
 }
+
+int curl_parse_content_range(const char *range, uint64_t *ret_first, uint64_t *ret_last, uint64_t *ret_total) {
+        uint64_t first = UINT64_MAX, last = UINT64_MAX, total;
+        const char *p, *e;
+
+        assert(range);
+
+        /* Parses the value of a Content-Range: header, e.g. "bytes 0-1023/4096". In a response to a range that
+         * can't be satisfied, the range is given as an asterisk, in which case first and last are returned as
+         * UINT64_MAX. An unknown total size, also given as an asterisk, is refused, we need to know it. */
+
+        p = startswith(range, "bytes ");
+        if (!p)
+                return -EINVAL;
+
+        e = strchr(p, '/');
+        if (!e)
+                return -EINVAL;
+
+        if (safe_atou64(e + 1, &total) < 0)
+                return -EINVAL;
+
+        if (e - p != 1 || p[0] != '*') {
+                const char *d;
+
+                d = memchr(p, '-', e - p);
+                if (!d)
+                        return -EINVAL;
+
+                if (safe_atou64(strndupa(p, d - p), &first) < 0 ||
+                    safe_atou64(strndupa(d + 1, e - d - 1), &last) < 0)
+                        return -EINVAL;
+
+                if (first > last || last >= total)
+                        return -EINVAL;
+        }
+
+        if (ret_first)
+                *ret_first = first;
+        if (ret_last)
+                *ret_last = last;
+        if (ret_total)
+                *ret_total = total;
+
+        return 0;
+}
+
+int curl_make_if_range(const char *etag, const char *last_modified, char **ret) {
+        char *h;
+
+        assert(ret);
+
+        /* Builds an If-Range: header that makes sure further range requests are served from the same version
+         * of a resource. Weak ETags may not be used for that. A date is only used if there's no strong ETag,
+         * the server decides then whether it is good enough. Returns 0 if there's nothing to use. */
+
+        if (etag && !startswith(etag, "W/"))
+                h = strjoin("If-Range: ", etag);
+        else if (last_modified)
+                h = strjoin("If-Range: ", last_modified);
+        else {
+                *ret = NULL;
+                return 0;
+        }
+        if (!h)
+                return -ENOMEM;
+
+        *ret = h;
+        return 1;
+}
@@ -33,6 +33,8 @@ void curl_glue_remove_and_free(CurlGlue *g, CURL *c);
 struct curl_slist *curl_slist_new(const char *first, ...) _sentinel_;
 int curl_header_strdup(const void *contents, size_t sz, const char *field, char **value);
 int curl_parse_http_time(const char *t, usec_t *ret);
+int curl_parse_content_range(const char *range, uint64_t *ret_first, uint64_t *ret_last, uint64_t *ret_total);
+int curl_make_if_range(const char *etag, const char *last_modified, char **ret);
 
 DEFINE_TRIVIAL_CLEANUP_FUNC(CURL*, curl_easy_cleanup);
 DEFINE_TRIVIAL_CLEANUP_FUNC(CURL*, curl_multi_cleanup);
@@ -15,17 +15,64 @@
 #include "parse-util.h"
 #include "pull-common.h"
 #include "pull-job.h"
+#include "stdio-util.h"
 #include "string-util.h"
 #include "strv.h"
 #include "xattr-util.h"
 
+/* The size of the HTTP range requests, when downloading in parallel */
+#define PULL_JOB_CHUNK_SIZE (16U*1024U*1024U)
+
+struct PullJobChunk {
+        PullJob *job;
+        CURL *curl;
+
+        uint64_t offset;
+        size_t size;
+
+        uint8_t *data;
+        size_t received;
+        bool done;
+};
+
+static PullJobChunk* pull_job_chunk_free(PullJobChunk *c) {
+        if (!c)
+                return NULL;
+
+        curl_glue_remove_and_free(c->job->glue, c->curl);
+        free(c->data);
+
+        return mfree(c);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(PullJobChunk*, pull_job_chunk_free);
+
+static void pull_job_free_chunks(PullJob *j) {
+        size_t i;
+
+        assert(j);
+
+        for (i = 0; i < j->n_chunks; i++)
+                pull_job_chunk_free(j->chunks[i]);
+
+        j->chunks = mfree(j->chunks);
+        j->n_chunks = 0;
+        j->chunks_buffered = 0;
+}
+
 PullJob* pull_job_unref(PullJob *j) {
         if (!j)
                 return NULL;
 
+        pull_job_free_chunks(j);
+        curl_slist_free_all(j->range_header);
+
         curl_glue_remove_and_free(j->glue, j->curl);
         curl_slist_free_all(j->request_header);
 
+        /* Stop the threads first, they use most of what follows */
+        pull_pipeline_free(j->pipeline);
+
         safe_close(j->disk_fd);
 
         import_compress_free(&j->compress);
@@ -35,6 +82,7 @@ PullJob* pull_job_unref(PullJob *j) {
 
         free(j->url);
         free(j->etag);
+        free(j->last_modified);
         strv_free(j->old_etags);
         free(j->payload);
         free(j->checksum);
@@ -48,6 +96,9 @@ static void pull_job_finish(PullJob *j, int ret) {
         if (IN_SET(j->state, PULL_JOB_DONE, PULL_JOB_FAILED))
                 return;
 
+        j->pipeline = pull_pipeline_free(j->pipeline);
+        pull_job_free_chunks(j);
+
         if (ret == 0) {
                 j->state = PULL_JOB_DONE;
                 j->progress_percent = 100;
@@ -72,6 +123,7 @@ static int pull_job_restart(PullJob *j) {
         free(j->url);
         j->url = chksum_url;
         j->state = PULL_JOB_INIT;
+        j->pipeline = pull_pipeline_free(j->pipeline);
         j->payload = mfree(j->payload);
         j->payload_size = 0;
         j->payload_allocated = 0;
@@ -85,6 +137,472 @@ static int pull_job_restart(PullJob *j) {
         return 0;
 }
 
+static int pull_job_restart_unranged(PullJob *j) {
+        assert(j);
+
+        /* Gives up on range requests for this job, and fetches the whole file in one go instead. Only called
+         * before anything of the first response was processed. */
+
+        log_debug("Restarting download of %s without range requests.", j->url);
+
+        curl_glue_remove_and_free(j->glue, j->curl);
+        j->curl = NULL;
+        curl_slist_free_all(j->request_header);
+        j->request_header = NULL;
+        curl_slist_free_all(j->range_header);
+        j->range_header = NULL;
+
+        j->n_parallel = 1;
+        j->restart_unranged = false;
+        j->state = PULL_JOB_INIT;
+        j->pipeline = pull_pipeline_free(j->pipeline);
+        j->payload = mfree(j->payload);
+        j->payload_size = 0;
+        j->payload_allocated = 0;
+        j->written_compressed = 0;
+        j->written_uncompressed = 0;
+        j->content_length = (uint64_t) -1;
+
+        return pull_job_begin(j);
+}
+
+static int pull_job_write_uncompressed(const void *p, size_t sz, void *userdata) {
+        PullJob *j = userdata;
+        ssize_t n;
+
+        assert(j);
+        assert(p);
+
+        if (sz <= 0)
+                return 0;
+
+        if (j->written_uncompressed + sz < j->written_uncompressed)
+                return log_error_errno(SYNTHETIC_ERRNO(EOVERFLOW),
+                                       "File too large, overflow");
+
+        if (j->written_uncompressed + sz > j->uncompressed_max)
+                return log_error_errno(SYNTHETIC_ERRNO(EFBIG),
+                                       "File overly large, refusing");
+
+        if (j->disk_fd >= 0) {
+
+                if (j->allow_sparse)
+                        n = sparse_write(j->disk_fd, p, sz, 64);
+                else {
+                        n = write(j->disk_fd, p, sz);
+                        if (n < 0)
+                                n = -errno;
+                }
+                if (n < 0)
+                        return log_error_errno((int) n, "Failed to write file: %m");
+                if ((size_t) n < sz)
+                        return log_error_errno(SYNTHETIC_ERRNO(EIO), "Short write");
+        } else {
+
+                if (!GREEDY_REALLOC(j->payload, j->payload_allocated, j->payload_size + sz))
+                        return log_oom();
+
+                memcpy(j->payload + j->payload_size, p, sz);
+                j->payload_size += sz;
+        }
+
+        j->written_uncompressed += sz;
+
+        return 0;
+}
+
+static int pull_job_write_compressed(PullJob *j, void *p, size_t sz) {
+        int r;
+
+        assert(j);
+        assert(p);
+
+        if (sz <= 0)
+                return 0;
+
+        if (j->written_compressed + sz < j->written_compressed)
+                return log_error_errno(SYNTHETIC_ERRNO(EOVERFLOW), "File too large, overflow");
+
+        if (j->written_compressed + sz > j->compressed_max)
+                return log_error_errno(SYNTHETIC_ERRNO(EFBIG), "File overly large, refusing.");
+
+        if (j->content_length != (uint64_t) -1 &&
+            j->written_compressed + sz > j->content_length)
+                return log_error_errno(SYNTHETIC_ERRNO(EFBIG),
+                                       "Content length incorrect.");
+
+        if (j->pipeline) {
+                r = pull_pipeline_feed(j->pipeline, p, sz);
+                if (r < 0)
+                        return r;
+        } else {
+                if (j->checksum_context)
+                        gcry_md_write(j->checksum_context, p, sz);
+
+                r = import_uncompress(&j->compress, p, sz, pull_job_write_uncompressed, j);
+                if (r < 0)
+                        return r;
+        }
+
+        j->written_compressed += sz;
+
+        return 0;
+}
+
+static int pull_job_open_disk(PullJob *j) {
+        int r;
+
+        assert(j);
+
+        if (j->on_open_disk) {
+                r = j->on_open_disk(j);
+                if (r < 0)
+                        return r;
+        }
+
+        if (j->disk_fd >= 0) {
+                /* Check if we can do sparse files */
+
+                if (lseek(j->disk_fd, SEEK_SET, 0) == 0)
+                        j->allow_sparse = true;
+                else {
+                        if (errno != ESPIPE)
+                                return log_error_errno(errno, "Failed to seek on file descriptor: %m");
+
+                        j->allow_sparse = false;
+                }
+        }
+
+        if (j->calc_checksum) {
+                initialize_libgcrypt(false);
+
+                if (gcry_md_open(&j->checksum_context, GCRY_MD_SHA256, 0) != 0)
+                        return log_error_errno(SYNTHETIC_ERRNO(EIO),
+                                               "Failed to initialize hash context.");
+        }
+
+        return 0;
+}
+
+static int pull_job_detect_compression(PullJob *j) {
+        _cleanup_free_ uint8_t *stub = NULL;
+        size_t stub_size;
+
+        int r;
+
+        assert(j);
+
+        r = import_uncompress_detect(&j->compress, j->payload, j->payload_size);
+        if (r < 0)
+                return log_error_errno(r, "Failed to initialize compressor: %m");
+        if (r == 0)
+                return 0;
+
+        log_debug("Stream is compressed: %s", import_compress_type_to_string(j->compress.type));
+
+        r = pull_job_open_disk(j);
+        if (r < 0)
+                return r;
+
+        /* When writing to disk, hash, decompress and write on threads of their own. The download itself
+         * stays in the event loop, and simply blocks when the others can't keep up. Downloads into memory
+         * are small, those aren't worth it. */
+        if (j->disk_fd >= 0) {
+                r = pull_pipeline_new(&j->pipeline, j->checksum_context, &j->compress, pull_job_write_uncompressed, j);
+                if (r < 0)
+                        log_debug_errno(r, "Failed to start processing threads, processing download in the event loop: %m");
+        }
+
+        /* Now, take the payload we read so far, and decompress it */
+        stub = j->payload;
+        stub_size = j->payload_size;
+
+        j->payload = NULL;
+        j->payload_size = 0;
+        j->payload_allocated = 0;
+
+        j->state = PULL_JOB_RUNNING;
+
+        r = pull_job_write_compressed(j, stub, stub_size);
+        if (r < 0)
+                return r;
+
+        return 0;
+}
+
+static int pull_job_complete(PullJob *j) {
+        int r;
+
+        assert(j);
+
+        /* Called once all of the download went through pull_job_write_compressed() */
+
+        if (j->content_length != (uint64_t) -1 &&
+            j->content_length != j->written_compressed)
+                return log_error_errno(SYNTHETIC_ERRNO(EIO), "Download truncated.");
+
+        if (j->pipeline) {
+                /* Wait for the threads to catch up, before we look at the checksum or the file */
+                r = pull_pipeline_finish(j->pipeline);
+                j->pipeline = pull_pipeline_free(j->pipeline);
+                if (r < 0)
+                        return r;
+        }
+
+        if (j->checksum_context) {
+                uint8_t *k;
+
+                k = gcry_md_read(j->checksum_context, GCRY_MD_SHA256);
+                if (!k)
+                        return log_error_errno(SYNTHETIC_ERRNO(EIO), "Failed to get checksum.");
+
+                j->checksum = hexmem(k, gcry_md_get_algo_dlen(GCRY_MD_SHA256));
+                if (!j->checksum)
+                        return log_oom();
+
+                log_debug("SHA256 of %s is %s.", j->url, j->checksum);
+        }
+
+        if (j->disk_fd >= 0 && j->allow_sparse) {
+                /* Make sure the file size is right, in case the file was
+                 * sparse and we just seeked for the last part */
+
+                if (ftruncate(j->disk_fd, j->written_uncompressed) < 0)
+                        return log_error_errno(errno, "Failed to truncate file: %m");
+
+                if (j->etag)
+                        (void) fsetxattr(j->disk_fd, "user.source_etag", j->etag, strlen(j->etag), 0);
+                if (j->url)
+                        (void) fsetxattr(j->disk_fd, "user.source_url", j->url, strlen(j->url), 0);
+
+                if (j->mtime != 0) {
+                        struct timespec ut[2];
+
+                        timespec_store(&ut[0], j->mtime);
+                        ut[1] = ut[0];
+                        (void) futimens(j->disk_fd, ut);
+
+                        (void) fd_setcrtime(j->disk_fd, j->mtime);
+                }
+        }
+
+        return 0;
+}
+
+static void pull_job_update_progress(PullJob *j, uint64_t dlnow, uint64_t dltotal) {
+        unsigned percent;
+        usec_t n;
+
+        assert(j);
+
+        if (dltotal == 0)
+                return;
+
+        percent = ((100 * dlnow) / dltotal);
+        n = now(CLOCK_MONOTONIC);
+
+        if (n > j->last_status_usec + USEC_PER_SEC &&
+            percent != j->progress_percent &&
+            dlnow < dltotal) {
+                char buf[FORMAT_TIMESPAN_MAX];
+
+                if (n - j->start_usec > USEC_PER_SEC && dlnow > 0) {
+                        char y[FORMAT_BYTES_MAX];
+                        usec_t left, done;
+
+                        done = n - j->start_usec;
+                        left = (usec_t) (((double) done * (double) dltotal) / dlnow) - done;
+
+                        log_info("Got %u%% of %s. %s left at %s/s.",
+                                 percent,
+                                 j->url,
+                                 format_timespan(buf, sizeof(buf), left, USEC_PER_SEC),
+                                 format_bytes(y, sizeof(y), (uint64_t) ((double) dlnow / ((double) done / (double) USEC_PER_SEC))));
+                } else
+                        log_info("Got %u%% of %s.", percent, j->url);
+
+                j->progress_percent = percent;
+                j->last_status_usec = n;
+
+                if (j->on_progress)
+                        j->on_progress(j);
+        }
+}
+
+static size_t pull_job_chunk_write_callback(void *contents, size_t size, size_t nmemb, void *userdata) {
+        PullJobChunk *c = userdata;
+        size_t sz = size * nmemb;
+
+        assert(contents);
+        assert(c);
+
+        if (sz > c->size - c->received) {
+                log_error("Server sent more data than requested for range of %s.", c->job->url);
+                return 0;
+        }
+
+        memcpy(c->data + c->received, contents, sz);
+        c->received += sz;
+        c->job->chunks_buffered += sz;
+
+        pull_job_update_progress(c->job, c->job->written_compressed + c->job->chunks_buffered, c->job->content_length);
+
+        return sz;
+}
+
+static int pull_job_add_chunk(PullJob *j) {
+        _cleanup_(pull_job_chunk_freep) PullJobChunk *c = NULL;
+        char range[DECIMAL_STR_MAX(uint64_t) * 2 + 2];
+        const char *url = NULL;
+        int r;
+
+        assert(j);
+        assert(j->n_chunks < j->n_parallel);
+        assert(j->range_offset < j->content_length);
+
+        c = new(PullJobChunk, 1);
+        if (!c)
+                return log_oom();
+
+        *c = (PullJobChunk) {
+                .job = j,
+                .offset = j->range_offset,
+                .size = MIN(PULL_JOB_CHUNK_SIZE, j->content_length - j->range_offset),
+        };
+
+        c->data = malloc(c->size);
+        if (!c->data)
+                return log_oom();
+
+        /* Don't go through the redirects again for each chunk */
+        if (curl_easy_getinfo(j->curl, CURLINFO_EFFECTIVE_URL, &url) != CURLE_OK || !url)
+                url = j->url;
+
+        /* The private pointer is the job, so that the completion ends up in pull_job_curl_on_finished() */
+        r = curl_glue_make(&c->curl, url, j);
+        if (r < 0)
+                return log_error_errno(r, "Failed to allocate range request: %m");
+
+        xsprintf(range, "%" PRIu64 "-%" PRIu64, c->offset, c->offset + c->size - 1);
+        if (curl_easy_setopt(c->curl, CURLOPT_RANGE, range) != CURLE_OK)
+                return log_error_errno(SYNTHETIC_ERRNO(EIO), "Failed to set range of request.");
+
+        if (j->range_header &&
+            curl_easy_setopt(c->curl, CURLOPT_HTTPHEADER, j->range_header) != CURLE_OK)
+                return log_error_errno(SYNTHETIC_ERRNO(EIO), "Failed to set request headers.");
+
+        if (curl_easy_setopt(c->curl, CURLOPT_WRITEFUNCTION, pull_job_chunk_write_callback) != CURLE_OK)
+                return log_error_errno(SYNTHETIC_ERRNO(EIO), "Failed to set write function.");
+
+        if (curl_easy_setopt(c->curl, CURLOPT_WRITEDATA, c) != CURLE_OK)
+                return log_error_errno(SYNTHETIC_ERRNO(EIO), "Failed to set write data.");
+
+        r = curl_glue_add(j->glue, c->curl);
+        if (r < 0)
+                return log_error_errno(r, "Failed to start range request: %m");
+
+        j->range_offset += c->size;
+        j->chunks[j->n_chunks++] = TAKE_PTR(c);
+
+        return 0;
+}
+
+static int pull_job_fill_chunks(PullJob *j) {
+        int r;
+
+        assert(j);
+        assert(j->n_parallel > 1);
+
+        /* Set up by pull_job_write_callback() when the first response came in */
+        assert(j->range_header);
+
+        if (!j->chunks) {
+                j->chunks = new0(PullJobChunk*, j->n_parallel);
+                if (!j->chunks)
+                        return log_oom();
+        }
+
+        while (j->n_chunks < j->n_parallel && j->range_offset < j->content_length) {
+                r = pull_job_add_chunk(j);
+                if (r < 0)
+                        return r;
+        }
+
+        return 0;
+}
+
+static void pull_job_chunk_on_finished(PullJob *j, CURL *curl, CURLcode result) {
+        PullJobChunk *c = NULL;
+        CURLcode code;
+        long status;
+        size_t i;
+        int r;
+
+        assert(j);
+
+        for (i = 0; i < j->n_chunks; i++)
+                if (j->chunks[i]->curl == curl) {
+                        c = j->chunks[i];
+                        break;
+                }
+        if (!c)
+                return;
+
+        if (result != CURLE_OK) {
+                log_error("Transfer of range failed: %s", curl_easy_strerror(result));
+                r = -EIO;
+                goto finish;
+        }
+
+        code = curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status);
+        if (code != CURLE_OK) {
+                log_error("Failed to retrieve response code: %s", curl_easy_strerror(code));
+                r = -EIO;
+                goto finish;
+        }
+        if (status != 206) {
+                /* A 200 here means the file changed since the first request */
+                log_error("HTTP range request to %s failed with code %li.", j->url, status);
+                r = -EIO;
+                goto finish;
+        }
+
+        if (c->received != c->size) {
+                log_error("Download of range truncated.");
+                r = -EIO;
+                goto finish;
+        }
+
+        c->done = true;
+
+        /* Pass on whatever is complete now, in order: hashing and decompression need it that way */
+        while (j->n_chunks > 0 && j->chunks[0]->done) {
+                c = j->chunks[0];
+
+                r = pull_job_write_compressed(j, c->data, c->size);
+                if (r < 0)
+                        goto finish;
+
+                j->chunks_buffered -= c->size;
+                pull_job_chunk_free(c);
+
+                memmove(j->chunks, j->chunks + 1, (j->n_chunks - 1) * sizeof(PullJobChunk*));
+                j->n_chunks--;
+        }
+
+        r = pull_job_fill_chunks(j);
+        if (r < 0)
+                goto finish;
+
+        if (j->n_chunks > 0)
+                return;
+
+        r = pull_job_complete(j);
+
+finish:
+        pull_job_finish(j, r);
+}
+
 void pull_job_curl_on_finished(CurlGlue *g, CURL *curl, CURLcode result) {
         PullJob *j = NULL;
         CURLcode code;
@@ -97,6 +615,20 @@ void pull_job_curl_on_finished(CurlGlue *g, CURL *curl, CURLcode result) {
         if (!j || IN_SET(j->state, PULL_JOB_DONE, PULL_JOB_FAILED))
                 return;
 
+        if (curl != j->curl) {
+                pull_job_chunk_on_finished(j, curl, result);
+                return;
+        }
+
+        if (j->restart_unranged) {
+                /* We aborted the transfer ourselves, see pull_job_write_callback() */
+                r = pull_job_restart_unranged(j);
+                if (r < 0)
+                        goto finish;
+
+                return;
+        }
+
         if (result != CURLE_OK) {
                 log_error("Transfer failed: %s", curl_easy_strerror(result));
                 r = -EIO;
@@ -113,6 +645,13 @@ void pull_job_curl_on_finished(CurlGlue *g, CURL *curl, CURLcode result) {
                 j->etag_exists = true;
                 r = 0;
                 goto finish;
+        } else if (status == 416 && j->n_parallel > 1) {
+                /* Our first range starts at 0, so it can only be refused if the file is empty */
+                r = pull_job_restart_unranged(j);
+                if (r < 0)
+                        goto finish;
+
+                return;
         } else if (status >= 300) {
                 if (status == 404 && j->style == VERIFICATION_PER_FILE) {
 
@@ -150,209 +689,69 @@ void pull_job_curl_on_finished(CurlGlue *g, CURL *curl, CURLcode result) {
         }
 
         if (j->content_length != (uint64_t) -1 &&
-            j->content_length != j->written_compressed) {
-                log_error("Download truncated.");
-                r = -EIO;
-                goto finish;
-        }
-
-        if (j->checksum_context) {
-                uint8_t *k;
-
-                k = gcry_md_read(j->checksum_context, GCRY_MD_SHA256);
-                if (!k) {
-                        log_error("Failed to get checksum.");
-                        r = -EIO;
-                        goto finish;
-                }
-
-                j->checksum = hexmem(k, gcry_md_get_algo_dlen(GCRY_MD_SHA256));
-                if (!j->checksum) {
-                        r = log_oom();
-                        goto finish;
-                }
-
-                log_debug("SHA256 of %s is %s.", j->url, j->checksum);
-        }
-
-        if (j->disk_fd >= 0 && j->allow_sparse) {
-                /* Make sure the file size is right, in case the file was
-                 * sparse and we just seeked for the last part */
+            j->written_compressed < j->content_length &&
+            status == 206 && j->n_parallel > 1 && j->range_offset == 0) {
+                /* The server honoured the range of our first request. Fetch the rest in parallel. */
+                j->range_offset = j->written_compressed;
 
-                if (ftruncate(j->disk_fd, j->written_uncompressed) < 0) {
-                        r = log_error_errno(errno, "Failed to truncate file: %m");
+                r = pull_job_fill_chunks(j);
+                if (r < 0)
                         goto finish;
-                }
-
-                if (j->etag)
-                        (void) fsetxattr(j->disk_fd, "user.source_etag", j->etag, strlen(j->etag), 0);
-                if (j->url)
-                        (void) fsetxattr(j->disk_fd, "user.source_url", j->url, strlen(j->url), 0);
-
-                if (j->mtime != 0) {
-                        struct timespec ut[2];
-
-                        timespec_store(&ut[0], j->mtime);
-                        ut[1] = ut[0];
-                        (void) futimens(j->disk_fd, ut);
 
-                        (void) fd_setcrtime(j->disk_fd, j->mtime);
-                }
+                return;
         }
 
-        r = 0;
+        r = pull_job_complete(j);
 
 finish:
         pull_job_finish(j, r);
 }
 
-static int pull_job_write_uncompressed(const void *p, size_t sz, void *userdata) {
-        PullJob *j = userdata;
-        ssize_t n;
-
-        assert(j);
-        assert(p);
-
-        if (sz <= 0)
-                return 0;
-
-        if (j->written_uncompressed + sz < j->written_uncompressed)
-                return log_error_errno(SYNTHETIC_ERRNO(EOVERFLOW),
-                                       "File too large, overflow");
-
-        if (j->written_uncompressed + sz > j->uncompressed_max)
-                return log_error_errno(SYNTHETIC_ERRNO(EFBIG),
-                                       "File overly large, refusing");
-
-        if (j->disk_fd >= 0) {
-
-                if (j->allow_sparse)
-                        n = sparse_write(j->disk_fd, p, sz, 64);
-                else {
-                        n = write(j->disk_fd, p, sz);
-                        if (n < 0)
-                                n = -errno;
-                }
-                if (n < 0)
-                        return log_error_errno((int) n, "Failed to write file: %m");
-                if ((size_t) n < sz)
-                        return log_error_errno(SYNTHETIC_ERRNO(EIO), "Short write");
-        } else {
-
-                if (!GREEDY_REALLOC(j->payload, j->payload_allocated, j->payload_size + sz))
-                        return log_oom();
-
-                memcpy(j->payload + j->payload_size, p, sz);
-                j->payload_size += sz;
-        }
-
-        j->written_uncompressed += sz;
-
-        return 0;
-}
-
-static int pull_job_write_compressed(PullJob *j, void *p, size_t sz) {
-        int r;
+static long pull_job_response_code(PullJob *j) {
+        long status;
 
         assert(j);
-        assert(p);
 
-        if (sz <= 0)
+        if (curl_easy_getinfo(j->curl, CURLINFO_RESPONSE_CODE, &status) != CURLE_OK)
                 return 0;
 
-        if (j->written_compressed + sz < j->written_compressed)
-                return log_error_errno(SYNTHETIC_ERRNO(EOVERFLOW), "File too large, overflow");
-
-        if (j->written_compressed + sz > j->compressed_max)
-                return log_error_errno(SYNTHETIC_ERRNO(EFBIG), "File overly large, refusing.");
-
-        if (j->content_length != (uint64_t) -1 &&
-            j->written_compressed + sz > j->content_length)
-                return log_error_errno(SYNTHETIC_ERRNO(EFBIG),
-                                       "Content length incorrect.");
-
-        if (j->checksum_context)
-                gcry_md_write(j->checksum_context, p, sz);
-
-        r = import_uncompress(&j->compress, p, sz, pull_job_write_uncompressed, j);
-        if (r < 0)
-                return r;
-
-        j->written_compressed += sz;
-
-        return 0;
+        return status;
 }
 
-static int pull_job_open_disk(PullJob *j) {
+static int pull_job_check_range_response(PullJob *j) {
+        _cleanup_free_ char *hdr = NULL;
+        long status;
         int r;
 
         assert(j);
 
-        if (j->on_open_disk) {
-                r = j->on_open_disk(j);
-                if (r < 0)
-                        return r;
-        }
-
-        if (j->disk_fd >= 0) {
-                /* Check if we can do sparse files */
-
-                if (lseek(j->disk_fd, SEEK_SET, 0) == 0)
-                        j->allow_sparse = true;
-                else {
-                        if (errno != ESPIPE)
-                                return log_error_errno(errno, "Failed to seek on file descriptor: %m");
-
-                        j->allow_sparse = false;
-                }
-        }
-
-        if (j->calc_checksum) {
-                initialize_libgcrypt(false);
-
-                if (gcry_md_open(&j->checksum_context, GCRY_MD_SHA256, 0) != 0)
-                        return log_error_errno(SYNTHETIC_ERRNO(EIO),
-                                               "Failed to initialize hash context.");
-        }
-
-        return 0;
-}
-
-static int pull_job_detect_compression(PullJob *j) {
-        _cleanup_free_ uint8_t *stub = NULL;
-        size_t stub_size;
-
-        int r;
+        /* Called with the first data of the response to our initial range request. Returns 0 if the data
+         * shall be ignored, 1 if it shall be processed, -EAGAIN if the transfer shall be restarted without
+         * range requests. */
 
-        assert(j);
+        status = pull_job_response_code(j);
 
-        r = import_uncompress_detect(&j->compress, j->payload, j->payload_size);
-        if (r < 0)
-                return log_error_errno(r, "Failed to initialize compressor: %m");
-        if (r == 0)
+        /* Just the error message, the download is started over once this completes */
+        if (status == 416)
                 return 0;
 
-        log_debug("Stream is compressed: %s", import_compress_type_to_string(j->compress.type));
+        if (status != 206 || j->range_header)
+                return 1;
 
-        r = pull_job_open_disk(j);
+        /* All further ranges have to come from the same version of the file as this one */
+        r = curl_make_if_range(j->etag, j->last_modified, &hdr);
         if (r < 0)
-                return r;
-
-        /* Now, take the payload we read so far, and decompress it */
-        stub = j->payload;
-        stub_size = j->payload_size;
-
-        j->payload = NULL;
-        j->payload_size = 0;
-        j->payload_allocated = 0;
-
-        j->state = PULL_JOB_RUNNING;
+                return log_oom();
+        if (r == 0) {
+                log_info("%s can't be pinned to one version, not downloading it in parallel.", j->url);
+                return -EAGAIN;
+        }
 
-        r = pull_job_write_compressed(j, stub, stub_size);
-        if (r < 0)
-                return r;
+        j->range_header = curl_slist_new(hdr, NULL);
+        if (!j->range_header)
+                return log_oom();
 
-        return 0;
+        return 1;
 }
 
 static size_t pull_job_write_callback(void *contents, size_t size, size_t nmemb, void *userdata) {
@@ -363,6 +762,19 @@ static size_t pull_job_write_callback(void *contents, size_t size, size_t nmemb,
         assert(contents);
         assert(j);
 
+        if (j->n_parallel > 1 && j->range_offset == 0 && j->state == PULL_JOB_ANALYZING) {
+                r = pull_job_check_range_response(j);
+                if (r == -EAGAIN) {
+                        /* Abort the transfer, pull_job_curl_on_finished() restarts it */
+                        j->restart_unranged = true;
+                        return 0;
+                }
+                if (r < 0)
+                        goto fail;
+                if (r == 0)
+                        return sz;
+        }
+
         switch (j->state) {
 
         case PULL_JOB_ANALYZING:
@@ -406,10 +818,52 @@ fail:
         return 0;
 }
 
+static bool pull_job_is_partial(PullJob *j) {
+        assert(j);
+
+        return j->n_parallel > 1 && pull_job_response_code(j) == 206;
+}
+
+static int pull_job_check_content_length(PullJob *j) {
+        char bytes[FORMAT_BYTES_MAX];
+
+        assert(j);
+
+        if (j->content_length == (uint64_t) -1)
+                return 0;
+
+        if (j->content_length > j->compressed_max)
+                return log_error_errno(SYNTHETIC_ERRNO(EFBIG), "Content too large.");
+
+        if (j->n_parallel > 1)
+                log_info("Downloading %s for %s, in up to %u parallel requests.",
+                         format_bytes(bytes, sizeof(bytes), j->content_length), j->url, j->n_parallel);
+        else
+                log_info("Downloading %s for %s.", format_bytes(bytes, sizeof(bytes), j->content_length), j->url);
+
+        return 0;
+}
+
+static int pull_job_parse_content_range(PullJob *j, const char *range) {
+        uint64_t first, total;
+
+        assert(j);
+        assert(range);
+
+        /* We only ever ask for ranges starting at 0, hence that's what we get back in the first response,
+         * for example "bytes 0-16777215/1073741824". */
+
+        if (curl_parse_content_range(range, &first, NULL, &total) < 0 || first != 0)
+                return log_error_errno(SYNTHETIC_ERRNO(EBADMSG), "Unexpected Content-Range header from %s: %s", j->url, range);
+
+        j->content_length = total;
+        return 0;
+}
+
 static size_t pull_job_header_callback(void *contents, size_t size, size_t nmemb, void *userdata) {
         PullJob *j = userdata;
         size_t sz = size * nmemb;
-        _cleanup_free_ char *length = NULL, *last_modified = NULL;
+        _cleanup_free_ char *length = NULL, *range = NULL, *last_modified = NULL;
         char *etag;
         int r;
 
@@ -448,19 +902,36 @@ static size_t pull_job_header_callback(void *contents, size_t size, size_t nmemb
                 goto fail;
         }
         if (r > 0) {
+                /* For partial content, the total size is taken from Content-Range: instead. If our range
+                 * was refused, this is just the size of the error message. */
+                if (pull_job_is_partial(j) || (j->n_parallel > 1 && pull_job_response_code(j) == 416))
+                        return sz;
+
                 (void) safe_atou64(length, &j->content_length);
 
-                if (j->content_length != (uint64_t) -1) {
-                        char bytes[FORMAT_BYTES_MAX];
+                r = pull_job_check_content_length(j);
+                if (r < 0)
+                        goto fail;
 
-                        if (j->content_length > j->compressed_max) {
-                                log_error("Content too large.");
-                                r = -EFBIG;
-                                goto fail;
-                        }
+                return sz;
+        }
 
-                        log_info("Downloading %s for %s.", format_bytes(bytes, sizeof(bytes), j->content_length), j->url);
-                }
+        r = curl_header_strdup(contents, sz, "Content-Range:", &range);
+        if (r < 0) {
+                log_oom();
+                goto fail;
+        }
+        if (r > 0) {
+                if (!pull_job_is_partial(j))
+                        return sz;
+
+                r = pull_job_parse_content_range(j, range);
+                if (r < 0)
+                        goto fail;
+
+                r = pull_job_check_content_length(j);
+                if (r < 0)
+                        goto fail;
 
                 return sz;
         }
@@ -472,6 +943,8 @@ static size_t pull_job_header_callback(void *contents, size_t size, size_t nmemb
         }
         if (r > 0) {
                 (void) curl_parse_http_time(last_modified, &j->mtime);
+
+                free_and_replace(j->last_modified, last_modified);
                 return sz;
         }
 
@@ -490,43 +963,14 @@ fail:
 
 static int pull_job_progress_callback(void *userdata, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow) {
         PullJob *j = userdata;
-        unsigned percent;
-        usec_t n;
 
         assert(j);
 
-        if (dltotal <= 0)
-                return 0;
-
-        percent = ((100 * dlnow) / dltotal);
-        n = now(CLOCK_MONOTONIC);
-
-        if (n > j->last_status_usec + USEC_PER_SEC &&
-            percent != j->progress_percent &&
-            dlnow < dltotal) {
-                char buf[FORMAT_TIMESPAN_MAX];
-
-                if (n - j->start_usec > USEC_PER_SEC && dlnow > 0) {
-                        char y[FORMAT_BYTES_MAX];
-                        usec_t left, done;
-
-                        done = n - j->start_usec;
-                        left = (usec_t) (((double) done * (double) dltotal) / dlnow) - done;
-
-                        log_info("Got %u%% of %s. %s left at %s/s.",
-                                 percent,
-                                 j->url,
-                                 format_timespan(buf, sizeof(buf), left, USEC_PER_SEC),
-                                 format_bytes(y, sizeof(y), (uint64_t) ((double) dlnow / ((double) done / (double) USEC_PER_SEC))));
-                } else
-                        log_info("Got %u%% of %s.", percent, j->url);
-
-                j->progress_percent = percent;
-                j->last_status_usec = n;
-
-                if (j->on_progress)
-                        j->on_progress(j);
-        }
+        /* For ranged downloads, curl only knows about the first range */
+        if (j->n_parallel > 1 && j->content_length != (uint64_t) -1)
+                pull_job_update_progress(j, j->written_compressed + j->chunks_buffered, j->content_length);
+        else if (dltotal > 0)
+                pull_job_update_progress(j, dlnow, dltotal);
 
         return 0;
 }
@@ -608,6 +1052,16 @@ int pull_job_begin(PullJob *j) {
                         return -EIO;
         }
 
+        if (j->n_parallel > 1) {
+                char range[STRLEN("0-") + DECIMAL_STR_MAX(unsigned)];
+
+                /* Ask for the first chunk only. If the server honours that, we know it supports ranges and
+                 * request the rest in parallel, otherwise we simply get the whole file in one go. */
+                xsprintf(range, "0-%u", PULL_JOB_CHUNK_SIZE - 1);
+                if (curl_easy_setopt(j->curl, CURLOPT_RANGE, range) != CURLE_OK)
+                        return -EIO;
+        }
+
         if (curl_easy_setopt(j->curl, CURLOPT_WRITEFUNCTION, pull_job_write_callback) != CURLE_OK)
                 return -EIO;
 
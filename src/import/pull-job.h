@@ -6,8 +6,10 @@
 #include "curl-util.h"
 #include "import-compress.h"
 #include "macro.h"
+#include "pull-pipeline.h"
 
 typedef struct PullJob PullJob;
+typedef struct PullJobChunk PullJobChunk;
 
 typedef void (*PullJobFinished)(PullJob *job);
 typedef int (*PullJobOpenDisk)(PullJob *job);
@@ -32,6 +34,9 @@ typedef enum VerificationStyle {
 
 #define PULL_JOB_IS_COMPLETE(j) (IN_SET((j)->state, PULL_JOB_DONE, PULL_JOB_FAILED))
 
+/* Upper limit for the number of HTTP range requests a job may have in flight at the same time */
+#define PULL_JOB_PARALLEL_MAX 64U
+
 struct PullJob {
         PullJobState state;
         int error;
@@ -68,6 +73,7 @@ struct PullJob {
         usec_t mtime;
 
         ImportCompress compress;
+        PullPipeline *pipeline;
 
         unsigned progress_percent;
         usec_t start_usec;
@@ -81,6 +87,17 @@ struct PullJob {
         char *checksum;
 
         VerificationStyle style;
+
+        /* If > 1, the download is split into HTTP range requests, up to this many of them in flight at once.
+         * Chunks that complete early are kept in memory until it's their turn. */
+        unsigned n_parallel;
+        uint64_t range_offset;
+        PullJobChunk **chunks;
+        size_t n_chunks;
+        uint64_t chunks_buffered;
+        struct curl_slist *range_header;
+        char *last_modified;
+        bool restart_unranged;
 };
 
 int pull_job_new(PullJob **job, const char *url, CurlGlue *glue, void *userdata);
@@ -0,0 +1,439 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <pthread.h>
+#include <signal.h>
+
+#include "alloc-util.h"
+#include "log.h"
+#include "pull-pipeline.h"
+
+/* How much data to pass on at once, and how many blocks each stage may have waiting for it */
+#define PULL_BLOCK_SIZE (1024U*1024U)
+#define PULL_QUEUE_MAX 8U
+
+typedef enum PullStage {
+        PULL_STAGE_CHECKSUM,
+        PULL_STAGE_UNCOMPRESS,
+        PULL_STAGE_WRITE,
+        _PULL_STAGE_MAX,
+} PullStage;
+
+typedef struct PullBlock {
+        unsigned n_ref;
+        size_t size;
+        uint8_t data[];
+} PullBlock;
+
+typedef struct PullQueue {
+        PullBlock *blocks[PULL_QUEUE_MAX];
+        size_t head;
+        size_t n;
+        bool eof; /* No more blocks will be queued */
+} PullQueue;
+
+struct PullPipeline {
+        /* Protects the queues and the error, and is signalled whenever either changes */
+        pthread_mutex_t mutex;
+        pthread_cond_t cond;
+
+        PullQueue queues[_PULL_STAGE_MAX];
+        pthread_t threads[_PULL_STAGE_MAX];
+        bool started[_PULL_STAGE_MAX];
+
+        /* The first error any stage ran into, everybody stops once it is set */
+        int error;
+
+        gcry_md_hd_t checksum_context;
+        ImportCompress *compress;
+        ImportCompressCallback write;
+        void *userdata;
+
+        PullBlock *input;  /* Filled by the caller */
+        PullBlock *output; /* Filled by the uncompress thread */
+};
+
+static PullBlock *pull_block_new(void) {
+        PullBlock *b;
+
+        b = malloc(offsetof(PullBlock, data) + PULL_BLOCK_SIZE);
+        if (!b)
+                return NULL;
+
+        b->n_ref = 1;
+        b->size = 0;
+
+        return b;
+}
+
+static PullBlock *pull_block_ref(PullBlock *b) {
+        assert(b);
+
+        __sync_add_and_fetch(&b->n_ref, 1);
+        return b;
+}
+
+static PullBlock *pull_block_unref(PullBlock *b) {
+        if (!b)
+                return NULL;
+
+        if (__sync_sub_and_fetch(&b->n_ref, 1) == 0)
+                free(b);
+
+        return NULL;
+}
+
+static void pull_pipeline_lock(PullPipeline *p) {
+        assert_se(pthread_mutex_lock(&p->mutex) == 0);
+}
+
+static void pull_pipeline_unlock(PullPipeline *p) {
+        assert_se(pthread_mutex_unlock(&p->mutex) == 0);
+}
+
+static void pull_pipeline_fail(PullPipeline *p, int error) {
+        assert(p);
+        assert(error < 0);
+
+        pull_pipeline_lock(p);
+        if (p->error == 0)
+                p->error = error;
+        assert_se(pthread_cond_broadcast(&p->cond) == 0);
+        pull_pipeline_unlock(p);
+}
+
+static void pull_pipeline_set_eof(PullPipeline *p, PullStage stage) {
+        assert(p);
+
+        pull_pipeline_lock(p);
+        p->queues[stage].eof = true;
+        assert_se(pthread_cond_broadcast(&p->cond) == 0);
+        pull_pipeline_unlock(p);
+}
+
+static int pull_pipeline_push(PullPipeline *p, PullStage stage, PullBlock *b) {
+        PullQueue *q;
+        int r;
+
+        assert(p);
+        assert(b);
+
+        /* Queues a reference to the block for the stage, waiting for room if necessary */
+
+        q = p->queues + stage;
+
+        pull_pipeline_lock(p);
+
+        while (q->n >= PULL_QUEUE_MAX && p->error == 0)
+                assert_se(pthread_cond_wait(&p->cond, &p->mutex) == 0);
+
+        r = p->error;
+        if (r == 0) {
+                q->blocks[(q->head + q->n) % PULL_QUEUE_MAX] = pull_block_ref(b);
+                q->n++;
+                assert_se(pthread_cond_broadcast(&p->cond) == 0);
+        }
+
+        pull_pipeline_unlock(p);
+
+        return r;
+}
+
+static int pull_pipeline_pop(PullPipeline *p, PullStage stage, PullBlock **ret) {
+        PullQueue *q;
+        int r;
+
+        assert(p);
+        assert(ret);
+
+        /* Returns > 0 and the next block for the stage, 0 if there won't be any more, or the error if some stage
+         * failed */
+
+        q = p->queues + stage;
+
+        pull_pipeline_lock(p);
+
+        while (q->n == 0 && !q->eof && p->error == 0)
+                assert_se(pthread_cond_wait(&p->cond, &p->mutex) == 0);
+
+        if (p->error != 0)
+                r = p->error;
+        else if (q->n == 0) {
+                *ret = NULL;
+                r = 0;
+        } else {
+                *ret = TAKE_PTR(q->blocks[q->head]);
+                q->head = (q->head + 1) % PULL_QUEUE_MAX;
+                q->n--;
+                assert_se(pthread_cond_broadcast(&p->cond) == 0);
+                r = 1;
+        }
+
+        pull_pipeline_unlock(p);
+
+        return r;
+}
+
+static void *checksum_thread(void *userdata) {
+        PullPipeline *p = userdata;
+        PullBlock *b;
+
+        (void) pthread_setname_np(pthread_self(), "pull-checksum");
+
+        while (pull_pipeline_pop(p, PULL_STAGE_CHECKSUM, &b) > 0) {
+                gcry_md_write(p->checksum_context, b->data, b->size);
+                pull_block_unref(b);
+        }
+
+        return NULL;
+}
+
+static int uncompress_callback(const void *data, size_t size, void *userdata) {
+        PullPipeline *p = userdata;
+        const uint8_t *d = data;
+        int r;
+
+        /* The decompressors hand out their output in small pieces, collect them into blocks for the writer */
+
+        while (size > 0) {
+                size_t n;
+
+                if (!p->output) {
+                        p->output = pull_block_new();
+                        if (!p->output)
+                                return log_oom();
+                }
+
+                n = MIN(size, PULL_BLOCK_SIZE - p->output->size);
+                memcpy(p->output->data + p->output->size, d, n);
+                p->output->size += n;
+                d += n;
+                size -= n;
+
+                if (p->output->size >= PULL_BLOCK_SIZE) {
+                        r = pull_pipeline_push(p, PULL_STAGE_WRITE, p->output);
+                        p->output = pull_block_unref(p->output);
+                        if (r < 0)
+                                return r;
+                }
+        }
+
+        return 0;
+}
+
+static void *uncompress_thread(void *userdata) {
+        PullPipeline *p = userdata;
+        PullBlock *b;
+        int r;
+
+        (void) pthread_setname_np(pthread_self(), "pull-uncompress");
+
+        while ((r = pull_pipeline_pop(p, PULL_STAGE_UNCOMPRESS, &b)) > 0) {
+                if (p->compress->type == IMPORT_COMPRESS_UNCOMPRESSED)
+                        /* Nothing to do, pass the block on as it is */
+                        r = pull_pipeline_push(p, PULL_STAGE_WRITE, b);
+                else
+                        r = import_uncompress(p->compress, b->data, b->size, uncompress_callback, p);
+
+                pull_block_unref(b);
+                if (r < 0)
+                        break;
+        }
+
+        if (r == 0 && p->output)
+                r = pull_pipeline_push(p, PULL_STAGE_WRITE, p->output);
+        p->output = pull_block_unref(p->output);
+
+        if (r < 0)
+                pull_pipeline_fail(p, r);
+        else
+                pull_pipeline_set_eof(p, PULL_STAGE_WRITE);
+
+        return NULL;
+}
+
+static void *write_thread(void *userdata) {
+        PullPipeline *p = userdata;
+        PullBlock *b;
+        int r;
+
+        (void) pthread_setname_np(pthread_self(), "pull-write");
+
+        while (pull_pipeline_pop(p, PULL_STAGE_WRITE, &b) > 0) {
+                r = p->write(b->data, b->size, p->userdata);
+                pull_block_unref(b);
+                if (r < 0) {
+                        pull_pipeline_fail(p, r);
+                        break;
+                }
+        }
+
+        return NULL;
+}
+
+static void pull_pipeline_join(PullPipeline *p) {
+        PullStage s;
+
+        assert(p);
+
+        for (s = 0; s < _PULL_STAGE_MAX; s++)
+                if (p->started[s]) {
+                        assert_se(pthread_join(p->threads[s], NULL) == 0);
+                        p->started[s] = false;
+                }
+}
+
+PullPipeline* pull_pipeline_free(PullPipeline *p) {
+        PullStage s;
+        size_t i;
+
+        if (!p)
+                return NULL;
+
+        /* Makes all threads give up whatever they are doing, if they are still running */
+        pull_pipeline_fail(p, -ECANCELED);
+        pull_pipeline_join(p);
+
+        for (s = 0; s < _PULL_STAGE_MAX; s++)
+                for (i = 0; i < p->queues[s].n; i++)
+                        pull_block_unref(p->queues[s].blocks[(p->queues[s].head + i) % PULL_QUEUE_MAX]);
+
+        pull_block_unref(p->input);
+        pull_block_unref(p->output);
+
+        assert_se(pthread_mutex_destroy(&p->mutex) == 0);
+        assert_se(pthread_cond_destroy(&p->cond) == 0);
+
+        return mfree(p);
+}
+
+int pull_pipeline_new(
+                PullPipeline **ret,
+                gcry_md_hd_t checksum_context,
+                ImportCompress *compress,
+                ImportCompressCallback write,
+                void *userdata) {
+
+        static void *(*const thread_functions[_PULL_STAGE_MAX])(void *userdata) = {
+                [PULL_STAGE_CHECKSUM] = checksum_thread,
+                [PULL_STAGE_UNCOMPRESS] = uncompress_thread,
+                [PULL_STAGE_WRITE] = write_thread,
+        };
+
+        _cleanup_(pull_pipeline_freep) PullPipeline *p = NULL;
+        sigset_t ss, saved_ss;
+        PullStage s;
+        int r;
+
+        assert(ret);
+        assert(compress);
+        assert(write);
+
+        p = new(PullPipeline, 1);
+        if (!p)
+                return -ENOMEM;
+
+        *p = (PullPipeline) {
+                .mutex = PTHREAD_MUTEX_INITIALIZER,
+                .cond = PTHREAD_COND_INITIALIZER,
+                .checksum_context = checksum_context,
+                .compress = compress,
+                .write = write,
+                .userdata = userdata,
+        };
+
+        assert_se(sigfillset(&ss) >= 0);
+
+        r = pthread_sigmask(SIG_BLOCK, &ss, &saved_ss);
+        if (r > 0)
+                return -r;
+
+        for (s = 0; s < _PULL_STAGE_MAX; s++) {
+                if (s == PULL_STAGE_CHECKSUM && !checksum_context)
+                        continue;
+
+                r = pthread_create(p->threads + s, NULL, thread_functions[s], p);
+                if (r > 0)
+                        break;
+
+                p->started[s] = true;
+        }
+
+        assert_se(pthread_sigmask(SIG_SETMASK, &saved_ss, NULL) == 0);
+
+        if (r > 0)
+                return -r;
+
+        *ret = TAKE_PTR(p);
+        return 0;
+}
+
+static int pull_pipeline_flush(PullPipeline *p) {
+        int r = 0;
+
+        assert(p);
+
+        if (!p->input || p->input->size == 0)
+                return 0;
+
+        if (p->started[PULL_STAGE_CHECKSUM])
+                r = pull_pipeline_push(p, PULL_STAGE_CHECKSUM, p->input);
+        if (r == 0)
+                r = pull_pipeline_push(p, PULL_STAGE_UNCOMPRESS, p->input);
+
+        p->input = pull_block_unref(p->input);
+
+        return r;
+}
+
+int pull_pipeline_feed(PullPipeline *p, const void *data, size_t size) {
+        const uint8_t *d = data;
+        int r;
+
+        assert(p);
+        assert(data || size == 0);
+
+        /* Blocks while the queues are full, which stops the download until the disk caught up */
+
+        while (size > 0) {
+                size_t n;
+
+                if (!p->input) {
+                        p->input = pull_block_new();
+                        if (!p->input)
+                                return -ENOMEM;
+                }
+
+                n = MIN(size, PULL_BLOCK_SIZE - p->input->size);
+                memcpy(p->input->data + p->input->size, d, n);
+                p->input->size += n;
+                d += n;
+                size -= n;
+
+                if (p->input->size >= PULL_BLOCK_SIZE) {
+                        r = pull_pipeline_flush(p);
+                        if (r < 0)
+                                return r;
+                }
+        }
+
+        return 0;
+}
+
+int pull_pipeline_finish(PullPipeline *p) {
+        int r;
+
+        assert(p);
+
+        /* Pushes out what is left, and waits until everything is hashed and written */
+
+        r = pull_pipeline_flush(p);
+        if (r < 0)
+                return r;
+
+        pull_pipeline_set_eof(p, PULL_STAGE_CHECKSUM);
+        pull_pipeline_set_eof(p, PULL_STAGE_UNCOMPRESS);
+
+        pull_pipeline_join(p);
+
+        return p->error;
+}
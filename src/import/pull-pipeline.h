@@ -0,0 +1,27 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+#include <gcrypt.h>
+
+#include "import-compress.h"
+#include "macro.h"
+
+/* Hashes, decompresses and writes out a download on three threads of their own, so that none of the three
+ * has to wait for the others, nor the event loop for any of them. Data is passed between them in blocks,
+ * through queues of bounded length, hence a slow disk eventually slows down the download, instead of
+ * accumulating it in memory. */
+
+typedef struct PullPipeline PullPipeline;
+
+int pull_pipeline_new(
+                PullPipeline **ret,
+                gcry_md_hd_t checksum_context,
+                ImportCompress *compress,
+                ImportCompressCallback write,
+                void *userdata);
+PullPipeline* pull_pipeline_free(PullPipeline *p);
+
+int pull_pipeline_feed(PullPipeline *p, const void *data, size_t size);
+int pull_pipeline_finish(PullPipeline *p);
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(PullPipeline*, pull_pipeline_free);
@@ -642,7 +642,8 @@ int raw_pull_start(
                 bool force_local,
                 ImportVerify verify,
                 bool settings,
-                bool roothash) {
+                bool roothash,
+                unsigned n_parallel) {
 
         int r;
 
@@ -677,6 +678,7 @@ int raw_pull_start(
         i->raw_job->on_open_disk = raw_pull_job_on_open_disk_raw;
         i->raw_job->on_progress = raw_pull_job_on_progress;
         i->raw_job->calc_checksum = verify != IMPORT_VERIFY_NO;
+        i->raw_job->n_parallel = n_parallel;
 
         r = pull_find_old_etags(url, i->image_root, DT_REG, ".raw-", ".raw", &i->raw_job->old_etags);
         if (r < 0)
@@ -12,6 +12,7 @@
 #include "machine-image.h"
 #include "main-func.h"
 #include "parse-util.h"
+#include "pull-job.h"
 #include "pull-raw.h"
 #include "pull-tar.h"
 #include "signal-util.h"
@@ -24,6 +25,7 @@ static const char *arg_image_root = "/var/lib/machines";
 static ImportVerify arg_verify = IMPORT_VERIFY_SIGNATURE;
 static bool arg_settings = true;
 static bool arg_roothash = true;
+static unsigned arg_parallel = 1;
 
 static int interrupt_signal_handler(sd_event_source *s, const struct signalfd_siginfo *si, void *userdata) {
         log_notice("Transfer aborted.");
@@ -105,7 +107,7 @@ static int pull_tar(int argc, char *argv[], void *userdata) {
         if (r < 0)
                 return log_error_errno(r, "Failed to allocate puller: %m");
 
-        r = tar_pull_start(pull, url, local, arg_force, arg_verify, arg_settings);
+        r = tar_pull_start(pull, url, local, arg_force, arg_verify, arg_settings, arg_parallel);
         if (r < 0)
                 return log_error_errno(r, "Failed to pull image: %m");
 
@@ -191,7 +193,7 @@ static int pull_raw(int argc, char *argv[], void *userdata) {
         if (r < 0)
                 return log_error_errno(r, "Failed to allocate puller: %m");
 
-        r = raw_pull_start(pull, url, local, arg_force, arg_verify, arg_settings, arg_roothash);
+        r = raw_pull_start(pull, url, local, arg_force, arg_verify, arg_settings, arg_roothash, arg_parallel);
         if (r < 0)
                 return log_error_errno(r, "Failed to pull image: %m");
 
@@ -214,7 +216,9 @@ static int help(int argc, char *argv[], void *userdata) {
                "                              'checksum', 'signature'\n"
                "     --settings=BOOL          Download settings file with image\n"
                "     --roothash=BOOL          Download root hash file with image\n"
-               "     --image-root=PATH        Image root directory\n\n"
+               "     --image-root=PATH        Image root directory\n"
+               "     --parallel=N             Download the image in N parts at once, if the\n"
+               "                              server supports range requests\n\n"
                "Commands:\n"
                "  tar URL [NAME]              Download a TAR image\n"
                "  raw URL [NAME]              Download a RAW image\n",
@@ -232,6 +236,7 @@ static int parse_argv(int argc, char *argv[]) {
                 ARG_VERIFY,
                 ARG_SETTINGS,
                 ARG_ROOTHASH,
+                ARG_PARALLEL,
         };
 
         static const struct option options[] = {
@@ -242,6 +247,7 @@ static int parse_argv(int argc, char *argv[]) {
                 { "verify",          required_argument, NULL, ARG_VERIFY          },
                 { "settings",        required_argument, NULL, ARG_SETTINGS        },
                 { "roothash",        required_argument, NULL, ARG_ROOTHASH        },
+                { "parallel",        required_argument, NULL, ARG_PARALLEL        },
                 {}
         };
 
@@ -292,6 +298,15 @@ static int parse_argv(int argc, char *argv[]) {
                         arg_roothash = r;
                         break;
 
+                case ARG_PARALLEL:
+                        r = safe_atou(optarg, &arg_parallel);
+                        if (r < 0)
+                                return log_error_errno(r, "Failed to parse --parallel= parameter '%s': %m", optarg);
+                        if (arg_parallel == 0 || arg_parallel > PULL_JOB_PARALLEL_MAX)
+                                return log_error_errno(SYNTHETIC_ERRNO(ERANGE),
+                                                       "--parallel= parameter must be between 1 and %u.", PULL_JOB_PARALLEL_MAX);
+                        break;
+
                 case '?':
                         return -EINVAL;
 
@@ -1,9 +1,13 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
+#include <pthread.h>
+#include <signal.h>
 #include <zlib.h>
 
 #include "alloc-util.h"
 #include "btrfs-util.h"
+#include "log.h"
+#include "memory-util.h"
 #include "qcow2-util.h"
 #include "sparse-endian.h"
 #include "util.h"
@@ -14,6 +18,12 @@
 #define QCOW2_COMPRESSED (1ULL << 62)
 #define QCOW2_ZERO (1ULL << 0)
 
+/* How much to read at once, how many batches of compressed clusters may wait for the threads, and how many
+ * threads to inflate them on at most */
+#define QCOW2_BATCH_MAX (1024U*1024U)
+#define QCOW2_QUEUE_MAX 16U
+#define QCOW2_THREADS_MAX 16U
+
 typedef struct _packed_ Header {
       be32_t magic;
       be32_t version;
@@ -61,68 +71,133 @@ static uint32_t HEADER_HEADER_LENGTH(const Header *h) {
         return be32toh(h->header_length);
 }
 
-static int copy_cluster(
+typedef struct Qcow2Cluster {
+        uint64_t offset; /* Of the compressed data, relative to the start of the batch */
+        uint64_t compressed_size;
+        uint64_t doffset;
+} Qcow2Cluster;
+
+typedef struct Qcow2Batch {
+        uint64_t soffset;
+        uint64_t size;
+
+        Qcow2Cluster *clusters;
+        size_t n_clusters, n_allocated;
+} Qcow2Batch;
+
+typedef struct Qcow2Converter {
+        /* Protects the queue and the error, and is signalled whenever either changes */
+        pthread_mutex_t mutex;
+        pthread_cond_t cond;
+
+        Qcow2Batch *queue[QCOW2_QUEUE_MAX];
+        size_t head, n_queued;
+        bool eof; /* No more batches will be queued */
+
+        /* The first error anybody ran into, everybody stops once it is set */
+        int error;
+
+        int qcow2_fd;
+        int raw_fd;
+        uint64_t cluster_size;
+
+        pthread_t threads[QCOW2_THREADS_MAX];
+        size_t n_threads;
+
+        /* The batch being collected, and the buffers to inflate it with if there are no threads */
+        Qcow2Batch *batch;
+        void *buffer;
+        size_t buffer_allocated;
+        void *output;
+} Qcow2Converter;
+
+static int write_clusters(
+                int dfd, uint64_t doffset,
+                const void *buffer,
+                uint64_t size,
+                uint64_t cluster_size) {
+
+        const uint8_t *b = buffer;
+        uint64_t i = 0;
+
+        /* Writes out the buffer, but leaves holes where whole clusters are zero. The target file has been
+         * truncated before, hence they read as zeroes anyway. */
+
+        while (i < size) {
+                uint64_t n = 0;
+                ssize_t l;
+
+                while (i + n < size && !memeqzero(b + i + n, MIN(cluster_size, size - i - n)))
+                        n += MIN(cluster_size, size - i - n);
+
+                if (n > 0) {
+                        l = pwrite(dfd, b + i, n, doffset + i);
+                        if (l < 0)
+                                return -errno;
+                        if ((uint64_t) l != n)
+                                return -EIO;
+                }
+
+                i += n;
+                if (i < size)
+                        i += MIN(cluster_size, size - i); /* Skip the zero cluster */
+        }
+
+        return 0;
+}
+
+static int copy_clusters(
                 int sfd, uint64_t soffset,
                 int dfd, uint64_t doffset,
+                uint64_t size,
                 uint64_t cluster_size,
                 void *buffer) {
 
         ssize_t l;
         int r;
 
-        r = btrfs_clone_range(sfd, soffset, dfd, doffset, cluster_size);
+        /* Copies a run of clusters that are adjacent both in the source and the target */
+
+        r = btrfs_clone_range(sfd, soffset, dfd, doffset, size);
         if (r >= 0)
                 return r;
 
-        l = pread(sfd, buffer, cluster_size, soffset);
-        if (l < 0)
-                return -errno;
-        if ((uint64_t) l != cluster_size)
-                return -EIO;
+        while (size > 0) {
+                uint64_t n;
 
-        l = pwrite(dfd, buffer, cluster_size, doffset);
-        if (l < 0)
-                return -errno;
-        if ((uint64_t) l != cluster_size)
-                return -EIO;
+                n = MIN(size, (uint64_t) QCOW2_BATCH_MAX);
+
+                l = pread(sfd, buffer, n, soffset);
+                if (l < 0)
+                        return -errno;
+                if ((uint64_t) l != n)
+                        return -EIO;
+
+                r = write_clusters(dfd, doffset, buffer, n, cluster_size);
+                if (r < 0)
+                        return r;
+
+                soffset += n;
+                doffset += n;
+                size -= n;
+        }
 
         return 0;
 }
 
-static int decompress_cluster(
-                int sfd, uint64_t soffset,
-                int dfd, uint64_t doffset,
+static int inflate_cluster(
+                const void *compressed,
                 uint64_t compressed_size,
-                uint64_t cluster_size,
-                void *buffer1,
-                void *buffer2) {
+                void *buffer,
+                uint64_t cluster_size) {
 
-        _cleanup_free_ void *large_buffer = NULL;
         z_stream s = {};
         uint64_t sz;
-        ssize_t l;
         int r;
 
-        if (compressed_size > cluster_size) {
-                /* The usual cluster buffer doesn't suffice, let's
-                 * allocate a larger one, temporarily */
-
-                large_buffer = malloc(compressed_size);
-                if (!large_buffer)
-                        return -ENOMEM;
-
-                buffer1 = large_buffer;
-        }
-
-        l = pread(sfd, buffer1, compressed_size, soffset);
-        if (l < 0)
-                return -errno;
-        if ((uint64_t) l != compressed_size)
-                return -EIO;
-
-        s.next_in = buffer1;
+        s.next_in = (void*) compressed;
         s.avail_in = compressed_size;
-        s.next_out = buffer2;
+        s.next_out = buffer;
         s.avail_out = cluster_size;
 
         r = inflateInit2(&s, -12);
@@ -130,17 +205,298 @@ static int decompress_cluster(
                 return -EIO;
 
         r = inflate(&s, Z_FINISH);
-        sz = (uint8_t*) s.next_out - (uint8_t*) buffer2;
+        sz = (uint8_t*) s.next_out - (uint8_t*) buffer;
         inflateEnd(&s);
         if (r != Z_STREAM_END || sz != cluster_size)
                 return -EIO;
 
-        l = pwrite(dfd, buffer2, cluster_size, doffset);
+        return 0;
+}
+
+static Qcow2Batch* qcow2_batch_free(Qcow2Batch *b) {
+        if (!b)
+                return NULL;
+
+        free(b->clusters);
+        return mfree(b);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(Qcow2Batch*, qcow2_batch_free);
+
+static int qcow2_batch_decompress(
+                Qcow2Batch *b,
+                int sfd, int dfd,
+                uint64_t cluster_size,
+                void **buffer, size_t *buffer_allocated,
+                void *output) {
+
+        size_t i;
+        ssize_t l;
+        int r;
+
+        assert(b);
+
+        /* Reads the compressed data of all clusters in the batch at once, then inflates them one by one */
+
+        if (!GREEDY_REALLOC(*buffer, *buffer_allocated, b->size))
+                return -ENOMEM;
+
+        l = pread(sfd, *buffer, b->size, b->soffset);
         if (l < 0)
                 return -errno;
-        if ((uint64_t) l != cluster_size)
+        if ((uint64_t) l != b->size)
                 return -EIO;
 
+        for (i = 0; i < b->n_clusters; i++) {
+                Qcow2Cluster *c = b->clusters + i;
+
+                r = inflate_cluster((uint8_t*) *buffer + c->offset, c->compressed_size, output, cluster_size);
+                if (r < 0)
+                        return r;
+
+                r = write_clusters(dfd, c->doffset, output, cluster_size, cluster_size);
+                if (r < 0)
+                        return r;
+        }
+
+        return 0;
+}
+
+static void qcow2_converter_lock(Qcow2Converter *q) {
+        assert_se(pthread_mutex_lock(&q->mutex) == 0);
+}
+
+static void qcow2_converter_unlock(Qcow2Converter *q) {
+        assert_se(pthread_mutex_unlock(&q->mutex) == 0);
+}
+
+static void qcow2_converter_fail(Qcow2Converter *q, int error) {
+        assert(q);
+        assert(error < 0);
+
+        qcow2_converter_lock(q);
+        if (q->error == 0)
+                q->error = error;
+        assert_se(pthread_cond_broadcast(&q->cond) == 0);
+        qcow2_converter_unlock(q);
+}
+
+static int qcow2_converter_get_error(Qcow2Converter *q) {
+        int r;
+
+        assert(q);
+
+        qcow2_converter_lock(q);
+        r = q->error;
+        qcow2_converter_unlock(q);
+
+        return r;
+}
+
+static int qcow2_converter_pop(Qcow2Converter *q, Qcow2Batch **ret) {
+        int r;
+
+        assert(q);
+        assert(ret);
+
+        /* Returns > 0 and the next batch, 0 if there won't be any more, or the error if somebody failed */
+
+        qcow2_converter_lock(q);
+
+        while (q->n_queued == 0 && !q->eof && q->error == 0)
+                assert_se(pthread_cond_wait(&q->cond, &q->mutex) == 0);
+
+        if (q->error != 0)
+                r = q->error;
+        else if (q->n_queued == 0) {
+                *ret = NULL;
+                r = 0;
+        } else {
+                *ret = TAKE_PTR(q->queue[q->head]);
+                q->head = (q->head + 1) % QCOW2_QUEUE_MAX;
+                q->n_queued--;
+                assert_se(pthread_cond_broadcast(&q->cond) == 0);
+                r = 1;
+        }
+
+        qcow2_converter_unlock(q);
+
+        return r;
+}
+
+static void *decompress_thread(void *userdata) {
+        Qcow2Converter *q = userdata;
+        _cleanup_free_ void *buffer = NULL, *output = NULL;
+        size_t buffer_allocated = 0;
+        Qcow2Batch *b;
+        int r;
+
+        (void) pthread_setname_np(pthread_self(), "qcow2-inflate");
+
+        output = malloc(q->cluster_size);
+        if (!output) {
+                qcow2_converter_fail(q, -ENOMEM);
+                return NULL;
+        }
+
+        while ((r = qcow2_converter_pop(q, &b)) > 0) {
+                r = qcow2_batch_decompress(b, q->qcow2_fd, q->raw_fd, q->cluster_size, &buffer, &buffer_allocated, output);
+                qcow2_batch_free(b);
+                if (r < 0) {
+                        qcow2_converter_fail(q, r);
+                        break;
+                }
+        }
+
+        return NULL;
+}
+
+static void qcow2_converter_done(Qcow2Converter *q) {
+        size_t i;
+
+        assert(q);
+
+        /* Lets the threads finish what is queued and waits for them */
+
+        qcow2_converter_lock(q);
+        q->eof = true;
+        assert_se(pthread_cond_broadcast(&q->cond) == 0);
+        qcow2_converter_unlock(q);
+
+        for (i = 0; i < q->n_threads; i++)
+                assert_se(pthread_join(q->threads[i], NULL) == 0);
+        q->n_threads = 0;
+
+        for (i = 0; i < q->n_queued; i++)
+                qcow2_batch_free(q->queue[(q->head + i) % QCOW2_QUEUE_MAX]);
+        q->n_queued = 0;
+
+        qcow2_batch_free(q->batch);
+        q->batch = NULL;
+
+        free(q->buffer);
+        free(q->output);
+
+        assert_se(pthread_mutex_destroy(&q->mutex) == 0);
+        assert_se(pthread_cond_destroy(&q->cond) == 0);
+}
+
+static void qcow2_converter_start(Qcow2Converter *q) {
+        sigset_t ss, saved_ss;
+        unsigned n;
+        long ncpus;
+        int r;
+
+        assert(q);
+
+        ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+        if (ncpus <= 1)
+                return;
+
+        n = (unsigned) MIN(ncpus, (long) QCOW2_THREADS_MAX);
+
+        assert_se(sigfillset(&ss) >= 0);
+
+        r = pthread_sigmask(SIG_BLOCK, &ss, &saved_ss);
+        if (r > 0) {
+                log_debug_errno(r, "Failed to block signals, decompressing qcow2 clusters synchronously: %m");
+                return;
+        }
+
+        for (; q->n_threads < n; q->n_threads++) {
+                r = pthread_create(q->threads + q->n_threads, NULL, decompress_thread, q);
+                if (r > 0) {
+                        /* Make do with whatever we got, or do the work ourselves if nothing */
+                        log_debug_errno(r, "Failed to start qcow2 decompression thread, ignoring: %m");
+                        break;
+                }
+        }
+
+        assert_se(pthread_sigmask(SIG_SETMASK, &saved_ss, NULL) == 0);
+}
+
+static int qcow2_converter_flush(Qcow2Converter *q) {
+        _cleanup_(qcow2_batch_freep) Qcow2Batch *b = NULL;
+        int r;
+
+        assert(q);
+
+        b = TAKE_PTR(q->batch);
+        if (!b)
+                return 0;
+
+        if (q->n_threads == 0) {
+                if (!q->output) {
+                        q->output = malloc(q->cluster_size);
+                        if (!q->output)
+                                return -ENOMEM;
+                }
+
+                return qcow2_batch_decompress(b, q->qcow2_fd, q->raw_fd, q->cluster_size, &q->buffer, &q->buffer_allocated, q->output);
+        }
+
+        /* Hand the batch to the threads, waiting for room if necessary */
+
+        qcow2_converter_lock(q);
+
+        while (q->n_queued >= QCOW2_QUEUE_MAX && q->error == 0)
+                assert_se(pthread_cond_wait(&q->cond, &q->mutex) == 0);
+
+        r = q->error;
+        if (r == 0) {
+                q->queue[(q->head + q->n_queued) % QCOW2_QUEUE_MAX] = TAKE_PTR(b);
+                q->n_queued++;
+                assert_se(pthread_cond_broadcast(&q->cond) == 0);
+        }
+
+        qcow2_converter_unlock(q);
+
+        return r;
+}
+
+static int qcow2_converter_add(Qcow2Converter *q, uint64_t soffset, uint64_t compressed_size, uint64_t doffset) {
+        Qcow2Batch *b;
+        int r;
+
+        assert(q);
+
+        /* Compressed clusters are usually stored back to back, in the order of the image. Collect them into
+         * batches that can be read in one go. The sizes are rounded up to the next sector, hence the ranges
+         * may overlap a bit. */
+
+        b = q->batch;
+        if (b &&
+            (soffset < b->soffset ||
+             soffset > b->soffset + b->size ||
+             soffset + compressed_size - b->soffset > QCOW2_BATCH_MAX)) {
+
+                r = qcow2_converter_flush(q);
+                if (r < 0)
+                        return r;
+
+                b = NULL;
+        }
+
+        if (!b) {
+                b = new0(Qcow2Batch, 1);
+                if (!b)
+                        return -ENOMEM;
+
+                b->soffset = soffset;
+                q->batch = b;
+        }
+
+        if (!GREEDY_REALLOC(b->clusters, b->n_allocated, b->n_clusters + 1))
+                return -ENOMEM;
+
+        b->clusters[b->n_clusters++] = (Qcow2Cluster) {
+                .offset = soffset - b->soffset,
+                .compressed_size = compressed_size,
+                .doffset = doffset,
+        };
+
+        b->size = MAX(b->size, soffset + compressed_size - b->soffset);
+
         return 0;
 }
 
@@ -227,9 +583,10 @@ static int verify_header(const Header *header) {
 }
 
 int qcow2_convert(int qcow2_fd, int raw_fd) {
-        _cleanup_free_ void *buffer1 = NULL, *buffer2 = NULL;
+        _cleanup_free_ void *buffer = NULL;
         _cleanup_free_ be64_t *l1_table = NULL, *l2_table = NULL;
-        uint64_t sz, i;
+        uint64_t sz, i, run_soffset = 0, run_doffset = 0, run_size = 0;
+        Qcow2Converter q;
         Header header;
         ssize_t l;
         int r;
@@ -252,12 +609,8 @@ int qcow2_convert(int qcow2_fd, int raw_fd) {
         if (!l2_table)
                 return -ENOMEM;
 
-        buffer1 = malloc(HEADER_CLUSTER_SIZE(&header));
-        if (!buffer1)
-                return -ENOMEM;
-
-        buffer2 = malloc(HEADER_CLUSTER_SIZE(&header));
-        if (!buffer2)
+        buffer = malloc(QCOW2_BATCH_MAX);
+        if (!buffer)
                 return -ENOMEM;
 
         /* Empty the file if it exists, we rely on zero bits */
@@ -274,20 +627,36 @@ int qcow2_convert(int qcow2_fd, int raw_fd) {
         if ((uint64_t) l != sz)
                 return -EIO;
 
+        /* Uncompressed clusters are copied here, in runs that are adjacent both in the image and in the
+         * output. Compressed clusters are collected into batches and inflated by a bunch of threads. */
+        q = (Qcow2Converter) {
+                .mutex = PTHREAD_MUTEX_INITIALIZER,
+                .cond = PTHREAD_COND_INITIALIZER,
+                .qcow2_fd = qcow2_fd,
+                .raw_fd = raw_fd,
+                .cluster_size = HEADER_CLUSTER_SIZE(&header),
+        };
+
+        qcow2_converter_start(&q);
+
         for (i = 0; i < HEADER_L1_SIZE(&header); i ++) {
                 uint64_t l2_begin, j;
 
                 r = normalize_offset(&header, l1_table[i], &l2_begin, NULL, NULL);
                 if (r < 0)
-                        return r;
+                        goto finish;
                 if (r == 0)
                         continue;
 
                 l = pread(qcow2_fd, l2_table, HEADER_CLUSTER_SIZE(&header), l2_begin);
-                if (l < 0)
-                        return -errno;
-                if ((uint64_t) l != HEADER_CLUSTER_SIZE(&header))
-                        return -EIO;
+                if (l < 0) {
+                        r = -errno;
+                        goto finish;
+                }
+                if ((uint64_t) l != HEADER_CLUSTER_SIZE(&header)) {
+                        r = -EIO;
+                        goto finish;
+                }
 
                 for (j = 0; j < HEADER_L2_SIZE(&header); j++) {
                         uint64_t data_begin, p, compressed_size;
@@ -297,27 +666,57 @@ int qcow2_convert(int qcow2_fd, int raw_fd) {
 
                         r = normalize_offset(&header, l2_table[j], &data_begin, &compressed, &compressed_size);
                         if (r < 0)
-                                return r;
+                                goto finish;
                         if (r == 0)
+                                continue; /* Holes and zero clusters stay holes */
+
+                        if (compressed) {
+                                r = qcow2_converter_add(&q, data_begin, compressed_size, p);
+                                if (r < 0)
+                                        goto finish;
+
                                 continue;
+                        }
 
-                        if (compressed)
-                                r = decompress_cluster(
-                                                qcow2_fd, data_begin,
-                                                raw_fd, p,
-                                                compressed_size, HEADER_CLUSTER_SIZE(&header),
-                                                buffer1, buffer2);
-                        else
-                                r = copy_cluster(
-                                                qcow2_fd, data_begin,
-                                                raw_fd, p,
-                                                HEADER_CLUSTER_SIZE(&header), buffer1);
+                        if (run_size > 0 &&
+                            run_soffset + run_size == data_begin &&
+                            run_doffset + run_size == p) {
+                                run_size += HEADER_CLUSTER_SIZE(&header);
+                                continue;
+                        }
+
+                        if (run_size > 0) {
+                                r = copy_clusters(qcow2_fd, run_soffset, raw_fd, run_doffset, run_size, HEADER_CLUSTER_SIZE(&header), buffer);
+                                if (r < 0)
+                                        goto finish;
+                        }
+
+                        run_soffset = data_begin;
+                        run_doffset = p;
+                        run_size = HEADER_CLUSTER_SIZE(&header);
+
+                        /* Don't keep going if one of the threads failed */
+                        r = qcow2_converter_get_error(&q);
                         if (r < 0)
-                                return r;
+                                goto finish;
                 }
         }
 
-        return 0;
+        if (run_size > 0) {
+                r = copy_clusters(qcow2_fd, run_soffset, raw_fd, run_doffset, run_size, HEADER_CLUSTER_SIZE(&header), buffer);
+                if (r < 0)
+                        goto finish;
+        }
+
+        r = qcow2_converter_flush(&q);
+
+finish:
+        if (r < 0)
+                qcow2_converter_fail(&q, r);
+
+        qcow2_converter_done(&q);
+
+        return r < 0 ? r : q.error;
 }
 
 int qcow2_detect(int fd) {
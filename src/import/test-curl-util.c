@@ -0,0 +1,94 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include "alloc-util.h"
+#include "curl-util.h"
+#include "string-util.h"
+#include "tests.h"
+
+static void test_parse_content_range(void) {
+        uint64_t first, last, total;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(curl_parse_content_range("bytes 0-16777215/1073741824", &first, &last, &total) >= 0);
+        assert_se(first == 0);
+        assert_se(last == 16777215);
+        assert_se(total == 1073741824);
+
+        assert_se(curl_parse_content_range("bytes 5-5/6", &first, &last, &total) >= 0);
+        assert_se(first == 5);
+        assert_se(last == 5);
+        assert_se(total == 6);
+
+        /* A refused range, e.g. for an empty file */
+        assert_se(curl_parse_content_range("bytes */0", &first, &last, &total) >= 0);
+        assert_se(first == UINT64_MAX);
+        assert_se(last == UINT64_MAX);
+        assert_se(total == 0);
+
+        assert_se(curl_parse_content_range("bytes 0-9/10", NULL, NULL, NULL) >= 0);
+
+        /* The total size has to be known */
+        assert_se(curl_parse_content_range("bytes 0-9/*", &first, &last, &total) == -EINVAL);
+
+        assert_se(curl_parse_content_range("bytes 0-10/10", &first, &last, &total) == -EINVAL);
+        assert_se(curl_parse_content_range("bytes 9-0/10", &first, &last, &total) == -EINVAL);
+        assert_se(curl_parse_content_range("bytes 0/10", &first, &last, &total) == -EINVAL);
+        assert_se(curl_parse_content_range("bytes -9/10", &first, &last, &total) == -EINVAL);
+        assert_se(curl_parse_content_range("bytes 0-9", &first, &last, &total) == -EINVAL);
+        assert_se(curl_parse_content_range("items 0-9/10", &first, &last, &total) == -EINVAL);
+        assert_se(curl_parse_content_range("", &first, &last, &total) == -EINVAL);
+}
+
+static void test_make_if_range(void) {
+        char *h;
+
+        log_info("/* %s */", __func__);
+
+        /* A strong ETag is preferred */
+        assert_se(curl_make_if_range("\"abc\"", "Thu, 15 Oct 2026 00:00:00 GMT", &h) == 1);
+        assert_se(streq(h, "If-Range: \"abc\""));
+        h = mfree(h);
+
+        /* A weak one is not allowed, fall back to the date */
+        assert_se(curl_make_if_range("W/\"abc\"", "Thu, 15 Oct 2026 00:00:00 GMT", &h) == 1);
+        assert_se(streq(h, "If-Range: Thu, 15 Oct 2026 00:00:00 GMT"));
+        h = mfree(h);
+
+        assert_se(curl_make_if_range(NULL, "Thu, 15 Oct 2026 00:00:00 GMT", &h) == 1);
+        assert_se(streq(h, "If-Range: Thu, 15 Oct 2026 00:00:00 GMT"));
+        h = mfree(h);
+
+        /* Nothing to pin the ranges to */
+        assert_se(curl_make_if_range("W/\"abc\"", NULL, &h) == 0);
+        assert_se(!h);
+        assert_se(curl_make_if_range(NULL, NULL, &h) == 0);
+        assert_se(!h);
+}
+
+static void test_header_strdup(void) {
+        static const char header[] = "Content-Range:  bytes 0-9/10 \r\n";
+        char *v = NULL;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(curl_header_strdup(header, strlen(header), "Content-Range:", &v) == 1);
+        assert_se(streq(v, "bytes 0-9/10"));
+        v = mfree(v);
+
+        assert_se(curl_header_strdup(header, strlen(header), "content-range:", &v) == 1);
+        v = mfree(v);
+
+        assert_se(curl_header_strdup(header, strlen(header), "Content-Length:", &v) == 0);
+        assert_se(!v);
+}
+
+int main(int argc, char *argv[]) {
+        test_setup_logging(LOG_DEBUG);
+
+        test_parse_content_range();
+        test_make_if_range();
+        test_header_strdup();
+
+        return 0;
+}
@@ -5,15 +5,20 @@
 #include <sys/types.h>
 
 #include "fd-util.h"
+#include "format-util.h"
 #include "log.h"
 #include "qcow2-util.h"
+#include "time-util.h"
 
 int main(int argc, char *argv[]) {
         _cleanup_close_ int sfd = -1, dfd = -1;
+        char buf[FORMAT_TIMESPAN_MAX], bytes[FORMAT_BYTES_MAX], allocated[FORMAT_BYTES_MAX];
+        usec_t n, dt;
+        struct stat st;
         int r;
 
-        if (argc != 3) {
-                log_error("Needs two arguments.");
+        if (!IN_SET(argc, 2, 3)) {
+                log_error("Needs one or two arguments.");
                 return EXIT_FAILURE;
         }
 
@@ -23,17 +28,41 @@ int main(int argc, char *argv[]) {
                 return EXIT_FAILURE;
         }
 
-        dfd = open(argv[2], O_WRONLY|O_CREAT|O_CLOEXEC|O_NOCTTY, 0666);
+        /* Without a destination, just measure how fast we are, by converting into an anonymous file */
+        if (argc == 3)
+                dfd = open(argv[2], O_WRONLY|O_CREAT|O_CLOEXEC|O_NOCTTY, 0666);
+        else
+                dfd = open("/var/tmp", O_WRONLY|O_TMPFILE|O_CLOEXEC|O_NOCTTY, 0600);
         if (dfd < 0) {
                 log_error_errno(errno, "Can't open destination file: %m");
                 return EXIT_FAILURE;
         }
 
+        n = now(CLOCK_MONOTONIC);
+
         r = qcow2_convert(sfd, dfd);
         if (r < 0) {
                 log_error_errno(r, "Failed to unpack: %m");
                 return EXIT_FAILURE;
         }
 
+        if (fsync(dfd) < 0) {
+                log_error_errno(errno, "Failed to sync destination file: %m");
+                return EXIT_FAILURE;
+        }
+
+        dt = now(CLOCK_MONOTONIC) - n;
+
+        if (fstat(dfd, &st) < 0) {
+                log_error_errno(errno, "Failed to stat destination file: %m");
+                return EXIT_FAILURE;
+        }
+
+        log_info("Unpacked %s image in %s (%.2fMiB/s), %s allocated.",
+                 format_bytes(bytes, sizeof(bytes), st.st_size),
+                 format_timespan(buf, sizeof(buf), dt, USEC_PER_MSEC),
+                 dt > 0 ? st.st_size / 1024. / 1024. / ((double) dt / USEC_PER_SEC) : 0.,
+                 format_bytes(allocated, sizeof(allocated), (uint64_t) st.st_blocks * 512));
+
         return EXIT_SUCCESS;
 }
@@ -8,6 +8,9 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
+#if HAVE_ZLIB
+#include <zlib.h>
+#endif
 
 #include "sd-bus.h"
 #include "sd-daemon.h"
@@ -32,6 +35,9 @@
 
 #define JOURNAL_WAIT_TIMEOUT (10*USEC_PER_SEC)
 
+/* We format as many entries as fit into this at once, rather than one entry per callback invocation */
+#define ENTRIES_CHUNK_SIZE (64U*1024U)
+
 static char *arg_key_pem = NULL;
 static char *arg_cert_pem = NULL;
 static char *arg_trust_pem = NULL;
@@ -54,6 +60,17 @@ typedef struct RequestMeta {
         FILE *tmp;
         uint64_t delta, size;
 
+        /* The entries formatted last, covering the stream from delta to delta + size */
+        char *chunk;
+        size_t chunk_allocated;
+        bool eof;
+
+#if HAVE_ZLIB
+        bool gzip;
+        bool gzip_initialized;
+        z_stream gzip_stream;
+#endif
+
         int argument_parse_error;
 
         bool follow;
@@ -100,6 +117,12 @@ static void request_meta_free(
         sd_journal_close(m->journal);
 
         safe_fclose(m->tmp);
+        free(m->chunk);
+
+#if HAVE_ZLIB
+        if (m->gzip_initialized)
+                deflateEnd(&m->gzip_stream);
+#endif
 
         free(m->cursor);
         free(m);
@@ -137,32 +160,70 @@ static int request_meta_ensure_tmp(RequestMeta *m) {
         return 0;
 }
 
-static ssize_t request_reader_entries(
-                void *cls,
-                uint64_t pos,
-                char *buf,
-                size_t max) {
+#if HAVE_ZLIB
+static int request_meta_compress(RequestMeta *m, const void *data, size_t size) {
+        int r;
 
-        RequestMeta *m = cls;
+        assert(m);
+        assert(data || size == 0);
+
+        if (!m->gzip_initialized) {
+                /* 15 + 16 selects the gzip format, rather than plain zlib */
+                r = deflateInit2(&m->gzip_stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY);
+                if (r != Z_OK)
+                        return -ENOMEM;
+
+                m->gzip_initialized = true;
+        }
+
+        m->gzip_stream.next_in = (void*) data;
+        m->gzip_stream.avail_in = size;
+        m->size = 0;
+
+        /* Flush after each chunk, so that followers see entries right-away, and finish the stream with the
+         * last one. */
+        for (;;) {
+                size_t available;
+
+                if (!GREEDY_REALLOC(m->chunk, m->chunk_allocated, m->size + ENTRIES_CHUNK_SIZE / 4))
+                        return -ENOMEM;
+
+                available = m->chunk_allocated - m->size;
+                m->gzip_stream.next_out = (uint8_t*) m->chunk + m->size;
+                m->gzip_stream.avail_out = available;
+
+                r = deflate(&m->gzip_stream, m->eof ? Z_FINISH : Z_SYNC_FLUSH);
+                if (!IN_SET(r, Z_OK, Z_STREAM_END, Z_BUF_ERROR))
+                        return -EIO;
+
+                m->size += available - m->gzip_stream.avail_out;
+
+                if (m->eof ? r == Z_STREAM_END : m->gzip_stream.avail_out > 0)
+                        return 0;
+        }
+}
+#endif
+
+static int request_meta_fill_entries(RequestMeta *m) {
+        _cleanup_fclose_ FILE *f = NULL;
+        _cleanup_free_ char *data = NULL;
+        size_t size = 0;
         int r;
-        size_t n, k;
 
         assert(m);
-        assert(buf);
-        assert(max > 0);
-        assert(pos >= m->delta);
 
-        pos -= m->delta;
+        f = open_memstream_unlocked(&data, &size);
+        if (!f)
+                return log_oom();
 
-        while (pos >= m->size) {
+        for (;;) {
                 off_t sz;
 
-                /* End of this entry, so let's serialize the next
-                 * one */
-
                 if (m->n_entries_set &&
-                    m->n_entries <= 0)
-                        return MHD_CONTENT_READER_END_OF_STREAM;
+                    m->n_entries <= 0) {
+                        m->eof = true;
+                        break;
+                }
 
                 if (m->n_skip < 0)
                         r = sd_journal_previous_skip(m->journal, (uint64_t) -m->n_skip + 1);
@@ -171,91 +232,116 @@ static ssize_t request_reader_entries(
                 else
                         r = sd_journal_next(m->journal);
 
-                if (r < 0) {
-                        log_error_errno(r, "Failed to advance journal pointer: %m");
-                        return MHD_CONTENT_READER_END_WITH_ERROR;
-                } else if (r == 0) {
+                if (r < 0)
+                        return log_error_errno(r, "Failed to advance journal pointer: %m");
+                else if (r == 0) {
 
                         if (m->follow) {
+                                /* Don't hold back what we have already while waiting for more */
+                                if (ftello(f) > 0)
+                                        break;
+
                                 r = sd_journal_wait(m->journal, (uint64_t) JOURNAL_WAIT_TIMEOUT);
-                                if (r < 0) {
-                                        log_error_errno(r, "Couldn't wait for journal event: %m");
-                                        return MHD_CONTENT_READER_END_WITH_ERROR;
-                                }
+                                if (r < 0)
+                                        return log_error_errno(r, "Couldn't wait for journal event: %m");
                                 if (r == SD_JOURNAL_NOP)
                                         break;
 
                                 continue;
                         }
 
-                        return MHD_CONTENT_READER_END_OF_STREAM;
+                        m->eof = true;
+                        break;
                 }
 
                 if (m->discrete) {
                         assert(m->cursor);
 
                         r = sd_journal_test_cursor(m->journal, m->cursor);
-                        if (r < 0) {
-                                log_error_errno(r, "Failed to test cursor: %m");
-                                return MHD_CONTENT_READER_END_WITH_ERROR;
-                        }
+                        if (r < 0)
+                                return log_error_errno(r, "Failed to test cursor: %m");
 
-                        if (r == 0)
-                                return MHD_CONTENT_READER_END_OF_STREAM;
+                        if (r == 0) {
+                                m->eof = true;
+                                break;
+                        }
                 }
 
-                pos -= m->size;
-                m->delta += m->size;
-
                 if (m->n_entries_set)
                         m->n_entries -= 1;
 
                 m->n_skip = 0;
 
-                r = request_meta_ensure_tmp(m);
-                if (r < 0) {
-                        log_error_errno(r, "Failed to create temporary file: %m");
-                        return MHD_CONTENT_READER_END_WITH_ERROR;
-                }
-
-                r = show_journal_entry(m->tmp, m->journal, m->mode, 0, OUTPUT_FULL_WIDTH,
+                r = show_journal_entry(f, m->journal, m->mode, 0, OUTPUT_FULL_WIDTH,
                                    NULL, NULL, NULL);
-                if (r < 0) {
-                        log_error_errno(r, "Failed to serialize item: %m");
-                        return MHD_CONTENT_READER_END_WITH_ERROR;
-                }
+                if (r < 0)
+                        return log_error_errno(r, "Failed to serialize item: %m");
 
-                sz = ftello(m->tmp);
-                if (sz == (off_t) -1) {
-                        log_error_errno(errno, "Failed to retrieve file position: %m");
-                        return MHD_CONTENT_READER_END_WITH_ERROR;
-                }
+                sz = ftello(f);
+                if (sz == (off_t) -1)
+                        return log_error_errno(errno, "Failed to retrieve file position: %m");
 
-                m->size = (uint64_t) sz;
+                if ((uint64_t) sz >= ENTRIES_CHUNK_SIZE)
+                        break;
         }
 
-        if (m->tmp == NULL && m->follow)
-                return 0;
+        r = fflush_and_check(f);
+        if (r < 0)
+                return log_error_errno(r, "Failed to format entries: %m");
 
-        if (fseeko(m->tmp, pos, SEEK_SET) < 0) {
-                log_error_errno(errno, "Failed to seek to position: %m");
-                return MHD_CONTENT_READER_END_WITH_ERROR;
-        }
+        f = safe_fclose(f);
 
-        n = m->size - pos;
-        if (n < 1)
-                return 0;
-        if (n > max)
-                n = max;
+#if HAVE_ZLIB
+        if (m->gzip)
+                return request_meta_compress(m, data, size);
+#endif
 
-        errno = 0;
-        k = fread(buf, 1, n, m->tmp);
-        if (k != n) {
-                log_error("Failed to read from file: %s", errno != 0 ? strerror_safe(errno) : "Premature EOF");
-                return MHD_CONTENT_READER_END_WITH_ERROR;
+        free_and_replace(m->chunk, data);
+        m->chunk_allocated = m->size = size;
+
+        return 0;
+}
+
+static ssize_t request_reader_entries(
+                void *cls,
+                uint64_t pos,
+                char *buf,
+                size_t max) {
+
+        RequestMeta *m = cls;
+        size_t n;
+        int r;
+
+        assert(m);
+        assert(buf);
+        assert(max > 0);
+        assert(pos >= m->delta);
+
+        pos -= m->delta;
+
+        while (pos >= m->size) {
+                /* End of this chunk, so let's serialize the next one */
+
+                if (m->eof)
+                        return MHD_CONTENT_READER_END_OF_STREAM;
+
+                pos -= m->size;
+                m->delta += m->size;
+                m->size = 0;
+
+                r = request_meta_fill_entries(m);
+                if (r < 0)
+                        return MHD_CONTENT_READER_END_WITH_ERROR;
+
+                /* Nothing new while following, let's get called again */
+                if (m->size == 0 && !m->eof)
+                        return 0;
         }
 
-        return (ssize_t) k;
+        n = MIN(m->size - pos, max);
+        memcpy(buf, m->chunk + pos, n);
+
+        return (ssize_t) n;
 }
 
 static int request_parse_accept(
@@ -285,6 +371,26 @@ static int request_parse_accept(
         return 0;
 }
 
+static int request_parse_accept_encoding(
+                RequestMeta *m,
+                struct MHD_Connection *connection) {
+
+        const char *header;
+
+        assert(m);
+        assert(connection);
+
+        header = MHD_lookup_connection_value(connection, MHD_HEADER_KIND, "Accept-Encoding");
+        if (!header)
+                return 0;
+
+#if HAVE_ZLIB
+        m->gzip = http_accept_encoding_allows(header, "gzip");
+#endif
+
+        return 0;
+}
+
 static int request_parse_range(
                 RequestMeta *m,
                 struct MHD_Connection *connection) {
@@ -476,6 +582,9 @@ static int request_handler_entries(
         if (request_parse_accept(m, connection) < 0)
                 return mhd_respond(connection, MHD_HTTP_BAD_REQUEST, "Failed to parse Accept header.");
 
+        if (request_parse_accept_encoding(m, connection) < 0)
+                return mhd_respond(connection, MHD_HTTP_BAD_REQUEST, "Failed to parse Accept-Encoding header.");
+
         if (request_parse_range(m, connection) < 0)
                 return mhd_respond(connection, MHD_HTTP_BAD_REQUEST, "Failed to parse Range header.");
 
@@ -499,11 +608,16 @@ static int request_handler_entries(
         if (r < 0)
                 return mhd_respond(connection, MHD_HTTP_BAD_REQUEST, "Failed to seek in journal.");
 
-        response = MHD_create_response_from_callback(MHD_SIZE_UNKNOWN, 4*1024, request_reader_entries, m, NULL);
+        response = MHD_create_response_from_callback(MHD_SIZE_UNKNOWN, ENTRIES_CHUNK_SIZE, request_reader_entries, m, NULL);
         if (!response)
                 return respond_oom(connection);
 
         MHD_add_response_header(response, "Content-Type", mime_types[m->mode]);
+#if HAVE_ZLIB
+        if (m->gzip)
+                MHD_add_response_header(response, "Content-Encoding", "gzip");
+#endif
+        MHD_add_response_header(response, "Vary", "Accept-Encoding");
         return MHD_queue_response(connection, MHD_HTTP_OK, response);
 }
 
@@ -39,6 +39,7 @@ static int http_socket = -1, https_socket = -1;
 static char** arg_gnutls_log = NULL;
 
 static JournalWriteSplitMode arg_split_mode = _JOURNAL_WRITE_SPLIT_INVALID;
+static unsigned arg_threads = 0;
 static const char* arg_output = NULL;
 
 static char *arg_key = NULL;
@@ -147,7 +148,7 @@ static int dispatch_http_event(sd_event_source *event,
                                uint32_t revents,
                                void *userdata);
 
-static int request_meta(void **connection_cls, int fd, char *hostname) {
+static int request_meta(void **connection_cls, int fd, char *hostname, bool binary) {
         RemoteSource *source;
         Writer *writer;
         int r;
@@ -167,6 +168,8 @@ static int request_meta(void **connection_cls, int fd, char *hostname) {
                 return log_oom();
         }
 
+        source->importer.binary = binary;
+
         log_debug("Added RemoteSource as connection metadata %p", source);
 
         *connection_cls = source;
@@ -266,7 +269,7 @@ static int request_handler(
         const char *header;
         int r, code, fd;
         _cleanup_free_ char *hostname = NULL;
-        bool chunked = false;
+        bool chunked = false, binary;
 
         assert(connection);
         assert(connection_cls);
@@ -287,9 +290,12 @@ static int request_handler(
                 return mhd_respond(connection, MHD_HTTP_NOT_FOUND, "Not found.");
 
         header = MHD_lookup_connection_value(connection, MHD_HEADER_KIND, "Content-Type");
-        if (!header || !streq(header, "application/vnd.fdo.journal"))
+        if (!header || !STR_IN_SET(header, "application/vnd.fdo.journal", JOURNAL_BINARY_CONTENT_TYPE))
                 return mhd_respond(connection, MHD_HTTP_UNSUPPORTED_MEDIA_TYPE,
-                                   "Content-Type: application/vnd.fdo.journal is required.");
+                                   "Content-Type: application/vnd.fdo.journal or "
+                                   JOURNAL_BINARY_CONTENT_TYPE " is required.");
+
+        binary = streq(header, JOURNAL_BINARY_CONTENT_TYPE);
 
         header = MHD_lookup_connection_value(connection, MHD_HEADER_KIND, "Transfer-Encoding");
         if (header) {
@@ -349,7 +355,7 @@ static int request_handler(
 
         assert(hostname);
 
-        r = request_meta(connection_cls, fd, hostname);
+        r = request_meta(connection_cls, fd, hostname, binary);
         if (r == -ENOMEM)
                 return respond_oom(connection);
         else if (r < 0)
@@ -604,6 +610,15 @@ static int create_remoteserver(
         if (r < 0)
                 return log_error_errno(r, "Failed to set up signals: %m");
 
+        if (arg_threads > 0) {
+                if (arg_split_mode == JOURNAL_WRITE_SPLIT_HOST) {
+                        r = journal_remote_start_shards(s, arg_threads);
+                        if (r < 0)
+                                return r;
+                } else
+                        log_notice("Threads= is only supported with SplitMode=host, ignoring.");
+        }
+
         n = sd_listen_fds(true);
         if (n < 0)
                 return log_error_errno(n, "Failed to read listening file descriptors from environment: %m");
@@ -756,6 +771,7 @@ static int parse_config(void) {
         const ConfigTableItem items[] = {
                 { "Remote",  "Seal",                   config_parse_bool,             0, &arg_seal       },
                 { "Remote",  "SplitMode",              config_parse_write_split_mode, 0, &arg_split_mode },
+                { "Remote",  "Threads",                config_parse_unsigned,         0, &arg_threads    },
                 { "Remote",  "ServerKeyFile",          config_parse_path,             0, &arg_key        },
                 { "Remote",  "ServerCertificateFile",  config_parse_path,             0, &arg_cert       },
                 { "Remote",  "TrustedCertificateFile", config_parse_path,             0, &arg_trust      },
@@ -797,6 +813,7 @@ static int help(void) {
                "     --gnutls-log=CATEGORY...\n"
                "                            Specify a list of gnutls logging categories\n"
                "     --split-mode=none|host How many output files to create\n"
+               "     --threads=N            Spread raw connections over N threads\n"
                "\nNote: file descriptors from sd_listen_fds() will be consumed, too.\n"
                "\nSee the %s for details.\n"
                , program_invocation_short_name
@@ -821,6 +838,7 @@ static int parse_argv(int argc, char *argv[]) {
                 ARG_CERT,
                 ARG_TRUST,
                 ARG_GNUTLS_LOG,
+                ARG_THREADS,
         };
 
         static const struct option options[] = {
@@ -839,6 +857,7 @@ static int parse_argv(int argc, char *argv[]) {
                 { "cert",         required_argument, NULL, ARG_CERT         },
                 { "trust",        required_argument, NULL, ARG_TRUST        },
                 { "gnutls-log",   required_argument, NULL, ARG_GNUTLS_LOG   },
+                { "threads",      required_argument, NULL, ARG_THREADS      },
                 {}
         };
 
@@ -963,6 +982,12 @@ static int parse_argv(int argc, char *argv[]) {
                                                        "Invalid split mode: %s", optarg);
                         break;
 
+                case ARG_THREADS:
+                        r = safe_atou(optarg, &arg_threads);
+                        if (r < 0)
+                                return log_error_errno(r, "Failed to parse --threads= parameter: %s", optarg);
+                        break;
+
                 case ARG_COMPRESS:
                         if (optarg) {
                                 r = parse_boolean(optarg);
@@ -1047,6 +1072,10 @@ static int parse_argv(int argc, char *argv[]) {
         if (arg_split_mode == _JOURNAL_WRITE_SPLIT_INVALID)
                 arg_split_mode = JOURNAL_WRITE_SPLIT_HOST;
 
+        if (arg_threads > REMOTE_SHARDS_MAX)
+                return log_error_errno(SYNTHETIC_ERRNO(EINVAL),
+                                       "Number of threads must be at most %u.", REMOTE_SHARDS_MAX);
+
         if (arg_split_mode == JOURNAL_WRITE_SPLIT_NONE && arg_output) {
                 if (is_dir(arg_output, true) > 0)
                         return log_error_errno(SYNTHETIC_ERRNO(EINVAL),
@@ -1160,6 +1189,9 @@ static int run(int argc, char **argv) {
                         return log_error_errno(r, "Failed to run event loop: %m");
         }
 
+        /* Let the other threads finish what they were writing */
+        journal_remote_stop_shards(&s);
+
         notify_message = NULL;
         (void) sd_notifyf(false,
                           "STOPPING=1\n"
@@ -4,7 +4,7 @@
 #include "journal-remote.h"
 
 static int do_rotate(JournalFile **f, bool compress, bool seal) {
-        int r = journal_file_rotate(f, compress, (uint64_t) -1, seal, NULL);
+        int r = journal_file_rotate(f, compress ? DEFAULT_COMPRESSION : 0, (uint64_t) -1, seal, NULL);
         if (r < 0) {
                 if (*f)
                         log_error_errno(r, "Failed to rotate %s: %m", (*f)->path);
@@ -22,6 +22,7 @@ Writer* writer_new(RemoteServer *server) {
         if (!w)
                 return NULL;
 
+        w->mutex = (pthread_mutex_t) PTHREAD_MUTEX_INITIALIZER;
         memset(&w->metrics, 0xFF, sizeof(w->metrics));
 
         w->mmap = mmap_cache_new();
@@ -43,25 +44,71 @@ static Writer* writer_free(Writer *w) {
                 journal_file_close(w->journal);
         }
 
-        if (w->server && w->hashmap_key)
-                hashmap_remove(w->server->writers, w->hashmap_key);
-
         free(w->hashmap_key);
 
         if (w->mmap)
                 mmap_cache_unref(w->mmap);
 
+        assert_se(pthread_mutex_destroy(&w->mutex) == 0);
+
         return mfree(w);
 }
 
-DEFINE_TRIVIAL_REF_UNREF_FUNC(Writer, writer, writer_free);
+/* Writers registered with a server may be looked up and released from several threads, hence the
+ * reference count is only changed while holding the lock of the server's writers hashmap. */
 
-int writer_write(Writer *w,
-                 struct iovec_wrapper *iovw,
-                 dual_timestamp *ts,
-                 sd_id128_t *boot_id,
-                 bool compress,
-                 bool seal) {
+Writer* writer_ref(Writer *w) {
+        if (!w)
+                return NULL;
+
+        if (w->server)
+                assert_se(pthread_mutex_lock(&w->server->writers_mutex) == 0);
+
+        assert(w->n_ref > 0);
+        w->n_ref++;
+
+        if (w->server)
+                assert_se(pthread_mutex_unlock(&w->server->writers_mutex) == 0);
+
+        return w;
+}
+
+Writer* writer_unref(Writer *w) {
+        unsigned n_ref;
+
+        if (!w)
+                return NULL;
+
+        if (w->server)
+                assert_se(pthread_mutex_lock(&w->server->writers_mutex) == 0);
+
+        assert(w->n_ref > 0);
+        n_ref = --w->n_ref;
+
+        if (n_ref == 0 && w->server && w->hashmap_key)
+                hashmap_remove(w->server->writers, w->hashmap_key);
+
+        if (w->server)
+                assert_se(pthread_mutex_unlock(&w->server->writers_mutex) == 0);
+
+        if (n_ref > 0)
+                return NULL;
+
+        return writer_free(w);
+}
+
+static void writer_count_entry(Writer *w) {
+        if (w->server)
+                (void) __atomic_add_fetch(&w->server->event_count, 1, __ATOMIC_RELAXED);
+}
+
+static int writer_write_locked(
+                Writer *w,
+                struct iovec_wrapper *iovw,
+                dual_timestamp *ts,
+                sd_id128_t *boot_id,
+                bool compress,
+                bool seal) {
         int r;
 
         assert(w);
@@ -80,8 +127,7 @@ int writer_write(Writer *w,
                                       iovw->iovec, iovw->count,
                                       &w->seqnum, NULL, NULL);
         if (r >= 0) {
-                if (w->server)
-                        w->server->event_count += 1;
+                writer_count_entry(w);
                 return 0;
         } else if (r == -EBADMSG)
                 return r;
@@ -100,7 +146,23 @@ int writer_write(Writer *w,
         if (r < 0)
                 return r;
 
-        if (w->server)
-                w->server->event_count += 1;
+        writer_count_entry(w);
         return 0;
 }
+
+int writer_write(Writer *w,
+                 struct iovec_wrapper *iovw,
+                 dual_timestamp *ts,
+                 sd_id128_t *boot_id,
+                 bool compress,
+                 bool seal) {
+        int r;
+
+        assert(w);
+
+        assert_se(pthread_mutex_lock(&w->mutex) == 0);
+        r = writer_write_locked(w, iovw, ts, boot_id, compress, seal);
+        assert_se(pthread_mutex_unlock(&w->mutex) == 0);
+
+        return r;
+}
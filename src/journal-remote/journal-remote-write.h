@@ -1,12 +1,17 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 #pragma once
 
+#include <pthread.h>
+
 #include "journal-file.h"
 #include "journal-importer.h"
 
 typedef struct RemoteServer RemoteServer;
 
 typedef struct Writer {
+        /* Serializes writes to the output file, which may be shared by several threads */
+        pthread_mutex_t mutex;
+
         JournalFile *journal;
         JournalMetrics metrics;
 
@@ -2,7 +2,9 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <stdlib.h>
+#include <sys/eventfd.h>
 #include <sys/prctl.h>
 #include <stdint.h>
 
@@ -13,6 +15,7 @@
 #include "errno-util.h"
 #include "escape.h"
 #include "fd-util.h"
+#include "io-util.h"
 #include "journal-file.h"
 #include "journal-remote-write.h"
 #include "journal-remote.h"
@@ -20,6 +23,7 @@
 #include "macro.h"
 #include "parse-util.h"
 #include "process-util.h"
+#include "siphash24.h"
 #include "socket-util.h"
 #include "stdio-util.h"
 #include "string-util.h"
@@ -27,6 +31,8 @@
 
 #define REMOTE_JOURNAL_PATH "/var/log/journal/remote"
 
+#define SHARD_HASH_KEY SD_ID128_MAKE(2d,eb,6f,91,1d,5c,47,66,b0,11,42,5d,5c,90,4b,d7)
+
 #define filename_escape(s) xescape((s), "/ ")
 
 static int open_output(RemoteServer *s, Writer *w, const char* host) {
@@ -62,7 +68,7 @@ static int open_output(RemoteServer *s, Writer *w, const char* host) {
 
         r = journal_file_open_reliably(filename,
                                        O_RDWR|O_CREAT, 0640,
-                                       s->compress, (uint64_t) -1, s->seal,
+                                       s->compress ? DEFAULT_COMPRESSION : 0, (uint64_t) -1, s->seal,
                                        &w->metrics,
                                        w->mmap, NULL,
                                        NULL, &w->journal);
@@ -93,7 +99,7 @@ static int init_writer_hashmap(RemoteServer *s) {
         return 0;
 }
 
-int journal_remote_get_writer(RemoteServer *s, const char *host, Writer **writer) {
+static int get_writer_locked(RemoteServer *s, const char *host, Writer **writer) {
         _cleanup_(writer_unrefp) Writer *w = NULL;
         const void *key;
         int r;
@@ -114,9 +120,11 @@ int journal_remote_get_writer(RemoteServer *s, const char *host, Writer **writer
 
         w = hashmap_get(s->writers, key);
         if (w)
-                writer_ref(w);
+                w->n_ref++;
         else {
-                w = writer_new(s);
+                /* The writer is only attached to the server once it is registered, so that dropping it
+                 * on failure doesn't try to take the lock we are holding */
+                w = writer_new(NULL);
                 if (!w)
                         return log_oom();
 
@@ -133,6 +141,8 @@ int journal_remote_get_writer(RemoteServer *s, const char *host, Writer **writer
                 r = hashmap_put(s->writers, w->hashmap_key ?: key, w);
                 if (r < 0)
                         return r;
+
+                w->server = s;
         }
 
         *writer = TAKE_PTR(w);
@@ -140,6 +150,24 @@ int journal_remote_get_writer(RemoteServer *s, const char *host, Writer **writer
         return 0;
 }
 
+int journal_remote_get_writer(RemoteServer *s, const char *host, Writer **writer) {
+        int r;
+
+        assert(s);
+        assert(writer);
+
+        /* Shards use the writers of the server they were started from, so that there's only ever one writer
+         * per output file, no matter which thread a connection is handled on. */
+        if (s->parent)
+                s = s->parent;
+
+        assert_se(pthread_mutex_lock(&s->writers_mutex) == 0);
+        r = get_writer_locked(s, host, writer);
+        assert_se(pthread_mutex_unlock(&s->writers_mutex) == 0);
+
+        return r;
+}
+
 /**********************************************************************
  **********************************************************************
  **********************************************************************/
@@ -185,6 +213,8 @@ static int get_source_for_fd(RemoteServer *s,
                         return log_oom();
                 }
 
+                s->sources[fd]->server = s;
+
                 s->active++;
         }
 
@@ -311,6 +341,7 @@ int journal_remote_server_init(
         assert(journal_remote_server_global == NULL);
         journal_remote_server_global = s;
 
+        s->writers_mutex = (pthread_mutex_t) PTHREAD_MUTEX_INITIALIZER;
         s->split_mode = split_mode;
         s->compress = compress;
         s->seal = seal;
@@ -347,6 +378,8 @@ static void MHDDaemonWrapper_free(MHDDaemonWrapper *d) {
 void journal_remote_server_destroy(RemoteServer *s) {
         size_t i;
 
+        journal_remote_stop_shards(s);
+
 #if HAVE_MICROHTTPD
         hashmap_free_with_destructor(s->daemons, MHDDaemonWrapper_free);
 #endif
@@ -370,6 +403,254 @@ void journal_remote_server_destroy(RemoteServer *s) {
         /* fds that we're listening on remain open... */
 }
 
+/**********************************************************************
+ **********************************************************************
+ **********************************************************************/
+
+typedef struct RemoteShardItem {
+        int fd;
+        char *hostname;
+} RemoteShardItem;
+
+struct RemoteShard {
+        /* The sources of this shard. Only ever touched from the shard's own thread, while it is running. The
+         * writers are shared with the main server. */
+        RemoteServer server;
+
+        pthread_t thread;
+        bool thread_started;
+
+        /* Connections handed over by the main thread, which signals the eventfd after queuing them */
+        pthread_mutex_t mutex;
+        RemoteShardItem *items;
+        size_t n_items, n_allocated;
+        bool quit;
+
+        int fd;
+        sd_event_source *event_source;
+};
+
+static void *remote_shard_thread(void *userdata) {
+        RemoteShard *shard = userdata;
+        int r;
+
+        (void) pthread_setname_np(pthread_self(), "journal-remote");
+
+        r = sd_event_loop(shard->server.events);
+        if (r < 0)
+                log_error_errno(r, "Failed to run event loop of shard: %m");
+
+        return NULL;
+}
+
+static int dispatch_shard_items(sd_event_source *event,
+                                int fd,
+                                uint32_t revents,
+                                void *userdata) {
+        RemoteShard *shard = userdata;
+        _cleanup_free_ RemoteShardItem *items = NULL;
+        size_t n, i;
+        bool quit;
+
+        (void) flush_fd(fd);
+
+        assert_se(pthread_mutex_lock(&shard->mutex) == 0);
+        items = TAKE_PTR(shard->items);
+        n = shard->n_items;
+        shard->n_items = shard->n_allocated = 0;
+        quit = shard->quit;
+        assert_se(pthread_mutex_unlock(&shard->mutex) == 0);
+
+        for (i = 0; i < n; i++)
+                (void) journal_remote_add_source(&shard->server, items[i].fd, items[i].hostname, true);
+
+        if (quit)
+                return sd_event_exit(shard->server.events, 0);
+
+        return 0;
+}
+
+static void remote_shard_join(RemoteShard *shard) {
+        assert(shard);
+
+        if (!shard->thread_started)
+                return;
+
+        assert_se(pthread_mutex_lock(&shard->mutex) == 0);
+        shard->quit = true;
+        assert_se(pthread_mutex_unlock(&shard->mutex) == 0);
+
+        (void) eventfd_write(shard->fd, 1);
+
+        assert_se(pthread_join(shard->thread, NULL) == 0);
+        shard->thread_started = false;
+}
+
+static RemoteShard* remote_shard_free(RemoteShard *shard) {
+        size_t i;
+
+        if (!shard)
+                return NULL;
+
+        remote_shard_join(shard);
+
+        for (i = 0; i < shard->n_items; i++) {
+                safe_close(shard->items[i].fd);
+                free(shard->items[i].hostname);
+        }
+        free(shard->items);
+
+        sd_event_source_unref(shard->event_source);
+        journal_remote_server_destroy(&shard->server);
+        safe_close(shard->fd);
+
+        assert_se(pthread_mutex_destroy(&shard->mutex) == 0);
+
+        return mfree(shard);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(RemoteShard*, remote_shard_free);
+
+static int remote_shard_new(RemoteServer *s, RemoteShard **ret) {
+        _cleanup_(remote_shard_freep) RemoteShard *shard = NULL;
+        sigset_t ss, saved_ss;
+        int r, k;
+
+        assert(s);
+        assert(ret);
+
+        shard = new(RemoteShard, 1);
+        if (!shard)
+                return log_oom();
+
+        *shard = (RemoteShard) {
+                .server = {
+                        .output = s->output,
+                        .split_mode = s->split_mode,
+                        .compress = s->compress,
+                        .seal = s->seal,
+                        .parent = s,
+                },
+                .mutex = PTHREAD_MUTEX_INITIALIZER,
+                .fd = -1,
+        };
+
+        r = sd_event_new(&shard->server.events);
+        if (r < 0)
+                return log_error_errno(r, "Failed to allocate event loop: %m");
+
+        shard->fd = eventfd(0, EFD_CLOEXEC|EFD_NONBLOCK);
+        if (shard->fd < 0)
+                return log_error_errno(errno, "Failed to allocate eventfd: %m");
+
+        r = sd_event_add_io(shard->server.events, &shard->event_source,
+                            shard->fd, EPOLLIN,
+                            dispatch_shard_items, shard);
+        if (r < 0)
+                return log_error_errno(r, "Failed to register shard event source: %m");
+
+        /* The signals are dealt with by the main thread */
+        assert_se(sigfillset(&ss) >= 0);
+
+        r = pthread_sigmask(SIG_BLOCK, &ss, &saved_ss);
+        if (r > 0)
+                return log_error_errno(r, "Failed to block signals: %m");
+
+        r = pthread_create(&shard->thread, NULL, remote_shard_thread, shard);
+
+        k = pthread_sigmask(SIG_SETMASK, &saved_ss, NULL);
+        if (r > 0)
+                return log_error_errno(r, "Failed to start shard thread: %m");
+
+        shard->thread_started = true;
+
+        if (k > 0)
+                return log_error_errno(k, "Failed to restore signal mask: %m");
+
+        *ret = TAKE_PTR(shard);
+        return 0;
+}
+
+int journal_remote_start_shards(RemoteServer *s, unsigned n) {
+        int r;
+
+        assert(s);
+        assert(s->n_shards == 0);
+        assert(n <= REMOTE_SHARDS_MAX);
+
+        /* Raw connections are spread over n threads, each with its own event loop. All connections from the
+         * same host end up on the same thread, so that they don't contend for that host's writer. Uploads
+         * over HTTP are still handled on the main thread, hence writes are serialized by the writer
+         * itself. */
+
+        if (n == 0)
+                return 0;
+
+        assert(s->split_mode == JOURNAL_WRITE_SPLIT_HOST);
+
+        s->shards = new0(RemoteShard*, n);
+        if (!s->shards)
+                return log_oom();
+
+        for (; s->n_shards < n; s->n_shards++) {
+                r = remote_shard_new(s, s->shards + s->n_shards);
+                if (r < 0)
+                        return r;
+        }
+
+        log_debug("Started %zu threads for raw connections.", s->n_shards);
+        return 0;
+}
+
+void journal_remote_stop_shards(RemoteServer *s) {
+        size_t i;
+
+        assert(s);
+
+        for (i = 0; i < s->n_shards; i++)
+                remote_shard_free(s->shards[i]);
+
+        s->shards = mfree(s->shards);
+        s->n_shards = 0;
+}
+
+static int remote_shard_add_connection(RemoteServer *s, int fd, char *hostname) {
+        RemoteShard *shard;
+        size_t i;
+
+        /* This takes ownership of fd and hostname, even on failure. */
+
+        assert(s);
+        assert(s->n_shards > 0);
+        assert(fd >= 0);
+        assert(hostname);
+
+        i = siphash24_string(hostname, SHARD_HASH_KEY.bytes) % s->n_shards;
+        shard = s->shards[i];
+
+        log_debug("Passing connection from %s to shard %zu.", hostname, i);
+
+        assert_se(pthread_mutex_lock(&shard->mutex) == 0);
+
+        if (!GREEDY_REALLOC(shard->items, shard->n_allocated, shard->n_items + 1)) {
+                assert_se(pthread_mutex_unlock(&shard->mutex) == 0);
+                safe_close(fd);
+                free(hostname);
+                return log_oom();
+        }
+
+        shard->items[shard->n_items++] = (RemoteShardItem) {
+                .fd = fd,
+                .hostname = hostname,
+        };
+
+        assert_se(pthread_mutex_unlock(&shard->mutex) == 0);
+
+        (void) eventfd_write(shard->fd, 1);
+
+        return 0;
+}
+
 /**********************************************************************
  **********************************************************************
  **********************************************************************/
@@ -428,7 +709,7 @@ static int dispatch_raw_source_until_block(sd_event_source *event,
         /* Make sure event stays around even if source is destroyed */
         sd_event_source_ref(event);
 
-        r = journal_remote_handle_raw_source(event, source->importer.fd, EPOLLIN, journal_remote_server_global);
+        r = journal_remote_handle_raw_source(event, source->importer.fd, EPOLLIN, source->server);
         if (r != 1)
                 /* No more data for now */
                 sd_event_source_set_enabled(event, SD_EVENT_OFF);
@@ -448,7 +729,7 @@ static int dispatch_raw_source_event(sd_event_source *event,
         assert(source->event);
         assert(source->buffer_event);
 
-        r = journal_remote_handle_raw_source(event, fd, EPOLLIN, journal_remote_server_global);
+        r = journal_remote_handle_raw_source(event, fd, EPOLLIN, source->server);
         if (r == 1)
                 /* Might have more data. We need to rerun the handler
                  * until we are sure the buffer is exhausted. */
@@ -461,7 +742,7 @@ static int dispatch_blocking_source_event(sd_event_source *event,
                                           void *userdata) {
         RemoteSource *source = userdata;
 
-        return journal_remote_handle_raw_source(event, source->importer.fd, EPOLLIN, journal_remote_server_global);
+        return journal_remote_handle_raw_source(event, source->importer.fd, EPOLLIN, source->server);
 }
 
 static int accept_connection(
@@ -532,5 +813,8 @@ static int dispatch_raw_connection_event(
         if (fd2 < 0)
                 return fd2;
 
+        if (s->n_shards > 0)
+                return remote_shard_add_connection(s, fd2, hostname);
+
         return journal_remote_add_source(s, fd2, hostname, true);
 }
@@ -1,6 +1,8 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 #pragma once
 
+#include <pthread.h>
+
 #include "sd-event.h"
 
 #include "hashmap.h"
@@ -21,6 +23,11 @@ struct MHDDaemonWrapper {
 };
 #endif
 
+/* Upper limit for the number of threads raw connections may be spread over */
+#define REMOTE_SHARDS_MAX 64U
+
+typedef struct RemoteShard RemoteShard;
+
 struct RemoteServer {
         RemoteSource **sources;
         size_t sources_size;
@@ -29,6 +36,9 @@ struct RemoteServer {
         sd_event *events;
         sd_event_source *sigterm_event, *sigint_event, *listen_event;
 
+        /* Protects the writers hashmap and the reference counts of the writers in it. Shards don't have
+         * writers of their own, they use the ones of the server they were started from. */
+        pthread_mutex_t writers_mutex;
         Hashmap *writers;
         Writer *_single_writer;
         uint64_t event_count;
@@ -36,6 +46,10 @@ struct RemoteServer {
 #if HAVE_MICROHTTPD
         Hashmap *daemons;
 #endif
+        RemoteShard **shards;
+        size_t n_shards;
+        RemoteServer *parent;
+
         const char *output;                    /* either the output file or directory */
 
         JournalWriteSplitMode split_mode;
@@ -56,6 +70,8 @@ int journal_remote_get_writer(RemoteServer *s, const char *host, Writer **writer
 
 int journal_remote_add_source(RemoteServer *s, int fd, char* name, bool own_name);
 int journal_remote_add_raw_socket(RemoteServer *s, int fd);
+int journal_remote_start_shards(RemoteServer *s, unsigned n);
+void journal_remote_stop_shards(RemoteServer *s);
 int journal_remote_handle_raw_source(
                 sd_event_source *event,
                 int fd,
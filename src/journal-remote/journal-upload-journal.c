@@ -6,9 +6,11 @@
 #include "sd-daemon.h"
 
 #include "alloc-util.h"
+#include "journal-importer.h"
 #include "journal-upload.h"
 #include "log.h"
 #include "string-util.h"
+#include "unaligned.h"
 #include "utf8.h"
 #include "util.h"
 
@@ -235,6 +237,97 @@ static ssize_t write_entry(char *buf, size_t size, Uploader *u) {
         assert_not_reached("WTF?");
 }
 
+static int serialize_binary_entry(Uploader *u) {
+        usec_t realtime, monotonic;
+        sd_id128_t boot_id;
+        const void *data;
+        size_t length, n;
+        int r;
+
+        assert(u);
+
+        u->current_cursor = mfree(u->current_cursor);
+
+        r = sd_journal_get_cursor(u->journal, &u->current_cursor);
+        if (r < 0)
+                return log_error_errno(r, "Failed to get cursor: %m");
+
+        r = sd_journal_get_realtime_usec(u->journal, &realtime);
+        if (r < 0)
+                return log_error_errno(r, "Failed to get realtime timestamp: %m");
+
+        r = sd_journal_get_monotonic_usec(u->journal, &monotonic, &boot_id);
+        if (r < 0)
+                return log_error_errno(r, "Failed to get monotonic timestamp: %m");
+
+        n = sizeof(uint64_t) + JOURNAL_BINARY_ENTRY_HEADER_SIZE;
+        if (!GREEDY_REALLOC(u->entry_buffer, u->entry_buffer_allocated, n))
+                return log_oom();
+
+        unaligned_write_le64(u->entry_buffer + sizeof(uint64_t), realtime);
+        unaligned_write_le64(u->entry_buffer + 2 * sizeof(uint64_t), monotonic);
+        memcpy(u->entry_buffer + 3 * sizeof(uint64_t), &boot_id, sizeof(boot_id));
+
+        /* Unlike the export format, the boot ID field is not suppressed here, the receiver doesn't
+         * synthesize it from the header */
+        sd_journal_restart_data(u->journal);
+        for (;;) {
+                r = sd_journal_enumerate_data(u->journal, &data, &length);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to move to next field in entry: %m");
+                if (r == 0)
+                        break;
+
+                if (length > UINT32_MAX)
+                        return log_error_errno(SYNTHETIC_ERRNO(E2BIG), "Field of %zu bytes is too large.", length);
+
+                if (!GREEDY_REALLOC(u->entry_buffer, u->entry_buffer_allocated, n + sizeof(uint32_t) + length))
+                        return log_oom();
+
+                unaligned_write_le32(u->entry_buffer + n, length);
+                memcpy(u->entry_buffer + n + sizeof(uint32_t), data, length);
+                n += sizeof(uint32_t) + length;
+        }
+
+        unaligned_write_le64(u->entry_buffer, n - sizeof(uint64_t));
+        u->entry_size = n;
+
+        return 0;
+}
+
+/**
+ * Like write_entry(), but in the binary framing. The entry is serialized
+ * up front, and then copied out as far as there is space.
+ */
+static ssize_t write_binary_entry(char *buf, size_t size, Uploader *u) {
+        size_t n;
+        int r;
+
+        assert(size <= SSIZE_MAX);
+
+        if (u->entry_state == ENTRY_CURSOR) {
+                r = serialize_binary_entry(u);
+                if (r < 0)
+                        return r;
+
+                u->field_pos = 0;
+                u->entry_state = ENTRY_BINARY;
+        }
+
+        assert(u->entry_state == ENTRY_BINARY);
+
+        n = MIN(size, u->entry_size - u->field_pos);
+        memcpy(buf, u->entry_buffer + u->field_pos, n);
+        u->field_pos += n;
+
+        if (u->field_pos >= u->entry_size) {
+                u->entry_state = ENTRY_DONE;
+                u->entries_sent++;
+        }
+
+        return n;
+}
+
 static void check_update_watchdog(Uploader *u) {
         usec_t after;
         usec_t elapsed_time;
@@ -287,7 +380,10 @@ static size_t journal_input_callback(void *buf, size_t size, size_t nmemb, void
                         u->entry_state = ENTRY_CURSOR;
                 }
 
-                w = write_entry((char*)buf + filled, size * nmemb - filled, u);
+                if (u->binary)
+                        w = write_binary_entry((char*)buf + filled, size * nmemb - filled, u);
+                else
+                        w = write_entry((char*)buf + filled, size * nmemb - filled, u);
                 if (w < 0)
                         return CURL_READFUNC_ABORT;
                 filled += w;
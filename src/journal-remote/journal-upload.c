@@ -18,6 +18,7 @@
 #include "fileio.h"
 #include "format-util.h"
 #include "glob-util.h"
+#include "journal-importer.h"
 #include "journal-upload.h"
 #include "log.h"
 #include "main-func.h"
@@ -52,6 +53,7 @@ static const char *arg_machine = NULL;
 static bool arg_merge = false;
 static int arg_follow = -1;
 static const char *arg_save_state = NULL;
+static bool arg_binary = false;
 
 static void close_fd_input(Uploader *u);
 
@@ -181,7 +183,8 @@ int start_upload(Uploader *u,
         if (!u->header) {
                 struct curl_slist *h;
 
-                h = curl_slist_append(NULL, "Content-Type: application/vnd.fdo.journal");
+                h = curl_slist_append(NULL, u->binary ? "Content-Type: " JOURNAL_BINARY_CONTENT_TYPE
+                                                      : "Content-Type: application/vnd.fdo.journal");
                 if (!h)
                         return log_oom();
 
@@ -462,6 +465,7 @@ static void destroy_uploader(Uploader *u) {
 
         free(u->last_cursor);
         free(u->current_cursor);
+        free(u->entry_buffer);
 
         free(u->url);
 
@@ -562,6 +566,7 @@ static int parse_config(void) {
                 { "Upload",  "ServerKeyFile",          config_parse_path_or_ignore, 0, &arg_key    },
                 { "Upload",  "ServerCertificateFile",  config_parse_path_or_ignore, 0, &arg_cert   },
                 { "Upload",  "TrustedCertificateFile", config_parse_path_or_ignore, 0, &arg_trust  },
+                { "Upload",  "Binary",                 config_parse_bool,           0, &arg_binary },
                 {}};
 
         return config_parse_many_nulstr(PKGSYSCONFDIR "/journal-upload.conf",
@@ -601,6 +606,8 @@ static int help(void) {
                "     --follow[=BOOL]        Do [not] wait for input\n"
                "     --save-state[=FILE]    Save uploaded cursors (default \n"
                "                            " STATE_FILE ")\n"
+               "     --binary[=BOOL]        Do [not] upload journal entries in the binary\n"
+               "                            framing\n"
                "\nSee the %s for details.\n"
                , program_invocation_short_name
                , link
@@ -622,6 +629,7 @@ static int parse_argv(int argc, char *argv[]) {
                 ARG_AFTER_CURSOR,
                 ARG_FOLLOW,
                 ARG_SAVE_STATE,
+                ARG_BINARY,
         };
 
         static const struct option options[] = {
@@ -641,6 +649,7 @@ static int parse_argv(int argc, char *argv[]) {
                 { "after-cursor", required_argument, NULL, ARG_AFTER_CURSOR   },
                 { "follow",       optional_argument, NULL, ARG_FOLLOW         },
                 { "save-state",   optional_argument, NULL, ARG_SAVE_STATE     },
+                { "binary",       optional_argument, NULL, ARG_BINARY         },
                 {}
         };
 
@@ -759,6 +768,19 @@ static int parse_argv(int argc, char *argv[]) {
                         arg_save_state = optarg ?: STATE_FILE;
                         break;
 
+                case ARG_BINARY:
+                        if (optarg) {
+                                r = parse_boolean(optarg);
+                                if (r < 0)
+                                        return log_error_errno(SYNTHETIC_ERRNO(EINVAL),
+                                                               "Failed to parse --binary= parameter.");
+
+                                arg_binary = r;
+                        } else
+                                arg_binary = true;
+
+                        break;
+
                 case '?':
                         return log_error_errno(SYNTHETIC_ERRNO(EINVAL),
                                                "Unknown option %s.",
@@ -850,6 +872,11 @@ static int run(int argc, char **argv) {
                 r = open_journal(&j);
                 if (r < 0)
                         return r;
+
+                /* Input given on the command line is passed through verbatim, and hence always has to
+                 * be in the export format */
+                u.binary = arg_binary;
+
                 r = open_journal_for_upload(&u, j,
                                             arg_cursor ?: u.last_cursor,
                                             arg_cursor ? arg_after_cursor : true,
@@ -19,6 +19,7 @@ typedef enum {
         ENTRY_BINARY_FIELD,         /* In the middle of a binary field. */
         ENTRY_OUTRO,                /* Writing '\n' */
         ENTRY_DONE,                 /* Need to move to a new field. */
+        ENTRY_BINARY,               /* Writing out the serialized entry in the binary framing. */
 } entry_state;
 
 typedef struct Uploader {
@@ -40,11 +41,16 @@ typedef struct Uploader {
 
         /* journal stuff */
         sd_journal* journal;
+        bool binary;
 
         entry_state entry_state;
         const void *field_data;
         size_t field_pos, field_length;
 
+        /* In binary mode the whole entry is serialized first, since it is prefixed by its size */
+        char *entry_buffer;
+        size_t entry_buffer_allocated, entry_size;
+
         /* general metrics */
         const char *state_file;
 
@@ -90,6 +90,100 @@ int mhd_respondf(struct MHD_Connection *connection,
         return mhd_respond_internal(connection, code, m, r, MHD_RESPMEM_MUST_FREE);
 }
 
+static bool http_qvalue_is_zero(const char *p, size_t n) {
+        size_t i;
+
+        /* A qvalue is "0" or "1", followed by up to three decimals. Anything we can't make sense of is
+         * treated as a refusal. */
+
+        if (n == 0 || n > 5)
+                return true;
+
+        if (p[0] == '1')
+                return false;
+        if (p[0] != '0')
+                return true;
+
+        if (n == 1)
+                return true;
+        if (p[1] != '.')
+                return true;
+
+        for (i = 2; i < n; i++) {
+                if (!strchr(DIGITS, p[i]))
+                        return true;
+                if (p[i] != '0')
+                        return false;
+        }
+
+        return true;
+}
+
+bool http_accept_encoding_allows(const char *header, const char *coding) {
+        bool wildcard = false;
+        const char *p;
+
+        assert(coding);
+
+        /* Checks whether the content coding is acceptable according to an Accept-Encoding: header, e.g.
+         * "deflate, gzip;q=1.0, *;q=0.5". A coding is acceptable if it is listed with a non-zero quality,
+         * or if it isn't listed at all and "*" is, with a non-zero quality. */
+
+        if (!header)
+                return false;
+
+        for (p = header; *p; ) {
+                size_t n, name_len;
+                const char *e;
+                bool allowed = true;
+
+                p += strspn(p, ", \t");
+                if (!*p)
+                        break;
+
+                n = strcspn(p, ",");
+
+                name_len = strcspn(p, "; \t");
+                if (name_len > n)
+                        name_len = n;
+
+                /* Look for a quality value among the parameters */
+                for (e = p + name_len; e < p + n; ) {
+                        size_t l;
+
+                        e += strspn(e, "; \t");
+                        if (e >= p + n)
+                                break;
+
+                        l = strcspn(e, ";,");
+                        if (l > (size_t) (p + n - e))
+                                l = p + n - e;
+
+                        if (l >= 2 && IN_SET(e[0], 'q', 'Q') && e[1] == '=') {
+                                size_t k = l - 2;
+
+                                /* Drop trailing whitespace */
+                                while (k > 0 && strchr(" \t", e[2 + k - 1]))
+                                        k--;
+
+                                allowed = !http_qvalue_is_zero(e + 2, k);
+                        }
+
+                        e += l;
+                }
+
+                if (name_len == strlen(coding) && strncaseeq(p, coding, name_len))
+                        return allowed;
+
+                if (name_len == 1 && p[0] == '*')
+                        wildcard = allowed;
+
+                p += n;
+        }
+
+        return wildcard;
+}
+
 #if HAVE_GNUTLS
 
 static struct {
@@ -65,6 +65,8 @@ int mhd_respond_oom(struct MHD_Connection *connection);
 
 int check_permissions(struct MHD_Connection *connection, int *code, char **hostname);
 
+bool http_accept_encoding_allows(const char *header, const char *coding);
+
 /* Set gnutls internal logging function to a callback which uses our
  * own logging framework.
  *
@@ -0,0 +1,150 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <pthread.h>
+
+#include "sd-journal.h"
+
+#include "io-util.h"
+#include "journal-remote.h"
+#include "path-util.h"
+#include "rm-rf.h"
+#include "string-util.h"
+#include "strv.h"
+#include "tests.h"
+#include "tmpfile-util.h"
+
+#define N_THREADS 4
+#define N_ENTRIES 200
+
+typedef struct WriterThread {
+        RemoteServer *parent;
+        const char *host;
+} WriterThread;
+
+static void *writer_thread(void *userdata) {
+        WriterThread *t = userdata;
+        RemoteServer child = {
+                .split_mode = t->parent->split_mode,
+                .parent = t->parent,
+        };
+        _cleanup_(writer_unrefp) Writer *w = NULL;
+        sd_id128_t boot_id;
+        unsigned i;
+
+        assert_se(sd_id128_get_boot(&boot_id) >= 0);
+
+        /* Every thread looks up its writer on its own, like a shard does for its connections */
+        assert_se(journal_remote_get_writer(&child, t->host, &w) >= 0);
+
+        for (i = 0; i < N_ENTRIES; i++) {
+                struct iovec iovec[] = {
+                        IOVEC_MAKE_STRING("MESSAGE=hello"),
+                        IOVEC_MAKE_STRING("_HOSTNAME=test"),
+                };
+                struct iovec_wrapper iovw = {
+                        .iovec = iovec,
+                        .count = ELEMENTSOF(iovec),
+                };
+                dual_timestamp ts;
+
+                dual_timestamp_get(&ts);
+                assert_se(writer_write(w, &iovw, &ts, &boot_id, false, false) >= 0);
+        }
+
+        return NULL;
+}
+
+static unsigned count_entries(const char *path) {
+        _cleanup_(sd_journal_closep) sd_journal *j = NULL;
+        unsigned n = 0;
+
+        assert_se(sd_journal_open_files(&j, (const char**) STRV_MAKE(path), 0) >= 0);
+
+        SD_JOURNAL_FOREACH(j)
+                n++;
+
+        return n;
+}
+
+static void test_shared_writers(const char *dir) {
+        _cleanup_(journal_remote_server_destroy) RemoteServer s = {};
+        RemoteServer child = {
+                .split_mode = JOURNAL_WRITE_SPLIT_HOST,
+                .parent = &s,
+        };
+        WriterThread threads[N_THREADS];
+        pthread_t tids[N_THREADS];
+        Writer *a, *b, *c;
+        unsigned i;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(journal_remote_server_init(&s, dir, JOURNAL_WRITE_SPLIT_HOST, false, false) >= 0);
+
+        /* A host has the same writer no matter which server it is looked up from */
+        assert_se(journal_remote_get_writer(&s, "foo", &a) >= 0);
+        assert_se(journal_remote_get_writer(&child, "foo", &b) >= 0);
+        assert_se(journal_remote_get_writer(&child, "bar", &c) >= 0);
+        assert_se(a == b);
+        assert_se(a != c);
+        assert_se(a->server == &s);
+        assert_se(c->server == &s);
+        assert_se(a->n_ref == 2);
+        assert_se(hashmap_size(s.writers) == 2);
+        assert_se(!child.writers);
+
+        writer_unref(b);
+        writer_unref(c);
+        assert_se(hashmap_size(s.writers) == 1);
+
+        /* Concurrent writers to the same output file must not lose or corrupt entries */
+        for (i = 0; i < N_THREADS; i++) {
+                threads[i] = (WriterThread) {
+                        .parent = &s,
+                        .host = i % 2 == 0 ? "foo" : "bar",
+                };
+                assert_se(pthread_create(tids + i, NULL, writer_thread, threads + i) == 0);
+        }
+
+        for (i = 0; i < N_THREADS; i++)
+                assert_se(pthread_join(tids[i], NULL) == 0);
+
+        assert_se(s.event_count == N_THREADS * N_ENTRIES);
+
+        /* The threads dropped their references, only ours is left */
+        assert_se(hashmap_size(s.writers) == 1);
+        assert_se(a->n_ref == 1);
+        writer_unref(a);
+        assert_se(hashmap_isempty(s.writers));
+
+        assert_se(count_entries(strjoina(dir, "/remote-foo.journal")) == (N_THREADS + 1) / 2 * N_ENTRIES);
+        assert_se(count_entries(strjoina(dir, "/remote-bar.journal")) == N_THREADS / 2 * N_ENTRIES);
+}
+
+static void test_shards(const char *dir) {
+        _cleanup_(journal_remote_server_destroy) RemoteServer s = {};
+
+        log_info("/* %s */", __func__);
+
+        assert_se(journal_remote_server_init(&s, dir, JOURNAL_WRITE_SPLIT_HOST, false, false) >= 0);
+
+        assert_se(journal_remote_start_shards(&s, 3) >= 0);
+        assert_se(s.n_shards == 3);
+
+        journal_remote_stop_shards(&s);
+        assert_se(s.n_shards == 0);
+        assert_se(!s.shards);
+}
+
+int main(int argc, char *argv[]) {
+        _cleanup_(rm_rf_physical_and_freep) char *dir = NULL;
+
+        test_setup_logging(LOG_DEBUG);
+
+        assert_se(mkdtemp_malloc("/tmp/test-journal-remote-writer.XXXXXX", &dir) >= 0);
+
+        test_shared_writers(dir);
+        test_shards(dir);
+
+        return 0;
+}
@@ -0,0 +1,59 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include "microhttpd-util.h"
+#include "tests.h"
+
+static void test_accept_encoding(void) {
+        log_info("/* %s */", __func__);
+
+        assert_se(!http_accept_encoding_allows(NULL, "gzip"));
+        assert_se(!http_accept_encoding_allows("", "gzip"));
+        assert_se(!http_accept_encoding_allows("identity", "gzip"));
+        assert_se(!http_accept_encoding_allows("gzipx, xgzip", "gzip"));
+
+        assert_se(http_accept_encoding_allows("gzip", "gzip"));
+        assert_se(http_accept_encoding_allows("GZip", "gzip"));
+        assert_se(http_accept_encoding_allows("deflate, gzip", "gzip"));
+        assert_se(http_accept_encoding_allows("deflate,gzip,br", "gzip"));
+        assert_se(http_accept_encoding_allows("deflate,\tgzip", "gzip"));
+        assert_se(http_accept_encoding_allows("  gzip  ", "gzip"));
+
+        /* Quality values, with and without whitespace around the parameters */
+        assert_se(http_accept_encoding_allows("gzip;q=1.0", "gzip"));
+        assert_se(http_accept_encoding_allows("gzip; q=0.5", "gzip"));
+        assert_se(http_accept_encoding_allows("gzip ;q=0.001", "gzip"));
+        assert_se(http_accept_encoding_allows("gzip;q=1", "gzip"));
+        assert_se(http_accept_encoding_allows("gzip;Q=0.1", "gzip"));
+        assert_se(!http_accept_encoding_allows("gzip;q=0", "gzip"));
+        assert_se(!http_accept_encoding_allows("gzip; q=0", "gzip"));
+        assert_se(!http_accept_encoding_allows("gzip;q=0.0", "gzip"));
+        assert_se(!http_accept_encoding_allows("gzip;q=0.000", "gzip"));
+        assert_se(!http_accept_encoding_allows("gzip; q=0 , deflate", "gzip"));
+        assert_se(!http_accept_encoding_allows("deflate;q=1, gzip;q=0.0", "gzip"));
+
+        /* Garbage quality values count as refusal */
+        assert_se(!http_accept_encoding_allows("gzip;q=", "gzip"));
+        assert_se(!http_accept_encoding_allows("gzip;q=2", "gzip"));
+        assert_se(!http_accept_encoding_allows("gzip;q=0.0001", "gzip"));
+        assert_se(!http_accept_encoding_allows("gzip;q=0.x", "gzip"));
+
+        /* Other parameters are ignored */
+        assert_se(http_accept_encoding_allows("gzip;level=1", "gzip"));
+        assert_se(!http_accept_encoding_allows("gzip;level=1;q=0", "gzip"));
+
+        /* The wildcard only applies to codings not listed explicitly */
+        assert_se(http_accept_encoding_allows("*", "gzip"));
+        assert_se(http_accept_encoding_allows("deflate, *;q=0.1", "gzip"));
+        assert_se(!http_accept_encoding_allows("*;q=0", "gzip"));
+        assert_se(!http_accept_encoding_allows("gzip;q=0, *", "gzip"));
+        assert_se(!http_accept_encoding_allows("*, gzip;q=0", "gzip"));
+        assert_se(http_accept_encoding_allows("*;q=0, gzip", "gzip"));
+}
+
+int main(int argc, char *argv[]) {
+        test_setup_logging(LOG_DEBUG);
+
+        test_accept_encoding();
+
+        return 0;
+}
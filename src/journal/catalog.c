@@ -17,6 +17,7 @@
 #include "fd-util.h"
 #include "fileio.h"
 #include "hashmap.h"
+#include "id128-util.h"
 #include "log.h"
 #include "memory-util.h"
 #include "mkdir.h"
@@ -44,8 +45,19 @@ typedef struct CatalogHeader {
         le64_t header_size;
         le64_t n_items;
         le64_t catalog_item_size;
+
+        /* Added later, a hash table mapping message IDs to the first item carrying them. Each bucket is
+         * the item index plus one, zero marks an empty bucket, collisions are resolved by linear probing. */
+        le64_t index_offset;
+        le64_t index_n_buckets;
 } CatalogHeader;
 
+#define CATALOG_HEADER_CONTAINS(h, field) \
+        (le64toh((h)->header_size) >= offsetof(CatalogHeader, field) + sizeof((h)->field))
+
+/* How many message IDs a CatalogCache remembers, before it starts over */
+#define CATALOG_CACHE_MAX 4096U
+
 typedef struct CatalogItem {
         sd_id128_t id;
         char language[32]; /* One byte is used for termination, so the maximum allowed
@@ -73,6 +85,66 @@ static int catalog_compare_func(const CatalogItem *a, const CatalogItem *b) {
 
 DEFINE_HASH_OPS(catalog_hash_ops, CatalogItem, catalog_hash_func, catalog_compare_func);
 
+struct CatalogCache {
+        char *database;
+        int error;
+
+        int fd;
+        void *p;
+        size_t size;
+
+        char *locale;
+        Hashmap *texts; /* sd_id128_t* → const char*, pointing into the mapping, or catalog_text_missing */
+};
+
+static const char catalog_text_missing[] = "";
+
+static uint64_t catalog_index_hash(sd_id128_t id) {
+        /* Message IDs are random already, hence there's no point in hashing them any further. The XOR is
+         * done before the conversion so that the result is the same regardless of endianness. */
+        return le64toh(id.qwords[0] ^ id.qwords[1]);
+}
+
+static le32_t *build_index(const CatalogItem *items, size_t n, uint64_t *ret_n_buckets) {
+        _cleanup_free_ le32_t *buckets = NULL;
+        uint64_t n_buckets = 2, mask;
+        size_t i, n_ids = 0;
+
+        assert(items);
+        assert(n > 0);
+        assert(ret_n_buckets);
+
+        /* The items are sorted, i.e. all items for the same message ID follow each other and the one without
+         * a language comes first. The index only points to that first one. */
+        for (i = 0; i < n; i++)
+                if (i == 0 || !sd_id128_equal(items[i-1].id, items[i].id))
+                        n_ids++;
+
+        /* Keep the table at most half full, so that probe sequences stay short */
+        while (n_buckets < n_ids * 2)
+                n_buckets *= 2;
+        mask = n_buckets - 1;
+
+        buckets = new0(le32_t, n_buckets);
+        if (!buckets)
+                return NULL;
+
+        for (i = 0; i < n; i++) {
+                uint64_t b;
+
+                if (i > 0 && sd_id128_equal(items[i-1].id, items[i].id))
+                        continue;
+
+                for (b = catalog_index_hash(items[i].id) & mask; buckets[b] != 0; b = (b + 1) & mask)
+                        ;
+
+                buckets[b] = htole32((uint32_t) i + 1);
+        }
+
+        *ret_n_buckets = n_buckets;
+        return TAKE_PTR(buckets);
+}
+
 static bool next_header(const char **s) {
         const char *e;
 
@@ -377,11 +449,15 @@ static int64_t write_catalog(
                 const char *database,
                 struct strbuf *sb,
                 CatalogItem *items,
-                size_t n) {
+                size_t n,
+                const le32_t *buckets,
+                uint64_t n_buckets) {
 
+        static const uint8_t padding[8] = {};
         _cleanup_fclose_ FILE *w = NULL;
         _cleanup_free_ char *p = NULL;
         CatalogHeader header;
+        uint64_t offset;
         size_t k;
         int r;
 
@@ -394,11 +470,16 @@ static int64_t write_catalog(
                 return log_error_errno(r, "Failed to open database for writing: %s: %m",
                                        database);
 
+        /* The index goes behind the strings, where older readers won't look */
+        offset = ALIGN_TO(sizeof(CatalogHeader), 8) + n * sizeof(CatalogItem) + sb->len;
+
         header = (CatalogHeader) {
                 .signature = CATALOG_SIGNATURE,
                 .header_size = htole64(ALIGN_TO(sizeof(CatalogHeader), 8)),
                 .catalog_item_size = htole64(sizeof(CatalogItem)),
                 .n_items = htole64(n),
+                .index_offset = htole64(ALIGN_TO(offset, 8)),
+                .index_n_buckets = htole64(n_buckets),
         };
 
         r = -EIO;
@@ -421,6 +502,18 @@ static int64_t write_catalog(
                 goto error;
         }
 
+        k = fwrite(padding, 1, ALIGN_TO(offset, 8) - offset, w);
+        if (k != ALIGN_TO(offset, 8) - offset) {
+                log_error("%s: failed to write padding.", p);
+                goto error;
+        }
+
+        k = fwrite(buckets, 1, n_buckets * sizeof(le32_t), w);
+        if (k != n_buckets * sizeof(le32_t)) {
+                log_error("%s: failed to write index.", p);
+                goto error;
+        }
+
         r = fflush_and_check(w);
         if (r < 0) {
                 log_error_errno(r, "%s: failed to write database: %m", p);
@@ -447,6 +540,8 @@ int catalog_update(const char* database, const char* root, const char* const* di
         _cleanup_(strbuf_cleanupp) struct strbuf *sb = NULL;
         _cleanup_ordered_hashmap_free_free_free_ OrderedHashmap *h = NULL;
         _cleanup_free_ CatalogItem *items = NULL;
+        _cleanup_free_ le32_t *buckets = NULL;
+        uint64_t n_buckets;
         ssize_t offset;
         char *payload;
         CatalogItem *i;
@@ -498,9 +593,13 @@ int catalog_update(const char* database, const char* root, const char* const* di
         assert(n == ordered_hashmap_size(h));
         typesafe_qsort(items, n, catalog_compare_func);
 
+        buckets = build_index(items, n, &n_buckets);
+        if (!buckets)
+                return log_oom();
+
         strbuf_complete(sb);
 
-        sz = write_catalog(database, sb, items, n);
+        sz = write_catalog(database, sb, items, n, buckets, n_buckets);
         if (sz < 0)
                 return log_error_errno(sz, "Failed to write %s: %m", database);
 
@@ -509,6 +608,10 @@ int catalog_update(const char* database, const char* root, const char* const* di
         return 0;
 }
 
+static bool header_has_index(const CatalogHeader *h) {
+        return CATALOG_HEADER_CONTAINS(h, index_n_buckets) && le64toh(h->index_n_buckets) > 0;
+}
+
 static int open_mmap(const char *database, int *_fd, struct stat *_st, void **_p) {
         _cleanup_close_ int fd = -1;
         const CatalogHeader *h;
@@ -526,7 +629,7 @@ static int open_mmap(const char *database, int *_fd, struct stat *_st, void **_p
         if (fstat(fd, &st) < 0)
                 return -errno;
 
-        if (st.st_size < (off_t) sizeof(CatalogHeader))
+        if (st.st_size < (off_t) offsetof(CatalogHeader, index_offset))
                 return -EINVAL;
 
         p = mmap(NULL, PAGE_ALIGN(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
@@ -535,13 +638,21 @@ static int open_mmap(const char *database, int *_fd, struct stat *_st, void **_p
 
         h = p;
         if (memcmp(h->signature, (const uint8_t[]) CATALOG_SIGNATURE, sizeof(h->signature)) != 0 ||
-            le64toh(h->header_size) < sizeof(CatalogHeader) ||
+            le64toh(h->header_size) < offsetof(CatalogHeader, index_offset) ||
             le64toh(h->catalog_item_size) < sizeof(CatalogItem) ||
             h->incompatible_flags != 0 ||
             le64toh(h->n_items) <= 0 ||
-            st.st_size < (off_t) (le64toh(h->header_size) + le64toh(h->catalog_item_size) * le64toh(h->n_items))) {
-                munmap(p, st.st_size);
-                return -EBADMSG;
+            st.st_size < (off_t) (le64toh(h->header_size) + le64toh(h->catalog_item_size) * le64toh(h->n_items)))
+                goto fail;
+
+        if (header_has_index(h)) {
+                uint64_t offset = le64toh(h->index_offset), n_buckets = le64toh(h->index_n_buckets);
+
+                if (offset % 8 != 0 ||
+                    offset > (uint64_t) st.st_size ||
+                    (n_buckets & (n_buckets - 1)) != 0 ||
+                    n_buckets > ((uint64_t) st.st_size - offset) / sizeof(le32_t))
+                        goto fail;
         }
 
         *_fd = TAKE_FD(fd);
@@ -549,10 +660,65 @@ static int open_mmap(const char *database, int *_fd, struct stat *_st, void **_p
         *_p = p;
 
         return 0;
+
+fail:
+        munmap(p, st.st_size);
+        return -EBADMSG;
+}
+
+static const CatalogItem *catalog_item(const void *p, uint64_t i) {
+        const CatalogHeader *h = p;
+
+        return (const CatalogItem*) ((const uint8_t*) p + le64toh(h->header_size) + i * le64toh(h->catalog_item_size));
+}
+
+static const CatalogItem *find_item_indexed(const void *p, sd_id128_t id, const char *language, const char *short_language) {
+        const CatalogHeader *h = p;
+        const CatalogItem *f = NULL, *fallback = NULL;
+        const le32_t *buckets;
+        uint64_t b, i, k, mask, n_items;
+
+        buckets = (const le32_t*) ((const uint8_t*) p + le64toh(h->index_offset));
+        mask = le64toh(h->index_n_buckets) - 1;
+        n_items = le64toh(h->n_items);
+
+        /* The table is never full, but don't trust the file to be sane */
+        for (b = catalog_index_hash(id) & mask, k = 0; k <= mask; b = (b + 1) & mask, k++) {
+                i = le32toh(buckets[b]);
+                if (i == 0 || i > n_items)
+                        return NULL;
+
+                f = catalog_item(p, i - 1);
+                if (sd_id128_equal(f->id, id))
+                        break;
+
+                f = NULL;
+        }
+        if (!f)
+                return NULL;
+
+        /* Now look at all items for this ID, and pick the best match for the language in one go */
+        for (i--; i < n_items; i++) {
+                const CatalogItem *c = catalog_item(p, i);
+
+                if (!sd_id128_equal(c->id, id))
+                        break;
+
+                if (!isempty(language) && streq(c->language, language))
+                        return c;
+
+                if (!isempty(short_language) && streq(c->language, short_language))
+                        fallback = c;
+                else if (!fallback && isempty(c->language))
+                        fallback = c;
+        }
+
+        return fallback;
 }
 
 static const char *find_id(void *p, sd_id128_t id) {
         CatalogItem *f = NULL, key = { .id = id };
+        char short_language[sizeof(key.language)] = {};
         const CatalogHeader *h = p;
         const char *loc;
 
@@ -567,34 +733,39 @@ static const char *find_id(void *p, sd_id128_t id) {
                         strncpy(key.language, loc, len);
                         key.language[len] = '\0';
 
+                        len = strcspn(key.language, "_");
+                        if (key.language[len] == '_')
+                                memcpy(short_language, key.language, len);
+                }
+        }
+
+        if (header_has_index(h))
+                f = (CatalogItem*) find_item_indexed(p, id, key.language, short_language);
+        else {
+                if (!isempty(key.language)) {
                         f = bsearch(&key,
                                     (const uint8_t*) p + le64toh(h->header_size),
                                     le64toh(h->n_items),
                                     le64toh(h->catalog_item_size),
                                     (comparison_fn_t) catalog_compare_func);
-                        if (!f) {
-                                char *e;
-
-                                e = strchr(key.language, '_');
-                                if (e) {
-                                        *e = 0;
-                                        f = bsearch(&key,
-                                                    (const uint8_t*) p + le64toh(h->header_size),
-                                                    le64toh(h->n_items),
-                                                    le64toh(h->catalog_item_size),
-                                                    (comparison_fn_t) catalog_compare_func);
-                                }
+                        if (!f && !isempty(short_language)) {
+                                strcpy(key.language, short_language);
+                                f = bsearch(&key,
+                                            (const uint8_t*) p + le64toh(h->header_size),
+                                            le64toh(h->n_items),
+                                            le64toh(h->catalog_item_size),
+                                            (comparison_fn_t) catalog_compare_func);
                         }
                 }
-        }
 
-        if (!f) {
-                zero(key.language);
-                f = bsearch(&key,
-                            (const uint8_t*) p + le64toh(h->header_size),
-                            le64toh(h->n_items),
-                            le64toh(h->catalog_item_size),
-                            (comparison_fn_t) catalog_compare_func);
+                if (!f) {
+                        zero(key.language);
+                        f = bsearch(&key,
+                                    (const uint8_t*) p + le64toh(h->header_size),
+                                    le64toh(h->n_items),
+                                    le64toh(h->catalog_item_size),
+                                    (comparison_fn_t) catalog_compare_func);
+                }
         }
 
         if (!f)
@@ -642,6 +813,115 @@ finish:
         return r;
 }
 
+CatalogCache *catalog_cache_free(CatalogCache *c) {
+        if (!c)
+                return NULL;
+
+        hashmap_free_free_key(c->texts);
+
+        if (c->p)
+                munmap(c->p, c->size);
+        safe_close(c->fd);
+
+        free(c->database);
+        free(c->locale);
+
+        return mfree(c);
+}
+
+static int catalog_cache_new(const char *database, CatalogCache **ret) {
+        _cleanup_(catalog_cache_freep) CatalogCache *c = NULL;
+        struct stat st;
+
+        c = new(CatalogCache, 1);
+        if (!c)
+                return -ENOMEM;
+
+        *c = (CatalogCache) {
+                .fd = -1,
+        };
+
+        c->database = strdup(database);
+        if (!c->database)
+                return -ENOMEM;
+
+        /* Failures are remembered too, so that a missing database doesn't cost us an open() per lookup */
+        c->error = open_mmap(database, &c->fd, &st, &c->p);
+        if (c->error >= 0)
+                c->size = st.st_size;
+
+        *ret = TAKE_PTR(c);
+        return 0;
+}
+
+int catalog_get_cached(CatalogCache **cache, const char *database, sd_id128_t id, char **ret) {
+        CatalogCache *c;
+        const char *loc, *s;
+        char *text;
+        int r;
+
+        assert(cache);
+        assert(database);
+        assert(ret);
+
+        /* Like catalog_get(), but keeps the database mapped and remembers what it found for each message
+         * ID. The database is not checked for updates, the cache is supposed to be short-lived. */
+
+        if (*cache && !streq((*cache)->database, database))
+                *cache = catalog_cache_free(*cache);
+
+        if (!*cache) {
+                r = catalog_cache_new(database, cache);
+                if (r < 0)
+                        return r;
+        }
+
+        c = *cache;
+        if (c->error < 0)
+                return c->error;
+
+        /* find_id() picks the language from LC_MESSAGES, start over if that changed */
+        loc = setlocale(LC_MESSAGES, NULL);
+        if (!streq_ptr(loc, c->locale) || hashmap_size(c->texts) >= CATALOG_CACHE_MAX) {
+                hashmap_clear_free_key(c->texts);
+
+                r = free_and_strdup(&c->locale, loc);
+                if (r < 0)
+                        return r;
+        }
+
+        s = hashmap_get(c->texts, &id);
+        if (!s) {
+                _cleanup_free_ sd_id128_t *key = NULL;
+
+                s = find_id(c->p, id) ?: catalog_text_missing;
+
+                key = newdup(sd_id128_t, &id, 1);
+                if (!key)
+                        return -ENOMEM;
+
+                r = hashmap_ensure_allocated(&c->texts, &id128_hash_ops);
+                if (r < 0)
+                        return r;
+
+                r = hashmap_put(c->texts, key, (char*) s);
+                if (r < 0)
+                        return r;
+
+                TAKE_PTR(key);
+        }
+
+        if (s == catalog_text_missing)
+                return -ENOENT;
+
+        text = strdup(s);
+        if (!text)
+                return -ENOMEM;
+
+        *ret = text;
+        return 0;
+}
+
 static char *find_header(const char *s, const char *header) {
 
         for (;;) {
@@ -4,34 +4,29 @@
 #include <unistd.h>
 
 #include "journal-def.h"
+#include "macro.h"
 
 const char* object_compressed_to_string(int compression);
 int object_compressed_from_string(const char *compression);
 
+bool compression_supported(int compression);
+
 int compress_blob_xz(const void *src, uint64_t src_size,
                      void *dst, size_t dst_alloc_size, size_t *dst_size);
 int compress_blob_lz4(const void *src, uint64_t src_size,
                       void *dst, size_t dst_alloc_size, size_t *dst_size);
-
-static inline int compress_blob(const void *src, uint64_t src_size,
-                                void *dst, size_t dst_alloc_size, size_t *dst_size) {
-        int r;
-#if HAVE_LZ4
-        r = compress_blob_lz4(src, src_size, dst, dst_alloc_size, dst_size);
-        if (r == 0)
-                return OBJECT_COMPRESSED_LZ4;
-#else
-        r = compress_blob_xz(src, src_size, dst, dst_alloc_size, dst_size);
-        if (r == 0)
-                return OBJECT_COMPRESSED_XZ;
-#endif
-        return r;
-}
+int compress_blob_zstd(const void *src, uint64_t src_size,
+                       void *dst, size_t dst_alloc_size, size_t *dst_size);
+int compress_blob(int compression,
+                  const void *src, uint64_t src_size,
+                  void *dst, size_t dst_alloc_size, size_t *dst_size);
 
 int decompress_blob_xz(const void *src, uint64_t src_size,
                        void **dst, size_t *dst_alloc_size, size_t* dst_size, size_t dst_max);
 int decompress_blob_lz4(const void *src, uint64_t src_size,
                         void **dst, size_t *dst_alloc_size, size_t* dst_size, size_t dst_max);
+int decompress_blob_zstd(const void *src, uint64_t src_size,
+                         void **dst, size_t *dst_alloc_size, size_t* dst_size, size_t dst_max);
 int decompress_blob(int compression,
                     const void *src, uint64_t src_size,
                     void **dst, size_t *dst_alloc_size, size_t* dst_size, size_t dst_max);
@@ -44,19 +39,64 @@ int decompress_startswith_lz4(const void *src, uint64_t src_size,
                               void **buffer, size_t *buffer_size,
                               const void *prefix, size_t prefix_len,
                               uint8_t extra);
+int decompress_startswith_zstd(const void *src, uint64_t src_size,
+                               void **buffer, size_t *buffer_size,
+                               const void *prefix, size_t prefix_len,
+                               uint8_t extra);
 int decompress_startswith(int compression,
                           const void *src, uint64_t src_size,
                           void **buffer, size_t *buffer_size,
                           const void *prefix, size_t prefix_len,
                           uint8_t extra);
 
+/* Compression dictionaries, used to compress short but repetitive blobs that wouldn't compress well on
+ * their own. Only supported for zstd. */
+typedef struct CompressionDictionary CompressionDictionary;
+
+int compression_dictionary_train(const void *samples, const size_t *sample_sizes, unsigned n_samples,
+                                 size_t dict_max_size, void **ret, size_t *ret_size);
+int compression_dictionary_new(const void *dict, size_t dict_size, CompressionDictionary **ret);
+CompressionDictionary* compression_dictionary_free(CompressionDictionary *d);
+DEFINE_TRIVIAL_CLEANUP_FUNC(CompressionDictionary*, compression_dictionary_free);
+
+bool compressed_blob_uses_dictionary(int compression, const void *src, uint64_t src_size);
+
+int compress_blob_zstd_with_dictionary(CompressionDictionary *d,
+                                       const void *src, uint64_t src_size,
+                                       void *dst, size_t dst_alloc_size, size_t *dst_size);
+int decompress_blob_zstd_with_dictionary(CompressionDictionary *d,
+                                         const void *src, uint64_t src_size,
+                                         void **dst, size_t *dst_alloc_size, size_t* dst_size, size_t dst_max);
+int decompress_startswith_zstd_with_dictionary(CompressionDictionary *d,
+                                               const void *src, uint64_t src_size,
+                                               void **buffer, size_t *buffer_size,
+                                               const void *prefix, size_t prefix_len,
+                                               uint8_t extra);
+
 int compress_stream_xz(int fdf, int fdt, uint64_t max_bytes);
 int compress_stream_lz4(int fdf, int fdt, uint64_t max_bytes);
+int compress_stream_zstd(int fdf, int fdt, uint64_t max_bytes);
 
 int decompress_stream_xz(int fdf, int fdt, uint64_t max_size);
 int decompress_stream_lz4(int fdf, int fdt, uint64_t max_size);
+int decompress_stream_zstd(int fdf, int fdt, uint64_t max_size);
+
+/* The algorithm used for newly created journal files, unless configured otherwise. Zstd gives us both
+ * better ratios than LZ4 and better speed than XZ, hence prefer it if available. */
+#if HAVE_ZSTD
+#  define DEFAULT_COMPRESSION OBJECT_COMPRESSED_ZSTD
+#elif HAVE_LZ4
+#  define DEFAULT_COMPRESSION OBJECT_COMPRESSED_LZ4
+#elif HAVE_XZ
+#  define DEFAULT_COMPRESSION OBJECT_COMPRESSED_XZ
+#else
+#  define DEFAULT_COMPRESSION 0
+#endif
 
-#if HAVE_LZ4
+#if HAVE_ZSTD
+#  define compress_stream compress_stream_zstd
+#  define COMPRESSED_EXT ".zst"
+#elif HAVE_LZ4
 #  define compress_stream compress_stream_lz4
 #  define COMPRESSED_EXT ".lz4"
 #else
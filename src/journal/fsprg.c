@@ -322,6 +322,32 @@ void FSPRG_Evolve(void *state) {
         gcry_mpi_release(x);
 }
 
+void FSPRG_EvolveN(void *state, uint64_t n) {
+        gcry_mpi_t m, x;
+        uint16_t secpar;
+        uint64_t epoch, i;
+
+        if (n == 0)
+                return;
+
+        initialize_libgcrypt(false);
+
+        secpar = read_secpar(state + 0);
+        m = mpi_import(state + 2 + 0 * secpar / 8, secpar / 8);
+        x = mpi_import(state + 2 + 1 * secpar / 8, secpar / 8);
+        epoch = uint64_import(state + 2 + 2 * secpar / 8, 8);
+
+        for (i = 0; i < n; i++)
+                gcry_mpi_mulm(x, x, x, m);
+        epoch += n;
+
+        mpi_export(state + 2 + 1 * secpar / 8, secpar / 8, x);
+        uint64_export(state + 2 + 2 * secpar / 8, 8, epoch);
+
+        gcry_mpi_release(m);
+        gcry_mpi_release(x);
+}
+
 uint64_t FSPRG_GetEpoch(const void *state) {
         uint16_t secpar;
         secpar = read_secpar(state + 0);
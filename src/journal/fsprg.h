@@ -49,6 +49,8 @@ void FSPRG_GenMK(void *msk, void *mpk, const void *seed, size_t seedlen, unsigne
 void FSPRG_GenState0(void *state, const void *mpk, const void *seed, size_t seedlen);
 
 void FSPRG_Evolve(void *state);
+/* Evolve n times, cheaper than calling FSPRG_Evolve() n times. */
+void FSPRG_EvolveN(void *state, uint64_t n);
 
 uint64_t FSPRG_GetEpoch(const void *state) _pure_;
 
@@ -137,18 +137,16 @@ int journal_file_fsprg_evolve(JournalFile *f, uint64_t realtime) {
                 return r;
 
         epoch = FSPRG_GetEpoch(f->fsprg_state);
-        if (epoch < goal)
-                log_debug("Evolving FSPRG key from epoch %"PRIu64" to %"PRIu64".", epoch, goal);
+        if (epoch > goal)
+                return -ESTALE;
+        if (epoch == goal)
+                return 0;
 
-        for (;;) {
-                if (epoch > goal)
-                        return -ESTALE;
-                if (epoch == goal)
-                        return 0;
+        log_debug("Evolving FSPRG key from epoch %"PRIu64" to %"PRIu64".", epoch, goal);
 
-                FSPRG_Evolve(f->fsprg_state);
-                epoch = FSPRG_GetEpoch(f->fsprg_state);
-        }
+        /* After a long idle period this may be many epochs, do them all in one go */
+        FSPRG_EvolveN(f->fsprg_state, goal - epoch);
+        return 0;
 }
 
 int journal_file_fsprg_seek(JournalFile *f, uint64_t goal) {
@@ -236,38 +234,43 @@ int journal_file_hmac_put_object(JournalFile *f, ObjectType type, Object *o, uin
                         return -EBADMSG;
         }
 
-        gcry_md_write(f->hmac, o, offsetof(ObjectHeader, payload));
+        /* The immutable parts of the objects directly follow the header, hence pass them together with
+         * it in a single call where possible */
 
         switch (o->object.type) {
 
         case OBJECT_DATA:
                 /* All but hash and payload are mutable */
-                gcry_md_write(f->hmac, &o->data.hash, sizeof(o->data.hash));
+                gcry_md_write(f->hmac, o, offsetof(DataObject, next_hash_offset));
                 gcry_md_write(f->hmac, o->data.payload, le64toh(o->object.size) - offsetof(DataObject, payload));
                 break;
 
         case OBJECT_FIELD:
                 /* Same here */
-                gcry_md_write(f->hmac, &o->field.hash, sizeof(o->field.hash));
+                gcry_md_write(f->hmac, o, offsetof(FieldObject, next_hash_offset));
                 gcry_md_write(f->hmac, o->field.payload, le64toh(o->object.size) - offsetof(FieldObject, payload));
                 break;
 
         case OBJECT_ENTRY:
+        case OBJECT_DICTIONARY:
+        case OBJECT_FIELD_INDEX:
+        case OBJECT_TIME_INDEX:
                 /* All */
-                gcry_md_write(f->hmac, &o->entry.seqnum, le64toh(o->object.size) - offsetof(EntryObject, seqnum));
+                gcry_md_write(f->hmac, o, le64toh(o->object.size));
                 break;
 
         case OBJECT_FIELD_HASH_TABLE:
         case OBJECT_DATA_HASH_TABLE:
         case OBJECT_ENTRY_ARRAY:
                 /* Nothing: everything is mutable */
+                gcry_md_write(f->hmac, o, offsetof(ObjectHeader, payload));
                 break;
 
         case OBJECT_TAG:
                 /* All but the tag itself */
-                gcry_md_write(f->hmac, &o->tag.seqnum, sizeof(o->tag.seqnum));
-                gcry_md_write(f->hmac, &o->tag.epoch, sizeof(o->tag.epoch));
+                gcry_md_write(f->hmac, o, offsetof(TagObject, tag));
                 break;
+
         default:
                 return -EINVAL;
         }
@@ -23,9 +23,14 @@ typedef struct EntryObject EntryObject;
 typedef struct HashTableObject HashTableObject;
 typedef struct EntryArrayObject EntryArrayObject;
 typedef struct TagObject TagObject;
+typedef struct DictionaryObject DictionaryObject;
+typedef struct FieldIndexObject FieldIndexObject;
+typedef struct TimeIndexObject TimeIndexObject;
 
 typedef struct EntryItem EntryItem;
 typedef struct HashItem HashItem;
+typedef struct FieldIndexItem FieldIndexItem;
+typedef struct TimeIndexItem TimeIndexItem;
 
 typedef struct FSSHeader FSSHeader;
 
@@ -39,6 +44,9 @@ typedef enum ObjectType {
         OBJECT_FIELD_HASH_TABLE,
         OBJECT_ENTRY_ARRAY,
         OBJECT_TAG,
+        OBJECT_DICTIONARY,
+        OBJECT_FIELD_INDEX,
+        OBJECT_TIME_INDEX,
         _OBJECT_TYPE_MAX
 } ObjectType;
 
@@ -46,10 +54,11 @@ typedef enum ObjectType {
 enum {
         OBJECT_COMPRESSED_XZ = 1 << 0,
         OBJECT_COMPRESSED_LZ4 = 1 << 1,
+        OBJECT_COMPRESSED_ZSTD = 1 << 2,
         _OBJECT_COMPRESSED_MAX
 };
 
-#define OBJECT_COMPRESSION_MASK (OBJECT_COMPRESSED_XZ | OBJECT_COMPRESSED_LZ4)
+#define OBJECT_COMPRESSION_MASK (OBJECT_COMPRESSED_XZ | OBJECT_COMPRESSED_LZ4 | OBJECT_COMPRESSED_ZSTD)
 
 struct ObjectHeader {
         uint8_t type;
@@ -126,6 +135,49 @@ struct TagObject {
         uint8_t tag[TAG_LENGTH]; /* SHA-256 HMAC */
 } _packed_;
 
+/* A compression dictionary, trained from the first short DATA objects written to the file. DATA objects
+ * that have been compressed with it are marked as such in their compressed payload. */
+struct DictionaryObject {
+        ObjectHeader object;
+        uint8_t payload[];
+} _packed_;
+
+struct FieldIndexItem {
+        le64_t data_offset;
+        le64_t first_realtime;
+        le64_t last_realtime;
+        le64_t size;
+        uint8_t payload[]; /* padded to a multiple of 8 bytes */
+} _packed_;
+
+/* Written when a file is archived: all distinct values of one field, together with the realtime range of
+ * the entries referencing them. n_entries is the number of entries in the file when the index was written,
+ * an index that doesn't match the header is stale and ignored. */
+struct FieldIndexObject {
+        ObjectHeader object;
+        le64_t field_offset;
+        le64_t next_field_index_offset;
+        le64_t n_entries;
+        le64_t n_items;
+        uint8_t items[]; /* FieldIndexItem, each aligned to 8 bytes */
+} _packed_;
+
+struct TimeIndexItem {
+        le64_t realtime;
+        le64_t entry_offset;
+        le64_t entry_array_offset; /* the array in the main entry array chain referencing the entry */
+        le64_t entry_array_index;  /* the entry's position in that array */
+} _packed_;
+
+/* Written when a file is archived: every interval'th entry of the main entry array, and the last one, so
+ * that seeking by realtime only has to bisect between two neighbouring items. */
+struct TimeIndexObject {
+        ObjectHeader object;
+        le64_t n_entries;
+        le64_t interval;
+        TimeIndexItem items[];
+} _packed_;
+
 union Object {
         ObjectHeader object;
         DataObject data;
@@ -134,6 +186,9 @@ union Object {
         HashTableObject hash_table;
         EntryArrayObject entry_array;
         TagObject tag;
+        DictionaryObject dictionary;
+        FieldIndexObject field_index;
+        TimeIndexObject time_index;
 };
 
 enum {
@@ -147,30 +202,41 @@ enum {
 enum {
         HEADER_INCOMPATIBLE_COMPRESSED_XZ = 1 << 0,
         HEADER_INCOMPATIBLE_COMPRESSED_LZ4 = 1 << 1,
+        /* 1 << 2 is reserved, for compatibility with files written by other implementations */
+        HEADER_INCOMPATIBLE_COMPRESSED_ZSTD = 1 << 3,
+        /* 1 << 4 is reserved, too. Flags specific to this implementation are allocated from 1 << 16 on,
+         * so that they don't collide with the ones upstream allocates from the bottom. */
+        HEADER_INCOMPATIBLE_COMPRESSION_DICTIONARY = 1 << 16,
 };
 
-#define HEADER_INCOMPATIBLE_ANY (HEADER_INCOMPATIBLE_COMPRESSED_XZ|HEADER_INCOMPATIBLE_COMPRESSED_LZ4)
+#define HEADER_INCOMPATIBLE_ANY                                         \
+        (HEADER_INCOMPATIBLE_COMPRESSED_XZ |                            \
+         HEADER_INCOMPATIBLE_COMPRESSED_LZ4 |                           \
+         HEADER_INCOMPATIBLE_COMPRESSED_ZSTD |                          \
+         HEADER_INCOMPATIBLE_COMPRESSION_DICTIONARY)
 
-#if HAVE_XZ && HAVE_LZ4
-#  define HEADER_INCOMPATIBLE_SUPPORTED HEADER_INCOMPATIBLE_ANY
-#elif HAVE_XZ
-#  define HEADER_INCOMPATIBLE_SUPPORTED HEADER_INCOMPATIBLE_COMPRESSED_XZ
-#elif HAVE_LZ4
-#  define HEADER_INCOMPATIBLE_SUPPORTED HEADER_INCOMPATIBLE_COMPRESSED_LZ4
-#else
-#  define HEADER_INCOMPATIBLE_SUPPORTED 0
-#endif
+#define HEADER_INCOMPATIBLE_SUPPORTED                                   \
+        ((HAVE_XZ ? HEADER_INCOMPATIBLE_COMPRESSED_XZ : 0) |            \
+         (HAVE_LZ4 ? HEADER_INCOMPATIBLE_COMPRESSED_LZ4 : 0) |          \
+         (HAVE_ZSTD ? HEADER_INCOMPATIBLE_COMPRESSED_ZSTD : 0) |        \
+         (HAVE_ZSTD ? HEADER_INCOMPATIBLE_COMPRESSION_DICTIONARY : 0))
 
 enum {
-        HEADER_COMPATIBLE_SEALED = 1
+        HEADER_COMPATIBLE_SEALED = 1 << 0,
+        /* 1 << 1 and 1 << 2 are reserved, see above */
+        HEADER_COMPATIBLE_FIELD_INDEX = 1 << 16,
+        HEADER_COMPATIBLE_TIME_INDEX = 1 << 17,
 };
 
-#define HEADER_COMPATIBLE_ANY HEADER_COMPATIBLE_SEALED
-#if HAVE_GCRYPT
-#  define HEADER_COMPATIBLE_SUPPORTED HEADER_COMPATIBLE_SEALED
-#else
-#  define HEADER_COMPATIBLE_SUPPORTED 0
-#endif
+#define HEADER_COMPATIBLE_ANY                                           \
+        (HEADER_COMPATIBLE_SEALED |                                     \
+         HEADER_COMPATIBLE_FIELD_INDEX |                                \
+         HEADER_COMPATIBLE_TIME_INDEX)
+
+#define HEADER_COMPATIBLE_SUPPORTED                                     \
+        ((HAVE_GCRYPT ? HEADER_COMPATIBLE_SEALED : 0) |                 \
+         HEADER_COMPATIBLE_FIELD_INDEX |                                \
+         HEADER_COMPATIBLE_TIME_INDEX)
 
 #define HEADER_SIGNATURE ((char[]) { 'L', 'P', 'K', 'S', 'H', 'H', 'R', 'H' })
 
@@ -205,12 +271,24 @@ enum {
         /* Added in 189 */                              \
         le64_t n_tags;                                  \
         le64_t n_entry_arrays;                          \
+        /* Added upstream in 246 and later, only the */ \
+        /* tail entry fields are maintained here */     \
+        le64_t data_hash_chain_depth;                   \
+        le64_t field_hash_chain_depth;                  \
+        le32_t tail_entry_array_offset;                 \
+        le32_t tail_entry_array_n_entries;              \
+        le64_t tail_entry_offset;                       \
+        /* Specific to this implementation */           \
+        le64_t dictionary_offset;                       \
+        le64_t field_index_offset;                      \
+        le64_t time_index_offset;                       \
         }
 
 struct Header struct_Header__contents;
 struct Header__packed struct_Header__contents _packed_;
 assert_cc(sizeof(struct Header) == sizeof(struct Header__packed));
-assert_cc(sizeof(struct Header) == 240);
+assert_cc(sizeof(struct Header) == 296);
+assert_cc(offsetof(struct Header, dictionary_offset) == 272);
 
 #define FSS_HEADER_SIGNATURE ((char[]) { 'K', 'S', 'H', 'H', 'R', 'H', 'L', 'P' })
 
@@ -39,6 +39,29 @@
 #define DEFAULT_COMPRESS_THRESHOLD (512ULL)
 #define MIN_COMPRESS_THRESHOLD (8ULL)
 
+/* DATA objects below the compression threshold but at least this large are compressed with a per-file
+ * dictionary, trained from such objects written to the file it replaces */
+#define MIN_DICTIONARY_COMPRESS_BYTES (32ULL)
+
+/* How much sample data to collect for training the dictionary at most and at least, and how large it may
+ * become. zstd recommends roughly 100x as much sample data as the dictionary size for good results. */
+#define DICTIONARY_SAMPLES_SIZE (256U*1024U)
+#define DICTIONARY_SAMPLES_SIZE_MIN (64U*1024U)
+#define DICTIONARY_SAMPLES_MAX 8192U
+#define DICTIONARY_SIZE_MAX (8U*1024U)
+
+/* Fields with more distinct values than this, or with longer values, are not included in the field index
+ * written when archiving a file. Enumerating them is rarely useful, and the index would become large. */
+#define FIELD_INDEX_VALUES_MAX 1024U
+#define FIELD_INDEX_VALUE_SIZE_MAX 512U
+
+/* The time index written when archiving a file references every this many entries */
+#define TIME_INDEX_INTERVAL 1024U
+
+/* Files are usually full when they are archived, hence the indexes written then may exceed the size limit
+ * by this much */
+#define ARCHIVE_INDEX_SIZE_MAX (1024 * 1024ULL)           /* 1 MiB */
+
 /* This is the minimum journal file size */
 #define JOURNAL_FILE_SIZE_MIN (512 * 1024ULL)             /* 512 KiB */
 
@@ -69,9 +92,22 @@
 /* n_data was the first entry we added after the initial file format design */
 #define HEADER_SIZE_MIN ALIGN64(offsetof(Header, n_data))
 
+/* The header size of files not using any of the fields specific to this implementation */
+#define HEADER_SIZE_BASE ALIGN64(offsetof(Header, data_hash_chain_depth))
+
 /* How many entries to keep in the entry array chain cache at max */
 #define CHAIN_CACHE_MAX 20
 
+/* How many slots the in-memory data object cache has, must be a power of two */
+#define DATA_CACHE_SIZE 2048U
+
+/* How many slots of the data object cache we look at for each hash */
+#define DATA_CACHE_PROBE_MAX 4U
+
+/* How many slots the offset translation cache used when copying entries between files has, must be a power of
+ * two */
+#define COPY_CACHE_SIZE 8192U
+
 /* How much to increase the journal file size at once each time we allocate something new. */
 #define FILE_SIZE_INCREASE (8 * 1024 * 1024ULL)          /* 8MB */
 
@@ -380,6 +416,11 @@ JournalFile* journal_file_close(JournalFile *f) {
                 (void) btrfs_defrag_fd(f->fd);
         }
 
+        if (f->data_cache)
+                log_debug("%s: data object cache statistics: %u hit, %u miss",
+                          f->path, f->data_cache_hit, f->data_cache_missed);
+        free(f->data_cache);
+
         if (f->close_fd)
                 safe_close(f->fd);
         free(f->path);
@@ -387,11 +428,18 @@ JournalFile* journal_file_close(JournalFile *f) {
         mmap_cache_unref(f->mmap);
 
         ordered_hashmap_free_free(f->chain_cache);
+        free(f->time_index);
 
-#if HAVE_XZ || HAVE_LZ4
+#if HAVE_COMPRESSION
         free(f->compress_buffer);
 #endif
 
+#if HAVE_ZSTD
+        compression_dictionary_free(f->dictionary);
+        free(f->dictionary_samples);
+        free(f->dictionary_sample_sizes);
+#endif
+
 #if HAVE_GCRYPT
         if (f->fss_file)
                 munmap(f->fss_file, PAGE_ALIGN(f->fss_file_size));
@@ -407,19 +455,25 @@ JournalFile* journal_file_close(JournalFile *f) {
         return mfree(f);
 }
 
-static int journal_file_init_header(JournalFile *f, JournalFile *template) {
+static int journal_file_init_header(JournalFile *f, JournalFile *template, bool extended) {
         Header h = {};
+        uint64_t header_size;
         ssize_t k;
         int r;
 
         assert(f);
 
+        /* Only files that may carry a compression dictionary or archive indexes get a header large enough
+         * to reference them. That includes upstream's newer fields, which sit in between. */
+        header_size = extended ? ALIGN64(sizeof(h)) : HEADER_SIZE_BASE;
+
         memcpy(h.signature, HEADER_SIGNATURE, 8);
-        h.header_size = htole64(ALIGN64(sizeof(h)));
+        h.header_size = htole64(header_size);
 
         h.incompatible_flags |= htole32(
                 f->compress_xz * HEADER_INCOMPATIBLE_COMPRESSED_XZ |
-                f->compress_lz4 * HEADER_INCOMPATIBLE_COMPRESSED_LZ4);
+                f->compress_lz4 * HEADER_INCOMPATIBLE_COMPRESSED_LZ4 |
+                f->compress_zstd * HEADER_INCOMPATIBLE_COMPRESSED_ZSTD);
 
         h.compatible_flags = htole32(
                 f->seal * HEADER_COMPATIBLE_SEALED);
@@ -434,11 +488,11 @@ static int journal_file_init_header(JournalFile *f, JournalFile *template) {
         } else
                 h.seqnum_id = h.file_id;
 
-        k = pwrite(f->fd, &h, sizeof(h), 0);
+        k = pwrite(f->fd, &h, header_size, 0);
         if (k < 0)
                 return -errno;
 
-        if (k != sizeof(h))
+        if ((uint64_t) k != header_size)
                 return -EIO;
 
         return 0;
@@ -489,16 +543,24 @@ static bool warn_wrong_flags(const JournalFile *f, bool compatible) {
                                   f->path, type, flags & ~any);
                 flags = (flags & any) & ~supported;
                 if (flags) {
-                        const char* strv[3];
+                        const char* strv[7];
                         unsigned n = 0;
                         _cleanup_free_ char *t = NULL;
 
                         if (compatible && (flags & HEADER_COMPATIBLE_SEALED))
                                 strv[n++] = "sealed";
+                        if (compatible && (flags & HEADER_COMPATIBLE_FIELD_INDEX))
+                                strv[n++] = "field-index";
+                        if (compatible && (flags & HEADER_COMPATIBLE_TIME_INDEX))
+                                strv[n++] = "time-index";
                         if (!compatible && (flags & HEADER_INCOMPATIBLE_COMPRESSED_XZ))
                                 strv[n++] = "xz-compressed";
                         if (!compatible && (flags & HEADER_INCOMPATIBLE_COMPRESSED_LZ4))
                                 strv[n++] = "lz4-compressed";
+                        if (!compatible && (flags & HEADER_INCOMPATIBLE_COMPRESSED_ZSTD))
+                                strv[n++] = "zstd-compressed";
+                        if (!compatible && (flags & HEADER_INCOMPATIBLE_COMPRESSION_DICTIONARY))
+                                strv[n++] = "compression-dictionary";
                         strv[n] = NULL;
                         assert(n < ELEMENTSOF(strv));
 
@@ -542,6 +604,12 @@ static int journal_file_verify_header(JournalFile *f) {
         if (JOURNAL_HEADER_SEALED(f->header) && !JOURNAL_HEADER_CONTAINS(f->header, n_entry_arrays))
                 return -EBADMSG;
 
+        if (JOURNAL_HEADER_FIELD_INDEXED(f->header) && !JOURNAL_HEADER_CONTAINS(f->header, field_index_offset))
+                return -EBADMSG;
+
+        if (JOURNAL_HEADER_TIME_INDEXED(f->header) && !JOURNAL_HEADER_CONTAINS(f->header, time_index_offset))
+                return -EBADMSG;
+
         arena_size = le64toh(f->header->arena_size);
 
         if (UINT64_MAX - header_size < arena_size || header_size + arena_size > (uint64_t) f->last_stat.st_size)
@@ -595,6 +663,7 @@ static int journal_file_verify_header(JournalFile *f) {
 
         f->compress_xz = JOURNAL_HEADER_COMPRESSED_XZ(f->header);
         f->compress_lz4 = JOURNAL_HEADER_COMPRESSED_LZ4(f->header);
+        f->compress_zstd = JOURNAL_HEADER_COMPRESSED_ZSTD(f->header);
 
         f->seal = JOURNAL_HEADER_SEALED(f->header);
 
@@ -737,6 +806,9 @@ static uint64_t minimum_header_size(Object *o) {
                 [OBJECT_FIELD_HASH_TABLE] = sizeof(HashTableObject),
                 [OBJECT_ENTRY_ARRAY] = sizeof(EntryArrayObject),
                 [OBJECT_TAG] = sizeof(TagObject),
+                [OBJECT_DICTIONARY] = sizeof(DictionaryObject),
+                [OBJECT_FIELD_INDEX] = sizeof(FieldIndexObject),
+                [OBJECT_TIME_INDEX] = sizeof(TimeIndexObject),
         };
 
         if (o->object.type >= ELEMENTSOF(table) || table[o->object.type] <= 0)
@@ -873,6 +945,34 @@ static int journal_file_check_object(JournalFile *f, uint64_t offset, Object *o)
                                                le64toh(o->tag.epoch), offset);
 
                 break;
+
+        case OBJECT_DICTIONARY:
+                if (le64toh(o->object.size) - offsetof(DictionaryObject, payload) <= 0)
+                        return log_debug_errno(SYNTHETIC_ERRNO(EBADMSG),
+                                               "Bad dictionary size (<= %zu): %" PRIu64 ": %" PRIu64,
+                                               offsetof(DictionaryObject, payload),
+                                               le64toh(o->object.size),
+                                               offset);
+                break;
+
+        case OBJECT_FIELD_INDEX:
+                if (!VALID64(le64toh(o->field_index.field_offset)) ||
+                    !VALID64(le64toh(o->field_index.next_field_index_offset)))
+                        return log_debug_errno(SYNTHETIC_ERRNO(EBADMSG),
+                                               "Invalid offset in field index object: " OFSfmt ", " OFSfmt ": %" PRIu64,
+                                               le64toh(o->field_index.field_offset),
+                                               le64toh(o->field_index.next_field_index_offset),
+                                               offset);
+                break;
+
+        case OBJECT_TIME_INDEX:
+                if ((le64toh(o->object.size) - offsetof(TimeIndexObject, items)) % sizeof(TimeIndexItem) != 0 ||
+                    (le64toh(o->object.size) - offsetof(TimeIndexObject, items)) / sizeof(TimeIndexItem) <= 0)
+                        return log_debug_errno(SYNTHETIC_ERRNO(EBADMSG),
+                                               "Invalid object time index size: %" PRIu64 ": %" PRIu64,
+                                               le64toh(o->object.size),
+                                               offset);
+                break;
         }
 
         return 0;
@@ -947,6 +1047,87 @@ int journal_file_move_to_object(JournalFile *f, ObjectType type, uint64_t offset
         return 0;
 }
 
+#if HAVE_ZSTD
+static int journal_file_load_dictionary(JournalFile *f) {
+        uint64_t p;
+        Object *o;
+        int r;
+
+        assert(f);
+
+        if (f->dictionary)
+                return 1;
+
+        if (!JOURNAL_HEADER_CONTAINS(f->header, dictionary_offset))
+                return 0;
+
+        p = le64toh(f->header->dictionary_offset);
+        if (p == 0)
+                return 0;
+
+        r = journal_file_move_to_object(f, OBJECT_DICTIONARY, p, &o);
+        if (r < 0)
+                return r;
+
+        r = compression_dictionary_new(o->dictionary.payload,
+                                       le64toh(o->object.size) - offsetof(DictionaryObject, payload),
+                                       &f->dictionary);
+        if (r < 0)
+                return r;
+
+        return 1;
+}
+#endif
+
+int journal_file_decompress_blob(JournalFile *f, int compression,
+                                 const void *src, uint64_t src_size,
+                                 void **dst, size_t *dst_alloc_size, size_t* dst_size, size_t dst_max) {
+        assert(f);
+
+#if HAVE_ZSTD
+        if (compressed_blob_uses_dictionary(compression, src, src_size)) {
+                int r;
+
+                r = journal_file_load_dictionary(f);
+                if (r < 0)
+                        return r;
+                if (r == 0)
+                        return -EBADMSG; /* Compressed with a dictionary, but the file has none */
+
+                return decompress_blob_zstd_with_dictionary(f->dictionary, src, src_size,
+                                                            dst, dst_alloc_size, dst_size, dst_max);
+        }
+#endif
+
+        return decompress_blob(compression, src, src_size, dst, dst_alloc_size, dst_size, dst_max);
+}
+
+int journal_file_decompress_startswith(JournalFile *f, int compression,
+                                       const void *src, uint64_t src_size,
+                                       void **buffer, size_t *buffer_size,
+                                       const void *prefix, size_t prefix_len,
+                                       uint8_t extra) {
+        assert(f);
+
+#if HAVE_ZSTD
+        if (compressed_blob_uses_dictionary(compression, src, src_size)) {
+                int r;
+
+                r = journal_file_load_dictionary(f);
+                if (r < 0)
+                        return r;
+                if (r == 0)
+                        return -EBADMSG;
+
+                return decompress_startswith_zstd_with_dictionary(f->dictionary, src, src_size,
+                                                                  buffer, buffer_size,
+                                                                  prefix, prefix_len, extra);
+        }
+#endif
+
+        return decompress_startswith(compression, src, src_size, buffer, buffer_size, prefix, prefix_len, extra);
+}
+
 static uint64_t journal_file_entry_seqnum(JournalFile *f, uint64_t *seqnum) {
         uint64_t r;
 
@@ -1306,93 +1487,189 @@ int journal_file_find_field_object(
                                                         ret, offset);
 }
 
-int journal_file_find_data_object_with_hash(
+static int journal_file_data_object_matches(
                 JournalFile *f,
+                uint64_t p,
                 const void *data, uint64_t size, uint64_t hash,
-                Object **ret, uint64_t *offset) {
+                Object **ret) {
 
-        uint64_t p, osize, h, m;
+        Object *o;
         int r;
 
         assert(f);
-        assert(f->header);
         assert(data || size == 0);
+        assert(ret);
 
-        /* If there's no data hash table, then there's no entry. */
-        if (le64toh(f->header->data_hash_table_size) <= 0)
-                return 0;
+        /* Returns > 0 if the DATA object at p carries the specified data. In either case the object is
+         * returned, so that the caller may follow the hash chain. */
 
-        /* Map the data hash table, if it isn't mapped yet. */
-        r = journal_file_map_data_hash_table(f);
+        r = journal_file_move_to_object(f, OBJECT_DATA, p, &o);
         if (r < 0)
                 return r;
 
-        osize = offsetof(Object, data.payload) + size;
+        *ret = o;
 
-        m = le64toh(f->header->data_hash_table_size) / sizeof(HashItem);
-        if (m <= 0)
-                return -EBADMSG;
+        if (le64toh(o->data.hash) != hash)
+                return 0;
 
-        h = hash % m;
-        p = le64toh(f->data_hash_table[h].head_hash_offset);
+        if (o->object.flags & OBJECT_COMPRESSION_MASK) {
+#if HAVE_COMPRESSION
+                uint64_t l;
+                size_t rsize = 0;
 
-        while (p > 0) {
-                Object *o;
+                l = le64toh(o->object.size);
+                if (l <= offsetof(Object, data.payload))
+                        return -EBADMSG;
 
-                r = journal_file_move_to_object(f, OBJECT_DATA, p, &o);
+                l -= offsetof(Object, data.payload);
+
+                r = journal_file_decompress_blob(f, o->object.flags & OBJECT_COMPRESSION_MASK,
+                                                 o->data.payload, l, &f->compress_buffer, &f->compress_buffer_size, &rsize, 0);
                 if (r < 0)
                         return r;
 
-                if (le64toh(o->data.hash) != hash)
-                        goto next;
+                if (rsize != size ||
+                    memcmp(f->compress_buffer, data, size) != 0)
+                        return 0;
+#else
+                return -EPROTONOSUPPORT;
+#endif
+        } else if (le64toh(o->object.size) != offsetof(Object, data.payload) + size ||
+                   memcmp(o->data.payload, data, size) != 0)
+                return 0;
 
-                if (o->object.flags & OBJECT_COMPRESSION_MASK) {
-#if HAVE_XZ || HAVE_LZ4
-                        uint64_t l;
-                        size_t rsize = 0;
+        return 1;
+}
 
-                        l = le64toh(o->object.size);
-                        if (l <= offsetof(Object, data.payload))
-                                return -EBADMSG;
+static uint64_t journal_file_data_cache_get(JournalFile *f, uint64_t hash, unsigned i) {
+        DataCacheItem *c;
 
-                        l -= offsetof(Object, data.payload);
+        assert(f);
+        assert(f->data_cache);
 
-                        r = decompress_blob(o->object.flags & OBJECT_COMPRESSION_MASK,
-                                            o->data.payload, l, &f->compress_buffer, &f->compress_buffer_size, &rsize, 0);
-                        if (r < 0)
-                                return r;
+        c = f->data_cache + ((hash + i) & (DATA_CACHE_SIZE - 1));
+
+        return c->hash == hash ? c->offset : 0;
+}
+
+static void journal_file_data_cache_put(JournalFile *f, uint64_t hash, uint64_t p) {
+        unsigned i;
+
+        assert(f);
+        assert(p > 0);
+
+        /* DATA objects never move or change once written, hence the cache never goes stale for the file's
+         * lifetime. We only bother for files we write to, as that's where the same fields are looked up over
+         * and over again. */
+        if (!f->writable)
+                return;
+
+        if (!f->data_cache) {
+                f->data_cache = new0(DataCacheItem, DATA_CACHE_SIZE);
+                if (!f->data_cache)
+                        return; /* The cache is optional, just continue without it */
+        }
+
+        /* Find a free slot, and if there's none just replace the first one we probed */
+        for (i = 0; i < DATA_CACHE_PROBE_MAX; i++) {
+                DataCacheItem *c = f->data_cache + ((hash + i) & (DATA_CACHE_SIZE - 1));
+
+                if (c->offset == 0 || (c->hash == hash && c->offset == p))
+                        break;
+        }
+        if (i >= DATA_CACHE_PROBE_MAX)
+                i = 0;
+
+        f->data_cache[(hash + i) & (DATA_CACHE_SIZE - 1)] = (DataCacheItem) {
+                .hash = hash,
+                .offset = p,
+        };
+}
+
+unsigned journal_file_data_cache_get_hit(JournalFile *f) {
+        assert(f);
+
+        return f->data_cache_hit;
+}
+
+unsigned journal_file_data_cache_get_missed(JournalFile *f) {
+        assert(f);
+
+        return f->data_cache_missed;
+}
+
+int journal_file_find_data_object_with_hash(
+                JournalFile *f,
+                const void *data, uint64_t size, uint64_t hash,
+                Object **ret, uint64_t *offset) {
+
+        uint64_t p, h, m;
+        Object *o;
+        int r;
+
+        assert(f);
+        assert(f->header);
+        assert(data || size == 0);
 
-                        if (rsize == size &&
-                            memcmp(f->compress_buffer, data, size) == 0) {
+        /* If there's no data hash table, then there's no entry. */
+        if (le64toh(f->header->data_hash_table_size) <= 0)
+                return 0;
 
-                                if (ret)
-                                        *ret = o;
+        /* Before walking the hash chain in the file, let's see if we looked at this object recently */
+        if (f->data_cache) {
+                unsigned i;
 
-                                if (offset)
-                                        *offset = p;
+                for (i = 0; i < DATA_CACHE_PROBE_MAX; i++) {
+                        p = journal_file_data_cache_get(f, hash, i);
+                        if (p == 0)
+                                continue;
 
-                                return 1;
+                        r = journal_file_data_object_matches(f, p, data, size, hash, &o);
+                        if (r < 0)
+                                return r;
+                        if (r > 0) {
+                                f->data_cache_hit++;
+                                goto found;
                         }
-#else
-                        return -EPROTONOSUPPORT;
-#endif
-                } else if (le64toh(o->object.size) == osize &&
-                           memcmp(o->data.payload, data, size) == 0) {
+                }
 
-                        if (ret)
-                                *ret = o;
+                f->data_cache_missed++;
+        }
 
-                        if (offset)
-                                *offset = p;
+        /* Map the data hash table, if it isn't mapped yet. */
+        r = journal_file_map_data_hash_table(f);
+        if (r < 0)
+                return r;
 
-                        return 1;
+        m = le64toh(f->header->data_hash_table_size) / sizeof(HashItem);
+        if (m <= 0)
+                return -EBADMSG;
+
+        h = hash % m;
+        p = le64toh(f->data_hash_table[h].head_hash_offset);
+
+        while (p > 0) {
+                r = journal_file_data_object_matches(f, p, data, size, hash, &o);
+                if (r < 0)
+                        return r;
+                if (r > 0) {
+                        journal_file_data_cache_put(f, hash, p);
+                        goto found;
                 }
 
-        next:
                 p = le64toh(o->data.next_hash_offset);
         }
 
         return 0;
+
+found:
+        if (ret)
+                *ret = o;
+
+        if (offset)
+                *offset = p;
+
+        return 1;
 }
 
 int journal_file_find_data_object(
@@ -1474,68 +1751,200 @@ static int journal_file_append_field(
         return 0;
 }
 
-static int journal_file_append_data(
-                JournalFile *f,
-                const void *data, uint64_t size,
-                Object **ret, uint64_t *offset) {
+#if HAVE_ZSTD
+static bool journal_file_wants_dictionary(JournalFile *f, uint64_t size) {
+        assert(f);
 
-        uint64_t hash, p;
-        uint64_t osize;
-        Object *o;
-        int r, compression = 0;
-        const void *eq;
+        /* Sealed files are excluded, since adding the dictionary changes the header flags, which are
+         * covered by the HMAC of the first tag. */
+        return f->compress_zstd &&
+                !f->seal &&
+                size >= MIN_DICTIONARY_COMPRESS_BYTES &&
+                size < f->compress_threshold_bytes;
+}
 
+static void journal_file_add_dictionary_sample(JournalFile *f, const void *data, uint64_t size) {
         assert(f);
-        assert(data || size == 0);
+        assert(data);
 
-        hash = hash64(data, size);
+        /* Collects short DATA objects, from which the dictionary of the file replacing this one is trained
+         * when rotating. Training takes a while, hence we merely copy the data here and don't stall the
+         * writer with it. */
 
-        r = journal_file_find_data_object_with_hash(f, data, size, hash, &o, &p);
-        if (r < 0)
-                return r;
-        if (r > 0) {
+        if (f->dictionary_samples_size + size > DICTIONARY_SAMPLES_SIZE ||
+            f->n_dictionary_samples >= DICTIONARY_SAMPLES_MAX)
+                return;
 
-                if (ret)
-                        *ret = o;
+        if (!GREEDY_REALLOC(f->dictionary_samples, f->dictionary_samples_allocated, f->dictionary_samples_size + size) ||
+            !GREEDY_REALLOC(f->dictionary_sample_sizes, f->dictionary_sample_sizes_allocated, f->n_dictionary_samples + 1))
+                return; /* Not fatal, we'll just train from fewer samples */
 
-                if (offset)
-                        *offset = p;
+        memcpy((uint8_t*) f->dictionary_samples + f->dictionary_samples_size, data, size);
+        f->dictionary_samples_size += size;
+        f->dictionary_sample_sizes[f->n_dictionary_samples++] = size;
+}
+
+static int journal_file_train_dictionary(JournalFile *f, void **ret, size_t *ret_size) {
+        int r;
+
+        assert(f);
+        assert(ret);
+        assert(ret_size);
+
+        /* Returns 0 and no dictionary if too few samples were collected, training would likely fail then
+         * or yield a dictionary not worth the space. */
 
+        if (f->dictionary_samples_size < DICTIONARY_SAMPLES_SIZE_MIN) {
+                *ret = NULL;
+                *ret_size = 0;
                 return 0;
         }
 
-        osize = offsetof(Object, data.payload) + size;
-        r = journal_file_append_object(f, OBJECT_DATA, osize, &o, &p);
+        r = compression_dictionary_train(f->dictionary_samples, f->dictionary_sample_sizes, f->n_dictionary_samples,
+                                         DICTIONARY_SIZE_MAX, ret, ret_size);
         if (r < 0)
                 return r;
 
-        o->data.hash = htole64(hash);
+        return 1;
+}
 
-#if HAVE_XZ || HAVE_LZ4
-        if (JOURNAL_FILE_COMPRESS(f) && size >= f->compress_threshold_bytes) {
-                size_t rsize = 0;
+static int journal_file_append_dictionary(JournalFile *f, const void *dict, size_t dict_size) {
+        uint64_t p;
+        Object *o;
+        int r;
 
-                compression = compress_blob(data, size, o->data.payload, size - 1, &rsize);
+        assert(f);
+        assert(f->header);
+        assert(dict);
+        assert(dict_size > 0);
 
-                if (compression >= 0) {
-                        o->object.size = htole64(offsetof(Object, data.payload) + rsize);
-                        o->object.flags |= compression;
+        /* Adds the dictionary to a freshly created file, before any entries are written to it */
 
-                        log_debug("Compressed data object %"PRIu64" -> %zu using %s",
-                                  size, rsize, object_compressed_to_string(compression));
-                } else
-                        /* Compression didn't work, we don't really care why, let's continue without compression */
-                        compression = 0;
-        }
-#endif
+        if (!f->compress_zstd || f->seal)
+                return 0;
 
-        if (compression == 0)
+        if (!JOURNAL_HEADER_CONTAINS(f->header, dictionary_offset) || f->header->dictionary_offset != 0)
+                return 0;
+
+        r = compression_dictionary_new(dict, dict_size, &f->dictionary);
+        if (r < 0)
+                return r;
+
+        r = journal_file_append_object(f, OBJECT_DICTIONARY, offsetof(Object, dictionary.payload) + dict_size, &o, &p);
+        if (r < 0) {
+                f->dictionary = compression_dictionary_free(f->dictionary);
+                return r;
+        }
+
+        memcpy(o->dictionary.payload, dict, dict_size);
+
+        f->header->dictionary_offset = htole64(p);
+        f->header->incompatible_flags |= htole32(HEADER_INCOMPATIBLE_COMPRESSION_DICTIONARY);
+
+        log_debug("Added %zu byte compression dictionary to %s.", dict_size, f->path);
+        return 1;
+}
+#endif
+
+static int journal_file_append_data_with_hash(
+                JournalFile *f,
+                const void *data, uint64_t size, uint64_t hash,
+                const JournalFileCompressed *compressed,
+                Object **ret, uint64_t *offset) {
+
+        uint64_t p;
+        uint64_t osize;
+        Object *o;
+        int r, compression = 0;
+        const void *eq;
+
+        assert(f);
+        assert(data || size == 0);
+
+        r = journal_file_find_data_object_with_hash(f, data, size, hash, &o, &p);
+        if (r < 0)
+                return r;
+        if (r > 0) {
+
+                if (ret)
+                        *ret = o;
+
+                if (offset)
+                        *offset = p;
+
+                return 0;
+        }
+
+#if HAVE_ZSTD
+        if (journal_file_wants_dictionary(f, size)) {
+                journal_file_add_dictionary_sample(f, data, size);
+
+                if (!f->dictionary_failed) {
+                        r = journal_file_load_dictionary(f);
+                        if (r < 0) {
+                                log_debug_errno(r, "Failed to load compression dictionary of %s, ignoring: %m", f->path);
+                                f->dictionary_failed = true;
+                        }
+                }
+        }
+#endif
+
+        osize = offsetof(Object, data.payload) + size;
+        r = journal_file_append_object(f, OBJECT_DATA, osize, &o, &p);
+        if (r < 0)
+                return r;
+
+        o->data.hash = htole64(hash);
+
+#if HAVE_COMPRESSION
+        if (JOURNAL_FILE_COMPRESS(f) && size >= f->compress_threshold_bytes) {
+                size_t rsize = 0;
+
+                if (compressed && compressed->compression == JOURNAL_FILE_COMPRESSION(f)) {
+                        /* The caller already did the work for us */
+                        if (compressed->data && compressed->size < size) {
+                                memcpy(o->data.payload, compressed->data, compressed->size);
+                                rsize = compressed->size;
+                                compression = compressed->compression;
+                        } else
+                                compression = -ENOBUFS;
+                } else
+                        compression = compress_blob(JOURNAL_FILE_COMPRESSION(f), data, size, o->data.payload, size - 1, &rsize);
+
+                if (compression >= 0) {
+                        o->object.size = htole64(offsetof(Object, data.payload) + rsize);
+                        o->object.flags |= compression;
+
+                        log_debug("Compressed data object %"PRIu64" -> %zu using %s",
+                                  size, rsize, object_compressed_to_string(compression));
+                } else
+                        /* Compression didn't work, we don't really care why, let's continue without compression */
+                        compression = 0;
+        }
+#endif
+
+#if HAVE_ZSTD
+        if (compression == 0 && f->dictionary && journal_file_wants_dictionary(f, size)) {
+                size_t rsize = 0;
+
+                r = compress_blob_zstd_with_dictionary(f->dictionary, data, size, o->data.payload, size - 1, &rsize);
+                if (r >= 0) {
+                        compression = OBJECT_COMPRESSED_ZSTD;
+                        o->object.size = htole64(offsetof(Object, data.payload) + rsize);
+                        o->object.flags |= compression;
+                }
+        }
+#endif
+
+        if (compression == 0)
                 memcpy_safe(o->data.payload, data, size);
 
         r = journal_file_link_data(f, o, p, hash);
         if (r < 0)
                 return r;
 
+        journal_file_data_cache_put(f, hash, p);
+
 #if HAVE_GCRYPT
         r = journal_file_hmac_put_object(f, OBJECT_DATA, o, p);
         if (r < 0)
@@ -1575,6 +1984,17 @@ static int journal_file_append_data(
         return 0;
 }
 
+static int journal_file_append_data(
+                JournalFile *f,
+                const void *data, uint64_t size,
+                Object **ret, uint64_t *offset) {
+
+        assert(f);
+        assert(data || size == 0);
+
+        return journal_file_append_data_with_hash(f, data, size, hash64(data, size), NULL, ret, offset);
+}
+
 uint64_t journal_file_entry_n_items(Object *o) {
         assert(o);
 
@@ -1602,9 +2022,30 @@ uint64_t journal_file_hash_table_n_items(Object *o) {
         return (le64toh(o->object.size) - offsetof(Object, hash_table.items)) / sizeof(HashItem);
 }
 
+static void link_entry_array_tail(le32_t *tail, le32_t *tidx, uint64_t a, uint64_t n) {
+
+        /* Upstream readers use these to find the last entry array of the main chain directly. The fields
+         * are only 32bit wide, hence we clear them if the file outgrew that. */
+
+        if (!tail)
+                return;
+
+        assert(tidx);
+
+        if (a > UINT32_MAX || n > UINT32_MAX) {
+                *tail = *tidx = 0;
+                return;
+        }
+
+        *tail = htole32(a);
+        *tidx = htole32(n);
+}
+
 static int link_entry_into_array(JournalFile *f,
                                  le64_t *first,
                                  le64_t *idx,
+                                 le32_t *tail,
+                                 le32_t *tidx,
                                  uint64_t p) {
         int r;
         uint64_t n = 0, ap = 0, q, i, a, hidx;
@@ -1628,6 +2069,7 @@ static int link_entry_into_array(JournalFile *f,
                 if (i < n) {
                         o->entry_array.items[i] = htole64(p);
                         *idx = htole64(hidx + 1);
+                        link_entry_array_tail(tail, tidx, a, i + 1);
                         return 0;
                 }
 
@@ -1672,6 +2114,7 @@ static int link_entry_into_array(JournalFile *f,
                 f->header->n_entry_arrays = htole64(le64toh(f->header->n_entry_arrays) + 1);
 
         *idx = htole64(hidx + 1);
+        link_entry_array_tail(tail, tidx, q, i + 1);
 
         return 0;
 }
@@ -1696,7 +2139,7 @@ static int link_entry_into_array_plus_one(JournalFile *f,
                 le64_t i;
 
                 i = htole64(le64toh(*idx) - 1);
-                r = link_entry_into_array(f, first, &i, p);
+                r = link_entry_into_array(f, first, &i, NULL, NULL, p);
                 if (r < 0)
                         return r;
         }
@@ -1729,6 +2172,7 @@ static int journal_file_link_entry_item(JournalFile *f, Object *o, uint64_t offs
 
 static int journal_file_link_entry(JournalFile *f, Object *o, uint64_t offset) {
         uint64_t n, i;
+        bool tail;
         int r;
 
         assert(f);
@@ -1741,14 +2185,21 @@ static int journal_file_link_entry(JournalFile *f, Object *o, uint64_t offset) {
 
         __sync_synchronize();
 
-        /* Link up the entry itself */
+        /* Link up the entry itself. Files with the larger header also carry upstream's tail entry
+         * fields, which we keep up to date so that upstream can read them. */
+        tail = JOURNAL_HEADER_CONTAINS(f->header, tail_entry_offset);
         r = link_entry_into_array(f,
                                   &f->header->entry_array_offset,
                                   &f->header->n_entries,
+                                  tail ? &f->header->tail_entry_array_offset : NULL,
+                                  tail ? &f->header->tail_entry_array_n_entries : NULL,
                                   offset);
         if (r < 0)
                 return r;
 
+        if (tail)
+                f->header->tail_entry_offset = htole64(offset);
+
         /* log_debug("=> %s seqnr=%"PRIu64" n_entries=%"PRIu64, f->path, o->entry.seqnum, f->header->n_entries); */
 
         if (f->header->head_entry_realtime == 0)
@@ -1913,16 +2364,16 @@ static int entry_item_cmp(const EntryItem *a, const EntryItem *b) {
         return CMP(le64toh(a->object_offset), le64toh(b->object_offset));
 }
 
-int journal_file_append_entry(
+static int journal_file_append_entry_one(
                 JournalFile *f,
                 const dual_timestamp *ts,
                 const sd_id128_t *boot_id,
-                const struct iovec iovec[], unsigned n_iovec,
+                const struct iovec iovec[], const uint64_t hashes[], const JournalFileCompressed compressed[], unsigned n_iovec,
+                EntryItem *items,
                 uint64_t *seqnum,
                 Object **ret, uint64_t *offset) {
 
         unsigned i;
-        EntryItem *items;
         int r;
         uint64_t xor_hash = 0;
         struct dual_timestamp _ts;
@@ -1930,6 +2381,7 @@ int journal_file_append_entry(
         assert(f);
         assert(f->header);
         assert(iovec || n_iovec == 0);
+        assert(items);
 
         if (ts) {
                 if (!VALID_REALTIME(ts->realtime))
@@ -1951,14 +2403,14 @@ int journal_file_append_entry(
                 return r;
 #endif
 
-        /* alloca() can't take 0, hence let's allocate at least one */
-        items = newa(EntryItem, MAX(1u, n_iovec));
-
         for (i = 0; i < n_iovec; i++) {
                 uint64_t p;
                 Object *o;
 
-                r = journal_file_append_data(f, iovec[i].iov_base, iovec[i].iov_len, &o, &p);
+                r = journal_file_append_data_with_hash(f, iovec[i].iov_base, iovec[i].iov_len,
+                                                       hashes ? hashes[i] : hash64(iovec[i].iov_base, iovec[i].iov_len),
+                                                       compressed ? compressed + i : NULL,
+                                                       &o, &p);
                 if (r < 0)
                         return r;
 
@@ -1971,7 +2423,11 @@ int journal_file_append_entry(
          * times for rotating media. */
         typesafe_qsort(items, n_iovec, entry_item_cmp);
 
-        r = journal_file_append_entry_internal(f, ts, boot_id, xor_hash, items, n_iovec, seqnum, ret, offset);
+        return journal_file_append_entry_internal(f, ts, boot_id, xor_hash, items, n_iovec, seqnum, ret, offset);
+}
+
+static int journal_file_append_entry_finish(JournalFile *f, int r) {
+        assert(f);
 
         /* If the memory mapping triggered a SIGBUS then we return an
          * IO error and ignore the error code passed down to us, since
@@ -1989,6 +2445,89 @@ int journal_file_append_entry(
         return r;
 }
 
+int journal_file_append_entry_with_hashes(
+                JournalFile *f,
+                const dual_timestamp *ts,
+                const sd_id128_t *boot_id,
+                const struct iovec iovec[], const uint64_t hashes[], unsigned n_iovec,
+                uint64_t *seqnum,
+                Object **ret, uint64_t *offset) {
+
+        EntryItem *items;
+        int r;
+
+        assert(f);
+        assert(f->header);
+        assert(iovec || n_iovec == 0);
+
+        /* If hashes is non-NULL, it contains the hash64() of each of the iovecs, as computed by the caller
+         * beforehand, e.g. because the same fields are added to many entries. */
+
+        /* alloca() can't take 0, hence let's allocate at least one */
+        items = newa(EntryItem, MAX(1u, n_iovec));
+
+        r = journal_file_append_entry_one(f, ts, boot_id, iovec, hashes, NULL, n_iovec, items, seqnum, ret, offset);
+
+        return journal_file_append_entry_finish(f, r);
+}
+
+int journal_file_append_entry(
+                JournalFile *f,
+                const dual_timestamp *ts,
+                const sd_id128_t *boot_id,
+                const struct iovec iovec[], unsigned n_iovec,
+                uint64_t *seqnum,
+                Object **ret, uint64_t *offset) {
+
+        return journal_file_append_entry_with_hashes(f, ts, boot_id, iovec, NULL, n_iovec, seqnum, ret, offset);
+}
+
+int journal_file_append_entries(
+                JournalFile *f,
+                const sd_id128_t *boot_id,
+                const JournalFileEntry entries[], size_t n_entries,
+                uint64_t *seqnum,
+                size_t *ret_n_appended) {
+
+        _cleanup_free_ EntryItem *items = NULL;
+        unsigned max_iovec = 1;
+        size_t i;
+        int r = 0;
+
+        assert(f);
+        assert(f->header);
+        assert(entries || n_entries == 0);
+
+        /* Appends a number of entries in order, stopping at the first one that fails. The items array is
+         * shared between the entries, and the SIGBUS check and change notification are done only once for
+         * the whole batch. Returns the error of the failed entry (if any), and the number of entries that
+         * were successfully appended in ret_n_appended. */
+
+        for (i = 0; i < n_entries; i++)
+                max_iovec = MAX(max_iovec, entries[i].n_iovec);
+
+        items = new(EntryItem, max_iovec);
+        if (!items)
+                return -ENOMEM;
+
+        for (i = 0; i < n_entries; i++) {
+                r = journal_file_append_entry_one(f, &entries[i].ts, boot_id,
+                                                  entries[i].iovec, entries[i].hashes, entries[i].compressed,
+                                                  entries[i].n_iovec,
+                                                  items, seqnum, NULL, NULL);
+                if (r < 0)
+                        break;
+        }
+
+        if (ret_n_appended)
+                *ret_n_appended = i;
+
+        if (n_entries == 0)
+                return 0;
+
+        return journal_file_append_entry_finish(f, r);
+}
+
 typedef struct ChainCacheItem {
         uint64_t first; /* the array at the beginning of the chain */
         uint64_t array; /* the cached array */
@@ -2490,15 +3029,186 @@ static int test_object_realtime(JournalFile *f, uint64_t p, uint64_t needle) {
                 return TEST_RIGHT;
 }
 
+static int journal_file_load_time_index(JournalFile *f) {
+        uint64_t p;
+        Object *o;
+        int r;
+
+        assert(f);
+
+        /* Loads the time index into memory. Returns > 0 if there's one and it covers all entries. */
+
+        if (!f->time_index_loaded) {
+                f->time_index_loaded = true;
+
+                if (!JOURNAL_HEADER_TIME_INDEXED(f->header))
+                        return 0;
+
+                p = le64toh(f->header->time_index_offset);
+                if (p == 0)
+                        return 0;
+
+                r = journal_file_move_to_object(f, OBJECT_TIME_INDEX, p, &o);
+                if (r < 0)
+                        return r;
+
+                /* Entries were added after the index was written, hence it is incomplete */
+                if (o->time_index.n_entries != f->header->n_entries)
+                        return 0;
+
+                f->n_time_index = (le64toh(o->object.size) - offsetof(Object, time_index.items)) / sizeof(TimeIndexItem);
+                f->time_index = newdup(TimeIndexItem, o->time_index.items, f->n_time_index);
+                if (!f->time_index) {
+                        f->n_time_index = 0;
+                        return -ENOMEM;
+                }
+        }
+
+        return f->n_time_index > 0;
+}
+
+static int journal_file_bisect_time_index(
+                JournalFile *f,
+                uint64_t realtime,
+                direction_t direction,
+                Object **ret,
+                uint64_t *offset) {
+
+        const TimeIndexItem *lo, *hi;
+        uint64_t left, right, mid, p;
+        Object *array, *o;
+        size_t n;
+        int r;
+
+        assert(f);
+
+        /* Looks up the entry through the time index: the neighbouring items that enclose the realtime are
+         * found in memory, and only the entries between them are bisected. Returns -ENODATA if the index
+         * can't be used, in which case we fall back to bisecting the whole entry array chain. */
+
+        r = journal_file_load_time_index(f);
+        if (r < 0)
+                return r;
+        if (r == 0)
+                return -ENODATA;
+
+        n = f->n_time_index;
+
+        /* The last item is the last entry, hence this finds the entry, if there's any */
+        left = 0;
+        right = n;
+        while (left < right) {
+                mid = (left + right) / 2;
+
+                if (direction == DIRECTION_DOWN ?
+                    le64toh(f->time_index[mid].realtime) >= realtime :
+                    le64toh(f->time_index[mid].realtime) > realtime)
+                        right = mid;
+                else
+                        left = mid + 1;
+        }
+
+        if (direction == DIRECTION_DOWN) {
+                /* left is the first item at or after the realtime */
+                if (left >= n)
+                        return 0;
+                if (left == 0) {
+                        p = le64toh(f->time_index[0].entry_offset);
+                        goto found;
+                }
+
+                lo = f->time_index + left - 1;
+                hi = f->time_index + left;
+        } else {
+                /* left is the first item after the realtime */
+                if (left == 0)
+                        return 0;
+                if (left >= n) {
+                        p = le64toh(f->time_index[n - 1].entry_offset);
+                        goto found;
+                }
+
+                lo = f->time_index + left - 1;
+                hi = f->time_index + left;
+        }
+
+        /* The entries between the two items are referenced from two different arrays, let's not bother */
+        if (lo->entry_array_offset != hi->entry_array_offset)
+                return -ENODATA;
+
+        r = journal_file_move_to_object(f, OBJECT_ENTRY_ARRAY, le64toh(hi->entry_array_offset), &array);
+        if (r < 0)
+                return r;
+
+        left = le64toh(lo->entry_array_index);
+        right = le64toh(hi->entry_array_index);
+        if (left >= right || right >= journal_file_entry_array_n_items(array))
+                return -ENODATA;
+
+        /* We know that lo is before and hi after the realtime, bisect the ones in between */
+        if (direction == DIRECTION_DOWN)
+                left++;
+        else
+                right--;
+
+        while (left < right) {
+                mid = direction == DIRECTION_DOWN ? (left + right) / 2 : (left + right + 1) / 2;
+
+                p = le64toh(array->entry_array.items[mid]);
+                if (p <= 0)
+                        return -ENODATA;
+
+                r = test_object_realtime(f, p, realtime);
+                if (r == -EBADMSG)
+                        return -ENODATA;
+                if (r < 0)
+                        return r;
+
+                if (direction == DIRECTION_DOWN) {
+                        if (r == TEST_LEFT)
+                                left = mid + 1;
+                        else
+                                right = mid;
+                } else {
+                        if (r == TEST_RIGHT)
+                                right = mid - 1;
+                        else
+                                left = mid;
+                }
+        }
+
+        p = le64toh(array->entry_array.items[left]);
+        if (p <= 0)
+                return -ENODATA;
+
+found:
+        r = journal_file_move_to_object(f, OBJECT_ENTRY, p, &o);
+        if (r < 0)
+                return r;
+
+        if (ret)
+                *ret = o;
+        if (offset)
+                *offset = p;
+
+        return 1;
+}
+
 int journal_file_move_to_entry_by_realtime(
                 JournalFile *f,
                 uint64_t realtime,
                 direction_t direction,
                 Object **ret,
                 uint64_t *offset) {
+        int r;
+
         assert(f);
         assert(f->header);
 
+        r = journal_file_bisect_time_index(f, realtime, direction, ret, offset);
+        if (r != -ENODATA)
+                return r;
+
         return generic_array_bisect(f,
                                     le64toh(f->header->entry_array_offset),
                                     le64toh(f->header->n_entries),
@@ -3026,6 +3736,21 @@ void journal_file_dump(JournalFile *f) {
                                le64toh(o->tag.epoch));
                         break;
 
+                case OBJECT_DICTIONARY:
+                        printf("Type: OBJECT_DICTIONARY\n");
+                        break;
+
+                case OBJECT_FIELD_INDEX:
+                        printf("Type: OBJECT_FIELD_INDEX field=" OFSfmt " n_items=%"PRIu64"\n",
+                               le64toh(o->field_index.field_offset),
+                               le64toh(o->field_index.n_items));
+                        break;
+
+                case OBJECT_TIME_INDEX:
+                        printf("Type: OBJECT_TIME_INDEX interval=%"PRIu64"\n",
+                               le64toh(o->time_index.interval));
+                        break;
+
                 default:
                         printf("Type: unknown (%i)\n", o->object.type);
                         break;
@@ -3070,8 +3795,8 @@ void journal_file_print_header(JournalFile *f) {
                "Boot ID: %s\n"
                "Sequential number ID: %s\n"
                "State: %s\n"
-               "Compatible flags:%s%s\n"
-               "Incompatible flags:%s%s%s\n"
+               "Compatible flags:%s%s%s%s\n"
+               "Incompatible flags:%s%s%s%s%s\n"
                "Header size: %"PRIu64"\n"
                "Arena size: %"PRIu64"\n"
                "Data hash table size: %"PRIu64"\n"
@@ -3093,9 +3818,13 @@ void journal_file_print_header(JournalFile *f) {
                f->header->state == STATE_ONLINE ? "ONLINE" :
                f->header->state == STATE_ARCHIVED ? "ARCHIVED" : "UNKNOWN",
                JOURNAL_HEADER_SEALED(f->header) ? " SEALED" : "",
+               JOURNAL_HEADER_FIELD_INDEXED(f->header) ? " FIELD-INDEX" : "",
+               JOURNAL_HEADER_TIME_INDEXED(f->header) ? " TIME-INDEX" : "",
                (le32toh(f->header->compatible_flags) & ~HEADER_COMPATIBLE_ANY) ? " ???" : "",
                JOURNAL_HEADER_COMPRESSED_XZ(f->header) ? " COMPRESSED-XZ" : "",
                JOURNAL_HEADER_COMPRESSED_LZ4(f->header) ? " COMPRESSED-LZ4" : "",
+               JOURNAL_HEADER_COMPRESSED_ZSTD(f->header) ? " COMPRESSED-ZSTD" : "",
+               JOURNAL_HEADER_COMPRESSION_DICTIONARY(f->header) ? " COMPRESSION-DICTIONARY" : "",
                (le32toh(f->header->incompatible_flags) & ~HEADER_INCOMPATIBLE_ANY) ? " ???" : "",
                le64toh(f->header->header_size),
                le64toh(f->header->arena_size),
@@ -3128,6 +3857,15 @@ void journal_file_print_header(JournalFile *f) {
         if (JOURNAL_HEADER_CONTAINS(f->header, n_entry_arrays))
                 printf("Entry array objects: %"PRIu64"\n",
                        le64toh(f->header->n_entry_arrays));
+        if (JOURNAL_HEADER_CONTAINS(f->header, dictionary_offset) && f->header->dictionary_offset != 0)
+                printf("Compression dictionary offset: %"PRIu64"\n",
+                       le64toh(f->header->dictionary_offset));
+        if (JOURNAL_HEADER_FIELD_INDEXED(f->header) && f->header->field_index_offset != 0)
+                printf("Field index offset: %"PRIu64"\n",
+                       le64toh(f->header->field_index_offset));
+        if (JOURNAL_HEADER_TIME_INDEXED(f->header) && f->header->time_index_offset != 0)
+                printf("Time index offset: %"PRIu64"\n",
+                       le64toh(f->header->time_index_offset));
 
         if (fstat(f->fd, &st) >= 0)
                 printf("Disk usage: %s\n", format_bytes(bytes, sizeof(bytes), (uint64_t) st.st_blocks * 512ULL));
@@ -3173,7 +3911,7 @@ int journal_file_open(
                 const char *fname,
                 int flags,
                 mode_t mode,
-                bool compress,
+                int compress,
                 uint64_t compress_threshold_bytes,
                 bool seal,
                 JournalMetrics *metrics,
@@ -3193,6 +3931,9 @@ int journal_file_open(
         if (!IN_SET((flags & O_ACCMODE), O_RDONLY, O_RDWR))
                 return -EINVAL;
 
+        if (compress != 0 && !compression_supported(compress))
+                return -EOPNOTSUPP;
+
         if (fname && (flags & O_CREAT) && !endswith(fname, ".journal"))
                 return -EINVAL;
 
@@ -3208,11 +3949,9 @@ int journal_file_open(
                 .prot = prot_from_flags(flags),
                 .writable = (flags & O_ACCMODE) != O_RDONLY,
 
-#if HAVE_LZ4
-                .compress_lz4 = compress,
-#elif HAVE_XZ
-                .compress_xz = compress,
-#endif
+                .compress_xz = compress == OBJECT_COMPRESSED_XZ,
+                .compress_lz4 = compress == OBJECT_COMPRESSED_LZ4,
+                .compress_zstd = compress == OBJECT_COMPRESSED_ZSTD,
                 .compress_threshold_bytes = compress_threshold_bytes == (uint64_t) -1 ?
                                             DEFAULT_COMPRESS_THRESHOLD :
                                             MAX(MIN_COMPRESS_THRESHOLD, compress_threshold_bytes),
@@ -3227,14 +3966,14 @@ int journal_file_open(
                 char bytes[FORMAT_BYTES_MAX];
 
                 if (last_seal != f->seal ||
-                    last_compress != JOURNAL_FILE_COMPRESS(f) ||
+                    last_compress != JOURNAL_FILE_COMPRESSION(f) ||
                     last_bytes != f->compress_threshold_bytes) {
 
                         log_debug("Journal effective settings seal=%s compress=%s compress_threshold_bytes=%s",
-                                  yes_no(f->seal), yes_no(JOURNAL_FILE_COMPRESS(f)),
+                                  yes_no(f->seal), JOURNAL_FILE_COMPRESS(f) ? object_compressed_to_string(JOURNAL_FILE_COMPRESSION(f)) : "no",
                                   format_bytes(bytes, sizeof bytes, f->compress_threshold_bytes));
                         last_seal = f->seal;
-                        last_compress = JOURNAL_FILE_COMPRESS(f);
+                        last_compress = JOURNAL_FILE_COMPRESSION(f);
                         last_bytes = f->compress_threshold_bytes;
                 }
         }
@@ -3321,7 +4060,9 @@ int journal_file_open(
                 }
 #endif
 
-                r = journal_file_init_header(f, template);
+                /* Files written by journald and journal-remote get indexed when archived, and the ones
+                 * replacing an archived file may get a compression dictionary. */
+                r = journal_file_init_header(f, template, metrics || template);
                 if (r < 0)
                         goto fail;
 
@@ -3430,13 +4171,535 @@ fail:
         return r;
 }
 
-int journal_file_archive(JournalFile *f) {
-        _cleanup_free_ char *p = NULL;
+void journal_field_range_free_many(JournalFieldRange *ranges, size_t n) {
+        size_t i;
+
+        for (i = 0; i < n; i++)
+                free(ranges[i].data);
+
+        free(ranges);
+}
+
+static int journal_file_collect_field_ranges(
+                JournalFile *f,
+                uint64_t field_offset,
+                size_t n_max,
+                uint64_t size_max,
+                JournalFieldRange **ret,
+                size_t *ret_n) {
+
+        JournalFieldRange *ranges = NULL;
+        size_t n = 0, n_allocated = 0;
+        uint64_t p;
+        Object *o;
+        int r;
+
+        assert(f);
+        assert(ret);
+        assert(ret_n);
+
+        /* Walks all DATA objects of a field and determines the realtime range of the entries referencing
+         * them. Returns 0 if the field has more than n_max values or one longer than size_max. */
+
+        r = journal_file_move_to_object(f, OBJECT_FIELD, field_offset, &o);
+        if (r < 0)
+                return r;
+
+        p = le64toh(o->field.head_data_offset);
+        while (p > 0) {
+                JournalFieldRange *range;
+                uint64_t next, l;
+                Object *d;
+
+                r = journal_file_move_to_object(f, OBJECT_DATA, p, &d);
+                if (r < 0)
+                        goto fail;
+
+                next = le64toh(d->data.next_field_offset);
+
+                /* Data objects not referenced by any entry are left over from failed appends */
+                if (le64toh(d->data.n_entries) <= 0)
+                        goto next;
+
+                if (n >= n_max) {
+                        r = 0;
+                        goto fail;
+                }
+
+                if (!GREEDY_REALLOC(ranges, n_allocated, n + 1)) {
+                        r = -ENOMEM;
+                        goto fail;
+                }
+
+                range = ranges + n;
+                *range = (JournalFieldRange) {
+                        .offset = p,
+                };
+
+                l = le64toh(d->object.size) - offsetof(Object, data.payload);
+
+                if (d->object.flags & OBJECT_COMPRESSION_MASK) {
+#if HAVE_COMPRESSION
+                        size_t rsize = 0;
+
+                        r = journal_file_decompress_blob(f, d->object.flags & OBJECT_COMPRESSION_MASK,
+                                                         d->data.payload, l, &f->compress_buffer, &f->compress_buffer_size, &rsize, 0);
+                        if (r < 0)
+                                goto fail;
+
+                        if (rsize > size_max) {
+                                r = 0;
+                                goto fail;
+                        }
+
+                        range->data = memdup(f->compress_buffer, rsize);
+                        range->size = rsize;
+#else
+                        r = -EPROTONOSUPPORT;
+                        goto fail;
+#endif
+                } else {
+                        if (l > size_max) {
+                                r = 0;
+                                goto fail;
+                        }
+
+                        range->data = memdup(d->data.payload, l);
+                        range->size = l;
+                }
+                if (!range->data) {
+                        r = -ENOMEM;
+                        goto fail;
+                }
+
+                n++;
+
+                r = journal_file_next_entry_for_data(f, NULL, 0, p, DIRECTION_DOWN, &o, NULL);
+                if (r < 0)
+                        goto fail;
+                if (r == 0) {
+                        free(ranges[--n].data);
+                        goto next;
+                }
+
+                range->first_realtime = le64toh(o->entry.realtime);
+
+                r = journal_file_next_entry_for_data(f, NULL, 0, p, DIRECTION_UP, &o, NULL);
+                if (r < 0)
+                        goto fail;
+
+                range->last_realtime = r > 0 ? le64toh(o->entry.realtime) : range->first_realtime;
+
+        next:
+                p = next;
+        }
+
+        *ret = ranges;
+        *ret_n = n;
+        return 1;
+
+fail:
+        journal_field_range_free_many(ranges, n);
+        return r;
+}
+
+static int journal_file_append_field_index_one(JournalFile *f, uint64_t field_offset) {
+        JournalFieldRange *ranges = NULL;
+        uint64_t size, q, p;
+        size_t n = 0, i;
+        Object *o;
+        int r;
+
+        assert(f);
+
+        r = journal_file_collect_field_ranges(f, field_offset, FIELD_INDEX_VALUES_MAX, FIELD_INDEX_VALUE_SIZE_MAX, &ranges, &n);
+        if (r <= 0)
+                return r;
+
+        size = offsetof(Object, field_index.items);
+        for (i = 0; i < n; i++)
+                size += ALIGN64(offsetof(FieldIndexItem, payload) + ranges[i].size);
+
+        r = journal_file_append_object(f, OBJECT_FIELD_INDEX, size, &o, &p);
+        if (r < 0)
+                goto finish;
+
+        o->field_index.field_offset = htole64(field_offset);
+        o->field_index.next_field_index_offset = f->header->field_index_offset;
+        o->field_index.n_entries = f->header->n_entries;
+        o->field_index.n_items = htole64(n);
+
+        q = offsetof(Object, field_index.items);
+        memzero((uint8_t*) o + q, size - q);
+
+        for (i = 0; i < n; i++) {
+                FieldIndexItem *item = (FieldIndexItem*) ((uint8_t*) o + q);
+
+                item->data_offset = htole64(ranges[i].offset);
+                item->first_realtime = htole64(ranges[i].first_realtime);
+                item->last_realtime = htole64(ranges[i].last_realtime);
+                item->size = htole64(ranges[i].size);
+                memcpy(item->payload, ranges[i].data, ranges[i].size);
+
+                q += ALIGN64(offsetof(FieldIndexItem, payload) + ranges[i].size);
+        }
+
+#if HAVE_GCRYPT
+        r = journal_file_hmac_put_object(f, OBJECT_FIELD_INDEX, o, p);
+        if (r < 0)
+                goto finish;
+#endif
+
+        f->header->field_index_offset = htole64(p);
+        r = 1;
+
+finish:
+        journal_field_range_free_many(ranges, n);
+        return r;
+}
+
+static int journal_file_append_field_index_all(JournalFile *f) {
+        unsigned n_indexed = 0;
+        uint64_t m, i;
+        int r;
+
+        assert(f);
+
+        r = journal_file_map_field_hash_table(f);
+        if (r < 0)
+                return r;
+
+        m = le64toh(f->header->field_hash_table_size) / sizeof(HashItem);
+
+        for (i = 0; i < m; i++) {
+                uint64_t p;
+
+                p = le64toh(f->field_hash_table[i].head_hash_offset);
+                while (p > 0) {
+                        uint64_t next;
+                        Object *o;
+
+                        r = journal_file_move_to_object(f, OBJECT_FIELD, p, &o);
+                        if (r < 0)
+                                return r;
+
+                        next = le64toh(o->field.next_hash_offset);
+
+                        r = journal_file_append_field_index_one(f, p);
+                        if (r < 0)
+                                return r;
+                        if (r > 0)
+                                n_indexed++;
+
+                        p = next;
+                }
+        }
+
+        return n_indexed;
+}
+
+int journal_file_append_field_index(JournalFile *f) {
+        int r;
 
         assert(f);
+        assert(f->header);
+
+        /* Adds an index of the distinct values of every field with few enough of them to the file. Only
+         * makes sense for files that won't get any further entries, i.e. when archiving. */
 
         if (!f->writable)
-                return -EINVAL;
+                return -EPERM;
+
+        if (!JOURNAL_HEADER_CONTAINS(f->header, field_index_offset))
+                return 0;
+
+        if (f->header->field_index_offset != 0)
+                return 0; /* Already indexed */
+
+        if (le64toh(f->header->n_entries) <= 0 ||
+            le64toh(f->header->field_hash_table_size) <= 0)
+                return 0;
+
+        r = journal_file_append_field_index_all(f);
+        if (r < 0)
+                return r;
+
+        /* Only now that the list is complete readers may use it. Writers that don't know the flag refuse to
+         * open the file, hence can't add entries behind the index' back without us noticing. */
+        if (f->header->field_index_offset != 0)
+                f->header->compatible_flags |= htole32(HEADER_COMPATIBLE_FIELD_INDEX);
+
+        log_debug("Added index for %i fields to %s.", r, f->path);
+        return r;
+}
+
+int journal_file_find_field_index(JournalFile *f, uint64_t field_offset, Object **ret, uint64_t *ret_offset) {
+        uint64_t p;
+        int r;
+
+        assert(f);
+        assert(f->header);
+
+        if (!JOURNAL_HEADER_FIELD_INDEXED(f->header))
+                return 0;
+
+        p = le64toh(f->header->field_index_offset);
+        while (p > 0) {
+                uint64_t next;
+                Object *o;
+
+                r = journal_file_move_to_object(f, OBJECT_FIELD_INDEX, p, &o);
+                if (r < 0)
+                        return r;
+
+                if (le64toh(o->field_index.field_offset) == field_offset) {
+                        /* Entries were added after the index was written, hence it is incomplete */
+                        if (o->field_index.n_entries != f->header->n_entries)
+                                return 0;
+
+                        if (ret)
+                                *ret = o;
+                        if (ret_offset)
+                                *ret_offset = p;
+
+                        return 1;
+                }
+
+                /* Index objects are prepended to the list, hence the list must be ordered */
+                next = le64toh(o->field_index.next_field_index_offset);
+                if (next >= p)
+                        return -EBADMSG;
+
+                p = next;
+        }
+
+        return 0;
+}
+
+int journal_file_next_field_index_item(Object *o, uint64_t *position, FieldIndexItem **ret) {
+        uint64_t q, size, l;
+        FieldIndexItem *item;
+
+        assert(o);
+        assert(o->object.type == OBJECT_FIELD_INDEX);
+        assert(position);
+        assert(ret);
+
+        /* Returns the item at *position, and moves *position to the next one. Start with *position == 0. */
+
+        q = *position > 0 ? *position : offsetof(Object, field_index.items);
+        size = le64toh(o->object.size);
+
+        if (q >= size)
+                return 0;
+
+        if (size - q < offsetof(FieldIndexItem, payload))
+                return -EBADMSG;
+
+        item = (FieldIndexItem*) ((uint8_t*) o + q);
+        l = le64toh(item->size);
+        if (l <= 0 || l > size - q - offsetof(FieldIndexItem, payload))
+                return -EBADMSG;
+
+        *position = q + ALIGN64(offsetof(FieldIndexItem, payload) + l);
+        *ret = item;
+        return 1;
+}
+
+int journal_file_get_field_ranges(JournalFile *f, const char *field, JournalFieldRange **ret, size_t *ret_n) {
+        JournalFieldRange *ranges = NULL;
+        size_t n = 0, n_allocated = 0;
+        uint64_t p, position = 0;
+        Object *o;
+        int r;
+
+        assert(f);
+        assert(field);
+        assert(ret);
+        assert(ret_n);
+
+        /* Returns all values of the field in this file, with the realtime range they were used in. Uses the
+         * field index if there is one, and reads the DATA objects otherwise. Returns > 0 if the index was
+         * used. */
+
+        r = journal_file_find_field_object(f, field, strlen(field), NULL, &p);
+        if (r < 0)
+                return r;
+        if (r == 0) {
+                *ret = NULL;
+                *ret_n = 0;
+                return 0;
+        }
+
+        r = journal_file_find_field_index(f, p, &o, NULL);
+        if (r < 0)
+                log_debug_errno(r, "%s: failed to look up field index, ignoring: %m", f->path);
+        if (r <= 0) {
+                r = journal_file_collect_field_ranges(f, p, SIZE_MAX, UINT64_MAX, ret, ret_n);
+                return r < 0 ? r : 0;
+        }
+
+        for (;;) {
+                FieldIndexItem *item;
+
+                r = journal_file_next_field_index_item(o, &position, &item);
+                if (r < 0)
+                        goto fail;
+                if (r == 0)
+                        break;
+
+                if (!GREEDY_REALLOC(ranges, n_allocated, n + 1)) {
+                        r = -ENOMEM;
+                        goto fail;
+                }
+
+                ranges[n] = (JournalFieldRange) {
+                        .offset = le64toh(item->data_offset),
+                        .size = le64toh(item->size),
+                        .first_realtime = le64toh(item->first_realtime),
+                        .last_realtime = le64toh(item->last_realtime),
+                };
+
+                ranges[n].data = memdup(item->payload, ranges[n].size);
+                if (!ranges[n].data) {
+                        r = -ENOMEM;
+                        goto fail;
+                }
+
+                n++;
+        }
+
+        *ret = ranges;
+        *ret_n = n;
+        return 1;
+
+fail:
+        journal_field_range_free_many(ranges, n);
+        return r;
+}
+
+int journal_file_append_time_index(JournalFile *f) {
+        _cleanup_free_ TimeIndexItem *items = NULL;
+        size_t n_items = 0, n_allocated = 0;
+        uint64_t a, n, t = 0, i = 0, p;
+        Object *o;
+        int r;
+
+        assert(f);
+        assert(f->header);
+
+        /* Adds a sparse index of the main entry array to the file, for seeking by realtime. Only makes
+         * sense for files that won't get any further entries, i.e. when archiving. */
+
+        if (!f->writable)
+                return -EPERM;
+
+        if (!JOURNAL_HEADER_CONTAINS(f->header, time_index_offset))
+                return 0;
+
+        if (f->header->time_index_offset != 0)
+                return 0; /* Already indexed */
+
+        n = le64toh(f->header->n_entries);
+        if (n <= 0)
+                return 0;
+
+        /* i is the index of the next entry we want to reference, t the index of the first entry of the
+         * current array. We never look at the entries in between. */
+        a = le64toh(f->header->entry_array_offset);
+        while (a > 0 && i < n) {
+                Object *array;
+                uint64_t k;
+
+                r = journal_file_move_to_object(f, OBJECT_ENTRY_ARRAY, a, &array);
+                if (r < 0)
+                        return r;
+
+                k = MIN(journal_file_entry_array_n_items(array), n - t);
+
+                while (i < t + k) {
+                        p = le64toh(array->entry_array.items[i - t]);
+                        if (p <= 0)
+                                return -EBADMSG;
+
+                        r = journal_file_move_to_object(f, OBJECT_ENTRY, p, &o);
+                        if (r < 0)
+                                return r;
+
+                        if (!GREEDY_REALLOC(items, n_allocated, n_items + 1))
+                                return -ENOMEM;
+
+                        items[n_items++] = (TimeIndexItem) {
+                                .realtime = o->entry.realtime,
+                                .entry_offset = htole64(p),
+                                .entry_array_offset = htole64(a),
+                                .entry_array_index = htole64(i - t),
+                        };
+
+                        i = i == n - 1 ? n : MIN(i + TIME_INDEX_INTERVAL, n - 1);
+                }
+
+                t += k;
+                a = le64toh(array->entry_array.next_entry_array_offset);
+        }
+
+        if (i < n)
+                return -EBADMSG;
+
+        r = journal_file_append_object(f, OBJECT_TIME_INDEX,
+                                       offsetof(Object, time_index.items) + n_items * sizeof(TimeIndexItem),
+                                       &o, &p);
+        if (r < 0)
+                return r;
+
+        o->time_index.n_entries = f->header->n_entries;
+        o->time_index.interval = htole64(TIME_INDEX_INTERVAL);
+        memcpy(o->time_index.items, items, n_items * sizeof(TimeIndexItem));
+
+#if HAVE_GCRYPT
+        r = journal_file_hmac_put_object(f, OBJECT_TIME_INDEX, o, p);
+        if (r < 0)
+                return r;
+#endif
+
+        f->header->time_index_offset = htole64(p);
+        f->header->compatible_flags |= htole32(HEADER_COMPATIBLE_TIME_INDEX);
+
+        /* A lookup before might have found no index, let the next one look again */
+        f->time_index = mfree(f->time_index);
+        f->n_time_index = 0;
+        f->time_index_loaded = false;
+
+        log_debug("Added time index with %zu items to %s.", n_items, f->path);
+        return 1;
+}
+
+static void journal_file_append_archive_indexes(JournalFile *f) {
+        uint64_t max_size;
+        int r;
+
+        assert(f);
+
+        max_size = f->metrics.max_size;
+        if (max_size > 0)
+                f->metrics.max_size = max_size + ARCHIVE_INDEX_SIZE_MAX;
+
+        r = journal_file_append_field_index(f);
+        if (r < 0)
+                log_debug_errno(r, "Failed to add field index to %s, ignoring: %m", f->path);
+
+        r = journal_file_append_time_index(f);
+        if (r < 0)
+                log_debug_errno(r, "Failed to add time index to %s, ignoring: %m", f->path);
+
+        f->metrics.max_size = max_size;
+}
+
+int journal_file_archived_path(JournalFile *f, char **ret) {
+        char *p;
+
+        assert(f);
+        assert(ret);
 
         /* Is this a journal file that was passed to us as fd? If so, we synthesized a path name for it, and we refuse
          * rotation, since we don't know the actual path, and couldn't rename the file hence. */
@@ -3453,6 +4716,23 @@ int journal_file_archive(JournalFile *f) {
                      le64toh(f->header->head_entry_realtime)) < 0)
                 return -ENOMEM;
 
+        *ret = p;
+        return 0;
+}
+
+int journal_file_archive(JournalFile *f) {
+        _cleanup_free_ char *p = NULL;
+        int r;
+
+        assert(f);
+
+        if (!f->writable)
+                return -EINVAL;
+
+        r = journal_file_archived_path(f, &p);
+        if (r < 0)
+                return r;
+
         /* Try to rename the file to the archived version. If the file already was deleted, we'll get ENOENT, let's
          * ignore that case. */
         if (rename(f->path, p) < 0 && errno != ENOENT)
@@ -3461,6 +4741,11 @@ int journal_file_archive(JournalFile *f) {
         /* Sync the rename to disk */
         (void) fsync_directory_of_file(f->fd);
 
+        /* The file won't get any further entries, which makes this the time to index it, so that readers
+         * neither have to walk all DATA objects when enumerating field values, nor bisect the whole entry
+         * array chain when seeking by time. */
+        journal_file_append_archive_indexes(f);
+
         /* Set as archive so offlining commits w/state=STATE_ARCHIVED. Previously we would set old_file->header->state
          * to STATE_ARCHIVED directly here, but journal_file_set_offline() short-circuits when state != STATE_ONLINE,
          * which would result in the rotated journal never getting fsync() called before closing.  Now we simply queue
@@ -3499,12 +4784,16 @@ JournalFile* journal_initiate_close(
 
 int journal_file_rotate(
                 JournalFile **f,
-                bool compress,
+                int compress,
                 uint64_t compress_threshold_bytes,
                 bool seal,
                 Set *deferred_closes) {
 
         JournalFile *new_file = NULL;
+#if HAVE_ZSTD
+        _cleanup_free_ void *dict = NULL;
+        size_t dict_size = 0;
+#endif
         int r;
 
         assert(f);
@@ -3514,6 +4803,14 @@ int journal_file_rotate(
         if (r < 0)
                 return r;
 
+#if HAVE_ZSTD
+        /* Train the compression dictionary of the new file from the short DATA objects the old one got.
+         * This takes a moment, which is fine once per rotation, but not on every append. */
+        r = journal_file_train_dictionary(*f, &dict, &dict_size);
+        if (r < 0)
+                log_debug_errno(r, "Failed to train compression dictionary from %s, not using one: %m", (*f)->path);
+#endif
+
         r = journal_file_open(
                         -1,
                         (*f)->path,
@@ -3531,7 +4828,18 @@ int journal_file_rotate(
         journal_initiate_close(*f, deferred_closes);
         *f = new_file;
 
-        return r;
+        if (r < 0)
+                return r;
+
+#if HAVE_ZSTD
+        if (dict) {
+                r = journal_file_append_dictionary(new_file, dict, dict_size);
+                if (r < 0)
+                        log_debug_errno(r, "Failed to add compression dictionary to %s, not using one: %m", new_file->path);
+        }
+#endif
+
+        return 0;
 }
 
 int journal_file_dispose(int dir_fd, const char *fname) {
@@ -3573,7 +4881,7 @@ int journal_file_open_reliably(
                 const char *fname,
                 int flags,
                 mode_t mode,
-                bool compress,
+                int compress,
                 uint64_t compress_threshold_bytes,
                 bool seal,
                 JournalMetrics *metrics,
@@ -3618,7 +4926,69 @@ int journal_file_open_reliably(
                                  deferred_closes, template, ret);
 }
 
-int journal_file_copy_entry(JournalFile *from, JournalFile *to, Object *o, uint64_t p) {
+typedef struct CopyCacheItem {
+        uint64_t from_offset;
+        uint64_t to_offset;
+} CopyCacheItem;
+
+struct JournalFileCopyCache {
+        /* Which pair of files the slots refer to */
+        sd_id128_t from_id, to_id;
+        CopyCacheItem items[COPY_CACHE_SIZE];
+
+        /* Compressed payloads are copied here before they are passed on to the other file */
+        void *buffer;
+        size_t buffer_size;
+};
+
+JournalFileCopyCache* journal_file_copy_cache_free(JournalFileCopyCache *c) {
+        if (!c)
+                return NULL;
+
+        free(c->buffer);
+        return mfree(c);
+}
+
+static CopyCacheItem *journal_file_copy_cache_get(
+                JournalFileCopyCache **cache,
+                JournalFile *from,
+                JournalFile *to,
+                uint64_t hash) {
+
+        JournalFileCopyCache *c;
+
+        assert(from);
+        assert(to);
+
+        if (!cache)
+                return NULL;
+
+        c = *cache;
+        if (!c) {
+                /* The cache is only an optimization, hence simply go without if we can't have it */
+                c = *cache = new0(JournalFileCopyCache, 1);
+                if (!c)
+                        return NULL;
+        }
+
+        /* Offsets only mean something for the pair of files they were recorded for, e.g. the other file is a
+         * different one after a rotation */
+        if (!sd_id128_equal(c->from_id, from->header->file_id) ||
+            !sd_id128_equal(c->to_id, to->header->file_id)) {
+                zero(c->items);
+                c->from_id = from->header->file_id;
+                c->to_id = to->header->file_id;
+        }
+
+        return c->items + (hash & (COPY_CACHE_SIZE - 1));
+}
+
+int journal_file_copy_entry_with_cache(
+                JournalFile *from,
+                JournalFile *to,
+                Object *o, uint64_t p,
+                JournalFileCopyCache **cache) {
+
         uint64_t i, n;
         uint64_t q, xor_hash = 0;
         int r;
@@ -3631,6 +5001,10 @@ int journal_file_copy_entry(JournalFile *from, JournalFile *to, Object *o, uint6
         assert(o);
         assert(p);
 
+        /* If cache is non-NULL, it remembers where the DATA objects of 'from' ended up in 'to', so that the
+         * ones referenced by many entries are only looked up once in 'to'. Both files use the same hash
+         * function, hence the hashes recorded in the entry items can be used as they are. */
+
         if (!to->writable)
                 return -EPERM;
 
@@ -3643,6 +5017,8 @@ int journal_file_copy_entry(JournalFile *from, JournalFile *to, Object *o, uint6
         items = newa(EntryItem, MAX(1u, n));
 
         for (i = 0; i < n; i++) {
+                JournalFileCompressed compressed = {}, *c = NULL;
+                CopyCacheItem *slot;
                 uint64_t l, h;
                 le64_t le_hash;
                 size_t t;
@@ -3652,6 +5028,14 @@ int journal_file_copy_entry(JournalFile *from, JournalFile *to, Object *o, uint6
                 q = le64toh(o->entry.items[i].object_offset);
                 le_hash = o->entry.items[i].hash;
 
+                slot = journal_file_copy_cache_get(cache, from, to, le64toh(le_hash));
+                if (slot && slot->from_offset == q) {
+                        xor_hash ^= le64toh(le_hash);
+                        items[i].object_offset = htole64(slot->to_offset);
+                        items[i].hash = le_hash;
+                        continue;
+                }
+
                 r = journal_file_move_to_object(from, OBJECT_DATA, q, &o);
                 if (r < 0)
                         return r;
@@ -3667,11 +5051,31 @@ int journal_file_copy_entry(JournalFile *from, JournalFile *to, Object *o, uint6
                         return -E2BIG;
 
                 if (o->object.flags & OBJECT_COMPRESSION_MASK) {
-#if HAVE_XZ || HAVE_LZ4
+#if HAVE_COMPRESSION
+                        int compression = o->object.flags & OBJECT_COMPRESSION_MASK;
                         size_t rsize = 0;
 
-                        r = decompress_blob(o->object.flags & OBJECT_COMPRESSION_MASK,
-                                            o->data.payload, l, &from->compress_buffer, &from->compress_buffer_size, &rsize, 0);
+                        /* If 'to' wants this compressed the same way, hand over what we have, rather than
+                         * compressing it again. That's not possible if a dictionary of 'from' was used. */
+                        if (cache && *cache &&
+                            JOURNAL_FILE_COMPRESS(to) && compression == JOURNAL_FILE_COMPRESSION(to)
+#if HAVE_ZSTD
+                            && !compressed_blob_uses_dictionary(compression, o->data.payload, l)
+#endif
+                            ) {
+                                if (!GREEDY_REALLOC((*cache)->buffer, (*cache)->buffer_size, t))
+                                        return -ENOMEM;
+
+                                compressed = (JournalFileCompressed) {
+                                        .compression = compression,
+                                        .data = memcpy((*cache)->buffer, o->data.payload, t),
+                                        .size = t,
+                                };
+                                c = &compressed;
+                        }
+
+                        r = journal_file_decompress_blob(from, compression,
+                                                         o->data.payload, l, &from->compress_buffer, &from->compress_buffer_size, &rsize, 0);
                         if (r < 0)
                                 return r;
 
@@ -3683,7 +5087,7 @@ int journal_file_copy_entry(JournalFile *from, JournalFile *to, Object *o, uint6
                 } else
                         data = o->data.payload;
 
-                r = journal_file_append_data(to, data, l, &u, &h);
+                r = journal_file_append_data_with_hash(to, data, l, hash64(data, l), c, &u, &h);
                 if (r < 0)
                         return r;
 
@@ -3691,6 +5095,12 @@ int journal_file_copy_entry(JournalFile *from, JournalFile *to, Object *o, uint6
                 items[i].object_offset = htole64(h);
                 items[i].hash = u->data.hash;
 
+                if (slot && u->data.hash == le_hash)
+                        *slot = (CopyCacheItem) {
+                                .from_offset = q,
+                                .to_offset = h,
+                        };
+
                 r = journal_file_move_to_object(from, OBJECT_ENTRY, p, &o);
                 if (r < 0)
                         return r;
@@ -3705,6 +5115,10 @@ int journal_file_copy_entry(JournalFile *from, JournalFile *to, Object *o, uint6
         return r;
 }
 
+int journal_file_copy_entry(JournalFile *from, JournalFile *to, Object *o, uint64_t p) {
+        return journal_file_copy_entry_with_cache(from, to, o, p, NULL);
+}
+
 void journal_reset_metrics(JournalMetrics *m) {
         assert(m);
 
@@ -11,6 +11,7 @@
 #include "sd-event.h"
 #include "sd-id128.h"
 
+#include "compress.h"
 #include "hashmap.h"
 #include "journal-def.h"
 #include "mmap-cache.h"
@@ -56,6 +57,11 @@ typedef enum OfflineState {
         OFFLINE_DONE
 } OfflineState;
 
+typedef struct DataCacheItem {
+        uint64_t hash;
+        uint64_t offset;
+} DataCacheItem;
+
 typedef struct JournalFile {
         int fd;
         MMapFileDescriptor *cache_fd;
@@ -67,6 +73,7 @@ typedef struct JournalFile {
         bool writable:1;
         bool compress_xz:1;
         bool compress_lz4:1;
+        bool compress_zstd:1;
         bool seal:1;
         bool defrag_on_close:1;
         bool close_fd:1;
@@ -75,6 +82,7 @@ typedef struct JournalFile {
         direction_t last_direction;
         LocationType location_type;
         uint64_t last_n_entries;
+        unsigned heap_idx; /* index in sd_journal's file_heap */
 
         char *path;
         struct stat last_stat;
@@ -99,17 +107,41 @@ typedef struct JournalFile {
 
         OrderedHashmap *chain_cache;
 
+        /* Recently looked up DATA objects, hash → offset, in front of the on-disk data hash table */
+        DataCacheItem *data_cache;
+        unsigned data_cache_hit;
+        unsigned data_cache_missed;
+
+        /* The time index of archived files, loaded on first use */
+        TimeIndexItem *time_index;
+        size_t n_time_index;
+        bool time_index_loaded;
+
         pthread_t offline_thread;
         volatile OfflineState offline_state;
 
         unsigned last_seen_generation;
 
         uint64_t compress_threshold_bytes;
-#if HAVE_XZ || HAVE_LZ4
+#if HAVE_COMPRESSION
         void *compress_buffer;
         size_t compress_buffer_size;
 #endif
 
+#if HAVE_ZSTD
+        /* The compression dictionary, loaded from the file */
+        CompressionDictionary *dictionary;
+        bool dictionary_failed;
+
+        /* Short DATA objects collected for training the dictionary of the file replacing this one */
+        void *dictionary_samples;
+        size_t dictionary_samples_size;
+        size_t dictionary_samples_allocated;
+        size_t *dictionary_sample_sizes;
+        size_t dictionary_sample_sizes_allocated;
+        unsigned n_dictionary_samples;
+#endif
+
 #if HAVE_GCRYPT
         gcry_md_hd_t hmac;
         bool hmac_running;
@@ -133,7 +165,7 @@ int journal_file_open(
                 const char *fname,
                 int flags,
                 mode_t mode,
-                bool compress,
+                int compress,
                 uint64_t compress_threshold_bytes,
                 bool seal,
                 JournalMetrics *metrics,
@@ -152,7 +184,7 @@ int journal_file_open_reliably(
                 const char *fname,
                 int flags,
                 mode_t mode,
-                bool compress,
+                int compress,
                 uint64_t compress_threshold_bytes,
                 bool seal,
                 JournalMetrics *metrics,
@@ -189,14 +221,35 @@ static inline bool VALID_EPOCH(uint64_t u) {
 #define JOURNAL_HEADER_SEALED(h) \
         (!!(le32toh((h)->compatible_flags) & HEADER_COMPATIBLE_SEALED))
 
+#define JOURNAL_HEADER_FIELD_INDEXED(h) \
+        (!!(le32toh((h)->compatible_flags) & HEADER_COMPATIBLE_FIELD_INDEX))
+
+#define JOURNAL_HEADER_TIME_INDEXED(h) \
+        (!!(le32toh((h)->compatible_flags) & HEADER_COMPATIBLE_TIME_INDEX))
+
 #define JOURNAL_HEADER_COMPRESSED_XZ(h) \
         (!!(le32toh((h)->incompatible_flags) & HEADER_INCOMPATIBLE_COMPRESSED_XZ))
 
 #define JOURNAL_HEADER_COMPRESSED_LZ4(h) \
         (!!(le32toh((h)->incompatible_flags) & HEADER_INCOMPATIBLE_COMPRESSED_LZ4))
 
+#define JOURNAL_HEADER_COMPRESSED_ZSTD(h) \
+        (!!(le32toh((h)->incompatible_flags) & HEADER_INCOMPATIBLE_COMPRESSED_ZSTD))
+
+#define JOURNAL_HEADER_COMPRESSION_DICTIONARY(h) \
+        (!!(le32toh((h)->incompatible_flags) & HEADER_INCOMPATIBLE_COMPRESSION_DICTIONARY))
+
 int journal_file_move_to_object(JournalFile *f, ObjectType type, uint64_t offset, Object **ret);
 
+int journal_file_decompress_blob(JournalFile *f, int compression,
+                                 const void *src, uint64_t src_size,
+                                 void **dst, size_t *dst_alloc_size, size_t* dst_size, size_t dst_max);
+int journal_file_decompress_startswith(JournalFile *f, int compression,
+                                       const void *src, uint64_t src_size,
+                                       void **buffer, size_t *buffer_size,
+                                       const void *prefix, size_t prefix_len,
+                                       uint8_t extra);
+
 uint64_t journal_file_entry_n_items(Object *o) _pure_;
 uint64_t journal_file_entry_array_n_items(Object *o) _pure_;
 uint64_t journal_file_hash_table_n_items(Object *o) _pure_;
@@ -210,6 +263,39 @@ int journal_file_append_entry(
                 uint64_t *seqno,
                 Object **ret,
                 uint64_t *offset);
+int journal_file_append_entry_with_hashes(
+                JournalFile *f,
+                const dual_timestamp *ts,
+                const sd_id128_t *boot_id,
+                const struct iovec iovec[], const uint64_t hashes[], unsigned n_iovec,
+                uint64_t *seqno,
+                Object **ret,
+                uint64_t *offset);
+
+/* The payload of a field, compressed by the caller ahead of time, e.g. on another thread */
+typedef struct JournalFileCompressed {
+        int compression;  /* OBJECT_COMPRESSED_xyz the payload was compressed with, 0 if it wasn't tried */
+        const void *data; /* NULL if it was tried, but the payload didn't compress */
+        size_t size;
+} JournalFileCompressed;
+
+typedef struct JournalFileEntry {
+        dual_timestamp ts;
+        const struct iovec *iovec;
+        const uint64_t *hashes; /* optional, hash64() of each iovec */
+        const JournalFileCompressed *compressed; /* optional, one for each iovec */
+        unsigned n_iovec;
+} JournalFileEntry;
+
+int journal_file_append_entries(
+                JournalFile *f,
+                const sd_id128_t *boot_id,
+                const JournalFileEntry entries[], size_t n_entries,
+                uint64_t *seqno,
+                size_t *ret_n_appended);
+
+unsigned journal_file_data_cache_get_hit(JournalFile *f);
+unsigned journal_file_data_cache_get_missed(JournalFile *f);
 
 int journal_file_find_data_object(JournalFile *f, const void *data, uint64_t size, Object **ret, uint64_t *offset);
 int journal_file_find_data_object_with_hash(JournalFile *f, const void *data, uint64_t size, uint64_t hash, Object **ret, uint64_t *offset);
@@ -233,14 +319,39 @@ int journal_file_move_to_entry_by_seqnum_for_data(JournalFile *f, uint64_t data_
 int journal_file_move_to_entry_by_realtime_for_data(JournalFile *f, uint64_t data_offset, uint64_t realtime, direction_t direction, Object **ret, uint64_t *offset);
 int journal_file_move_to_entry_by_monotonic_for_data(JournalFile *f, uint64_t data_offset, sd_id128_t boot_id, uint64_t monotonic, direction_t direction, Object **ret, uint64_t *offset);
 
+typedef struct JournalFileCopyCache JournalFileCopyCache;
+
+JournalFileCopyCache* journal_file_copy_cache_free(JournalFileCopyCache *c);
+DEFINE_TRIVIAL_CLEANUP_FUNC(JournalFileCopyCache*, journal_file_copy_cache_free);
+
 int journal_file_copy_entry(JournalFile *from, JournalFile *to, Object *o, uint64_t p);
+int journal_file_copy_entry_with_cache(JournalFile *from, JournalFile *to, Object *o, uint64_t p, JournalFileCopyCache **cache);
 
 void journal_file_dump(JournalFile *f);
 void journal_file_print_header(JournalFile *f);
 
+/* A distinct value of a field, and the realtime range of the entries in a file that reference it */
+typedef struct JournalFieldRange {
+        uint64_t offset;
+        void *data;
+        size_t size;
+        usec_t first_realtime;
+        usec_t last_realtime;
+} JournalFieldRange;
+
+void journal_field_range_free_many(JournalFieldRange *ranges, size_t n);
+
+int journal_file_append_field_index(JournalFile *f);
+int journal_file_find_field_index(JournalFile *f, uint64_t field_offset, Object **ret, uint64_t *ret_offset);
+int journal_file_next_field_index_item(Object *o, uint64_t *position, FieldIndexItem **ret);
+int journal_file_get_field_ranges(JournalFile *f, const char *field, JournalFieldRange **ret, size_t *ret_n);
+
+int journal_file_append_time_index(JournalFile *f);
+
+int journal_file_archived_path(JournalFile *f, char **ret);
 int journal_file_archive(JournalFile *f);
 JournalFile* journal_initiate_close(JournalFile *f, Set *deferred_closes);
-int journal_file_rotate(JournalFile **f, bool compress, uint64_t compress_threshold_bytes, bool seal, Set *deferred_closes);
+int journal_file_rotate(JournalFile **f, int compress, uint64_t compress_threshold_bytes, bool seal, Set *deferred_closes);
 
 int journal_file_dispose(int dir_fd, const char *fname);
 
@@ -260,5 +371,18 @@ int journal_file_map_field_hash_table(JournalFile *f);
 
 static inline bool JOURNAL_FILE_COMPRESS(JournalFile *f) {
         assert(f);
-        return f->compress_xz || f->compress_lz4;
+        return f->compress_xz || f->compress_lz4 || f->compress_zstd;
+}
+
+/* Returns the OBJECT_COMPRESSED_xyz flag new data objects in this file are compressed with, or 0 */
+static inline int JOURNAL_FILE_COMPRESSION(JournalFile *f) {
+        assert(f);
+
+        if (f->compress_zstd)
+                return OBJECT_COMPRESSED_ZSTD;
+        if (f->compress_lz4)
+                return OBJECT_COMPRESSED_LZ4;
+        if (f->compress_xz)
+                return OBJECT_COMPRESSED_XZ;
+        return 0;
 }
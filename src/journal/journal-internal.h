@@ -8,15 +8,19 @@
 #include "sd-id128.h"
 #include "sd-journal.h"
 
+#include "catalog.h"
 #include "hashmap.h"
 #include "journal-def.h"
 #include "journal-file.h"
 #include "list.h"
+#include "prioq.h"
 #include "set.h"
 
 typedef struct Match Match;
 typedef struct Location Location;
 typedef struct Directory Directory;
+typedef struct DeferredFile DeferredFile;
+typedef struct FileChain FileChain;
 
 typedef enum MatchType {
         MATCH_DISCRETE,
@@ -64,6 +68,29 @@ struct Directory {
         unsigned last_seen_generation;
 };
 
+/* An archived journal file we know about, but didn't open yet. Everything we need to know about it is
+ * encoded in its name. */
+struct DeferredFile {
+        char *path;
+        uint64_t head_seqnum;
+        usec_t head_realtime;
+        unsigned last_seen_generation;
+};
+
+/* The journal files in one directory that share the name prefix and the sequence number ID, i.e. an active
+ * file and the files archived from it. Their entries follow each other without overlapping, hence the older
+ * ones only need to be opened once iteration gets past the oldest one we have open. */
+struct FileChain {
+        char *key;              /* "<directory>/<prefix>@<seqnum id>" */
+        size_t prefix_len;      /* length of "<directory>/<prefix>" */
+        sd_id128_t seqnum_id;
+
+        DeferredFile *deferred; /* ordered by head_seqnum, oldest first */
+        size_t n_deferred, n_deferred_allocated;
+
+        bool dirty;             /* deferred files were added or open files removed */
+};
+
 struct sd_journal {
         int toplevel_fd;
 
@@ -73,6 +100,7 @@ struct sd_journal {
 
         OrderedHashmap *files;
         IteratedCache *files_cache;
+        Hashmap *file_chains;
         MMapCache *mmap;
 
         Location current_location;
@@ -80,6 +108,15 @@ struct sd_journal {
         JournalFile *current_file;
         uint64_t current_field;
 
+        /* All files that have an entry beyond the current location, ordered by that entry */
+        Prioq *file_heap;
+        direction_t file_heap_direction;
+
+        /* Files inotify reported as modified since the heap was last built from all files. Only those can
+         * have grown beyond their tail, hence only those need to be looked at again once the heap runs
+         * empty. */
+        Set *modified_files;
+
         Match *level0, *level1, *level2;
 
         pid_t original_pid;
@@ -93,6 +130,8 @@ struct sd_journal {
         char *unique_field;
         JournalFile *unique_file;
         uint64_t unique_offset;
+        uint64_t unique_index_offset; /* field index object of unique_file we use instead of the DATA objects */
+        uint64_t unique_index_position;
 
         /* Iterating through known fields */
         JournalFile *fields_file;
@@ -113,17 +152,30 @@ struct sd_journal {
         bool fields_file_lost:1;
         bool has_runtime_files:1;
         bool has_persistent_files:1;
+        bool defer_archived_files:1;
 
         size_t data_threshold;
 
+        /* If set, sd_journal_enumerate_data() only returns these fields */
+        char **data_fields;
+
+        /* Number of threads to use for seeking in all files at once, 0 to seek sequentially */
+        unsigned n_seek_threads;
+
         Hashmap *directories_by_path;
         Hashmap *directories_by_wd;
 
         Hashmap *errors;
+
+        /* Catalog texts looked up for sd_journal_get_catalog() */
+        CatalogCache *catalog_cache;
 };
 
 char *journal_make_match_string(sd_journal *j);
 void journal_print_header(sd_journal *j);
+void journal_open_deferred_files(sd_journal *j);
+
+int journal_get_field_ranges(sd_journal *j, const char *field, JournalFieldRange **ret, size_t *ret_n);
 
 #define JOURNAL_FOREACH_DATA_RETVAL(j, data, l, retval)                     \
         for (sd_journal_restart_data(j); ((retval) = sd_journal_enumerate_data((j), &(data), &(l))) > 0; )
@@ -0,0 +1,158 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include "journal-ring.h"
+#include "memory-util.h"
+
+int journal_ring_write(JournalRingHeader *h, uint8_t *data, size_t data_size, const struct iovec *iovec, size_t n_iovec) {
+        uint64_t head, tail, need;
+        size_t size = 0, total, offset, i;
+        uint8_t *p;
+
+        assert(h);
+        assert(data);
+        assert(journal_ring_data_size_valid(data_size));
+        assert(iovec || n_iovec == 0);
+
+        /* Writes one message, assembled from the specified iovecs, into the ring. Returns -ENOBUFS if there's
+         * no room for it, and > 0 if journald has to be woken up. */
+
+        for (i = 0; i < n_iovec; i++)
+                size += iovec[i].iov_len;
+
+        /* A single message may not take up more than a quarter of the ring, so that a few large ones don't
+         * push out everything else. Those are better off with the socket anyway. */
+        if (size > JOURNAL_RING_RECORD_SIZE_MASK || journal_ring_record_size(size) > data_size / 4)
+                return -EMSGSIZE;
+
+        total = journal_ring_record_size(size);
+
+        for (;;) {
+                head = h->head;
+                tail = h->tail;
+
+                offset = head & (data_size - 1);
+                need = total;
+                if (offset + total > data_size)
+                        need += data_size - offset;
+
+                if (head - tail > data_size || head - tail + need > data_size)
+                        return -ENOBUFS;
+
+                if (__sync_bool_compare_and_swap(&h->head, head, head + need))
+                        break;
+        }
+
+        if (need > total) {
+                /* Doesn't fit before the end of the data area, hence pad the rest and start over at the
+                 * beginning. There's nothing to copy, hence the padding record can be committed right away. */
+                *(volatile uint64_t*) (data + offset) =
+                        JOURNAL_RING_RECORD_COMMITTED | JOURNAL_RING_RECORD_PADDING | (data_size - offset - sizeof(uint64_t));
+                offset = 0;
+        }
+
+        p = data + offset + sizeof(uint64_t);
+        for (i = 0; i < n_iovec; i++) {
+                memcpy_safe(p, iovec[i].iov_base, iovec[i].iov_len);
+                p += iovec[i].iov_len;
+        }
+
+        /* Make sure the message is in place before journald can see the record */
+        __sync_synchronize();
+        *(volatile uint64_t*) (data + offset) = JOURNAL_RING_RECORD_COMMITTED | size;
+
+        /* Pairs with the barrier journald issues between setting need_wakeup and looking at the ring again */
+        __sync_synchronize();
+        if (h->need_wakeup && __sync_bool_compare_and_swap(&h->need_wakeup, 1, 0))
+                return 1;
+
+        return 0;
+}
+
+int journal_ring_read(
+                uint8_t *data,
+                size_t data_size,
+                uint64_t tail,
+                uint64_t consumed,
+                const uint8_t **ret_message,
+                size_t *ret_size,
+                size_t *ret_record_size) {
+
+        size_t offset, size, total;
+        uint64_t word;
+
+        assert(data);
+        assert(journal_ring_data_size_valid(data_size));
+        assert(ret_message);
+        assert(ret_size);
+        assert(ret_record_size);
+
+        /* Looks at the record at 'tail', 'consumed' bytes after the last position that was released. Returns 0
+         * if there's none (yet), and -EBADMSG if the ring contains garbage. On success, the returned message
+         * still lives in the shared memory, and the client may modify it at any time, hence the caller needs
+         * to copy it before doing anything with it. For padding records NULL is returned as message. */
+
+        offset = tail & (data_size - 1);
+
+        word = *(volatile uint64_t*) (data + offset);
+        if (word == 0)
+                return 0;
+
+        /* Pairs with the barrier the writer issues before committing the record */
+        __sync_synchronize();
+
+        if (!FLAGS_SET(word, JOURNAL_RING_RECORD_COMMITTED) ||
+            (word & ~(JOURNAL_RING_RECORD_COMMITTED|JOURNAL_RING_RECORD_PADDING|JOURNAL_RING_RECORD_SIZE_MASK)) != 0)
+                return -EBADMSG;
+
+        size = word & JOURNAL_RING_RECORD_SIZE_MASK;
+
+        if (FLAGS_SET(word, JOURNAL_RING_RECORD_PADDING)) {
+                total = data_size - offset;
+                if (size != total - sizeof(uint64_t))
+                        return -EBADMSG;
+        } else
+                total = journal_ring_record_size(size);
+
+        /* Writers never get further than one full lap ahead of what was released */
+        if (total > data_size - offset || consumed + total > data_size)
+                return -EBADMSG;
+
+        if (FLAGS_SET(word, JOURNAL_RING_RECORD_PADDING)) {
+                *ret_message = NULL;
+                *ret_size = 0;
+        } else {
+                *ret_message = data + offset + sizeof(uint64_t);
+                *ret_size = size;
+        }
+
+        *ret_record_size = total;
+        return 1;
+}
+
+void journal_ring_release(JournalRingHeader *h, uint8_t *data, size_t data_size, uint64_t old_tail, uint64_t new_tail) {
+        size_t offset, n, k;
+
+        assert(h);
+        assert(data);
+        assert(journal_ring_data_size_valid(data_size));
+        assert(new_tail - old_tail <= data_size);
+
+        /* Gives the space between the two positions back to the writers. Record headers may end up anywhere
+         * in there, hence it all has to be zero again before they may reuse it. */
+
+        if (new_tail == old_tail)
+                return;
+
+        offset = old_tail & (data_size - 1);
+        n = new_tail - old_tail;
+        k = MIN(n, data_size - offset);
+
+        memzero(data + offset, k);
+        memzero(data, n - k);
+
+        __sync_synchronize();
+        h->tail = new_tail;
+}
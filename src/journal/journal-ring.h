@@ -0,0 +1,76 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/uio.h>
+
+#include "macro.h"
+
+/* A shared memory ring buffer clients may use to pass native protocol messages to journald without a sendmsg()
+ * per message.
+ *
+ * The client creates a memfd of JOURNAL_RING_HEADER_SIZE plus a power of two bytes, seals it against shrinking
+ * and growing, and one SOCK_SEQPACKET socket pair. It then sends a datagram consisting of JOURNAL_RING_COMMAND to
+ * the native socket, with the memfd and one end of the socket pair attached. All messages written to the ring
+ * are attributed to the credentials of that registration datagram. Once journald has mapped the ring it sets
+ * 'attached' in the header, and the client may start writing to it. When journald closes its end of the socket
+ * pair the ring is gone, and if the client closes its end journald processes what is left and then drops it.
+ *
+ * Any number of threads of the client may write to the ring at the same time: a writer reserves space by
+ * advancing 'head' with an atomic compare-and-swap, copies the message into the reserved space, and then sets
+ * the header word of the record. journald reads the records in order, stopping at the first one whose header
+ * word is still zero, copies them out, zeroes the space they took up and then advances 'tail'. A record that
+ * doesn't fit before the end of the data area is preceded by a padding record that takes up the rest of it.
+ *
+ * Wakeups are only needed when journald has run dry: it then sets 'need_wakeup', and the first writer that
+ * clears it again afterwards sends a single byte over the socket pair. */
+
+#define JOURNAL_RING_COMMAND ".ring\n"
+
+#define JOURNAL_RING_SIGNATURE ((const char[]) { 'J', 'R', 'I', 'N', 'G', 0, 0, 1 })
+
+#define JOURNAL_RING_HEADER_SIZE 256U
+#define JOURNAL_RING_DATA_SIZE_MIN (64U*1024U)
+#define JOURNAL_RING_DATA_SIZE_MAX (64U*1024U*1024U)
+
+#define JOURNAL_RING_RECORD_COMMITTED (UINT64_C(1) << 63)
+#define JOURNAL_RING_RECORD_PADDING (UINT64_C(1) << 62)
+#define JOURNAL_RING_RECORD_SIZE_MASK UINT64_C(0xffffffff)
+
+typedef struct JournalRingHeader {
+        uint8_t signature[8];
+        uint64_t data_size;
+
+        uint8_t _pad0[48];
+
+        /* Written by the clients, each on its own cache line */
+        volatile uint64_t head;
+        uint8_t _pad1[56];
+        volatile uint32_t need_wakeup;
+        uint8_t _pad2[60];
+
+        /* Written by journald */
+        volatile uint64_t tail;
+        volatile uint32_t attached;
+        uint8_t _pad3[4];
+} JournalRingHeader;
+
+assert_cc(offsetof(JournalRingHeader, head) == 64);
+assert_cc(offsetof(JournalRingHeader, need_wakeup) == 128);
+assert_cc(offsetof(JournalRingHeader, tail) == 192);
+assert_cc(sizeof(JournalRingHeader) <= JOURNAL_RING_HEADER_SIZE);
+
+static inline bool journal_ring_data_size_valid(size_t sz) {
+        return sz >= JOURNAL_RING_DATA_SIZE_MIN && sz <= JOURNAL_RING_DATA_SIZE_MAX && (sz & (sz - 1)) == 0;
+}
+
+/* Each record is a header word followed by the message, padded to a multiple of 8 */
+static inline size_t journal_ring_record_size(size_t message_size) {
+        return ALIGN_TO(sizeof(uint64_t) + message_size, sizeof(uint64_t));
+}
+
+int journal_ring_write(JournalRingHeader *h, uint8_t *data, size_t data_size, const struct iovec *iovec, size_t n_iovec);
+int journal_ring_read(uint8_t *data, size_t data_size, uint64_t tail, uint64_t consumed, const uint8_t **ret_message, size_t *ret_size, size_t *ret_record_size);
+void journal_ring_release(JournalRingHeader *h, uint8_t *data, size_t data_size, uint64_t old_tail, uint64_t new_tail);
@@ -3,7 +3,9 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <printf.h>
+#include <pthread.h>
 #include <stddef.h>
+#include <sys/mman.h>
 #include <sys/un.h>
 #include <unistd.h>
 
@@ -12,10 +14,13 @@
 #include "sd-journal.h"
 
 #include "alloc-util.h"
+#include "env-util.h"
 #include "errno-util.h"
 #include "fd-util.h"
 #include "io-util.h"
+#include "journal-ring.h"
 #include "memfd-util.h"
+#include "missing_fcntl.h"
 #include "socket-util.h"
 #include "stdio-util.h"
 #include "string-util.h"
@@ -23,6 +28,8 @@
 
 #define SNDBUF_SIZE (8*1024*1024)
 
+#define RING_DATA_SIZE (8U*1024U*1024U)
+
 #define ALLOCA_CODE_FUNC(f, func)                 \
         do {                                      \
                 size_t _fl;                       \
@@ -61,6 +68,172 @@ retry:
         return fd;
 }
 
+/* If $SYSTEMD_JOURNAL_RING is set, we also set up a shared memory ring with journald, also shared by all
+ * threads, and write messages into that instead of sending them, as long as they fit. See journal-ring.h for
+ * details. */
+
+typedef struct SendRing {
+        int fd;
+        JournalRingHeader *header;
+        uint8_t *data;
+} SendRing;
+
+#define SEND_RING_DISABLED ((SendRing*) -1)
+
+static SendRing *send_ring = NULL;
+
+static void send_ring_free(SendRing *r) {
+        if (!r || r == SEND_RING_DISABLED)
+                return;
+
+        (void) munmap(r->header, JOURNAL_RING_HEADER_SIZE + RING_DATA_SIZE);
+        safe_close(r->fd);
+        free(r);
+}
+
+static void send_ring_reset(void) {
+        /* Invoked in the child after a fork(). No other threads exist at that point, hence we can safely drop
+         * the ring of our parent, and the child sets up its own one, if it logs. */
+        send_ring_free(send_ring);
+        send_ring = NULL;
+}
+
+static int send_ring_new(int fd, const struct sockaddr *sa, socklen_t salen, SendRing **ret) {
+        _cleanup_close_pair_ int pair[2] = { -1, -1 };
+        _cleanup_close_ int memfd = -1;
+        union {
+                struct cmsghdr cmsghdr;
+                uint8_t buf[CMSG_SPACE(sizeof(int) * 2)];
+        } control = {};
+        struct iovec iov = IOVEC_MAKE_STRING(JOURNAL_RING_COMMAND);
+        struct msghdr mh = {
+                .msg_name = (struct sockaddr*) sa,
+                .msg_namelen = salen,
+                .msg_iov = &iov,
+                .msg_iovlen = 1,
+                .msg_control = &control,
+                .msg_controllen = sizeof(control),
+        };
+        _cleanup_free_ SendRing *r = NULL;
+        struct cmsghdr *cmsg;
+        void *p;
+        int k;
+
+        assert(fd >= 0);
+        assert(ret);
+
+        r = new(SendRing, 1);
+        if (!r)
+                return -ENOMEM;
+
+        memfd = memfd_new("journal-ring");
+        if (memfd < 0)
+                return memfd;
+
+        k = memfd_set_size(memfd, JOURNAL_RING_HEADER_SIZE + RING_DATA_SIZE);
+        if (k < 0)
+                return k;
+
+        if (fcntl(memfd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) < 0)
+                return -errno;
+
+        p = mmap(NULL, JOURNAL_RING_HEADER_SIZE + RING_DATA_SIZE, PROT_READ|PROT_WRITE, MAP_SHARED, memfd, 0);
+        if (p == MAP_FAILED)
+                return -errno;
+
+        *r = (SendRing) {
+                .fd = -1,
+                .header = p,
+                .data = (uint8_t*) p + JOURNAL_RING_HEADER_SIZE,
+        };
+
+        memcpy(r->header->signature, JOURNAL_RING_SIGNATURE, sizeof(r->header->signature));
+        r->header->data_size = RING_DATA_SIZE;
+        r->header->need_wakeup = 1;
+
+        if (socketpair(AF_UNIX, SOCK_SEQPACKET|SOCK_CLOEXEC|SOCK_NONBLOCK, 0, pair) < 0) {
+                k = -errno;
+                goto fail;
+        }
+
+        cmsg = CMSG_FIRSTHDR(&mh);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int) * 2);
+        memcpy(CMSG_DATA(cmsg), (int[]) { memfd, pair[1] }, sizeof(int) * 2);
+
+        /* We start writing to the ring once journald marked it as attached. Until then, and if it never does
+         * because it doesn't know about rings, everything goes through the socket as before. */
+        if (sendmsg(fd, &mh, MSG_NOSIGNAL) < 0) {
+                k = -errno;
+                goto fail;
+        }
+
+        r->fd = TAKE_FD(pair[0]);
+
+        *ret = TAKE_PTR(r);
+        return 0;
+
+fail:
+        (void) munmap(p, JOURNAL_RING_HEADER_SIZE + RING_DATA_SIZE);
+        return k;
+}
+
+static SendRing *send_ring_get(int fd, const struct sockaddr *sa, socklen_t salen) {
+        SendRing *r;
+
+        r = send_ring;
+        if (r == SEND_RING_DISABLED)
+                return NULL;
+        if (r)
+                return r->header->attached ? r : NULL;
+
+        if (getenv_bool_secure("SYSTEMD_JOURNAL_RING") <= 0 ||
+            send_ring_new(fd, sa, salen, &r) < 0)
+                r = SEND_RING_DISABLED;
+
+        if (!__sync_bool_compare_and_swap(&send_ring, NULL, r))
+                send_ring_free(r);
+        else if (r != SEND_RING_DISABLED)
+                (void) pthread_atfork(NULL, NULL, send_ring_reset);
+
+        /* journald didn't have a chance to map the ring yet, use the socket for this message */
+        return NULL;
+}
+
+static int send_ring_write(SendRing *r, const struct iovec *iov, size_t n) {
+        static const char wakeup = 0;
+        int k;
+
+        assert(r);
+
+        /* Returns > 0 if the message was written to the ring, 0 if it should go via the socket instead */
+
+        k = journal_ring_write(r->header, r->data, RING_DATA_SIZE, iov, n);
+        if (k == -ENOBUFS) {
+                char c;
+
+                /* The ring is full. Either journald can't keep up, or it went away without telling us.
+                 * In the latter case our end of the socket pair is hung up, and there's no point in trying
+                 * the ring again. */
+                if (recv(r->fd, &c, sizeof(c), MSG_DONTWAIT|MSG_PEEK) == 0)
+                        r->header->attached = 0;
+
+                return 0;
+        }
+        if (k < 0)
+                return 0;
+
+        if (k > 0 && send(r->fd, &wakeup, sizeof(wakeup), MSG_DONTWAIT|MSG_NOSIGNAL) < 0 &&
+            IN_SET(errno, EPIPE, ECONNRESET)) {
+                /* journald went away. It won't see this message, hence send it via the socket instead. */
+                r->header->attached = 0;
+                return 0;
+        }
+
+        return 1;
+}
+
 _public_ int sd_journal_print(int priority, const char *format, ...) {
         int r;
         va_list ap;
@@ -209,6 +382,7 @@ _public_ int sd_journal_sendv(const struct iovec *iov, int n) {
         ssize_t k;
         bool have_syslog_identifier = false;
         bool seal = true;
+        SendRing *ring;
 
         assert_return(iov, -EINVAL);
         assert_return(n > 0, -EINVAL);
@@ -273,6 +447,10 @@ _public_ int sd_journal_sendv(const struct iovec *iov, int n) {
         if (_unlikely_(fd < 0))
                 return fd;
 
+        ring = send_ring_get(fd, mh.msg_name, mh.msg_namelen);
+        if (ring && send_ring_write(ring, w, j) > 0)
+                return 0;
+
         mh.msg_iov = w;
         mh.msg_iovlen = j;
 
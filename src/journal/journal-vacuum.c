@@ -14,11 +14,16 @@
 #include "journal-def.h"
 #include "journal-file.h"
 #include "journal-vacuum.h"
+#include "path-util.h"
+#include "set.h"
 #include "sort-util.h"
 #include "string-util.h"
 #include "time-util.h"
 #include "xattr-util.h"
 
+/* Rescan the directory every now and then, in case somebody else added or removed files behind our back */
+#define VACUUM_INDEX_RESCAN_USEC (1*USEC_PER_HOUR)
+
 struct vacuum_info {
         uint64_t usage;
         char *filename;
@@ -28,6 +33,26 @@ struct vacuum_info {
         sd_id128_t seqnum_id;
         uint64_t seqnum;
         bool have_seqnum;
+
+        bool empty;
+};
+
+struct JournalVacuumIndex {
+        char *directory;
+
+        /* CLOCK_MONOTONIC timestamp of the last scan of the directory, or 0 if there was none yet, or the
+         * results shall not be trusted anymore */
+        usec_t timestamp;
+
+        /* All archived and corrupted files, oldest first. We may delete these. */
+        struct vacuum_info *list;
+        size_t n_list, n_allocated;
+        size_t n_empty;
+        uint64_t usage;
+
+        /* Everything else that looks like some journal file, these are left alone, but count towards the
+         * number of files we keep */
+        Set *active;
 };
 
 static int vacuum_compare(const struct vacuum_info *a, const struct vacuum_info *b) {
@@ -51,7 +76,7 @@ static void patch_realtime(
                 int fd,
                 const char *fn,
                 const struct stat *st,
-                unsigned long long *realtime) {
+                usec_t *realtime) {
 
         usec_t x, crtime = 0;
 
@@ -118,204 +143,457 @@ static int journal_file_empty(int dir_fd, const char *name) {
         return le64toh(n_entries) <= 0;
 }
 
-int journal_directory_vacuum(
-                const char *directory,
-                uint64_t max_use,
-                uint64_t n_max_files,
-                usec_t max_retention_usec,
-                usec_t *oldest_usec,
-                bool verbose) {
+static void vacuum_info_done(struct vacuum_info *i) {
+        assert(i);
+
+        i->filename = mfree(i->filename);
+}
+
+/* Returns 1 if the file is an archived or corrupted journal file, 0 if it is some other journal file, and
+ * -EINVAL if it is no journal file at all. */
+static int vacuum_info_parse(const char *name, struct vacuum_info *ret) {
+        unsigned long long seqnum = 0, realtime, tmp;
+        char id[SD_ID128_STRING_MAX];
+        sd_id128_t seqnum_id = {};
+        bool have_seqnum;
+        size_t q;
+
+        assert(name);
+        assert(ret);
+
+        q = strlen(name);
+
+        if (endswith(name, ".journal")) {
+
+                /* Vacuum archived files. Active files are
+                 * left around */
+
+                if (q < 1 + 32 + 1 + 16 + 1 + 16 + 8)
+                        return 0;
+
+                if (name[q-8-16-1] != '-' ||
+                    name[q-8-16-1-16-1] != '-' ||
+                    name[q-8-16-1-16-1-32-1] != '@')
+                        return 0;
+
+                memcpy(id, name + q-8-16-1-16-1-32, 32);
+                id[32] = 0;
+                if (sd_id128_from_string(id, &seqnum_id) < 0)
+                        return 0;
+
+                if (sscanf(name + q-8-16-1-16, "%16llx-%16llx.journal", &seqnum, &realtime) != 2)
+                        return 0;
+
+                have_seqnum = true;
+
+        } else if (endswith(name, ".journal~")) {
+
+                /* Vacuum corrupted files */
+
+                if (q < 1 + 16 + 1 + 16 + 8 + 1)
+                        return 0;
+
+                if (name[q-1-8-16-1] != '-' ||
+                    name[q-1-8-16-1-16-1] != '@')
+                        return 0;
+
+                if (sscanf(name + q-1-8-16-1-16, "%16llx-%16llx.journal~", &realtime, &tmp) != 2)
+                        return 0;
+
+                have_seqnum = false;
+        } else
+                return -EINVAL;
+
+        *ret = (struct vacuum_info) {
+                .seqnum = seqnum,
+                .realtime = realtime,
+                .seqnum_id = seqnum_id,
+                .have_seqnum = have_seqnum,
+        };
+
+        return 1;
+}
+
+int journal_vacuum_index_new(const char *directory, JournalVacuumIndex **ret) {
+        _cleanup_(journal_vacuum_index_freep) JournalVacuumIndex *idx = NULL;
+
+        assert(directory);
+        assert(ret);
+
+        idx = new0(JournalVacuumIndex, 1);
+        if (!idx)
+                return -ENOMEM;
+
+        idx->directory = strdup(directory);
+        if (!idx->directory)
+                return -ENOMEM;
+
+        *ret = TAKE_PTR(idx);
+        return 0;
+}
+
+static void journal_vacuum_index_clear(JournalVacuumIndex *idx) {
+        size_t i;
+
+        assert(idx);
+
+        for (i = 0; i < idx->n_list; i++)
+                vacuum_info_done(idx->list + i);
+
+        idx->n_list = idx->n_empty = 0;
+        idx->usage = 0;
+        idx->active = set_free_free(idx->active);
+        idx->timestamp = 0;
+}
+
+JournalVacuumIndex* journal_vacuum_index_free(JournalVacuumIndex *idx) {
+        if (!idx)
+                return NULL;
+
+        journal_vacuum_index_clear(idx);
+        free(idx->list);
+        free(idx->directory);
+
+        return mfree(idx);
+}
+
+void journal_vacuum_index_invalidate(JournalVacuumIndex *idx) {
+        if (idx)
+                idx->timestamp = 0;
+}
+
+static int journal_vacuum_index_add_active(JournalVacuumIndex *idx, const char *name) {
+        int r;
+
+        assert(idx);
+        assert(name);
+
+        r = set_ensure_allocated(&idx->active, &string_hash_ops);
+        if (r < 0)
+                return r;
+
+        r = set_put_strdup(idx->active, name);
+        return r < 0 ? r : 0;
+}
+
+/* Inserts the file into the list, keeping it sorted. Takes possession of the file name. */
+static int journal_vacuum_index_insert(JournalVacuumIndex *idx, struct vacuum_info *info) {
+        size_t a, b;
+
+        assert(idx);
+        assert(info);
+
+        if (!GREEDY_REALLOC(idx->list, idx->n_allocated, idx->n_list + 1))
+                return -ENOMEM;
+
+        /* Newly archived files are usually the newest ones, hence check the end first */
+        a = 0;
+        b = idx->n_list;
+        if (b > 0 && vacuum_compare(idx->list + b - 1, info) <= 0)
+                a = b;
+
+        while (a < b) {
+                size_t c = (a + b) / 2;
+
+                if (vacuum_compare(idx->list + c, info) <= 0)
+                        a = c + 1;
+                else
+                        b = c;
+        }
+
+        if (a > 0 && streq(idx->list[a-1].filename, info->filename)) {
+                /* We know this one already */
+                vacuum_info_done(info);
+                return 0;
+        }
+
+        memmove(idx->list + a + 1, idx->list + a, (idx->n_list - a) * sizeof(struct vacuum_info));
+        idx->list[a] = *info;
+        idx->n_list++;
+
+        idx->usage += info->usage;
+        if (info->empty)
+                idx->n_empty++;
+
+        *info = (struct vacuum_info) {};
+        return 1;
+}
+
+static int journal_vacuum_index_add_at(JournalVacuumIndex *idx, int dir_fd, const char *name, bool check_empty) {
+        _cleanup_(vacuum_info_done) struct vacuum_info info = {};
+        struct stat st;
+        int r;
+
+        assert(idx);
+        assert(dir_fd >= 0);
+        assert(name);
+
+        if (fstatat(dir_fd, name, &st, AT_SYMLINK_NOFOLLOW) < 0)
+                return log_debug_errno(errno, "Failed to stat file %s while vacuuming, ignoring: %m", name);
+
+        if (!S_ISREG(st.st_mode))
+                return 0;
+
+        r = vacuum_info_parse(name, &info);
+        if (r == -EINVAL) {
+                /* We do not vacuum unknown files! */
+                log_debug("Not vacuuming unknown file %s.", name);
+                return 0;
+        }
+
+        if (r == 0)
+                return journal_vacuum_index_add_active(idx, name);
+
+        info.filename = strdup(name);
+        if (!info.filename)
+                return -ENOMEM;
+
+        info.usage = 512UL * (uint64_t) st.st_blocks;
+
+        if (check_empty) {
+                r = journal_file_empty(dir_fd, name);
+                if (r < 0)
+                        return log_debug_errno(r, "Failed check if %s is empty, ignoring: %m", name);
+
+                info.empty = r > 0;
+        }
+
+        patch_realtime(dir_fd, name, &st, &info.realtime);
+
+        return journal_vacuum_index_insert(idx, &info);
+}
 
-        uint64_t sum = 0, freed = 0, n_active_files = 0;
-        size_t n_list = 0, n_allocated = 0, i;
+static int journal_vacuum_index_scan(JournalVacuumIndex *idx) {
         _cleanup_closedir_ DIR *d = NULL;
-        struct vacuum_info *list = NULL;
-        usec_t retention_limit = 0;
-        char sbytes[FORMAT_BYTES_MAX];
         struct dirent *de;
         int r;
 
-        assert(directory);
+        assert(idx);
 
-        if (max_use <= 0 && max_retention_usec <= 0 && n_max_files <= 0)
+        journal_vacuum_index_clear(idx);
+
+        d = opendir(idx->directory);
+        if (!d)
+                return -errno;
+
+        FOREACH_DIRENT_ALL(de, d, return -errno) {
+                r = journal_vacuum_index_add_at(idx, dirfd(d), de->d_name, true);
+                if (r == -ENOMEM) {
+                        journal_vacuum_index_clear(idx);
+                        return r;
+                }
+        }
+
+        idx->timestamp = now(CLOCK_MONOTONIC);
+        return 0;
+}
+
+static int journal_vacuum_index_refresh(JournalVacuumIndex *idx) {
+        assert(idx);
+
+        if (idx->timestamp > 0 && usec_add(idx->timestamp, VACUUM_INDEX_RESCAN_USEC) > now(CLOCK_MONOTONIC))
                 return 0;
 
-        if (max_retention_usec > 0)
-                retention_limit = usec_sub_unsigned(now(CLOCK_REALTIME), max_retention_usec);
+        return journal_vacuum_index_scan(idx);
+}
 
-        d = opendir(directory);
-        if (!d)
+int journal_vacuum_index_add(JournalVacuumIndex *idx, const char *filename) {
+        _cleanup_close_ int fd = -1;
+        int r;
+
+        assert(idx);
+        assert(filename);
+
+        /* Tells the index about a file that was just archived or created. Until the next scan we don't
+         * know anything anyway, hence no need to bother. */
+        if (idx->timestamp == 0)
+                return 0;
+
+        fd = open(idx->directory, O_RDONLY|O_CLOEXEC|O_DIRECTORY);
+        if (fd < 0)
                 return -errno;
 
-        FOREACH_DIRENT_ALL(de, d, r = -errno; goto finish) {
+        /* A file that was just archived might still be in the process of being written out, hence don't
+         * look into it */
+        r = journal_vacuum_index_add_at(idx, fd, filename, false);
+        return r < 0 ? r : 0;
+}
 
-                unsigned long long seqnum = 0, realtime;
-                _cleanup_free_ char *p = NULL;
-                sd_id128_t seqnum_id;
-                bool have_seqnum;
-                uint64_t size;
-                struct stat st;
-                size_t q;
+int journal_vacuum_index_usage(JournalVacuumIndex *idx, uint64_t *ret) {
+        _cleanup_close_ int fd = -1;
+        uint64_t sum;
+        Iterator i;
+        char *name;
+        int r;
 
-                if (fstatat(dirfd(d), de->d_name, &st, AT_SYMLINK_NOFOLLOW) < 0) {
-                        log_debug_errno(errno, "Failed to stat file %s while vacuuming, ignoring: %m", de->d_name);
-                        continue;
-                }
+        assert(idx);
+        assert(ret);
 
-                if (!S_ISREG(st.st_mode))
-                        continue;
+        r = journal_vacuum_index_refresh(idx);
+        if (r < 0)
+                return r;
 
-                q = strlen(de->d_name);
+        /* The archived files don't change anymore, only the active ones need to be looked at again */
+        sum = idx->usage;
 
-                if (endswith(de->d_name, ".journal")) {
+        if (!set_isempty(idx->active)) {
+                fd = open(idx->directory, O_RDONLY|O_CLOEXEC|O_DIRECTORY);
+                if (fd < 0)
+                        return -errno;
 
-                        /* Vacuum archived files. Active files are
-                         * left around */
+                SET_FOREACH(name, idx->active, i) {
+                        struct stat st;
 
-                        if (q < 1 + 32 + 1 + 16 + 1 + 16 + 8) {
-                                n_active_files++;
+                        if (fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW) < 0) {
+                                log_debug_errno(errno, "Failed to stat %s/%s, ignoring: %m", idx->directory, name);
                                 continue;
                         }
 
-                        if (de->d_name[q-8-16-1] != '-' ||
-                            de->d_name[q-8-16-1-16-1] != '-' ||
-                            de->d_name[q-8-16-1-16-1-32-1] != '@') {
-                                n_active_files++;
-                                continue;
-                        }
+                        if (S_ISREG(st.st_mode))
+                                sum += 512UL * (uint64_t) st.st_blocks;
+                }
+        }
 
-                        p = strdup(de->d_name);
-                        if (!p) {
-                                r = -ENOMEM;
-                                goto finish;
-                        }
+        *ret = sum;
+        return 0;
+}
 
-                        de->d_name[q-8-16-1-16-1] = 0;
-                        if (sd_id128_from_string(de->d_name + q-8-16-1-16-1-32, &seqnum_id) < 0) {
-                                n_active_files++;
-                                continue;
-                        }
+/* Drops the files that are gone from the list, i.e. the ones whose names were freed */
+static void journal_vacuum_index_compact(JournalVacuumIndex *idx) {
+        size_t i, k = 0;
 
-                        if (sscanf(de->d_name + q-8-16-1-16, "%16llx-%16llx.journal", &seqnum, &realtime) != 2) {
-                                n_active_files++;
-                                continue;
-                        }
+        assert(idx);
 
-                        have_seqnum = true;
+        for (i = 0; i < idx->n_list; i++)
+                if (idx->list[i].filename)
+                        idx->list[k++] = idx->list[i];
 
-                } else if (endswith(de->d_name, ".journal~")) {
-                        unsigned long long tmp;
+        idx->n_list = k;
+}
 
-                        /* Vacuum corrupted files */
+static uint64_t journal_vacuum_index_remove(JournalVacuumIndex *idx, int dir_fd, size_t i, bool verbose) {
+        struct vacuum_info *info;
+        char sbytes[FORMAT_BYTES_MAX];
+        int r;
 
-                        if (q < 1 + 16 + 1 + 16 + 8 + 1) {
-                                n_active_files++;
-                                continue;
-                        }
+        assert(idx);
+        assert(dir_fd >= 0);
+        assert(i < idx->n_list);
 
-                        if (de->d_name[q-1-8-16-1] != '-' ||
-                            de->d_name[q-1-8-16-1-16-1] != '@') {
-                                n_active_files++;
-                                continue;
-                        }
+        /* Returns the space freed, and forgets about the file, unless we failed to delete it */
 
-                        p = strdup(de->d_name);
-                        if (!p) {
-                                r = -ENOMEM;
-                                goto finish;
-                        }
+        info = idx->list + i;
 
-                        if (sscanf(de->d_name + q-1-8-16-1-16, "%16llx-%16llx.journal~", &realtime, &tmp) != 2) {
-                                n_active_files++;
-                                continue;
-                        }
+        r = unlinkat_deallocate(dir_fd, info->filename, 0);
+        if (r < 0 && r != -ENOENT) {
+                log_warning_errno(r, "Failed to delete %sarchived journal %s/%s: %m",
+                                  info->empty ? "empty " : "", idx->directory, info->filename);
+                return 0;
+        }
 
-                        have_seqnum = false;
-                } else {
-                        /* We do not vacuum unknown files! */
-                        log_debug("Not vacuuming unknown file %s.", de->d_name);
-                        continue;
-                }
+        if (r >= 0)
+                log_full(verbose ? LOG_INFO : LOG_DEBUG, "Deleted %sarchived journal %s/%s (%s).",
+                         info->empty ? "empty " : "", idx->directory, info->filename,
+                         format_bytes(sbytes, sizeof(sbytes), info->usage));
 
-                size = 512UL * (uint64_t) st.st_blocks;
+        idx->usage = LESS_BY(idx->usage, info->usage);
+        if (info->empty)
+                idx->n_empty--;
 
-                r = journal_file_empty(dirfd(d), p);
-                if (r < 0) {
-                        log_debug_errno(r, "Failed check if %s is empty, ignoring: %m", p);
-                        continue;
-                }
-                if (r > 0) {
-                        /* Always vacuum empty non-online files. */
+        vacuum_info_done(info);
 
-                        r = unlinkat_deallocate(dirfd(d), p, 0);
-                        if (r >= 0) {
+        return r >= 0 ? info->usage : 0;
+}
 
-                                log_full(verbose ? LOG_INFO : LOG_DEBUG,
-                                         "Deleted empty archived journal %s/%s (%s).", directory, p, format_bytes(sbytes, sizeof(sbytes), size));
+int journal_vacuum_index_vacuum(
+                JournalVacuumIndex *idx,
+                uint64_t max_use,
+                uint64_t n_max_files,
+                usec_t max_retention_usec,
+                usec_t *oldest_usec,
+                bool verbose) {
 
-                                freed += size;
-                        } else if (r != -ENOENT)
-                                log_warning_errno(r, "Failed to delete empty archived journal %s/%s: %m", directory, p);
+        uint64_t freed = 0;
+        _cleanup_close_ int fd = -1;
+        usec_t retention_limit = 0;
+        char sbytes[FORMAT_BYTES_MAX];
+        size_t i;
+        int r;
 
-                        continue;
-                }
+        assert(idx);
 
-                patch_realtime(dirfd(d), p, &st, &realtime);
+        if (max_use <= 0 && max_retention_usec <= 0 && n_max_files <= 0)
+                return 0;
 
-                if (!GREEDY_REALLOC(list, n_allocated, n_list + 1)) {
-                        r = -ENOMEM;
-                        goto finish;
-                }
+        if (max_retention_usec > 0)
+                retention_limit = usec_sub_unsigned(now(CLOCK_REALTIME), max_retention_usec);
 
-                list[n_list++] = (struct vacuum_info) {
-                        .filename = TAKE_PTR(p),
-                        .usage = size,
-                        .seqnum = seqnum,
-                        .realtime = realtime,
-                        .seqnum_id = seqnum_id,
-                        .have_seqnum = have_seqnum,
-                };
+        r = journal_vacuum_index_refresh(idx);
+        if (r < 0)
+                goto finish;
 
-                sum += size;
+        fd = open(idx->directory, O_RDONLY|O_CLOEXEC|O_DIRECTORY);
+        if (fd < 0) {
+                r = -errno;
+                goto finish;
         }
 
-        typesafe_qsort(list, n_list, vacuum_compare);
+        /* Always vacuum empty non-online files. */
+        if (idx->n_empty > 0) {
+                for (i = 0; i < idx->n_list; i++)
+                        if (idx->list[i].empty)
+                                freed += journal_vacuum_index_remove(idx, fd, i, verbose);
+
+                journal_vacuum_index_compact(idx);
+        }
 
-        for (i = 0; i < n_list; i++) {
+        /* The list is sorted, hence we only need to look at the files we actually delete, plus one */
+        for (i = 0; i < idx->n_list; i++) {
                 uint64_t left;
 
-                left = n_active_files + n_list - i;
+                left = set_size(idx->active) + idx->n_list - i;
 
-                if ((max_retention_usec <= 0 || list[i].realtime >= retention_limit) &&
-                    (max_use <= 0 || sum <= max_use) &&
+                if ((max_retention_usec <= 0 || idx->list[i].realtime >= retention_limit) &&
+                    (max_use <= 0 || idx->usage <= max_use) &&
                     (n_max_files <= 0 || left <= n_max_files))
                         break;
 
-                r = unlinkat_deallocate(dirfd(d), list[i].filename, 0);
-                if (r >= 0) {
-                        log_full(verbose ? LOG_INFO : LOG_DEBUG, "Deleted archived journal %s/%s (%s).", directory, list[i].filename, format_bytes(sbytes, sizeof(sbytes), list[i].usage));
-                        freed += list[i].usage;
-
-                        if (list[i].usage < sum)
-                                sum -= list[i].usage;
-                        else
-                                sum = 0;
-
-                } else if (r != -ENOENT)
-                        log_warning_errno(r, "Failed to delete archived journal %s/%s: %m", directory, list[i].filename);
+                freed += journal_vacuum_index_remove(idx, fd, i, verbose);
         }
 
-        if (oldest_usec && i < n_list && (*oldest_usec == 0 || list[i].realtime < *oldest_usec))
-                *oldest_usec = list[i].realtime;
+        if (oldest_usec && i < idx->n_list && (*oldest_usec == 0 || idx->list[i].realtime < *oldest_usec))
+                *oldest_usec = idx->list[i].realtime;
+
+        if (i > 0)
+                journal_vacuum_index_compact(idx);
 
         r = 0;
 
 finish:
-        for (i = 0; i < n_list; i++)
-                free(list[i].filename);
-        free(list);
-
-        log_full(verbose ? LOG_INFO : LOG_DEBUG, "Vacuuming done, freed %s of archived journals from %s.", format_bytes(sbytes, sizeof(sbytes), freed), directory);
+        log_full(verbose ? LOG_INFO : LOG_DEBUG, "Vacuuming done, freed %s of archived journals from %s.", format_bytes(sbytes, sizeof(sbytes), freed), idx->directory);
 
         return r;
 }
+
+int journal_directory_vacuum(
+                const char *directory,
+                uint64_t max_use,
+                uint64_t n_max_files,
+                usec_t max_retention_usec,
+                usec_t *oldest_usec,
+                bool verbose) {
+
+        _cleanup_(journal_vacuum_index_freep) JournalVacuumIndex *idx = NULL;
+        int r;
+
+        assert(directory);
+
+        if (max_use <= 0 && max_retention_usec <= 0 && n_max_files <= 0)
+                return 0;
+
+        r = journal_vacuum_index_new(directory, &idx);
+        if (r < 0)
+                return r;
+
+        return journal_vacuum_index_vacuum(idx, max_use, n_max_files, max_retention_usec, oldest_usec, verbose);
+}
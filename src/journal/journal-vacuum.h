@@ -4,6 +4,20 @@
 #include <inttypes.h>
 #include <stdbool.h>
 
+#include "macro.h"
 #include "time-util.h"
 
+/* An index of the journal files in a directory, so that repeated vacuuming of the same directory doesn't have
+ * to look at every file each time */
+typedef struct JournalVacuumIndex JournalVacuumIndex;
+
+int journal_vacuum_index_new(const char *directory, JournalVacuumIndex **ret);
+JournalVacuumIndex* journal_vacuum_index_free(JournalVacuumIndex *idx);
+DEFINE_TRIVIAL_CLEANUP_FUNC(JournalVacuumIndex*, journal_vacuum_index_free);
+
+void journal_vacuum_index_invalidate(JournalVacuumIndex *idx);
+int journal_vacuum_index_add(JournalVacuumIndex *idx, const char *filename);
+int journal_vacuum_index_usage(JournalVacuumIndex *idx, uint64_t *ret);
+int journal_vacuum_index_vacuum(JournalVacuumIndex *idx, uint64_t max_use, uint64_t n_max_files, usec_t max_retention_usec, usec_t *oldest_usec, bool verbose);
+
 int journal_directory_vacuum(const char *directory, uint64_t max_use, uint64_t n_max_files, usec_t max_retention_usec, usec_t *oldest_usec, bool verbose);
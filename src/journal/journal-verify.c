@@ -14,6 +14,7 @@
 #include "journal-def.h"
 #include "journal-file.h"
 #include "journal-verify.h"
+#include "limits-util.h"
 #include "lookup3.h"
 #include "macro.h"
 #include "terminal-util.h"
@@ -119,7 +120,7 @@ static int journal_file_object_verify(JournalFile *f, uint64_t offset, Object *o
          * possible field values. It does not follow any references to
          * other objects. */
 
-        if ((o->object.flags & OBJECT_COMPRESSED_XZ) &&
+        if ((o->object.flags & OBJECT_COMPRESSION_MASK) &&
             o->object.type != OBJECT_DATA) {
                 error(offset, "Found compressed object that isn't of type DATA, which is not allowed.");
                 return -EBADMSG;
@@ -153,10 +154,10 @@ static int journal_file_object_verify(JournalFile *f, uint64_t offset, Object *o
                         _cleanup_free_ void *b = NULL;
                         size_t alloc = 0, b_size;
 
-                        r = decompress_blob(compression,
-                                            o->data.payload,
-                                            le64toh(o->object.size) - offsetof(Object, data.payload),
-                                            &b, &alloc, &b_size, 0);
+                        r = journal_file_decompress_blob(f, compression,
+                                                         o->data.payload,
+                                                         le64toh(o->object.size) - offsetof(Object, data.payload),
+                                                         &b, &alloc, &b_size, 0);
                         if (r < 0) {
                                 error_errno(offset, r, "%s decompression failed: %m",
                                             object_compressed_to_string(compression));
@@ -345,39 +346,215 @@ static int journal_file_object_verify(JournalFile *f, uint64_t offset, Object *o
                 }
 
                 break;
+
+        case OBJECT_DICTIONARY:
+                if (le64toh(o->object.size) <= offsetof(DictionaryObject, payload)) {
+                        error(offset,
+                              "Invalid object dictionary size: %"PRIu64,
+                              le64toh(o->object.size));
+                        return -EBADMSG;
+                }
+
+                if (!JOURNAL_HEADER_COMPRESSION_DICTIONARY(f->header)) {
+                        error(offset, "Dictionary object in file without compression dictionary");
+                        return -EBADMSG;
+                }
+
+                if (!JOURNAL_HEADER_CONTAINS(f->header, dictionary_offset) ||
+                    le64toh(f->header->dictionary_offset) != offset) {
+                        error(offset, "Dictionary object not referenced from header");
+                        return -EBADMSG;
+                }
+
+                break;
+
+        case OBJECT_FIELD_INDEX: {
+                uint64_t position = 0, n = 0;
+                FieldIndexItem *item;
+                int r;
+
+                if (!JOURNAL_HEADER_FIELD_INDEXED(f->header)) {
+                        error(offset, "Field index object in file without field index flag");
+                        return -EBADMSG;
+                }
+
+                if (!VALID64(le64toh(o->field_index.field_offset)) ||
+                    le64toh(o->field_index.field_offset) <= 0 ||
+                    !VALID64(le64toh(o->field_index.next_field_index_offset)) ||
+                    le64toh(o->field_index.next_field_index_offset) >= offset) {
+                        error(offset,
+                              "Invalid field index field_offset/next_field_index_offset: "OFSfmt"/"OFSfmt,
+                              le64toh(o->field_index.field_offset),
+                              le64toh(o->field_index.next_field_index_offset));
+                        return -EBADMSG;
+                }
+
+                for (;;) {
+                        r = journal_file_next_field_index_item(o, &position, &item);
+                        if (r == 0)
+                                break;
+                        if (r < 0 ||
+                            !VALID64(le64toh(item->data_offset)) ||
+                            le64toh(item->data_offset) <= 0 ||
+                            !VALID_REALTIME(le64toh(item->first_realtime)) ||
+                            !VALID_REALTIME(le64toh(item->last_realtime))) {
+                                error(offset, "Invalid field index item %"PRIu64, n);
+                                return -EBADMSG;
+                        }
+
+                        n++;
+                }
+
+                if (n != le64toh(o->field_index.n_items)) {
+                        error(offset,
+                              "Field index has %"PRIu64" items, but claims %"PRIu64,
+                              n, le64toh(o->field_index.n_items));
+                        return -EBADMSG;
+                }
+
+                break;
+        }
+
+        case OBJECT_TIME_INDEX: {
+                uint64_t n, q;
+
+                if (!JOURNAL_HEADER_TIME_INDEXED(f->header) ||
+                    le64toh(f->header->time_index_offset) != offset) {
+                        error(offset, "Time index object not referenced from header");
+                        return -EBADMSG;
+                }
+
+                if ((le64toh(o->object.size) - offsetof(TimeIndexObject, items)) % sizeof(TimeIndexItem) != 0 ||
+                    (le64toh(o->object.size) - offsetof(TimeIndexObject, items)) / sizeof(TimeIndexItem) <= 0 ||
+                    le64toh(o->time_index.interval) <= 0) {
+                        error(offset,
+                              "Invalid object time index size/interval: %"PRIu64"/%"PRIu64,
+                              le64toh(o->object.size),
+                              le64toh(o->time_index.interval));
+                        return -EBADMSG;
+                }
+
+                n = (le64toh(o->object.size) - offsetof(TimeIndexObject, items)) / sizeof(TimeIndexItem);
+                for (q = 0; q < n; q++)
+                        if (!VALID_REALTIME(le64toh(o->time_index.items[q].realtime)) ||
+                            !VALID64(le64toh(o->time_index.items[q].entry_offset)) ||
+                            le64toh(o->time_index.items[q].entry_offset) <= 0 ||
+                            !VALID64(le64toh(o->time_index.items[q].entry_array_offset)) ||
+                            le64toh(o->time_index.items[q].entry_array_offset) <= 0) {
+                                error(offset, "Invalid time index item %"PRIu64, q);
+                                return -EBADMSG;
+                        }
+
+                break;
+        }
+        }
+
+        return 0;
+}
+
+/* The offsets of all objects of one type. One bit per 64 bit slot of the file if we can afford that, and a
+ * sorted list of offsets in a temporary file otherwise, which is then bisected through the mmap cache. */
+typedef struct OffsetSet {
+        uint64_t *bitmap;
+        size_t n_allocated;
+
+        int fd;
+        MMapFileDescriptor *cache_fd;
+
+        uint64_t n;
+} OffsetSet;
+
+static int offset_set_init(JournalFile *f, OffsetSet *s, bool in_memory, const char *tmp_dir) {
+        assert(f);
+        assert(s);
+
+        *s = (OffsetSet) {
+                .fd = -1,
+        };
+
+        if (in_memory) {
+                s->n_allocated = MAX(DIV_ROUND_UP((uint64_t) f->last_stat.st_size, 8 * 64), 1U);
+                s->bitmap = new0(uint64_t, s->n_allocated);
+                if (!s->bitmap)
+                        return -ENOMEM;
+
+                return 0;
         }
 
+        assert(tmp_dir);
+
+        s->fd = open_tmpfile_unlinkable(tmp_dir, O_RDWR | O_CLOEXEC);
+        if (s->fd < 0)
+                return s->fd;
+
+        s->cache_fd = mmap_cache_add_fd(f->mmap, s->fd);
+        if (!s->cache_fd)
+                return -ENOMEM;
+
         return 0;
 }
 
-static int write_uint64(int fd, uint64_t p) {
+static void offset_set_done(MMapCache *m, OffsetSet *s) {
+        assert(m);
+        assert(s);
+
+        if (s->cache_fd)
+                mmap_cache_free_fd(m, s->cache_fd);
+
+        safe_close(s->fd);
+        free(s->bitmap);
+}
+
+/* Offsets have to be added in ascending order */
+static int offset_set_add(OffsetSet *s, uint64_t p) {
         ssize_t k;
 
-        k = write(fd, &p, sizeof(p));
+        assert(s);
+        assert(VALID64(p));
+
+        if (s->fd < 0) {
+                /* The file might have grown since we looked at its size */
+                if (!GREEDY_REALLOC0(s->bitmap, s->n_allocated, p / 8 / 64 + 1))
+                        return -ENOMEM;
+
+                s->bitmap[p / 8 / 64] |= UINT64_C(1) << (p / 8 % 64);
+                s->n++;
+                return 0;
+        }
+
+        k = write(s->fd, &p, sizeof(p));
         if (k < 0)
                 return -errno;
         if (k != sizeof(p))
                 return -EIO;
 
+        s->n++;
         return 0;
 }
 
-static int contains_uint64(MMapCache *m, MMapFileDescriptor *f, uint64_t n, uint64_t p) {
+static int offset_set_contains(MMapCache *m, OffsetSet *s, uint64_t p) {
         uint64_t a, b;
         int r;
 
         assert(m);
-        assert(f);
+        assert(s);
+
+        if (s->fd < 0) {
+                if (!VALID64(p) || p / 8 / 64 >= s->n_allocated)
+                        return 0;
+
+                return !!(s->bitmap[p / 8 / 64] & (UINT64_C(1) << (p / 8 % 64)));
+        }
 
         /* Bisection ... */
 
-        a = 0; b = n;
+        a = 0; b = s->n;
         while (a < b) {
                 uint64_t c, *z;
 
                 c = (a + b) / 2;
 
-                r = mmap_cache_get(m, f, PROT_READ|PROT_WRITE, 0, false, c * sizeof(uint64_t), sizeof(uint64_t), NULL, (void **) &z, NULL);
+                r = mmap_cache_get(m, s->cache_fd, PROT_READ|PROT_WRITE, 0, false, c * sizeof(uint64_t), sizeof(uint64_t), NULL, (void **) &z, NULL);
                 if (r < 0)
                         return r;
 
@@ -398,8 +575,7 @@ static int contains_uint64(MMapCache *m, MMapFileDescriptor *f, uint64_t n, uint
 
 static int entry_points_to_data(
                 JournalFile *f,
-                MMapFileDescriptor *cache_entry_fd,
-                uint64_t n_entries,
+                OffsetSet *entries,
                 uint64_t entry_p,
                 uint64_t data_p) {
 
@@ -409,9 +585,9 @@ static int entry_points_to_data(
         bool found = false;
 
         assert(f);
-        assert(cache_entry_fd);
+        assert(entries);
 
-        if (!contains_uint64(f->mmap, cache_entry_fd, n_entries, entry_p)) {
+        if (!offset_set_contains(f->mmap, entries, entry_p)) {
                 error(data_p, "Data object references invalid entry at "OFSfmt, entry_p);
                 return -EBADMSG;
         }
@@ -485,16 +661,16 @@ static int entry_points_to_data(
 static int verify_data(
                 JournalFile *f,
                 Object *o, uint64_t p,
-                MMapFileDescriptor *cache_entry_fd, uint64_t n_entries,
-                MMapFileDescriptor *cache_entry_array_fd, uint64_t n_entry_arrays) {
+                OffsetSet *entries,
+                OffsetSet *entry_arrays) {
 
         uint64_t i, n, a, last, q;
         int r;
 
         assert(f);
         assert(o);
-        assert(cache_entry_fd);
-        assert(cache_entry_array_fd);
+        assert(entries);
+        assert(entry_arrays);
 
         n = le64toh(o->data.n_entries);
         a = le64toh(o->data.entry_array_offset);
@@ -512,7 +688,7 @@ static int verify_data(
         assert(o->data.entry_offset);
 
         last = q = le64toh(o->data.entry_offset);
-        r = entry_points_to_data(f, cache_entry_fd, n_entries, q, p);
+        r = entry_points_to_data(f, entries, q, p);
         if (r < 0)
                 return r;
 
@@ -525,7 +701,7 @@ static int verify_data(
                         return -EBADMSG;
                 }
 
-                if (!contains_uint64(f->mmap, cache_entry_array_fd, n_entry_arrays, a)) {
+                if (!offset_set_contains(f->mmap, entry_arrays, a)) {
                         error(p, "Invalid array offset "OFSfmt, a);
                         return -EBADMSG;
                 }
@@ -550,7 +726,7 @@ static int verify_data(
                         }
                         last = q;
 
-                        r = entry_points_to_data(f, cache_entry_fd, n_entries, q, p);
+                        r = entry_points_to_data(f, entries, q, p);
                         if (r < 0)
                                 return r;
 
@@ -568,9 +744,9 @@ static int verify_data(
 
 static int verify_hash_table(
                 JournalFile *f,
-                MMapFileDescriptor *cache_data_fd, uint64_t n_data,
-                MMapFileDescriptor *cache_entry_fd, uint64_t n_entries,
-                MMapFileDescriptor *cache_entry_array_fd, uint64_t n_entry_arrays,
+                OffsetSet *data,
+                OffsetSet *entries,
+                OffsetSet *entry_arrays,
                 usec_t *last_usec,
                 bool show_progress) {
 
@@ -578,9 +754,9 @@ static int verify_hash_table(
         int r;
 
         assert(f);
-        assert(cache_data_fd);
-        assert(cache_entry_fd);
-        assert(cache_entry_array_fd);
+        assert(data);
+        assert(entries);
+        assert(entry_arrays);
         assert(last_usec);
 
         n = le64toh(f->header->data_hash_table_size) / sizeof(HashItem);
@@ -602,7 +778,7 @@ static int verify_hash_table(
                         Object *o;
                         uint64_t next;
 
-                        if (!contains_uint64(f->mmap, cache_data_fd, n_data, p)) {
+                        if (!offset_set_contains(f->mmap, data, p)) {
                                 error(p, "Invalid data object at hash entry %"PRIu64" of %"PRIu64, i, n);
                                 return -EBADMSG;
                         }
@@ -622,7 +798,7 @@ static int verify_hash_table(
                                 return -EBADMSG;
                         }
 
-                        r = verify_data(f, o, p, cache_entry_fd, n_entries, cache_entry_array_fd, n_entry_arrays);
+                        r = verify_data(f, o, p, entries, entry_arrays);
                         if (r < 0)
                                 return r;
 
@@ -674,14 +850,14 @@ static int data_object_in_hash_table(JournalFile *f, uint64_t hash, uint64_t p)
 static int verify_entry(
                 JournalFile *f,
                 Object *o, uint64_t p,
-                MMapFileDescriptor *cache_data_fd, uint64_t n_data) {
+                OffsetSet *data) {
 
         uint64_t i, n;
         int r;
 
         assert(f);
         assert(o);
-        assert(cache_data_fd);
+        assert(data);
 
         n = journal_file_entry_n_items(o);
         for (i = 0; i < n; i++) {
@@ -691,7 +867,7 @@ static int verify_entry(
                 q = le64toh(o->entry.items[i].object_offset);
                 h = le64toh(o->entry.items[i].hash);
 
-                if (!contains_uint64(f->mmap, cache_data_fd, n_data, q)) {
+                if (!offset_set_contains(f->mmap, data, q)) {
                         error(p, "Invalid data object of entry");
                         return -EBADMSG;
                 }
@@ -719,9 +895,9 @@ static int verify_entry(
 
 static int verify_entry_array(
                 JournalFile *f,
-                MMapFileDescriptor *cache_data_fd, uint64_t n_data,
-                MMapFileDescriptor *cache_entry_fd, uint64_t n_entries,
-                MMapFileDescriptor *cache_entry_array_fd, uint64_t n_entry_arrays,
+                OffsetSet *data,
+                OffsetSet *entries,
+                OffsetSet *entry_arrays,
                 usec_t *last_usec,
                 bool show_progress) {
 
@@ -729,9 +905,9 @@ static int verify_entry_array(
         int r;
 
         assert(f);
-        assert(cache_data_fd);
-        assert(cache_entry_fd);
-        assert(cache_entry_array_fd);
+        assert(data);
+        assert(entries);
+        assert(entry_arrays);
         assert(last_usec);
 
         n = le64toh(f->header->n_entries);
@@ -748,7 +924,7 @@ static int verify_entry_array(
                         return -EBADMSG;
                 }
 
-                if (!contains_uint64(f->mmap, cache_entry_array_fd, n_entry_arrays, a)) {
+                if (!offset_set_contains(f->mmap, entry_arrays, a)) {
                         error(a, "Invalid array %"PRIu64" of %"PRIu64, i, n);
                         return -EBADMSG;
                 }
@@ -774,7 +950,7 @@ static int verify_entry_array(
                         }
                         last = p;
 
-                        if (!contains_uint64(f->mmap, cache_entry_fd, n_entries, p)) {
+                        if (!offset_set_contains(f->mmap, entries, p)) {
                                 error(a, "Invalid array entry at %"PRIu64" of %"PRIu64, i, n);
                                 return -EBADMSG;
                         }
@@ -783,7 +959,7 @@ static int verify_entry_array(
                         if (r < 0)
                                 return r;
 
-                        r = verify_entry(f, o, p, cache_data_fd, n_data);
+                        r = verify_entry(f, o, p, data);
                         if (r < 0)
                                 return r;
 
@@ -813,10 +989,9 @@ int journal_file_verify(
         bool entry_seqnum_set = false, entry_monotonic_set = false, entry_realtime_set = false, found_main_entry_array = false;
         uint64_t n_weird = 0, n_objects = 0, n_entries = 0, n_data = 0, n_fields = 0, n_data_hash_tables = 0, n_field_hash_tables = 0, n_entry_arrays = 0, n_tags = 0;
         usec_t last_usec = 0;
-        int data_fd = -1, entry_fd = -1, entry_array_fd = -1;
-        MMapFileDescriptor *cache_data_fd = NULL, *cache_entry_fd = NULL, *cache_entry_array_fd = NULL;
+        OffsetSet data = { .fd = -1 }, entries = { .fd = -1 }, entry_arrays = { .fd = -1 };
         unsigned i;
-        bool found_last = false;
+        bool found_last = false, in_memory;
         const char *tmp_dir = NULL;
 
 #if HAVE_GCRYPT
@@ -837,46 +1012,32 @@ int journal_file_verify(
         } else if (f->seal)
                 return -ENOKEY;
 
-        r = var_tmp_dir(&tmp_dir);
-        if (r < 0) {
-                log_error_errno(r, "Failed to determine temporary directory: %m");
-                goto fail;
-        }
-
-        data_fd = open_tmpfile_unlinkable(tmp_dir, O_RDWR | O_CLOEXEC);
-        if (data_fd < 0) {
-                r = log_error_errno(data_fd, "Failed to create data file: %m");
-                goto fail;
-        }
-
-        entry_fd = open_tmpfile_unlinkable(tmp_dir, O_RDWR | O_CLOEXEC);
-        if (entry_fd < 0) {
-                r = log_error_errno(entry_fd, "Failed to create entry file: %m");
-                goto fail;
-        }
-
-        entry_array_fd = open_tmpfile_unlinkable(tmp_dir, O_RDWR | O_CLOEXEC);
-        if (entry_array_fd < 0) {
-                r = log_error_errno(entry_array_fd,
-                                    "Failed to create entry array file: %m");
-                goto fail;
+        /* Keep the offset sets in memory as long as they take up less than an eighth of physical memory,
+         * otherwise write them out to temporary files. */
+        in_memory = 3 * DIV_ROUND_UP((uint64_t) f->last_stat.st_size, 64) <= physical_memory() / 8;
+        if (!in_memory) {
+                r = var_tmp_dir(&tmp_dir);
+                if (r < 0) {
+                        log_error_errno(r, "Failed to determine temporary directory: %m");
+                        goto fail;
+                }
         }
 
-        cache_data_fd = mmap_cache_add_fd(f->mmap, data_fd);
-        if (!cache_data_fd) {
-                r = log_oom();
+        r = offset_set_init(f, &data, in_memory, tmp_dir);
+        if (r < 0) {
+                log_error_errno(r, "Failed to create data file: %m");
                 goto fail;
         }
 
-        cache_entry_fd = mmap_cache_add_fd(f->mmap, entry_fd);
-        if (!cache_entry_fd) {
-                r = log_oom();
+        r = offset_set_init(f, &entries, in_memory, tmp_dir);
+        if (r < 0) {
+                log_error_errno(r, "Failed to create entry file: %m");
                 goto fail;
         }
 
-        cache_entry_array_fd = mmap_cache_add_fd(f->mmap, entry_array_fd);
-        if (!cache_entry_array_fd) {
-                r = log_oom();
+        r = offset_set_init(f, &entry_arrays, in_memory, tmp_dir);
+        if (r < 0) {
+                log_error_errno(r, "Failed to create entry array file: %m");
                 goto fail;
         }
 
@@ -925,8 +1086,7 @@ int journal_file_verify(
                         goto fail;
                 }
 
-                if ((o->object.flags & OBJECT_COMPRESSED_XZ) &&
-                    (o->object.flags & OBJECT_COMPRESSED_LZ4)) {
+                if (__builtin_popcount(o->object.flags & OBJECT_COMPRESSION_MASK) > 1) {
                         error(p, "Objected with double compression");
                         r = -EINVAL;
                         goto fail;
@@ -944,10 +1104,16 @@ int journal_file_verify(
                         goto fail;
                 }
 
+                if ((o->object.flags & OBJECT_COMPRESSED_ZSTD) && !JOURNAL_HEADER_COMPRESSED_ZSTD(f->header)) {
+                        error(p, "ZSTD compressed object in file without ZSTD compression");
+                        r = -EBADMSG;
+                        goto fail;
+                }
+
                 switch (o->object.type) {
 
                 case OBJECT_DATA:
-                        r = write_uint64(data_fd, p);
+                        r = offset_set_add(&data, p);
                         if (r < 0)
                                 goto fail;
 
@@ -965,7 +1131,7 @@ int journal_file_verify(
                                 goto fail;
                         }
 
-                        r = write_uint64(entry_fd, p);
+                        r = offset_set_add(&entries, p);
                         if (r < 0)
                                 goto fail;
 
@@ -1052,7 +1218,7 @@ int journal_file_verify(
                         break;
 
                 case OBJECT_ENTRY_ARRAY:
-                        r = write_uint64(entry_array_fd, p);
+                        r = offset_set_add(&entry_arrays, p);
                         if (r < 0)
                                 goto fail;
 
@@ -1157,6 +1323,11 @@ int journal_file_verify(
                         n_tags++;
                         break;
 
+                case OBJECT_DICTIONARY:
+                case OBJECT_FIELD_INDEX:
+                case OBJECT_TIME_INDEX:
+                        break;
+
                 default:
                         n_weird++;
                 }
@@ -1251,18 +1422,14 @@ int journal_file_verify(
          * referenced is consistent. */
 
         r = verify_entry_array(f,
-                               cache_data_fd, n_data,
-                               cache_entry_fd, n_entries,
-                               cache_entry_array_fd, n_entry_arrays,
+                               &data, &entries, &entry_arrays,
                                &last_usec,
                                show_progress);
         if (r < 0)
                 goto fail;
 
         r = verify_hash_table(f,
-                              cache_data_fd, n_data,
-                              cache_entry_fd, n_entries,
-                              cache_entry_array_fd, n_entry_arrays,
+                              &data, &entries, &entry_arrays,
                               &last_usec,
                               show_progress);
         if (r < 0)
@@ -1271,13 +1438,9 @@ int journal_file_verify(
         if (show_progress)
                 flush_progress();
 
-        mmap_cache_free_fd(f->mmap, cache_data_fd);
-        mmap_cache_free_fd(f->mmap, cache_entry_fd);
-        mmap_cache_free_fd(f->mmap, cache_entry_array_fd);
-
-        safe_close(data_fd);
-        safe_close(entry_fd);
-        safe_close(entry_array_fd);
+        offset_set_done(f->mmap, &data);
+        offset_set_done(f->mmap, &entries);
+        offset_set_done(f->mmap, &entry_arrays);
 
         if (first_contained)
                 *first_contained = le64toh(f->header->head_entry_realtime);
@@ -1298,23 +1461,9 @@ fail:
                   (unsigned long long) f->last_stat.st_size,
                   100 * p / f->last_stat.st_size);
 
-        if (data_fd >= 0)
-                safe_close(data_fd);
-
-        if (entry_fd >= 0)
-                safe_close(entry_fd);
-
-        if (entry_array_fd >= 0)
-                safe_close(entry_array_fd);
-
-        if (cache_data_fd)
-                mmap_cache_free_fd(f->mmap, cache_data_fd);
-
-        if (cache_entry_fd)
-                mmap_cache_free_fd(f->mmap, cache_entry_fd);
-
-        if (cache_entry_array_fd)
-                mmap_cache_free_fd(f->mmap, cache_entry_array_fd);
+        offset_set_done(f->mmap, &data);
+        offset_set_done(f->mmap, &entries);
+        offset_set_done(f->mmap, &entry_arrays);
 
         return r;
 }
@@ -29,6 +29,7 @@
 #include "bus-util.h"
 #include "catalog.h"
 #include "chattr-util.h"
+#include "cpu-set-util.h"
 #include "def.h"
 #include "device-private.h"
 #include "fd-util.h"
@@ -57,9 +58,12 @@
 #include "parse-util.h"
 #include "path-util.h"
 #include "pretty-print.h"
+#include "process-util.h"
 #include "rlimit-util.h"
 #include "set.h"
 #include "sigbus.h"
+#include "signal-util.h"
+#include "sort-util.h"
 #include "string-table.h"
 #include "strv.h"
 #include "stdio-util.h"
@@ -1428,13 +1432,79 @@ finish:
         return count;
 }
 
+static int boot_range_compare(const JournalFieldRange *a, const JournalFieldRange *b) {
+        int r;
+
+        r = CMP(a->first_realtime, b->first_realtime);
+        if (r != 0)
+                return r;
+
+        return CMP(a->last_realtime, b->last_realtime);
+}
+
+static int get_all_boots(sd_journal *j, BootId **boots) {
+        BootId *head = NULL, *tail = NULL;
+        JournalFieldRange *ranges;
+        size_t n, i;
+        int r, count = 0;
+
+        assert(j);
+        assert(boots);
+
+        /* Determines the list of all boots from the values of the _BOOT_ID= field and the realtime range of
+         * the entries referencing them, rather than by seeking from boot to boot through all entries.
+         * Archived journal files keep an index of these, hence this doesn't need to look at most of the
+         * data. */
+
+        r = journal_get_field_ranges(j, "_BOOT_ID", &ranges, &n);
+        if (r < 0)
+                return r;
+
+        typesafe_qsort(ranges, n, boot_range_compare);
+
+        for (i = 0; i < n; i++) {
+                char s[SD_ID128_STRING_MAX];
+                BootId *current;
+
+                if (ranges[i].size != STRLEN("_BOOT_ID=") + SD_ID128_STRING_MAX - 1)
+                        continue;
+
+                memcpy(s, (const char*) ranges[i].data + STRLEN("_BOOT_ID="), SD_ID128_STRING_MAX - 1);
+                s[SD_ID128_STRING_MAX - 1] = 0;
+
+                current = new0(BootId, 1);
+                if (!current) {
+                        boot_id_free_all(head);
+                        journal_field_range_free_many(ranges, n);
+                        return -ENOMEM;
+                }
+
+                if (sd_id128_from_string(s, &current->id) < 0) {
+                        free(current);
+                        continue;
+                }
+
+                current->first = ranges[i].first_realtime;
+                current->last = ranges[i].last_realtime;
+
+                LIST_INSERT_AFTER(boot_list, head, tail, current);
+                tail = current;
+                count++;
+        }
+
+        journal_field_range_free_many(ranges, n);
+
+        *boots = head;
+        return count;
+}
+
 static int list_boots(sd_journal *j) {
         int w, i, count;
         BootId *id, *all_ids;
 
         assert(j);
 
-        count = get_boots(j, &all_ids, NULL, 0);
+        count = get_all_boots(j, &all_ids);
         if (count < 0)
                 return log_error_errno(count, "Failed to determine boots: %m");
         if (count == 0)
@@ -1973,51 +2043,135 @@ finish:
 #endif
 }
 
+static int verify_one(JournalFile *f, bool show_progress) {
+        char a[FORMAT_TIMESTAMP_MAX], b[FORMAT_TIMESTAMP_MAX], c[FORMAT_TIMESPAN_MAX];
+        usec_t first = 0, validated = 0, last = 0;
+        int r;
+
+        assert(f);
+
+#if HAVE_GCRYPT
+        if (!arg_verify_key && JOURNAL_HEADER_SEALED(f->header))
+                log_notice("Journal file %s has sealing enabled but verification key has not been passed using --verify-key=.", f->path);
+#endif
+
+        r = journal_file_verify(f, arg_verify_key, &first, &validated, &last, show_progress);
+        if (r == -EINVAL)
+                /* If the key was invalid give up right-away. */
+                return r;
+        if (r < 0)
+                return log_warning_errno(r, "FAIL: %s (%m)", f->path);
+
+        log_info("PASS: %s", f->path);
+
+        if (arg_verify_key && JOURNAL_HEADER_SEALED(f->header)) {
+                if (validated > 0) {
+                        log_info("=> Validated from %s to %s, final %s entries not sealed.",
+                                 format_timestamp_maybe_utc(a, sizeof(a), first),
+                                 format_timestamp_maybe_utc(b, sizeof(b), validated),
+                                 format_timespan(c, sizeof(c), last > validated ? last - validated : 0, 0));
+                } else if (last > 0)
+                        log_info("=> No sealing yet, %s of entries not sealed.",
+                                 format_timespan(c, sizeof(c), last - first, 0));
+                else
+                        log_info("=> No sealing yet, no entries in file.");
+        }
+
+        return 0;
+}
+
+static int verify_wait(pid_t pid) {
+        siginfo_t si;
+        int r;
+
+        r = wait_for_terminate(pid, &si);
+        if (r < 0)
+                return log_error_errno(r, "Failed to wait for verification process: %m");
+
+        /* The child exits with the negated error of verify_one(), which already logged about it */
+        if (si.si_code == CLD_EXITED)
+                return -si.si_status;
+
+        return log_error_errno(SYNTHETIC_ERRNO(EPROTO), "Verification process died of signal %s.", signal_to_string(si.si_status));
+}
+
 static int verify(sd_journal *j) {
-        int r = 0;
-        Iterator i;
+        _cleanup_free_ pid_t *pids = NULL;
+        size_t n_jobs, n_pids = 0, i;
+        bool invalid_key = false;
+        Iterator it;
         JournalFile *f;
+        int r = 0, k;
 
         assert(j);
 
         log_show_color(true);
 
-        ORDERED_HASHMAP_FOREACH(f, j->files, i) {
-                int k;
-                usec_t first = 0, validated = 0, last = 0;
+        journal_open_deferred_files(j);
+
+        /* Every file is verified on its own, hence check several of them at the same time, one process per
+         * CPU. The JournalFile objects share the mmap cache of the sd_journal object, so use processes
+         * rather than threads. */
+        k = cpus_in_affinity_mask();
+        n_jobs = MIN((size_t) MAX(k, 1), ordered_hashmap_size(j->files));
+
+        if (n_jobs <= 1) {
+                ORDERED_HASHMAP_FOREACH(f, j->files, it) {
+                        k = verify_one(f, true);
+                        if (k == -EINVAL)
+                                return k;
+                        if (k < 0)
+                                r = k;
+                }
 
-#if HAVE_GCRYPT
-                if (!arg_verify_key && JOURNAL_HEADER_SEALED(f->header))
-                        log_notice("Journal file %s has sealing enabled but verification key has not been passed using --verify-key=.", f->path);
-#endif
+                return r;
+        }
+
+        pids = new(pid_t, n_jobs);
+        if (!pids)
+                return log_oom();
+
+        ORDERED_HASHMAP_FOREACH(f, j->files, it) {
+                pid_t pid;
+
+                if (n_pids >= n_jobs) {
+                        /* Wait for the oldest one, they all take roughly the same time per byte */
+                        k = verify_wait(pids[0]);
+                        if (k == -EINVAL)
+                                invalid_key = true;
+                        else if (k < 0)
+                                r = k;
 
-                k = journal_file_verify(f, arg_verify_key, &first, &validated, &last, true);
-                if (k == -EINVAL) {
-                        /* If the key was invalid give up right-away. */
-                        return k;
-                } else if (k < 0) {
-                        log_warning_errno(k, "FAIL: %s (%m)", f->path);
+                        memmove(pids, pids + 1, (n_pids - 1) * sizeof(pid_t));
+                        n_pids--;
+
+                        if (invalid_key)
+                                break;
+                }
+
+                k = safe_fork("(journal-verify)", FORK_DEATHSIG|FORK_LOG, &pid);
+                if (k < 0) {
                         r = k;
-                } else {
-                        char a[FORMAT_TIMESTAMP_MAX], b[FORMAT_TIMESTAMP_MAX], c[FORMAT_TIMESPAN_MAX];
-                        log_info("PASS: %s", f->path);
-
-                        if (arg_verify_key && JOURNAL_HEADER_SEALED(f->header)) {
-                                if (validated > 0) {
-                                        log_info("=> Validated from %s to %s, final %s entries not sealed.",
-                                                 format_timestamp_maybe_utc(a, sizeof(a), first),
-                                                 format_timestamp_maybe_utc(b, sizeof(b), validated),
-                                                 format_timespan(c, sizeof(c), last > validated ? last - validated : 0, 0));
-                                } else if (last > 0)
-                                        log_info("=> No sealing yet, %s of entries not sealed.",
-                                                 format_timespan(c, sizeof(c), last - first, 0));
-                                else
-                                        log_info("=> No sealing yet, no entries in file.");
-                        }
+                        break;
                 }
+                if (k == 0) {
+                        /* The progress bars of several files would only garble each other */
+                        k = verify_one(f, false);
+                        _exit(k < 0 ? MIN(-k, 255) : EXIT_SUCCESS);
+                }
+
+                pids[n_pids++] = pid;
         }
 
-        return r;
+        for (i = 0; i < n_pids; i++) {
+                k = verify_wait(pids[i]);
+                if (k == -EINVAL)
+                        invalid_key = true;
+                else if (k < 0)
+                        r = k;
+        }
+
+        return invalid_key ? -EINVAL : r;
 }
 
 static int simple_varlink_call(const char *option, const char *method) {
@@ -0,0 +1,164 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include "alloc-util.h"
+#include "compress.h"
+#include "journald-compress.h"
+#include "lookup3.h"
+#include "pthread-util.h"
+
+/* Below this many bytes to compress, starting threads costs more than it saves */
+#define COMPRESS_BATCH_SIZE_MIN (64U*1024U)
+
+typedef struct CompressItem {
+        const struct iovec *iovec;
+        JournalFileCompressed *result;
+} CompressItem;
+
+typedef struct CompressContext {
+        int compression;
+        CompressItem *items;
+        size_t n_items;
+        size_t next_item;
+} CompressContext;
+
+static void *compress_thread(void *userdata) {
+        CompressContext *c = userdata;
+
+        assert(c);
+
+        for (;;) {
+                CompressItem *item;
+                size_t i, rsize = 0;
+                void *buf;
+                int k;
+
+                i = __sync_fetch_and_add(&c->next_item, 1);
+                if (i >= c->n_items)
+                        break;
+
+                item = c->items + i;
+
+                /* Same as journal_file_append_data_with_hash(): it's only worth it if it gets smaller */
+                buf = malloc(item->iovec->iov_len - 1);
+                if (!buf)
+                        continue; /* Leave this one to the main thread */
+
+                k = compress_blob(c->compression, item->iovec->iov_base, item->iovec->iov_len,
+                                  buf, item->iovec->iov_len - 1, &rsize);
+                if (k < 0) {
+                        free(buf);
+                        *item->result = (JournalFileCompressed) {
+                                .compression = c->compression,
+                        };
+                } else
+                        *item->result = (JournalFileCompressed) {
+                                .compression = k,
+                                .data = buf,
+                                .size = rsize,
+                        };
+        }
+
+        return NULL;
+}
+
+int compress_entries_threaded(
+                JournalFile *f,
+                JournalFileEntry entries[], size_t n_entries,
+                unsigned n_threads,
+                JournalFileCompressed **ret, size_t *ret_n) {
+
+        _cleanup_free_ JournalFileCompressed *compressed = NULL;
+        _cleanup_free_ CompressItem *items = NULL;
+        size_t i, n_iovec = 0, n_items = 0, n_bytes = 0, k;
+        CompressContext c;
+        uint64_t threshold;
+
+        assert(f);
+        assert(entries || n_entries == 0);
+        assert(ret);
+        assert(ret_n);
+
+        /* Compressing large fields is the one expensive thing left when writing an entry, and nothing in it
+         * depends on the journal file, except the algorithm and the threshold. Hence compress all fields of
+         * the entries, that will be compressed when appended, on separate threads beforehand, and let
+         * journal_file_append_entries() copy the results in. Fields the file already contains aren't
+         * compressed again, hence those are skipped. Returns 0 and NULL if there's not enough work to bother
+         * with threads. */
+
+        *ret = NULL;
+        *ret_n = 0;
+
+        if (n_threads == 0 || !JOURNAL_FILE_COMPRESS(f))
+                return 0;
+
+        threshold = f->compress_threshold_bytes;
+
+        for (i = 0; i < n_entries; i++)
+                for (k = 0; k < entries[i].n_iovec; k++) {
+                        const struct iovec *iovec = entries[i].iovec + k;
+
+                        n_iovec++;
+
+                        if (iovec->iov_len < threshold || iovec->iov_len < 2)
+                                continue;
+
+                        n_items++;
+                        n_bytes += iovec->iov_len;
+                }
+
+        if (n_bytes < COMPRESS_BATCH_SIZE_MIN)
+                return 0;
+
+        compressed = new0(JournalFileCompressed, n_iovec);
+        items = new(CompressItem, n_items);
+        if (!compressed || !items)
+                return -ENOMEM;
+
+        n_items = 0;
+        n_iovec = 0;
+        for (i = 0; i < n_entries; i++) {
+                entries[i].compressed = compressed + n_iovec;
+
+                for (k = 0; k < entries[i].n_iovec; k++, n_iovec++) {
+                        const struct iovec *iovec = entries[i].iovec + k;
+
+                        if (iovec->iov_len < threshold || iovec->iov_len < 2)
+                                continue;
+
+                        if (journal_file_find_data_object_with_hash(
+                                            f, iovec->iov_base, iovec->iov_len,
+                                            entries[i].hashes ? entries[i].hashes[k] : hash64(iovec->iov_base, iovec->iov_len),
+                                            NULL, NULL) > 0)
+                                continue;
+
+                        items[n_items++] = (CompressItem) {
+                                .iovec = iovec,
+                                .result = compressed + n_iovec,
+                        };
+                }
+        }
+
+        c = (CompressContext) {
+                .compression = JOURNAL_FILE_COMPRESSION(f),
+                .items = items,
+                .n_items = n_items,
+        };
+
+        run_parallel(MIN3(n_threads, COMPRESS_THREADS_MAX, n_items) + 1, compress_thread, &c);
+
+        *ret = TAKE_PTR(compressed);
+        *ret_n = n_iovec;
+
+        return 1;
+}
+
+void journal_file_compressed_free_many(JournalFileCompressed *c, size_t n) {
+        size_t i;
+
+        assert(c || n == 0);
+
+        for (i = 0; i < n; i++)
+                free((void*) c[i].data);
+
+        free(c);
+}
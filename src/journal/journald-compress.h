@@ -0,0 +1,15 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+#include "journal-file.h"
+
+/* Upper limit for the number of compression threads, see $SYSTEMD_JOURNAL_COMPRESS_THREADS */
+#define COMPRESS_THREADS_MAX 64U
+
+int compress_entries_threaded(
+                JournalFile *f,
+                JournalFileEntry entries[], size_t n_entries,
+                unsigned n_threads,
+                JournalFileCompressed **ret, size_t *ret_n);
+
+void journal_file_compressed_free_many(JournalFileCompressed *c, size_t n);
@@ -16,6 +16,9 @@
 #include "stdio-util.h"
 #include "terminal-util.h"
 
+/* Upper limit on how much console output we collect during a write batch before writing it out */
+#define CONSOLE_FORWARD_BUFFER_MAX (64U*1024U)
+
 static bool prefix_timestamp(void) {
 
         static int cached_printk_time = -1;
@@ -31,6 +34,30 @@ static bool prefix_timestamp(void) {
         return cached_printk_time;
 }
 
+static void console_write(Server *s, const struct iovec *iovec, size_t n) {
+        _cleanup_close_ int fd = -1;
+        const char *tty;
+
+        assert(s);
+        assert(iovec);
+
+        tty = s->tty_path ?: "/dev/console";
+
+        /* Before you ask: yes, on purpose we open/close the console for each batch of log lines we write. This is a
+         * good strategy to avoid journald getting killed by the kernel's SAK concept (it doesn't fix this entirely,
+         * but minimizes the time window the kernel might end up killing journald due to SAK). It also makes things
+         * easier for us so that we don't have to recover from hangups and suchlike triggered on the console. */
+
+        fd = open_terminal(tty, O_WRONLY|O_NOCTTY|O_CLOEXEC);
+        if (fd < 0) {
+                log_debug_errno(fd, "Failed to open %s for logging: %m", tty);
+                return;
+        }
+
+        if (writev(fd, iovec, n) < 0)
+                log_debug_errno(errno, "Failed to write to %s for logging: %m", tty);
+}
+
 void server_forward_console(
                 Server *s,
                 int priority,
@@ -43,9 +70,9 @@ void server_forward_console(
         char tbuf[STRLEN("[] ") + DECIMAL_STR_MAX(ts.tv_sec) + DECIMAL_STR_MAX(ts.tv_nsec)-3 + 1];
         char header_pid[STRLEN("[]: ") + DECIMAL_STR_MAX(pid_t)];
         _cleanup_free_ char *ident_buf = NULL;
-        _cleanup_close_ int fd = -1;
-        const char *tty;
-        int n = 0;
+        size_t sz = 0;
+        int i, n = 0;
+        char *p;
 
         assert(s);
         assert(message);
@@ -85,19 +112,35 @@ void server_forward_console(
         iovec[n++] = IOVEC_MAKE_STRING(message);
         iovec[n++] = IOVEC_MAKE_STRING("\n");
 
-        tty = s->tty_path ?: "/dev/console";
+        /* During a write batch the lines are collected, and written out together at its end, see
+         * server_end_write_batch(). Large bursts are written out early, to keep the buffer bounded. */
+        for (i = 0; i < n; i++)
+                sz += iovec[i].iov_len;
 
-        /* Before you ask: yes, on purpose we open/close the console for each log line we write individually. This is a
-         * good strategy to avoid journald getting killed by the kernel's SAK concept (it doesn't fix this entirely,
-         * but minimizes the time window the kernel might end up killing journald due to SAK). It also makes things
-         * easier for us so that we don't have to recover from hangups and suchlike triggered on the console. */
+        if (s->console_forward_buffer_size + sz > CONSOLE_FORWARD_BUFFER_MAX)
+                server_flush_forward_console(s);
 
-        fd = open_terminal(tty, O_WRONLY|O_NOCTTY|O_CLOEXEC);
-        if (fd < 0) {
-                log_debug_errno(fd, "Failed to open %s for logging: %m", tty);
+        if (s->write_batch_depth == 0 ||
+            !GREEDY_REALLOC(s->console_forward_buffer, s->console_forward_buffer_allocated, s->console_forward_buffer_size + sz)) {
+                /* Flush what we have so far to keep the ordering, then write this one directly */
+                server_flush_forward_console(s);
+                console_write(s, iovec, n);
                 return;
         }
 
-        if (writev(fd, iovec, n) < 0)
-                log_debug_errno(errno, "Failed to write to %s for logging: %m", tty);
+        p = s->console_forward_buffer + s->console_forward_buffer_size;
+        for (i = 0; i < n; i++)
+                p = mempcpy(p, iovec[i].iov_base, iovec[i].iov_len);
+
+        s->console_forward_buffer_size += sz;
+}
+
+void server_flush_forward_console(Server *s) {
+        assert(s);
+
+        if (s->console_forward_buffer_size == 0)
+                return;
+
+        console_write(s, &IOVEC_MAKE(s->console_forward_buffer, s->console_forward_buffer_size), 1);
+        s->console_forward_buffer_size = 0;
 }
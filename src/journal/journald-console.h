@@ -3,4 +3,6 @@
 
 #include "journald-server.h"
 
+void server_flush_forward_console(Server *s);
+
 void server_forward_console(Server *s, int priority, const char *identifier, const char *message, const struct ucred *ucred);
@@ -10,14 +10,18 @@
 #include "env-util.h"
 #include "fd-util.h"
 #include "fileio.h"
+#include "format-util.h"
 #include "fs-util.h"
 #include "io-util.h"
 #include "journal-util.h"
 #include "journald-context.h"
+#include "lookup3.h"
 #include "parse-util.h"
 #include "path-util.h"
 #include "process-util.h"
 #include "procfs-util.h"
+#include "stdio-util.h"
+#include "string-pool.h"
 #include "string-util.h"
 #include "syslog-util.h"
 #include "unaligned.h"
@@ -38,6 +42,12 @@
  * as long as their socket is connected. Note that cache entries are shared between different transports. That means a
  * cache entry pinned for the stream connection logic may be reused for the syslog or native protocols.
  *
+ * The metadata that is the same for all processes of a unit (i.e. everything derived from the cgroup path, and what
+ * PID 1 stores in /run/systemd/units/ for the unit) is kept in a second level cache indexed by the cgroup path, and
+ * shared between the cache entries of all PIDs in that cgroup. It is refreshed at most once per second, regardless
+ * of the number of processes logging. This way a service forking lots of short-lived processes doesn't make us
+ * reread the unit's data for every single one of them.
+ *
  * Caching metadata like this has two major benefits:
  *
  * 1. Reading metadata is expensive, and we can thus substantially speed up log processing under flood.
@@ -101,6 +111,86 @@ static int client_context_compare(const void *a, const void *b) {
         return CMP(x->pid, y->pid);
 }
 
+static const char* server_intern_consume(Server *s, char *t) {
+        const char *interned;
+
+        assert(s);
+
+        /* Takes possession of t, returns NULL if it cannot be interned */
+
+        if (!t)
+                return NULL;
+
+        if (string_pool_intern_consume(&s->strings, t, &interned) < 0)
+                return NULL;
+
+        return interned;
+}
+
+static int unit_context_new(Server *s, UnitContext **ret) {
+        UnitContext *u;
+
+        assert(s);
+        assert(ret);
+
+        u = new(UnitContext, 1);
+        if (!u)
+                return -ENOMEM;
+
+        *u = (UnitContext) {
+                .n_ref = 1,
+                .timestamp = USEC_INFINITY,
+                .owner_uid = UID_INVALID,
+                .extra_fields_mtime = NSEC_INFINITY,
+                .log_level_max = -1,
+                .log_ratelimit_interval = s->ratelimit_interval,
+                .log_ratelimit_burst = s->ratelimit_burst,
+        };
+
+        *ret = u;
+        return 0;
+}
+
+static UnitContext* unit_context_free(Server *s, UnitContext *u) {
+        assert(s);
+
+        if (!u)
+                return NULL;
+
+        if (u->cgroup)
+                assert_se(hashmap_remove(s->unit_contexts, u->cgroup) == u);
+
+        free(u->cgroup);
+        string_pool_release(s->strings, u->session);
+        string_pool_release(s->strings, u->unit);
+        string_pool_release(s->strings, u->user_unit);
+        string_pool_release(s->strings, u->slice);
+        string_pool_release(s->strings, u->user_slice);
+
+        free(u->extra_fields_iovec);
+        free(u->extra_fields_data);
+
+        journal_ratelimit_group_unref(u->ratelimit_group);
+
+        return mfree(u);
+}
+
+static UnitContext* unit_context_unref(Server *s, UnitContext *u) {
+        assert(s);
+
+        if (!u)
+                return NULL;
+
+        assert(u->n_ref > 0);
+
+        /* Unit contexts are only kept around as long as some client context refers to them, which in turn
+         * are kept around until there's cache pressure */
+        if (--u->n_ref == 0)
+                unit_context_free(s, u);
+
+        return NULL;
+}
+
 static int client_context_new(Server *s, pid_t pid, ClientContext **ret) {
         ClientContext *c;
         int r;
@@ -127,13 +217,8 @@ static int client_context_new(Server *s, pid_t pid, ClientContext **ret) {
                 .gid = GID_INVALID,
                 .auditid = AUDIT_SESSION_INVALID,
                 .loginuid = UID_INVALID,
-                .owner_uid = UID_INVALID,
                 .lru_index = PRIOQ_IDX_NULL,
                 .timestamp = USEC_INFINITY,
-                .extra_fields_mtime = NSEC_INFINITY,
-                .log_level_max = -1,
-                .log_ratelimit_interval = s->ratelimit_interval,
-                .log_ratelimit_burst = s->ratelimit_burst,
         };
 
         r = hashmap_put(s->client_contexts, PID_TO_PTR(pid), c);
@@ -155,36 +240,22 @@ static void client_context_reset(Server *s, ClientContext *c) {
         c->uid = UID_INVALID;
         c->gid = GID_INVALID;
 
-        c->comm = mfree(c->comm);
-        c->exe = mfree(c->exe);
+        c->comm = string_pool_release(s->strings, c->comm);
+        c->exe = string_pool_release(s->strings, c->exe);
+        c->capeff = string_pool_release(s->strings, c->capeff);
         c->cmdline = mfree(c->cmdline);
-        c->capeff = mfree(c->capeff);
 
         c->auditid = AUDIT_SESSION_INVALID;
         c->loginuid = UID_INVALID;
 
-        c->cgroup = mfree(c->cgroup);
-        c->session = mfree(c->session);
-        c->owner_uid = UID_INVALID;
-        c->unit = mfree(c->unit);
-        c->user_unit = mfree(c->user_unit);
-        c->slice = mfree(c->slice);
-        c->user_slice = mfree(c->user_slice);
-
-        c->invocation_id = SD_ID128_NULL;
+        c->unit_context = unit_context_unref(s, c->unit_context);
 
         c->label = mfree(c->label);
         c->label_size = 0;
 
-        c->extra_fields_iovec = mfree(c->extra_fields_iovec);
-        c->extra_fields_n_iovec = 0;
-        c->extra_fields_data = mfree(c->extra_fields_data);
-        c->extra_fields_mtime = NSEC_INFINITY;
-
-        c->log_level_max = -1;
-
-        c->log_ratelimit_interval = s->ratelimit_interval;
-        c->log_ratelimit_burst = s->ratelimit_burst;
+        c->fields_iovec = mfree(c->fields_iovec);
+        c->fields_hash = NULL;
+        c->fields_n_iovec = 0;
 }
 
 static ClientContext* client_context_free(Server *s, ClientContext *c) {
@@ -219,23 +290,38 @@ static void client_context_read_uid_gid(ClientContext *c, const struct ucred *uc
                 (void) get_process_gid(c->pid, &c->gid);
 }
 
-static void client_context_read_basic(ClientContext *c) {
+static void client_context_replace_interned(Server *s, const char **field, char *t) {
+        const char *interned;
+
+        assert(s);
+        assert(field);
+
+        interned = server_intern_consume(s, t);
+        if (!interned)
+                return;
+
+        string_pool_release(s->strings, *field);
+        *field = interned;
+}
+
+static void client_context_read_basic(Server *s, ClientContext *c) {
         char *t;
 
+        assert(s);
         assert(c);
         assert(pid_is_valid(c->pid));
 
         if (get_process_comm(c->pid, &t) >= 0)
-                free_and_replace(c->comm, t);
+                client_context_replace_interned(s, &c->comm, t);
 
         if (get_process_exe(c->pid, &t) >= 0)
-                free_and_replace(c->exe, t);
+                client_context_replace_interned(s, &c->exe, t);
 
         if (get_process_cmdline(c->pid, SIZE_MAX, 0, &t) >= 0)
                 free_and_replace(c->cmdline, t);
 
         if (get_process_capeff(c->pid, &t) >= 0)
-                free_and_replace(c->capeff, t);
+                client_context_replace_interned(s, &c->capeff, t);
 }
 
 static int client_context_read_label(
@@ -274,77 +360,29 @@ static int client_context_read_label(
         return 0;
 }
 
-static int client_context_read_cgroup(Server *s, ClientContext *c, const char *unit_id) {
-        _cleanup_free_ char *t = NULL;
-        int r;
-
-        assert(c);
-
-        /* Try to acquire the current cgroup path */
-        r = cg_pid_get_path_shifted(c->pid, s->cgroup_root, &t);
-        if (r < 0 || empty_or_root(t)) {
-                /* We use the unit ID passed in as fallback if we have nothing cached yet and cg_pid_get_path_shifted()
-                 * failed or process is running in a root cgroup. Zombie processes are automatically migrated to root cgroup
-                 * on cgroup v1 and we want to be able to map log messages from them too. */
-                if (unit_id && !c->unit) {
-                        c->unit = strdup(unit_id);
-                        if (c->unit)
-                                return 0;
-                }
-
-                return r;
-        }
-
-        /* Let's shortcut this if the cgroup path didn't change */
-        if (streq_ptr(c->cgroup, t))
-                return 0;
-
-        free_and_replace(c->cgroup, t);
-
-        (void) cg_path_get_session(c->cgroup, &t);
-        free_and_replace(c->session, t);
-
-        if (cg_path_get_owner_uid(c->cgroup, &c->owner_uid) < 0)
-                c->owner_uid = UID_INVALID;
-
-        (void) cg_path_get_unit(c->cgroup, &t);
-        free_and_replace(c->unit, t);
-
-        (void) cg_path_get_user_unit(c->cgroup, &t);
-        free_and_replace(c->user_unit, t);
-
-        (void) cg_path_get_slice(c->cgroup, &t);
-        free_and_replace(c->slice, t);
-
-        (void) cg_path_get_user_slice(c->cgroup, &t);
-        free_and_replace(c->user_slice, t);
-
-        return 0;
-}
-
-static int client_context_read_invocation_id(
+static int unit_context_read_invocation_id(
                 Server *s,
-                ClientContext *c) {
+                UnitContext *u) {
 
         _cleanup_free_ char *p = NULL, *value = NULL;
         int r;
 
         assert(s);
-        assert(c);
+        assert(u);
 
         /* Read the invocation ID of a unit off a unit.
          * PID 1 stores it in a per-unit symlink in /run/systemd/units/
          * User managers store it in a per-unit symlink under /run/user/<uid>/systemd/units/ */
 
-        if (!c->unit)
+        if (!u->unit)
                 return 0;
 
-        if (c->user_unit) {
-                r = asprintf(&p, "/run/user/" UID_FMT "/systemd/units/invocation:%s", c->owner_uid, c->user_unit);
+        if (u->user_unit) {
+                r = asprintf(&p, "/run/user/" UID_FMT "/systemd/units/invocation:%s", u->owner_uid, u->user_unit);
                 if (r < 0)
                         return r;
         } else {
-                p = strjoin("/run/systemd/units/invocation:", c->unit);
+                p = strjoin("/run/systemd/units/invocation:", u->unit);
                 if (!p)
                         return -ENOMEM;
         }
@@ -353,21 +391,21 @@ static int client_context_read_invocation_id(
         if (r < 0)
                 return r;
 
-        return sd_id128_from_string(value, &c->invocation_id);
+        return sd_id128_from_string(value, &u->invocation_id);
 }
 
-static int client_context_read_log_level_max(
+static int unit_context_read_log_level_max(
                 Server *s,
-                ClientContext *c) {
+                UnitContext *u) {
 
         _cleanup_free_ char *value = NULL;
         const char *p;
         int r, ll;
 
-        if (!c->unit)
+        if (!u->unit)
                 return 0;
 
-        p = strjoina("/run/systemd/units/log-level-max:", c->unit);
+        p = strjoina("/run/systemd/units/log-level-max:", u->unit);
         r = readlink_malloc(p, &value);
         if (r < 0)
                 return r;
@@ -376,13 +414,13 @@ static int client_context_read_log_level_max(
         if (ll < 0)
                 return -EINVAL;
 
-        c->log_level_max = ll;
+        u->log_level_max = ll;
         return 0;
 }
 
-static int client_context_read_extra_fields(
+static int unit_context_read_extra_fields(
                 Server *s,
-                ClientContext *c) {
+                UnitContext *u) {
 
         size_t size = 0, n_iovec = 0, n_allocated = 0, left;
         _cleanup_free_ struct iovec *iovec = NULL;
@@ -393,12 +431,12 @@ static int client_context_read_extra_fields(
         uint8_t *q;
         int r;
 
-        if (!c->unit)
+        if (!u->unit)
                 return 0;
 
-        p = strjoina("/run/systemd/units/log-extra-fields:", c->unit);
+        p = strjoina("/run/systemd/units/log-extra-fields:", u->unit);
 
-        if (c->extra_fields_mtime != NSEC_INFINITY) {
+        if (u->extra_fields_mtime != NSEC_INFINITY) {
                 if (stat(p, &st) < 0) {
                         if (errno == ENOENT)
                                 return 0;
@@ -406,7 +444,7 @@ static int client_context_read_extra_fields(
                         return -errno;
                 }
 
-                if (timespec_load_nsec(&st.st_mtim) == c->extra_fields_mtime)
+                if (timespec_load_nsec(&st.st_mtim) == u->extra_fields_mtime)
                         return 0;
         }
 
@@ -459,51 +497,266 @@ static int client_context_read_extra_fields(
                 left -= n, q += n;
         }
 
-        free(c->extra_fields_iovec);
-        free(c->extra_fields_data);
+        free(u->extra_fields_iovec);
+        free(u->extra_fields_data);
 
-        c->extra_fields_iovec = TAKE_PTR(iovec);
-        c->extra_fields_n_iovec = n_iovec;
-        c->extra_fields_data = TAKE_PTR(data);
-        c->extra_fields_mtime = timespec_load_nsec(&st.st_mtim);
+        u->extra_fields_iovec = TAKE_PTR(iovec);
+        u->extra_fields_n_iovec = n_iovec;
+        u->extra_fields_data = TAKE_PTR(data);
+        u->extra_fields_mtime = timespec_load_nsec(&st.st_mtim);
 
         return 0;
 }
 
-static int client_context_read_log_ratelimit_interval(ClientContext *c) {
+static int unit_context_read_log_ratelimit_interval(UnitContext *u) {
         _cleanup_free_ char *value = NULL;
         const char *p;
         int r;
 
-        assert(c);
+        assert(u);
 
-        if (!c->unit)
+        if (!u->unit)
                 return 0;
 
-        p = strjoina("/run/systemd/units/log-rate-limit-interval:", c->unit);
+        p = strjoina("/run/systemd/units/log-rate-limit-interval:", u->unit);
         r = readlink_malloc(p, &value);
         if (r < 0)
                 return r;
 
-        return safe_atou64(value, &c->log_ratelimit_interval);
+        return safe_atou64(value, &u->log_ratelimit_interval);
 }
 
-static int client_context_read_log_ratelimit_burst(ClientContext *c) {
+static int unit_context_read_log_ratelimit_burst(UnitContext *u) {
         _cleanup_free_ char *value = NULL;
         const char *p;
         int r;
 
-        assert(c);
+        assert(u);
 
-        if (!c->unit)
+        if (!u->unit)
                 return 0;
 
-        p = strjoina("/run/systemd/units/log-rate-limit-burst:", c->unit);
+        p = strjoina("/run/systemd/units/log-rate-limit-burst:", u->unit);
         r = readlink_malloc(p, &value);
         if (r < 0)
                 return r;
 
-        return safe_atou(value, &c->log_ratelimit_burst);
+        return safe_atou(value, &u->log_ratelimit_burst);
+}
+
+static void unit_context_parse_cgroup(Server *s, UnitContext *u) {
+        char *t;
+
+        assert(s);
+        assert(u);
+        assert(u->cgroup);
+
+        /* All of these are derived from the cgroup path only, hence never change for a unit context */
+
+        if (cg_path_get_session(u->cgroup, &t) >= 0)
+                u->session = server_intern_consume(s, t);
+
+        if (cg_path_get_owner_uid(u->cgroup, &u->owner_uid) < 0)
+                u->owner_uid = UID_INVALID;
+
+        if (cg_path_get_unit(u->cgroup, &t) >= 0)
+                u->unit = server_intern_consume(s, t);
+        if (cg_path_get_user_unit(u->cgroup, &t) >= 0)
+                u->user_unit = server_intern_consume(s, t);
+        if (cg_path_get_slice(u->cgroup, &t) >= 0)
+                u->slice = server_intern_consume(s, t);
+        if (cg_path_get_user_slice(u->cgroup, &t) >= 0)
+                u->user_slice = server_intern_consume(s, t);
+}
+
+static void unit_context_maybe_refresh(Server *s, UnitContext *u, bool new_client, usec_t timestamp) {
+        assert(s);
+        assert(u);
+
+        /* The unit context is shared by all processes of the unit, hence this is done at most once per
+         * REFRESH_USEC, no matter how many processes are logging. A process we didn't know yet might have
+         * been started by a new invocation of the unit though, whose settings may differ. Hence check for
+         * that, and refresh right away if so. */
+        if (u->timestamp != USEC_INFINITY && u->timestamp + REFRESH_USEC >= timestamp) {
+                sd_id128_t old = u->invocation_id;
+
+                if (!new_client)
+                        return;
+
+                (void) unit_context_read_invocation_id(s, u);
+                if (sd_id128_equal(old, u->invocation_id))
+                        return;
+        }
+
+        (void) unit_context_read_invocation_id(s, u);
+        (void) unit_context_read_log_level_max(s, u);
+        (void) unit_context_read_extra_fields(s, u);
+        (void) unit_context_read_log_ratelimit_interval(u);
+        (void) unit_context_read_log_ratelimit_burst(u);
+
+        u->timestamp = timestamp;
+}
+
+static int client_context_read_cgroup(Server *s, ClientContext *c, const char *unit_id) {
+        _cleanup_free_ char *t = NULL;
+        UnitContext *u;
+        int r;
+
+        assert(s);
+        assert(c);
+
+        /* Try to acquire the current cgroup path */
+        r = cg_pid_get_path_shifted(c->pid, s->cgroup_root, &t);
+        if (r < 0 || empty_or_root(t)) {
+                /* We use the unit ID passed in as fallback if we have nothing cached yet and cg_pid_get_path_shifted()
+                 * failed or process is running in a root cgroup. Zombie processes are automatically migrated to root cgroup
+                 * on cgroup v1 and we want to be able to map log messages from them too. Such a unit context
+                 * is private to the client context. */
+                if (unit_id && !c->unit_context && unit_context_new(s, &u) >= 0) {
+                        if (string_pool_intern(&s->strings, unit_id, &u->unit) >= 0) {
+                                c->unit_context = u;
+                                return 0;
+                        }
+
+                        unit_context_free(s, u);
+                }
+
+                return r;
+        }
+
+        /* Let's shortcut this if the cgroup path didn't change */
+        if (c->unit_context && streq_ptr(c->unit_context->cgroup, t))
+                return 0;
+
+        u = hashmap_get(s->unit_contexts, t);
+        if (u)
+                u->n_ref++;
+        else {
+                r = hashmap_ensure_allocated(&s->unit_contexts, &string_hash_ops);
+                if (r < 0)
+                        return r;
+
+                r = unit_context_new(s, &u);
+                if (r < 0)
+                        return r;
+
+                r = hashmap_put(s->unit_contexts, t, u);
+                if (r < 0) {
+                        unit_context_free(s, u);
+                        return r;
+                }
+
+                u->cgroup = TAKE_PTR(t);
+                unit_context_parse_cgroup(s, u);
+        }
+
+        unit_context_unref(s, c->unit_context);
+        c->unit_context = u;
+
+        return 0;
+}
+
+typedef struct ContextField {
+        const char *name;
+        const char *value;
+        size_t size;
+} ContextField;
+
+static void context_field_add(ContextField *fields, size_t *n, const char *name, const char *value, size_t size) {
+        assert(fields);
+        assert(n);
+        assert(name);
+
+        if (size == 0)
+                return;
+
+        assert(*n < N_CLIENT_CONTEXT_FIELDS);
+        fields[(*n)++] = (ContextField) {
+                .name = name,
+                .value = value,
+                .size = size,
+        };
+}
+
+static int client_context_render_fields(ClientContext *c) {
+        char pid[DECIMAL_STR_MAX(pid_t)], uid[DECIMAL_STR_MAX(uid_t)], gid[DECIMAL_STR_MAX(gid_t)],
+                auditid[DECIMAL_STR_MAX(uint32_t)], loginuid[DECIMAL_STR_MAX(uid_t)],
+                owner_uid[DECIMAL_STR_MAX(uid_t)], invocation_id[SD_ID128_STRING_MAX];
+        ContextField fields[N_CLIENT_CONTEXT_FIELDS];
+        size_t n = 0, size = 0, i;
+        struct iovec *iovec;
+        uint64_t *hash;
+        char *p;
+
+        assert(c);
+
+        /* The trusted fields are the same for every message of a client, hence let's format them and
+         * calculate their hashes only once here, instead of for every message. */
+
+#define ADD_NUMERIC(buf, value, isset, format, name)                    \
+        if (isset(value)) {                                             \
+                xsprintf(buf, format, value);                           \
+                context_field_add(fields, &n, name, buf, strlen(buf));  \
+        }
+#define ADD_STRING(value, name)                                         \
+        context_field_add(fields, &n, name, value, strlen_ptr(value))
+
+        ADD_NUMERIC(pid, c->pid, pid_is_valid, PID_FMT, "_PID=");
+        ADD_NUMERIC(uid, c->uid, uid_is_valid, UID_FMT, "_UID=");
+        ADD_NUMERIC(gid, c->gid, gid_is_valid, GID_FMT, "_GID=");
+
+        ADD_STRING(c->comm, "_COMM=");
+        ADD_STRING(c->exe, "_EXE=");
+        ADD_STRING(c->cmdline, "_CMDLINE=");
+        ADD_STRING(c->capeff, "_CAP_EFFECTIVE=");
+        context_field_add(fields, &n, "_SELINUX_CONTEXT=", c->label, c->label_size);
+        ADD_NUMERIC(auditid, c->auditid, audit_session_is_valid, "%" PRIu32, "_AUDIT_SESSION=");
+        ADD_NUMERIC(loginuid, c->loginuid, uid_is_valid, UID_FMT, "_AUDIT_LOGINUID=");
+
+        if (c->unit_context) {
+                const UnitContext *u = c->unit_context;
+
+                ADD_STRING(u->cgroup, "_SYSTEMD_CGROUP=");
+                ADD_STRING(u->session, "_SYSTEMD_SESSION=");
+                ADD_NUMERIC(owner_uid, u->owner_uid, uid_is_valid, UID_FMT, "_SYSTEMD_OWNER_UID=");
+                ADD_STRING(u->unit, "_SYSTEMD_UNIT=");
+                ADD_STRING(u->user_unit, "_SYSTEMD_USER_UNIT=");
+                ADD_STRING(u->slice, "_SYSTEMD_SLICE=");
+                ADD_STRING(u->user_slice, "_SYSTEMD_USER_SLICE=");
+
+                if (!sd_id128_is_null(u->invocation_id))
+                        context_field_add(fields, &n, "_SYSTEMD_INVOCATION_ID=",
+                                          sd_id128_to_string(u->invocation_id, invocation_id), SD_ID128_STRING_MAX - 1);
+        }
+
+#undef ADD_NUMERIC
+#undef ADD_STRING
+
+        for (i = 0; i < n; i++)
+                size += strlen(fields[i].name) + fields[i].size + 1;
+
+        iovec = malloc(n * (sizeof(struct iovec) + sizeof(uint64_t)) + size);
+        if (!iovec)
+                return -ENOMEM;
+
+        hash = (uint64_t*) (iovec + n);
+        p = (char*) (hash + n);
+
+        for (i = 0; i < n; i++) {
+                char *k = p;
+
+                p = mempcpy(stpcpy(p, fields[i].name), fields[i].value, fields[i].size);
+                *(p++) = 0;
+
+                iovec[i] = IOVEC_MAKE(k, p - k - 1);
+                hash[i] = hash64(iovec[i].iov_base, iovec[i].iov_len);
+        }
+
+        free_and_replace(c->fields_iovec, iovec);
+        c->fields_hash = hash;
+        c->fields_n_iovec = n;
+
+        return 0;
 }
 
 static void client_context_really_refresh(
@@ -514,6 +767,8 @@ static void client_context_really_refresh(
                 const char *unit_id,
                 usec_t timestamp) {
 
+        bool new_client;
+
         assert(s);
         assert(c);
         assert(pid_is_valid(c->pid));
@@ -521,21 +776,24 @@ static void client_context_really_refresh(
         if (timestamp == USEC_INFINITY)
                 timestamp = now(CLOCK_MONOTONIC);
 
+        new_client = c->timestamp == USEC_INFINITY;
+
         client_context_read_uid_gid(c, ucred);
-        client_context_read_basic(c);
+        client_context_read_basic(s, c);
         (void) client_context_read_label(c, label, label_size);
 
         (void) audit_session_from_pid(c->pid, &c->auditid);
         (void) audit_loginuid_from_pid(c->pid, &c->loginuid);
 
         (void) client_context_read_cgroup(s, c, unit_id);
-        (void) client_context_read_invocation_id(s, c);
-        (void) client_context_read_log_level_max(s, c);
-        (void) client_context_read_extra_fields(s, c);
-        (void) client_context_read_log_ratelimit_interval(c);
-        (void) client_context_read_log_ratelimit_burst(c);
+        if (c->unit_context)
+                unit_context_maybe_refresh(s, c->unit_context, new_client, timestamp);
 
-        c->timestamp = timestamp;
+        /* If this fails we keep the old timestamp, so that we'll try again with the next message */
+        if (client_context_render_fields(c) < 0)
+                log_oom();
+        else
+                c->timestamp = timestamp;
 
         if (c->in_lru) {
                 assert(c->n_ref == 0);
@@ -647,9 +905,14 @@ void client_context_flush_all(Server *s) {
 
         assert(prioq_size(s->client_contexts_lru) == 0);
         assert(hashmap_size(s->client_contexts) == 0);
+        assert(hashmap_size(s->unit_contexts) == 0);
 
         s->client_contexts_lru = prioq_free(s->client_contexts_lru);
         s->client_contexts = hashmap_free(s->client_contexts);
+        s->unit_contexts = hashmap_free(s->unit_contexts);
+
+        assert(string_pool_size(s->strings) == 0);
+        s->strings = string_pool_free(s->strings);
 }
 
 static int client_context_get_internal(
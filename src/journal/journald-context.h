@@ -7,12 +7,45 @@
 
 #include "sd-id128.h"
 
+#include "journald-rate-limit.h"
 #include "time-util.h"
 
 typedef struct ClientContext ClientContext;
+typedef struct UnitContext UnitContext;
 
 #include "journald-server.h"
 
+/* The metadata that is the same for all processes in a cgroup, shared between their ClientContext objects */
+struct UnitContext {
+        unsigned n_ref;
+        usec_t timestamp;
+
+        char *cgroup; /* NULL if the unit name was only passed in by the client */
+        uid_t owner_uid;
+
+        /* Interned in Server.strings, many cgroups share their slice, unit or session */
+        const char *session;
+
+        const char *unit;
+        const char *user_unit;
+
+        const char *slice;
+        const char *user_slice;
+
+        sd_id128_t invocation_id;
+
+        int log_level_max;
+
+        struct iovec *extra_fields_iovec;
+        size_t extra_fields_n_iovec;
+        void *extra_fields_data;
+        nsec_t extra_fields_mtime;
+
+        usec_t log_ratelimit_interval;
+        unsigned log_ratelimit_burst;
+        JournalRateLimitGroup *ratelimit_group; /* cached by journal_ratelimit_test() */
+};
+
 struct ClientContext {
         unsigned n_ref;
         unsigned lru_index;
@@ -23,38 +56,27 @@ struct ClientContext {
         uid_t uid;
         gid_t gid;
 
-        char *comm;
-        char *exe;
+        /* Interned in Server.strings, as they are the same for most processes of a binary */
+        const char *comm;
+        const char *exe;
+        const char *capeff;
+
         char *cmdline;
-        char *capeff;
 
         uint32_t auditid;
         uid_t loginuid;
 
-        char *cgroup;
-        char *session;
-        uid_t owner_uid;
-
-        char *unit;
-        char *user_unit;
-
-        char *slice;
-        char *user_slice;
-
-        sd_id128_t invocation_id;
+        UnitContext *unit_context;
 
         char *label;
         size_t label_size;
 
-        int log_level_max;
-
-        struct iovec *extra_fields_iovec;
-        size_t extra_fields_n_iovec;
-        void *extra_fields_data;
-        nsec_t extra_fields_mtime;
-
-        usec_t log_ratelimit_interval;
-        unsigned log_ratelimit_burst;
+        /* The fields above and those of the unit context, rendered once for all log messages from this
+         * client, together with their hash64() values. Both arrays and the field data are in one allocation
+         * owned by fields_iovec. */
+        struct iovec *fields_iovec;
+        uint64_t *fields_hash;
+        size_t fields_n_iovec;
 };
 
 int client_context_get(
@@ -86,16 +108,19 @@ void client_context_maybe_refresh(
 void client_context_acquire_default(Server *s);
 void client_context_flush_all(Server *s);
 
+/* The maximum number of fields in ClientContext.fields_iovec */
+#define N_CLIENT_CONTEXT_FIELDS 18
+
 static inline size_t client_context_extra_fields_n_iovec(const ClientContext *c) {
-        return c ? c->extra_fields_n_iovec : 0;
+        return c && c->unit_context ? c->unit_context->extra_fields_n_iovec : 0;
 }
 
 static inline bool client_context_test_priority(const ClientContext *c, int priority) {
-        if (!c)
+        if (!c || !c->unit_context)
                 return true;
 
-        if (c->log_level_max < 0)
+        if (c->unit_context->log_level_max < 0)
                 return true;
 
-        return LOG_PRI(priority) <= c->log_level_max;
+        return LOG_PRI(priority) <= c->unit_context->log_level_max;
 }
@@ -14,6 +14,7 @@
 #include "escape.h"
 #include "fd-util.h"
 #include "format-util.h"
+#include "hashmap.h"
 #include "io-util.h"
 #include "journald-kmsg.h"
 #include "journald-server.h"
@@ -22,6 +23,125 @@
 #include "process-util.h"
 #include "stdio-util.h"
 #include "string-util.h"
+#include "strv.h"
+
+/* Upper limit on records we read from /dev/kmsg per wakeup, so that a flood of kernel messages doesn't starve the
+ * other sources */
+#define KMSG_RECORDS_PER_WAKEUP_MAX 256U
+
+/* How many devices we remember, and for how long. The latter matters as device ids may be reused. */
+#define KMSG_DEVICES_MAX 256U
+#define KMSG_DEVICE_CACHE_USEC (5 * USEC_PER_SEC)
+
+typedef struct KmsgDevice {
+        char *id;
+        usec_t timestamp;
+        char **fields;
+} KmsgDevice;
+
+static KmsgDevice* kmsg_device_free(KmsgDevice *d) {
+        if (!d)
+                return NULL;
+
+        free(d->id);
+        strv_free(d->fields);
+        return mfree(d);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(KmsgDevice*, kmsg_device_free);
+
+DEFINE_PRIVATE_HASH_OPS_WITH_VALUE_DESTRUCTOR(kmsg_device_hash_ops, char, string_hash_func, string_compare_func,
+                                              KmsgDevice, kmsg_device_free);
+
+static int kmsg_device_build_fields(const char *id, char ***ret) {
+        _cleanup_(sd_device_unrefp) sd_device *d = NULL;
+        _cleanup_strv_free_ char **l = NULL;
+        const char *g;
+        size_t j = 0;
+
+        assert(id);
+        assert(ret);
+
+        /* A device we can't find results in no fields, which we want to remember, too */
+        l = strv_new(NULL);
+        if (!l)
+                return -ENOMEM;
+
+        if (sd_device_new_from_device_id(&d, id) < 0) {
+                *ret = TAKE_PTR(l);
+                return 0;
+        }
+
+        if (sd_device_get_devname(d, &g) >= 0)
+                if (strv_consume(&l, strjoin("_UDEV_DEVNODE=", g)) < 0)
+                        return -ENOMEM;
+
+        if (sd_device_get_sysname(d, &g) >= 0)
+                if (strv_consume(&l, strjoin("_UDEV_SYSNAME=", g)) < 0)
+                        return -ENOMEM;
+
+        FOREACH_DEVICE_DEVLINK(d, g) {
+
+                if (j >= N_IOVEC_UDEV_FIELDS)
+                        break;
+
+                if (strv_consume(&l, strjoin("_UDEV_DEVLINK=", g)) < 0)
+                        return -ENOMEM;
+
+                j++;
+        }
+
+        *ret = TAKE_PTR(l);
+        return 0;
+}
+
+static char **kmsg_device_fields(Server *s, const char *id) {
+        _cleanup_(kmsg_device_freep) KmsgDevice *d = NULL;
+        KmsgDevice *cached;
+        usec_t n;
+        int r;
+
+        assert(s);
+        assert(id);
+
+        /* Returns the udev fields for the device, owned by the cache, or NULL on failure */
+
+        n = now(CLOCK_MONOTONIC);
+
+        cached = hashmap_get(s->kmsg_devices, id);
+        if (cached) {
+                if (usec_add(cached->timestamp, KMSG_DEVICE_CACHE_USEC) > n)
+                        return cached->fields;
+
+                kmsg_device_free(hashmap_remove(s->kmsg_devices, id));
+        }
+
+        if (hashmap_size(s->kmsg_devices) >= KMSG_DEVICES_MAX)
+                hashmap_clear(s->kmsg_devices);
+
+        d = new(KmsgDevice, 1);
+        if (!d)
+                return NULL;
+
+        *d = (KmsgDevice) {
+                .id = strdup(id),
+                .timestamp = n,
+        };
+        if (!d->id)
+                return NULL;
+
+        r = kmsg_device_build_fields(id, &d->fields);
+        if (r < 0)
+                return NULL;
+
+        if (hashmap_ensure_allocated(&s->kmsg_devices, &kmsg_device_hash_ops) < 0)
+                return NULL;
+
+        if (hashmap_put(s->kmsg_devices, d->id, d) < 0)
+                return NULL;
+
+        return TAKE_PTR(d)->fields;
+}
 
 void server_forward_kmsg(
                 Server *s,
@@ -210,43 +330,12 @@ void dev_kmsg_record(Server *s, char *p, size_t l) {
         }
 
         if (kernel_device) {
-                _cleanup_(sd_device_unrefp) sd_device *d = NULL;
-
-                if (sd_device_new_from_device_id(&d, kernel_device) >= 0) {
-                        const char *g;
-                        char *b;
-
-                        if (sd_device_get_devname(d, &g) >= 0) {
-                                b = strjoin("_UDEV_DEVNODE=", g);
-                                if (b) {
-                                        iovec[n++] = IOVEC_MAKE_STRING(b);
-                                        z++;
-                                }
-                        }
-
-                        if (sd_device_get_sysname(d, &g) >= 0) {
-                                b = strjoin("_UDEV_SYSNAME=", g);
-                                if (b) {
-                                        iovec[n++] = IOVEC_MAKE_STRING(b);
-                                        z++;
-                                }
-                        }
-
-                        j = 0;
-                        FOREACH_DEVICE_DEVLINK(d, g) {
-
-                                if (j >= N_IOVEC_UDEV_FIELDS)
-                                        break;
-
-                                b = strjoin("_UDEV_DEVLINK=", g);
-                                if (b) {
-                                        iovec[n++] = IOVEC_MAKE_STRING(b);
-                                        z++;
-                                }
-
-                                j++;
-                        }
-                }
+                char **fields, **g;
+
+                /* These are owned by the cache, hence not counted in z */
+                fields = kmsg_device_fields(s, kernel_device);
+                STRV_FOREACH(g, fields)
+                        iovec[n++] = IOVEC_MAKE_STRING(*g);
         }
 
         if (asprintf(&source_time, "_SOURCE_MONOTONIC_TIMESTAMP=%llu", usec) >= 0)
@@ -335,20 +424,21 @@ int server_flush_dev_kmsg(Server *s) {
 
         log_debug("Flushing /dev/kmsg...");
 
+        server_begin_write_batch(s);
         for (;;) {
                 r = server_read_dev_kmsg(s);
-                if (r < 0)
-                        return r;
-
-                if (r == 0)
+                if (r <= 0)
                         break;
         }
+        server_end_write_batch(s);
 
-        return 0;
+        return r < 0 ? r : 0;
 }
 
 static int dispatch_dev_kmsg(sd_event_source *es, int fd, uint32_t revents, void *userdata) {
         Server *s = userdata;
+        unsigned i;
+        int r = 0;
 
         assert(es);
         assert(fd == s->dev_kmsg_fd);
@@ -360,7 +450,16 @@ static int dispatch_dev_kmsg(sd_event_source *es, int fd, uint32_t revents, void
         if (!(revents & EPOLLIN))
                 log_error("Got invalid event from epoll for /dev/kmsg: %"PRIx32, revents);
 
-        return server_read_dev_kmsg(s);
+        /* Drain a number of records per wakeup, and write them out in one go */
+        server_begin_write_batch(s);
+        for (i = 0; i < KMSG_RECORDS_PER_WAKEUP_MAX; i++) {
+                r = server_read_dev_kmsg(s);
+                if (r <= 0)
+                        break;
+        }
+        server_end_write_batch(s);
+
+        return r < 0 ? r : 0;
 }
 
 int server_open_dev_kmsg(Server *s) {
@@ -26,7 +26,6 @@ static const int priority_map[] = {
 };
 
 typedef struct JournalRateLimitPool JournalRateLimitPool;
-typedef struct JournalRateLimitGroup JournalRateLimitGroup;
 
 struct JournalRateLimitPool {
         usec_t begin;
@@ -35,7 +34,10 @@ struct JournalRateLimitPool {
 };
 
 struct JournalRateLimitGroup {
-        JournalRateLimit *parent;
+        JournalRateLimit *parent; /* NULL once dropped from the rate limiter */
+
+        /* References held by callers that cache the group, see journal_ratelimit_test() */
+        unsigned n_ref;
 
         char *id;
 
@@ -57,6 +59,10 @@ struct JournalRateLimit {
         unsigned n_groups;
 
         uint8_t hash_key[16];
+
+        /* The available disk space the burst is modulated with, and the resulting factor in quarters */
+        uint64_t available;
+        unsigned burst_factor;
 };
 
 JournalRateLimit *journal_ratelimit_new(void) {
@@ -67,6 +73,7 @@ JournalRateLimit *journal_ratelimit_new(void) {
                 return NULL;
 
         random_bytes(r->hash_key, sizeof(r->hash_key));
+        r->burst_factor = 4;
 
         return r;
 }
@@ -84,12 +91,31 @@ static void journal_ratelimit_group_free(JournalRateLimitGroup *g) {
                 LIST_REMOVE(bucket, g->parent->buckets[g->hash % BUCKETS_MAX], g);
 
                 g->parent->n_groups--;
+                g->parent = NULL;
         }
 
+        /* Somebody still has it cached, they'll notice it's gone the next time they use it */
+        if (g->n_ref > 0)
+                return;
+
         free(g->id);
         free(g);
 }
 
+JournalRateLimitGroup* journal_ratelimit_group_unref(JournalRateLimitGroup *g) {
+        if (!g)
+                return NULL;
+
+        assert(g->n_ref > 0);
+
+        if (--g->n_ref == 0 && !g->parent) {
+                free(g->id);
+                free(g);
+        }
+
+        return NULL;
+}
+
 void journal_ratelimit_free(JournalRateLimit *r) {
         assert(r);
 
@@ -156,19 +182,17 @@ fail:
         return NULL;
 }
 
-static unsigned burst_modulate(unsigned burst, uint64_t available) {
+static unsigned burst_factor(uint64_t available) {
         unsigned k;
 
         /* Modulates the burst rate a bit with the amount of available
-         * disk space */
+         * disk space. Returns the factor in quarters. */
 
         k = u64log2(available);
 
         /* 1MB */
         if (k <= 20)
-                return burst;
-
-        burst = (burst * (k-16)) / 4;
+                return 4;
 
         /*
          * Example:
@@ -181,10 +205,18 @@ static unsigned burst_modulate(unsigned burst, uint64_t available) {
          *         1TB = rate * 6
          */
 
-        return burst;
+        return k - 16;
 }
 
-int journal_ratelimit_test(JournalRateLimit *r, const char *id, usec_t rl_interval, unsigned rl_burst, int priority, uint64_t available) {
+int journal_ratelimit_test(
+                JournalRateLimit *r,
+                JournalRateLimitGroup **group,
+                const char *id,
+                usec_t rl_interval,
+                unsigned rl_burst,
+                int priority,
+                uint64_t available) {
+
         uint64_t h;
         JournalRateLimitGroup *g;
         JournalRateLimitPool *p;
@@ -198,6 +230,10 @@ int journal_ratelimit_test(JournalRateLimit *r, const char *id, usec_t rl_interv
          * 0     → the log message shall be suppressed,
          * 1 + n → the log message shall be permitted, and n messages were dropped from the peer before
          * < 0   → error
+         *
+         * If group is non-NULL, it caches the group for id between calls, so that it doesn't have to be
+         * looked up each time. The caller has to release it with journal_ratelimit_group_unref(), and has to
+         * always pass the same id with it.
          */
 
         if (!r)
@@ -205,24 +241,42 @@ int journal_ratelimit_test(JournalRateLimit *r, const char *id, usec_t rl_interv
 
         ts = now(CLOCK_MONOTONIC);
 
-        h = siphash24_string(id, r->hash_key);
-        g = r->buckets[h % BUCKETS_MAX];
+        g = group ? *group : NULL;
+        if (!g || g->parent != r) {
+                if (group)
+                        *group = journal_ratelimit_group_unref(*group);
+
+                h = siphash24_string(id, r->hash_key);
+                g = r->buckets[h % BUCKETS_MAX];
 
-        LIST_FOREACH(bucket, g, g)
-                if (streq(g->id, id))
-                        break;
+                LIST_FOREACH(bucket, g, g)
+                        if (streq(g->id, id))
+                                break;
 
-        if (!g) {
-                g = journal_ratelimit_group_new(r, id, rl_interval, ts);
-                if (!g)
-                        return -ENOMEM;
-        } else
-                g->interval = rl_interval;
+                if (!g) {
+                        g = journal_ratelimit_group_new(r, id, rl_interval, ts);
+                        if (!g)
+                                return -ENOMEM;
+                }
+
+                if (group) {
+                        g->n_ref++;
+                        *group = g;
+                }
+        }
+
+        g->interval = rl_interval;
 
         if (rl_interval == 0 || rl_burst == 0)
                 return 1;
 
-        burst = burst_modulate(rl_burst, available);
+        /* The available space only changes when the server refreshes its cached value */
+        if (available != r->available) {
+                r->available = available;
+                r->burst_factor = burst_factor(available);
+        }
+
+        burst = (rl_burst * r->burst_factor) / 4;
 
         p = &g->pools[priority_map[priority]];
 
@@ -4,7 +4,9 @@
 #include "time-util.h"
 
 typedef struct JournalRateLimit JournalRateLimit;
+typedef struct JournalRateLimitGroup JournalRateLimitGroup;
 
 JournalRateLimit *journal_ratelimit_new(void);
 void journal_ratelimit_free(JournalRateLimit *r);
-int journal_ratelimit_test(JournalRateLimit *r, const char *id, usec_t rl_interval, unsigned rl_burst, int priority, uint64_t available);
+JournalRateLimitGroup* journal_ratelimit_group_unref(JournalRateLimitGroup *g);
+int journal_ratelimit_test(JournalRateLimit *r, JournalRateLimitGroup **group, const char *id, usec_t rl_interval, unsigned rl_burst, int priority, uint64_t available);
@@ -0,0 +1,391 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "fd-util.h"
+#include "journal-ring.h"
+#include "journald-native.h"
+#include "journald-ring.h"
+#include "journald-server.h"
+#include "missing_fcntl.h"
+#include "process-util.h"
+
+/* Make sure clients can't pin arbitrary amounts of our address space */
+#define NATIVE_RINGS_MAX 256U
+
+/* How many records to process per wakeup, before we write them out and return to the event loop */
+#define RECORDS_PER_WAKEUP_MAX 256U
+
+struct NativeRing {
+        Server *server;
+
+        int fd;
+        sd_event_source *event_source;
+        sd_event_source *defer_event_source;
+
+        JournalRingHeader *header;
+        uint8_t *data;
+        size_t data_size;
+
+        /* Our own copy of the read position, the one in the shared header is for the client's benefit only */
+        uint64_t tail;
+
+        struct ucred ucred;
+        char *label;
+        size_t label_len;
+
+        /* Set once we found garbage in the ring, we don't look at it anymore then */
+        bool broken;
+
+        char *buffer;
+        size_t buffer_allocated;
+
+        LIST_FIELDS(NativeRing, native_ring);
+};
+
+static int native_ring_process(NativeRing *r, unsigned max) {
+        bool armed = false;
+        uint64_t tail;
+        unsigned n = 0;
+        int k = 0;
+
+        assert(r);
+        assert(r->header);
+        assert(max > 0);
+
+        /* Processes up to max records. Returns > 0 if there might be more, 0 if the ring ran dry, in which case
+         * the client will wake us up when it writes the next record. */
+
+        if (r->broken)
+                return -EBADMSG;
+
+        tail = r->tail;
+
+        while (n < max) {
+                const uint8_t *p;
+                size_t size, total;
+
+                k = journal_ring_read(r->data, r->data_size, tail, tail - r->tail, &p, &size, &total);
+                if (k < 0)
+                        break;
+                if (k == 0) {
+                        if (armed)
+                                break;
+
+                        /* Ask for a wakeup, then look again, in case the client wrote something before it
+                         * could see that */
+                        r->header->need_wakeup = 1;
+                        __sync_synchronize();
+                        armed = true;
+                        continue;
+                }
+
+                if (p) {
+                        /* The client may change the message under our feet, hence copy it before looking at
+                         * it. Otherwise it could sneak in trusted fields after we validated them. */
+                        if (!GREEDY_REALLOC(r->buffer, r->buffer_allocated, size + 1)) {
+                                k = log_oom();
+                                break;
+                        }
+
+                        memcpy(r->buffer, p, size);
+                        r->buffer[size] = 0;
+
+                        server_process_native_message(r->server, r->buffer, size, &r->ucred, NULL, r->label, r->label_len);
+                }
+
+                tail += total;
+                n++;
+        }
+
+        journal_ring_release(r->header, r->data, r->data_size, r->tail, tail);
+        r->tail = tail;
+
+        if (k == -EBADMSG) {
+                r->broken = true;
+                return log_warning_errno(k, "Journal ring of PID " PID_FMT " contains garbage, dropping it.", r->ucred.pid);
+        }
+
+        return k;
+}
+
+static int native_ring_dispatch(NativeRing *r) {
+        int k;
+
+        assert(r);
+
+        server_begin_write_batch(r->server);
+        k = native_ring_process(r, RECORDS_PER_WAKEUP_MAX);
+        server_end_write_batch(r->server);
+
+        if (k == -EBADMSG) {
+                native_ring_free(r);
+                return 0;
+        }
+
+        /* We stopped early (or ran out of memory), come back to this ring after everybody else had their
+         * turn */
+        if (k != 0)
+                (void) sd_event_source_set_enabled(r->defer_event_source, SD_EVENT_ONESHOT);
+
+        return 0;
+}
+
+static int native_ring_dispatch_io(sd_event_source *es, int fd, uint32_t revents, void *userdata) {
+        NativeRing *r = userdata;
+        bool gone = false;
+
+        assert(r);
+
+        /* The wakeups carry no information, just throw them away */
+        if (FLAGS_SET(revents, EPOLLIN))
+                for (;;) {
+                        char buf[64];
+                        ssize_t l;
+
+                        l = recv(fd, buf, sizeof(buf), MSG_DONTWAIT);
+                        if (l > 0)
+                                continue;
+                        if (l < 0) {
+                                if (errno == EINTR)
+                                        continue;
+                                if (errno == EAGAIN)
+                                        break;
+
+                                /* Anything else is not going to go away, don't spin on it */
+                                log_debug_errno(errno, "Failed to read from journal ring socket of PID " PID_FMT ": %m", r->ucred.pid);
+                        }
+
+                        gone = true;
+                        break;
+                }
+
+        if (gone || (revents & (EPOLLHUP|EPOLLERR))) {
+                log_debug("Client PID " PID_FMT " closed its journal ring.", r->ucred.pid);
+                native_ring_free(r);
+                return 0;
+        }
+
+        return native_ring_dispatch(r);
+}
+
+static int native_ring_dispatch_defer(sd_event_source *es, void *userdata) {
+        return native_ring_dispatch(userdata);
+}
+
+void server_drain_native_rings(Server *s, pid_t pid) {
+        NativeRing *r, *n;
+
+        assert(s);
+
+        /* Called before a message of the specified client that came in via the socket is processed. The
+         * client falls back to the socket when its ring is full, hence process everything it wrote to the
+         * ring before, so that the messages are stored in the order they were written. */
+
+        LIST_FOREACH_SAFE(native_ring, r, n, s->native_rings) {
+                if (r->ucred.pid != pid)
+                        continue;
+
+                server_begin_write_batch(s);
+                if (native_ring_process(r, UINT_MAX) == -EBADMSG)
+                        native_ring_free(r);
+                server_end_write_batch(s);
+        }
+}
+
+void native_ring_free(NativeRing *r) {
+        if (!r)
+                return;
+
+        if (r->server) {
+                if (r->header && !r->broken) {
+                        /* Write out whatever the client managed to put in there before it went away, or
+                         * before we are going away. Then tell the client to go back to the socket. */
+                        server_begin_write_batch(r->server);
+                        (void) native_ring_process(r, UINT_MAX);
+                        server_end_write_batch(r->server);
+
+                        r->header->attached = 0;
+                }
+
+                assert(r->server->n_native_rings > 0);
+                r->server->n_native_rings--;
+                LIST_REMOVE(native_ring, r->server->native_rings, r);
+
+                (void) server_start_or_stop_idle_timer(r->server); /* Maybe we are idle now? */
+        }
+
+        if (r->event_source) {
+                sd_event_source_set_enabled(r->event_source, SD_EVENT_OFF);
+                r->event_source = sd_event_source_unref(r->event_source);
+        }
+
+        sd_event_source_unref(r->defer_event_source);
+
+        if (r->header)
+                (void) munmap(r->header, JOURNAL_RING_HEADER_SIZE + r->data_size);
+
+        safe_close(r->fd);
+        free(r->label);
+        free(r->buffer);
+
+        free(r);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(NativeRing*, native_ring_free);
+
+static int native_ring_map(NativeRing *r, int fd) {
+        struct stat st;
+        void *p;
+        int seals;
+
+        assert(r);
+        assert(fd >= 0);
+
+        /* The memfd must not shrink under our feet, or we'd get SIGBUS. And it must stay writable, since we
+         * need to zero what we consumed. */
+        seals = fcntl(fd, F_GET_SEALS);
+        if (seals < 0)
+                return log_warning_errno(errno, "Failed to get seals of journal ring: %m");
+        if ((seals & (F_SEAL_SHRINK|F_SEAL_GROW|F_SEAL_SEAL|F_SEAL_WRITE)) != (F_SEAL_SHRINK|F_SEAL_GROW|F_SEAL_SEAL))
+                return log_warning_errno(SYNTHETIC_ERRNO(EPERM), "Journal ring is not sealed properly, refusing.");
+
+        if (fstat(fd, &st) < 0)
+                return log_warning_errno(errno, "Failed to stat journal ring: %m");
+
+        if (!S_ISREG(st.st_mode) ||
+            st.st_size < JOURNAL_RING_HEADER_SIZE ||
+            !journal_ring_data_size_valid(st.st_size - JOURNAL_RING_HEADER_SIZE))
+                return log_warning_errno(SYNTHETIC_ERRNO(EINVAL), "Journal ring has invalid size, refusing.");
+
+        p = mmap(NULL, st.st_size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED)
+                return log_warning_errno(errno, "Failed to map journal ring: %m");
+
+        r->header = p;
+        r->data = (uint8_t*) p + JOURNAL_RING_HEADER_SIZE;
+        r->data_size = st.st_size - JOURNAL_RING_HEADER_SIZE;
+
+        if (memcmp(r->header->signature, JOURNAL_RING_SIGNATURE, sizeof(r->header->signature)) != 0 ||
+            r->header->data_size != r->data_size)
+                return log_warning_errno(SYNTHETIC_ERRNO(EBADMSG), "Journal ring has invalid header, refusing.");
+
+        r->tail = r->header->tail;
+
+        return 0;
+}
+
+void server_process_native_ring(
+                Server *s,
+                int fds[static 2],
+                const struct ucred *ucred,
+                const char *label,
+                size_t label_len) {
+
+        _cleanup_(native_ring_freep) NativeRing *ring = NULL;
+        socklen_t sl = sizeof(int);
+        int r, type;
+
+        assert(s);
+        assert(fds);
+
+        /* A client asked to pass its messages to us in a shared memory ring. fds[0] is the ring, fds[1] the
+         * socket it wakes us up with. */
+
+        if (!ucred || !pid_is_valid(ucred->pid)) {
+                log_warning("Got journal ring from unknown peer, refusing.");
+                return;
+        }
+
+        if (s->n_native_rings >= NATIVE_RINGS_MAX) {
+                log_warning("Too many journal rings, refusing ring of PID " PID_FMT ".", ucred->pid);
+                return;
+        }
+
+        ring = new(NativeRing, 1);
+        if (!ring) {
+                log_oom();
+                return;
+        }
+
+        *ring = (NativeRing) {
+                .fd = -1,
+                .ucred = *ucred,
+        };
+
+        if (label_len > 0) {
+                ring->label = memdup(label, label_len);
+                if (!ring->label) {
+                        log_oom();
+                        return;
+                }
+
+                ring->label_len = label_len;
+        }
+
+        if (native_ring_map(ring, fds[0]) < 0)
+                return;
+
+        if (getsockopt(fds[1], SOL_SOCKET, SO_TYPE, &type, &sl) < 0) {
+                log_warning_errno(errno, "Failed to get type of journal ring socket, refusing: %m");
+                return;
+        }
+        if (sl != sizeof(type) || type != SOCK_SEQPACKET) {
+                log_warning("Journal ring socket is not a SOCK_SEQPACKET socket, refusing.");
+                return;
+        }
+
+        r = fd_nonblock(fds[1], true);
+        if (r < 0) {
+                log_warning_errno(r, "Failed to make journal ring socket non-blocking, refusing: %m");
+                return;
+        }
+
+        r = sd_event_add_io(s->event, &ring->event_source, fds[1], EPOLLIN, native_ring_dispatch_io, ring);
+        if (r < 0) {
+                log_warning_errno(r, "Failed to add journal ring to event loop, refusing: %m");
+                return;
+        }
+
+        ring->fd = TAKE_FD(fds[1]);
+
+        r = sd_event_source_set_priority(ring->event_source, SD_EVENT_PRIORITY_NORMAL+5);
+        if (r < 0) {
+                log_warning_errno(r, "Failed to adjust journal ring event source priority: %m");
+                return;
+        }
+
+        r = sd_event_add_defer(s->event, &ring->defer_event_source, native_ring_dispatch_defer, ring);
+        if (r < 0) {
+                log_warning_errno(r, "Failed to add journal ring defer event source: %m");
+                return;
+        }
+
+        r = sd_event_source_set_priority(ring->defer_event_source, SD_EVENT_PRIORITY_NORMAL+5);
+        if (r < 0) {
+                log_warning_errno(r, "Failed to adjust journal ring defer event source priority: %m");
+                return;
+        }
+
+        (void) sd_event_source_set_enabled(ring->defer_event_source, SD_EVENT_OFF);
+
+        ring->server = s;
+        LIST_PREPEND(native_ring, s->native_rings, ring);
+        s->n_native_rings++;
+
+        (void) server_start_or_stop_idle_timer(s); /* Maybe no longer idle? */
+
+        /* From now on the client may write to the ring */
+        __sync_synchronize();
+        ring->header->attached = 1;
+
+        log_debug("Attached journal ring of %zu bytes of PID " PID_FMT ".", ring->data_size, ring->ucred.pid);
+
+        TAKE_PTR(ring);
+}
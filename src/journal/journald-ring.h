@@ -0,0 +1,17 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+typedef struct NativeRing NativeRing;
+
+#include "journald-server.h"
+
+void server_process_native_ring(
+                Server *s,
+                int fds[static 2],
+                const struct ucred *ucred,
+                const char *label,
+                size_t label_len);
+
+void server_drain_native_rings(Server *s, pid_t pid);
+
+void native_ring_free(NativeRing *r);
@@ -3,6 +3,8 @@
 #if HAVE_SELINUX
 #include <selinux/selinux.h>
 #endif
+#include <pthread.h>
+#include <sys/eventfd.h>
 #include <sys/ioctl.h>
 #include <sys/mman.h>
 #include <sys/signalfd.h>
@@ -17,6 +19,7 @@
 #include "alloc-util.h"
 #include "audit-util.h"
 #include "cgroup-util.h"
+#include "compress.h"
 #include "conf-parser.h"
 #include "dirent-util.h"
 #include "extract-word.h"
@@ -31,16 +34,23 @@
 #include "journal-authenticate.h"
 #include "journal-file.h"
 #include "journal-internal.h"
+#include "journal-ring.h"
 #include "journal-vacuum.h"
 #include "journald-audit.h"
+#include "journald-compress.h"
+#include "journald-console.h"
 #include "journald-context.h"
 #include "journald-kmsg.h"
 #include "journald-native.h"
 #include "journald-rate-limit.h"
+#include "journald-ring.h"
 #include "journald-server.h"
 #include "journald-stream.h"
 #include "journald-syslog.h"
+#include "journald-unit-index.h"
 #include "log.h"
+#include "lookup3.h"
+#include "metrics.h"
 #include "missing_audit.h"
 #include "mkdir.h"
 #include "parse-util.h"
@@ -54,6 +64,7 @@
 #include "stdio-util.h"
 #include "string-table.h"
 #include "string-util.h"
+#include "strv.h"
 #include "syslog-util.h"
 #include "user-util.h"
 
@@ -79,21 +90,140 @@
 
 #define IDLE_TIMEOUT_USEC (30*USEC_PER_SEC)
 
+/* How many datagrams to read from a socket per wakeup, before we write them out and return to the event loop */
+#define DATAGRAMS_PER_WAKEUP_MAX 64U
+
+/* How many datagrams to receive with one recvmmsg() call, how large each may be, and how much of each slot
+ * may stay populated after a large datagram. The slot size is derived from the send buffer sd-journal asks
+ * for (see SNDBUF_SIZE in journal-send.c): the kernel doubles it and refuses AF_UNIX datagrams that don't fit
+ * into it, hence no datagram sd-journal sends can be larger than that. Larger datagrams from senders that
+ * force a bigger send buffer are still received in full if they are first in the queue, and dropped with a
+ * warning otherwise.
+ *
+ * The bound: there is one batch per server, shared by the native and the syslog socket, and it reserves
+ * DATAGRAM_BATCH_MAX * DATAGRAM_BATCH_SLOT_SIZE = 256 MiB of address space with MAP_NORESERVE. None of this
+ * is accounted as committed memory, only pages actually written to become resident, and everything beyond
+ * DATAGRAM_BATCH_SLOT_KEEP in each slot is given back after each datagram, hence the resident set of the
+ * batch stays below DATAGRAM_BATCH_MAX * DATAGRAM_BATCH_SLOT_KEEP = 1 MiB between wakeups. */
+#define DATAGRAM_SNDBUF_SIZE ((size_t) (8U*1024U*1024U))
+#define DATAGRAM_BATCH_MAX 16U
+#define DATAGRAM_BATCH_SLOT_SIZE (2U * DATAGRAM_SNDBUF_SIZE)
+#define DATAGRAM_BATCH_SLOT_KEEP ((size_t) (64U*1024U))
+#define DATAGRAM_BATCH_SIZE ((size_t) DATAGRAM_BATCH_MAX * DATAGRAM_BATCH_SLOT_SIZE)
+assert_cc(DATAGRAM_BATCH_MAX <= DATAGRAMS_PER_WAKEUP_MAX);
+
+static JournalVacuumIndex* storage_vacuum_index(JournalStorage *storage) {
+        int r;
+
+        assert(storage);
+
+        /* Returns the index of the directory, or NULL if the background vacuuming is using it right now */
+
+        if (storage->vacuum_index_busy)
+                return NULL;
+
+        if (!storage->vacuum_index) {
+                r = journal_vacuum_index_new(storage->path, &storage->vacuum_index);
+                if (r < 0) {
+                        log_debug_errno(r, "Failed to allocate index of %s, ignoring: %m", storage->path);
+                        return NULL;
+                }
+        }
+
+        return storage->vacuum_index;
+}
+
+static void storage_vacuum_index_add(JournalStorage *storage, const char *path) {
+        const char *fn;
+        int r;
+
+        assert(storage);
+        assert(path);
+
+        fn = path_startswith(path, storage->path);
+        if (isempty(fn) || strchr(fn, '/'))
+                return;
+
+        if (storage->vacuum_index_busy) {
+                if (strv_extend(&storage->vacuum_index_pending, fn) < 0)
+                        storage->vacuum_index_stale = true;
+                return;
+        }
+
+        if (!storage->vacuum_index)
+                return;
+
+        r = journal_vacuum_index_add(storage->vacuum_index, fn);
+        if (r < 0) {
+                log_debug_errno(r, "Failed to add %s to index, rescanning %s later: %m", fn, storage->path);
+                journal_vacuum_index_invalidate(storage->vacuum_index);
+        }
+}
+
+static void storage_vacuum_index_invalidate(JournalStorage *storage) {
+        assert(storage);
+
+        if (storage->vacuum_index_busy)
+                storage->vacuum_index_stale = true;
+        else
+                journal_vacuum_index_invalidate(storage->vacuum_index);
+}
+
+static void storage_vacuum_index_release(JournalStorage *storage) {
+        char **fn;
+
+        assert(storage);
+        assert(storage->vacuum_index_busy);
+
+        /* The background vacuuming is done with the index, catch up on what happened in the meantime */
+
+        storage->vacuum_index_busy = false;
+
+        STRV_FOREACH(fn, storage->vacuum_index_pending)
+                storage_vacuum_index_add(storage, *fn);
+        storage->vacuum_index_pending = strv_free(storage->vacuum_index_pending);
+
+        if (storage->vacuum_index_stale) {
+                journal_vacuum_index_invalidate(storage->vacuum_index);
+                storage->vacuum_index_stale = false;
+        }
+}
+
 static int determine_path_usage(
                 Server *s,
-                const char *path,
+                JournalStorage *storage,
                 uint64_t *ret_used,
                 uint64_t *ret_free) {
 
         _cleanup_closedir_ DIR *d = NULL;
+        JournalVacuumIndex *idx;
         struct dirent *de;
         struct statvfs ss;
+        const char *path;
+        int r;
 
         assert(s);
-        assert(path);
+        assert(storage);
         assert(ret_used);
         assert(ret_free);
 
+        path = storage->path;
+
+        idx = storage_vacuum_index(storage);
+        if (idx) {
+                if (statvfs(path, &ss) < 0)
+                        return log_full_errno(errno == ENOENT ? LOG_DEBUG : LOG_ERR,
+                                              errno, "Failed to statvfs(%s): %m", path);
+
+                r = journal_vacuum_index_usage(idx, ret_used);
+                if (r >= 0) {
+                        *ret_free = ss.f_bsize * ss.f_bavail;
+                        return 0;
+                }
+
+                log_debug_errno(r, "Failed to determine usage of %s from index, counting again: %m", path);
+        }
+
         d = opendir(path);
         if (!d)
                 return log_full_errno(errno == ENOENT ? LOG_DEBUG : LOG_ERR,
@@ -146,7 +276,7 @@ static int cache_space_refresh(Server *s, JournalStorage *storage) {
         if (space->timestamp != 0 && space->timestamp + RECHECK_SPACE_USEC > ts)
                 return 0;
 
-        r = determine_path_usage(s, storage->path, &vfs_used, &vfs_avail);
+        r = determine_path_usage(s, storage, &vfs_used, &vfs_avail);
         if (r < 0)
                 return r;
 
@@ -262,13 +392,19 @@ static void server_add_acls(JournalFile *f, uid_t uid) {
 #endif
 }
 
+static int server_compression(Server *s) {
+        assert(s);
+
+        return s->compress.enabled ? s->compress.algorithm : 0;
+}
+
 static int open_journal(
                 Server *s,
                 bool reliably,
                 const char *fname,
                 int flags,
                 bool seal,
-                JournalMetrics *metrics,
+                JournalStorage *storage,
                 JournalFile **ret) {
 
         _cleanup_(journal_file_closep) JournalFile *f = NULL;
@@ -276,18 +412,21 @@ static int open_journal(
 
         assert(s);
         assert(fname);
+        assert(storage);
         assert(ret);
 
         if (reliably)
-                r = journal_file_open_reliably(fname, flags, 0640, s->compress.enabled, s->compress.threshold_bytes,
-                                               seal, metrics, s->mmap, s->deferred_closes, NULL, &f);
+                r = journal_file_open_reliably(fname, flags, 0640, server_compression(s), s->compress.threshold_bytes,
+                                               seal, &storage->metrics, s->mmap, s->deferred_closes, NULL, &f);
         else
-                r = journal_file_open(-1, fname, flags, 0640, s->compress.enabled, s->compress.threshold_bytes, seal,
-                                      metrics, s->mmap, s->deferred_closes, NULL, &f);
+                r = journal_file_open(-1, fname, flags, 0640, server_compression(s), s->compress.threshold_bytes, seal,
+                                      &storage->metrics, s->mmap, s->deferred_closes, NULL, &f);
 
         if (r < 0)
                 return r;
 
+        storage_vacuum_index_add(storage, fname);
+
         r = journal_file_enable_post_change_timer(f, s->event, POST_CHANGE_TIMER_INTERVAL_USEC);
         if (r < 0)
                 return r;
@@ -329,7 +468,7 @@ static int system_journal_open(Server *s, bool flush_requested, bool relinquish_
                 (void) mkdir(s->system_storage.path, 0755);
 
                 fn = strjoina(s->system_storage.path, "/system.journal");
-                r = open_journal(s, true, fn, O_RDWR|O_CREAT, s->seal, &s->system_storage.metrics, &s->system_journal);
+                r = open_journal(s, true, fn, O_RDWR|O_CREAT, s->seal, &s->system_storage, &s->system_journal);
                 if (r >= 0) {
                         server_add_acls(s->system_journal, 0);
                         (void) cache_space_refresh(s, &s->system_storage);
@@ -362,7 +501,7 @@ static int system_journal_open(Server *s, bool flush_requested, bool relinquish_
                          * if it already exists, so that we can flush
                          * it into the system journal */
 
-                        r = open_journal(s, false, fn, O_RDWR, false, &s->runtime_storage.metrics, &s->runtime_journal);
+                        r = open_journal(s, false, fn, O_RDWR, false, &s->runtime_storage, &s->runtime_journal);
                         if (r < 0) {
                                 if (r != -ENOENT)
                                         log_warning_errno(r, "Failed to open runtime journal: %m");
@@ -377,7 +516,7 @@ static int system_journal_open(Server *s, bool flush_requested, bool relinquish_
                         (void) mkdir_parents(s->runtime_storage.path, 0755);
                         (void) mkdir(s->runtime_storage.path, 0750);
 
-                        r = open_journal(s, true, fn, O_RDWR|O_CREAT, false, &s->runtime_storage.metrics, &s->runtime_journal);
+                        r = open_journal(s, true, fn, O_RDWR|O_CREAT, false, &s->runtime_storage, &s->runtime_journal);
                         if (r < 0)
                                 return log_error_errno(r, "Failed to open runtime journal: %m");
                 }
@@ -433,7 +572,7 @@ static JournalFile* find_journal(Server *s, uid_t uid) {
                 (void) journal_file_close(f);
         }
 
-        r = open_journal(s, true, p, O_RDWR|O_CREAT, s->seal, &s->system_storage.metrics, &f);
+        r = open_journal(s, true, p, O_RDWR|O_CREAT, s->seal, &s->system_storage, &f);
         if (r < 0)
                 return s->system_journal;
 
@@ -449,18 +588,30 @@ static JournalFile* find_journal(Server *s, uid_t uid) {
 
 static int do_rotate(
                 Server *s,
+                JournalStorage *storage,
                 JournalFile **f,
                 const char* name,
                 bool seal,
                 uint32_t uid) {
 
+        _cleanup_free_ char *archived = NULL;
+        JournalFile *old;
         int r;
+
         assert(s);
+        assert(storage);
 
         if (!*f)
                 return -EINVAL;
 
-        r = journal_file_rotate(f, s->compress.enabled, s->compress.threshold_bytes, seal, s->deferred_closes);
+        (void) journal_file_archived_path(*f, &archived);
+        old = *f;
+
+        r = journal_file_rotate(f, server_compression(s), s->compress.threshold_bytes, seal, s->deferred_closes);
+
+        /* The old file got archived, even if we couldn't open a new one */
+        if (*f != old && archived)
+                storage_vacuum_index_add(storage, archived);
         if (r < 0) {
                 if (*f)
                         return log_error_errno(r, "Failed to rotate %s: %m", (*f)->path);
@@ -520,7 +671,7 @@ static int vacuum_offline_user_journals(Server *s) {
         }
 
         for (;;) {
-                _cleanup_free_ char *u = NULL, *full = NULL;
+                _cleanup_free_ char *u = NULL, *full = NULL, *archived = NULL;
                 _cleanup_close_ int fd = -1;
                 const char *a, *b;
                 struct dirent *de;
@@ -576,7 +727,7 @@ static int vacuum_offline_user_journals(Server *s) {
                                       full,
                                       O_RDWR,
                                       0640,
-                                      s->compress.enabled,
+                                      server_compression(s),
                                       s->compress.threshold_bytes,
                                       s->seal,
                                       &s->system_storage.metrics,
@@ -590,17 +741,25 @@ static int vacuum_offline_user_journals(Server *s) {
                         r = journal_file_dispose(dirfd(d), de->d_name);
                         if (r < 0)
                                 log_warning_errno(r, "Failed to move %s out of the way, ignoring: %m", full);
-                        else
+                        else {
                                 log_debug("Successfully moved %s out of the way.", full);
 
+                                /* We don't know the new name, look again */
+                                storage_vacuum_index_invalidate(&s->system_storage);
+                        }
+
                         continue;
                 }
 
                 TAKE_FD(fd); /* Donated to journal_file_open() */
 
+                (void) journal_file_archived_path(f, &archived);
+
                 r = journal_file_archive(f);
                 if (r < 0)
                         log_debug_errno(r, "Failed to archive journal file '%s', ignoring: %m", full);
+                else if (archived)
+                        storage_vacuum_index_add(&s->system_storage, archived);
 
                 f = journal_initiate_close(f, s->deferred_closes);
         }
@@ -617,12 +776,12 @@ void server_rotate(Server *s) {
         log_debug("Rotating...");
 
         /* First, rotate the system journal (either in its runtime flavour or in its runtime flavour) */
-        (void) do_rotate(s, &s->runtime_journal, "runtime", false, 0);
-        (void) do_rotate(s, &s->system_journal, "system", s->seal, 0);
+        (void) do_rotate(s, &s->runtime_storage, &s->runtime_journal, "runtime", false, 0);
+        (void) do_rotate(s, &s->system_storage, &s->system_journal, "system", s->seal, 0);
 
         /* Then, rotate all user journals we have open (keeping them open) */
         ORDERED_HASHMAP_FOREACH_KEY(f, k, s->user_journals, i) {
-                r = do_rotate(s, &f, "user", s->seal, PTR_TO_UID(k));
+                r = do_rotate(s, &s->system_storage, &f, "user", s->seal, PTR_TO_UID(k));
                 if (r >= 0)
                         ordered_hashmap_replace(s->user_journals, k, f);
                 else if (!f)
@@ -665,29 +824,156 @@ void server_sync(Server *s) {
 }
 
 static void do_vacuum(Server *s, JournalStorage *storage, bool verbose) {
-
         int r;
 
+        JournalVacuumIndex *idx;
+
         assert(s);
         assert(storage);
 
+        /* This is what is done when asked to, or when we are out of space, hence don't trust the index, but
+         * look at the directory again */
+        idx = storage_vacuum_index(storage);
+        journal_vacuum_index_invalidate(idx);
+        cache_space_invalidate(&storage->space);
+
         (void) cache_space_refresh(s, storage);
 
         if (verbose)
                 server_space_usage_message(s, storage);
 
-        r = journal_directory_vacuum(storage->path, storage->space.limit,
-                                     storage->metrics.n_max_files, s->max_retention_usec,
-                                     &s->oldest_file_usec, verbose);
+        if (idx)
+                r = journal_vacuum_index_vacuum(idx, storage->space.limit,
+                                                storage->metrics.n_max_files, s->max_retention_usec,
+                                                &s->oldest_file_usec, verbose);
+        else
+                r = journal_directory_vacuum(storage->path, storage->space.limit,
+                                             storage->metrics.n_max_files, s->max_retention_usec,
+                                             &s->oldest_file_usec, verbose);
         if (r < 0 && r != -ENOENT)
                 log_warning_errno(r, "Failed to vacuum %s, ignoring: %m", storage->path);
 
         cache_space_invalidate(&storage->space);
 }
 
+typedef struct VacuumItem {
+        JournalStorage *storage;
+        JournalVacuumIndex *index;
+        char *path;
+        uint64_t max_use;
+        uint64_t n_max_files;
+} VacuumItem;
+
+struct VacuumJob {
+        Server *server;
+
+        pthread_t thread;
+        bool thread_started;
+
+        /* The thread signals this eventfd when it is done */
+        int fd;
+        sd_event_source *event_source;
+
+        VacuumItem items[2];
+        size_t n_items;
+        usec_t max_retention_usec;
+        usec_t oldest_usec;
+};
+
+static void *vacuum_thread(void *userdata) {
+        VacuumJob *j = userdata;
+        size_t i;
+        int r;
+
+        (void) pthread_setname_np(pthread_self(), "journal-vacuum");
+
+        for (i = 0; i < j->n_items; i++) {
+                VacuumItem *item = j->items + i;
+
+                if (item->index)
+                        r = journal_vacuum_index_vacuum(item->index, item->max_use, item->n_max_files,
+                                                        j->max_retention_usec, &j->oldest_usec, false);
+                else
+                        r = journal_directory_vacuum(item->path, item->max_use, item->n_max_files,
+                                                     j->max_retention_usec, &j->oldest_usec, false);
+                if (r < 0 && r != -ENOENT)
+                        log_warning_errno(r, "Failed to vacuum %s, ignoring: %m", item->path);
+        }
+
+        (void) eventfd_write(j->fd, 1);
+
+        return NULL;
+}
+
+static VacuumJob* vacuum_job_free(VacuumJob *j) {
+        size_t i;
+
+        if (!j)
+                return NULL;
+
+        if (j->thread_started)
+                assert_se(pthread_join(j->thread, NULL) == 0);
+
+        sd_event_source_unref(j->event_source);
+        safe_close(j->fd);
+
+        for (i = 0; i < j->n_items; i++) {
+                if (j->items[i].index)
+                        storage_vacuum_index_release(j->items[i].storage);
+
+                free(j->items[i].path);
+        }
+
+        return mfree(j);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(VacuumJob*, vacuum_job_free);
+
+static void server_finish_vacuum(Server *s, bool restart) {
+        VacuumJob *j;
+
+        assert(s);
+
+        /* Waits for the background vacuuming to finish, if there is any, and picks up its results */
+
+        j = s->vacuum_job;
+        if (!j)
+                return;
+
+        assert_se(pthread_join(j->thread, NULL) == 0);
+        j->thread_started = false;
+
+        if (j->oldest_usec > 0 && (s->oldest_file_usec == 0 || j->oldest_usec < s->oldest_file_usec))
+                s->oldest_file_usec = j->oldest_usec;
+
+        cache_space_invalidate(&s->system_storage.space);
+        cache_space_invalidate(&s->runtime_storage.space);
+
+        s->vacuum_job = vacuum_job_free(j);
+
+        if (restart && s->vacuum_pending) {
+                s->vacuum_pending = false;
+                server_vacuum_in_background(s);
+        }
+}
+
+static int dispatch_vacuum_done(sd_event_source *es, int fd, uint32_t revents, void *userdata) {
+        Server *s = userdata;
+
+        assert(s);
+
+        server_finish_vacuum(s, true);
+        return 0;
+}
+
 int server_vacuum(Server *s, bool verbose) {
         assert(s);
 
+        /* Don't run in parallel with the background vacuuming, and there's no point in doing it again
+         * afterwards */
+        server_finish_vacuum(s, false);
+        s->vacuum_pending = false;
+
         log_debug("Vacuuming...");
 
         s->oldest_file_usec = 0;
@@ -700,6 +986,125 @@ int server_vacuum(Server *s, bool verbose) {
         return 0;
 }
 
+static int vacuum_job_add(VacuumJob *j, Server *s, JournalStorage *storage) {
+        char *path;
+
+        assert(j);
+        assert(j->n_items < ELEMENTSOF(j->items));
+        assert(s);
+        assert(storage);
+
+        (void) cache_space_refresh(s, storage);
+
+        path = strdup(storage->path);
+        if (!path)
+                return -ENOMEM;
+
+        j->items[j->n_items++] = (VacuumItem) {
+                .storage = storage,
+                .index = storage_vacuum_index(storage),
+                .path = path,
+                .max_use = storage->space.limit,
+                .n_max_files = storage->metrics.n_max_files,
+        };
+
+        /* Until the thread is done with it, the index is off limits */
+        if (j->items[j->n_items - 1].index)
+                storage->vacuum_index_busy = true;
+
+        return 0;
+}
+
+static int server_start_vacuum(Server *s) {
+        _cleanup_(vacuum_job_freep) VacuumJob *j = NULL;
+        sigset_t ss, saved_ss;
+        int r, k;
+
+        assert(s);
+        assert(!s->vacuum_job);
+
+        j = new(VacuumJob, 1);
+        if (!j)
+                return -ENOMEM;
+
+        *j = (VacuumJob) {
+                .server = s,
+                .fd = -1,
+                .max_retention_usec = s->max_retention_usec,
+        };
+
+        if (s->system_journal) {
+                r = vacuum_job_add(j, s, &s->system_storage);
+                if (r < 0)
+                        return r;
+        }
+        if (s->runtime_journal) {
+                r = vacuum_job_add(j, s, &s->runtime_storage);
+                if (r < 0)
+                        return r;
+        }
+
+        if (j->n_items == 0)
+                return 0;
+
+        j->fd = eventfd(0, EFD_CLOEXEC|EFD_NONBLOCK);
+        if (j->fd < 0)
+                return -errno;
+
+        r = sd_event_add_io(s->event, &j->event_source, j->fd, EPOLLIN, dispatch_vacuum_done, s);
+        if (r < 0)
+                return r;
+
+        assert_se(sigfillset(&ss) >= 0);
+
+        r = pthread_sigmask(SIG_BLOCK, &ss, &saved_ss);
+        if (r > 0)
+                return -r;
+
+        r = pthread_create(&j->thread, NULL, vacuum_thread, j);
+
+        k = pthread_sigmask(SIG_SETMASK, &saved_ss, NULL);
+        if (r > 0)
+                return -r;
+
+        j->thread_started = true;
+
+        if (k > 0)
+                return -k;
+
+        s->vacuum_job = TAKE_PTR(j);
+        return 1;
+}
+
+void server_vacuum_in_background(Server *s) {
+        int r;
+
+        assert(s);
+
+        /* Like server_vacuum(), but enumerating the directories and deleting the files happens in a separate
+         * thread, since that may take a while if there are many archived files. Use server_vacuum() when
+         * the space is needed right away. */
+
+        if (s->vacuum_job) {
+                /* Coalesce with the one running, but do run again afterwards, since the limits might have
+                 * been reached again in the meantime. */
+                s->vacuum_pending = true;
+                return;
+        }
+
+        log_debug("Vacuuming in the background...");
+
+        /* The results only show up once it is done, don't trigger another one based on the old ones until
+         * then */
+        s->oldest_file_usec = 0;
+
+        r = server_start_vacuum(s);
+        if (r < 0) {
+                log_debug_errno(r, "Failed to start vacuuming in the background, vacuuming right away: %m");
+                server_vacuum(s, false);
+        }
+}
+
 static void server_cache_machine_id(Server *s) {
         sd_id128_t id;
         int r;
@@ -792,23 +1197,17 @@ static bool shall_try_append_again(JournalFile *f, int r) {
         }
 }
 
-static void write_to_journal(Server *s, uid_t uid, struct iovec *iovec, size_t n, int priority) {
-        bool vacuumed = false, rotate = false;
-        struct dual_timestamp ts;
+static JournalFile* server_journal_for_entry(Server *s, uid_t uid, const dual_timestamp *ts, bool *vacuumed) {
+        bool rotate = false;
         JournalFile *f;
-        int r;
 
         assert(s);
-        assert(iovec);
-        assert(n > 0);
+        assert(ts);
+        assert(vacuumed);
 
-        /* Get the closest, linearized time we have for this log event from the event loop. (Note that we do not use
-         * the source time, and not even the time the event was originally seen, but instead simply the time we started
-         * processing it, as we want strictly linear ordering in what we write out.) */
-        assert_se(sd_event_now(s->event, CLOCK_REALTIME, &ts.realtime) >= 0);
-        assert_se(sd_event_now(s->event, CLOCK_MONOTONIC, &ts.monotonic) >= 0);
+        *vacuumed = false;
 
-        if (ts.realtime < s->last_realtime_clock) {
+        if (ts->realtime < s->last_realtime_clock) {
                 /* When the time jumps backwards, let's immediately rotate. Of course, this should not happen during
                  * regular operation. However, when it does happen, then we should make sure that we start fresh files
                  * to ensure that the entries in the journal files are strictly ordered by time, in order to ensure
@@ -820,7 +1219,7 @@ static void write_to_journal(Server *s, uid_t uid, struct iovec *iovec, size_t n
 
                 f = find_journal(s, uid);
                 if (!f)
-                        return;
+                        return NULL;
 
                 if (journal_file_rotate_suggested(f, s->max_file_usec)) {
                         log_debug("%s: Journal header limits reached or header out-of-date, rotating.", f->path);
@@ -830,40 +1229,268 @@ static void write_to_journal(Server *s, uid_t uid, struct iovec *iovec, size_t n
 
         if (rotate) {
                 server_rotate(s);
-                server_vacuum(s, false);
-                vacuumed = true;
+                server_vacuum_in_background(s);
+                *vacuumed = true;
 
                 f = find_journal(s, uid);
                 if (!f)
-                        return;
+                        return NULL;
         }
 
-        s->last_realtime_clock = ts.realtime;
+        s->last_realtime_clock = ts->realtime;
+
+        return f;
+}
+
+static void write_to_journal_failed(
+                Server *s,
+                JournalFile *f,
+                uid_t uid,
+                const dual_timestamp *ts,
+                const struct iovec *iovec, const uint64_t *hashes, size_t n,
+                int priority,
+                bool vacuumed,
+                int r) {
+
+        assert(s);
+        assert(f);
+        assert(ts);
+
+        if ((vacuumed && !s->vacuum_job) || !shall_try_append_again(f, r)) {
+                log_error_errno(r, "Failed to write entry (%zu items, %zu bytes), ignoring: %m", n, IOVEC_TOTAL_SIZE(iovec, n));
+                return;
+        }
+
+        if (vacuumed)
+                /* We just rotated, but the vacuuming is still going on in the background. Wait for it to
+                 * free up space, and then try again. */
+                server_finish_vacuum(s, true);
+        else {
+                server_rotate(s);
+                server_vacuum(s, false);
+        }
+
+        f = find_journal(s, uid);
+        if (!f)
+                return;
+
+        log_debug("Retrying write.");
+        r = journal_file_append_entry_with_hashes(f, ts, NULL, iovec, hashes, n, &s->seqnum, NULL, NULL);
+        if (r < 0)
+                log_error_errno(r, "Failed to write entry (%zu items, %zu bytes) despite vacuuming, ignoring: %m", n, IOVEC_TOTAL_SIZE(iovec, n));
+        else {
+                metric_inc(s->metrics + SERVER_METRIC_ENTRIES_WRITTEN);
+                server_schedule_sync(s, priority);
+        }
+}
+
+static void write_to_journal_now(
+                Server *s,
+                uid_t uid,
+                const dual_timestamp *ts,
+                const struct iovec *iovec, const uint64_t *hashes, size_t n,
+                int priority) {
+
+        bool vacuumed;
+        JournalFile *f;
+        int r;
+
+        assert(s);
+        assert(ts);
 
-        r = journal_file_append_entry(f, &ts, NULL, iovec, n, &s->seqnum, NULL, NULL);
+        f = server_journal_for_entry(s, uid, ts, &vacuumed);
+        if (!f)
+                return;
+
+        r = journal_file_append_entry_with_hashes(f, ts, NULL, iovec, hashes, n, &s->seqnum, NULL, NULL);
         if (r >= 0) {
+                metric_inc(s->metrics + SERVER_METRIC_ENTRIES_WRITTEN);
                 server_schedule_sync(s, priority);
                 return;
         }
 
-        if (vacuumed || !shall_try_append_again(f, r)) {
-                log_error_errno(r, "Failed to write entry (%zu items, %zu bytes), ignoring: %m", n, IOVEC_TOTAL_SIZE(iovec, n));
+        write_to_journal_failed(s, f, uid, ts, iovec, hashes, n, priority, vacuumed, r);
+}
+
+static int server_queue_entry(
+                Server *s,
+                uid_t uid,
+                const dual_timestamp *ts,
+                const struct iovec *iovec, const uint64_t *hashes, size_t n,
+                int priority) {
+
+        struct iovec *copy;
+        uint64_t *copy_hashes;
+        uint8_t *data;
+        size_t i;
+
+        assert(s);
+        assert(ts);
+        assert(iovec);
+        assert(hashes);
+
+        /* The iovec array usually points to stack memory of the caller, hence make a copy of it, of the
+         * hashes and of the data in a single allocation. */
+
+        if (!GREEDY_REALLOC(s->pending_entries, s->n_pending_entries_allocated, s->n_pending_entries + 1))
+                return -ENOMEM;
+
+        copy = malloc(n * (sizeof(struct iovec) + sizeof(uint64_t)) + IOVEC_TOTAL_SIZE(iovec, n));
+        if (!copy)
+                return -ENOMEM;
+
+        copy_hashes = memcpy(copy + n, hashes, n * sizeof(uint64_t));
+        data = (uint8_t*) (copy_hashes + n);
+        for (i = 0; i < n; i++) {
+                copy[i] = IOVEC_MAKE(data, iovec[i].iov_len);
+                data = mempcpy(data, iovec[i].iov_base, iovec[i].iov_len);
+        }
+
+        s->pending_entries[s->n_pending_entries++] = (PendingEntry) {
+                .uid = uid,
+                .priority = priority,
+                .ts = *ts,
+                .iovec = copy,
+                .hashes = copy_hashes,
+                .n_iovec = n,
+        };
+
+        return 0;
+}
+
+static void server_write_pending_entries(Server *s) {
+        _cleanup_free_ JournalFileEntry *entries = NULL;
+        size_t i = 0, j;
+
+        assert(s);
+
+        if (s->n_pending_entries == 0)
                 return;
+
+        metric_observe(s->metrics + SERVER_METRIC_WRITE_BATCH_ENTRIES, s->n_pending_entries);
+
+        entries = new(JournalFileEntry, s->n_pending_entries);
+        if (!entries) {
+                /* Can't batch, let's at least write them out one by one */
+                for (i = 0; i < s->n_pending_entries; i++) {
+                        PendingEntry *e = s->pending_entries + i;
+
+                        write_to_journal_now(s, e->uid, &e->ts, e->iovec, e->hashes, e->n_iovec, e->priority);
+                }
+
+                goto finish;
+        }
+
+        while (i < s->n_pending_entries) {
+                PendingEntry *e = s->pending_entries + i;
+                int priority = e->priority, r;
+                size_t n_appended = 0;
+                bool vacuumed, failed;
+                JournalFileCompressed *compressed = NULL;
+                size_t n_compressed = 0;
+                JournalFile *f;
+
+                f = server_journal_for_entry(s, e->uid, &e->ts, &vacuumed);
+                if (!f) {
+                        i++;
+                        continue;
+                }
+
+                /* Collect all following entries that go to the same file and don't require a rotation */
+                for (j = i; j < s->n_pending_entries; j++) {
+                        PendingEntry *next = s->pending_entries + j;
+
+                        if (j > i &&
+                            (next->ts.realtime < s->last_realtime_clock || find_journal(s, next->uid) != f))
+                                break;
+
+                        entries[j - i] = (JournalFileEntry) {
+                                .ts = next->ts,
+                                .iovec = next->iovec,
+                                .hashes = next->hashes,
+                                .n_iovec = next->n_iovec,
+                        };
+
+                        s->last_realtime_clock = next->ts.realtime;
+                }
+
+                r = compress_entries_threaded(f, entries, j - i, s->n_compress_threads, &compressed, &n_compressed);
+                if (r < 0)
+                        log_debug_errno(r, "Failed to compress entries on separate threads, ignoring: %m");
+
+                r = journal_file_append_entries(f, NULL, entries, j - i, &s->seqnum, &n_appended);
+                journal_file_compressed_free_many(compressed, n_compressed);
+                failed = r < 0 && n_appended < j - i;
+
+                for (size_t l = 0; l < n_appended; l++)
+                        priority = MIN(priority, s->pending_entries[i + l].priority);
+                if (n_appended > 0) {
+                        metric_add(s->metrics + SERVER_METRIC_ENTRIES_WRITTEN, n_appended);
+                        server_schedule_sync(s, priority);
+                }
+
+                i += n_appended;
+
+                if (failed) {
+                        /* Rotate and retry the failed entry on its own, then continue with the rest */
+                        e = s->pending_entries + i;
+                        write_to_journal_failed(s, f, e->uid, &e->ts, e->iovec, e->hashes, e->n_iovec, e->priority, vacuumed, r);
+                        i++;
+                } else if (r < 0)
+                        log_error_errno(r, "Failed to write %zu entries, ignoring: %m", n_appended);
         }
 
-        server_rotate(s);
-        server_vacuum(s, false);
+finish:
+        for (i = 0; i < s->n_pending_entries; i++)
+                free(s->pending_entries[i].iovec);
+        s->n_pending_entries = 0;
+}
+
+void server_begin_write_batch(Server *s) {
+        assert(s);
+
+        /* Between this call and the matching server_end_write_batch() entries are only queued, and then
+         * written out with a single journal_file_append_entries() call per journal file. Calls may be
+         * nested. */
+
+        s->write_batch_depth++;
+}
+
+void server_end_write_batch(Server *s) {
+        assert(s);
+        assert(s->write_batch_depth > 0);
+
+        if (--s->write_batch_depth > 0)
+                return;
+
+        server_write_pending_entries(s);
+        server_flush_forward_syslog(s);
+        server_flush_forward_console(s);
+}
+
+static void write_to_journal(Server *s, uid_t uid, struct iovec *iovec, const uint64_t *hashes, size_t n, int priority) {
+        struct dual_timestamp ts;
+
+        assert(s);
+        assert(iovec);
+        assert(n > 0);
+
+        /* Get the closest, linearized time we have for this log event from the event loop. (Note that we do not use
+         * the source time, and not even the time the event was originally seen, but instead simply the time we started
+         * processing it, as we want strictly linear ordering in what we write out.) */
+        assert_se(sd_event_now(s->event, CLOCK_REALTIME, &ts.realtime) >= 0);
+        assert_se(sd_event_now(s->event, CLOCK_MONOTONIC, &ts.monotonic) >= 0);
 
-        f = find_journal(s, uid);
-        if (!f)
-                return;
+        if (s->write_batch_depth > 0) {
+                if (server_queue_entry(s, uid, &ts, iovec, hashes, n, priority) >= 0)
+                        return;
 
-        log_debug("Retrying write.");
-        r = journal_file_append_entry(f, &ts, NULL, iovec, n, &s->seqnum, NULL, NULL);
-        if (r < 0)
-                log_error_errno(r, "Failed to write entry (%zu items, %zu bytes) despite vacuuming, ignoring: %m", n, IOVEC_TOTAL_SIZE(iovec, n));
-        else
-                server_schedule_sync(s, priority);
+                /* Out of memory, flush what we have so far to keep the ordering, then write this one directly */
+                log_oom();
+                server_write_pending_entries(s);
+        }
+
+        write_to_journal_now(s, uid, &ts, iovec, hashes, n, priority);
 }
 
 #define IOVEC_ADD_NUMERIC_FIELD(iovec, n, value, type, isset, format, field)  \
@@ -906,8 +1533,10 @@ static void dispatch_message_real(
                 pid_t object_pid) {
 
         char source_time[sizeof("_SOURCE_REALTIME_TIMESTAMP=") + DECIMAL_STR_MAX(usec_t)];
-        _cleanup_free_ char *cmdline1 = NULL, *cmdline2 = NULL;
+        _cleanup_free_ char *cmdline = NULL;
+        size_t context_start = 0, context_n = 0, i;
         uid_t journal_uid;
+        uint64_t *hashes;
         ClientContext *o;
 
         assert(s);
@@ -919,36 +1548,16 @@ static void dispatch_message_real(
                client_context_extra_fields_n_iovec(c) <= m);
 
         if (c) {
-                IOVEC_ADD_NUMERIC_FIELD(iovec, n, c->pid, pid_t, pid_is_valid, PID_FMT, "_PID");
-                IOVEC_ADD_NUMERIC_FIELD(iovec, n, c->uid, uid_t, uid_is_valid, UID_FMT, "_UID");
-                IOVEC_ADD_NUMERIC_FIELD(iovec, n, c->gid, gid_t, gid_is_valid, GID_FMT, "_GID");
-
-                IOVEC_ADD_STRING_FIELD(iovec, n, c->comm, "_COMM"); /* At most TASK_COMM_LENGTH (16 bytes) */
-                IOVEC_ADD_STRING_FIELD(iovec, n, c->exe, "_EXE"); /* A path, so at most PATH_MAX (4096 bytes) */
-
-                if (c->cmdline)
-                        /* At most _SC_ARG_MAX (2MB usually), which is too much to put on stack.
-                         * Let's use a heap allocation for this one. */
-                        cmdline1 = set_iovec_string_field(iovec, &n, "_CMDLINE=", c->cmdline);
-
-                IOVEC_ADD_STRING_FIELD(iovec, n, c->capeff, "_CAP_EFFECTIVE"); /* Read from /proc/.../status */
-                IOVEC_ADD_SIZED_FIELD(iovec, n, c->label, c->label_size, "_SELINUX_CONTEXT");
-                IOVEC_ADD_NUMERIC_FIELD(iovec, n, c->auditid, uint32_t, audit_session_is_valid, "%" PRIu32, "_AUDIT_SESSION");
-                IOVEC_ADD_NUMERIC_FIELD(iovec, n, c->loginuid, uid_t, uid_is_valid, UID_FMT, "_AUDIT_LOGINUID");
-
-                IOVEC_ADD_STRING_FIELD(iovec, n, c->cgroup, "_SYSTEMD_CGROUP"); /* A path */
-                IOVEC_ADD_STRING_FIELD(iovec, n, c->session, "_SYSTEMD_SESSION");
-                IOVEC_ADD_NUMERIC_FIELD(iovec, n, c->owner_uid, uid_t, uid_is_valid, UID_FMT, "_SYSTEMD_OWNER_UID");
-                IOVEC_ADD_STRING_FIELD(iovec, n, c->unit, "_SYSTEMD_UNIT"); /* Unit names are bounded by UNIT_NAME_MAX */
-                IOVEC_ADD_STRING_FIELD(iovec, n, c->user_unit, "_SYSTEMD_USER_UNIT");
-                IOVEC_ADD_STRING_FIELD(iovec, n, c->slice, "_SYSTEMD_SLICE");
-                IOVEC_ADD_STRING_FIELD(iovec, n, c->user_slice, "_SYSTEMD_USER_SLICE");
-
-                IOVEC_ADD_ID128_FIELD(iovec, n, c->invocation_id, "_SYSTEMD_INVOCATION_ID");
-
-                if (c->extra_fields_n_iovec > 0) {
-                        memcpy(iovec + n, c->extra_fields_iovec, c->extra_fields_n_iovec * sizeof(struct iovec));
-                        n += c->extra_fields_n_iovec;
+                /* The trusted fields have been rendered already when the context was refreshed, together
+                 * with their hashes */
+                memcpy_safe(iovec + n, c->fields_iovec, c->fields_n_iovec * sizeof(struct iovec));
+                context_start = n;
+                context_n = c->fields_n_iovec;
+                n += c->fields_n_iovec;
+
+                if (client_context_extra_fields_n_iovec(c) > 0) {
+                        memcpy(iovec + n, c->unit_context->extra_fields_iovec, c->unit_context->extra_fields_n_iovec * sizeof(struct iovec));
+                        n += c->unit_context->extra_fields_n_iovec;
                 }
         }
 
@@ -964,22 +1573,26 @@ static void dispatch_message_real(
                 IOVEC_ADD_STRING_FIELD(iovec, n, o->comm, "OBJECT_COMM");
                 IOVEC_ADD_STRING_FIELD(iovec, n, o->exe, "OBJECT_EXE");
                 if (o->cmdline)
-                        cmdline2 = set_iovec_string_field(iovec, &n, "OBJECT_CMDLINE=", o->cmdline);
+                        cmdline = set_iovec_string_field(iovec, &n, "OBJECT_CMDLINE=", o->cmdline);
 
                 IOVEC_ADD_STRING_FIELD(iovec, n, o->capeff, "OBJECT_CAP_EFFECTIVE");
                 IOVEC_ADD_SIZED_FIELD(iovec, n, o->label, o->label_size, "OBJECT_SELINUX_CONTEXT");
                 IOVEC_ADD_NUMERIC_FIELD(iovec, n, o->auditid, uint32_t, audit_session_is_valid, "%" PRIu32, "OBJECT_AUDIT_SESSION");
                 IOVEC_ADD_NUMERIC_FIELD(iovec, n, o->loginuid, uid_t, uid_is_valid, UID_FMT, "OBJECT_AUDIT_LOGINUID");
 
-                IOVEC_ADD_STRING_FIELD(iovec, n, o->cgroup, "OBJECT_SYSTEMD_CGROUP");
-                IOVEC_ADD_STRING_FIELD(iovec, n, o->session, "OBJECT_SYSTEMD_SESSION");
-                IOVEC_ADD_NUMERIC_FIELD(iovec, n, o->owner_uid, uid_t, uid_is_valid, UID_FMT, "OBJECT_SYSTEMD_OWNER_UID");
-                IOVEC_ADD_STRING_FIELD(iovec, n, o->unit, "OBJECT_SYSTEMD_UNIT");
-                IOVEC_ADD_STRING_FIELD(iovec, n, o->user_unit, "OBJECT_SYSTEMD_USER_UNIT");
-                IOVEC_ADD_STRING_FIELD(iovec, n, o->slice, "OBJECT_SYSTEMD_SLICE");
-                IOVEC_ADD_STRING_FIELD(iovec, n, o->user_slice, "OBJECT_SYSTEMD_USER_SLICE");
+                if (o->unit_context) {
+                        const UnitContext *u = o->unit_context;
+
+                        IOVEC_ADD_STRING_FIELD(iovec, n, u->cgroup, "OBJECT_SYSTEMD_CGROUP");
+                        IOVEC_ADD_STRING_FIELD(iovec, n, u->session, "OBJECT_SYSTEMD_SESSION");
+                        IOVEC_ADD_NUMERIC_FIELD(iovec, n, u->owner_uid, uid_t, uid_is_valid, UID_FMT, "OBJECT_SYSTEMD_OWNER_UID");
+                        IOVEC_ADD_STRING_FIELD(iovec, n, u->unit, "OBJECT_SYSTEMD_UNIT");
+                        IOVEC_ADD_STRING_FIELD(iovec, n, u->user_unit, "OBJECT_SYSTEMD_USER_UNIT");
+                        IOVEC_ADD_STRING_FIELD(iovec, n, u->slice, "OBJECT_SYSTEMD_SLICE");
+                        IOVEC_ADD_STRING_FIELD(iovec, n, u->user_slice, "OBJECT_SYSTEMD_USER_SLICE");
 
-                IOVEC_ADD_ID128_FIELD(iovec, n, o->invocation_id, "OBJECT_SYSTEMD_INVOCATION_ID=");
+                        IOVEC_ADD_ID128_FIELD(iovec, n, u->invocation_id, "OBJECT_SYSTEMD_INVOCATION_ID=");
+                }
         }
 
         assert(n <= m);
@@ -1009,17 +1622,25 @@ static void dispatch_message_real(
         if (s->split_mode == SPLIT_UID && c && uid_is_valid(c->uid))
                 /* Split up strictly by (non-root) UID */
                 journal_uid = c->uid;
-        else if (s->split_mode == SPLIT_LOGIN && c && c->uid > 0 && uid_is_valid(c->owner_uid))
+        else if (s->split_mode == SPLIT_LOGIN && c && c->uid > 0 && c->unit_context && uid_is_valid(c->unit_context->owner_uid))
                 /* Split up by login UIDs.  We do this only if the
                  * realuid is not root, in order not to accidentally
                  * leak privileged information to the user that is
                  * logged by a privileged process that is part of an
                  * unprivileged session. */
-                journal_uid = c->owner_uid;
+                journal_uid = c->unit_context->owner_uid;
         else
                 journal_uid = 0;
 
-        write_to_journal(s, journal_uid, iovec, n, priority);
+        hashes = newa(uint64_t, n);
+        for (i = 0; i < n; i++)
+                hashes[i] = i >= context_start && i < context_start + context_n ?
+                        c->fields_hash[i - context_start] :
+                        hash64(iovec[i].iov_base, iovec[i].iov_len);
+
+        server_unit_index_note(s, c, iovec, n);
+
+        write_to_journal(s, journal_uid, iovec, hashes, n, priority);
 }
 
 void server_driver_message(Server *s, pid_t object_pid, const char *message_id, const char *format, ...) {
@@ -1096,18 +1717,22 @@ void server_dispatch_message(
         if (s->storage == STORAGE_NONE)
                 return;
 
-        if (c && c->unit) {
+        if (c && c->unit_context && c->unit_context->unit) {
+                UnitContext *u = c->unit_context;
+
                 (void) determine_space(s, &available, NULL);
 
-                rl = journal_ratelimit_test(s->ratelimit, c->unit, c->log_ratelimit_interval, c->log_ratelimit_burst, priority & LOG_PRIMASK, available);
-                if (rl == 0)
+                rl = journal_ratelimit_test(s->ratelimit, &u->ratelimit_group, u->unit, u->log_ratelimit_interval, u->log_ratelimit_burst, priority & LOG_PRIMASK, available);
+                if (rl == 0) {
+                        metric_inc(s->metrics + SERVER_METRIC_RATELIMIT_DROPPED);
                         return;
+                }
 
                 /* Write a suppression message if we suppressed something */
                 if (rl > 1)
                         server_driver_message(s, c->pid,
                                               "MESSAGE_ID=" SD_MESSAGE_JOURNAL_DROPPED_STR,
-                                              LOG_MESSAGE("Suppressed %i messages from %s", rl - 1, c->unit),
+                                              LOG_MESSAGE("Suppressed %i messages from %s", rl - 1, u->unit),
                                               "N_DROPPED=%i", rl - 1,
                                               NULL);
         }
@@ -1116,6 +1741,7 @@ void server_dispatch_message(
 }
 
 int server_flush_to_var(Server *s, bool require_flag_file) {
+        _cleanup_(journal_file_copy_cache_freep) JournalFileCopyCache *cache = NULL;
         char ts[FORMAT_TIMESPAN_MAX];
         sd_journal *j = NULL;
         const char *fn;
@@ -1167,7 +1793,7 @@ int server_flush_to_var(Server *s, bool require_flag_file) {
                         goto finish;
                 }
 
-                r = journal_file_copy_entry(f, s->system_journal, o, f->current_offset);
+                r = journal_file_copy_entry_with_cache(f, s->system_journal, o, f->current_offset, &cache);
                 if (r >= 0)
                         continue;
 
@@ -1186,7 +1812,7 @@ int server_flush_to_var(Server *s, bool require_flag_file) {
                 }
 
                 log_debug("Retrying write.");
-                r = journal_file_copy_entry(f, s->system_journal, o, f->current_offset);
+                r = journal_file_copy_entry_with_cache(f, s->system_journal, o, f->current_offset, &cache);
                 if (r < 0) {
                         log_error_errno(r, "Can't write entry: %m");
                         goto finish;
@@ -1201,8 +1827,10 @@ finish:
 
         s->runtime_journal = journal_file_close(s->runtime_journal);
 
-        if (r >= 0)
+        if (r >= 0) {
                 (void) rm_rf(s->runtime_storage.path, REMOVE_ROOT);
+                storage_vacuum_index_invalidate(&s->runtime_storage);
+        }
 
         sd_journal_close(j);
 
@@ -1251,83 +1879,44 @@ static int server_relinquish_var(Server *s) {
         return 0;
 }
 
-int server_process_datagram(
-                sd_event_source *es,
+/* We use NAME_MAX space for the SELinux label here. The kernel currently enforces no limit, but according to
+ * suggestions from the SELinux people this will change and it will probably be identical to NAME_MAX. For
+ * now we use that, but this should be updated one day when the final limit is known. */
+typedef union DatagramControl {
+        struct cmsghdr cmsghdr;
+        uint8_t buf[CMSG_SPACE(sizeof(struct ucred)) +
+                    CMSG_SPACE(sizeof(struct timeval)) +
+                    CMSG_SPACE(sizeof(int)) + /* fd */
+                    CMSG_SPACE(NAME_MAX)]; /* selinux label */
+} DatagramControl;
+
+struct DatagramBatch {
+        uint8_t *buffers; /* DATAGRAM_BATCH_MAX slots of DATAGRAM_BATCH_SLOT_SIZE each */
+        struct mmsghdr msgs[DATAGRAM_BATCH_MAX];
+        struct iovec iovecs[DATAGRAM_BATCH_MAX];
+        DatagramControl controls[DATAGRAM_BATCH_MAX];
+};
+
+static void server_dispatch_datagram(
+                Server *s,
                 int fd,
-                uint32_t revents,
-                void *userdata) {
+                struct msghdr *msghdr,
+                char *buffer,
+                size_t n) {
 
-        Server *s = userdata;
         struct ucred *ucred = NULL;
         struct timeval *tv = NULL;
         struct cmsghdr *cmsg;
         char *label = NULL;
-        size_t label_len = 0, m;
-        struct iovec iovec;
-        ssize_t n;
-        int *fds = NULL, v = 0;
+        size_t label_len = 0;
+        int *fds = NULL;
         size_t n_fds = 0;
 
-        union {
-                struct cmsghdr cmsghdr;
-
-                /* We use NAME_MAX space for the SELinux label
-                 * here. The kernel currently enforces no
-                 * limit, but according to suggestions from
-                 * the SELinux people this will change and it
-                 * will probably be identical to NAME_MAX. For
-                 * now we use that, but this should be updated
-                 * one day when the final limit is known. */
-                uint8_t buf[CMSG_SPACE(sizeof(struct ucred)) +
-                            CMSG_SPACE(sizeof(struct timeval)) +
-                            CMSG_SPACE(sizeof(int)) + /* fd */
-                            CMSG_SPACE(NAME_MAX)]; /* selinux label */
-        } control = {};
-
-        union sockaddr_union sa = {};
-
-        struct msghdr msghdr = {
-                .msg_iov = &iovec,
-                .msg_iovlen = 1,
-                .msg_control = &control,
-                .msg_controllen = sizeof(control),
-                .msg_name = &sa,
-                .msg_namelen = sizeof(sa),
-        };
-
         assert(s);
-        assert(fd == s->native_fd || fd == s->syslog_fd || fd == s->audit_fd);
-
-        if (revents != EPOLLIN)
-                return log_error_errno(SYNTHETIC_ERRNO(EIO),
-                                       "Got invalid event from epoll for datagram fd: %" PRIx32,
-                                       revents);
-
-        /* Try to get the right size, if we can. (Not all sockets support SIOCINQ, hence we just try, but don't rely on
-         * it.) */
-        (void) ioctl(fd, SIOCINQ, &v);
-
-        /* Fix it up, if it is too small. We use the same fixed value as auditd here. Awful! */
-        m = PAGE_ALIGN(MAX3((size_t) v + 1,
-                            (size_t) LINE_MAX,
-                            ALIGN(sizeof(struct nlmsghdr)) + ALIGN((size_t) MAX_AUDIT_MESSAGE_LENGTH)) + 1);
-
-        if (!GREEDY_REALLOC(s->buffer, s->buffer_size, m))
-                return log_oom();
-
-        iovec = IOVEC_MAKE(s->buffer, s->buffer_size - 1); /* Leave room for trailing NUL we add later */
-
-        n = recvmsg_safe(fd, &msghdr, MSG_DONTWAIT|MSG_CMSG_CLOEXEC);
-        if (IN_SET(n, -EINTR, -EAGAIN))
-                return 0;
-        if (n == -EXFULL) {
-                log_warning("Got message with truncated control data (too many fds sent?), ignoring.");
-                return 0;
-        }
-        if (n < 0)
-                return log_error_errno(n, "recvmsg() failed: %m");
+        assert(msghdr);
+        assert(buffer);
 
-        CMSG_FOREACH(cmsg, &msghdr)
+        CMSG_FOREACH(cmsg, msghdr)
                 if (cmsg->cmsg_level == SOL_SOCKET &&
                     cmsg->cmsg_type == SCM_CREDENTIALS &&
                     cmsg->cmsg_len == CMSG_LEN(sizeof(struct ucred))) {
@@ -1351,19 +1940,25 @@ int server_process_datagram(
                 }
 
         /* And a trailing NUL, just in case */
-        s->buffer[n] = 0;
+        buffer[n] = 0;
 
         if (fd == s->syslog_fd) {
                 if (n > 0 && n_fds == 0)
-                        server_process_syslog_message(s, s->buffer, n, ucred, tv, label, label_len);
+                        server_process_syslog_message(s, buffer, n, ucred, tv, label, label_len);
                 else if (n_fds > 0)
                         log_warning("Got file descriptors via syslog socket. Ignoring.");
 
         } else if (fd == s->native_fd) {
+                if (s->n_native_rings > 0 && ucred && (n > 0 || n_fds == 1))
+                        server_drain_native_rings(s, ucred->pid);
+
                 if (n > 0 && n_fds == 0)
-                        server_process_native_message(s, s->buffer, n, ucred, tv, label, label_len);
+                        server_process_native_message(s, buffer, n, ucred, tv, label, label_len);
                 else if (n == 0 && n_fds == 1)
                         server_process_native_file(s, fds[0], ucred, tv, label, label_len);
+                else if (n == STRLEN(JOURNAL_RING_COMMAND) && n_fds == 2 &&
+                         memcmp(buffer, JOURNAL_RING_COMMAND, n) == 0)
+                        server_process_native_ring(s, fds, ucred, label, label_len);
                 else if (n_fds > 0)
                         log_warning("Got too many file descriptors via native socket. Ignoring.");
 
@@ -1371,15 +1966,207 @@ int server_process_datagram(
                 assert(fd == s->audit_fd);
 
                 if (n > 0 && n_fds == 0)
-                        server_process_audit_message(s, s->buffer, n, ucred, &sa, msghdr.msg_namelen);
+                        server_process_audit_message(s, buffer, n, ucred, msghdr->msg_name, msghdr->msg_namelen);
                 else if (n_fds > 0)
                         log_warning("Got file descriptors via audit socket. Ignoring.");
         }
 
         close_many(fds, n_fds);
+}
+
+static int server_process_datagram_one(Server *s, int fd) {
+        DatagramControl control = {};
+        union sockaddr_union sa = {};
+        struct iovec iovec;
+        ssize_t n;
+        size_t m;
+        int v = 0;
+
+        struct msghdr msghdr = {
+                .msg_iov = &iovec,
+                .msg_iovlen = 1,
+                .msg_control = &control,
+                .msg_controllen = sizeof(control),
+                .msg_name = &sa,
+                .msg_namelen = sizeof(sa),
+        };
+
+        assert(s);
+
+        /* Try to get the right size, if we can. (Not all sockets support SIOCINQ, hence we just try, but don't rely on
+         * it.) */
+        (void) ioctl(fd, SIOCINQ, &v);
+
+        /* Fix it up, if it is too small. We use the same fixed value as auditd here. Awful! */
+        m = PAGE_ALIGN(MAX3((size_t) v + 1,
+                            (size_t) LINE_MAX,
+                            ALIGN(sizeof(struct nlmsghdr)) + ALIGN((size_t) MAX_AUDIT_MESSAGE_LENGTH)) + 1);
+
+        if (!GREEDY_REALLOC(s->buffer, s->buffer_size, m))
+                return log_oom();
+
+        iovec = IOVEC_MAKE(s->buffer, s->buffer_size - 1); /* Leave room for trailing NUL we add later */
+
+        n = recvmsg_safe(fd, &msghdr, MSG_DONTWAIT|MSG_CMSG_CLOEXEC);
+        if (IN_SET(n, -EINTR, -EAGAIN))
+                return 0;
+        if (n == -EXFULL) {
+                log_warning("Got message with truncated control data (too many fds sent?), ignoring.");
+                return 1;
+        }
+        if (n < 0)
+                return log_error_errno(n, "recvmsg() failed: %m");
+
+        server_dispatch_datagram(s, fd, &msghdr, s->buffer, n);
+        return 1;
+}
+
+static int server_setup_datagram_batch(Server *s) {
+        _cleanup_free_ DatagramBatch *b = NULL;
+        void *p;
+
+        assert(s);
+
+        if (s->datagram_batch)
+                return 1;
+        if (s->datagram_batch_failed)
+                return 0;
+
+        /* The slots have to be large enough for any datagram, since there's no way to find out the size of
+         * anything but the first queued datagram. We hence reserve address space for them, see
+         * DATAGRAM_BATCH_SIZE for the bound. Not worth it on 32bit. */
+        if (sizeof(void*) < 8) {
+                s->datagram_batch_failed = true;
+                return 0;
+        }
+
+        b = new0(DatagramBatch, 1);
+        if (!b)
+                return log_oom();
+
+        p = mmap(NULL, DATAGRAM_BATCH_SIZE, PROT_READ|PROT_WRITE,
+                 MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+        if (p == MAP_FAILED) {
+                log_debug_errno(errno, "Failed to reserve memory for receiving datagrams in batches, receiving them one by one: %m");
+                s->datagram_batch_failed = true;
+                return 0;
+        }
+
+        b->buffers = p;
+        s->datagram_batch = TAKE_PTR(b);
+
+        return 1;
+}
+
+static void server_free_datagram_batch(Server *s) {
+        assert(s);
+
+        if (!s->datagram_batch)
+                return;
+
+        (void) munmap(s->datagram_batch->buffers, DATAGRAM_BATCH_SIZE);
+        s->datagram_batch = mfree(s->datagram_batch);
+}
+
+static int server_process_datagram_batch(Server *s, int fd, unsigned max) {
+        DatagramBatch *b;
+        unsigned i;
+        int n, r, v = 0;
+
+        assert(s);
+        assert(max > 0);
+
+        /* Receives up to max datagrams with a single recvmmsg() call. Returns the number of datagrams we
+         * took off the socket. */
+
+        /* If the first datagram doesn't fit into a slot, read it on its own */
+        if (ioctl(fd, SIOCINQ, &v) >= 0 && (size_t) v >= DATAGRAM_BATCH_SLOT_SIZE)
+                return server_process_datagram_one(s, fd);
+
+        r = server_setup_datagram_batch(s);
+        if (r <= 0)
+                return server_process_datagram_one(s, fd);
+
+        b = s->datagram_batch;
+        max = MIN(max, DATAGRAM_BATCH_MAX);
+
+        for (i = 0; i < max; i++) {
+                b->iovecs[i] = IOVEC_MAKE(b->buffers + (size_t) i * DATAGRAM_BATCH_SLOT_SIZE,
+                                          DATAGRAM_BATCH_SLOT_SIZE - 1); /* Leave room for trailing NUL */
+                b->msgs[i] = (struct mmsghdr) {
+                        .msg_hdr = {
+                                .msg_iov = b->iovecs + i,
+                                .msg_iovlen = 1,
+                                .msg_control = b->controls + i,
+                                .msg_controllen = sizeof(DatagramControl),
+                        },
+                };
+        }
+
+        n = recvmmsg(fd, b->msgs, max, MSG_DONTWAIT|MSG_CMSG_CLOEXEC, NULL);
+        if (n < 0) {
+                if (IN_SET(errno, EINTR, EAGAIN))
+                        return 0;
+
+                return log_error_errno(errno, "recvmmsg() failed: %m");
+        }
+
+        for (i = 0; i < (unsigned) n; i++) {
+                struct msghdr *mh = &b->msgs[i].msg_hdr;
+                size_t l = b->msgs[i].msg_len;
+
+                if (FLAGS_SET(mh->msg_flags, MSG_CTRUNC)) {
+                        cmsg_close_all(mh);
+                        log_warning("Got message with truncated control data (too many fds sent?), ignoring.");
+                } else if (FLAGS_SET(mh->msg_flags, MSG_TRUNC)) {
+                        cmsg_close_all(mh);
+                        log_warning("Got datagram larger than %zu bytes, ignoring.", DATAGRAM_BATCH_SLOT_SIZE - 1);
+                } else
+                        server_dispatch_datagram(s, fd, mh, b->iovecs[i].iov_base, l);
+
+                /* Give back what a large datagram populated, so that the slots don't pin memory */
+                if (l + 1 > DATAGRAM_BATCH_SLOT_KEEP)
+                        (void) madvise((uint8_t*) b->iovecs[i].iov_base + DATAGRAM_BATCH_SLOT_KEEP,
+                                       PAGE_ALIGN(MIN(l + 1, DATAGRAM_BATCH_SLOT_SIZE)) - DATAGRAM_BATCH_SLOT_KEEP,
+                                       MADV_DONTNEED);
+        }
+
+        return n;
+}
+
+int server_process_datagram(
+                sd_event_source *es,
+                int fd,
+                uint32_t revents,
+                void *userdata) {
+
+        Server *s = userdata;
+        unsigned i;
+        int r = 0;
+
+        assert(s);
+        assert(fd == s->native_fd || fd == s->syslog_fd || fd == s->audit_fd);
+
+        if (revents != EPOLLIN)
+                return log_error_errno(SYNTHETIC_ERRNO(EIO),
+                                       "Got invalid event from epoll for datagram fd: %" PRIx32,
+                                       revents);
+
+        /* Drain a number of datagrams per wakeup, and write whatever we got in one go. The audit socket sees
+         * little traffic, there we don't bother with receiving in batches. */
+        server_begin_write_batch(s);
+        for (i = 0; i < DATAGRAMS_PER_WAKEUP_MAX; i += r) {
+                if (fd == s->audit_fd)
+                        r = server_process_datagram_one(s, fd);
+                else
+                        r = server_process_datagram_batch(s, fd, DATAGRAMS_PER_WAKEUP_MAX - i);
+                if (r <= 0)
+                        break;
+        }
+        server_end_write_batch(s);
 
         server_refresh_idle_timer(s);
-        return 0;
+        return r < 0 ? r : 0;
 }
 
 static void server_full_flush(Server *s) {
@@ -2022,6 +2809,51 @@ static int vl_method_relinquish_var(Varlink *link, JsonVariant *parameters, Varl
         return varlink_reply(link, NULL);
 }
 
+static int vl_method_get_event_loop_statistics(Varlink *link, JsonVariant *parameters, VarlinkMethodFlags flags, void *userdata) {
+        _cleanup_free_ char *dump = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+        Server *s = userdata;
+        size_t size;
+        int r;
+
+        assert(link);
+        assert(s);
+
+        if (json_variant_elements(parameters) > 0)
+                return varlink_error_invalid_parameter(link, parameters);
+
+        f = open_memstream_unlocked(&dump, &size);
+        if (!f)
+                return -ENOMEM;
+
+        r = sd_event_dump_statistics(s->event, f);
+        if (r < 0)
+                return r;
+
+        r = fflush_and_check(f);
+        if (r < 0)
+                return r;
+
+        f = safe_fclose(f);
+
+        return varlink_replyb(link, JSON_BUILD_OBJECT(JSON_BUILD_PAIR("statistics", JSON_BUILD_STRING(dump))));
+}
+
+static int vl_method_list_metrics(Varlink *link, JsonVariant *parameters, VarlinkMethodFlags flags, void *userdata) {
+        Server *s = userdata;
+
+        assert(link);
+        assert(s);
+
+        /* These are maintained elsewhere, copy them in only when asked */
+        metric_set(s->metrics + SERVER_METRIC_MMAP_CACHE_HIT, mmap_cache_get_hit(s->mmap));
+        metric_set(s->metrics + SERVER_METRIC_MMAP_CACHE_MISSED, mmap_cache_get_missed(s->mmap));
+        metric_set(s->metrics + SERVER_METRIC_CLIENT_CONTEXTS, hashmap_size(s->client_contexts));
+        metric_set(s->metrics + SERVER_METRIC_STDOUT_STREAMS, s->n_stdout_streams);
+
+        return varlink_reply_metrics(link, parameters, s->metrics, ELEMENTSOF(s->metrics));
+}
+
 static int vl_connect(VarlinkServer *server, Varlink *link, void *userdata) {
         Server *s = userdata;
 
@@ -2057,10 +2889,12 @@ static int server_open_varlink(Server *s, const char *socket, int fd) {
 
         r = varlink_server_bind_method_many(
                         s->varlink_server,
-                        "io.systemd.Journal.Synchronize",   vl_method_synchronize,
-                        "io.systemd.Journal.Rotate",        vl_method_rotate,
-                        "io.systemd.Journal.FlushToVar",    vl_method_flush_to_var,
-                        "io.systemd.Journal.RelinquishVar", vl_method_relinquish_var);
+                        "io.systemd.Journal.Synchronize",            vl_method_synchronize,
+                        "io.systemd.Journal.Rotate",                 vl_method_rotate,
+                        "io.systemd.Journal.FlushToVar",             vl_method_flush_to_var,
+                        "io.systemd.Journal.RelinquishVar",          vl_method_relinquish_var,
+                        "io.systemd.Journal.GetEventLoopStatistics", vl_method_get_event_loop_statistics,
+                        "io.systemd.Metrics.List",                   vl_method_list_metrics);
         if (r < 0)
                 return r;
 
@@ -2106,6 +2940,10 @@ static bool server_is_idle(Server *s) {
         if (s->n_stdout_streams > 0)
                 return false;
 
+        /* Neither if clients write to us via shared memory */
+        if (s->n_native_rings > 0)
+                return false;
+
         return true;
 }
 
@@ -2193,6 +3031,17 @@ static int set_namespace(Server *s, const char *namespace) {
         return 1;
 }
 
+static const Metric server_metrics[_SERVER_METRIC_MAX] = {
+        [SERVER_METRIC_ENTRIES_WRITTEN]       = METRIC_INIT(METRIC_COUNTER,   "entries_written",       "Entries written to journal files"),
+        [SERVER_METRIC_WRITE_BATCH_ENTRIES]   = METRIC_INIT(METRIC_HISTOGRAM, "write_batch_entries",   "Entries queued per write batch"),
+        [SERVER_METRIC_RATELIMIT_DROPPED]     = METRIC_INIT(METRIC_COUNTER,   "ratelimit_dropped",     "Messages dropped by the per-unit rate limit"),
+        [SERVER_METRIC_FORWARD_SYSLOG_MISSED] = METRIC_INIT(METRIC_COUNTER,   "forward_syslog_missed", "Messages that could not be forwarded to syslog"),
+        [SERVER_METRIC_MMAP_CACHE_HIT]        = METRIC_INIT(METRIC_COUNTER,   "mmap_cache_hit",        "Lookups served from the mmap cache"),
+        [SERVER_METRIC_MMAP_CACHE_MISSED]     = METRIC_INIT(METRIC_COUNTER,   "mmap_cache_missed",     "Lookups that required a new mapping"),
+        [SERVER_METRIC_CLIENT_CONTEXTS]       = METRIC_INIT(METRIC_GAUGE,     "client_contexts",       "Cached client metadata contexts"),
+        [SERVER_METRIC_STDOUT_STREAMS]        = METRIC_INIT(METRIC_GAUGE,     "stdout_streams",        "Connected stdout streams"),
+};
+
 int server_init(Server *s, const char *namespace) {
         const char *native_socket, *syslog_socket, *stdout_socket, *varlink_socket, *e;
         _cleanup_fdset_free_ FDSet *fds = NULL;
@@ -2209,9 +3058,11 @@ int server_init(Server *s, const char *namespace) {
                 .audit_fd = -1,
                 .hostname_fd = -1,
                 .notify_fd = -1,
+                .unit_index_fd = -1,
 
                 .compress.enabled = true,
                 .compress.threshold_bytes = (uint64_t) -1,
+                .compress.algorithm = DEFAULT_COMPRESSION,
                 .seal = true,
 
                 .set_audit = true,
@@ -2240,6 +3091,8 @@ int server_init(Server *s, const char *namespace) {
                 .system_storage.name = "System Journal",
         };
 
+        memcpy(s->metrics, server_metrics, sizeof(s->metrics));
+
         r = set_namespace(s, namespace);
         if (r < 0)
                 return r;
@@ -2266,6 +3119,14 @@ int server_init(Server *s, const char *namespace) {
                 s->ratelimit_interval = s->ratelimit_burst = 0;
         }
 
+        e = secure_getenv("SYSTEMD_JOURNAL_COMPRESS_THREADS");
+        if (e) {
+                if (safe_atou(e, &s->n_compress_threads) < 0)
+                        log_debug("Failed to parse $SYSTEMD_JOURNAL_COMPRESS_THREADS, ignoring: %s", e);
+                else
+                        s->n_compress_threads = MIN(s->n_compress_threads, COMPRESS_THREADS_MAX);
+        }
+
         e = getenv("RUNTIME_DIRECTORY");
         if (e)
                 s->runtime_directory = strdup(e);
@@ -2278,6 +3139,8 @@ int server_init(Server *s, const char *namespace) {
 
         (void) mkdir_p(s->runtime_directory, 0755);
 
+        server_unit_index_open(s);
+
         s->user_journals = ordered_hashmap_new(NULL);
         if (!s->user_journals)
                 return log_oom();
@@ -2476,11 +3339,16 @@ void server_done(Server *s) {
         free(s->namespace);
         free(s->namespace_field);
 
+        server_finish_vacuum(s, false);
+
         set_free_with_destructor(s->deferred_closes, journal_file_close);
 
         while (s->stdout_streams)
                 stdout_stream_free(s->stdout_streams);
 
+        while (s->native_rings)
+                native_ring_free(s->native_rings);
+
         client_context_flush_all(s);
 
         (void) journal_file_close(s->system_journal);
@@ -2511,6 +3379,7 @@ void server_done(Server *s) {
         safe_close(s->native_fd);
         safe_close(s->stdout_fd);
         safe_close(s->dev_kmsg_fd);
+        hashmap_free(s->kmsg_devices);
         safe_close(s->audit_fd);
         safe_close(s->hostname_fd);
         safe_close(s->notify_fd);
@@ -2521,13 +3390,25 @@ void server_done(Server *s) {
         if (s->kernel_seqnum)
                 munmap(s->kernel_seqnum, sizeof(uint64_t));
 
+        for (size_t i = 0; i < s->n_pending_entries; i++)
+                free(s->pending_entries[i].iovec);
+        free(s->pending_entries);
+
+        /* Forwarded messages are only queued during a write batch, hence there's nothing left to free in them */
+        free(s->syslog_forward_queue);
+        free(s->console_forward_buffer);
+
         free(s->buffer);
+        server_free_datagram_batch(s);
         free(s->tty_path);
         free(s->cgroup_root);
         free(s->hostname_field);
+        journal_vacuum_index_free(s->runtime_storage.vacuum_index);
+        journal_vacuum_index_free(s->system_storage.vacuum_index);
         free(s->runtime_storage.path);
         free(s->system_storage.path);
         free(s->runtime_directory);
+        server_unit_index_close(s);
 
         mmap_cache_unref(s->mmap);
 }
@@ -2644,3 +3525,50 @@ int config_parse_compress(
 
         return 0;
 }
+
+int config_parse_compress_algorithm(
+                const char* unit,
+                const char *filename,
+                unsigned line,
+                const char *section,
+                unsigned section_line,
+                const char *lvalue,
+                int ltype,
+                const char *rvalue,
+                void *data,
+                void *userdata) {
+
+        static const int algorithms[] = {
+                OBJECT_COMPRESSED_XZ,
+                OBJECT_COMPRESSED_LZ4,
+                OBJECT_COMPRESSED_ZSTD,
+        };
+        JournalCompressOptions* compress = data;
+        int c = 0;
+        size_t i;
+
+        if (isempty(rvalue)) {
+                compress->algorithm = DEFAULT_COMPRESSION;
+                return 0;
+        }
+
+        for (i = 0; i < ELEMENTSOF(algorithms); i++)
+                if (strcaseeq(rvalue, object_compressed_to_string(algorithms[i]))) {
+                        c = algorithms[i];
+                        break;
+                }
+        if (c == 0) {
+                log_syntax(unit, LOG_ERR, filename, line, 0,
+                           "Failed to parse compression algorithm, ignoring: %s", rvalue);
+                return 0;
+        }
+
+        if (!compression_supported(c)) {
+                log_syntax(unit, LOG_WARNING, filename, line, 0,
+                           "Compression algorithm %s is not supported by this build, ignoring.", rvalue);
+                return 0;
+        }
+
+        compress->algorithm = c;
+        return 0;
+}
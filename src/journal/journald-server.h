@@ -11,11 +11,15 @@ typedef struct Server Server;
 #include "conf-parser.h"
 #include "hashmap.h"
 #include "journal-file.h"
+#include "journal-vacuum.h"
 #include "journald-context.h"
 #include "journald-rate-limit.h"
+#include "journald-ring.h"
 #include "journald-stream.h"
 #include "list.h"
+#include "metrics.h"
 #include "prioq.h"
+#include "string-pool.h"
 #include "time-util.h"
 #include "varlink.h"
 
@@ -28,6 +32,18 @@ typedef enum Storage {
         _STORAGE_INVALID = -1
 } Storage;
 
+typedef enum ServerMetric {
+        SERVER_METRIC_ENTRIES_WRITTEN,
+        SERVER_METRIC_WRITE_BATCH_ENTRIES,
+        SERVER_METRIC_RATELIMIT_DROPPED,
+        SERVER_METRIC_FORWARD_SYSLOG_MISSED,
+        SERVER_METRIC_MMAP_CACHE_HIT,
+        SERVER_METRIC_MMAP_CACHE_MISSED,
+        SERVER_METRIC_CLIENT_CONTEXTS,
+        SERVER_METRIC_STDOUT_STREAMS,
+        _SERVER_METRIC_MAX,
+} ServerMetric;
+
 typedef enum SplitMode {
         SPLIT_UID,
         SPLIT_LOGIN, /* deprecated */
@@ -39,6 +55,7 @@ typedef enum SplitMode {
 typedef struct JournalCompressOptions {
         bool enabled;
         uint64_t threshold_bytes;
+        int algorithm; /* OBJECT_COMPRESSED_xyz */
 } JournalCompressOptions;
 
 typedef struct JournalStorageSpace {
@@ -51,12 +68,33 @@ typedef struct JournalStorageSpace {
         uint64_t vfs_available;
 } JournalStorageSpace;
 
+typedef struct PendingEntry {
+        uid_t uid;
+        int priority;
+        dual_timestamp ts;
+        struct iovec *iovec; /* the iovec array, followed by the hashes and the data it points to */
+        uint64_t *hashes;
+        size_t n_iovec;
+} PendingEntry;
+
+typedef struct SyslogForward SyslogForward;
+
+typedef struct DatagramBatch DatagramBatch;
+typedef struct VacuumJob VacuumJob;
+
 typedef struct JournalStorage {
         const char *name;
         char *path;
 
         JournalMetrics metrics;
         JournalStorageSpace space;
+
+        /* The files in the directory, so that we don't have to look at all of them each time. While the
+         * background vacuuming uses the index, what we learn about the directory is queued up. */
+        JournalVacuumIndex *vacuum_index;
+        bool vacuum_index_busy;
+        bool vacuum_index_stale;
+        char **vacuum_index_pending;
 } JournalStorage;
 
 struct Server {
@@ -97,6 +135,10 @@ struct Server {
         char *buffer;
         size_t buffer_size;
 
+        /* Buffers for receiving multiple datagrams at once, allocated on first use */
+        DatagramBatch *datagram_batch;
+        bool datagram_batch_failed;
+
         JournalRateLimit *ratelimit;
         usec_t sync_interval_usec;
         usec_t ratelimit_interval;
@@ -126,6 +168,9 @@ struct Server {
         LIST_HEAD(StdoutStream, stdout_streams_notify_queue);
         unsigned n_stdout_streams;
 
+        LIST_HEAD(NativeRing, native_rings);
+        unsigned n_native_rings;
+
         char *tty_path;
 
         int max_level_store;
@@ -141,9 +186,16 @@ struct Server {
 
         Set *deferred_closes;
 
+        /* Vacuuming running in the background, and whether another one was asked for in the meantime */
+        VacuumJob *vacuum_job;
+        bool vacuum_pending;
+
         uint64_t *kernel_seqnum;
         bool dev_kmsg_readable:1;
 
+        /* kernel device id → udev fields, so that we don't look up the device for each kernel message */
+        Hashmap *kmsg_devices;
+
         bool send_watchdog:1;
         bool sent_notify_ready:1;
         bool sync_scheduled:1;
@@ -154,6 +206,10 @@ struct Server {
         char *namespace_field;
         char *runtime_directory;
 
+        /* Units that logged something during this boot, see journald-unit-index.c */
+        int unit_index_fd;
+        Set *unit_index;
+
         /* Cached cgroup root, so that we don't have to query that all the time */
         char *cgroup_root;
 
@@ -166,6 +222,8 @@ struct Server {
         /* Caching of client metadata */
         Hashmap *client_contexts;
         Prioq *client_contexts_lru;
+        Hashmap *unit_contexts; /* cgroup path → UnitContext, shared by the client contexts */
+        StringPool *strings; /* interned strings of the client and unit contexts */
 
         usec_t last_cache_pid_flush;
 
@@ -173,6 +231,23 @@ struct Server {
         ClientContext *pid1_context; /* the context of PID 1 */
 
         VarlinkServer *varlink_server;
+
+        /* Entries queued between server_begin_write_batch() and server_end_write_batch() */
+        PendingEntry *pending_entries;
+        size_t n_pending_entries, n_pending_entries_allocated;
+        unsigned write_batch_depth;
+
+        /* Messages to forward to syslog and the console, sent out in one go at the end of a write batch */
+        SyslogForward *syslog_forward_queue;
+        size_t n_syslog_forward_queue;
+        char *console_forward_buffer;
+        size_t console_forward_buffer_size, console_forward_buffer_allocated;
+
+        /* Threads to compress large fields of a batch on, see $SYSTEMD_JOURNAL_COMPRESS_THREADS */
+        unsigned n_compress_threads;
+
+        /* Exported via io.systemd.Metrics.List */
+        Metric metrics[_SERVER_METRIC_MAX];
 };
 
 #define SERVER_MACHINE_ID(s) ((s)->machine_id_field + STRLEN("_MACHINE_ID="))
@@ -201,6 +276,7 @@ const struct ConfigPerfItem* journald_gperf_lookup(const char *key, GPERF_LEN_TY
 CONFIG_PARSER_PROTOTYPE(config_parse_storage);
 CONFIG_PARSER_PROTOTYPE(config_parse_line_max);
 CONFIG_PARSER_PROTOTYPE(config_parse_compress);
+CONFIG_PARSER_PROTOTYPE(config_parse_compress_algorithm);
 
 const char *storage_to_string(Storage s) _const_;
 Storage storage_from_string(const char *s) _pure_;
@@ -214,8 +290,11 @@ int server_init(Server *s, const char *namespace);
 void server_done(Server *s);
 void server_sync(Server *s);
 int server_vacuum(Server *s, bool verbose);
+void server_vacuum_in_background(Server *s);
 void server_rotate(Server *s);
 int server_schedule_sync(Server *s, int priority);
+void server_begin_write_batch(Server *s);
+void server_end_write_batch(Server *s);
 int server_flush_to_var(Server *s, bool require_flag_file);
 void server_maybe_append_tags(Server *s);
 int server_process_datagram(sd_event_source *es, int fd, uint32_t revents, void *userdata);
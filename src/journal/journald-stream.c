@@ -26,6 +26,7 @@
 #include "journald-stream.h"
 #include "journald-syslog.h"
 #include "journald-wall.h"
+#include "memory-util.h"
 #include "mkdir.h"
 #include "parse-util.h"
 #include "process-util.h"
@@ -440,19 +441,18 @@ static int stdout_stream_scan(StdoutStream *s, bool force_flush) {
         for (;;) {
                 LineBreak line_break;
                 size_t skip;
-                char *end1, *end2;
+                char *end;
 
-                end1 = memchr(p, '\n', remaining);
-                end2 = memchr(p, 0, end1 ? (size_t) (end1 - p) : remaining);
+                end = memchr3(p, remaining, '\n', 0, 0);
 
-                if (end2) {
+                if (end && *end == 0) {
                         /* We found a NUL terminator */
-                        skip = end2 - p + 1;
+                        skip = end - p + 1;
                         line_break = LINE_BREAK_NUL;
-                } else if (end1) {
+                } else if (end) {
                         /* We found a \n terminator */
-                        *end1 = 0;
-                        skip = end1 - p + 1;
+                        *end = 0;
+                        skip = end - p + 1;
                         line_break = LINE_BREAK_NEWLINE;
                 } else if (remaining >= s->server->line_max) {
                         /* Force a line break after the maximum line length */
@@ -488,7 +488,7 @@ static int stdout_stream_scan(StdoutStream *s, bool force_flush) {
         return 0;
 }
 
-static int stdout_stream_process(sd_event_source *es, int fd, uint32_t revents, void *userdata) {
+static int stdout_stream_process_one(sd_event_source *es, int fd, uint32_t revents, void *userdata) {
         uint8_t buf[CMSG_SPACE(sizeof(struct ucred))];
         StdoutStream *s = userdata;
         struct ucred *ucred;
@@ -569,6 +569,24 @@ terminate:
         return 0;
 }
 
+static int stdout_stream_process(sd_event_source *es, int fd, uint32_t revents, void *userdata) {
+        StdoutStream *stream = userdata;
+        Server *s;
+        int r;
+
+        assert(stream);
+
+        /* The stream might be destroyed while processing it, hence remember the server */
+        s = stream->server;
+
+        /* Write all lines we got out of this read in one go */
+        server_begin_write_batch(s);
+        r = stdout_stream_process_one(es, fd, revents, userdata);
+        server_end_write_batch(s);
+
+        return r;
+}
+
 int stdout_stream_install(Server *s, int fd, StdoutStream **ret) {
         _cleanup_(stdout_stream_freep) StdoutStream *stream = NULL;
         sd_id128_t id;
@@ -25,90 +25,177 @@
 /* Warn once every 30s if we missed syslog message */
 #define WARN_FORWARD_SYSLOG_MISSED_USEC (30 * USEC_PER_SEC)
 
-static void forward_syslog_iovec(
-                Server *s,
-                const struct iovec *iovec,
-                unsigned n_iovec,
-                const struct ucred *ucred,
-                const struct timeval *tv) {
+/* How many forwarded messages we queue up at most, and hence send with a single sendmmsg() call */
+#define FORWARD_SYSLOG_QUEUE_MAX 64U
 
-        union sockaddr_union sa;
+struct SyslogForward {
+        void *data;
+        size_t size;
+        struct ucred ucred;
+        bool has_ucred;
+};
 
-        struct msghdr msghdr = {
-                .msg_iov = (struct iovec *) iovec,
-                .msg_iovlen = n_iovec,
-        };
-        struct cmsghdr *cmsg;
+void server_flush_forward_syslog(Server *s) {
         union {
                 struct cmsghdr cmsghdr;
                 uint8_t buf[CMSG_SPACE(sizeof(struct ucred))];
-        } control;
+        } control[FORWARD_SYSLOG_QUEUE_MAX];
+        struct mmsghdr msgs[FORWARD_SYSLOG_QUEUE_MAX];
+        struct iovec iovecs[FORWARD_SYSLOG_QUEUE_MAX];
+        union sockaddr_union sa;
+        size_t i, n, done = 0;
+        socklen_t salen;
         const char *j;
         int r;
 
         assert(s);
-        assert(iovec);
-        assert(n_iovec > 0);
+
+        n = s->n_syslog_forward_queue;
+        if (n == 0)
+                return;
 
         j = strjoina(s->runtime_directory, "/syslog");
         r = sockaddr_un_set_path(&sa.un, j);
         if (r < 0) {
                 log_debug_errno(r, "Forwarding socket path %s too long for AF_UNIX, not forwarding: %m", j);
-                return;
+                goto finish;
         }
-
-        msghdr.msg_name = &sa.sa;
-        msghdr.msg_namelen = r;
-
-        if (ucred) {
-                zero(control);
-                msghdr.msg_control = &control;
-                msghdr.msg_controllen = sizeof(control);
-
-                cmsg = CMSG_FIRSTHDR(&msghdr);
+        salen = r;
+
+        for (i = 0; i < n; i++) {
+                SyslogForward *f = s->syslog_forward_queue + i;
+                struct msghdr *mh = &msgs[i].msg_hdr;
+                struct cmsghdr *cmsg;
+
+                iovecs[i] = IOVEC_MAKE(f->data, f->size);
+                *mh = (struct msghdr) {
+                        .msg_name = &sa.sa,
+                        .msg_namelen = salen,
+                        .msg_iov = iovecs + i,
+                        .msg_iovlen = 1,
+                };
+                msgs[i].msg_len = 0;
+
+                if (!f->has_ucred)
+                        continue;
+
+                zero(control[i]);
+                mh->msg_control = &control[i];
+                mh->msg_controllen = sizeof(control[i]);
+
+                cmsg = CMSG_FIRSTHDR(mh);
                 cmsg->cmsg_level = SOL_SOCKET;
                 cmsg->cmsg_type = SCM_CREDENTIALS;
                 cmsg->cmsg_len = CMSG_LEN(sizeof(struct ucred));
-                memcpy(CMSG_DATA(cmsg), ucred, sizeof(struct ucred));
-                msghdr.msg_controllen = cmsg->cmsg_len;
+                memcpy(CMSG_DATA(cmsg), &f->ucred, sizeof(struct ucred));
+                mh->msg_controllen = cmsg->cmsg_len;
         }
 
-        /* Forward the syslog message we received via /dev/log to
+        /* Forward the syslog messages we received via /dev/log to
          * /run/systemd/syslog. Unfortunately we currently can't set
          * the SO_TIMESTAMP auxiliary data, and hence we don't. */
 
-        if (sendmsg(s->syslog_fd, &msghdr, MSG_NOSIGNAL) >= 0)
-                return;
+        while (done < n) {
+                SyslogForward *f;
+                int k;
 
-        /* The socket is full? I guess the syslog implementation is
-         * too slow, and we shouldn't wait for that... */
-        if (errno == EAGAIN) {
-                s->n_forward_syslog_missed++;
-                return;
+                k = sendmmsg(s->syslog_fd, msgs + done, n - done, MSG_NOSIGNAL);
+                if (k > 0) {
+                        done += k;
+                        continue;
+                }
+                if (k == 0)
+                        break;
+
+                /* The socket is full? I guess the syslog implementation is
+                 * too slow, and we shouldn't wait for that... Drop the rest
+                 * of the batch, but keep count. */
+                if (errno == EAGAIN) {
+                        s->n_forward_syslog_missed += n - done;
+                        metric_add(s->metrics + SERVER_METRIC_FORWARD_SYSLOG_MISSED, n - done);
+                        break;
+                }
+
+                /* Nobody listening? Then there's no point in trying the rest either. */
+                if (errno == ENOENT)
+                        break;
+
+                f = s->syslog_forward_queue + done;
+                if (f->has_ucred && IN_SET(errno, ESRCH, EPERM) && f->ucred.pid != getpid_cached()) {
+
+                        /* Hmm, presumably the sender process vanished
+                         * by now, or we don't have CAP_SYS_AMDIN, so
+                         * let's fix it as good as we can, and retry */
+
+                        f->ucred.pid = getpid_cached();
+                        memcpy(CMSG_DATA(CMSG_FIRSTHDR(&msgs[done].msg_hdr)), &f->ucred, sizeof(struct ucred));
+                        continue;
+                }
+
+                log_debug_errno(errno, "Failed to forward syslog message: %m");
+                done++;
         }
 
-        if (ucred && IN_SET(errno, ESRCH, EPERM)) {
-                struct ucred u;
+finish:
+        for (i = 0; i < n; i++)
+                free(s->syslog_forward_queue[i].data);
 
-                /* Hmm, presumably the sender process vanished
-                 * by now, or we don't have CAP_SYS_AMDIN, so
-                 * let's fix it as good as we can, and retry */
+        s->n_syslog_forward_queue = 0;
+}
 
-                u = *ucred;
-                u.pid = getpid_cached();
-                memcpy(CMSG_DATA(cmsg), &u, sizeof(struct ucred));
+static void forward_syslog_iovec(
+                Server *s,
+                const struct iovec *iovec,
+                unsigned n_iovec,
+                const struct ucred *ucred,
+                const struct timeval *tv) {
 
-                if (sendmsg(s->syslog_fd, &msghdr, MSG_NOSIGNAL) >= 0)
-                        return;
+        size_t sz = 0;
+        uint8_t *p;
+        unsigned i;
 
-                if (errno == EAGAIN) {
+        assert(s);
+        assert(iovec);
+        assert(n_iovec > 0);
+
+        /* Messages forwarded during a write batch are queued up and sent together at its end, see
+         * server_end_write_batch(). Outside of a batch they are sent right away. If we cannot queue the
+         * message, it is accounted as missed, like when the syslog implementation is too slow. */
+
+        if (!s->syslog_forward_queue) {
+                s->syslog_forward_queue = new(SyslogForward, FORWARD_SYSLOG_QUEUE_MAX);
+                if (!s->syslog_forward_queue) {
                         s->n_forward_syslog_missed++;
+                        metric_inc(s->metrics + SERVER_METRIC_FORWARD_SYSLOG_MISSED);
                         return;
                 }
         }
 
-        if (errno != ENOENT)
-                log_debug_errno(errno, "Failed to forward syslog message: %m");
+        if (s->n_syslog_forward_queue >= FORWARD_SYSLOG_QUEUE_MAX)
+                server_flush_forward_syslog(s);
+
+        for (i = 0; i < n_iovec; i++)
+                sz += iovec[i].iov_len;
+
+        p = malloc(MAX(sz, 1U));
+        if (!p) {
+                s->n_forward_syslog_missed++;
+                metric_inc(s->metrics + SERVER_METRIC_FORWARD_SYSLOG_MISSED);
+                return;
+        }
+
+        s->syslog_forward_queue[s->n_syslog_forward_queue++] = (SyslogForward) {
+                .data = p,
+                .size = sz,
+                .ucred = ucred ? *ucred : (struct ucred) {},
+                .has_ucred = ucred,
+        };
+
+        for (i = 0; i < n_iovec; i++)
+                p = mempcpy(p, iovec[i].iov_base, iovec[i].iov_len);
+
+        if (s->write_batch_depth == 0)
+                server_flush_forward_syslog(s);
 }
 
 static void forward_syslog_raw(Server *s, int priority, const char *buffer, size_t buffer_len, const struct ucred *ucred, const struct timeval *tv) {
@@ -0,0 +1,169 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <fcntl.h>
+
+#include "alloc-util.h"
+#include "fd-util.h"
+#include "fileio.h"
+#include "journald-unit-index.h"
+#include "mkdir.h"
+#include "set.h"
+#include "stdio-util.h"
+#include "string-util.h"
+#include "unit-name.h"
+
+/* We maintain a directory in /run with one empty file for each unit that logged something during this
+ * boot, i.e. for each value of the fields add_matches_for_unit() looks at. The ".since" file in it contains
+ * the CLOCK_MONOTONIC timestamp since when this is done. This allows "systemctl status" to skip searching
+ * the journal for units that didn't log anything since they were started. Only the default namespace has
+ * this index.
+ *
+ * The index may only ever err on the side of listing too many units, hence if we fail to record a unit, the
+ * ".since" file is removed to make readers ignore the index. */
+
+static void server_unit_index_invalidate(Server *s) {
+        assert(s);
+
+        if (s->unit_index_fd < 0)
+                return;
+
+        if (unlinkat(s->unit_index_fd, ".since", 0) < 0 && errno != ENOENT)
+                log_warning_errno(errno, "Failed to remove unit index timestamp, ignoring: %m");
+
+        server_unit_index_close(s);
+}
+
+void server_unit_index_open(Server *s) {
+        _cleanup_close_ int fd = -1;
+        const char *p;
+        int r;
+
+        assert(s);
+
+        if (s->namespace)
+                return;
+
+        p = strjoina(s->runtime_directory, "/units");
+
+        (void) mkdir_p(p, 0755);
+
+        fd = open(p, O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+        if (fd < 0) {
+                log_debug_errno(errno, "Failed to open unit index directory %s, ignoring: %m", p);
+                return;
+        }
+
+        /* If the timestamp exists already, a previous instance of ours maintained the index up to now, and
+         * we simply continue. Otherwise start a new one, which is valid from now on. */
+        if (faccessat(fd, ".since", F_OK, 0) < 0) {
+                char buf[DECIMAL_STR_MAX(usec_t)];
+
+                if (errno != ENOENT) {
+                        log_debug_errno(errno, "Failed to check unit index timestamp, ignoring: %m");
+                        return;
+                }
+
+                xsprintf(buf, USEC_FMT, now(CLOCK_MONOTONIC));
+
+                p = strjoina(p, "/.since");
+                r = write_string_file(p, buf, WRITE_STRING_FILE_CREATE|WRITE_STRING_FILE_ATOMIC);
+                if (r < 0) {
+                        log_debug_errno(r, "Failed to write unit index timestamp, ignoring: %m");
+                        return;
+                }
+        }
+
+        s->unit_index_fd = TAKE_FD(fd);
+}
+
+void server_unit_index_close(Server *s) {
+        assert(s);
+
+        s->unit_index_fd = safe_close(s->unit_index_fd);
+        s->unit_index = set_free_free(s->unit_index);
+}
+
+static void server_unit_index_add(Server *s, const char *p, size_t l) {
+        char name[UNIT_NAME_MAX + 1];
+        _cleanup_free_ char *copy = NULL;
+        _cleanup_close_ int fd = -1;
+        int r;
+
+        assert(s);
+        assert(p);
+
+        if (l == 0 || l > UNIT_NAME_MAX)
+                return;
+
+        memcpy(name, p, l);
+        name[l] = 0;
+
+        if (set_contains(s->unit_index, name))
+                return;
+
+        /* Readers only ever look for valid unit names, let's not create any other files */
+        if (!unit_name_is_valid(name, UNIT_NAME_ANY))
+                return;
+
+        if (set_size(s->unit_index) >= UNIT_INDEX_MAX) {
+                log_debug("Too many units in unit index, invalidating it.");
+                server_unit_index_invalidate(s);
+                return;
+        }
+
+        fd = openat(s->unit_index_fd, name, O_WRONLY|O_CREAT|O_CLOEXEC|O_NOCTTY|O_NOFOLLOW, 0644);
+        if (fd < 0) {
+                log_warning_errno(errno, "Failed to add %s to unit index, invalidating it: %m", name);
+                server_unit_index_invalidate(s);
+                return;
+        }
+
+        copy = strdup(name);
+        if (!copy)
+                goto fail;
+
+        r = set_ensure_allocated(&s->unit_index, &string_hash_ops);
+        if (r < 0)
+                goto fail;
+
+        r = set_put(s->unit_index, copy);
+        if (r < 0)
+                goto fail;
+
+        TAKE_PTR(copy);
+        return;
+
+fail:
+        /* The file exists, we just don't remember that. Not fatal, we'll try again next time. */
+        log_oom();
+}
+
+void server_unit_index_note(Server *s, const ClientContext *c, const struct iovec *iovec, size_t n) {
+        bool from_pid1, from_root;
+        size_t i;
+
+        assert(s);
+        assert(iovec || n == 0);
+
+        if (s->unit_index_fd < 0)
+                return;
+
+        /* Except for _SYSTEMD_UNIT=, add_matches_for_unit() only looks at the unit fields when they come
+         * from PID 1 or root. Don't let anybody else fill the index with names that are never looked for. */
+        from_pid1 = c && c->pid == 1;
+        from_root = c && c->uid == 0;
+
+        for (i = 0; i < n && s->unit_index_fd >= 0; i++) {
+                const char *p = iovec[i].iov_base, *v;
+                size_t l = iovec[i].iov_len;
+
+                if (l < STRLEN("UNIT=") || !IN_SET(p[0], '_', 'U', 'C', 'O'))
+                        continue;
+
+                if ((v = memory_startswith(p, l, "_SYSTEMD_UNIT=")) ||
+                    (from_pid1 && (v = memory_startswith(p, l, "UNIT="))) ||
+                    (from_root && (v = memory_startswith(p, l, "COREDUMP_UNIT="))) ||
+                    (from_root && (v = memory_startswith(p, l, "OBJECT_SYSTEMD_UNIT="))))
+                        server_unit_index_add(s, v, l - (v - p));
+        }
+}
@@ -0,0 +1,16 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+#include <sys/uio.h>
+
+#include "journald-context.h"
+#include "journald-server.h"
+
+/* Upper limit on the number of units we track. If more units log than this, the index is invalidated, so
+ * that readers fall back to searching the journal. */
+#define UNIT_INDEX_MAX 65536U
+
+void server_unit_index_open(Server *s);
+void server_unit_index_close(Server *s);
+
+void server_unit_index_note(Server *s, const ClientContext *c, const struct iovec *iovec, size_t n);
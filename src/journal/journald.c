@@ -77,7 +77,7 @@ int main(int argc, char *argv[]) {
                         if (server.oldest_file_usec + server.max_retention_usec < n) {
                                 log_info("Retention time reached.");
                                 server_rotate(&server);
-                                server_vacuum(&server, false);
+                                server_vacuum_in_background(&server);
                                 continue;
                         }
 
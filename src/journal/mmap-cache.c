@@ -50,12 +50,14 @@ struct MMapFileDescriptor {
         MMapCache *cache;
         int fd;
         bool sigbus;
+        MMapAccess access;
         LIST_HEAD(Window, windows);
 };
 
 struct MMapCache {
         unsigned n_ref;
         unsigned n_windows;
+        uint64_t n_mapped_bytes;
 
         unsigned n_hit, n_missed;
 
@@ -66,13 +68,23 @@ struct MMapCache {
         Window *last_unused;
 };
 
+/* Keep at least this many windows around before we start reusing unused ones, plus a few more for each file,
+ * so that interleaving many files doesn't evict each others windows all the time. */
 #define WINDOWS_MIN 64
+#define WINDOWS_PER_FD 4
+
+/* Once we have this much mapped, always reuse unused windows instead of allocating new ones. We are much
+ * more constrained on 32bit archs. */
+#define MAPPED_BYTES_MAX (sizeof(void*) >= 8 ? 64ULL*1024ULL*1024ULL*1024ULL : 512ULL*1024ULL*1024ULL)
 
 #if ENABLE_DEBUG_MMAP_CACHE
 /* Tiny windows increase mmap activity and the chance of exposing unsafe use. */
 # define WINDOW_SIZE (page_size())
+# define SEQUENTIAL_WINDOW_SIZE (page_size())
 #else
 # define WINDOW_SIZE (8ULL*1024ULL*1024ULL)
+/* Files that are scanned sequentially get bigger windows, if we can afford the address space */
+# define SEQUENTIAL_WINDOW_SIZE (sizeof(void*) >= 8 ? 32ULL*1024ULL*1024ULL : WINDOW_SIZE)
 #endif
 
 MMapCache* mmap_cache_new(void) {
@@ -91,8 +103,10 @@ static void window_unlink(Window *w) {
 
         assert(w);
 
-        if (w->ptr)
+        if (w->ptr) {
                 munmap(w->ptr, w->size);
+                w->cache->n_mapped_bytes -= w->size;
+        }
 
         if (w->fd)
                 LIST_REMOVE(by_fd, w->fd->windows, w);
@@ -159,7 +173,9 @@ static Window *window_add(MMapCache *m, MMapFileDescriptor *f, int prot, bool ke
         assert(m);
         assert(f);
 
-        if (!m->last_unused || m->n_windows <= WINDOWS_MIN) {
+        if (!m->last_unused ||
+            (m->n_windows <= MAX(WINDOWS_MIN, hashmap_size(m->fds) * WINDOWS_PER_FD) &&
+             m->n_mapped_bytes + size <= MAPPED_BYTES_MAX)) {
 
                 /* Allocate a new window */
                 w = new(Window, 1);
@@ -184,6 +200,7 @@ static Window *window_add(MMapCache *m, MMapFileDescriptor *f, int prot, bool ke
         };
 
         LIST_PREPEND(by_fd, f->windows, w);
+        m->n_mapped_bytes += size;
 
         return w;
 }
@@ -430,7 +447,7 @@ static int add_mmap(
                 void **ret,
                 size_t *ret_size) {
 
-        uint64_t woffset, wsize;
+        uint64_t woffset, wsize, window_size;
         Context *c;
         Window *w;
         void *d;
@@ -442,21 +459,38 @@ static int add_mmap(
         assert(size > 0);
         assert(ret);
 
+        window_size = f->access == MMAP_ACCESS_RANDOM ? WINDOW_SIZE : SEQUENTIAL_WINDOW_SIZE;
+
         woffset = offset & ~((uint64_t) page_size() - 1ULL);
         wsize = size + (offset - woffset);
         wsize = PAGE_ALIGN(wsize);
 
-        if (wsize < WINDOW_SIZE) {
+        if (wsize < window_size) {
                 uint64_t delta;
 
-                delta = PAGE_ALIGN((WINDOW_SIZE - wsize) / 2);
+                /* Center the window around the requested range for random access. When reading sequentially
+                 * most of the window should be in front of us, but keep a bit behind, since referenced
+                 * objects are usually located before the object referencing them. */
+                switch (f->access) {
+
+                case MMAP_ACCESS_FORWARD:
+                        delta = PAGE_ALIGN((window_size - wsize) / 8);
+                        break;
+
+                case MMAP_ACCESS_BACKWARD:
+                        delta = PAGE_ALIGN((window_size - wsize) / 8 * 7);
+                        break;
+
+                default:
+                        delta = PAGE_ALIGN((window_size - wsize) / 2);
+                }
 
                 if (delta > offset)
                         woffset = 0;
                 else
                         woffset -= delta;
 
-                wsize = WINDOW_SIZE;
+                wsize = window_size;
         }
 
         if (st) {
@@ -475,6 +509,12 @@ static int add_mmap(
         if (r < 0)
                 return r;
 
+        /* Let the kernel know how we are going to read this, these are only hints, hence ignore errors */
+        if (f->access == MMAP_ACCESS_FORWARD)
+                (void) madvise(d, wsize, MADV_SEQUENTIAL);
+        else if (f->access == MMAP_ACCESS_BACKWARD && offset > woffset)
+                (void) madvise(d, offset - woffset, MADV_WILLNEED);
+
         c = context_add(m, context);
         if (!c)
                 goto outofmem;
@@ -650,6 +690,14 @@ MMapFileDescriptor* mmap_cache_add_fd(MMapCache *m, int fd) {
         return f;
 }
 
+void mmap_cache_fd_set_access(MMapFileDescriptor *f, MMapAccess access) {
+        assert(f);
+        assert(access >= 0 && access < _MMAP_ACCESS_MAX);
+
+        /* This only affects windows mapped from now on */
+        f->access = access;
+}
+
 void mmap_cache_free_fd(MMapCache *m, MMapFileDescriptor *f) {
         assert(m);
         assert(f);
@@ -5,11 +5,19 @@
 #include <sys/stat.h>
 
 /* One context per object type, plus one of the header, plus one "additional" one */
-#define MMAP_CACHE_MAX_CONTEXTS 9
+#define MMAP_CACHE_MAX_CONTEXTS 12
 
 typedef struct MMapCache MMapCache;
 typedef struct MMapFileDescriptor MMapFileDescriptor;
 
+typedef enum MMapAccess {
+        MMAP_ACCESS_RANDOM,
+        MMAP_ACCESS_FORWARD,
+        MMAP_ACCESS_BACKWARD,
+        _MMAP_ACCESS_MAX,
+        _MMAP_ACCESS_INVALID = -1,
+} MMapAccess;
+
 MMapCache* mmap_cache_new(void);
 MMapCache* mmap_cache_ref(MMapCache *m);
 MMapCache* mmap_cache_unref(MMapCache *m);
@@ -27,6 +35,7 @@ int mmap_cache_get(
         size_t *ret_size);
 MMapFileDescriptor * mmap_cache_add_fd(MMapCache *m, int fd);
 void mmap_cache_free_fd(MMapCache *m, MMapFileDescriptor *f);
+void mmap_cache_fd_set_access(MMapFileDescriptor *f, MMapAccess access);
 
 unsigned mmap_cache_get_hit(MMapCache *m);
 unsigned mmap_cache_get_missed(MMapCache *m);
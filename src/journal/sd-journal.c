@@ -17,6 +17,7 @@
 #include "compress.h"
 #include "dirent-util.h"
 #include "env-file.h"
+#include "env-util.h"
 #include "escape.h"
 #include "fd-util.h"
 #include "fileio.h"
@@ -32,9 +33,12 @@
 #include "list.h"
 #include "lookup3.h"
 #include "nulstr-util.h"
+#include "parse-util.h"
 #include "path-util.h"
 #include "process-util.h"
+#include "pthread-util.h"
 #include "replace-var.h"
+#include "sort-util.h"
 #include "stat-util.h"
 #include "stdio-util.h"
 #include "string-util.h"
@@ -49,7 +53,13 @@
 
 #define DEFAULT_DATA_THRESHOLD (64*1024)
 
+/* Upper limit for the number of threads used for seeking, see $SYSTEMD_JOURNAL_THREADS */
+#define SEEK_THREADS_MAX 64U
+
 static void remove_file_real(sd_journal *j, JournalFile *f);
+static void file_chains_resolve(sd_journal *j);
+static void open_deferred_files_for_location(sd_journal *j);
+static int file_heap_extend_chain(sd_journal *j, JournalFile *f, direction_t direction);
 
 static bool journal_pid_changed(sd_journal *j) {
         assert(j);
@@ -102,6 +112,22 @@ static int journal_put_error(sd_journal *j, int r, const char *path) {
         return 0;
 }
 
+static void invalidate_file_heap(sd_journal *j) {
+        assert(j);
+
+        /* The heap is rebuilt from scratch on the next iteration step, which looks at all files anyway */
+        j->file_heap = prioq_free(j->file_heap);
+        set_clear(j->modified_files);
+}
+
+static bool journal_tracks_modifications(sd_journal *j) {
+        assert(j);
+
+        /* Only if all directories are watched via inotify we learn about every file that grows. Files
+         * opened explicitly are not watched. */
+        return j->inotify_fd >= 0 && !j->no_new_files;
+}
+
 static void detach_location(sd_journal *j) {
         Iterator i;
         JournalFile *f;
@@ -111,6 +137,8 @@ static void detach_location(sd_journal *j) {
         j->current_file = NULL;
         j->current_field = 0;
 
+        invalidate_file_heap(j);
+
         ORDERED_HASHMAP_FOREACH(f, j->files, i)
                 journal_file_reset_location(f);
 }
@@ -756,6 +784,9 @@ static int next_beyond_location(sd_journal *j, JournalFile *f, direction_t direc
         f->last_n_entries = n_entries;
 
         if (f->last_direction == direction && f->current_offset > 0) {
+                /* We are iterating through the file now, let the memory maps follow us */
+                mmap_cache_fd_set_access(f->cache_fd, direction == DIRECTION_DOWN ? MMAP_ACCESS_FORWARD : MMAP_ACCESS_BACKWARD);
+
                 /* LOCATION_SEEK here means we did the work in a previous
                  * iteration and the current location already points to a
                  * candidate entry. */
@@ -769,6 +800,9 @@ static int next_beyond_location(sd_journal *j, JournalFile *f, direction_t direc
         } else {
                 f->last_direction = direction;
 
+                /* Seeking means bisecting, i.e. random access */
+                mmap_cache_fd_set_access(f->cache_fd, MMAP_ACCESS_RANDOM);
+
                 r = find_location_with_matches(j, f, direction, &c, &cp);
                 if (r <= 0)
                         return r;
@@ -805,58 +839,331 @@ static int next_beyond_location(sd_journal *j, JournalFile *f, direction_t direc
         }
 }
 
-static int real_journal_next(sd_journal *j, direction_t direction) {
-        JournalFile *new_file = NULL;
+static int file_heap_compare_down(const void *a, const void *b) {
+        return journal_file_compare_locations((JournalFile*) a, (JournalFile*) b);
+}
+
+static int file_heap_compare_up(const void *a, const void *b) {
+        return journal_file_compare_locations((JournalFile*) b, (JournalFile*) a);
+}
+
+typedef struct SeekItem {
+        JournalFile *file;  /* The file as known to the sd_journal object */
+        JournalFile *view;  /* A second instance of the same file, with its own mmap cache */
+        int result;
+} SeekItem;
+
+typedef struct SeekContext {
+        sd_journal *journal;
+        direction_t direction;
+        SeekItem *items;
+        size_t n_items;
+        size_t next_item;
+} SeekContext;
+
+static void copy_iteration_state(JournalFile *to, const JournalFile *from) {
+        assert(to);
+        assert(from);
+
+        to->last_direction = from->last_direction;
+        to->location_type = from->location_type;
+        to->last_n_entries = from->last_n_entries;
+        to->current_offset = from->current_offset;
+        to->current_seqnum = from->current_seqnum;
+        to->current_realtime = from->current_realtime;
+        to->current_monotonic = from->current_monotonic;
+        to->current_boot_id = from->current_boot_id;
+        to->current_xor_hash = from->current_xor_hash;
+}
+
+static void *seek_thread(void *userdata) {
+        SeekContext *c = userdata;
+
+        assert(c);
+
+        for (;;) {
+                SeekItem *item;
+                size_t i;
+
+                i = __sync_fetch_and_add(&c->next_item, 1);
+                if (i >= c->n_items)
+                        break;
+
+                item = c->items + i;
+                if (!item->view)
+                        continue;
+
+                /* The view only shares what is not modified while iterating: the match tree and the location
+                 * we are looking for. Everything else of the file (its mmap cache in particular) is private to
+                 * the view, hence this may run in parallel with other threads. */
+                sd_journal view = {
+                        .level0 = c->journal->level0,
+                        .current_location = c->journal->current_location,
+                        .current_file = c->journal->current_file == item->file ? item->view : NULL,
+                };
+
+                item->result = next_beyond_location(&view, item->view, c->direction);
+        }
+
+        return NULL;
+}
+
+static int seek_files_threaded(sd_journal *j, direction_t direction, const void **files, unsigned n_files, int *results) {
+        _cleanup_free_ SeekItem *items = NULL;
+        SeekContext c;
+        unsigned i;
+        int r;
+
+        assert(j);
+        assert(files);
+        assert(results);
+
+        /* Finding the right place in each file means bisecting through entry arrays of cold archives, which is
+         * dominated by page faults. Do that for all files in parallel on separate instances of the files, and
+         * then copy the resulting locations back. Since the page cache is shared, the main thread is cheap
+         * afterwards, should it need to look at the same objects again. */
+
+        items = new0(SeekItem, n_files);
+        if (!items)
+                return -ENOMEM;
+
+        /* Open the views here rather than in the threads, journal_file_open() is not meant to be called
+         * concurrently. Files that cannot be opened a second time are simply handled on the main thread. */
+        for (i = 0; i < n_files; i++) {
+                JournalFile *f = (JournalFile*) files[i];
+
+                items[i].file = f;
+                items[i].result = -EAGAIN;
+
+                r = journal_file_open(f->fd, f->path, O_RDONLY, 0, 0, 0, false, NULL, NULL, NULL, NULL, &items[i].view);
+                if (r < 0) {
+                        log_debug_errno(r, "Failed to open second instance of %s, not seeking in parallel: %m", f->path);
+                        items[i].view = NULL;
+                        continue;
+                }
+
+                /* The fd stays owned by the original file */
+                items[i].view->close_fd = false;
+
+                copy_iteration_state(items[i].view, f);
+        }
+
+        c = (SeekContext) {
+                .journal = j,
+                .direction = direction,
+                .items = items,
+                .n_items = n_files,
+        };
+
+        run_parallel(MIN(j->n_seek_threads, n_files) + 1, seek_thread, &c);
+
+        for (i = 0; i < n_files; i++) {
+                if (!items[i].view)
+                        continue;
+
+                /* Errors are left for the main thread to handle, it will retry on its own */
+                if (items[i].result >= 0)
+                        copy_iteration_state(items[i].file, items[i].view);
+
+                results[i] = items[i].result;
+                items[i].view = journal_file_close(items[i].view);
+        }
+
+        return 0;
+}
+
+static int build_file_heap(sd_journal *j, direction_t direction) {
+        _cleanup_free_ int *results = NULL;
         unsigned i, n_files;
         const void **files;
-        Object *o;
         int r;
 
-        assert_return(j, -EINVAL);
-        assert_return(!journal_pid_changed(j), -ECHILD);
+        assert(j);
+
+        invalidate_file_heap(j);
+
+        file_chains_resolve(j);
+        if (direction == DIRECTION_DOWN)
+                open_deferred_files_for_location(j);
+
+        j->file_heap = prioq_new(direction == DIRECTION_DOWN ? file_heap_compare_down : file_heap_compare_up);
+        if (!j->file_heap)
+                return -ENOMEM;
+        j->file_heap_direction = direction;
 
         r = iterated_cache_get(j->files_cache, NULL, &files, &n_files);
         if (r < 0)
                 return r;
 
+        if (j->n_seek_threads > 0 && n_files > 1) {
+                results = new(int, n_files);
+                if (!results)
+                        return -ENOMEM;
+
+                for (i = 0; i < n_files; i++)
+                        results[i] = -EAGAIN;
+
+                r = seek_files_threaded(j, direction, files, n_files, results);
+                if (r < 0)
+                        log_debug_errno(r, "Failed to seek in parallel, ignoring: %m");
+        }
+
         for (i = 0; i < n_files; i++) {
                 JournalFile *f = (JournalFile *)files[i];
-                bool found;
 
-                r = next_beyond_location(j, f, direction);
+                if (results && results[i] >= 0)
+                        r = results[i];
+                else
+                        r = next_beyond_location(j, f, direction);
                 if (r < 0) {
                         log_debug_errno(r, "Can't iterate through %s, ignoring: %m", f->path);
                         remove_file_real(j, f);
+                        if (!j->file_heap) /* Removing files drops the heap, start over */
+                                return build_file_heap(j, direction);
                         continue;
                 } else if (r == 0) {
                         f->location_type = LOCATION_TAIL;
+
+                        if (direction == DIRECTION_UP) {
+                                r = file_heap_extend_chain(j, f, direction);
+                                if (r < 0)
+                                        return r;
+                        }
+
                         continue;
                 }
 
-                if (!new_file)
-                        found = true;
-                else {
-                        int k;
+                r = prioq_put(j->file_heap, f, &f->heap_idx);
+                if (r < 0)
+                        return r;
+        }
+
+        return 0;
+}
+
+static int rebuild_file_heap_from_modified(sd_journal *j, direction_t direction) {
+        JournalFile *f;
+        int r;
+
+        assert(j);
+        assert(j->file_heap);
+        assert(j->file_heap_direction == direction);
+
+        /* All files not in the heap reached their tail. Unless inotify told us otherwise they still have
+         * the same number of entries, and next_beyond_location() would find nothing new in them. Hence
+         * only look at those that were modified, so that following a journal with many files doesn't
+         * require touching every single one of them on each wakeup. */
+
+        if (!journal_tracks_modifications(j))
+                return build_file_heap(j, direction);
+
+        while ((f = set_steal_first(j->modified_files))) {
+
+                r = next_beyond_location(j, f, direction);
+                if (r < 0) {
+                        log_debug_errno(r, "Can't iterate through %s, ignoring: %m", f->path);
+                        remove_file_real(j, f);
+                        return build_file_heap(j, direction);
+                } else if (r == 0) {
+                        f->location_type = LOCATION_TAIL;
 
-                        k = journal_file_compare_locations(f, new_file);
+                        if (direction == DIRECTION_UP) {
+                                r = file_heap_extend_chain(j, f, direction);
+                                if (r < 0)
+                                        return r;
+                        }
 
-                        found = direction == DIRECTION_DOWN ? k < 0 : k > 0;
+                        continue;
                 }
 
-                if (found)
-                        new_file = f;
+                r = prioq_put(j->file_heap, f, &f->heap_idx);
+                if (r < 0)
+                        return r;
         }
 
-        if (!new_file)
-                return 0;
+        return 0;
+}
+
+static int real_journal_next(sd_journal *j, direction_t direction) {
+        bool rebuilt = false;
+        JournalFile *f;
+        Object *o;
+        int r;
+
+        assert_return(j, -EINVAL);
+        assert_return(!journal_pid_changed(j), -ECHILD);
+
+        /* All files with an entry beyond the current location are kept in a heap ordered by that entry, so
+         * that we only have to advance the file we took the last entry from, instead of looking at every
+         * single file on each step. A file's position in the heap is only a lower bound, since the entry it
+         * points to might turn out to be identical to the current one, in which case it needs to advance
+         * further. Hence, we validate the file at the top, and if it stays at the top after that, it is the
+         * one we want. */
+
+        if (!j->file_heap || j->file_heap_direction != direction) {
+                r = build_file_heap(j, direction);
+                if (r < 0)
+                        goto fail;
+                rebuilt = true;
+        }
+
+        for (;;) {
+                f = prioq_peek(j->file_heap);
+                if (!f) {
+                        if (rebuilt)
+                                return 0;
+
+                        /* Files we already reached the end of might have grown in the meantime, have another
+                         * look at them before giving up. */
+                        r = rebuild_file_heap_from_modified(j, direction);
+                        if (r < 0)
+                                goto fail;
+                        rebuilt = true;
+                        continue;
+                }
+
+                r = next_beyond_location(j, f, direction);
+                if (r < 0) {
+                        log_debug_errno(r, "Can't iterate through %s, ignoring: %m", f->path);
+                        remove_file_real(j, f);
 
-        r = journal_file_move_to_object(new_file, OBJECT_ENTRY, new_file->current_offset, &o);
+                        r = build_file_heap(j, direction);
+                        if (r < 0)
+                                goto fail;
+                        rebuilt = true;
+                        continue;
+                } else if (r == 0) {
+                        f->location_type = LOCATION_TAIL;
+                        assert_se(prioq_remove(j->file_heap, f, &f->heap_idx) > 0);
+
+                        if (direction == DIRECTION_UP) {
+                                r = file_heap_extend_chain(j, f, direction);
+                                if (r < 0)
+                                        goto fail;
+                        }
+
+                        continue;
+                }
+
+                r = prioq_reshuffle(j->file_heap, f, &f->heap_idx);
+                if (r < 0)
+                        goto fail;
+
+                if (prioq_peek(j->file_heap) == f)
+                        break;
+        }
+
+        r = journal_file_move_to_object(f, OBJECT_ENTRY, f->current_offset, &o);
         if (r < 0)
-                return r;
+                goto fail;
 
-        set_location(j, new_file, o);
+        set_location(j, f, o);
 
         return 1;
+
+fail:
+        invalidate_file_heap(j);
+        return r;
 }
 
 _public_ int sd_journal_next(sd_journal *j) {
@@ -1226,13 +1533,13 @@ static bool path_has_prefix(sd_journal *j, const char *path, const char *prefix)
         return path_startswith(path, prefix);
 }
 
-static void track_file_disposition(sd_journal *j, JournalFile *f) {
+static void track_file_disposition(sd_journal *j, const char *path) {
         assert(j);
-        assert(f);
+        assert(path);
 
-        if (!j->has_runtime_files && path_has_prefix(j, f->path, "/run"))
+        if (!j->has_runtime_files && path_has_prefix(j, path, "/run"))
                 j->has_runtime_files = true;
-        else if (!j->has_persistent_files && path_has_prefix(j, f->path, "/var"))
+        else if (!j->has_persistent_files && path_has_prefix(j, path, "/var"))
                 j->has_persistent_files = true;
 }
 
@@ -1335,30 +1642,467 @@ static int add_any_file(
                 goto finish;
         }
 
-        close_fd = false; /* the fd is now owned by the JournalFile object */
+        close_fd = false; /* the fd is now owned by the JournalFile object */
+
+        f->last_seen_generation = j->generation;
+
+        /* The new file needs to be considered when iterating */
+        invalidate_file_heap(j);
+
+        track_file_disposition(j, f->path);
+        check_network(j, f->fd);
+
+        j->current_invalidate_counter++;
+
+        log_debug("File %s added.", f->path);
+
+        r = 0;
+
+finish:
+        if (close_fd)
+                safe_close(fd);
+
+        if (r < 0) {
+                k = journal_put_error(j, r, path);
+                if (k < 0)
+                        return k;
+        }
+
+        return r;
+}
+
+/* Length of "@<seqnum id>-<head seqnum>-<head realtime>.journal" at the end of archived file names */
+#define ARCHIVED_SUFFIX_LEN (1 + 32 + 1 + 16 + 1 + 16 + STRLEN(".journal"))
+
+static int parse_archived_file_name(
+                const char *path,
+                size_t *ret_prefix_len,
+                sd_id128_t *ret_seqnum_id,
+                uint64_t *ret_seqnum,
+                usec_t *ret_realtime) {
+
+        unsigned long long seqnum, realtime;
+        char id[SD_ID128_STRING_MAX];
+        sd_id128_t seqnum_id;
+        const char *s;
+        size_t q;
+
+        assert(path);
+
+        /* Same naming scheme as journal_file_archive() generates, see vacuum_info_parse() */
+
+        q = strlen(path);
+        if (q <= ARCHIVED_SUFFIX_LEN || !endswith(path, ".journal"))
+                return 0;
+
+        s = path + q - ARCHIVED_SUFFIX_LEN;
+        if (s[-1] == '/' || s[0] != '@' || s[1 + 32] != '-' || s[1 + 32 + 1 + 16] != '-')
+                return 0;
+
+        memcpy(id, s + 1, 32);
+        id[32] = 0;
+        if (sd_id128_from_string(id, &seqnum_id) < 0)
+                return 0;
+
+        if (sscanf(s + 1 + 32 + 1, "%16llx-%16llx.journal", &seqnum, &realtime) != 2)
+                return 0;
+
+        if (ret_prefix_len)
+                *ret_prefix_len = s - path;
+        if (ret_seqnum_id)
+                *ret_seqnum_id = seqnum_id;
+        if (ret_seqnum)
+                *ret_seqnum = seqnum;
+        if (ret_realtime)
+                *ret_realtime = realtime;
+
+        return 1;
+}
+
+static FileChain *file_chain_free(FileChain *c) {
+        size_t i;
+
+        if (!c)
+                return NULL;
+
+        for (i = 0; i < c->n_deferred; i++)
+                free(c->deferred[i].path);
+
+        free(c->deferred);
+        free(c->key);
+        return mfree(c);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(FileChain*, file_chain_free);
+
+DEFINE_PRIVATE_HASH_OPS_WITH_VALUE_DESTRUCTOR(file_chain_hash_ops, char, string_hash_func, string_compare_func,
+                                              FileChain, file_chain_free);
+
+static bool file_chain_prefix_len(const char *path, size_t *ret) {
+        assert(path);
+        assert(ret);
+
+        /* Corrupted files ("….journal~") don't belong to any chain */
+
+        if (parse_archived_file_name(path, ret, NULL, NULL, NULL) > 0)
+                return true;
+
+        if (!endswith(path, ".journal"))
+                return false;
+
+        *ret = strlen(path) - STRLEN(".journal");
+        return true;
+}
+
+static FileChain *file_chain_get(sd_journal *j, JournalFile *f) {
+        char id[SD_ID128_STRING_MAX];
+        size_t prefix_len;
+        const char *key;
+
+        assert(j);
+        assert(f);
+
+        if (hashmap_isempty(j->file_chains))
+                return NULL;
+
+        if (!file_chain_prefix_len(f->path, &prefix_len))
+                return NULL;
+
+        key = strjoina(strndupa(f->path, prefix_len), "@", sd_id128_to_string(f->header->seqnum_id, id));
+        return hashmap_get(j->file_chains, key);
+}
+
+static bool file_in_chain(JournalFile *f, FileChain *c) {
+        size_t prefix_len;
+
+        assert(f);
+        assert(c);
+
+        return sd_id128_equal(f->header->seqnum_id, c->seqnum_id) &&
+                file_chain_prefix_len(f->path, &prefix_len) &&
+                prefix_len == c->prefix_len &&
+                strneq(f->path, c->key, prefix_len);
+}
+
+static uint64_t file_head_seqnum(JournalFile *f) {
+        assert(f);
+
+        /* A file without entries is an active file that was just created, hence the newest one */
+        if (le64toh(f->header->n_entries) <= 0)
+                return UINT64_MAX;
+
+        return le64toh(f->header->head_entry_seqnum);
+}
+
+static JournalFile *file_chain_oldest_open(sd_journal *j, FileChain *c) {
+        JournalFile *f, *oldest = NULL;
+        Iterator i;
+
+        assert(j);
+        assert(c);
+
+        ORDERED_HASHMAP_FOREACH(f, j->files, i)
+                if (file_in_chain(f, c) &&
+                    (!oldest || file_head_seqnum(f) < file_head_seqnum(oldest)))
+                        oldest = f;
+
+        return oldest;
+}
+
+static JournalFile *file_chain_open_newest(sd_journal *j, FileChain *c) {
+        assert(j);
+        assert(c);
+
+        while (c->n_deferred > 0) {
+                _cleanup_free_ char *path = NULL;
+                unsigned counter;
+                JournalFile *f;
+                int r;
+
+                c->n_deferred--;
+                path = TAKE_PTR(c->deferred[c->n_deferred].path);
+
+                /* The file was accounted for when it was deferred, opening it doesn't change what the
+                 * journal contains, hence don't report SD_JOURNAL_INVALIDATE for it. */
+                counter = j->current_invalidate_counter;
+                r = add_any_file(j, -1, path);
+                j->current_invalidate_counter = counter;
+                if (r < 0)
+                        continue;
+
+                f = ordered_hashmap_get(j->files, path);
+                if (f)
+                        return f;
+        }
+
+        return NULL;
+}
+
+static int defer_file(sd_journal *j, const char *path) {
+        sd_id128_t seqnum_id;
+        uint64_t seqnum;
+        usec_t realtime;
+        size_t prefix_len, lo, hi, k;
+        const char *key;
+        char *copy;
+        FileChain *c;
+        int r;
+
+        assert(j);
+        assert(path);
+
+        /* Archived files are only opened when iteration gets to them, see file_chains_resolve(). Returns
+         * 1 if the file was deferred, 0 if it shall be opened right away. */
+
+        if (!j->defer_archived_files)
+                return 0;
+
+        if (ordered_hashmap_contains(j->files, path))
+                return 0;
+
+        if (parse_archived_file_name(path, &prefix_len, &seqnum_id, &seqnum, &realtime) <= 0)
+                return 0;
+
+        /* The name contains "<prefix>@<seqnum id>" already */
+        key = strndupa(path, prefix_len + 1 + 32);
+
+        c = hashmap_get(j->file_chains, key);
+        if (!c) {
+                _cleanup_(file_chain_freep) FileChain *n = NULL;
+
+                r = hashmap_ensure_allocated(&j->file_chains, &file_chain_hash_ops);
+                if (r < 0)
+                        return r;
+
+                n = new(FileChain, 1);
+                if (!n)
+                        return -ENOMEM;
+
+                *n = (FileChain) {
+                        .key = strdup(key),
+                        .prefix_len = prefix_len,
+                        .seqnum_id = seqnum_id,
+                };
+                if (!n->key)
+                        return -ENOMEM;
+
+                r = hashmap_put(j->file_chains, n->key, n);
+                if (r < 0)
+                        return r;
+
+                c = TAKE_PTR(n);
+        }
+
+        lo = 0;
+        hi = c->n_deferred;
+        while (lo < hi) {
+                size_t m = (lo + hi) / 2;
+
+                if (c->deferred[m].head_seqnum < seqnum)
+                        lo = m + 1;
+                else
+                        hi = m;
+        }
+
+        for (k = lo; k < c->n_deferred && c->deferred[k].head_seqnum == seqnum; k++)
+                if (streq(c->deferred[k].path, path)) {
+                        c->deferred[k].last_seen_generation = j->generation;
+                        return 1;
+                }
+
+        copy = strdup(path);
+        if (!copy)
+                return -ENOMEM;
+
+        if (!GREEDY_REALLOC(c->deferred, c->n_deferred_allocated, c->n_deferred + 1)) {
+                free(copy);
+                return -ENOMEM;
+        }
+
+        memmove(c->deferred + lo + 1, c->deferred + lo, (c->n_deferred - lo) * sizeof(DeferredFile));
+        c->deferred[lo] = (DeferredFile) {
+                .path = copy,
+                .head_seqnum = seqnum,
+                .head_realtime = realtime,
+                .last_seen_generation = j->generation,
+        };
+        c->n_deferred++;
+        c->dirty = true;
+
+        track_file_disposition(j, path);
+
+        j->current_invalidate_counter++;
+
+        log_debug("File %s deferred.", path);
+
+        return 1;
+}
+
+static bool undefer_file(sd_journal *j, const char *path) {
+        FileChain *c;
+        Iterator i;
+        size_t k;
+
+        assert(j);
+        assert(path);
+
+        HASHMAP_FOREACH(c, j->file_chains, i)
+                for (k = 0; k < c->n_deferred; k++) {
+                        if (!streq(c->deferred[k].path, path))
+                                continue;
+
+                        free(c->deferred[k].path);
+                        memmove(c->deferred + k, c->deferred + k + 1, (c->n_deferred - k - 1) * sizeof(DeferredFile));
+                        c->n_deferred--;
+
+                        j->current_invalidate_counter++;
+
+                        log_debug("Deferred file %s removed.", path);
+                        return true;
+                }
+
+        return false;
+}
+
+static void file_chains_resolve(sd_journal *j) {
+        FileChain *c;
+        Iterator i;
+
+        assert(j);
+
+        /* Make sure that of each chain at least one file is open, and that all files we didn't open yet are
+         * older than the ones we did. Then iteration only has to look at the older files once it got past
+         * the oldest open one, see file_heap_extend_chain(). */
+
+        HASHMAP_FOREACH(c, j->file_chains, i) {
+                JournalFile *oldest;
+
+                if (!c->dirty)
+                        continue;
+
+                c->dirty = false;
+
+                oldest = file_chain_oldest_open(j, c);
+                while (c->n_deferred > 0 &&
+                       (!oldest || c->deferred[c->n_deferred - 1].head_seqnum >= file_head_seqnum(oldest)))
+                        oldest = file_chain_open_newest(j, c);
+        }
+}
+
+static bool location_before_file(sd_journal *j, JournalFile *f) {
+        Location *l;
+
+        assert(j);
+        assert(f);
+
+        /* Checks whether the current location might be before the first entry of the file */
+
+        if (le64toh(f->header->n_entries) <= 0)
+                return true;
+
+        l = &j->current_location;
+
+        switch (l->type) {
+
+        case LOCATION_HEAD:
+                return true;
+
+        case LOCATION_TAIL:
+                return false;
+
+        default:
+                if (l->seqnum_set && sd_id128_equal(l->seqnum_id, f->header->seqnum_id))
+                        return l->seqnum < le64toh(f->header->head_entry_seqnum);
+
+                if (l->realtime_set)
+                        return l->realtime < le64toh(f->header->head_entry_realtime);
+
+                return true;
+        }
+}
+
+static void open_deferred_files_for_location(sd_journal *j) {
+        FileChain *c;
+        Iterator i;
+
+        assert(j);
+
+        /* When going forward, entries of files we didn't open yet come before those of the open files of the
+         * same chain. Open the ones that might have entries after the current location. */
+
+        HASHMAP_FOREACH(c, j->file_chains, i) {
+                JournalFile *oldest;
+
+                if (c->n_deferred <= 0)
+                        continue;
+
+                oldest = file_chain_oldest_open(j, c);
+                while (c->n_deferred > 0 && (!oldest || location_before_file(j, oldest)))
+                        oldest = file_chain_open_newest(j, c);
+        }
+}
+
+static int file_heap_extend_chain(sd_journal *j, JournalFile *f, direction_t direction) {
+        FileChain *c;
+        int r;
 
-        f->last_seen_generation = j->generation;
+        assert(j);
+        assert(f);
+        assert(direction == DIRECTION_UP);
 
-        track_file_disposition(j, f);
-        check_network(j, f->fd);
+        /* Called when going backwards and there's nothing more to find in f. If f is the oldest file of its
+         * chain we have open, the older files have to be looked at now. They are older than all files in
+         * the heap of the same chain, hence can be added to the heap without rebuilding it. Returns > 0 if
+         * a file was added. */
 
-        j->current_invalidate_counter++;
+        c = file_chain_get(j, f);
+        if (!c || c->n_deferred <= 0)
+                return 0;
 
-        log_debug("File %s added.", f->path);
+        if (file_chain_oldest_open(j, c) != f)
+                return 0;
 
-        r = 0;
+        for (;;) {
+                JournalFile *d;
+                Set *modified;
+                Prioq *heap;
+
+                /* Adding a file invalidates the heap, which we are still using */
+                heap = TAKE_PTR(j->file_heap);
+                modified = TAKE_PTR(j->modified_files);
+                d = file_chain_open_newest(j, c);
+                j->file_heap = heap;
+                j->modified_files = modified;
+                if (!d)
+                        return 0;
 
-finish:
-        if (close_fd)
-                safe_close(fd);
+                r = next_beyond_location(j, d, direction);
+                if (r < 0)
+                        log_debug_errno(r, "Can't iterate through %s, ignoring: %m", d->path);
+                if (r <= 0) {
+                        d->location_type = LOCATION_TAIL;
+                        continue;
+                }
 
-        if (r < 0) {
-                k = journal_put_error(j, r, path);
-                if (k < 0)
-                        return k;
+                r = prioq_put(j->file_heap, d, &d->heap_idx);
+                if (r < 0)
+                        return r;
+
+                return 1;
         }
+}
 
-        return r;
+void journal_open_deferred_files(sd_journal *j) {
+        FileChain *c;
+        Iterator i;
+
+        assert(j);
+
+        /* For everything that needs to look at all files, not just iterate through entries */
+
+        HASHMAP_FOREACH(c, j->file_chains, i)
+                while (file_chain_open_newest(j, c))
+                        ;
 }
 
 static int add_file_by_name(
@@ -1367,6 +2111,7 @@ static int add_file_by_name(
                 const char *filename) {
 
         const char *path;
+        int r;
 
         assert(j);
         assert(prefix);
@@ -1379,6 +2124,13 @@ static int add_file_by_name(
                 return 0;
 
         path = prefix_roota(prefix, filename);
+
+        r = defer_file(j, path);
+        if (r < 0)
+                log_debug_errno(r, "Failed to defer opening %s, opening it right away: %m", path);
+        if (r > 0)
+                return 0;
+
         return add_any_file(j, -1, path);
 }
 
@@ -1396,20 +2148,32 @@ static void remove_file_by_name(
 
         path = prefix_roota(prefix, filename);
         f = ordered_hashmap_get(j->files, path);
-        if (!f)
+        if (!f) {
+                (void) undefer_file(j, path);
                 return;
+        }
 
         remove_file_real(j, f);
 }
 
 static void remove_file_real(sd_journal *j, JournalFile *f) {
+        FileChain *c;
+
         assert(j);
         assert(f);
 
+        /* If this was the last open file of its chain, open an older one instead */
+        c = file_chain_get(j, f);
+        if (c)
+                c->dirty = true;
+
         (void) ordered_hashmap_remove(j->files, f->path);
+        (void) set_remove(j->modified_files, f);
 
         log_debug("File %s removed.", f->path);
 
+        invalidate_file_heap(j);
+
         if (j->current_file == f) {
                 j->current_file = NULL;
                 j->current_field = 0;
@@ -1419,6 +2183,7 @@ static void remove_file_real(sd_journal *j, JournalFile *f) {
                 /* Jump to the next unique_file or NULL if that one was last */
                 j->unique_file = ordered_hashmap_next(j->files, j->unique_file->path);
                 j->unique_offset = 0;
+                j->unique_index_offset = 0;
                 if (!j->unique_file)
                         j->unique_file_lost = true;
         }
@@ -1561,6 +2326,7 @@ static void directory_enumerate(sd_journal *j, Directory *m, DIR *d) {
                         (void) add_directory(j, m->path, de->d_name);
         }
 
+        file_chains_resolve(j);
         return;
 
 fail:
@@ -1873,6 +2639,8 @@ static int allocate_inotify(sd_journal *j) {
 
 static sd_journal *journal_new(int flags, const char *path, const char *namespace) {
         _cleanup_(sd_journal_closep) sd_journal *j = NULL;
+        const char *e;
+        int r;
 
         j = new0(sd_journal, 1);
         if (!j)
@@ -1884,6 +2652,20 @@ static sd_journal *journal_new(int flags, const char *path, const char *namespac
         j->flags = flags;
         j->data_threshold = DEFAULT_DATA_THRESHOLD;
 
+        /* Archived files are opened only when needed, unless turned off */
+        r = getenv_bool_secure("SYSTEMD_JOURNAL_LAZY");
+        if (r < 0 && r != -ENXIO)
+                log_debug_errno(r, "Failed to parse $SYSTEMD_JOURNAL_LAZY, ignoring: %m");
+        j->defer_archived_files = r != 0;
+
+        e = secure_getenv("SYSTEMD_JOURNAL_THREADS");
+        if (e) {
+                if (safe_atou(e, &j->n_seek_threads) < 0)
+                        log_debug("Failed to parse $SYSTEMD_JOURNAL_THREADS, ignoring: %s", e);
+                else
+                        j->n_seek_threads = MIN(j->n_seek_threads, SEEK_THREADS_MAX);
+        }
+
         if (path) {
                 char *t;
 
@@ -2137,6 +2919,10 @@ _public_ void sd_journal_close(sd_journal *j) {
 
         sd_journal_flush_matches(j);
 
+        prioq_free(j->file_heap);
+        set_free(j->modified_files);
+        strv_free(j->data_fields);
+        hashmap_free(j->file_chains);
         ordered_hashmap_free_with_destructor(j->files, journal_file_close);
         iterated_cache_free(j->files_cache);
 
@@ -2157,6 +2943,7 @@ _public_ void sd_journal_close(sd_journal *j) {
         }
 
         hashmap_free_free(j->errors);
+        catalog_cache_free(j->catalog_cache);
 
         free(j->path);
         free(j->prefix);
@@ -2302,11 +3089,11 @@ _public_ int sd_journal_get_data(sd_journal *j, const char *field, const void **
 
                 compression = o->object.flags & OBJECT_COMPRESSION_MASK;
                 if (compression) {
-#if HAVE_XZ || HAVE_LZ4
-                        r = decompress_startswith(compression,
-                                                  o->data.payload, l,
-                                                  &f->compress_buffer, &f->compress_buffer_size,
-                                                  field, field_length, '=');
+#if HAVE_COMPRESSION
+                        r = journal_file_decompress_startswith(f, compression,
+                                                               o->data.payload, l,
+                                                               &f->compress_buffer, &f->compress_buffer_size,
+                                                               field, field_length, '=');
                         if (r < 0)
                                 log_debug_errno(r, "Cannot decompress %s object of length %"PRIu64" at offset "OFSfmt": %m",
                                                 object_compressed_to_string(compression), l, p);
@@ -2314,10 +3101,10 @@ _public_ int sd_journal_get_data(sd_journal *j, const char *field, const void **
 
                                 size_t rsize;
 
-                                r = decompress_blob(compression,
-                                                    o->data.payload, l,
-                                                    &f->compress_buffer, &f->compress_buffer_size, &rsize,
-                                                    j->data_threshold);
+                                r = journal_file_decompress_blob(f, compression,
+                                                                 o->data.payload, l,
+                                                                 &f->compress_buffer, &f->compress_buffer_size, &rsize,
+                                                                 j->data_threshold);
                                 if (r < 0)
                                         return r;
 
@@ -2366,13 +3153,13 @@ static int return_data(sd_journal *j, JournalFile *f, Object *o, const void **da
 
         compression = o->object.flags & OBJECT_COMPRESSION_MASK;
         if (compression) {
-#if HAVE_XZ || HAVE_LZ4
+#if HAVE_COMPRESSION
                 size_t rsize;
                 int r;
 
-                r = decompress_blob(compression,
-                                    o->data.payload, l, &f->compress_buffer,
-                                    &f->compress_buffer_size, &rsize, j->data_threshold);
+                r = journal_file_decompress_blob(f, compression,
+                                                 o->data.payload, l, &f->compress_buffer,
+                                                 &f->compress_buffer_size, &rsize, j->data_threshold);
                 if (r < 0)
                         return r;
 
@@ -2389,6 +3176,58 @@ static int return_data(sd_journal *j, JournalFile *f, Object *o, const void **da
         return 0;
 }
 
+static bool data_field_wanted(sd_journal *j, JournalFile *f, Object *o) {
+        const char *eq;
+        uint64_t l;
+        int compression;
+        char **field;
+
+        assert(j);
+        assert(f);
+        assert(o);
+
+        /* Checks whether the field of a DATA object is among the ones selected with
+         * sd_journal_set_data_fields(), looking only at the field name. Compressed objects are decompressed
+         * only as far as needed to compare the name. */
+
+        if (!j->data_fields)
+                return true;
+
+        l = le64toh(o->object.size) - offsetof(Object, data.payload);
+
+        compression = o->object.flags & OBJECT_COMPRESSION_MASK;
+        if (compression) {
+#if HAVE_COMPRESSION
+                STRV_FOREACH(field, j->data_fields) {
+                        int r;
+
+                        r = journal_file_decompress_startswith(f, compression,
+                                                               o->data.payload, l,
+                                                               &f->compress_buffer, &f->compress_buffer_size,
+                                                               *field, strlen(*field), '=');
+                        if (r != 0) /* On error, let return_data() report it */
+                                return true;
+                }
+
+                return false;
+#else
+                return true;
+#endif
+        }
+
+        /* Field names are at most 64 characters long, see field_is_valid() */
+        eq = memchr(o->data.payload, '=', MIN(l, (uint64_t) 65));
+        if (!eq)
+                return false;
+
+        STRV_FOREACH(field, j->data_fields)
+                if (strlen(*field) == (size_t) (eq - (const char*) o->data.payload) &&
+                    memcmp(o->data.payload, *field, eq - (const char*) o->data.payload) == 0)
+                        return true;
+
+        return false;
+}
+
 _public_ int sd_journal_enumerate_data(sd_journal *j, const void **data, size_t *size) {
         JournalFile *f;
         uint64_t p, n;
@@ -2408,22 +3247,29 @@ _public_ int sd_journal_enumerate_data(sd_journal *j, const void **data, size_t
         if (f->current_offset <= 0)
                 return -EADDRNOTAVAIL;
 
-        r = journal_file_move_to_object(f, OBJECT_ENTRY, f->current_offset, &o);
-        if (r < 0)
-                return r;
+        for (;;) {
+                r = journal_file_move_to_object(f, OBJECT_ENTRY, f->current_offset, &o);
+                if (r < 0)
+                        return r;
 
-        n = journal_file_entry_n_items(o);
-        if (j->current_field >= n)
-                return 0;
+                n = journal_file_entry_n_items(o);
+                if (j->current_field >= n)
+                        return 0;
 
-        p = le64toh(o->entry.items[j->current_field].object_offset);
-        le_hash = o->entry.items[j->current_field].hash;
-        r = journal_file_move_to_object(f, OBJECT_DATA, p, &o);
-        if (r < 0)
-                return r;
+                p = le64toh(o->entry.items[j->current_field].object_offset);
+                le_hash = o->entry.items[j->current_field].hash;
+                r = journal_file_move_to_object(f, OBJECT_DATA, p, &o);
+                if (r < 0)
+                        return r;
+
+                if (le_hash != o->data.hash)
+                        return -EBADMSG;
+
+                if (data_field_wanted(j, f, o))
+                        break;
 
-        if (le_hash != o->data.hash)
-                return -EBADMSG;
+                j->current_field++;
+        }
 
         r = return_data(j, f, o, data, size);
         if (r < 0)
@@ -2475,6 +3321,9 @@ _public_ int sd_journal_get_fd(sd_journal *j) {
         if (r < 0)
                 return r;
 
+        /* Files might have grown before we started watching them, look at all of them once more */
+        invalidate_file_heap(j);
+
         log_debug("Reiterating files to get inotify watches established.");
 
         /* Iterate through all dirs again, to add them to the inotify */
@@ -2524,6 +3373,7 @@ _public_ int sd_journal_get_timeout(sd_journal *j, uint64_t *timeout_usec) {
 static void process_q_overflow(sd_journal *j) {
         JournalFile *f;
         Directory *m;
+        FileChain *c;
         Iterator i;
 
         assert(j);
@@ -2538,6 +3388,9 @@ static void process_q_overflow(sd_journal *j) {
         j->generation++;
         (void) reiterate_all_paths(j);
 
+        /* We lost track of which files were modified */
+        invalidate_file_heap(j);
+
         ORDERED_HASHMAP_FOREACH(f, j->files, i) {
 
                 if (f->last_seen_generation == j->generation)
@@ -2547,6 +3400,22 @@ static void process_q_overflow(sd_journal *j) {
                 remove_file_real(j, f);
         }
 
+        HASHMAP_FOREACH(c, j->file_chains, i) {
+                size_t k, n = 0;
+
+                for (k = 0; k < c->n_deferred; k++) {
+                        if (c->deferred[k].last_seen_generation != j->generation) {
+                                log_debug("Deferred file '%s' hasn't been seen in this enumeration, removing.", c->deferred[k].path);
+                                free(c->deferred[k].path);
+                                continue;
+                        }
+
+                        c->deferred[n++] = c->deferred[k];
+                }
+
+                c->n_deferred = n;
+        }
+
         HASHMAP_FOREACH(m, j->directories_by_path, i) {
 
                 if (m->last_seen_generation == j->generation)
@@ -2582,6 +3451,22 @@ static void process_inotify_event(sd_journal *j, const struct inotify_event *e)
 
                         /* Event for a journal file */
 
+                        if ((e->mask & (IN_CREATE|IN_MOVED_TO|IN_ATTRIB)) == 0 && (e->mask & IN_MODIFY)) {
+                                const char *path;
+                                JournalFile *f;
+
+                                /* A file we already track grew, just remember it for the next iteration
+                                 * step, there's no need to open it again. */
+                                path = prefix_roota(d->path, e->name);
+                                f = ordered_hashmap_get(j->files, path);
+                                if (f) {
+                                        if (set_ensure_allocated(&j->modified_files, NULL) < 0 ||
+                                            set_put(j->modified_files, f) < 0)
+                                                invalidate_file_heap(j);
+                                        return;
+                                }
+                        }
+
                         if (e->mask & (IN_CREATE|IN_MOVED_TO|IN_MODIFY|IN_ATTRIB))
                                 (void) add_file_by_name(j, d->path, e->name);
                         else if (e->mask & (IN_DELETE|IN_MOVED_FROM|IN_UNMOUNT))
@@ -2719,6 +3604,7 @@ _public_ int sd_journal_get_cutoff_realtime_usec(sd_journal *j, uint64_t *from,
         JournalFile *f;
         bool first = true;
         uint64_t fmin = 0, tmax = 0;
+        FileChain *c;
         int r;
 
         assert_return(j, -EINVAL);
@@ -2726,6 +3612,20 @@ _public_ int sd_journal_get_cutoff_realtime_usec(sd_journal *j, uint64_t *from,
         assert_return(from || to, -EINVAL);
         assert_return(from != to, -EINVAL);
 
+        /* Files we didn't open yet are older than the open ones of their chain, hence only the time of
+         * their first entry matters, and that's part of their name. */
+        HASHMAP_FOREACH(c, j->file_chains, i) {
+                size_t k;
+
+                for (k = 0; k < c->n_deferred; k++) {
+                        if (c->deferred[k].head_realtime <= 0)
+                                continue;
+
+                        fmin = first ? c->deferred[k].head_realtime : MIN(fmin, c->deferred[k].head_realtime);
+                        first = false;
+                }
+        }
+
         ORDERED_HASHMAP_FOREACH(f, j->files, i) {
                 usec_t fr, t;
 
@@ -2766,6 +3666,8 @@ _public_ int sd_journal_get_cutoff_monotonic_usec(sd_journal *j, sd_id128_t boot
         assert_return(from || to, -EINVAL);
         assert_return(from != to, -EINVAL);
 
+        journal_open_deferred_files(j);
+
         ORDERED_HASHMAP_FOREACH(f, j->files, i) {
                 usec_t fr, t;
 
@@ -2801,6 +3703,8 @@ void journal_print_header(sd_journal *j) {
 
         assert(j);
 
+        journal_open_deferred_files(j);
+
         ORDERED_HASHMAP_FOREACH(f, j->files, i) {
                 if (newline)
                         putchar('\n');
@@ -2811,6 +3715,76 @@ void journal_print_header(sd_journal *j) {
         }
 }
 
+static int field_range_compare(const JournalFieldRange *a, const JournalFieldRange *b) {
+        int r;
+
+        r = CMP(a->size, b->size);
+        if (r != 0)
+                return r;
+
+        return memcmp(a->data, b->data, a->size);
+}
+
+int journal_get_field_ranges(sd_journal *j, const char *field, JournalFieldRange **ret, size_t *ret_n) {
+        JournalFieldRange *ranges = NULL;
+        size_t n = 0, n_allocated = 0, i, m;
+        JournalFile *f;
+        Iterator it;
+        int r;
+
+        assert(j);
+        assert(field);
+        assert(ret);
+        assert(ret_n);
+
+        /* Returns the distinct values of the field in all files, together with the realtime range of the
+         * entries referencing them, ordered by value. Uses the field indexes of archived files where
+         * available. */
+
+        journal_open_deferred_files(j);
+
+        ORDERED_HASHMAP_FOREACH(f, j->files, it) {
+                JournalFieldRange *file_ranges;
+                size_t file_n;
+
+                r = journal_file_get_field_ranges(f, field, &file_ranges, &file_n);
+                if (r < 0) {
+                        log_debug_errno(r, "%s: failed to read values of field %s, skipping: %m", f->path, field);
+                        continue;
+                }
+                if (file_n <= 0)
+                        continue;
+
+                if (!GREEDY_REALLOC(ranges, n_allocated, n + file_n)) {
+                        journal_field_range_free_many(file_ranges, file_n);
+                        journal_field_range_free_many(ranges, n);
+                        return -ENOMEM;
+                }
+
+                memcpy(ranges + n, file_ranges, file_n * sizeof(JournalFieldRange));
+                n += file_n;
+                free(file_ranges);
+        }
+
+        typesafe_qsort(ranges, n, field_range_compare);
+
+        /* Merge the ranges of the same value in different files */
+        for (i = 0, m = 0; i < n; i++) {
+                if (m > 0 && field_range_compare(ranges + m - 1, ranges + i) == 0) {
+                        ranges[m - 1].first_realtime = MIN(ranges[m - 1].first_realtime, ranges[i].first_realtime);
+                        ranges[m - 1].last_realtime = MAX(ranges[m - 1].last_realtime, ranges[i].last_realtime);
+                        free(ranges[i].data);
+                        continue;
+                }
+
+                ranges[m++] = ranges[i];
+        }
+
+        *ret = ranges;
+        *ret_n = m;
+        return 0;
+}
+
 _public_ int sd_journal_get_usage(sd_journal *j, uint64_t *bytes) {
         Iterator i;
         JournalFile *f;
@@ -2820,6 +3794,8 @@ _public_ int sd_journal_get_usage(sd_journal *j, uint64_t *bytes) {
         assert_return(!journal_pid_changed(j), -ECHILD);
         assert_return(bytes, -EINVAL);
 
+        journal_open_deferred_files(j);
+
         ORDERED_HASHMAP_FOREACH(f, j->files, i) {
                 struct stat st;
 
@@ -2849,11 +3825,81 @@ _public_ int sd_journal_query_unique(sd_journal *j, const char *field) {
         j->unique_field = f;
         j->unique_file = NULL;
         j->unique_offset = 0;
+        j->unique_index_offset = 0;
         j->unique_file_lost = false;
 
         return 0;
 }
 
+static int unique_value_in_earlier_file(sd_journal *j, const void *data, size_t size, uint64_t hash) {
+        JournalFile *of;
+        Iterator i;
+        int r;
+
+        assert(j);
+
+        /* Checks if we already returned this value, by checking if it exists in the earlier traversed files. */
+        ORDERED_HASHMAP_FOREACH(of, j->files, i) {
+                if (of == j->unique_file)
+                        break;
+
+                /* Skip this file it didn't have any fields indexed */
+                if (JOURNAL_HEADER_CONTAINS(of->header, n_fields) && le64toh(of->header->n_fields) <= 0)
+                        continue;
+
+                r = journal_file_find_data_object_with_hash(of, data, size, hash, NULL, NULL);
+                if (r != 0)
+                        return r;
+        }
+
+        return 0;
+}
+
+static int enumerate_unique_index(sd_journal *j, size_t k, const void **data, size_t *l) {
+        Object *o;
+        int r;
+
+        assert(j);
+        assert(j->unique_index_offset > 0);
+
+        /* The field index stores the values uncompressed and next to each other, hence we return them
+         * directly from it. The object lives in its own mmap context, so that looking up the values in the
+         * other files doesn't invalidate it. */
+
+        r = journal_file_move_to_object(j->unique_file, OBJECT_FIELD_INDEX, j->unique_index_offset, &o);
+        if (r < 0)
+                return r;
+
+        for (;;) {
+                FieldIndexItem *item;
+                size_t size;
+
+                r = journal_file_next_field_index_item(o, &j->unique_index_position, &item);
+                if (r <= 0)
+                        return r;
+
+                size = le64toh(item->size);
+                if (size <= k ||
+                    memcmp(item->payload, j->unique_field, k) != 0 ||
+                    item->payload[k] != '=')
+                        return log_debug_errno(SYNTHETIC_ERRNO(EBADMSG),
+                                               "%s:offset " OFSfmt ": field index item does not start with \"%s=\"",
+                                               j->unique_file->path,
+                                               j->unique_index_offset,
+                                               j->unique_field);
+
+                r = unique_value_in_earlier_file(j, item->payload, size, hash64(item->payload, size));
+                if (r < 0)
+                        return r;
+                if (r > 0)
+                        continue;
+
+                *data = item->payload;
+                *l = size;
+                return 1;
+        }
+}
+
 _public_ int sd_journal_enumerate_unique(sd_journal *j, const void **data, size_t *l) {
         size_t k;
 
@@ -2869,29 +3915,61 @@ _public_ int sd_journal_enumerate_unique(sd_journal *j, const void **data, size_
                 if (j->unique_file_lost)
                         return 0;
 
+                journal_open_deferred_files(j);
+
                 j->unique_file = ordered_hashmap_first(j->files);
                 if (!j->unique_file)
                         return 0;
 
                 j->unique_offset = 0;
+                j->unique_index_offset = 0;
         }
 
         for (;;) {
-                JournalFile *of;
-                Iterator i;
                 Object *o;
                 const void *odata;
                 size_t ol;
-                bool found;
                 int r;
 
+                if (j->unique_index_offset > 0) {
+                        r = enumerate_unique_index(j, k, data, l);
+                        if (r != 0)
+                                return r;
+
+                        /* We reached the end of the index? Then start again, with the next file */
+                        j->unique_index_offset = 0;
+                        j->unique_offset = 0;
+
+                        j->unique_file = ordered_hashmap_next(j->files, j->unique_file->path);
+                        if (!j->unique_file)
+                                return 0;
+
+                        continue;
+                }
+
                 /* Proceed to next data object in the field's linked list */
                 if (j->unique_offset == 0) {
-                        r = journal_file_find_field_object(j->unique_file, j->unique_field, k, &o, NULL);
+                        uint64_t p;
+
+                        r = journal_file_find_field_object(j->unique_file, j->unique_field, k, &o, &p);
                         if (r < 0)
                                 return r;
 
                         j->unique_offset = r > 0 ? le64toh(o->field.head_data_offset) : 0;
+
+                        /* Archived files might come with an index of the field's values, use it if so */
+                        if (j->unique_offset > 0) {
+                                r = journal_file_find_field_index(j->unique_file, p, NULL, &j->unique_index_offset);
+                                if (r < 0)
+                                        log_debug_errno(r, "%s: failed to look up field index, ignoring: %m",
+                                                        j->unique_file->path);
+                                if (r > 0) {
+                                        j->unique_index_position = 0;
+                                        continue;
+                                }
+
+                                j->unique_index_offset = 0;
+                        }
                 } else {
                         r = journal_file_move_to_object(j->unique_file, OBJECT_DATA, j->unique_offset, &o);
                         if (r < 0)
@@ -2942,28 +4020,10 @@ _public_ int sd_journal_enumerate_unique(sd_journal *j, const void **data, size_
                                                j->unique_offset,
                                                j->unique_field);
 
-                /* OK, now let's see if we already returned this data
-                 * object by checking if it exists in the earlier
-                 * traversed files. */
-                found = false;
-                ORDERED_HASHMAP_FOREACH(of, j->files, i) {
-                        if (of == j->unique_file)
-                                break;
-
-                        /* Skip this file it didn't have any fields indexed */
-                        if (JOURNAL_HEADER_CONTAINS(of->header, n_fields) && le64toh(of->header->n_fields) <= 0)
-                                continue;
-
-                        r = journal_file_find_data_object_with_hash(of, odata, ol, le64toh(o->data.hash), NULL, NULL);
-                        if (r < 0)
-                                return r;
-                        if (r > 0) {
-                                found = true;
-                                break;
-                        }
-                }
-
-                if (found)
+                r = unique_value_in_earlier_file(j, odata, ol, le64toh(o->data.hash));
+                if (r < 0)
+                        return r;
+                if (r > 0)
                         continue;
 
                 r = return_data(j, j->unique_file, o, data, l);
@@ -2980,6 +4040,7 @@ _public_ void sd_journal_restart_unique(sd_journal *j) {
 
         j->unique_file = NULL;
         j->unique_offset = 0;
+        j->unique_index_offset = 0;
         j->unique_file_lost = false;
 }
 
@@ -2994,6 +4055,8 @@ _public_ int sd_journal_enumerate_fields(sd_journal *j, const char **field) {
                 if (j->fields_file_lost)
                         return 0;
 
+                journal_open_deferred_files(j);
+
                 j->fields_file = ordered_hashmap_first(j->files);
                 if (!j->fields_file)
                         return 0;
@@ -3182,7 +4245,7 @@ _public_ int sd_journal_get_catalog(sd_journal *j, char **ret) {
         if (r < 0)
                 return r;
 
-        r = catalog_get(CATALOG_DATABASE, id, &text);
+        r = catalog_get_cached(&j->catalog_cache, CATALOG_DATABASE, id, &text);
         if (r < 0)
                 return r;
 
@@ -3208,6 +4271,34 @@ _public_ int sd_journal_set_data_threshold(sd_journal *j, size_t sz) {
         return 0;
 }
 
+_public_ int sd_journal_set_data_fields(sd_journal *j, char **fields) {
+        _cleanup_strv_free_ char **copy = NULL;
+        char **field;
+
+        assert_return(j, -EINVAL);
+        assert_return(!journal_pid_changed(j), -ECHILD);
+
+        if (strv_isempty(fields)) {
+                j->data_fields = strv_free(j->data_fields);
+                return 0;
+        }
+
+        /* Callers typically set this for every entry they show, make that cheap */
+        if (strv_equal(j->data_fields, fields))
+                return 0;
+
+        STRV_FOREACH(field, fields)
+                if (!field_is_valid(*field))
+                        return -EINVAL;
+
+        copy = strv_copy(fields);
+        if (!copy)
+                return -ENOMEM;
+
+        strv_free_and_replace(j->data_fields, copy);
+        return 0;
+}
+
 _public_ int sd_journal_get_data_threshold(sd_journal *j, size_t *sz) {
         assert_return(j, -EINVAL);
         assert_return(!journal_pid_changed(j), -ECHILD);
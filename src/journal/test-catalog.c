@@ -9,7 +9,9 @@
 
 #include "alloc-util.h"
 #include "catalog.h"
+#include "copy.h"
 #include "fd-util.h"
+#include "fileio.h"
 #include "fs-util.h"
 #include "log.h"
 #include "macro.h"
@@ -169,6 +171,68 @@ static void test_catalog_update(const char *database) {
         assert_se(r == 0);
 }
 
+static char *list_catalog(const char *database) {
+        _cleanup_fclose_ FILE *f = NULL;
+        _cleanup_free_ char *buf = NULL;
+        size_t sz = 0;
+
+        assert_se(f = open_memstream_unlocked(&buf, &sz));
+        assert_se(catalog_list(f, database, false) >= 0);
+        assert_se(fflush_and_check(f) >= 0);
+        f = safe_fclose(f);
+
+        return TAKE_PTR(buf);
+}
+
+static void test_catalog_index(const char *database) {
+        _cleanup_(unlink_tempfilep) char copy[] = "/tmp/test-catalog.XXXXXX";
+        _cleanup_free_ char *with_index = NULL, *without_index = NULL;
+        _cleanup_close_ int fd = -1;
+        uint64_t zero = 0;
+
+        log_info("/* %s */", __func__);
+
+        /* Drop the index from a copy of the database, the lookups have to return the same with bisection */
+        assert_se((fd = mkostemp_safe(copy)) >= 0);
+        fd = safe_close(fd);
+        assert_se(copy_file(database, copy, 0, 0644, 0, 0, COPY_REPLACE) >= 0);
+        assert_se((fd = open(copy, O_WRONLY|O_CLOEXEC)) >= 0);
+        assert_se(pwrite(fd, &zero, sizeof(zero), 48) == sizeof(zero));
+
+        with_index = list_catalog(database);
+        without_index = list_catalog(copy);
+        assert_se(streq(with_index, without_index));
+}
+
+static void test_catalog_get_cached(const char *database) {
+        _cleanup_(catalog_cache_freep) CatalogCache *cache = NULL;
+        unsigned i;
+
+        log_info("/* %s */", __func__);
+
+        for (i = 0; i < 2; i++) {
+                _cleanup_free_ char *a = NULL, *b = NULL;
+
+                assert_se(catalog_get(database, SD_MESSAGE_COREDUMP, &a) >= 0);
+                assert_se(catalog_get_cached(&cache, database, SD_MESSAGE_COREDUMP, &b) >= 0);
+                assert_se(streq(a, b));
+
+                assert_se(catalog_get_cached(&cache, database, SD_ID128_MAKE(ac,d8,5e,5a,a8,be,4f,01,85,2c,2d,9d,6e,21,4b,57), &b) == -ENOENT);
+        }
+
+        /* A different language has to be looked up again */
+        assert_se(setlocale(LC_MESSAGES, "C"));
+        for (i = 0; i < 2; i++) {
+                _cleanup_free_ char *a = NULL, *b = NULL;
+
+                assert_se(catalog_get(database, SD_MESSAGE_COREDUMP, &a) >= 0);
+                assert_se(catalog_get_cached(&cache, database, SD_MESSAGE_COREDUMP, &b) >= 0);
+                assert_se(streq(a, b));
+        }
+
+        assert_se(catalog_get_cached(&cache, "/hopefully/no/catalog.db", SD_MESSAGE_COREDUMP, &(char*) { NULL }) == -ENOENT);
+}
+
 static void test_catalog_file_lang(void) {
         _cleanup_free_ char *lang = NULL, *lang2 = NULL, *lang3 = NULL, *lang4 = NULL;
 
@@ -234,5 +298,8 @@ int main(int argc, char *argv[]) {
         assert_se(catalog_get(database, SD_MESSAGE_COREDUMP, &text) >= 0);
         printf(">>>%s<<<\n", text);
 
+        test_catalog_index(database);
+        test_catalog_get_cached(database);
+
         return 0;
 }
@@ -14,6 +14,7 @@
 #include "memory-util.h"
 #include "path-util.h"
 #include "random-util.h"
+#include "stdio-util.h"
 #include "tests.h"
 #include "tmpfile-util.h"
 
@@ -29,6 +30,8 @@
 # define LZ4_OK -EPROTONOSUPPORT
 #endif
 
+#define HUGE_SIZE (4096*1024)
+
 typedef int (compress_blob_t)(const void *src, uint64_t src_size,
                               void *dst, size_t dst_alloc_size, size_t *dst_size);
 typedef int (decompress_blob_t)(const void *src, uint64_t src_size,
@@ -42,7 +45,7 @@ typedef int (decompress_sw_t)(const void *src, uint64_t src_size,
 typedef int (compress_stream_t)(int fdf, int fdt, uint64_t max_bytes);
 typedef int (decompress_stream_t)(int fdf, int fdt, uint64_t max_size);
 
-#if HAVE_XZ || HAVE_LZ4
+#if HAVE_COMPRESSION
 static void test_compress_decompress(int compression,
                                      compress_blob_t compress,
                                      decompress_blob_t decompress,
@@ -231,7 +234,6 @@ static void test_lz4_decompress_partial(void) {
         int r;
         _cleanup_free_ char *huge = NULL;
 
-#define HUGE_SIZE (4096*1024)
         assert_se(huge = malloc(HUGE_SIZE));
         memcpy(huge, "HUGE=", STRLEN("HUGE="));
         memset(&huge[STRLEN("HUGE=")], 'x', HUGE_SIZE - STRLEN("HUGE=") - 1);
@@ -264,8 +266,64 @@ static void test_lz4_decompress_partial(void) {
 }
 #endif
 
+#if HAVE_ZSTD
+static void test_zstd_dictionary(void) {
+        _cleanup_(compression_dictionary_freep) CompressionDictionary *d = NULL;
+        _cleanup_free_ void *samples = NULL, *dict = NULL, *decompressed = NULL;
+        _cleanup_free_ size_t *sizes = NULL;
+        size_t samples_size = 0, dict_size, plain_size, with_size, decompressed_size = 0, decompressed_alloc = 0;
+        char buf[256], plain[256], with[256];
+        const unsigned n_samples = 2000;
+        int r;
+
+        log_info("/* testing zstd dictionary compression */");
+
+        /* Lots of short, similar fields, like the ones typically found in a journal */
+        assert_se(samples = malloc(n_samples * sizeof(buf)));
+        assert_se(sizes = new(size_t, n_samples));
+        for (unsigned i = 0; i < n_samples; i++) {
+                xsprintf(buf, "_SYSTEMD_UNIT=systemd-something-%u.service MESSAGE=Started unit %u, everything fine.", i % 97, i);
+                sizes[i] = strlen(buf);
+                memcpy((uint8_t*) samples + samples_size, buf, sizes[i]);
+                samples_size += sizes[i];
+        }
+
+        r = compression_dictionary_train(samples, sizes, n_samples, 8192, &dict, &dict_size);
+        if (r == -ENODATA) {
+                log_info_errno(r, "Could not train dictionary, skipping test: %m");
+                return;
+        }
+        assert_se(r >= 0);
+        log_info("Trained %zu byte dictionary from %zu bytes of samples", dict_size, samples_size);
+
+        assert_se(compression_dictionary_new(dict, dict_size, &d) >= 0);
+
+        xsprintf(buf, "_SYSTEMD_UNIT=systemd-something-%u.service MESSAGE=Started unit %u, everything fine.", 5u, 12345u);
+
+        assert_se(compress_blob_zstd(buf, strlen(buf), plain, sizeof(plain), &plain_size) >= 0);
+        assert_se(!compressed_blob_uses_dictionary(OBJECT_COMPRESSED_ZSTD, plain, plain_size));
+
+        assert_se(compress_blob_zstd_with_dictionary(d, buf, strlen(buf), with, sizeof(with), &with_size) >= 0);
+        assert_se(compressed_blob_uses_dictionary(OBJECT_COMPRESSED_ZSTD, with, with_size));
+        log_info("Compressed %zu bytes to %zu without and %zu with dictionary", strlen(buf), plain_size, with_size);
+        assert_se(with_size < plain_size);
+
+        assert_se(decompress_blob_zstd_with_dictionary(d, with, with_size, &decompressed, &decompressed_alloc, &decompressed_size, 0) >= 0);
+        assert_se(decompressed_size == strlen(buf));
+        assert_se(memcmp(decompressed, buf, decompressed_size) == 0);
+
+        assert_se(decompress_startswith_zstd_with_dictionary(d, with, with_size, &decompressed, &decompressed_alloc,
+                                                             "_SYSTEMD_UNIT", STRLEN("_SYSTEMD_UNIT"), '=') > 0);
+        assert_se(decompress_startswith_zstd_with_dictionary(d, with, with_size, &decompressed, &decompressed_alloc,
+                                                             "MESSAGE", STRLEN("MESSAGE"), '=') == 0);
+
+        /* Without the dictionary the frame cannot be decoded */
+        assert_se(decompress_blob_zstd(with, with_size, &decompressed, &decompressed_alloc, &decompressed_size, 0) < 0);
+}
+#endif
+
 int main(int argc, char *argv[]) {
-#if HAVE_XZ || HAVE_LZ4
+#if HAVE_COMPRESSION
         const char text[] =
                 "text\0foofoofoofoo AAAA aaaaaaaaa ghost busters barbarbar FFF"
                 "foofoofoofoo AAAA aaaaaaaaa ghost busters barbarbar FFF";
@@ -338,9 +396,35 @@ int main(int argc, char *argv[]) {
         log_info("/* LZ4 test skipped */");
 #endif
 
+#if HAVE_ZSTD
+        test_compress_decompress(OBJECT_COMPRESSED_ZSTD, compress_blob_zstd, decompress_blob_zstd,
+                                 text, sizeof(text), false);
+        test_compress_decompress(OBJECT_COMPRESSED_ZSTD, compress_blob_zstd, decompress_blob_zstd,
+                                 data, sizeof(data), true);
+
+        test_decompress_startswith(OBJECT_COMPRESSED_ZSTD,
+                                   compress_blob_zstd, decompress_startswith_zstd,
+                                   text, sizeof(text), false);
+        test_decompress_startswith(OBJECT_COMPRESSED_ZSTD,
+                                   compress_blob_zstd, decompress_startswith_zstd,
+                                   data, sizeof(data), true);
+        test_decompress_startswith(OBJECT_COMPRESSED_ZSTD,
+                                   compress_blob_zstd, decompress_startswith_zstd,
+                                   huge, HUGE_SIZE, true);
+
+        test_compress_stream(OBJECT_COMPRESSED_ZSTD, "zstdcat",
+                             compress_stream_zstd, decompress_stream_zstd, srcfile);
+
+        test_decompress_startswith_short(OBJECT_COMPRESSED_ZSTD, compress_blob_zstd, decompress_startswith_zstd);
+
+        test_zstd_dictionary();
+#else
+        log_info("/* ZSTD test skipped */");
+#endif
+
         return 0;
 #else
-        log_info("/* XZ and LZ4 tests skipped */");
+        log_info("/* XZ, LZ4 and ZSTD tests skipped */");
         return EXIT_TEST_SKIP;
 #endif
 }
@@ -0,0 +1,127 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "sd-journal.h"
+
+#include "alloc-util.h"
+#include "chattr-util.h"
+#include "io-util.h"
+#include "journal-file.h"
+#include "journal-internal.h"
+#include "log.h"
+#include "macro.h"
+#include "rm-rf.h"
+#include "stdio-util.h"
+#include "tests.h"
+#include "tmpfile-util.h"
+
+/* Benchmarks appending entries that look like typical service output to a journal file, and reading them
+ * back, with and without a match. */
+
+#define N_ENTRIES_PER_CALL 100U
+#define N_UNITS 10U
+
+typedef struct Append {
+        JournalFile *file;
+        dual_timestamp ts;
+        uint64_t n_entries;
+} Append;
+
+static void append_entries(void *userdata) {
+        Append *a = userdata;
+
+        for (unsigned i = 0; i < N_ENTRIES_PER_CALL; i++) {
+                char message[STRLEN("MESSAGE=Benchmark message ") + DECIMAL_STR_MAX(uint64_t)],
+                        unit[STRLEN("_SYSTEMD_UNIT=benchmark-.service") + DECIMAL_STR_MAX(unsigned)];
+                struct iovec iovec[8];
+                unsigned n = 0;
+
+                xsprintf(message, "MESSAGE=Benchmark message %" PRIu64, a->n_entries);
+                xsprintf(unit, "_SYSTEMD_UNIT=benchmark-%u.service", (unsigned) (a->n_entries % N_UNITS));
+
+                iovec[n++] = IOVEC_MAKE_STRING(message);
+                iovec[n++] = IOVEC_MAKE_STRING(unit);
+                iovec[n++] = IOVEC_MAKE_STRING("PRIORITY=6");
+                iovec[n++] = IOVEC_MAKE_STRING("SYSLOG_FACILITY=3");
+                iovec[n++] = IOVEC_MAKE_STRING("SYSLOG_IDENTIFIER=benchmark");
+                iovec[n++] = IOVEC_MAKE_STRING("_TRANSPORT=stdout");
+                iovec[n++] = IOVEC_MAKE_STRING("_COMM=benchmark");
+                iovec[n++] = IOVEC_MAKE_STRING("_EXE=/usr/bin/benchmark");
+
+                /* Entries must be ordered strictly */
+                a->ts.realtime++;
+                a->ts.monotonic++;
+
+                assert_se(journal_file_append_entry(a->file, &a->ts, NULL, iovec, n, NULL, NULL, NULL) == 0);
+                a->n_entries++;
+        }
+}
+
+typedef struct Read {
+        const char *directory;
+        const char *match;
+        uint64_t n_found;
+} Read;
+
+static void read_entries(void *userdata) {
+        _cleanup_(sd_journal_closep) sd_journal *j = NULL;
+        Read *r = userdata;
+        uint64_t n = 0;
+
+        assert_se(sd_journal_open_directory(&j, r->directory, 0) >= 0);
+        if (r->match)
+                assert_se(sd_journal_add_match(j, r->match, 0) >= 0);
+
+        SD_JOURNAL_FOREACH(j) {
+                const void *d;
+                size_t l;
+
+                assert_se(sd_journal_get_data(j, "MESSAGE", &d, &l) >= 0);
+                n++;
+        }
+
+        r->n_found = n;
+}
+
+int main(int argc, char *argv[]) {
+        _cleanup_(rm_rf_physical_and_freep) char *t = NULL;
+        Read r;
+        Append a = {};
+
+        /* journal_file_open requires a valid machine id */
+        if (access("/etc/machine-id", F_OK) != 0)
+                return log_tests_skipped("/etc/machine-id not found");
+
+        test_setup_logging(LOG_INFO);
+
+        assert_se(mkdtemp_malloc("/var/tmp/journal-benchmark-XXXXXX", &t) >= 0);
+        assert_se(chdir(t) >= 0);
+        (void) chattr_path(t, FS_NOCOW_FL, FS_NOCOW_FL, NULL);
+
+        assert_se(journal_file_open(-1, "benchmark.journal", O_RDWR|O_CREAT, 0644, DEFAULT_COMPRESSION, (uint64_t) -1, false,
+                                    NULL, NULL, NULL, NULL, &a.file) == 0);
+        dual_timestamp_get(&a.ts);
+
+        benchmark_run("journal-append", append_entries, &a, N_ENTRIES_PER_CALL);
+        (void) journal_file_close(a.file);
+
+        /* Reading is measured per entry read, hence how long a call takes depends on how much we appended */
+        r = (Read) {
+                .directory = t,
+        };
+        read_entries(&r);
+        assert_se(r.n_found == a.n_entries);
+        benchmark_run("journal-read", read_entries, &r, r.n_found);
+
+        r = (Read) {
+                .directory = t,
+                .match = "_SYSTEMD_UNIT=benchmark-1.service",
+        };
+        read_entries(&r);
+        assert_se(r.n_found > 0);
+        benchmark_run("journal-read-match", read_entries, &r, r.n_found);
+
+        return 0;
+}
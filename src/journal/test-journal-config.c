@@ -2,6 +2,7 @@
 
 #include <stdbool.h>
 
+#include "compress.h"
 #include "journald-server.h"
 
 #define _COMPRESS_PARSE_CHECK(str, enab, thresh, varname)               \
@@ -46,8 +47,31 @@ static void test_config_compress(void) {
         COMPRESS_PARSE_CHECK("", true, (uint64_t)-1);
 }
 
+static void test_config_compress_algorithm(void) {
+        JournalCompressOptions c = {
+                .enabled = true,
+                .algorithm = DEFAULT_COMPRESSION,
+        };
+
+        config_parse_compress_algorithm("", "", 0, "", 0, "", 0, "blah", &c, NULL);
+        assert_se(c.algorithm == DEFAULT_COMPRESSION);
+
+#if HAVE_XZ
+        config_parse_compress_algorithm("", "", 0, "", 0, "", 0, "xz", &c, NULL);
+        assert_se(c.algorithm == OBJECT_COMPRESSED_XZ);
+#endif
+#if HAVE_ZSTD
+        config_parse_compress_algorithm("", "", 0, "", 0, "", 0, "ZSTD", &c, NULL);
+        assert_se(c.algorithm == OBJECT_COMPRESSED_ZSTD);
+#endif
+
+        config_parse_compress_algorithm("", "", 0, "", 0, "", 0, "", &c, NULL);
+        assert_se(c.algorithm == DEFAULT_COMPRESSION);
+}
+
 int main(int argc, char *argv[]) {
         test_config_compress();
+        test_config_compress_algorithm();
 
         return 0;
 }
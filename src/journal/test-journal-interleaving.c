@@ -9,10 +9,13 @@
 #include "chattr-util.h"
 #include "io-util.h"
 #include "journal-file.h"
+#include "journal-internal.h"
 #include "journal-vacuum.h"
 #include "log.h"
 #include "parse-util.h"
 #include "rm-rf.h"
+#include "stdio-util.h"
+#include "string-util.h"
 #include "tests.h"
 #include "util.h"
 
@@ -35,7 +38,7 @@ _noreturn_ static void log_assert_errno(const char *text, int error, const char
 
 static JournalFile *test_open(const char *name) {
         JournalFile *f;
-        assert_ret(journal_file_open(-1, name, O_RDWR|O_CREAT, 0644, true, (uint64_t) -1, false, NULL, NULL, NULL, NULL, &f));
+        assert_ret(journal_file_open(-1, name, O_RDWR|O_CREAT, 0644, DEFAULT_COMPRESSION, (uint64_t) -1, false, NULL, NULL, NULL, NULL, &f));
         return f;
 }
 
@@ -131,6 +134,57 @@ static void setup_interleaved(void) {
         test_close(two);
 }
 
+#define N_MANY_FILES 8
+#define N_MANY_ENTRIES 4
+
+static void setup_many_interleaved(void) {
+        JournalFile *files[N_MANY_FILES];
+        int i, k;
+
+        for (i = 0; i < N_MANY_FILES; i++) {
+                char name[STRLEN("many-.journal") + DECIMAL_STR_MAX(int)];
+
+                xsprintf(name, "many-%i.journal", i);
+                files[i] = test_open(name);
+        }
+
+        /* Round-robin, so that each step has to switch to the next file */
+        for (k = 0; k < N_MANY_ENTRIES; k++)
+                for (i = 0; i < N_MANY_FILES; i++)
+                        append_number(files[i], k * N_MANY_FILES + i + 1, NULL);
+
+        for (i = 0; i < N_MANY_FILES; i++)
+                test_close(files[i]);
+}
+
+#define N_ROTATIONS 2
+
+static void setup_rotated(void) {
+        JournalFile *one, *two;
+        int i, n = 0;
+
+        /* Two chains of one active and N_ROTATIONS archived files each, with interleaved entries */
+        one = test_open("one.journal");
+        two = test_open("two.journal");
+
+        for (i = 0; i <= N_ROTATIONS; i++) {
+                append_number(one, ++n, NULL);
+                append_number(two, ++n, NULL);
+                append_number(one, ++n, NULL);
+                append_number(two, ++n, NULL);
+
+                if (i < N_ROTATIONS) {
+                        assert_ret(journal_file_rotate(&one, DEFAULT_COMPRESSION, (uint64_t) -1, false, NULL));
+                        assert_ret(journal_file_rotate(&two, DEFAULT_COMPRESSION, (uint64_t) -1, false, NULL));
+                }
+        }
+
+        test_close(one);
+        test_close(two);
+}
+
+#define N_ROTATED_ENTRIES (4 * (N_ROTATIONS + 1))
+
 static void mkdtemp_chdir_chattr(char *path) {
         assert_se(mkdtemp(path));
         assert_se(chdir(path) >= 0);
@@ -140,7 +194,7 @@ static void mkdtemp_chdir_chattr(char *path) {
         (void) chattr_path(path, FS_NOCOW_FL, FS_NOCOW_FL, NULL);
 }
 
-static void test_skip(void (*setup)(void)) {
+static void test_skip(void (*setup)(void), int n) {
         char t[] = "/var/tmp/journal-skip-XXXXXX";
         sd_journal *j;
         int r;
@@ -154,7 +208,7 @@ static void test_skip(void (*setup)(void)) {
         assert_ret(sd_journal_open_directory(&j, t, 0));
         assert_ret(sd_journal_seek_head(j));
         assert_ret(sd_journal_next(j));
-        test_check_numbers_down(j, 4);
+        test_check_numbers_down(j, n);
         sd_journal_close(j);
 
         /* Seek to tail, iterate up.
@@ -162,27 +216,120 @@ static void test_skip(void (*setup)(void)) {
         assert_ret(sd_journal_open_directory(&j, t, 0));
         assert_ret(sd_journal_seek_tail(j));
         assert_ret(sd_journal_previous(j));
-        test_check_numbers_up(j, 4);
+        test_check_numbers_up(j, n);
         sd_journal_close(j);
 
         /* Seek to tail, skip to head, iterate down.
          */
         assert_ret(sd_journal_open_directory(&j, t, 0));
         assert_ret(sd_journal_seek_tail(j));
-        assert_ret(r = sd_journal_previous_skip(j, 4));
-        assert_se(r == 4);
-        test_check_numbers_down(j, 4);
+        assert_ret(r = sd_journal_previous_skip(j, n));
+        assert_se(r == n);
+        test_check_numbers_down(j, n);
         sd_journal_close(j);
 
         /* Seek to head, skip to tail, iterate up.
          */
         assert_ret(sd_journal_open_directory(&j, t, 0));
         assert_ret(sd_journal_seek_head(j));
-        assert_ret(r = sd_journal_next_skip(j, 4));
-        assert_se(r == 4);
-        test_check_numbers_up(j, 4);
+        assert_ret(r = sd_journal_next_skip(j, n));
+        assert_se(r == n);
+        test_check_numbers_up(j, n);
+        sd_journal_close(j);
+
+        log_info("Done...");
+
+        if (arg_keep)
+                log_info("Not removing %s", t);
+        else {
+                journal_directory_vacuum(".", 3000000, 0, 0, NULL, true);
+
+                assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+        }
+
+        puts("------------------------------------------------------------");
+}
+
+static void test_rotated(bool lazy) {
+        char t[] = "/var/tmp/journal-rotated-XXXXXX";
+        char *cursors[N_ROTATED_ENTRIES] = {};
+        usec_t realtime[N_ROTATED_ENTRIES], monotonic[N_ROTATED_ENTRIES], from, to;
+        sd_id128_t boot_id;
+        sd_journal *j;
+        int i, r;
+
+        log_info("/* %s(%s) */", __func__, yes_no(lazy));
+
+        assert_se(setenv("SYSTEMD_JOURNAL_LAZY", yes_no(lazy), 1) >= 0);
+
+        mkdtemp_chdir_chattr(t);
+
+        setup_rotated();
+
+        /* Only the active files are opened right away, unless turned off */
+        assert_ret(sd_journal_open_directory(&j, t, 0));
+        assert_se(ordered_hashmap_size(j->files) == (lazy ? 2 : 2 * (N_ROTATIONS + 1)));
+
+        /* The realtime cutoff of files that aren't open yet is taken from their names */
+        assert_ret(sd_journal_get_cutoff_realtime_usec(j, &from, &to));
+
+        /* Collect timestamps and cursors of all entries, from archived and active files */
+        assert_ret(sd_journal_seek_head(j));
+        for (i = 0; i < N_ROTATED_ENTRIES; i++) {
+                assert_ret(r = sd_journal_next(j));
+                assert_se(r == 1);
+                test_check_number(j, i + 1);
+                assert_ret(sd_journal_get_realtime_usec(j, realtime + i));
+                assert_ret(sd_journal_get_monotonic_usec(j, monotonic + i, &boot_id));
+                assert_ret(sd_journal_get_cursor(j, cursors + i));
+        }
+        assert_ret(r = sd_journal_next(j));
+        assert_se(r == 0);
+
+        assert_se(from == realtime[0]);
+        assert_se(to == realtime[N_ROTATED_ENTRIES - 1]);
+        sd_journal_close(j);
+
+        assert_ret(sd_journal_open_directory(&j, t, 0));
+        assert_ret(sd_journal_get_cutoff_monotonic_usec(j, boot_id, &from, &to));
+        assert_se(from == monotonic[0]);
+        assert_se(to == monotonic[N_ROTATED_ENTRIES - 1]);
         sd_journal_close(j);
 
+        /* Seek to every entry by realtime and by cursor, and iterate from there in both directions */
+        for (i = 0; i < N_ROTATED_ENTRIES; i++) {
+                assert_ret(sd_journal_open_directory(&j, t, 0));
+                assert_ret(sd_journal_seek_realtime_usec(j, realtime[i]));
+                assert_ret(r = sd_journal_next(j));
+                assert_se(r == 1);
+                test_check_number(j, i + 1);
+                assert_ret(r = sd_journal_next_skip(j, N_ROTATED_ENTRIES));
+                assert_se(r == N_ROTATED_ENTRIES - i - 1);
+                test_check_number(j, N_ROTATED_ENTRIES);
+                sd_journal_close(j);
+
+                assert_ret(sd_journal_open_directory(&j, t, 0));
+                assert_ret(sd_journal_seek_cursor(j, cursors[i]));
+                assert_ret(r = sd_journal_previous(j));
+                assert_se(r == 1);
+                test_check_number(j, i + 1);
+                assert_se(sd_journal_test_cursor(j, cursors[i]) > 0);
+                test_check_numbers_up(j, i + 1);
+                sd_journal_close(j);
+
+                assert_ret(sd_journal_open_directory(&j, t, 0));
+                assert_ret(sd_journal_seek_cursor(j, cursors[i]));
+                assert_ret(r = sd_journal_next(j));
+                assert_se(r == 1);
+                test_check_number(j, i + 1);
+                assert_ret(r = sd_journal_next_skip(j, N_ROTATED_ENTRIES));
+                assert_se(r == N_ROTATED_ENTRIES - i - 1);
+                sd_journal_close(j);
+        }
+
+        for (i = 0; i < N_ROTATED_ENTRIES; i++)
+                free(cursors[i]);
+
         log_info("Done...");
 
         if (arg_keep)
@@ -193,6 +340,8 @@ static void test_skip(void (*setup)(void)) {
                 assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
         }
 
+        assert_se(unsetenv("SYSTEMD_JOURNAL_LAZY") >= 0);
+
         puts("------------------------------------------------------------");
 }
 
@@ -206,7 +355,7 @@ static void test_sequence_numbers(void) {
         mkdtemp_chdir_chattr(t);
 
         assert_se(journal_file_open(-1, "one.journal", O_RDWR|O_CREAT, 0644,
-                                    true, (uint64_t) -1, false, NULL, NULL, NULL, NULL, &one) == 0);
+                                    DEFAULT_COMPRESSION, (uint64_t) -1, false, NULL, NULL, NULL, NULL, &one) == 0);
 
         append_number(one, 1, &seqnum);
         printf("seqnum=%"PRIu64"\n", seqnum);
@@ -223,7 +372,7 @@ static void test_sequence_numbers(void) {
         memcpy(&seqnum_id, &one->header->seqnum_id, sizeof(sd_id128_t));
 
         assert_se(journal_file_open(-1, "two.journal", O_RDWR|O_CREAT, 0644,
-                                    true, (uint64_t) -1, false, NULL, NULL, NULL, one, &two) == 0);
+                                    DEFAULT_COMPRESSION, (uint64_t) -1, false, NULL, NULL, NULL, one, &two) == 0);
 
         assert_se(two->header->state == STATE_ONLINE);
         assert_se(!sd_id128_equal(two->header->file_id, one->header->file_id));
@@ -254,7 +403,7 @@ static void test_sequence_numbers(void) {
         seqnum = 0;
 
         assert_se(journal_file_open(-1, "two.journal", O_RDWR, 0,
-                                    true, (uint64_t) -1, false, NULL, NULL, NULL, NULL, &two) == 0);
+                                    DEFAULT_COMPRESSION, (uint64_t) -1, false, NULL, NULL, NULL, NULL, &two) == 0);
 
         assert_se(sd_id128_equal(two->header->seqnum_id, seqnum_id));
 
@@ -287,8 +436,23 @@ int main(int argc, char *argv[]) {
 
         arg_keep = argc > 1;
 
-        test_skip(setup_sequential);
-        test_skip(setup_interleaved);
+        test_skip(setup_sequential, 4);
+        test_skip(setup_interleaved, 4);
+        test_skip(setup_many_interleaved, N_MANY_FILES * N_MANY_ENTRIES);
+
+        /* Once more, with seeking in parallel */
+        assert_se(setenv("SYSTEMD_JOURNAL_THREADS", "4", 1) >= 0);
+        test_skip(setup_many_interleaved, N_MANY_FILES * N_MANY_ENTRIES);
+        assert_se(unsetenv("SYSTEMD_JOURNAL_THREADS") >= 0);
+
+        /* Archived files are opened lazily, check that this doesn't change what we find */
+        test_skip(setup_rotated, N_ROTATED_ENTRIES);
+        assert_se(setenv("SYSTEMD_JOURNAL_LAZY", "0", 1) >= 0);
+        test_skip(setup_rotated, N_ROTATED_ENTRIES);
+        assert_se(unsetenv("SYSTEMD_JOURNAL_LAZY") >= 0);
+
+        test_rotated(true);
+        test_rotated(false);
 
         test_sequence_numbers();
 
@@ -0,0 +1,187 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "sd-journal.h"
+
+#include "alloc-util.h"
+#include "chattr-util.h"
+#include "fd-util.h"
+#include "fileio.h"
+#include "io-util.h"
+#include "journal-file.h"
+#include "json.h"
+#include "logs-show.h"
+#include "macro.h"
+#include "parse-util.h"
+#include "path-util.h"
+#include "rm-rf.h"
+#include "stdio-util.h"
+#include "string-util.h"
+#include "tests.h"
+#include "time-util.h"
+#include "tmpfile-util.h"
+
+#define N_ENTRIES_DEFAULT 20000U
+
+static void generate_journal(const char *fn, unsigned n_entries) {
+        static const uint8_t binary[] = { 'B', 'I', 'N', 'A', 'R', 'Y', '=', 0, 1, 2, 255, '\n' };
+        JournalFile *f;
+        unsigned i, k;
+
+        assert_se(journal_file_open(-1, fn, O_RDWR|O_CREAT, 0644, DEFAULT_COMPRESSION, UINT64_MAX, false, NULL, NULL, NULL, NULL, &f) == 0);
+
+        for (i = 0; i < n_entries; i++) {
+                char message[STRLEN("MESSAGE=Entry \"\" with\ta\\b\n") + DECIMAL_STR_MAX(unsigned)],
+                        priority[STRLEN("PRIORITY=") + DECIMAL_STR_MAX(unsigned)],
+                        many[80][STRLEN("FIELD_=") + DECIMAL_STR_MAX(unsigned) * 2];
+                struct iovec iovec[ELEMENTSOF(many) + 7];
+                dual_timestamp ts;
+                size_t n = 0;
+
+                dual_timestamp_get(&ts);
+
+                xsprintf(message, "MESSAGE=Entry \"%u\" with\ta\\b\n", i);
+                xsprintf(priority, "PRIORITY=%u", i % 8);
+                iovec[n++] = IOVEC_MAKE_STRING(message);
+                iovec[n++] = IOVEC_MAKE_STRING(priority);
+                iovec[n++] = IOVEC_MAKE_STRING("_TRANSPORT=journal");
+                iovec[n++] = IOVEC_MAKE_STRING("SYSLOG_IDENTIFIER=test-journal-output");
+                iovec[n++] = IOVEC_MAKE_STRING("UNICODE=\xe2\x9c\x93");
+
+                if (i % 10 == 0) {
+                        /* Repeated fields, and a field that isn't printable */
+                        iovec[n++] = IOVEC_MAKE_STRING("PRIORITY=9");
+                        iovec[n++] = IOVEC_MAKE((void*) binary, sizeof(binary));
+                }
+
+                if (i % 100 == 0)
+                        /* More fields than the fast path handles */
+                        for (k = 0; k < ELEMENTSOF(many); k++) {
+                                xsprintf(many[k], "FIELD_%u=%u", k, i);
+                                iovec[n++] = IOVEC_MAKE_STRING(many[k]);
+                        }
+
+                assert_se(journal_file_append_entry(f, &ts, NULL, iovec, n, NULL, NULL, NULL) == 0);
+        }
+
+        (void) journal_file_close(f);
+}
+
+static char *format_entry(sd_journal *j, OutputMode mode) {
+        _cleanup_fclose_ FILE *f = NULL;
+        _cleanup_free_ char *buf = NULL;
+        size_t sz = 0;
+
+        sd_journal_restart_data(j);
+
+        assert_se(f = open_memstream_unlocked(&buf, &sz));
+        assert_se(show_journal_entry(f, j, mode, 0, OUTPUT_SHOW_ALL, NULL, NULL, NULL) >= 0);
+        assert_se(fflush_and_check(f) >= 0);
+        f = safe_fclose(f);
+
+        return TAKE_PTR(buf);
+}
+
+static void test_json_equivalence(sd_journal *j) {
+        unsigned n = 0;
+
+        log_info("/* %s */", __func__);
+
+        /* The pretty output goes through JSON variants, compare the compact output against that */
+        SD_JOURNAL_FOREACH(j) {
+                _cleanup_(json_variant_unrefp) JsonVariant *a = NULL, *b = NULL, *c = NULL, *d = NULL;
+                _cleanup_free_ char *compact = NULL, *pretty = NULL, *seq = NULL, *sse = NULL;
+
+                compact = format_entry(j, OUTPUT_JSON);
+                pretty = format_entry(j, OUTPUT_JSON_PRETTY);
+                seq = format_entry(j, OUTPUT_JSON_SEQ);
+                sse = format_entry(j, OUTPUT_JSON_SSE);
+
+                assert_se(endswith(compact, "}\n"));
+                assert_se(strchr(compact, '\n') == compact + strlen(compact) - 1);
+                assert_se(json_parse(compact, 0, &a, NULL, NULL) >= 0);
+                assert_se(json_parse(pretty, 0, &b, NULL, NULL) >= 0);
+                assert_se(json_variant_equal(a, b));
+
+                /* The same, apart from the framing */
+                assert_se(startswith(seq, "\x1e"));
+                assert_se(json_parse(seq + 1, 0, &c, NULL, NULL) >= 0);
+                assert_se(json_variant_equal(a, c));
+
+                assert_se(startswith(sse, "data: "));
+                assert_se(endswith(sse, "}\n\n"));
+                assert_se(json_parse(sse + STRLEN("data: "), 0, &d, NULL, NULL) >= 0);
+                assert_se(json_variant_equal(a, d));
+
+                if (++n >= 1000)
+                        break;
+        }
+
+        assert_se(n > 0);
+}
+
+static void benchmark(sd_journal *j, OutputMode mode) {
+        _cleanup_fclose_ FILE *f = NULL;
+        char ts[FORMAT_TIMESPAN_MAX];
+        unsigned n = 0;
+        usec_t t;
+
+        assert_se(f = fopen("/dev/null", "we"));
+
+        t = now(CLOCK_MONOTONIC);
+
+        SD_JOURNAL_FOREACH(j) {
+                assert_se(show_journal_entry(f, j, mode, 0, 0, NULL, NULL, NULL) >= 0);
+                n++;
+        }
+
+        t = now(CLOCK_MONOTONIC) - t;
+
+        log_info("%-12s %u entries in %s, %.0f entries/s",
+                 output_mode_to_string(mode), n, format_timespan(ts, sizeof(ts), t, 0), n / ((double) MAX(t, 1U) / USEC_PER_SEC));
+}
+
+int main(int argc, char *argv[]) {
+        static const OutputMode modes[] = {
+                OUTPUT_SHORT,
+                OUTPUT_EXPORT,
+                OUTPUT_JSON,
+                OUTPUT_JSON_PRETTY,
+                OUTPUT_CAT,
+        };
+        _cleanup_(rm_rf_physical_and_freep) char *dn = NULL;
+        _cleanup_free_ char *fn = NULL;
+        const char *files[2] = {};
+        unsigned n = N_ENTRIES_DEFAULT;
+        sd_journal *j;
+        size_t i;
+
+        test_setup_logging(LOG_INFO);
+
+        /* Takes a journal file to run the benchmark on, or the number of entries to generate one with */
+
+        if (argc > 1 && safe_atou(argv[1], &n) < 0)
+                files[0] = argv[1];
+        else {
+                assert_se(mkdtemp_malloc("/var/tmp/test-journal-output-XXXXXX", &dn) >= 0);
+                (void) chattr_path(dn, FS_NOCOW_FL, FS_NOCOW_FL, NULL);
+
+                assert_se(fn = path_join(dn, "test.journal"));
+                generate_journal(fn, n);
+                files[0] = fn;
+        }
+
+        assert_se(sd_journal_open_files(&j, files, 0) >= 0);
+
+        test_json_equivalence(j);
+
+        for (i = 0; i < ELEMENTSOF(modes); i++)
+                benchmark(j, modes[i]);
+
+        sd_journal_close(j);
+
+        return 0;
+}
@@ -0,0 +1,234 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+
+#include "alloc-util.h"
+#include "io-util.h"
+#include "journal-ring.h"
+#include "macro.h"
+#include "memory-util.h"
+#include "stdio-util.h"
+#include "string-util.h"
+#include "tests.h"
+#include "unaligned.h"
+
+#define DATA_SIZE JOURNAL_RING_DATA_SIZE_MIN
+
+#define N_THREADS 4U
+#define N_MESSAGES 100000U
+
+typedef struct Ring {
+        JournalRingHeader header;
+        uint8_t data[DATA_SIZE];
+} Ring;
+
+static Ring *ring_new(void) {
+        Ring *r;
+
+        assert_se(r = new0(Ring, 1));
+        r->header.data_size = DATA_SIZE;
+
+        return r;
+}
+
+static int write_string(Ring *r, const char *s) {
+        struct iovec iovec[2] = {
+                IOVEC_MAKE_STRING(s),
+                IOVEC_MAKE_STRING("\n"),
+        };
+
+        return journal_ring_write(&r->header, r->data, DATA_SIZE, iovec, ELEMENTSOF(iovec));
+}
+
+/* Reads the next message, skipping padding, and releases it right away. Returns 0 if there is none. */
+static int read_string(Ring *r, char **ret) {
+        const uint8_t *p;
+        size_t size, total;
+        uint64_t tail;
+        int k;
+
+        tail = r->header.tail;
+
+        for (;;) {
+                k = journal_ring_read(r->data, DATA_SIZE, tail, 0, &p, &size, &total);
+                assert_se(k >= 0);
+                if (k == 0)
+                        return 0;
+
+                if (p) {
+                        /* The same as journald does: copy it before it is released */
+                        assert_se(size > 0 && p[size - 1] == '\n');
+                        assert_se(*ret = strndup((const char*) p, size - 1));
+                }
+
+                journal_ring_release(&r->header, r->data, DATA_SIZE, tail, tail + total);
+                tail += total;
+
+                if (p)
+                        return 1;
+        }
+}
+
+static void test_basic(void) {
+        _cleanup_free_ Ring *r = ring_new();
+        char buf[STRLEN("MESSAGE=") + DECIMAL_STR_MAX(unsigned)];
+        unsigned i;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(read_string(r, &(char*) { NULL }) == 0);
+
+        /* Write and read back enough to go round the ring a couple of times */
+        for (i = 0; i < 10000; i++) {
+                _cleanup_free_ char *s = NULL;
+
+                xsprintf(buf, "MESSAGE=%u", i);
+                assert_se(write_string(r, buf) == 0);
+                assert_se(read_string(r, &s) > 0);
+                assert_se(streq(s, buf));
+        }
+
+        assert_se(r->header.head > 2 * DATA_SIZE);
+        assert_se(r->header.head == r->header.tail);
+
+        /* Everything we consumed is zero again */
+        for (i = 0; i < DATA_SIZE; i++)
+                assert_se(r->data[i] == 0);
+}
+
+static void test_full(void) {
+        _cleanup_free_ Ring *r = ring_new();
+        _cleanup_free_ char *large = NULL, *s = NULL;
+        unsigned n = 0;
+        int k;
+
+        log_info("/* %s */", __func__);
+
+        /* Messages that take up more than a quarter of the ring are refused */
+        assert_se(large = malloc(DATA_SIZE / 4));
+        memset(large, 'x', DATA_SIZE / 4 - 1);
+        large[DATA_SIZE / 4 - 1] = 0;
+        assert_se(write_string(r, large) == -EMSGSIZE);
+
+        while ((k = write_string(r, "MESSAGE=full")) == 0)
+                n++;
+
+        assert_se(k == -ENOBUFS);
+        assert_se(n == DATA_SIZE / journal_ring_record_size(STRLEN("MESSAGE=full\n")));
+
+        /* Once something is consumed there's room again */
+        assert_se(read_string(r, &s) > 0);
+        assert_se(streq(s, "MESSAGE=full"));
+        assert_se(write_string(r, "MESSAGE=full") == 0);
+        assert_se(write_string(r, "MESSAGE=full") == -ENOBUFS);
+}
+
+static void test_wakeup(void) {
+        _cleanup_free_ Ring *r = ring_new();
+
+        log_info("/* %s */", __func__);
+
+        /* Only the first writer after the reader asked for it has to wake it up */
+        assert_se(write_string(r, "MESSAGE=one") == 0);
+        r->header.need_wakeup = 1;
+        assert_se(write_string(r, "MESSAGE=two") > 0);
+        assert_se(r->header.need_wakeup == 0);
+        assert_se(write_string(r, "MESSAGE=three") == 0);
+}
+
+static void test_garbage(void) {
+        _cleanup_free_ Ring *r = ring_new();
+        const uint8_t *p;
+        size_t size, total;
+
+        log_info("/* %s */", __func__);
+
+        /* Not committed */
+        unaligned_write_ne64(r->data, 5);
+        assert_se(journal_ring_read(r->data, DATA_SIZE, 0, 0, &p, &size, &total) == -EBADMSG);
+
+        /* Larger than the ring */
+        unaligned_write_ne64(r->data, JOURNAL_RING_RECORD_COMMITTED | DATA_SIZE);
+        assert_se(journal_ring_read(r->data, DATA_SIZE, 0, 0, &p, &size, &total) == -EBADMSG);
+
+        /* Padding that doesn't extend to the end */
+        unaligned_write_ne64(r->data, JOURNAL_RING_RECORD_COMMITTED | JOURNAL_RING_RECORD_PADDING | 8);
+        assert_se(journal_ring_read(r->data, DATA_SIZE, 0, 0, &p, &size, &total) == -EBADMSG);
+
+        /* More than one lap ahead */
+        unaligned_write_ne64(r->data, JOURNAL_RING_RECORD_COMMITTED | 8);
+        assert_se(journal_ring_read(r->data, DATA_SIZE, 0, DATA_SIZE - 8, &p, &size, &total) == -EBADMSG);
+        assert_se(journal_ring_read(r->data, DATA_SIZE, 0, 0, &p, &size, &total) == 1);
+        assert_se(size == 8 && total == 16);
+}
+
+static void *writer_thread(void *userdata) {
+        Ring *r = ((void**) userdata)[0];
+        unsigned t = PTR_TO_UINT(((void**) userdata)[1]), i;
+        char buf[STRLEN("THREAD= N=") + DECIMAL_STR_MAX(unsigned) * 2];
+
+        for (i = 0; i < N_MESSAGES; i++) {
+                int k;
+
+                xsprintf(buf, "THREAD=%u N=%u", t, i);
+
+                while ((k = write_string(r, buf)) == -ENOBUFS)
+                        sched_yield();
+
+                assert_se(k >= 0);
+        }
+
+        return NULL;
+}
+
+static void test_threads(void) {
+        _cleanup_free_ Ring *r = ring_new();
+        void *args[N_THREADS][2];
+        pthread_t threads[N_THREADS];
+        unsigned next[N_THREADS] = {}, i, n = 0;
+
+        log_info("/* %s */", __func__);
+
+        for (i = 0; i < N_THREADS; i++) {
+                args[i][0] = r;
+                args[i][1] = UINT_TO_PTR(i);
+                assert_se(pthread_create(threads + i, NULL, writer_thread, args[i]) == 0);
+        }
+
+        /* Each thread's messages have to show up completely, and in the order they were written */
+        while (n < N_THREADS * N_MESSAGES) {
+                _cleanup_free_ char *s = NULL;
+                unsigned t, m;
+
+                if (read_string(r, &s) == 0) {
+                        sched_yield();
+                        continue;
+                }
+
+                assert_se(sscanf(s, "THREAD=%u N=%u", &t, &m) == 2);
+                assert_se(t < N_THREADS);
+                assert_se(m == next[t]);
+                next[t]++;
+                n++;
+        }
+
+        for (i = 0; i < N_THREADS; i++)
+                assert_se(pthread_join(threads[i], NULL) == 0);
+
+        assert_se(r->header.head == r->header.tail);
+        log_info("%u messages, ring went round %" PRIu64 " times", n, r->header.head / DATA_SIZE);
+}
+
+int main(int argc, char *argv[]) {
+        test_setup_logging(LOG_INFO);
+
+        test_basic();
+        test_full();
+        test_wakeup();
+        test_garbage();
+        test_threads();
+
+        return 0;
+}
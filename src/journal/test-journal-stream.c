@@ -7,12 +7,15 @@
 
 #include "alloc-util.h"
 #include "chattr-util.h"
+#include "io-util.h"
 #include "journal-file.h"
 #include "journal-internal.h"
 #include "log.h"
 #include "macro.h"
 #include "parse-util.h"
 #include "rm-rf.h"
+#include "string-util.h"
+#include "strv.h"
 #include "tests.h"
 #include "util.h"
 
@@ -58,6 +61,113 @@ static void verify_contents(sd_journal *j, unsigned skip) {
                 assert_se(i == N_ENTRIES);
 }
 
+static void append_data_fields_entry(JournalFile *f, const char *long_value) {
+        _cleanup_free_ char *message = NULL, *foo = NULL;
+        struct iovec iovec[4];
+        dual_timestamp ts;
+
+        /* The long values compress well, the short ones don't, and hence are stored as they are */
+        assert_se(message = strjoin("MESSAGE=", long_value));
+        assert_se(foo = strjoin("FOO=", long_value));
+
+        iovec[0] = IOVEC_MAKE_STRING(message);
+        iovec[1] = IOVEC_MAKE_STRING(foo);
+        iovec[2] = IOVEC_MAKE_STRING("FOOBAR=short");
+        iovec[3] = IOVEC_MAKE_STRING("BAR=short");
+
+        dual_timestamp_get(&ts);
+        assert_se(journal_file_append_entry(f, &ts, NULL, iovec, ELEMENTSOF(iovec), NULL, NULL, NULL) == 0);
+}
+
+static void verify_data_fields(sd_journal *j, char **expected) {
+        unsigned n = 0;
+
+        SD_JOURNAL_FOREACH(j) {
+                _cleanup_strv_free_ char **fields = NULL;
+                const void *d;
+                size_t l;
+
+                SD_JOURNAL_FOREACH_DATA(j, d, l) {
+                        const char *eq;
+
+                        assert_se(eq = memchr(d, '=', l));
+                        assert_se(strv_extend(&fields, strndupa(d, eq - (const char*) d)) >= 0);
+
+                        /* What is returned is still the complete, decompressed payload */
+                        if (memcmp(d, "FOO=", 4) == 0 || memcmp(d, "MESSAGE=", 8) == 0)
+                                assert_se(l - (eq + 1 - (const char*) d) == 1024);
+                }
+
+                /* Fields that aren't enumerated can still be retrieved directly */
+                assert_se(sd_journal_get_data(j, "BAR", &d, &l) >= 0);
+                assert_se(l == STRLEN("BAR=short") && memcmp(d, "BAR=short", l) == 0);
+
+                strv_sort(fields);
+                assert_se(strv_equal(fields, expected));
+                n++;
+        }
+
+        assert_se(n == 2);
+}
+
+static void test_data_fields(void) {
+        char t[] = "/var/tmp/journal-data-fields-XXXXXX";
+        _cleanup_(sd_journal_closep) sd_journal *j = NULL;
+        _cleanup_free_ char *long_value = NULL;
+        JournalFile *compressed, *uncompressed;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(mkdtemp(t));
+        (void) chattr_path(t, FS_NOCOW_FL, FS_NOCOW_FL, NULL);
+
+        assert_se(long_value = malloc(1025));
+        memset(long_value, 'x', 1024);
+        long_value[1024] = 0;
+
+        /* One file compresses everything beyond 8 bytes, the other nothing, so that both ways of looking at
+         * the field name are exercised */
+        assert_se(journal_file_open(-1, strjoina(t, "/compressed.journal"), O_RDWR|O_CREAT, 0666, DEFAULT_COMPRESSION, 8, false, NULL, NULL, NULL, NULL, &compressed) == 0);
+        assert_se(journal_file_open(-1, strjoina(t, "/uncompressed.journal"), O_RDWR|O_CREAT, 0666, false, (uint64_t) -1, false, NULL, NULL, NULL, NULL, &uncompressed) == 0);
+
+        append_data_fields_entry(compressed, long_value);
+        append_data_fields_entry(uncompressed, long_value);
+
+        (void) journal_file_close(compressed);
+        (void) journal_file_close(uncompressed);
+
+        assert_se(sd_journal_open_directory(&j, t, 0) >= 0);
+
+        /* Without a selection, everything is enumerated */
+        verify_data_fields(j, STRV_MAKE("BAR", "FOO", "FOOBAR", "MESSAGE"));
+
+        /* Only whole field names match, neither prefixes nor longer names */
+        assert_se(sd_journal_set_data_fields(j, STRV_MAKE("FOO", "MESSAGE")) >= 0);
+        verify_data_fields(j, STRV_MAKE("FOO", "MESSAGE"));
+
+        assert_se(sd_journal_set_data_fields(j, STRV_MAKE("FO", "FOOBAR", "BAR")) >= 0);
+        verify_data_fields(j, STRV_MAKE("BAR", "FOOBAR"));
+
+        /* Setting the same list again is fine */
+        assert_se(sd_journal_set_data_fields(j, STRV_MAKE("FO", "FOOBAR", "BAR")) >= 0);
+        verify_data_fields(j, STRV_MAKE("BAR", "FOOBAR"));
+
+        assert_se(sd_journal_set_data_fields(j, STRV_MAKE("NONE")) >= 0);
+        verify_data_fields(j, STRV_MAKE_EMPTY);
+
+        assert_se(sd_journal_set_data_fields(j, STRV_MAKE("foo")) == -EINVAL);
+        assert_se(sd_journal_set_data_fields(j, STRV_MAKE("FOO=")) == -EINVAL);
+
+        /* A failed call leaves the previous selection in place */
+        verify_data_fields(j, STRV_MAKE_EMPTY);
+
+        /* NULL resets the selection */
+        assert_se(sd_journal_set_data_fields(j, NULL) >= 0);
+        verify_data_fields(j, STRV_MAKE("BAR", "FOO", "FOOBAR", "MESSAGE"));
+
+        assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+}
+
 int main(int argc, char *argv[]) {
         JournalFile *one, *two, *three;
         char t[] = "/var/tmp/journal-stream-XXXXXX";
@@ -78,9 +188,9 @@ int main(int argc, char *argv[]) {
         assert_se(chdir(t) >= 0);
         (void) chattr_path(t, FS_NOCOW_FL, FS_NOCOW_FL, NULL);
 
-        assert_se(journal_file_open(-1, "one.journal", O_RDWR|O_CREAT, 0666, true, (uint64_t) -1, false, NULL, NULL, NULL, NULL, &one) == 0);
-        assert_se(journal_file_open(-1, "two.journal", O_RDWR|O_CREAT, 0666, true, (uint64_t) -1, false, NULL, NULL, NULL, NULL, &two) == 0);
-        assert_se(journal_file_open(-1, "three.journal", O_RDWR|O_CREAT, 0666, true, (uint64_t) -1, false, NULL, NULL, NULL, NULL, &three) == 0);
+        assert_se(journal_file_open(-1, "one.journal", O_RDWR|O_CREAT, 0666, DEFAULT_COMPRESSION, (uint64_t) -1, false, NULL, NULL, NULL, NULL, &one) == 0);
+        assert_se(journal_file_open(-1, "two.journal", O_RDWR|O_CREAT, 0666, DEFAULT_COMPRESSION, (uint64_t) -1, false, NULL, NULL, NULL, NULL, &two) == 0);
+        assert_se(journal_file_open(-1, "three.journal", O_RDWR|O_CREAT, 0666, DEFAULT_COMPRESSION, (uint64_t) -1, false, NULL, NULL, NULL, NULL, &three) == 0);
 
         for (i = 0; i < N_ENTRIES; i++) {
                 char *p, *q;
@@ -178,5 +288,7 @@ int main(int argc, char *argv[]) {
 
         assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
 
+        test_data_fields();
+
         return 0;
 }
@@ -0,0 +1,108 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <unistd.h>
+
+#include "fileio.h"
+#include "io-util.h"
+#include "journal-util.h"
+#include "journald-unit-index.h"
+#include "parse-util.h"
+#include "rm-rf.h"
+#include "string-util.h"
+#include "tests.h"
+#include "tmpfile-util.h"
+
+static void note(Server *s, const ClientContext *c, const char *field) {
+        struct iovec iovec[] = {
+                IOVEC_MAKE_STRING("MESSAGE=hello"),
+                IOVEC_MAKE_STRING(field),
+        };
+
+        server_unit_index_note(s, c, iovec, ELEMENTSOF(iovec));
+}
+
+static void test_unit_index(const char *dir) {
+        ClientContext pid1 = { .pid = 1, .uid = 0 }, root = { .pid = 100, .uid = 0 }, user = { .pid = 200, .uid = 1000 };
+        Server s = {
+                .runtime_directory = (char*) dir,
+                .unit_index_fd = -1,
+        };
+        _cleanup_free_ char *line = NULL;
+        const char *index, *p;
+        usec_t since;
+
+        log_info("/* %s */", __func__);
+
+        index = strjoina(dir, "/units");
+
+        /* Nothing to look at yet */
+        assert_se(journal_unit_index_check(index, "foo.service", 1) == -ENOENT);
+
+        server_unit_index_open(&s);
+        assert_se(s.unit_index_fd >= 0);
+
+        p = strjoina(index, "/.since");
+        assert_se(read_one_line_file(p, &line) >= 0);
+        assert_se(safe_atou64(line, &since) >= 0);
+
+        /* The unit's own messages count, no matter who sent them */
+        note(&s, &user, "_SYSTEMD_UNIT=own.service");
+
+        /* The other fields only count when add_matches_for_unit() looks at them */
+        note(&s, &pid1, "UNIT=pid1.service");
+        note(&s, &root, "UNIT=root.service");
+        note(&s, &user, "UNIT=user.service");
+        note(&s, &root, "COREDUMP_UNIT=coredump-root.service");
+        note(&s, &user, "COREDUMP_UNIT=coredump-user.service");
+        note(&s, &root, "OBJECT_SYSTEMD_UNIT=object-root.service");
+        note(&s, &user, "OBJECT_SYSTEMD_UNIT=object-user.service");
+        note(&s, NULL, "UNIT=nocontext.service");
+
+        /* Invalid names are never recorded */
+        note(&s, &pid1, "UNIT=../foo.service");
+        note(&s, &pid1, "UNIT=");
+
+        assert_se(journal_unit_index_check(index, "own.service", since) > 0);
+        assert_se(journal_unit_index_check(index, "pid1.service", since) > 0);
+        assert_se(journal_unit_index_check(index, "root.service", since) == 0);
+        assert_se(journal_unit_index_check(index, "user.service", since) == 0);
+        assert_se(journal_unit_index_check(index, "coredump-root.service", since) > 0);
+        assert_se(journal_unit_index_check(index, "coredump-user.service", since) == 0);
+        assert_se(journal_unit_index_check(index, "object-root.service", since) > 0);
+        assert_se(journal_unit_index_check(index, "object-user.service", since) == 0);
+        assert_se(journal_unit_index_check(index, "nocontext.service", since) == 0);
+        assert_se(journal_unit_index_check(index, "other.service", since) == 0);
+        assert_se(access(strjoina(dir, "/foo.service"), F_OK) < 0 && errno == ENOENT);
+
+        /* The index doesn't know about anything before it was started */
+        assert_se(journal_unit_index_check(index, "other.service", since - 1) == -ESTALE);
+
+        /* A file that exists already, e.g. left behind by a previous instance, is fine */
+        server_unit_index_close(&s);
+        server_unit_index_open(&s);
+        assert_se(s.unit_index_fd >= 0);
+        note(&s, &pid1, "UNIT=pid1.service");
+        note(&s, &pid1, "UNIT=new.service");
+        assert_se(journal_unit_index_check(index, "own.service", since) > 0);
+        assert_se(journal_unit_index_check(index, "pid1.service", since) > 0);
+        assert_se(journal_unit_index_check(index, "new.service", since) > 0);
+        assert_se(s.unit_index_fd >= 0);
+
+        /* Without the timestamp the index cannot be used */
+        assert_se(unlink(p) >= 0);
+        assert_se(journal_unit_index_check(index, "other.service", since) == -ENOENT);
+
+        server_unit_index_close(&s);
+}
+
+int main(int argc, char *argv[]) {
+        _cleanup_(rm_rf_physical_and_freep) char *dir = NULL;
+
+        test_setup_logging(LOG_DEBUG);
+
+        assert_se(mkdtemp_malloc("/tmp/test-journal-unit-index.XXXXXX", &dir) >= 0);
+
+        test_unit_index(dir);
+
+        return 0;
+}
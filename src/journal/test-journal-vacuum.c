@@ -0,0 +1,119 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "fd-util.h"
+#include "fs-util.h"
+#include "journal-def.h"
+#include "journal-vacuum.h"
+#include "path-util.h"
+#include "rm-rf.h"
+#include "sd-id128.h"
+#include "stdio-util.h"
+#include "tests.h"
+#include "tmpfile-util.h"
+
+#define SEQNUM_ID SD_ID128_MAKE(a6,b3,b5,3d,7e,e6,4c,5e,93,8d,ad,e6,1d,4b,db,ee)
+
+static void make_file(const char *dn, const char *fn, uint64_t n_entries) {
+        _cleanup_free_ char *p = NULL, *buf = NULL;
+        _cleanup_close_ int fd = -1;
+        le64_t n = htole64(n_entries);
+
+        assert_se(p = path_join(dn, fn));
+        assert_se((fd = open(p, O_CREAT|O_WRONLY|O_CLOEXEC|O_EXCL, 0644)) >= 0);
+
+        /* Something that looks like a header, with the number of entries in place */
+        assert_se(buf = malloc0(64 * 1024));
+        assert_se(pwrite(fd, buf, 64 * 1024, 0) == 64 * 1024);
+        assert_se(pwrite(fd, &n, sizeof(n), offsetof(Header, n_entries)) == sizeof(n));
+        assert_se(fsync(fd) >= 0);
+}
+
+static char *archived_name(uint64_t seqnum) {
+        char *fn;
+
+        assert_se(asprintf(&fn, "system@" SD_ID128_FORMAT_STR "-%016" PRIx64 "-%016" PRIx64 ".journal",
+                           SD_ID128_FORMAT_VAL(SEQNUM_ID), seqnum, UINT64_C(1000000) + seqnum) >= 0);
+        return fn;
+}
+
+static bool file_exists(const char *dn, uint64_t seqnum) {
+        _cleanup_free_ char *fn = archived_name(seqnum), *p = NULL;
+
+        assert_se(p = path_join(dn, fn));
+        return access(p, F_OK) >= 0;
+}
+
+static void test_vacuum_index(void) {
+        _cleanup_(journal_vacuum_index_freep) JournalVacuumIndex *idx = NULL;
+        _cleanup_(rm_rf_physical_and_freep) char *dn = NULL;
+        _cleanup_free_ char *fn = NULL;
+        uint64_t usage, usage2, i;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(mkdtemp_malloc("/var/tmp/test-journal-vacuum-XXXXXX", &dn) >= 0);
+
+        make_file(dn, "system.journal", 1);
+        make_file(dn, "unrelated.txt", 1);
+        for (i = 1; i <= 5; i++) {
+                _cleanup_free_ char *a = archived_name(i * 10);
+
+                /* The third one is empty, it goes away first, no matter what */
+                make_file(dn, a, i == 3 ? 0 : 1);
+        }
+
+        assert_se(journal_vacuum_index_new(dn, &idx) >= 0);
+        assert_se(journal_vacuum_index_usage(idx, &usage) >= 0);
+        assert_se(usage > 0);
+
+        /* Keep four files, i.e. the active one and the three newest archived ones */
+        assert_se(journal_vacuum_index_vacuum(idx, 0, 4, 0, NULL, true) >= 0);
+        assert_se(!file_exists(dn, 10));
+        assert_se(file_exists(dn, 20));
+        assert_se(!file_exists(dn, 30));
+        assert_se(file_exists(dn, 40));
+        assert_se(file_exists(dn, 50));
+
+        assert_se(journal_vacuum_index_usage(idx, &usage2) >= 0);
+        assert_se(usage2 < usage);
+
+        /* A newly archived file is picked up without a scan, and the oldest goes away */
+        fn = archived_name(60);
+        make_file(dn, fn, 1);
+        assert_se(journal_vacuum_index_add(idx, fn) >= 0);
+        assert_se(journal_vacuum_index_usage(idx, &usage) >= 0);
+        assert_se(usage > usage2);
+
+        assert_se(journal_vacuum_index_vacuum(idx, 0, 4, 0, NULL, true) >= 0);
+        assert_se(!file_exists(dn, 20));
+        assert_se(file_exists(dn, 40));
+        assert_se(file_exists(dn, 60));
+
+        /* Files that disappeared behind our back don't confuse it */
+        fn = mfree(fn);
+        fn = archived_name(40);
+        assert_se(unlinkat(AT_FDCWD, prefix_roota(dn, fn), 0) >= 0);
+        assert_se(journal_vacuum_index_vacuum(idx, 0, 2, 0, NULL, true) >= 0);
+        assert_se(!file_exists(dn, 50));
+        assert_se(file_exists(dn, 60));
+
+        /* And after invalidation everything is looked at again */
+        journal_vacuum_index_invalidate(idx);
+        assert_se(journal_vacuum_index_usage(idx, &usage) >= 0);
+        assert_se(journal_vacuum_index_vacuum(idx, 0, 1, 0, NULL, true) >= 0);
+        assert_se(!file_exists(dn, 60));
+        assert_se(access(prefix_roota(dn, "system.journal"), F_OK) >= 0);
+        assert_se(access(prefix_roota(dn, "unrelated.txt"), F_OK) >= 0);
+}
+
+int main(int argc, char *argv[]) {
+        test_setup_logging(LOG_DEBUG);
+
+        test_vacuum_index();
+
+        return 0;
+}
@@ -3,13 +3,17 @@
 #include <fcntl.h>
 #include <unistd.h>
 
+#include "alloc-util.h"
 #include "chattr-util.h"
 #include "io-util.h"
 #include "journal-authenticate.h"
 #include "journal-file.h"
 #include "journal-vacuum.h"
+#include "journald-compress.h"
 #include "log.h"
+#include "lookup3.h"
 #include "rm-rf.h"
+#include "stdio-util.h"
 #include "tests.h"
 
 static bool arg_keep = false;
@@ -37,7 +41,7 @@ static void test_non_empty(void) {
 
         mkdtemp_chdir_chattr(t);
 
-        assert_se(journal_file_open(-1, "test.journal", O_RDWR|O_CREAT, 0666, true, (uint64_t) -1, true, NULL, NULL, NULL, NULL, &f) == 0);
+        assert_se(journal_file_open(-1, "test.journal", O_RDWR|O_CREAT, 0666, DEFAULT_COMPRESSION, (uint64_t) -1, true, NULL, NULL, NULL, NULL, &f) == 0);
 
         assert_se(dual_timestamp_get(&ts));
         assert_se(sd_id128_randomize(&fake_boot_id) == 0);
@@ -98,8 +102,8 @@ static void test_non_empty(void) {
 
         assert_se(journal_file_move_to_entry_by_seqnum(f, 10, DIRECTION_DOWN, &o, NULL) == 0);
 
-        journal_file_rotate(&f, true, (uint64_t) -1, true, NULL);
-        journal_file_rotate(&f, true, (uint64_t) -1, true, NULL);
+        journal_file_rotate(&f, DEFAULT_COMPRESSION, (uint64_t) -1, true, NULL);
+        journal_file_rotate(&f, DEFAULT_COMPRESSION, (uint64_t) -1, true, NULL);
 
         (void) journal_file_close(f);
 
@@ -116,6 +120,414 @@ static void test_non_empty(void) {
         puts("------------------------------------------------------------");
 }
 
+static void test_append_entries(void) {
+        JournalFileEntry entries[3];
+        struct iovec iovec[2];
+        static const char test[] = "TEST1=1", test2[] = "TEST2=2", test3[] = "TEST3=3";
+        JournalFile *f;
+        dual_timestamp ts;
+        size_t n_appended = 0;
+        Object *o;
+        uint64_t p;
+        char t[] = "/var/tmp/journal-XXXXXX";
+
+        mkdtemp_chdir_chattr(t);
+
+        assert_se(journal_file_open(-1, "test.journal", O_RDWR|O_CREAT, 0666, DEFAULT_COMPRESSION, (uint64_t) -1, true, NULL, NULL, NULL, NULL, &f) == 0);
+
+        assert_se(dual_timestamp_get(&ts));
+
+        iovec[0] = IOVEC_MAKE_STRING(test);
+        iovec[1] = IOVEC_MAKE_STRING(test2);
+
+        entries[0] = (JournalFileEntry) { .ts = ts, .iovec = iovec, .n_iovec = 2 };
+        entries[1] = (JournalFileEntry) { .ts = ts, .iovec = iovec + 1, .n_iovec = 1 };
+        entries[2] = (JournalFileEntry) { .ts = ts, .iovec = &IOVEC_MAKE_STRING(test3), .n_iovec = 1 };
+
+        assert_se(journal_file_append_entries(f, NULL, entries, ELEMENTSOF(entries), NULL, &n_appended) == 0);
+        assert_se(n_appended == ELEMENTSOF(entries));
+        assert_se(le64toh(f->header->n_entries) == 3);
+
+        /* An invalid timestamp stops the batch */
+        entries[1].ts.realtime = 0;
+        assert_se(journal_file_append_entries(f, NULL, entries, ELEMENTSOF(entries), NULL, &n_appended) == -EBADMSG);
+        assert_se(n_appended == 1);
+        assert_se(le64toh(f->header->n_entries) == 4);
+
+        assert_se(journal_file_find_data_object(f, test2, strlen(test2), NULL, &p) == 1);
+        assert_se(journal_file_next_entry_for_data(f, NULL, 0, p, DIRECTION_DOWN, &o, NULL) == 1);
+        assert_se(le64toh(o->entry.seqnum) == 1);
+        assert_se(journal_file_next_entry_for_data(f, NULL, 0, p, DIRECTION_UP, &o, NULL) == 1);
+        assert_se(le64toh(o->entry.seqnum) == 4);
+
+        assert_se(journal_file_find_data_object(f, test3, strlen(test3), NULL, &p) == 1);
+        assert_se(journal_file_next_entry_for_data(f, NULL, 0, p, DIRECTION_DOWN, &o, NULL) == 1);
+        assert_se(le64toh(o->entry.seqnum) == 3);
+
+        (void) journal_file_close(f);
+
+        if (arg_keep)
+                log_info("Not removing %s", t);
+        else
+                assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+
+        puts("------------------------------------------------------------");
+}
+
+#if HAVE_COMPRESSION
+static void test_append_entries_compressed(void) {
+        JournalFileEntry entries[16];
+        struct iovec iovec[ELEMENTSOF(entries)];
+        char *fields[ELEMENTSOF(entries)];
+        JournalFileCompressed *compressed;
+        size_t i, n_compressed, n_appended = 0;
+        JournalFile *f;
+        dual_timestamp ts;
+        Object *o;
+        char t[] = "/var/tmp/journal-XXXXXX";
+
+        mkdtemp_chdir_chattr(t);
+
+        assert_se(journal_file_open(-1, "test.journal", O_RDWR|O_CREAT, 0666, DEFAULT_COMPRESSION, (uint64_t) -1, true, NULL, NULL, NULL, NULL, &f) == 0);
+
+        assert_se(dual_timestamp_get(&ts));
+
+        /* Large enough in total to be compressed on threads, and one of them is there already */
+        for (i = 0; i < ELEMENTSOF(entries); i++) {
+                assert_se(fields[i] = malloc(16 * 1024));
+                memset(fields[i], 'a' + i, 16 * 1024);
+                memcpy(fields[i], "FIELD=", STRLEN("FIELD="));
+
+                iovec[i] = IOVEC_MAKE(fields[i], 16 * 1024);
+                entries[i] = (JournalFileEntry) { .ts = ts, .iovec = iovec + i, .n_iovec = 1 };
+        }
+
+        assert_se(journal_file_append_entry(f, &ts, NULL, iovec, 1, NULL, NULL, NULL) == 0);
+
+        /* Not enough data, nothing done */
+        assert_se(compress_entries_threaded(f, entries + 1, 1, 4, &compressed, &n_compressed) == 0);
+        assert_se(!compressed && n_compressed == 0);
+        assert_se(!entries[1].compressed);
+
+        assert_se(compress_entries_threaded(f, entries, ELEMENTSOF(entries), 4, &compressed, &n_compressed) == 1);
+        assert_se(n_compressed == ELEMENTSOF(entries));
+        assert_se(compressed[0].compression == 0);
+        for (i = 1; i < ELEMENTSOF(entries); i++) {
+                assert_se(entries[i].compressed == compressed + i);
+                assert_se(compressed[i].compression == JOURNAL_FILE_COMPRESSION(f));
+                assert_se(compressed[i].data);
+                assert_se(compressed[i].size < iovec[i].iov_len);
+        }
+
+        assert_se(journal_file_append_entries(f, NULL, entries, ELEMENTSOF(entries), NULL, &n_appended) == 0);
+        assert_se(n_appended == ELEMENTSOF(entries));
+        journal_file_compressed_free_many(compressed, n_compressed);
+
+        assert_se(le64toh(f->header->n_entries) == ELEMENTSOF(entries) + 1);
+        assert_se(le64toh(f->header->n_data) == ELEMENTSOF(entries));
+
+        /* What ended up on disk decompresses to the original again */
+        for (i = 0; i < ELEMENTSOF(entries); i++) {
+                assert_se(journal_file_find_data_object(f, fields[i], iovec[i].iov_len, &o, NULL) == 1);
+                assert_se(o->object.flags & OBJECT_COMPRESSION_MASK);
+                assert_se(le64toh(o->object.size) < offsetof(Object, data.payload) + iovec[i].iov_len);
+                free(fields[i]);
+        }
+
+        (void) journal_file_close(f);
+
+        if (arg_keep)
+                log_info("Not removing %s", t);
+        else
+                assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+
+        puts("------------------------------------------------------------");
+}
+#endif
+
+static void test_copy_entries(void) {
+        _cleanup_(journal_file_copy_cache_freep) JournalFileCopyCache *cache = NULL;
+        _cleanup_free_ char *large = NULL;
+        JournalFile *from, *to, *to_uncached;
+        char buf[STRLEN("N=") + DECIMAL_STR_MAX(unsigned)];
+        dual_timestamp ts;
+        Object *o;
+        uint64_t p = 0, q;
+        unsigned i;
+        char t[] = "/var/tmp/journal-XXXXXX";
+
+        mkdtemp_chdir_chattr(t);
+
+        assert_se(journal_file_open(-1, "from.journal", O_RDWR|O_CREAT, 0666, DEFAULT_COMPRESSION, (uint64_t) -1, false, NULL, NULL, NULL, NULL, &from) == 0);
+        assert_se(journal_file_open(-1, "to.journal", O_RDWR|O_CREAT, 0666, DEFAULT_COMPRESSION, (uint64_t) -1, false, NULL, NULL, NULL, NULL, &to) == 0);
+        assert_se(journal_file_open(-1, "to-uncached.journal", O_RDWR|O_CREAT, 0666, DEFAULT_COMPRESSION, (uint64_t) -1, false, NULL, NULL, NULL, NULL, &to_uncached) == 0);
+
+        assert_se(large = malloc(4096 + 1));
+        memset(large, 'x', 4096);
+        memcpy(large, "LARGE=", STRLEN("LARGE="));
+        large[4096] = 0;
+
+        assert_se(dual_timestamp_get(&ts));
+
+        /* Most fields are the same for all entries */
+        for (i = 0; i < 100; i++) {
+                struct iovec iovec[3];
+
+                xsprintf(buf, "N=%u", i);
+                iovec[0] = IOVEC_MAKE_STRING(buf);
+                iovec[1] = IOVEC_MAKE_STRING("SAME=same");
+                iovec[2] = IOVEC_MAKE_STRING(large);
+
+                assert_se(journal_file_append_entry(from, &ts, NULL, iovec, ELEMENTSOF(iovec), NULL, NULL, NULL) == 0);
+        }
+
+        while (journal_file_next_entry(from, p, DIRECTION_DOWN, &o, &p) > 0) {
+                assert_se(journal_file_copy_entry_with_cache(from, to, o, p, &cache) >= 0);
+
+                assert_se(journal_file_move_to_object(from, OBJECT_ENTRY, p, &o) >= 0);
+                assert_se(journal_file_copy_entry(from, to_uncached, o, p) >= 0);
+        }
+
+        assert_se(cache);
+        assert_se(le64toh(to->header->n_entries) == 100);
+        assert_se(le64toh(to->header->n_data) == le64toh(from->header->n_data));
+        assert_se(le64toh(to->header->n_data) == le64toh(to_uncached->header->n_data));
+        assert_se(le64toh(to->header->n_fields) == le64toh(from->header->n_fields));
+
+        /* The compressed payload is passed through as it is */
+        assert_se(journal_file_find_data_object(from, large, 4096, &o, &q) == 1);
+        assert_se(o->object.flags & OBJECT_COMPRESSION_MASK);
+        assert_se(journal_file_find_data_object(to, large, 4096, NULL, &p) == 1);
+        assert_se(journal_file_find_data_object(to_uncached, large, 4096, NULL, &p) == 1);
+
+        /* Entries of the copy reference the same data as the original ones */
+        assert_se(journal_file_find_data_object(to, "SAME=same", STRLEN("SAME=same"), NULL, &p) == 1);
+        assert_se(journal_file_next_entry_for_data(to, NULL, 0, p, DIRECTION_UP, &o, NULL) == 1);
+        assert_se(le64toh(o->entry.seqnum) == 100);
+        assert_se(journal_file_find_data_object(to, "N=42", STRLEN("N=42"), NULL, &p) == 1);
+        assert_se(journal_file_next_entry_for_data(to, NULL, 0, p, DIRECTION_DOWN, &o, NULL) == 1);
+        assert_se(le64toh(o->entry.seqnum) == 43);
+
+        (void) journal_file_close(from);
+        (void) journal_file_close(to);
+        (void) journal_file_close(to_uncached);
+
+        if (arg_keep)
+                log_info("Not removing %s", t);
+        else
+                assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+
+        puts("------------------------------------------------------------");
+}
+
+static void test_data_cache(void) {
+        static const char test[] = "TEST=cached";
+        struct iovec iovec[2];
+        uint64_t hashes[2];
+        JournalFile *f;
+        dual_timestamp ts;
+        uint64_t p, q;
+        char t[] = "/var/tmp/journal-XXXXXX";
+
+        mkdtemp_chdir_chattr(t);
+
+        assert_se(journal_file_open(-1, "test.journal", O_RDWR|O_CREAT, 0666, DEFAULT_COMPRESSION, (uint64_t) -1, true, NULL, NULL, NULL, NULL, &f) == 0);
+
+        assert_se(dual_timestamp_get(&ts));
+
+        for (unsigned i = 0; i < 10; i++) {
+                char n[DECIMAL_STR_MAX(unsigned) + 3];
+
+                xsprintf(n, "N=%u", i);
+                iovec[0] = IOVEC_MAKE_STRING(test);
+                iovec[1] = IOVEC_MAKE_STRING(n);
+
+                assert_se(journal_file_append_entry(f, &ts, NULL, iovec, ELEMENTSOF(iovec), NULL, NULL, NULL) == 0);
+        }
+
+        /* The first lookup happens before the cache exists, after that TEST= is always a hit and N= always a miss */
+        log_info("data object cache: %u hit, %u miss",
+                 journal_file_data_cache_get_hit(f), journal_file_data_cache_get_missed(f));
+        assert_se(journal_file_data_cache_get_hit(f) == 9);
+        assert_se(journal_file_data_cache_get_missed(f) == 10);
+        assert_se(le64toh(f->header->n_data) == 11);
+
+        /* Cached and uncached lookups must agree */
+        assert_se(journal_file_find_data_object(f, test, strlen(test), NULL, &p) == 1);
+        assert_se(journal_file_find_data_object(f, "N=3", 3, NULL, &q) == 1);
+        assert_se(p != q);
+        assert_se(journal_file_find_data_object(f, "N=10", 4, NULL, &q) == 0);
+
+        /* Entries with precomputed hashes refer to the very same objects */
+        iovec[0] = IOVEC_MAKE_STRING(test);
+        iovec[1] = IOVEC_MAKE_STRING("N=10");
+        hashes[0] = hash64(iovec[0].iov_base, iovec[0].iov_len);
+        hashes[1] = hash64(iovec[1].iov_base, iovec[1].iov_len);
+        assert_se(journal_file_append_entry_with_hashes(f, &ts, NULL, iovec, hashes, ELEMENTSOF(iovec), NULL, NULL, NULL) == 0);
+        assert_se(le64toh(f->header->n_data) == 12);
+        assert_se(journal_file_find_data_object(f, test, strlen(test), NULL, &q) == 1);
+        assert_se(p == q);
+        assert_se(journal_file_find_data_object(f, "N=10", 4, NULL, &q) == 1);
+
+        (void) journal_file_close(f);
+
+        if (arg_keep)
+                log_info("Not removing %s", t);
+        else
+                assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+
+        puts("------------------------------------------------------------");
+}
+
+static void check_field_ranges(JournalFile *f, int expected) {
+        JournalFieldRange *ranges;
+        size_t n, i;
+        unsigned found = 0;
+
+        assert_se(journal_file_get_field_ranges(f, "BOOT", &ranges, &n) == expected);
+        assert_se(n == 2);
+
+        for (i = 0; i < n; i++) {
+                if (ranges[i].size == 6 && memcmp(ranges[i].data, "BOOT=a", 6) == 0) {
+                        assert_se(ranges[i].first_realtime == 1000);
+                        assert_se(ranges[i].last_realtime == 3000);
+                        found++;
+                } else if (ranges[i].size == 6 && memcmp(ranges[i].data, "BOOT=b", 6) == 0) {
+                        assert_se(ranges[i].first_realtime == 2000);
+                        assert_se(ranges[i].last_realtime == 2000);
+                        found++;
+                }
+        }
+
+        assert_se(found == 2);
+        journal_field_range_free_many(ranges, n);
+}
+
+static void test_field_index(void) {
+        static const char *const boots[] = { "BOOT=a", "BOOT=b", "BOOT=a" };
+        JournalMetrics metrics;
+        JournalFile *f;
+        uint64_t p;
+        char t[] = "/var/tmp/journal-XXXXXX";
+
+        mkdtemp_chdir_chattr(t);
+
+        /* Only files with metrics, i.e. the ones journald writes, get room for the index in the header */
+        journal_reset_metrics(&metrics);
+        assert_se(journal_file_open(-1, "test.journal", O_RDWR|O_CREAT, 0666, DEFAULT_COMPRESSION, (uint64_t) -1, false, &metrics, NULL, NULL, NULL, &f) == 0);
+        assert_se(JOURNAL_HEADER_CONTAINS(f->header, field_index_offset));
+
+        for (unsigned i = 0; i < ELEMENTSOF(boots); i++) {
+                dual_timestamp ts = { .realtime = (i + 1) * 1000, .monotonic = (i + 1) * 1000 };
+                char n[DECIMAL_STR_MAX(unsigned) + 3];
+                struct iovec iovec[2];
+
+                xsprintf(n, "N=%u", i);
+                iovec[0] = IOVEC_MAKE_STRING(boots[i]);
+                iovec[1] = IOVEC_MAKE_STRING(n);
+
+                assert_se(journal_file_append_entry(f, &ts, NULL, iovec, ELEMENTSOF(iovec), NULL, NULL, NULL) == 0);
+        }
+
+        /* Without an index, the values are read from the DATA objects */
+        check_field_ranges(f, 0);
+        assert_se(!JOURNAL_HEADER_FIELD_INDEXED(f->header));
+
+        assert_se(journal_file_archive(f) == 0);
+        assert_se(JOURNAL_HEADER_FIELD_INDEXED(f->header));
+        assert_se(journal_file_find_field_object(f, "BOOT", 4, NULL, &p) == 1);
+        assert_se(journal_file_find_field_index(f, p, NULL, NULL) == 1);
+        assert_se(journal_file_find_field_object(f, "N", 1, NULL, &p) == 1);
+        assert_se(journal_file_find_field_index(f, p, NULL, NULL) == 1);
+
+        check_field_ranges(f, 1);
+
+        (void) journal_file_close(f);
+
+        if (arg_keep)
+                log_info("Not removing %s", t);
+        else
+                assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+
+        puts("------------------------------------------------------------");
+}
+
+#define N_TIME_INDEX_ENTRIES 3000U
+
+static void reset_time_index(JournalFile *f) {
+        f->time_index = mfree(f->time_index);
+        f->n_time_index = 0;
+        f->time_index_loaded = false;
+}
+
+static void check_seek_realtime(JournalFile *f, bool indexed) {
+        Object *o;
+        uint64_t x;
+
+        /* Entry i has realtime (i + 1) * 10. The index is loaded anew for every lookup, so that each one
+         * goes through the index, if there is one. */
+        for (x = 0; x <= (N_TIME_INDEX_ENTRIES + 1) * 10; x += 7) {
+                uint64_t down = DIV_ROUND_UP(x, 10) * 10, up = x / 10 * 10;
+                int r;
+
+                reset_time_index(f);
+                r = journal_file_move_to_entry_by_realtime(f, x, DIRECTION_DOWN, &o, NULL);
+                assert_se(r >= 0);
+                assert_se(f->time_index_loaded);
+                assert_se((f->n_time_index > 0) == indexed);
+                if (down > N_TIME_INDEX_ENTRIES * 10)
+                        assert_se(r == 0);
+                else
+                        assert_se(r == 1 && le64toh(o->entry.realtime) == MAX(down, 10U));
+
+                reset_time_index(f);
+                r = journal_file_move_to_entry_by_realtime(f, x, DIRECTION_UP, &o, NULL);
+                assert_se(r >= 0);
+                assert_se(f->time_index_loaded);
+                assert_se((f->n_time_index > 0) == indexed);
+                if (up < 10)
+                        assert_se(r == 0);
+                else
+                        assert_se(r == 1 && le64toh(o->entry.realtime) == MIN(up, N_TIME_INDEX_ENTRIES * 10));
+        }
+}
+
+static void test_time_index(void) {
+        JournalMetrics metrics;
+        JournalFile *f;
+        char t[] = "/var/tmp/journal-XXXXXX";
+
+        mkdtemp_chdir_chattr(t);
+
+        journal_reset_metrics(&metrics);
+        assert_se(journal_file_open(-1, "test.journal", O_RDWR|O_CREAT, 0666, false, (uint64_t) -1, false, &metrics, NULL, NULL, NULL, &f) == 0);
+
+        for (unsigned i = 0; i < N_TIME_INDEX_ENTRIES; i++) {
+                dual_timestamp ts = { .realtime = (i + 1) * 10, .monotonic = (i + 1) * 10 };
+                struct iovec iovec = IOVEC_MAKE_STRING("TEST=time");
+
+                assert_se(journal_file_append_entry(f, &ts, NULL, &iovec, 1, NULL, NULL, NULL) == 0);
+        }
+
+        check_seek_realtime(f, false);
+        assert_se(!JOURNAL_HEADER_TIME_INDEXED(f->header));
+
+        assert_se(journal_file_archive(f) == 0);
+        assert_se(JOURNAL_HEADER_TIME_INDEXED(f->header));
+        assert_se(f->header->time_index_offset != 0);
+
+        check_seek_realtime(f, true);
+
+        (void) journal_file_close(f);
+
+        if (arg_keep)
+                log_info("Not removing %s", t);
+        else
+                assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+
+        puts("------------------------------------------------------------");
+}
+
 static void test_empty(void) {
         JournalFile *f1, *f2, *f3, *f4;
         char t[] = "/var/tmp/journal-XXXXXX";
@@ -126,11 +538,11 @@ static void test_empty(void) {
 
         assert_se(journal_file_open(-1, "test.journal", O_RDWR|O_CREAT, 0666, false, (uint64_t) -1, false, NULL, NULL, NULL, NULL, &f1) == 0);
 
-        assert_se(journal_file_open(-1, "test-compress.journal", O_RDWR|O_CREAT, 0666, true, (uint64_t) -1, false, NULL, NULL, NULL, NULL, &f2) == 0);
+        assert_se(journal_file_open(-1, "test-compress.journal", O_RDWR|O_CREAT, 0666, DEFAULT_COMPRESSION, (uint64_t) -1, false, NULL, NULL, NULL, NULL, &f2) == 0);
 
         assert_se(journal_file_open(-1, "test-seal.journal", O_RDWR|O_CREAT, 0666, false, (uint64_t) -1, true, NULL, NULL, NULL, NULL, &f3) == 0);
 
-        assert_se(journal_file_open(-1, "test-seal-compress.journal", O_RDWR|O_CREAT, 0666, true, (uint64_t) -1, true, NULL, NULL, NULL, NULL, &f4) == 0);
+        assert_se(journal_file_open(-1, "test-seal-compress.journal", O_RDWR|O_CREAT, 0666, DEFAULT_COMPRESSION, (uint64_t) -1, true, NULL, NULL, NULL, NULL, &f4) == 0);
 
         journal_file_print_header(f1);
         puts("");
@@ -157,7 +569,7 @@ static void test_empty(void) {
         (void) journal_file_close(f4);
 }
 
-#if HAVE_XZ || HAVE_LZ4
+#if HAVE_COMPRESSION
 static bool check_compressed(uint64_t compress_threshold, uint64_t data_size) {
         dual_timestamp ts;
         JournalFile *f;
@@ -175,7 +587,7 @@ static bool check_compressed(uint64_t compress_threshold, uint64_t data_size) {
 
         mkdtemp_chdir_chattr(t);
 
-        assert_se(journal_file_open(-1, "test.journal", O_RDWR|O_CREAT, 0666, true, compress_threshold, true, NULL, NULL, NULL, NULL, &f) == 0);
+        assert_se(journal_file_open(-1, "test.journal", O_RDWR|O_CREAT, 0666, DEFAULT_COMPRESSION, compress_threshold, true, NULL, NULL, NULL, NULL, &f) == 0);
 
         dual_timestamp_get(&ts);
 
@@ -240,6 +652,64 @@ static void test_min_compress_size(void) {
 }
 #endif
 
+#if HAVE_ZSTD
+#define N_DICTIONARY_ENTRIES 4000U
+
+static void test_dictionary(void) {
+        JournalFile *f;
+        char t[] = "/var/tmp/journal-XXXXXX";
+        char m[128];
+        Object *o;
+
+        mkdtemp_chdir_chattr(t);
+
+        assert_se(journal_file_open(-1, "test.journal", O_RDWR|O_CREAT, 0666, OBJECT_COMPRESSED_ZSTD, (uint64_t) -1, false, NULL, NULL, NULL, NULL, &f) == 0);
+        assert_se(!JOURNAL_HEADER_CONTAINS(f->header, dictionary_offset));
+
+        /* Samples are collected while appending, but the dictionary is only trained when rotating */
+        for (unsigned i = 0; i < N_DICTIONARY_ENTRIES; i++) {
+                dual_timestamp ts = { .realtime = (i + 1) * 10, .monotonic = (i + 1) * 10 };
+                struct iovec iovec;
+
+                xsprintf(m, "MESSAGE=Accepted publickey for user%u from 192.168.%u.%u port %u", i % 7, i % 13, i, 40000 + i);
+                iovec = IOVEC_MAKE_STRING(m);
+                assert_se(journal_file_append_entry(f, &ts, NULL, &iovec, 1, NULL, NULL, NULL) == 0);
+        }
+
+        assert_se(f->dictionary_samples_size > 0);
+        assert_se(!f->dictionary);
+
+        assert_se(journal_file_rotate(&f, OBJECT_COMPRESSED_ZSTD, (uint64_t) -1, false, NULL) >= 0);
+        assert_se(JOURNAL_HEADER_CONTAINS(f->header, dictionary_offset));
+
+        if (f->header->dictionary_offset == 0)
+                log_info("Could not train dictionary, skipping rest of test");
+        else {
+                dual_timestamp ts = { .realtime = 1, .monotonic = 1 };
+                struct iovec iovec;
+
+                assert_se(le32toh(f->header->incompatible_flags) & HEADER_INCOMPATIBLE_COMPRESSION_DICTIONARY);
+
+                xsprintf(m, "MESSAGE=Accepted publickey for user%u from 192.168.%u.%u port %u", 3U, 5U, 100U, 50000U);
+                iovec = IOVEC_MAKE_STRING(m);
+                assert_se(journal_file_append_entry(f, &ts, NULL, &iovec, 1, NULL, NULL, NULL) == 0);
+
+                /* Finding the object compares the decompressed payload */
+                assert_se(journal_file_find_data_object(f, m, strlen(m), &o, NULL) == 1);
+                log_info("Data object is %s", (o->object.flags & OBJECT_COMPRESSED_ZSTD) ? "compressed" : "uncompressed");
+        }
+
+        (void) journal_file_close(f);
+
+        if (arg_keep)
+                log_info("Not removing %s", t);
+        else
+                assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+
+        puts("------------------------------------------------------------");
+}
+#endif
+
 int main(int argc, char *argv[]) {
         arg_keep = argc > 1;
 
@@ -250,8 +720,19 @@ int main(int argc, char *argv[]) {
                 return log_tests_skipped("/etc/machine-id not found");
 
         test_non_empty();
+        test_append_entries();
+#if HAVE_COMPRESSION
+        test_append_entries_compressed();
+#endif
+        test_copy_entries();
+        test_data_cache();
+        test_field_index();
+        test_time_index();
+#if HAVE_ZSTD
+        test_dictionary();
+#endif
         test_empty();
-#if HAVE_XZ || HAVE_LZ4
+#if HAVE_COMPRESSION
         test_min_compress_size();
 #endif
 
@@ -55,6 +55,33 @@ int main(int argc, char *argv[]) {
 
         assert_se((uint8_t*) p + 1 == (uint8_t*) q);
 
+        /* Sequential access maps bigger windows, mostly in front of the requested offset */
+        mmap_cache_fd_set_access(fx, MMAP_ACCESS_FORWARD);
+
+        r = mmap_cache_get(m, fx, PROT_READ, 0, false, 64ULL*1024ULL*1024ULL, 2, NULL, &p, NULL);
+        assert_se(r >= 0);
+
+        r = mmap_cache_get(m, fx, PROT_READ, 1, false, 64ULL*1024ULL*1024ULL+16ULL*1024ULL*1024ULL, 2, NULL, &q, NULL);
+        assert_se(r >= 0);
+
+#if !ENABLE_DEBUG_MMAP_CACHE
+        if (sizeof(void*) >= 8)
+                assert_se((uint8_t*) p + 16ULL*1024ULL*1024ULL == (uint8_t*) q);
+#endif
+
+        mmap_cache_fd_set_access(fx, MMAP_ACCESS_BACKWARD);
+
+        r = mmap_cache_get(m, fx, PROT_READ, 0, false, 256ULL*1024ULL*1024ULL, 2, NULL, &p, NULL);
+        assert_se(r >= 0);
+
+        r = mmap_cache_get(m, fx, PROT_READ, 1, false, 256ULL*1024ULL*1024ULL-16ULL*1024ULL*1024ULL, 2, NULL, &q, NULL);
+        assert_se(r >= 0);
+
+#if !ENABLE_DEBUG_MMAP_CACHE
+        if (sizeof(void*) >= 8)
+                assert_se((uint8_t*) q + 16ULL*1024ULL*1024ULL == (uint8_t*) p);
+#endif
+
         mmap_cache_free_fd(m, fx);
         mmap_cache_unref(m);
 
@@ -28,6 +28,15 @@ typedef struct DHCPClientId {
         void *data;
 } DHCPClientId;
 
+typedef struct DHCPServerStatistics {
+        uint64_t n_messages;
+        uint64_t n_offers;
+        uint64_t n_acks;
+        uint64_t n_naks;
+        usec_t processing_usec_total;
+        usec_t processing_usec_max;
+} DHCPServerStatistics;
+
 typedef struct DHCPLease {
         DHCPClientId client_id;
 
@@ -65,9 +74,17 @@ struct sd_dhcp_server {
 
         Hashmap *leases_by_client_id;
         DHCPLease **bound_leases;
+        uint64_t *bound_bitmap; /* one bit per pool offset, set if bound_leases[] is in use, or beyond the pool */
+        uint32_t n_bound;
         DHCPLease invalid_lease;
+        bool leases_loaded; /* the saved leases were picked up, hence may be overwritten */
 
         uint32_t max_lease_time, default_lease_time;
+
+        sd_dhcp_server_callback_t callback;
+        void *callback_userdata;
+
+        DHCPServerStatistics statistics;
 };
 
 typedef struct DHCPRequest {
@@ -91,5 +108,8 @@ int dhcp_server_send_packet(sd_dhcp_server *server,
                             DHCPRequest *req, DHCPPacket *packet,
                             int type, size_t optoffset);
 
+int dhcp_server_save_leases(sd_dhcp_server *server, const char *lease_file);
+int dhcp_server_load_leases(sd_dhcp_server *server, const char *lease_file);
+
 void client_id_hash_func(const DHCPClientId *p, struct siphash *state);
 int client_id_compare_func(const DHCPClientId *a, const DHCPClientId *b);
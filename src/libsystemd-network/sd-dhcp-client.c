@@ -35,6 +35,8 @@
 #define RESTART_AFTER_NAK_MIN_USEC (1 * USEC_PER_SEC)
 #define RESTART_AFTER_NAK_MAX_USEC (30 * USEC_PER_MINUTE)
 
+#define DHCP_RENEWAL_ACCURACY_MAX_USEC (10 * USEC_PER_SEC)
+
 struct sd_dhcp_client {
         unsigned n_ref;
 
@@ -1557,6 +1559,26 @@ static uint64_t client_compute_timeout(sd_dhcp_client *client, uint32_t lifetime
                 + (random_u32() & 0x1fffff);
 }
 
+static uint64_t client_compute_renewal_jitter(sd_dhcp_client *client, uint64_t t1_timeout) {
+        assert(client);
+        assert(t1_timeout >= client->request_sent);
+
+        /* RFC 2131 asks for some random fuzz on T1 and T2, so that clients that got their leases at the
+         * same time do not all renew at once either. The couple of seconds client_compute_timeout()
+         * adds are not enough for e.g. hundreds of containers that came up together, hence renew up to
+         * a tenth of T1 earlier. Renewing early is always safe. */
+        return t1_timeout - random_u64() % ((t1_timeout - client->request_sent) / 10 + 1);
+}
+
+static uint64_t client_compute_accuracy(uint64_t timeout, uint64_t next_timeout) {
+        /* Allow the event loop to coalesce renewal timers, so that many clients wake it up less often.
+         * Some slack is fine, as long as the next timeout is not reached. */
+        if (next_timeout <= timeout)
+                return 10 * USEC_PER_MSEC;
+
+        return CLAMP((next_timeout - timeout) / 4, 10 * USEC_PER_MSEC, DHCP_RENEWAL_ACCURACY_MAX_USEC);
+}
+
 static int client_set_lease_timeouts(sd_dhcp_client *client) {
         usec_t time_now;
         uint64_t lifetime_timeout;
@@ -1628,6 +1650,8 @@ static int client_set_lease_timeouts(sd_dhcp_client *client) {
                 client->lease->t2 = (client->lease->lifetime * 7) / 8;
         }
 
+        t1_timeout = client_compute_renewal_jitter(client, t1_timeout);
+
         /* arm lifetime timeout */
         r = event_reset_time(client->event, &client->timeout_expire,
                              clock_boottime_or_monotonic(),
@@ -1647,7 +1671,7 @@ static int client_set_lease_timeouts(sd_dhcp_client *client) {
         /* arm T2 timeout */
         r = event_reset_time(client->event, &client->timeout_t2,
                              clock_boottime_or_monotonic(),
-                             t2_timeout, 10 * USEC_PER_MSEC,
+                             t2_timeout, client_compute_accuracy(t2_timeout, lifetime_timeout),
                              client_timeout_t2, client,
                              client->event_priority, "dhcp4-t2-timeout", true);
         if (r < 0)
@@ -1663,7 +1687,7 @@ static int client_set_lease_timeouts(sd_dhcp_client *client) {
         /* arm T1 timeout */
         r = event_reset_time(client->event, &client->timeout_t1,
                              clock_boottime_or_monotonic(),
-                             t1_timeout, 10 * USEC_PER_MSEC,
+                             t1_timeout, client_compute_accuracy(t1_timeout, t2_timeout),
                              client_timeout_t1, client,
                              client->event_priority, "dhcp4-t1-timer", true);
         if (r < 0)
@@ -3,7 +3,9 @@
   Copyright © 2013 Intel Corporation. All rights reserved.
 ***/
 
+#include <arpa/inet.h>
 #include <sys/ioctl.h>
+#include <sys/stat.h>
 
 #include "sd-dhcp-server.h"
 #include "sd-id128.h"
@@ -11,11 +13,16 @@
 #include "alloc-util.h"
 #include "dhcp-internal.h"
 #include "dhcp-server-internal.h"
+#include "extract-word.h"
 #include "fd-util.h"
+#include "fileio.h"
+#include "hexdecoct.h"
 #include "in-addr-util.h"
 #include "io-util.h"
+#include "parse-util.h"
 #include "siphash24.h"
 #include "string-util.h"
+#include "tmpfile-util.h"
 #include "unaligned.h"
 
 #define DHCP_DEFAULT_LEASE_TIME_USEC USEC_PER_HOUR
@@ -29,6 +36,67 @@ static DHCPLease *dhcp_lease_free(DHCPLease *lease) {
         return mfree(lease);
 }
 
+DEFINE_TRIVIAL_CLEANUP_FUNC(DHCPLease*, dhcp_lease_free);
+
+static void pool_set_lease(sd_dhcp_server *server, uint32_t offset, DHCPLease *lease) {
+        uint64_t bit;
+
+        assert(server);
+        assert(offset < server->pool_size);
+
+        bit = UINT64_C(1) << (offset % 64);
+
+        if (!server->bound_leases[offset] && lease) {
+                server->bound_bitmap[offset / 64] |= bit;
+                server->n_bound++;
+        } else if (server->bound_leases[offset] && !lease) {
+                server->bound_bitmap[offset / 64] &= ~bit;
+                server->n_bound--;
+        }
+
+        server->bound_leases[offset] = lease;
+}
+
+/* Finds the first free pool offset at or after the given one, wrapping around at the end of the pool. Free
+ * offsets are looked up a word of the bitmap at a time, and not at all if the pool is exhausted. */
+static int pool_find_free(sd_dhcp_server *server, uint32_t start, uint32_t *ret) {
+        size_t n_words, k;
+
+        assert(server);
+        assert(start < server->pool_size);
+        assert(ret);
+
+        if (server->n_bound >= server->pool_size)
+                return -ENOSPC;
+
+        n_words = DIV_ROUND_UP(server->pool_size, 64);
+
+        /* The word containing the start offset is looked at twice: first only from the start offset on,
+         * and after wrapping around completely. */
+        for (k = 0; k <= n_words; k++) {
+                size_t w = (start / 64 + k) % n_words;
+                uint64_t free_bits;
+
+                free_bits = ~server->bound_bitmap[w];
+                if (k == 0)
+                        free_bits &= UINT64_MAX << (start % 64);
+
+                if (free_bits != 0) {
+                        *ret = w * 64 + __builtin_ctzll(free_bits);
+                        return 0;
+                }
+        }
+
+        return -ENOSPC;
+}
+
+static void dhcp_server_notify(sd_dhcp_server *server, uint64_t event) {
+        assert(server);
+
+        if (server->callback)
+                server->callback(server, event, server->callback_userdata);
+}
+
 /* configures the server's address and subnet, and optionally the pool's size and offset into the subnet
  * the whole pool must fit into the subnet, and may not contain the first (any) nor last (broadcast) address
  * moreover, the server's own address may be in the pool, and is in that case reserved in order not to
@@ -73,12 +141,25 @@ int sd_dhcp_server_configure_pool(sd_dhcp_server *server, struct in_addr *addres
                 size = size_max;
 
         if (server->address != address->s_addr || server->netmask != netmask || server->pool_size != size || server->pool_offset != offset) {
+                _cleanup_free_ DHCPLease **bound_leases = NULL;
+                _cleanup_free_ uint64_t *bound_bitmap = NULL;
+
+                bound_leases = new0(DHCPLease*, size);
+                if (!bound_leases)
+                        return -ENOMEM;
 
-                free(server->bound_leases);
-                server->bound_leases = new0(DHCPLease*, size);
-                if (!server->bound_leases)
+                bound_bitmap = new0(uint64_t, DIV_ROUND_UP(size, 64));
+                if (!bound_bitmap)
                         return -ENOMEM;
 
+                /* The bits beyond the end of the pool are marked as used, so that they are never picked */
+                if (size % 64 != 0)
+                        bound_bitmap[size / 64] = UINT64_MAX << (size % 64);
+
+                free_and_replace(server->bound_leases, bound_leases);
+                free_and_replace(server->bound_bitmap, bound_bitmap);
+                server->n_bound = 0;
+
                 server->pool_offset = offset;
                 server->pool_size = size;
 
@@ -87,7 +168,7 @@ int sd_dhcp_server_configure_pool(sd_dhcp_server *server, struct in_addr *addres
                 server->subnet = address->s_addr & netmask;
 
                 if (server_off >= offset && server_off - offset < size)
-                        server->bound_leases[server_off - offset] = &server->invalid_lease;
+                        pool_set_lease(server, server_off - offset, &server->invalid_lease);
 
                 /* Drop any leases associated with the old address range */
                 hashmap_clear(server->leases_by_client_id);
@@ -102,6 +183,15 @@ int sd_dhcp_server_is_running(sd_dhcp_server *server) {
         return !!server->receive_message;
 }
 
+int sd_dhcp_server_set_callback(sd_dhcp_server *server, sd_dhcp_server_callback_t cb, void *userdata) {
+        assert_return(server, -EINVAL);
+
+        server->callback = cb;
+        server->callback_userdata = userdata;
+
+        return 0;
+}
+
 void client_id_hash_func(const DHCPClientId *id, struct siphash *state) {
         assert(id);
         assert(id->length);
@@ -150,6 +240,7 @@ static sd_dhcp_server *dhcp_server_free(sd_dhcp_server *server) {
         ordered_hashmap_free(server->vendor_options);
 
         free(server->bound_leases);
+        free(server->bound_bitmap);
         return mfree(server);
 }
 
@@ -726,6 +817,31 @@ static int get_pool_offset(sd_dhcp_server *server, be32_t requested_ip) {
         return be32toh(requested_ip & ~server->netmask) - server->pool_offset;
 }
 
+static unsigned dhcp_server_drop_expired_leases(sd_dhcp_server *server, usec_t time_now) {
+        DHCPLease *lease;
+        unsigned n = 0;
+        Iterator i;
+
+        assert(server);
+
+        HASHMAP_FOREACH(lease, server->leases_by_client_id, i) {
+                int pool_offset;
+
+                if (lease->expiration > time_now)
+                        continue;
+
+                pool_offset = get_pool_offset(server, lease->address);
+                if (pool_offset >= 0 && server->bound_leases[pool_offset] == lease)
+                        pool_set_lease(server, pool_offset, NULL);
+
+                hashmap_remove(server->leases_by_client_id, &lease->client_id);
+                dhcp_lease_free(lease);
+                n++;
+        }
+
+        return n;
+}
+
 #define HASH_KEY SD_ID128_MAKE(0d,1d,fe,bd,f1,24,bd,b3,47,f1,dd,6e,73,21,93,30)
 
 int dhcp_server_handle_message(sd_dhcp_server *server, DHCPMessage *message,
@@ -763,7 +879,6 @@ int dhcp_server_handle_message(sd_dhcp_server *server, DHCPMessage *message,
 
         case DHCP_DISCOVER: {
                 be32_t address = INADDR_ANY;
-                unsigned i;
 
                 log_dhcp_server(server, "DISCOVER (0x%x)",
                                 be32toh(req->message->xid));
@@ -789,14 +904,23 @@ int dhcp_server_handle_message(sd_dhcp_server *server, DHCPMessage *message,
                         hash = htole64(siphash24_finalize(&state));
                         next_offer = hash % server->pool_size;
 
-                        for (i = 0; i < server->pool_size; i++) {
-                                if (!server->bound_leases[next_offer]) {
-                                        address = server->subnet | htobe32(server->pool_offset + next_offer);
-                                        break;
-                                }
+                        r = pool_find_free(server, next_offer, &next_offer);
+                        if (r == -ENOSPC) {
+                                usec_t time_now;
+
+                                /* The pool is exhausted. Make room by dropping the leases that expired. */
+                                r = sd_event_now(server->event, clock_boottime_or_monotonic(), &time_now);
+                                if (r < 0)
+                                        return r;
 
-                                next_offer = (next_offer + 1) % server->pool_size;
+                                if (dhcp_server_drop_expired_leases(server, time_now) > 0) {
+                                        dhcp_server_notify(server, SD_DHCP_SERVER_EVENT_LEASE_CHANGED);
+                                        r = pool_find_free(server, next_offer, &next_offer);
+                                } else
+                                        r = -ENOSPC;
                         }
+                        if (r >= 0)
+                                address = server->subnet | htobe32(server->pool_offset + next_offer);
                 }
 
                 if (address == INADDR_ANY)
@@ -919,10 +1043,12 @@ int dhcp_server_handle_message(sd_dhcp_server *server, DHCPMessage *message,
                                 log_dhcp_server(server, "ACK (0x%x)",
                                                 be32toh(req->message->xid));
 
-                                server->bound_leases[pool_offset] = lease;
+                                pool_set_lease(server, pool_offset, lease);
                                 hashmap_put(server->leases_by_client_id,
                                             &lease->client_id, lease);
 
+                                dhcp_server_notify(server, SD_DHCP_SERVER_EVENT_LEASE_CHANGED);
+
                                 return DHCP_ACK;
                         }
 
@@ -956,9 +1082,11 @@ int dhcp_server_handle_message(sd_dhcp_server *server, DHCPMessage *message,
                         return 0;
 
                 if (server->bound_leases[pool_offset] == existing_lease) {
-                        server->bound_leases[pool_offset] = NULL;
+                        pool_set_lease(server, pool_offset, NULL);
                         hashmap_remove(server->leases_by_client_id, existing_lease);
                         dhcp_lease_free(existing_lease);
+
+                        dhcp_server_notify(server, SD_DHCP_SERVER_EVENT_LEASE_CHANGED);
                 }
 
                 return 0;
@@ -981,6 +1109,7 @@ static int server_receive_message(sd_event_source *s, int fd,
         };
         struct cmsghdr *cmsg;
         ssize_t buflen, len;
+        usec_t start, elapsed;
         int r;
 
         assert(server);
@@ -1018,10 +1147,21 @@ static int server_receive_message(sd_event_source *s, int fd,
                 }
         }
 
+        start = now(CLOCK_MONOTONIC);
+
         r = dhcp_server_handle_message(server, message, (size_t) len);
         if (r < 0)
                 log_dhcp_server_errno(server, r, "Couldn't process incoming message: %m");
 
+        elapsed = now(CLOCK_MONOTONIC) - start;
+
+        server->statistics.n_messages++;
+        server->statistics.n_offers += r == DHCP_OFFER;
+        server->statistics.n_acks += r == DHCP_ACK;
+        server->statistics.n_naks += r == DHCP_NAK;
+        server->statistics.processing_usec_total += elapsed;
+        server->statistics.processing_usec_max = MAX(server->statistics.processing_usec_max, elapsed);
+
         return 0;
 }
 
@@ -1263,3 +1403,192 @@ int sd_dhcp_server_add_vendor_option(sd_dhcp_server *server, sd_dhcp_option *v)
 
         return 1;
 }
+
+static int dhcp_server_load_lease_line(sd_dhcp_server *server, const char *line, usec_t time_now, usec_t realtime_now) {
+        _cleanup_free_ char *address_str = NULL, *client_id_str = NULL, *chaddr_str = NULL, *gateway_str = NULL, *expiration_str = NULL;
+        _cleanup_(dhcp_lease_freep) DHCPLease *lease = NULL;
+        union in_addr_union address, gateway;
+        _cleanup_free_ void *chaddr = NULL;
+        size_t chaddr_len;
+        usec_t expiration;
+        int pool_offset, r;
+
+        assert(server);
+        assert(line);
+
+        r = extract_many_words(&line, NULL, 0, &address_str, &client_id_str, &chaddr_str, &gateway_str, &expiration_str, NULL);
+        if (r < 0)
+                return r;
+        if (r < 5)
+                return -EBADMSG;
+
+        r = in_addr_from_string(AF_INET, address_str, &address);
+        if (r < 0)
+                return r;
+
+        r = in_addr_from_string(AF_INET, gateway_str, &gateway);
+        if (r < 0)
+                return r;
+
+        r = safe_atou64(expiration_str, &expiration);
+        if (r < 0)
+                return r;
+
+        /* Expired while we were not running */
+        if (expiration <= realtime_now)
+                return 0;
+
+        /* Not in the pool anymore, or already taken, e.g. by the server itself */
+        pool_offset = get_pool_offset(server, address.in.s_addr);
+        if (pool_offset < 0 || server->bound_leases[pool_offset])
+                return 0;
+
+        lease = new0(DHCPLease, 1);
+        if (!lease)
+                return -ENOMEM;
+
+        r = unhexmem(client_id_str, (size_t) -1, &lease->client_id.data, &lease->client_id.length);
+        if (r < 0)
+                return r;
+        if (lease->client_id.length == 0)
+                return -EBADMSG;
+
+        if (hashmap_contains(server->leases_by_client_id, &lease->client_id))
+                return 0;
+
+        r = unhexmem(chaddr_str, (size_t) -1, &chaddr, &chaddr_len);
+        if (r < 0)
+                return r;
+        if (chaddr_len != ETH_ALEN)
+                return -EBADMSG;
+
+        memcpy(lease->chaddr, chaddr, ETH_ALEN);
+        lease->address = address.in.s_addr;
+        lease->gateway = gateway.in.s_addr;
+        lease->expiration = time_now + (expiration - realtime_now);
+
+        r = hashmap_put(server->leases_by_client_id, &lease->client_id, lease);
+        if (r < 0)
+                return r;
+
+        pool_set_lease(server, pool_offset, TAKE_PTR(lease));
+
+        return 1;
+}
+
+/* Leases are saved with their expiration in CLOCK_REALTIME, and converted back to the clock the server uses
+ * when they are loaded. Leases that do not fit the current pool are skipped. */
+int dhcp_server_load_leases(sd_dhcp_server *server, const char *lease_file) {
+        _cleanup_fclose_ FILE *f = NULL;
+        usec_t time_now, realtime_now;
+        unsigned n = 0;
+        int r;
+
+        assert(server);
+        assert(lease_file);
+
+        if (server->pool_size == 0)
+                return -EINVAL;
+
+        f = fopen(lease_file, "re");
+        if (!f) {
+                if (errno != ENOENT)
+                        return -errno;
+
+                server->leases_loaded = true;
+                return 0;
+        }
+
+        time_now = now(clock_boottime_or_monotonic());
+        realtime_now = now(CLOCK_REALTIME);
+
+        for (;;) {
+                _cleanup_free_ char *line = NULL;
+
+                r = read_line(f, LONG_LINE_MAX, &line);
+                if (r < 0)
+                        return r;
+                if (r == 0)
+                        break;
+
+                if (isempty(line) || line[0] == '#')
+                        continue;
+
+                r = dhcp_server_load_lease_line(server, line, time_now, realtime_now);
+                if (r < 0)
+                        log_dhcp_server_errno(server, r, "Failed to parse lease \"%s\", ignoring: %m", line);
+                else
+                        n += r;
+        }
+
+        log_dhcp_server(server, "Loaded %u leases from %s", n, lease_file);
+        server->leases_loaded = true;
+
+        return (int) n;
+}
+
+int dhcp_server_save_leases(sd_dhcp_server *server, const char *lease_file) {
+        _cleanup_free_ char *temp_path = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+        usec_t time_now, realtime_now;
+        DHCPLease *lease;
+        Iterator i;
+        int r;
+
+        assert(server);
+        assert(lease_file);
+
+        /* Until the leases saved before were loaded, we know only a part of them, if any. Don't lose the
+         * others by overwriting the file. */
+        if (!server->leases_loaded)
+                return 0;
+
+        r = fopen_temporary(lease_file, &f, &temp_path);
+        if (r < 0)
+                goto fail;
+
+        (void) fchmod(fileno(f), 0644);
+
+        time_now = now(clock_boottime_or_monotonic());
+        realtime_now = now(CLOCK_REALTIME);
+
+        fputs("# This is private data. Do not parse.\n", f);
+
+        HASHMAP_FOREACH(lease, server->leases_by_client_id, i) {
+                _cleanup_free_ char *client_id = NULL, *chaddr = NULL;
+                char address[INET_ADDRSTRLEN], gateway[INET_ADDRSTRLEN];
+
+                if (lease->expiration <= time_now)
+                        continue;
+
+                client_id = hexmem(lease->client_id.data, lease->client_id.length);
+                chaddr = hexmem(lease->chaddr, ETH_ALEN);
+                if (!client_id || !chaddr) {
+                        r = -ENOMEM;
+                        goto fail;
+                }
+
+                fprintf(f, "%s %s %s %s " USEC_FMT "\n",
+                        inet_ntop(AF_INET, &lease->address, address, sizeof(address)),
+                        client_id, chaddr,
+                        inet_ntop(AF_INET, &lease->gateway, gateway, sizeof(gateway)),
+                        realtime_now + (lease->expiration - time_now));
+        }
+
+        r = fflush_and_check(f);
+        if (r < 0)
+                goto fail;
+
+        if (rename(temp_path, lease_file) < 0) {
+                r = -errno;
+                goto fail;
+        }
+
+        return 0;
+
+fail:
+        if (temp_path)
+                (void) unlink(temp_path);
+
+        return log_dhcp_server_errno(server, r, "Failed to save leases to %s: %m", lease_file);
+}
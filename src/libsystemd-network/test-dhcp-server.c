@@ -9,7 +9,12 @@
 #include "sd-event.h"
 
 #include "dhcp-server-internal.h"
+#include "fd-util.h"
+#include "fileio.h"
+#include "fs-util.h"
+#include "string-util.h"
 #include "tests.h"
+#include "tmpfile-util.h"
 
 static void test_pool(struct in_addr *address, unsigned size, int ret) {
         _cleanup_(sd_dhcp_server_unrefp) sd_dhcp_server *server = NULL;
@@ -180,6 +185,118 @@ static void test_message_handler(void) {
         assert_se(dhcp_server_handle_message(server, (DHCPMessage*)&test, sizeof(test)) == 0);
 }
 
+static void lease_changed(sd_dhcp_server *server, uint64_t event, void *userdata) {
+        unsigned *n_changed = userdata;
+
+        assert_se(event == SD_DHCP_SERVER_EVENT_LEASE_CHANGED);
+        (*n_changed)++;
+}
+
+static void test_pool_exhaustion_and_persistence(void) {
+        _cleanup_(sd_dhcp_server_unrefp) sd_dhcp_server *server = NULL, *loaded = NULL;
+        _cleanup_(unlink_tempfilep) char lease_file[] = "/tmp/test-dhcp-server-leases.XXXXXX";
+        _cleanup_free_ char *contents = NULL;
+        _cleanup_close_ int fd = -1;
+        struct {
+                DHCPMessage message;
+                struct {
+                        uint8_t code;
+                        uint8_t length;
+                        uint8_t type;
+                } _packed_ option_type;
+                struct {
+                        uint8_t code;
+                        uint8_t length;
+                        be32_t address;
+                } _packed_ option_requested_ip;
+                struct {
+                        uint8_t code;
+                        uint8_t length;
+                        be32_t address;
+                } _packed_ option_server_id;
+                uint8_t end;
+        } _packed_ test = {
+                .message.op = BOOTREQUEST,
+                .message.htype = ARPHRD_ETHER,
+                .message.hlen = ETHER_ADDR_LEN,
+                .message.xid = htobe32(0x12345678),
+                .message.chaddr = { 'A', 'B', 'C', 'D', 'E', 'F' },
+                .option_type.code = SD_DHCP_OPTION_MESSAGE_TYPE,
+                .option_type.length = 1,
+                .option_requested_ip.code = SD_DHCP_OPTION_REQUESTED_IP_ADDRESS,
+                .option_requested_ip.length = 4,
+                .option_server_id.code = SD_DHCP_OPTION_SERVER_IDENTIFIER,
+                .option_server_id.length = 4,
+                .option_server_id.address = htobe32(INADDR_LOOPBACK),
+                .end = SD_DHCP_OPTION_END,
+        };
+        struct in_addr address_lo = {
+                .s_addr = htonl(INADDR_LOOPBACK),
+        };
+        unsigned i, n_changed = 0;
+
+        log_info("/* %s */", __func__);
+
+        /* 127.0.0.1 - 127.0.0.10, the first one is the server itself */
+        assert_se(sd_dhcp_server_new(&server, 1) >= 0);
+        assert_se(sd_dhcp_server_configure_pool(server, &address_lo, 8, 1, 10) >= 0);
+        assert_se(sd_dhcp_server_set_callback(server, lease_changed, &n_changed) >= 0);
+        assert_se(sd_dhcp_server_attach_event(server, NULL, 0) >= 0);
+        assert_se(sd_dhcp_server_start(server) >= 0);
+        assert_se(server->n_bound == 1);
+
+        test.option_type.type = DHCP_REQUEST;
+        for (i = 2; i <= 10; i++) {
+                test.message.chaddr[5] = i;
+                test.option_requested_ip.address = htobe32(INADDR_LOOPBACK - 1 + i);
+                assert_se(dhcp_server_handle_message(server, (DHCPMessage*) &test, sizeof(test)) == DHCP_ACK);
+        }
+        assert_se(server->n_bound == 10);
+        assert_se(n_changed == 9);
+
+        /* The pool is exhausted, and nothing expired yet */
+        test.message.chaddr[5] = 'X';
+        test.option_type.type = DHCP_DISCOVER;
+        assert_se(dhcp_server_handle_message(server, (DHCPMessage*) &test, sizeof(test)) == 0);
+
+        /* Nothing is saved before the leases saved earlier were loaded, so that they are not lost */
+        assert_se((fd = mkostemp_safe(lease_file)) >= 0);
+        assert_se(write(fd, "127.0.0.2 01 000000000002 0.0.0.0 1\n", 36) == 36);
+        assert_se(dhcp_server_save_leases(server, lease_file) >= 0);
+        assert_se(read_full_file(lease_file, &contents, NULL) >= 0);
+        assert_se(streq(contents, "127.0.0.2 01 000000000002 0.0.0.0 1\n"));
+        contents = mfree(contents);
+
+        /* The lease in the file has long expired, hence nothing is loaded */
+        assert_se(dhcp_server_load_leases(server, lease_file) == 0);
+        assert_se(server->n_bound == 10);
+        assert_se(dhcp_server_save_leases(server, lease_file) >= 0);
+
+        /* Loading into a smaller pool skips the leases that don't fit anymore */
+        assert_se(sd_dhcp_server_new(&loaded, 1) >= 0);
+        assert_se(sd_dhcp_server_configure_pool(loaded, &address_lo, 8, 1, 5) >= 0);
+        assert_se(dhcp_server_load_leases(loaded, lease_file) == 4);
+        assert_se(loaded->n_bound == 5);
+        assert_se(hashmap_size(loaded->leases_by_client_id) == 4);
+
+        /* And into the same pool gets all of them back */
+        loaded = sd_dhcp_server_unref(loaded);
+        assert_se(sd_dhcp_server_new(&loaded, 1) >= 0);
+        assert_se(sd_dhcp_server_configure_pool(loaded, &address_lo, 8, 1, 10) >= 0);
+        assert_se(dhcp_server_load_leases(loaded, lease_file) == 9);
+        assert_se(loaded->n_bound == 10);
+        for (i = 1; i < 10; i++) {
+                assert_se(loaded->bound_leases[i]);
+                assert_se(loaded->bound_leases[i]->address == htobe32(INADDR_LOOPBACK + i));
+        }
+
+        /* Loading the same file again is a NOP */
+        assert_se(dhcp_server_load_leases(loaded, lease_file) == 0);
+
+        /* A missing file is not an error */
+        assert_se(dhcp_server_load_leases(loaded, "/tmp/test-dhcp-server-no-such-file") == 0);
+}
+
 static uint64_t client_id_hash_helper(DHCPClientId *id, uint8_t key[HASH_KEY_SIZE]) {
         struct siphash state;
 
@@ -238,6 +355,7 @@ int main(int argc, char *argv[]) {
                 return log_tests_skipped("cannot start dhcp server");
 
         test_message_handler();
+        test_pool_exhaustion_and_persistence();
         test_client_id_hash();
 
         return 0;
@@ -15,6 +15,7 @@
 #include "bus-message.h"
 #include "bus-util.h"
 #include "capability-util.h"
+#include "missing_syscall.h"
 #include "process-util.h"
 #include "stdio-util.h"
 #include "string-util.h"
@@ -422,13 +423,404 @@ _public_ int sd_bus_list_names(sd_bus *bus, char ***acquired, char ***activatabl
         return 0;
 }
 
+/* How many peers we remember the credentials the bus driver reported for, see bus_creds_cache_put() */
+#define CREDS_CACHE_MAX 1024U
+
+/* What the bus driver told us about a peer. The driver determines this once, when the peer connects, and
+ * unique names are never reused during the lifetime of a bus, hence the answer itself never changes. The
+ * peer might exit and its PID be recycled though, without us being told, as we might not be subscribed to
+ * NameOwnerChanged. Hence we also remember the start time of the process, and before handing out the PID
+ * again, check that it still refers to the same process. If not, the driver is asked again, which then
+ * fails as it should, since the peer is gone. */
+typedef struct DriverCreds {
+        uint64_t known;         /* which of SD_BUS_CREDS_PID, _EUID, _SELINUX_CONTEXT we asked for */
+        pid_t pid;
+        uint64_t pid_start_time;
+        uid_t euid;
+        bool have_euid;
+        char *label;            /* NULL if the driver has no security context for the peer */
+        char unique_name[];
+} DriverCreds;
+
+static DriverCreds *driver_creds_free(DriverCreds *d) {
+        if (!d)
+                return NULL;
+
+        free(d->label);
+        return mfree(d);
+}
+
+DEFINE_PRIVATE_HASH_OPS_WITH_VALUE_DESTRUCTOR(driver_creds_hash_ops, char, string_hash_func, string_compare_func,
+                                              DriverCreds, driver_creds_free);
+
+void bus_creds_cache_put(sd_bus *bus, const char *unique, uint64_t known, pid_t pid, const sd_bus_creds *c) {
+        uint64_t pid_start_time = 0;
+        DriverCreds *d;
+        int r;
+
+        assert(bus);
+        assert(unique);
+        assert(c);
+
+        /* If we cannot tell the process apart from a later one with the same PID, don't remember the PID */
+        if ((known & SD_BUS_CREDS_PID) && pid > 0 && get_process_start_time(pid, &pid_start_time) < 0)
+                known &= ~SD_BUS_CREDS_PID;
+
+        d = hashmap_get(bus->creds_cache, unique);
+        if (!d) {
+                /* Peers come and go, don't let the cache grow without bounds. We don't know which entries are
+                 * still useful, hence simply start over. */
+                if (hashmap_size(bus->creds_cache) >= CREDS_CACHE_MAX)
+                        hashmap_clear(bus->creds_cache);
+
+                r = hashmap_ensure_allocated(&bus->creds_cache, &driver_creds_hash_ops);
+                if (r < 0)
+                        return;
+
+                d = malloc0(offsetof(DriverCreds, unique_name) + strlen(unique) + 1);
+                if (!d)
+                        return;
+
+                strcpy(d->unique_name, unique);
+
+                r = hashmap_put(bus->creds_cache, d->unique_name, d);
+                if (r < 0) {
+                        driver_creds_free(d);
+                        return;
+                }
+        }
+
+        if (known & SD_BUS_CREDS_PID) {
+                d->pid = pid;
+                d->pid_start_time = pid_start_time;
+        }
+
+        if ((known & SD_BUS_CREDS_EUID) && (c->mask & SD_BUS_CREDS_EUID)) {
+                d->euid = c->euid;
+                d->have_euid = true;
+        }
+
+        if (known & SD_BUS_CREDS_SELINUX_CONTEXT) {
+                d->label = mfree(d->label);
+
+                if (c->mask & SD_BUS_CREDS_SELINUX_CONTEXT) {
+                        d->label = strdup(c->label);
+                        if (!d->label) {
+                                /* Better forget about this than to report a peer without label */
+                                d->known &= ~SD_BUS_CREDS_SELINUX_CONTEXT;
+                                known &= ~SD_BUS_CREDS_SELINUX_CONTEXT;
+                        }
+                }
+        }
+
+        d->known |= known;
+}
+
+int bus_creds_cache_get(sd_bus *bus, const char *unique, uint64_t wanted, uint64_t mask, sd_bus_creds *c, pid_t *ret_pid) {
+        DriverCreds *d;
+
+        assert(bus);
+        assert(c);
+        assert(ret_pid);
+
+        if (!unique)
+                return 0;
+
+        d = hashmap_get(bus->creds_cache, unique);
+        if (!d || (wanted & ~d->known) != 0)
+                return 0;
+
+        if ((wanted & SD_BUS_CREDS_PID) && d->pid > 0) {
+                uint64_t t;
+
+                if (get_process_start_time(d->pid, &t) < 0 || t != d->pid_start_time) {
+                        /* The peer is gone */
+                        driver_creds_free(hashmap_remove(bus->creds_cache, unique));
+                        return 0;
+                }
+        }
+
+        if (wanted & SD_BUS_CREDS_PID) {
+                *ret_pid = d->pid;
+                if (mask & SD_BUS_CREDS_PID) {
+                        c->pid = d->pid;
+                        c->mask |= SD_BUS_CREDS_PID;
+                }
+        }
+
+        if ((wanted & SD_BUS_CREDS_EUID) && d->have_euid) {
+                c->euid = d->euid;
+                c->mask |= SD_BUS_CREDS_EUID;
+        }
+
+        if ((wanted & SD_BUS_CREDS_SELINUX_CONTEXT) && d->label) {
+                c->label = strdup(d->label);
+                if (!c->label)
+                        return -ENOMEM;
+
+                c->mask |= SD_BUS_CREDS_SELINUX_CONTEXT;
+        }
+
+        return 1;
+}
+
+void bus_creds_cache_process(sd_bus *bus, sd_bus_message *m) {
+        const char *name, *old_owner, *new_owner;
+
+        assert(bus);
+        assert(m);
+
+        /* Forget about peers the driver tells us are gone, if we happen to be subscribed to that */
+
+        if (hashmap_isempty(bus->creds_cache))
+                return;
+
+        if (!sd_bus_message_is_signal(m, "org.freedesktop.DBus", "NameOwnerChanged") ||
+            !streq_ptr(m->sender, "org.freedesktop.DBus"))
+                return;
+
+        if (sd_bus_message_read(m, "sss", &name, &old_owner, &new_owner) < 0)
+                goto finish;
+
+        if (name[0] == ':' && isempty(new_owner))
+                driver_creds_free(hashmap_remove(bus->creds_cache, name));
+
+finish:
+        (void) sd_bus_message_rewind(m, true);
+}
+
+static int bus_get_name_creds_from_driver(
+                sd_bus *bus,
+                const char *name,
+                uint64_t mask,
+                bool need_pid,
+                bool need_uid,
+                bool need_selinux,
+                sd_bus_creds *c,
+                pid_t *ret_pid) {
+
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+        bool need_separate_calls;
+        pid_t pid = 0;
+        int r;
+
+        assert(bus);
+        assert(name);
+        assert(c);
+        assert(ret_pid);
+
+        if (need_pid + need_uid + need_selinux > 1) {
+
+                /* If we need more than one of the credentials, then use GetConnectionCredentials() */
+
+                r = sd_bus_call_method(
+                                bus,
+                                "org.freedesktop.DBus",
+                                "/org/freedesktop/DBus",
+                                "org.freedesktop.DBus",
+                                "GetConnectionCredentials",
+                                &error,
+                                &reply,
+                                "s",
+                                name);
+
+                if (r < 0) {
+
+                        if (!sd_bus_error_has_name(&error, SD_BUS_ERROR_UNKNOWN_METHOD))
+                                return r;
+
+                        /* If we got an unknown method error, fall back to the individual calls... */
+                        need_separate_calls = true;
+                        sd_bus_error_free(&error);
+
+                } else {
+                        need_separate_calls = false;
+
+                        r = sd_bus_message_enter_container(reply, 'a', "{sv}");
+                        if (r < 0)
+                                return r;
+
+                        for (;;) {
+                                const char *m;
+
+                                r = sd_bus_message_enter_container(reply, 'e', "sv");
+                                if (r < 0)
+                                        return r;
+                                if (r == 0)
+                                        break;
+
+                                r = sd_bus_message_read(reply, "s", &m);
+                                if (r < 0)
+                                        return r;
+
+                                if (need_uid && streq(m, "UnixUserID")) {
+                                        uint32_t u;
+
+                                        r = sd_bus_message_read(reply, "v", "u", &u);
+                                        if (r < 0)
+                                                return r;
+
+                                        c->euid = u;
+                                        c->mask |= SD_BUS_CREDS_EUID;
+
+                                } else if (need_pid && streq(m, "ProcessID")) {
+                                        uint32_t p;
+
+                                        r = sd_bus_message_read(reply, "v", "u", &p);
+                                        if (r < 0)
+                                                return r;
+
+                                        pid = p;
+                                        if (mask & SD_BUS_CREDS_PID) {
+                                                c->pid = p;
+                                                c->mask |= SD_BUS_CREDS_PID;
+                                        }
+
+                                } else if (need_selinux && streq(m, "LinuxSecurityLabel")) {
+                                        const void *p = NULL;
+                                        size_t sz = 0;
+
+                                        r = sd_bus_message_enter_container(reply, 'v', "ay");
+                                        if (r < 0)
+                                                return r;
+
+                                        r = sd_bus_message_read_array(reply, 'y', &p, &sz);
+                                        if (r < 0)
+                                                return r;
+
+                                        free(c->label);
+                                        c->label = strndup(p, sz);
+                                        if (!c->label)
+                                                return -ENOMEM;
+
+                                        c->mask |= SD_BUS_CREDS_SELINUX_CONTEXT;
+
+                                        r = sd_bus_message_exit_container(reply);
+                                        if (r < 0)
+                                                return r;
+                                } else {
+                                        r = sd_bus_message_skip(reply, "v");
+                                        if (r < 0)
+                                                return r;
+                                }
+
+                                r = sd_bus_message_exit_container(reply);
+                                if (r < 0)
+                                        return r;
+                        }
+
+                        r = sd_bus_message_exit_container(reply);
+                        if (r < 0)
+                                return r;
+
+                        if (need_pid && pid == 0)
+                                return -EPROTO;
+                }
+
+        } else /* When we only need a single field, then let's use separate calls */
+                need_separate_calls = true;
+
+        if (need_separate_calls) {
+                if (need_pid) {
+                        uint32_t u;
+
+                        r = sd_bus_call_method(
+                                        bus,
+                                        "org.freedesktop.DBus",
+                                        "/org/freedesktop/DBus",
+                                        "org.freedesktop.DBus",
+                                        "GetConnectionUnixProcessID",
+                                        NULL,
+                                        &reply,
+                                        "s",
+                                        name);
+                        if (r < 0)
+                                return r;
+
+                        r = sd_bus_message_read(reply, "u", &u);
+                        if (r < 0)
+                                return r;
+
+                        pid = u;
+                        if (mask & SD_BUS_CREDS_PID) {
+                                c->pid = u;
+                                c->mask |= SD_BUS_CREDS_PID;
+                        }
+
+                        reply = sd_bus_message_unref(reply);
+                }
+
+                if (need_uid) {
+                        uint32_t u;
+
+                        r = sd_bus_call_method(
+                                        bus,
+                                        "org.freedesktop.DBus",
+                                        "/org/freedesktop/DBus",
+                                        "org.freedesktop.DBus",
+                                        "GetConnectionUnixUser",
+                                        NULL,
+                                        &reply,
+                                        "s",
+                                        name);
+                        if (r < 0)
+                                return r;
+
+                        r = sd_bus_message_read(reply, "u", &u);
+                        if (r < 0)
+                                return r;
+
+                        c->euid = u;
+                        c->mask |= SD_BUS_CREDS_EUID;
+
+                        reply = sd_bus_message_unref(reply);
+                }
+
+                if (need_selinux) {
+                        const void *p = NULL;
+                        size_t sz = 0;
+
+                        r = sd_bus_call_method(
+                                        bus,
+                                        "org.freedesktop.DBus",
+                                        "/org/freedesktop/DBus",
+                                        "org.freedesktop.DBus",
+                                        "GetConnectionSELinuxSecurityContext",
+                                        &error,
+                                        &reply,
+                                        "s",
+                                        name);
+                        if (r < 0) {
+                                if (!sd_bus_error_has_name(&error, "org.freedesktop.DBus.Error.SELinuxSecurityContextUnknown"))
+                                        return r;
+
+                                /* no data is fine */
+                        } else {
+                                r = sd_bus_message_read_array(reply, 'y', &p, &sz);
+                                if (r < 0)
+                                        return r;
+
+                                c->label = memdup_suffix0(p, sz);
+                                if (!c->label)
+                                        return -ENOMEM;
+
+                                c->mask |= SD_BUS_CREDS_SELINUX_CONTEXT;
+                        }
+                }
+        }
+
+        *ret_pid = pid;
+        return 0;
+}
+
 _public_ int sd_bus_get_name_creds(
                 sd_bus *bus,
                 const char *name,
                 uint64_t mask,
                 sd_bus_creds **creds) {
 
-        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply_unique = NULL, *reply = NULL;
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply_unique = NULL;
         _cleanup_(sd_bus_creds_unrefp) sd_bus_creds *c = NULL;
         const char *unique;
         pid_t pid = 0;
@@ -484,8 +876,8 @@ _public_ int sd_bus_get_name_creds(
         }
 
         if (mask != 0) {
-                _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
-                bool need_pid, need_uid, need_selinux, need_separate_calls;
+                bool need_pid, need_uid, need_selinux;
+                uint64_t wanted;
 
                 c = bus_creds_new();
                 if (!c)
@@ -512,204 +904,21 @@ _public_ int sd_bus_get_name_creds(
                 need_uid = mask & SD_BUS_CREDS_EUID;
                 need_selinux = mask & SD_BUS_CREDS_SELINUX_CONTEXT;
 
-                if (need_pid + need_uid + need_selinux > 1) {
-
-                        /* If we need more than one of the credentials, then use GetConnectionCredentials() */
-
-                        r = sd_bus_call_method(
-                                        bus,
-                                        "org.freedesktop.DBus",
-                                        "/org/freedesktop/DBus",
-                                        "org.freedesktop.DBus",
-                                        "GetConnectionCredentials",
-                                        &error,
-                                        &reply,
-                                        "s",
-                                        unique ?: name);
-
-                        if (r < 0) {
-
-                                if (!sd_bus_error_has_name(&error, SD_BUS_ERROR_UNKNOWN_METHOD))
-                                        return r;
-
-                                /* If we got an unknown method error, fall back to the individual calls... */
-                                need_separate_calls = true;
-                                sd_bus_error_free(&error);
-
-                        } else {
-                                need_separate_calls = false;
-
-                                r = sd_bus_message_enter_container(reply, 'a', "{sv}");
-                                if (r < 0)
-                                        return r;
-
-                                for (;;) {
-                                        const char *m;
-
-                                        r = sd_bus_message_enter_container(reply, 'e', "sv");
-                                        if (r < 0)
-                                                return r;
-                                        if (r == 0)
-                                                break;
-
-                                        r = sd_bus_message_read(reply, "s", &m);
-                                        if (r < 0)
-                                                return r;
-
-                                        if (need_uid && streq(m, "UnixUserID")) {
-                                                uint32_t u;
-
-                                                r = sd_bus_message_read(reply, "v", "u", &u);
-                                                if (r < 0)
-                                                        return r;
-
-                                                c->euid = u;
-                                                c->mask |= SD_BUS_CREDS_EUID;
-
-                                        } else if (need_pid && streq(m, "ProcessID")) {
-                                                uint32_t p;
-
-                                                r = sd_bus_message_read(reply, "v", "u", &p);
-                                                if (r < 0)
-                                                        return r;
-
-                                                pid = p;
-                                                if (mask & SD_BUS_CREDS_PID) {
-                                                        c->pid = p;
-                                                        c->mask |= SD_BUS_CREDS_PID;
-                                                }
-
-                                        } else if (need_selinux && streq(m, "LinuxSecurityLabel")) {
-                                                const void *p = NULL;
-                                                size_t sz = 0;
-
-                                                r = sd_bus_message_enter_container(reply, 'v', "ay");
-                                                if (r < 0)
-                                                        return r;
-
-                                                r = sd_bus_message_read_array(reply, 'y', &p, &sz);
-                                                if (r < 0)
-                                                        return r;
-
-                                                free(c->label);
-                                                c->label = strndup(p, sz);
-                                                if (!c->label)
-                                                        return -ENOMEM;
+                /* Ask the bus driver only if we didn't ask about this peer before */
+                wanted = (need_pid ? SD_BUS_CREDS_PID : 0) |
+                        (need_uid ? SD_BUS_CREDS_EUID : 0) |
+                        (need_selinux ? SD_BUS_CREDS_SELINUX_CONTEXT : 0);
 
-                                                c->mask |= SD_BUS_CREDS_SELINUX_CONTEXT;
-
-                                                r = sd_bus_message_exit_container(reply);
-                                                if (r < 0)
-                                                        return r;
-                                        } else {
-                                                r = sd_bus_message_skip(reply, "v");
-                                                if (r < 0)
-                                                        return r;
-                                        }
-
-                                        r = sd_bus_message_exit_container(reply);
-                                        if (r < 0)
-                                                return r;
-                                }
-
-                                r = sd_bus_message_exit_container(reply);
-                                if (r < 0)
-                                        return r;
-
-                                if (need_pid && pid == 0)
-                                        return -EPROTO;
-                        }
-
-                } else /* When we only need a single field, then let's use separate calls */
-                        need_separate_calls = true;
-
-                if (need_separate_calls) {
-                        if (need_pid) {
-                                uint32_t u;
-
-                                r = sd_bus_call_method(
-                                                bus,
-                                                "org.freedesktop.DBus",
-                                                "/org/freedesktop/DBus",
-                                                "org.freedesktop.DBus",
-                                                "GetConnectionUnixProcessID",
-                                                NULL,
-                                                &reply,
-                                                "s",
-                                                unique ?: name);
-                                if (r < 0)
-                                        return r;
-
-                                r = sd_bus_message_read(reply, "u", &u);
-                                if (r < 0)
-                                        return r;
-
-                                pid = u;
-                                if (mask & SD_BUS_CREDS_PID) {
-                                        c->pid = u;
-                                        c->mask |= SD_BUS_CREDS_PID;
-                                }
-
-                                reply = sd_bus_message_unref(reply);
-                        }
-
-                        if (need_uid) {
-                                uint32_t u;
-
-                                r = sd_bus_call_method(
-                                                bus,
-                                                "org.freedesktop.DBus",
-                                                "/org/freedesktop/DBus",
-                                                "org.freedesktop.DBus",
-                                                "GetConnectionUnixUser",
-                                                NULL,
-                                                &reply,
-                                                "s",
-                                                unique ?: name);
-                                if (r < 0)
-                                        return r;
-
-                                r = sd_bus_message_read(reply, "u", &u);
-                                if (r < 0)
-                                        return r;
-
-                                c->euid = u;
-                                c->mask |= SD_BUS_CREDS_EUID;
-
-                                reply = sd_bus_message_unref(reply);
-                        }
-
-                        if (need_selinux) {
-                                const void *p = NULL;
-                                size_t sz = 0;
-
-                                r = sd_bus_call_method(
-                                                bus,
-                                                "org.freedesktop.DBus",
-                                                "/org/freedesktop/DBus",
-                                                "org.freedesktop.DBus",
-                                                "GetConnectionSELinuxSecurityContext",
-                                                &error,
-                                                &reply,
-                                                "s",
-                                                unique ?: name);
-                                if (r < 0) {
-                                        if (!sd_bus_error_has_name(&error, "org.freedesktop.DBus.Error.SELinuxSecurityContextUnknown"))
-                                                return r;
-
-                                        /* no data is fine */
-                                } else {
-                                        r = sd_bus_message_read_array(reply, 'y', &p, &sz);
-                                        if (r < 0)
-                                                return r;
-
-                                        c->label = memdup_suffix0(p, sz);
-                                        if (!c->label)
-                                                return -ENOMEM;
+                r = bus_creds_cache_get(bus, unique, wanted, mask, c, &pid);
+                if (r < 0)
+                        return r;
+                if (r == 0 && wanted != 0) {
+                        r = bus_get_name_creds_from_driver(bus, unique ?: name, mask, need_pid, need_uid, need_selinux, c, &pid);
+                        if (r < 0)
+                                return r;
 
-                                        c->mask |= SD_BUS_CREDS_SELINUX_CONTEXT;
-                                }
-                        }
+                        if (unique)
+                                bus_creds_cache_put(bus, unique, wanted, pid, c);
                 }
 
                 r = bus_creds_add_more(c, mask, pid, 0);
@@ -791,6 +1000,12 @@ _public_ int sd_bus_get_owner_creds(sd_bus *bus, uint64_t mask, sd_bus_creds **r
         if (r < 0)
                 return r;
 
+        /* If the peer went away and its PID got recycled in the meantime, whatever we read from /proc
+         * describes another process. The pidfd tells us if that could have happened. */
+        if (bus->peer_pidfd >= 0 && (mask & SD_BUS_CREDS_AUGMENT) && pid > 0 &&
+            pidfd_send_signal(bus->peer_pidfd, 0, NULL, 0) < 0 && errno == ESRCH)
+                return -ESRCH;
+
         *ret = TAKE_PTR(c);
 
         return 0;
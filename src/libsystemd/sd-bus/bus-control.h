@@ -7,3 +7,7 @@ int bus_add_match_internal(sd_bus *bus, const char *match, uint64_t *ret_counter
 int bus_add_match_internal_async(sd_bus *bus, sd_bus_slot **ret, const char *match, sd_bus_message_handler_t callback, void *userdata);
 
 int bus_remove_match_internal(sd_bus *bus, const char *match);
+
+void bus_creds_cache_put(sd_bus *bus, const char *unique, uint64_t known, pid_t pid, const sd_bus_creds *c);
+int bus_creds_cache_get(sd_bus *bus, const char *unique, uint64_t wanted, uint64_t mask, sd_bus_creds *c, pid_t *ret_pid);
+void bus_creds_cache_process(sd_bus *bus, sd_bus_message *m);
@@ -515,13 +515,6 @@ typedef struct _packed_ pcap_hdr_s {
         uint32_t network;        /* data link type */
 } pcap_hdr_t ;
 
-typedef struct  _packed_ pcaprec_hdr_s {
-        uint32_t ts_sec;         /* timestamp seconds */
-        uint32_t ts_usec;        /* timestamp microseconds */
-        uint32_t incl_len;       /* number of octets of packet saved in file */
-        uint32_t orig_len;       /* actual length of packet */
-} pcaprec_hdr_t;
-
 int bus_pcap_header(size_t snaplen, FILE *f) {
 
         pcap_hdr_t hdr = {
@@ -546,29 +539,37 @@ int bus_pcap_header(size_t snaplen, FILE *f) {
         return fflush_and_check(f);
 }
 
-int bus_message_pcap_frame(sd_bus_message *m, size_t snaplen, FILE *f) {
-        struct bus_body_part *part;
-        pcaprec_hdr_t hdr = {};
+static void bus_message_pcap_frame_header(sd_bus_message *m, size_t snaplen, pcaprec_hdr_t *hdr) {
         struct timeval tv;
-        unsigned i;
-        size_t w;
-
-        if (!f)
-                f = stdout;
 
         assert(m);
         assert(snaplen > 0);
         assert((size_t) (uint32_t) snaplen == snaplen);
+        assert(hdr);
 
         if (m->realtime != 0)
                 timeval_store(&tv, m->realtime);
         else
                 assert_se(gettimeofday(&tv, NULL) >= 0);
 
-        hdr.ts_sec = tv.tv_sec;
-        hdr.ts_usec = tv.tv_usec;
-        hdr.orig_len = BUS_MESSAGE_SIZE(m);
-        hdr.incl_len = MIN(hdr.orig_len, snaplen);
+        *hdr = (pcaprec_hdr_t) {
+                .ts_sec = tv.tv_sec,
+                .ts_usec = tv.tv_usec,
+                .orig_len = BUS_MESSAGE_SIZE(m),
+                .incl_len = MIN(BUS_MESSAGE_SIZE(m), snaplen),
+        };
+}
+
+int bus_message_pcap_frame(sd_bus_message *m, size_t snaplen, FILE *f) {
+        struct bus_body_part *part;
+        pcaprec_hdr_t hdr;
+        unsigned i;
+        size_t w;
+
+        if (!f)
+                f = stdout;
+
+        bus_message_pcap_frame_header(m, snaplen, &hdr);
 
         /* write the pcap header */
         fwrite(&hdr, 1, sizeof(hdr), f);
@@ -590,3 +591,37 @@ int bus_message_pcap_frame(sd_bus_message *m, size_t snaplen, FILE *f) {
 
         return fflush_and_check(f);
 }
+
+size_t bus_message_pcap_frame_size(sd_bus_message *m, size_t snaplen) {
+        assert(m);
+
+        return sizeof(pcaprec_hdr_t) + MIN(BUS_MESSAGE_SIZE(m), snaplen);
+}
+
+void bus_message_pcap_frame_to_memory(sd_bus_message *m, size_t snaplen, void *buffer) {
+        struct bus_body_part *part;
+        pcaprec_hdr_t hdr;
+        uint8_t *p;
+        unsigned i;
+        size_t w;
+
+        /* Like bus_message_pcap_frame(), but writes to a buffer of bus_message_pcap_frame_size() bytes */
+
+        assert(buffer);
+
+        bus_message_pcap_frame_header(m, snaplen, &hdr);
+        p = mempcpy(buffer, &hdr, sizeof(hdr));
+
+        w = MIN(BUS_MESSAGE_BODY_BEGIN(m), snaplen);
+        p = mempcpy(p, m->header, w);
+        snaplen -= w;
+
+        MESSAGE_FOREACH_PART(part, i, m) {
+                if (snaplen <= 0)
+                        break;
+
+                w = MIN(part->size, snaplen);
+                p = mempcpy(p, part->data, w);
+                snaplen -= w;
+        }
+}
@@ -6,7 +6,18 @@
 
 #include "sd-bus.h"
 
+#include "macro.h"
+
+typedef struct _packed_ pcaprec_hdr_s {
+        uint32_t ts_sec;         /* timestamp seconds */
+        uint32_t ts_usec;        /* timestamp microseconds */
+        uint32_t incl_len;       /* number of octets of packet saved in file */
+        uint32_t orig_len;       /* actual length of packet */
+} pcaprec_hdr_t;
+
 int bus_creds_dump(sd_bus_creds *c, FILE *f, bool terse);
 
 int bus_pcap_header(size_t snaplen, FILE *f);
 int bus_message_pcap_frame(sd_bus_message *m, size_t snaplen, FILE *f);
+size_t bus_message_pcap_frame_size(sd_bus_message *m, size_t snaplen);
+void bus_message_pcap_frame_to_memory(sd_bus_message *m, size_t snaplen, void *buffer);
@@ -102,6 +102,9 @@ struct node_vtable {
         const sd_bus_vtable *vtable;
         sd_bus_object_find_t find;
 
+        /* XML of the members of the vtable, generated on the first Introspect() call that needs it */
+        char *introspection;
+
         LIST_FIELDS(struct node_vtable, vtables);
 };
 
@@ -190,6 +193,9 @@ struct sd_bus {
         int message_endian;
 
         bool can_fds:1;
+        bool can_memfd_body:1;
+        bool can_gvariant:1;
+        bool negotiate_gvariant:1;
         bool bus_client:1;
         bool ucred_valid:1;
         bool is_server:1;
@@ -259,12 +265,13 @@ struct sd_bus {
 
         enum bus_auth auth;
         unsigned auth_index;
-        struct iovec auth_iovec[3];
+        struct iovec auth_iovec[5];
         size_t auth_rbegin;
         char *auth_buffer;
         usec_t auth_timeout;
 
         struct ucred ucred;
+        int peer_pidfd;
         char *label;
         gid_t *groups;
         size_t n_groups;
@@ -317,6 +324,14 @@ struct sd_bus {
         LIST_HEAD(sd_bus_slot, slots);
         LIST_HEAD(sd_bus_track, tracks);
 
+        /* Names tracked by any sd_bus_track object of this bus, mapped to the list of their track items,
+         * and the single NameOwnerChanged match watching all of them. */
+        Hashmap *track_names;
+        sd_bus_slot *track_slot;
+
+        /* What the bus driver told us about the credentials of peers, indexed by their unique names */
+        Hashmap *creds_cache;
+
         int *inotify_watches;
         size_t n_inotify_watches;
 
@@ -375,6 +390,16 @@ int bus_next_address(sd_bus *bus);
 
 int bus_seal_synthetic_message(sd_bus *b, sd_bus_message *m);
 
+/* A method call issued with bus_call_many(), and its outcome */
+typedef struct BusCall {
+        sd_bus_message *call;
+        sd_bus_message *reply;
+        sd_bus_error error;
+} BusCall;
+
+int bus_call_many(sd_bus *bus, BusCall *calls, size_t n, uint64_t usec);
+void bus_call_done_many(BusCall *calls, size_t n);
+
 int bus_rqueue_make_room(sd_bus *bus);
 
 bool bus_pid_changed(sd_bus *bus);
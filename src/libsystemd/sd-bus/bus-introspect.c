@@ -173,6 +173,36 @@ int introspect_write_interface(struct introspect *i, const sd_bus_vtable *v) {
         return 0;
 }
 
+int introspect_interface_to_string(const sd_bus_vtable *v, bool trusted, char **ret) {
+        _cleanup_(introspect_free) struct introspect i = {
+                .trusted = trusted,
+        };
+        int r;
+
+        assert(v);
+        assert(ret);
+
+        /* Like introspect_write_interface(), but returns the XML as a string, so that it can be cached and
+         * reused for all objects the vtable is registered for */
+
+        i.f = open_memstream_unlocked(&i.introspection, &i.size);
+        if (!i.f)
+                return -ENOMEM;
+
+        r = introspect_write_interface(&i, v);
+        if (r < 0)
+                return r;
+
+        r = fflush_and_check(i.f);
+        if (r < 0)
+                return r;
+
+        i.f = safe_fclose(i.f);
+        *ret = TAKE_PTR(i.introspection);
+
+        return 0;
+}
+
 int introspect_finish(struct introspect *i, char **ret) {
         int r;
 
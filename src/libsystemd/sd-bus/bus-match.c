@@ -53,11 +53,21 @@ static bool BUS_MATCH_IS_COMPARE(enum bus_match_node_type t) {
 }
 
 static bool BUS_MATCH_CAN_HASH(enum bus_match_node_type t) {
-        return (t >= BUS_MATCH_MESSAGE_TYPE && t <= BUS_MATCH_PATH) ||
+        return (t >= BUS_MATCH_MESSAGE_TYPE && t <= BUS_MATCH_PATH_NAMESPACE) ||
                 (t >= BUS_MATCH_ARG && t <= BUS_MATCH_ARG_LAST) ||
+                (t >= BUS_MATCH_ARG_NAMESPACE && t <= BUS_MATCH_ARG_NAMESPACE_LAST) ||
                 (t >= BUS_MATCH_ARG_HAS && t <= BUS_MATCH_ARG_HAS_LAST);
 }
 
+static char BUS_MATCH_NAMESPACE_SEPARATOR(enum bus_match_node_type t) {
+        if (t == BUS_MATCH_PATH_NAMESPACE)
+                return '/';
+        if (t >= BUS_MATCH_ARG_NAMESPACE && t <= BUS_MATCH_ARG_NAMESPACE_LAST)
+                return '.';
+
+        return 0;
+}
+
 static void bus_match_node_free(struct bus_match_node *node) {
         assert(node);
         assert(node->parent);
@@ -239,6 +249,60 @@ static bool value_node_same(
         }
 }
 
+static int bus_match_run_namespace(
+                sd_bus *bus,
+                struct bus_match_node *node,
+                const char *test_str,
+                sd_bus_message *m) {
+
+        _cleanup_free_ char *p = NULL;
+        char separator;
+        size_t n;
+        int r;
+
+        assert(node);
+        assert(test_str);
+
+        /* A namespace match "a.b" matches "a.b" itself and everything below it, i.e. all values it is a
+         * prefix of that continue with a separator. Also "a.b." matches everything below "a.b". Hence,
+         * instead of testing each value node, look up every prefix of the tested string that ends right
+         * before or right after a separator, which only depends on the number of labels, not on the number
+         * of matches. */
+
+        separator = BUS_MATCH_NAMESPACE_SEPARATOR(node->type);
+        assert(separator != 0);
+
+        n = strlen(test_str);
+        p = strdup(test_str);
+        if (!p)
+                return -ENOMEM;
+
+        for (size_t l = 0; l <= n; l++) {
+                struct bus_match_node *found;
+                char c;
+
+                if (l < n && p[l] != separator && !(l > 0 && p[l-1] == separator))
+                        continue;
+
+                c = p[l];
+                p[l] = 0;
+                found = hashmap_get(node->compare.children, p);
+                p[l] = c;
+
+                if (!found)
+                        continue;
+
+                r = bus_match_run(bus, found, m);
+                if (r != 0)
+                        return r;
+
+                if (bus && bus->match_callbacks_modified)
+                        return 0;
+        }
+
+        return 0;
+}
+
 int bus_match_run(
                 sd_bus *bus,
                 struct bus_match_node *node,
@@ -384,7 +448,13 @@ int bus_match_run(
 
                 /* Lookup via hash table, nice! So let's jump directly. */
 
-                if (test_str)
+                if (test_str && BUS_MATCH_NAMESPACE_SEPARATOR(node->type) != 0) {
+                        r = bus_match_run_namespace(bus, node, test_str, m);
+                        if (r != 0)
+                                return r;
+
+                        found = NULL;
+                } else if (test_str)
                         found = hashmap_get(node->compare.children, test_str);
                 else if (test_strv) {
                         char **i;
@@ -501,6 +501,11 @@ int bus_message_from_header(
 
                 m->fields_size -= sizeof(struct bus_header);
                 m->body_size = message_size - (sizeof(struct bus_header) + ALIGN8(m->fields_size));
+
+                /* If the size is set, as on the socket transport, it better be the right one */
+                if (h->dbus2.size != 0 &&
+                    BUS_MESSAGE_BSWAP32(m, h->dbus2.size) != message_size - sizeof(struct bus_header))
+                        return -EBADMSG;
         } else {
                 if (h->dbus1.serial == 0)
                         return -EBADMSG;
@@ -580,6 +585,91 @@ int bus_message_from_malloc(
         return 0;
 }
 
+int bus_message_from_malloc_and_memfd(
+                sd_bus *bus,
+                void *buffer,
+                size_t length,
+                int memfd,
+                int *fds,
+                size_t n_fds,
+                const char *label,
+                sd_bus_message **ret) {
+
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+        _cleanup_close_ int fd = memfd;
+        struct bus_header *h = buffer;
+        size_t body_size, mapped;
+        uint64_t sz;
+        void *p;
+        int r;
+
+        /* Like bus_message_from_malloc(), but the buffer only contains the header and the fields, and the
+         * body is mapped from a sealed memfd instead of being copied. Takes possession of the memfd in all
+         * cases. */
+
+        assert(memfd >= 0);
+
+        if (length < sizeof(struct bus_header) || h->version != 1)
+                return -EBADMSG;
+
+        if (h->endian == BUS_LITTLE_ENDIAN)
+                body_size = le32toh(h->dbus1.body_size);
+        else if (h->endian == BUS_BIG_ENDIAN)
+                body_size = be32toh(h->dbus1.body_size);
+        else
+                return -EBADMSG;
+
+        if (body_size == 0)
+                return -EBADMSG;
+
+        /* Only if the sender cannot modify or truncate the memfd anymore it's safe to map it */
+        r = memfd_get_sealed(fd);
+        if (r <= 0)
+                return -EBADMSG;
+
+        r = memfd_get_size(fd, &sz);
+        if (r < 0 || sz < body_size)
+                return -EBADMSG;
+
+        mapped = PAGE_ALIGN(body_size);
+        p = mmap(NULL, mapped, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED)
+                return -errno;
+
+        r = bus_message_from_header(
+                        bus,
+                        buffer, length,
+                        buffer, length,
+                        length + body_size,
+                        fds, n_fds,
+                        label,
+                        0, &m);
+        if (r < 0) {
+                (void) munmap(p, mapped);
+                return r;
+        }
+
+        /* From now on the message owns the mapping and the memfd */
+        m->n_body_parts = 1;
+        m->body.data = p;
+        m->body.size = body_size;
+        m->body.sealed = true;
+        m->body.memfd = TAKE_FD(fd);
+        m->body.mmap_begin = p;
+        m->body.mapped = mapped;
+
+        r = bus_message_parse_fields(m);
+        if (r < 0)
+                return r;
+
+        /* We take possession of the memory and fds now */
+        m->free_header = true;
+        m->free_fds = true;
+
+        *ret = TAKE_PTR(m);
+        return 0;
+}
+
 _public_ int sd_bus_message_new(
                 sd_bus *bus,
                 sd_bus_message **m,
@@ -2817,6 +2907,53 @@ _public_ int sd_bus_message_append_string_memfd(
         return 0;
 }
 
+static int message_append_strv_dbus1(sd_bus_message *m, char **l) {
+        size_t sz = 0;
+        uint8_t *a, *p;
+        char **i;
+
+        assert(m);
+        assert(!BUS_MESSAGE_IS_GVARIANT(m));
+
+        /* Appends all strings of the array in one go: the signature was checked when the array was opened
+         * already, hence all that's left to do is to calculate the size once, and copy the strings. */
+
+        STRV_FOREACH(i, l) {
+                sz = ALIGN_TO(sz, 4) + 4 + strlen(*i) + 1;
+
+                /* message_extend_body() would refuse this anyway, but let's not overflow on the way */
+                if (sz > UINT32_MAX) {
+                        m->poisoned = true;
+                        return -ENOMEM;
+                }
+        }
+
+        if (sz == 0)
+                return 0;
+
+        a = message_extend_body(m, 4, sz, false, false);
+        if (!a)
+                return -ENOMEM;
+
+        p = a;
+        STRV_FOREACH(i, l) {
+                size_t n, padding;
+
+                padding = ALIGN_TO((size_t) (p - a), 4) - (size_t) (p - a);
+                memzero(p, padding);
+                p += padding;
+
+                n = strlen(*i);
+                *(uint32_t*) p = n;
+                memcpy(p + 4, *i, n + 1);
+                p += 4 + n + 1;
+        }
+
+        assert((size_t) (p - a) == sz);
+
+        return 0;
+}
+
 _public_ int sd_bus_message_append_strv(sd_bus_message *m, char **l) {
         char **i;
         int r;
@@ -2829,8 +2966,14 @@ _public_ int sd_bus_message_append_strv(sd_bus_message *m, char **l) {
         if (r < 0)
                 return r;
 
-        STRV_FOREACH(i, l) {
-                r = sd_bus_message_append_basic(m, 's', *i);
+        if (BUS_MESSAGE_IS_GVARIANT(m))
+                STRV_FOREACH(i, l) {
+                        r = sd_bus_message_append_basic(m, 's', *i);
+                        if (r < 0)
+                                return r;
+                }
+        else {
+                r = message_append_strv_dbus1(m, l);
                 if (r < 0)
                         return r;
         }
@@ -2890,6 +3033,8 @@ static int bus_message_close_header(sd_bus_message *m) {
 
                 m->footer = d;
                 m->footer_accessible = 1 + l + 2 + sz;
+
+                m->header->dbus2.size = ALIGN8(m->fields_size) + m->body_size;
         } else {
                 m->header->dbus1.fields_size = m->fields_size;
                 m->header->dbus1.body_size = m->body_size;
@@ -5214,7 +5359,7 @@ int bus_message_parse_fields(sd_bus_message *m) {
                                 return r;
 
                         framing = bus_gvariant_read_word_le(q, sz);
-                        if (framing >= m->fields_size - sz)
+                        if (framing > m->fields_size - sz)
                                 return -EBADMSG;
                         if ((m->fields_size - framing) % sz != 0)
                                 return -EBADMSG;
@@ -5573,6 +5718,62 @@ int bus_message_get_blob(sd_bus_message *m, void **buffer, size_t *sz) {
         return 0;
 }
 
+static int message_read_strv_dbus1(sd_bus_message *m, char ***l) {
+        struct bus_container *c;
+        size_t n, allocated, end;
+        int r;
+
+        assert(m);
+        assert(l);
+        assert(!BUS_MESSAGE_IS_GVARIANT(m));
+
+        /* Reads all strings of the array we just entered in one go, without checking the signature again
+         * for each of them, and without reallocating the array for each of them. */
+
+        c = message_get_last_container(m);
+        assert(c->enclosing == SD_BUS_TYPE_ARRAY);
+        assert(c->array_size);
+
+        end = c->begin + BUS_MESSAGE_BSWAP32(m, *c->array_size);
+
+        n = strv_length(*l);
+        allocated = *l ? n + 1 : 0;
+
+        while (m->rindex < end) {
+                size_t rindex = m->rindex;
+                uint32_t k;
+                void *q;
+
+                r = message_peek_body(m, &rindex, 4, 4, &q);
+                if (r < 0)
+                        return r;
+
+                k = BUS_MESSAGE_BSWAP32(m, *(uint32_t*) q);
+                if (k == UINT32_MAX)
+                        return -EBADMSG;
+
+                r = message_peek_body(m, &rindex, 1, k+1, &q);
+                if (r < 0)
+                        return r;
+
+                if (!validate_string(q, k))
+                        return -EBADMSG;
+
+                if (!GREEDY_REALLOC(*l, allocated, n + 2))
+                        return -ENOMEM;
+
+                (*l)[n] = strndup(q, k);
+                if (!(*l)[n])
+                        return -ENOMEM;
+
+                (*l)[++n] = NULL;
+
+                m->rindex = rindex;
+        }
+
+        return 0;
+}
+
 int bus_message_read_strv_extend(sd_bus_message *m, char ***l) {
         const char *s;
         int r;
@@ -5584,11 +5785,14 @@ int bus_message_read_strv_extend(sd_bus_message *m, char ***l) {
         if (r <= 0)
                 return r;
 
-        while ((r = sd_bus_message_read_basic(m, 's', &s)) > 0) {
-                r = strv_extend(l, s);
-                if (r < 0)
-                        return r;
-        }
+        if (BUS_MESSAGE_IS_GVARIANT(m)) {
+                while ((r = sd_bus_message_read_basic(m, 's', &s)) > 0) {
+                        r = strv_extend(l, s);
+                        if (r < 0)
+                                return r;
+                }
+        } else
+                r = message_read_strv_dbus1(m, l);
         if (r < 0)
                 return r;
 
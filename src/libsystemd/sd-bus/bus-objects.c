@@ -991,9 +991,13 @@ int introspect_path(
                         fprintf(intro.f, " <interface name=\"%s\">\n", c->interface);
                 }
 
-                r = introspect_write_interface(&intro, c->vtable);
-                if (r < 0)
-                        return r;
+                if (!c->introspection) {
+                        r = introspect_interface_to_string(c->vtable, bus->trusted, &c->introspection);
+                        if (r < 0)
+                                return r;
+                }
+
+                fputs(c->introspection, intro.f);
 
                 previous_interface = c->interface;
         }
@@ -1025,6 +1029,18 @@ int introspect_path(
         return 1;
 }
 
+void bus_flush_introspection(sd_bus *b) {
+        struct node_vtable *c;
+        struct node *n;
+        Iterator i;
+
+        assert(b);
+
+        HASHMAP_FOREACH(n, b->nodes, i)
+                LIST_FOREACH(vtables, c, n->vtables)
+                        c->introspection = mfree(c->introspection);
+}
+
 static int process_introspect(
                 sd_bus *bus,
                 sd_bus_message *m,
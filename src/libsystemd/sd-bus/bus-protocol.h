@@ -26,9 +26,12 @@ struct _packed_ bus_header {
                         uint32_t fields_size;
                 } dbus1;
 
-                /* dbus2: Used for kdbus connections */
+                /* dbus2: Originally used for kdbus connections, and on socket connections if both sides
+                 * agreed to it during authentication */
                 struct _packed_ {
-                        uint32_t _reserved;
+                        /* On the socket transport the size of the message following the header, since we
+                         * can't derive it from the transport as on kdbus. */
+                        uint32_t size;
                         uint64_t cookie;
                 } dbus2;
 
@@ -57,6 +60,11 @@ enum {
         BUS_MESSAGE_NO_REPLY_EXPECTED               = 1 << 0,
         BUS_MESSAGE_NO_AUTO_START                   = 1 << 1,
         BUS_MESSAGE_ALLOW_INTERACTIVE_AUTHORIZATION = 1 << 2,
+
+        /* Not part of the D-Bus specification: only used on socket connections where both sides agreed to it
+         * during authentication, and marks that the body is not sent inline, but passed as sealed memfd
+         * after the fds of the message itself. Never set on messages outside of the socket transport. */
+        BUS_MESSAGE_BODY_MEMFD                      = 1 << 7,
 };
 
 /* Header fields */
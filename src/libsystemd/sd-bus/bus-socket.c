@@ -10,6 +10,7 @@
 
 #include "alloc-util.h"
 #include "bus-internal.h"
+#include "bus-kernel.h"
 #include "bus-message.h"
 #include "bus-socket.h"
 #include "fd-util.h"
@@ -18,7 +19,9 @@
 #include "hexdecoct.h"
 #include "io-util.h"
 #include "macro.h"
+#include "memfd-util.h"
 #include "memory-util.h"
+#include "missing_socket.h"
 #include "path-util.h"
 #include "process-util.h"
 #include "rlimit-util.h"
@@ -26,11 +29,35 @@
 #include "signal-util.h"
 #include "stdio-util.h"
 #include "string-util.h"
+#include "unaligned.h"
 #include "user-util.h"
 #include "utf8.h"
 
 #define SNDBUF_SIZE (8*1024*1024)
 
+/* How much to read at once, if we don't need a specific amount */
+#define RBUFFER_BATCH_SIZE (64U*1024U)
+
+/* How many queued messages to write with a single syscall at most */
+#define WQUEUE_BATCH_MAX 64U
+
+static bool bus_socket_want_memfd_body(sd_bus *b) {
+        assert(b);
+
+        /* We only ask for passing bodies as memfds on direct connections, since message brokers don't know
+         * about it. Peers that don't know it either just reply with an error. */
+        return b->accept_fd && !b->bus_client;
+}
+
+static bool bus_socket_want_gvariant(sd_bus *b) {
+        assert(b);
+
+        /* GVariant marshalling is only asked for, or agreed to, on direct connections too, and only if
+         * requested, as it makes little difference for small messages. Both sides have to opt in, so that a
+         * server doesn't switch the format on clients of a service that never asked for it. */
+        return b->negotiate_gvariant && !b->bus_client;
+}
+
 static void iovec_advance(struct iovec iov[], unsigned *idx, size_t size) {
 
         while (size > 0) {
@@ -156,17 +183,19 @@ static int bus_socket_write_auth(sd_bus *b) {
 }
 
 static int bus_socket_auth_verify_client(sd_bus *b) {
-        char *d, *e, *f, *start;
+        char *d, *e, *f, *g, *h, *start;
         sd_id128_t peer;
         int r;
 
         assert(b);
 
         /*
-         * We expect three response lines:
+         * We expect up to four response lines:
          *   "DATA\r\n"
          *   "OK <server-id>\r\n"
          *   "AGREE_UNIX_FD\r\n"        (optional)
+         *   "AGREE_MEMFD_BODY\r\n"     (optional)
+         *   "AGREE_GVARIANT\r\n"       (optional)
          */
 
         d = memmem_safe(b->rbuffer, b->rbuffer_size, "\r\n", 2);
@@ -188,6 +217,24 @@ static int bus_socket_auth_verify_client(sd_bus *b) {
                 start = e + 2;
         }
 
+        if (bus_socket_want_memfd_body(b)) {
+                g = memmem(f + 2, b->rbuffer_size - (f - (char*) b->rbuffer) - 2, "\r\n", 2);
+                if (!g)
+                        return 0;
+
+                start = g + 2;
+        } else
+                g = NULL;
+
+        if (bus_socket_want_gvariant(b)) {
+                h = memmem(start, b->rbuffer_size - (start - (char*) b->rbuffer), "\r\n", 2);
+                if (!h)
+                        return 0;
+
+                start = h + 2;
+        } else
+                h = NULL;
+
         /* Nice! We got all the lines we need. First check the DATA line. */
 
         if (d - (char*) b->rbuffer == 4) {
@@ -241,6 +288,25 @@ static int bus_socket_auth_verify_client(sd_bus *b) {
                         memcmp(e + 2, "AGREE_UNIX_FD",
                                STRLEN("AGREE_UNIX_FD")) == 0;
 
+        /* And the fourth, which we only get an agreement for if the peer is fine with fd passing too */
+        if (g)
+                b->can_memfd_body =
+                        b->can_fds &&
+                        (g - f == STRLEN("\r\nAGREE_MEMFD_BODY")) &&
+                        memcmp(f + 2, "AGREE_MEMFD_BODY",
+                               STRLEN("AGREE_MEMFD_BODY")) == 0;
+
+        /* And the last one, which follows whichever line came before it */
+        if (h) {
+                const char *p = (g ?: f ?: e) + 2;
+
+                b->can_gvariant =
+                        (size_t) (h - p) == STRLEN("AGREE_GVARIANT") &&
+                        memcmp(p, "AGREE_GVARIANT", STRLEN("AGREE_GVARIANT")) == 0;
+                if (b->can_gvariant)
+                        b->message_version = 2;
+        }
+
         b->rbuffer_size -= (start - (char*) b->rbuffer);
         memmove(b->rbuffer, start, b->rbuffer_size);
 
@@ -490,6 +556,21 @@ static int bus_socket_auth_verify_server(sd_bus *b) {
                                 b->can_fds = true;
                                 r = bus_socket_auth_write(b, "AGREE_UNIX_FD\r\n");
                         }
+                } else if (line_equals(line, l, "NEGOTIATE_MEMFD_BODY")) {
+                        if (b->auth == _BUS_AUTH_INVALID || !b->can_fds)
+                                r = bus_socket_auth_write(b, "ERROR\r\n");
+                        else {
+                                b->can_memfd_body = true;
+                                r = bus_socket_auth_write(b, "AGREE_MEMFD_BODY\r\n");
+                        }
+                } else if (line_equals(line, l, "NEGOTIATE_GVARIANT")) {
+                        if (b->auth == _BUS_AUTH_INVALID || !bus_socket_want_gvariant(b))
+                                r = bus_socket_auth_write(b, "ERROR\r\n");
+                        else {
+                                b->can_gvariant = true;
+                                b->message_version = 2;
+                                r = bus_socket_auth_write(b, "AGREE_GVARIANT\r\n");
+                        }
                 } else
                         r = bus_socket_auth_write(b, "ERROR\r\n");
 
@@ -626,6 +707,20 @@ static void bus_get_peercred(sd_bus *b) {
         /* Get the peer for socketpair() sockets */
         b->ucred_valid = getpeercred(b->input_fd, &b->ucred) >= 0;
 
+        /* Pin the peer process, so that we can tell later whether the PID still refers to it */
+        if (b->ucred_valid) {
+                socklen_t n = sizeof(b->peer_pidfd);
+
+                b->peer_pidfd = safe_close(b->peer_pidfd);
+
+                if (getsockopt(b->input_fd, SOL_SOCKET, SO_PEERPIDFD, &b->peer_pidfd, &n) < 0) {
+                        if (!IN_SET(errno, ENOPROTOOPT, EINVAL, ENODATA))
+                                log_debug_errno(errno, "Failed to acquire pidfd of peer, ignoring: %m");
+
+                        b->peer_pidfd = -1;
+                }
+        }
+
         /* Get the SELinux context of the peer */
         r = getpeersec(b->input_fd, &b->label);
         if (r < 0 && !IN_SET(r, -EOPNOTSUPP, -ENOPROTOOPT))
@@ -657,6 +752,12 @@ static int bus_socket_start_auth_client(sd_bus *b) {
         static const char sasl_negotiate_unix_fd[] = {
                 "NEGOTIATE_UNIX_FD\r\n"
         };
+        static const char sasl_negotiate_memfd_body[] = {
+                "NEGOTIATE_MEMFD_BODY\r\n"
+        };
+        static const char sasl_negotiate_gvariant[] = {
+                "NEGOTIATE_GVARIANT\r\n"
+        };
         static const char sasl_begin[] = {
                 "BEGIN\r\n"
         };
@@ -672,6 +773,12 @@ static int bus_socket_start_auth_client(sd_bus *b) {
         if (b->accept_fd)
                 b->auth_iovec[i++] = IOVEC_MAKE_STRING(sasl_negotiate_unix_fd);
 
+        if (bus_socket_want_memfd_body(b))
+                b->auth_iovec[i++] = IOVEC_MAKE_STRING(sasl_negotiate_memfd_body);
+
+        if (bus_socket_want_gvariant(b))
+                b->auth_iovec[i++] = IOVEC_MAKE_STRING(sasl_negotiate_gvariant);
+
         b->auth_iovec[i++] = IOVEC_MAKE_STRING(sasl_begin);
 
         return bus_socket_write_auth(b);
@@ -1000,10 +1107,56 @@ int bus_socket_take_fd(sd_bus *b) {
         return bus_socket_start_auth(b);
 }
 
+static bool bus_socket_message_use_memfd(sd_bus *bus, sd_bus_message *m) {
+        assert(bus);
+        assert(m);
+
+        /* Large bodies are passed as sealed memfd if the peer agreed to that, so that they are copied only
+         * once into the memfd on our side, and not at all on the receiving side, which just maps them. */
+        return bus->can_memfd_body &&
+                !bus->prefer_writev &&
+                !BUS_MESSAGE_IS_GVARIANT(m) &&
+                m->n_fds < BUS_FDS_MAX &&
+                m->body_size >= MEMFD_MIN_SIZE;
+}
+
+static int bus_message_make_body_memfd(sd_bus_message *m) {
+        _cleanup_close_ int fd = -1;
+        struct bus_body_part *part;
+        unsigned i;
+        int r;
+
+        assert(m);
+        assert(m->sealed);
+
+        fd = memfd_new("sd-bus-body");
+        if (fd < 0)
+                return fd;
+
+        MESSAGE_FOREACH_PART(part, i, m) {
+                r = bus_body_part_map(part);
+                if (r < 0)
+                        return r;
+
+                r = loop_write(fd, part->data, part->size, false);
+                if (r < 0)
+                        return r;
+        }
+
+        r = memfd_set_sealed(fd);
+        if (r < 0)
+                return r;
+
+        return TAKE_FD(fd);
+}
+
 int bus_socket_write_message(sd_bus *bus, sd_bus_message *m, size_t *idx) {
+        _cleanup_close_ int memfd = -1;
+        struct bus_header header;
         struct iovec *iov;
+        size_t n, n_iovec;
+        bool use_memfd;
         ssize_t k;
-        size_t n;
         unsigned j;
         int r;
 
@@ -1015,39 +1168,144 @@ int bus_socket_write_message(sd_bus *bus, sd_bus_message *m, size_t *idx) {
         if (*idx >= BUS_MESSAGE_SIZE(m))
                 return 0;
 
-        r = bus_message_setup_iovec(m);
-        if (r < 0)
-                return r;
+        use_memfd = bus_socket_message_use_memfd(bus, m);
+        if (use_memfd) {
+                /* Only the header and the fields go over the socket, with the flag set that tells the
+                 * receiver to look for the body in the last fd. The message itself is left untouched. */
+                header = *m->header;
+                header.flags |= BUS_MESSAGE_BODY_MEMFD;
+
+                n_iovec = 2;
+                iov = newa(struct iovec, n_iovec);
+                iov[0] = IOVEC_MAKE(&header, sizeof(header));
+                iov[1] = IOVEC_MAKE((uint8_t*) m->header + sizeof(header), BUS_MESSAGE_BODY_BEGIN(m) - sizeof(header));
+
+                if (*idx == 0) {
+                        memfd = bus_message_make_body_memfd(m);
+                        if (memfd < 0)
+                                return memfd;
+                }
+        } else {
+                r = bus_message_setup_iovec(m);
+                if (r < 0)
+                        return r;
 
-        n = m->n_iovec * sizeof(struct iovec);
-        iov = newa(struct iovec, n);
-        memcpy_safe(iov, m->iovec, n);
+                n_iovec = m->n_iovec;
+                n = n_iovec * sizeof(struct iovec);
+                iov = newa(struct iovec, n);
+                memcpy_safe(iov, m->iovec, n);
+        }
 
         j = 0;
         iovec_advance(iov, &j, *idx);
 
         if (bus->prefer_writev)
-                k = writev(bus->output_fd, iov, m->n_iovec);
+                k = writev(bus->output_fd, iov, n_iovec);
         else {
                 struct msghdr mh = {
                         .msg_iov = iov,
-                        .msg_iovlen = m->n_iovec,
+                        .msg_iovlen = n_iovec,
                 };
+                size_t n_fds = m->n_fds + (memfd >= 0);
 
-                if (m->n_fds > 0 && *idx == 0) {
+                if (n_fds > 0 && *idx == 0) {
                         struct cmsghdr *control;
 
-                        mh.msg_control = control = alloca(CMSG_SPACE(sizeof(int) * m->n_fds));
-                        mh.msg_controllen = control->cmsg_len = CMSG_LEN(sizeof(int) * m->n_fds);
+                        mh.msg_control = control = alloca(CMSG_SPACE(sizeof(int) * n_fds));
+                        mh.msg_controllen = control->cmsg_len = CMSG_LEN(sizeof(int) * n_fds);
                         control->cmsg_level = SOL_SOCKET;
                         control->cmsg_type = SCM_RIGHTS;
-                        memcpy(CMSG_DATA(control), m->fds, sizeof(int) * m->n_fds);
+                        memcpy_safe(CMSG_DATA(control), m->fds, sizeof(int) * m->n_fds);
+                        if (memfd >= 0)
+                                ((int*) CMSG_DATA(control))[m->n_fds] = memfd;
+                }
+
+                k = sendmsg(bus->output_fd, &mh, MSG_DONTWAIT|MSG_NOSIGNAL);
+                if (k < 0 && errno == ENOTSOCK) {
+                        bus->prefer_writev = true;
+                        k = writev(bus->output_fd, iov, n_iovec);
+                }
+        }
+
+        if (k < 0)
+                return errno == EAGAIN ? 0 : -errno;
+
+        *idx += (size_t) k;
+
+        /* The body went out with the memfd already, hence we are done once the fields are written */
+        if (use_memfd && *idx >= BUS_MESSAGE_BODY_BEGIN(m))
+                *idx = BUS_MESSAGE_SIZE(m);
+
+        return 1;
+}
+
+int bus_socket_write_messages(sd_bus *bus, sd_bus_message **messages, size_t n_messages, size_t *idx) {
+        struct iovec *iov;
+        size_t n, n_iovec = 0;
+        ssize_t k;
+        unsigned j;
+        int r;
+
+        assert(bus);
+        assert(messages);
+        assert(n_messages > 0);
+        assert(idx);
+        assert(IN_SET(bus->state, BUS_RUNNING, BUS_HELLO));
+
+        /* Writes the first message, starting at the specified index, and as many of the following ones as
+         * possible along with it. The index afterwards points into the concatenation of all the messages.
+         * The receiver assigns fds to the last message starting in what it read, hence a message with fds
+         * is always written on its own, and never batched with the messages around it. */
+
+        if (messages[0]->n_fds > 0 || bus_socket_message_use_memfd(bus, messages[0]))
+                return bus_socket_write_message(bus, messages[0], idx);
+
+        for (n = 0; n < MIN(n_messages, WQUEUE_BATCH_MAX); n++) {
+                sd_bus_message *m = messages[n];
+
+                if (n > 0 && (m->n_fds > 0 || bus_socket_message_use_memfd(bus, m)))
+                        break;
+
+                r = bus_message_setup_iovec(m);
+                if (r < 0) {
+                        if (n == 0)
+                                return r;
+
+                        /* Deal with it when it comes first */
+                        break;
                 }
 
+                if (n > 0 && n_iovec + m->n_iovec > IOV_MAX)
+                        break;
+
+                n_iovec += m->n_iovec;
+        }
+
+        if (n <= 1)
+                return bus_socket_write_message(bus, messages[0], idx);
+
+        iov = newa(struct iovec, n_iovec);
+        n_iovec = 0;
+        for (size_t i = 0; i < n; i++) {
+                memcpy(iov + n_iovec, messages[i]->iovec, messages[i]->n_iovec * sizeof(struct iovec));
+                n_iovec += messages[i]->n_iovec;
+        }
+
+        j = 0;
+        iovec_advance(iov, &j, *idx);
+
+        if (bus->prefer_writev)
+                k = writev(bus->output_fd, iov, n_iovec);
+        else {
+                struct msghdr mh = {
+                        .msg_iov = iov,
+                        .msg_iovlen = n_iovec,
+                };
+
                 k = sendmsg(bus->output_fd, &mh, MSG_DONTWAIT|MSG_NOSIGNAL);
                 if (k < 0 && errno == ENOTSOCK) {
                         bus->prefer_writev = true;
-                        k = writev(bus->output_fd, iov, m->n_iovec);
+                        k = writev(bus->output_fd, iov, n_iovec);
                 }
         }
 
@@ -1058,16 +1316,30 @@ int bus_socket_write_message(sd_bus *bus, sd_bus_message *m, size_t *idx) {
         return 1;
 }
 
-static int bus_socket_read_message_need(sd_bus *bus, size_t *need) {
+static bool bus_socket_message_has_memfd_body(sd_bus *bus, const void *p) {
+        assert(bus);
+        assert(p);
+
+        return bus->can_memfd_body &&
+                FLAGS_SET(((const struct bus_header*) p)->flags, BUS_MESSAGE_BODY_MEMFD);
+}
+
+static int bus_socket_read_message_need(sd_bus *bus, size_t offset, size_t *need) {
+        const uint8_t *p;
         uint32_t a, b;
         uint8_t e;
         uint64_t sum;
 
         assert(bus);
+        assert(offset <= bus->rbuffer_size);
         assert(need);
         assert(IN_SET(bus->state, BUS_RUNNING, BUS_HELLO));
 
-        if (bus->rbuffer_size < sizeof(struct bus_header)) {
+        /* Determines the size of the message starting at the specified offset of the read buffer */
+
+        p = (const uint8_t*) bus->rbuffer + offset;
+
+        if (bus->rbuffer_size - offset < sizeof(struct bus_header)) {
                 *need = sizeof(struct bus_header) + 8;
 
                 /* Minimum message size:
@@ -1089,10 +1361,10 @@ static int bus_socket_read_message_need(sd_bus *bus, size_t *need) {
                 return 0;
         }
 
-        a = ((const uint32_t*) bus->rbuffer)[1];
-        b = ((const uint32_t*) bus->rbuffer)[3];
+        a = unaligned_read_ne32(p + 4);
+        b = unaligned_read_ne32(p + 12);
 
-        e = ((const uint8_t*) bus->rbuffer)[0];
+        e = p[0];
         if (e == BUS_LITTLE_ENDIAN) {
                 a = le32toh(a);
                 b = le32toh(b);
@@ -1102,54 +1374,80 @@ static int bus_socket_read_message_need(sd_bus *bus, size_t *need) {
         } else
                 return -EBADMSG;
 
-        sum = (uint64_t) sizeof(struct bus_header) + (uint64_t) ALIGN_TO(b, 8) + (uint64_t) a;
+        if (p[3] == 2) {
+                /* The dbus2 header has the size of everything following it where dbus1 has the body size */
+                if (!bus->can_gvariant)
+                        return -EBADMSG;
+
+                sum = (uint64_t) sizeof(struct bus_header) + (uint64_t) a;
+        } else
+                sum = (uint64_t) sizeof(struct bus_header) + (uint64_t) ALIGN_TO(b, 8) + (uint64_t) a;
         if (sum >= BUS_MESSAGE_SIZE_MAX)
                 return -ENOBUFS;
 
+        /* If the body is passed as memfd, only the header and the fields are sent inline */
+        if (bus_socket_message_has_memfd_body(bus, p))
+                sum -= a;
+
         *need = (size_t) sum;
         return 0;
 }
 
-static int bus_socket_make_message(sd_bus *bus, size_t size) {
+static int bus_socket_make_message(sd_bus *bus, void *buffer, size_t size, bool take_fds) {
         sd_bus_message *t = NULL;
-        void *b;
+        int *fds = take_fds ? bus->fds : NULL;
+        size_t n_fds = take_fds ? bus->n_fds : 0;
         int r;
 
         assert(bus);
-        assert(bus->rbuffer_size >= size);
+        assert(buffer);
         assert(IN_SET(bus->state, BUS_RUNNING, BUS_HELLO));
 
+        /* Turns the specified buffer into a message and queues it. Takes possession of the buffer, and of
+         * the pending fds if requested, unless this fails with an error other than -EBADMSG. */
+
         r = bus_rqueue_make_room(bus);
         if (r < 0)
                 return r;
 
-        if (bus->rbuffer_size > size) {
-                b = memdup((const uint8_t*) bus->rbuffer + size,
-                           bus->rbuffer_size - size);
-                if (!b)
-                        return -ENOMEM;
+        if (bus_socket_message_has_memfd_body(bus, buffer)) {
+                int memfd;
+
+                /* The memfd with the body is always the last fd passed along with the message. Strip the
+                 * flag again, so that the message looks like any other one from here on. */
+                if (n_fds > 0) {
+                        memfd = fds[--n_fds];
+                        ((struct bus_header*) buffer)->flags &= ~BUS_MESSAGE_BODY_MEMFD;
+
+                        r = bus_message_from_malloc_and_memfd(bus,
+                                                              buffer, size,
+                                                              memfd,
+                                                              fds, n_fds,
+                                                              NULL,
+                                                              &t);
+                        if (r < 0 && r != -EBADMSG)
+                                /* The memfd is gone either way, don't leave it in the array */
+                                bus->n_fds--;
+                } else
+                        r = -EBADMSG;
         } else
-                b = NULL;
-
-        r = bus_message_from_malloc(bus,
-                                    bus->rbuffer, size,
-                                    bus->fds, bus->n_fds,
-                                    NULL,
-                                    &t);
+                r = bus_message_from_malloc(bus,
+                                            buffer, size,
+                                            fds, n_fds,
+                                            NULL,
+                                            &t);
         if (r == -EBADMSG) {
                 log_debug_errno(r, "Received invalid message from connection %s, dropping.", strna(bus->description));
-                free(bus->rbuffer); /* We want to drop current rbuffer and proceed with whatever remains in b */
-        } else if (r < 0) {
-                free(b);
+                free(buffer);
+                close_many(fds, n_fds);
+                free(fds);
+        } else if (r < 0)
                 return r;
-        }
-
-        /* rbuffer ownership was either transferred to t, or we got EBADMSG and dropped it. */
-        bus->rbuffer = b;
-        bus->rbuffer_size -= size;
 
-        bus->fds = NULL;
-        bus->n_fds = 0;
+        if (take_fds) {
+                bus->fds = NULL;
+                bus->n_fds = 0;
+        }
 
         if (t) {
                 t->read_counter = ++bus->read_counter;
@@ -1160,11 +1458,82 @@ static int bus_socket_make_message(sd_bus *bus, size_t size) {
         return 1;
 }
 
+static int bus_socket_make_messages(sd_bus *bus) {
+        size_t offset = 0, need;
+        int r, ret = 0;
+
+        assert(bus);
+
+        /* Turns all complete messages in the read buffer into message objects at once. Data is read in larger
+         * chunks only while no fds are pending, and the kernel never returns data following a chunk with fds
+         * attached in the same read. Since fds are always sent along with the first bytes of a message, the
+         * pending fds belong to the last message starting in the buffer, i.e. the one no data follows. */
+
+        for (;;) {
+                bool last;
+                void *b;
+
+                r = bus_socket_read_message_need(bus, offset, &need);
+                if (r < 0)
+                        break;
+
+                if (bus->rbuffer_size - offset < need)
+                        break;
+
+                last = offset + need == bus->rbuffer_size;
+
+                if (offset == 0 && last)
+                        b = bus->rbuffer;
+                else {
+                        b = memdup((const uint8_t*) bus->rbuffer + offset, need);
+                        if (!b) {
+                                r = -ENOMEM;
+                                break;
+                        }
+                }
+
+                r = bus_socket_make_message(bus, b, need, last);
+                if (r < 0) {
+                        if (b != bus->rbuffer)
+                                free(b);
+                        break;
+                }
+
+                offset += need;
+                ret = 1;
+
+                if (last) {
+                        /* The buffer is entirely consumed, and possibly owned by the message now */
+                        if (b == bus->rbuffer)
+                                bus->rbuffer = NULL;
+                        break;
+                }
+        }
+
+        if (offset > 0) {
+                if (bus->rbuffer_size > offset) {
+                        void *b;
+
+                        b = memdup((const uint8_t*) bus->rbuffer + offset, bus->rbuffer_size - offset);
+                        if (!b)
+                                return -ENOMEM;
+
+                        free(bus->rbuffer);
+                        bus->rbuffer = b;
+                } else
+                        bus->rbuffer = mfree(bus->rbuffer);
+
+                bus->rbuffer_size -= offset;
+        }
+
+        return ret > 0 ? ret : r;
+}
+
 int bus_socket_read_message(sd_bus *bus) {
         struct msghdr mh;
         struct iovec iov = {};
         ssize_t k;
-        size_t need;
+        size_t need, allocated;
         int r;
         void *b;
         union {
@@ -1176,20 +1545,28 @@ int bus_socket_read_message(sd_bus *bus) {
         assert(bus);
         assert(IN_SET(bus->state, BUS_RUNNING, BUS_HELLO));
 
-        r = bus_socket_read_message_need(bus, &need);
+        r = bus_socket_read_message_need(bus, 0, &need);
         if (r < 0)
                 return r;
 
         if (bus->rbuffer_size >= need)
-                return bus_socket_make_message(bus, need);
+                return bus_socket_make_messages(bus);
+
+        /* Read as much as there is, so that a flood of messages doesn't cost a syscall each. Except if we
+         * already got fds for the incomplete message at the beginning of the buffer: then read that one
+         * only, so that there's never any doubt which message pending fds belong to. */
+        if (bus->n_fds == 0)
+                allocated = MAX(need, RBUFFER_BATCH_SIZE);
+        else
+                allocated = need;
 
-        b = realloc(bus->rbuffer, need);
+        b = realloc(bus->rbuffer, allocated);
         if (!b)
                 return -ENOMEM;
 
         bus->rbuffer = b;
 
-        iov = IOVEC_MAKE((uint8_t *)bus->rbuffer + bus->rbuffer_size, need - bus->rbuffer_size);
+        iov = IOVEC_MAKE((uint8_t *)bus->rbuffer + bus->rbuffer_size, allocated - bus->rbuffer_size);
 
         if (bus->prefer_readv)
                 k = readv(bus->input_fd, &iov, 1);
@@ -1255,12 +1632,12 @@ int bus_socket_read_message(sd_bus *bus) {
                                           cmsg->cmsg_level, cmsg->cmsg_type);
         }
 
-        r = bus_socket_read_message_need(bus, &need);
+        r = bus_socket_read_message_need(bus, 0, &need);
         if (r < 0)
                 return r;
 
         if (bus->rbuffer_size >= need)
-                return bus_socket_make_message(bus, need);
+                return bus_socket_make_messages(bus);
 
         return 1;
 }
@@ -4,13 +4,16 @@
 
 #include "alloc-util.h"
 #include "bus-internal.h"
+#include "bus-message.h"
 #include "bus-track.h"
 #include "bus-util.h"
 
 struct track_item {
         unsigned n_ref;
         char *name;
-        sd_bus_slot *slot;
+        sd_bus_track *track;
+        uint64_t after; /* ignore NameOwnerChanged signals read before we started tracking */
+        LIST_FIELDS(struct track_item, by_name);
 };
 
 struct sd_bus_track {
@@ -31,20 +34,50 @@ struct sd_bus_track {
         LIST_FIELDS(sd_bus_track, tracks);
 };
 
-#define MATCH_FOR_NAME(name)                            \
-        strjoina("type='signal',"                       \
-                 "sender='org.freedesktop.DBus',"       \
-                 "path='/org/freedesktop/DBus',"        \
-                 "interface='org.freedesktop.DBus',"    \
-                 "member='NameOwnerChanged',"           \
-                 "arg0='", name, "'")
+/* All track objects of a bus share a single NameOwnerChanged match, and look up the names in
+ * bus->track_names when a signal arrives. This keeps the number of matches installed locally and on the
+ * broker constant, regardless of how many peers are tracked, and avoids an AddMatch()/RemoveMatch() round
+ * trip for each of them. */
+#define MATCH_NAME_OWNER_CHANGED                        \
+        "type='signal',"                                \
+        "sender='org.freedesktop.DBus',"                \
+        "path='/org/freedesktop/DBus',"                 \
+        "interface='org.freedesktop.DBus',"             \
+        "member='NameOwnerChanged'"
+
+static void track_item_unlink(struct track_item *i) {
+        struct track_item *head;
+        sd_bus *bus;
+
+        assert(i);
+
+        if (!i->track)
+                return;
+
+        bus = i->track->bus;
+        i->track = NULL;
+
+        head = hashmap_get(bus->track_names, i->name);
+        LIST_REMOVE(by_name, head, i);
+
+        if (head)
+                /* The key is owned by the first item, hence update it along with the value */
+                assert_se(hashmap_replace(bus->track_names, head->name, head) >= 0);
+        else
+                hashmap_remove(bus->track_names, i->name);
+
+        if (hashmap_isempty(bus->track_names)) {
+                bus->track_names = hashmap_free(bus->track_names);
+                bus->track_slot = sd_bus_slot_unref(bus->track_slot);
+        }
+}
 
 static struct track_item* track_item_free(struct track_item *i) {
 
         if (!i)
                 return NULL;
 
-        sd_bus_slot_unref(i->slot);
+        track_item_unlink(i);
         free(i->name);
         return mfree(i);
 }
@@ -164,25 +197,68 @@ static sd_bus_track *track_free(sd_bus_track *track) {
 DEFINE_PUBLIC_TRIVIAL_REF_UNREF_FUNC(sd_bus_track, sd_bus_track, track_free);
 
 static int on_name_owner_changed(sd_bus_message *message, void *userdata, sd_bus_error *error) {
-        sd_bus_track *track = userdata;
+        sd_bus *bus = userdata;
+        struct track_item *head, *i, *n;
         const char *name, *old, *new;
         int r;
 
         assert(message);
-        assert(track);
+        assert(bus);
 
         r = sd_bus_message_read(message, "sss", &name, &old, &new);
         if (r < 0)
                 return 0;
 
-        bus_track_remove_name_fully(track, name);
+        head = hashmap_get(bus->track_names, name);
+        LIST_FOREACH_SAFE(by_name, i, n, head)
+                if (message->read_counter > i->after)
+                        bus_track_remove_name_fully(i->track, name);
+
+        return 0;
+}
+
+static int bus_track_link_item(sd_bus_track *track, struct track_item *i) {
+        struct track_item *head;
+        int r;
+
+        assert(track);
+        assert(i);
+        assert(!i->track);
+
+        head = hashmap_get(track->bus->track_names, i->name);
+        if (head) {
+                /* Somebody else tracks this name already, hence the match is in place. Add us at the
+                 * end, so that the key of the hashmap entry remains valid. */
+                LIST_APPEND(by_name, head, i);
+                i->track = track;
+                return 0;
+        }
+
+        r = hashmap_ensure_allocated(&track->bus->track_names, &string_hash_ops);
+        if (r < 0)
+                return r;
+
+        r = hashmap_put(track->bus->track_names, i->name, i);
+        if (r < 0)
+                return r;
+
+        i->track = track;
+
+        if (!track->bus->track_slot) {
+                r = sd_bus_add_match_async(track->bus, &track->bus->track_slot, MATCH_NAME_OWNER_CHANGED,
+                                           on_name_owner_changed, NULL, track->bus);
+                if (r < 0) {
+                        track_item_unlink(i);
+                        return r;
+                }
+        }
+
         return 0;
 }
 
 _public_ int sd_bus_track_add_name(sd_bus_track *track, const char *name) {
         _cleanup_(track_item_freep) struct track_item *n = NULL;
         struct track_item *i;
-        const char *match;
         int r;
 
         assert_return(track, -EINVAL);
@@ -214,12 +290,13 @@ _public_ int sd_bus_track_add_name(sd_bus_track *track, const char *name) {
         if (!n->name)
                 return -ENOMEM;
 
-        /* First, subscribe to this name */
-        match = MATCH_FOR_NAME(name);
+        /* Signals already read at this point predate our interest in the name, and must not remove it. */
+        n->after = track->bus->read_counter;
 
         bus_track_remove_from_queue(track); /* don't dispatch this while we work in it */
 
-        r = sd_bus_add_match_async(track->bus, &n->slot, match, on_name_owner_changed, NULL, track);
+        /* First, subscribe to this name */
+        r = bus_track_link_item(track, n);
         if (r < 0) {
                 bus_track_add_to_queue(track);
                 return r;
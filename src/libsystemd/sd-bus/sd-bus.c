@@ -29,6 +29,7 @@
 #include "bus-util.h"
 #include "cgroup-util.h"
 #include "def.h"
+#include "env-util.h"
 #include "errno-util.h"
 #include "fd-util.h"
 #include "hexdecoct.h"
@@ -133,6 +134,9 @@ void bus_close_io_fds(sd_bus *b) {
         if (b->input_fd != b->output_fd)
                 safe_close(b->output_fd);
         b->output_fd = b->input_fd = safe_close(b->input_fd);
+
+        /* The pidfd pins the peer of the connection, hence goes away with it */
+        b->peer_pidfd = safe_close(b->peer_pidfd);
 }
 
 void bus_close_inotify_fd(sd_bus *b) {
@@ -167,6 +171,8 @@ static sd_bus* bus_free(sd_bus *b) {
         assert(b);
         assert(!b->track_queue);
         assert(!b->tracks);
+        assert(!b->track_names);
+        assert(!b->track_slot);
 
         b->state = BUS_CLOSED;
 
@@ -190,6 +196,8 @@ static sd_bus* bus_free(sd_bus *b) {
         bus_close_io_fds(b);
         bus_close_inotify_fd(b);
 
+        hashmap_free(b->creds_cache);
+
         free(b->label);
         free(b->groups);
         free(b->rbuffer);
@@ -243,12 +251,14 @@ _public_ int sd_bus_new(sd_bus **ret) {
                 .input_fd = -1,
                 .output_fd = -1,
                 .inotify_fd = -1,
+                .peer_pidfd = -1,
                 .message_version = 1,
                 .creds_mask = SD_BUS_CREDS_WELL_KNOWN_NAMES|SD_BUS_CREDS_UNIQUE_NAME,
                 .accept_fd = true,
                 .original_pid = getpid_cached(),
                 .n_groups = (size_t) -1,
                 .close_on_exit = true,
+                .negotiate_gvariant = getenv_bool_secure("SYSTEMD_BUS_GVARIANT") > 0,
         };
 
         /* We guarantee that wqueue always has space for at least one entry */
@@ -393,7 +403,13 @@ _public_ int sd_bus_set_trusted(sd_bus *bus, int b) {
         assert_return(bus->state == BUS_UNSET, -EPERM);
         assert_return(!bus_pid_changed(bus), -ECHILD);
 
+        if (bus->trusted == !!b)
+                return 0;
+
         bus->trusted = !!b;
+
+        /* The cached introspection data depends on this, flush it */
+        bus_flush_introspection(bus);
         return 0;
 }
 
@@ -1769,18 +1785,10 @@ int bus_seal_synthetic_message(sd_bus *b, sd_bus_message *m) {
         return sd_bus_message_seal(m, 0xFFFFFFFFULL, 0);
 }
 
-static int bus_write_message(sd_bus *bus, sd_bus_message *m, size_t *idx) {
-        int r;
-
-        assert(bus);
+static void bus_log_message_sent(sd_bus_message *m) {
         assert(m);
 
-        r = bus_socket_write_message(bus, m, idx);
-        if (r <= 0)
-                return r;
-
-        if (*idx >= BUS_MESSAGE_SIZE(m))
-                log_debug("Sent message type=%s sender=%s destination=%s path=%s interface=%s member=%s cookie=%" PRIu64 " reply_cookie=%" PRIu64 " signature=%s error-name=%s error-message=%s",
+        log_debug("Sent message type=%s sender=%s destination=%s path=%s interface=%s member=%s cookie=%" PRIu64 " reply_cookie=%" PRIu64 " signature=%s error-name=%s error-message=%s",
                           bus_message_type_to_string(m->header->type),
                           strna(sd_bus_message_get_sender(m)),
                           strna(sd_bus_message_get_destination(m)),
@@ -1792,6 +1800,20 @@ static int bus_write_message(sd_bus *bus, sd_bus_message *m, size_t *idx) {
                           strna(m->root_container.signature),
                           strna(m->error.name),
                           strna(m->error.message));
+}
+
+static int bus_write_message(sd_bus *bus, sd_bus_message *m, size_t *idx) {
+        int r;
+
+        assert(bus);
+        assert(m);
+
+        r = bus_socket_write_message(bus, m, idx);
+        if (r <= 0)
+                return r;
+
+        if (*idx >= BUS_MESSAGE_SIZE(m))
+                bus_log_message_sent(m);
 
         return r;
 }
@@ -1803,28 +1825,28 @@ static int dispatch_wqueue(sd_bus *bus) {
         assert(IN_SET(bus->state, BUS_RUNNING, BUS_HELLO));
 
         while (bus->wqueue_size > 0) {
+                size_t n = 0;
 
-                r = bus_write_message(bus, bus->wqueue[0], &bus->windex);
+                /* Write as many queued messages at once as possible. The index then points into the
+                 * concatenation of the queued messages. */
+                r = bus_socket_write_messages(bus, bus->wqueue, bus->wqueue_size, &bus->windex);
                 if (r < 0)
                         return r;
-                else if (r == 0)
+                if (r == 0)
                         /* Didn't do anything this time */
                         return ret;
-                else if (bus->windex >= BUS_MESSAGE_SIZE(bus->wqueue[0])) {
-                        /* Fully written. Let's drop the entry from
-                         * the queue.
-                         *
-                         * This isn't particularly optimized, but
-                         * well, this is supposed to be our worst-case
-                         * buffer only, and the socket buffer is
-                         * supposed to be our primary buffer, and if
-                         * it got full, then all bets are off
-                         * anyway. */
-
-                        bus->wqueue_size--;
-                        bus_message_unref_queued(bus->wqueue[0], bus);
-                        memmove(bus->wqueue, bus->wqueue + 1, sizeof(sd_bus_message*) * bus->wqueue_size);
-                        bus->windex = 0;
+
+                /* Drop all fully written entries from the queue */
+                while (n < bus->wqueue_size && bus->windex >= BUS_MESSAGE_SIZE(bus->wqueue[n])) {
+                        bus->windex -= BUS_MESSAGE_SIZE(bus->wqueue[n]);
+                        bus_log_message_sent(bus->wqueue[n]);
+                        bus_message_unref_queued(bus->wqueue[n], bus);
+                        n++;
+                }
+
+                if (n > 0) {
+                        bus->wqueue_size -= n;
+                        memmove(bus->wqueue, bus->wqueue + n, sizeof(sd_bus_message*) * bus->wqueue_size);
 
                         ret = 1;
                 }
@@ -2281,6 +2303,171 @@ fail:
         return sd_bus_error_set_errno(error, r);
 }
 
+void bus_call_done_many(BusCall *calls, size_t n) {
+        size_t k;
+
+        assert(calls || n == 0);
+
+        for (k = 0; k < n; k++) {
+                calls[k].call = sd_bus_message_unref(calls[k].call);
+                calls[k].reply = sd_bus_message_unref(calls[k].reply);
+                sd_bus_error_free(&calls[k].error);
+        }
+}
+
+int bus_call_many(sd_bus *bus, BusCall *calls, size_t n, uint64_t usec) {
+        _cleanup_free_ uint64_t *cookies = NULL;
+        size_t i, k, n_pending = 0;
+        usec_t timeout = 0;
+        int r;
+
+        /* Like sd_bus_call(), but for a number of method calls at once: all of them are sent right away,
+         * and only then we wait for the replies, so that they take a single round trip instead of one each.
+         * The outcome of each call is stored in its entry of calls[], as reply or as error. Only
+         * failures that affect all calls, such as a disconnect, are returned. Like sd_bus_call() this does
+         * not dispatch any other incoming messages, they are left in the read queue for later. Entries
+         * without a call are skipped. */
+
+        assert(bus);
+        assert(calls || n == 0);
+
+        assert_return(bus = bus_resolve(bus), -ENOPKG);
+        assert_return(!bus_pid_changed(bus), -ECHILD);
+
+        if (n == 0)
+                return 0;
+
+        if (!BUS_IS_OPEN(bus->state))
+                return -ENOTCONN;
+
+        r = bus_ensure_running(bus);
+        if (r < 0)
+                return r;
+
+        cookies = new0(uint64_t, n);
+        if (!cookies)
+                return -ENOMEM;
+
+        i = bus->rqueue_size;
+
+        for (k = 0; k < n; k++) {
+                _cleanup_(sd_bus_message_unrefp) sd_bus_message *c = NULL;
+
+                if (!calls[k].call)
+                        continue;
+
+                c = sd_bus_message_ref(calls[k].call);
+
+                assert(c->header->type == SD_BUS_MESSAGE_METHOD_CALL);
+                assert(!(c->header->flags & BUS_MESSAGE_NO_REPLY_EXPECTED));
+                assert(!calls[k].reply);
+                assert(!bus_error_is_dirty(&calls[k].error));
+
+                r = bus_seal_message(bus, c, usec);
+                if (r >= 0)
+                        r = bus_remarshal_message(bus, &c);
+                if (r >= 0)
+                        r = sd_bus_send(bus, c, cookies + k);
+                if (r < 0) {
+                        cookies[k] = 0;
+                        (void) sd_bus_error_set_errno(&calls[k].error, r);
+                        continue;
+                }
+
+                timeout = MAX(timeout, calc_elapse(bus, c->timeout));
+                n_pending++;
+        }
+
+        while (n_pending > 0) {
+                usec_t left;
+
+                while (i < bus->rqueue_size) {
+                        _cleanup_(sd_bus_message_unrefp) sd_bus_message *incoming = NULL;
+
+                        for (k = 0; k < n; k++)
+                                if (cookies[k] != 0 && bus->rqueue[i]->reply_cookie == cookies[k])
+                                        break;
+                        if (k >= n) {
+                                /* Not a reply to one of ours, leave it for later dispatching */
+                                i++;
+                                continue;
+                        }
+
+                        incoming = sd_bus_message_ref(bus->rqueue[i]);
+                        rqueue_drop_one(bus, i);
+                        log_debug_bus_message(incoming);
+
+                        cookies[k] = 0;
+                        n_pending--;
+
+                        if (incoming->header->type == SD_BUS_MESSAGE_METHOD_RETURN) {
+                                if (incoming->n_fds <= 0 || bus->accept_fd)
+                                        calls[k].reply = TAKE_PTR(incoming);
+                                else
+                                        (void) sd_bus_error_setf(&calls[k].error, SD_BUS_ERROR_INCONSISTENT_MESSAGE, "Reply message contained file descriptors which I couldn't accept. Sorry.");
+                        } else if (incoming->header->type == SD_BUS_MESSAGE_METHOD_ERROR)
+                                (void) sd_bus_error_copy(&calls[k].error, &incoming->error);
+                        else
+                                (void) sd_bus_error_set_errno(&calls[k].error, EIO);
+                }
+
+                if (n_pending == 0)
+                        break;
+
+                r = bus_read_message(bus);
+                if (r < 0) {
+                        if (ERRNO_IS_DISCONNECT(r)) {
+                                bus_enter_closing(bus);
+                                r = -ECONNRESET;
+                        }
+
+                        goto fail;
+                }
+                if (r > 0)
+                        continue;
+
+                if (timeout > 0) {
+                        usec_t t;
+
+                        t = now(CLOCK_MONOTONIC);
+                        if (t >= timeout) {
+                                r = -ETIMEDOUT;
+                                goto fail;
+                        }
+
+                        left = timeout - t;
+                } else
+                        left = (uint64_t) -1;
+
+                r = bus_poll(bus, true, left);
+                if (r < 0)
+                        goto fail;
+                if (r == 0) {
+                        r = -ETIMEDOUT;
+                        goto fail;
+                }
+
+                r = dispatch_wqueue(bus);
+                if (r < 0) {
+                        if (ERRNO_IS_DISCONNECT(r)) {
+                                bus_enter_closing(bus);
+                                r = -ECONNRESET;
+                        }
+
+                        goto fail;
+                }
+        }
+
+        return 0;
+
+fail:
+        for (k = 0; k < n; k++)
+                if (cookies[k] != 0)
+                        (void) sd_bus_error_set_errno(&calls[k].error, r);
+
+        return r;
+}
+
 _public_ int sd_bus_get_fd(sd_bus *bus) {
         assert_return(bus, -EINVAL);
         assert_return(bus = bus_resolve(bus), -ENOPKG);
@@ -2735,6 +2922,8 @@ static int process_message(sd_bus *bus, sd_bus_message *m) {
         if (r != 0)
                 goto finish;
 
+        bus_creds_cache_process(bus, m);
+
         r = process_reply(bus, m);
         if (r != 0)
                 goto finish;
@@ -12,16 +12,19 @@
 #include "def.h"
 #include "fd-util.h"
 #include "missing_resource.h"
+#include "strv.h"
 #include "time-util.h"
 #include "util.h"
 
 #define MAX_SIZE (2*1024*1024)
+#define N_UNITS 4096U
 
 static usec_t arg_loop_usec = 100 * USEC_PER_MSEC;
 
 typedef enum Type {
         TYPE_LEGACY,
         TYPE_DIRECT,
+        TYPE_GVARIANT,
 } Type;
 
 static void server(sd_bus *b, size_t *result) {
@@ -156,9 +159,11 @@ static void client_chart(Type type, const char *address, const char *server_name
         r = sd_bus_new(&b);
         assert_se(r >= 0);
 
-        if (type == TYPE_DIRECT) {
+        if (IN_SET(type, TYPE_DIRECT, TYPE_GVARIANT)) {
                 r = sd_bus_set_fd(b, fd, fd);
                 assert_se(r >= 0);
+
+                b->negotiate_gvariant = type == TYPE_GVARIANT;
         } else {
                 r = sd_bus_set_address(b, address);
                 assert_se(r >= 0);
@@ -173,6 +178,8 @@ static void client_chart(Type type, const char *address, const char *server_name
         r = sd_bus_call_method(b, server_name, "/", "benchmark.server", "Ping", NULL, NULL, NULL);
         assert_se(r >= 0);
 
+        assert_se(b->can_gvariant == (type == TYPE_GVARIANT));
+
         switch (type) {
         case TYPE_LEGACY:
                 printf("SIZE\tLEGACY\n");
@@ -180,6 +187,9 @@ static void client_chart(Type type, const char *address, const char *server_name
         case TYPE_DIRECT:
                 printf("SIZE\tDIRECT\n");
                 break;
+        case TYPE_GVARIANT:
+                printf("SIZE\tGVARIANT\n");
+                break;
         }
 
         for (csize = 1; csize <= MAX_SIZE; csize *= 2) {
@@ -206,10 +216,84 @@ static void client_chart(Type type, const char *address, const char *server_name
         sd_bus_unref(b);
 }
 
+static void marshal_units(sd_bus *b, char **names) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+        const char *id, *description, *load, *active, *sub, *following, *path, *job_type, *job_path;
+        uint32_t job_id;
+        unsigned n = 0;
+        char **i;
+
+        /* A reply shaped like the one of ListUnits() */
+        assert_se(sd_bus_message_new_method_call(b, &m, NULL, "/", "benchmark.server", "Units") >= 0);
+        assert_se(sd_bus_message_open_container(m, 'a', "(ssssssouso)") >= 0);
+        STRV_FOREACH(i, names)
+                assert_se(sd_bus_message_append(m, "(ssssssouso)",
+                                                *i, "Some unit", "loaded", "active", "running", "",
+                                                "/org/freedesktop/systemd1/unit/some_2eservice",
+                                                0, "", "/") >= 0);
+        assert_se(sd_bus_message_close_container(m) >= 0);
+        assert_se(sd_bus_message_seal(m, 1, 0) >= 0);
+
+        assert_se(sd_bus_message_enter_container(m, 'a', "(ssssssouso)") > 0);
+        while (sd_bus_message_read(m, "(ssssssouso)",
+                                   &id, &description, &load, &active, &sub, &following,
+                                   &path, &job_id, &job_type, &job_path) > 0)
+                n++;
+        assert_se(sd_bus_message_exit_container(m) >= 0);
+
+        assert_se(n == strv_length(names));
+}
+
+static void marshal_strv(sd_bus *b, char **names) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+        _cleanup_strv_free_ char **l = NULL;
+
+        assert_se(sd_bus_message_new_method_call(b, &m, NULL, "/", "benchmark.server", "Strv") >= 0);
+        assert_se(sd_bus_message_append_strv(m, names) >= 0);
+        assert_se(sd_bus_message_seal(m, 1, 0) >= 0);
+
+        assert_se(sd_bus_message_read_strv(m, &l) > 0);
+        assert_se(strv_equal(l, names));
+}
+
+static void benchmark_marshal(sd_bus *b, Type type) {
+        _cleanup_strv_free_ char **names = NULL;
+        usec_t t;
+        unsigned n;
+
+        /* Builds and parses messages locally, without involving any socket, to measure the marshalling
+         * code alone. */
+
+        for (unsigned k = 0; k < N_UNITS; k++)
+                assert_se(strv_extendf(&names, "unit-%u.service", k) >= 0);
+
+        /* New messages are marshalled in the format of the connection */
+        b->message_version = type == TYPE_GVARIANT ? 2 : 1;
+
+        printf("MESSAGE\t%s\n", type == TYPE_GVARIANT ? "GVARIANT" : "DBUS1");
+
+        t = now(CLOCK_MONOTONIC);
+        for (n = 0;; n++) {
+                marshal_units(b, names);
+                if (now(CLOCK_MONOTONIC) >= t + arg_loop_usec)
+                        break;
+        }
+        printf("a(ssssssouso)\t%u\n", (unsigned) ((n * USEC_PER_SEC) / arg_loop_usec));
+
+        t = now(CLOCK_MONOTONIC);
+        for (n = 0;; n++) {
+                marshal_strv(b, names);
+                if (now(CLOCK_MONOTONIC) >= t + arg_loop_usec)
+                        break;
+        }
+        printf("as\t%u\n", (unsigned) ((n * USEC_PER_SEC) / arg_loop_usec));
+}
+
 int main(int argc, char *argv[]) {
         enum {
                 MODE_BISECT,
                 MODE_CHART,
+                MODE_MARSHAL,
         } mode = MODE_BISECT;
         Type type = TYPE_LEGACY;
         int i, pair[2] = { -1, -1 };
@@ -232,6 +316,12 @@ int main(int argc, char *argv[]) {
                 } else if (streq(argv[i], "direct")) {
                         type = TYPE_DIRECT;
                         continue;
+                } else if (streq(argv[i], "gvariant")) {
+                        type = TYPE_GVARIANT;
+                        continue;
+                } else if (streq(argv[i], "marshal")) {
+                        mode = MODE_MARSHAL;
+                        continue;
                 }
 
                 assert_se(parse_sec(argv[i], &arg_loop_usec) >= 0);
@@ -239,6 +329,10 @@ int main(int argc, char *argv[]) {
 
         assert_se(arg_loop_usec > 0);
 
+        /* Doesn't need a peer, hence use a direct connection, which never gets connected */
+        if (mode == MODE_MARSHAL && type != TYPE_GVARIANT)
+                type = TYPE_DIRECT;
+
         if (type == TYPE_LEGACY) {
                 const char *e;
 
@@ -252,7 +346,7 @@ int main(int argc, char *argv[]) {
         r = sd_bus_new(&b);
         assert_se(r >= 0);
 
-        if (type == TYPE_DIRECT) {
+        if (IN_SET(type, TYPE_DIRECT, TYPE_GVARIANT)) {
                 assert_se(socketpair(AF_UNIX, SOCK_STREAM, 0, pair) >= 0);
 
                 r = sd_bus_set_fd(b, pair[0], pair[0]);
@@ -260,6 +354,8 @@ int main(int argc, char *argv[]) {
 
                 r = sd_bus_set_server(b, true, SD_ID128_NULL);
                 assert_se(r >= 0);
+
+                b->negotiate_gvariant = type == TYPE_GVARIANT;
         } else {
                 r = sd_bus_set_address(b, address);
                 assert_se(r >= 0);
@@ -271,7 +367,16 @@ int main(int argc, char *argv[]) {
         r = sd_bus_start(b);
         assert_se(r >= 0);
 
-        if (type != TYPE_DIRECT) {
+        if (mode == MODE_MARSHAL) {
+                benchmark_marshal(b, type);
+
+                safe_close(pair[1]);
+                sd_bus_unref(b);
+
+                return 0;
+        }
+
+        if (type == TYPE_LEGACY) {
                 r = sd_bus_get_unique_name(b, &unique);
                 assert_se(r >= 0);
 
@@ -301,6 +406,9 @@ int main(int argc, char *argv[]) {
                 case MODE_CHART:
                         client_chart(type, address, server_name, pair[1]);
                         break;
+
+                default:
+                        assert_not_reached("Unexpected mode");
                 }
 
                 _exit(EXIT_SUCCESS);
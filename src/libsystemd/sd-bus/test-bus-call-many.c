@@ -0,0 +1,154 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <pthread.h>
+#include <sys/socket.h>
+
+#include "sd-bus.h"
+
+#include "bus-internal.h"
+#include "fd-util.h"
+#include "log.h"
+#include "macro.h"
+#include "string-util.h"
+#include "tests.h"
+
+#define N_CALLS 32U
+
+static void *server(void *p) {
+        sd_bus_message *calls[N_CALLS] = {};
+        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
+        int *fd = p;
+        size_t n = 0, k;
+        bool quit = false;
+        sd_id128_t id;
+
+        assert_se(sd_id128_randomize(&id) >= 0);
+
+        assert_se(sd_bus_new(&bus) >= 0);
+        assert_se(sd_bus_set_fd(bus, *fd, *fd) >= 0);
+        assert_se(sd_bus_set_server(bus, 1, id) >= 0);
+        assert_se(sd_bus_start(bus) >= 0);
+
+        while (!quit) {
+                _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+                int r;
+
+                r = sd_bus_process(bus, &m);
+                assert_se(r >= 0);
+                if (r == 0) {
+                        assert_se(sd_bus_wait(bus, (uint64_t) -1) >= 0);
+                        continue;
+                }
+                if (!m)
+                        continue;
+
+                if (sd_bus_message_is_method_call(m, "org.freedesktop.systemd.test", "Exit")) {
+                        assert_se(sd_bus_reply_method_return(m, NULL) >= 0);
+                        quit = true;
+                        continue;
+                }
+
+                assert_se(sd_bus_message_is_method_call(m, "org.freedesktop.systemd.test", NULL));
+                assert_se(n < N_CALLS);
+                calls[n++] = TAKE_PTR(m);
+                if (n < N_CALLS - 1)
+                        continue;
+
+                /* All calls are there before the first reply is sent, i.e. they are not issued one by one. Send
+                 * a signal first, which the caller has to leave alone, then reply in reverse order. */
+                assert_se(sd_bus_emit_signal(bus, "/", "org.freedesktop.systemd.test", "Signal", NULL) >= 0);
+
+                for (k = n; k > 0; k--) {
+                        sd_bus_message *c = calls[k - 1];
+                        uint32_t u;
+
+                        assert_se(sd_bus_message_read(c, "u", &u) >= 0);
+
+                        if (sd_bus_message_is_method_call(c, NULL, "Echo"))
+                                assert_se(sd_bus_reply_method_return(c, "u", u) >= 0);
+                        else {
+                                assert_se(sd_bus_message_is_method_call(c, NULL, "Fail"));
+                                assert_se(sd_bus_reply_method_errorf(c, "org.freedesktop.systemd.test.Failed", "Call %" PRIu32 " failed", u) >= 0);
+                        }
+
+                        calls[k - 1] = sd_bus_message_unref(c);
+                }
+
+                n = 0;
+        }
+
+        return NULL;
+}
+
+static void test_call_many(int fd) {
+        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+        BusCall calls[N_CALLS] = {};
+        size_t k;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(sd_bus_new(&bus) >= 0);
+        assert_se(sd_bus_set_fd(bus, fd, fd) >= 0);
+        assert_se(sd_bus_start(bus) >= 0);
+
+        /* Nothing to do */
+        assert_se(bus_call_many(bus, NULL, 0, 0) == 0);
+
+        /* Every third call fails, and the last entry is left empty and hence skipped */
+        for (k = 0; k < N_CALLS - 1; k++) {
+                assert_se(sd_bus_message_new_method_call(bus, &calls[k].call, NULL, "/",
+                                                         "org.freedesktop.systemd.test",
+                                                         k % 3 == 0 ? "Fail" : "Echo") >= 0);
+                assert_se(sd_bus_message_append(calls[k].call, "u", (uint32_t) k) >= 0);
+        }
+
+        assert_se(bus_call_many(bus, calls, N_CALLS, 0) == 0);
+
+        for (k = 0; k < N_CALLS - 1; k++) {
+                _cleanup_free_ char *t = NULL;
+                uint32_t u;
+
+                if (k % 3 == 0) {
+                        assert_se(!calls[k].reply);
+                        assert_se(sd_bus_error_has_name(&calls[k].error, "org.freedesktop.systemd.test.Failed"));
+                        assert_se(asprintf(&t, "Call %zu failed", k) >= 0);
+                        assert_se(streq(calls[k].error.message, t));
+                        continue;
+                }
+
+                assert_se(!sd_bus_error_is_set(&calls[k].error));
+                assert_se(calls[k].reply);
+                assert_se(sd_bus_message_read(calls[k].reply, "u", &u) >= 0);
+                assert_se(u == k);
+        }
+
+        assert_se(!calls[N_CALLS - 1].reply);
+        assert_se(!sd_bus_error_is_set(&calls[N_CALLS - 1].error));
+
+        bus_call_done_many(calls, N_CALLS);
+
+        /* The signal that came in between was not dispatched, but is still queued */
+        assert_se(sd_bus_process(bus, &m) > 0);
+        assert_se(m);
+        assert_se(sd_bus_message_is_signal(m, "org.freedesktop.systemd.test", "Signal"));
+
+        assert_se(sd_bus_call_method(bus, NULL, "/", "org.freedesktop.systemd.test", "Exit", NULL, NULL, NULL) >= 0);
+}
+
+int main(int argc, char *argv[]) {
+        int fds[2];
+        pthread_t s;
+
+        test_setup_logging(LOG_DEBUG);
+
+        assert_se(socketpair(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0, fds) >= 0);
+
+        assert_se(pthread_create(&s, NULL, server, fds) == 0);
+
+        test_call_many(fds[1]);
+
+        assert_se(pthread_join(s, NULL) == 0);
+
+        return 0;
+}
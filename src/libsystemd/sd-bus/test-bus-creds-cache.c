@@ -0,0 +1,143 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "sd-bus.h"
+
+#include "bus-control.h"
+#include "bus-creds.h"
+#include "bus-internal.h"
+#include "fd-util.h"
+#include "process-util.h"
+#include "tests.h"
+
+static sd_bus_creds *creds_new_euid(uid_t euid) {
+        sd_bus_creds *c;
+
+        assert_se(c = bus_creds_new());
+        c->euid = euid;
+        c->mask |= SD_BUS_CREDS_EUID;
+
+        return c;
+}
+
+static void test_creds_cache_hit(sd_bus *bus) {
+        _cleanup_(sd_bus_creds_unrefp) sd_bus_creds *c = NULL, *d = NULL;
+        pid_t pid = 0;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(d = bus_creds_new());
+        assert_se(bus_creds_cache_get(bus, ":1.1", SD_BUS_CREDS_PID|SD_BUS_CREDS_EUID, _SD_BUS_CREDS_ALL, d, &pid) == 0);
+        d = sd_bus_creds_unref(d);
+
+        c = creds_new_euid(4711);
+        bus_creds_cache_put(bus, ":1.1", SD_BUS_CREDS_PID|SD_BUS_CREDS_EUID, getpid_cached(), c);
+
+        assert_se(d = bus_creds_new());
+        assert_se(bus_creds_cache_get(bus, ":1.1", SD_BUS_CREDS_PID|SD_BUS_CREDS_EUID, _SD_BUS_CREDS_ALL, d, &pid) > 0);
+        assert_se(pid == getpid_cached());
+        assert_se(d->pid == getpid_cached());
+        assert_se(d->euid == 4711);
+        assert_se((d->mask & (SD_BUS_CREDS_PID|SD_BUS_CREDS_EUID)) == (SD_BUS_CREDS_PID|SD_BUS_CREDS_EUID));
+        d = sd_bus_creds_unref(d);
+
+        /* Nothing was asked about the security label yet */
+        assert_se(d = bus_creds_new());
+        assert_se(bus_creds_cache_get(bus, ":1.1", SD_BUS_CREDS_SELINUX_CONTEXT, _SD_BUS_CREDS_ALL, d, &pid) == 0);
+        d = sd_bus_creds_unref(d);
+
+        /* Other peers are not affected */
+        assert_se(d = bus_creds_new());
+        assert_se(bus_creds_cache_get(bus, ":1.2", SD_BUS_CREDS_EUID, _SD_BUS_CREDS_ALL, d, &pid) == 0);
+}
+
+static void test_creds_cache_pid_gone(sd_bus *bus) {
+        _cleanup_(sd_bus_creds_unrefp) sd_bus_creds *c = NULL, *d = NULL;
+        pid_t pid, p = 0;
+
+        log_info("/* %s */", __func__);
+
+        /* The cached PID must not be handed out anymore once the peer process is gone */
+
+        pid = fork();
+        assert_se(pid >= 0);
+        if (pid == 0)
+                _exit(EXIT_SUCCESS);
+
+        c = creds_new_euid(4711);
+        bus_creds_cache_put(bus, ":1.3", SD_BUS_CREDS_PID|SD_BUS_CREDS_EUID, pid, c);
+
+        assert_se(d = bus_creds_new());
+        assert_se(bus_creds_cache_get(bus, ":1.3", SD_BUS_CREDS_PID, _SD_BUS_CREDS_ALL, d, &p) > 0);
+        assert_se(p == pid);
+        d = sd_bus_creds_unref(d);
+
+        assert_se(wait_for_terminate(pid, NULL) >= 0);
+
+        assert_se(d = bus_creds_new());
+        assert_se(bus_creds_cache_get(bus, ":1.3", SD_BUS_CREDS_PID, _SD_BUS_CREDS_ALL, d, &p) == 0);
+        d = sd_bus_creds_unref(d);
+
+        /* … and the entry is dropped altogether */
+        assert_se(d = bus_creds_new());
+        assert_se(bus_creds_cache_get(bus, ":1.3", SD_BUS_CREDS_EUID, _SD_BUS_CREDS_ALL, d, &p) == 0);
+}
+
+static void name_owner_changed(sd_bus *bus, const char *sender, const char *name, const char *old_owner, const char *new_owner) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+
+        assert_se(sd_bus_message_new_signal(bus, &m, "/org/freedesktop/DBus", "org.freedesktop.DBus", "NameOwnerChanged") >= 0);
+        assert_se(sd_bus_message_set_sender(m, sender) >= 0);
+        assert_se(sd_bus_message_append(m, "sss", name, old_owner, new_owner) >= 0);
+        assert_se(sd_bus_message_seal(m, 1, 0) >= 0);
+
+        bus_creds_cache_process(bus, m);
+}
+
+static void test_creds_cache_name_owner_changed(sd_bus *bus) {
+        _cleanup_(sd_bus_creds_unrefp) sd_bus_creds *c = NULL, *d = NULL;
+        pid_t pid = 0;
+
+        log_info("/* %s */", __func__);
+
+        c = creds_new_euid(4711);
+        bus_creds_cache_put(bus, ":1.4", SD_BUS_CREDS_EUID, 0, c);
+
+        /* Only the bus driver may tell us that a peer is gone, and only the unique name counts */
+        name_owner_changed(bus, ":1.5", ":1.4", ":1.4", "");
+        name_owner_changed(bus, "org.freedesktop.DBus", "org.example.Foo", ":1.4", "");
+        name_owner_changed(bus, "org.freedesktop.DBus", ":1.4", "", ":1.4");
+
+        assert_se(d = bus_creds_new());
+        assert_se(bus_creds_cache_get(bus, ":1.4", SD_BUS_CREDS_EUID, _SD_BUS_CREDS_ALL, d, &pid) > 0);
+        assert_se(d->euid == 4711);
+        d = sd_bus_creds_unref(d);
+
+        name_owner_changed(bus, "org.freedesktop.DBus", ":1.4", ":1.4", "");
+
+        assert_se(d = bus_creds_new());
+        assert_se(bus_creds_cache_get(bus, ":1.4", SD_BUS_CREDS_EUID, _SD_BUS_CREDS_ALL, d, &pid) == 0);
+}
+
+int main(int argc, char *argv[]) {
+        _cleanup_(sd_bus_unrefp) sd_bus *bus = NULL;
+        _cleanup_close_pair_ int pair[2] = { -1, -1 };
+
+        test_setup_logging(LOG_DEBUG);
+
+        /* The cache is never consulted for anything that goes over the wire, hence a connection that never
+         * gets past authentication is good enough */
+        assert_se(socketpair(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0, pair) >= 0);
+        assert_se(sd_bus_new(&bus) >= 0);
+        assert_se(sd_bus_set_fd(bus, pair[0], pair[0]) >= 0);
+        TAKE_FD(pair[0]);
+        assert_se(sd_bus_start(bus) >= 0);
+
+        test_creds_cache_hit(bus);
+        test_creds_cache_pid_gone(bus);
+        test_creds_cache_name_owner_changed(bus);
+
+        return 0;
+}
@@ -1,8 +1,12 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
-#include "bus-introspect.h"
+#include "alloc-util.h"
+#include "bus-objects.h"
 #include "log.h"
+#include "stdio-util.h"
+#include "string-util.h"
 #include "tests.h"
+#include "time-util.h"
 
 #include "test-vtable-data.h"
 
@@ -23,6 +27,63 @@ static void test_manual_introspection(const sd_bus_vtable vtable[]) {
         fputs("\n", stdout);
 }
 
+static int find_unit(sd_bus *bus, const char *path, const char *interface, void *userdata, void **found, sd_bus_error *error) {
+        *found = userdata;
+        return 1;
+}
+
+static void test_introspect_path_benchmark(unsigned n) {
+        _cleanup_(sd_bus_unrefp) sd_bus *bus = NULL;
+        _cleanup_free_ char *first = NULL;
+        char a[FORMAT_TIMESPAN_MAX], b[FORMAT_TIMESPAN_MAX];
+        char path[STRLEN("/org/freedesktop/systemd1/unit/unit_") + DECIMAL_STR_MAX(unsigned)];
+        struct context c = {};
+        struct node *node;
+        usec_t start, cached, uncached;
+        unsigned i;
+
+        log_info("/* %s(%u) */", __func__, n);
+
+        /* Introspect many objects sharing the same fallback vtables, the way PID1 exports its units */
+
+        assert_se(sd_bus_new(&bus) >= 0);
+        assert_se(sd_bus_add_fallback_vtable(bus, NULL, "/org/freedesktop/systemd1/unit", "org.foo.Unit",
+                                             test_vtable_2, find_unit, &c) >= 0);
+        assert_se(sd_bus_add_fallback_vtable(bus, NULL, "/org/freedesktop/systemd1/unit", "org.foo.Service",
+                                             test_vtable_2, find_unit, &c) >= 0);
+        assert_se(node = hashmap_get(bus->nodes, "/org/freedesktop/systemd1/unit"));
+
+        start = now(CLOCK_MONOTONIC);
+        for (i = 0; i < n; i++) {
+                _cleanup_free_ char *s = NULL;
+
+                xsprintf(path, "/org/freedesktop/systemd1/unit/unit_%u", i);
+                assert_se(introspect_path(bus, path, node, true, true, NULL, &s, NULL) == 1);
+
+                /* The vtables are the same for all units, hence so is the XML */
+                if (!first)
+                        first = TAKE_PTR(s);
+                else
+                        assert_se(streq(first, s));
+        }
+        cached = now(CLOCK_MONOTONIC) - start;
+
+        /* For comparison, generate the interface XML from scratch each time, as we did before it was cached */
+        start = now(CLOCK_MONOTONIC);
+        for (i = 0; i < n; i++) {
+                _cleanup_free_ char *x = NULL, *y = NULL;
+
+                assert_se(introspect_interface_to_string(test_vtable_2, false, &x) >= 0);
+                assert_se(introspect_interface_to_string(test_vtable_2, false, &y) >= 0);
+        }
+        uncached = now(CLOCK_MONOTONIC) - start;
+
+        log_info("%u paths introspected in %s, generating their interfaces alone takes %s without caching",
+                 n,
+                 format_timespan(a, sizeof(a), cached, 1),
+                 format_timespan(b, sizeof(b), uncached, 1));
+}
+
 int main(int argc, char *argv[]) {
         test_setup_logging(LOG_DEBUG);
 
@@ -31,5 +92,7 @@ int main(int argc, char *argv[]) {
         test_manual_introspection(test_vtable_deprecated);
         test_manual_introspection((const sd_bus_vtable *) vtable_format_221);
 
+        test_introspect_path_benchmark(slow_tests_enabled() ? 100000 : 1000);
+
         return 0;
 }
@@ -22,6 +22,7 @@
 #include "fd-util.h"
 #include "fileio.h"
 #include "log.h"
+#include "strv.h"
 #include "tests.h"
 #include "util.h"
 
@@ -105,6 +106,51 @@ static void test_bus_label_escape(void) {
         test_bus_label_escape_one(":1", "_3a1");
 }
 
+static void test_bus_message_strv(sd_bus *bus) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+        _cleanup_strv_free_ char **l = NULL, **k = NULL;
+        char **strv = STRV_MAKE("", "a", "bc", "def", "ghij", "", "klmnopq");
+        const char *x;
+        uint64_t u64;
+        char **i;
+
+        /* The bulk string array functions must produce and accept the same as doing it element by element */
+
+        assert_se(sd_bus_message_new_method_call(bus, &m, "foobar.waldo", "/", "foobar.waldo", "Piep") >= 0);
+
+        assert_se(sd_bus_message_append(m, "y", 1) >= 0);
+        assert_se(sd_bus_message_append_strv(m, strv) >= 0);
+        assert_se(sd_bus_message_append_strv(m, NULL) >= 0);
+        assert_se(sd_bus_message_append(m, "tas", UINT64_C(4711), 2, "uvw", "xyz") >= 0);
+        assert_se(sd_bus_message_seal(m, 4713, 0) >= 0);
+
+        assert_se(sd_bus_message_skip(m, "y") > 0);
+        assert_se(sd_bus_message_enter_container(m, 'a', "s") > 0);
+        STRV_FOREACH(i, strv) {
+                assert_se(sd_bus_message_read_basic(m, 's', &x) > 0);
+                assert_se(streq(x, *i));
+        }
+        assert_se(sd_bus_message_read_basic(m, 's', &x) == 0);
+        assert_se(sd_bus_message_exit_container(m) >= 0);
+
+        assert_se(sd_bus_message_rewind(m, true) >= 0);
+
+        assert_se(sd_bus_message_skip(m, "y") > 0);
+        assert_se(sd_bus_message_read_strv(m, &l) > 0);
+        assert_se(strv_equal(l, strv));
+        l = strv_free(l);
+        assert_se(sd_bus_message_read_strv(m, &l) > 0);
+        assert_se(strv_isempty(l));
+        assert_se(sd_bus_message_read(m, "t", &u64) > 0);
+        assert_se(u64 == 4711);
+
+        assert_se(k = strv_new("first"));
+        assert_se(bus_message_read_strv_extend(m, &k) > 0);
+        assert_se(strv_equal(k, STRV_MAKE("first", "uvw", "xyz")));
+
+        assert_se(sd_bus_message_at_end(m, true) > 0);
+}
+
 int main(int argc, char *argv[]) {
         _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL, *copy = NULL;
         int r, boolean;
@@ -413,6 +459,8 @@ int main(int argc, char *argv[]) {
         assert_se(streq(c, "ccc"));
         assert_se(streq(d, "3"));
 
+        test_bus_message_strv(bus);
+
         test_bus_label_escape();
         test_bus_path_encode();
         test_bus_path_encode_unique();
@@ -1,5 +1,6 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
+#include "alloc-util.h"
 #include "bus-match.h"
 #include "bus-message.h"
 #include "bus-slot.h"
@@ -7,7 +8,9 @@
 #include "log.h"
 #include "macro.h"
 #include "memory-util.h"
+#include "stdio-util.h"
 #include "tests.h"
+#include "time-util.h"
 
 static bool mask[32];
 
@@ -59,6 +62,76 @@ static int match_add(sd_bus_slot *slots, struct bus_match_node *root, const char
         return r;
 }
 
+static unsigned n_benchmark_hits = 0;
+
+static int benchmark_filter(sd_bus_message *m, void *userdata, sd_bus_error *ret_error) {
+        n_benchmark_hits++;
+        return 0;
+}
+
+static void test_match_benchmark(sd_bus *bus) {
+        struct bus_match_node root = {
+                .type = BUS_MATCH_ROOT,
+        };
+        _cleanup_free_ sd_bus_slot *slots = NULL;
+        unsigned n_matches = 3 * 4096, n_iterations = 10000;
+        usec_t t;
+
+        /* Mimics PID1 with lots of tracked units: one member, one path and one path_namespace match per
+         * unit. Dispatching a message should only trigger the handful of matching ones, and not get slower
+         * with the number of matches. */
+
+        slots = new0(sd_bus_slot, n_matches);
+        assert_se(slots);
+
+        for (unsigned i = 0; i < n_matches; i++) {
+                struct bus_match_component *components = NULL;
+                unsigned n_components = 0;
+                char match[STRLEN("path_namespace='/org/freedesktop/systemd1/unit/'") + DECIMAL_STR_MAX(unsigned)];
+
+                if (i % 3 == 0)
+                        xsprintf(match, "member='Member%u'", i / 3);
+                else if (i % 3 == 1)
+                        xsprintf(match, "path='/org/freedesktop/systemd1/unit/%u'", i / 3);
+                else
+                        xsprintf(match, "path_namespace='/org/freedesktop/systemd1/unit/%u'", i / 3);
+
+                assert_se(bus_match_parse(match, &components, &n_components) >= 0);
+
+                slots[i].match_callback.callback = benchmark_filter;
+                assert_se(bus_match_add(&root, components, n_components, &slots[i].match_callback) >= 0);
+                bus_match_parse_free(components, n_components);
+        }
+
+        for (unsigned k = 0; k < 2; k++) {
+                _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+
+                /* The first message hits one match of each kind, the second one only the namespace match */
+                assert_se(sd_bus_message_new_signal(bus, &m,
+                                                    k == 0 ? "/org/freedesktop/systemd1/unit/77" : "/org/freedesktop/systemd1/unit/77/sub",
+                                                    "org.freedesktop.systemd1.Unit",
+                                                    "Member77") >= 0);
+                assert_se(sd_bus_message_seal(m, 1, 0) >= 0);
+
+                n_benchmark_hits = 0;
+                t = now(CLOCK_MONOTONIC);
+                for (unsigned i = 0; i < n_iterations; i++)
+                        assert_se(bus_match_run(NULL, &root, m) == 0);
+                t = now(CLOCK_MONOTONIC) - t;
+
+                assert_se(n_benchmark_hits == n_iterations * (k == 0 ? 3 : 2));
+
+                log_info("%u matches, %u runs of %s: %.3f µs per run",
+                         n_matches, n_iterations, sd_bus_message_get_path(m), (double) t / n_iterations);
+        }
+
+        for (unsigned i = 0; i < n_matches; i++)
+                assert_se(bus_match_remove(&root, &slots[i].match_callback) > 0);
+
+        assert_se(!root.child);
+        bus_match_free(&root);
+}
+
 static void test_match_scope(const char *match, enum bus_match_scope scope) {
         struct bus_match_component *components = NULL;
         unsigned n_components = 0;
@@ -76,7 +149,7 @@ int main(int argc, char *argv[]) {
         _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
         _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
         enum bus_match_node_type i;
-        sd_bus_slot slots[19];
+        sd_bus_slot slots[21];
         int r;
 
         test_setup_logging(LOG_INFO);
@@ -105,6 +178,8 @@ int main(int argc, char *argv[]) {
         assert_se(match_add(slots, &root, "arg4has='pa'", 16) >= 0);
         assert_se(match_add(slots, &root, "arg4has='po'", 17) >= 0);
         assert_se(match_add(slots, &root, "arg4='pi'", 18) >= 0);
+        assert_se(match_add(slots, &root, "path_namespace='/'", 19) >= 0);
+        assert_se(match_add(slots, &root, "arg3namespace='prefix.four.five'", 20) >= 0);
 
         bus_match_dump(&root, 0);
 
@@ -114,7 +189,7 @@ int main(int argc, char *argv[]) {
 
         zero(mask);
         assert_se(bus_match_run(NULL, &root, m) == 0);
-        assert_se(mask_contains((unsigned[]) { 9, 8, 7, 5, 10, 12, 13, 14, 15, 16, 17 }, 11));
+        assert_se(mask_contains((unsigned[]) { 9, 8, 7, 5, 10, 12, 13, 14, 15, 16, 17, 19 }, 12));
 
         assert_se(bus_match_remove(&root, &slots[8].match_callback) >= 0);
         assert_se(bus_match_remove(&root, &slots[13].match_callback) >= 0);
@@ -123,7 +198,7 @@ int main(int argc, char *argv[]) {
 
         zero(mask);
         assert_se(bus_match_run(NULL, &root, m) == 0);
-        assert_se(mask_contains((unsigned[]) { 9, 5, 10, 12, 14, 7, 15, 16, 17 }, 9));
+        assert_se(mask_contains((unsigned[]) { 9, 5, 10, 12, 14, 7, 15, 16, 17, 19 }, 10));
 
         for (i = 0; i < _BUS_MATCH_NODE_TYPE_MAX; i++) {
                 char buf[32];
@@ -137,6 +212,8 @@ int main(int argc, char *argv[]) {
 
         bus_match_free(&root);
 
+        test_match_benchmark(bus);
+
         test_match_scope("interface='foobar'", BUS_MATCH_GENERIC);
         test_match_scope("", BUS_MATCH_GENERIC);
         test_match_scope("interface='org.freedesktop.DBus.Local'", BUS_MATCH_LOCAL);
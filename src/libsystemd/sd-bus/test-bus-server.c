@@ -6,11 +6,17 @@
 #include "sd-bus.h"
 
 #include "bus-internal.h"
+#include "bus-kernel.h"
 #include "bus-util.h"
 #include "log.h"
 #include "macro.h"
 #include "memory-util.h"
 
+#define LARGE_SIZE (2*1024*1024)
+#define N_PINGS 512U
+/* Too large for the socket buffer, but too small to be passed as memfd */
+#define FILL_SIZE (MEMFD_MIN_SIZE - 1)
+
 struct context {
         int fds[2];
 
@@ -19,6 +25,11 @@ struct context {
 
         bool client_anonymous_auth;
         bool server_anonymous_auth;
+
+        bool client_negotiate_gvariant;
+        bool server_negotiate_gvariant;
+
+        unsigned n_pings;
 };
 
 static void *server(void *p) {
@@ -35,6 +46,7 @@ static void *server(void *p) {
         assert_se(sd_bus_set_server(bus, 1, id) >= 0);
         assert_se(sd_bus_set_anonymous(bus, c->server_anonymous_auth) >= 0);
         assert_se(sd_bus_negotiate_fds(bus, c->server_negotiate_unix_fds) >= 0);
+        bus->negotiate_gvariant = c->server_negotiate_gvariant;
         assert_se(sd_bus_start(bus) >= 0);
 
         while (!quit) {
@@ -66,6 +78,8 @@ static void *server(void *p) {
                         assert_se((sd_bus_can_send(bus, 'h') >= 1) ==
                                   (c->server_negotiate_unix_fds && c->client_negotiate_unix_fds));
 
+                        assert_se(c->n_pings == N_PINGS);
+
                         r = sd_bus_message_new_method_return(m, &reply);
                         if (r < 0) {
                                 log_error_errno(r, "Failed to allocate return: %m");
@@ -74,6 +88,53 @@ static void *server(void *p) {
 
                         quit = true;
 
+                } else if (sd_bus_message_is_method_call(m, "org.freedesktop.systemd.test", "Ping")) {
+                        unsigned u;
+                        int fd;
+
+                        /* The pings arrive in a flood, hence many of them are read at once. Make sure they
+                         * arrive in order, and the fds end up with the right ones. */
+                        if (sd_bus_message_has_signature(m, "uh")) {
+                                assert_se(sd_bus_message_read(m, "uh", &u, &fd) >= 0);
+                                assert_se(u % 16 == 0);
+                                assert_se(fd >= 0);
+                        } else {
+                                assert_se(sd_bus_message_read(m, "u", &u) >= 0);
+                                assert_se(u % 16 != 0 || sd_bus_can_send(bus, 'h') <= 0);
+                        }
+
+                        assert_se(u == c->n_pings);
+                        c->n_pings++;
+
+                } else if (sd_bus_message_is_method_call(m, "org.freedesktop.systemd.test", "Fill")) {
+                        const void *data;
+                        size_t sz;
+
+                        assert_se(sd_bus_message_read_array(m, 'y', &data, &sz) >= 0);
+                        assert_se(sz == FILL_SIZE);
+                        assert_se(c->n_pings == 0);
+
+                } else if (sd_bus_message_is_method_call(m, "org.freedesktop.systemd.test", "Large")) {
+                        const void *data;
+                        size_t sz;
+
+                        /* Large bodies are passed as memfd if fd passing works in both directions */
+                        assert_se(bus->can_memfd_body ==
+                                  (c->server_negotiate_unix_fds && c->client_negotiate_unix_fds));
+
+                        assert_se(sd_bus_message_read_array(m, 'y', &data, &sz) >= 0);
+                        assert_se(sz == LARGE_SIZE);
+                        assert_se(((const uint8_t*) data)[0] == 'a');
+                        assert_se(((const uint8_t*) data)[sz - 1] == 'z');
+
+                        r = sd_bus_message_new_method_return(m, &reply);
+                        if (r < 0) {
+                                log_error_errno(r, "Failed to allocate return: %m");
+                                goto fail;
+                        }
+
+                        assert_se(sd_bus_message_append_array(reply, 'y', data, sz) >= 0);
+
                 } else if (sd_bus_message_is_method_call(m, NULL, NULL)) {
                         r = sd_bus_message_new_method_error(
                                         m,
@@ -109,14 +170,107 @@ static int client(struct context *c) {
         _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL, *reply = NULL;
         _cleanup_(sd_bus_unrefp) sd_bus *bus = NULL;
         _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+        _cleanup_free_ uint8_t *large = NULL;
+        bool can_send_fds;
+        uint64_t n_queued;
+        const void *data;
+        size_t sz;
         int r;
 
         assert_se(sd_bus_new(&bus) >= 0);
         assert_se(sd_bus_set_fd(bus, c->fds[1], c->fds[1]) >= 0);
         assert_se(sd_bus_negotiate_fds(bus, c->client_negotiate_unix_fds) >= 0);
         assert_se(sd_bus_set_anonymous(bus, c->client_anonymous_auth) >= 0);
+        bus->negotiate_gvariant = c->client_negotiate_gvariant;
         assert_se(sd_bus_start(bus) >= 0);
 
+        r = sd_bus_can_send(bus, 'h');
+        if (r < 0)
+                return log_error_errno(r, "Failed to connect: %m");
+        can_send_fds = r > 0;
+
+        /* Send something that does not fit into the socket buffer first, so that the pings pile up in
+         * the write queue behind it, and are written in batches, each ping with fds followed by plain
+         * ones. */
+        r = sd_bus_message_new_method_call(
+                        bus,
+                        &m,
+                        "org.freedesktop.systemd.test",
+                        "/",
+                        "org.freedesktop.systemd.test",
+                        "Fill");
+        if (r < 0)
+                return log_error_errno(r, "Failed to allocate method call: %m");
+
+        large = malloc0(FILL_SIZE);
+        assert_se(large);
+        assert_se(sd_bus_message_set_expect_reply(m, false) >= 0);
+        assert_se(sd_bus_message_append_array(m, 'y', large, FILL_SIZE) >= 0);
+
+        r = sd_bus_send(bus, m, NULL);
+        if (r < 0)
+                return log_error_errno(r, "Failed to send fill: %m");
+        assert_se(sd_bus_get_n_queued_write(bus, &n_queued) >= 0);
+        assert_se(n_queued == 1);
+
+        m = sd_bus_message_unref(m);
+        large = mfree(large);
+
+        for (unsigned u = 0; u < N_PINGS; u++) {
+                _cleanup_(sd_bus_message_unrefp) sd_bus_message *ping = NULL;
+
+                r = sd_bus_message_new_method_call(
+                                bus,
+                                &ping,
+                                "org.freedesktop.systemd.test",
+                                "/",
+                                "org.freedesktop.systemd.test",
+                                "Ping");
+                if (r < 0)
+                        return log_error_errno(r, "Failed to allocate method call: %m");
+
+                assert_se(sd_bus_message_set_expect_reply(ping, false) >= 0);
+
+                if (u % 16 == 0 && can_send_fds)
+                        assert_se(sd_bus_message_append(ping, "uh", u, STDIN_FILENO) >= 0);
+                else
+                        assert_se(sd_bus_message_append(ping, "u", u) >= 0);
+
+                r = sd_bus_send(bus, ping, NULL);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to send ping: %m");
+        }
+
+        r = sd_bus_message_new_method_call(
+                        bus,
+                        &m,
+                        "org.freedesktop.systemd.test",
+                        "/",
+                        "org.freedesktop.systemd.test",
+                        "Large");
+        if (r < 0)
+                return log_error_errno(r, "Failed to allocate method call: %m");
+
+        large = malloc(LARGE_SIZE);
+        assert_se(large);
+        memset(large, 'a', LARGE_SIZE / 2);
+        memset(large + LARGE_SIZE / 2, 'z', LARGE_SIZE - LARGE_SIZE / 2);
+        assert_se(sd_bus_message_append_array(m, 'y', large, LARGE_SIZE) >= 0);
+
+        r = sd_bus_call(bus, m, 0, &error, &reply);
+        if (r < 0)
+                return log_error_errno(r, "Failed to issue method call: %s", bus_error_message(&error, -r));
+
+        assert_se(sd_bus_message_read_array(reply, 'y', &data, &sz) >= 0);
+        assert_se(sz == LARGE_SIZE);
+        assert_se(memcmp(data, large, sz) == 0);
+
+        /* GVariant marshalling is only used if both sides asked for it */
+        assert_se(bus->can_gvariant == (c->client_negotiate_gvariant && c->server_negotiate_gvariant));
+
+        m = sd_bus_message_unref(m);
+        reply = sd_bus_message_unref(reply);
+
         r = sd_bus_message_new_method_call(
                         bus,
                         &m,
@@ -135,7 +289,8 @@ static int client(struct context *c) {
 }
 
 static int test_one(bool client_negotiate_unix_fds, bool server_negotiate_unix_fds,
-                    bool client_anonymous_auth, bool server_anonymous_auth) {
+                    bool client_anonymous_auth, bool server_anonymous_auth,
+                    bool client_negotiate_gvariant, bool server_negotiate_gvariant) {
 
         struct context c;
         pthread_t s;
@@ -150,6 +305,8 @@ static int test_one(bool client_negotiate_unix_fds, bool server_negotiate_unix_f
         c.server_negotiate_unix_fds = server_negotiate_unix_fds;
         c.client_anonymous_auth = client_anonymous_auth;
         c.server_anonymous_auth = server_anonymous_auth;
+        c.client_negotiate_gvariant = client_negotiate_gvariant;
+        c.server_negotiate_gvariant = server_negotiate_gvariant;
 
         r = pthread_create(&s, NULL, server, &c);
         if (r != 0)
@@ -173,26 +330,38 @@ static int test_one(bool client_negotiate_unix_fds, bool server_negotiate_unix_f
 int main(int argc, char *argv[]) {
         int r;
 
-        r = test_one(true, true, false, false);
+        r = test_one(true, true, false, false, false, false);
         assert_se(r >= 0);
 
-        r = test_one(true, false, false, false);
+        r = test_one(true, false, false, false, false, false);
         assert_se(r >= 0);
 
-        r = test_one(false, true, false, false);
+        r = test_one(false, true, false, false, false, false);
         assert_se(r >= 0);
 
-        r = test_one(false, false, false, false);
+        r = test_one(false, false, false, false, false, false);
         assert_se(r >= 0);
 
-        r = test_one(true, true, true, true);
+        r = test_one(true, true, true, true, false, false);
         assert_se(r >= 0);
 
-        r = test_one(true, true, false, true);
+        r = test_one(true, true, false, true, false, false);
         assert_se(r >= 0);
 
-        r = test_one(true, true, true, false);
+        r = test_one(true, true, true, false, false, false);
         assert_se(r == -EPERM);
 
+        r = test_one(true, true, false, false, true, true);
+        assert_se(r >= 0);
+
+        r = test_one(false, false, false, false, true, true);
+        assert_se(r >= 0);
+
+        r = test_one(true, true, false, false, true, false);
+        assert_se(r >= 0);
+
+        r = test_one(true, true, false, false, false, true);
+        assert_se(r >= 0);
+
         return EXIT_SUCCESS;
 }
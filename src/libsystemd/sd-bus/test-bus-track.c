@@ -10,6 +10,7 @@
 
 static bool track_cb_called_x = false;
 static bool track_cb_called_y = false;
+static bool track_cb_called_z = false;
 
 static int track_cb_x(sd_bus_track *t, void *userdata) {
 
@@ -41,9 +42,21 @@ static int track_cb_y(sd_bus_track *t, void *userdata) {
         return 0;
 }
 
+static int track_cb_z(sd_bus_track *t, void *userdata) {
+
+        log_error("TRACK CB Z");
+
+        /* b's name disappeared, and this is tracked by two objects, which should both be notified */
+
+        assert_se(!track_cb_called_z);
+        track_cb_called_z = true;
+
+        return 1;
+}
+
 int main(int argc, char *argv[]) {
         _cleanup_(sd_event_unrefp) sd_event *event = NULL;
-        _cleanup_(sd_bus_track_unrefp) sd_bus_track *x = NULL, *y = NULL;
+        _cleanup_(sd_bus_track_unrefp) sd_bus_track *x = NULL, *y = NULL, *z = NULL;
         _cleanup_(sd_bus_unrefp) sd_bus *a = NULL, *b = NULL;
         bool use_system_bus = false;
         const char *unique;
@@ -85,6 +98,13 @@ int main(int argc, char *argv[]) {
         r = sd_bus_track_add_name(x, unique);
         assert_se(r >= 0);
 
+        /* Watch b's name from a a second time, in a separate object */
+        r = sd_bus_track_new(a, &z, track_cb_z, NULL);
+        assert_se(r >= 0);
+
+        r = sd_bus_track_add_name(z, unique);
+        assert_se(r >= 0);
+
         /* Watch's a's own name from a */
         r = sd_bus_track_new(a, &y, track_cb_y, NULL);
         assert_se(r >= 0);
@@ -103,6 +123,7 @@ int main(int argc, char *argv[]) {
 
         assert_se(track_cb_called_x);
         assert_se(track_cb_called_y);
+        assert_se(track_cb_called_z);
 
         return 0;
 }
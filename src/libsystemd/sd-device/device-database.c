@@ -0,0 +1,477 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <fcntl.h>
+#include <stddef.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "device-database.h"
+#include "dirent-util.h"
+#include "fd-util.h"
+#include "fileio.h"
+#include "fs-util.h"
+#include "hashmap.h"
+#include "memory-util.h"
+#include "path-util.h"
+#include "tmpfile-util.h"
+
+/* Don't bother compacting files smaller than this */
+#define DEVICE_DATABASE_VACUUM_MIN (1024U * 1024U)
+
+struct DeviceDatabase {
+        void *map;
+        size_t map_size;
+        size_t live_size; /* bytes taken by the records still in effect */
+        Hashmap *records; /* id → DeviceDatabaseRecord, both pointing into the map */
+};
+
+static size_t record_size(size_t id_size, size_t data_size) {
+        return ALIGN8(offsetof(DeviceDatabaseRecord, payload) + id_size + data_size);
+}
+
+static bool header_is_valid(const DeviceDatabaseHeader *h) {
+        return memcmp(h->signature, DEVICE_DATABASE_SIGNATURE, sizeof(h->signature)) == 0 &&
+                h->header_size == sizeof(DeviceDatabaseHeader) &&
+                h->tail_offset >= sizeof(DeviceDatabaseHeader);
+}
+
+static int database_load(DeviceDatabase *db) {
+        const DeviceDatabaseHeader *h;
+        uint64_t tail, p;
+        int r;
+
+        assert(db);
+
+        if (db->map_size < sizeof(DeviceDatabaseHeader))
+                return -EBADMSG;
+
+        h = db->map;
+        if (!header_is_valid(h))
+                return -EBADMSG;
+
+        /* The writer might have appended more since we mapped the file, ignore that. If it was in the middle of
+         * writing a record when we looked at the size of the file, but moved the tail offset past it before we
+         * read that, the last record we mapped is incomplete. Skip it, it's not in effect for us yet. */
+        tail = MIN(h->tail_offset, (uint64_t) db->map_size);
+
+        for (p = sizeof(DeviceDatabaseHeader); p < tail; ) {
+                const DeviceDatabaseRecord *rec, *old;
+                const char *id;
+
+                if (tail - p < sizeof(DeviceDatabaseRecord)) {
+                        if (tail < h->tail_offset)
+                                break;
+
+                        return -EBADMSG;
+                }
+
+                rec = (const DeviceDatabaseRecord*) ((const uint8_t*) db->map + p);
+                if (rec->size > tail - p && tail < h->tail_offset)
+                        break;
+
+                if (rec->size < sizeof(DeviceDatabaseRecord) ||
+                    rec->size > tail - p ||
+                    rec->size % 8 != 0 ||
+                    rec->id_size == 0 ||
+                    rec->data_size > rec->size - sizeof(DeviceDatabaseRecord) ||
+                    rec->id_size > rec->size - sizeof(DeviceDatabaseRecord) - rec->data_size)
+                        return -EBADMSG;
+
+                id = (const char*) rec->payload;
+                if (id[rec->id_size - 1] != '\0')
+                        return -EBADMSG;
+
+                old = hashmap_remove(db->records, id);
+                if (old)
+                        db->live_size -= old->size;
+
+                if (!FLAGS_SET(rec->flags, DEVICE_DATABASE_RECORD_REMOVED)) {
+                        r = hashmap_put(db->records, id, (void*) rec);
+                        if (r < 0)
+                                return r;
+
+                        db->live_size += rec->size;
+                }
+
+                p += rec->size;
+        }
+
+        return 0;
+}
+
+static int database_new_from_fd(int fd, DeviceDatabase **ret) {
+        _cleanup_(device_database_freep) DeviceDatabase *db = NULL;
+        struct stat st;
+        void *p;
+        int r;
+
+        assert(fd >= 0);
+        assert(ret);
+
+        if (fstat(fd, &st) < 0)
+                return -errno;
+
+        if ((uint64_t) st.st_size < sizeof(DeviceDatabaseHeader))
+                return -EBADMSG;
+        if ((uint64_t) st.st_size > SIZE_MAX)
+                return -EFBIG;
+
+        db = new0(DeviceDatabase, 1);
+        if (!db)
+                return -ENOMEM;
+
+        db->records = hashmap_new(&string_hash_ops);
+        if (!db->records)
+                return -ENOMEM;
+
+        /* The file is only ever appended to, or replaced as a whole, hence the part we map stays valid */
+        p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED)
+                return -errno;
+
+        db->map = p;
+        db->map_size = st.st_size;
+
+        r = database_load(db);
+        if (r < 0)
+                return r;
+
+        *ret = TAKE_PTR(db);
+        return 0;
+}
+
+int device_database_open(const char *path, DeviceDatabase **ret) {
+        _cleanup_close_ int fd = -1;
+
+        assert(path);
+        assert(ret);
+
+        fd = open(path, O_RDONLY|O_CLOEXEC|O_NOCTTY);
+        if (fd < 0)
+                return -errno;
+
+        return database_new_from_fd(fd, ret);
+}
+
+DeviceDatabase *device_database_free(DeviceDatabase *db) {
+        if (!db)
+                return NULL;
+
+        hashmap_free(db->records);
+
+        if (db->map)
+                (void) munmap(db->map, db->map_size);
+
+        return mfree(db);
+}
+
+size_t device_database_size(DeviceDatabase *db) {
+        return db ? hashmap_size(db->records) : 0;
+}
+
+int device_database_get(DeviceDatabase *db, const char *id, const char **ret_data, size_t *ret_size) {
+        const DeviceDatabaseRecord *rec;
+
+        assert(db);
+        assert(id);
+
+        rec = hashmap_get(db->records, id);
+        if (!rec)
+                return -ENOENT;
+
+        if (ret_data)
+                *ret_data = (const char*) rec->payload + rec->id_size;
+        if (ret_size)
+                *ret_size = rec->data_size;
+
+        return 0;
+}
+
+static int database_lock(const char *path, bool create, int *ret_fd) {
+        assert(path);
+        assert(ret_fd);
+
+        for (;;) {
+                _cleanup_close_ int fd = -1;
+                struct stat st;
+
+                fd = open(path, O_RDWR|O_CLOEXEC|O_NOCTTY|O_NOFOLLOW|(create ? O_CREAT : 0), 0644);
+                if (fd < 0)
+                        return -errno;
+
+                if (flock(fd, LOCK_EX) < 0)
+                        return -errno;
+
+                /* The file might have been replaced or removed while we were waiting for the lock */
+                if (fstat(fd, &st) < 0)
+                        return -errno;
+
+                if (st.st_nlink > 0) {
+                        *ret_fd = TAKE_FD(fd);
+                        return 0;
+                }
+        }
+}
+
+static int database_append(const char *path, uint32_t flags, const char *id, const char *data, size_t size) {
+        _cleanup_free_ DeviceDatabaseRecord *rec = NULL;
+        _cleanup_close_ int fd = -1;
+        DeviceDatabaseHeader h;
+        size_t id_size, sz;
+        ssize_t n;
+        int r;
+
+        assert(path);
+        assert(id);
+        assert(data || size == 0);
+
+        r = database_lock(path, false, &fd);
+        if (r == -ENOENT)
+                return 0; /* Nothing to keep in sync */
+        if (r < 0)
+                return r;
+
+        n = pread(fd, &h, sizeof(h), 0);
+        if (n < 0) {
+                r = -errno;
+                goto fail;
+        }
+        if ((size_t) n != sizeof(h) || !header_is_valid(&h)) {
+                r = -EBADMSG;
+                goto fail;
+        }
+
+        id_size = strlen(id) + 1;
+        sz = record_size(id_size, size);
+
+        rec = malloc0(sz);
+        if (!rec) {
+                r = -ENOMEM;
+                goto fail;
+        }
+
+        rec->size = sz;
+        rec->flags = flags;
+        rec->id_size = id_size;
+        rec->data_size = size;
+        memcpy(rec->payload, id, id_size);
+        memcpy_safe(rec->payload + id_size, data, size);
+
+        /* First the record, then the tail offset, so that readers never look at a partial record */
+        n = pwrite(fd, rec, sz, h.tail_offset);
+        if (n < 0) {
+                r = -errno;
+                goto fail;
+        }
+        if ((size_t) n != sz) {
+                r = -EIO;
+                goto fail;
+        }
+
+        h.tail_offset += sz;
+
+        n = pwrite(fd, &h.tail_offset, sizeof(h.tail_offset), offsetof(DeviceDatabaseHeader, tail_offset));
+        if (n < 0) {
+                r = -errno;
+                goto fail;
+        }
+        if ((size_t) n != sizeof(h.tail_offset)) {
+                r = -EIO;
+                goto fail;
+        }
+
+        return 0;
+
+fail:
+        /* Better no database at all than one that is out of sync with the per-device files */
+        (void) unlink(path);
+        return r;
+}
+
+int device_database_update(const char *path, const char *id, const char *data, size_t size) {
+        return database_append(path, 0, id, data, size);
+}
+
+int device_database_remove(const char *path, const char *id) {
+        return database_append(path, DEVICE_DATABASE_RECORD_REMOVED, id, NULL, 0);
+}
+
+static void write_record(FILE *f, uint64_t *offset, const char *id, const char *data, size_t size) {
+        DeviceDatabaseRecord rec;
+        size_t id_size, sz;
+
+        assert(f);
+        assert(offset);
+        assert(id);
+
+        id_size = strlen(id) + 1;
+        sz = record_size(id_size, size);
+
+        rec = (DeviceDatabaseRecord) {
+                .size = sz,
+                .id_size = id_size,
+                .data_size = size,
+        };
+
+        fwrite(&rec, 1, offsetof(DeviceDatabaseRecord, payload), f);
+        fwrite(id, 1, id_size, f);
+        fwrite(data, 1, size, f);
+        fwrite((const uint8_t[8]) {}, 1, sz - offsetof(DeviceDatabaseRecord, payload) - id_size - size, f);
+
+        /* Errors are caught by fflush_and_check() eventually */
+        *offset += sz;
+}
+
+/* Writes the header and calls the callback to write the records, then replaces the file at path */
+static int database_replace(
+                const char *path,
+                int (*write_records)(FILE *f, uint64_t *offset, void *userdata),
+                void *userdata) {
+
+        _cleanup_(unlink_and_freep) char *t = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+        DeviceDatabaseHeader h = {
+                .header_size = sizeof(DeviceDatabaseHeader),
+        };
+        uint64_t offset = sizeof(DeviceDatabaseHeader);
+        int r;
+
+        r = fopen_temporary(path, &f, &t);
+        if (r < 0)
+                return r;
+
+        if (fchmod(fileno(f), 0644) < 0)
+                return -errno;
+
+        /* Write the header last, so that an incomplete file never looks valid */
+        fwrite(&h, 1, sizeof(h), f);
+
+        r = write_records(f, &offset, userdata);
+        if (r < 0)
+                return r;
+
+        r = fflush_and_check(f);
+        if (r < 0)
+                return r;
+
+        memcpy(h.signature, DEVICE_DATABASE_SIGNATURE, sizeof(h.signature));
+        h.tail_offset = offset;
+
+        if (pwrite(fileno(f), &h, sizeof(h), 0) != sizeof(h))
+                return errno > 0 ? -errno : -EIO;
+
+        if (rename(t, path) < 0)
+                return -errno;
+
+        t = mfree(t);
+        return 0;
+}
+
+static int write_records_from_dir(FILE *f, uint64_t *offset, void *userdata) {
+        _cleanup_closedir_ DIR *d = NULL;
+        const char *dir = userdata;
+        struct dirent *de;
+        int r;
+
+        d = opendir(dir);
+        if (!d)
+                return errno == ENOENT ? 0 : -errno;
+
+        FOREACH_DIRENT(de, d, return -errno) {
+                _cleanup_free_ char *p = NULL, *data = NULL;
+                size_t size;
+
+                if (!IN_SET(de->d_type, DT_REG, DT_UNKNOWN))
+                        continue;
+
+                p = path_join(dir, de->d_name);
+                if (!p)
+                        return -ENOMEM;
+
+                r = read_full_file(p, &data, &size);
+                if (r == -ENOENT)
+                        continue;
+                if (r < 0)
+                        return r;
+
+                write_record(f, offset, de->d_name, data, size);
+        }
+
+        return 0;
+}
+
+int device_database_rebuild(const char *path, const char *dir) {
+        _cleanup_close_ int fd = -1;
+        int r;
+
+        assert(path);
+        assert(dir);
+
+        /* Hold the lock on the current file, or on an empty placeholder, until it is replaced: writers that
+         * update the per-device files concurrently then wait for us, and afterwards go to the new file. */
+        r = database_lock(path, true, &fd);
+        if (r < 0)
+                return r;
+
+        r = database_replace(path, write_records_from_dir, (void*) dir);
+        if (r < 0) {
+                (void) unlink(path);
+                return r;
+        }
+
+        return 0;
+}
+
+static int write_records_from_database(FILE *f, uint64_t *offset, void *userdata) {
+        DeviceDatabase *db = userdata;
+        const DeviceDatabaseRecord *rec;
+        Iterator i;
+
+        HASHMAP_FOREACH(rec, db->records, i)
+                write_record(f, offset, (const char*) rec->payload,
+                             (const char*) rec->payload + rec->id_size, rec->data_size);
+
+        return 0;
+}
+
+int device_database_vacuum(const char *path) {
+        _cleanup_(device_database_freep) DeviceDatabase *db = NULL;
+        _cleanup_close_ int fd = -1;
+        struct stat st;
+        int r;
+
+        assert(path);
+
+        r = database_lock(path, false, &fd);
+        if (r == -ENOENT)
+                return 0;
+        if (r < 0)
+                return r;
+
+        if (fstat(fd, &st) < 0)
+                return -errno;
+
+        if ((uint64_t) st.st_size < DEVICE_DATABASE_VACUUM_MIN)
+                return 0;
+
+        r = database_new_from_fd(fd, &db);
+        if (r < 0)
+                goto fail;
+
+        /* Only compact once more than half of the file is made of superseded records */
+        if (db->map_size <= 2 * db->live_size)
+                return 0;
+
+        r = database_replace(path, write_records_from_database, db);
+        if (r < 0)
+                goto fail;
+
+        return 1;
+
+fail:
+        (void) unlink(path);
+        return r;
+}
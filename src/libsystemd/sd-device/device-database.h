@@ -0,0 +1,54 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+#include <inttypes.h>
+#include <sys/types.h>
+
+#include "macro.h"
+
+/* All entries of /run/udev/data/ in one file, so that clients enumerating devices do not need to open each of
+ * them. The file consists of a header followed by records, all in native endianness. A record carries the
+ * device id and the contents of the per-device file, in the same format. Later records replace earlier ones
+ * for the same id, and records flagged DEVICE_DATABASE_RECORD_REMOVED delete it.
+ *
+ * Writers take an flock() on the file, append a record, and only then move the tail offset in the header
+ * forward, hence readers never see partially written records and need no locking. The file is only ever
+ * created from a full scan of /run/udev/data/ and atomically replaced when it is rebuilt, and updating it is
+ * only attempted if it exists. If an update fails, the file is removed instead. Hence, if it exists, it
+ * carries the same information as the per-device files, which stay authoritative. */
+
+#define DEVICE_DATABASE_PATH "/run/udev/data.bin"
+
+#define DEVICE_DATABASE_SIGNATURE ((const uint8_t[8]) { 'U', 'D', 'E', 'V', 'D', 'B', '0', '1' })
+
+typedef struct DeviceDatabaseHeader {
+        uint8_t signature[8];
+        uint64_t header_size;
+        uint64_t tail_offset;  /* end of the last complete record */
+} DeviceDatabaseHeader;
+
+enum {
+        DEVICE_DATABASE_RECORD_REMOVED = 1 << 0,
+};
+
+typedef struct DeviceDatabaseRecord {
+        uint64_t size;         /* of the whole record, including this header and padding */
+        uint32_t flags;
+        uint32_t id_size;      /* including the trailing NUL */
+        uint64_t data_size;
+        uint8_t payload[];     /* the id, followed by the data */
+} DeviceDatabaseRecord;
+
+typedef struct DeviceDatabase DeviceDatabase;
+
+int device_database_open(const char *path, DeviceDatabase **ret);
+DeviceDatabase *device_database_free(DeviceDatabase *db);
+DEFINE_TRIVIAL_CLEANUP_FUNC(DeviceDatabase*, device_database_free);
+
+size_t device_database_size(DeviceDatabase *db);
+int device_database_get(DeviceDatabase *db, const char *id, const char **ret_data, size_t *ret_size);
+
+int device_database_update(const char *path, const char *id, const char *data, size_t size);
+int device_database_remove(const char *path, const char *id);
+int device_database_rebuild(const char *path, const char *dir);
+int device_database_vacuum(const char *path);
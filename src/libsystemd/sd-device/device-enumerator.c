@@ -7,9 +7,12 @@
 
 #include "alloc-util.h"
 #include "device-enumerator-private.h"
+#include "device-internal.h"
 #include "device-util.h"
 #include "dirent-util.h"
 #include "fd-util.h"
+#include "parse-util.h"
+#include "pthread-util.h"
 #include "set.h"
 #include "sort-util.h"
 #include "string-util.h"
@@ -17,6 +20,9 @@
 
 #define DEVICE_ENUMERATE_MAX_DEPTH 256
 
+/* Upper limit for the number of threads used for scanning, see $SYSTEMD_DEVICE_ENUMERATOR_THREADS */
+#define SCAN_THREADS_MAX 64U
+
 typedef enum DeviceEnumerationType {
         DEVICE_ENUMERATION_TYPE_DEVICES,
         DEVICE_ENUMERATION_TYPE_SUBSYSTEMS,
@@ -24,6 +30,15 @@ typedef enum DeviceEnumerationType {
         _DEVICE_ENUMERATION_TYPE_INVALID = -1,
 } DeviceEnumerationType;
 
+typedef int (*scan_test_t)(sd_device_enumerator *enumerator, const char *name, sd_device **ret);
+
+typedef struct ScanEntry {
+        scan_test_t test;
+        char *name;          /* syspath or device id, as understood by the test function */
+        sd_device *device;   /* set if the candidate matched */
+        int result;
+} ScanEntry;
+
 struct sd_device_enumerator {
         unsigned n_ref;
 
@@ -41,10 +56,17 @@ struct sd_device_enumerator {
         Set *match_tag;
         Set *match_parent;
         bool match_allow_uninitialized;
+
+        DeviceDatabase *database; /* only while scanning */
+
+        unsigned n_scan_threads;
+        ScanEntry *scan_entries; /* queued candidates, only while scanning with threads */
+        size_t n_scan_entries, n_scan_allocated, next_scan_entry;
 };
 
 _public_ int sd_device_enumerator_new(sd_device_enumerator **ret) {
         _cleanup_(sd_device_enumerator_unrefp) sd_device_enumerator *enumerator = NULL;
+        const char *e;
 
         assert(ret);
 
@@ -57,6 +79,14 @@ _public_ int sd_device_enumerator_new(sd_device_enumerator **ret) {
                 .type = _DEVICE_ENUMERATION_TYPE_INVALID,
         };
 
+        e = secure_getenv("SYSTEMD_DEVICE_ENUMERATOR_THREADS");
+        if (e) {
+                if (safe_atou(e, &enumerator->n_scan_threads) < 0)
+                        log_debug("sd-device-enumerator: Failed to parse $SYSTEMD_DEVICE_ENUMERATOR_THREADS, ignoring: %s", e);
+                else
+                        enumerator->n_scan_threads = MIN(enumerator->n_scan_threads, SCAN_THREADS_MAX);
+        }
+
         *ret = TAKE_PTR(enumerator);
 
         return 0;
@@ -79,6 +109,13 @@ static sd_device_enumerator *device_enumerator_free(sd_device_enumerator *enumer
         set_free_free(enumerator->match_sysname);
         set_free_free(enumerator->match_tag);
         set_free_free(enumerator->match_parent);
+        device_database_free(enumerator->database);
+
+        for (i = 0; i < enumerator->n_scan_entries; i++) {
+                free(enumerator->scan_entries[i].name);
+                sd_device_unref(enumerator->scan_entries[i].device);
+        }
+        free(enumerator->scan_entries);
 
         return mfree(enumerator);
 }
@@ -461,6 +498,171 @@ static bool match_sysname(sd_device_enumerator *enumerator, const char *sysname)
         return false;
 }
 
+static void enumerator_prepare_device(sd_device_enumerator *enumerator, sd_device *device) {
+        int r;
+
+        assert(enumerator);
+        assert(device);
+
+        if (!enumerator->database)
+                return;
+
+        /* Take the udev database entry from the combined file, instead of opening the per-device one */
+        r = device_read_db_from_database(device, enumerator->database);
+        if (r < 0)
+                log_device_debug_errno(device, r, "sd-device-enumerator: Failed to read db from %s, ignoring: %m",
+                                       DEVICE_DATABASE_PATH);
+}
+
+static int enumerator_scan_entry(sd_device_enumerator *enumerator, scan_test_t test, const char *name) {
+        _cleanup_(sd_device_unrefp) sd_device *device = NULL;
+        int r;
+
+        assert(enumerator);
+        assert(test);
+        assert(name);
+
+        if (enumerator->n_scan_threads > 0) {
+                _cleanup_free_ char *n = NULL;
+
+                /* Only collect the candidate here, enumerator_scan_queued() tests them all in parallel */
+                n = strdup(name);
+                if (!n)
+                        return -ENOMEM;
+
+                if (!GREEDY_REALLOC(enumerator->scan_entries, enumerator->n_scan_allocated, enumerator->n_scan_entries + 1))
+                        return -ENOMEM;
+
+                enumerator->scan_entries[enumerator->n_scan_entries++] = (ScanEntry) {
+                        .test = test,
+                        .name = TAKE_PTR(n),
+                };
+
+                return 0;
+        }
+
+        r = test(enumerator, name, &device);
+        if (r <= 0)
+                return r;
+
+        return device_enumerator_add_device(enumerator, device);
+}
+
+static void *scan_thread(void *userdata) {
+        sd_device_enumerator *enumerator = userdata;
+
+        assert(enumerator);
+
+        for (;;) {
+                ScanEntry *entry;
+                size_t i;
+
+                i = __sync_fetch_and_add(&enumerator->next_scan_entry, 1);
+                if (i >= enumerator->n_scan_entries)
+                        break;
+
+                /* The test functions create their own sd_device object and only read the matches and the
+                 * database of the enumerator, neither of which is modified while scanning. */
+                entry = enumerator->scan_entries + i;
+                entry->result = entry->test(enumerator, entry->name, &entry->device);
+        }
+
+        return NULL;
+}
+
+static int enumerator_scan_queued(sd_device_enumerator *enumerator) {
+        int r = 0, k;
+        size_t i;
+
+        assert(enumerator);
+
+        /* Creating the devices means resolving their syspaths and reading their uevent and db files, which is
+         * pure syscall latency, and independent for each device. Hence spread that over the threads, and
+         * add the matching devices afterwards, in the order in which they were found. */
+
+        if (enumerator->n_scan_entries == 0)
+                return 0;
+
+        enumerator->next_scan_entry = 0;
+
+        run_parallel(MIN(enumerator->n_scan_threads, enumerator->n_scan_entries - 1) + 1, scan_thread, enumerator);
+
+        for (i = 0; i < enumerator->n_scan_entries; i++) {
+                ScanEntry *entry = enumerator->scan_entries + i;
+
+                if (entry->result < 0)
+                        r = entry->result;
+                else if (entry->device) {
+                        k = device_enumerator_add_device(enumerator, entry->device);
+                        if (k < 0)
+                                r = k;
+                }
+
+                entry->name = mfree(entry->name);
+                entry->device = sd_device_unref(entry->device);
+        }
+
+        enumerator->n_scan_entries = 0;
+
+        return r;
+}
+
+static int test_syspath(sd_device_enumerator *enumerator, const char *syspath, sd_device **ret) {
+        _cleanup_(sd_device_unrefp) sd_device *device = NULL;
+        int initialized, r;
+
+        assert(enumerator);
+        assert(syspath);
+        assert(ret);
+
+        r = sd_device_new_from_syspath(&device, syspath);
+        if (r == -ENODEV)
+                /* this is necessarily racey, so ignore missing devices */
+                return 0;
+        if (r < 0)
+                return r;
+
+        enumerator_prepare_device(enumerator, device);
+
+        initialized = sd_device_get_is_initialized(device);
+        if (initialized == -ENOENT)
+                /* this is necessarily racey, so ignore missing devices */
+                return 0;
+        if (initialized < 0)
+                return initialized;
+
+        /*
+         * All devices with a device node or network interfaces
+         * possibly need udev to adjust the device node permission
+         * or context, or rename the interface before it can be
+         * reliably used from other processes.
+         *
+         * For now, we can only check these types of devices, we
+         * might not store a database, and have no way to find out
+         * for all other types of devices.
+         */
+        if (!enumerator->match_allow_uninitialized &&
+            !initialized &&
+            (sd_device_get_devnum(device, NULL) >= 0 ||
+             sd_device_get_ifindex(device, NULL) >= 0))
+                return 0;
+
+        if (!match_parent(enumerator, device))
+                return 0;
+
+        if (!match_tag(enumerator, device))
+                return 0;
+
+        if (!match_property(enumerator, device))
+                return 0;
+
+        if (!match_sysattr(enumerator, device))
+                return 0;
+
+        *ret = TAKE_PTR(device);
+        return 1;
+}
+
 static int enumerator_scan_dir_and_add_devices(sd_device_enumerator *enumerator, const char *basedir, const char *subdir1, const char *subdir2) {
         _cleanup_closedir_ DIR *dir = NULL;
         char *path;
@@ -483,9 +685,8 @@ static int enumerator_scan_dir_and_add_devices(sd_device_enumerator *enumerator,
                 return -errno;
 
         FOREACH_DIRENT_ALL(dent, dir, return -errno) {
-                _cleanup_(sd_device_unrefp) sd_device *device = NULL;
                 char syspath[strlen(path) + 1 + strlen(dent->d_name) + 1];
-                int initialized, k;
+                int k;
 
                 if (dent->d_name[0] == '.')
                         continue;
@@ -495,53 +696,7 @@ static int enumerator_scan_dir_and_add_devices(sd_device_enumerator *enumerator,
 
                 (void) sprintf(syspath, "%s%s", path, dent->d_name);
 
-                k = sd_device_new_from_syspath(&device, syspath);
-                if (k < 0) {
-                        if (k != -ENODEV)
-                                /* this is necessarily racey, so ignore missing devices */
-                                r = k;
-
-                        continue;
-                }
-
-                initialized = sd_device_get_is_initialized(device);
-                if (initialized < 0) {
-                        if (initialized != -ENOENT)
-                                /* this is necessarily racey, so ignore missing devices */
-                                r = initialized;
-
-                        continue;
-                }
-
-                /*
-                 * All devices with a device node or network interfaces
-                 * possibly need udev to adjust the device node permission
-                 * or context, or rename the interface before it can be
-                 * reliably used from other processes.
-                 *
-                 * For now, we can only check these types of devices, we
-                 * might not store a database, and have no way to find out
-                 * for all other types of devices.
-                 */
-                if (!enumerator->match_allow_uninitialized &&
-                    !initialized &&
-                    (sd_device_get_devnum(device, NULL) >= 0 ||
-                     sd_device_get_ifindex(device, NULL) >= 0))
-                        continue;
-
-                if (!match_parent(enumerator, device))
-                        continue;
-
-                if (!match_tag(enumerator, device))
-                        continue;
-
-                if (!match_property(enumerator, device))
-                        continue;
-
-                if (!match_sysattr(enumerator, device))
-                        continue;
-
-                k = device_enumerator_add_device(enumerator, device);
+                k = enumerator_scan_entry(enumerator, test_syspath, syspath);
                 if (k < 0)
                         r = k;
         }
@@ -603,6 +758,54 @@ static int enumerator_scan_dir(sd_device_enumerator *enumerator, const char *bas
         return r;
 }
 
+static int test_device_id(sd_device_enumerator *enumerator, const char *id, sd_device **ret) {
+        _cleanup_(sd_device_unrefp) sd_device *device = NULL;
+        const char *subsystem, *sysname;
+        int r;
+
+        assert(enumerator);
+        assert(id);
+        assert(ret);
+
+        r = sd_device_new_from_device_id(&device, id);
+        if (r == -ENODEV)
+                /* this is necessarily racy, so ignore missing devices */
+                return 0;
+        if (r < 0)
+                return r;
+
+        enumerator_prepare_device(enumerator, device);
+
+        r = sd_device_get_subsystem(device, &subsystem);
+        if (r == -ENOENT)
+                /* this is necessarily racy, so ignore missing devices */
+                return 0;
+        if (r < 0)
+                return r;
+
+        if (!match_subsystem(enumerator, subsystem))
+                return 0;
+
+        r = sd_device_get_sysname(device, &sysname);
+        if (r < 0)
+                return r;
+
+        if (!match_sysname(enumerator, sysname))
+                return 0;
+
+        if (!match_parent(enumerator, device))
+                return 0;
+
+        if (!match_property(enumerator, device))
+                return 0;
+
+        if (!match_sysattr(enumerator, device))
+                return 0;
+
+        *ret = TAKE_PTR(device);
+        return 1;
+}
+
 static int enumerator_scan_devices_tag(sd_device_enumerator *enumerator, const char *tag) {
         _cleanup_closedir_ DIR *dir = NULL;
         char *path;
@@ -624,56 +827,14 @@ static int enumerator_scan_devices_tag(sd_device_enumerator *enumerator, const c
         /* TODO: filter away subsystems? */
 
         FOREACH_DIRENT_ALL(dent, dir, return -errno) {
-                _cleanup_(sd_device_unrefp) sd_device *device = NULL;
-                const char *subsystem, *sysname;
                 int k;
 
                 if (dent->d_name[0] == '.')
                         continue;
 
-                k = sd_device_new_from_device_id(&device, dent->d_name);
-                if (k < 0) {
-                        if (k != -ENODEV)
-                                /* this is necessarily racy, so ignore missing devices */
-                                r = k;
-
-                        continue;
-                }
-
-                k = sd_device_get_subsystem(device, &subsystem);
-                if (k < 0) {
-                        if (k != -ENOENT)
-                                /* this is necessarily racy, so ignore missing devices */
-                                r = k;
-                        continue;
-                }
-
-                if (!match_subsystem(enumerator, subsystem))
-                        continue;
-
-                k = sd_device_get_sysname(device, &sysname);
-                if (k < 0) {
-                        r = k;
-                        continue;
-                }
-
-                if (!match_sysname(enumerator, sysname))
-                        continue;
-
-                if (!match_parent(enumerator, device))
-                        continue;
-
-                if (!match_property(enumerator, device))
-                        continue;
-
-                if (!match_sysattr(enumerator, device))
-                        continue;
-
-                k = device_enumerator_add_device(enumerator, device);
-                if (k < 0) {
+                k = enumerator_scan_entry(enumerator, test_device_id, dent->d_name);
+                if (k < 0)
                         r = k;
-                        continue;
-                }
         }
 
         return r;
@@ -697,11 +858,15 @@ static int enumerator_scan_devices_tags(sd_device_enumerator *enumerator) {
         return r;
 }
 
-static int parent_add_child(sd_device_enumerator *enumerator, const char *path) {
+static int test_child(sd_device_enumerator *enumerator, const char *path, sd_device **ret) {
         _cleanup_(sd_device_unrefp) sd_device *device = NULL;
         const char *subsystem, *sysname;
         int r;
 
+        assert(enumerator);
+        assert(path);
+        assert(ret);
+
         r = sd_device_new_from_syspath(&device, path);
         if (r == -ENODEV)
                 /* this is necessarily racy, so ignore missing devices */
@@ -709,6 +874,8 @@ static int parent_add_child(sd_device_enumerator *enumerator, const char *path)
         else if (r < 0)
                 return r;
 
+        enumerator_prepare_device(enumerator, device);
+
         r = sd_device_get_subsystem(device, &subsystem);
         if (r == -ENOENT)
                 return 0;
@@ -731,13 +898,14 @@ static int parent_add_child(sd_device_enumerator *enumerator, const char *path)
         if (!match_sysattr(enumerator, device))
                 return 0;
 
-        r = device_enumerator_add_device(enumerator, device);
-        if (r < 0)
-                return r;
-
+        *ret = TAKE_PTR(device);
         return 1;
 }
 
+static int parent_add_child(sd_device_enumerator *enumerator, const char *path) {
+        return enumerator_scan_entry(enumerator, test_child, path);
+}
+
 static int parent_crawl_children(sd_device_enumerator *enumerator, const char *path, unsigned maxdepth) {
         _cleanup_closedir_ DIR *dir = NULL;
         struct dirent *dent;
@@ -863,6 +1031,10 @@ int device_enumerator_scan_devices(sd_device_enumerator *enumerator) {
 
         enumerator->n_devices = 0;
 
+        k = device_database_open(DEVICE_DATABASE_PATH, &enumerator->database);
+        if (k < 0 && k != -ENOENT)
+                log_debug_errno(k, "sd-device-enumerator: Failed to open %s, ignoring: %m", DEVICE_DATABASE_PATH);
+
         if (!set_isempty(enumerator->match_tag)) {
                 k = enumerator_scan_devices_tags(enumerator);
                 if (k < 0)
@@ -877,6 +1049,12 @@ int device_enumerator_scan_devices(sd_device_enumerator *enumerator) {
                         r = k;
         }
 
+        k = enumerator_scan_queued(enumerator);
+        if (k < 0)
+                r = k;
+
+        enumerator->database = device_database_free(enumerator->database);
+
         typesafe_qsort(enumerator->devices, enumerator->n_devices, device_compare);
         device_enumerator_dedup_devices(enumerator);
 
@@ -962,6 +1140,10 @@ int device_enumerator_scan_subsystems(sd_device_enumerator *enumerator) {
                 }
         }
 
+        k = enumerator_scan_queued(enumerator);
+        if (k < 0)
+                r = k;
+
         typesafe_qsort(enumerator->devices, enumerator->n_devices, device_compare);
         device_enumerator_dedup_devices(enumerator);
 
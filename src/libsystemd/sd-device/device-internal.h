@@ -3,6 +3,7 @@
 
 #include "sd-device.h"
 
+#include "device-database.h"
 #include "device-private.h"
 #include "hashmap.h"
 #include "set.h"
@@ -24,6 +25,8 @@ struct sd_device {
         OrderedHashmap *properties_db;
 
         Hashmap *sysattr_values; /* cached sysattr values */
+        unsigned sysattr_reads; /* lookups that went to sysfs */
+        unsigned sysattr_cache_hits; /* lookups answered from sysattr_values */
 
         Set *sysattrs; /* names of sysattrs */
         Iterator sysattrs_iterator;
@@ -90,6 +93,7 @@ int device_new_aux(sd_device **ret);
 int device_add_property_aux(sd_device *device, const char *key, const char *value, bool db);
 int device_add_property_internal(sd_device *device, const char *key, const char *value);
 int device_read_uevent_file(sd_device *device);
+int device_read_db_from_database(sd_device *device, DeviceDatabase *database);
 
 int device_set_syspath(sd_device *device, const char *_syspath, bool verify);
 int device_set_ifindex(sd_device *device, const char *ifindex);
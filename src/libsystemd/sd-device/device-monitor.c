@@ -20,9 +20,15 @@
 #include "mountpoint-util.h"
 #include "set.h"
 #include "socket-util.h"
+#include "sort-util.h"
 #include "string-util.h"
 #include "strv.h"
 
+/* How many messages to receive with one recvmmsg() call, when dispatching to a callback */
+#define MONITOR_BATCH_MAX 16U
+
+typedef struct MonitorBatch MonitorBatch;
+
 struct sd_device_monitor {
         unsigned n_ref;
 
@@ -39,6 +45,8 @@ struct sd_device_monitor {
         sd_event_source *event_source;
         sd_device_monitor_handler_t callback;
         void *userdata;
+
+        MonitorBatch *batch;
 };
 
 #define UDEV_MONITOR_MAGIC                0xfeedcafe
@@ -62,6 +70,19 @@ typedef struct monitor_netlink_header {
         unsigned filter_tag_bloom_lo;
 } monitor_netlink_header;
 
+typedef union MonitorMessage {
+        monitor_netlink_header nlh;
+        char raw[8192];
+} MonitorMessage;
+
+struct MonitorBatch {
+        struct mmsghdr msgs[MONITOR_BATCH_MAX];
+        struct iovec iovecs[MONITOR_BATCH_MAX];
+        union sockaddr_union addrs[MONITOR_BATCH_MAX];
+        uint8_t controls[MONITOR_BATCH_MAX][CMSG_SPACE(sizeof(struct ucred))];
+        MonitorMessage messages[MONITOR_BATCH_MAX];
+};
+
 static int monitor_set_nl_address(sd_device_monitor *m) {
         union sockaddr_union snl;
         socklen_t addrlen;
@@ -184,19 +205,31 @@ _public_ int sd_device_monitor_stop(sd_device_monitor *m) {
         return 0;
 }
 
+static int device_monitor_receive_devices(sd_device_monitor *m, sd_device **devices, size_t *ret_n);
+
 static int device_monitor_event_handler(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
-        _cleanup_(sd_device_unrefp) sd_device *device = NULL;
-        sd_device_monitor *m = userdata;
+        _cleanup_(sd_device_monitor_unrefp) sd_device_monitor *m = NULL;
+        sd_device *devices[MONITOR_BATCH_MAX];
+        size_t n = 0, i;
+        int r = 0;
 
-        assert(m);
+        assert(userdata);
 
-        if (device_monitor_receive_device(m, &device) <= 0)
+        /* The callback might drop the last reference to the monitor, while we still have devices to dispatch */
+        m = sd_device_monitor_ref(userdata);
+
+        if (device_monitor_receive_devices(m, devices, &n) < 0)
                 return 0;
 
-        if (m->callback)
-                return m->callback(m, device, m->userdata);
+        for (i = 0; i < n; i++) {
+                /* Don't dispatch the rest if the callback failed, or stopped or restarted the monitor */
+                if (r >= 0 && m->callback && m->event_source == s)
+                        r = m->callback(m, devices[i], m->userdata);
 
-        return 0;
+                sd_device_unref(devices[i]);
+        }
+
+        return r;
 }
 
 _public_ int sd_device_monitor_start(sd_device_monitor *m, sd_device_monitor_handler_t callback, void *userdata) {
@@ -299,6 +332,7 @@ static sd_device_monitor *device_monitor_free(sd_device_monitor *m) {
 
         hashmap_free_free_free(m->subsystem_filter);
         set_free_free(m->tag_filter);
+        free(m->batch);
 
         return mfree(m);
 }
@@ -351,59 +385,45 @@ tag:
         return 0;
 }
 
-int device_monitor_receive_device(sd_device_monitor *m, sd_device **ret) {
+static int device_monitor_process_message(
+                sd_device_monitor *m,
+                struct msghdr *smsg,
+                MonitorMessage *buf,
+                ssize_t buflen,
+                sd_device **ret) {
+
         _cleanup_(sd_device_unrefp) sd_device *device = NULL;
-        union {
-                monitor_netlink_header nlh;
-                char raw[8192];
-        } buf;
-        struct iovec iov = {
-                .iov_base = &buf,
-                .iov_len = sizeof(buf)
-        };
-        char cred_msg[CMSG_SPACE(sizeof(struct ucred))];
-        union sockaddr_union snl;
-        struct msghdr smsg = {
-                .msg_iov = &iov,
-                .msg_iovlen = 1,
-                .msg_control = cred_msg,
-                .msg_controllen = sizeof(cred_msg),
-                .msg_name = &snl,
-                .msg_namelen = sizeof(snl),
-        };
+        union sockaddr_union *snl;
         struct cmsghdr *cmsg;
         struct ucred *cred;
-        ssize_t buflen, bufpos;
+        ssize_t bufpos;
         bool is_initialized = false;
         int r;
 
+        assert(m);
+        assert(smsg);
+        assert(buf);
         assert(ret);
 
-        buflen = recvmsg(m->sock, &smsg, 0);
-        if (buflen < 0) {
-                if (errno != EINTR)
-                        log_debug_errno(errno, "sd-device-monitor: Failed to receive message: %m");
-                return -errno;
-        }
-
-        if (buflen < 32 || (smsg.msg_flags & MSG_TRUNC))
+        if (buflen < 32 || (smsg->msg_flags & MSG_TRUNC))
                 return log_debug_errno(SYNTHETIC_ERRNO(EINVAL),
                                        "sd-device-monitor: Invalid message length.");
 
-        if (snl.nl.nl_groups == MONITOR_GROUP_NONE) {
+        snl = smsg->msg_name;
+        if (snl->nl.nl_groups == MONITOR_GROUP_NONE) {
                 /* unicast message, check if we trust the sender */
                 if (m->snl_trusted_sender.nl.nl_pid == 0 ||
-                    snl.nl.nl_pid != m->snl_trusted_sender.nl.nl_pid)
+                    snl->nl.nl_pid != m->snl_trusted_sender.nl.nl_pid)
                         return log_debug_errno(SYNTHETIC_ERRNO(EAGAIN),
                                                "sd-device-monitor: Unicast netlink message ignored.");
 
-        } else if (snl.nl.nl_groups == MONITOR_GROUP_KERNEL) {
-                if (snl.nl.nl_pid > 0)
+        } else if (snl->nl.nl_groups == MONITOR_GROUP_KERNEL) {
+                if (snl->nl.nl_pid > 0)
                         return log_debug_errno(SYNTHETIC_ERRNO(EAGAIN),
-                                               "sd-device-monitor: Multicast kernel netlink message from PID %"PRIu32" ignored.", snl.nl.nl_pid);
+                                               "sd-device-monitor: Multicast kernel netlink message from PID %"PRIu32" ignored.", snl->nl.nl_pid);
         }
 
-        cmsg = CMSG_FIRSTHDR(&smsg);
+        cmsg = CMSG_FIRSTHDR(smsg);
         if (!cmsg || cmsg->cmsg_type != SCM_CREDENTIALS)
                 return log_debug_errno(SYNTHETIC_ERRNO(EAGAIN),
                                        "sd-device-monitor: No sender credentials received, message ignored.");
@@ -413,37 +433,37 @@ int device_monitor_receive_device(sd_device_monitor *m, sd_device **ret) {
                 return log_debug_errno(SYNTHETIC_ERRNO(EAGAIN),
                                        "sd-device-monitor: Sender uid="UID_FMT", message ignored.", cred->uid);
 
-        if (streq(buf.raw, "libudev")) {
+        if (streq(buf->raw, "libudev")) {
                 /* udev message needs proper version magic */
-                if (buf.nlh.magic != htobe32(UDEV_MONITOR_MAGIC))
+                if (buf->nlh.magic != htobe32(UDEV_MONITOR_MAGIC))
                         return log_debug_errno(SYNTHETIC_ERRNO(EAGAIN),
                                                "sd-device-monitor: Invalid message signature (%x != %x)",
-                                               buf.nlh.magic, htobe32(UDEV_MONITOR_MAGIC));
+                                               buf->nlh.magic, htobe32(UDEV_MONITOR_MAGIC));
 
-                if (buf.nlh.properties_off+32 > (size_t) buflen)
+                if (buf->nlh.properties_off+32 > (size_t) buflen)
                         return log_debug_errno(SYNTHETIC_ERRNO(EAGAIN),
                                                "sd-device-monitor: Invalid message length (%u > %zd)",
-                                               buf.nlh.properties_off+32, buflen);
+                                               buf->nlh.properties_off+32, buflen);
 
-                bufpos = buf.nlh.properties_off;
+                bufpos = buf->nlh.properties_off;
 
                 /* devices received from udev are always initialized */
                 is_initialized = true;
 
         } else {
                 /* kernel message with header */
-                bufpos = strlen(buf.raw) + 1;
+                bufpos = strlen(buf->raw) + 1;
                 if ((size_t) bufpos < sizeof("a@/d") || bufpos >= buflen)
                         return log_debug_errno(SYNTHETIC_ERRNO(EAGAIN),
                                                "sd-device-monitor: Invalid message length");
 
                 /* check message header */
-                if (!strstr(buf.raw, "@/"))
+                if (!strstr(buf->raw, "@/"))
                         return log_debug_errno(SYNTHETIC_ERRNO(EAGAIN),
                                                "sd-device-monitor: Invalid message header");
         }
 
-        r = device_new_from_nulstr(&device, (uint8_t*) &buf.raw[bufpos], buflen - bufpos);
+        r = device_new_from_nulstr(&device, (uint8_t*) &buf->raw[bufpos], buflen - bufpos);
         if (r < 0)
                 return log_debug_errno(r, "sd-device-monitor: Failed to create device from received message: %m");
 
@@ -462,6 +482,99 @@ int device_monitor_receive_device(sd_device_monitor *m, sd_device **ret) {
         return r;
 }
 
+int device_monitor_receive_device(sd_device_monitor *m, sd_device **ret) {
+        MonitorMessage buf;
+        struct iovec iov = {
+                .iov_base = &buf,
+                .iov_len = sizeof(buf)
+        };
+        char cred_msg[CMSG_SPACE(sizeof(struct ucred))];
+        union sockaddr_union snl;
+        struct msghdr smsg = {
+                .msg_iov = &iov,
+                .msg_iovlen = 1,
+                .msg_control = cred_msg,
+                .msg_controllen = sizeof(cred_msg),
+                .msg_name = &snl,
+                .msg_namelen = sizeof(snl),
+        };
+        ssize_t buflen;
+
+        assert(ret);
+
+        buflen = recvmsg(m->sock, &smsg, 0);
+        if (buflen < 0) {
+                if (errno != EINTR)
+                        log_debug_errno(errno, "sd-device-monitor: Failed to receive message: %m");
+                return -errno;
+        }
+
+        return device_monitor_process_message(m, &smsg, &buf, buflen, ret);
+}
+
+static int device_monitor_receive_devices(sd_device_monitor *m, sd_device **devices, size_t *ret_n) {
+        MonitorBatch *b;
+        size_t n_devices = 0;
+        unsigned i;
+        int n, r;
+
+        assert(m);
+        assert(devices);
+        assert(ret_n);
+
+        /* A broad subscriber sees uevents in bursts, e.g. on coldplug or when a disk with many partitions
+         * appears. Take everything that is queued, up to MONITOR_BATCH_MAX messages, with a single call,
+         * instead of waking up and receiving once per message. */
+
+        if (!m->batch) {
+                m->batch = new(MonitorBatch, 1);
+                if (!m->batch) {
+                        /* Let's not fail because of that, one message at a time works, too */
+                        *ret_n = 0;
+                        r = device_monitor_receive_device(m, devices);
+                        if (r > 0)
+                                *ret_n = 1;
+                        return r;
+                }
+        }
+
+        b = m->batch;
+
+        for (i = 0; i < MONITOR_BATCH_MAX; i++) {
+                b->iovecs[i] = IOVEC_MAKE(b->messages + i, sizeof(MonitorMessage));
+                b->msgs[i] = (struct mmsghdr) {
+                        .msg_hdr = {
+                                .msg_iov = b->iovecs + i,
+                                .msg_iovlen = 1,
+                                .msg_control = b->controls[i],
+                                .msg_controllen = sizeof(b->controls[i]),
+                                .msg_name = b->addrs + i,
+                                .msg_namelen = sizeof(b->addrs[i]),
+                        },
+                };
+        }
+
+        n = recvmmsg(m->sock, b->msgs, MONITOR_BATCH_MAX, MSG_DONTWAIT, NULL);
+        if (n < 0) {
+                if (!IN_SET(errno, EINTR, EAGAIN))
+                        log_debug_errno(errno, "sd-device-monitor: Failed to receive messages: %m");
+                *ret_n = 0;
+                return -errno;
+        }
+
+        for (i = 0; i < (unsigned) n; i++) {
+                sd_device *device = NULL;
+
+                /* Messages that don't pass, or are invalid, are skipped without affecting the others */
+                r = device_monitor_process_message(m, &b->msgs[i].msg_hdr, b->messages + i, b->msgs[i].msg_len, &device);
+                if (r > 0)
+                        devices[n_devices++] = device;
+        }
+
+        *ret_n = n_devices;
+        return 0;
+}
+
 static uint32_t string_hash32(const char *str) {
         return MurmurHash2(str, strlen(str), 0);
 }
@@ -562,43 +675,159 @@ int device_monitor_send_device(
         return count;
 }
 
+/* The subsystem matches are sorted by their hashes and looked up by bisection, with up to this many subsystems tested
+ * one after the other at the leaves of the search tree */
+#define BPF_SUBSYSTEM_LEAF_MAX 4U
+
+typedef struct SubsystemMatch {
+        uint32_t subsystem_hash;
+        uint32_t devtype_hash;
+        bool any_devtype;
+} SubsystemMatch;
+
+/* All emitters below only count the instructions if ins is NULL, so that the program can be sized before it is
+ * generated. */
+
 static void bpf_stmt(struct sock_filter *ins, unsigned *i,
                      unsigned short code, unsigned data) {
-        ins[(*i)++] = (struct sock_filter) {
-                .code = code,
-                .k = data,
-        };
+        if (ins)
+                ins[*i] = (struct sock_filter) {
+                        .code = code,
+                        .k = data,
+                };
+        (*i)++;
 }
 
 static void bpf_jmp(struct sock_filter *ins, unsigned *i,
                     unsigned short code, unsigned data,
                     unsigned short jt, unsigned short jf) {
-        ins[(*i)++] = (struct sock_filter) {
-                .code = code,
-                .jt = jt,
-                .jf = jf,
-                .k = data,
-        };
+        /* Conditional jumps can only skip up to 255 instructions, use BPF_JA for anything further */
+        assert(jt <= UINT8_MAX);
+        assert(jf <= UINT8_MAX);
+
+        if (ins)
+                ins[*i] = (struct sock_filter) {
+                        .code = code,
+                        .jt = jt,
+                        .jf = jf,
+                        .k = data,
+                };
+        (*i)++;
 }
 
-_public_ int sd_device_monitor_filter_update(sd_device_monitor *m) {
-        struct sock_filter ins[512] = {};
-        struct sock_fprog filter;
-        const char *subsystem, *devtype, *tag;
-        unsigned i = 0;
-        Iterator it;
+static int subsystem_match_compare(const SubsystemMatch *a, const SubsystemMatch *b) {
+        int r;
 
-        assert_return(m, -EINVAL);
+        r = CMP(a->subsystem_hash, b->subsystem_hash);
+        if (r != 0)
+                return r;
 
-        if (m->filter_uptodate)
+        /* Matches for any devtype first, they make the devtype irrelevant */
+        r = CMP(b->any_devtype, a->any_devtype);
+        if (r != 0)
+                return r;
+
+        return CMP(a->devtype_hash, b->devtype_hash);
+}
+
+static int bpf_subsystem_group(struct sock_filter *ins, unsigned *i, const SubsystemMatch *matches, size_t n) {
+        size_t j;
+
+        assert(i);
+        assert(matches);
+        assert(n > 0);
+
+        /* All matches here have the same subsystem hash, which is in A */
+
+        if (matches[0].any_devtype) {
+                /* jump to next subsystem if it does not match */
+                bpf_jmp(ins, i, BPF_JMP|BPF_JEQ|BPF_K, matches[0].subsystem_hash, 0, 1);
+                /* matched, pass packet */
+                bpf_stmt(ins, i, BPF_RET|BPF_K, 0xffffffff);
                 return 0;
+        }
 
-        if (hashmap_isempty(m->subsystem_filter) &&
-            set_isempty(m->tag_filter)) {
-                m->filter_uptodate = true;
+        if (n + 3 > UINT8_MAX)
+                return -E2BIG;
+
+        /* jump to next subsystem if it does not match */
+        bpf_jmp(ins, i, BPF_JMP|BPF_JEQ|BPF_K, matches[0].subsystem_hash, 0, n + 3);
+        /* load device devtype value in A */
+        bpf_stmt(ins, i, BPF_LD|BPF_W|BPF_ABS, offsetof(monitor_netlink_header, filter_devtype_hash));
+        /* jump to the pass statement below if any devtype matches */
+        for (j = 0; j < n; j++)
+                bpf_jmp(ins, i, BPF_JMP|BPF_JEQ|BPF_K, matches[j].devtype_hash, n - j, 0);
+        /* no other match can have this subsystem hash, drop packet */
+        bpf_stmt(ins, i, BPF_RET|BPF_K, 0);
+        /* matched, pass packet */
+        bpf_stmt(ins, i, BPF_RET|BPF_K, 0xffffffff);
+
+        return 0;
+}
+
+static int bpf_subsystem_tree(
+                struct sock_filter *ins,
+                unsigned *i,
+                const SubsystemMatch *matches,
+                const size_t *groups,
+                size_t lo,
+                size_t hi) {
+
+        size_t mid, g;
+        unsigned ja;
+        int r;
+
+        assert(i);
+        assert(matches);
+        assert(groups);
+        assert(lo < hi);
+
+        /* groups[g] is the index of the first match of the g-th distinct subsystem hash, and
+         * groups[g + 1] the end of its matches. The subsystem hash of the device is in A. */
+
+        if (hi - lo <= BPF_SUBSYSTEM_LEAF_MAX) {
+                for (g = lo; g < hi; g++) {
+                        r = bpf_subsystem_group(ins, i, matches + groups[g], groups[g + 1] - groups[g]);
+                        if (r < 0)
+                                return r;
+                }
+
+                /* nothing matched, drop packet */
+                bpf_stmt(ins, i, BPF_RET|BPF_K, 0);
                 return 0;
         }
 
+        mid = lo + (hi - lo) / 2;
+
+        /* hashes beyond the lower half are looked up in the upper half, jumping over the lower half's code */
+        bpf_jmp(ins, i, BPF_JMP|BPF_JGT|BPF_K, matches[groups[mid] - 1].subsystem_hash, 0, 1);
+        ja = *i;
+        bpf_stmt(ins, i, BPF_JMP|BPF_JA, 0);
+
+        r = bpf_subsystem_tree(ins, i, matches, groups, lo, mid);
+        if (r < 0)
+                return r;
+
+        if (ins)
+                ins[ja].k = *i - ja - 1;
+
+        return bpf_subsystem_tree(ins, i, matches, groups, mid, hi);
+}
+
+static int bpf_filter(
+                sd_device_monitor *m,
+                const SubsystemMatch *matches,
+                const size_t *groups,
+                size_t n_groups,
+                struct sock_filter *ins,
+                unsigned *ret_len) {
+
+        unsigned i = 0;
+        int r;
+
+        assert(m);
+        assert(ret_len);
+
         /* load magic in A */
         bpf_stmt(ins, &i, BPF_LD|BPF_W|BPF_ABS, offsetof(monitor_netlink_header, magic));
         /* jump if magic matches */
@@ -607,7 +836,9 @@ _public_ int sd_device_monitor_filter_update(sd_device_monitor *m) {
         bpf_stmt(ins, &i, BPF_RET|BPF_K, 0xffffffff);
 
         if (!set_isempty(m->tag_filter)) {
-                int tag_matches = set_size(m->tag_filter);
+                unsigned tag_matches = set_size(m->tag_filter);
+                const char *tag;
+                Iterator it;
 
                 /* add all tags matches */
                 SET_FOREACH(tag, m->tag_filter, it) {
@@ -620,15 +851,17 @@ _public_ int sd_device_monitor_filter_update(sd_device_monitor *m) {
                         /* clear bits (tag bits & bloom bits) */
                         bpf_stmt(ins, &i, BPF_ALU|BPF_AND|BPF_K, tag_bloom_hi);
                         /* jump to next tag if it does not match */
-                        bpf_jmp(ins, &i, BPF_JMP|BPF_JEQ|BPF_K, tag_bloom_hi, 0, 3);
+                        bpf_jmp(ins, &i, BPF_JMP|BPF_JEQ|BPF_K, tag_bloom_hi, 0, 4);
 
                         /* load device bloom bits in A */
                         bpf_stmt(ins, &i, BPF_LD|BPF_W|BPF_ABS, offsetof(monitor_netlink_header, filter_tag_bloom_lo));
                         /* clear bits (tag bits & bloom bits) */
                         bpf_stmt(ins, &i, BPF_ALU|BPF_AND|BPF_K, tag_bloom_lo);
-                        /* jump behind end of tag match block if tag matches */
+                        /* jump to next tag if it does not match */
+                        bpf_jmp(ins, &i, BPF_JMP|BPF_JEQ|BPF_K, tag_bloom_lo, 0, 1);
+                        /* jump behind end of tag match block, which may be further than a conditional jump reaches */
                         tag_matches--;
-                        bpf_jmp(ins, &i, BPF_JMP|BPF_JEQ|BPF_K, tag_bloom_lo, 1 + (tag_matches * 6), 0);
+                        bpf_stmt(ins, &i, BPF_JMP|BPF_JA, 1 + tag_matches * 7);
                 }
 
                 /* nothing matched, drop packet */
@@ -636,42 +869,86 @@ _public_ int sd_device_monitor_filter_update(sd_device_monitor *m) {
         }
 
         /* add all subsystem matches */
-        if (!hashmap_isempty(m->subsystem_filter)) {
-                HASHMAP_FOREACH_KEY(devtype, subsystem, m->subsystem_filter, it) {
-                        uint32_t hash = string_hash32(subsystem);
-
-                        /* load device subsystem value in A */
-                        bpf_stmt(ins, &i, BPF_LD|BPF_W|BPF_ABS, offsetof(monitor_netlink_header, filter_subsystem_hash));
-                        if (!devtype) {
-                                /* jump if subsystem does not match */
-                                bpf_jmp(ins, &i, BPF_JMP|BPF_JEQ|BPF_K, hash, 0, 1);
-                        } else {
-                                /* jump if subsystem does not match */
-                                bpf_jmp(ins, &i, BPF_JMP|BPF_JEQ|BPF_K, hash, 0, 3);
-                                /* load device devtype value in A */
-                                bpf_stmt(ins, &i, BPF_LD|BPF_W|BPF_ABS, offsetof(monitor_netlink_header, filter_devtype_hash));
-                                /* jump if value does not match */
-                                hash = string_hash32(devtype);
-                                bpf_jmp(ins, &i, BPF_JMP|BPF_JEQ|BPF_K, hash, 0, 1);
-                        }
-
-                        /* matched, pass packet */
-                        bpf_stmt(ins, &i, BPF_RET|BPF_K, 0xffffffff);
-
-                        if (i+1 >= ELEMENTSOF(ins))
-                                return -E2BIG;
-                }
+        if (n_groups > 0) {
+                /* load device subsystem value in A */
+                bpf_stmt(ins, &i, BPF_LD|BPF_W|BPF_ABS, offsetof(monitor_netlink_header, filter_subsystem_hash));
 
-                /* nothing matched, drop packet */
-                bpf_stmt(ins, &i, BPF_RET|BPF_K, 0);
+                r = bpf_subsystem_tree(ins, &i, matches, groups, 0, n_groups);
+                if (r < 0)
+                        return r;
         }
 
         /* matched, pass packet */
         bpf_stmt(ins, &i, BPF_RET|BPF_K, 0xffffffff);
 
+        *ret_len = i;
+        return 0;
+}
+
+_public_ int sd_device_monitor_filter_update(sd_device_monitor *m) {
+        _cleanup_free_ SubsystemMatch *matches = NULL;
+        _cleanup_free_ struct sock_filter *ins = NULL;
+        _cleanup_free_ size_t *groups = NULL;
+        size_t n_matches = 0, n_groups = 0, j;
+        const char *subsystem, *devtype;
+        struct sock_fprog filter;
+        unsigned len;
+        Iterator it;
+        int r;
+
+        assert_return(m, -EINVAL);
+
+        if (m->filter_uptodate)
+                return 0;
+
+        if (hashmap_isempty(m->subsystem_filter) &&
+            set_isempty(m->tag_filter)) {
+                m->filter_uptodate = true;
+                return 0;
+        }
+
+        if (!hashmap_isempty(m->subsystem_filter)) {
+                matches = new(SubsystemMatch, hashmap_size(m->subsystem_filter));
+                if (!matches)
+                        return -ENOMEM;
+
+                groups = new(size_t, hashmap_size(m->subsystem_filter) + 1);
+                if (!groups)
+                        return -ENOMEM;
+
+                HASHMAP_FOREACH_KEY(devtype, subsystem, m->subsystem_filter, it)
+                        matches[n_matches++] = (SubsystemMatch) {
+                                .subsystem_hash = string_hash32(subsystem),
+                                .devtype_hash = devtype ? string_hash32(devtype) : 0,
+                                .any_devtype = !devtype,
+                        };
+
+                typesafe_qsort(matches, n_matches, subsystem_match_compare);
+
+                for (j = 0; j < n_matches; j++)
+                        if (j == 0 || matches[j].subsystem_hash != matches[j - 1].subsystem_hash)
+                                groups[n_groups++] = j;
+                groups[n_groups] = n_matches;
+        }
+
+        /* First count the instructions, then generate them */
+        r = bpf_filter(m, matches, groups, n_groups, NULL, &len);
+        if (r < 0)
+                return r;
+        if (len > BPF_MAXINSNS)
+                return -E2BIG;
+
+        ins = new0(struct sock_filter, len);
+        if (!ins)
+                return -ENOMEM;
+
+        r = bpf_filter(m, matches, groups, n_groups, ins, &len);
+        if (r < 0)
+                return r;
+
         /* install filter */
         filter = (struct sock_fprog) {
-                .len = i,
+                .len = len,
                 .filter = ins,
         };
         if (setsockopt(m->sock, SOL_SOCKET, SO_ATTACH_FILTER, &filter, sizeof(filter)) < 0)
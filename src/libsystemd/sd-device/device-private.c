@@ -607,6 +607,15 @@ void device_set_watch_handle(sd_device *device, int handle) {
         device->watch_handle = handle;
 }
 
+void device_get_sysattr_statistics(sd_device *device, unsigned *ret_reads, unsigned *ret_cache_hits) {
+        assert(device);
+
+        if (ret_reads)
+                *ret_reads = device->sysattr_reads;
+        if (ret_cache_hits)
+                *ret_cache_hits = device->sysattr_cache_hits;
+}
+
 int device_rename(sd_device *device, const char *name) {
         _cleanup_free_ char *dirname = NULL;
         const char *new_syspath, *interface;
@@ -863,11 +872,25 @@ void device_set_db_persist(sd_device *device) {
         device->db_persist = true;
 }
 
+static void device_update_database(sd_device *device, const char *id, const char *data, size_t size) {
+        int r;
+
+        /* The per-device file is what counts, hence failing to update the database is not fatal, it is
+         * removed in that case */
+        if (data)
+                r = device_database_update(DEVICE_DATABASE_PATH, id, data, size);
+        else
+                r = device_database_remove(DEVICE_DATABASE_PATH, id);
+        if (r < 0)
+                log_device_debug_errno(device, r, "sd-device: Failed to update %s, ignoring: %m", DEVICE_DATABASE_PATH);
+}
+
 int device_update_db(sd_device *device) {
         const char *id;
         char *path;
-        _cleanup_fclose_ FILE *f = NULL;
-        _cleanup_free_ char *path_tmp = NULL;
+        _cleanup_fclose_ FILE *f = NULL, *m = NULL;
+        _cleanup_free_ char *path_tmp = NULL, *buf = NULL;
+        size_t buf_size = 0;
         bool has_info;
         int r;
 
@@ -887,6 +910,7 @@ int device_update_db(sd_device *device) {
                 if (r < 0 && errno != ENOENT)
                         return -errno;
 
+                device_update_database(device, id, NULL, 0);
                 return 0;
         }
 
@@ -917,6 +941,13 @@ int device_update_db(sd_device *device) {
                 }
         }
 
+        /* Format the contents in memory first, as they also go into the database */
+        m = open_memstream_unlocked(&buf, &buf_size);
+        if (!m) {
+                r = -ENOMEM;
+                goto fail;
+        }
+
         if (has_info) {
                 const char *property, *value, *tag;
                 Iterator i;
@@ -925,25 +956,31 @@ int device_update_db(sd_device *device) {
                         const char *devlink;
 
                         FOREACH_DEVICE_DEVLINK(device, devlink)
-                                fprintf(f, "S:%s\n", devlink + STRLEN("/dev/"));
+                                fprintf(m, "S:%s\n", devlink + STRLEN("/dev/"));
 
                         if (device->devlink_priority != 0)
-                                fprintf(f, "L:%i\n", device->devlink_priority);
+                                fprintf(m, "L:%i\n", device->devlink_priority);
 
                         if (device->watch_handle >= 0)
-                                fprintf(f, "W:%i\n", device->watch_handle);
+                                fprintf(m, "W:%i\n", device->watch_handle);
                 }
 
                 if (device->usec_initialized > 0)
-                        fprintf(f, "I:"USEC_FMT"\n", device->usec_initialized);
+                        fprintf(m, "I:"USEC_FMT"\n", device->usec_initialized);
 
                 ORDERED_HASHMAP_FOREACH_KEY(value, property, device->properties_db, i)
-                        fprintf(f, "E:%s=%s\n", property, value);
+                        fprintf(m, "E:%s=%s\n", property, value);
 
                 FOREACH_DEVICE_TAG(device, tag)
-                        fprintf(f, "G:%s\n", tag);
+                        fprintf(m, "G:%s\n", tag);
         }
 
+        r = fflush_and_check(m);
+        if (r < 0)
+                goto fail;
+
+        fwrite(buf, 1, buf_size, f);
+
         r = fflush_and_check(f);
         if (r < 0)
                 goto fail;
@@ -957,11 +994,13 @@ int device_update_db(sd_device *device) {
         log_device_debug(device, "sd-device: Created %s file '%s' for '%s'", has_info ? "db" : "empty",
                          path, device->devpath);
 
+        device_update_database(device, id, buf ?: "", buf_size);
         return 0;
 
 fail:
         (void) unlink(path);
         (void) unlink(path_tmp);
+        device_update_database(device, id, NULL, 0);
 
         return log_device_debug_errno(device, r, "sd-device: Failed to create %s file '%s' for '%s'", has_info ? "db" : "empty", path, device->devpath);
 }
@@ -983,6 +1022,7 @@ int device_delete_db(sd_device *device) {
         if (r < 0 && errno != ENOENT)
                 return -errno;
 
+        device_update_database(device, id, NULL, 0);
         return 0;
 }
 
@@ -58,6 +58,8 @@ int device_properties_prepare(sd_device *device);
 int device_get_properties_nulstr(sd_device *device, const uint8_t **nulstr, size_t *len);
 int device_get_properties_strv(sd_device *device, char ***strv);
 
+void device_get_sysattr_statistics(sd_device *device, unsigned *ret_reads, unsigned *ret_cache_hits);
+
 int device_rename(sd_device *device, const char *name);
 int device_shallow_clone(sd_device *old_device, sd_device **new_device);
 int device_clone_with_db(sd_device *old_device, sd_device **new_device);
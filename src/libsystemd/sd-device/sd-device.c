@@ -1278,10 +1278,9 @@ int device_get_id_filename(sd_device *device, const char **ret) {
         return 0;
 }
 
-int device_read_db_internal_filename(sd_device *device, const char *filename) {
-        _cleanup_free_ char *db = NULL;
+static int device_parse_db(sd_device *device, char *db, size_t db_len) {
         const char *value;
-        size_t db_len, i;
+        size_t i;
         char key;
         int r;
 
@@ -1294,15 +1293,7 @@ int device_read_db_internal_filename(sd_device *device, const char *filename) {
         } state = PRE_KEY;
 
         assert(device);
-        assert(filename);
-
-        r = read_full_file(filename, &db, &db_len);
-        if (r < 0) {
-                if (r == -ENOENT)
-                        return 0;
-
-                return log_device_debug_errno(device, r, "sd-device: Failed to read db '%s': %m", filename);
-        }
+        assert(db || db_len == 0);
 
         /* devices with a database entry are initialized */
         device->is_initialized = true;
@@ -1361,6 +1352,58 @@ int device_read_db_internal_filename(sd_device *device, const char *filename) {
         return 0;
 }
 
+int device_read_db_internal_filename(sd_device *device, const char *filename) {
+        _cleanup_free_ char *db = NULL;
+        size_t db_len;
+        int r;
+
+        assert(device);
+        assert(filename);
+
+        r = read_full_file(filename, &db, &db_len);
+        if (r < 0) {
+                if (r == -ENOENT)
+                        return 0;
+
+                return log_device_debug_errno(device, r, "sd-device: Failed to read db '%s': %m", filename);
+        }
+
+        return device_parse_db(device, db, db_len);
+}
+
+int device_read_db_from_database(sd_device *device, DeviceDatabase *database) {
+        _cleanup_free_ char *db = NULL;
+        const char *id, *data;
+        size_t size;
+        int r;
+
+        assert(device);
+        assert(database);
+
+        if (device->db_loaded || device->sealed)
+                return 0;
+
+        r = device_get_id_filename(device, &id);
+        if (r < 0)
+                return r;
+
+        r = device_database_get(database, id, &data, &size);
+        if (r == -ENOENT) {
+                /* The database covers all devices, hence there's no file to look for either */
+                device->db_loaded = true;
+                return 0;
+        }
+        if (r < 0)
+                return r;
+
+        /* The parser modifies the buffer, and the database is mapped read-only */
+        db = memdup_suffix0(data, size);
+        if (!db)
+                return -ENOMEM;
+
+        return device_parse_db(device, db, size);
+}
+
 int device_read_db_internal(sd_device *device, bool force) {
         const char *id, *path;
         int r;
@@ -1744,6 +1787,8 @@ _public_ int sd_device_get_sysattr_value(sd_device *device, const char *sysattr,
                 if (r < 0)
                         return r;
 
+                device->sysattr_cache_hits++;
+
                 if (!cached_value)
                         /* we looked up the sysattr before and it did not exist */
                         return -ENOENT;
@@ -1758,6 +1803,8 @@ _public_ int sd_device_get_sysattr_value(sd_device *device, const char *sysattr,
         if (r < 0)
                 return r;
 
+        device->sysattr_reads++;
+
         path = prefix_roota(syspath, sysattr);
         r = lstat(path, &statbuf);
         if (r < 0) {
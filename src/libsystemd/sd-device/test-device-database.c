@@ -0,0 +1,151 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "device-database.h"
+#include "fd-util.h"
+#include "fileio.h"
+#include "path-util.h"
+#include "rm-rf.h"
+#include "string-util.h"
+#include "tests.h"
+#include "tmpfile-util.h"
+
+static void assert_record(DeviceDatabase *db, const char *id, const char *expected) {
+        const char *data;
+        size_t size;
+
+        if (!expected) {
+                assert_se(device_database_get(db, id, NULL, NULL) == -ENOENT);
+                return;
+        }
+
+        assert_se(device_database_get(db, id, &data, &size) >= 0);
+        assert_se(size == strlen(expected));
+        assert_se(memcmp(data, expected, size) == 0);
+}
+
+static void test_device_database(void) {
+        _cleanup_(rm_rf_physical_and_freep) char *t = NULL;
+        _cleanup_(device_database_freep) DeviceDatabase *db = NULL;
+        _cleanup_free_ char *dir = NULL, *path = NULL, *p = NULL;
+        struct stat st;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(mkdtemp_malloc("/tmp/test-device-database.XXXXXX", &t) >= 0);
+        assert_se(dir = path_join(t, "data"));
+        assert_se(path = path_join(t, "data.bin"));
+        assert_se(mkdir(dir, 0755) >= 0);
+
+        /* Without a database, updates are not recorded anywhere */
+        assert_se(device_database_update(path, "b8:0", "E:FOO=1\n", 8) >= 0);
+        assert_se(device_database_open(path, &db) == -ENOENT);
+
+        assert_se(p = path_join(dir, "b8:0"));
+        assert_se(write_string_file(p, "E:ID_BUS=ata\nG:systemd", WRITE_STRING_FILE_CREATE) >= 0);
+        p = mfree(p);
+        assert_se(p = path_join(dir, "n1"));
+        assert_se(write_string_file(p, "I:1234", WRITE_STRING_FILE_CREATE) >= 0);
+
+        assert_se(device_database_rebuild(path, dir) >= 0);
+        assert_se(device_database_open(path, &db) >= 0);
+        assert_se(device_database_size(db) == 2);
+        assert_record(db, "b8:0", "E:ID_BUS=ata\nG:systemd\n");
+        assert_record(db, "n1", "I:1234\n");
+        assert_record(db, "c1:3", NULL);
+        db = device_database_free(db);
+
+        assert_se(device_database_update(path, "c1:3", "", 0) >= 0);
+        assert_se(device_database_update(path, "n1", "I:5678\n", 7) >= 0);
+        assert_se(device_database_remove(path, "b8:0") >= 0);
+        assert_se(device_database_remove(path, "b8:16") >= 0);
+
+        assert_se(device_database_open(path, &db) >= 0);
+        assert_se(device_database_size(db) == 2);
+        assert_record(db, "b8:0", NULL);
+        assert_record(db, "n1", "I:5678\n");
+        assert_record(db, "c1:3", "");
+        db = device_database_free(db);
+
+        /* Supersede the same entry until the file is large enough to be compacted */
+        do
+                assert_se(device_database_update(path, "n1", "I:9999\n", 7) >= 0);
+        while (stat(path, &st) >= 0 && st.st_size < 2 * 1024 * 1024);
+
+        assert_se(device_database_vacuum(path) > 0);
+        assert_se(stat(path, &st) >= 0);
+        assert_se(st.st_size < 1024);
+        assert_se(device_database_vacuum(path) == 0);
+
+        assert_se(device_database_open(path, &db) >= 0);
+        assert_se(device_database_size(db) == 2);
+        assert_record(db, "n1", "I:9999\n");
+        assert_record(db, "c1:3", "");
+}
+
+static void test_device_database_invalid(void) {
+        char path[] = "/tmp/test-device-database-invalid.XXXXXX";
+        _cleanup_(device_database_freep) DeviceDatabase *db = NULL;
+        _cleanup_close_ int fd = -1;
+
+        log_info("/* %s */", __func__);
+
+        assert_se((fd = mkostemp_safe(path)) >= 0);
+        assert_se(write(fd, "garbage", 7) == 7);
+
+        assert_se(device_database_open(path, &db) == -EBADMSG);
+
+        /* Rather than appending to something we don't understand, the file is removed */
+        assert_se(device_database_update(path, "n1", "I:1\n", 4) == -EBADMSG);
+        assert_se(access(path, F_OK) < 0 && errno == ENOENT);
+}
+
+static void test_device_database_partial(void) {
+        _cleanup_(rm_rf_physical_and_freep) char *t = NULL;
+        _cleanup_(device_database_freep) DeviceDatabase *db = NULL;
+        _cleanup_free_ char *dir = NULL, *path = NULL;
+        struct stat st;
+        off_t size;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(mkdtemp_malloc("/tmp/test-device-database.XXXXXX", &t) >= 0);
+        assert_se(dir = path_join(t, "data"));
+        assert_se(path = path_join(t, "data.bin"));
+        assert_se(mkdir(dir, 0755) >= 0);
+
+        assert_se(device_database_rebuild(path, dir) >= 0);
+        assert_se(device_database_update(path, "n1", "I:1234\n", 7) >= 0);
+        assert_se(stat(path, &st) >= 0);
+        size = st.st_size;
+        assert_se(device_database_update(path, "n2", "I:5678\n", 7) >= 0);
+        assert_se(stat(path, &st) >= 0);
+
+        /* A reader might see the tail offset of a record the writer hasn't completely written when the reader
+         * looked at the size of the file. That record is skipped, rather than rejecting the whole file. */
+        assert_se(truncate(path, size + (st.st_size - size) / 2) >= 0);
+        assert_se(device_database_open(path, &db) >= 0);
+        assert_se(device_database_size(db) == 1);
+        assert_record(db, "n1", "I:1234\n");
+        assert_record(db, "n2", NULL);
+        db = device_database_free(db);
+
+        /* Even if not even the start of the record made it */
+        assert_se(truncate(path, size + 4) >= 0);
+        assert_se(device_database_open(path, &db) >= 0);
+        assert_se(device_database_size(db) == 1);
+        assert_record(db, "n1", "I:1234\n");
+}
+
+int main(int argc, char *argv[]) {
+        test_setup_logging(LOG_DEBUG);
+
+        test_device_database();
+        test_device_database_invalid();
+        test_device_database_partial();
+
+        return 0;
+}
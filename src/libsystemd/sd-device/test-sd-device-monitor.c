@@ -10,6 +10,7 @@
 #include "device-private.h"
 #include "device-util.h"
 #include "macro.h"
+#include "stdio-util.h"
 #include "string-util.h"
 #include "tests.h"
 #include "util.h"
@@ -157,6 +158,79 @@ static void test_sd_device_monitor_filter_remove(sd_device *device) {
         assert_se(sd_event_loop(sd_device_monitor_get_event(monitor_client)) == 100);
 }
 
+static void test_subsystem_filter_many(sd_device *device) {
+        _cleanup_(sd_device_monitor_unrefp) sd_device_monitor *monitor_server = NULL, *monitor_client = NULL;
+        const char *syspath, *subsystem;
+        unsigned i;
+
+        log_device_info(device, "/* %s */", __func__);
+
+        assert_se(sd_device_get_syspath(device, &syspath) >= 0);
+        assert_se(sd_device_get_subsystem(device, &subsystem) >= 0);
+
+        assert_se(device_monitor_new_full(&monitor_server, MONITOR_GROUP_NONE, -1) >= 0);
+        assert_se(sd_device_monitor_start(monitor_server, NULL, NULL) >= 0);
+        assert_se(sd_event_source_set_description(sd_device_monitor_get_event_source(monitor_server), "sender") >= 0);
+
+        assert_se(device_monitor_new_full(&monitor_client, MONITOR_GROUP_NONE, -1) >= 0);
+        assert_se(device_monitor_allow_unicast_sender(monitor_client, monitor_server) >= 0);
+        assert_se(sd_device_monitor_start(monitor_client, monitor_handler, (void *) syspath) >= 0);
+        assert_se(sd_event_source_set_description(sd_device_monitor_get_event_source(monitor_client), "receiver") >= 0);
+
+        /* More matches than a linear filter program could jump over */
+        for (i = 0; i < 500; i++) {
+                char s[DECIMAL_STR_MAX(unsigned) + 5], d[DECIMAL_STR_MAX(unsigned) + 5];
+
+                xsprintf(s, "hoge%u", i);
+                assert_se(sd_device_monitor_filter_add_match_subsystem_devtype(monitor_client, s, NULL) >= 0);
+
+                if (i < 100) {
+                        xsprintf(d, "foo%u", i);
+                        assert_se(sd_device_monitor_filter_add_match_subsystem_devtype(monitor_client, "hogehoge", d) >= 0);
+                }
+        }
+        assert_se(sd_device_monitor_filter_update(monitor_client) >= 0);
+
+        assert_se(device_monitor_send_device(monitor_server, monitor_client, device) >= 0);
+        assert_se(sd_event_run(sd_device_monitor_get_event(monitor_client), 0) >= 0);
+
+        assert_se(sd_device_monitor_filter_add_match_subsystem_devtype(monitor_client, subsystem, NULL) >= 0);
+        assert_se(sd_device_monitor_filter_update(monitor_client) >= 0);
+
+        assert_se(device_monitor_send_device(monitor_server, monitor_client, device) >= 0);
+        assert_se(sd_event_loop(sd_device_monitor_get_event(monitor_client)) == 100);
+}
+
+static int monitor_count_handler(sd_device_monitor *m, sd_device *d, void *userdata) {
+        unsigned *n = userdata;
+
+        (*n)++;
+        return 0;
+}
+
+static void test_receive_batch(sd_device *device) {
+        _cleanup_(sd_device_monitor_unrefp) sd_device_monitor *monitor_server = NULL, *monitor_client = NULL;
+        unsigned i, n = 0;
+
+        log_device_info(device, "/* %s */", __func__);
+
+        assert_se(device_monitor_new_full(&monitor_server, MONITOR_GROUP_NONE, -1) >= 0);
+        assert_se(sd_device_monitor_start(monitor_server, NULL, NULL) >= 0);
+        assert_se(sd_event_source_set_description(sd_device_monitor_get_event_source(monitor_server), "sender") >= 0);
+
+        assert_se(device_monitor_new_full(&monitor_client, MONITOR_GROUP_NONE, -1) >= 0);
+        assert_se(device_monitor_allow_unicast_sender(monitor_client, monitor_server) >= 0);
+        assert_se(sd_device_monitor_start(monitor_client, monitor_count_handler, &n) >= 0);
+        assert_se(sd_event_source_set_description(sd_device_monitor_get_event_source(monitor_client), "receiver") >= 0);
+
+        for (i = 0; i < 5; i++)
+                assert_se(device_monitor_send_device(monitor_server, monitor_client, device) >= 0);
+
+        /* All queued messages are dispatched in one wakeup */
+        assert_se(sd_event_run(sd_device_monitor_get_event(monitor_client), 0) > 0);
+        assert_se(n == 5);
+}
+
 static void test_device_copy_properties(sd_device *device) {
         _cleanup_(sd_device_unrefp) sd_device *copy = NULL;
 
@@ -195,6 +269,8 @@ int main(int argc, char *argv[]) {
 
         test_subsystem_filter(loopback);
         test_sd_device_monitor_filter_remove(loopback);
+        test_subsystem_filter_many(loopback);
+        test_receive_batch(loopback);
         test_device_copy_properties(loopback);
 
         r = sd_device_new_from_subsystem_sysname(&sda, "block", "sda");
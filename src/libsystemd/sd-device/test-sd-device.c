@@ -81,6 +81,42 @@ static void test_sd_device_enumerator_subsystems(void) {
                 test_sd_device_one(d);
 }
 
+static void test_sd_device_enumerator_threads(void) {
+        _cleanup_(sd_device_enumerator_unrefp) sd_device_enumerator *e = NULL, *t = NULL;
+        sd_device **devices, **devices_threaded;
+        size_t n, n_threaded, i;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(unsetenv("SYSTEMD_DEVICE_ENUMERATOR_THREADS") >= 0);
+        assert_se(sd_device_enumerator_new(&e) >= 0);
+        assert_se(sd_device_enumerator_allow_uninitialized(e) >= 0);
+        assert_se(device_enumerator_scan_devices(e) >= 0);
+        devices = device_enumerator_get_devices(e, &n);
+        assert_se(devices || n == 0);
+
+        assert_se(setenv("SYSTEMD_DEVICE_ENUMERATOR_THREADS", "4", 1) >= 0);
+        assert_se(sd_device_enumerator_new(&t) >= 0);
+        assert_se(unsetenv("SYSTEMD_DEVICE_ENUMERATOR_THREADS") >= 0);
+        assert_se(sd_device_enumerator_allow_uninitialized(t) >= 0);
+        assert_se(device_enumerator_scan_devices(t) >= 0);
+        devices_threaded = device_enumerator_get_devices(t, &n_threaded);
+        assert_se(devices_threaded || n_threaded == 0);
+
+        /* Devices may come and go in between, but on a quiet system both scans see the same, in the same order */
+        log_info("serial scan: %zu devices, threaded scan: %zu devices", n, n_threaded);
+        if (n != n_threaded)
+                return;
+
+        for (i = 0; i < n; i++) {
+                const char *a, *b;
+
+                assert_se(sd_device_get_syspath(devices[i], &a) >= 0);
+                assert_se(sd_device_get_syspath(devices_threaded[i], &b) >= 0);
+                assert_se(streq(a, b));
+        }
+}
+
 static unsigned test_sd_device_enumerator_filter_subsystem_one(const char *subsystem, Hashmap *h) {
         _cleanup_(sd_device_enumerator_unrefp) sd_device_enumerator *e = NULL;
         sd_device *d, *t;
@@ -161,12 +197,33 @@ static void test_sd_device_enumerator_filter_subsystem(void) {
         assert_se(n_new_dev <= 10);
 }
 
+static void test_sd_device_sysattr_statistics(void) {
+        _cleanup_(sd_device_unrefp) sd_device *d = NULL;
+        const char *val;
+        unsigned reads, cache_hits;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(sd_device_new_from_subsystem_sysname(&d, "net", "lo") >= 0);
+
+        assert_se(sd_device_get_sysattr_value(d, "address", &val) >= 0);
+        assert_se(sd_device_get_sysattr_value(d, "address", &val) >= 0);
+        assert_se(sd_device_get_sysattr_value(d, "hoge", &val) == -ENOENT);
+        assert_se(sd_device_get_sysattr_value(d, "hoge", &val) == -ENOENT);
+
+        device_get_sysattr_statistics(d, &reads, &cache_hits);
+        assert_se(reads == 2);
+        assert_se(cache_hits == 2);
+}
+
 int main(int argc, char **argv) {
         test_setup_logging(LOG_INFO);
 
         test_sd_device_enumerator_devices();
         test_sd_device_enumerator_subsystems();
+        test_sd_device_enumerator_threads();
         test_sd_device_enumerator_filter_subsystem();
+        test_sd_device_sysattr_statistics();
 
         return 0;
 }
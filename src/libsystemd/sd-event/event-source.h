@@ -11,6 +11,7 @@
 #include "hashmap.h"
 #include "list.h"
 #include "prioq.h"
+#include "timer-wheel.h"
 
 typedef enum EventSourceType {
         SOURCE_IO,
@@ -67,6 +68,12 @@ struct sd_event_source {
         uint64_t pending_iteration;
         uint64_t prepare_iteration;
 
+        /* Dispatch statistics: how often the callback ran, how long it took, and how long after the event
+         * loop woke up it was invoked */
+        uint64_t n_dispatched;
+        usec_t dispatch_usec_total, dispatch_usec_max;
+        usec_t latency_usec_total, latency_usec_max;
+
         sd_event_destroy_t destroy_callback;
 
         LIST_FIELDS(sd_event_source, sources);
@@ -79,12 +86,16 @@ struct sd_event_source {
                         uint32_t revents;
                         bool registered:1;
                         bool owned:1;
+                        bool disarmed:1; /* registered with EPOLLONESHOT and triggered, i.e. inert until re-armed */
                 } io;
                 struct {
                         sd_event_time_handler_t callback;
                         usec_t next, accuracy;
                         unsigned earliest_index;
                         unsigned latest_index;
+                        TimerWheelItem earliest_item;
+                        TimerWheelItem latest_item;
+                        bool wheel:1; /* whether kept in the timer wheels rather than the prioqs */
                 } time;
                 struct {
                         sd_event_signal_handler_t callback;
@@ -131,10 +142,16 @@ struct clock_data {
          * dispatched, and one ordered by the latest times they must
          * have been dispatched. The range between the top entries in
          * the two prioqs is the time window we can freely schedule
-         * wakeups in */
+         * wakeups in.
+         *
+         * Event sources with some accuracy slack are instead kept in
+         * the same way in two timer wheels, which are cheaper to
+         * update when the sources are rescheduled frequently. */
 
         Prioq *earliest;
         Prioq *latest;
+        TimerWheel *wheel_earliest;
+        TimerWheel *wheel_latest;
         usec_t next;
 
         bool needs_rearm:1;
@@ -29,6 +29,9 @@
 
 #define DEFAULT_ACCURACY_USEC (250 * USEC_PER_MSEC)
 
+/* Time event sources with at least this much accuracy slack are kept in the timer wheels instead of the prioqs */
+#define WHEEL_ACCURACY_MIN_USEC (1 * USEC_PER_MSEC)
+
 static bool EVENT_SOURCE_WATCH_PIDFD(sd_event_source *s) {
         /* Returns true if this is a PID event source and can be implemented by watching EPOLLIN */
         return s &&
@@ -105,6 +108,7 @@ struct sd_event {
         bool need_process_child:1;
         bool watchdog:1;
         bool profile_delays:1;
+        bool timer_wheel:1;
 
         int exit_code;
 
@@ -115,6 +119,12 @@ struct sd_event {
 
         unsigned n_sources;
 
+        /* How many pending sources of the same priority to dispatch per iteration, 0 or 1 for just one */
+        unsigned dispatch_batch;
+
+        /* When the previous callback of this iteration returned, i.e. when the next one is dispatched */
+        usec_t dispatch_timestamp;
+
         struct epoll_event *event_queue;
         size_t event_queue_allocated;
 
@@ -179,52 +189,32 @@ static int prepare_prioq_compare(const void *a, const void *b) {
         return CMP(x->priority, y->priority);
 }
 
-static int earliest_time_prioq_compare(const void *a, const void *b) {
-        const sd_event_source *x = a, *y = b;
+static uint64_t time_prioq_key(const sd_event_source *s, usec_t t) {
+        assert(EVENT_SOURCE_IS_TIME(s->type));
 
-        assert(EVENT_SOURCE_IS_TIME(x->type));
-        assert(x->type == y->type);
+        /* Enabled ones first, ordered by time, then the pending ones, then the disabled ones */
+        if (s->enabled == SD_EVENT_OFF)
+                return UINT64_MAX;
+        if (s->pending)
+                return UINT64_MAX - 1;
 
-        /* Enabled ones first */
-        if (x->enabled != SD_EVENT_OFF && y->enabled == SD_EVENT_OFF)
-                return -1;
-        if (x->enabled == SD_EVENT_OFF && y->enabled != SD_EVENT_OFF)
-                return 1;
+        return MIN(t, UINT64_MAX - 2);
+}
 
-        /* Move the pending ones to the end */
-        if (!x->pending && y->pending)
-                return -1;
-        if (x->pending && !y->pending)
-                return 1;
+static uint64_t earliest_time_prioq_key(const void *a) {
+        const sd_event_source *s = a;
 
-        /* Order by time */
-        return CMP(x->time.next, y->time.next);
+        return time_prioq_key(s, s->time.next);
 }
 
 static usec_t time_event_source_latest(const sd_event_source *s) {
         return usec_add(s->time.next, s->time.accuracy);
 }
 
-static int latest_time_prioq_compare(const void *a, const void *b) {
-        const sd_event_source *x = a, *y = b;
-
-        assert(EVENT_SOURCE_IS_TIME(x->type));
-        assert(x->type == y->type);
-
-        /* Enabled ones first */
-        if (x->enabled != SD_EVENT_OFF && y->enabled == SD_EVENT_OFF)
-                return -1;
-        if (x->enabled == SD_EVENT_OFF && y->enabled != SD_EVENT_OFF)
-                return 1;
-
-        /* Move the pending ones to the end */
-        if (!x->pending && y->pending)
-                return -1;
-        if (x->pending && !y->pending)
-                return 1;
+static uint64_t latest_time_prioq_key(const void *a) {
+        const sd_event_source *s = a;
 
-        /* Order by time */
-        return CMP(time_event_source_latest(x), time_event_source_latest(y));
+        return time_prioq_key(s, time_event_source_latest(s));
 }
 
 static int exit_prioq_compare(const void *a, const void *b) {
@@ -250,6 +240,8 @@ static void free_clock_data(struct clock_data *d) {
         safe_close(d->fd);
         prioq_free(d->earliest);
         prioq_free(d->latest);
+        timer_wheel_free(d->wheel_earliest);
+        timer_wheel_free(d->wheel_latest);
 }
 
 static sd_event *event_free(sd_event *e) {
@@ -344,6 +336,8 @@ _public_ int sd_event_new(sd_event** ret) {
                 e->profile_delays = true;
         }
 
+        e->timer_wheel = getenv_bool_secure("SYSTEMD_EVENT_TIMER_WHEEL") != 0;
+
         *ret = e;
         return 0;
 
@@ -384,6 +378,24 @@ static void source_io_unregister(sd_event_source *s) {
                                 strna(s->description), event_source_type_to_string(s->type));
 
         s->io.registered = false;
+        s->io.disarmed = false;
+}
+
+static void source_io_disable_disarmed(sd_event_source *s) {
+        assert(s);
+        assert(s->type == SOURCE_IO);
+        assert(s->io.disarmed);
+
+        /* Disables a oneshot source when it is dispatched. The kernel disarmed the registration already when
+         * reporting the event, and it won't report anything until it is modified again. Keep it registered
+         * then, so that enabling the source again only needs EPOLL_CTL_MOD instead of EPOLL_CTL_DEL followed
+         * by EPOLL_CTL_ADD. Sources that are disabled explicitly are always removed from the epoll set, so
+         * that their fd may be closed right away. */
+
+        s->enabled = SD_EVENT_OFF;
+
+        if (s->prepare)
+                prioq_reshuffle(s->event->prepare, s, &s->prepare_index);
 }
 
 static int source_io_register(
@@ -409,6 +421,7 @@ static int source_io_register(
                 return -errno;
 
         s->io.registered = true;
+        s->io.disarmed = false;
 
         return 0;
 }
@@ -529,6 +542,31 @@ static struct clock_data* event_get_clock_data(sd_event *e, EventSourceType t) {
         }
 }
 
+static void event_source_time_reshuffle(sd_event_source *s, struct clock_data *d) {
+        assert(s);
+        assert(EVENT_SOURCE_IS_TIME(s->type));
+        assert(d);
+
+        /* Needs to be called whenever the time, accuracy, enabled or pending state of a time event source
+         * changed. Sources in the timer wheels are only linked in while they may elapse, the prioqs instead
+         * sort disabled and pending ones to the end. */
+
+        if (s->time.wheel) {
+                if (s->enabled == SD_EVENT_OFF || s->pending || s->time.next == USEC_INFINITY) {
+                        timer_wheel_remove(d->wheel_earliest, &s->time.earliest_item);
+                        timer_wheel_remove(d->wheel_latest, &s->time.latest_item);
+                } else {
+                        timer_wheel_put(d->wheel_earliest, &s->time.earliest_item, s->time.next);
+                        timer_wheel_put(d->wheel_latest, &s->time.latest_item, time_event_source_latest(s));
+                }
+        } else {
+                prioq_reshuffle(d->earliest, s, &s->time.earliest_index);
+                prioq_reshuffle(d->latest, s, &s->time.latest_index);
+        }
+
+        d->needs_rearm = true;
+}
+
 static void event_free_signal_data(sd_event *e, struct signal_data *d) {
         assert(e);
 
@@ -732,8 +770,13 @@ static void source_disconnect(sd_event_source *s) {
                 d = event_get_clock_data(s->event, s->type);
                 assert(d);
 
-                prioq_remove(d->earliest, s, &s->time.earliest_index);
-                prioq_remove(d->latest, s, &s->time.latest_index);
+                if (s->time.wheel) {
+                        timer_wheel_remove(d->wheel_earliest, &s->time.earliest_item);
+                        timer_wheel_remove(d->wheel_latest, &s->time.latest_item);
+                } else {
+                        prioq_remove(d->earliest, s, &s->time.earliest_index);
+                        prioq_remove(d->latest, s, &s->time.latest_index);
+                }
                 d->needs_rearm = true;
                 break;
         }
@@ -916,9 +959,7 @@ static int source_set_pending(sd_event_source *s, bool b) {
                 d = event_get_clock_data(s->event, s->type);
                 assert(d);
 
-                prioq_reshuffle(d->earliest, s, &s->time.earliest_index);
-                prioq_reshuffle(d->latest, s, &s->time.latest_index);
-                d->needs_rearm = true;
+                event_source_time_reshuffle(s, d);
         }
 
         if (s->type == SOURCE_SIGNAL && !b) {
@@ -1083,6 +1124,7 @@ _public_ int sd_event_add_time(
         EventSourceType type;
         _cleanup_(source_freep) sd_event_source *s = NULL;
         struct clock_data *d;
+        bool wheel;
         int r;
 
         assert_return(e, -EINVAL);
@@ -1101,16 +1143,34 @@ _public_ int sd_event_add_time(
         if (!callback)
                 callback = time_exit_callback;
 
+        if (accuracy == 0)
+                accuracy = DEFAULT_ACCURACY_USEC;
+
         d = event_get_clock_data(e, type);
         assert(d);
 
-        r = prioq_ensure_allocated(&d->earliest, earliest_time_prioq_compare);
-        if (r < 0)
-                return r;
+        wheel = e->timer_wheel && accuracy >= WHEEL_ACCURACY_MIN_USEC;
+        if (wheel) {
+                if (!d->wheel_earliest) {
+                        d->wheel_earliest = timer_wheel_new(now(clock));
+                        if (!d->wheel_earliest)
+                                return -ENOMEM;
+                }
 
-        r = prioq_ensure_allocated(&d->latest, latest_time_prioq_compare);
-        if (r < 0)
-                return r;
+                if (!d->wheel_latest) {
+                        d->wheel_latest = timer_wheel_new(now(clock));
+                        if (!d->wheel_latest)
+                                return -ENOMEM;
+                }
+        } else {
+                r = prioq_ensure_allocated_keyed(&d->earliest, earliest_time_prioq_key);
+                if (r < 0)
+                        return r;
+
+                r = prioq_ensure_allocated_keyed(&d->latest, latest_time_prioq_key);
+                if (r < 0)
+                        return r;
+        }
 
         if (d->fd < 0) {
                 r = event_setup_timer_fd(e, d, clock);
@@ -1123,21 +1183,26 @@ _public_ int sd_event_add_time(
                 return -ENOMEM;
 
         s->time.next = usec;
-        s->time.accuracy = accuracy == 0 ? DEFAULT_ACCURACY_USEC : accuracy;
+        s->time.accuracy = accuracy;
         s->time.callback = callback;
         s->time.earliest_index = s->time.latest_index = PRIOQ_IDX_NULL;
+        s->time.wheel = wheel;
         s->userdata = userdata;
         s->enabled = SD_EVENT_ONESHOT;
 
         d->needs_rearm = true;
 
-        r = prioq_put(d->earliest, s, &s->time.earliest_index);
-        if (r < 0)
-                return r;
+        if (wheel)
+                event_source_time_reshuffle(s, d);
+        else {
+                r = prioq_put(d->earliest, s, &s->time.earliest_index);
+                if (r < 0)
+                        return r;
 
-        r = prioq_put(d->latest, s, &s->time.latest_index);
-        if (r < 0)
-                return r;
+                r = prioq_put(d->latest, s, &s->time.latest_index);
+                if (r < 0)
+                        return r;
+        }
 
         if (ret)
                 *ret = s;
@@ -1965,8 +2030,9 @@ _public_ int sd_event_source_set_io_fd(sd_event_source *s, int fd) {
                 return 0;
 
         if (s->enabled == SD_EVENT_OFF) {
+                /* A disabled source might still be registered in disarmed state */
+                source_io_unregister(s);
                 s->io.fd = fd;
-                s->io.registered = false;
         } else {
                 int saved_fd;
 
@@ -2196,8 +2262,14 @@ _public_ int sd_event_source_set_enabled(sd_event_source *s, int m) {
         if (s->event->state == SD_EVENT_FINISHED)
                 return m == SD_EVENT_OFF ? 0 : -ESTALE;
 
-        if (s->enabled == m)
+        if (s->enabled == m) {
+                /* A oneshot io source disabled when dispatched may still be registered, see
+                 * source_io_disable_disarmed(). Disabling it explicitly removes it from the epoll set. */
+                if (m == SD_EVENT_OFF && s->type == SOURCE_IO)
+                        source_io_unregister(s);
+
                 return 0;
+        }
 
         if (m == SD_EVENT_OFF) {
 
@@ -2226,9 +2298,7 @@ _public_ int sd_event_source_set_enabled(sd_event_source *s, int m) {
                         d = event_get_clock_data(s->event, s->type);
                         assert(d);
 
-                        prioq_reshuffle(d->earliest, s, &s->time.earliest_index);
-                        prioq_reshuffle(d->latest, s, &s->time.latest_index);
-                        d->needs_rearm = true;
+                        event_source_time_reshuffle(s, d);
                         break;
                 }
 
@@ -2296,9 +2366,7 @@ _public_ int sd_event_source_set_enabled(sd_event_source *s, int m) {
                         d = event_get_clock_data(s->event, s->type);
                         assert(d);
 
-                        prioq_reshuffle(d->earliest, s, &s->time.earliest_index);
-                        prioq_reshuffle(d->latest, s, &s->time.latest_index);
-                        d->needs_rearm = true;
+                        event_source_time_reshuffle(s, d);
                         break;
                 }
 
@@ -2398,9 +2466,7 @@ _public_ int sd_event_source_set_time(sd_event_source *s, uint64_t usec) {
         d = event_get_clock_data(s->event, s->type);
         assert(d);
 
-        prioq_reshuffle(d->earliest, s, &s->time.earliest_index);
-        prioq_reshuffle(d->latest, s, &s->time.latest_index);
-        d->needs_rearm = true;
+        event_source_time_reshuffle(s, d);
 
         return 0;
 }
@@ -2437,8 +2503,7 @@ _public_ int sd_event_source_set_time_accuracy(sd_event_source *s, uint64_t usec
         d = event_get_clock_data(s->event, s->type);
         assert(d);
 
-        prioq_reshuffle(d->latest, s, &s->time.latest_index);
-        d->needs_rearm = true;
+        event_source_time_reshuffle(s, d);
 
         return 0;
 }
@@ -2698,9 +2763,10 @@ static int event_arm_timer(
                 sd_event *e,
                 struct clock_data *d) {
 
+        usec_t earliest = USEC_INFINITY, latest = USEC_INFINITY, t;
         struct itimerspec its = {};
         sd_event_source *a, *b;
-        usec_t t;
+        TimerWheelItem *i;
         int r;
 
         assert(e);
@@ -2712,7 +2778,26 @@ static int event_arm_timer(
                 d->needs_rearm = false;
 
         a = prioq_peek(d->earliest);
-        if (!a || a->enabled == SD_EVENT_OFF || a->time.next == USEC_INFINITY) {
+        if (a && a->enabled != SD_EVENT_OFF && a->time.next != USEC_INFINITY) {
+                b = prioq_peek(d->latest);
+                assert_se(b && b->enabled != SD_EVENT_OFF);
+
+                earliest = a->time.next;
+                latest = time_event_source_latest(b);
+        }
+
+        if (d->wheel_earliest) {
+                i = timer_wheel_peek(d->wheel_earliest);
+                if (i) {
+                        earliest = MIN(earliest, i->key);
+
+                        i = timer_wheel_peek(d->wheel_latest);
+                        assert_se(i);
+                        latest = MIN(latest, i->key);
+                }
+        }
+
+        if (earliest == USEC_INFINITY) {
 
                 if (d->fd < 0)
                         return 0;
@@ -2729,10 +2814,7 @@ static int event_arm_timer(
                 return 0;
         }
 
-        b = prioq_peek(d->latest);
-        assert_se(b && b->enabled != SD_EVENT_OFF);
-
-        t = sleep_between(e, a->time.next, time_event_source_latest(b));
+        t = sleep_between(e, earliest, latest);
         if (d->next == t)
                 return 0;
 
@@ -2769,6 +2851,10 @@ static int process_io(sd_event *e, sd_event_source *s, uint32_t revents) {
         else
                 s->io.revents = revents;
 
+        /* The kernel disarms oneshot registrations when reporting an event */
+        if (s->enabled == SD_EVENT_ONESHOT)
+                s->io.disarmed = true;
+
         return source_set_pending(s, true);
 }
 
@@ -2804,6 +2890,7 @@ static int process_timer(
                 struct clock_data *d) {
 
         sd_event_source *s;
+        TimerWheelItem *i;
         int r;
 
         assert(e);
@@ -2821,9 +2908,22 @@ static int process_timer(
                 if (r < 0)
                         return r;
 
-                prioq_reshuffle(d->earliest, s, &s->time.earliest_index);
-                prioq_reshuffle(d->latest, s, &s->time.latest_index);
-                d->needs_rearm = true;
+                event_source_time_reshuffle(s, d);
+        }
+
+        if (!d->wheel_earliest)
+                return 0;
+
+        timer_wheel_advance(d->wheel_earliest, n);
+        timer_wheel_advance(d->wheel_latest, n);
+
+        /* Marking a source pending unlinks it from the wheels */
+        while ((i = timer_wheel_peek(d->wheel_earliest)) && i->key <= n) {
+                s = container_of(i, sd_event_source, time.earliest_item);
+
+                r = source_set_pending(s, true);
+                if (r < 0)
+                        return r;
         }
 
         return 0;
@@ -3145,8 +3245,30 @@ static int process_inotify(sd_event *e) {
         return done;
 }
 
+static void source_account_dispatch(sd_event_source *s, usec_t start, usec_t end) {
+        usec_t d;
+
+        assert(s);
+
+        s->n_dispatched++;
+
+        d = usec_sub_unsigned(end, start);
+        s->dispatch_usec_total = usec_add(s->dispatch_usec_total, d);
+        s->dispatch_usec_max = MAX(s->dispatch_usec_max, d);
+
+        /* The time between the wakeup of the event loop and the invocation of the callback. The callback
+         * might have disconnected the source from its event loop, in which case there's nothing to go by. */
+        if (s->event && timestamp_is_set(s->event->timestamp.monotonic)) {
+                d = usec_sub_unsigned(start, s->event->timestamp.monotonic);
+                s->latency_usec_total = usec_add(s->latency_usec_total, d);
+                s->latency_usec_max = MAX(s->latency_usec_max, d);
+        }
+}
+
 static int source_dispatch(sd_event_source *s) {
         EventSourceType saved_type;
+        sd_event *saved_event;
+        usec_t start;
         int r = 0;
 
         assert(s);
@@ -3156,6 +3278,10 @@ static int source_dispatch(sd_event_source *s) {
          * the event. */
         saved_type = s->type;
 
+        /* Same for the event loop, which the callback might disconnect the source from. The caller holds a
+         * reference to it. */
+        saved_event = s->event;
+
         if (!IN_SET(s->type, SOURCE_DEFER, SOURCE_EXIT)) {
                 r = source_set_pending(s, false);
                 if (r < 0)
@@ -3180,12 +3306,17 @@ static int source_dispatch(sd_event_source *s) {
         }
 
         if (s->enabled == SD_EVENT_ONESHOT) {
-                r = sd_event_source_set_enabled(s, SD_EVENT_OFF);
-                if (r < 0)
-                        return r;
+                if (s->type == SOURCE_IO && s->io.disarmed)
+                        source_io_disable_disarmed(s);
+                else {
+                        r = sd_event_source_set_enabled(s, SD_EVENT_OFF);
+                        if (r < 0)
+                                return r;
+                }
         }
 
         s->dispatching = true;
+        start = saved_event->dispatch_timestamp;
 
         switch (s->type) {
 
@@ -3263,6 +3394,11 @@ static int source_dispatch(sd_event_source *s) {
 
         s->dispatching = false;
 
+        /* The end of this callback is the start of the next one, so that there's only one clock read per
+         * dispatch */
+        saved_event->dispatch_timestamp = now(CLOCK_MONOTONIC);
+        source_account_dispatch(s, start, saved_event->dispatch_timestamp);
+
         if (r < 0)
                 log_debug_errno(r, "Event source %s (type %s) returned error, disabling: %m",
                                 strna(s->description), event_source_type_to_string(saved_type));
@@ -3327,6 +3463,7 @@ static int dispatch_exit(sd_event *e) {
         ref = sd_event_ref(e);
         e->iteration++;
         e->state = SD_EVENT_EXITING;
+        e->dispatch_timestamp = now(CLOCK_MONOTONIC);
         r = source_dispatch(p);
         e->state = SD_EVENT_INITIAL;
         return r;
@@ -3628,10 +3765,27 @@ _public_ int sd_event_dispatch(sd_event *e) {
         p = event_next_pending(e);
         if (p) {
                 _cleanup_(sd_event_unrefp) sd_event *ref = NULL;
+                int64_t priority = p->priority;
 
                 ref = sd_event_ref(e);
                 e->state = SD_EVENT_RUNNING;
+                e->dispatch_timestamp = now(CLOCK_MONOTONIC);
                 r = source_dispatch(p);
+
+                /* In batch mode, dispatch further pending sources of the same priority right away, instead of
+                 * going through sd_event_prepare() and sd_event_wait() again for each. Defer and exit sources
+                 * stay pending when dispatched and post sources are made pending by dispatching any other
+                 * source, hence leave those to the next iteration. */
+                for (unsigned n = 1; r >= 0 && n < e->dispatch_batch && !e->exit_requested; n++) {
+                        p = event_next_pending(e);
+                        if (!p ||
+                            p->priority != priority ||
+                            IN_SET(p->type, SOURCE_DEFER, SOURCE_POST, SOURCE_EXIT))
+                                break;
+
+                        r = source_dispatch(p);
+                }
+
                 e->state = SD_EVENT_INITIAL;
                 return r;
         }
@@ -3886,6 +4040,81 @@ _public_ int sd_event_get_watchdog(sd_event *e) {
         return e->watchdog;
 }
 
+_public_ int sd_event_set_dispatch_batch(sd_event *e, unsigned n) {
+        assert_return(e, -EINVAL);
+        assert_return(e = event_resolve(e), -ENOPKG);
+        assert_return(!event_pid_changed(e), -ECHILD);
+
+        e->dispatch_batch = MAX(n, 1U);
+        return 0;
+}
+
+_public_ int sd_event_get_dispatch_batch(sd_event *e, unsigned *ret) {
+        assert_return(e, -EINVAL);
+        assert_return(e = event_resolve(e), -ENOPKG);
+        assert_return(ret, -EINVAL);
+        assert_return(!event_pid_changed(e), -ECHILD);
+
+        *ret = MAX(e->dispatch_batch, 1U);
+        return 0;
+}
+
+_public_ int sd_event_source_get_statistics(
+                sd_event_source *s,
+                uint64_t *ret_n_dispatched,
+                uint64_t *ret_usec_total,
+                uint64_t *ret_usec_max,
+                uint64_t *ret_latency_usec_total,
+                uint64_t *ret_latency_usec_max) {
+
+        assert_return(s, -EINVAL);
+        /* The statistics remain available after the event loop is gone and the source was disconnected */
+        assert_return(!s->event || !event_pid_changed(s->event), -ECHILD);
+
+        if (ret_n_dispatched)
+                *ret_n_dispatched = s->n_dispatched;
+        if (ret_usec_total)
+                *ret_usec_total = s->dispatch_usec_total;
+        if (ret_usec_max)
+                *ret_usec_max = s->dispatch_usec_max;
+        if (ret_latency_usec_total)
+                *ret_latency_usec_total = s->latency_usec_total;
+        if (ret_latency_usec_max)
+                *ret_latency_usec_max = s->latency_usec_max;
+
+        return 0;
+}
+
+_public_ int sd_event_dump_statistics(sd_event *e, FILE *f) {
+        sd_event_source *s;
+
+        assert_return(e, -EINVAL);
+        assert_return(e = event_resolve(e), -ENOPKG);
+        assert_return(!event_pid_changed(e), -ECHILD);
+
+        if (!f)
+                f = stdout;
+
+        LIST_FOREACH(sources, s, e->sources) {
+                char a[FORMAT_TIMESPAN_MAX], b[FORMAT_TIMESPAN_MAX], c[FORMAT_TIMESPAN_MAX], d[FORMAT_TIMESPAN_MAX];
+
+                fprintf(f,
+                        "%s (%s): priority=%" PRIi64 " enabled=%s dispatched=%" PRIu64
+                        " time-total=%s time-max=%s latency-avg=%s latency-max=%s\n",
+                        strna(s->description),
+                        event_source_type_to_string(s->type),
+                        s->priority,
+                        s->enabled == SD_EVENT_OFF ? "off" : s->enabled == SD_EVENT_ONESHOT ? "oneshot" : "on",
+                        s->n_dispatched,
+                        format_timespan(a, sizeof(a), s->dispatch_usec_total, 1),
+                        format_timespan(b, sizeof(b), s->dispatch_usec_max, 1),
+                        format_timespan(c, sizeof(c), s->n_dispatched > 0 ? s->latency_usec_total / s->n_dispatched : 0, 1),
+                        format_timespan(d, sizeof(d), s->latency_usec_max, 1));
+        }
+
+        return 0;
+}
+
 _public_ int sd_event_get_iteration(sd_event *e, uint64_t *ret) {
         assert_return(e, -EINVAL);
         assert_return(e = event_resolve(e), -ENOPKG);
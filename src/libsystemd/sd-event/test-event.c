@@ -1,5 +1,6 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
+#include <sys/eventfd.h>
 #include <sys/wait.h>
 
 #include "sd-event.h"
@@ -590,6 +591,274 @@ static void test_pidfd(void) {
         sd_event_unref(e);
 }
 
+static unsigned n_oneshot_dispatched = 0;
+
+static int oneshot_handler(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
+        assert_se(revents & EPOLLIN);
+
+        n_oneshot_dispatched++;
+        return 0;
+}
+
+static bool fd_in_epoll(sd_event *e, int fd) {
+        struct epoll_event ev = {};
+
+        /* Checks whether the fd is in the epoll set, and leaves the set as it was */
+        if (epoll_ctl(sd_event_get_fd(e), EPOLL_CTL_ADD, fd, &ev) < 0) {
+                assert_se(errno == EEXIST);
+                return true;
+        }
+
+        assert_se(epoll_ctl(sd_event_get_fd(e), EPOLL_CTL_DEL, fd, NULL) >= 0);
+        return false;
+}
+
+static void test_io_oneshot_rearm(void) {
+        _cleanup_(sd_event_unrefp) sd_event *e = NULL;
+        _cleanup_close_ int fd = -1, fd2 = -1;
+        sd_event_source *s;
+
+        assert_se(sd_event_new(&e) >= 0);
+
+        fd = eventfd(1, EFD_CLOEXEC|EFD_NONBLOCK);
+        assert_se(fd >= 0);
+
+        assert_se(sd_event_add_io(e, &s, fd, EPOLLIN, oneshot_handler, NULL) >= 0);
+        assert_se(sd_event_source_set_enabled(s, SD_EVENT_ONESHOT) >= 0);
+
+        /* The source is disabled after each dispatch, but stays registered in disarmed state; make sure
+         * enabling it again re-arms it, and it stays quiet while disabled */
+        for (unsigned i = 1; i <= 5; i++) {
+                assert_se(sd_event_run(e, 0) > 0);
+                assert_se(n_oneshot_dispatched == i);
+                assert_se(sd_event_source_get_enabled(s, NULL) == SD_EVENT_OFF);
+                assert_se(fd_in_epoll(e, fd));
+
+                assert_se(sd_event_run(e, 0) == 0);
+                assert_se(n_oneshot_dispatched == i);
+
+                assert_se(sd_event_source_set_enabled(s, SD_EVENT_ONESHOT) >= 0);
+        }
+
+        /* Disabling a dispatched source explicitly removes it from the epoll set, so that the fd may be
+         * closed right away */
+        assert_se(sd_event_run(e, 0) > 0);
+        assert_se(n_oneshot_dispatched == 6);
+        assert_se(sd_event_source_set_enabled(s, SD_EVENT_OFF) >= 0);
+        assert_se(!fd_in_epoll(e, fd));
+
+        /* The same for a source that triggered, but wasn't dispatched yet */
+        assert_se(sd_event_source_set_enabled(s, SD_EVENT_ONESHOT) >= 0);
+        assert_se(fd_in_epoll(e, fd));
+        assert_se(sd_event_prepare(e) == 0);
+        assert_se(sd_event_wait(e, 0) > 0);
+        assert_se(sd_event_source_set_enabled(s, SD_EVENT_OFF) >= 0);
+        assert_se(!fd_in_epoll(e, fd));
+        assert_se(sd_event_dispatch(e) >= 0);
+        assert_se(n_oneshot_dispatched == 6);
+
+        /* Moving a disabled, disarmed source to a different fd must drop the old registration */
+        assert_se(sd_event_source_set_enabled(s, SD_EVENT_ONESHOT) >= 0);
+        assert_se(sd_event_run(e, 0) > 0);
+        assert_se(n_oneshot_dispatched == 7);
+
+        fd2 = eventfd(1, EFD_CLOEXEC|EFD_NONBLOCK);
+        assert_se(fd2 >= 0);
+        assert_se(sd_event_source_set_io_fd(s, fd2) >= 0);
+        assert_se(sd_event_source_set_enabled(s, SD_EVENT_ON) >= 0);
+        assert_se(sd_event_run(e, 0) > 0);
+        assert_se(n_oneshot_dispatched == 8);
+        assert_se(!fd_in_epoll(e, fd));
+
+        /* The old fd can be used with a new source */
+        assert_se(sd_event_source_set_enabled(s, SD_EVENT_OFF) >= 0);
+        sd_event_source_unref(s);
+        assert_se(sd_event_add_io(e, &s, fd, EPOLLIN, oneshot_handler, NULL) >= 0);
+        assert_se(sd_event_run(e, 0) > 0);
+        assert_se(n_oneshot_dispatched == 9);
+
+        sd_event_source_unref(s);
+}
+
+#define N_TIMERS 300U
+
+static unsigned n_timers_elapsed = 0;
+
+static int timer_handler(sd_event_source *s, uint64_t usec, void *userdata) {
+        uint64_t t, n;
+
+        assert_se(sd_event_source_get_time(s, &t) >= 0);
+        assert_se(t == usec);
+        assert_se(sd_event_now(sd_event_source_get_event(s), CLOCK_MONOTONIC, &n) >= 0);
+        assert_se(n >= usec);
+
+        n_timers_elapsed++;
+        return 0;
+}
+
+static void test_timers(bool wheel) {
+        static const uint64_t accuracies[] = { 1, USEC_PER_MSEC, 10 * USEC_PER_MSEC, 0 };
+        _cleanup_(sd_event_unrefp) sd_event *e = NULL;
+        sd_event_source *sources[N_TIMERS];
+        unsigned n_expected = 0;
+        uint64_t start;
+
+        assert_se(setenv("SYSTEMD_EVENT_TIMER_WHEEL", one_zero(wheel), 1) >= 0);
+
+        assert_se(sd_event_new(&e) >= 0);
+        assert_se(sd_event_now(e, CLOCK_MONOTONIC, &start) >= 0);
+
+        n_timers_elapsed = 0;
+
+        for (unsigned i = 0; i < N_TIMERS; i++) {
+                uint64_t usec;
+
+                /* Every tenth timer is far out, beyond the reach of the wheel levels, and is moved back in below */
+                usec = i % 10 == 0 ? start + 10 * USEC_PER_HOUR : start + (i * 7919 % 200) * USEC_PER_MSEC;
+
+                assert_se(sd_event_add_time(e, &sources[i], CLOCK_MONOTONIC, usec, accuracies[i % ELEMENTSOF(accuracies)],
+                                            timer_handler, NULL) >= 0);
+        }
+
+        for (unsigned i = 0; i < N_TIMERS; i++) {
+                if (i % 10 == 0)
+                        assert_se(sd_event_source_set_time(sources[i], start + (i % 50) * USEC_PER_MSEC) >= 0);
+                else if (i % 10 == 3)
+                        assert_se(sd_event_source_set_enabled(sources[i], SD_EVENT_OFF) >= 0);
+                else if (i % 10 == 7)
+                        assert_se(sd_event_source_set_time(sources[i], USEC_INFINITY) >= 0);
+                else if (i % 10 == 9)
+                        assert_se(sd_event_source_set_time_accuracy(sources[i], 50 * USEC_PER_MSEC) >= 0);
+
+                if (!IN_SET(i % 10, 3, 7))
+                        n_expected++;
+        }
+
+        while (n_timers_elapsed < n_expected)
+                assert_se(sd_event_run(e, 5 * USEC_PER_SEC) > 0);
+
+        /* Nothing else may elapse */
+        assert_se(sd_event_run(e, 300 * USEC_PER_MSEC) == 0);
+        assert_se(n_timers_elapsed == n_expected);
+
+        for (unsigned i = 0; i < N_TIMERS; i++)
+                sd_event_source_unref(sources[i]);
+
+        assert_se(unsetenv("SYSTEMD_EVENT_TIMER_WHEEL") >= 0);
+}
+
+#define N_READY_SOURCES 256U
+#define N_READY_DISPATCHES 50000U
+
+static unsigned n_ready_dispatched = 0;
+
+static int ready_handler(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
+        /* The eventfd is never read, hence stays ready */
+        n_ready_dispatched++;
+        return 0;
+}
+
+static void test_dispatch_batch_one(unsigned batch) {
+        _cleanup_(sd_event_unrefp) sd_event *e = NULL;
+        sd_event_source *sources[N_READY_SOURCES];
+        char buf[FORMAT_TIMESPAN_MAX];
+        int fds[N_READY_SOURCES];
+        unsigned n_iterations = 0, b;
+        usec_t start, elapsed;
+
+        assert_se(sd_event_new(&e) >= 0);
+        assert_se(sd_event_set_dispatch_batch(e, batch) >= 0);
+        assert_se(sd_event_get_dispatch_batch(e, &b) >= 0);
+        assert_se(b == MAX(batch, 1U));
+
+        for (unsigned i = 0; i < N_READY_SOURCES; i++) {
+                fds[i] = eventfd(1, EFD_CLOEXEC|EFD_NONBLOCK);
+                assert_se(fds[i] >= 0);
+                assert_se(sd_event_add_io(e, &sources[i], fds[i], EPOLLIN, ready_handler, NULL) >= 0);
+        }
+
+        n_ready_dispatched = 0;
+        start = now(CLOCK_MONOTONIC);
+
+        while (n_ready_dispatched < N_READY_DISPATCHES) {
+                assert_se(sd_event_run(e, 0) > 0);
+                n_iterations++;
+        }
+
+        elapsed = now(CLOCK_MONOTONIC) - start;
+        log_info("Dispatch batch %u: %u events in %u iterations, %s, %.0f events/s",
+                 b, n_ready_dispatched, n_iterations,
+                 format_timespan(buf, sizeof(buf), elapsed, USEC_PER_MSEC),
+                 (double) n_ready_dispatched * USEC_PER_SEC / MAX(elapsed, 1U));
+
+        if (b == 1)
+                assert_se(n_iterations == n_ready_dispatched);
+        else
+                assert_se(n_iterations < n_ready_dispatched);
+
+        for (unsigned i = 0; i < N_READY_SOURCES; i++) {
+                sd_event_source_unref(sources[i]);
+                safe_close(fds[i]);
+        }
+}
+
+static void test_dispatch_batch(void) {
+        test_dispatch_batch_one(0);
+        test_dispatch_batch_one(16);
+        test_dispatch_batch_one(N_READY_SOURCES);
+}
+
+static int slow_handler(sd_event_source *s, void *userdata) {
+        (void) usleep(2 * USEC_PER_MSEC);
+        return 0;
+}
+
+static int disconnect_handler(sd_event_source *s, void *userdata) {
+        uint64_t n;
+
+        /* Dropping the last reference while dispatching disconnects the source from the event loop, but
+         * keeps it around until the handler returns */
+        assert_se(!sd_event_source_unref(s));
+
+        assert_se(sd_event_source_get_statistics(s, &n, NULL, NULL, NULL, NULL) >= 0);
+        assert_se(n == 0);
+
+        return 0;
+}
+
+static void test_statistics(void) {
+        _cleanup_(sd_event_unrefp) sd_event *e = NULL;
+        uint64_t n, total, max, latency_total, latency_max;
+        sd_event_source *s;
+
+        assert_se(sd_event_new(&e) >= 0);
+        assert_se(sd_event_add_defer(e, &s, slow_handler, NULL) >= 0);
+        assert_se(sd_event_source_set_description(s, "slow") >= 0);
+
+        assert_se(sd_event_source_get_statistics(s, &n, &total, &max, &latency_total, &latency_max) >= 0);
+        assert_se(n == 0 && total == 0 && max == 0 && latency_total == 0 && latency_max == 0);
+
+        assert_se(sd_event_source_set_enabled(s, SD_EVENT_ON) >= 0);
+        for (unsigned i = 0; i < 3; i++)
+                assert_se(sd_event_run(e, 0) > 0);
+
+        assert_se(sd_event_source_get_statistics(s, &n, &total, &max, &latency_total, &latency_max) >= 0);
+        assert_se(n == 3);
+        assert_se(total >= 3 * 2 * USEC_PER_MSEC);
+        assert_se(max >= 2 * USEC_PER_MSEC);
+        assert_se(max <= total);
+        assert_se(latency_max <= latency_total);
+
+        assert_se(sd_event_source_get_statistics(s, NULL, NULL, NULL, NULL, NULL) >= 0);
+        assert_se(sd_event_dump_statistics(e, stdout) >= 0);
+
+        sd_event_source_unref(s);
+
+        /* A source that is disconnected while it is dispatched still knows what it did */
+        assert_se(sd_event_add_defer(e, &s, disconnect_handler, NULL) >= 0);
+        assert_se(sd_event_run(e, 0) > 0);
+}
+
 int main(int argc, char *argv[]) {
         test_setup_logging(LOG_INFO);
 
@@ -604,5 +873,14 @@ int main(int argc, char *argv[]) {
 
         test_pidfd();
 
+        test_io_oneshot_rearm();
+
+        test_timers(true);
+        test_timers(false);
+
+        test_dispatch_batch();
+
+        test_statistics();
+
         return 0;
 }
@@ -0,0 +1,189 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include "alloc-util.h"
+#include "timer-wheel.h"
+
+#define TIMER_WHEEL_SLOT_MASK ((usec_t) (TIMER_WHEEL_SLOTS - 1))
+
+static unsigned level_shift(unsigned level) {
+        return TIMER_WHEEL_GRANULARITY_BITS + level * TIMER_WHEEL_SLOT_BITS;
+}
+
+static TimerWheelItem **level_slot(TimerWheel *w, unsigned level, usec_t tick) {
+        return &w->slots[level * TIMER_WHEEL_SLOTS + (tick & TIMER_WHEEL_SLOT_MASK)];
+}
+
+TimerWheel* timer_wheel_new(usec_t base) {
+        TimerWheel *w;
+
+        w = new0(TimerWheel, 1);
+        if (!w)
+                return NULL;
+
+        w->base = base;
+        w->min_valid = true; /* An empty wheel has no minimum, and we know that */
+
+        return w;
+}
+
+TimerWheel* timer_wheel_free(TimerWheel *w) {
+        /* The items are owned by the caller, we don't touch them here */
+        return mfree(w);
+}
+
+static TimerWheelItem **timer_wheel_find_slot(TimerWheel *w, usec_t key) {
+        assert(w);
+
+        /* Items due before the current base are placed as if they were due right at it, so that they are
+         * found in the very first slot. */
+        key = MAX(key, w->base);
+
+        for (unsigned level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+                unsigned shift = level_shift(level);
+
+                if ((key >> shift) - (w->base >> shift) < TIMER_WHEEL_SLOTS)
+                        return level_slot(w, level, key >> shift);
+        }
+
+        return &w->far;
+}
+
+static void timer_wheel_link(TimerWheel *w, TimerWheelItem *i) {
+        TimerWheelItem **head;
+
+        head = timer_wheel_find_slot(w, i->key);
+        LIST_PREPEND(items, *head, i);
+        i->head = head;
+}
+
+static void timer_wheel_unlink_list(TimerWheelItem **head, TimerWheelItem **list) {
+        TimerWheelItem *i;
+
+        while ((i = *head)) {
+                LIST_REMOVE(items, *head, i);
+                LIST_PREPEND(items, *list, i);
+        }
+}
+
+void timer_wheel_put(TimerWheel *w, TimerWheelItem *i, usec_t key) {
+        assert(w);
+        assert(i);
+
+        if (i->head) {
+                LIST_REMOVE(items, *i->head, i);
+                i->head = NULL;
+                w->n_items--;
+
+                /* If this was the minimum, it stays the minimum if it is moved to an earlier time */
+                if (w->min == i && key > i->key) {
+                        w->min = NULL;
+                        w->min_valid = false;
+                }
+        }
+
+        i->key = key;
+        timer_wheel_link(w, i);
+        w->n_items++;
+
+        if (w->min_valid && (!w->min || key < w->min->key))
+                w->min = i;
+}
+
+void timer_wheel_remove(TimerWheel *w, TimerWheelItem *i) {
+        assert(w);
+        assert(i);
+
+        if (!i->head)
+                return;
+
+        LIST_REMOVE(items, *i->head, i);
+        i->head = NULL;
+        w->n_items--;
+
+        if (w->min == i) {
+                w->min = NULL;
+                w->min_valid = w->n_items == 0;
+        }
+}
+
+void timer_wheel_advance(TimerWheel *w, usec_t n) {
+        TimerWheelItem *list = NULL, *i;
+        unsigned level;
+
+        assert(w);
+
+        if (n == w->base)
+                return;
+
+        if (n < w->base) {
+                /* The clock jumped backwards (only CLOCK_REALTIME does that), hence the slots are not
+                 * relative to anything useful anymore. Start from scratch. */
+                for (size_t k = 0; k < ELEMENTSOF(w->slots); k++)
+                        timer_wheel_unlink_list(w->slots + k, &list);
+                timer_wheel_unlink_list(&w->far, &list);
+        } else {
+                /* Pick up all items in slots whose time has passed, and on each level the slot we just entered,
+                 * so that its items are redistributed on the finer levels. */
+                for (level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+                        unsigned shift = level_shift(level);
+                        usec_t from = w->base >> shift, to = n >> shift;
+
+                        /* If this level didn't move, none of the coarser ones did either */
+                        if (from == to)
+                                break;
+
+                        for (usec_t t = from; t <= to && t - from < TIMER_WHEEL_SLOTS; t++)
+                                timer_wheel_unlink_list(level_slot(w, level, t), &list);
+                }
+
+                /* If even the coarsest level moved on, some of the far items might fit into it now */
+                if (level >= TIMER_WHEEL_LEVELS)
+                        timer_wheel_unlink_list(&w->far, &list);
+        }
+
+        w->base = n;
+
+        /* The keys don't change, hence our cached minimum stays valid */
+        while ((i = list)) {
+                LIST_REMOVE(items, list, i);
+                timer_wheel_link(w, i);
+        }
+}
+
+TimerWheelItem* timer_wheel_peek(TimerWheel *w) {
+        TimerWheelItem *i;
+
+        assert(w);
+
+        if (w->min_valid)
+                return w->min;
+
+        w->min = NULL;
+
+        /* Within a level, items in slots further away from the base are always later than items in slots
+         * closer to it. Hence we only need to look at the first occupied slot of each level. Between levels
+         * there's no such ordering since the base moves on. */
+        for (unsigned level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+                unsigned shift = level_shift(level);
+
+                for (usec_t k = 0; k < TIMER_WHEEL_SLOTS; k++) {
+                        TimerWheelItem *head;
+
+                        head = *level_slot(w, level, (w->base >> shift) + k);
+                        if (!head)
+                                continue;
+
+                        LIST_FOREACH(items, i, head)
+                                if (!w->min || i->key < w->min->key)
+                                        w->min = i;
+                        break;
+                }
+        }
+
+        LIST_FOREACH(items, i, w->far)
+                if (!w->min || i->key < w->min->key)
+                        w->min = i;
+
+        w->min_valid = true;
+        return w->min;
+}
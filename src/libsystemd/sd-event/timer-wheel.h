@@ -0,0 +1,56 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "list.h"
+#include "macro.h"
+#include "time-util.h"
+
+/* A hierarchical timer wheel: items are kept in unsorted per-slot lists, on four levels of 64 slots each, the
+ * finest level covering ~1ms per slot, the coarsest ~268s per slot. Items further out than the coarsest level
+ * can hold are kept on a separate list. Inserting, moving and removing an item is O(1), finding the item with
+ * the lowest key only needs to look at the first occupied slot of each level, and is cached between changes. */
+
+#define TIMER_WHEEL_LEVELS 4U
+#define TIMER_WHEEL_SLOT_BITS 6U
+#define TIMER_WHEEL_SLOTS (1U << TIMER_WHEEL_SLOT_BITS)
+#define TIMER_WHEEL_GRANULARITY_BITS 10U
+#define TIMER_WHEEL_GRANULARITY_USEC (UINT64_C(1) << TIMER_WHEEL_GRANULARITY_BITS)
+
+typedef struct TimerWheelItem TimerWheelItem;
+
+struct TimerWheelItem {
+        usec_t key;
+        TimerWheelItem **head; /* the list the item is currently linked into, NULL if not linked */
+        LIST_FIELDS(TimerWheelItem, items);
+};
+
+typedef struct TimerWheel {
+        usec_t base; /* slots of all levels are relative to this */
+        size_t n_items;
+
+        TimerWheelItem *min; /* cached result of timer_wheel_peek(), if min_valid is set */
+        bool min_valid;
+
+        TimerWheelItem *far;
+        TimerWheelItem *slots[TIMER_WHEEL_LEVELS * TIMER_WHEEL_SLOTS];
+} TimerWheel;
+
+TimerWheel* timer_wheel_new(usec_t base);
+TimerWheel* timer_wheel_free(TimerWheel *w);
+DEFINE_TRIVIAL_CLEANUP_FUNC(TimerWheel*, timer_wheel_free);
+
+static inline bool timer_wheel_item_linked(const TimerWheelItem *i) {
+        return i && i->head;
+}
+
+static inline size_t timer_wheel_size(const TimerWheel *w) {
+        return w ? w->n_items : 0;
+}
+
+void timer_wheel_put(TimerWheel *w, TimerWheelItem *i, usec_t key);
+void timer_wheel_remove(TimerWheel *w, TimerWheelItem *i);
+void timer_wheel_advance(TimerWheel *w, usec_t n);
+TimerWheelItem* timer_wheel_peek(TimerWheel *w);
@@ -1,7 +1,9 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
 #include <ctype.h>
+#include <fcntl.h>
 #include <stdio.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 
 #include "alloc-util.h"
@@ -14,10 +16,12 @@
 #include "label.h"
 #include "mkdir.h"
 #include "path-util.h"
+#include "set.h"
 #include "sort-util.h"
 #include "strbuf.h"
 #include "string-util.h"
 #include "strv.h"
+#include "time-util.h"
 #include "tmpfile-util.h"
 
 static const char *default_hwdb_bin_dir = "/etc/udev";
@@ -586,6 +590,156 @@ static int import_file(struct trie *trie, const char *filename, uint16_t file_pr
         return r;
 }
 
+/* Plenty for any real match string, but protects against loops in a corrupted file */
+#define HWDB_BIN_DEPTH_MAX 4096U
+
+static int hwdb_bin_collect_filenames(
+                const char *map,
+                size_t size,
+                const struct trie_header_f *head,
+                uint64_t node_off,
+                unsigned depth,
+                Set *filenames) {
+
+        uint64_t node_size = le64toh(head->node_size), child_size = le64toh(head->child_entry_size),
+                value_size = le64toh(head->value_entry_size), values_count, i;
+        const struct trie_node_f *node;
+        const char *p;
+        int r;
+
+        if (depth > HWDB_BIN_DEPTH_MAX)
+                return -EBADMSG;
+
+        if (node_off > size || size - node_off < node_size)
+                return -EBADMSG;
+
+        node = (const struct trie_node_f*) (map + node_off);
+        values_count = le64toh(node->values_count);
+
+        if (values_count > size / value_size ||
+            size - node_off - node_size < node->children_count * child_size + values_count * value_size)
+                return -EBADMSG;
+
+        p = map + node_off + node_size;
+        for (i = 0; i < node->children_count; i++, p += child_size) {
+                r = hwdb_bin_collect_filenames(map, size, head, le64toh(((const struct trie_child_entry_f*) p)->child_off),
+                                               depth + 1, filenames);
+                if (r < 0)
+                        return r;
+        }
+
+        for (i = 0; i < values_count; i++, p += value_size) {
+                uint64_t off = le64toh(((const struct trie_value_entry2_f*) p)->filename_off);
+
+                if (off >= size || !memchr(map + off, 0, size - off))
+                        return -EBADMSG;
+
+                r = set_put(filenames, map + off);
+                if (r < 0)
+                        return r;
+        }
+
+        return 0;
+}
+
+static int hwdb_bin_is_uptodate(const char *hwdb_bin, const char *root, char **files) {
+        _cleanup_set_free_ Set *filenames = NULL;
+        const struct trie_header_f *head;
+        const char sig[] = HWDB_SIG;
+        _cleanup_close_ int fd = -1;
+        const char * const *d;
+        const char *filename;
+        struct stat st;
+        usec_t built;
+        size_t size;
+        Iterator i;
+        char **f;
+        void *map;
+        int r;
+
+        /* Returns > 0 if hwdb_bin was created by this version from these files, and neither they nor the
+         * directories they are in were touched since. That's how we find out that no file was added, changed
+         * or replaced. The database records which files contributed to it, which tells us that no relevant
+         * file was removed. */
+
+        fd = open(hwdb_bin, O_RDONLY|O_CLOEXEC);
+        if (fd < 0)
+                return errno == ENOENT ? 0 : -errno;
+
+        if (fstat(fd, &st) < 0)
+                return -errno;
+        if (st.st_size < (off_t) sizeof(struct trie_header_f))
+                return 0;
+
+        built = timespec_load(&st.st_mtim);
+        size = st.st_size;
+
+        map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+        if (map == MAP_FAILED)
+                return -errno;
+
+        head = map;
+        if (memcmp(head->signature, sig, sizeof(head->signature)) != 0 ||
+            le64toh(head->file_size) != size ||
+            le64toh(head->tool_version) != PROJECT_VERSION ||
+            le64toh(head->node_size) < sizeof(struct trie_node_f) ||
+            le64toh(head->child_entry_size) < sizeof(struct trie_child_entry_f) ||
+            le64toh(head->value_entry_size) < sizeof(struct trie_value_entry2_f)) {
+                r = 0;
+                goto finish;
+        }
+
+        filenames = set_new(&string_hash_ops);
+        if (!filenames) {
+                r = -ENOMEM;
+                goto finish;
+        }
+
+        r = hwdb_bin_collect_filenames(map, size, head, le64toh(head->nodes_root_off), 0, filenames);
+        if (r < 0)
+                goto finish;
+
+        r = 0;
+
+        SET_FOREACH(filename, filenames, i)
+                if (!strv_contains(files, filename))
+                        goto finish;
+
+        STRV_FOREACH(f, files)
+                if (stat(*f, &st) < 0 ||
+                    timespec_load(&st.st_ctim) >= built ||
+                    timespec_load(&st.st_mtim) >= built)
+                        goto finish;
+
+        STRV_FOREACH(d, conf_file_dirs) {
+                _cleanup_free_ char *p = NULL;
+
+                p = path_join(root, *d);
+                if (!p) {
+                        r = -ENOMEM;
+                        goto finish;
+                }
+
+                if (stat(p, &st) < 0) {
+                        if (errno == ENOENT)
+                                continue;
+                        goto finish;
+                }
+
+                if (timespec_load(&st.st_ctim) >= built ||
+                    timespec_load(&st.st_mtim) >= built)
+                        goto finish;
+        }
+
+        r = 1;
+
+finish:
+        /* The file names point into the map */
+        filenames = set_free(filenames);
+        (void) munmap(map, size);
+        return r;
+}
+
 int hwdb_update(const char *root, const char *hwdb_bin_dir, bool strict, bool compat) {
         _cleanup_free_ char *hwdb_bin = NULL;
         _cleanup_(trie_freep) struct trie *trie = NULL;
@@ -599,6 +753,27 @@ int hwdb_update(const char *root, const char *hwdb_bin_dir, bool strict, bool co
          * will be created without the information. systemd-hwdb command should set the argument false, and 'udevadm hwdb'
          * command should set it true. */
 
+        err = conf_files_list_strv(&files, ".hwdb", root, 0, conf_file_dirs);
+        if (err < 0)
+                return log_error_errno(err, "Failed to enumerate hwdb files: %m");
+
+        hwdb_bin = path_join(root, hwdb_bin_dir ?: default_hwdb_bin_dir, "hwdb.bin");
+        if (!hwdb_bin)
+                return -ENOMEM;
+
+        /* Don't bother rebuilding the database if none of its sources changed. This requires the file names
+         * recorded in the database, which the compat format lacks. In strict mode we always parse all files,
+         * to report any errors. */
+        if (!compat && !strict) {
+                err = hwdb_bin_is_uptodate(hwdb_bin, root, files);
+                if (err < 0)
+                        log_debug_errno(err, "Failed to check whether %s is up to date, rebuilding: %m", hwdb_bin);
+                else if (err > 0) {
+                        log_debug("%s is up to date, not rebuilding.", hwdb_bin);
+                        return 0;
+                }
+        }
+
         trie = new0(struct trie, 1);
         if (!trie)
                 return -ENOMEM;
@@ -615,10 +790,6 @@ int hwdb_update(const char *root, const char *hwdb_bin_dir, bool strict, bool co
 
         trie->nodes_count++;
 
-        err = conf_files_list_strv(&files, ".hwdb", root, 0, conf_file_dirs);
-        if (err < 0)
-                return log_error_errno(err, "Failed to enumerate hwdb files: %m");
-
         STRV_FOREACH(f, files) {
                 log_debug("Reading file \"%s\"", *f);
                 err = import_file(trie, *f, file_priority++, compat);
@@ -642,10 +813,6 @@ int hwdb_update(const char *root, const char *hwdb_bin_dir, bool strict, bool co
         log_debug("strings dedup'ed: %8zu bytes (%8zu)",
                   trie->strings->dedup_len, trie->strings->dedup_count);
 
-        hwdb_bin = path_join(root, hwdb_bin_dir ?: default_hwdb_bin_dir, "hwdb.bin");
-        if (!hwdb_bin)
-                return -ENOMEM;
-
         mkdir_parents_label(hwdb_bin, 0755);
         err = trie_store(trie, hwdb_bin, compat);
         if (err < 0)
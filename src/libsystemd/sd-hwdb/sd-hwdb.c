@@ -104,22 +104,37 @@ static const char *trie_string(sd_hwdb *hwdb, le64_t off) {
         return hwdb->map + le64toh(off);
 }
 
-static int trie_children_cmp_f(const void *v1, const void *v2) {
-        const struct trie_child_entry_f *n1 = v1;
-        const struct trie_child_entry_f *n2 = v2;
+static const struct trie_node_f *node_lookup_f(sd_hwdb *hwdb, const struct trie_node_f *node, uint8_t c) {
+        size_t lo = 0, hi = node->children_count;
 
-        return n1->c - n2->c;
-}
+        /* This is the innermost loop of every lookup, which runs up to four times per node. Most nodes only have
+         * a handful of children, which are scanned in order, and the rest is bisected. Either way, this avoids
+         * going through bsearch() and a comparison callback for each step. */
+
+        if (hi == 0)
+                return NULL;
+
+        while (hi - lo > 8) {
+                size_t mid = lo + (hi - lo) / 2;
+                uint8_t m = trie_node_child(hwdb, node, mid)->c;
+
+                if (m == c)
+                        return trie_node_from_off(hwdb, trie_node_child(hwdb, node, mid)->child_off);
+                if (m < c)
+                        lo = mid + 1;
+                else
+                        hi = mid;
+        }
+
+        for (; lo < hi; lo++) {
+                const struct trie_child_entry_f *child = trie_node_child(hwdb, node, lo);
+
+                if (child->c == c)
+                        return trie_node_from_off(hwdb, child->child_off);
+                if (child->c > c)
+                        break;
+        }
 
-static const struct trie_node_f *node_lookup_f(sd_hwdb *hwdb, const struct trie_node_f *node, uint8_t c) {
-        struct trie_child_entry_f *child;
-        struct trie_child_entry_f search;
-
-        search.c = c;
-        child = bsearch(&search, (const char *)node + le64toh(hwdb->head->node_size), node->children_count,
-                        le64toh(hwdb->head->child_entry_size), trie_children_cmp_f);
-        if (child)
-                return trie_node_from_off(hwdb, child->child_off);
         return NULL;
 }
 
@@ -257,8 +257,8 @@ _public_ int sd_id128_randomize(sd_id128_t *ret) {
         assert_return(ret, -EINVAL);
 
         /* We allow usage if x86-64 RDRAND here. It might not be trusted enough for keeping secrets, but it should be
-         * fine for UUIDS. */
-        r = genuine_random_bytes(&t, sizeof t, RANDOM_ALLOW_RDRAND);
+         * fine for UUIDS. For the same reason we may serve them from the buffered pool. */
+        r = genuine_random_bytes(&t, sizeof t, RANDOM_ALLOW_RDRAND|RANDOM_ALLOW_POOL);
         if (r < 0)
                 return r;
 
@@ -13,6 +13,7 @@
 #include "env-file.h"
 #include "escape.h"
 #include "fd-util.h"
+#include "fileio.h"
 #include "format-util.h"
 #include "fs-util.h"
 #include "hostname-util.h"
@@ -22,6 +23,7 @@
 #include "parse-util.h"
 #include "path-util.h"
 #include "socket-util.h"
+#include "stdio-util.h"
 #include "string-util.h"
 #include "strv.h"
 #include "user-util.h"
@@ -952,9 +954,22 @@ static sd_login_monitor* FD_TO_MONITOR(int fd) {
         return (sd_login_monitor*) (unsigned long) (fd + 1);
 }
 
+static const struct {
+        const char *category;
+        const char *path;
+        const char *skip_prefix;
+} monitor_dirs[] = {
+        { "seat",    "/run/systemd/seats/"    },
+        { "session", "/run/systemd/sessions/" },
+        { "uid",     "/run/systemd/users/"    },
+        /* machined also keeps "unit:<unit>" symlinks to the machine files there */
+        { "machine", "/run/systemd/machines/", "unit:" },
+};
+
 _public_ int sd_login_monitor_new(const char *category, sd_login_monitor **m) {
         _cleanup_close_ int fd = -1;
         bool good = false;
+        size_t i;
         int k;
 
         assert_return(m, -EINVAL);
@@ -963,32 +978,11 @@ _public_ int sd_login_monitor_new(const char *category, sd_login_monitor **m) {
         if (fd < 0)
                 return -errno;
 
-        if (!category || streq(category, "seat")) {
-                k = inotify_add_watch(fd, "/run/systemd/seats/", IN_MOVED_TO|IN_DELETE);
-                if (k < 0)
-                        return -errno;
-
-                good = true;
-        }
-
-        if (!category || streq(category, "session")) {
-                k = inotify_add_watch(fd, "/run/systemd/sessions/", IN_MOVED_TO|IN_DELETE);
-                if (k < 0)
-                        return -errno;
-
-                good = true;
-        }
-
-        if (!category || streq(category, "uid")) {
-                k = inotify_add_watch(fd, "/run/systemd/users/", IN_MOVED_TO|IN_DELETE);
-                if (k < 0)
-                        return -errno;
-
-                good = true;
-        }
+        for (i = 0; i < ELEMENTSOF(monitor_dirs); i++) {
+                if (category && !streq(category, monitor_dirs[i].category))
+                        continue;
 
-        if (!category || streq(category, "machine")) {
-                k = inotify_add_watch(fd, "/run/systemd/machines/", IN_MOVED_TO|IN_DELETE);
+                k = inotify_add_watch(fd, monitor_dirs[i].path, IN_MOVED_TO|IN_DELETE);
                 if (k < 0)
                         return -errno;
 
@@ -1028,6 +1022,129 @@ _public_ int sd_login_monitor_flush(sd_login_monitor *m) {
         return 0;
 }
 
+static int monitor_find_watches(int fd, int wds[static ELEMENTSOF(monitor_dirs)]) {
+        char path[STRLEN("/proc/self/fdinfo/") + DECIMAL_STR_MAX(int)];
+        _cleanup_free_ char *fdinfo = NULL;
+        _cleanup_strv_free_ char **lines = NULL;
+        ino_t inodes[ELEMENTSOF(monitor_dirs)];
+        char **line;
+        size_t i;
+        int r;
+
+        /* The monitor object is just the inotify fd, hence we have no place to store which watch descriptor
+         * belongs to which directory. Let's figure that out from the inode numbers the kernel shows in
+         * fdinfo. */
+
+        for (i = 0; i < ELEMENTSOF(monitor_dirs); i++) {
+                struct stat st;
+
+                wds[i] = -1;
+                inodes[i] = stat(monitor_dirs[i].path, &st) < 0 ? 0 : st.st_ino;
+        }
+
+        xsprintf(path, "/proc/self/fdinfo/%i", fd);
+
+        r = read_full_file(path, &fdinfo, NULL);
+        if (r < 0)
+                return r;
+
+        lines = strv_split_newlines(fdinfo);
+        if (!lines)
+                return -ENOMEM;
+
+        STRV_FOREACH(line, lines) {
+                unsigned long ino;
+                unsigned wd;
+
+                /* The kernel shows both in hex */
+                if (sscanf(*line, "inotify wd:%x ino:%lx", &wd, &ino) != 2)
+                        continue;
+                if (wd > INT_MAX)
+                        continue;
+
+                for (i = 0; i < ELEMENTSOF(monitor_dirs); i++)
+                        if (inodes[i] != 0 && inodes[i] == (ino_t) ino)
+                                wds[i] = (int) wd;
+        }
+
+        return 0;
+}
+
+_public_ int sd_login_monitor_flush_changes(sd_login_monitor *m, char ***ret) {
+        int wds[ELEMENTSOF(monitor_dirs)];
+        _cleanup_strv_free_ char **l = NULL;
+        bool overflow = false;
+        int fd, r;
+
+        assert_return(m, -EINVAL);
+        assert_return(ret, -EINVAL);
+
+        fd = MONITOR_TO_FD(m);
+
+        r = monitor_find_watches(fd, wds);
+        if (r < 0)
+                return r;
+
+        for (;;) {
+                union inotify_event_buffer buffer;
+                struct inotify_event *e;
+                ssize_t n;
+
+                n = read(fd, &buffer, sizeof(buffer));
+                if (n < 0) {
+                        if (errno == EINTR)
+                                continue;
+                        if (errno == EAGAIN)
+                                break;
+
+                        return -errno;
+                }
+
+                FOREACH_INOTIFY_EVENT(e, buffer, n) {
+                        _cleanup_free_ char *s = NULL;
+                        size_t i;
+
+                        if (e->mask & IN_Q_OVERFLOW) {
+                                overflow = true;
+                                continue;
+                        }
+
+                        /* Skip the temporary files the state files are written to first */
+                        if (e->len == 0 || e->name[0] == '.')
+                                continue;
+
+                        for (i = 0; i < ELEMENTSOF(monitor_dirs); i++)
+                                if (wds[i] == e->wd)
+                                        break;
+                        if (i >= ELEMENTSOF(monitor_dirs))
+                                continue;
+
+                        if (monitor_dirs[i].skip_prefix && startswith(e->name, monitor_dirs[i].skip_prefix))
+                                continue;
+
+                        s = strjoin(monitor_dirs[i].category, ":", e->name);
+                        if (!s)
+                                return -ENOMEM;
+
+                        if (strv_contains(l, s))
+                                continue;
+
+                        r = strv_consume(&l, TAKE_PTR(s));
+                        if (r < 0)
+                                return r;
+                }
+        }
+
+        /* We lost events, the caller has to reread everything */
+        if (overflow)
+                return -ENOBUFS;
+
+        r = (int) strv_length(l);
+        *ret = TAKE_PTR(l);
+
+        return r;
+}
+
 _public_ int sd_login_monitor_get_fd(sd_login_monitor *m) {
 
         assert_return(m, -EINVAL);
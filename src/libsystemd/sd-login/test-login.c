@@ -242,6 +242,61 @@ static void test_login(void) {
         }
 }
 
+static void check_changes(char **changes, int n, const char *category) {
+        char **c;
+
+        assert_se(strv_length(changes) == (size_t) n);
+
+        STRV_FOREACH(c, changes) {
+                const char *name = NULL, *k;
+
+                if (category)
+                        name = startswith(*c, category);
+                else
+                        FOREACH_STRING(k, "seat", "session", "uid", "machine") {
+                                name = startswith(*c, k);
+                                if (name)
+                                        break;
+                        }
+                assert_se(name);
+                name = startswith(name, ":");
+                assert_se(name);
+
+                /* Neither temporary files nor machined's unit symlinks are reported */
+                assert_se(!isempty(name));
+                assert_se(name[0] != '.');
+                assert_se(!startswith(name, "unit:"));
+
+                /* Each object is listed once */
+                assert_se(!strv_find(c + 1, *c));
+        }
+}
+
+static void test_monitor_changes(void) {
+        _cleanup_(sd_login_monitor_unrefp) sd_login_monitor *m = NULL;
+        _cleanup_strv_free_ char **changes = NULL;
+        int r;
+
+        log_info("/* %s */", __func__);
+
+        r = sd_login_monitor_new(NULL, &m);
+        if (r == -ENOENT) {
+                log_info("Not running under logind, skipping.");
+                return;
+        }
+        assert_se(r >= 0);
+
+        /* Nothing happened yet, or at least nothing but what a busy system does in the meantime */
+        r = sd_login_monitor_flush_changes(m, &changes);
+        assert_se(r >= 0);
+        check_changes(changes, r, NULL);
+
+        changes = strv_free(changes);
+        r = sd_login_monitor_flush_changes(m, &changes);
+        assert_se(r >= 0);
+        check_changes(changes, r, NULL);
+}
+
 static void test_monitor(void) {
         sd_login_monitor *m = NULL;
         unsigned n;
@@ -268,7 +323,23 @@ static void test_monitor(void) {
 
                 assert_se(r >= 0);
 
-                sd_login_monitor_flush(m);
+                if (n % 2 == 0)
+                        assert_se(sd_login_monitor_flush(m) >= 0);
+                else {
+                        _cleanup_strv_free_ char **changes = NULL;
+                        _cleanup_free_ char *j = NULL;
+
+                        r = sd_login_monitor_flush_changes(m, &changes);
+                        if (r == -ENOBUFS)
+                                log_info("Changes were lost.");
+                        else {
+                                assert_se(r >= 0);
+                                check_changes(changes, r, "session");
+
+                                assert_se(j = strv_join(changes, " "));
+                                log_info("Changed: %s", j);
+                        }
+                }
                 printf("Wake!\n");
         }
 
@@ -282,6 +353,7 @@ int main(int argc, char* argv[]) {
         log_info("/* Information printed is from the live system */");
 
         test_login();
+        test_monitor_changes();
 
         if (streq_ptr(argv[1], "-m"))
                 test_monitor();
@@ -46,9 +46,9 @@ static int genl_message_new(sd_netlink *nl, sd_genl_family family, uint16_t nlms
                 return r;
 
         size = NLMSG_SPACE(sizeof(struct genlmsghdr));
-        m->hdr = malloc0(size);
-        if (!m->hdr)
-                return -ENOMEM;
+        r = message_new_header(nl, m, nlmsg_type, size);
+        if (r < 0)
+                return r;
 
         m->hdr->nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK;
 
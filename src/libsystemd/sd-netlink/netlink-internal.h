@@ -15,13 +15,36 @@
 #define RTNL_WQUEUE_MAX 1024
 #define RTNL_RQUEUE_MAX 64*1024
 
+/* Asynchronous requests are queued and written in batches of this size at most with a single sendmsg(). The
+ * kernel processes a batch in one go, hence bound it well below the default socket send buffer size. */
+#define RTNL_WBATCH_SIZE_MAX (64U*1024U)
+
+/* The kernel drops replies that don't fit into the receive buffer, hence no more requests are kept waiting
+ * for a reply than the receive buffer has room for replies of (generously estimated) this size, and never
+ * more than RTNL_WQUEUE_MAX. */
+#define RTNL_REPLY_SIZE_ESTIMATE (8U*1024U)
+
+/* Number of messages processed at most per event loop iteration */
+#define RTNL_PROCESS_MAX 64
+
+/* Datagrams are read directly into the read buffer, without peeking at their size first. The kernel sizes
+ * dump datagrams after the buffer size of previous reads, capped at 32K, so with that size a dump is
+ * received in fewer, larger datagrams. */
+#define RTNL_RBUFFER_SIZE_MIN (32U*1024U)
+
+/* Space for attributes allocated with a new message, unless messages of the same type sent before were
+ * larger. This way most messages are built without any reallocation. */
+#define RTNL_MESSAGE_ATTRIBUTES_SIZE_DEFAULT 256U
+
 #define RTNL_CONTAINER_DEPTH 32
 
 struct reply_callback {
         sd_netlink_message_handler_t callback;
         usec_t timeout;
+        uint64_t usec; /* relative timeout, armed only once a queued request is actually written */
         uint64_t serial;
         unsigned prioq_idx;
+        bool in_flight:1;
 };
 
 struct match_callback {
@@ -78,10 +101,24 @@ struct sd_netlink {
         unsigned rqueue_partial_size;
         size_t rqueue_partial_allocated;
 
+        sd_netlink_message **wqueue;
+        size_t wqueue_size;
+        size_t wqueue_allocated;
+        unsigned n_in_flight;
+        unsigned in_flight_max; /* 0 if not determined yet */
+
         struct nlmsghdr *rbuffer;
         size_t rbuffer_allocated;
 
         bool processing:1;
+        bool overrun_pending:1;
+
+        uint64_t n_datagrams;
+        uint64_t n_messages;
+        uint64_t n_overruns;
+
+        sd_netlink_overrun_handler_t overrun_callback;
+        void *overrun_userdata;
 
         uint32_t serial;
 
@@ -101,6 +138,8 @@ struct sd_netlink {
 
         Hashmap *genl_family_to_nlmsg_type;
         Hashmap *nlmsg_type_to_genl_family;
+
+        Hashmap *message_size_hints; /* nlmsg_type → size of the largest message of this type sent */
 };
 
 struct netlink_attribute {
@@ -122,6 +161,7 @@ struct sd_netlink_message {
         int protocol;
 
         struct nlmsghdr *hdr;
+        size_t hdr_allocated;
         struct netlink_container containers[RTNL_CONTAINER_DEPTH];
         unsigned n_containers; /* number of containers */
         bool sealed:1;
@@ -132,6 +172,8 @@ struct sd_netlink_message {
 
 int message_new(sd_netlink *rtnl, sd_netlink_message **ret, uint16_t type);
 int message_new_empty(sd_netlink *rtnl, sd_netlink_message **ret);
+int message_new_header(sd_netlink *rtnl, sd_netlink_message *m, uint16_t type, size_t size);
+void message_update_size_hint(sd_netlink *rtnl, sd_netlink_message *m);
 
 int netlink_open_family(sd_netlink **ret, int family);
 
@@ -140,6 +182,7 @@ int socket_bind(sd_netlink *nl);
 int socket_broadcast_group_ref(sd_netlink *nl, unsigned group);
 int socket_broadcast_group_unref(sd_netlink *nl, unsigned group);
 int socket_write_message(sd_netlink *nl, sd_netlink_message *m);
+int socket_writev_message(sd_netlink *nl, sd_netlink_message **m, size_t msgcount);
 int socket_read_message(sd_netlink *nl);
 
 int rtnl_rqueue_make_room(sd_netlink *rtnl);
@@ -46,6 +46,46 @@ int message_new_empty(sd_netlink *rtnl, sd_netlink_message **ret) {
         return 0;
 }
 
+int message_new_header(sd_netlink *rtnl, sd_netlink_message *m, uint16_t type, size_t size) {
+        size_t allocated;
+
+        assert(rtnl);
+        assert(m);
+        assert(!m->hdr);
+        assert(size >= sizeof(struct nlmsghdr));
+
+        /* Make room for the attributes right away, so that they can be appended without reallocating */
+        allocated = PTR_TO_SIZE(hashmap_get(rtnl->message_size_hints, UINT_TO_PTR(type)));
+        allocated = MAX(allocated, size + RTNL_MESSAGE_ATTRIBUTES_SIZE_DEFAULT);
+
+        m->hdr = malloc(allocated);
+        if (!m->hdr)
+                return -ENOMEM;
+
+        memzero(m->hdr, size);
+        m->hdr_allocated = allocated;
+
+        return 0;
+}
+
+void message_update_size_hint(sd_netlink *rtnl, sd_netlink_message *m) {
+        size_t hint;
+
+        assert(rtnl);
+        assert(m);
+        assert(m->hdr);
+
+        hint = PTR_TO_SIZE(hashmap_get(rtnl->message_size_hints, UINT_TO_PTR(m->hdr->nlmsg_type)));
+        if (m->hdr->nlmsg_len <= hint)
+                return;
+
+        /* The hints are an optimization only, hence ignore failures */
+        if (hashmap_ensure_allocated(&rtnl->message_size_hints, NULL) < 0)
+                return;
+
+        (void) hashmap_replace(rtnl->message_size_hints, UINT_TO_PTR(m->hdr->nlmsg_type), SIZE_TO_PTR(m->hdr->nlmsg_len));
+}
+
 int message_new(sd_netlink *rtnl, sd_netlink_message **ret, uint16_t type) {
         _cleanup_(sd_netlink_message_unrefp) sd_netlink_message *m = NULL;
         const NLType *nl_type;
@@ -67,10 +107,9 @@ int message_new(sd_netlink *rtnl, sd_netlink_message **ret, uint16_t type) {
 
         size = NLMSG_SPACE(type_get_size(nl_type));
 
-        assert(size >= sizeof(struct nlmsghdr));
-        m->hdr = malloc0(size);
-        if (!m->hdr)
-                return -ENOMEM;
+        r = message_new_header(rtnl, m, type, size);
+        if (r < 0)
+                return r;
 
         m->hdr->nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK;
 
@@ -89,7 +128,7 @@ int sd_netlink_message_request_dump(sd_netlink_message *m, int dump) {
 
         assert_return(IN_SET(m->hdr->nlmsg_type,
                              RTM_GETLINK, RTM_GETLINKPROP, RTM_GETADDR, RTM_GETROUTE, RTM_GETNEIGH,
-                             RTM_GETRULE, RTM_GETADDRLABEL, RTM_GETNEXTHOP), -EINVAL);
+                             RTM_GETRULE, RTM_GETADDRLABEL, RTM_GETNEXTHOP, RTM_GETSTATS), -EINVAL);
 
         SET_FLAG(m->hdr->nlmsg_flags, NLM_F_DUMP, dump);
 
@@ -143,7 +182,6 @@ int sd_netlink_message_is_broadcast(const sd_netlink_message *m) {
    unsuccessful the old message is untouched. */
 static int add_rtattr(sd_netlink_message *m, unsigned short type, const void *data, size_t data_length) {
         size_t message_length;
-        struct nlmsghdr *new_hdr;
         struct rtattr *rta;
         unsigned i;
         int offset;
@@ -161,11 +199,10 @@ static int add_rtattr(sd_netlink_message *m, unsigned short type, const void *da
         if (message_length > MIN(page_size(), 8192UL))
                 return -ENOBUFS;
 
-        /* realloc to fit the new attribute */
-        new_hdr = realloc(m->hdr, message_length);
-        if (!new_hdr)
+        /* grow the buffer to fit the new attribute, with some room for more */
+        if (message_length > m->hdr_allocated &&
+            !greedy_realloc((void **) &m->hdr, &m->hdr_allocated, message_length, sizeof(uint8_t)))
                 return -ENOMEM;
-        m->hdr = new_hdr;
 
         /* get pointer to the attribute we are about to add */
         rta = (struct rtattr *) ((uint8_t *) m->hdr + m->hdr->nlmsg_len);
@@ -66,6 +66,11 @@ void netlink_slot_disconnect(sd_netlink_slot *slot, bool unref) {
                 if (slot->reply_callback.timeout != 0)
                         prioq_remove(nl->reply_callbacks_prioq, &slot->reply_callback, &slot->reply_callback.prioq_idx);
 
+                if (slot->reply_callback.in_flight) {
+                        assert(nl->n_in_flight > 0);
+                        nl->n_in_flight--;
+                }
+
                 break;
         case NETLINK_MATCH_CALLBACK:
                 LIST_REMOVE(match_callbacks, nl->match_callbacks, &slot->match_callback);
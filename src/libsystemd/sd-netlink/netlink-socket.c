@@ -238,6 +238,47 @@ int socket_write_message(sd_netlink *nl, sd_netlink_message *m) {
         return k;
 }
 
+int socket_writev_message(sd_netlink *nl, sd_netlink_message **m, size_t msgcount) {
+        _cleanup_free_ struct iovec *iovs = NULL;
+        union {
+                struct sockaddr sa;
+                struct sockaddr_nl nl;
+        } addr = {
+                .nl.nl_family = AF_NETLINK,
+        };
+        struct msghdr mh = {
+                .msg_name = &addr.sa,
+                .msg_namelen = sizeof(addr),
+        };
+        ssize_t k;
+        size_t i;
+
+        assert(nl);
+        assert(m);
+        assert(msgcount > 0);
+
+        /* The kernel processes all requests contained in one sendmsg() one after the other, as if they were
+         * sent individually, and replies to each of them separately. */
+
+        iovs = new(struct iovec, msgcount);
+        if (!iovs)
+                return -ENOMEM;
+
+        for (i = 0; i < msgcount; i++) {
+                assert(m[i]->hdr);
+                iovs[i] = IOVEC_MAKE(m[i]->hdr, m[i]->hdr->nlmsg_len);
+        }
+
+        mh.msg_iov = iovs;
+        mh.msg_iovlen = msgcount;
+
+        k = sendmsg(nl->fd, &mh, 0);
+        if (k < 0)
+                return -errno;
+
+        return k;
+}
+
 static int socket_recv_message(int fd, struct iovec *iov, uint32_t *ret_mcast_group, bool peek) {
         union sockaddr_union sender;
         uint8_t cmsg_buffer[CMSG_SPACE(sizeof(struct nl_pktinfo))];
@@ -311,32 +352,42 @@ int socket_read_message(sd_netlink *rtnl) {
         assert(rtnl->rbuffer);
         assert(rtnl->rbuffer_allocated >= sizeof(struct nlmsghdr));
 
-        /* read nothing, just get the pending message size */
-        r = socket_recv_message(rtnl->fd, &iov, NULL, true);
+        iov = IOVEC_MAKE(rtnl->rbuffer, rtnl->rbuffer_allocated);
+
+        /* Peek at the pending message with the whole read buffer, which also tells us its full size. The
+         * kernel sizes dump datagrams after the buffer, hence they usually fit. */
+        r = socket_recv_message(rtnl->fd, &iov, &group, true);
+        if (r == -ENOBUFS) {
+                rtnl->n_overruns++;
+                rtnl->overrun_pending = true;
+                return r;
+        }
         if (r <= 0)
                 return r;
         else
                 len = (size_t) r;
 
-        /* make room for the pending message */
-        if (!greedy_realloc((void **)&rtnl->rbuffer,
-                            &rtnl->rbuffer_allocated,
-                            len, sizeof(uint8_t)))
-                return -ENOMEM;
+        if (len <= rtnl->rbuffer_allocated)
+                /* We have the whole message already, only drop it from the socket, without copying it again */
+                iov = IOVEC_MAKE(NULL, 0);
+        else {
+                /* make room for the pending message */
+                if (!greedy_realloc((void **)&rtnl->rbuffer, &rtnl->rbuffer_allocated, len, sizeof(uint8_t)))
+                        return -ENOMEM;
 
-        iov = IOVEC_MAKE(rtnl->rbuffer, rtnl->rbuffer_allocated);
+                iov = IOVEC_MAKE(rtnl->rbuffer, rtnl->rbuffer_allocated);
+        }
 
         /* read the pending message */
-        r = socket_recv_message(rtnl->fd, &iov, &group, false);
+        r = socket_recv_message(rtnl->fd, &iov, NULL, false);
         if (r <= 0)
                 return r;
-        else
-                len = (size_t) r;
-
-        if (len > rtnl->rbuffer_allocated)
-                /* message did not fit in read buffer */
+        if ((size_t) r != len)
+                /* Somebody else read from the socket in between */
                 return -EIO;
 
+        rtnl->n_datagrams++;
+
         if (NLMSG_OK(rtnl->rbuffer, len) && rtnl->rbuffer->nlmsg_flags & NLM_F_MULTI) {
                 multi_part = true;
 
@@ -405,6 +456,7 @@ int socket_read_message(sd_netlink *rtnl) {
                 if (first)
                         m->next = first;
                 first = TAKE_PTR(m);
+                rtnl->n_messages++;
         }
 
         if (len > 0)
@@ -2,6 +2,7 @@
 
 #include <netinet/in.h>
 #include <linux/if_addrlabel.h>
+#include <linux/if_link.h>
 #include <linux/nexthop.h>
 #include <stdbool.h>
 #include <unistd.h>
@@ -1120,3 +1121,37 @@ int sd_rtnl_message_set_tclass_handle(sd_netlink_message *m, uint32_t handle) {
 
         return 0;
 }
+
+int sd_rtnl_message_new_stats(sd_netlink *rtnl, sd_netlink_message **ret, uint16_t nlmsg_type, int ifindex, uint32_t filter_mask) {
+        struct if_stats_msg *ifsm;
+        int r;
+
+        assert_return(nlmsg_type == RTM_GETSTATS, -EINVAL);
+        assert_return(ifindex >= 0, -EINVAL);
+        assert_return(ret, -EINVAL);
+
+        r = message_new(rtnl, ret, nlmsg_type);
+        if (r < 0)
+                return r;
+
+        ifsm = NLMSG_DATA((*ret)->hdr);
+        ifsm->family = AF_UNSPEC;
+        ifsm->ifindex = ifindex;
+        ifsm->filter_mask = filter_mask;
+
+        return 0;
+}
+
+int sd_rtnl_message_stats_get_ifindex(const sd_netlink_message *m, int *ifindex) {
+        struct if_stats_msg *ifsm;
+
+        assert_return(m, -EINVAL);
+        assert_return(m->hdr, -EINVAL);
+        assert_return(rtnl_message_type_is_stats(m->hdr->nlmsg_type), -EINVAL);
+        assert_return(ifindex, -EINVAL);
+
+        ifsm = NLMSG_DATA(m->hdr);
+        *ifindex = ifsm->ifindex;
+
+        return 0;
+}
@@ -1,5 +1,6 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
+#include <limits.h>
 #include <poll.h>
 
 #include "sd-netlink.h"
@@ -40,9 +41,9 @@ static int sd_netlink_new(sd_netlink **ret) {
         };
 
         /* We guarantee that the read buffer has at least space for
-         * a message header */
+         * a message header, and make it large enough for most datagrams */
         if (!greedy_realloc((void**)&rtnl->rbuffer, &rtnl->rbuffer_allocated,
-                            sizeof(struct nlmsghdr), sizeof(uint8_t)))
+                            RTNL_RBUFFER_SIZE_MIN, sizeof(uint8_t)))
                 return -ENOMEM;
 
         *ret = TAKE_PTR(rtnl);
@@ -148,15 +149,47 @@ int sd_netlink_inc_rcvbuf(sd_netlink *rtnl, size_t size) {
         assert_return(rtnl, -EINVAL);
         assert_return(!rtnl_pid_changed(rtnl), -ECHILD);
 
+        /* Recalculate how many requests we may keep in flight */
+        rtnl->in_flight_max = 0;
+
         return fd_inc_rcvbuf(rtnl->fd, size);
 }
 
+int sd_netlink_set_overrun_handler(sd_netlink *rtnl, sd_netlink_overrun_handler_t callback, void *userdata) {
+        assert_return(rtnl, -EINVAL);
+        assert_return(!rtnl_pid_changed(rtnl), -ECHILD);
+
+        rtnl->overrun_callback = callback;
+        rtnl->overrun_userdata = userdata;
+
+        return 0;
+}
+
+int sd_netlink_get_statistics(sd_netlink *rtnl, uint64_t *ret_datagrams, uint64_t *ret_messages, uint64_t *ret_overruns) {
+        assert_return(rtnl, -EINVAL);
+
+        if (ret_datagrams)
+                *ret_datagrams = rtnl->n_datagrams;
+        if (ret_messages)
+                *ret_messages = rtnl->n_messages;
+        if (ret_overruns)
+                *ret_overruns = rtnl->n_overruns;
+
+        return 0;
+}
+
+static int rtnl_wqueue_flush(sd_netlink *nl, bool all);
+
 static sd_netlink *netlink_free(sd_netlink *rtnl) {
         sd_netlink_slot *s;
         unsigned i;
 
         assert(rtnl);
 
+        /* Requests that were issued should go out, even if nobody is around anymore to see the replies */
+        if (!rtnl_pid_changed(rtnl))
+                (void) rtnl_wqueue_flush(rtnl, true);
+
         for (i = 0; i < rtnl->rqueue_size; i++)
                 sd_netlink_message_unref(rtnl->rqueue[i]);
         free(rtnl->rqueue);
@@ -165,6 +198,10 @@ static sd_netlink *netlink_free(sd_netlink *rtnl) {
                 sd_netlink_message_unref(rtnl->rqueue_partial[i]);
         free(rtnl->rqueue_partial);
 
+        for (i = 0; i < rtnl->wqueue_size; i++)
+                sd_netlink_message_unref(rtnl->wqueue[i]);
+        free(rtnl->wqueue);
+
         free(rtnl->rbuffer);
 
         while ((s = rtnl->slots)) {
@@ -182,6 +219,7 @@ static sd_netlink *netlink_free(sd_netlink *rtnl) {
 
         hashmap_free(rtnl->genl_family_to_nlmsg_type);
         hashmap_free(rtnl->nlmsg_type_to_genl_family);
+        hashmap_free(rtnl->message_size_hints);
 
         safe_close(rtnl->fd);
         return mfree(rtnl);
@@ -199,6 +237,7 @@ static void rtnl_seal_message(sd_netlink *rtnl, sd_netlink_message *m) {
            would get confused by replies to such messages */
         m->hdr->nlmsg_seq = rtnl->serial++ ? : rtnl->serial++;
 
+        message_update_size_hint(rtnl, m);
         rtnl_message_seal(m);
 
         return;
@@ -214,6 +253,11 @@ int sd_netlink_send(sd_netlink *nl,
         assert_return(message, -EINVAL);
         assert_return(!message->sealed, -EPERM);
 
+        /* Keep the order of requests, hence write out anything queued first */
+        r = rtnl_wqueue_flush(nl, true);
+        if (r < 0)
+                return r;
+
         rtnl_seal_message(nl, message);
 
         r = socket_write_message(nl, message);
@@ -264,7 +308,8 @@ static int dispatch_rqueue(sd_netlink *rtnl, sd_netlink_message **message) {
         if (rtnl->rqueue_size <= 0) {
                 /* Try to read a new message */
                 r = socket_read_message(rtnl);
-                if (r == -ENOBUFS) { /* FIXME: ignore buffer overruns for now */
+                if (r == -ENOBUFS) {
+                        /* Messages were lost. This is dealt with in process_overrun(). */
                         log_debug_errno(r, "Got ENOBUFS from netlink socket, ignoring.");
                         return 1;
                 }
@@ -305,6 +350,12 @@ static int process_timeout(sd_netlink *rtnl) {
         c->timeout = 0;
         hashmap_remove(rtnl->reply_callbacks, &c->serial);
 
+        if (c->in_flight) {
+                assert(rtnl->n_in_flight > 0);
+                rtnl->n_in_flight--;
+                c->in_flight = false;
+        }
+
         slot = container_of(c, sd_netlink_slot, reply_callback);
 
         r = c->callback(rtnl, m, slot->userdata);
@@ -340,6 +391,12 @@ static int process_reply(sd_netlink *rtnl, sd_netlink_message *m) {
                 c->timeout = 0;
         }
 
+        if (c->in_flight) {
+                assert(rtnl->n_in_flight > 0);
+                rtnl->n_in_flight--;
+                c->in_flight = false;
+        }
+
         r = sd_netlink_message_get_type(m, &type);
         if (r < 0)
                 return r;
@@ -395,12 +452,40 @@ static int process_match(sd_netlink *rtnl, sd_netlink_message *m) {
         return 1;
 }
 
+static int process_overrun(sd_netlink *rtnl) {
+        int r;
+
+        assert(rtnl);
+
+        if (!rtnl->overrun_pending)
+                return 0;
+
+        rtnl->overrun_pending = false;
+
+        /* The kernel does not tell us which messages were dropped, so all we can do is to let the owner of
+         * the connection know, so that it can re-enumerate the objects whose state it keeps. */
+        if (!rtnl->overrun_callback) {
+                log_debug("sd-netlink: receive buffer overrun (%"PRIu64" so far), messages were lost.", rtnl->n_overruns);
+                return 0;
+        }
+
+        r = rtnl->overrun_callback(rtnl, rtnl->overrun_userdata);
+        if (r < 0)
+                log_debug_errno(r, "sd-netlink: overrun callback failed, ignoring: %m");
+
+        return 1;
+}
+
 static int process_running(sd_netlink *rtnl, sd_netlink_message **ret) {
         _cleanup_(sd_netlink_message_unrefp) sd_netlink_message *m = NULL;
         int r;
 
         assert(rtnl);
 
+        r = process_overrun(rtnl);
+        if (r != 0)
+                goto null_message;
+
         r = process_timeout(rtnl);
         if (r != 0)
                 goto null_message;
@@ -461,6 +546,100 @@ static usec_t calc_elapse(uint64_t usec) {
         return now(CLOCK_MONOTONIC) + usec;
 }
 
+static int rtnl_wqueue_fail(sd_netlink *nl, uint32_t serial, int error) {
+        _cleanup_(sd_netlink_message_unrefp) sd_netlink_message *m = NULL;
+        int r;
+
+        assert(nl);
+
+        /* Make the reply callback see the error, as if the kernel had refused the request */
+
+        r = rtnl_rqueue_make_room(nl);
+        if (r < 0)
+                return r;
+
+        r = rtnl_message_new_synthetic_error(nl, error, serial, &m);
+        if (r < 0)
+                return r;
+
+        nl->rqueue[nl->rqueue_size++] = TAKE_PTR(m);
+        return 0;
+}
+
+static unsigned rtnl_in_flight_max(sd_netlink *nl) {
+        int rcvbuf;
+
+        assert(nl);
+
+        if (nl->in_flight_max == 0) {
+                socklen_t l = sizeof(rcvbuf);
+
+                if (getsockopt(nl->fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, &l) < 0 || rcvbuf <= 0)
+                        rcvbuf = 0;
+
+                nl->in_flight_max = CLAMP((unsigned) rcvbuf / RTNL_REPLY_SIZE_ESTIMATE, 1U, (unsigned) RTNL_WQUEUE_MAX);
+        }
+
+        return nl->in_flight_max;
+}
+
+static int rtnl_wqueue_flush(sd_netlink *nl, bool all) {
+        size_t n, size, i;
+        int r;
+
+        assert(nl);
+
+        /* Writes out queued asynchronous requests, packing as many of them into a single sendmsg() as
+         * possible. Unless 'all' is true, only as many are written as we want to wait for replies for at a
+         * time, the rest is written as replies come in. */
+
+        while (nl->wqueue_size > 0) {
+                size = 0;
+                for (n = 0; n < MIN(nl->wqueue_size, (size_t) IOV_MAX); n++) {
+                        if (!all && nl->n_in_flight + n >= rtnl_in_flight_max(nl))
+                                break;
+                        if (n > 0 && size + nl->wqueue[n]->hdr->nlmsg_len > RTNL_WBATCH_SIZE_MAX)
+                                break;
+
+                        size += nl->wqueue[n]->hdr->nlmsg_len;
+                }
+                if (n == 0)
+                        break;
+
+                r = socket_writev_message(nl, nl->wqueue, n);
+                if (r < 0)
+                        log_debug_errno(r, "sd-netlink: failed to write %zu queued requests: %m", n);
+
+                for (i = 0; i < n; i++) {
+                        uint64_t serial = rtnl_message_get_serial(nl->wqueue[i]);
+                        struct reply_callback *c;
+
+                        sd_netlink_message_unref(nl->wqueue[i]);
+
+                        c = hashmap_get(nl->reply_callbacks, &serial);
+                        if (!c) /* Slot is gone already, nobody cares about the reply */
+                                continue;
+
+                        if (r < 0 && rtnl_wqueue_fail(nl, serial, r) >= 0)
+                                continue;
+
+                        /* Only now start the timeout, so that waiting in the queue doesn't count */
+                        c->in_flight = true;
+                        nl->n_in_flight++;
+
+                        c->timeout = calc_elapse(c->usec);
+                        if (c->timeout != 0 &&
+                            prioq_put(nl->reply_callbacks_prioq, c, &c->prioq_idx) < 0)
+                                c->timeout = 0;
+                }
+
+                nl->wqueue_size -= n;
+                memmove(nl->wqueue, nl->wqueue + n, sizeof(sd_netlink_message*) * nl->wqueue_size);
+        }
+
+        return 0;
+}
+
 static int rtnl_poll(sd_netlink *rtnl, bool need_more, uint64_t timeout_usec) {
         struct pollfd p[1] = {};
         struct timespec ts;
@@ -560,23 +739,44 @@ int sd_netlink_call_async(
                 return r;
 
         slot->reply_callback.callback = callback;
-        slot->reply_callback.timeout = calc_elapse(usec);
 
-        k = sd_netlink_send(nl, m, &s);
-        if (k < 0)
-                return k;
+        if (nl->io_event_source) {
+                /* If we are attached to an event loop, queue the request, and write it together with any
+                 * others issued in the same event loop iteration from the prepare callback. */
+                assert_return(!m->sealed, -EPERM);
 
-        slot->reply_callback.serial = s;
+                if (!GREEDY_REALLOC(nl->wqueue, nl->wqueue_allocated, nl->wqueue_size + 1))
+                        return -ENOMEM;
 
-        r = hashmap_put(nl->reply_callbacks, &slot->reply_callback.serial, &slot->reply_callback);
-        if (r < 0)
-                return r;
+                rtnl_seal_message(nl, m);
+                slot->reply_callback.serial = rtnl_message_get_serial(m);
+                slot->reply_callback.usec = usec;
+
+                r = hashmap_put(nl->reply_callbacks, &slot->reply_callback.serial, &slot->reply_callback);
+                if (r < 0)
+                        return r;
+
+                nl->wqueue[nl->wqueue_size++] = sd_netlink_message_ref(m);
+                k = 1;
+        } else {
+                slot->reply_callback.timeout = calc_elapse(usec);
+
+                k = sd_netlink_send(nl, m, &s);
+                if (k < 0)
+                        return k;
 
-        if (slot->reply_callback.timeout != 0) {
-                r = prioq_put(nl->reply_callbacks_prioq, &slot->reply_callback, &slot->reply_callback.prioq_idx);
-                if (r < 0) {
-                        (void) hashmap_remove(nl->reply_callbacks, &slot->reply_callback.serial);
+                slot->reply_callback.serial = s;
+
+                r = hashmap_put(nl->reply_callbacks, &slot->reply_callback.serial, &slot->reply_callback);
+                if (r < 0)
                         return r;
+
+                if (slot->reply_callback.timeout != 0) {
+                        r = prioq_put(nl->reply_callbacks_prioq, &slot->reply_callback, &slot->reply_callback.prioq_idx);
+                        if (r < 0) {
+                                (void) hashmap_remove(nl->reply_callbacks, &slot->reply_callback.serial);
+                                return r;
+                        }
                 }
         }
 
@@ -692,7 +892,7 @@ int sd_netlink_get_timeout(const sd_netlink *rtnl, uint64_t *timeout_usec) {
         assert_return(timeout_usec, -EINVAL);
         assert_return(!rtnl_pid_changed(rtnl), -ECHILD);
 
-        if (rtnl->rqueue_size > 0) {
+        if (rtnl->rqueue_size > 0 || rtnl->overrun_pending) {
                 *timeout_usec = 0;
                 return 1;
         }
@@ -710,13 +910,21 @@ int sd_netlink_get_timeout(const sd_netlink *rtnl, uint64_t *timeout_usec) {
 
 static int io_callback(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
         sd_netlink *rtnl = userdata;
+        unsigned i;
         int r;
 
         assert(rtnl);
 
-        r = sd_netlink_process(rtnl, NULL);
-        if (r < 0)
-                return r;
+        NETLINK_DONT_DESTROY(rtnl);
+
+        /* Process a bunch of messages in one go, replies to batched requests tend to come in bulk */
+        for (i = 0; i < RTNL_PROCESS_MAX; i++) {
+                r = sd_netlink_process(rtnl, NULL);
+                if (r < 0)
+                        return r;
+                if (r == 0)
+                        break;
+        }
 
         return 1;
 }
@@ -742,6 +950,10 @@ static int prepare_callback(sd_event_source *s, void *userdata) {
         assert(s);
         assert(rtnl);
 
+        r = rtnl_wqueue_flush(rtnl, false);
+        if (r < 0)
+                return r;
+
         e = sd_netlink_get_events(rtnl);
         if (e < 0)
                 return e;
@@ -824,6 +1036,9 @@ int sd_netlink_detach_event(sd_netlink *rtnl) {
         assert_return(rtnl, -EINVAL);
         assert_return(rtnl->event, -ENXIO);
 
+        /* Nobody will flush the queue anymore, hence do so now */
+        (void) rtnl_wqueue_flush(rtnl, true);
+
         rtnl->io_event_source = sd_event_source_unref(rtnl->io_event_source);
 
         rtnl->time_event_source = sd_event_source_unref(rtnl->time_event_source);
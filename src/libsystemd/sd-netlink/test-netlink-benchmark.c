@@ -0,0 +1,130 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <linux/if_addr.h>
+#include <linux/neighbour.h>
+#include <linux/rtnetlink.h>
+
+#include "sd-netlink.h"
+
+#include "tests.h"
+#include "time-util.h"
+
+/* Builds route and neighbor messages over and over, the way networkd does when configuring many routes or
+ * neighbors at once. The messages are not sent. */
+
+static usec_t arg_duration = 2 * USEC_PER_SEC;
+
+static int build_route(sd_netlink *rtnl, unsigned n) {
+        _cleanup_(sd_netlink_message_unrefp) sd_netlink_message *m = NULL;
+        struct in_addr dst = { .s_addr = htobe32(0x0a000000 | (n & 0xffffff)) },
+                gw = { .s_addr = htobe32(0xc0a80001) };
+        int r;
+
+        r = sd_rtnl_message_new_route(rtnl, &m, RTM_NEWROUTE, AF_INET, RTPROT_STATIC);
+        if (r < 0)
+                return r;
+
+        r = sd_rtnl_message_route_set_dst_prefixlen(m, 32);
+        if (r < 0)
+                return r;
+
+        r = sd_netlink_message_append_in_addr(m, RTA_DST, &dst);
+        if (r < 0)
+                return r;
+
+        r = sd_netlink_message_append_in_addr(m, RTA_GATEWAY, &gw);
+        if (r < 0)
+                return r;
+
+        r = sd_netlink_message_append_u32(m, RTA_OIF, 1);
+        if (r < 0)
+                return r;
+
+        r = sd_netlink_message_append_u32(m, RTA_PRIORITY, 1024);
+        if (r < 0)
+                return r;
+
+        r = sd_netlink_message_append_u32(m, RTA_TABLE, RT_TABLE_MAIN);
+        if (r < 0)
+                return r;
+
+        r = sd_netlink_message_append_u8(m, RTA_PREF, 0);
+        if (r < 0)
+                return r;
+
+        r = sd_netlink_message_open_container(m, RTA_METRICS);
+        if (r < 0)
+                return r;
+
+        r = sd_netlink_message_append_u32(m, RTAX_MTU, 1500);
+        if (r < 0)
+                return r;
+
+        r = sd_netlink_message_append_u32(m, RTAX_INITCWND, 10);
+        if (r < 0)
+                return r;
+
+        r = sd_netlink_message_append_u32(m, RTAX_INITRWND, 10);
+        if (r < 0)
+                return r;
+
+        return sd_netlink_message_close_container(m);
+}
+
+static int build_neighbor(sd_netlink *rtnl, unsigned n) {
+        _cleanup_(sd_netlink_message_unrefp) sd_netlink_message *m = NULL;
+        struct in_addr dst = { .s_addr = htobe32(0x0a000000 | (n & 0xffffff)) };
+        struct ether_addr lladdr = { { 0x02, 0x00, 0x00, n >> 16, n >> 8, n } };
+        int r;
+
+        r = sd_rtnl_message_new_neigh(rtnl, &m, RTM_NEWNEIGH, 1, AF_INET);
+        if (r < 0)
+                return r;
+
+        r = sd_rtnl_message_neigh_set_state(m, NUD_PERMANENT);
+        if (r < 0)
+                return r;
+
+        r = sd_netlink_message_append_in_addr(m, NDA_DST, &dst);
+        if (r < 0)
+                return r;
+
+        return sd_netlink_message_append_data(m, NDA_LLADDR, &lladdr, sizeof(lladdr));
+}
+
+static void run(const char *what, sd_netlink *rtnl, int (*build)(sd_netlink *rtnl, unsigned n)) {
+        char buf[FORMAT_TIMESPAN_MAX];
+        usec_t start, elapsed;
+        unsigned n = 0;
+
+        start = now(CLOCK_MONOTONIC);
+        do {
+                unsigned i;
+
+                for (i = 0; i < 1000; i++)
+                        assert_se(build(rtnl, n++) >= 0);
+
+                elapsed = now(CLOCK_MONOTONIC) - start;
+        } while (elapsed < arg_duration);
+
+        log_info("%u %s messages in %s, %.1f messages/s, %.3f µs per message",
+                 n, what, format_timespan(buf, sizeof(buf), elapsed, USEC_PER_MSEC),
+                 (double) n * USEC_PER_SEC / elapsed,
+                 (double) elapsed / n);
+}
+
+int main(int argc, char *argv[]) {
+        _cleanup_(sd_netlink_unrefp) sd_netlink *rtnl = NULL;
+        int r;
+
+        test_setup_logging(LOG_INFO);
+
+        r = sd_netlink_open(&rtnl);
+        if (r < 0)
+                return log_tests_skipped_errno(r, "cannot open netlink socket");
+
+        run("route", rtnl, build_route);
+        run("neighbor", rtnl, build_neighbor);
+
+        return 0;
+}
@@ -14,6 +14,7 @@
 #include "stdio-util.h"
 #include "string-util.h"
 #include "strv.h"
+#include "time-util.h"
 #include "util.h"
 
 static void test_message_link_bridge(sd_netlink *rtnl) {
@@ -423,6 +424,79 @@ static void test_pipe(int ifindex) {
         assert_se((rtnl = sd_netlink_unref(rtnl)) == NULL);
 }
 
+static int batch_handler(sd_netlink *rtnl, sd_netlink_message *m, void *userdata) {
+        int *counter = userdata;
+
+        assert_se(sd_netlink_message_get_errno(m) >= 0);
+        (*counter)--;
+
+        return 1;
+}
+
+static void test_batch(int ifindex) {
+        _cleanup_(sd_event_unrefp) sd_event *event = NULL;
+        _cleanup_(sd_netlink_unrefp) sd_netlink *rtnl = NULL;
+        int counter = 0, i;
+
+        assert_se(sd_netlink_open(&rtnl) >= 0);
+        assert_se(sd_event_new(&event) >= 0);
+        assert_se(sd_netlink_attach_event(rtnl, event, 0) >= 0);
+
+        /* Way more requests than are written at once or kept in flight, they are queued and written in batches */
+        for (i = 0; i < 5000; i++) {
+                _cleanup_(sd_netlink_message_unrefp) sd_netlink_message *m = NULL;
+
+                assert_se(sd_rtnl_message_new_link(rtnl, &m, RTM_GETLINK, ifindex) >= 0);
+
+                counter++;
+                assert_se(sd_netlink_call_async(rtnl, NULL, m, batch_handler, NULL, &counter, 0, NULL) >= 0);
+        }
+
+        while (counter > 0)
+                assert_se(sd_event_run(event, 5 * USEC_PER_SEC) > 0);
+
+        assert_se(sd_netlink_detach_event(rtnl) >= 0);
+}
+
+static int overrun_handler(sd_netlink *rtnl, void *userdata) {
+        unsigned *n = userdata;
+
+        (*n)++;
+        return 0;
+}
+
+static void test_overrun(int ifindex) {
+        _cleanup_(sd_netlink_unrefp) sd_netlink *rtnl = NULL;
+        uint64_t n_datagrams, n_messages, n_overruns;
+        unsigned n_handled = 0;
+        int fd, i;
+
+        /* Send way more requests than replies fit into a tiny receive buffer, without reading anything */
+        assert_se((fd = socket(AF_NETLINK, SOCK_RAW|SOCK_CLOEXEC|SOCK_NONBLOCK, NETLINK_ROUTE)) >= 0);
+        assert_se(setsockopt_int(fd, SOL_SOCKET, SO_RCVBUF, 4096) >= 0);
+        assert_se(sd_netlink_open_fd(&rtnl, fd) >= 0);
+        assert_se(sd_netlink_set_overrun_handler(rtnl, overrun_handler, &n_handled) >= 0);
+
+        for (i = 0; i < 256; i++) {
+                _cleanup_(sd_netlink_message_unrefp) sd_netlink_message *m = NULL;
+
+                assert_se(sd_rtnl_message_new_link(rtnl, &m, RTM_GETLINK, ifindex) >= 0);
+                assert_se(sd_netlink_send(rtnl, m, NULL) >= 0);
+        }
+
+        while (sd_netlink_process(rtnl, NULL) > 0)
+                ;
+
+        assert_se(sd_netlink_get_statistics(rtnl, &n_datagrams, &n_messages, &n_overruns) >= 0);
+        log_info("%"PRIu64" datagrams with %"PRIu64" messages received, %"PRIu64" overruns",
+                 n_datagrams, n_messages, n_overruns);
+
+        assert_se(n_overruns > 0);
+        assert_se(n_handled > 0);
+        assert_se(n_handled <= n_overruns);
+        assert_se(n_messages < 256);
+}
+
 static void test_container(sd_netlink *rtnl) {
         _cleanup_(sd_netlink_message_unrefp) sd_netlink_message *m = NULL;
         uint16_t u16_data;
@@ -502,6 +576,42 @@ static void test_get_addresses(sd_netlink *rtnl) {
         }
 }
 
+static void test_get_stats(sd_netlink *rtnl, int ifindex) {
+        _cleanup_(sd_netlink_message_unrefp) sd_netlink_message *req = NULL, *reply = NULL;
+        struct rtnl_link_stats64 stats;
+        sd_netlink_message *m;
+        bool found = false;
+        int r;
+
+        assert_se(sd_rtnl_message_new_stats(rtnl, &req, RTM_GETSTATS, 0, IFLA_STATS_FILTER_BIT(IFLA_STATS_LINK_64)) >= 0);
+        assert_se(sd_netlink_message_request_dump(req, true) >= 0);
+
+        r = sd_netlink_call(rtnl, req, 0, &reply);
+        if (IN_SET(r, -EOPNOTSUPP, -EINVAL)) {
+                log_info_errno(r, "RTM_GETSTATS is not supported, skipping: %m");
+                return;
+        }
+        assert_se(r >= 0);
+
+        for (m = reply; m; m = sd_netlink_message_next(m)) {
+                uint16_t type;
+                int i;
+
+                assert_se(sd_netlink_message_get_type(m, &type) >= 0);
+                assert_se(type == RTM_NEWSTATS);
+
+                assert_se(sd_rtnl_message_stats_get_ifindex(m, &i) >= 0);
+                assert_se(i > 0);
+
+                assert_se(sd_netlink_message_read(m, IFLA_STATS_LINK_64, sizeof stats, &stats) >= 0);
+
+                if (i == ifindex)
+                        found = true;
+        }
+
+        assert_se(found);
+}
+
 static void test_message(sd_netlink *rtnl) {
         _cleanup_(sd_netlink_message_unrefp) sd_netlink_message *m = NULL;
 
@@ -607,10 +717,13 @@ int main(void) {
         test_slot_set(if_loopback);
         test_async_destroy_callback(if_loopback);
         test_pipe(if_loopback);
+        test_batch(if_loopback);
+        test_overrun(if_loopback);
         test_event_loop(if_loopback);
         test_link_configure(rtnl, if_loopback);
 
         test_get_addresses(rtnl);
+        test_get_stats(rtnl, if_loopback);
         test_message_link_bridge(rtnl);
 
         assert_se(sd_rtnl_message_new_link(rtnl, &m, RTM_GETLINK, if_loopback) >= 0);
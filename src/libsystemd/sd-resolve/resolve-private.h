@@ -3,6 +3,12 @@
 
 #include "sd-resolve.h"
 
+#include "time-util.h"
+
+int resolve_set_workers_max(sd_resolve *resolve, unsigned n);
+int resolve_set_cache_usec(sd_resolve *resolve, usec_t usec);
+int resolve_get_statistics(sd_resolve *resolve, uint64_t *ret_n_lookups, uint64_t *ret_n_cache_hits);
+
 int resolve_getaddrinfo_with_destroy_callback(
                 sd_resolve *resolve, sd_resolve_query **q,
                 const char *node, const char *service, const struct addrinfo *hints,
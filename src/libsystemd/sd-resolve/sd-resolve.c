@@ -18,6 +18,8 @@
 #include "dns-domain.h"
 #include "errno-util.h"
 #include "fd-util.h"
+#include "hashmap.h"
+#include "hexdecoct.h"
 #include "io-util.h"
 #include "list.h"
 #include "memory-util.h"
@@ -25,10 +27,13 @@
 #include "process-util.h"
 #include "resolve-private.h"
 #include "socket-util.h"
+#include "string-util.h"
+#include "time-util.h"
 
 #define WORKERS_MIN 1U
 #define WORKERS_MAX 16U
 #define QUERIES_MAX 256U
+#define CACHE_MAX 64U
 #define BUFSIZE 10240U
 
 typedef enum {
@@ -37,7 +42,8 @@ typedef enum {
         REQUEST_NAMEINFO,
         RESPONSE_NAMEINFO,
         REQUEST_TERMINATE,
-        RESPONSE_DIED
+        RESPONSE_DIED,
+        RESPONSE_CACHED,
 } QueryType;
 
 enum {
@@ -58,6 +64,7 @@ struct sd_resolve {
 
         pthread_t workers[WORKERS_MAX];
         unsigned n_valid_workers;
+        unsigned workers_max;
 
         unsigned current_id;
         sd_resolve_query* query_array[QUERIES_MAX];
@@ -68,6 +75,13 @@ struct sd_resolve {
 
         sd_resolve_query *current;
 
+        /* Results of recent queries by their key, if enabled with resolve_set_cache_usec() */
+        Hashmap *cache;
+        usec_t cache_usec;
+
+        /* How many queries were passed to a worker, and how many were answered from the cache */
+        uint64_t n_lookups, n_cache_hits;
+
         sd_resolve **default_resolve_ptr;
         pid_t tid;
 
@@ -81,9 +95,15 @@ struct sd_resolve_query {
 
         QueryType type:4;
         bool done:1;
+        bool answered:1; /* the result is known, but the callback not called yet */
         bool floating:1;
         unsigned id;
 
+        /* Identical queries issued while one of them is in flight are not passed to a worker again, but
+         * wait for the same request, i.e. share the request id. The key identifies the query. */
+        unsigned request_id;
+        char *key;
+
         int ret;
         int _errno;
         int _h_errno;
@@ -150,6 +170,16 @@ typedef struct NameInfoResponse {
         int _h_errno;
 } NameInfoResponse;
 
+typedef struct ResolveResult {
+        char *key;
+        usec_t until;
+        int ret;
+        int _errno;
+        int _h_errno;
+        struct addrinfo *addrinfo;
+        char *host, *serv;
+} ResolveResult;
+
 typedef union Packet {
         RHeader rheader;
         AddrInfoRequest addrinfo_request;
@@ -162,6 +192,7 @@ static int getaddrinfo_done(sd_resolve_query* q);
 static int getnameinfo_done(sd_resolve_query *q);
 
 static void resolve_query_disconnect(sd_resolve_query *q);
+static void resolve_freeaddrinfo(struct addrinfo *ai);
 
 #define RESOLVE_DONT_DESTROY(resolve) \
         _cleanup_(sd_resolve_unrefp) _unused_ sd_resolve *_dont_destroy_##resolve = sd_resolve_ref(resolve)
@@ -174,6 +205,123 @@ static void query_assign_errno(sd_resolve_query *q, int ret, int error, int h_er
         q->_h_errno = h_error;
 }
 
+static void resolve_result_assign_errno(ResolveResult *r, int ret, int error, int h_error) {
+        assert(r);
+
+        r->ret = ret;
+        r->_errno = abs(error);
+        r->_h_errno = h_error;
+}
+
+static void resolve_result_done(ResolveResult *r) {
+        assert(r);
+
+        r->key = mfree(r->key);
+        resolve_freeaddrinfo(r->addrinfo);
+        r->addrinfo = NULL;
+        r->host = mfree(r->host);
+        r->serv = mfree(r->serv);
+}
+
+static ResolveResult *resolve_result_free(ResolveResult *r) {
+        if (!r)
+                return NULL;
+
+        resolve_result_done(r);
+        return mfree(r);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(ResolveResult*, resolve_result_free);
+DEFINE_PRIVATE_HASH_OPS_WITH_VALUE_DESTRUCTOR(resolve_result_hash_ops, char, string_hash_func, string_compare_func,
+                                              ResolveResult, resolve_result_free);
+
+static int addrinfo_copy(const struct addrinfo *ai, struct addrinfo **ret) {
+        struct addrinfo *first = NULL, *prev = NULL;
+
+        assert(ret);
+
+        for (; ai; ai = ai->ai_next) {
+                struct addrinfo *c;
+
+                c = new(struct addrinfo, 1);
+                if (!c)
+                        goto fail;
+
+                *c = (struct addrinfo) {
+                        .ai_flags = ai->ai_flags,
+                        .ai_family = ai->ai_family,
+                        .ai_socktype = ai->ai_socktype,
+                        .ai_protocol = ai->ai_protocol,
+                        .ai_addrlen = ai->ai_addrlen,
+                };
+
+                if (prev)
+                        prev->ai_next = c;
+                else
+                        first = c;
+                prev = c;
+
+                if (ai->ai_addr) {
+                        c->ai_addr = memdup(ai->ai_addr, ai->ai_addrlen);
+                        if (!c->ai_addr)
+                                goto fail;
+                }
+
+                if (ai->ai_canonname) {
+                        c->ai_canonname = strdup(ai->ai_canonname);
+                        if (!c->ai_canonname)
+                                goto fail;
+                }
+        }
+
+        *ret = first;
+        return 0;
+
+fail:
+        resolve_freeaddrinfo(first);
+        return -ENOMEM;
+}
+
+static void query_set_result(sd_resolve_query *q, ResolveResult *r, bool steal) {
+        assert(q);
+        assert(r);
+
+        /* Copies the result into the query, or moves it there if this is the last query that needs it */
+
+        query_assign_errno(q, r->ret, r->_errno, r->_h_errno);
+
+        if (steal) {
+                q->addrinfo = TAKE_PTR(r->addrinfo);
+                q->host = TAKE_PTR(r->host);
+                q->serv = TAKE_PTR(r->serv);
+                return;
+        }
+
+        if (addrinfo_copy(r->addrinfo, &q->addrinfo) < 0)
+                goto fail;
+
+        if (r->host) {
+                q->host = strdup(r->host);
+                if (!q->host)
+                        goto fail;
+        }
+
+        if (r->serv) {
+                q->serv = strdup(r->serv);
+                if (!q->serv)
+                        goto fail;
+        }
+
+        return;
+
+fail:
+        resolve_freeaddrinfo(q->addrinfo);
+        q->addrinfo = NULL;
+        q->host = mfree(q->host);
+        q->serv = mfree(q->serv);
+        query_assign_errno(q, EAI_MEMORY, ENOMEM, 0);
+}
+
 static int send_died(int out_fd) {
         RHeader rh = {
                 .type = RESPONSE_DIED,
@@ -449,7 +597,7 @@ static int start_threads(sd_resolve *resolve, unsigned extra) {
                 return -r;
 
         n = resolve->n_outstanding + extra;
-        n = CLAMP(n, WORKERS_MIN, WORKERS_MAX);
+        n = CLAMP(n, WORKERS_MIN, resolve->workers_max);
 
         while (resolve->n_valid_workers < n) {
                 r = pthread_create(&resolve->workers[resolve->n_valid_workers], NULL, thread_worker, resolve);
@@ -492,6 +640,7 @@ _public_ int sd_resolve_new(sd_resolve **ret) {
 
         resolve->n_ref = 1;
         resolve->original_pid = getpid_cached();
+        resolve->workers_max = WORKERS_MAX;
 
         for (i = 0; i < _FD_MAX; i++)
                 resolve->fds[i] = -1;
@@ -557,6 +706,47 @@ _public_ int sd_resolve_get_tid(sd_resolve *resolve, pid_t *tid) {
         return -ENXIO;
 }
 
+int resolve_set_workers_max(sd_resolve *resolve, unsigned n) {
+        assert_return(resolve, -EINVAL);
+        assert_return(!resolve_pid_changed(resolve), -ECHILD);
+
+        /* Workers that are running already are not stopped, this only limits how many are started */
+
+        if (n < WORKERS_MIN || n > WORKERS_MAX)
+                return -ERANGE;
+
+        resolve->workers_max = n;
+        return 0;
+}
+
+int resolve_set_cache_usec(sd_resolve *resolve, usec_t usec) {
+        assert_return(resolve, -EINVAL);
+        assert_return(!resolve_pid_changed(resolve), -ECHILD);
+
+        /* Results are cached for the specified time, zero turns caching off. Note that this is a simple
+         * cache, which doesn't know about the TTLs of the records looked up, nor about changes of the
+         * network configuration. Only use it where slightly outdated results are acceptable. */
+
+        resolve->cache_usec = usec;
+
+        if (usec == 0)
+                resolve->cache = hashmap_free(resolve->cache);
+
+        return 0;
+}
+
+int resolve_get_statistics(sd_resolve *resolve, uint64_t *ret_n_lookups, uint64_t *ret_n_cache_hits) {
+        assert_return(resolve, -EINVAL);
+        assert_return(!resolve_pid_changed(resolve), -ECHILD);
+
+        if (ret_n_lookups)
+                *ret_n_lookups = resolve->n_lookups;
+        if (ret_n_cache_hits)
+                *ret_n_cache_hits = resolve->n_cache_hits;
+
+        return 0;
+}
+
 static sd_resolve *resolve_free(sd_resolve *resolve) {
         PROTECT_ERRNO;
         sd_resolve_query *q;
@@ -597,6 +787,8 @@ static sd_resolve *resolve_free(sd_resolve *resolve) {
         /* Close all communication channels */
         close_many(resolve->fds, _FD_MAX);
 
+        hashmap_free(resolve->cache);
+
         return mfree(resolve);
 }
 
@@ -625,17 +817,93 @@ _public_ int sd_resolve_get_timeout(sd_resolve *resolve, uint64_t *usec) {
         return 0;
 }
 
-static sd_resolve_query *lookup_query(sd_resolve *resolve, unsigned id) {
-        sd_resolve_query *q;
+static ResolveResult *resolve_cache_get(sd_resolve *resolve, const char *key) {
+        ResolveResult *e;
 
         assert(resolve);
+        assert(key);
 
-        q = resolve->query_array[id % QUERIES_MAX];
-        if (q)
-                if (q->id == id)
-                        return q;
+        e = hashmap_get(resolve->cache, key);
+        if (!e)
+                return NULL;
 
-        return NULL;
+        if (e->until <= now(CLOCK_MONOTONIC)) {
+                hashmap_remove(resolve->cache, key);
+                resolve_result_free(e);
+                return NULL;
+        }
+
+        return e;
+}
+
+static void resolve_cache_put(sd_resolve *resolve, const char *key, const ResolveResult *r) {
+        _cleanup_(resolve_result_freep) ResolveResult *e = NULL;
+        ResolveResult *i;
+        Iterator j;
+        usec_t n;
+
+        assert(resolve);
+        assert(key);
+        assert(r);
+
+        if (resolve->cache_usec == 0)
+                return;
+
+        /* Don't remember temporary failures, only actual answers, positive or negative */
+        if (IN_SET(r->ret, EAI_AGAIN, EAI_MEMORY, EAI_SYSTEM))
+                return;
+
+        n = now(CLOCK_MONOTONIC);
+
+        HASHMAP_FOREACH(i, resolve->cache, j)
+                if (i->until <= n) {
+                        hashmap_remove(resolve->cache, i->key);
+                        resolve_result_free(i);
+                }
+
+        if (hashmap_size(resolve->cache) >= CACHE_MAX)
+                resolve_result_free(hashmap_steal_first(resolve->cache));
+
+        /* The cache is best effort, hence if we fail to allocate anything here, we simply don't cache */
+
+        e = new(ResolveResult, 1);
+        if (!e)
+                return;
+
+        *e = (ResolveResult) {
+                .key = strdup(key),
+                .until = usec_add(n, resolve->cache_usec),
+                .ret = r->ret,
+                ._errno = r->_errno,
+                ._h_errno = r->_h_errno,
+        };
+        if (!e->key)
+                return;
+
+        if (addrinfo_copy(r->addrinfo, &e->addrinfo) < 0)
+                return;
+
+        if (r->host) {
+                e->host = strdup(r->host);
+                if (!e->host)
+                        return;
+        }
+
+        if (r->serv) {
+                e->serv = strdup(r->serv);
+                if (!e->serv)
+                        return;
+        }
+
+        if (hashmap_ensure_allocated(&resolve->cache, &resolve_result_hash_ops) < 0)
+                return;
+
+        resolve_result_free(hashmap_remove(resolve->cache, key));
+
+        if (hashmap_put(resolve->cache, e->key, e) < 0)
+                return;
+
+        TAKE_PTR(e);
 }
 
 static int complete_query(sd_resolve *resolve, sd_resolve_query *q) {
@@ -676,6 +944,58 @@ static int complete_query(sd_resolve *resolve, sd_resolve_query *q) {
         return r;
 }
 
+static void answer_queries(sd_resolve *resolve, unsigned id, ResolveResult *r, QueryType type) {
+        sd_resolve_query *q;
+        unsigned n = 0;
+
+        assert(resolve);
+        assert(r);
+
+        /* Hands the result of a request to all queries waiting for it. They are only marked as answered
+         * here, and completed afterwards by complete_answered_queries(). That way, identical queries
+         * issued from the callbacks are not attached to a request that has already been answered. */
+
+        LIST_FOREACH(queries, q, resolve->queries)
+                if (!q->answered && q->request_id == id && q->type == type)
+                        n++;
+
+        LIST_FOREACH(queries, q, resolve->queries) {
+                if (q->answered || q->request_id != id || q->type != type)
+                        continue;
+
+                if (n == 1)
+                        resolve_cache_put(resolve, q->key, r);
+
+                query_set_result(q, r, --n == 0);
+                q->answered = true;
+        }
+}
+
+static int complete_answered_queries(sd_resolve *resolve, unsigned id) {
+        int r = 0;
+
+        assert(resolve);
+
+        /* The callbacks may free any of the queries, hence look for the next one after each */
+
+        for (;;) {
+                sd_resolve_query *q, *found = NULL;
+                int k;
+
+                /* Take the last one, i.e. the oldest, so that callbacks are called in the order the
+                 * queries were issued */
+                LIST_FOREACH(queries, q, resolve->queries)
+                        if (q->answered && !q->done && q->request_id == id)
+                                found = q;
+                if (!found)
+                        return r;
+
+                k = complete_query(resolve, found);
+                if (k < 0 && r >= 0)
+                        r = k;
+        }
+}
+
 static int unserialize_addrinfo(const void **p, size_t *length, struct addrinfo **ret_ai) {
         AddrInfoSerialization s;
         struct addrinfo *ai;
@@ -732,8 +1052,8 @@ static int unserialize_addrinfo(const void **p, size_t *length, struct addrinfo
 }
 
 static int handle_response(sd_resolve *resolve, const Packet *packet, size_t length) {
+        _cleanup_(resolve_result_done) ResolveResult result = {};
         const RHeader *resp;
-        sd_resolve_query *q;
         int r;
 
         assert(resolve);
@@ -751,12 +1071,12 @@ static int handle_response(sd_resolve *resolve, const Packet *packet, size_t len
         assert(resolve->n_outstanding > 0);
         resolve->n_outstanding--;
 
-        q = lookup_query(resolve, resp->id);
-        if (!q)
-                return 0;
-
         switch (resp->type) {
 
+        case RESPONSE_CACHED:
+                /* The result has been filled in when the query was issued already */
+                return complete_answered_queries(resolve, resp->id);
+
         case RESPONSE_ADDRINFO: {
                 const AddrInfoResponse *ai_resp = &packet->addrinfo_response;
                 const void *p;
@@ -764,9 +1084,8 @@ static int handle_response(sd_resolve *resolve, const Packet *packet, size_t len
                 struct addrinfo *prev = NULL;
 
                 assert_return(length >= sizeof(AddrInfoResponse), -EBADMSG);
-                assert_return(q->type == REQUEST_ADDRINFO, -EBADMSG);
 
-                query_assign_errno(q, ai_resp->ret, ai_resp->_errno, ai_resp->_h_errno);
+                resolve_result_assign_errno(&result, ai_resp->ret, ai_resp->_errno, ai_resp->_h_errno);
 
                 l = length - sizeof(AddrInfoResponse);
                 p = (const uint8_t*) resp + sizeof(AddrInfoResponse);
@@ -776,52 +1095,53 @@ static int handle_response(sd_resolve *resolve, const Packet *packet, size_t len
 
                         r = unserialize_addrinfo(&p, &l, &ai);
                         if (r < 0) {
-                                query_assign_errno(q, EAI_SYSTEM, r, 0);
-                                freeaddrinfo(q->addrinfo);
-                                q->addrinfo = NULL;
+                                resolve_result_assign_errno(&result, EAI_SYSTEM, r, 0);
+                                resolve_freeaddrinfo(result.addrinfo);
+                                result.addrinfo = NULL;
                                 break;
                         }
 
                         if (prev)
                                 prev->ai_next = ai;
                         else
-                                q->addrinfo = ai;
+                                result.addrinfo = ai;
 
                         prev = ai;
                 }
 
-                return complete_query(resolve, q);
+                answer_queries(resolve, resp->id, &result, REQUEST_ADDRINFO);
+                return complete_answered_queries(resolve, resp->id);
         }
 
         case RESPONSE_NAMEINFO: {
                 const NameInfoResponse *ni_resp = &packet->nameinfo_response;
 
                 assert_return(length >= sizeof(NameInfoResponse), -EBADMSG);
-                assert_return(q->type == REQUEST_NAMEINFO, -EBADMSG);
 
                 if (ni_resp->hostlen > DNS_HOSTNAME_MAX ||
                     ni_resp->servlen > DNS_HOSTNAME_MAX ||
                     sizeof(NameInfoResponse) + ni_resp->hostlen + ni_resp->servlen > length)
-                        query_assign_errno(q, EAI_SYSTEM, EIO, 0);
+                        resolve_result_assign_errno(&result, EAI_SYSTEM, EIO, 0);
                 else {
-                        query_assign_errno(q, ni_resp->ret, ni_resp->_errno, ni_resp->_h_errno);
+                        resolve_result_assign_errno(&result, ni_resp->ret, ni_resp->_errno, ni_resp->_h_errno);
 
                         if (ni_resp->hostlen > 0) {
-                                q->host = strndup((const char*) ni_resp + sizeof(NameInfoResponse),
-                                                  ni_resp->hostlen-1);
-                                if (!q->host)
-                                        query_assign_errno(q, EAI_MEMORY, ENOMEM, 0);
+                                result.host = strndup((const char*) ni_resp + sizeof(NameInfoResponse),
+                                                      ni_resp->hostlen-1);
+                                if (!result.host)
+                                        resolve_result_assign_errno(&result, EAI_MEMORY, ENOMEM, 0);
                         }
 
                         if (ni_resp->servlen > 0) {
-                                q->serv = strndup((const char*) ni_resp + sizeof(NameInfoResponse) + ni_resp->hostlen,
-                                                  ni_resp->servlen-1);
-                                if (!q->serv)
-                                        query_assign_errno(q, EAI_MEMORY, ENOMEM, 0);
+                                result.serv = strndup((const char*) ni_resp + sizeof(NameInfoResponse) + ni_resp->hostlen,
+                                                      ni_resp->servlen-1);
+                                if (!result.serv)
+                                        resolve_result_assign_errno(&result, EAI_MEMORY, ENOMEM, 0);
                         }
                 }
 
-                return complete_query(resolve, q);
+                answer_queries(resolve, resp->id, &result, REQUEST_NAMEINFO);
+                return complete_answered_queries(resolve, resp->id);
         }
 
         default:
@@ -885,7 +1205,6 @@ _public_ int sd_resolve_wait(sd_resolve *resolve, uint64_t timeout_usec) {
 
 static int alloc_query(sd_resolve *resolve, bool floating, sd_resolve_query **_q) {
         sd_resolve_query *q;
-        int r;
 
         assert(resolve);
         assert(_q);
@@ -893,10 +1212,6 @@ static int alloc_query(sd_resolve *resolve, bool floating, sd_resolve_query **_q
         if (resolve->n_queries >= QUERIES_MAX)
                 return -ENOBUFS;
 
-        r = start_threads(resolve, 1);
-        if (r < 0)
-                return r;
-
         while (resolve->query_array[resolve->current_id % QUERIES_MAX])
                 resolve->current_id++;
 
@@ -908,6 +1223,7 @@ static int alloc_query(sd_resolve *resolve, bool floating, sd_resolve_query **_q
         q->resolve = resolve;
         q->floating = floating;
         q->id = resolve->current_id++;
+        q->request_id = q->id;
 
         if (!floating)
                 sd_resolve_ref(resolve);
@@ -919,6 +1235,57 @@ static int alloc_query(sd_resolve *resolve, bool floating, sd_resolve_query **_q
         return 0;
 }
 
+static int query_dispatch(sd_resolve *resolve, sd_resolve_query *q, const struct msghdr *mh) {
+        sd_resolve_query *i;
+        ResolveResult *e;
+        int r;
+
+        assert(resolve);
+        assert(q);
+        assert(q->key);
+        assert(mh);
+
+        /* First, check if we know the answer already */
+        e = resolve_cache_get(resolve, q->key);
+        if (e) {
+                RHeader rh = {
+                        .type = RESPONSE_CACHED,
+                        .id = q->id,
+                        .length = sizeof(RHeader),
+                };
+
+                /* Callbacks are never invoked from within the call issuing the query, hence let's
+                 * complete it from sd_resolve_process(), like any other */
+                if (send(resolve->fds[RESPONSE_SEND_FD], &rh, rh.length, MSG_NOSIGNAL|MSG_DONTWAIT) < 0)
+                        return -errno;
+
+                query_set_result(q, e, false);
+                q->answered = true;
+                resolve->n_outstanding++;
+                resolve->n_cache_hits++;
+                return 0;
+        }
+
+        /* Second, if the very same query is in flight already, just wait for its answer too */
+        LIST_FOREACH(queries, i, resolve->queries)
+                if (i != q && !i->answered && i->type == q->type && streq(i->key, q->key)) {
+                        q->request_id = i->request_id;
+                        return 0;
+                }
+
+        /* Otherwise, pass it to a worker */
+        r = start_threads(resolve, 1);
+        if (r < 0)
+                return r;
+
+        if (sendmsg(resolve->fds[REQUEST_SEND_FD], mh, MSG_NOSIGNAL) < 0)
+                return -errno;
+
+        resolve->n_outstanding++;
+        resolve->n_lookups++;
+        return 0;
+}
+
 int resolve_getaddrinfo_with_destroy_callback(
                 sd_resolve *resolve,
                 sd_resolve_query **ret_query,
@@ -951,6 +1318,16 @@ int resolve_getaddrinfo_with_destroy_callback(
         node_len = node ? strlen(node) + 1 : 0;
         service_len = service ? strlen(service) + 1 : 0;
 
+        /* The lengths make the concatenation of node and service unambiguous */
+        if (asprintf(&q->key, "%i %i %i %i %i %zu %zu %s%s",
+                     !!hints,
+                     hints ? hints->ai_flags : 0,
+                     hints ? hints->ai_family : 0,
+                     hints ? hints->ai_socktype : 0,
+                     hints ? hints->ai_protocol : 0,
+                     node_len, service_len, strempty(node), strempty(service)) < 0)
+                return -ENOMEM;
+
         req = (AddrInfoRequest) {
                 .node_len = node_len,
                 .service_len = service_len,
@@ -975,10 +1352,10 @@ int resolve_getaddrinfo_with_destroy_callback(
                 iov[mh.msg_iovlen++] = IOVEC_MAKE((void*) service, req.service_len);
         mh.msg_iov = iov;
 
-        if (sendmsg(resolve->fds[REQUEST_SEND_FD], &mh, MSG_NOSIGNAL) < 0)
-                return -errno;
+        r = query_dispatch(resolve, q, &mh);
+        if (r < 0)
+                return r;
 
-        resolve->n_outstanding++;
         q->destroy_callback = destroy_callback;
 
         if (ret_query)
@@ -1022,6 +1399,7 @@ int resolve_getnameinfo_with_destroy_callback(
                 void *userdata) {
 
         _cleanup_(sd_resolve_query_unrefp) sd_resolve_query *q = NULL;
+        _cleanup_free_ char *hex = NULL;
         NameInfoRequest req = {};
         struct iovec iov[2];
         struct msghdr mh;
@@ -1043,6 +1421,13 @@ int resolve_getnameinfo_with_destroy_callback(
         q->getnameinfo_handler = callback;
         q->userdata = userdata;
 
+        hex = hexmem(sa, salen);
+        if (!hex)
+                return -ENOMEM;
+
+        if (asprintf(&q->key, "%i %" PRIu64 " %s", flags, get, hex) < 0)
+                return -ENOMEM;
+
         req = (NameInfoRequest) {
                 .header.id = q->id,
                 .header.type = REQUEST_NAMEINFO,
@@ -1064,10 +1449,10 @@ int resolve_getnameinfo_with_destroy_callback(
                 .msg_iovlen = ELEMENTSOF(iov)
         };
 
-        if (sendmsg(resolve->fds[REQUEST_SEND_FD], &mh, MSG_NOSIGNAL) < 0)
-                return -errno;
+        r = query_dispatch(resolve, q, &mh);
+        if (r < 0)
+                return r;
 
-        resolve->n_outstanding++;
         q->destroy_callback = destroy_callback;
 
         if (ret_query)
@@ -1152,6 +1537,7 @@ static sd_resolve_query *resolve_query_free(sd_resolve_query *q) {
         resolve_freeaddrinfo(q->addrinfo);
         free(q->host);
         free(q->serv);
+        free(q->key);
 
         return mfree(q);
 }
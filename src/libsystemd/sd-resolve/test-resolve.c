@@ -10,6 +10,7 @@
 
 #include "alloc-util.h"
 #include "macro.h"
+#include "resolve-private.h"
 #include "socket-util.h"
 #include "string-util.h"
 #include "time-util.h"
@@ -50,6 +51,94 @@ static int getnameinfo_handler(sd_resolve_query *q, int ret, const char *host, c
         return 0;
 }
 
+typedef struct CountingResult {
+        unsigned n;
+        int ret;
+        struct sockaddr_storage first;
+} CountingResult;
+
+static int counting_handler(sd_resolve_query *q, int ret, const struct addrinfo *ai, void *userdata) {
+        CountingResult *c = userdata;
+
+        assert_se(q);
+
+        log_info("getaddrinfo(\"localhost\") finished: %s", ret == 0 ? "success" : gai_strerror(ret));
+
+        /* Every query waiting for the same lookup, or answered from the cache, gets the same result */
+        if (ret == 0) {
+                assert_se(ai);
+                assert_se(ai->ai_addrlen <= sizeof(c->first));
+        }
+
+        if (c->n == 0) {
+                c->ret = ret;
+                if (ret == 0)
+                        memcpy(&c->first, ai->ai_addr, ai->ai_addrlen);
+        } else {
+                assert_se(ret == c->ret);
+                if (ret == 0)
+                        assert_se(memcmp(&c->first, ai->ai_addr, ai->ai_addrlen) == 0);
+        }
+
+        c->n++;
+        return 0;
+}
+
+static void test_dedup_and_cache(void) {
+        _cleanup_(sd_resolve_unrefp) sd_resolve *resolve = NULL;
+        CountingResult c = {}, d = {};
+        uint64_t n_lookups, n_cache_hits;
+        unsigned i;
+
+        assert_se(sd_resolve_new(&resolve) >= 0);
+        assert_se(resolve_set_workers_max(resolve, 2) >= 0);
+        assert_se(resolve_set_cache_usec(resolve, 30 * USEC_PER_SEC) >= 0);
+
+        /* Identical queries issued at the same time are answered by a single lookup, and each callback
+         * is still called */
+        for (i = 0; i < 5; i++)
+                assert_se(sd_resolve_getaddrinfo(resolve, NULL, "localhost", NULL, NULL, counting_handler, &c) >= 0);
+
+        assert_se(resolve_get_statistics(resolve, &n_lookups, &n_cache_hits) >= 0);
+        assert_se(n_lookups == 1);
+        assert_se(n_cache_hits == 0);
+
+        while (c.n < 5)
+                assert_se(sd_resolve_wait(resolve, TEST_TIMEOUT_USEC) >= 0);
+
+        /* Further ones are answered from the cache, but still asynchronously */
+        assert_se(sd_resolve_getaddrinfo(resolve, NULL, "localhost", NULL, NULL, counting_handler, &c) >= 0);
+        assert_se(c.n == 5);
+
+        assert_se(resolve_get_statistics(resolve, &n_lookups, &n_cache_hits) >= 0);
+        assert_se(n_lookups == 1);
+        assert_se(n_cache_hits == 1);
+
+        while (c.n < 6)
+                assert_se(sd_resolve_wait(resolve, TEST_TIMEOUT_USEC) >= 0);
+
+        /* A different query is looked up on its own */
+        assert_se(sd_resolve_getaddrinfo(resolve, NULL, "localhost", "80", NULL, counting_handler, &d) >= 0);
+        assert_se(resolve_get_statistics(resolve, &n_lookups, &n_cache_hits) >= 0);
+        assert_se(n_lookups == 2);
+        assert_se(n_cache_hits == 1);
+
+        while (d.n < 1)
+                assert_se(sd_resolve_wait(resolve, TEST_TIMEOUT_USEC) >= 0);
+
+        /* Without the cache, the same query is looked up again */
+        assert_se(resolve_set_cache_usec(resolve, 0) >= 0);
+        assert_se(sd_resolve_getaddrinfo(resolve, NULL, "localhost", NULL, NULL, counting_handler, &c) >= 0);
+        assert_se(resolve_get_statistics(resolve, &n_lookups, &n_cache_hits) >= 0);
+        assert_se(n_lookups == 3);
+        assert_se(n_cache_hits == 1);
+
+        while (c.n < 7)
+                assert_se(sd_resolve_wait(resolve, TEST_TIMEOUT_USEC) >= 0);
+
+        assert_se(sd_resolve_wait(resolve, 0) == 0);
+}
+
 int main(int argc, char *argv[]) {
         _cleanup_(sd_resolve_query_unrefp) sd_resolve_query *q1 = NULL, *q2 = NULL;
         _cleanup_(sd_resolve_unrefp) sd_resolve *resolve = NULL;
@@ -66,6 +155,8 @@ int main(int argc, char *argv[]) {
                 .sin_port = htons(80)
         };
 
+        test_dedup_and_cache();
+
         assert_se(sd_resolve_default(&resolve) >= 0);
 
         /* Test a floating resolver query */
@@ -5,7 +5,9 @@
 
 #include "sd-device.h"
 
+#include "alloc-util.h"
 #include "device-nodes.h"
+#include "hashmap.h"
 #include "libudev-util.h"
 #include "string-util.h"
 #include "strxcpyx.h"
@@ -18,8 +20,52 @@
  * Utilities useful when dealing with devices and device node names.
  */
 
-/* handle "[<SUBSYSTEM>/<KERNEL>]<attribute>" format */
-int util_resolve_subsys_kernel(const char *string, char *result, size_t maxsize, bool read_value) {
+DEFINE_PRIVATE_HASH_OPS_FULL(device_hash_ops, char, string_hash_func, string_compare_func, free,
+                             sd_device, sd_device_unref);
+
+static int get_device(Hashmap **devices, const char *subsys, const char *sysname, sd_device **ret) {
+        _cleanup_(sd_device_unrefp) sd_device *dev = NULL;
+        _cleanup_free_ char *key = NULL;
+        int r;
+
+        assert(subsys);
+        assert(sysname);
+        assert(ret);
+
+        if (!devices)
+                return sd_device_new_from_subsystem_sysname(ret, subsys, sysname);
+
+        key = strjoin(subsys, "/", sysname);
+        if (!key)
+                return -ENOMEM;
+
+        dev = sd_device_ref(hashmap_get(*devices, key));
+        if (dev) {
+                *ret = TAKE_PTR(dev);
+                return 0;
+        }
+
+        r = sd_device_new_from_subsystem_sysname(&dev, subsys, sysname);
+        if (r < 0)
+                return r;
+
+        r = hashmap_ensure_allocated(devices, &device_hash_ops);
+        if (r < 0)
+                return r;
+
+        r = hashmap_put(*devices, key, dev);
+        if (r < 0)
+                return r;
+
+        TAKE_PTR(key);
+        *ret = sd_device_ref(dev);
+        return 0;
+}
+
+/* handle "[<SUBSYSTEM>/<KERNEL>]<attribute>" format. If devices is non-NULL, the devices looked up are
+ * remembered there, keyed by "<SUBSYSTEM>/<KERNEL>", so that repeated lookups share one sd_device object
+ * and hence its attribute cache. */
+int util_resolve_subsys_kernel_full(const char *string, Hashmap **devices, char *result, size_t maxsize, bool read_value) {
         char temp[UTIL_PATH_SIZE], *subsys, *sysname, *attr;
         _cleanup_(sd_device_unrefp) sd_device *dev = NULL;
         const char *val;
@@ -51,7 +97,7 @@ int util_resolve_subsys_kernel(const char *string, char *result, size_t maxsize,
         if (read_value && !attr)
                 return -EINVAL;
 
-        r = sd_device_new_from_subsystem_sysname(&dev, subsys, sysname);
+        r = get_device(devices, subsys, sysname, &dev);
         if (r < 0)
                 return r;
 
@@ -3,6 +3,7 @@
 
 #include "libudev.h"
 
+#include "hashmap.h"
 #include "macro.h"
 
 /* libudev-util.c */
@@ -13,7 +14,10 @@
 size_t util_path_encode(const char *src, char *dest, size_t size);
 size_t util_replace_whitespace(const char *str, char *to, size_t len);
 size_t util_replace_chars(char *str, const char *white);
-int util_resolve_subsys_kernel(const char *string, char *result, size_t maxsize, bool read_value);
+int util_resolve_subsys_kernel_full(const char *string, Hashmap **devices, char *result, size_t maxsize, bool read_value);
+static inline int util_resolve_subsys_kernel(const char *string, char *result, size_t maxsize, bool read_value) {
+        return util_resolve_subsys_kernel_full(string, NULL, result, maxsize, read_value);
+}
 
 /* Cleanup functions */
 DEFINE_TRIVIAL_CLEANUP_FUNC(struct udev*, udev_unref);
@@ -65,6 +65,9 @@ Seat* seat_free(Seat *s) {
         if (s->in_gc_queue)
                 LIST_REMOVE(gc_queue, s->manager->seat_gc_queue, s);
 
+        if (s->in_save_queue)
+                LIST_REMOVE(save_queue, s->manager->seat_save_queue, s);
+
         while (s->sessions)
                 session_free(s->sessions);
 
@@ -82,12 +85,31 @@ Seat* seat_free(Seat *s) {
 }
 
 int seat_save(Seat *s) {
+        assert(s);
+
+        /* Only marks the state file dirty, see session_save() */
+
+        if (s->in_save_queue)
+                return 0;
+
+        LIST_PREPEND(save_queue, s->manager->seat_save_queue, s);
+        s->in_save_queue = true;
+
+        return 0;
+}
+
+int seat_save_now(Seat *s) {
         _cleanup_free_ char *temp_path = NULL;
         _cleanup_fclose_ FILE *f = NULL;
         int r;
 
         assert(s);
 
+        if (s->in_save_queue) {
+                LIST_REMOVE(save_queue, s->manager->seat_save_queue, s);
+                s->in_save_queue = false;
+        }
+
         if (!s->started)
                 return 0;
 
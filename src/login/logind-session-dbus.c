@@ -935,8 +935,11 @@ int session_send_create_reply(Session *s, sd_bus_error *error) {
         if (fifo_fd < 0)
                 return fifo_fd;
 
-        /* Update the session state file before we notify the client about the result. */
-        session_save(s);
+        /* Update the state files before we notify the client about the result. */
+        session_save_now(s);
+        user_save_now(s->user);
+        if (s->seat)
+                seat_save_now(s->seat);
 
         p = session_bus_path(s);
         if (!p)
@@ -93,6 +93,9 @@ Session* session_free(Session *s) {
         if (s->in_gc_queue)
                 LIST_REMOVE(gc_queue, s->manager->session_gc_queue, s);
 
+        if (s->in_save_queue)
+                LIST_REMOVE(save_queue, s->manager->session_save_queue, s);
+
         s->timer_event_source = sd_event_source_unref(s->timer_event_source);
 
         session_drop_controller(s);
@@ -200,12 +203,32 @@ static void session_save_devices(Session *s, FILE *f) {
 }
 
 int session_save(Session *s) {
+        assert(s);
+
+        /* Only marks the state file dirty, it's written at the end of the current event loop iteration, so
+         * that multiple changes are coalesced into a single write. */
+
+        if (s->in_save_queue)
+                return 0;
+
+        LIST_PREPEND(save_queue, s->manager->session_save_queue, s);
+        s->in_save_queue = true;
+
+        return 0;
+}
+
+int session_save_now(Session *s) {
         _cleanup_free_ char *temp_path = NULL;
         _cleanup_fclose_ FILE *f = NULL;
         int r = 0;
 
         assert(s);
 
+        if (s->in_save_queue) {
+                LIST_REMOVE(save_queue, s->manager->session_save_queue, s);
+                s->in_save_queue = false;
+        }
+
         if (!s->user)
                 return -ESTALE;
 
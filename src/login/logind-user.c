@@ -109,6 +109,9 @@ User *user_free(User *u) {
         if (u->in_gc_queue)
                 LIST_REMOVE(gc_queue, u->manager->user_gc_queue, u);
 
+        if (u->in_save_queue)
+                LIST_REMOVE(save_queue, u->manager->user_save_queue, u);
+
         while (u->sessions)
                 session_free(u->sessions);
 
@@ -296,6 +299,25 @@ fail:
 int user_save(User *u) {
         assert(u);
 
+        /* Only marks the state file dirty, see session_save() */
+
+        if (u->in_save_queue)
+                return 0;
+
+        LIST_PREPEND(save_queue, u->manager->user_save_queue, u);
+        u->in_save_queue = true;
+
+        return 0;
+}
+
+int user_save_now(User *u) {
+        assert(u);
+
+        if (u->in_save_queue) {
+                LIST_REMOVE(save_queue, u->manager->user_save_queue, u);
+                u->in_save_queue = false;
+        }
+
         if (!u->started)
                 return 0;
 
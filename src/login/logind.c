@@ -35,6 +35,8 @@
 static Manager* manager_unref(Manager *m);
 DEFINE_TRIVIAL_CLEANUP_FUNC(Manager*, manager_unref);
 
+static void manager_flush_save_queue(Manager *m);
+
 static int manager_new(Manager **ret) {
         _cleanup_(manager_unrefp) Manager *m = NULL;
         int r;
@@ -96,6 +98,9 @@ static Manager* manager_unref(Manager *m) {
         if (!m)
                 return NULL;
 
+        /* The state files are supposed to survive a restart, hence write out anything still pending */
+        manager_flush_save_queue(m);
+
         while ((session = hashmap_first(m->sessions)))
                 session_free(session);
 
@@ -990,6 +995,26 @@ static void manager_gc(Manager *m, bool drop_not_started) {
         }
 }
 
+static void manager_flush_save_queue(Manager *m) {
+        Session *session;
+        User *user;
+        Seat *seat;
+
+        assert(m);
+
+        /* Writes out the state files of all objects that changed since the last time we got here. Each of
+         * the *_save_now() calls removes the object from its queue. */
+
+        while ((seat = m->seat_save_queue))
+                (void) seat_save_now(seat);
+
+        while ((session = m->session_save_queue))
+                (void) session_save_now(session);
+
+        while ((user = m->user_save_queue))
+                (void) user_save_now(user);
+}
+
 static int manager_dispatch_idle_action(sd_event_source *s, uint64_t t, void *userdata) {
         Manager *m = userdata;
         struct dual_timestamp since;
@@ -1188,6 +1213,8 @@ static int manager_run(Manager *m) {
                 if (r > 0)
                         continue;
 
+                manager_flush_save_queue(m);
+
                 r = sd_event_run(m->event, (uint64_t) -1);
                 if (r < 0)
                         return r;
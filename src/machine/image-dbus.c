@@ -18,8 +18,10 @@
 #include "machine-image.h"
 #include "missing_capability.h"
 #include "mount-util.h"
+#include "nulstr-util.h"
 #include "process-util.h"
 #include "raw-clone.h"
+#include "set.h"
 #include "strv.h"
 #include "user-util.h"
 
@@ -232,6 +234,9 @@ int bus_image_method_mark_read_only(
         if (r < 0)
                 return r;
 
+        /* Not necessarily visible to the inotify watches */
+        manager_flush_image_discover_cache(m);
+
         return sd_bus_reply_method_return(message, NULL);
 }
 
@@ -271,6 +276,9 @@ int bus_image_method_set_limit(
         if (r < 0)
                 return r;
 
+        /* Not necessarily visible to the inotify watches */
+        manager_flush_image_discover_cache(m);
+
         return sd_bus_reply_method_return(message, NULL);
 }
 
@@ -462,9 +470,126 @@ char *image_bus_path(const char *name) {
         return strjoin("/org/freedesktop/machine1/image/", e);
 }
 
-int image_node_enumerator(sd_bus *bus, const char *path, void *userdata, char ***nodes, sd_bus_error *error) {
+void manager_flush_image_discover_cache(Manager *m) {
+        assert(m);
+
+        m->image_discover_cache = hashmap_free(m->image_discover_cache);
+        m->image_watch_event_sources = set_free_with_destructor(m->image_watch_event_sources, sd_event_source_unref);
+}
+
+static int image_watch_dispatch(sd_event_source *s, const struct inotify_event *event, void *userdata) {
+        Manager *m = userdata;
+
+        assert(m);
+
+        /* Something changed in one of the image directories, forget everything we know. The watches are
+         * reestablished on the next enumeration. */
+        manager_flush_image_discover_cache(m);
+        return 0;
+}
+
+static int image_watch_search_path(Manager *m) {
+        const char *path;
+        int r;
+
+        assert(m);
+
+        /* Watch all directories of the search path that exist. Changes to images behind symlinks, to the
+         * contents of directory images and the creation of missing search path directories are not
+         * noticed this way, hence the cache also has a maximum age. */
+
+        NULSTR_FOREACH(path, image_search_path_nulstr(IMAGE_MACHINE)) {
+                _cleanup_(sd_event_source_unrefp) sd_event_source *s = NULL;
+
+                r = sd_event_add_inotify(m->event, &s, path,
+                                         IN_CREATE|IN_DELETE|IN_MOVED_FROM|IN_MOVED_TO|IN_ATTRIB|IN_MODIFY|
+                                         IN_CLOSE_WRITE|IN_DELETE_SELF|IN_MOVE_SELF|IN_ONLYDIR,
+                                         image_watch_dispatch, m);
+                if (r == -ENOENT)
+                        continue;
+                if (r < 0)
+                        return r;
+
+                (void) sd_event_source_set_description(s, "image-watch");
+
+                r = set_ensure_allocated(&m->image_watch_event_sources, NULL);
+                if (r < 0)
+                        return r;
+
+                r = set_put(m->image_watch_event_sources, s);
+                if (r < 0)
+                        return r;
+
+                TAKE_PTR(s);
+        }
+
+        return 0;
+}
+
+int manager_discover_images(Manager *m, ImageDiscoverFlags flags, Hashmap **ret) {
         _cleanup_hashmap_free_ Hashmap *images = NULL;
+        usec_t n;
+        int r;
+
+        assert(m);
+        assert(ret);
+
+        /* Returns all images in the search path. The result is cached until the image directories change
+         * or it becomes too old, and remains owned by the manager. If the caller doesn't need the disk usage
+         * and there's no cached result, we don't bother populating the cache and just do a cheap
+         * enumeration into the 'ret' hashmap, which the caller has to free then. */
+
+        n = now(CLOCK_MONOTONIC);
+
+        if (m->image_discover_cache &&
+            n < usec_add(m->image_discover_cache_timestamp, IMAGE_DISCOVER_CACHE_MAX_AGE_USEC)) {
+                *ret = m->image_discover_cache;
+                return 0;
+        }
+
+        manager_flush_image_discover_cache(m);
+
+        images = hashmap_new(&image_hash_ops);
+        if (!images)
+                return -ENOMEM;
+
+        if (FLAGS_SET(flags, IMAGE_DISCOVER_SKIP_USAGE)) {
+                r = image_discover(IMAGE_MACHINE, flags, images);
+                if (r < 0)
+                        return r;
+
+                *ret = TAKE_PTR(images);
+                return 1;
+        }
+
+        /* Establish the watches first, so that we don't miss changes made while we enumerate */
+        r = image_watch_search_path(m);
+        if (r < 0)
+                log_debug_errno(r, "Failed to watch image directories, not caching images: %m");
+
+        r = image_discover(IMAGE_MACHINE, flags, images);
+        if (r < 0) {
+                manager_flush_image_discover_cache(m);
+                return r;
+        }
+
+        if (!m->image_watch_event_sources) {
+                *ret = TAKE_PTR(images);
+                return 1;
+        }
+
+        m->image_discover_cache = TAKE_PTR(images);
+        m->image_discover_cache_timestamp = n;
+
+        *ret = m->image_discover_cache;
+        return 0;
+}
+
+int image_node_enumerator(sd_bus *bus, const char *path, void *userdata, char ***nodes, sd_bus_error *error) {
+        _cleanup_hashmap_free_ Hashmap *owned = NULL;
         _cleanup_strv_free_ char **l = NULL;
+        Manager *m = userdata;
+        Hashmap *images;
         Image *image;
         Iterator i;
         int r;
@@ -473,13 +598,11 @@ int image_node_enumerator(sd_bus *bus, const char *path, void *userdata, char **
         assert(path);
         assert(nodes);
 
-        images = hashmap_new(&image_hash_ops);
-        if (!images)
-                return -ENOMEM;
-
-        r = image_discover(IMAGE_MACHINE, images);
+        r = manager_discover_images(m, IMAGE_DISCOVER_SKIP_USAGE, &images);
         if (r < 0)
                 return r;
+        if (r > 0)
+                owned = images;
 
         HASHMAP_FOREACH(image, images, i) {
                 char *p;
@@ -1,12 +1,20 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 #pragma once
 
+#include "machine-image.h"
 #include "machined.h"
 
+/* How long to trust the cached image enumeration at most, since not all changes are visible to the inotify
+ * watches on the image directories. */
+#define IMAGE_DISCOVER_CACHE_MAX_AGE_USEC (5 * USEC_PER_SEC)
+
 extern const sd_bus_vtable image_vtable[];
 
 char *image_bus_path(const char *name);
 
+int manager_discover_images(Manager *m, ImageDiscoverFlags flags, Hashmap **ret);
+void manager_flush_image_discover_cache(Manager *m);
+
 int image_object_find(sd_bus *bus, const char *path, const char *interface, void *userdata, void **found, sd_bus_error *error);
 int image_node_enumerator(sd_bus *bus, const char *path, void *userdata, char ***nodes, sd_bus_error *error);
 
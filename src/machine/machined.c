@@ -18,6 +18,7 @@
 #include "format-util.h"
 #include "hostname-util.h"
 #include "label.h"
+#include "loop-util.h"
 #include "machine-image.h"
 #include "machined.h"
 #include "main-func.h"
@@ -61,6 +62,9 @@ static int manager_new(Manager **ret) {
 
         (void) sd_event_set_watchdog(m->event, true);
 
+        /* We set up loop devices for images whenever their metadata is requested, keep a few around */
+        loop_device_pool_set_size(LOOP_DEVICE_POOL_SIZE_DEFAULT);
+
         *ret = TAKE_PTR(m);
         return 0;
 }
@@ -78,6 +82,7 @@ static Manager* manager_unref(Manager *m) {
         hashmap_free(m->machine_units);
         hashmap_free(m->machine_leaders);
         hashmap_free(m->image_cache);
+        manager_flush_image_discover_cache(m);
 
         sd_event_source_unref(m->image_cache_defer_event);
         sd_event_source_unref(m->nscd_cache_flush_event);
@@ -87,6 +92,8 @@ static Manager* manager_unref(Manager *m) {
         sd_bus_flush_close_unref(m->bus);
         sd_event_unref(m->event);
 
+        loop_device_pool_set_size(0);
+
         return mfree(m);
 }
 
@@ -8,6 +8,8 @@
 
 #include "hashmap.h"
 #include "list.h"
+#include "set.h"
+#include "time-util.h"
 
 typedef struct Manager Manager;
 
@@ -29,6 +31,11 @@ struct Manager {
         Hashmap *image_cache;
         sd_event_source *image_cache_defer_event;
 
+        /* All images in the search path, invalidated by the inotify watches on the search path directories */
+        Hashmap *image_discover_cache;
+        usec_t image_discover_cache_timestamp;
+        Set *image_watch_event_sources;
+
         LIST_HEAD(Machine, machine_gc_queue);
 
         Machine *host_machine;
@@ -2,6 +2,7 @@
 
 #include "sd-dhcp-server.h"
 
+#include "dhcp-server-internal.h"
 #include "networkd-dhcp-server.h"
 #include "networkd-link.h"
 #include "networkd-manager.h"
@@ -174,6 +175,16 @@ static int link_push_uplink_to_dhcp_server(
         return sd_dhcp_server_set_servers(s, what, addresses, n_addresses);
 }
 
+static void dhcp4_server_callback(sd_dhcp_server *server, uint64_t event, void *userdata) {
+        Link *link = userdata;
+
+        assert(link);
+
+        /* The leases are saved along with the link state */
+        if (event & SD_DHCP_SERVER_EVENT_LEASE_CHANGED)
+                link_dirty(link);
+}
+
 int dhcp4_server_configure(Link *link) {
         bool acquired_uplink = false;
         sd_dhcp_option *p;
@@ -315,7 +326,17 @@ int dhcp4_server_configure(Link *link) {
                         return log_link_error_errno(link, r, "Failed to set DHCPv4 option: %m");
         }
 
+        r = sd_dhcp_server_set_callback(link->dhcp_server, dhcp4_server_callback, link);
+        if (r < 0)
+                return log_link_error_errno(link, r, "Failed to set callback for DHCPv4 server instance: %m");
+
         if (!sd_dhcp_server_is_running(link->dhcp_server)) {
+                /* Pick up the leases handed out before networkd was restarted, so that the addresses are not
+                 * offered again to other clients. */
+                r = dhcp_server_load_leases(link->dhcp_server, link->dhcp_server_lease_file);
+                if (r < 0)
+                        log_link_warning_errno(link, r, "Failed to load DHCPv4 server leases, ignoring: %m");
+
                 r = sd_dhcp_server_start(link->dhcp_server);
                 if (r < 0)
                         return log_link_error_errno(link, r, "Could not start DHCPv4 server instance: %m");
@@ -324,6 +345,24 @@ int dhcp4_server_configure(Link *link) {
         return 0;
 }
 
+void dhcp4_server_save_leases(Link *link) {
+        assert(link);
+        assert(link->dhcp_server_lease_file);
+
+        if (!link->dhcp_server) {
+                (void) unlink(link->dhcp_server_lease_file);
+                return;
+        }
+
+        /* The link state is also saved while the server is being set up, before it picked up the leases
+         * saved earlier. Those must survive until then. */
+        if (!sd_dhcp_server_is_running(link->dhcp_server))
+                return;
+
+        /* Failures are logged, but do not prevent the link state from being saved */
+        (void) dhcp_server_save_leases(link->dhcp_server, link->dhcp_server_lease_file);
+}
+
 static int config_parse_dhcp_lease_server_list(
                 const char *unit,
                 const char *filename,
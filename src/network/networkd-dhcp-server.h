@@ -8,6 +8,7 @@
 typedef struct Link Link;
 
 int dhcp4_server_configure(Link *link);
+void dhcp4_server_save_leases(Link *link);
 
 CONFIG_PARSER_PROTOTYPE(config_parse_dhcp_server_dns);
 CONFIG_PARSER_PROTOTYPE(config_parse_dhcp_server_ntp);
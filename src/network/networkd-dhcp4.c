@@ -54,6 +54,7 @@ void dhcp4_release_old_lease(Link *link) {
 static void dhcp4_check_ready(Link *link) {
         if (link->dhcp4_messages == 0) {
                 link->dhcp4_configured = true;
+                link_latency_stop(link, &link->dhcp4_latency, "DHCPv4");
                 /* New address and routes are configured now. Let's release old lease. */
                 dhcp4_release_old_lease(link);
                 link_check_ready(link);
@@ -1141,6 +1142,7 @@ static int dhcp4_handler(sd_dhcp_client *client, int event, void *userdata) {
                                 return 0;
                         }
 
+                        link_latency_start(link, &link->dhcp4_latency);
                         r = dhcp_lease_ip_change(client, link);
                         if (r < 0) {
                                 link_enter_failed(link);
@@ -1149,6 +1151,7 @@ static int dhcp4_handler(sd_dhcp_client *client, int event, void *userdata) {
 
                         break;
                 case SD_DHCP_CLIENT_EVENT_RENEW:
+                        link_latency_start(link, &link->dhcp4_latency);
                         r = dhcp_lease_renew(client, link);
                         if (r < 0) {
                                 link_enter_failed(link);
@@ -1156,6 +1159,7 @@ static int dhcp4_handler(sd_dhcp_client *client, int event, void *userdata) {
                         }
                         break;
                 case SD_DHCP_CLIENT_EVENT_IP_ACQUIRE:
+                        link_latency_start(link, &link->dhcp4_latency);
                         r = dhcp_lease_acquired(client, link);
                         if (r < 0) {
                                 link_enter_failed(link);
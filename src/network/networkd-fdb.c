@@ -13,6 +13,7 @@
 #include "networkd-fdb.h"
 #include "networkd-manager.h"
 #include "parse-util.h"
+#include "set.h"
 #include "string-util.h"
 #include "string-table.h"
 #include "util.h"
@@ -113,29 +114,53 @@ static int set_fdb_handler(sd_netlink *rtnl, sd_netlink_message *m, Link *link)
         return 1;
 }
 
-/* send a request to the kernel to add a FDB entry in its static MAC table. */
-int fdb_entry_configure(Link *link, FdbEntry *fdb_entry) {
-        _cleanup_(sd_netlink_message_unrefp) sd_netlink_message *req = NULL;
+static void fdb_entry_hash_func(const FdbEntry *fdb_entry, struct siphash *state) {
+        assert(fdb_entry);
+
+        siphash24_compress(&fdb_entry->mac_addr, sizeof(fdb_entry->mac_addr), state);
+        siphash24_compress(&fdb_entry->vlan_id, sizeof(fdb_entry->vlan_id), state);
+        siphash24_compress(&fdb_entry->vni, sizeof(fdb_entry->vni), state);
+        siphash24_compress(&fdb_entry->fdb_ntf_flags, sizeof(fdb_entry->fdb_ntf_flags), state);
+        siphash24_compress(&fdb_entry->family, sizeof(fdb_entry->family), state);
+
+        if (IN_SET(fdb_entry->family, AF_INET, AF_INET6))
+                siphash24_compress(&fdb_entry->destination_addr, FAMILY_ADDRESS_SIZE(fdb_entry->family), state);
+}
+
+static int fdb_entry_compare_func(const FdbEntry *a, const FdbEntry *b) {
         int r;
 
-        assert(link);
-        assert(link->network);
-        assert(link->manager);
-        assert(fdb_entry);
+        r = memcmp(&a->mac_addr, &b->mac_addr, sizeof(a->mac_addr));
+        if (r != 0)
+                return r;
 
-        /* create new RTM message */
-        r = sd_rtnl_message_new_neigh(link->manager->rtnl, &req, RTM_NEWNEIGH, link->ifindex, PF_BRIDGE);
-        if (r < 0)
-                return log_link_error_errno(link, r, "Could not create RTM_NEWNEIGH message: %m");
+        r = CMP(a->vlan_id, b->vlan_id);
+        if (r != 0)
+                return r;
 
-        r = sd_rtnl_message_neigh_set_flags(req, fdb_entry->fdb_ntf_flags);
-        if (r < 0)
-                return log_link_error_errno(link, r, "Could not set neighbor flags: %m");
+        r = CMP(a->vni, b->vni);
+        if (r != 0)
+                return r;
 
-        /* only NUD_PERMANENT state supported. */
-        r = sd_rtnl_message_neigh_set_state(req, NUD_NOARP | NUD_PERMANENT);
-        if (r < 0)
-                return log_link_error_errno(link, r, "Could not set neighbor state: %m");
+        r = CMP(a->fdb_ntf_flags, b->fdb_ntf_flags);
+        if (r != 0)
+                return r;
+
+        r = CMP(a->family, b->family);
+        if (r != 0)
+                return r;
+
+        if (IN_SET(a->family, AF_INET, AF_INET6))
+                return memcmp(&a->destination_addr, &b->destination_addr, FAMILY_ADDRESS_SIZE(a->family));
+
+        return 0;
+}
+
+/* Does not own the entries. Entries in Link.fdb_entries are freed explicitly. */
+DEFINE_HASH_OPS(fdb_entry_hash_ops, FdbEntry, fdb_entry_hash_func, fdb_entry_compare_func);
+
+static int fdb_entry_append_attributes(Link *link, FdbEntry *fdb_entry, sd_netlink_message *req) {
+        int r;
 
         r = sd_netlink_message_append_data(req, NDA_LLADDR, &fdb_entry->mac_addr, sizeof(fdb_entry->mac_addr));
         if (r < 0)
@@ -160,6 +185,41 @@ int fdb_entry_configure(Link *link, FdbEntry *fdb_entry) {
                         return log_link_error_errno(link, r, "Could not append NDA_VNI attribute: %m");
         }
 
+        return 0;
+}
+
+/* send a request to the kernel to add a FDB entry in its static MAC table. */
+int fdb_entry_configure(Link *link, FdbEntry *fdb_entry) {
+        _cleanup_(sd_netlink_message_unrefp) sd_netlink_message *req = NULL;
+        int r;
+
+        assert(link);
+        assert(link->network);
+        assert(link->manager);
+        assert(fdb_entry);
+
+        /* The kernel already has this entry, e.g. because networkd was restarted. Do not add it again. */
+        if (set_contains(link->fdb_entries, fdb_entry))
+                return 0;
+
+        /* create new RTM message */
+        r = sd_rtnl_message_new_neigh(link->manager->rtnl, &req, RTM_NEWNEIGH, link->ifindex, PF_BRIDGE);
+        if (r < 0)
+                return log_link_error_errno(link, r, "Could not create RTM_NEWNEIGH message: %m");
+
+        r = sd_rtnl_message_neigh_set_flags(req, fdb_entry->fdb_ntf_flags);
+        if (r < 0)
+                return log_link_error_errno(link, r, "Could not set neighbor flags: %m");
+
+        /* only NUD_PERMANENT state supported. */
+        r = sd_rtnl_message_neigh_set_state(req, NUD_NOARP | NUD_PERMANENT);
+        if (r < 0)
+                return log_link_error_errno(link, r, "Could not set neighbor state: %m");
+
+        r = fdb_entry_append_attributes(link, fdb_entry, req);
+        if (r < 0)
+                return r;
+
         /* send message to the kernel to update its internal static MAC table. */
         r = netlink_call_async(link->manager->rtnl, NULL, req, set_fdb_handler,
                                link_netlink_destroy_callback, link);
@@ -171,6 +231,158 @@ int fdb_entry_configure(Link *link, FdbEntry *fdb_entry) {
         return 1;
 }
 
+static int remove_fdb_handler(sd_netlink *rtnl, sd_netlink_message *m, Link *link) {
+        int r;
+
+        assert(link);
+
+        if (IN_SET(link->state, LINK_STATE_FAILED, LINK_STATE_LINGER))
+                return 1;
+
+        r = sd_netlink_message_get_errno(m);
+        if (r < 0 && !IN_SET(r, -ENOENT, -ESRCH))
+                log_link_message_warning_errno(link, m, r, "Could not remove FDB entry, ignoring");
+
+        return 1;
+}
+
+int fdb_entry_remove(Link *link, FdbEntry *fdb_entry) {
+        _cleanup_(sd_netlink_message_unrefp) sd_netlink_message *req = NULL;
+        int r;
+
+        assert(link);
+        assert(link->manager);
+        assert(fdb_entry);
+
+        r = sd_rtnl_message_new_neigh(link->manager->rtnl, &req, RTM_DELNEIGH, link->ifindex, PF_BRIDGE);
+        if (r < 0)
+                return log_link_error_errno(link, r, "Could not create RTM_DELNEIGH message: %m");
+
+        r = sd_rtnl_message_neigh_set_flags(req, fdb_entry->fdb_ntf_flags);
+        if (r < 0)
+                return log_link_error_errno(link, r, "Could not set neighbor flags: %m");
+
+        r = fdb_entry_append_attributes(link, fdb_entry, req);
+        if (r < 0)
+                return r;
+
+        r = netlink_call_async(link->manager->rtnl, NULL, req, remove_fdb_handler,
+                               link_netlink_destroy_callback, link);
+        if (r < 0)
+                return log_link_error_errno(link, r, "Could not send rtnetlink message: %m");
+
+        link_ref(link);
+
+        return 0;
+}
+
+/* Keeps track of the static FDB entries the kernel has on the link, so that entries which already exist are
+ * not added again, and entries which are no longer configured can be removed on reconfiguration. */
+int fdb_entry_process_message(Link *link, uint16_t type, sd_netlink_message *message) {
+        _cleanup_(fdb_entry_freep) FdbEntry *tmp = NULL;
+        FdbEntry *existing;
+        uint8_t flags;
+        int r;
+
+        assert(link);
+        assert(message);
+
+        tmp = new(FdbEntry, 1);
+        if (!tmp)
+                return log_oom();
+
+        *tmp = (FdbEntry) {
+                .vni = VXLAN_VID_MAX + 1,
+        };
+
+        r = sd_netlink_message_read(message, NDA_LLADDR, sizeof(tmp->mac_addr), &tmp->mac_addr);
+        if (r < 0)
+                return log_link_debug_errno(link, r, "rtnl: received FDB entry without valid MAC address, ignoring: %m");
+
+        r = sd_rtnl_message_neigh_get_flags(message, &flags);
+        if (r < 0)
+                return log_link_debug_errno(link, r, "rtnl: received FDB entry without flags, ignoring: %m");
+        tmp->fdb_ntf_flags = flags & (NTF_SELF | NTF_MASTER | NTF_ROUTER);
+
+        r = sd_netlink_message_read_u16(message, NDA_VLAN, &tmp->vlan_id);
+        if (r < 0 && r != -ENODATA)
+                return log_link_debug_errno(link, r, "rtnl: received FDB entry with invalid VLAN ID, ignoring: %m");
+
+        r = sd_netlink_message_read_u32(message, NDA_VNI, &tmp->vni);
+        if (r < 0 && r != -ENODATA)
+                return log_link_debug_errno(link, r, "rtnl: received FDB entry with invalid VNI, ignoring: %m");
+
+        if (sd_netlink_message_read(message, NDA_DST, sizeof(tmp->destination_addr.in6), &tmp->destination_addr.in6) >= 0)
+                tmp->family = AF_INET6;
+        else if (sd_netlink_message_read(message, NDA_DST, sizeof(tmp->destination_addr.in), &tmp->destination_addr.in) >= 0)
+                tmp->family = AF_INET;
+
+        existing = set_get(link->fdb_entries, tmp);
+
+        switch (type) {
+        case RTM_NEWNEIGH:
+                if (existing)
+                        return 0;
+
+                r = set_ensure_allocated(&link->fdb_entries, &fdb_entry_hash_ops);
+                if (r < 0)
+                        return log_oom();
+
+                r = set_put(link->fdb_entries, tmp);
+                if (r < 0)
+                        return log_oom();
+
+                TAKE_PTR(tmp)->link = link;
+                return 0;
+
+        case RTM_DELNEIGH:
+                fdb_entry_free(existing);
+                return 0;
+
+        default:
+                assert_not_reached("Received invalid RTNL message type");
+        }
+}
+
+/* Removes the kernel FDB entries configured by the current .network file which the new one does not configure. */
+int link_drop_fdb_entries(Link *link, Network *network) {
+        _cleanup_set_free_ Set *keep = NULL;
+        FdbEntry *fdb_entry, *existing;
+        int r;
+
+        assert(link);
+
+        if (!link->network || set_isempty(link->fdb_entries))
+                return 0;
+
+        if (network) {
+                keep = set_new(&fdb_entry_hash_ops);
+                if (!keep)
+                        return log_oom();
+
+                LIST_FOREACH(static_fdb_entries, fdb_entry, network->static_fdb_entries) {
+                        r = set_put(keep, fdb_entry);
+                        if (r < 0)
+                                return log_oom();
+                }
+        }
+
+        LIST_FOREACH(static_fdb_entries, fdb_entry, link->network->static_fdb_entries) {
+                if (set_contains(keep, fdb_entry))
+                        continue;
+
+                existing = set_get(link->fdb_entries, fdb_entry);
+                if (!existing)
+                        continue;
+
+                r = fdb_entry_remove(link, existing);
+                if (r < 0)
+                        return r;
+        }
+
+        return 0;
+}
+
 /* remove and FDB entry. */
 void fdb_entry_free(FdbEntry *fdb_entry) {
         if (!fdb_entry)
@@ -185,6 +397,9 @@ void fdb_entry_free(FdbEntry *fdb_entry) {
                         hashmap_remove(fdb_entry->network->fdb_entries_by_section, fdb_entry->section);
         }
 
+        if (fdb_entry->link)
+                set_remove(fdb_entry->link->fdb_entries, fdb_entry);
+
         network_config_section_free(fdb_entry->section);
         free(fdb_entry);
 }
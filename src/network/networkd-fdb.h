@@ -7,6 +7,8 @@
 
 #include <linux/neighbour.h>
 
+#include "sd-netlink.h"
+
 #include "conf-parser.h"
 #include "list.h"
 #include "macro.h"
@@ -28,6 +30,7 @@ typedef enum NeighborCacheEntryFlags {
 
 struct FdbEntry {
         Network *network;
+        Link *link;
         NetworkConfigSection *section;
 
         uint32_t vni;
@@ -42,8 +45,13 @@ struct FdbEntry {
         LIST_FIELDS(FdbEntry, static_fdb_entries);
 };
 
+extern const struct hash_ops fdb_entry_hash_ops;
+
 void fdb_entry_free(FdbEntry *fdb_entry);
 int fdb_entry_configure(Link *link, FdbEntry *fdb_entry);
+int fdb_entry_remove(Link *link, FdbEntry *fdb_entry);
+int fdb_entry_process_message(Link *link, uint16_t type, sd_netlink_message *message);
+int link_drop_fdb_entries(Link *link, Network *network);
 
 DEFINE_NETWORK_SECTION_FUNCTIONS(FdbEntry, fdb_entry_free);
 
@@ -8,6 +8,7 @@
 #include "bus-common-errors.h"
 #include "bus-polkit.h"
 #include "bus-util.h"
+#include "dhcp-server-internal.h"
 #include "dns-domain.h"
 #include "networkd-link-bus.h"
 #include "networkd-link.h"
@@ -63,6 +64,93 @@ static int property_get_bit_rates(
         return sd_bus_message_append(reply, "(tt)", tx, rx);
 }
 
+static int property_get_configuration_progress(
+                sd_bus *bus,
+                const char *path,
+                const char *interface,
+                const char *property,
+                sd_bus_message *reply,
+                void *userdata,
+                sd_bus_error *error) {
+
+        Link *link = userdata;
+
+        assert(bus);
+        assert(reply);
+        assert(link);
+
+        /* The number of static addresses and routes whose configuration the kernel confirmed already, and the
+         * number requested in total */
+        return sd_bus_message_append(reply, "(tttt)",
+                                     (uint64_t) LESS_BY(link->address_messages_total, link->address_messages),
+                                     (uint64_t) link->address_messages_total,
+                                     (uint64_t) LESS_BY(link->route_messages_total, link->route_messages),
+                                     (uint64_t) link->route_messages_total);
+}
+
+static int property_get_configuration_latency(
+                sd_bus *bus,
+                const char *path,
+                const char *interface,
+                const char *property,
+                sd_bus_message *reply,
+                void *userdata,
+                sd_bus_error *error) {
+
+        Link *link = userdata;
+        int r;
+
+        assert(bus);
+        assert(reply);
+        assert(link);
+
+        r = sd_bus_message_open_container(reply, 'a', "(sttt)");
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_append(reply, "(sttt)", "dhcp4",
+                                  link->dhcp4_latency.n, link->dhcp4_latency.last, link->dhcp4_latency.max);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_append(reply, "(sttt)", "ndisc",
+                                  link->ndisc_latency.n, link->ndisc_latency.last, link->ndisc_latency.max);
+        if (r < 0)
+                return r;
+
+        return sd_bus_message_close_container(reply);
+}
+
+static int property_get_dhcp_server_statistics(
+                sd_bus *bus,
+                const char *path,
+                const char *interface,
+                const char *property,
+                sd_bus_message *reply,
+                void *userdata,
+                sd_bus_error *error) {
+
+        Link *link = userdata;
+        DHCPServerStatistics *s;
+
+        assert(bus);
+        assert(reply);
+        assert(link);
+
+        if (!link->dhcp_server)
+                return sd_bus_message_append(reply, "(ttttttt)",
+                                             UINT64_MAX, UINT64_MAX, UINT64_MAX, UINT64_MAX,
+                                             UINT64_MAX, UINT64_MAX, UINT64_MAX);
+
+        /* Message, offer, ACK and NAK counters, the number of bound leases, and the total and maximum time spent
+         * processing a message. Rates are to be derived by sampling the counters. */
+        s = &link->dhcp_server->statistics;
+        return sd_bus_message_append(reply, "(ttttttt)",
+                                     s->n_messages, s->n_offers, s->n_acks, s->n_naks,
+                                     (uint64_t) link->dhcp_server->n_bound,
+                                     s->processing_usec_total, s->processing_usec_max);
+}
+
 static int verify_managed_link(Link *l, sd_bus_error *error) {
         assert(l);
 
@@ -667,6 +755,9 @@ const sd_bus_vtable link_vtable[] = {
         SD_BUS_PROPERTY("AddressState", "s", property_get_address_state, offsetof(Link, address_state), SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
         SD_BUS_PROPERTY("AdministrativeState", "s", property_get_administrative_state, offsetof(Link, state), SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
         SD_BUS_PROPERTY("BitRates", "(tt)", property_get_bit_rates, 0, 0),
+        SD_BUS_PROPERTY("ConfigurationProgress", "(tttt)", property_get_configuration_progress, 0, 0),
+        SD_BUS_PROPERTY("ConfigurationLatency", "a(sttt)", property_get_configuration_latency, 0, 0),
+        SD_BUS_PROPERTY("DHCPServerStatistics", "(ttttttt)", property_get_dhcp_server_statistics, 0, 0),
 
         SD_BUS_METHOD("SetNTP", "as", NULL, bus_link_method_set_ntp_servers, SD_BUS_VTABLE_UNPRIVILEGED),
         SD_BUS_METHOD("SetDNS", "a(iay)", NULL, bus_link_method_set_dns_servers, SD_BUS_VTABLE_UNPRIVILEGED),
@@ -632,6 +632,9 @@ static int link_new(Manager *manager, sd_netlink_message *message, Link **ret) {
         if (asprintf(&link->lease_file, "/run/systemd/netif/leases/%d", link->ifindex) < 0)
                 return -ENOMEM;
 
+        if (asprintf(&link->dhcp_server_lease_file, "/run/systemd/netif/dhcp-server-leases/%d", link->ifindex) < 0)
+                return -ENOMEM;
+
         if (asprintf(&link->lldp_file, "/run/systemd/netif/lldp/%d", link->ifindex) < 0)
                 return -ENOMEM;
 
@@ -707,6 +710,7 @@ static Link *link_free(Link *link) {
 
         link->neighbors = set_free_with_destructor(link->neighbors, neighbor_free);
         link->neighbors_foreign = set_free_with_destructor(link->neighbors_foreign, neighbor_free);
+        link->fdb_entries = set_free_with_destructor(link->fdb_entries, fdb_entry_free);
 
         link->addresses = set_free_with_destructor(link->addresses, address_free);
         link->addresses_foreign = set_free_with_destructor(link->addresses_foreign, address_free);
@@ -719,6 +723,7 @@ static Link *link_free(Link *link) {
         link_lldp_emit_stop(link);
         link_free_engines(link);
         free(link->lease_file);
+        free(link->dhcp_server_lease_file);
         free(link->lldp_file);
 
         free(link->ifname);
@@ -1031,6 +1036,7 @@ int link_request_set_routes(Link *link) {
 
         link->static_routes_configured = false;
         link->static_routes_ready = false;
+        link->route_messages_total = 0;
 
         if (!link_has_carrier(link) && !link->network->configure_without_carrier)
                 /* During configuring addresses, the link lost its carrier. As networkd is dropping
@@ -1053,8 +1059,10 @@ int link_request_set_routes(Link *link) {
                         r = route_configure(rt, link, route_handler);
                         if (r < 0)
                                 return log_link_warning_errno(link, r, "Could not set routes: %m");
-                        if (r > 0)
+                        if (r > 0) {
                                 link->route_messages++;
+                                link->route_messages_total++;
+                        }
                 }
 
         if (link->route_messages == 0) {
@@ -1157,6 +1165,10 @@ static int link_request_set_neighbors(Link *link) {
         link->neighbors_configured = false;
 
         LIST_FOREACH(neighbors, neighbor, link->network->neighbors) {
+                /* Already set, e.g. kept from a previous configuration or claimed after a restart. */
+                if (neighbor_get(link, neighbor->family, &neighbor->in_addr, &neighbor->lladdr, neighbor->lladdr_size, NULL) > 0)
+                        continue;
+
                 r = neighbor_configure(neighbor, link, NULL);
                 if (r < 0)
                         return log_link_warning_errno(link, r, "Could not set neighbor: %m");
@@ -1237,6 +1249,7 @@ static int link_request_set_addresses(Link *link) {
         link->static_routes_ready = false;
         link->static_nexthops_configured = false;
         link->routing_policy_rules_configured = false;
+        link->address_messages_total = 0;
 
         r = link_set_bridge_fdb(link);
         if (r < 0)
@@ -1254,8 +1267,10 @@ static int link_request_set_addresses(Link *link) {
                 r = address_configure(ad, link, address_handler, update);
                 if (r < 0)
                         return log_link_warning_errno(link, r, "Could not set addresses: %m");
-                if (r > 0)
+                if (r > 0) {
                         link->address_messages++;
+                        link->address_messages_total++;
+                }
         }
 
         if (IN_SET(link->network->router_prefix_delegation,
@@ -1283,8 +1298,10 @@ static int link_request_set_addresses(Link *link) {
                         r = address_configure(address, link, address_handler, true);
                         if (r < 0)
                                 return log_link_warning_errno(link, r, "Could not set addresses: %m");
-                        if (r > 0)
+                        if (r > 0) {
                                 link->address_messages++;
+                                link->address_messages_total++;
+                        }
                 }
 
         LIST_FOREACH(labels, label, link->network->address_labels) {
@@ -2123,6 +2140,7 @@ void link_drop(Link *link) {
         log_link_debug(link, "Link removed");
 
         (void) unlink(link->state_file);
+        (void) unlink(link->dhcp_server_lease_file);
         link_detach_from_manager(link);
 }
 
@@ -2492,63 +2510,111 @@ static bool link_is_static_address_configured(Link *link, Address *address) {
         return false;
 }
 
-static bool link_is_neighbor_configured(Link *link, Neighbor *neighbor) {
+static int network_index_neighbors(Network *network, Set **ret) {
+        _cleanup_set_free_ Set *s = NULL;
         Neighbor *net_neighbor;
+        int r;
 
-        assert(link);
-        assert(neighbor);
+        assert(ret);
 
-        if (!link->network)
-                return false;
+        if (!network) {
+                *ret = NULL;
+                return 0;
+        }
 
-        LIST_FOREACH(neighbors, net_neighbor, link->network->neighbors)
-                if (neighbor_equal(net_neighbor, neighbor))
-                        return true;
+        s = set_new(&neighbor_hash_ops);
+        if (!s)
+                return -ENOMEM;
 
-        return false;
+        LIST_FOREACH(neighbors, net_neighbor, network->neighbors) {
+                r = set_put(s, net_neighbor);
+                if (r < 0)
+                        return r;
+        }
+
+        *ret = TAKE_PTR(s);
+        return 0;
 }
 
-static bool link_is_static_route_configured(Link *link, Route *route) {
+static int link_index_static_routes(Link *link, Set **ret) {
+        _cleanup_set_free_ Set *s = NULL;
         Route *net_route;
+        int r;
 
         assert(link);
-        assert(route);
+        assert(ret);
 
-        if (!link->network)
-                return false;
+        if (!link->network) {
+                *ret = NULL;
+                return 0;
+        }
 
-        LIST_FOREACH(routes, net_route, link->network->static_routes)
-                if (route_equal(net_route, route))
-                        return true;
+        s = set_new(&route_index_hash_ops);
+        if (!s)
+                return -ENOMEM;
 
-        return false;
+        LIST_FOREACH(routes, net_route, link->network->static_routes) {
+                r = set_put(s, net_route);
+                if (r < 0)
+                        return r;
+        }
+
+        *ret = TAKE_PTR(s);
+        return 0;
 }
 
-static bool link_address_is_dynamic(Link *link, Address *address) {
+static int link_index_dhcp_prefsrcs(Link *link, Set **ret) {
+        _cleanup_set_free_free_ Set *s = NULL;
         Route *route;
         Iterator i;
+        int r;
 
         assert(link);
-        assert(address);
-
-        if (address->cinfo.ifa_prefered != CACHE_INFO_INFINITY_LIFE_TIME)
-                return true;
+        assert(ret);
 
         /* Even when the address is leased from a DHCP server, networkd assign the address
-         * without lifetime when KeepConfiguration=dhcp. So, let's check that we have
-         * corresponding routes with RTPROT_DHCP. */
+         * without lifetime when KeepConfiguration=dhcp. So, let's collect the preferred source
+         * addresses of the routes with RTPROT_DHCP. */
         SET_FOREACH(route, link->routes_foreign, i) {
+                _cleanup_free_ struct in_addr_data *d = NULL;
+
                 if (route->protocol != RTPROT_DHCP)
                         continue;
 
-                if (address->family != route->family)
-                        continue;
+                d = new(struct in_addr_data, 1);
+                if (!d)
+                        return -ENOMEM;
 
-                if (in_addr_equal(address->family, &address->in_addr, &route->prefsrc))
-                        return true;
+                *d = (struct in_addr_data) {
+                        .family = route->family,
+                        .address = route->prefsrc,
+                };
+
+                r = set_ensure_allocated(&s, &in_addr_data_hash_ops);
+                if (r < 0)
+                        return r;
+
+                r = set_put(s, d);
+                if (r < 0)
+                        return r;
+                if (r > 0)
+                        TAKE_PTR(d);
         }
 
-        return false;
+        *ret = TAKE_PTR(s);
+        return 0;
+}
+
+static bool link_address_is_dynamic(Address *address, Set *dhcp_prefsrcs) {
+        assert(address);
+
+        if (address->cinfo.ifa_prefered != CACHE_INFO_INFINITY_LIFE_TIME)
+                return true;
+
+        return set_contains(dhcp_prefsrcs, &(struct in_addr_data) {
+                                    .family = address->family,
+                                    .address = address->in_addr,
+                            });
 }
 
 static int link_enumerate_ipv6_tentative_addresses(Link *link) {
@@ -2594,6 +2660,8 @@ static int link_enumerate_ipv6_tentative_addresses(Link *link) {
 }
 
 static int link_drop_foreign_config(Link *link) {
+        _cleanup_set_free_free_ Set *dhcp_prefsrcs = NULL;
+        _cleanup_set_free_ Set *static_routes = NULL, *static_neighbors = NULL;
         Address *address;
         Neighbor *neighbor;
         Route *route;
@@ -2608,12 +2676,25 @@ static int link_drop_foreign_config(Link *link) {
                         return r;
         }
 
+        /* Build lookup tables first, so that the loops below stay linear even with many foreign routes. */
+        r = link_index_dhcp_prefsrcs(link, &dhcp_prefsrcs);
+        if (r < 0)
+                return log_oom();
+
+        r = link_index_static_routes(link, &static_routes);
+        if (r < 0)
+                return log_oom();
+
+        r = network_index_neighbors(link->network, &static_neighbors);
+        if (r < 0)
+                return log_oom();
+
         SET_FOREACH(address, link->addresses_foreign, i) {
                 /* we consider IPv6LL addresses to be managed by the kernel */
                 if (address->family == AF_INET6 && in_addr_is_link_local(AF_INET6, &address->in_addr) == 1 && link_ipv6ll_enabled(link))
                         continue;
 
-                if (link_address_is_dynamic(link, address)) {
+                if (link_address_is_dynamic(address, dhcp_prefsrcs)) {
                         if (link->network && FLAGS_SET(link->network->keep_configuration, KEEP_CONFIGURATION_DHCP))
                                 continue;
                 } else if (link->network && FLAGS_SET(link->network->keep_configuration, KEEP_CONFIGURATION_STATIC))
@@ -2631,7 +2712,7 @@ static int link_drop_foreign_config(Link *link) {
         }
 
         SET_FOREACH(neighbor, link->neighbors_foreign, i) {
-                if (link_is_neighbor_configured(link, neighbor)) {
+                if (set_contains(static_neighbors, neighbor)) {
                         r = neighbor_add(link, neighbor->family, &neighbor->in_addr, &neighbor->lladdr, neighbor->lladdr_size, NULL);
                         if (r < 0)
                                 return r;
@@ -2664,7 +2745,7 @@ static int link_drop_foreign_config(Link *link) {
                     FLAGS_SET(link->network->keep_configuration, KEEP_CONFIGURATION_DHCP))
                         continue;
 
-                if (link_is_static_route_configured(link, route)) {
+                if (set_contains(static_routes, route)) {
                         r = route_add(link, route, NULL);
                         if (r < 0)
                                 return r;
@@ -2678,13 +2759,20 @@ static int link_drop_foreign_config(Link *link) {
         return 0;
 }
 
-static int link_drop_config(Link *link) {
+/* Drops the configuration of the link. Neighbors that are also configured by the .network file the link is
+ * about to be reconfigured with are kept, so that they are not missing while the new configuration is set. */
+static int link_drop_config(Link *link, Network *network) {
+        _cleanup_set_free_ Set *keep_neighbors = NULL;
         Address *address, *pool_address;
         Neighbor *neighbor;
         Route *route;
         Iterator i;
         int r;
 
+        r = network_index_neighbors(network, &keep_neighbors);
+        if (r < 0)
+                return log_oom();
+
         SET_FOREACH(address, link->addresses, i) {
                 /* we consider IPv6LL addresses to be managed by the kernel */
                 if (address->family == AF_INET6 && in_addr_is_link_local(AF_INET6, &address->in_addr) == 1 && link_ipv6ll_enabled(link))
@@ -2705,6 +2793,9 @@ static int link_drop_config(Link *link) {
         }
 
         SET_FOREACH(neighbor, link->neighbors, i) {
+                if (set_contains(keep_neighbors, neighbor))
+                        continue;
+
                 r = neighbor_remove(neighbor, link, NULL);
                 if (r < 0)
                         return r;
@@ -3106,7 +3197,11 @@ static int link_reconfigure_internal(Link *link, sd_netlink_message *m, bool for
         if (link_dhcp4_server_enabled(link))
                 (void) sd_dhcp_server_stop(link->dhcp_server);
 
-        r = link_drop_config(link);
+        r = link_drop_fdb_entries(link, network);
+        if (r < 0)
+                return r;
+
+        r = link_drop_config(link, network);
         if (r < 0)
                 return r;
 
@@ -3671,7 +3766,7 @@ static int link_carrier_lost(Link *link) {
         if (link_dhcp4_server_enabled(link))
                 (void) sd_dhcp_server_stop(link->dhcp_server);
 
-        r = link_drop_config(link);
+        r = link_drop_config(link, NULL);
         if (r < 0)
                 return r;
 
@@ -4323,6 +4418,8 @@ int link_save(Link *link) {
         } else
                 (void) unlink(link->lease_file);
 
+        dhcp4_server_save_leases(link);
+
         if (link->ipv4ll) {
                 struct in_addr address;
 
@@ -4383,6 +4480,36 @@ void link_clean(Link *link) {
         link_unref(set_remove(link->manager->dirty_links, link));
 }
 
+/* The event loop timestamp is the closest we get to the time the packet was received, without asking the
+ * kernel for timestamps. */
+void link_latency_start(Link *link, LinkLatency *latency) {
+        assert(link);
+        assert(link->manager);
+        assert(latency);
+
+        if (sd_event_now(link->manager->event, clock_boottime_or_monotonic(), &latency->start) < 0)
+                latency->start = 0;
+}
+
+void link_latency_stop(Link *link, LinkLatency *latency, const char *what) {
+        char buf[FORMAT_TIMESPAN_MAX];
+
+        assert(link);
+        assert(latency);
+        assert(what);
+
+        if (latency->start == 0)
+                return;
+
+        latency->last = usec_sub_unsigned(now(clock_boottime_or_monotonic()), latency->start);
+        latency->max = MAX(latency->max, latency->last);
+        latency->n++;
+        latency->start = 0;
+
+        log_link_debug(link, "%s configuration applied %s after reception.",
+                       what, format_timespan(buf, sizeof(buf), latency->last, USEC_PER_MSEC));
+}
+
 static const char* const link_state_table[_LINK_STATE_MAX] = {
         [LINK_STATE_PENDING] = "pending",
         [LINK_STATE_INITIALIZED] = "initialized",
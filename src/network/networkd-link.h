@@ -22,6 +22,7 @@
 #include "ordered-set.h"
 #include "resolve-util.h"
 #include "set.h"
+#include "time-util.h"
 
 typedef enum LinkState {
         LINK_STATE_PENDING,     /* udev has not initialized the link */
@@ -40,6 +41,14 @@ typedef struct Network Network;
 typedef struct Address Address;
 typedef struct DUID DUID;
 
+/* Time from receiving a lease or router advertisement until the resulting configuration was applied */
+typedef struct LinkLatency {
+        usec_t start; /* 0 if nothing is being applied */
+        usec_t last;
+        usec_t max;
+        uint64_t n;
+} LinkLatency;
+
 typedef struct Link {
         Manager *manager;
 
@@ -83,10 +92,15 @@ typedef struct Link {
         unsigned tc_messages;
         unsigned enslaving;
 
+        /* Static addresses and routes requested in the current configuration round, for reporting progress */
+        unsigned address_messages_total;
+        unsigned route_messages_total;
+
         Set *addresses;
         Set *addresses_foreign;
         Set *neighbors;
         Set *neighbors_foreign;
+        Set *fdb_entries; /* static FDB entries the kernel has on the link */
         Set *routes;
         Set *routes_foreign;
         Set *nexthops;
@@ -102,9 +116,11 @@ typedef struct Link {
         bool dhcp4_route_retrying:1;
         bool dhcp4_configured:1;
         bool dhcp6_configured:1;
+        LinkLatency dhcp4_latency;
 
         unsigned ndisc_messages;
         bool ndisc_configured;
+        LinkLatency ndisc_latency;
 
         sd_ipv4ll *ipv4ll;
         bool ipv4ll_address:1;
@@ -124,6 +140,7 @@ typedef struct Link {
         LIST_HEAD(Address, pool_addresses);
 
         sd_dhcp_server *dhcp_server;
+        char *dhcp_server_lease_file;
 
         sd_ndisc *ndisc;
         Set *ndisc_rdnss;
@@ -195,6 +212,9 @@ void link_dirty(Link *link);
 void link_clean(Link *link);
 int link_save(Link *link);
 
+void link_latency_start(Link *link, LinkLatency *latency);
+void link_latency_stop(Link *link, LinkLatency *latency, const char *what);
+
 int link_carrier_reset(Link *link);
 bool link_has_carrier(Link *link);
 
@@ -19,6 +19,7 @@
 #include "device-private.h"
 #include "device-util.h"
 #include "dns-domain.h"
+#include "event-util.h"
 #include "fd-util.h"
 #include "fileio.h"
 #include "local-addresses.h"
@@ -44,6 +45,9 @@
 /* use 128 MB for receive socket kernel queue. */
 #define RCVBUF_SIZE    (128*1024*1024)
 
+/* How long to wait after a netlink receive buffer overrun before re-enumerating */
+#define RTNL_RESYNC_DELAY_USEC (500 * USEC_PER_MSEC)
+
 static int log_message_warning_errno(sd_netlink_message *m, int err, const char *msg) {
         const char *err_msg = NULL;
 
@@ -280,6 +284,24 @@ static int manager_connect_udev(Manager *m) {
         return 0;
 }
 
+static bool manager_ignores_foreign_route(Manager *m, const Route *route) {
+        assert(m);
+        assert(route);
+
+        if (!m->manage_foreign_routes)
+                return true;
+
+        /* With full routing tables installed by other daemons, tracking their routes is pointless and
+         * expensive. Allow them to be skipped by table or protocol. */
+        if (set_contains(m->ignore_foreign_routes_tables, UINT32_TO_PTR(route->table)))
+                return true;
+
+        if (set_contains(m->ignore_foreign_routes_protocols, UINT32_TO_PTR(route->protocol)))
+                return true;
+
+        return false;
+}
+
 int manager_rtnl_process_route(sd_netlink *rtnl, sd_netlink_message *message, void *userdata) {
         _cleanup_(route_freep) Route *tmp = NULL;
         Route *route = NULL;
@@ -288,6 +310,7 @@ int manager_rtnl_process_route(sd_netlink *rtnl, sd_netlink_message *message, vo
         uint32_t ifindex;
         uint16_t type;
         unsigned char table;
+        bool ignore;
         int r;
 
         assert(rtnl);
@@ -448,6 +471,13 @@ int manager_rtnl_process_route(sd_netlink *rtnl, sd_netlink_message *message, vo
         }
         tmp->table = table;
 
+        /* rtm_table can only carry table numbers below 256, the full number is in RTA_TABLE. */
+        r = sd_netlink_message_read_u32(message, RTA_TABLE, &tmp->table);
+        if (r < 0 && r != -ENODATA) {
+                log_link_warning_errno(link, r, "rtnl: received route message with invalid table, ignoring: %m");
+                return 0;
+        }
+
         r = sd_netlink_message_read_u32(message, RTA_PRIORITY, &tmp->priority);
         if (r < 0 && r != -ENODATA) {
                 log_link_warning_errno(link, r, "rtnl: received route message with invalid priority, ignoring: %m");
@@ -480,6 +510,7 @@ int manager_rtnl_process_route(sd_netlink *rtnl, sd_netlink_message *message, vo
         }
 
         (void) route_get(link, tmp, &route);
+        ignore = !route && manager_ignores_foreign_route(m, tmp);
 
         if (DEBUG_LOGGING) {
                 _cleanup_free_ char *buf_dst = NULL, *buf_dst_prefixlen = NULL,
@@ -500,7 +531,7 @@ int manager_rtnl_process_route(sd_netlink *rtnl, sd_netlink_message *message, vo
 
                 log_link_debug(link,
                                "%s route: dst: %s%s, src: %s, gw: %s, prefsrc: %s, scope: %s, table: %s, proto: %s, type: %s",
-                               (!route && !link->manager->manage_foreign_routes) || type == RTM_DELROUTE ? "Forgetting" :
+                               ignore || type == RTM_DELROUTE ? "Forgetting" :
                                route ? "Received remembered" : "Remembering",
                                strna(buf_dst), strempty(buf_dst_prefixlen),
                                strna(buf_src), strna(buf_gw), strna(buf_prefsrc),
@@ -512,7 +543,7 @@ int manager_rtnl_process_route(sd_netlink *rtnl, sd_netlink_message *message, vo
 
         switch (type) {
         case RTM_NEWROUTE:
-                if (!route && link->manager->manage_foreign_routes) {
+                if (!route && !ignore) {
                         /* A route appeared that we did not request */
                         r = route_add_foreign(link, tmp, &route);
                         if (r < 0) {
@@ -639,6 +670,9 @@ int manager_rtnl_process_neighbor(sd_netlink *rtnl, sd_netlink_message *message,
         if (r < 0) {
                 log_link_warning(link, "rtnl: received neighbor message without family, ignoring.");
                 return 0;
+        } else if (family == AF_BRIDGE) {
+                (void) fdb_entry_process_message(link, type, message);
+                return 0;
         } else if (!IN_SET(family, AF_INET, AF_INET6)) {
                 log_link_debug(link, "rtnl: received neighbor message with invalid family '%i', ignoring.", family);
                 return 0;
@@ -1344,6 +1378,58 @@ static int manager_connect_genl(Manager *m) {
         return 0;
 }
 
+static int manager_rtnl_resync_handler(sd_event_source *s, uint64_t usec, void *userdata) {
+        Manager *m = userdata;
+        uint64_t n_overruns = 0;
+        int r;
+
+        assert(m);
+
+        (void) sd_netlink_get_statistics(m->rtnl, NULL, NULL, &n_overruns);
+        log_notice("Netlink receive buffer overrun (%"PRIu64" so far), re-enumerating links, addresses, neighbors, routes, rules and nexthops.",
+                   n_overruns);
+
+        /* Notifications that were dropped by the kernel would leave us with stale state. Re-dump the
+         * objects we track, so that what was added or changed in the meantime is picked up again. */
+        r = manager_rtnl_enumerate_links(m);
+        if (r < 0)
+                log_warning_errno(r, "Could not enumerate links, ignoring: %m");
+
+        r = manager_rtnl_enumerate_addresses(m);
+        if (r < 0)
+                log_warning_errno(r, "Could not enumerate addresses, ignoring: %m");
+
+        r = manager_rtnl_enumerate_neighbors(m);
+        if (r < 0)
+                log_warning_errno(r, "Could not enumerate neighbors, ignoring: %m");
+
+        r = manager_rtnl_enumerate_routes(m);
+        if (r < 0)
+                log_warning_errno(r, "Could not enumerate routes, ignoring: %m");
+
+        r = manager_rtnl_enumerate_rules(m);
+        if (r < 0)
+                log_warning_errno(r, "Could not enumerate rules, ignoring: %m");
+
+        r = manager_rtnl_enumerate_nexthop(m);
+        if (r < 0)
+                log_warning_errno(r, "Could not enumerate nexthops, ignoring: %m");
+
+        return 0;
+}
+
+static int manager_rtnl_overrun_handler(sd_netlink *rtnl, void *userdata) {
+        Manager *m = userdata;
+
+        assert(m);
+
+        /* Overruns come in bursts, e.g. when many links flap at once. Let things settle a bit, and then
+         * re-enumerate once, rather than every time. An already scheduled resync is not postponed. */
+        return event_reset_time(m->event, &m->rtnl_resync_event_source, clock_boottime_or_monotonic(),
+                                usec_add(now(clock_boottime_or_monotonic()), RTNL_RESYNC_DELAY_USEC), 0,
+                                manager_rtnl_resync_handler, m, 0, "rtnl-resync", false);
+}
+
 static int manager_connect_rtnl(Manager *m) {
         int fd, r;
 
@@ -1365,6 +1451,10 @@ static int manager_connect_rtnl(Manager *m) {
         if (r < 0)
                 return r;
 
+        r = sd_netlink_set_overrun_handler(m->rtnl, manager_rtnl_overrun_handler, m);
+        if (r < 0)
+                return r;
+
         r = sd_netlink_add_match(m->rtnl, NULL, RTM_NEWLINK, &manager_rtnl_process_link, NULL, m, "network-rtnl_process_link");
         if (r < 0)
                 return r;
@@ -1872,6 +1962,7 @@ void manager_free(Manager *m) {
         m->links = hashmap_free_with_destructor(m->links, link_unref);
 
         m->duids_requesting_uuid = set_free(m->duids_requesting_uuid);
+        network_index_clear(m);
         m->networks = ordered_hashmap_free_with_destructor(m->networks, network_unref);
 
         m->netdevs = hashmap_free_with_destructor(m->netdevs, netdev_unref);
@@ -1879,12 +1970,16 @@ void manager_free(Manager *m) {
         while ((pool = m->address_pools))
                 address_pool_free(pool);
 
+        m->ignore_foreign_routes_tables = set_free(m->ignore_foreign_routes_tables);
+        m->ignore_foreign_routes_protocols = set_free(m->ignore_foreign_routes_protocols);
+
         /* routing_policy_rule_free() access m->rules and m->rules_foreign.
          * So, it is necessary to set NULL after the sets are freed. */
         m->rules = set_free_with_destructor(m->rules, routing_policy_rule_free);
         m->rules_foreign = set_free_with_destructor(m->rules_foreign, routing_policy_rule_free);
         set_free_with_destructor(m->rules_saved, routing_policy_rule_free);
 
+        sd_event_source_unref(m->rtnl_resync_event_source);
         sd_netlink_unref(m->rtnl);
         sd_netlink_unref(m->genl);
         sd_resolve_unref(m->resolve);
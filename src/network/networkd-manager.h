@@ -19,6 +19,7 @@
 
 struct Manager {
         sd_netlink *rtnl;
+        sd_event_source *rtnl_resync_event_source;
         /* lazy initialized */
         sd_netlink *genl;
         sd_event *event;
@@ -31,6 +32,8 @@ struct Manager {
         bool dirty:1;
         bool restarting:1;
         bool manage_foreign_routes;
+        Set *ignore_foreign_routes_tables;
+        Set *ignore_foreign_routes_protocols;
 
         Set *dirty_links;
 
@@ -42,6 +45,14 @@ struct Manager {
         Hashmap *links;
         Hashmap *netdevs;
         OrderedHashmap *networks;
+        /* Index of the .network files by the literal values in their [Match] section, see network_get() */
+        Hashmap *networks_by_mac;
+        Hashmap *networks_by_name;
+        Hashmap *networks_by_driver;
+        Network **networks_unindexed;
+        size_t n_networks_unindexed;
+        size_t n_networks_unindexed_allocated;
+        bool networks_indexed;
         Hashmap *dhcp6_prefixes;
         LIST_HEAD(AddressPool, address_pools);
 
@@ -66,6 +77,8 @@ struct Manager {
         usec_t speed_meter_interval_usec;
         usec_t speed_meter_usec_new;
         usec_t speed_meter_usec_old;
+        bool speed_meter_pending;
+        bool speed_meter_use_getlink;
 
         bool dhcp4_prefix_root_cannot_set_table;
 };
@@ -102,6 +102,7 @@ static int ndisc_netlink_route_message_handler(sd_netlink *rtnl, sd_netlink_mess
 
         if (link->ndisc_messages == 0) {
                 link->ndisc_configured = true;
+                link_latency_stop(link, &link->ndisc_latency, "NDisc");
                 r = link_request_set_routes(link);
                 if (r < 0) {
                         link_enter_failed(link);
@@ -134,6 +135,7 @@ static int ndisc_netlink_address_message_handler(sd_netlink *rtnl, sd_netlink_me
 
         if (link->ndisc_messages == 0) {
                 link->ndisc_configured = true;
+                link_latency_stop(link, &link->ndisc_latency, "NDisc");
                 r = link_request_set_routes(link);
                 if (r < 0) {
                         link_enter_failed(link);
@@ -828,6 +830,7 @@ static void ndisc_handler(sd_ndisc *nd, sd_ndisc_event event, sd_ndisc_router *r
         switch (event) {
 
         case SD_NDISC_EVENT_ROUTER:
+                link_latency_start(link, &link->ndisc_latency);
                 (void) ndisc_router_handler(link, rt);
                 break;
 
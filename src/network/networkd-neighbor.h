@@ -33,6 +33,8 @@ struct Neighbor {
         LIST_FIELDS(Neighbor, neighbors);
 };
 
+extern const struct hash_ops neighbor_hash_ops;
+
 void neighbor_free(Neighbor *neighbor);
 
 DEFINE_NETWORK_SECTION_FUNCTIONS(Neighbor, neighbor_free);
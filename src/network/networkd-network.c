@@ -8,7 +8,9 @@
 #include "conf-files.h"
 #include "conf-parser.h"
 #include "dns-domain.h"
+#include "ether-addr-util.h"
 #include "fd-util.h"
+#include "glob-util.h"
 #include "hostname-util.h"
 #include "in-addr-util.h"
 #include "networkd-dhcp-server.h"
@@ -19,6 +21,7 @@
 #include "path-lookup.h"
 #include "set.h"
 #include "socket-util.h"
+#include "sort-util.h"
 #include "stat-util.h"
 #include "string-table.h"
 #include "string-util.h"
@@ -381,6 +384,7 @@ int network_load_one(Manager *manager, OrderedHashmap **networks, const char *fi
 
                 .required_for_online = true,
                 .required_operstate_for_online = LINK_OPERSTATE_RANGE_DEFAULT,
+                .speed_meter = true,
                 .dhcp = ADDRESS_FAMILY_NO,
                 .dhcp_critical = -1,
                 .dhcp_use_ntp = true,
@@ -545,6 +549,9 @@ int network_load_one(Manager *manager, OrderedHashmap **networks, const char *fi
         if (r < 0)
                 return r;
 
+        if (*networks == manager->networks)
+                network_index_clear(manager);
+
         network = NULL;
         return 0;
 }
@@ -556,6 +563,7 @@ int network_load(Manager *manager, OrderedHashmap **networks) {
 
         assert(manager);
 
+        network_index_clear(manager);
         ordered_hashmap_clear_with_destructor(*networks, network_unref);
 
         r = conf_files_list_strv(&files, ".network", NULL, 0, NETWORK_DIRS);
@@ -602,6 +610,7 @@ int network_reload(Manager *manager) {
                 network_unref(n);
         }
 
+        network_index_clear(manager);
         ordered_hashmap_free_with_destructor(manager->networks, network_unref);
         manager->networks = new_networks;
 
@@ -759,42 +768,287 @@ int network_get_by_name(Manager *manager, const char *name, Network **ret) {
         return 0;
 }
 
+void network_index_clear(Manager *manager) {
+        assert(manager);
+
+        manager->networks_by_mac = hashmap_free_with_destructor(manager->networks_by_mac, set_free);
+        manager->networks_by_name = hashmap_free_with_destructor(manager->networks_by_name, set_free);
+        manager->networks_by_driver = hashmap_free_with_destructor(manager->networks_by_driver, set_free);
+        manager->networks_unindexed = mfree(manager->networks_unindexed);
+        manager->n_networks_unindexed = manager->n_networks_unindexed_allocated = 0;
+        manager->networks_indexed = false;
+}
+
+static bool strv_is_literal(char * const *l) {
+        char * const *p;
+
+        if (strv_isempty(l))
+                return false;
+
+        /* Only positive patterns without any wildcards can be looked up directly. */
+        STRV_FOREACH(p, l)
+                if (**p == '!' || string_is_glob(*p) || strchr(*p, '\\'))
+                        return false;
+
+        return true;
+}
+
+static int network_index_put(Hashmap **h, const struct hash_ops *ops, const void *key, Network *network) {
+        _cleanup_set_free_ Set *new_set = NULL;
+        Set *s;
+        int r;
+
+        s = hashmap_get(*h, key);
+        if (!s) {
+                r = hashmap_ensure_allocated(h, ops);
+                if (r < 0)
+                        return r;
+
+                new_set = set_new(NULL);
+                if (!new_set)
+                        return -ENOMEM;
+
+                r = hashmap_put(*h, key, new_set);
+                if (r < 0)
+                        return r;
+
+                s = TAKE_PTR(new_set);
+        }
+
+        return set_put(s, network);
+}
+
+static int network_index_build(Manager *manager) {
+        Network *network;
+        unsigned order = 0;
+        Iterator i;
+        int r;
+
+        assert(manager);
+
+        /* A .network file whose MACAddress=, Name= or Driver= setting only lists literal values can only
+         * match links that have one of them, so it is indexed by them. All settings in the [Match]
+         * section have to match, hence one of them is sufficient. All other files need to be checked
+         * against every link. */
+        ORDERED_HASHMAP_FOREACH(network, manager->networks, i) {
+                char **p;
+
+                network->order = order++;
+
+                if (!set_isempty(network->match_mac)) {
+                        struct ether_addr *mac;
+                        Iterator j;
+
+                        SET_FOREACH(mac, network->match_mac, j) {
+                                r = network_index_put(&manager->networks_by_mac, &ether_addr_hash_ops, mac, network);
+                                if (r < 0)
+                                        return r;
+                        }
+
+                } else if (strv_is_literal(network->match_name)) {
+                        STRV_FOREACH(p, network->match_name) {
+                                r = network_index_put(&manager->networks_by_name, &string_hash_ops, *p, network);
+                                if (r < 0)
+                                        return r;
+                        }
+
+                } else if (strv_is_literal(network->match_driver)) {
+                        STRV_FOREACH(p, network->match_driver) {
+                                r = network_index_put(&manager->networks_by_driver, &string_hash_ops, *p, network);
+                                if (r < 0)
+                                        return r;
+                        }
+
+                } else {
+                        if (!GREEDY_REALLOC(manager->networks_unindexed, manager->n_networks_unindexed_allocated,
+                                            manager->n_networks_unindexed + 1))
+                                return -ENOMEM;
+
+                        manager->networks_unindexed[manager->n_networks_unindexed++] = network;
+                }
+        }
+
+        log_debug("Indexed %u .network files, %zu need to be checked against every link.",
+                  order, manager->n_networks_unindexed);
+
+        manager->networks_indexed = true;
+        return 0;
+}
+
+static int network_candidates_add(Network ***candidates, size_t *n, size_t *allocated, Set *s) {
+        Network *network;
+        Iterator i;
+
+        if (set_isempty(s))
+                return 0;
+
+        if (!GREEDY_REALLOC(*candidates, *allocated, *n + set_size(s)))
+                return -ENOMEM;
+
+        SET_FOREACH(network, s, i)
+                (*candidates)[(*n)++] = network;
+
+        return 0;
+}
+
+static int network_compare_order(Network * const *a, Network * const *b) {
+        return CMP((*a)->order, (*b)->order);
+}
+
+/* Returns the .network files that may match the link, in the order their files are checked. */
+static int network_get_candidates(
+                Manager *manager,
+                sd_device *device,
+                const char *ifname,
+                char * const *alternative_names,
+                const struct ether_addr *address,
+                Network ***ret,
+                size_t *ret_n) {
+
+        _cleanup_free_ Network **candidates = NULL;
+        size_t n = 0, allocated = 0, k, j;
+        const char *driver = NULL, *mac_str;
+        struct ether_addr mac_buf;
+        char * const *p;
+        int r;
+
+        assert(manager);
+        assert(ret);
+        assert(ret_n);
+
+        if (!manager->networks_indexed) {
+                r = network_index_build(manager);
+                if (r < 0) {
+                        network_index_clear(manager);
+                        return r;
+                }
+        }
+
+        /* Look up the same values net_match_config() checks. */
+        if (device) {
+                (void) sd_device_get_property_value(device, "ID_NET_DRIVER", &driver);
+                if (!ifname)
+                        (void) sd_device_get_sysname(device, &ifname);
+                if (!address &&
+                    sd_device_get_sysattr_value(device, "address", &mac_str) >= 0 &&
+                    ether_addr_from_string(mac_str, &mac_buf) >= 0)
+                        address = &mac_buf;
+        }
+
+        if (manager->n_networks_unindexed > 0) {
+                if (!GREEDY_REALLOC(candidates, allocated, manager->n_networks_unindexed))
+                        return -ENOMEM;
+
+                for (k = 0; k < manager->n_networks_unindexed; k++)
+                        candidates[n++] = manager->networks_unindexed[k];
+        }
+
+        if (address) {
+                r = network_candidates_add(&candidates, &n, &allocated, hashmap_get(manager->networks_by_mac, address));
+                if (r < 0)
+                        return r;
+        }
+
+        if (ifname) {
+                r = network_candidates_add(&candidates, &n, &allocated, hashmap_get(manager->networks_by_name, ifname));
+                if (r < 0)
+                        return r;
+        }
+
+        STRV_FOREACH(p, alternative_names) {
+                r = network_candidates_add(&candidates, &n, &allocated, hashmap_get(manager->networks_by_name, *p));
+                if (r < 0)
+                        return r;
+        }
+
+        if (driver) {
+                r = network_candidates_add(&candidates, &n, &allocated, hashmap_get(manager->networks_by_driver, driver));
+                if (r < 0)
+                        return r;
+        }
+
+        typesafe_qsort(candidates, n, network_compare_order);
+
+        /* A file may be found via both the interface name and an alternative name */
+        for (k = 0, j = 0; k < n; k++)
+                if (j == 0 || candidates[j - 1] != candidates[k])
+                        candidates[j++] = candidates[k];
+
+        *ret = TAKE_PTR(candidates);
+        *ret_n = j;
+        return 0;
+}
+
+static bool network_matches(
+                Network *network,
+                unsigned short iftype,
+                sd_device *device,
+                const char *ifname,
+                char * const *alternative_names,
+                const struct ether_addr *address,
+                const struct ether_addr *permanent_address,
+                enum nl80211_iftype wlan_iftype,
+                const char *ssid,
+                const struct ether_addr *bssid) {
+
+        if (!net_match_config(network->match_mac, network->match_permanent_mac,
+                              network->match_path, network->match_driver,
+                              network->match_type, network->match_name, network->match_property,
+                              network->match_wlan_iftype, network->match_ssid, network->match_bssid,
+                              iftype, device, address, permanent_address,
+                              ifname, alternative_names, wlan_iftype, ssid, bssid))
+                return false;
+
+        if (network->match_name && device) {
+                const char *attr;
+                uint8_t name_assign_type = NET_NAME_UNKNOWN;
+
+                if (sd_device_get_sysattr_value(device, "name_assign_type", &attr) >= 0)
+                        (void) safe_atou8(attr, &name_assign_type);
+
+                if (name_assign_type == NET_NAME_ENUM)
+                        log_warning("%s: found matching network '%s', based on potentially unpredictable ifname",
+                                    ifname, network->filename);
+                else
+                        log_debug("%s: found matching network '%s'", ifname, network->filename);
+        } else
+                log_debug("%s: found matching network '%s'", ifname, network->filename);
+
+        return true;
+}
+
 int network_get(Manager *manager, unsigned short iftype, sd_device *device,
                 const char *ifname, char * const *alternative_names,
                 const struct ether_addr *address, const struct ether_addr *permanent_address,
                 enum nl80211_iftype wlan_iftype, const char *ssid, const struct ether_addr *bssid,
                 Network **ret) {
+        _cleanup_free_ Network **candidates = NULL;
+        size_t n_candidates, k;
         Network *network;
         Iterator i;
+        int r;
 
         assert(manager);
         assert(ret);
 
-        ORDERED_HASHMAP_FOREACH(network, manager->networks, i)
-                if (net_match_config(network->match_mac, network->match_permanent_mac,
-                                     network->match_path, network->match_driver,
-                                     network->match_type, network->match_name, network->match_property,
-                                     network->match_wlan_iftype, network->match_ssid, network->match_bssid,
-                                     iftype, device, address, permanent_address,
-                                     ifname, alternative_names, wlan_iftype, ssid, bssid)) {
-                        if (network->match_name && device) {
-                                const char *attr;
-                                uint8_t name_assign_type = NET_NAME_UNKNOWN;
-
-                                if (sd_device_get_sysattr_value(device, "name_assign_type", &attr) >= 0)
-                                        (void) safe_atou8(attr, &name_assign_type);
-
-                                if (name_assign_type == NET_NAME_ENUM)
-                                        log_warning("%s: found matching network '%s', based on potentially unpredictable ifname",
-                                                    ifname, network->filename);
-                                else
-                                        log_debug("%s: found matching network '%s'", ifname, network->filename);
-                        } else
-                                log_debug("%s: found matching network '%s'", ifname, network->filename);
-
-                        *ret = network;
-                        return 0;
-                }
+        r = network_get_candidates(manager, device, ifname, alternative_names, address, &candidates, &n_candidates);
+        if (r >= 0) {
+                for (k = 0; k < n_candidates; k++)
+                        if (network_matches(candidates[k], iftype, device, ifname, alternative_names,
+                                            address, permanent_address, wlan_iftype, ssid, bssid)) {
+                                *ret = candidates[k];
+                                return 0;
+                        }
+        } else {
+                log_debug_errno(r, "Failed to look up matching .network files in index, checking all of them: %m");
+
+                ORDERED_HASHMAP_FOREACH(network, manager->networks, i)
+                        if (network_matches(network, iftype, device, ifname, alternative_names,
+                                            address, permanent_address, wlan_iftype, ssid, bssid)) {
+                                *ret = network;
+                                return 0;
+                        }
+        }
 
         *ret = NULL;
 
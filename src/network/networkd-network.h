@@ -62,6 +62,7 @@ struct Network {
         usec_t timestamp;
 
         unsigned n_ref;
+        unsigned order; /* position in Manager.networks, to keep the order when looking up via the index */
 
         Set *match_mac;
         Set *match_permanent_mac;
@@ -260,6 +261,7 @@ struct Network {
 
         bool required_for_online; /* Is this network required to be considered online? */
         LinkOperationalStateRange required_operstate_for_online;
+        bool speed_meter; /* Is the link sampled by the speed meter? */
 
         /* LLDP support */
         LLDPMode lldp_mode; /* LLDP reception */
@@ -329,6 +331,7 @@ int network_load_one(Manager *manager, OrderedHashmap **networks, const char *fi
 int network_verify(Network *network);
 
 int network_get_by_name(Manager *manager, const char *name, Network **ret);
+void network_index_clear(Manager *manager);
 int network_get(Manager *manager, unsigned short iftype, sd_device *device, const char *ifname, char * const *alternative_names,
                 const struct ether_addr *mac, const struct ether_addr *permanent_mac,
                 enum nl80211_iftype wlan_iftype, const char *ssid,
@@ -267,6 +267,13 @@ DEFINE_HASH_OPS_WITH_KEY_DESTRUCTOR(
                 route_compare_func,
                 route_free);
 
+/* Same as above, but does not own the routes. Used for temporary lookup tables. */
+DEFINE_HASH_OPS(
+                route_index_hash_ops,
+                Route,
+                route_hash_func,
+                route_compare_func);
+
 bool route_equal(Route *r1, Route *r2) {
         if (r1 == r2)
                 return true;
@@ -958,7 +965,7 @@ static const char * const route_protocol_full_table[] = {
         [RTPROT_EIGRP]    = "eigrp",
 };
 
-DEFINE_PRIVATE_STRING_TABLE_LOOKUP_TO_STRING(route_protocol_full, int);
+DEFINE_PRIVATE_STRING_TABLE_LOOKUP(route_protocol_full, int);
 
 const char *format_route_protocol(int protocol, char *buf, size_t size) {
         const char *s;
@@ -1236,6 +1243,106 @@ int config_parse_route_table(
         return 0;
 }
 
+static int config_parse_route_foreign_set(
+                const char *unit,
+                const char *filename,
+                unsigned line,
+                const char *lvalue,
+                const char *rvalue,
+                Set **set,
+                bool is_table) {
+
+        const char *p;
+        int r;
+
+        if (isempty(rvalue)) {
+                *set = set_free(*set);
+                return 0;
+        }
+
+        for (p = rvalue;;) {
+                _cleanup_free_ char *word = NULL;
+                uint32_t k;
+
+                r = extract_first_word(&p, &word, NULL, 0);
+                if (r == -ENOMEM)
+                        return log_oom();
+                if (r < 0) {
+                        log_syntax(unit, LOG_ERR, filename, line, r,
+                                   "Failed to extract %s=, ignoring: %s", lvalue, rvalue);
+                        return 0;
+                }
+                if (r == 0)
+                        return 0;
+
+                r = is_table ? route_table_from_string(word) : route_protocol_full_from_string(word);
+                if (r >= 0)
+                        k = r;
+                else if (is_table)
+                        r = safe_atou32(word, &k);
+                else {
+                        uint8_t u;
+
+                        r = safe_atou8(word, &u);
+                        k = u;
+                }
+                if (r < 0 || k == 0) {
+                        log_syntax(unit, LOG_ERR, filename, line, r < 0 ? r : 0,
+                                   "Invalid route %s \"%s\" in %s=, ignoring.",
+                                   is_table ? "table" : "protocol", word, lvalue);
+                        continue;
+                }
+
+                r = set_ensure_allocated(set, NULL);
+                if (r < 0)
+                        return log_oom();
+
+                r = set_put(*set, UINT32_TO_PTR(k));
+                if (r < 0)
+                        return log_oom();
+        }
+}
+
+int config_parse_route_table_set(
+                const char *unit,
+                const char *filename,
+                unsigned line,
+                const char *section,
+                unsigned section_line,
+                const char *lvalue,
+                int ltype,
+                const char *rvalue,
+                void *data,
+                void *userdata) {
+
+        assert(filename);
+        assert(lvalue);
+        assert(rvalue);
+        assert(data);
+
+        return config_parse_route_foreign_set(unit, filename, line, lvalue, rvalue, data, true);
+}
+
+int config_parse_route_protocol_set(
+                const char *unit,
+                const char *filename,
+                unsigned line,
+                const char *section,
+                unsigned section_line,
+                const char *lvalue,
+                int ltype,
+                const char *rvalue,
+                void *data,
+                void *userdata) {
+
+        assert(filename);
+        assert(lvalue);
+        assert(rvalue);
+        assert(data);
+
+        return config_parse_route_foreign_set(unit, filename, line, lvalue, rvalue, data, false);
+}
+
 int config_parse_gateway_onlink(
                 const char *unit,
                 const char *filename,
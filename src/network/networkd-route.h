@@ -63,6 +63,7 @@ struct Route {
 };
 
 extern const struct hash_ops route_hash_ops;
+extern const struct hash_ops route_index_hash_ops;
 
 int route_new(Route **ret);
 void route_free(Route *route);
@@ -103,6 +104,8 @@ CONFIG_PARSER_PROTOTYPE(config_parse_route_table);
 CONFIG_PARSER_PROTOTYPE(config_parse_gateway_onlink);
 CONFIG_PARSER_PROTOTYPE(config_parse_ipv6_route_preference);
 CONFIG_PARSER_PROTOTYPE(config_parse_route_protocol);
+CONFIG_PARSER_PROTOTYPE(config_parse_route_table_set);
+CONFIG_PARSER_PROTOTYPE(config_parse_route_protocol_set);
 CONFIG_PARSER_PROTOTYPE(config_parse_route_type);
 CONFIG_PARSER_PROTOTYPE(config_parse_tcp_window);
 CONFIG_PARSER_PROTOTYPE(config_parse_quickack);
@@ -1,15 +1,23 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
 #include <errno.h>
+#include <linux/if_link.h>
 
 #include "sd-event.h"
 #include "sd-netlink.h"
 
+#include "netlink-util.h"
 #include "networkd-link-bus.h"
 #include "networkd-link.h"
 #include "networkd-manager.h"
 #include "networkd-speed-meter.h"
 
+static bool link_wants_speed_meter(Link *link) {
+        assert(link);
+
+        return !link->network || link->network->speed_meter;
+}
+
 static int process_message(Manager *manager, sd_netlink_message *message) {
         uint16_t type;
         int ifindex, r;
@@ -19,10 +27,12 @@ static int process_message(Manager *manager, sd_netlink_message *message) {
         if (r < 0)
                 return r;
 
-        if (type != RTM_NEWLINK)
+        if (type == RTM_NEWSTATS)
+                r = sd_rtnl_message_stats_get_ifindex(message, &ifindex);
+        else if (type == RTM_NEWLINK)
+                r = sd_rtnl_message_link_get_ifindex(message, &ifindex);
+        else
                 return 0;
-
-        r = sd_rtnl_message_link_get_ifindex(message, &ifindex);
         if (r < 0)
                 return r;
 
@@ -30,9 +40,13 @@ static int process_message(Manager *manager, sd_netlink_message *message) {
         if (!link)
                 return -ENODEV;
 
+        if (!link_wants_speed_meter(link))
+                return 0;
+
         link->stats_old = link->stats_new;
 
-        r = sd_netlink_message_read(message, IFLA_STATS64, sizeof link->stats_new, &link->stats_new);
+        r = sd_netlink_message_read(message, type == RTM_NEWSTATS ? IFLA_STATS_LINK_64 : IFLA_STATS64,
+                                    sizeof link->stats_new, &link->stats_new);
         if (r < 0)
                 return r;
 
@@ -41,23 +55,33 @@ static int process_message(Manager *manager, sd_netlink_message *message) {
         return 0;
 }
 
-static int speed_meter_handler(sd_event_source *s, uint64_t usec, void *userdata) {
-        _cleanup_(sd_netlink_message_unrefp) sd_netlink_message *req = NULL, *reply = NULL;
-        Manager *manager = userdata;
+static int speed_meter_request(Manager *manager);
+
+static int speed_meter_reply_handler(sd_netlink *rtnl, sd_netlink_message *reply, Manager *manager) {
         sd_netlink_message *i;
         usec_t usec_now;
         Iterator j;
         Link *link;
         int r;
 
-        assert(s);
-        assert(userdata);
+        assert(manager);
 
-        r = sd_event_now(sd_event_source_get_event(s), CLOCK_MONOTONIC, &usec_now);
-        if (r < 0)
-                return r;
+        manager->speed_meter_pending = false;
 
-        r = sd_event_source_set_time(s, usec_now + manager->speed_meter_interval_usec);
+        r = reply ? sd_netlink_message_get_errno(reply) : 0;
+        if (IN_SET(r, -EOPNOTSUPP, -EINVAL) && !manager->speed_meter_use_getlink) {
+                /* RTM_GETSTATS is available since kernel 4.7. Fall back to dumping all link information. */
+                log_debug_errno(r, "RTM_GETSTATS is not supported, using RTM_GETLINK for the speed meter: %m");
+                manager->speed_meter_use_getlink = true;
+                (void) speed_meter_request(manager);
+                return 0;
+        }
+        if (r < 0) {
+                log_warning_errno(r, "Failed to receive link statistics, ignoring: %m");
+                return 0;
+        }
+
+        r = sd_event_now(manager->event, CLOCK_MONOTONIC, &usec_now);
         if (r < 0)
                 return r;
 
@@ -67,26 +91,60 @@ static int speed_meter_handler(sd_event_source *s, uint64_t usec, void *userdata
         HASHMAP_FOREACH(link, manager->links, j)
                 link->stats_updated = false;
 
-        r = sd_rtnl_message_new_link(manager->rtnl, &req, RTM_GETLINK, 0);
-        if (r < 0) {
-                log_warning_errno(r, "Failed to allocate RTM_GETLINK netlink message, ignoring: %m");
-                return 0;
-        }
+        for (i = reply; i; i = sd_netlink_message_next(i))
+                (void) process_message(manager, i);
+
+        return 0;
+}
+
+static int speed_meter_request(Manager *manager) {
+        _cleanup_(sd_netlink_message_unrefp) sd_netlink_message *req = NULL;
+        int r;
+
+        assert(manager);
+
+        if (manager->speed_meter_use_getlink)
+                r = sd_rtnl_message_new_link(manager->rtnl, &req, RTM_GETLINK, 0);
+        else
+                /* Only ask for the 64bit counters, which keeps the dump small even with many links. */
+                r = sd_rtnl_message_new_stats(manager->rtnl, &req, RTM_GETSTATS, 0,
+                                              IFLA_STATS_FILTER_BIT(IFLA_STATS_LINK_64));
+        if (r < 0)
+                return log_warning_errno(r, "Failed to allocate netlink message for link statistics, ignoring: %m");
 
         r = sd_netlink_message_request_dump(req, true);
-        if (r < 0) {
-                log_warning_errno(r, "Failed to set dump flag, ignoring: %m");
-                return 0;
-        }
+        if (r < 0)
+                return log_warning_errno(r, "Failed to set dump flag, ignoring: %m");
 
-        r = sd_netlink_call(manager->rtnl, req, 0, &reply);
-        if (r < 0) {
-                log_warning_errno(r, "Failed to call RTM_GETLINK, ignoring: %m");
+        r = netlink_call_async(manager->rtnl, NULL, req, speed_meter_reply_handler, NULL, manager);
+        if (r < 0)
+                return log_warning_errno(r, "Failed to request link statistics, ignoring: %m");
+
+        manager->speed_meter_pending = true;
+        return 0;
+}
+
+static int speed_meter_handler(sd_event_source *s, uint64_t usec, void *userdata) {
+        Manager *manager = userdata;
+        usec_t usec_now;
+        int r;
+
+        assert(s);
+        assert(userdata);
+
+        r = sd_event_now(sd_event_source_get_event(s), CLOCK_MONOTONIC, &usec_now);
+        if (r < 0)
+                return r;
+
+        r = sd_event_source_set_time(s, usec_now + manager->speed_meter_interval_usec);
+        if (r < 0)
+                return r;
+
+        /* Do not pile up requests if the previous dump has not been answered yet. */
+        if (manager->speed_meter_pending)
                 return 0;
-        }
 
-        for (i = reply; i; i = sd_netlink_message_next(i))
-                (void) process_message(manager, i);
+        (void) speed_meter_request(manager);
 
         return 0;
 }
@@ -7,10 +7,12 @@
 
 #include "alloc-util.h"
 #include "dhcp-lease-internal.h"
+#include "ether-addr-util.h"
 #include "hostname-util.h"
 #include "network-internal.h"
 #include "networkd-manager.h"
 #include "string-util.h"
+#include "strv.h"
 #include "tests.h"
 
 static void test_deserialize_in_addr(void) {
@@ -136,6 +138,67 @@ static void test_network_get(Manager *manager, sd_device *loopback) {
                 assert_not_reached("bad error!");
 }
 
+static Network *add_test_network(Manager *manager, const char *name, const char *match_mac, char **match_name) {
+        Network *network;
+
+        assert_se(network = new0(Network, 1));
+        network->n_ref = 1;
+        assert_se(network->name = strdup(name));
+        assert_se(network->filename = strjoin("/run/systemd/network/", name));
+        network->match_name = strv_copy(match_name);
+
+        if (match_mac) {
+                struct ether_addr *mac;
+
+                assert_se(mac = new(struct ether_addr, 1));
+                assert_se(ether_addr_from_string(match_mac, mac) >= 0);
+                assert_se(set_ensure_allocated(&network->match_mac, &ether_addr_hash_ops) >= 0);
+                assert_se(set_put(network->match_mac, mac) > 0);
+        }
+
+        assert_se(ordered_hashmap_ensure_allocated(&manager->networks, &string_hash_ops) >= 0);
+        assert_se(ordered_hashmap_put(manager->networks, network->name, network) >= 0);
+        network_index_clear(manager);
+
+        return network;
+}
+
+static void test_network_get_index(void) {
+        _cleanup_(manager_freep) Manager *manager = NULL;
+        Network *by_mac, *by_name, *by_glob, *network;
+        struct ether_addr mac1, mac2;
+
+        assert_se(manager_new(&manager) >= 0);
+
+        by_mac = add_test_network(manager, "10-mac.network", "00:11:22:33:44:01", NULL);
+        by_name = add_test_network(manager, "20-name.network", NULL, STRV_MAKE("eth0", "eth1"));
+        by_glob = add_test_network(manager, "30-glob.network", NULL, STRV_MAKE("eth*"));
+
+        assert_se(ether_addr_from_string("00:11:22:33:44:01", &mac1) >= 0);
+        assert_se(ether_addr_from_string("00:11:22:33:44:02", &mac2) >= 0);
+
+        /* The first matching file wins, whether it is indexed or not */
+        assert_se(network_get(manager, 0, NULL, "eth0", NULL, &mac1, NULL, 0, NULL, NULL, &network) >= 0);
+        assert_se(network == by_mac);
+        assert_se(manager->networks_indexed);
+        assert_se(manager->n_networks_unindexed == 1);
+
+        assert_se(network_get(manager, 0, NULL, "eth0", NULL, &mac2, NULL, 0, NULL, NULL, &network) >= 0);
+        assert_se(network == by_name);
+        assert_se(network_get(manager, 0, NULL, "foo", STRV_MAKE("bar", "eth1"), &mac2, NULL, 0, NULL, NULL, &network) >= 0);
+        assert_se(network == by_name);
+        assert_se(network_get(manager, 0, NULL, "eth2", NULL, &mac2, NULL, 0, NULL, NULL, &network) >= 0);
+        assert_se(network == by_glob);
+        assert_se(network_get(manager, 0, NULL, "wlan0", NULL, &mac2, NULL, 0, NULL, NULL, &network) == -ENOENT);
+        assert_se(!network);
+
+        /* Adding a file drops the index, and it is rebuilt on the next lookup */
+        network = add_test_network(manager, "40-all.network", NULL, STRV_MAKE("!lo"));
+        assert_se(!manager->networks_indexed);
+        assert_se(network_get(manager, 0, NULL, "wlan0", NULL, &mac2, NULL, 0, NULL, NULL, &network) >= 0);
+        assert_se(streq(network->name, "40-all.network"));
+}
+
 static void test_address_equality(void) {
         _cleanup_(address_freep) Address *a1 = NULL, *a2 = NULL;
 
@@ -181,6 +244,64 @@ static void test_address_equality(void) {
         assert_se(!address_equal(a1, a2));
 }
 
+static void fdb_message_new(sd_netlink *rtnl, uint16_t type, const struct ether_addr *mac, const char *dst, uint32_t vni, sd_netlink_message **ret) {
+        _cleanup_(sd_netlink_message_unrefp) sd_netlink_message *m = NULL;
+        union in_addr_union a;
+
+        assert_se(sd_rtnl_message_new_neigh(rtnl, &m, type, 1, PF_BRIDGE) >= 0);
+        assert_se(sd_rtnl_message_neigh_set_flags(m, NTF_SELF) >= 0);
+        assert_se(sd_rtnl_message_neigh_set_state(m, NUD_NOARP | NUD_PERMANENT) >= 0);
+        assert_se(sd_netlink_message_append_data(m, NDA_LLADDR, mac, sizeof(*mac)) >= 0);
+        assert_se(in_addr_from_string(AF_INET, dst, &a) >= 0);
+        assert_se(sd_netlink_message_append_in_addr(m, NDA_DST, &a.in) >= 0);
+        assert_se(sd_netlink_message_append_u32(m, NDA_VNI, vni) >= 0);
+        assert_se(sd_netlink_message_rewind(m, NULL) >= 0);
+
+        *ret = TAKE_PTR(m);
+}
+
+static void test_fdb_entry_tracking(void) {
+        _cleanup_(sd_netlink_unrefp) sd_netlink *rtnl = NULL;
+        _cleanup_(sd_netlink_message_unrefp) sd_netlink_message *m1 = NULL, *m2 = NULL, *del = NULL;
+        struct ether_addr zero = {}, mac = { { 0x02, 0x00, 0x00, 0x00, 0x00, 0x01 } };
+        FdbEntry configured;
+        Link link = {};
+
+        if (sd_netlink_open(&rtnl) < 0) {
+                log_info("/* %s: cannot open rtnl, skipping */", __func__);
+                return;
+        }
+
+        /* The same entry reported twice, e.g. when enumerating after an overrun, is tracked once. Entries
+         * which only differ in the destination are different entries. */
+        fdb_message_new(rtnl, RTM_NEWNEIGH, &zero, "192.168.0.1", 42, &m1);
+        fdb_message_new(rtnl, RTM_NEWNEIGH, &zero, "192.168.0.2", 42, &m2);
+        assert_se(fdb_entry_process_message(&link, RTM_NEWNEIGH, m1) >= 0);
+        assert_se(fdb_entry_process_message(&link, RTM_NEWNEIGH, m1) >= 0);
+        assert_se(fdb_entry_process_message(&link, RTM_NEWNEIGH, m2) >= 0);
+        assert_se(set_size(link.fdb_entries) == 2);
+
+        configured = (FdbEntry) {
+                .vni = 42,
+                .family = AF_INET,
+                .fdb_ntf_flags = NEIGHBOR_CACHE_ENTRY_FLAGS_SELF,
+        };
+        assert_se(in_addr_from_string(AF_INET, "192.168.0.1", &configured.destination_addr) >= 0);
+        assert_se(set_contains(link.fdb_entries, &configured));
+
+        configured.vni = 43;
+        assert_se(!set_contains(link.fdb_entries, &configured));
+        configured.vni = 42;
+        configured.mac_addr = mac;
+        assert_se(!set_contains(link.fdb_entries, &configured));
+
+        fdb_message_new(rtnl, RTM_DELNEIGH, &zero, "192.168.0.1", 42, &del);
+        assert_se(fdb_entry_process_message(&link, RTM_DELNEIGH, del) >= 0);
+        assert_se(set_size(link.fdb_entries) == 1);
+
+        link.fdb_entries = set_free_with_destructor(link.fdb_entries, fdb_entry_free);
+}
+
 static void test_dhcp_hostname_shorten_overlong(void) {
         int r;
 
@@ -236,6 +357,7 @@ int main(void) {
         test_deserialize_in_addr();
         test_deserialize_dhcp_routes();
         test_address_equality();
+        test_fdb_entry_tracking();
         test_dhcp_hostname_shorten_overlong();
 
         assert_se(manager_new(&manager) >= 0);
@@ -251,6 +373,7 @@ int main(void) {
         assert_se(ifindex == 1);
 
         test_network_get(manager, loopback);
+        test_network_get_index();
 
         assert_se(manager_rtnl_enumerate_links(manager) >= 0);
 }
@@ -10,6 +10,7 @@
 #include "network-internal.h"
 #include "networkd-conf.h"
 #include "networkd-network.h"
+#include "networkd-route.h"
 
 static void test_config_parse_duid_type_one(const char *rvalue, int ret, DUIDType expected, usec_t expected_time) {
         DUID actual = {};
@@ -243,6 +244,30 @@ static void test_config_parse_match_strv(void) {
                                        "KEY3=val with \\quotation\\")));
 }
 
+static void test_config_parse_route_table_set(void) {
+        _cleanup_set_free_ Set *s = NULL;
+
+        assert_se(config_parse_route_table_set("network", "filename", 1, "section", 1, "IgnoreForeignRoutesTable", 0, "main 1000 0 foo", &s, NULL) == 0);
+        assert_se(set_size(s) == 2);
+        assert_se(set_contains(s, UINT32_TO_PTR(RT_TABLE_MAIN)));
+        assert_se(set_contains(s, UINT32_TO_PTR(1000)));
+
+        assert_se(config_parse_route_table_set("network", "filename", 1, "section", 1, "IgnoreForeignRoutesTable", 0, "", &s, NULL) == 0);
+        assert_se(set_isempty(s));
+}
+
+static void test_config_parse_route_protocol_set(void) {
+        _cleanup_set_free_ Set *s = NULL;
+
+        assert_se(config_parse_route_protocol_set("network", "filename", 1, "section", 1, "IgnoreForeignRoutesProtocol", 0, "bird zebra 99 256", &s, NULL) == 0);
+        assert_se(config_parse_route_protocol_set("network", "filename", 1, "section", 1, "IgnoreForeignRoutesProtocol", 0, "bgp", &s, NULL) == 0);
+        assert_se(set_size(s) == 4);
+        assert_se(set_contains(s, UINT32_TO_PTR(RTPROT_BIRD)));
+        assert_se(set_contains(s, UINT32_TO_PTR(RTPROT_ZEBRA)));
+        assert_se(set_contains(s, UINT32_TO_PTR(RTPROT_BGP)));
+        assert_se(set_contains(s, UINT32_TO_PTR(99)));
+}
+
 int main(int argc, char **argv) {
         log_parse_environment();
         log_open();
@@ -253,6 +278,8 @@ int main(int argc, char **argv) {
         test_config_parse_address();
         test_config_parse_match_ifnames();
         test_config_parse_match_strv();
+        test_config_parse_route_table_set();
+        test_config_parse_route_protocol_set();
 
         return 0;
 }
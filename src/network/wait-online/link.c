@@ -3,9 +3,12 @@
 #include "sd-network.h"
 
 #include "alloc-util.h"
+#include "env-file.h"
 #include "hashmap.h"
 #include "link.h"
 #include "manager.h"
+#include "parse-util.h"
+#include "stdio-util.h"
 #include "string-util.h"
 
 int link_new(Manager *m, Link **ret, int ifindex, const char *ifname) {
@@ -104,23 +107,40 @@ int link_update_rtnl(Link *l, sd_netlink_message *m) {
 }
 
 int link_update_monitor(Link *l) {
-        _cleanup_free_ char *operstate = NULL, *required_operstate = NULL, *state = NULL;
+        _cleanup_free_ char *required_for_online = NULL, *required_operstate = NULL, *operstate = NULL, *state = NULL;
+        char path[STRLEN("/run/systemd/netif/links/") + DECIMAL_STR_MAX(int)];
         int r, ret = 0;
 
         assert(l);
         assert(l->ifname);
 
-        r = sd_network_link_get_required_for_online(l->ifindex);
+        /* Read everything we need from the state file in one go, rather than once per field through the
+         * sd_network_link_get_*() calls. When waiting for thousands of links, this is what we mostly do. The
+         * defaults for missing fields are the same as those of sd-network. */
+        xsprintf(path, "/run/systemd/netif/links/%i", l->ifindex);
+
+        r = parse_env_file(NULL, path,
+                           "REQUIRED_FOR_ONLINE", &required_for_online,
+                           "REQUIRED_OPER_STATE_FOR_ONLINE", &required_operstate,
+                           "OPER_STATE", &operstate,
+                           "ADMIN_STATE", &state);
+        if (r == -ENOENT)
+                return -ENODATA;
         if (r < 0)
-                ret = log_link_debug_errno(l, r, "Failed to determine whether the link is required for online or not, "
-                                           "ignoring: %m");
-        else
-                l->required_for_online = r > 0;
+                return log_link_debug_errno(l, r, "Failed to read link state file, ignoring: %m");
 
-        r = sd_network_link_get_required_operstate_for_online(l->ifindex, &required_operstate);
-        if (r < 0)
-                ret = log_link_debug_errno(l, r, "Failed to get required operational state, ignoring: %m");
-        else if (isempty(required_operstate))
+        if (isempty(required_for_online))
+                l->required_for_online = true;
+        else {
+                r = parse_boolean(required_for_online);
+                if (r < 0)
+                        ret = log_link_debug_errno(l, r, "Failed to determine whether the link is required for online or not, "
+                                                   "ignoring: %m");
+                else
+                        l->required_for_online = r > 0;
+        }
+
+        if (isempty(required_operstate))
                 l->required_operstate = LINK_OPERSTATE_RANGE_DEFAULT;
         else {
                 r = parse_operational_state_range(required_operstate, &l->required_operstate);
@@ -129,9 +149,8 @@ int link_update_monitor(Link *l) {
                                                    "Failed to parse required operational state, ignoring: %m");
         }
 
-        r = sd_network_link_get_operational_state(l->ifindex, &operstate);
-        if (r < 0)
-                ret = log_link_debug_errno(l, r, "Failed to get operational state, ignoring: %m");
+        if (isempty(operstate))
+                ret = log_link_debug_errno(l, SYNTHETIC_ERRNO(ENODATA), "Failed to get operational state, ignoring: %m");
         else {
                 LinkOperationalState s;
 
@@ -143,9 +162,8 @@ int link_update_monitor(Link *l) {
                         l->operational_state = s;
         }
 
-        r = sd_network_link_get_setup_state(l->ifindex, &state);
-        if (r < 0)
-                ret = log_link_debug_errno(l, r, "Failed to get setup state, ignoring: %m");
+        if (isempty(state))
+                ret = log_link_debug_errno(l, SYNTHETIC_ERRNO(ENODATA), "Failed to get setup state, ignoring: %m");
         else
                 free_and_replace(l->state, state);
 
@@ -9,6 +9,7 @@
 #include "manager.h"
 #include "netlink-util.h"
 #include "network-internal.h"
+#include "parse-util.h"
 #include "strv.h"
 #include "time-util.h"
 #include "util.h"
@@ -126,6 +127,36 @@ bool manager_configured(Manager *m) {
         return one_ready;
 }
 
+static int on_check(sd_event_source *s, void *userdata) {
+        Manager *m = userdata;
+
+        assert(m);
+
+        if (manager_configured(m))
+                sd_event_exit(m->event, 0);
+
+        return 0;
+}
+
+static int manager_schedule_check(Manager *m) {
+        int r;
+
+        assert(m);
+
+        /* Evaluating all links is done at most once per event loop iteration, however many links changed. */
+
+        if (m->check_event_source)
+                return sd_event_source_set_enabled(m->check_event_source, SD_EVENT_ONESHOT);
+
+        r = sd_event_add_defer(m->event, &m->check_event_source, on_check, m);
+        if (r < 0)
+                return r;
+
+        (void) sd_event_source_set_description(m->check_event_source, "wait-online-check");
+
+        return 0;
+}
+
 static int manager_process_link(sd_netlink *rtnl, sd_netlink_message *mm, void *userdata) {
         Manager *m = userdata;
         uint16_t type;
@@ -201,8 +232,9 @@ static int on_rtnl_event(sd_netlink *rtnl, sd_netlink_message *mm, void *userdat
         if (r < 0)
                 return r;
 
-        if (manager_configured(m))
-                sd_event_exit(m->event, 0);
+        r = manager_schedule_check(m);
+        if (r < 0)
+                return r;
 
         return 1;
 }
@@ -253,26 +285,65 @@ static int manager_rtnl_listen(Manager *m) {
         return r;
 }
 
-static int on_network_event(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
-        Manager *m = userdata;
+static void manager_update_all_links(Manager *m) {
         Iterator i;
         Link *l;
         int r;
 
         assert(m);
 
-        sd_network_monitor_flush(m->network_monitor);
-
         HASHMAP_FOREACH(l, m->links, i) {
                 r = link_update_monitor(l);
                 if (r < 0 && r != -ENODATA)
                         log_link_warning_errno(l, r, "Failed to update link state, ignoring: %m");
         }
+}
 
-        if (manager_configured(m))
-                sd_event_exit(m->event, 0);
+static int on_network_event(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
+        Manager *m = userdata;
 
-        return 0;
+        assert(m);
+
+        sd_network_monitor_flush(m->network_monitor);
+
+        manager_update_all_links(m);
+
+        return manager_schedule_check(m);
+}
+
+static int on_links_inotify(sd_event_source *s, const struct inotify_event *event, void *userdata) {
+        Manager *m = userdata;
+        int ifindex, r;
+        Link *l;
+
+        assert(m);
+        assert(event);
+
+        /* The state file of each link is named after its ifindex, hence only the link whose state file was
+         * replaced needs to be looked at. */
+        if (event->mask & IN_Q_OVERFLOW) {
+                log_debug("inotify queue overflow, rereading all link state files.");
+                manager_update_all_links(m);
+                return manager_schedule_check(m);
+        }
+
+        if (event->len == 0)
+                return 0;
+
+        ifindex = parse_ifindex(event->name);
+        if (ifindex < 0)
+                return 0;
+
+        l = hashmap_get(m->links, INT_TO_PTR(ifindex));
+        if (!l)
+                /* Not seen via rtnl yet, the state file will be read once it is. */
+                return 0;
+
+        r = link_update_monitor(l);
+        if (r < 0 && r != -ENODATA)
+                log_link_warning_errno(l, r, "Failed to update link state, ignoring: %m");
+
+        return manager_schedule_check(m);
 }
 
 static int manager_network_monitor_listen(Manager *m) {
@@ -280,6 +351,18 @@ static int manager_network_monitor_listen(Manager *m) {
 
         assert(m);
 
+        r = sd_event_add_inotify(m->event, &m->links_event_source, "/run/systemd/netif/links/",
+                                 IN_MOVED_TO|IN_DELETE|IN_ONLYDIR, on_links_inotify, m);
+        if (r >= 0) {
+                (void) sd_event_source_set_description(m->links_event_source, "wait-online-links");
+                return 0;
+        }
+        if (r != -ENOENT)
+                return r;
+
+        /* networkd did not create the state directory yet. Fall back to sd-network, which waits for it to
+         * appear, but only tells us that something changed. */
+
         r = sd_network_monitor_new(&m->network_monitor, NULL);
         if (r < 0)
                 return r;
@@ -361,6 +444,9 @@ void manager_free(Manager *m) {
         sd_event_source_unref(m->network_monitor_event_source);
         sd_network_monitor_unref(m->network_monitor);
 
+        sd_event_source_unref(m->links_event_source);
+        sd_event_source_unref(m->check_event_source);
+
         sd_event_source_unref(m->rtnl_event_source);
         sd_netlink_unref(m->rtnl);
 
@@ -29,6 +29,9 @@ struct Manager {
         sd_network_monitor *network_monitor;
         sd_event_source *network_monitor_event_source;
 
+        sd_event_source *links_event_source;
+        sd_event_source *check_event_source;
+
         sd_event *event;
 };
 
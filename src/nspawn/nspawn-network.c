@@ -57,6 +57,102 @@ static int remove_one_link(sd_netlink *rtnl, const char *name) {
         return 1;
 }
 
+/* Several netlink requests sent at once, so that we only wait for the kernel once instead of once per
+ * request. The kernel processes the requests in the order they are sent, hence later requests may refer
+ * to interfaces created by earlier ones in the same batch. */
+typedef struct NetlinkBatch {
+        sd_netlink *rtnl;
+        unsigned n_pending;
+        int error;
+} NetlinkBatch;
+
+typedef struct NetlinkBatchRequest {
+        NetlinkBatch *batch;
+        char *description;
+} NetlinkBatchRequest;
+
+static void netlink_batch_request_free(void *userdata) {
+        NetlinkBatchRequest *req = userdata;
+
+        if (!req)
+                return;
+
+        free(req->description);
+        free(req);
+}
+
+static int netlink_batch_handler(sd_netlink *rtnl, sd_netlink_message *m, void *userdata) {
+        NetlinkBatchRequest *req = userdata;
+        int r;
+
+        assert(req);
+        assert(req->batch->n_pending > 0);
+
+        req->batch->n_pending--;
+
+        r = sd_netlink_message_get_errno(m);
+        if (r < 0) {
+                log_error_errno(r, "Failed to %s: %m", req->description);
+                if (req->batch->error == 0)
+                        req->batch->error = r;
+        }
+
+        return 0;
+}
+
+static int netlink_batch_add(NetlinkBatch *b, sd_netlink_message *m, const char *description) {
+        NetlinkBatchRequest *req;
+        int r;
+
+        assert(b);
+        assert(m);
+        assert(description);
+
+        req = new(NetlinkBatchRequest, 1);
+        if (!req)
+                return log_oom();
+
+        *req = (NetlinkBatchRequest) {
+                .batch = b,
+                .description = strdup(description),
+        };
+        if (!req->description) {
+                free(req);
+                return log_oom();
+        }
+
+        r = sd_netlink_call_async(b->rtnl, NULL, m, netlink_batch_handler, netlink_batch_request_free, req, 0, NULL);
+        if (r < 0) {
+                netlink_batch_request_free(req);
+                return log_error_errno(r, "Failed to send netlink request to %s: %m", description);
+        }
+
+        b->n_pending++;
+        return 0;
+}
+
+static int netlink_batch_wait(NetlinkBatch *b) {
+        int r;
+
+        assert(b);
+
+        /* Waits for the replies to all requests, returns the first error, which was logged already */
+
+        while (b->n_pending > 0) {
+                r = sd_netlink_process(b->rtnl, NULL);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to process netlink replies: %m");
+                if (r > 0)
+                        continue;
+
+                r = sd_netlink_wait(b->rtnl, (uint64_t) -1);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to wait for netlink replies: %m");
+        }
+
+        return b->error;
+}
+
 static int generate_mac(
                 const char *machine_name,
                 struct ether_addr *mac,
@@ -126,10 +222,9 @@ static int set_alternative_ifname(sd_netlink *rtnl, const char *ifname, const ch
 }
 
 static int add_veth(
-                sd_netlink *rtnl,
+                NetlinkBatch *b,
                 pid_t pid,
                 const char *ifname_host,
-                const char *altifname_host,
                 const struct ether_addr *mac_host,
                 const char *ifname_container,
                 const struct ether_addr *mac_container) {
@@ -137,13 +232,13 @@ static int add_veth(
         _cleanup_(sd_netlink_message_unrefp) sd_netlink_message *m = NULL;
         int r;
 
-        assert(rtnl);
+        assert(b);
         assert(ifname_host);
         assert(mac_host);
         assert(ifname_container);
         assert(mac_container);
 
-        r = sd_rtnl_message_new_link(rtnl, &m, RTM_NEWLINK, 0);
+        r = sd_rtnl_message_new_link(b->rtnl, &m, RTM_NEWLINK, 0);
         if (r < 0)
                 return log_error_errno(r, "Failed to allocate netlink message: %m");
 
@@ -191,13 +286,7 @@ static int add_veth(
         if (r < 0)
                 return log_error_errno(r, "Failed to close netlink container: %m");
 
-        r = sd_netlink_call(rtnl, m, 0, NULL);
-        if (r < 0)
-                return log_error_errno(r, "Failed to add new veth interfaces (%s:%s): %m", ifname_host, ifname_container);
-
-        (void) set_alternative_ifname(rtnl, ifname_host, altifname_host);
-
-        return 0;
+        return netlink_batch_add(b, m, strjoina("add new veth interfaces (", ifname_host, ":", ifname_container, ")"));
 }
 
 /* This is almost base64char(), but not entirely, as it uses the "url and filename safe" alphabet, since we
@@ -250,6 +339,7 @@ int setup_veth(const char *machine_name,
 
         _cleanup_(sd_netlink_unrefp) sd_netlink *rtnl = NULL;
         struct ether_addr mac_host, mac_container;
+        NetlinkBatch b = {};
         unsigned u;
         char *n, *a = NULL;
         int r;
@@ -277,10 +367,18 @@ int setup_veth(const char *machine_name,
         if (r < 0)
                 return log_error_errno(r, "Failed to connect to netlink: %m");
 
-        r = add_veth(rtnl, pid, n, a, &mac_host, "host0", &mac_container);
+        b.rtnl = rtnl;
+
+        r = add_veth(&b, pid, n, &mac_host, "host0", &mac_container);
+        if (r < 0)
+                return r;
+
+        r = netlink_batch_wait(&b);
         if (r < 0)
                 return r;
 
+        (void) set_alternative_ifname(rtnl, n, a);
+
         u = if_nametoindex(n); /* We don't need to use resolve_ifname() here because the
                                 * name we assigned is always the main name. */
         if (u == 0)
@@ -296,6 +394,7 @@ int setup_veth_extra(
                 char **pairs) {
 
         _cleanup_(sd_netlink_unrefp) sd_netlink *rtnl = NULL;
+        NetlinkBatch batch = {};
         uint64_t idx = 0;
         char **a, **b;
         int r;
@@ -310,6 +409,8 @@ int setup_veth_extra(
         if (r < 0)
                 return log_error_errno(r, "Failed to connect to netlink: %m");
 
+        batch.rtnl = rtnl;
+
         STRV_FOREACH_PAIR(a, b, pairs) {
                 struct ether_addr mac_host, mac_container;
 
@@ -321,14 +422,14 @@ int setup_veth_extra(
                 if (r < 0)
                         return log_error_errno(r, "Failed to generate predictable MAC address for host side of extra veth link: %m");
 
-                r = add_veth(rtnl, pid, *a, NULL, &mac_host, *b, &mac_container);
+                r = add_veth(&batch, pid, *a, &mac_host, *b, &mac_container);
                 if (r < 0)
                         return r;
 
                 idx++;
         }
 
-        return 0;
+        return netlink_batch_wait(&batch);
 }
 
 static int join_bridge(sd_netlink *rtnl, const char *veth_name, const char *bridge_name) {
@@ -510,6 +611,7 @@ int test_network_interface_initialized(const char *name) {
 
 int move_network_interfaces(int netns_fd, char **ifaces) {
         _cleanup_(sd_netlink_unrefp) sd_netlink *rtnl = NULL;
+        NetlinkBatch b = {};
         char **i;
         int r;
 
@@ -520,6 +622,8 @@ int move_network_interfaces(int netns_fd, char **ifaces) {
         if (r < 0)
                 return log_error_errno(r, "Failed to connect to netlink: %m");
 
+        b.rtnl = rtnl;
+
         STRV_FOREACH(i, ifaces) {
                 _cleanup_(sd_netlink_message_unrefp) sd_netlink_message *m = NULL;
                 int ifi;
@@ -536,18 +640,20 @@ int move_network_interfaces(int netns_fd, char **ifaces) {
                 if (r < 0)
                         return log_error_errno(r, "Failed to append namespace fd to netlink message: %m");
 
-                r = sd_netlink_call(rtnl, m, 0, NULL);
+                r = netlink_batch_add(&b, m, strjoina("move interface ", *i, " to namespace"));
                 if (r < 0)
-                        return log_error_errno(r, "Failed to move interface %s to namespace: %m", *i);
+                        return r;
         }
 
-        return 0;
+        return netlink_batch_wait(&b);
 }
 
 int setup_macvlan(const char *machine_name, pid_t pid, char **ifaces) {
         _cleanup_(sd_netlink_unrefp) sd_netlink *rtnl = NULL;
+        _cleanup_strv_free_ char **altnames = NULL;
+        NetlinkBatch b = {};
         unsigned idx = 0;
-        char **i;
+        char **i, **name, **altname;
         int r;
 
         if (strv_isempty(ifaces))
@@ -557,6 +663,8 @@ int setup_macvlan(const char *machine_name, pid_t pid, char **ifaces) {
         if (r < 0)
                 return log_error_errno(r, "Failed to connect to netlink: %m");
 
+        b.rtnl = rtnl;
+
         STRV_FOREACH(i, ifaces) {
                 _cleanup_(sd_netlink_message_unrefp) sd_netlink_message *m = NULL;
                 _cleanup_free_ char *n = NULL, *a = NULL;
@@ -622,19 +730,29 @@ int setup_macvlan(const char *machine_name, pid_t pid, char **ifaces) {
                 if (r < 0)
                         return log_error_errno(r, "Failed to close netlink container: %m");
 
-                r = sd_netlink_call(rtnl, m, 0, NULL);
+                r = netlink_batch_add(&b, m, "add new macvlan interfaces");
                 if (r < 0)
-                        return log_error_errno(r, "Failed to add new macvlan interfaces: %m");
+                        return r;
 
-                (void) set_alternative_ifname(rtnl, n, a);
+                if (a && strv_consume_pair(&altnames, TAKE_PTR(n), TAKE_PTR(a)) < 0)
+                        return log_oom();
         }
 
+        r = netlink_batch_wait(&b);
+        if (r < 0)
+                return r;
+
+        STRV_FOREACH_PAIR(name, altname, altnames)
+                (void) set_alternative_ifname(rtnl, *name, *altname);
+
         return 0;
 }
 
 int setup_ipvlan(const char *machine_name, pid_t pid, char **ifaces) {
         _cleanup_(sd_netlink_unrefp) sd_netlink *rtnl = NULL;
-        char **i;
+        _cleanup_strv_free_ char **altnames = NULL;
+        NetlinkBatch b = {};
+        char **i, **name, **altname;
         int r;
 
         if (strv_isempty(ifaces))
@@ -644,6 +762,8 @@ int setup_ipvlan(const char *machine_name, pid_t pid, char **ifaces) {
         if (r < 0)
                 return log_error_errno(r, "Failed to connect to netlink: %m");
 
+        b.rtnl = rtnl;
+
         STRV_FOREACH(i, ifaces) {
                 _cleanup_(sd_netlink_message_unrefp) sd_netlink_message *m = NULL;
                 _cleanup_free_ char *n = NULL, *a = NULL;
@@ -700,13 +820,21 @@ int setup_ipvlan(const char *machine_name, pid_t pid, char **ifaces) {
                 if (r < 0)
                         return log_error_errno(r, "Failed to close netlink container: %m");
 
-                r = sd_netlink_call(rtnl, m, 0, NULL);
+                r = netlink_batch_add(&b, m, "add new ipvlan interfaces");
                 if (r < 0)
-                        return log_error_errno(r, "Failed to add new ipvlan interfaces: %m");
+                        return r;
 
-                (void) set_alternative_ifname(rtnl, n, a);
+                if (a && strv_consume_pair(&altnames, TAKE_PTR(n), TAKE_PTR(a)) < 0)
+                        return log_oom();
         }
 
+        r = netlink_batch_wait(&b);
+        if (r < 0)
+                return r;
+
+        STRV_FOREACH_PAIR(name, altname, altnames)
+                (void) set_alternative_ifname(rtnl, *name, *altname);
+
         return 0;
 }
 
@@ -1,11 +1,16 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
 #include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/resource.h>
 #include <sys/statvfs.h>
 #include <sys/vfs.h>
+#include <sys/xattr.h>
 #include <unistd.h>
 
 #include "acl-util.h"
+#include "alloc-util.h"
 #include "dirent-util.h"
 #include "fd-util.h"
 #include "fileio.h"
@@ -19,6 +24,12 @@
 #include "strv.h"
 #include "user-util.h"
 
+/* How many directories may wait for a thread to pick them up, each holding an fd, and how many threads to use
+ * at most */
+#define PATCH_UID_QUEUE_MIN 64U
+#define PATCH_UID_QUEUE_MAX 1024U
+#define PATCH_UID_THREADS_MAX 16U
+
 #if HAVE_ACL
 
 static int get_acl(int fd, const char *name, acl_type_t type, acl_t *ret) {
@@ -50,6 +61,34 @@ static int get_acl(int fd, const char *name, acl_type_t type, acl_t *ret) {
         return 0;
 }
 
+static int has_acl(int fd, const char *name, acl_type_t type) {
+        char procfs_path[STRLEN("/proc/self/fd/") + DECIMAL_STR_MAX(int) + 1 + NAME_MAX + 1];
+        const char *xattr;
+        ssize_t l;
+
+        assert(fd >= 0);
+
+        /* Checks whether there's an extended ACL set on the inode at all. Without one, the access ACL is just the
+         * mode and there's no default ACL, hence nothing to shift. This is a lot cheaper than reading the ACL,
+         * which is synthesized from the mode in this case. */
+
+        xattr = type == ACL_TYPE_ACCESS ? "system.posix_acl_access" : "system.posix_acl_default";
+
+        if (name) {
+                xsprintf(procfs_path, "/proc/self/fd/%i/%s", fd, name);
+                l = lgetxattr(procfs_path, xattr, NULL, 0);
+        } else
+                l = fgetxattr(fd, xattr, NULL, 0);
+        if (l < 0) {
+                if (IN_SET(errno, ENODATA, EOPNOTSUPP))
+                        return 0;
+
+                return -errno;
+        }
+
+        return 1;
+}
+
 static int set_acl(int fd, const char *name, acl_type_t type, acl_t acl) {
         char procfs_path[STRLEN("/proc/self/fd/") + DECIMAL_STR_MAX(int) + 1];
         int r;
@@ -170,21 +209,26 @@ static int patch_acls(int fd, const char *name, const struct stat *st, uid_t shi
         if (S_ISLNK(st->st_mode))
                 return 0;
 
-        r = get_acl(fd, name, ACL_TYPE_ACCESS, &acl);
-        if (r == -EOPNOTSUPP)
-                return 0;
-        if (r < 0)
-                return r;
-
-        r = shift_acl(acl, shift, &shifted);
+        r = has_acl(fd, name, ACL_TYPE_ACCESS);
         if (r < 0)
                 return r;
         if (r > 0) {
-                r = set_acl(fd, name, ACL_TYPE_ACCESS, shifted);
+                r = get_acl(fd, name, ACL_TYPE_ACCESS, &acl);
+                if (r == -EOPNOTSUPP)
+                        return 0;
                 if (r < 0)
                         return r;
 
-                changed = true;
+                r = shift_acl(acl, shift, &shifted);
+                if (r < 0)
+                        return r;
+                if (r > 0) {
+                        r = set_acl(fd, name, ACL_TYPE_ACCESS, shifted);
+                        if (r < 0)
+                                return r;
+
+                        changed = true;
+                }
         }
 
         if (S_ISDIR(st->st_mode)) {
@@ -193,6 +237,10 @@ static int patch_acls(int fd, const char *name, const struct stat *st, uid_t shi
 
                 acl = shifted = NULL;
 
+                r = has_acl(fd, name, ACL_TYPE_DEFAULT);
+                if (r <= 0)
+                        return r < 0 ? r : changed;
+
                 r = get_acl(fd, name, ACL_TYPE_DEFAULT, &acl);
                 if (r < 0)
                         return r;
@@ -292,12 +340,223 @@ static int is_fs_fully_userns_compatible(const struct statfs *sfs) {
                F_TYPE_EQUAL(sfs->f_type, SYSFS_MAGIC);
 }
 
-static int recurse_fd(int fd, bool donate_fd, const struct stat *st, uid_t shift, bool is_toplevel) {
+typedef struct PatchUidDir {
+        int fd;
+        struct stat st;
+} PatchUidDir;
+
+typedef struct PatchUidWalker {
+        /* Protects everything below, and is signalled whenever the queue, the number of busy workers or the
+         * error changes */
+        pthread_mutex_t mutex;
+        pthread_cond_t cond;
+
+        /* Directories some worker may pick up. Each of them holds an fd, hence the queue is limited to the fd
+         * budget. Directories that don't fit are descended into by whoever found them. */
+        PatchUidDir queue[PATCH_UID_QUEUE_MAX];
+        size_t head, n_queued, queue_max;
+
+        unsigned n_busy;
+        int error;
+        bool changed;
+        bool finished;
+
+        uid_t shift;
+
+        pthread_t threads[PATCH_UID_THREADS_MAX];
+        size_t n_threads;
+} PatchUidWalker;
+
+static int recurse_fd(PatchUidWalker *w, int fd, bool donate_fd, const struct stat *st, bool is_toplevel);
+
+static void patch_uid_walker_lock(PatchUidWalker *w) {
+        assert_se(pthread_mutex_lock(&w->mutex) == 0);
+}
+
+static void patch_uid_walker_unlock(PatchUidWalker *w) {
+        assert_se(pthread_mutex_unlock(&w->mutex) == 0);
+}
+
+static bool patch_uid_walker_push(PatchUidWalker *w, int fd, const struct stat *st) {
+        bool queued = false;
+
+        assert(w);
+        assert(fd >= 0);
+        assert(st);
+
+        /* Returns true if the directory was queued and the fd taken over, false if the caller should descend
+         * into it itself */
+
+        if (w->n_threads == 0)
+                return false;
+
+        patch_uid_walker_lock(w);
+
+        if (w->n_queued < w->queue_max && w->error == 0) {
+                w->queue[(w->head + w->n_queued) % PATCH_UID_QUEUE_MAX] = (PatchUidDir) {
+                        .fd = fd,
+                        .st = *st,
+                };
+                w->n_queued++;
+                assert_se(pthread_cond_signal(&w->cond) == 0);
+                queued = true;
+        }
+
+        patch_uid_walker_unlock(w);
+
+        return queued;
+}
+
+static void patch_uid_walker_fail(PatchUidWalker *w, int error) {
+        assert(w);
+        assert(error < 0);
+
+        patch_uid_walker_lock(w);
+        if (w->error == 0)
+                w->error = error;
+        assert_se(pthread_cond_broadcast(&w->cond) == 0);
+        patch_uid_walker_unlock(w);
+}
+
+static void patch_uid_walker_run(PatchUidWalker *w) {
+        assert(w);
+
+        /* Processes queued directories until there are none left and nobody is busy anymore, so that no new
+         * ones can show up. The caller is counted as busy when it calls this. */
+
+        patch_uid_walker_lock(w);
+
+        for (;;) {
+                PatchUidDir dir;
+                int r;
+
+                w->n_busy--;
+
+                while (w->n_queued == 0 && w->n_busy > 0 && w->error == 0)
+                        assert_se(pthread_cond_wait(&w->cond, &w->mutex) == 0);
+
+                if (w->n_queued == 0 || w->error != 0) {
+                        /* Wake up everybody else, so that they notice too */
+                        assert_se(pthread_cond_broadcast(&w->cond) == 0);
+                        break;
+                }
+
+                dir = w->queue[w->head];
+                w->head = (w->head + 1) % PATCH_UID_QUEUE_MAX;
+                w->n_queued--;
+                w->n_busy++;
+
+                patch_uid_walker_unlock(w);
+
+                r = recurse_fd(w, dir.fd, true, &dir.st, false);
+
+                patch_uid_walker_lock(w);
+
+                if (r < 0) {
+                        if (w->error == 0)
+                                w->error = r;
+                } else if (r > 0)
+                        w->changed = true;
+        }
+
+        patch_uid_walker_unlock(w);
+}
+
+static void *patch_uid_thread(void *userdata) {
+        PatchUidWalker *w = userdata;
+
+        (void) pthread_setname_np(pthread_self(), "patch-uid");
+
+        patch_uid_walker_run(w);
+
+        return NULL;
+}
+
+static void patch_uid_walker_start(PatchUidWalker *w) {
+        sigset_t ss, saved_ss;
+        struct rlimit rl;
+        unsigned n;
+        long ncpus;
+        int r;
+
+        assert(w);
+
+        /* The walker itself counts as busy, until it's done with the top-level directory */
+        w->n_busy = 1;
+
+        ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+        if (ncpus <= 1)
+                return;
+
+        /* Leave most of the fds to the threads descending into directories themselves, and to everybody else. If
+         * that leaves too few to be worth it, stay single-threaded. */
+        w->queue_max = PATCH_UID_QUEUE_MAX;
+        if (getrlimit(RLIMIT_NOFILE, &rl) >= 0 && rl.rlim_cur != RLIM_INFINITY)
+                w->queue_max = MIN(w->queue_max, (size_t) rl.rlim_cur / 4);
+        if (w->queue_max < PATCH_UID_QUEUE_MIN)
+                return;
+
+        n = (unsigned) MIN(ncpus, (long) PATCH_UID_THREADS_MAX) - 1;
+
+        assert_se(sigfillset(&ss) >= 0);
+
+        r = pthread_sigmask(SIG_BLOCK, &ss, &saved_ss);
+        if (r > 0)
+                return;
+
+        patch_uid_walker_lock(w);
+
+        for (; w->n_threads < n; w->n_threads++) {
+                /* Each thread is busy until it finds the queue empty for the first time */
+                w->n_busy++;
+
+                r = pthread_create(w->threads + w->n_threads, NULL, patch_uid_thread, w);
+                if (r > 0) {
+                        /* Make do with whatever we got */
+                        w->n_busy--;
+                        break;
+                }
+        }
+
+        patch_uid_walker_unlock(w);
+
+        assert_se(pthread_sigmask(SIG_SETMASK, &saved_ss, NULL) == 0);
+}
+
+static int patch_uid_walker_finish(PatchUidWalker *w) {
+        size_t i;
+
+        assert(w);
+
+        /* Helps with the remaining work, then waits for the threads and returns the first error any of them
+         * ran into */
+
+        if (w->finished)
+                return w->error;
+
+        patch_uid_walker_run(w);
+
+        for (i = 0; i < w->n_threads; i++)
+                assert_se(pthread_join(w->threads[i], NULL) == 0);
+        w->n_threads = 0;
+
+        /* If we failed, there might be some directories left over */
+        for (i = 0; i < w->n_queued; i++)
+                safe_close(w->queue[(w->head + i) % PATCH_UID_QUEUE_MAX].fd);
+        w->n_queued = 0;
+
+        w->finished = true;
+
+        return w->error;
+}
+
+static int recurse_fd(PatchUidWalker *w, int fd, bool donate_fd, const struct stat *st, bool is_toplevel) {
         _cleanup_closedir_ DIR *d = NULL;
         bool changed = false;
         struct statfs sfs;
         int r;
 
+        assert(w);
         assert(fd >= 0);
 
         if (fstatfs(fd, &sfs) < 0)
@@ -363,14 +622,18 @@ static int recurse_fd(int fd, bool donate_fd, const struct stat *st, uid_t shift
 
                                 }
 
-                                r = recurse_fd(subdir_fd, true, &fst, shift, false);
+                                /* Leave the subtree to another thread if we can, otherwise descend ourselves */
+                                if (patch_uid_walker_push(w, subdir_fd, &fst))
+                                        continue;
+
+                                r = recurse_fd(w, subdir_fd, true, &fst, false);
                                 if (r < 0)
                                         goto finish;
                                 if (r > 0)
                                         changed = true;
 
                         } else {
-                                r = patch_fd(dirfd(d), de->d_name, &fst, shift);
+                                r = patch_fd(dirfd(d), de->d_name, &fst, w->shift);
                                 if (r < 0)
                                         goto finish;
                                 if (r > 0)
@@ -379,10 +642,20 @@ static int recurse_fd(int fd, bool donate_fd, const struct stat *st, uid_t shift
                 }
         }
 
+        /* Subtrees handed to other threads might still be in progress at this point. For the top-level directory
+         * wait for all of them to finish. */
+        if (is_toplevel) {
+                r = patch_uid_walker_finish(w);
+                if (r < 0)
+                        goto finish;
+                if (w->changed)
+                        changed = true;
+        }
+
         /* After we descended, also patch the directory itself. It's key to do this in this order so that the top-level
          * directory is patched as very last object in the tree, so that we can use it as quick indicator whether the
          * tree is properly chown()ed already. */
-        r = patch_fd(d ? dirfd(d) : fd, NULL, st, shift);
+        r = patch_fd(d ? dirfd(d) : fd, NULL, st, w->shift);
         if (r == -EROFS)
                 goto read_only;
         if (r > 0)
@@ -409,8 +682,9 @@ finish:
 }
 
 static int fd_patch_uid_internal(int fd, bool donate_fd, uid_t shift, uid_t range) {
+        PatchUidWalker w;
         struct stat st;
-        int r;
+        int r, k;
 
         assert(fd >= 0);
 
@@ -465,7 +739,28 @@ static int fd_patch_uid_internal(int fd, bool donate_fd, uid_t shift, uid_t rang
                 }
         }
 
-        return recurse_fd(fd, donate_fd, &st, shift, true);
+        w = (PatchUidWalker) {
+                .mutex = PTHREAD_MUTEX_INITIALIZER,
+                .cond = PTHREAD_COND_INITIALIZER,
+                .shift = shift,
+        };
+
+        /* Independent subtrees are patched on a number of threads at the same time */
+        patch_uid_walker_start(&w);
+
+        r = recurse_fd(&w, fd, donate_fd, &st, true);
+
+        /* In case we didn't get as far as waiting for the threads, make them give up and wait for them */
+        if (r < 0)
+                patch_uid_walker_fail(&w, r);
+        k = patch_uid_walker_finish(&w);
+        if (r >= 0 && k < 0)
+                r = k;
+
+        assert_se(pthread_mutex_destroy(&w.mutex) == 0);
+        assert_se(pthread_cond_destroy(&w.cond) == 0);
+
+        return r;
 
 finish:
         if (donate_fd)
@@ -131,6 +131,7 @@ static const char *arg_selinux_apifs_context = NULL;
 static char *arg_slice = NULL;
 static bool arg_private_network = false;
 static bool arg_read_only = false;
+static bool arg_share_image = false;
 static StartMode arg_start_mode = START_PID1;
 static bool arg_ephemeral = false;
 static LinkJournal arg_link_journal = LINK_AUTO;
@@ -611,6 +612,11 @@ static int parse_environment(void) {
         if (e)
                 arg_container_service_name = e;
 
+        r = getenv_bool("SYSTEMD_NSPAWN_SHARE_IMAGE");
+        if (r < 0 && r != -ENXIO)
+                return log_error_errno(r, "Failed to parse $SYSTEMD_NSPAWN_SHARE_IMAGE: %m");
+        arg_share_image = r > 0;
+
         return detect_unified_cgroup_hierarchy_from_environment();
 }
 
@@ -4415,6 +4421,9 @@ static int run_container(
         }
 
         if (arg_private_network) {
+                char timespan[FORMAT_TIMESPAN_MAX];
+                usec_t network_start;
+
                 if (!arg_network_namespace_path) {
                         /* Wait until the child has unshared its network namespace. */
                         if (!barrier_place_and_sync(&barrier)) /* #3 */
@@ -4429,6 +4438,8 @@ static int run_container(
                                 return log_error_errno(r, "Failed to open child network namespace: %m");
                 }
 
+                network_start = now(CLOCK_MONOTONIC);
+
                 r = move_network_interfaces(child_netns_fd, arg_network_interfaces);
                 if (r < 0)
                         return r;
@@ -4475,6 +4486,9 @@ static int run_container(
                 r = setup_ipvlan(arg_machine, *pid, arg_network_ipvlan);
                 if (r < 0)
                         return r;
+
+                log_debug("Network setup took %s.",
+                          format_timespan(timespan, sizeof(timespan), now(CLOCK_MONOTONIC) - network_start, USEC_PER_MSEC));
         }
 
         if (arg_register || !arg_keep_unit) {
@@ -5154,7 +5168,11 @@ static int run(int argc, char *argv[]) {
                         goto finish;
                 }
 
-                r = loop_device_make_by_path(arg_image, arg_read_only ? O_RDONLY : O_RDWR, LO_FLAGS_PARTSCAN, &loop);
+                /* Read-only loop devices may be shared with other containers running off the same image */
+                if (arg_share_image && arg_read_only)
+                        r = loop_device_make_by_path_shared(arg_image, LO_FLAGS_PARTSCAN, &loop);
+                else
+                        r = loop_device_make_by_path(arg_image, arg_read_only ? O_RDONLY : O_RDWR, LO_FLAGS_PARTSCAN, &loop);
                 if (r < 0) {
                         log_error_errno(r, "Failed to set up loopback block device: %m");
                         goto finish;
@@ -5164,7 +5182,7 @@ static int run(int argc, char *argv[]) {
                                 loop->fd,
                                 arg_image,
                                 arg_root_hash, arg_root_hash_size,
-                                DISSECT_IMAGE_REQUIRE_ROOT|DISSECT_IMAGE_RELAX_VAR_CHECK,
+                                DISSECT_IMAGE_REQUIRE_ROOT|DISSECT_IMAGE_RELAX_VAR_CHECK|DISSECT_IMAGE_CACHE,
                                 &dissected_image);
                 if (r == -ENOPKG) {
                         /* dissected_image_and_warn() already printed a brief error message. Extend on that with more details */
@@ -5182,7 +5200,9 @@ static int run(int argc, char *argv[]) {
                 if (!arg_root_hash && dissected_image->can_verity)
                         log_notice("Note: image %s contains verity information, but no root hash specified! Proceeding without integrity checking.", arg_image);
 
-                r = dissected_image_decrypt_interactively(dissected_image, NULL, arg_root_hash, arg_root_hash_size, 0, &decrypted_image);
+                r = dissected_image_decrypt_interactively(dissected_image, NULL, arg_root_hash, arg_root_hash_size,
+                                                          arg_share_image ? DISSECT_IMAGE_VERITY_SHARE : 0,
+                                                          &decrypted_image);
                 if (r < 0)
                         goto finish;
 
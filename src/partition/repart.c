@@ -39,6 +39,7 @@
 #include "parse-util.h"
 #include "path-util.h"
 #include "pretty-print.h"
+#include "pthread-util.h"
 #include "proc-cmdline.h"
 #include "sort-util.h"
 #include "stat-util.h"
@@ -53,6 +54,9 @@
  * sector size devices were generally assumed to have an even number of sectors, hence at the worst we'll
  * waste 3K per partition, which is probably fine. */
 
+/* Upper limit on the number of discard requests we issue concurrently */
+#define DISCARD_THREADS_MAX 16U
+
 static enum {
         EMPTY_REFUSE,   /* refuse empty disks, never create a partition table */
         EMPTY_ALLOW,    /* allow empty disks, create partition table if necessary */
@@ -1943,41 +1947,43 @@ static int context_discard_range(Context *context, uint64_t offset, uint64_t siz
         return -EOPNOTSUPP;
 }
 
-static int context_discard_partition(Context *context, Partition *p) {
-        int r;
+typedef struct DiscardRange {
+        Partition *partition; /* The partition to discard, or the one preceding the gap, NULL for the first gap */
+        bool gap;
+        uint64_t offset;
+        uint64_t size;
+        int result;           /* As returned by context_discard_range() */
+} DiscardRange;
 
-        assert(context);
-        assert(p);
+typedef struct DiscardQueue {
+        Context *context;
+        DiscardRange *ranges;
+        size_t n_ranges, n_allocated;
+        size_t next_range;
+} DiscardQueue;
 
-        assert(p->offset != UINT64_MAX);
-        assert(p->new_size != UINT64_MAX);
-        assert(!PARTITION_EXISTS(p)); /* Safety check: never discard existing partitions */
+static int discard_queue_add(DiscardQueue *q, Partition *p, bool gap, uint64_t offset, uint64_t size) {
+        assert(q);
 
-        if (!arg_discard)
-                return 0;
+        if (!GREEDY_REALLOC(q->ranges, q->n_allocated, q->n_ranges + 1))
+                return log_oom();
 
-        r = context_discard_range(context, p->offset, p->new_size);
-        if (r == -EOPNOTSUPP) {
-                log_info("Storage does not support discarding, not discarding data in new partition %" PRIu64 ".", p->partno);
-                return 0;
-        }
-        if (r == 0) {
-                log_info("Partition %" PRIu64 " too short for discard, skipping.", p->partno);
-                return 0;
-        }
-        if (r < 0)
-                return log_error_errno(r, "Failed to discard data for new partition %" PRIu64 ".", p->partno);
+        q->ranges[q->n_ranges++] = (DiscardRange) {
+                .partition = p,
+                .gap = gap,
+                .offset = offset,
+                .size = size,
+        };
 
-        log_info("Successfully discarded data from partition %" PRIu64 ".", p->partno);
-        return 1;
+        return 0;
 }
 
-static int context_discard_gap_after(Context *context, Partition *p) {
+static int context_queue_discard_gap_after(Context *context, DiscardQueue *queue, Partition *p) {
         uint64_t gap, next = UINT64_MAX;
         Partition *q;
-        int r;
 
         assert(context);
+        assert(queue);
         assert(!p || (p->offset != UINT64_MAX && p->new_size != UINT64_MAX));
 
         if (p)
@@ -2006,7 +2012,64 @@ static int context_discard_gap_after(Context *context, Partition *p) {
         }
 
         assert(next >= gap);
-        r = context_discard_range(context, gap, next - gap);
+        return discard_queue_add(queue, p, true, gap, next - gap);
+}
+
+static void *discard_thread(void *userdata) {
+        DiscardQueue *q = userdata;
+
+        for (;;) {
+                DiscardRange *d;
+                size_t i;
+
+                i = __sync_fetch_and_add(&q->next_range, 1);
+                if (i >= q->n_ranges)
+                        break;
+
+                d = q->ranges + i;
+                d->result = context_discard_range(q->context, d->offset, d->size);
+        }
+
+        return NULL;
+}
+
+static void discard_queue_run(DiscardQueue *q) {
+        assert(q);
+
+        /* Discarding may take a while on some storage, and every BLKDISCARD waits for its range to complete,
+         * hence issue the discards for the different ranges concurrently. */
+
+        if (q->n_ranges == 0)
+                return;
+
+        run_parallel(MIN(DISCARD_THREADS_MAX, q->n_ranges - 1) + 1, discard_thread, q);
+}
+
+static int discard_range_log(const DiscardRange *d) {
+        Partition *p;
+        int r;
+
+        assert(d);
+
+        p = d->partition;
+        r = d->result;
+
+        if (!d->gap) {
+                if (r == -EOPNOTSUPP) {
+                        log_info("Storage does not support discarding, not discarding data in new partition %" PRIu64 ".", p->partno);
+                        return 0;
+                }
+                if (r == 0) {
+                        log_info("Partition %" PRIu64 " too short for discard, skipping.", p->partno);
+                        return 0;
+                }
+                if (r < 0)
+                        return log_error_errno(r, "Failed to discard data for new partition %" PRIu64 ".", p->partno);
+
+                log_info("Successfully discarded data from partition %" PRIu64 ".", p->partno);
+                return 0;
+        }
+
         if (r == -EOPNOTSUPP) {
                 if (p)
                         log_info("Storage does not support discarding, not discarding gap after partition %" PRIu64 ".", p->partno);
@@ -2031,40 +2094,93 @@ static int context_discard_gap_after(Context *context, Partition *p) {
         return 0;
 }
 
-static int context_wipe_and_discard(Context *context, bool from_scratch) {
+static int context_discard(Context *context) {
+        DiscardQueue queue = {
+                .context = context,
+        };
+        char buf[FORMAT_BYTES_MAX], buf2[FORMAT_TIMESPAN_MAX];
+        uint64_t total = 0;
+        usec_t begin, t;
         Partition *p;
-        int r;
+        size_t i;
+        int r = 0;
 
         assert(context);
 
-        /* Wipe and discard the contents of all partitions we are about to create. We skip the discarding if
-         * we were supposed to start from scratch anyway, as in that case we just discard the whole block
-         * device in one go early on. */
+        /* Collect the data of all partitions we are about to create and the gaps between them first, and
+         * then discard them all in parallel. */
 
         LIST_FOREACH(partitions, p, context->partitions) {
 
                 if (!p->allocated_to_area)
                         continue;
 
-                if (!from_scratch) {
-                        r = context_discard_partition(context, p);
+                assert(p->offset != UINT64_MAX);
+                assert(p->new_size != UINT64_MAX);
+                assert(!PARTITION_EXISTS(p)); /* Safety check: never discard existing partitions */
+
+                if (arg_discard) {
+                        r = discard_queue_add(&queue, p, false, p->offset, p->new_size);
                         if (r < 0)
-                                return r;
+                                goto finish;
                 }
 
-                r = context_wipe_partition(context, p);
+                r = context_queue_discard_gap_after(context, &queue, p);
                 if (r < 0)
-                        return r;
+                        goto finish;
+        }
 
-                if (!from_scratch) {
-                        r = context_discard_gap_after(context, p);
-                        if (r < 0)
-                                return r;
-                }
+        r = context_queue_discard_gap_after(context, &queue, NULL);
+        if (r < 0)
+                goto finish;
+
+        begin = now(CLOCK_MONOTONIC);
+        discard_queue_run(&queue);
+        t = usec_sub_unsigned(now(CLOCK_MONOTONIC), begin);
+
+        for (i = 0; i < queue.n_ranges; i++) {
+                r = discard_range_log(queue.ranges + i);
+                if (r < 0)
+                        goto finish;
+
+                if (queue.ranges[i].result > 0)
+                        total += queue.ranges[i].size;
         }
 
+        if (total > 0)
+                log_info("Discarded %s in %s.",
+                         format_bytes(buf, sizeof(buf), total),
+                         format_timespan(buf2, sizeof(buf2), t, USEC_PER_MSEC));
+
+        r = 0;
+
+finish:
+        free(queue.ranges);
+        return r;
+}
+
+static int context_wipe_and_discard(Context *context, bool from_scratch) {
+        Partition *p;
+        int r;
+
+        assert(context);
+
+        /* Wipe and discard the contents of all partitions we are about to create. We skip the discarding if
+         * we were supposed to start from scratch anyway, as in that case we just discard the whole block
+         * device in one go early on. */
+
         if (!from_scratch) {
-                r = context_discard_gap_after(context, NULL);
+                r = context_discard(context);
+                if (r < 0)
+                        return r;
+        }
+
+        LIST_FOREACH(partitions, p, context->partitions) {
+
+                if (!p->allocated_to_area)
+                        continue;
+
+                r = context_wipe_partition(context, p);
                 if (r < 0)
                         return r;
         }
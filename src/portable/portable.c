@@ -9,6 +9,7 @@
 #include "def.h"
 #include "dirent-util.h"
 #include "dissect-image.h"
+#include "env-util.h"
 #include "fd-util.h"
 #include "fileio.h"
 #include "fs-util.h"
@@ -17,6 +18,7 @@
 #include "locale-util.h"
 #include "loop-util.h"
 #include "machine-image.h"
+#include "memory-util.h"
 #include "mkdir.h"
 #include "nulstr-util.h"
 #include "os-util.h"
@@ -224,6 +226,303 @@ static int recv_item(
 DEFINE_PRIVATE_HASH_OPS_WITH_VALUE_DESTRUCTOR(portable_metadata_hash_ops, char, string_hash_func, string_compare_func,
                                               PortableMetadata, portable_metadata_unref);
 
+/* For how many raw images we remember the extracted metadata at most, see portable_metadata_cache_set_size() */
+#define METADATA_CACHE_MAX 256U
+
+/* The contents of one metadata file, as extracted from a raw image. We keep the contents rather than the fds
+ * we received, so that each user gets a file descriptor of its own, with its own file offset. */
+typedef struct CachedItem {
+        char *data;
+        size_t size;
+        char name[];
+} CachedItem;
+
+/* All metadata extracted from a raw image, unfiltered, and the identity of the image file and root hash it
+ * was extracted with. If the image file is replaced or modified, or the root hash changes, the entry is out of
+ * date and is dropped. */
+struct PortableCachedImage {
+        char *path;
+        dev_t dev;
+        ino_t ino;
+        struct timespec mtime;
+        off_t size;
+        void *root_hash;
+        size_t root_hash_size;
+
+        CachedItem *os_release;
+        Hashmap *unit_files;
+};
+
+static Hashmap *metadata_cache = NULL;
+static unsigned metadata_cache_size = 0;
+
+static CachedItem *cached_item_free(CachedItem *i) {
+        if (!i)
+                return NULL;
+
+        free(i->data);
+        return mfree(i);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(CachedItem*, cached_item_free);
+DEFINE_PRIVATE_HASH_OPS_WITH_VALUE_DESTRUCTOR(cached_item_hash_ops, char, string_hash_func, string_compare_func,
+                                              CachedItem, cached_item_free);
+
+int portable_cached_image_new(PortableCachedImage **ret) {
+        _cleanup_(portable_cached_image_freep) PortableCachedImage *c = NULL;
+
+        assert(ret);
+
+        c = new0(PortableCachedImage, 1);
+        if (!c)
+                return -ENOMEM;
+
+        c->unit_files = hashmap_new(&cached_item_hash_ops);
+        if (!c->unit_files)
+                return -ENOMEM;
+
+        *ret = TAKE_PTR(c);
+        return 0;
+}
+
+PortableCachedImage *portable_cached_image_free(PortableCachedImage *c) {
+        if (!c)
+                return NULL;
+
+        free(c->path);
+        free(c->root_hash);
+        cached_item_free(c->os_release);
+        hashmap_free(c->unit_files);
+
+        return mfree(c);
+}
+
+DEFINE_PRIVATE_HASH_OPS_WITH_VALUE_DESTRUCTOR(cached_image_hash_ops, char, string_hash_func, string_compare_func,
+                                              PortableCachedImage, portable_cached_image_free);
+
+int portable_cached_image_add(PortableCachedImage *c, const char *name, int *fd) {
+        _cleanup_(cached_item_freep) CachedItem *i = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+        int r;
+
+        assert(c);
+        assert(name);
+        assert(fd);
+
+        /* Reads the metadata file, and takes possession of the fd */
+
+        f = take_fdopen(fd, "r");
+        if (!f)
+                return -errno;
+
+        i = malloc0(offsetof(CachedItem, name) + strlen(name) + 1);
+        if (!i)
+                return -ENOMEM;
+
+        strcpy(i->name, name);
+
+        r = read_full_stream(f, &i->data, &i->size);
+        if (r < 0)
+                return r;
+
+        if (PORTABLE_METADATA_IS_UNIT(i)) {
+                r = hashmap_put(c->unit_files, i->name, i);
+                if (r < 0)
+                        return r;
+
+                TAKE_PTR(i);
+        } else if (PORTABLE_METADATA_IS_OS_RELEASE(i)) {
+                if (c->os_release)
+                        return -EEXIST;
+
+                c->os_release = TAKE_PTR(i);
+        } else
+                return -EINVAL;
+
+        return 0;
+}
+
+static int cached_item_to_metadata(const CachedItem *i, PortableMetadata **ret) {
+        PortableMetadata *m;
+        int fd;
+
+        assert(i);
+        assert(ret);
+
+        fd = acquire_data_fd(i->data, i->size, 0);
+        if (fd < 0)
+                return fd;
+
+        m = portable_metadata_new(i->name, fd);
+        if (!m) {
+                safe_close(fd);
+                return -ENOMEM;
+        }
+
+        *ret = m;
+        return 0;
+}
+
+int portable_cached_image_to_metadata(
+                const PortableCachedImage *c,
+                char **matches,
+                PortableMetadata **ret_os_release,
+                Hashmap **ret_unit_files) {
+
+        _cleanup_hashmap_free_ Hashmap *unit_files = NULL;
+        _cleanup_(portable_metadata_unrefp) PortableMetadata *os_release = NULL;
+        CachedItem *i;
+        Iterator iterator;
+        int r;
+
+        assert(c);
+        assert(ret_os_release);
+        assert(ret_unit_files);
+
+        if (c->os_release) {
+                r = cached_item_to_metadata(c->os_release, &os_release);
+                if (r < 0)
+                        return r;
+        }
+
+        unit_files = hashmap_new(&portable_metadata_hash_ops);
+        if (!unit_files)
+                return -ENOMEM;
+
+        HASHMAP_FOREACH(i, c->unit_files, iterator) {
+                _cleanup_(portable_metadata_unrefp) PortableMetadata *m = NULL;
+
+                if (!unit_match(i->name, matches))
+                        continue;
+
+                r = cached_item_to_metadata(i, &m);
+                if (r < 0)
+                        return r;
+
+                r = hashmap_put(unit_files, m->name, m);
+                if (r < 0)
+                        return r;
+                TAKE_PTR(m);
+        }
+
+        *ret_os_release = TAKE_PTR(os_release);
+        *ret_unit_files = TAKE_PTR(unit_files);
+
+        return 0;
+}
+
+static bool cached_image_is_current(
+                const PortableCachedImage *c,
+                const struct stat *st,
+                const void *root_hash,
+                size_t root_hash_size) {
+
+        assert(c);
+        assert(st);
+
+        return c->dev == st->st_dev &&
+                c->ino == st->st_ino &&
+                c->size == st->st_size &&
+                c->mtime.tv_sec == st->st_mtim.tv_sec &&
+                c->mtime.tv_nsec == st->st_mtim.tv_nsec &&
+                memcmp_nn(c->root_hash, c->root_hash_size, root_hash, root_hash_size) == 0;
+}
+
+PortableCachedImage *portable_metadata_cache_get(
+                const char *path,
+                const struct stat *st,
+                const void *root_hash,
+                size_t root_hash_size) {
+
+        PortableCachedImage *c;
+
+        assert(path);
+        assert(st);
+
+        c = hashmap_get(metadata_cache, path);
+        if (!c)
+                return NULL;
+
+        if (!cached_image_is_current(c, st, root_hash, root_hash_size)) {
+                log_debug("Image '%s' or its root hash changed, dropping cached metadata.", path);
+                portable_cached_image_free(hashmap_remove(metadata_cache, path));
+                return NULL;
+        }
+
+        return c;
+}
+
+void portable_metadata_cache_put(
+                PortableCachedImage *c,
+                const char *path,
+                const struct stat *st,
+                const void *root_hash,
+                size_t root_hash_size) {
+
+        int r;
+
+        assert(c);
+        assert(path);
+        assert(st);
+
+        /* Takes possession of the entry in any case */
+
+        if (metadata_cache_size == 0) {
+                portable_cached_image_free(c);
+                return;
+        }
+
+        c->path = strdup(path);
+        if (!c->path) {
+                r = -ENOMEM;
+                goto fail;
+        }
+
+        if (root_hash_size > 0) {
+                c->root_hash = memdup(root_hash, root_hash_size);
+                if (!c->root_hash) {
+                        r = -ENOMEM;
+                        goto fail;
+                }
+        }
+
+        c->root_hash_size = root_hash_size;
+        c->dev = st->st_dev;
+        c->ino = st->st_ino;
+        c->size = st->st_size;
+        c->mtime = st->st_mtim;
+
+        portable_cached_image_free(hashmap_remove(metadata_cache, c->path));
+
+        /* Make room by dropping an arbitrary entry, images are rarely switched that often */
+        if (hashmap_size(metadata_cache) >= metadata_cache_size)
+                portable_cached_image_free(hashmap_steal_first(metadata_cache));
+
+        r = hashmap_ensure_allocated(&metadata_cache, &cached_image_hash_ops);
+        if (r >= 0)
+                r = hashmap_put(metadata_cache, c->path, c);
+        if (r >= 0)
+                return;
+
+fail:
+        log_debug_errno(r, "Failed to cache metadata of image '%s', ignoring: %m", path);
+        portable_cached_image_free(c);
+}
+
+void portable_metadata_cache_set_size(unsigned n) {
+
+        /* Long-running users that extract metadata from the same raw images regularly may ask us to remember
+         * the metadata of up to n images, instead of mounting them again each time. Set to 0 to flush. */
+
+        metadata_cache_size = MIN(n, METADATA_CACHE_MAX);
+
+        while (hashmap_size(metadata_cache) > metadata_cache_size)
+                portable_cached_image_free(hashmap_steal_first(metadata_cache));
+
+        if (metadata_cache_size == 0)
+                metadata_cache = hashmap_free(metadata_cache);
+}
+
 static int extract_now(
                 const char *where,
                 char **matches,
@@ -347,6 +646,18 @@ static int extract_now(
         return 0;
 }
 
+static int metadata_check(const char *path, PortableMetadata *os_release, Hashmap *unit_files, sd_bus_error *error) {
+        assert(path);
+
+        if (!os_release)
+                return sd_bus_error_setf(error, SD_BUS_ERROR_INVALID_ARGS, "Image '%s' lacks os-release data, refusing.", path);
+
+        if (hashmap_isempty(unit_files))
+                return sd_bus_error_setf(error, SD_BUS_ERROR_INVALID_ARGS, "Couldn't find any matching unit files in image '%s', refusing.", path);
+
+        return 0;
+}
+
 static int portable_extract_by_path(
                 const char *path,
                 char **matches,
@@ -357,11 +668,59 @@ static int portable_extract_by_path(
         _cleanup_hashmap_free_ Hashmap *unit_files = NULL;
         _cleanup_(portable_metadata_unrefp) PortableMetadata* os_release = NULL;
         _cleanup_(loop_device_unrefp) LoopDevice *d = NULL;
+        _cleanup_free_ void *root_hash = NULL;
+        size_t root_hash_size = 0;
+        bool cacheable, share;
+        struct stat st;
         int r;
 
         assert(path);
 
-        r = loop_device_make_by_path(path, O_RDONLY, LO_FLAGS_PARTSCAN, &d);
+        /* A root hash that can't be read or parsed is no reason to refuse looking into the image, it just
+         * can't be verified then */
+        r = root_hash_load(path, &root_hash, &root_hash_size);
+        if (r < 0) {
+                log_debug_errno(r, "Failed to load root hash of image '%s', ignoring: %m", path);
+                root_hash = mfree(root_hash);
+                root_hash_size = 0;
+        }
+
+        /* Looking into a raw image means setting it up, dissecting and mounting it, hence check first if we
+         * looked into the same image with the same root hash before */
+        cacheable = metadata_cache_size > 0 && stat(path, &st) >= 0 && S_ISREG(st.st_mode);
+        if (cacheable) {
+                PortableCachedImage *c;
+
+                c = portable_metadata_cache_get(path, &st, root_hash, root_hash_size);
+                if (c) {
+                        log_debug("Using cached metadata of image '%s'.", path);
+
+                        r = portable_cached_image_to_metadata(c, matches, &os_release, &unit_files);
+                        if (r < 0)
+                                return r;
+
+                        r = metadata_check(path, os_release, unit_files, error);
+                        if (r < 0)
+                                return r;
+
+                        if (ret_unit_files)
+                                *ret_unit_files = TAKE_PTR(unit_files);
+                        if (ret_os_release)
+                                *ret_os_release = TAKE_PTR(os_release);
+
+                        return 0;
+                }
+        }
+
+        r = getenv_bool("SYSTEMD_PORTABLE_SHARE_IMAGE");
+        if (r < 0 && r != -ENXIO)
+                log_debug_errno(r, "Failed to parse $SYSTEMD_PORTABLE_SHARE_IMAGE, ignoring: %m");
+        share = r > 0;
+
+        if (share)
+                r = loop_device_make_by_path_shared(path, LO_FLAGS_PARTSCAN, &d);
+        else
+                r = loop_device_make_by_path(path, O_RDONLY, LO_FLAGS_PARTSCAN, &d);
         if (r == -EISDIR) {
                 /* We can't turn this into a loop-back block device, and this returns EISDIR? Then this is a directory
                  * tree and not a raw device. It's easy then. */
@@ -374,6 +733,8 @@ static int portable_extract_by_path(
                 return log_debug_errno(r, "Failed to set up loopback device: %m");
         else {
                 _cleanup_(dissected_image_unrefp) DissectedImage *m = NULL;
+                _cleanup_(decrypted_image_unrefp) DecryptedImage *di = NULL;
+                _cleanup_(portable_cached_image_freep) PortableCachedImage *c = NULL;
                 _cleanup_(rmdir_and_freep) char *tmpdir = NULL;
                 _cleanup_(close_pairp) int seq[2] = { -1, -1 };
                 _cleanup_(sigkill_waitp) pid_t child = 0;
@@ -387,7 +748,7 @@ static int portable_extract_by_path(
                 if (r < 0)
                         return log_debug_errno(r, "Failed to create temporary directory: %m");
 
-                r = dissect_image(d->fd, NULL, 0, DISSECT_IMAGE_READ_ONLY|DISSECT_IMAGE_REQUIRE_ROOT|DISSECT_IMAGE_DISCARD_ON_LOOP|DISSECT_IMAGE_RELAX_VAR_CHECK, &m);
+                r = dissect_image(d->fd, root_hash, root_hash_size, DISSECT_IMAGE_READ_ONLY|DISSECT_IMAGE_REQUIRE_ROOT|DISSECT_IMAGE_DISCARD_ON_LOOP|DISSECT_IMAGE_RELAX_VAR_CHECK|DISSECT_IMAGE_CACHE, &m);
                 if (r == -ENOPKG)
                         sd_bus_error_setf(error, SD_BUS_ERROR_INVALID_ARGS, "Couldn't identify a suitable partition table or file system in '%s'.", path);
                 else if (r == -EADDRNOTAVAIL)
@@ -401,6 +762,15 @@ static int portable_extract_by_path(
                 if (r < 0)
                         return r;
 
+                if (m->verity) {
+                        /* When sharing images, name the verity device after the root hash and reuse it if it
+                         * exists already, so that the root hash doesn't need to be verified again each time */
+                        r = dissected_image_decrypt(m, NULL, root_hash, root_hash_size,
+                                                    share ? DISSECT_IMAGE_VERITY_SHARE : 0, &di);
+                        if (r < 0)
+                                return log_debug_errno(r, "Failed to set up verity for image '%s': %m", path);
+                }
+
                 if (socketpair(AF_UNIX, SOCK_SEQPACKET|SOCK_CLOEXEC, 0, seq) < 0)
                         return log_debug_errno(errno, "Failed to allocated SOCK_SEQPACKET socket: %m");
 
@@ -416,7 +786,9 @@ static int portable_extract_by_path(
                                 goto child_finish;
                         }
 
-                        r = extract_now(tmpdir, matches, seq[1], NULL, NULL);
+                        /* Extract all unit files, the parent filters them, so that what we find may be cached
+                         * regardless of the matches */
+                        r = extract_now(tmpdir, NULL, seq[1], NULL, NULL);
 
                 child_finish:
                         _exit(r < 0 ? EXIT_FAILURE : EXIT_SUCCESS);
@@ -424,12 +796,11 @@ static int portable_extract_by_path(
 
                 seq[1] = safe_close(seq[1]);
 
-                unit_files = hashmap_new(&portable_metadata_hash_ops);
-                if (!unit_files)
-                        return -ENOMEM;
+                r = portable_cached_image_new(&c);
+                if (r < 0)
+                        return r;
 
                 for (;;) {
-                        _cleanup_(portable_metadata_unrefp) PortableMetadata *add = NULL;
                         _cleanup_free_ char *name = NULL;
                         _cleanup_close_ int fd = -1;
 
@@ -447,41 +818,31 @@ static int portable_extract_by_path(
                                 return -EINVAL;
                         }
 
-                        add = portable_metadata_new(name, fd);
-                        if (!add)
-                                return -ENOMEM;
-                        fd = -1;
-
-                        /* Note that we do not initialize 'add->source' here, as the source path is not usable here as
-                         * it refers to a path only valid in the short-living namespaced child process we forked
-                         * here. */
+                        /* Note that we do not initialize the source path of the metadata here, as the source path is
+                         * not usable here as it refers to a path only valid in the short-living namespaced child
+                         * process we forked here. */
 
-                        if (PORTABLE_METADATA_IS_UNIT(add)) {
-                                r = hashmap_put(unit_files, add->name, add);
-                                if (r < 0)
-                                        return log_debug_errno(r, "Failed to add item to unit file list: %m");
-
-                                add = NULL;
-
-                        } else if (PORTABLE_METADATA_IS_OS_RELEASE(add)) {
-
-                                assert(!os_release);
-                                os_release = TAKE_PTR(add);
-                        } else
-                                assert_not_reached("Unexpected metadata item from child.");
+                        r = portable_cached_image_add(c, name, &fd);
+                        if (r < 0)
+                                return log_debug_errno(r, "Failed to add item '%s': %m", name);
                 }
 
                 r = wait_for_terminate_and_check("(sd-dissect)", child, 0);
                 if (r < 0)
                         return r;
                 child = 0;
-        }
 
-        if (!os_release)
-                return sd_bus_error_setf(error, SD_BUS_ERROR_INVALID_ARGS, "Image '%s' lacks os-release data, refusing.", path);
+                r = portable_cached_image_to_metadata(c, matches, &os_release, &unit_files);
+                if (r < 0)
+                        return r;
 
-        if (hashmap_isempty(unit_files))
-                return sd_bus_error_setf(error, SD_BUS_ERROR_INVALID_ARGS, "Couldn't find any matching unit files in image '%s', refusing.", path);
+                if (cacheable)
+                        portable_metadata_cache_put(TAKE_PTR(c), path, &st, root_hash, root_hash_size);
+        }
+
+        r = metadata_check(path, os_release, unit_files, error);
+        if (r < 0)
+                return r;
 
         if (ret_unit_files)
                 *ret_unit_files = TAKE_PTR(unit_files);
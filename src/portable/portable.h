@@ -1,6 +1,8 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 #pragma once
 
+#include <sys/stat.h>
+
 #include "sd-bus.h"
 
 #include "hashmap.h"
@@ -56,6 +58,24 @@ DEFINE_TRIVIAL_CLEANUP_FUNC(PortableMetadata*, portable_metadata_unref);
 
 int portable_metadata_hashmap_to_sorted_array(Hashmap *unit_files, PortableMetadata ***ret);
 
+/* Cache size for long-running services that extract metadata from the same raw images regularly */
+#define PORTABLE_METADATA_CACHE_SIZE_DEFAULT 64U
+
+void portable_metadata_cache_set_size(unsigned n);
+
+/* The cached metadata of one raw image, only exported for the tests */
+typedef struct PortableCachedImage PortableCachedImage;
+
+int portable_cached_image_new(PortableCachedImage **ret);
+PortableCachedImage *portable_cached_image_free(PortableCachedImage *c);
+DEFINE_TRIVIAL_CLEANUP_FUNC(PortableCachedImage*, portable_cached_image_free);
+
+int portable_cached_image_add(PortableCachedImage *c, const char *name, int *fd);
+int portable_cached_image_to_metadata(const PortableCachedImage *c, char **matches, PortableMetadata **ret_os_release, Hashmap **ret_unit_files);
+
+PortableCachedImage *portable_metadata_cache_get(const char *path, const struct stat *st, const void *root_hash, size_t root_hash_size);
+void portable_metadata_cache_put(PortableCachedImage *c, const char *path, const struct stat *st, const void *root_hash, size_t root_hash_size);
+
 int portable_extract(const char *image, char **matches, PortableMetadata **ret_os_release, Hashmap **ret_unit_files, sd_bus_error *error);
 
 int portable_attach(sd_bus *bus, const char *name_or_path, char **matches, const char *profile, PortableFlags flags, PortableChange **changes, size_t *n_changes, sd_bus_error *error);
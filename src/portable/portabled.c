@@ -10,7 +10,9 @@
 #include "bus-log-control-api.h"
 #include "bus-polkit.h"
 #include "def.h"
+#include "loop-util.h"
 #include "main-func.h"
+#include "portable.h"
 #include "portabled-bus.h"
 #include "portabled-image-bus.h"
 #include "portabled.h"
@@ -44,6 +46,12 @@ static int manager_new(Manager **ret) {
 
         (void) sd_event_set_watchdog(m->event, true);
 
+        /* Raw images are attached for each inspection, recycle their loop devices */
+        loop_device_pool_set_size(LOOP_DEVICE_POOL_SIZE_DEFAULT);
+
+        /* The same images are inspected and attached over and over, remember what we found in them */
+        portable_metadata_cache_set_size(PORTABLE_METADATA_CACHE_SIZE_DEFAULT);
+
         *ret = TAKE_PTR(m);
         return 0;
 }
@@ -60,6 +68,9 @@ static Manager* manager_unref(Manager *m) {
         sd_bus_flush_close_unref(m->bus);
         sd_event_unref(m->event);
 
+        loop_device_pool_set_size(0);
+        portable_metadata_cache_set_size(0);
+
         return mfree(m);
 }
 
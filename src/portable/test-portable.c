@@ -0,0 +1,165 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "fd-util.h"
+#include "fileio.h"
+#include "fs-util.h"
+#include "portable.h"
+#include "string-util.h"
+#include "strv.h"
+#include "tests.h"
+#include "tmpfile-util.h"
+
+static void add_item(PortableCachedImage *c, const char *name, const char *contents) {
+        int fd;
+
+        assert_se((fd = acquire_data_fd(contents, strlen(contents), 0)) >= 0);
+        assert_se(portable_cached_image_add(c, name, &fd) >= 0);
+        assert_se(fd < 0);
+}
+
+static PortableCachedImage *make_image(void) {
+        PortableCachedImage *c;
+
+        assert_se(portable_cached_image_new(&c) >= 0);
+
+        add_item(c, "/etc/os-release", "ID=test\n");
+        add_item(c, "foo.service", "[Service]\nExecStart=/bin/foo\n");
+        add_item(c, "foo-bar.socket", "[Socket]\n");
+        add_item(c, "foobar.service", "[Service]\nExecStart=/bin/foobar\n");
+        add_item(c, "other.timer", "[Timer]\n");
+
+        return c;
+}
+
+static void check_item(PortableMetadata *m, const char *contents) {
+        _cleanup_fclose_ FILE *f = NULL;
+        _cleanup_free_ char *data = NULL;
+
+        assert_se(m);
+
+        assert_se(f = fdopen(fcntl(m->fd, F_DUPFD_CLOEXEC, 3), "r"));
+        assert_se(read_full_stream(f, &data, NULL) >= 0);
+        assert_se(streq(data, contents));
+}
+
+static void test_cached_image(void) {
+        _cleanup_(portable_cached_image_freep) PortableCachedImage *c = NULL;
+        _cleanup_(portable_metadata_unrefp) PortableMetadata *os_release = NULL;
+        _cleanup_hashmap_free_ Hashmap *unit_files = NULL;
+        int fd;
+
+        log_info("/* %s */", __func__);
+
+        c = make_image();
+
+        /* Only one os-release, and nothing else but units */
+        assert_se((fd = acquire_data_fd("ID=other\n", 9, 0)) >= 0);
+        assert_se(portable_cached_image_add(c, "/etc/os-release", &fd) == -EEXIST);
+        assert_se((fd = acquire_data_fd("", 0, 0)) >= 0);
+        assert_se(portable_cached_image_add(c, "/etc/passwd", &fd) == -EINVAL);
+
+        /* Without matches, all units are returned */
+        assert_se(portable_cached_image_to_metadata(c, NULL, &os_release, &unit_files) >= 0);
+        check_item(os_release, "ID=test\n");
+        assert_se(hashmap_size(unit_files) == 4);
+        check_item(hashmap_get(unit_files, "foo.service"), "[Service]\nExecStart=/bin/foo\n");
+        check_item(hashmap_get(unit_files, "other.timer"), "[Timer]\n");
+        os_release = portable_metadata_unref(os_release);
+        unit_files = hashmap_free(unit_files);
+
+        /* Matches are applied to what is cached, and only match whole prefixes */
+        assert_se(portable_cached_image_to_metadata(c, STRV_MAKE("foo"), &os_release, &unit_files) >= 0);
+        check_item(os_release, "ID=test\n");
+        assert_se(hashmap_size(unit_files) == 2);
+        check_item(hashmap_get(unit_files, "foo.service"), "[Service]\nExecStart=/bin/foo\n");
+        check_item(hashmap_get(unit_files, "foo-bar.socket"), "[Socket]\n");
+        os_release = portable_metadata_unref(os_release);
+        unit_files = hashmap_free(unit_files);
+
+        assert_se(portable_cached_image_to_metadata(c, STRV_MAKE("fo", "nope"), &os_release, &unit_files) >= 0);
+        assert_se(hashmap_isempty(unit_files));
+        os_release = portable_metadata_unref(os_release);
+        unit_files = hashmap_free(unit_files);
+
+        /* The same data may be handed out again */
+        assert_se(portable_cached_image_to_metadata(c, STRV_MAKE("other"), &os_release, &unit_files) >= 0);
+        assert_se(hashmap_size(unit_files) == 1);
+        check_item(hashmap_get(unit_files, "other.timer"), "[Timer]\n");
+}
+
+static void test_metadata_cache(void) {
+        _cleanup_(unlink_tempfilep) char path[] = "/tmp/test-portable.XXXXXX", path2[] = "/tmp/test-portable.XXXXXX";
+        static const uint8_t hash[32] = { 1, 2, 3 }, hash2[32] = { 4, 5, 6 };
+        _cleanup_close_ int fd = -1, fd2 = -1;
+        PortableCachedImage *c;
+        struct stat st, st2;
+
+        log_info("/* %s */", __func__);
+
+        assert_se((fd = mkostemp_safe(path)) >= 0);
+        assert_se((fd2 = mkostemp_safe(path2)) >= 0);
+        assert_se(fstat(fd, &st) >= 0);
+        assert_se(fstat(fd2, &st2) >= 0);
+
+        /* Without a cache size nothing is remembered */
+        portable_metadata_cache_put(make_image(), path, &st, hash, sizeof(hash));
+        assert_se(!portable_metadata_cache_get(path, &st, hash, sizeof(hash)));
+
+        portable_metadata_cache_set_size(2);
+
+        /* Hits for the same image and root hash */
+        c = make_image();
+        portable_metadata_cache_put(c, path, &st, hash, sizeof(hash));
+        assert_se(portable_metadata_cache_get(path, &st, hash, sizeof(hash)) == c);
+        assert_se(portable_metadata_cache_get(path, &st, hash, sizeof(hash)) == c);
+        assert_se(!portable_metadata_cache_get(path2, &st, hash, sizeof(hash)));
+
+        /* A different root hash, e.g. from a new sidecar file, invalidates the entry */
+        assert_se(!portable_metadata_cache_get(path, &st, hash2, sizeof(hash2)));
+        assert_se(!portable_metadata_cache_get(path, &st, hash, sizeof(hash)));
+
+        /* So does a root hash that is gone, or one that appeared */
+        portable_metadata_cache_put(make_image(), path, &st, hash, sizeof(hash));
+        assert_se(!portable_metadata_cache_get(path, &st, NULL, 0));
+        portable_metadata_cache_put(make_image(), path, &st, NULL, 0);
+        assert_se(portable_metadata_cache_get(path, &st, NULL, 0));
+        assert_se(!portable_metadata_cache_get(path, &st, hash, sizeof(hash)));
+
+        /* A modified image invalidates the entry */
+        portable_metadata_cache_put(make_image(), path, &st, NULL, 0);
+        assert_se(write(fd, "x", 1) == 1);
+        assert_se(fstat(fd, &st) >= 0);
+        assert_se(!portable_metadata_cache_get(path, &st, NULL, 0));
+
+        /* Adding the same image again replaces the old entry */
+        portable_metadata_cache_put(make_image(), path, &st, NULL, 0);
+        c = make_image();
+        portable_metadata_cache_put(c, path, &st, hash, sizeof(hash));
+        assert_se(portable_metadata_cache_get(path, &st, hash, sizeof(hash)) == c);
+
+        /* Different images are cached side by side */
+        portable_metadata_cache_put(make_image(), path2, &st2, NULL, 0);
+        assert_se(portable_metadata_cache_get(path, &st, hash, sizeof(hash)) == c);
+        assert_se(portable_metadata_cache_get(path2, &st2, NULL, 0));
+
+        /* Shrinking the cache drops entries until they fit */
+        portable_metadata_cache_set_size(1);
+        assert_se(!!portable_metadata_cache_get(path, &st, hash, sizeof(hash)) +
+                  !!portable_metadata_cache_get(path2, &st2, NULL, 0) == 1);
+
+        portable_metadata_cache_set_size(0);
+        assert_se(!portable_metadata_cache_get(path, &st, hash, sizeof(hash)));
+        assert_se(!portable_metadata_cache_get(path2, &st2, NULL, 0));
+}
+
+int main(int argc, char *argv[]) {
+        test_setup_logging(LOG_DEBUG);
+
+        test_cached_image();
+        test_metadata_cache();
+
+        return 0;
+}
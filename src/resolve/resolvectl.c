@@ -982,13 +982,84 @@ static int verb_tlsa(int argc, char **argv, void *userdata) {
         return r;
 }
 
+static int show_scope_statistics(sd_bus *bus) {
+        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+        _cleanup_(table_unrefp) Table *table = NULL;
+        int r;
+
+        assert(bus);
+
+        r = sd_bus_get_property(bus,
+                                "org.freedesktop.resolve1",
+                                "/org/freedesktop/resolve1",
+                                "org.freedesktop.resolve1.Manager",
+                                "ScopeStatistics",
+                                &error,
+                                &reply,
+                                "a(isittt)");
+        if (sd_bus_error_has_name(&error, SD_BUS_ERROR_UNKNOWN_PROPERTY))
+                return 0; /* Older versions of systemd-resolved don't know this yet */
+        if (r < 0)
+                return log_error_errno(r, "Failed to get scope statistics: %s", bus_error_message(&error, r));
+
+        table = table_new("link", "protocol", "family", "issued", "coalesced", "timed out");
+        if (!table)
+                return log_oom();
+
+        r = sd_bus_message_enter_container(reply, 'a', "(isittt)");
+        if (r < 0)
+                return bus_log_parse_error(r);
+
+        for (;;) {
+                uint64_t n_issued, n_coalesced, n_timeout;
+                char ifname[IF_NAMESIZE + 1] = "*";
+                const char *protocol;
+                int ifindex, family;
+
+                r = sd_bus_message_read(reply, "(isittt)", &ifindex, &protocol, &family, &n_issued, &n_coalesced, &n_timeout);
+                if (r < 0)
+                        return bus_log_parse_error(r);
+                if (r == 0)
+                        break;
+
+                if (ifindex > 0 && !format_ifname(ifindex, ifname))
+                        xsprintf(ifname, "%i", ifindex);
+
+                r = table_add_many(table,
+                                   TABLE_STRING, ifname,
+                                   TABLE_STRING, protocol,
+                                   TABLE_STRING, af_to_name_short(family),
+                                   TABLE_UINT64, n_issued,
+                                   TABLE_UINT64, n_coalesced,
+                                   TABLE_UINT64, n_timeout);
+                if (r < 0)
+                        return table_log_add_error(r);
+        }
+
+        r = sd_bus_message_exit_container(reply);
+        if (r < 0)
+                return bus_log_parse_error(r);
+
+        if (table_get_rows(table) <= 1)
+                return 0;
+
+        putchar('\n');
+
+        r = table_print(table, NULL);
+        if (r < 0)
+                return log_error_errno(r, "Failed to print table: %m");
+
+        return 0;
+}
+
 static int show_statistics(int argc, char **argv, void *userdata) {
         _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
         _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
         _cleanup_(table_unrefp) Table *table = NULL;
         sd_bus *bus = userdata;
         uint64_t n_current_transactions, n_total_transactions,
-                cache_size, n_cache_hit, n_cache_miss,
+                cache_size, n_cache_hit, n_cache_miss, cache_memory, n_cache_evicted,
                 n_dnssec_secure, n_dnssec_insecure, n_dnssec_bogus, n_dnssec_indeterminate;
         int r, dnssec_supported;
 
@@ -1049,6 +1120,25 @@ static int show_statistics(int argc, char **argv, void *userdata) {
 
         reply = sd_bus_message_unref(reply);
 
+        r = sd_bus_get_property(bus,
+                                "org.freedesktop.resolve1",
+                                "/org/freedesktop/resolve1",
+                                "org.freedesktop.resolve1.Manager",
+                                "CacheMemoryStatistics",
+                                &error,
+                                &reply,
+                                "(tt)");
+        if (r < 0)
+                return log_error_errno(r, "Failed to get cache memory statistics: %s", bus_error_message(&error, r));
+
+        r = sd_bus_message_read(reply, "(tt)",
+                                &cache_memory,
+                                &n_cache_evicted);
+        if (r < 0)
+                return bus_log_parse_error(r);
+
+        reply = sd_bus_message_unref(reply);
+
         r = sd_bus_get_property(bus,
                                 "org.freedesktop.resolve1",
                                 "/org/freedesktop/resolve1",
@@ -1095,6 +1185,10 @@ static int show_statistics(int argc, char **argv, void *userdata) {
                            TABLE_UINT64, n_cache_hit,
                            TABLE_STRING, "Cache Misses:",
                            TABLE_UINT64, n_cache_miss,
+                           TABLE_STRING, "Cache Memory:",
+                           TABLE_SIZE, cache_memory,
+                           TABLE_STRING, "Cache Evictions:",
+                           TABLE_UINT64, n_cache_evicted,
                            TABLE_EMPTY, TABLE_EMPTY,
                            TABLE_STRING, "DNSSEC Verdicts",
                            TABLE_SET_COLOR, ansi_highlight(),
@@ -1116,7 +1210,7 @@ static int show_statistics(int argc, char **argv, void *userdata) {
         if (r < 0)
                 return log_error_errno(r, "Failed to print table: %m");
 
-        return 0;
+        return show_scope_statistics(bus);
 }
 
 static int reset_statistics(int argc, char **argv, void *userdata) {
@@ -0,0 +1,225 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <sys/stat.h>
+
+#include "alloc-util.h"
+#include "fd-util.h"
+#include "fileio.h"
+#include "fs-util.h"
+#include "parse-util.h"
+#include "resolved-dns-cache-file.h"
+#include "stdio-util.h"
+#include "string-util.h"
+#include "strv.h"
+#include "tmpfile-util.h"
+
+/* The cache is kept in /run, which survives restarts of the service, but not reboots, after which the cached
+ * data wouldn't be useful anymore anyway. The expiry times in it are in CLOCK_BOOTTIME. */
+#define CACHE_FILE "/run/systemd/resolve/cache"
+
+/* How often to save the cache while running, so that not everything is lost if we crash */
+#define CACHE_FILE_SAVE_INTERVAL_USEC (5 * USEC_PER_MINUTE)
+
+static bool manager_cache_file_enabled(Manager *m) {
+        assert(m);
+
+        return m->preserve_cache && m->enable_cache != DNS_CACHE_MODE_NO;
+}
+
+static int on_cache_file_timer(sd_event_source *s, uint64_t usec, void *userdata) {
+        Manager *m = userdata;
+        int r;
+
+        assert(m);
+
+        /* By now all interfaces showed up, hence entries for scopes that didn't appear won't be needed */
+        manager_cache_file_flush(m);
+
+        (void) manager_cache_file_save(m);
+
+        r = sd_event_source_set_time(s, usec + CACHE_FILE_SAVE_INTERVAL_USEC);
+        if (r < 0)
+                return log_warning_errno(r, "Failed to reschedule cache file timer: %m");
+
+        return sd_event_source_set_enabled(s, SD_EVENT_ON);
+}
+
+static int manager_cache_file_import(Manager *m, DnsScope *s, char **lines) {
+        unsigned n = 0;
+        char **line;
+        int r;
+
+        assert(m);
+        assert(s);
+
+        STRV_FOREACH(line, lines) {
+                r = dns_cache_load_line(&s->cache, *line);
+                if (r < 0) {
+                        log_debug_errno(r, "Failed to restore cache entry, ignoring: %m");
+                        continue;
+                }
+
+                n += r > 0;
+        }
+
+        log_debug("Restored %u cache entries for scope on %s.", n, s->link ? s->link->ifname : "*");
+        return 0;
+}
+
+void manager_cache_file_restore(Manager *m, DnsScope *s) {
+        _cleanup_strv_free_ char **lines = NULL;
+
+        assert(m);
+        assert(s);
+
+        if (s->protocol != DNS_PROTOCOL_DNS)
+                return;
+
+        lines = hashmap_remove(m->cache_file_entries, INT_TO_PTR(s->link ? s->link->ifindex : 0));
+        if (!lines)
+                return;
+
+        (void) manager_cache_file_import(m, s, lines);
+}
+
+void manager_cache_file_flush(Manager *m) {
+        char **lines;
+
+        assert(m);
+
+        while ((lines = hashmap_steal_first(m->cache_file_entries)))
+                strv_free(lines);
+
+        m->cache_file_entries = hashmap_free(m->cache_file_entries);
+}
+
+int manager_cache_file_load(Manager *m) {
+        _cleanup_fclose_ FILE *f = NULL;
+        Iterator i;
+        usec_t n;
+        Link *l;
+        int r;
+
+        assert(m);
+
+        /* Reads the cache file saved by a previous instance. The entries are kept around indexed by the scope they
+         * belong to, and are imported into each scope when it is created. */
+
+        if (!manager_cache_file_enabled(m)) {
+                (void) unlink(CACHE_FILE);
+                return 0;
+        }
+
+        assert_se(sd_event_now(m->event, clock_boottime_or_monotonic(), &n) >= 0);
+
+        r = sd_event_add_time(m->event, &m->cache_file_event_source, clock_boottime_or_monotonic(),
+                              n + CACHE_FILE_SAVE_INTERVAL_USEC, 0, on_cache_file_timer, m);
+        if (r < 0)
+                return log_warning_errno(r, "Failed to install cache file timer: %m");
+
+        (void) sd_event_source_set_description(m->cache_file_event_source, "cache-file-timer");
+
+        f = fopen(CACHE_FILE, "re");
+        if (!f) {
+                if (errno == ENOENT)
+                        return 0;
+
+                return log_warning_errno(errno, "Failed to open " CACHE_FILE ": %m");
+        }
+
+        for (;;) {
+                _cleanup_free_ char *line = NULL, *word = NULL;
+                const char *p;
+                char **lines;
+                int ifindex;
+
+                r = read_line(f, LONG_LINE_MAX, &line);
+                if (r < 0)
+                        return log_warning_errno(r, "Failed to read " CACHE_FILE ": %m");
+                if (r == 0)
+                        break;
+
+                /* Each line starts with the interface index of the scope, 0 for the global one */
+                p = line;
+                r = extract_first_word(&p, &word, NULL, 0);
+                if (r <= 0 || safe_atoi(word, &ifindex) < 0 || ifindex < 0 || !p) {
+                        log_debug("Invalid line in " CACHE_FILE ", ignoring.");
+                        continue;
+                }
+
+                r = hashmap_ensure_allocated(&m->cache_file_entries, NULL);
+                if (r < 0)
+                        return log_oom();
+
+                lines = hashmap_get(m->cache_file_entries, INT_TO_PTR(ifindex));
+                r = strv_extend(&lines, p);
+                if (r < 0)
+                        return log_oom();
+
+                /* The array might have been moved, hence always store it again */
+                r = hashmap_replace(m->cache_file_entries, INT_TO_PTR(ifindex), lines);
+                if (r < 0) {
+                        strv_free(lines);
+                        return log_oom();
+                }
+        }
+
+        /* Some scopes exist already, fill them right away */
+        if (m->unicast_scope)
+                manager_cache_file_restore(m, m->unicast_scope);
+
+        HASHMAP_FOREACH(l, m->links, i)
+                if (l->unicast_scope)
+                        manager_cache_file_restore(m, l->unicast_scope);
+
+        return 0;
+}
+
+int manager_cache_file_save(Manager *m) {
+        _cleanup_(unlink_and_freep) char *temp_path = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+        Iterator i;
+        Link *l;
+        int r;
+
+        assert(m);
+
+        if (!manager_cache_file_enabled(m))
+                return 0;
+
+        r = fopen_temporary(CACHE_FILE, &f, &temp_path);
+        if (r < 0)
+                return log_warning_errno(r, "Failed to open new " CACHE_FILE " for writing: %m");
+
+        /* This reveals which names were looked up recently, keep it private */
+        (void) fchmod(fileno(f), 0600);
+
+        if (m->unicast_scope) {
+                r = dns_cache_save(&m->unicast_scope->cache, f, "0 ");
+                if (r < 0)
+                        return log_warning_errno(r, "Failed to write cache: %m");
+        }
+
+        HASHMAP_FOREACH(l, m->links, i) {
+                char prefix[DECIMAL_STR_MAX(int) + 2];
+
+                if (!l->unicast_scope)
+                        continue;
+
+                xsprintf(prefix, "%i ", l->ifindex);
+
+                r = dns_cache_save(&l->unicast_scope->cache, f, prefix);
+                if (r < 0)
+                        return log_warning_errno(r, "Failed to write cache of %s: %m", l->ifname);
+        }
+
+        r = fflush_and_check(f);
+        if (r < 0)
+                return log_warning_errno(r, "Failed to write " CACHE_FILE ": %m");
+
+        if (rename(temp_path, CACHE_FILE) < 0)
+                return log_warning_errno(errno, "Failed to move new " CACHE_FILE " into place: %m");
+
+        temp_path = mfree(temp_path);
+        return 0;
+}
@@ -0,0 +1,10 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+#include "resolved-dns-scope.h"
+#include "resolved-manager.h"
+
+int manager_cache_file_load(Manager *m);
+int manager_cache_file_save(Manager *m);
+void manager_cache_file_restore(Manager *m, DnsScope *s);
+void manager_cache_file_flush(Manager *m);
@@ -6,15 +6,13 @@
 #include "alloc-util.h"
 #include "dns-domain.h"
 #include "format-util.h"
+#include "hexdecoct.h"
+#include "parse-util.h"
 #include "resolved-dns-answer.h"
 #include "resolved-dns-cache.h"
 #include "resolved-dns-packet.h"
 #include "string-util.h"
 
-/* Never cache more than 4K entries. RFC 1536, Section 5 suggests to
- * leave DNS caches unbounded, but that's crazy. */
-#define CACHE_MAX 4096
-
 /* We never keep any item longer than 2h in our cache */
 #define CACHE_TTL_MAX_USEC (2 * USEC_PER_HOUR)
 
@@ -22,6 +20,12 @@
  * now) */
 #define CACHE_TTL_STRANGE_RCODE_USEC (30 * USEC_PER_SEC)
 
+/* Suggest refreshing an entry when it is hit within the last tenth of its lifetime */
+#define CACHE_PREFETCH_FRACTION 10U
+
+/* The TTL to report for stale data, see RFC 8767, Section 4 */
+#define CACHE_STALE_TTL 30U
+
 typedef enum DnsCacheItemType DnsCacheItemType;
 typedef struct DnsCacheItem DnsCacheItem;
 
@@ -39,14 +43,20 @@ struct DnsCacheItem {
         int rcode;
 
         usec_t until;
+        usec_t refresh_after;
         bool authenticated:1;
         bool shared_owner:1;
+        bool refreshing:1;
 
         int ifindex;
         int owner_family;
         union in_addr_union owner_address;
 
+        size_t size;
+        uint64_t usage;
+
         unsigned prioq_idx;
+        unsigned usage_prioq_idx;
         LIST_FIELDS(DnsCacheItem, by_key);
 };
 
@@ -82,6 +92,32 @@ static void dns_cache_item_free(DnsCacheItem *i) {
 
 DEFINE_TRIVIAL_CLEANUP_FUNC(DnsCacheItem*, dns_cache_item_free);
 
+static size_t dns_cache_item_size(DnsCacheItem *i) {
+        size_t sz;
+
+        assert(i);
+
+        /* An estimate of the memory used by the item. Keys and RRs may be shared between items, but this is good
+         * enough to keep the cache within its limit. */
+
+        sz = sizeof(DnsCacheItem) + sizeof(DnsResourceKey) + strlen(dns_resource_key_name(i->key)) + 1;
+        if (i->rr)
+                sz += dns_resource_record_memory_size(i->rr);
+
+        return sz;
+}
+
+static void dns_cache_item_unlink_prioqs(DnsCache *c, DnsCacheItem *i) {
+        assert(c);
+        assert(i);
+
+        prioq_remove(c->by_expiry, i, &i->prioq_idx);
+        prioq_remove(c->by_usage, i, &i->usage_prioq_idx);
+
+        assert(c->size >= i->size);
+        c->size -= i->size;
+}
+
 static void dns_cache_item_unlink_and_free(DnsCache *c, DnsCacheItem *i) {
         DnsCacheItem *first;
 
@@ -98,7 +134,7 @@ static void dns_cache_item_unlink_and_free(DnsCache *c, DnsCacheItem *i) {
         else
                 hashmap_remove(c->by_key, i->key);
 
-        prioq_remove(c->by_expiry, i, &i->prioq_idx);
+        dns_cache_item_unlink_prioqs(c, i);
 
         dns_cache_item_free(i);
 }
@@ -132,7 +168,7 @@ static bool dns_cache_remove_by_key(DnsCache *c, DnsResourceKey *key) {
                 return false;
 
         LIST_FOREACH_SAFE(by_key, i, n, first) {
-                prioq_remove(c->by_expiry, i, &i->prioq_idx);
+                dns_cache_item_unlink_prioqs(c, i);
                 dns_cache_item_free(i);
         }
 
@@ -144,45 +180,21 @@ void dns_cache_flush(DnsCache *c) {
 
         assert(c);
 
+        if (c->generation)
+                (*c->generation)++;
+
         while ((key = hashmap_first_key(c->by_key)))
                 dns_cache_remove_by_key(c, key);
 
         assert(hashmap_size(c->by_key) == 0);
         assert(prioq_size(c->by_expiry) == 0);
+        assert(prioq_size(c->by_usage) == 0);
+        assert(c->size == 0);
 
         c->by_key = hashmap_free(c->by_key);
         c->by_expiry = prioq_free(c->by_expiry);
-}
-
-static void dns_cache_make_space(DnsCache *c, unsigned add) {
-        assert(c);
-
-        if (add <= 0)
-                return;
-
-        /* Makes space for n new entries. Note that we actually allow
-         * the cache to grow beyond CACHE_MAX, but only when we shall
-         * add more RRs to the cache than CACHE_MAX at once. In that
-         * case the cache will be emptied completely otherwise. */
-
-        for (;;) {
-                _cleanup_(dns_resource_key_unrefp) DnsResourceKey *key = NULL;
-                DnsCacheItem *i;
-
-                if (prioq_size(c->by_expiry) <= 0)
-                        break;
-
-                if (prioq_size(c->by_expiry) + add < CACHE_MAX)
-                        break;
-
-                i = prioq_peek(c->by_expiry);
-                assert(i);
-
-                /* Take an extra reference to the key so that it
-                 * doesn't go away in the middle of the remove call */
-                key = dns_resource_key_ref(i->key);
-                dns_cache_remove_by_key(c, key);
-        }
+        c->by_usage = prioq_free(c->by_usage);
+        c->usage_age = 0;
 }
 
 void dns_cache_prune(DnsCache *c) {
@@ -190,7 +202,7 @@ void dns_cache_prune(DnsCache *c) {
 
         assert(c);
 
-        /* Remove all entries that are past their TTL */
+        /* Remove all entries that are past their TTL, plus the time we keep them around for serving stale data */
 
         for (;;) {
                 DnsCacheItem *i;
@@ -203,7 +215,7 @@ void dns_cache_prune(DnsCache *c) {
                 if (t <= 0)
                         t = now(clock_boottime_or_monotonic());
 
-                if (i->until > t)
+                if (usec_add(i->until, c->stale_retention_usec) > t)
                         break;
 
                 /* Depending whether this is an mDNS shared entry
@@ -226,8 +238,87 @@ void dns_cache_prune(DnsCache *c) {
         }
 }
 
-static int dns_cache_item_prioq_compare_func(const void *a, const void *b) {
+static void dns_cache_make_space(DnsCache *c, unsigned add) {
+        size_t size_max, need;
+
+        assert(c);
+
+        if (add <= 0)
+                return;
+
+        /* Makes space for n new entries, assuming they are about as large as the ones we have already. Note that we
+         * actually allow the cache to grow beyond its limit, but only when we shall add more RRs to the cache than
+         * fit at once. In that case the cache will be emptied completely otherwise.
+         *
+         * Entries which expired are dropped first. After that, the least frequently used ones are evicted, as
+         * the names looked up over and over are the ones that matter, regardless of their TTL. To let entries
+         * which were popular once but aren't anymore go eventually, this ages usage dynamically (LFU-DA): an
+         * entry's usage is bumped to the usage of the most recently evicted entry plus one whenever it is
+         * used, hence recently used entries always rank above the ones that were only used long ago. */
+
+        dns_cache_prune(c);
+
+        size_max = c->size_max > 0 ? c->size_max : DNS_CACHE_SIZE_MAX_DEFAULT;
+
+        for (;;) {
+                _cleanup_(dns_resource_key_unrefp) DnsResourceKey *key = NULL;
+                DnsCacheItem *i;
+
+                if (prioq_size(c->by_usage) <= 0)
+                        break;
+
+                need = add * (c->size / prioq_size(c->by_usage));
+                if (c->size + need <= size_max)
+                        break;
+
+                i = prioq_peek(c->by_usage);
+                assert(i);
+
+                c->usage_age = MAX(c->usage_age, i->usage);
+                c->n_evicted++;
+
+                /* Take an extra reference to the key so that it
+                 * doesn't go away in the middle of the remove call */
+                key = dns_resource_key_ref(i->key);
+                dns_cache_remove_by_key(c, key);
+        }
+}
+
+static void dns_cache_mark_used(DnsCache *c, DnsCacheItem *first, bool refresh, bool *ret_refresh) {
+        DnsCacheItem *i;
+
+        assert(c);
+
+        /* Counts a hit on the items, and if the caller is told to refresh them, remembers that, so that this is
+         * suggested only once */
+
+        c->n_hit++;
+
+        LIST_FOREACH(by_key, i, first) {
+                i->usage = MAX(i->usage, c->usage_age) + 1;
+                prioq_reshuffle(c->by_usage, i, &i->usage_prioq_idx);
+
+                if (refresh)
+                        i->refreshing = true;
+        }
+
+        if (ret_refresh)
+                *ret_refresh = refresh;
+}
+
+static uint64_t dns_cache_item_prioq_key_func(const void *a) {
+        const DnsCacheItem *i = a;
+
+        return i->until;
+}
+
+static int dns_cache_item_usage_prioq_compare_func(const void *a, const void *b) {
         const DnsCacheItem *x = a, *y = b;
+        int r;
+
+        r = CMP(x->usage, y->usage);
+        if (r != 0)
+                return r;
 
         return CMP(x->until, y->until);
 }
@@ -237,7 +328,11 @@ static int dns_cache_init(DnsCache *c) {
 
         assert(c);
 
-        r = prioq_ensure_allocated(&c->by_expiry, dns_cache_item_prioq_compare_func);
+        r = prioq_ensure_allocated_keyed(&c->by_expiry, dns_cache_item_prioq_key_func);
+        if (r < 0)
+                return r;
+
+        r = prioq_ensure_allocated(&c->by_usage, dns_cache_item_usage_prioq_compare_func);
         if (r < 0)
                 return r;
 
@@ -255,10 +350,22 @@ static int dns_cache_link_item(DnsCache *c, DnsCacheItem *i) {
         assert(c);
         assert(i);
 
+        /* New entries start out like entries used once since the last eviction */
+        i->usage = c->usage_age + 1;
+        i->size = dns_cache_item_size(i);
+
         r = prioq_put(c->by_expiry, i, &i->prioq_idx);
         if (r < 0)
                 return r;
 
+        r = prioq_put(c->by_usage, i, &i->usage_prioq_idx);
+        if (r < 0) {
+                prioq_remove(c->by_expiry, i, &i->prioq_idx);
+                return r;
+        }
+
+        c->size += i->size;
+
         first = hashmap_get(c->by_key, i->key);
         if (first) {
                 _cleanup_(dns_resource_key_unrefp) DnsResourceKey *k = NULL;
@@ -279,7 +386,7 @@ static int dns_cache_link_item(DnsCache *c, DnsCacheItem *i) {
         } else {
                 r = hashmap_put(c->by_key, i->key, i);
                 if (r < 0) {
-                        prioq_remove(c->by_expiry, i, &i->prioq_idx);
+                        dns_cache_item_unlink_prioqs(c, i);
                         return r;
                 }
         }
@@ -336,6 +443,10 @@ static usec_t calculate_until(DnsResourceRecord *rr, uint32_t nsec_ttl, usec_t t
         return timestamp + u;
 }
 
+static usec_t calculate_refresh_after(usec_t until, usec_t timestamp) {
+        return until - (until - timestamp) / CACHE_PREFETCH_FRACTION;
+}
+
 static void dns_cache_item_update_positive(
                 DnsCache *c,
                 DnsCacheItem *i,
@@ -368,6 +479,8 @@ static void dns_cache_item_update_positive(
         i->key = dns_resource_key_ref(rr->key);
 
         i->until = calculate_until(rr, (uint32_t) -1, timestamp, false);
+        i->refresh_after = calculate_refresh_after(i->until, timestamp);
+        i->refreshing = false;
         i->authenticated = authenticated;
         i->shared_owner = shared_owner;
 
@@ -376,7 +489,12 @@ static void dns_cache_item_update_positive(
         i->owner_family = owner_family;
         i->owner_address = *owner_address;
 
+        c->size -= i->size;
+        i->size = dns_cache_item_size(i);
+        c->size += i->size;
+
         prioq_reshuffle(c->by_expiry, i, &i->prioq_idx);
+        prioq_reshuffle(c->by_usage, i, &i->usage_prioq_idx);
 }
 
 static int dns_cache_put_positive(
@@ -444,6 +562,7 @@ static int dns_cache_put_positive(
         i->key = dns_resource_key_ref(rr->key);
         i->rr = dns_resource_record_ref(rr);
         i->until = calculate_until(rr, (uint32_t) -1, timestamp, false);
+        i->refresh_after = calculate_refresh_after(i->until, timestamp);
         i->authenticated = authenticated;
         i->shared_owner = shared_owner;
         i->ifindex = ifindex;
@@ -531,6 +650,9 @@ static int dns_cache_put_negative(
         i->until =
                 i->type == DNS_CACHE_RCODE ? timestamp + CACHE_TTL_STRANGE_RCODE_USEC :
                 calculate_until(soa, nsec_ttl, timestamp, true);
+        i->refresh_after =
+                i->type == DNS_CACHE_RCODE ? USEC_INFINITY :
+                calculate_refresh_after(i->until, timestamp);
         i->authenticated = authenticated;
         i->owner_family = owner_family;
         i->owner_address = *owner_address;
@@ -822,14 +944,23 @@ static DnsCacheItem *dns_cache_get_by_key_follow_cname_dname_nsec(DnsCache *c, D
         return NULL;
 }
 
-int dns_cache_lookup(DnsCache *c, DnsResourceKey *key, bool clamp_ttl, int *rcode, DnsAnswer **ret, bool *authenticated) {
+int dns_cache_lookup(
+                DnsCache *c,
+                DnsResourceKey *key,
+                bool clamp_ttl,
+                bool stale_ok,
+                int *rcode,
+                DnsAnswer **ret,
+                bool *authenticated,
+                bool *ret_refresh) {
+
         _cleanup_(dns_answer_unrefp) DnsAnswer *answer = NULL;
         char key_str[DNS_RESOURCE_KEY_STRING_MAX];
         unsigned n = 0;
         int r;
         bool nxdomain = false;
         DnsCacheItem *j, *first, *nsec = NULL;
-        bool have_authenticated = false, have_non_authenticated = false;
+        bool have_authenticated = false, have_non_authenticated = false, stale = false, refresh = false;
         usec_t current;
         int found_rcode = -1;
 
@@ -839,6 +970,14 @@ int dns_cache_lookup(DnsCache *c, DnsResourceKey *key, bool clamp_ttl, int *rcod
         assert(ret);
         assert(authenticated);
 
+        /* Looks up the key, returns > 0 on a hit. Entries past their TTL, which are only still around if we keep
+         * them for serving stale data, are only used if stale_ok is true. If ret_refresh is passed, it's set to
+         * true if the caller should refresh the entry in the background, because it expires soon or already
+         * did. */
+
+        if (ret_refresh)
+                *ret_refresh = false;
+
         if (key->type == DNS_TYPE_ANY || key->class == DNS_CLASS_ANY) {
                 /* If we have ANY lookups we don't use the cache, so
                  * that the caller refreshes via the network. */
@@ -871,6 +1010,8 @@ int dns_cache_lookup(DnsCache *c, DnsResourceKey *key, bool clamp_ttl, int *rcod
                 return 0;
         }
 
+        current = now(clock_boottime_or_monotonic());
+
         LIST_FOREACH(by_key, j, first) {
                 if (j->rr) {
                         if (j->rr->key->type == DNS_TYPE_NSEC)
@@ -886,6 +1027,25 @@ int dns_cache_lookup(DnsCache *c, DnsResourceKey *key, bool clamp_ttl, int *rcod
                         have_authenticated = true;
                 else
                         have_non_authenticated = true;
+
+                if (j->until <= current)
+                        stale = true;
+                if (j->refresh_after <= current && !j->refreshing)
+                        refresh = true;
+        }
+
+        /* Never serve stale failures, only stale data */
+        if (stale && (!stale_ok || found_rcode >= 0)) {
+                log_debug("Cache entry for %s expired",
+                          dns_resource_key_to_string(key, key_str, sizeof key_str));
+
+                c->n_miss++;
+
+                *ret = NULL;
+                *rcode = DNS_RCODE_SUCCESS;
+                *authenticated = false;
+
+                return 0;
         }
 
         if (found_rcode >= 0) {
@@ -897,7 +1057,7 @@ int dns_cache_lookup(DnsCache *c, DnsResourceKey *key, bool clamp_ttl, int *rcod
                 *rcode = found_rcode;
                 *authenticated = false;
 
-                c->n_hit++;
+                dns_cache_mark_used(c, first, refresh, ret_refresh);
                 return 1;
         }
 
@@ -919,7 +1079,7 @@ int dns_cache_lookup(DnsCache *c, DnsResourceKey *key, bool clamp_ttl, int *rcod
                 if (!bitmap_isset(nsec->rr->nsec.types, key->type) &&
                     !bitmap_isset(nsec->rr->nsec.types, DNS_TYPE_CNAME) &&
                     !bitmap_isset(nsec->rr->nsec.types, DNS_TYPE_DNAME)) {
-                        c->n_hit++;
+                        dns_cache_mark_used(c, first, refresh, ret_refresh);
                         return 1;
                 }
 
@@ -927,13 +1087,14 @@ int dns_cache_lookup(DnsCache *c, DnsResourceKey *key, bool clamp_ttl, int *rcod
                 return 0;
         }
 
-        log_debug("%s cache hit for %s",
+        log_debug("%s%s cache hit for %s",
+                  stale ? "Stale " : "",
                   n > 0    ? "Positive" :
                   nxdomain ? "NXDOMAIN" : "NODATA",
                   dns_resource_key_to_string(key, key_str, sizeof key_str));
 
         if (n <= 0) {
-                c->n_hit++;
+                dns_cache_mark_used(c, first, refresh, ret_refresh);
 
                 *ret = NULL;
                 *rcode = nxdomain ? DNS_RCODE_NXDOMAIN : DNS_RCODE_SUCCESS;
@@ -945,9 +1106,6 @@ int dns_cache_lookup(DnsCache *c, DnsResourceKey *key, bool clamp_ttl, int *rcod
         if (!answer)
                 return -ENOMEM;
 
-        if (clamp_ttl)
-                current = now(clock_boottime_or_monotonic());
-
         LIST_FOREACH(by_key, j, first) {
                 _cleanup_(dns_resource_record_unrefp) DnsResourceRecord *rr = NULL;
 
@@ -957,7 +1115,7 @@ int dns_cache_lookup(DnsCache *c, DnsResourceKey *key, bool clamp_ttl, int *rcod
                 if (clamp_ttl) {
                         rr = dns_resource_record_ref(j->rr);
 
-                        r = dns_resource_record_clamp_ttl(&rr, LESS_BY(j->until, current) / USEC_PER_SEC);
+                        r = dns_resource_record_clamp_ttl(&rr, j->until > current ? (j->until - current) / USEC_PER_SEC : CACHE_STALE_TTL);
                         if (r < 0)
                                 return r;
                 }
@@ -967,7 +1125,7 @@ int dns_cache_lookup(DnsCache *c, DnsResourceKey *key, bool clamp_ttl, int *rcod
                         return r;
         }
 
-        c->n_hit++;
+        dns_cache_mark_used(c, first, refresh, ret_refresh);
 
         *ret = answer;
         *rcode = DNS_RCODE_SUCCESS;
@@ -1114,3 +1272,143 @@ unsigned dns_cache_size(DnsCache *cache) {
 
         return hashmap_size(cache->by_key);
 }
+
+int dns_cache_save(DnsCache *cache, FILE *f, const char *prefix) {
+        DnsCacheItem *i;
+        Iterator iterator;
+        int r;
+
+        assert(cache);
+        assert(f);
+
+        /* Writes out all positive entries, one per line, each starting with the specified prefix, in a format
+         * dns_cache_load_line() understands: the interface index the RR was received on, the time it expires
+         * at (CLOCK_BOOTTIME), whether it is authenticated, the server it was received from, and the RR in wire
+         * format, Base64 encoded. */
+
+        HASHMAP_FOREACH(i, cache->by_key, iterator) {
+                DnsCacheItem *j;
+
+                LIST_FOREACH(by_key, j, i) {
+                        _cleanup_free_ char *b = NULL, *a = NULL;
+
+                        if (j->type != DNS_CACHE_POSITIVE || !j->rr || j->shared_owner)
+                                continue;
+
+                        r = dns_resource_record_to_wire_format(j->rr, false);
+                        if (r < 0)
+                                return r;
+
+                        if (base64mem(j->rr->wire_format, j->rr->wire_format_size, &b) < 0)
+                                return -ENOMEM;
+
+                        if (j->owner_family != AF_UNSPEC) {
+                                r = in_addr_to_string(j->owner_family, &j->owner_address, &a);
+                                if (r < 0)
+                                        return r;
+                        }
+
+                        fprintf(f, "%s%i " USEC_FMT " %s %s %s\n",
+                                strempty(prefix),
+                                j->ifindex,
+                                j->until,
+                                yes_no(j->authenticated),
+                                a ?: "-",
+                                b);
+                }
+        }
+
+        return 0;
+}
+
+int dns_cache_load_line(DnsCache *cache, const char *line) {
+        _cleanup_free_ char *ifindex_str = NULL, *until_str = NULL, *authenticated_str = NULL, *owner_str = NULL, *rr_str = NULL;
+        _cleanup_(dns_resource_record_unrefp) DnsResourceRecord *rr = NULL;
+        _cleanup_(dns_cache_item_freep) DnsCacheItem *i = NULL;
+        union in_addr_union owner_address = {};
+        int ifindex, authenticated, owner_family = AF_UNSPEC, r;
+        _cleanup_free_ void *data = NULL;
+        usec_t until, n;
+        size_t size;
+
+        assert(cache);
+        assert(line);
+
+        /* Adds an entry written by dns_cache_save() back, unless it expired in the meantime. Returns > 0 if
+         * the entry was added, 0 if it wasn't needed anymore. */
+
+        r = extract_many_words(&line, NULL, 0, &ifindex_str, &until_str, &authenticated_str, &owner_str, &rr_str, NULL);
+        if (r < 0)
+                return r;
+        if (r < 5 || !isempty(line))
+                return -EINVAL;
+
+        r = safe_atoi(ifindex_str, &ifindex);
+        if (r < 0)
+                return r;
+
+        r = safe_atou64(until_str, &until);
+        if (r < 0)
+                return r;
+
+        authenticated = parse_boolean(authenticated_str);
+        if (authenticated < 0)
+                return authenticated;
+
+        if (!streq(owner_str, "-")) {
+                r = in_addr_from_string_auto(owner_str, &owner_family, &owner_address);
+                if (r < 0)
+                        return r;
+        }
+
+        r = unbase64mem(rr_str, (size_t) -1, &data, &size);
+        if (r < 0)
+                return r;
+
+        r = dns_resource_record_new_from_wire_format(&rr, data, size);
+        if (r < 0)
+                return r;
+
+        n = now(clock_boottime_or_monotonic());
+        if (usec_add(until, cache->stale_retention_usec) <= n)
+                return 0;
+
+        /* Never keep anything longer than we would have when receiving it now */
+        until = MIN(until, n + CACHE_TTL_MAX_USEC);
+
+        if (dns_class_is_pseudo(rr->key->class) || dns_type_is_pseudo(rr->key->type))
+                return -EINVAL;
+
+        if (dns_cache_get(cache, rr))
+                return 0;
+
+        r = dns_cache_init(cache);
+        if (r < 0)
+                return r;
+
+        dns_cache_make_space(cache, 1);
+
+        i = new(DnsCacheItem, 1);
+        if (!i)
+                return -ENOMEM;
+
+        *i = (DnsCacheItem) {
+                .type = DNS_CACHE_POSITIVE,
+                .key = dns_resource_key_ref(rr->key),
+                .rr = TAKE_PTR(rr),
+                .until = until,
+                .refresh_after = calculate_refresh_after(until, MIN(until, n)),
+                .authenticated = authenticated,
+                .ifindex = ifindex,
+                .owner_family = owner_family,
+                .owner_address = owner_address,
+                .prioq_idx = PRIOQ_IDX_NULL,
+        };
+
+        r = dns_cache_link_item(cache, i);
+        if (r < 0)
+                return r;
+
+        TAKE_PTR(i);
+        return 1;
+}
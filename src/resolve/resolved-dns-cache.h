@@ -7,11 +7,21 @@
 #include "resolve-util.h"
 #include "time-util.h"
 
+/* By default, use about as much memory as the 4K entries we used to limit the cache to */
+#define DNS_CACHE_SIZE_MAX_DEFAULT (1024U*1024U)
+
 typedef struct DnsCache {
         Hashmap *by_key;
         Prioq *by_expiry;
+        Prioq *by_usage;
+        uint64_t usage_age;   /* The usage of the most recently evicted item, see dns_cache_make_space() */
+        size_t size;          /* The estimated memory used by all items */
+        size_t size_max;      /* 0 means DNS_CACHE_SIZE_MAX_DEFAULT */
         unsigned n_hit;
         unsigned n_miss;
+        unsigned n_evicted;
+        uint64_t *generation; /* If set, bumped whenever the cache is flushed */
+        usec_t stale_retention_usec; /* How long to keep entries past their TTL, to serve them if lookups fail */
 } DnsCache;
 
 #include "resolved-dns-answer.h"
@@ -23,7 +33,7 @@ void dns_cache_flush(DnsCache *c);
 void dns_cache_prune(DnsCache *c);
 
 int dns_cache_put(DnsCache *c, DnsCacheMode cache_mode, DnsResourceKey *key, int rcode, DnsAnswer *answer, bool authenticated, uint32_t nsec_ttl, usec_t timestamp, int owner_family, const union in_addr_union *owner_address);
-int dns_cache_lookup(DnsCache *c, DnsResourceKey *key, bool clamp_ttl, int *rcode, DnsAnswer **answer, bool *authenticated);
+int dns_cache_lookup(DnsCache *c, DnsResourceKey *key, bool clamp_ttl, bool stale_ok, int *rcode, DnsAnswer **answer, bool *authenticated, bool *ret_refresh);
 
 int dns_cache_check_conflicts(DnsCache *cache, DnsResourceRecord *rr, int owner_family, const union in_addr_union *owner_address);
 
@@ -33,3 +43,6 @@ bool dns_cache_is_empty(DnsCache *cache);
 unsigned dns_cache_size(DnsCache *cache);
 
 int dns_cache_export_shared_to_packet(DnsCache *cache, DnsPacket *p);
+
+int dns_cache_save(DnsCache *cache, FILE *f, const char *prefix);
+int dns_cache_load_line(DnsCache *cache, const char *line);
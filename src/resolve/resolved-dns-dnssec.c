@@ -9,8 +9,10 @@
 #include "memory-util.h"
 #include "resolved-dns-dnssec.h"
 #include "resolved-dns-packet.h"
+#include "siphash24.h"
 #include "sort-util.h"
 #include "string-table.h"
+#include "unaligned.h"
 
 #define VERIFY_RRS_MAX 256
 #define MAX_KEY_SIZE (32*1024)
@@ -627,26 +629,194 @@ static void dnssec_fix_rrset_ttl(
         rrsig->expiry = rrsig->rrsig.expiration * USEC_PER_SEC;
 }
 
-int dnssec_verify_rrset(
+static int dnssec_verify_signature(
+                DnsResourceRecord *rrsig,
+                DnsResourceRecord *dnskey,
+                const void *sig_data,
+                size_t sig_size) {
+
+        _cleanup_(gcry_md_closep) gcry_md_hd_t md = NULL;
+        int r, md_algorithm;
+        size_t hash_size;
+        void *hash;
+
+        assert(rrsig);
+        assert(dnskey);
+        assert(sig_data);
+
+        /* Does the actual public key operation. Returns > 0 if the signature is valid, 0 if it isn't, and
+         * -EOPNOTSUPP if we don't support the algorithm. */
+
+        switch (rrsig->rrsig.algorithm) {
+#if GCRYPT_VERSION_NUMBER >= 0x010600
+        case DNSSEC_ALGORITHM_ED25519:
+                break;
+#else
+        case DNSSEC_ALGORITHM_ED25519:
+#endif
+        case DNSSEC_ALGORITHM_ED448:
+                return -EOPNOTSUPP;
+        default:
+                /* OK, the RRs are now in canonical order. Let's calculate the digest */
+                md_algorithm = algorithm_to_gcrypt_md(rrsig->rrsig.algorithm);
+                if (md_algorithm < 0)
+                        return md_algorithm;
+
+                gcry_md_open(&md, md_algorithm, 0);
+                if (!md)
+                        return -EIO;
+
+                hash_size = gcry_md_get_algo_dlen(md_algorithm);
+                assert(hash_size > 0);
+
+                gcry_md_write(md, sig_data, sig_size);
+
+                hash = gcry_md_read(md, 0);
+                if (!hash)
+                        return -EIO;
+        }
+
+        switch (rrsig->rrsig.algorithm) {
+
+        case DNSSEC_ALGORITHM_RSASHA1:
+        case DNSSEC_ALGORITHM_RSASHA1_NSEC3_SHA1:
+        case DNSSEC_ALGORITHM_RSASHA256:
+        case DNSSEC_ALGORITHM_RSASHA512:
+                r = dnssec_rsa_verify(
+                                gcry_md_algo_name(md_algorithm),
+                                hash, hash_size,
+                                rrsig,
+                                dnskey);
+                break;
+
+        case DNSSEC_ALGORITHM_ECDSAP256SHA256:
+        case DNSSEC_ALGORITHM_ECDSAP384SHA384:
+                r = dnssec_ecdsa_verify(
+                                gcry_md_algo_name(md_algorithm),
+                                rrsig->rrsig.algorithm,
+                                hash, hash_size,
+                                rrsig,
+                                dnskey);
+                break;
+#if GCRYPT_VERSION_NUMBER >= 0x010600
+        case DNSSEC_ALGORITHM_ED25519:
+                r = dnssec_eddsa_verify(
+                                rrsig->rrsig.algorithm,
+                                sig_data, sig_size,
+                                rrsig,
+                                dnskey);
+                break;
+#endif
+        default:
+                return -EOPNOTSUPP;
+        }
+
+        return r;
+}
+
+static void signature_digest_hash_func(const uint8_t *p, struct siphash *state) {
+        siphash24_compress(p, DNSSEC_SIGNATURE_DIGEST_SIZE, state);
+}
+
+static int signature_digest_compare_func(const uint8_t *a, const uint8_t *b) {
+        return memcmp(a, b, DNSSEC_SIGNATURE_DIGEST_SIZE);
+}
+
+DEFINE_PRIVATE_HASH_OPS_WITH_KEY_DESTRUCTOR(signature_digest_hash_ops, uint8_t, signature_digest_hash_func, signature_digest_compare_func, free);
+
+static int dnssec_signature_digest(
+                DnsResourceRecord *rrsig,
+                DnsResourceRecord *dnskey,
+                const void *sig_data,
+                size_t sig_size,
+                uint8_t ret[static DNSSEC_SIGNATURE_DIGEST_SIZE]) {
+
+        _cleanup_(gcry_md_closep) gcry_md_hd_t md = NULL;
+        uint8_t sizes[4];
+        void *p;
+
+        assert(rrsig);
+        assert(dnskey);
+        assert(sig_data);
+        assert(ret);
+
+        /* Calculates an identifier for the combination of key, signature and signed data, which includes the
+         * algorithm and the RRSIG fields. The sizes are included so that the concatenation is unambiguous. */
+
+        assert(dnskey->dnskey.key_size <= UINT16_MAX);
+        assert(rrsig->rrsig.signature_size <= UINT16_MAX);
+        unaligned_write_be16(sizes, dnskey->dnskey.key_size);
+        unaligned_write_be16(sizes + 2, rrsig->rrsig.signature_size);
+
+        gcry_md_open(&md, GCRY_MD_SHA256, 0);
+        if (!md)
+                return -EIO;
+
+        gcry_md_write(md, sizes, sizeof(sizes));
+        gcry_md_write(md, dnskey->dnskey.key, dnskey->dnskey.key_size);
+        gcry_md_write(md, rrsig->rrsig.signature, rrsig->rrsig.signature_size);
+        gcry_md_write(md, sig_data, sig_size);
+
+        p = gcry_md_read(md, 0);
+        if (!p)
+                return -EIO;
+
+        memcpy(ret, p, DNSSEC_SIGNATURE_DIGEST_SIZE);
+        return 0;
+}
+
+static int dnssec_signature_cache_add(DnssecSignatureCache *c, const uint8_t digest[static DNSSEC_SIGNATURE_DIGEST_SIZE]) {
+        _cleanup_free_ uint8_t *d = NULL;
+        int r;
+
+        assert(c);
+        assert(digest);
+
+        /* Make room by forgetting the oldest entries first */
+        while (ordered_set_size(c->digests) >= DNSSEC_SIGNATURE_CACHE_MAX)
+                free(ordered_set_steal_first(c->digests));
+
+        r = ordered_set_ensure_allocated(&c->digests, &signature_digest_hash_ops);
+        if (r < 0)
+                return r;
+
+        d = memdup(digest, DNSSEC_SIGNATURE_DIGEST_SIZE);
+        if (!d)
+                return -ENOMEM;
+
+        r = ordered_set_put(c->digests, d);
+        if (r < 0)
+                return r;
+
+        TAKE_PTR(d);
+        return 0;
+}
+
+void dnssec_signature_cache_flush(DnssecSignatureCache *c) {
+        assert(c);
+
+        c->digests = ordered_set_free(c->digests);
+}
+
+static int dnssec_verify_rrset_internal(
                 DnsAnswer *a,
                 const DnsResourceKey *key,
                 DnsResourceRecord *rrsig,
                 DnsResourceRecord *dnskey,
                 usec_t realtime,
+                DnssecSignatureCache *cache,
                 DnssecResult *result) {
 
         uint8_t wire_format_name[DNS_WIRE_FORMAT_HOSTNAME_MAX];
+        uint8_t digest[DNSSEC_SIGNATURE_DIGEST_SIZE];
         DnsResourceRecord **list, *rr;
         const char *source, *name;
-        _cleanup_(gcry_md_closep) gcry_md_hd_t md = NULL;
-        int r, md_algorithm;
+        int r;
         size_t k, n = 0;
         size_t sig_size = 0;
         _cleanup_free_ char *sig_data = NULL;
         _cleanup_fclose_ FILE *f = NULL;
-        size_t hash_size;
-        void *hash;
-        bool wildcard;
+        bool wildcard, cached = false;
 
         assert(key);
         assert(rrsig);
@@ -797,74 +967,29 @@ int dnssec_verify_rrset(
 
         initialize_libgcrypt(false);
 
-        switch (rrsig->rrsig.algorithm) {
-#if GCRYPT_VERSION_NUMBER >= 0x010600
-        case DNSSEC_ALGORITHM_ED25519:
-                break;
-#else
-        case DNSSEC_ALGORITHM_ED25519:
-#endif
-        case DNSSEC_ALGORITHM_ED448:
-                *result = DNSSEC_UNSUPPORTED_ALGORITHM;
-                return 0;
-        default:
-                /* OK, the RRs are now in canonical order. Let's calculate the digest */
-                md_algorithm = algorithm_to_gcrypt_md(rrsig->rrsig.algorithm);
-                if (md_algorithm == -EOPNOTSUPP) {
-                        *result = DNSSEC_UNSUPPORTED_ALGORITHM;
-                        return 0;
-                }
-                if (md_algorithm < 0)
-                        return md_algorithm;
-
-                gcry_md_open(&md, md_algorithm, 0);
-                if (!md)
-                        return -EIO;
-
-                hash_size = gcry_md_get_algo_dlen(md_algorithm);
-                assert(hash_size > 0);
-
-                gcry_md_write(md, sig_data, sig_size);
+        /* Maybe we verified the very same signature over the very same data with the very same key before? */
+        if (cache) {
+                r = dnssec_signature_digest(rrsig, dnskey, sig_data, sig_size, digest);
+                if (r < 0)
+                        return r;
 
-                hash = gcry_md_read(md, 0);
-                if (!hash)
-                        return -EIO;
+                cached = ordered_set_contains(cache->digests, digest);
         }
 
-        switch (rrsig->rrsig.algorithm) {
-
-        case DNSSEC_ALGORITHM_RSASHA1:
-        case DNSSEC_ALGORITHM_RSASHA1_NSEC3_SHA1:
-        case DNSSEC_ALGORITHM_RSASHA256:
-        case DNSSEC_ALGORITHM_RSASHA512:
-                r = dnssec_rsa_verify(
-                                gcry_md_algo_name(md_algorithm),
-                                hash, hash_size,
-                                rrsig,
-                                dnskey);
-                break;
+        if (cached)
+                r = 1;
+        else {
+                r = dnssec_verify_signature(rrsig, dnskey, sig_data, sig_size);
+                if (r == -EOPNOTSUPP) {
+                        *result = DNSSEC_UNSUPPORTED_ALGORITHM;
+                        return 0;
+                }
+                if (r < 0)
+                        return r;
 
-        case DNSSEC_ALGORITHM_ECDSAP256SHA256:
-        case DNSSEC_ALGORITHM_ECDSAP384SHA384:
-                r = dnssec_ecdsa_verify(
-                                gcry_md_algo_name(md_algorithm),
-                                rrsig->rrsig.algorithm,
-                                hash, hash_size,
-                                rrsig,
-                                dnskey);
-                break;
-#if GCRYPT_VERSION_NUMBER >= 0x010600
-        case DNSSEC_ALGORITHM_ED25519:
-                r = dnssec_eddsa_verify(
-                                rrsig->rrsig.algorithm,
-                                sig_data, sig_size,
-                                rrsig,
-                                dnskey);
-                break;
-#endif
+                if (r > 0 && cache)
+                        (void) dnssec_signature_cache_add(cache, digest);
         }
-        if (r < 0)
-                return r;
 
         /* Now, fix the ttl, expiry, and remember the synthesizing source and the signer */
         if (r > 0)
@@ -880,6 +1005,17 @@ int dnssec_verify_rrset(
         return 0;
 }
 
+int dnssec_verify_rrset(
+                DnsAnswer *a,
+                const DnsResourceKey *key,
+                DnsResourceRecord *rrsig,
+                DnsResourceRecord *dnskey,
+                usec_t realtime,
+                DnssecResult *result) {
+
+        return dnssec_verify_rrset_internal(a, key, rrsig, dnskey, realtime, NULL, result);
+}
+
 int dnssec_rrsig_match_dnskey(DnsResourceRecord *rrsig, DnsResourceRecord *dnskey, bool revoked_ok) {
 
         assert(rrsig);
@@ -931,6 +1067,7 @@ int dnssec_verify_rrset_search(
                 const DnsResourceKey *key,
                 DnsAnswer *validated_dnskeys,
                 usec_t realtime,
+                DnssecSignatureCache *cache,
                 DnssecResult *result,
                 DnsResourceRecord **ret_rrsig) {
 
@@ -985,7 +1122,7 @@ int dnssec_verify_rrset_search(
                          * the RRSet against the RRSIG and DNSKEY
                          * combination. */
 
-                        r = dnssec_verify_rrset(a, key, rrsig, dnskey, realtime, &one_result);
+                        r = dnssec_verify_rrset_internal(a, key, rrsig, dnskey, realtime, cache, &one_result);
                         if (r < 0)
                                 return r;
 
@@ -2194,12 +2331,16 @@ int dnssec_verify_rrset_search(
                 const DnsResourceKey *key,
                 DnsAnswer *validated_dnskeys,
                 usec_t realtime,
+                DnssecSignatureCache *cache,
                 DnssecResult *result,
                 DnsResourceRecord **ret_rrsig) {
 
         return -EOPNOTSUPP;
 }
 
+void dnssec_signature_cache_flush(DnssecSignatureCache *c) {
+}
+
 int dnssec_has_rrsig(DnsAnswer *a, const DnsResourceKey *key) {
 
         return -EOPNOTSUPP;
@@ -5,6 +5,7 @@ typedef enum DnssecResult DnssecResult;
 typedef enum DnssecVerdict DnssecVerdict;
 
 #include "dns-domain.h"
+#include "ordered-set.h"
 #include "resolved-dns-answer.h"
 #include "resolved-dns-rr.h"
 
@@ -45,11 +46,25 @@ enum DnssecVerdict {
 /* The longest digest we'll ever generate, of all digest algorithms we support */
 #define DNSSEC_HASH_SIZE_MAX (MAX(20, 32))
 
+/* Size of the SHA-256 digests identifying verified signatures */
+#define DNSSEC_SIGNATURE_DIGEST_SIZE 32
+#define DNSSEC_SIGNATURE_CACHE_MAX 4096U
+
+/* Remembers signatures that have been verified successfully, identified by a digest of key, signature and
+ * signed data. Signatures usually remain valid much longer than the TTLs of the RRsets they cover, hence when an
+ * RRset is fetched again after it expired from the cache, it typically comes with the very same signature, and
+ * the public key operation can be skipped. The signature's validity period is checked nonetheless. */
+typedef struct DnssecSignatureCache {
+        OrderedSet *digests;
+} DnssecSignatureCache;
+
+void dnssec_signature_cache_flush(DnssecSignatureCache *c);
+
 int dnssec_rrsig_match_dnskey(DnsResourceRecord *rrsig, DnsResourceRecord *dnskey, bool revoked_ok);
 int dnssec_key_match_rrsig(const DnsResourceKey *key, DnsResourceRecord *rrsig);
 
 int dnssec_verify_rrset(DnsAnswer *answer, const DnsResourceKey *key, DnsResourceRecord *rrsig, DnsResourceRecord *dnskey, usec_t realtime, DnssecResult *result);
-int dnssec_verify_rrset_search(DnsAnswer *answer, const DnsResourceKey *key, DnsAnswer *validated_dnskeys, usec_t realtime, DnssecResult *result, DnsResourceRecord **rrsig);
+int dnssec_verify_rrset_search(DnsAnswer *answer, const DnsResourceKey *key, DnsAnswer *validated_dnskeys, usec_t realtime, DnssecSignatureCache *cache, DnssecResult *result, DnsResourceRecord **rrsig);
 
 int dnssec_verify_dnskey_by_ds(DnsResourceRecord *dnskey, DnsResourceRecord *ds, bool mask_revoke);
 int dnssec_verify_dnskey_by_ds_search(DnsResourceRecord *dnskey, DnsAnswer *validated_ds);
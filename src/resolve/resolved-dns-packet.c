@@ -176,6 +176,7 @@ static void dns_packet_free(DnsPacket *p) {
         dns_question_unref(p->question);
         dns_answer_unref(p->answer);
         dns_resource_record_unref(p->opt);
+        dns_resource_key_unref(p->last_key);
 
         while ((s = hashmap_steal_first_key(p->names)))
                 free(s);
@@ -372,6 +373,10 @@ void dns_packet_truncate(DnsPacket *p, size_t sz) {
                 free(s);
         }
 
+        /* Whatever is appended next might be located where the name of the last key was */
+        if (p->last_key_name >= sz)
+                p->last_key = dns_resource_key_unref(p->last_key);
+
         p->size = sz;
 }
 
@@ -1467,6 +1472,98 @@ int dns_packet_read_name(
         return 0;
 }
 
+int dns_packet_skip_name(
+                DnsPacket *p,
+                bool allow_compression,
+                size_t *start) {
+
+        _cleanup_(rewind_dns_packet) DnsPacketRewinder rewinder;
+        size_t after_rindex = 0, jump_barrier;
+        int r;
+
+        assert(p);
+        INIT_REWINDER(rewinder, p);
+        jump_barrier = p->rindex;
+
+        /* Like dns_packet_read_name(), and applies the same checks, but doesn't actually generate the
+         * name, for the cases where we aren't interested in it. */
+
+        if (p->refuse_compression)
+                allow_compression = false;
+
+        for (;;) {
+                uint8_t c, d;
+
+                r = dns_packet_read_uint8(p, &c, NULL);
+                if (r < 0)
+                        return r;
+
+                if (c == 0)
+                        /* End of name */
+                        break;
+                else if (c <= 63) {
+                        /* Literal label */
+                        r = dns_packet_read(p, c, NULL, NULL);
+                        if (r < 0)
+                                return r;
+                } else if (allow_compression && (c & 0xc0) == 0xc0) {
+                        uint16_t ptr;
+
+                        /* Pointer */
+                        r = dns_packet_read_uint8(p, &d, NULL);
+                        if (r < 0)
+                                return r;
+
+                        ptr = (uint16_t) (c & ~0xc0) << 8 | (uint16_t) d;
+                        if (ptr < DNS_PACKET_HEADER_SIZE || ptr >= jump_barrier)
+                                return -EBADMSG;
+
+                        if (after_rindex == 0)
+                                after_rindex = p->rindex;
+
+                        /* Jumps are limited to a "prior occurrence" (RFC-1035 4.1.4) */
+                        jump_barrier = ptr;
+                        p->rindex = ptr;
+                } else
+                        return -EBADMSG;
+        }
+
+        if (after_rindex != 0)
+                p->rindex = after_rindex;
+
+        if (start)
+                *start = rewinder.saved_rindex;
+        CANCEL_REWINDER(rewinder);
+
+        return 0;
+}
+
+static size_t dns_packet_name_origin(DnsPacket *p) {
+        size_t offset, jump_barrier;
+        const uint8_t *d;
+
+        assert(p);
+
+        /* Returns the offset the name at the current read index actually starts at after following any
+         * compression pointers it begins with, or 0 if that cannot be determined. Doesn't validate the name, nor
+         * modify the read index. */
+
+        offset = jump_barrier = p->rindex;
+        d = DNS_PACKET_DATA(p);
+
+        while (!p->refuse_compression && offset + 2 <= p->size && (d[offset] & 0xc0) == 0xc0) {
+                size_t ptr;
+
+                ptr = (size_t) (d[offset] & ~0xc0) << 8 | (size_t) d[offset + 1];
+                if (ptr < DNS_PACKET_HEADER_SIZE || ptr >= jump_barrier)
+                        return 0;
+
+                offset = jump_barrier = ptr;
+        }
+
+        return offset;
+}
+
 static int dns_packet_read_type_window(DnsPacket *p, Bitmap **types, size_t *start) {
         uint8_t window;
         uint8_t length;
@@ -1569,13 +1666,21 @@ int dns_packet_read_key(DnsPacket *p, DnsResourceKey **ret, bool *ret_cache_flus
         bool cache_flush = false;
         uint16_t class, type;
         DnsResourceKey *key;
+        size_t origin, name_rindex;
         int r;
 
         assert(p);
         assert(ret);
         INIT_REWINDER(rewinder, p);
 
-        r = dns_packet_read_name(p, &name, true, NULL);
+        origin = dns_packet_name_origin(p);
+        name_rindex = p->rindex;
+
+        /* If the name is the one of the key we read last, we don't need to generate it again */
+        if (p->last_key && origin > 0 && origin == p->last_key_name)
+                r = dns_packet_skip_name(p, true, NULL);
+        else
+                r = dns_packet_read_name(p, &name, true, NULL);
         if (r < 0)
                 return r;
 
@@ -1596,11 +1701,36 @@ int dns_packet_read_key(DnsPacket *p, DnsResourceKey **ret, bool *ret_cache_flus
                 }
         }
 
-        key = dns_resource_key_new_consume(class, type, name);
-        if (!key)
-                return -ENOMEM;
+        if (!name && p->last_key->type == type && p->last_key->class == class)
+                /* Same RRset as before, we can just share the key */
+                key = dns_resource_key_ref(p->last_key);
+        else {
+                if (!name) {
+                        size_t after_rindex = p->rindex;
+
+                        /* Same name, but a different RRset, hence we need the name after all */
+                        p->rindex = name_rindex;
+
+                        r = dns_packet_read_name(p, &name, true, NULL);
+                        if (r < 0)
+                                return r;
+
+                        p->rindex = after_rindex;
+                }
+
+                key = dns_resource_key_new_consume(class, type, name);
+                if (!key)
+                        return -ENOMEM;
+
+                name = NULL;
+
+                if (origin > 0) {
+                        dns_resource_key_unref(p->last_key);
+                        p->last_key = dns_resource_key_ref(key);
+                        p->last_key_name = origin;
+                }
+        }
 
-        name = NULL;
         *ret = key;
 
         if (ret_cache_flush)
@@ -65,6 +65,11 @@ struct DnsPacket {
         DnsAnswer *answer;
         DnsResourceRecord *opt;
 
+        /* The key read last, and the offset of the first label of its name after following compression
+         * pointers. Following RRs of the same RRset usually point to the very same name, and can share it. */
+        DnsResourceKey *last_key;
+        size_t last_key_name;
+
         /* Packet reception metadata */
         int ifindex;
         int family, ipproto;
@@ -213,6 +218,7 @@ int dns_packet_read_uint32(DnsPacket *p, uint32_t *ret, size_t *start);
 int dns_packet_read_string(DnsPacket *p, char **ret, size_t *start);
 int dns_packet_read_raw_string(DnsPacket *p, const void **ret, size_t *size, size_t *start);
 int dns_packet_read_name(DnsPacket *p, char **ret, bool allow_compression, size_t *start);
+int dns_packet_skip_name(DnsPacket *p, bool allow_compression, size_t *start);
 int dns_packet_read_key(DnsPacket *p, DnsResourceKey **ret, bool *ret_cache_flush, size_t *start);
 int dns_packet_read_rr(DnsPacket *p, DnsResourceRecord **ret, bool *ret_cache_flush, size_t *start);
 
@@ -101,6 +101,8 @@ static int dns_query_candidate_add_transaction(DnsQueryCandidate *c, DnsResource
         assert(key);
 
         t = dns_scope_find_transaction(c->scope, key, true);
+        if (!t)
+                t = dns_scope_find_shared_transaction(c->scope, key);
         if (!t) {
                 r = dns_transaction_new(&t, c->scope, key);
                 if (r < 0)
@@ -108,6 +110,8 @@ static int dns_query_candidate_add_transaction(DnsQueryCandidate *c, DnsResource
         } else {
                 if (set_contains(c->transactions, t))
                         return 0;
+
+                c->scope->n_transactions_coalesced++;
         }
 
         r = set_ensure_allocated(&c->transactions, NULL);
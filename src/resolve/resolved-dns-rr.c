@@ -491,6 +491,86 @@ static DnsResourceRecord* dns_resource_record_free(DnsResourceRecord *rr) {
 
 DEFINE_TRIVIAL_REF_UNREF_FUNC(DnsResourceRecord, dns_resource_record, dns_resource_record_free);
 
+static size_t bitmap_memory_size(const Bitmap *b) {
+        return b ? sizeof(Bitmap) + b->bitmaps_allocated * sizeof(uint64_t) : 0;
+}
+
+size_t dns_resource_record_memory_size(const DnsResourceRecord *rr) {
+        const DnsTxtItem *i;
+        size_t sz;
+
+        assert(rr);
+        assert(rr->key);
+
+        /* An estimate of the memory an RR uses, not counting its key. RRs parsed from a packet don't carry
+         * their wire format, hence look at the parsed fields, the same ones dns_resource_record_free() frees. */
+
+        sz = sizeof(DnsResourceRecord) + rr->wire_format_size;
+
+        if (rr->unparseable)
+                return sz + rr->generic.data_size;
+
+        switch (rr->key->type) {
+
+        case DNS_TYPE_SRV:
+                return sz + strlen_ptr(rr->srv.name);
+
+        case DNS_TYPE_PTR:
+        case DNS_TYPE_NS:
+        case DNS_TYPE_CNAME:
+        case DNS_TYPE_DNAME:
+                return sz + strlen_ptr(rr->ptr.name);
+
+        case DNS_TYPE_HINFO:
+                return sz + strlen_ptr(rr->hinfo.cpu) + strlen_ptr(rr->hinfo.os);
+
+        case DNS_TYPE_TXT:
+        case DNS_TYPE_SPF:
+                LIST_FOREACH(items, i, rr->txt.items)
+                        sz += sizeof(DnsTxtItem) + i->length + 1;
+                return sz;
+
+        case DNS_TYPE_SOA:
+                return sz + strlen_ptr(rr->soa.mname) + strlen_ptr(rr->soa.rname);
+
+        case DNS_TYPE_MX:
+                return sz + strlen_ptr(rr->mx.exchange);
+
+        case DNS_TYPE_DS:
+                return sz + rr->ds.digest_size;
+
+        case DNS_TYPE_SSHFP:
+                return sz + rr->sshfp.fingerprint_size;
+
+        case DNS_TYPE_DNSKEY:
+                return sz + rr->dnskey.key_size;
+
+        case DNS_TYPE_RRSIG:
+                return sz + strlen_ptr(rr->rrsig.signer) + rr->rrsig.signature_size;
+
+        case DNS_TYPE_NSEC:
+                return sz + strlen_ptr(rr->nsec.next_domain_name) + bitmap_memory_size(rr->nsec.types);
+
+        case DNS_TYPE_NSEC3:
+                return sz + rr->nsec3.next_hashed_name_size + rr->nsec3.salt_size + bitmap_memory_size(rr->nsec3.types);
+
+        case DNS_TYPE_LOC:
+        case DNS_TYPE_A:
+        case DNS_TYPE_AAAA:
+                return sz;
+
+        case DNS_TYPE_TLSA:
+                return sz + rr->tlsa.data_size;
+
+        case DNS_TYPE_CAA:
+                return sz + strlen_ptr(rr->caa.tag) + rr->caa.value_size;
+
+        case DNS_TYPE_OPENPGPKEY:
+        default:
+                return sz + rr->generic.data_size;
+        }
+}
+
 int dns_resource_record_new_reverse(DnsResourceRecord **ret, int family, const union in_addr_union *address, const char *hostname) {
         _cleanup_(dns_resource_key_unrefp) DnsResourceKey *key = NULL;
         _cleanup_(dns_resource_record_unrefp) DnsResourceRecord *rr = NULL;
@@ -1256,6 +1336,40 @@ int dns_resource_record_to_wire_format(DnsResourceRecord *rr, bool canonical) {
         return 0;
 }
 
+int dns_resource_record_new_from_wire_format(DnsResourceRecord **ret, const void *data, size_t size) {
+        _cleanup_(dns_resource_record_unrefp) DnsResourceRecord *rr = NULL;
+        _cleanup_(dns_packet_unrefp) DnsPacket *p = NULL;
+        int r;
+
+        assert(ret);
+        assert(data || size == 0);
+
+        /* The reverse of dns_resource_record_to_wire_format(): parses a single, uncompressed RR */
+
+        if (size > DNS_PACKET_SIZE_MAX - DNS_PACKET_HEADER_SIZE)
+                return -EMSGSIZE;
+
+        r = dns_packet_new(&p, DNS_PROTOCOL_DNS, size, DNS_PACKET_SIZE_MAX);
+        if (r < 0)
+                return r;
+
+        p->refuse_compression = true;
+
+        r = dns_packet_append_blob(p, data, size, NULL);
+        if (r < 0)
+                return r;
+
+        r = dns_packet_read_rr(p, &rr, NULL, NULL);
+        if (r < 0)
+                return r;
+
+        if (p->rindex != p->size)
+                return -EBADMSG;
+
+        *ret = TAKE_PTR(rr);
+        return 0;
+}
+
 int dns_resource_record_signer(DnsResourceRecord *rr, const char **ret) {
         const char *n;
         int r;
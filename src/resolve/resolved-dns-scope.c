@@ -9,6 +9,7 @@
 #include "hostname-util.h"
 #include "missing_network.h"
 #include "random-util.h"
+#include "resolved-dns-cache-file.h"
 #include "resolved-dnssd.h"
 #include "resolved-dns-scope.h"
 #include "resolved-dns-zone.h"
@@ -40,8 +41,14 @@ int dns_scope_new(Manager *m, DnsScope **ret, Link *l, DnsProtocol protocol, int
                 .protocol = protocol,
                 .family = family,
                 .resend_timeout = MULTICAST_RESEND_TIMEOUT_MIN_USEC,
+                .cache.size_max = m->cache_size_max,
+                .cache.generation = &m->dns_cache_generation,
+                .cache.stale_retention_usec = protocol == DNS_PROTOCOL_DNS ? m->stale_retention_usec : 0,
         };
 
+        /* A new scope might change where lookups are routed to */
+        m->dns_cache_generation++;
+
         if (protocol == DNS_PROTOCOL_DNS) {
                 /* Copy DNSSEC mode from the link if it is set there,
                  * otherwise take the manager's DNSSEC mode. Note that
@@ -72,6 +79,9 @@ int dns_scope_new(Manager *m, DnsScope **ret, Link *l, DnsProtocol protocol, int
         /* Enforce ratelimiting for the multicast protocols */
         s->ratelimit = (RateLimit) { MULTICAST_RATELIMIT_INTERVAL_USEC, MULTICAST_RATELIMIT_BURST };
 
+        /* Fill the cache with what a previous instance saved for this scope, if anything */
+        manager_cache_file_restore(m, s);
+
         *ret = s;
         return 0;
 }
@@ -943,6 +953,86 @@ DnsTransaction *dns_scope_find_transaction(DnsScope *scope, DnsResourceKey *key,
         return t;
 }
 
+static DnsServer *dns_scope_get_dns_servers(DnsScope *s) {
+        DnsServer *current;
+
+        assert(s);
+
+        /* Returns the head of the list of servers the current server was picked from */
+
+        current = dns_scope_get_dns_server(s);
+        if (!current)
+                return NULL;
+
+        if (s->link)
+                return s->link->dns_servers;
+        if (current->type == DNS_SERVER_FALLBACK)
+                return s->manager->fallback_dns_servers;
+
+        return s->manager->dns_servers;
+}
+
+static bool dns_scope_same_servers(DnsScope *a, DnsScope *b) {
+        DnsServer *i, *j;
+
+        assert(a);
+        assert(b);
+
+        if (a->protocol != DNS_PROTOCOL_DNS || b->protocol != DNS_PROTOCOL_DNS)
+                return false;
+
+        if (a->dnssec_mode != b->dnssec_mode ||
+            a->dns_over_tls_mode != b->dns_over_tls_mode)
+                return false;
+
+        /* The transaction is sent to the current server, hence this one needs to be the same, as well as all
+         * the ones we might switch to later on */
+        i = dns_scope_get_dns_server(a);
+        j = dns_scope_get_dns_server(b);
+        if (!i || !j || !dns_server_same(i, j))
+                return false;
+
+        for (i = dns_scope_get_dns_servers(a), j = dns_scope_get_dns_servers(b);
+             i && j;
+             i = i->servers_next, j = j->servers_next)
+                if (!dns_server_same(i, j))
+                        return false;
+
+        return !i && !j;
+}
+
+DnsTransaction *dns_scope_find_shared_transaction(DnsScope *scope, DnsResourceKey *key) {
+        DnsTransaction *t;
+        DnsScope *s;
+
+        assert(scope);
+        assert(key);
+
+        /* Try to find an ongoing transaction for the same key on another unicast DNS scope (i.e. of another
+         * link, or the global one) that talks to the very same servers in the very same way. Several links
+         * are frequently configured with the same upstream servers, and there's no point in asking them the
+         * same question more than once. */
+
+        if (scope->protocol != DNS_PROTOCOL_DNS)
+                return NULL;
+
+        LIST_FOREACH(scopes, s, scope->manager->dns_scopes) {
+                if (s == scope || s->protocol != DNS_PROTOCOL_DNS)
+                        continue;
+
+                t = hashmap_get(s->transactions_by_key, key);
+                if (!t || !IN_SET(t->state, DNS_TRANSACTION_PENDING, DNS_TRANSACTION_VALIDATING))
+                        continue;
+
+                if (!dns_scope_same_servers(scope, s))
+                        continue;
+
+                return t;
+        }
+
+        return NULL;
+}
+
 static int dns_scope_make_conflict_packet(
                 DnsScope *s,
                 DnsResourceRecord *rr,
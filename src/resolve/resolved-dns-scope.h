@@ -63,6 +63,12 @@ struct DnsScope {
         Hashmap *transactions_by_key;
         LIST_HEAD(DnsTransaction, transactions);
 
+        /* Statistics: transactions sent to the network, queries attached to an ongoing transaction
+         * (possibly one of another scope talking to the same servers), and transactions that got no reply */
+        unsigned n_transactions_issued;
+        unsigned n_transactions_coalesced;
+        unsigned n_transactions_timeout;
+
         LIST_FIELDS(DnsScope, scopes);
 };
 
@@ -90,6 +96,7 @@ int dns_scope_make_reply_packet(DnsScope *s, uint16_t id, int rcode, DnsQuestion
 void dns_scope_process_query(DnsScope *s, DnsStream *stream, DnsPacket *p);
 
 DnsTransaction *dns_scope_find_transaction(DnsScope *scope, DnsResourceKey *key, bool cache_ok);
+DnsTransaction *dns_scope_find_shared_transaction(DnsScope *scope, DnsResourceKey *key);
 
 int dns_scope_notify_conflict(DnsScope *scope, DnsResourceRecord *rr);
 void dns_scope_check_conflicts(DnsScope *scope, DnsPacket *p);
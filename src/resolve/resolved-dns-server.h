@@ -2,6 +2,7 @@
 #pragma once
 
 #include "in-addr-util.h"
+#include "string-util.h"
 
 typedef struct DnsServer DnsServer;
 
@@ -125,6 +126,16 @@ void dns_server_warn_downgrade(DnsServer *server);
 
 DnsServer *dns_server_find(DnsServer *first, int family, const union in_addr_union *in_addr, int ifindex);
 
+static inline bool dns_server_same(const DnsServer *a, const DnsServer *b) {
+        /* Whether queries to both end up at the same server. Servers of different links are never the same,
+         * even with the same address, since they are reached through different interfaces. */
+        return a->family == b->family &&
+                in_addr_equal(a->family, &a->address, &b->address) > 0 &&
+                a->link == b->link &&
+                a->ifindex == b->ifindex &&
+                streq_ptr(a->server_name, b->server_name);
+}
+
 void dns_server_unlink_all(DnsServer *first);
 void dns_server_unlink_marked(DnsServer *first);
 void dns_server_mark_all(DnsServer *first);
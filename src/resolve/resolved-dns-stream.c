@@ -10,6 +10,9 @@
 #include "resolved-dns-stream.h"
 
 #define DNS_STREAM_TIMEOUT_USEC (10 * USEC_PER_SEC)
+/* How long to keep the connection to a DNS server open while no lookups are pending on it, so that follow-up
+ * lookups don't have to pay for the TCP and TLS handshakes again */
+#define DNS_STREAM_IDLE_TIMEOUT_USEC (60 * USEC_PER_SEC)
 #define DNS_STREAMS_MAX 128
 
 #define DNS_QUERIES_PER_STREAM 32
@@ -282,11 +285,36 @@ static ssize_t dns_stream_read(DnsStream *s, void *buf, size_t count) {
         return ss;
 }
 
+static usec_t dns_stream_timeout_usec(DnsStream *s) {
+        assert(s);
+
+        /* The long-lived connection of a server is allowed to linger while nothing is pending on it */
+        if (s->server && !s->transactions)
+                return DNS_STREAM_IDLE_TIMEOUT_USEC;
+
+        return DNS_STREAM_TIMEOUT_USEC;
+}
+
 static int on_stream_timeout(sd_event_source *es, usec_t usec, void *userdata) {
         DnsStream *s = userdata;
+        usec_t until;
+        int r;
 
         assert(s);
 
+        /* The timer was armed for the shorter timeout while lookups were pending, but they have been answered
+         * or canceled since. Let's keep the connection around until it has been idle for long enough. */
+        until = usec_add(s->last_activity, dns_stream_timeout_usec(s));
+        if (until > usec) {
+                r = sd_event_source_set_time(es, until);
+                if (r >= 0)
+                        r = sd_event_source_set_enabled(es, SD_EVENT_ONESHOT);
+                if (r >= 0)
+                        return 0;
+
+                log_debug_errno(r, "Failed to extend TCP connection timeout, closing connection: %m");
+        }
+
         return dns_stream_complete(s, ETIMEDOUT);
 }
 
@@ -414,8 +442,10 @@ static int on_stream_io(sd_event_source *es, int fd, uint32_t revents, void *use
                                                 return dns_stream_complete(s, -ss);
                                 } else if (ss == 0)
                                         return dns_stream_complete(s, ECONNRESET);
-                                else
+                                else {
+                                        progressed = true;
                                         s->n_read += ss;
+                                }
                         }
 
                         /* Are we done? If so, disable the event source for EPOLLIN */
@@ -446,9 +476,11 @@ static int on_stream_io(sd_event_source *es, int fd, uint32_t revents, void *use
 
         /* If we did something, let's restart the timeout event source */
         if (progressed && s->timeout_event_source) {
-                r = sd_event_source_set_time(s->timeout_event_source, now(clock_boottime_or_monotonic()) + DNS_STREAM_TIMEOUT_USEC);
+                s->last_activity = now(clock_boottime_or_monotonic());
+
+                r = sd_event_source_set_time(s->timeout_event_source, usec_add(s->last_activity, dns_stream_timeout_usec(s)));
                 if (r < 0)
-                        log_warning_errno(errno, "Couldn't restart TCP connection timeout, ignoring: %m");
+                        log_warning_errno(r, "Couldn't restart TCP connection timeout, ignoring: %m");
         }
 
         return 0;
@@ -529,11 +561,13 @@ int dns_stream_new(
 
         (void) sd_event_source_set_description(s->io_event_source, "dns-stream-io");
 
+        s->last_activity = now(clock_boottime_or_monotonic());
+
         r = sd_event_add_time(
                         m->event,
                         &s->timeout_event_source,
                         clock_boottime_or_monotonic(),
-                        now(clock_boottime_or_monotonic()) + DNS_STREAM_TIMEOUT_USEC, 0,
+                        s->last_activity + DNS_STREAM_TIMEOUT_USEC, 0,
                         on_stream_timeout, s);
         if (r < 0)
                 return r;
@@ -568,6 +602,15 @@ int dns_stream_write_packet(DnsStream *s, DnsPacket *p) {
 
         dns_packet_ref(p);
 
+        /* Give the peer the full timeout to respond to this, even if the connection was idle for a while */
+        if (s->timeout_event_source) {
+                s->last_activity = now(clock_boottime_or_monotonic());
+
+                r = sd_event_source_set_time(s->timeout_event_source, usec_add(s->last_activity, dns_stream_timeout_usec(s)));
+                if (r < 0)
+                        log_debug_errno(r, "Couldn't restart TCP connection timeout, ignoring: %m");
+        }
+
         return dns_stream_update_io(s);
 }
 
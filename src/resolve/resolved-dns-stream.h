@@ -55,6 +55,7 @@ struct DnsStream {
 
         sd_event_source *io_event_source;
         sd_event_source *timeout_event_source;
+        usec_t last_activity;
 
         be16_t write_size, read_size;
         DnsPacket *write_packet, *read_packet;
@@ -0,0 +1,273 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include "alloc-util.h"
+#include "resolved-dns-stub-reply.h"
+#include "set.h"
+#include "string-util.h"
+#include "unaligned.h"
+
+/* The maximum number of ready-to-send replies we keep around */
+#define DNS_STUB_REPLIES_MAX 4096U
+
+/* A finished reply packet for a single-question lookup, kept around so that repeated lookups of the same name can
+ * be answered by copying it and patching the transaction ID, the question and the TTLs, without going through the
+ * query logic and the packet serializer again. Such entries are only valid as long as the TTLs have not run out and
+ * the cache generation of the manager did not change, i.e. no cache was flushed and no scope appeared or went away
+ * in the meantime. */
+typedef struct DnsStubReply {
+        DnsResourceKey *key;
+        uint8_t edns;            /* 0: no OPT RR, 1: OPT RR, 2: OPT RR with DO bit */
+
+        void *data;
+        size_t size;
+        size_t question_end;     /* offset of the first byte after the question section */
+        size_t *ttl_offsets;
+        size_t n_ttl_offsets;
+
+        usec_t timestamp;
+        usec_t until;
+        uint64_t generation;
+} DnsStubReply;
+
+static DnsStubReply* dns_stub_reply_free(DnsStubReply *r) {
+        if (!r)
+                return NULL;
+
+        dns_resource_key_unref(r->key);
+        free(r->data);
+        free(r->ttl_offsets);
+        return mfree(r);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(DnsStubReply*, dns_stub_reply_free);
+
+static void dns_stub_reply_hash_func(const DnsStubReply *r, struct siphash *state) {
+        assert(r);
+
+        dns_resource_key_hash_ops.hash(r->key, state);
+        siphash24_compress(&r->edns, sizeof(r->edns), state);
+}
+
+static int dns_stub_reply_compare_func(const DnsStubReply *x, const DnsStubReply *y) {
+        int r;
+
+        r = CMP(x->edns, y->edns);
+        if (r != 0)
+                return r;
+
+        return dns_resource_key_hash_ops.compare(x->key, y->key);
+}
+
+DEFINE_PRIVATE_HASH_OPS_WITH_KEY_DESTRUCTOR(dns_stub_reply_hash_ops, DnsStubReply, dns_stub_reply_hash_func, dns_stub_reply_compare_func, dns_stub_reply_free);
+
+static uint8_t dns_stub_reply_edns(DnsPacket *p) {
+        assert(p);
+
+        if (!p->opt)
+                return 0;
+
+        return DNS_PACKET_DO(p) ? 2 : 1;
+}
+
+static int dns_stub_reply_find_ttls(DnsPacket *p, size_t *ret_question_end, size_t **ret_offsets, size_t *ret_n_offsets, uint32_t *ret_ttl_min) {
+        _cleanup_free_ size_t *offsets = NULL;
+        size_t question_end, n = 0, allocated = 0;
+        uint32_t ttl_min = UINT32_MAX;
+        unsigned i, n_rrs;
+        int r;
+
+        assert(p);
+
+        /* Walks through the reply we just generated, and records where the TTL fields of the RRs are, so that they
+         * can be patched when the reply is sent again later. */
+
+        dns_packet_rewind(p, DNS_PACKET_HEADER_SIZE);
+
+        for (i = 0; i < DNS_PACKET_QDCOUNT(p); i++) {
+                r = dns_packet_skip_name(p, true, NULL);
+                if (r < 0)
+                        return r;
+
+                r = dns_packet_read(p, 4, NULL, NULL);
+                if (r < 0)
+                        return r;
+        }
+
+        question_end = p->rindex;
+
+        n_rrs = DNS_PACKET_ANCOUNT(p) + DNS_PACKET_NSCOUNT(p) + DNS_PACKET_ARCOUNT(p);
+        for (i = 0; i < n_rrs; i++) {
+                uint16_t type, rdlength;
+                size_t offset;
+                uint32_t ttl;
+
+                r = dns_packet_skip_name(p, true, NULL);
+                if (r < 0)
+                        return r;
+
+                r = dns_packet_read_uint16(p, &type, NULL);
+                if (r < 0)
+                        return r;
+
+                r = dns_packet_read(p, 2, NULL, NULL);
+                if (r < 0)
+                        return r;
+
+                r = dns_packet_read_uint32(p, &ttl, &offset);
+                if (r < 0)
+                        return r;
+
+                r = dns_packet_read_uint16(p, &rdlength, NULL);
+                if (r < 0)
+                        return r;
+
+                r = dns_packet_read(p, rdlength, NULL, NULL);
+                if (r < 0)
+                        return r;
+
+                /* The "TTL" of the OPT pseudo-RR carries flags, leave it alone */
+                if (type == DNS_TYPE_OPT)
+                        continue;
+
+                if (!GREEDY_REALLOC(offsets, allocated, n + 1))
+                        return -ENOMEM;
+
+                offsets[n++] = offset;
+                ttl_min = MIN(ttl_min, ttl);
+        }
+
+        *ret_question_end = question_end;
+        *ret_offsets = TAKE_PTR(offsets);
+        *ret_n_offsets = n;
+        *ret_ttl_min = ttl_min;
+        return 0;
+}
+
+int dns_stub_reply_remember(Manager *m, DnsPacket *request, DnsPacket *reply, usec_t timestamp) {
+        _cleanup_(dns_stub_reply_freep) DnsStubReply *e = NULL;
+        DnsStubReply *old;
+        uint32_t ttl_min;
+        int r;
+
+        assert(m);
+        assert(request);
+        assert(reply);
+
+        if (dns_question_size(request->question) != 1)
+                return 0;
+        if (DNS_PACKET_TC(reply) || DNS_PACKET_RCODE(reply) != DNS_RCODE_SUCCESS || DNS_PACKET_ANCOUNT(reply) == 0)
+                return 0;
+
+        e = new(DnsStubReply, 1);
+        if (!e)
+                return -ENOMEM;
+
+        *e = (DnsStubReply) {
+                .key = dns_resource_key_ref(request->question->keys[0]),
+                .edns = dns_stub_reply_edns(request),
+                .size = reply->size,
+                .timestamp = timestamp,
+                .generation = m->dns_cache_generation,
+        };
+
+        r = dns_stub_reply_find_ttls(reply, &e->question_end, &e->ttl_offsets, &e->n_ttl_offsets, &ttl_min);
+        if (r < 0)
+                return r;
+
+        /* Nothing that may be cached for a while? Then don't bother */
+        if (e->n_ttl_offsets == 0 || ttl_min == 0)
+                return 0;
+
+        /* Stop using the reply a bit before the TTL runs out, so that lookups go through the cache again while
+         * it may still refresh its entries in the background */
+        e->until = usec_add(e->timestamp, ttl_min * USEC_PER_SEC / 10 * 9);
+
+        e->data = memdup(DNS_PACKET_DATA(reply), reply->size);
+        if (!e->data)
+                return -ENOMEM;
+
+        r = set_ensure_allocated(&m->dns_stub_replies, &dns_stub_reply_hash_ops);
+        if (r < 0)
+                return r;
+
+        old = set_remove(m->dns_stub_replies, e);
+        dns_stub_reply_free(old);
+
+        /* Full? Then make room by dropping any one entry, this is a shortcut, not a cache that needs to be fair */
+        if (set_size(m->dns_stub_replies) >= DNS_STUB_REPLIES_MAX)
+                dns_stub_reply_free(set_steal_first(m->dns_stub_replies));
+
+        r = set_put(m->dns_stub_replies, e);
+        if (r < 0)
+                return r;
+
+        TAKE_PTR(e);
+        return 0;
+}
+
+int dns_stub_reply_recall(Manager *m, DnsPacket *p, usec_t timestamp, DnsPacket **ret) {
+        _cleanup_(dns_packet_unrefp) DnsPacket *reply = NULL;
+        DnsStubReply *e, template;
+        uint32_t elapsed;
+        uint8_t *data;
+        size_t i;
+        int r;
+
+        assert(m);
+        assert(p);
+        assert(ret);
+
+        /* Returns > 0 and a copy of the remembered reply patched up for this request if there is one, 0 if there
+         * is none and the query needs to be processed the normal way */
+
+        if (dns_question_size(p->question) != 1)
+                return 0;
+
+        template = (DnsStubReply) {
+                .key = p->question->keys[0],
+                .edns = dns_stub_reply_edns(p),
+        };
+
+        e = set_get(m->dns_stub_replies, &template);
+        if (!e)
+                return 0;
+
+        if (e->generation != m->dns_cache_generation || timestamp >= e->until) {
+                dns_stub_reply_free(set_remove(m->dns_stub_replies, e));
+                return 0;
+        }
+
+        if (e->size > DNS_PACKET_PAYLOAD_SIZE_MAX(p))
+                return 0;
+
+        /* The question is copied from the request, so that the client gets back exactly the case it asked with,
+         * but it needs to have the same wire format as ours, so that compression pointers stay valid. */
+        if (p->size < e->question_end ||
+            ascii_strcasecmp_nn((const char*) DNS_PACKET_DATA(p) + DNS_PACKET_HEADER_SIZE, e->question_end - DNS_PACKET_HEADER_SIZE,
+                                (const char*) e->data + DNS_PACKET_HEADER_SIZE, e->question_end - DNS_PACKET_HEADER_SIZE) != 0)
+                return 0;
+
+        r = dns_packet_new(&reply, DNS_PROTOCOL_DNS, e->size, DNS_PACKET_SIZE_MAX);
+        if (r < 0)
+                return r;
+
+        r = dns_packet_append_blob(reply, (const uint8_t*) e->data + DNS_PACKET_HEADER_SIZE, e->size - DNS_PACKET_HEADER_SIZE, NULL);
+        if (r < 0)
+                return r;
+
+        data = DNS_PACKET_DATA(reply);
+        memcpy(data, e->data, DNS_PACKET_HEADER_SIZE);
+        DNS_PACKET_HEADER(reply)->id = DNS_PACKET_ID(p);
+        memcpy(data + DNS_PACKET_HEADER_SIZE, DNS_PACKET_DATA(p) + DNS_PACKET_HEADER_SIZE, e->question_end - DNS_PACKET_HEADER_SIZE);
+
+        elapsed = (uint32_t) ((timestamp - e->timestamp) / USEC_PER_SEC);
+        for (i = 0; i < e->n_ttl_offsets; i++) {
+                uint32_t ttl;
+
+                ttl = unaligned_read_be32(data + e->ttl_offsets[i]);
+                unaligned_write_be32(data + e->ttl_offsets[i], ttl > elapsed ? ttl - elapsed : 0);
+        }
+
+        *ret = TAKE_PTR(reply);
+        return 1;
+}
@@ -0,0 +1,9 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+#include "resolved-dns-packet.h"
+#include "resolved-manager.h"
+#include "time-util.h"
+
+int dns_stub_reply_remember(Manager *m, DnsPacket *request, DnsPacket *reply, usec_t timestamp);
+int dns_stub_reply_recall(Manager *m, DnsPacket *request, usec_t timestamp, DnsPacket **ret);
@@ -3,13 +3,19 @@
 #include "errno-util.h"
 #include "fd-util.h"
 #include "missing_network.h"
+#include "resolved-dns-stub-reply.h"
 #include "resolved-dns-stub.h"
+#include "set.h"
 #include "socket-util.h"
 
 /* The MTU of the loopback device is 64K on Linux, advertise that as maximum datagram size, but subtract the Ethernet,
  * IP and UDP header sizes */
 #define ADVERTISE_DATAGRAM_SIZE_MAX (65536U-14U-20U-8U)
 
+/* How large UDP queries received in a batch may be. Real queries are much smaller, larger ones are only
+ * received on their own if they are the first one in the socket buffer, and dropped otherwise. */
+#define DNS_STUB_BATCH_DATAGRAM_SIZE_MAX 4096U
+
 static int manager_dns_stub_udp_fd(Manager *m);
 static int manager_dns_stub_tcp_fd(Manager *m);
 
@@ -128,6 +134,30 @@ static int dns_stub_finish_reply_packet(
         return 0;
 }
 
+static void dns_stub_flush_replies(Manager *m) {
+        size_t i;
+        int r;
+
+        assert(m);
+
+        if (m->n_dns_stub_udp_replies == 0)
+                return;
+
+        if (m->dns_stub_udp_fd >= 0) {
+                r = manager_send_replies(m, m->dns_stub_udp_fd, LOOPBACK_IFINDEX,
+                                         m->dns_stub_udp_requests, m->dns_stub_udp_replies, m->n_dns_stub_udp_replies);
+                if (r < 0)
+                        log_debug_errno(r, "Failed to send reply packets: %m");
+        }
+
+        for (i = 0; i < m->n_dns_stub_udp_replies; i++) {
+                m->dns_stub_udp_requests[i] = dns_packet_unref(m->dns_stub_udp_requests[i]);
+                m->dns_stub_udp_replies[i] = dns_packet_unref(m->dns_stub_udp_replies[i]);
+        }
+
+        m->n_dns_stub_udp_replies = 0;
+}
+
 static int dns_stub_send(Manager *m, DnsStream *s, DnsPacket *p, DnsPacket *reply) {
         int r;
 
@@ -137,7 +167,19 @@ static int dns_stub_send(Manager *m, DnsStream *s, DnsPacket *p, DnsPacket *repl
 
         if (s)
                 r = dns_stream_write_packet(s, reply);
-        else {
+        else if (m->dns_stub_udp_batching) {
+                /* We are processing a batch of queries, queue the reply and send it along with the others when
+                 * the batch is done */
+
+                if (m->n_dns_stub_udp_replies >= ELEMENTSOF(m->dns_stub_udp_replies))
+                        dns_stub_flush_replies(m);
+
+                m->dns_stub_udp_requests[m->n_dns_stub_udp_replies] = dns_packet_ref(p);
+                m->dns_stub_udp_replies[m->n_dns_stub_udp_replies] = dns_packet_ref(reply);
+                m->n_dns_stub_udp_replies++;
+
+                return 0;
+        } else {
                 int fd;
 
                 fd = manager_dns_stub_udp_fd(m);
@@ -174,6 +216,27 @@ static int dns_stub_send_failure(Manager *m, DnsStream *s, DnsPacket *p, int rco
         return dns_stub_send(m, s, p, reply);
 }
 
+static int dns_stub_send_remembered(Manager *m, DnsStream *s, DnsPacket *p) {
+        _cleanup_(dns_packet_unrefp) DnsPacket *reply = NULL;
+        int r;
+
+        assert(m);
+        assert(p);
+
+        /* Returns > 0 if a remembered reply was sent, 0 if there was none and the query needs to be processed the
+         * normal way */
+
+        r = dns_stub_reply_recall(m, p, now(clock_boottime_or_monotonic()), &reply);
+        if (r <= 0)
+                return r;
+
+        r = dns_stub_send(m, s, p, reply);
+        if (r < 0)
+                return r;
+
+        return 1;
+}
+
 static void dns_stub_query_complete(DnsQuery *q) {
         int r;
 
@@ -219,6 +282,13 @@ static void dns_stub_query_complete(DnsQuery *q) {
                 }
 
                 (void) dns_stub_send(q->manager, q->request_dns_stream, q->request_dns_packet, q->reply_dns_packet);
+
+                if (q->answer_protocol == DNS_PROTOCOL_DNS) {
+                        r = dns_stub_reply_remember(q->manager, q->request_dns_packet, q->reply_dns_packet,
+                                                    now(clock_boottime_or_monotonic()));
+                        if (r < 0)
+                                log_debug_errno(r, "Failed to remember reply packet, ignoring: %m");
+                }
                 break;
         }
 
@@ -330,6 +400,14 @@ static void dns_stub_process_query(Manager *m, DnsStream *s, DnsPacket *p) {
                 goto fail;
         }
 
+        r = dns_stub_send_remembered(m, s, p);
+        if (r < 0)
+                log_debug_errno(r, "Failed to send remembered reply, processing query normally: %m");
+        if (r > 0) {
+                log_debug("Answered query from remembered reply.");
+                return;
+        }
+
         r = dns_query_new(m, &q, p->question, p->question, 0, SD_RESOLVED_PROTOCOLS_ALL|SD_RESOLVED_NO_SEARCH);
         if (r < 0) {
                 log_error_errno(r, "Failed to generate query object: %m");
@@ -374,14 +452,9 @@ fail:
         dns_query_free(q);
 }
 
-static int on_dns_stub_packet(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
-        _cleanup_(dns_packet_unrefp) DnsPacket *p = NULL;
-        Manager *m = userdata;
-        int r;
-
-        r = manager_recv(m, fd, DNS_PROTOCOL_DNS, &p);
-        if (r <= 0)
-                return r;
+static void dns_stub_process_udp_packet(Manager *m, DnsPacket *p) {
+        assert(m);
+        assert(p);
 
         if (dns_packet_validate_query(p) > 0) {
                 log_debug("Got DNS stub UDP query packet for id %u", DNS_PACKET_ID(p));
@@ -389,6 +462,45 @@ static int on_dns_stub_packet(sd_event_source *s, int fd, uint32_t revents, void
                 dns_stub_process_query(m, NULL, p);
         } else
                 log_debug("Invalid DNS stub UDP packet, ignoring.");
+}
+
+static int on_dns_stub_packet(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
+        Manager *m = userdata;
+        ssize_t ms;
+        int i, n, r;
+
+        /* If the first datagram doesn't fit into the packets we receive batches into, read it on its own */
+        ms = next_datagram_size_fd(fd);
+        if (ms < 0)
+                return ms;
+        if ((size_t) ms > DNS_STUB_BATCH_DATAGRAM_SIZE_MAX) {
+                _cleanup_(dns_packet_unrefp) DnsPacket *p = NULL;
+
+                r = manager_recv(m, fd, DNS_PROTOCOL_DNS, &p);
+                if (r <= 0)
+                        return r;
+
+                dns_stub_process_udp_packet(m, p);
+                return 0;
+        }
+
+        n = manager_recv_many(m, fd, DNS_PROTOCOL_DNS, m->dns_stub_udp_packets, ELEMENTSOF(m->dns_stub_udp_packets), DNS_STUB_BATCH_DATAGRAM_SIZE_MAX);
+        if (n <= 0)
+                return n;
+
+        /* Replies that can be generated right away, i.e. cache hits, are collected and sent with a single
+         * syscall once the whole batch is processed */
+        m->dns_stub_udp_batching = true;
+
+        for (i = 0; i < n; i++) {
+                _cleanup_(dns_packet_unrefp) DnsPacket *p = NULL;
+
+                p = TAKE_PTR(m->dns_stub_udp_packets[i]);
+                dns_stub_process_udp_packet(m, p);
+        }
+
+        m->dns_stub_udp_batching = false;
+        dns_stub_flush_replies(m);
 
         return 0;
 }
@@ -582,4 +694,12 @@ void manager_dns_stub_stop(Manager *m) {
 
         m->dns_stub_udp_fd = safe_close(m->dns_stub_udp_fd);
         m->dns_stub_tcp_fd = safe_close(m->dns_stub_tcp_fd);
+
+        m->dns_stub_replies = set_free(m->dns_stub_replies);
+
+        /* The socket is closed already, hence this just drops whatever is still queued */
+        dns_stub_flush_replies(m);
+
+        for (size_t i = 0; i < ELEMENTSOF(m->dns_stub_udp_packets); i++)
+                m->dns_stub_udp_packets[i] = dns_packet_unref(m->dns_stub_udp_packets[i]);
 }
@@ -136,6 +136,10 @@ bool dns_transaction_gc(DnsTransaction *t) {
         if (t->block_gc > 0)
                 return true;
 
+        /* Nobody waits for refresh transactions, keep them around until they are done */
+        if (t->refresh && DNS_TRANSACTION_IS_LIVE(t->state))
+                return true;
+
         if (set_isempty(t->notify_query_candidates) &&
             set_isempty(t->notify_query_candidates_done) &&
             set_isempty(t->notify_zone_items) &&
@@ -305,6 +309,9 @@ void dns_transaction_complete(DnsTransaction *t, DnsTransactionState state) {
         assert(t);
         assert(!DNS_TRANSACTION_IS_LIVE(state));
 
+        if (IN_SET(state, DNS_TRANSACTION_TIMEOUT, DNS_TRANSACTION_ATTEMPTS_MAX_REACHED))
+                t->scope->n_transactions_timeout++;
+
         if (state == DNS_TRANSACTION_DNSSEC_FAILED) {
                 dns_resource_key_to_string(t->key, key_str, sizeof key_str);
 
@@ -364,6 +371,75 @@ void dns_transaction_complete(DnsTransaction *t, DnsTransactionState state) {
         dns_transaction_gc(t);
 }
 
+static void dns_transaction_start_refresh(DnsTransaction *t) {
+        char key_str[DNS_RESOURCE_KEY_STRING_MAX];
+        DnsTransaction *refresh;
+        int r;
+
+        assert(t);
+        assert(t->scope->protocol == DNS_PROTOCOL_DNS);
+
+        /* Starts a new transaction for the same key, which bypasses the cache, and whose only purpose is to put a
+         * fresh answer into the cache. Used to refresh popular entries before they expire, and to replace stale
+         * data we handed out. */
+
+        r = dns_transaction_new(&refresh, t->scope, t->key);
+        if (r < 0) {
+                log_debug_errno(r, "Failed to allocate refresh transaction for <%s>, ignoring: %m",
+                                dns_resource_key_to_string(t->key, key_str, sizeof key_str));
+                return;
+        }
+
+        /* Queries shall not pick up the refresh transaction and wait for it, they are served from the cache in the
+         * meantime. */
+        hashmap_remove_value(t->scope->transactions_by_key, refresh->key, refresh);
+        refresh->refresh = true;
+
+        log_debug("Refreshing cache entry for <%s> in transaction %" PRIu16 ".",
+                  dns_resource_key_to_string(t->key, key_str, sizeof key_str), refresh->id);
+
+        r = dns_transaction_go(refresh);
+        if (r < 0) {
+                log_debug_errno(r, "Failed to start refresh transaction, ignoring: %m");
+                dns_transaction_free(refresh);
+        }
+}
+
+static bool dns_transaction_serve_stale(DnsTransaction *t) {
+        _cleanup_(dns_answer_unrefp) DnsAnswer *answer = NULL;
+        bool authenticated, refresh;
+        int rcode, r;
+
+        assert(t);
+
+        /* If upstream doesn't answer in time or fails, answer with data that expired a while ago instead, as
+         * suggested by RFC 8767, and keep trying to get fresh data in the background. Returns true if the
+         * transaction was completed that way. */
+
+        if (t->scope->protocol != DNS_PROTOCOL_DNS || t->refresh)
+                return false;
+        if (t->scope->cache.stale_retention_usec <= 0)
+                return false;
+
+        r = dns_cache_lookup(&t->scope->cache, t->key, t->clamp_ttl, true, &rcode, &answer, &authenticated, &refresh);
+        if (r <= 0)
+                return false;
+
+        log_debug("Answering transaction %" PRIu16 " with stale data from the cache.", t->id);
+
+        dns_transaction_reset_answer(t);
+        t->answer = TAKE_PTR(answer);
+        t->answer_rcode = rcode;
+        t->answer_authenticated = authenticated;
+        t->answer_source = DNS_TRANSACTION_CACHE;
+
+        if (refresh)
+                dns_transaction_start_refresh(t);
+
+        dns_transaction_complete(t, rcode == DNS_RCODE_SUCCESS ? DNS_TRANSACTION_SUCCESS : DNS_TRANSACTION_RCODE_FAILURE);
+        return true;
+}
+
 static int dns_transaction_pick_server(DnsTransaction *t) {
         DnsServer *server;
 
@@ -535,8 +611,11 @@ static int on_stream_packet(DnsStream *s) {
         p = dns_stream_take_read_packet(s);
         assert(p);
 
+        /* Replies to pipelined lookups may arrive in any order, hence match them by their ID. But only accept a
+         * reply for a transaction that is actually waiting on this stream, the ID might be in use by a new
+         * transaction by now. */
         t = hashmap_get(s->manager->dns_transactions, UINT_TO_PTR(DNS_PACKET_ID(p)));
-        if (t)
+        if (t && t->stream == s)
                 return dns_transaction_on_stream_packet(t, p);
 
         /* Ignore incorrect transaction id as an old transaction can have been canceled. */
@@ -824,6 +903,18 @@ static void dns_transaction_process_dnssec(DnsTransaction *t) {
         if (t->answer_dnssec_result == DNSSEC_INCOMPATIBLE_SERVER)
                 dns_server_warn_downgrade(t->server);
 
+        if (IN_SET(t->answer_rcode, DNS_RCODE_SERVFAIL, DNS_RCODE_REFUSED)) {
+                /* Upstream failed us, answer with stale data if we have some */
+                if (dns_transaction_serve_stale(t))
+                        return;
+
+                /* Don't let a failed refresh replace the data we still have */
+                if (t->refresh) {
+                        dns_transaction_complete(t, DNS_TRANSACTION_RCODE_FAILURE);
+                        return;
+                }
+        }
+
         dns_transaction_cache_answer(t);
 
         if (t->answer_rcode == DNS_RCODE_SUCCESS)
@@ -1302,6 +1393,10 @@ static int on_transaction_timeout(sd_event_source *s, usec_t usec, void *userdat
 
         log_debug("Timeout reached on transaction %" PRIu16 ".", t->id);
 
+        /* Don't let the client wait for the next attempts if we have stale data to serve */
+        if (dns_transaction_serve_stale(t))
+                return 0;
+
         dns_transaction_retry(t, true);
         return 0;
 }
@@ -1441,8 +1536,9 @@ static int dns_transaction_prepare(DnsTransaction *t, usec_t ts) {
         }
 
         /* Check the cache, but only if this transaction is not used
-         * for probing or verifying a zone item. */
-        if (set_isempty(t->notify_zone_items)) {
+         * for probing or verifying a zone item, or for refreshing the cache. */
+        if (set_isempty(t->notify_zone_items) && !t->refresh) {
+                bool refresh;
 
                 /* Before trying the cache, let's make sure we figured out a
                  * server to use. Should this cause a change of server this
@@ -1452,10 +1548,15 @@ static int dns_transaction_prepare(DnsTransaction *t, usec_t ts) {
                 /* Let's then prune all outdated entries */
                 dns_cache_prune(&t->scope->cache);
 
-                r = dns_cache_lookup(&t->scope->cache, t->key, t->clamp_ttl, &t->answer_rcode, &t->answer, &t->answer_authenticated);
+                r = dns_cache_lookup(&t->scope->cache, t->key, t->clamp_ttl, false, &t->answer_rcode, &t->answer, &t->answer_authenticated, &refresh);
                 if (r < 0)
                         return r;
                 if (r > 0) {
+                        /* Popular entry about to expire? Then fetch it again in the background, so that the next
+                         * lookups don't have to wait for it */
+                        if (refresh && t->scope->protocol == DNS_PROTOCOL_DNS)
+                                dns_transaction_start_refresh(t);
+
                         t->answer_source = DNS_TRANSACTION_CACHE;
                         if (t->answer_rcode == DNS_RCODE_SUCCESS)
                                 dns_transaction_complete(t, DNS_TRANSACTION_SUCCESS);
@@ -1709,6 +1810,9 @@ int dns_transaction_go(DnsTransaction *t) {
         }
 
         /* Otherwise, we need to ask the network */
+        if (t->n_attempts == 1)
+                t->scope->n_transactions_issued++;
+
         r = dns_transaction_make_packet(t);
         if (r < 0)
                 return r;
@@ -2857,7 +2961,7 @@ static int dnssec_validate_records(
                                 continue;
                 }
 
-                r = dnssec_verify_rrset_search(t->answer, rr->key, t->validated_keys, USEC_INFINITY, &result, &rrsig);
+                r = dnssec_verify_rrset_search(t->answer, rr->key, t->validated_keys, USEC_INFINITY, &t->scope->manager->dnssec_signature_cache, &result, &rrsig);
                 if (r < 0)
                         return r;
 
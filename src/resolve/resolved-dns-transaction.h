@@ -62,6 +62,10 @@ struct DnsTransaction {
 
         bool probing:1;
 
+        /* Set for transactions started in the background to refresh a cache entry, see
+         * dns_transaction_start_refresh() */
+        bool refresh:1;
+
         DnsPacket *sent, *received;
 
         DnsAnswer *answer;
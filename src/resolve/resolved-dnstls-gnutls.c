@@ -26,6 +26,39 @@ static ssize_t dnstls_stream_writev(gnutls_transport_ptr_t p, const giovec_t *io
         return r;
 }
 
+static void dnstls_stream_save_session(DnsStream *stream) {
+        gnutls_session_t gs;
+
+        assert(stream);
+        assert(stream->encrypted);
+
+        /* Store TLS ticket for faster successive TLS handshakes, as soon as we have one, so that it is
+         * available even if this connection is not closed cleanly. */
+
+        gs = stream->dnstls_data.session;
+
+        if (!stream->server || stream->dnstls_data.session_saved)
+                return;
+        if (stream->dnstls_data.handshake != GNUTLS_E_SUCCESS)
+                return;
+
+        /* With TLS 1.3 the server sends the ticket only after the handshake, wait until it arrived */
+        if (gnutls_protocol_get_version(gs) == GNUTLS_TLS1_3 &&
+            !FLAGS_SET(gnutls_session_get_flags(gs), GNUTLS_SFLAGS_SESSION_TICKET))
+                return;
+
+        if (stream->server->dnstls_data.session_data.data) {
+                gnutls_free(stream->server->dnstls_data.session_data.data);
+                stream->server->dnstls_data.session_data.data = NULL;
+                stream->server->dnstls_data.session_data.size = 0;
+        }
+
+        if (gnutls_session_get_data2(gs, &stream->server->dnstls_data.session_data) < 0)
+                return;
+
+        stream->dnstls_data.session_saved = true;
+}
+
 int dnstls_stream_connect_tls(DnsStream *stream, DnsServer *server) {
         _cleanup_(gnutls_deinitp) gnutls_session_t gs;
         int r;
@@ -131,6 +164,8 @@ int dnstls_stream_on_io(DnsStream *stream, uint32_t revents) {
                 }
 
                 stream->dnstls_events = 0;
+
+                dnstls_stream_save_session(stream);
         }
 
         return 0;
@@ -143,9 +178,7 @@ int dnstls_stream_shutdown(DnsStream *stream, int error) {
         assert(stream->encrypted);
         assert(stream->dnstls_data.session);
 
-        /* Store TLS Ticket for faster successive TLS handshakes */
-        if (stream->server && stream->server->dnstls_data.session_data.size == 0 && stream->dnstls_data.handshake == GNUTLS_E_SUCCESS)
-                gnutls_session_get_data2(stream->dnstls_data.session, &stream->server->dnstls_data.session_data);
+        dnstls_stream_save_session(stream);
 
         if (IN_SET(error, ETIMEDOUT, 0)) {
                 r = gnutls_bye(stream->dnstls_data.session, GNUTLS_SHUT_RDWR);
@@ -195,6 +228,9 @@ ssize_t dnstls_stream_read(DnsStream *stream, void *buf, size_t count) {
         assert(buf);
 
         ss = gnutls_record_recv(stream->dnstls_data.session, buf, count);
+        if (ss > 0)
+                /* A TLS 1.3 session ticket might have been processed along with the data */
+                dnstls_stream_save_session(stream);
         if (ss < 0)
                 switch(ss) {
                 case GNUTLS_E_INTERRUPTED:
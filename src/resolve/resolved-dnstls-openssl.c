@@ -49,6 +49,28 @@ static int dnstls_flush_write_buffer(DnsStream *stream) {
         return 0;
 }
 
+static int dnstls_new_session(SSL *ssl, SSL_SESSION *session) {
+        DnsStream *stream;
+
+        assert(ssl);
+        assert(session);
+
+        /* Called whenever the server hands out a session we can resume later, i.e. after the handshake with
+         * TLS 1.2, and whenever a ticket is received with TLS 1.3. Keep the latest one for the next connection
+         * to this server, so that it doesn't matter whether this connection is closed cleanly. */
+
+        stream = SSL_get_app_data(ssl);
+        if (!stream || !stream->server)
+                return 0;
+
+        if (stream->server->dnstls_data.session)
+                SSL_SESSION_free(stream->server->dnstls_data.session);
+
+        stream->server->dnstls_data.session = session;
+
+        return 1; /* We took ownership of the session */
+}
+
 int dnstls_stream_connect_tls(DnsStream *stream, DnsServer *server) {
         _cleanup_(BIO_freep) BIO *rb = NULL, *wb = NULL;
         _cleanup_(SSL_freep) SSL *s = NULL;
@@ -74,6 +96,7 @@ int dnstls_stream_connect_tls(DnsStream *stream, DnsServer *server) {
                 return -ENOMEM;
 
         SSL_set_connect_state(s);
+        SSL_set_app_data(s, stream);
         r = SSL_set_session(s, server->dnstls_data.session);
         if (r == 0)
                 return -EIO;
@@ -228,22 +251,11 @@ int dnstls_stream_on_io(DnsStream *stream, uint32_t revents) {
 
 int dnstls_stream_shutdown(DnsStream *stream, int error) {
         int ssl_error, r;
-        SSL_SESSION *s;
 
         assert(stream);
         assert(stream->encrypted);
         assert(stream->dnstls_data.ssl);
 
-        if (stream->server) {
-                s = SSL_get1_session(stream->dnstls_data.ssl);
-                if (s) {
-                        if (stream->server->dnstls_data.session)
-                                SSL_SESSION_free(stream->server->dnstls_data.session);
-
-                        stream->server->dnstls_data.session = s;
-                }
-        }
-
         if (error == ETIMEDOUT) {
                 ERR_clear_error();
                 r = SSL_shutdown(stream->dnstls_data.ssl);
@@ -393,6 +405,10 @@ int dnstls_manager_init(Manager *manager) {
 
         (void) SSL_CTX_set_options(manager->dnstls_data.ctx, SSL_OP_NO_COMPRESSION);
 
+        /* Sessions are stored per server by ourselves, see dnstls_new_session() */
+        (void) SSL_CTX_set_session_cache_mode(manager->dnstls_data.ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+        SSL_CTX_sess_set_new_cb(manager->dnstls_data.ctx, dnstls_new_session);
+
         r = SSL_CTX_set_default_verify_paths(manager->dnstls_data.ctx);
         if (r == 0)
                 return log_warning_errno(SYNTHETIC_ERRNO(EIO),
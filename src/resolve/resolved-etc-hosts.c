@@ -1,22 +1,31 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
+#include <sys/inotify.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 
+#include "sd-id128.h"
+
+#include "alloc-util.h"
 #include "fd-util.h"
 #include "fileio.h"
 #include "hostname-util.h"
+#include "mountpoint-util.h"
 #include "resolved-dns-synthesize.h"
 #include "resolved-etc-hosts.h"
+#include "siphash24.h"
 #include "socket-netlink.h"
 #include "string-util.h"
 #include "strv.h"
 #include "time-util.h"
 
-/* Recheck /etc/hosts at most once every 2s */
+/* Recheck /etc/hosts at most once every 2s, unless we get notified about changes via inotify */
 #define ETC_HOSTS_RECHECK_USEC (2*USEC_PER_SEC)
 
+/* Key for hashing the contents of /etc/hosts, so that we don't have to re-parse it if just its timestamp changed */
+#define ETC_HOSTS_HASH_KEY SD_ID128_MAKE(6e,1b,bd,0c,58,90,4e,31,a5,c2,9d,47,3d,f8,02,b6)
+
 static void etc_hosts_item_free(EtcHostsItem *item) {
         strv_free(item->names);
         free(item);
@@ -39,6 +48,7 @@ void manager_etc_hosts_flush(Manager *m) {
         m->etc_hosts_mtime = USEC_INFINITY;
         m->etc_hosts_ino = 0;
         m->etc_hosts_dev = 0;
+        m->etc_hosts_hash = 0;
 }
 
 static int parse_line(EtcHosts *hosts, unsigned nr, const char *line) {
@@ -205,15 +215,24 @@ int etc_hosts_parse(EtcHosts *hosts, FILE *f) {
 
 static int manager_etc_hosts_read(Manager *m) {
         _cleanup_fclose_ FILE *f = NULL;
+        _cleanup_free_ char *contents = NULL;
         struct stat st;
+        uint64_t hash;
+        size_t size;
         usec_t ts;
         int r;
 
         assert_se(sd_event_now(m->event, clock_boottime_or_monotonic(), &ts) >= 0);
 
-        /* See if we checked /etc/hosts recently already */
-        if (m->etc_hosts_last != USEC_INFINITY && m->etc_hosts_last + ETC_HOSTS_RECHECK_USEC > ts)
-                return 0;
+        if (m->etc_hosts_last != USEC_INFINITY) {
+                /* If we watch /etc/hosts via inotify we'll be told when to look at it again */
+                if (m->etc_hosts_event_source)
+                        return 0;
+
+                /* See if we checked /etc/hosts recently already */
+                if (m->etc_hosts_last + ETC_HOSTS_RECHECK_USEC > ts)
+                        return 0;
+        }
 
         m->etc_hosts_last = ts;
 
@@ -247,18 +266,87 @@ static int manager_etc_hosts_read(Manager *m) {
         if (r < 0)
                 return log_error_errno(errno, "Failed to fstat() /etc/hosts: %m");
 
-        r = etc_hosts_parse(&m->etc_hosts, f);
+        r = read_full_stream(f, &contents, &size);
         if (r < 0)
-                return r;
+                return log_error_errno(r, "Failed to read /etc/hosts: %m");
+
+        /* Tools that manage /etc/hosts tend to rewrite it in full even if nothing changed. Don't bother parsing it
+         * again in that case, and keep the names and addresses we already know. */
+        hash = siphash24(contents, size, ETC_HOSTS_HASH_KEY.bytes);
+        if (m->etc_hosts_mtime == USEC_INFINITY || hash != m->etc_hosts_hash) {
+                rewind(f);
+
+                r = etc_hosts_parse(&m->etc_hosts, f);
+                if (r < 0)
+                        return r;
+        } else
+                log_debug("/etc/hosts timestamp changed, but contents didn't, not parsing it again.");
 
         m->etc_hosts_mtime = timespec_load(&st.st_mtim);
         m->etc_hosts_ino = st.st_ino;
         m->etc_hosts_dev = st.st_dev;
+        m->etc_hosts_hash = hash;
         m->etc_hosts_last = ts;
 
         return 1;
 }
 
+static int on_etc_hosts_inotify(sd_event_source *s, const struct inotify_event *event, void *userdata) {
+        Manager *m = userdata;
+
+        assert(m);
+        assert(event);
+
+        if (FLAGS_SET(event->mask, IN_IGNORED)) {
+                /* /etc/ itself went away or was unmounted, fall back to checking the file's timestamp */
+                log_debug("/etc/ watch invalidated, checking /etc/hosts periodically instead.");
+                m->etc_hosts_event_source = sd_event_source_unref(m->etc_hosts_event_source);
+        } else if (!FLAGS_SET(event->mask, IN_Q_OVERFLOW) &&
+                   (event->len == 0 || !streq(event->name, "hosts")))
+                return 0;
+
+        /* Read the file right away, so that the next lookup doesn't have to */
+        m->etc_hosts_last = USEC_INFINITY;
+        (void) manager_etc_hosts_read(m);
+
+        return 0;
+}
+
+int manager_etc_hosts_watch(Manager *m) {
+        struct stat st;
+        int r;
+
+        assert(m);
+
+        if (!m->read_etc_hosts)
+                return 0;
+
+        /* We watch /etc/ rather than /etc/hosts itself, so that we notice the file being created, removed or
+         * atomically replaced by rename(). If /etc/hosts is a symlink or mounted over (as container managers
+         * like to do), changes to it won't show up there, hence stick to checking the timestamp in that case. */
+
+        if (lstat("/etc/hosts", &st) >= 0 && S_ISLNK(st.st_mode)) {
+                log_debug("/etc/hosts is a symlink, not watching it via inotify.");
+                return 0;
+        }
+
+        r = path_is_mount_point("/etc/hosts", NULL, 0);
+        if (r > 0) {
+                log_debug("/etc/hosts is a mount point, not watching it via inotify.");
+                return 0;
+        }
+
+        r = sd_event_add_inotify(m->event, &m->etc_hosts_event_source, "/etc/",
+                                 IN_CLOSE_WRITE|IN_CREATE|IN_DELETE|IN_MOVED_FROM|IN_MOVED_TO|IN_ONLYDIR,
+                                 on_etc_hosts_inotify, m);
+        if (r < 0)
+                return log_debug_errno(r, "Failed to watch /etc/ via inotify, checking /etc/hosts periodically: %m");
+
+        (void) sd_event_source_set_description(m->etc_hosts_event_source, "etc-hosts-inotify");
+
+        return 1;
+}
+
 int manager_etc_hosts_lookup(Manager *m, DnsQuestion* q, DnsAnswer **answer) {
         bool found_a = false, found_aaaa = false;
         struct in_addr_data k = {};
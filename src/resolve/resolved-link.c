@@ -109,6 +109,10 @@ void link_allocate_scopes(Link *l) {
 
         assert(l);
 
+        /* Whatever changed on the link might change how lookups are routed, hence invalidate the replies the stub
+         * remembered */
+        l->manager->dns_cache_generation++;
+
         /* If a link that used to be relevant is no longer, or a link that did not use to be relevant now becomes
          * relevant, let's reinit the learnt global DNS server information, since we might talk to different servers
          * now, even if they have the same addresses as before. */
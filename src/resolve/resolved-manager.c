@@ -29,6 +29,7 @@
 #include "random-util.h"
 #include "resolved-bus.h"
 #include "resolved-conf.h"
+#include "resolved-dns-cache-file.h"
 #include "resolved-dns-stub.h"
 #include "resolved-dnssd.h"
 #include "resolved-etc-hosts.h"
@@ -586,6 +587,7 @@ int manager_new(Manager **ret) {
                 .dnssec_mode = DEFAULT_DNSSEC_MODE,
                 .dns_over_tls_mode = DEFAULT_DNS_OVER_TLS_MODE,
                 .enable_cache = DNS_CACHE_MODE_YES,
+                .cache_size_max = DNS_CACHE_SIZE_MAX_DEFAULT,
                 .dns_stub_listener_mode = DNS_STUB_LISTENER_YES,
                 .read_resolv_conf = true,
                 .need_builtin_fallbacks = true,
@@ -623,6 +625,8 @@ int manager_new(Manager **ret) {
         if (r < 0)
                 return r;
 
+        (void) manager_etc_hosts_watch(m);
+
         r = dnssd_load(m);
         if (r < 0)
                 log_warning_errno(r, "Failed to load DNS-SD configuration files: %m");
@@ -663,6 +667,8 @@ int manager_start(Manager *m) {
         if (r < 0)
                 return r;
 
+        (void) manager_cache_file_load(m);
+
         return 0;
 }
 
@@ -734,72 +740,52 @@ Manager *manager_free(Manager *m) {
         hashmap_free(m->dnssd_services);
 
         dns_trust_anchor_flush(&m->trust_anchor);
+        dnssec_signature_cache_flush(&m->dnssec_signature_cache);
         manager_etc_hosts_flush(m);
+        sd_event_source_unref(m->etc_hosts_event_source);
+
+        manager_cache_file_flush(m);
+        sd_event_source_unref(m->cache_file_event_source);
 
         return mfree(m);
 }
 
-int manager_recv(Manager *m, int fd, DnsProtocol protocol, DnsPacket **ret) {
-        _cleanup_(dns_packet_unrefp) DnsPacket *p = NULL;
-        union {
-                struct cmsghdr header; /* For alignment */
-                uint8_t buffer[CMSG_SPACE(MAXSIZE(struct in_pktinfo, struct in6_pktinfo))
-                               + CMSG_SPACE(int) /* ttl/hoplimit */
-                               + EXTRA_CMSG_SPACE /* kernel appears to require extra buffer space */];
-        } control;
-        union sockaddr_union sa;
-        struct iovec iov;
-        struct msghdr mh = {
-                .msg_name = &sa.sa,
-                .msg_namelen = sizeof(sa),
-                .msg_iov = &iov,
-                .msg_iovlen = 1,
-                .msg_control = &control,
-                .msg_controllen = sizeof(control),
-        };
+typedef union RecvControl {
+        struct cmsghdr header; /* For alignment */
+        uint8_t buffer[CMSG_SPACE(MAXSIZE(struct in_pktinfo, struct in6_pktinfo))
+                       + CMSG_SPACE(int) /* ttl/hoplimit */
+                       + EXTRA_CMSG_SPACE /* kernel appears to require extra buffer space */];
+} RecvControl;
+
+static int manager_recv_finish(Manager *m, DnsProtocol protocol, DnsPacket *p, struct msghdr *mh, size_t l) {
+        const union sockaddr_union *sa;
         struct cmsghdr *cmsg;
-        ssize_t ms, l;
-        int r;
 
         assert(m);
-        assert(fd >= 0);
-        assert(ret);
-
-        ms = next_datagram_size_fd(fd);
-        if (ms < 0)
-                return ms;
+        assert(p);
+        assert(mh);
 
-        r = dns_packet_new(&p, protocol, ms, DNS_PACKET_SIZE_MAX);
-        if (r < 0)
-                return r;
+        /* Fills in the packet's metadata from what recvmsg() or recvmmsg() returned for it */
 
-        iov = IOVEC_MAKE(DNS_PACKET_DATA(p), p->allocated);
+        assert(!(mh->msg_flags & MSG_TRUNC));
 
-        l = recvmsg_safe(fd, &mh, 0);
-        if (IN_SET(l, -EAGAIN, -EINTR))
-                return 0;
-        if (l < 0)
-                return l;
-        if (l == 0)
-                return 0;
-
-        assert(!(mh.msg_flags & MSG_TRUNC));
+        sa = mh->msg_name;
 
-        p->size = (size_t) l;
+        p->size = l;
 
-        p->family = sa.sa.sa_family;
+        p->family = sa->sa.sa_family;
         p->ipproto = IPPROTO_UDP;
         if (p->family == AF_INET) {
-                p->sender.in = sa.in.sin_addr;
-                p->sender_port = be16toh(sa.in.sin_port);
+                p->sender.in = sa->in.sin_addr;
+                p->sender_port = be16toh(sa->in.sin_port);
         } else if (p->family == AF_INET6) {
-                p->sender.in6 = sa.in6.sin6_addr;
-                p->sender_port = be16toh(sa.in6.sin6_port);
-                p->ifindex = sa.in6.sin6_scope_id;
+                p->sender.in6 = sa->in6.sin6_addr;
+                p->sender_port = be16toh(sa->in6.sin6_port);
+                p->ifindex = sa->in6.sin6_scope_id;
         } else
                 return -EAFNOSUPPORT;
 
-        CMSG_FOREACH(cmsg, &mh) {
+        CMSG_FOREACH(cmsg, mh) {
 
                 if (cmsg->cmsg_level == IPPROTO_IPV6) {
                         assert(p->family == AF_INET6);
@@ -857,11 +843,128 @@ int manager_recv(Manager *m, int fd, DnsProtocol protocol, DnsPacket **ret) {
                         p->ifindex = manager_find_ifindex(m, p->family, &p->destination);
         }
 
+        return 0;
+}
+
+int manager_recv(Manager *m, int fd, DnsProtocol protocol, DnsPacket **ret) {
+        _cleanup_(dns_packet_unrefp) DnsPacket *p = NULL;
+        RecvControl control;
+        union sockaddr_union sa;
+        struct iovec iov;
+        struct msghdr mh = {
+                .msg_name = &sa.sa,
+                .msg_namelen = sizeof(sa),
+                .msg_iov = &iov,
+                .msg_iovlen = 1,
+                .msg_control = &control,
+                .msg_controllen = sizeof(control),
+        };
+        ssize_t ms, l;
+        int r;
+
+        assert(m);
+        assert(fd >= 0);
+        assert(ret);
+
+        ms = next_datagram_size_fd(fd);
+        if (ms < 0)
+                return ms;
+
+        r = dns_packet_new(&p, protocol, ms, DNS_PACKET_SIZE_MAX);
+        if (r < 0)
+                return r;
+
+        iov = IOVEC_MAKE(DNS_PACKET_DATA(p), p->allocated);
+
+        l = recvmsg_safe(fd, &mh, 0);
+        if (IN_SET(l, -EAGAIN, -EINTR))
+                return 0;
+        if (l < 0)
+                return l;
+        if (l == 0)
+                return 0;
+
+        r = manager_recv_finish(m, protocol, p, &mh, (size_t) l);
+        if (r < 0)
+                return r;
+
         *ret = TAKE_PTR(p);
 
         return 1;
 }
 
+int manager_recv_many(Manager *m, int fd, DnsProtocol protocol, DnsPacket **packets, size_t n_packets, size_t packet_size) {
+        struct mmsghdr msgs[MANAGER_DATAGRAM_BATCH_MAX];
+        union sockaddr_union sas[MANAGER_DATAGRAM_BATCH_MAX];
+        RecvControl controls[MANAGER_DATAGRAM_BATCH_MAX];
+        struct iovec iovs[MANAGER_DATAGRAM_BATCH_MAX];
+        size_t i, j;
+        int n, r;
+
+        assert(m);
+        assert(fd >= 0);
+        assert(packets);
+        assert(n_packets > 0);
+        assert(n_packets <= MANAGER_DATAGRAM_BATCH_MAX);
+
+        /* Receives up to n_packets datagrams with a single recvmmsg() call, into the packets array. Slots that are
+         * NULL are allocated with room for packet_size bytes, slots that are not used stay allocated for the next
+         * call. Returns the number of packets received, which are placed at the beginning of the array, and are
+         * owned by the caller. Datagrams that don't fit into packet_size are dropped. */
+
+        for (i = 0; i < n_packets; i++) {
+                if (!packets[i]) {
+                        r = dns_packet_new(packets + i, protocol, packet_size, DNS_PACKET_SIZE_MAX);
+                        if (r < 0)
+                                return r;
+                }
+
+                iovs[i] = IOVEC_MAKE(DNS_PACKET_DATA(packets[i]), packets[i]->allocated);
+                msgs[i] = (struct mmsghdr) {
+                        .msg_hdr = {
+                                .msg_name = &sas[i].sa,
+                                .msg_namelen = sizeof(sas[i]),
+                                .msg_iov = iovs + i,
+                                .msg_iovlen = 1,
+                                .msg_control = controls + i,
+                                .msg_controllen = sizeof(controls[i]),
+                        },
+                };
+        }
+
+        n = recvmmsg(fd, msgs, n_packets, MSG_DONTWAIT, NULL);
+        if (n < 0) {
+                if (IN_SET(errno, EAGAIN, EINTR))
+                        return 0;
+
+                return -errno;
+        }
+
+        for (i = 0, j = 0; i < (size_t) n; i++) {
+                if (FLAGS_SET(msgs[i].msg_hdr.msg_flags, MSG_TRUNC)) {
+                        log_debug("Got datagram larger than %zu bytes, ignoring.", packets[i]->allocated);
+                        packets[i] = dns_packet_unref(packets[i]);
+                        continue;
+                }
+                if (msgs[i].msg_len == 0) {
+                        packets[i] = dns_packet_unref(packets[i]);
+                        continue;
+                }
+
+                r = manager_recv_finish(m, protocol, packets[i], &msgs[i].msg_hdr, msgs[i].msg_len);
+                if (r < 0) {
+                        log_debug_errno(r, "Failed to process received datagram, ignoring: %m");
+                        packets[i] = dns_packet_unref(packets[i]);
+                        continue;
+                }
+
+                SWAP_TWO(packets[i], packets[j]);
+                j++;
+        }
+
+        return (int) j;
+}
+
 static int sendmsg_loop(int fd, struct msghdr *mh, int flags) {
         int r;
 
@@ -922,50 +1025,62 @@ int manager_write(Manager *m, int fd, DnsPacket *p) {
         return 0;
 }
 
-static int manager_ipv4_send(
-                Manager *m,
-                int fd,
+typedef struct SendSlot {
+        union sockaddr_union sa;
+        struct iovec iov;
+        union {
+                struct cmsghdr header; /* For alignment */
+                uint8_t buffer[CMSG_SPACE(MAXSIZE(struct in_pktinfo, struct in6_pktinfo))];
+        } control;
+} SendSlot;
+
+static int manager_prepare_send(
+                SendSlot *slot,
+                struct msghdr *mh,
                 int ifindex,
-                const struct in_addr *destination,
+                int family,
+                const union in_addr_union *destination,
                 uint16_t port,
-                const struct in_addr *source,
+                const union in_addr_union *source,
                 DnsPacket *p) {
-        union {
-                struct cmsghdr header; /* For alignment */
-                uint8_t buffer[CMSG_SPACE(sizeof(struct in_pktinfo))];
-        } control = {};
-        union sockaddr_union sa;
-        struct iovec iov;
-        struct msghdr mh = {
-                .msg_iov = &iov,
-                .msg_iovlen = 1,
-                .msg_name = &sa.sa,
-                .msg_namelen = sizeof(sa.in),
-        };
 
-        assert(m);
-        assert(fd >= 0);
+        struct cmsghdr *cmsg;
+
+        assert(slot);
+        assert(mh);
         assert(destination);
         assert(port > 0);
         assert(p);
 
-        iov = IOVEC_MAKE(DNS_PACKET_DATA(p), p->size);
+        /* Fills in mh for sending p to the specified destination, using the buffers in slot */
 
-        sa = (union sockaddr_union) {
-                .in.sin_family = AF_INET,
-                .in.sin_addr = *destination,
-                .in.sin_port = htobe16(port),
+        *slot = (SendSlot) {
+                .iov = IOVEC_MAKE(DNS_PACKET_DATA(p), p->size),
+        };
+        *mh = (struct msghdr) {
+                .msg_iov = &slot->iov,
+                .msg_iovlen = 1,
+                .msg_name = &slot->sa.sa,
         };
 
-        if (ifindex > 0) {
-                struct cmsghdr *cmsg;
+        if (family == AF_INET) {
                 struct in_pktinfo *pi;
 
-                mh.msg_control = &control;
-                mh.msg_controllen = CMSG_LEN(sizeof(struct in_pktinfo));
+                slot->sa.in = (struct sockaddr_in) {
+                        .sin_family = AF_INET,
+                        .sin_addr = destination->in,
+                        .sin_port = htobe16(port),
+                };
+                mh->msg_namelen = sizeof(slot->sa.in);
+
+                if (ifindex <= 0)
+                        return 0;
+
+                mh->msg_control = &slot->control;
+                mh->msg_controllen = CMSG_LEN(sizeof(struct in_pktinfo));
 
-                cmsg = CMSG_FIRSTHDR(&mh);
-                cmsg->cmsg_len = mh.msg_controllen;
+                cmsg = CMSG_FIRSTHDR(mh);
+                cmsg->cmsg_len = mh->msg_controllen;
                 cmsg->cmsg_level = IPPROTO_IP;
                 cmsg->cmsg_type = IP_PKTINFO;
 
@@ -973,58 +1088,30 @@ static int manager_ipv4_send(
                 pi->ipi_ifindex = ifindex;
 
                 if (source)
-                        pi->ipi_spec_dst = *source;
-        }
-
-        return sendmsg_loop(fd, &mh, 0);
-}
-
-static int manager_ipv6_send(
-                Manager *m,
-                int fd,
-                int ifindex,
-                const struct in6_addr *destination,
-                uint16_t port,
-                const struct in6_addr *source,
-                DnsPacket *p) {
-
-        union {
-                struct cmsghdr header; /* For alignment */
-                uint8_t buffer[CMSG_SPACE(sizeof(struct in6_pktinfo))];
-        } control = {};
-        union sockaddr_union sa;
-        struct iovec iov;
-        struct msghdr mh = {
-                .msg_iov = &iov,
-                .msg_iovlen = 1,
-                .msg_name = &sa.sa,
-                .msg_namelen = sizeof(sa.in6),
-        };
+                        pi->ipi_spec_dst = source->in;
 
-        assert(m);
-        assert(fd >= 0);
-        assert(destination);
-        assert(port > 0);
-        assert(p);
+                return 0;
+        }
 
-        iov = IOVEC_MAKE(DNS_PACKET_DATA(p), p->size);
+        if (family == AF_INET6) {
+                struct in6_pktinfo *pi;
 
-        sa = (union sockaddr_union) {
-                .in6.sin6_family = AF_INET6,
-                .in6.sin6_addr = *destination,
-                .in6.sin6_port = htobe16(port),
-                .in6.sin6_scope_id = ifindex,
-        };
+                slot->sa.in6 = (struct sockaddr_in6) {
+                        .sin6_family = AF_INET6,
+                        .sin6_addr = destination->in6,
+                        .sin6_port = htobe16(port),
+                        .sin6_scope_id = ifindex,
+                };
+                mh->msg_namelen = sizeof(slot->sa.in6);
 
-        if (ifindex > 0) {
-                struct cmsghdr *cmsg;
-                struct in6_pktinfo *pi;
+                if (ifindex <= 0)
+                        return 0;
 
-                mh.msg_control = &control;
-                mh.msg_controllen = CMSG_LEN(sizeof(struct in6_pktinfo));
+                mh->msg_control = &slot->control;
+                mh->msg_controllen = CMSG_LEN(sizeof(struct in6_pktinfo));
 
-                cmsg = CMSG_FIRSTHDR(&mh);
-                cmsg->cmsg_len = mh.msg_controllen;
+                cmsg = CMSG_FIRSTHDR(mh);
+                cmsg->cmsg_len = mh->msg_controllen;
                 cmsg->cmsg_level = IPPROTO_IPV6;
                 cmsg->cmsg_type = IPV6_PKTINFO;
 
@@ -1032,10 +1119,12 @@ static int manager_ipv6_send(
                 pi->ipi6_ifindex = ifindex;
 
                 if (source)
-                        pi->ipi6_addr = *source;
+                        pi->ipi6_addr = source->in6;
+
+                return 0;
         }
 
-        return sendmsg_loop(fd, &mh, 0);
+        return -EAFNOSUPPORT;
 }
 
 int manager_send(
@@ -1048,6 +1137,10 @@ int manager_send(
                 const union in_addr_union *source,
                 DnsPacket *p) {
 
+        struct msghdr mh;
+        SendSlot slot;
+        int r;
+
         assert(m);
         assert(fd >= 0);
         assert(destination);
@@ -1056,12 +1149,65 @@ int manager_send(
 
         log_debug("Sending %s packet with id %" PRIu16 " on interface %i/%s.", DNS_PACKET_QR(p) ? "response" : "query", DNS_PACKET_ID(p), ifindex, af_to_name(family));
 
-        if (family == AF_INET)
-                return manager_ipv4_send(m, fd, ifindex, &destination->in, port, source ? &source->in : NULL, p);
-        if (family == AF_INET6)
-                return manager_ipv6_send(m, fd, ifindex, &destination->in6, port, source ? &source->in6 : NULL, p);
+        r = manager_prepare_send(&slot, &mh, ifindex, family, destination, port, source, p);
+        if (r < 0)
+                return r;
 
-        return -EAFNOSUPPORT;
+        return sendmsg_loop(fd, &mh, 0);
+}
+
+int manager_send_replies(Manager *m, int fd, int ifindex, DnsPacket **requests, DnsPacket **replies, size_t n) {
+        struct mmsghdr msgs[MANAGER_DATAGRAM_BATCH_MAX];
+        SendSlot slots[MANAGER_DATAGRAM_BATCH_MAX];
+        size_t i;
+        int r;
+
+        assert(m);
+        assert(fd >= 0);
+        assert(requests || n == 0);
+        assert(replies || n == 0);
+        assert(n <= MANAGER_DATAGRAM_BATCH_MAX);
+
+        /* Sends each of the replies back to the sender of the matching request, from the address the request was
+         * sent to, with a single sendmmsg() call where possible. */
+
+        for (i = 0; i < n; i++) {
+                log_debug("Sending response packet with id %" PRIu16 " on interface %i/%s.",
+                          DNS_PACKET_ID(replies[i]), ifindex, af_to_name(requests[i]->family));
+
+                msgs[i] = (struct mmsghdr) {};
+                r = manager_prepare_send(slots + i, &msgs[i].msg_hdr, ifindex, requests[i]->family,
+                                         &requests[i]->sender, requests[i]->sender_port,
+                                         &requests[i]->destination, replies[i]);
+                if (r < 0)
+                        return r;
+        }
+
+        i = 0;
+        while (i < n) {
+                int k;
+
+                k = sendmmsg(fd, msgs + i, n - i, 0);
+                if (k < 0) {
+                        if (errno == EINTR)
+                                continue;
+                        if (errno != EAGAIN)
+                                return -errno;
+
+                        /* The socket buffer is full, send the rest one by one, which waits for it to drain */
+                        for (; i < n; i++) {
+                                r = sendmsg_loop(fd, &msgs[i].msg_hdr, 0);
+                                if (r < 0)
+                                        return r;
+                        }
+
+                        break;
+                }
+
+                i += k;
+        }
+
+        return 0;
 }
 
 uint32_t manager_find_mtu(Manager *m) {
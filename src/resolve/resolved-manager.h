@@ -24,6 +24,9 @@ typedef struct Manager Manager;
 #define MANAGER_SEARCH_DOMAINS_MAX 256
 #define MANAGER_DNS_SERVERS_MAX 256
 
+/* How many datagrams to receive or send with one recvmmsg() or sendmmsg() call */
+#define MANAGER_DATAGRAM_BATCH_MAX 16U
+
 typedef struct EtcHosts {
         Hashmap *by_address;
         Hashmap *by_name;
@@ -38,6 +41,9 @@ struct Manager {
         DnssecMode dnssec_mode;
         DnsOverTlsMode dns_over_tls_mode;
         DnsCacheMode enable_cache;
+        size_t cache_size_max;
+        usec_t stale_retention_usec;
+        bool preserve_cache;
         DnsStubListenerMode dns_stub_listener_mode;
 
 #if ENABLE_DNS_OVER_TLS
@@ -76,6 +82,7 @@ struct Manager {
         usec_t resolv_conf_mtime;
 
         DnsTrustAnchor trust_anchor;
+        DnssecSignatureCache dnssec_signature_cache;
 
         LIST_HEAD(DnsScope, dns_scopes);
         DnsScope *unicast_scope;
@@ -129,6 +136,8 @@ struct Manager {
         usec_t etc_hosts_last, etc_hosts_mtime;
         ino_t etc_hosts_ino;
         dev_t etc_hosts_dev;
+        uint64_t etc_hosts_hash;
+        sd_event_source *etc_hosts_event_source;
         bool read_etc_hosts;
 
         /* Local DNS stub on 127.0.0.53:53 */
@@ -138,6 +147,22 @@ struct Manager {
         sd_event_source *dns_stub_udp_event_source;
         sd_event_source *dns_stub_tcp_event_source;
 
+        /* Packets the stub receives the next batch of UDP queries into, and the replies it queued while
+         * processing a batch, to send them all at once afterwards */
+        DnsPacket *dns_stub_udp_packets[MANAGER_DATAGRAM_BATCH_MAX];
+        DnsPacket *dns_stub_udp_requests[MANAGER_DATAGRAM_BATCH_MAX];
+        DnsPacket *dns_stub_udp_replies[MANAGER_DATAGRAM_BATCH_MAX];
+        size_t n_dns_stub_udp_replies;
+        bool dns_stub_udp_batching;
+
+        /* Ready-to-send replies of the stub, valid as long as the generation matches */
+        Set *dns_stub_replies;
+
+        /* Cache entries saved by the previous instance, for scopes that don't exist yet, indexed by ifindex */
+        Hashmap *cache_file_entries;
+        sd_event_source *cache_file_event_source;
+        uint64_t dns_cache_generation;
+
         Hashmap *polkit_registry;
 };
 
@@ -152,7 +177,9 @@ uint32_t manager_find_mtu(Manager *m);
 
 int manager_write(Manager *m, int fd, DnsPacket *p);
 int manager_send(Manager *m, int fd, int ifindex, int family, const union in_addr_union *destination, uint16_t port, const union in_addr_union *source, DnsPacket *p);
+int manager_send_replies(Manager *m, int fd, int ifindex, DnsPacket **requests, DnsPacket **replies, size_t n);
 int manager_recv(Manager *m, int fd, DnsProtocol protocol, DnsPacket **ret);
+int manager_recv_many(Manager *m, int fd, DnsProtocol protocol, DnsPacket **packets, size_t n_packets, size_t packet_size);
 
 int manager_find_ifindex(Manager *m, int family, const union in_addr_union *in_addr);
 LinkAddress* manager_find_link_address(Manager *m, int family, const union in_addr_union *in_addr);
@@ -12,6 +12,7 @@
 #include "main-func.h"
 #include "mkdir.h"
 #include "resolved-conf.h"
+#include "resolved-dns-cache-file.h"
 #include "resolved-manager.h"
 #include "resolved-resolv-conf.h"
 #include "selinux-util.h"
@@ -85,6 +86,8 @@ static int run(int argc, char *argv[]) {
         if (r < 0)
                 return log_error_errno(r, "Event loop failed: %m");
 
+        (void) manager_cache_file_save(m);
+
         return 0;
 }
 
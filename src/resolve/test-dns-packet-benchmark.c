@@ -0,0 +1,107 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include "in-addr-util.h"
+#include "log.h"
+#include "resolved-dns-answer.h"
+#include "resolved-dns-packet.h"
+#include "resolved-dns-question.h"
+#include "resolved-dns-rr.h"
+#include "tests.h"
+
+/* Benchmarks serializing and parsing a typical reply packet, i.e. one for a name that is a CNAME for a name
+ * with a couple of addresses. */
+
+typedef struct Reply {
+        DnsQuestion *question;
+        DnsAnswer *answer;
+        DnsPacket *packet;
+} Reply;
+
+static void add_rr(DnsAnswer *answer, DnsResourceRecord *rr) {
+        rr->ttl = 3600;
+        assert_se(dns_answer_add(answer, rr, 0, DNS_ANSWER_CACHEABLE) >= 0);
+        dns_resource_record_unref(rr);
+}
+
+static void add_address(DnsAnswer *answer, const char *name, int family, const char *address) {
+        DnsResourceRecord *rr = NULL;
+        union in_addr_union a;
+
+        assert_se(in_addr_from_string(family, address, &a) >= 0);
+        assert_se(dns_resource_record_new_address(&rr, family, &a, name) >= 0);
+        add_rr(answer, rr);
+}
+
+static void reply_init(Reply *r) {
+        _cleanup_(dns_resource_key_unrefp) DnsResourceKey *key = NULL;
+        DnsResourceRecord *rr;
+
+        assert_se(key = dns_resource_key_new(DNS_CLASS_IN, DNS_TYPE_A, "www.example.com"));
+        assert_se(r->question = dns_question_new(1));
+        assert_se(dns_question_add(r->question, key) >= 0);
+
+        assert_se(r->answer = dns_answer_new(6));
+
+        assert_se(rr = dns_resource_record_new_full(DNS_CLASS_IN, DNS_TYPE_CNAME, "www.example.com"));
+        assert_se(rr->cname.name = strdup("www.cdn.example.com"));
+        add_rr(r->answer, rr);
+
+        add_address(r->answer, "www.cdn.example.com", AF_INET, "192.0.2.1");
+        add_address(r->answer, "www.cdn.example.com", AF_INET, "192.0.2.2");
+        add_address(r->answer, "www.cdn.example.com", AF_INET, "192.0.2.3");
+        add_address(r->answer, "www.cdn.example.com", AF_INET, "192.0.2.4");
+}
+
+static void reply_done(Reply *r) {
+        dns_question_unref(r->question);
+        dns_answer_unref(r->answer);
+        dns_packet_unref(r->packet);
+}
+
+static DnsPacket *reply_serialize(Reply *r) {
+        _cleanup_(dns_packet_unrefp) DnsPacket *p = NULL;
+
+        assert_se(dns_packet_new(&p, DNS_PROTOCOL_DNS, 0, DNS_PACKET_SIZE_MAX) >= 0);
+
+        DNS_PACKET_HEADER(p)->flags = htobe16(DNS_PACKET_MAKE_FLAGS(1, 0, 0, 0, 1, 1, 0, 0, DNS_RCODE_SUCCESS));
+        DNS_PACKET_HEADER(p)->qdcount = htobe16(dns_question_size(r->question));
+        DNS_PACKET_HEADER(p)->ancount = htobe16(dns_answer_size(r->answer));
+
+        assert_se(dns_packet_append_question(p, r->question) >= 0);
+        assert_se(dns_packet_append_answer(p, r->answer) >= 0);
+
+        return TAKE_PTR(p);
+}
+
+static void serialize_one(void *userdata) {
+        dns_packet_unref(reply_serialize(userdata));
+}
+
+static void parse_one(void *userdata) {
+        _cleanup_(dns_packet_unrefp) DnsPacket *p = NULL;
+        Reply *r = userdata;
+
+        /* Like a packet we just received */
+        assert_se(dns_packet_new(&p, DNS_PROTOCOL_DNS, r->packet->size, DNS_PACKET_SIZE_MAX) >= 0);
+        memcpy(DNS_PACKET_DATA(p), DNS_PACKET_DATA(r->packet), r->packet->size);
+        p->size = r->packet->size;
+
+        assert_se(dns_packet_validate_reply(p) > 0);
+        assert_se(dns_packet_extract(p) >= 0);
+        assert_se(dns_answer_size(p->answer) == dns_answer_size(r->answer));
+}
+
+int main(int argc, char *argv[]) {
+        Reply r = {};
+
+        test_setup_logging(LOG_INFO);
+
+        reply_init(&r);
+        benchmark_run("dns-packet-serialize", serialize_one, &r, 1);
+
+        r.packet = reply_serialize(&r);
+        benchmark_run("dns-packet-parse", parse_one, &r, 1);
+
+        reply_done(&r);
+        return 0;
+}
@@ -7,6 +7,7 @@
 #include "alloc-util.h"
 #include "fileio.h"
 #include "glob-util.h"
+#include "in-addr-util.h"
 #include "log.h"
 #include "macro.h"
 #include "resolved-dns-packet.h"
@@ -90,6 +91,67 @@ static void test_packet_from_file(const char* filename, bool canonical) {
         }
 }
 
+static void append_address(DnsPacket *p, const char *name, int family, const char *address) {
+        _cleanup_(dns_resource_record_unrefp) DnsResourceRecord *rr = NULL;
+        union in_addr_union a;
+
+        assert_se(in_addr_from_string(family, address, &a) >= 0);
+        assert_se(dns_resource_record_new_address(&rr, family, &a, name) >= 0);
+        rr->ttl = 3600;
+        assert_se(dns_packet_append_rr(p, rr, 0, NULL, NULL) >= 0);
+}
+
+static void test_packet_shared_keys(void) {
+        _cleanup_(dns_resource_key_unrefp) DnsResourceKey *key = NULL;
+        _cleanup_(dns_packet_unrefp) DnsPacket *p = NULL;
+        DnsResourceKey *k;
+        size_t rindex;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(dns_packet_new(&p, DNS_PROTOCOL_DNS, 0, DNS_PACKET_SIZE_MAX) >= 0);
+
+        assert_se(key = dns_resource_key_new(DNS_CLASS_IN, DNS_TYPE_A, "www.example.com"));
+        assert_se(dns_packet_append_key(p, key, 0, NULL) >= 0);
+
+        append_address(p, "www.example.com", AF_INET, "192.0.2.1");
+        append_address(p, "www.example.com", AF_INET, "192.0.2.2");
+        append_address(p, "www.example.com", AF_INET6, "2001:db8::1");
+        append_address(p, "mail.example.com", AF_INET, "192.0.2.3");
+
+        DNS_PACKET_HEADER(p)->qdcount = htobe16(1);
+        DNS_PACKET_HEADER(p)->ancount = htobe16(4);
+
+        /* Skipping a compressed name ends up where reading it does */
+        dns_packet_rewind(p, DNS_PACKET_HEADER_SIZE);
+        assert_se(dns_packet_skip_name(p, true, NULL) >= 0);
+        rindex = p->rindex;
+        dns_packet_rewind(p, DNS_PACKET_HEADER_SIZE);
+        {
+                _cleanup_free_ char *name = NULL;
+
+                assert_se(dns_packet_read_name(p, &name, true, NULL) >= 0);
+                assert_se(streq(name, "www.example.com"));
+                assert_se(p->rindex == rindex);
+        }
+
+        assert_se(dns_packet_extract(p) >= 0);
+        assert_se(dns_question_size(p->question) == 1);
+        assert_se(dns_answer_size(p->answer) == 4);
+
+        /* The A RRs refer to the question's name, and hence share its key, while the others get their own */
+        k = p->question->keys[0];
+        assert_se(p->answer->items[0].rr->key == k);
+        assert_se(p->answer->items[1].rr->key == k);
+
+        assert_se(p->answer->items[2].rr->key != k);
+        assert_se(p->answer->items[2].rr->key->type == DNS_TYPE_AAAA);
+        assert_se(streq(dns_resource_key_name(p->answer->items[2].rr->key), "www.example.com"));
+
+        assert_se(p->answer->items[3].rr->key->type == DNS_TYPE_A);
+        assert_se(streq(dns_resource_key_name(p->answer->items[3].rr->key), "mail.example.com"));
+}
+
 int main(int argc, char **argv) {
         int i, N;
         _cleanup_globfree_ glob_t g = {};
@@ -97,6 +159,8 @@ int main(int argc, char **argv) {
 
         log_parse_environment();
 
+        test_packet_shared_keys();
+
         if (argc >= 2) {
                 N = argc - 1;
                 fnames = argv + 1;
@@ -351,6 +351,102 @@ static void test_dnssec_verify_rrset(void) {
         assert_se(result == DNSSEC_VALIDATED);
 }
 
+static void test_dnssec_signature_cache(void) {
+
+        static const uint8_t signature_blob[] = {
+                0x7f, 0x79, 0xdd, 0x5e, 0x89, 0x79, 0x18, 0xd0, 0x34, 0x86, 0x8c, 0x72, 0x77, 0x75, 0x48, 0x4d,
+                0xc3, 0x7d, 0x38, 0x04, 0xab, 0xcd, 0x9e, 0x4c, 0x82, 0xb0, 0x92, 0xca, 0xe9, 0x66, 0xe9, 0x6e,
+                0x47, 0xc7, 0x68, 0x8c, 0x94, 0xf6, 0x69, 0xcb, 0x75, 0x94, 0xe6, 0x30, 0xa6, 0xfb, 0x68, 0x64,
+                0x96, 0x1a, 0x84, 0xe1, 0xdc, 0x16, 0x4c, 0x83, 0x6c, 0x44, 0xf2, 0x74, 0x4d, 0x74, 0x79, 0x8f,
+                0xf3, 0xf4, 0x63, 0x0d, 0xef, 0x5a, 0xe7, 0xe2, 0xfd, 0xf2, 0x2b, 0x38, 0x7c, 0x28, 0x96, 0x9d,
+                0xb6, 0xcd, 0x5c, 0x3b, 0x57, 0xe2, 0x24, 0x78, 0x65, 0xd0, 0x9e, 0x77, 0x83, 0x09, 0x6c, 0xff,
+                0x3d, 0x52, 0x3f, 0x6e, 0xd1, 0xed, 0x2e, 0xf9, 0xee, 0x8e, 0xa6, 0xbe, 0x9a, 0xa8, 0x87, 0x76,
+                0xd8, 0x77, 0xcc, 0x96, 0xa0, 0x98, 0xa1, 0xd1, 0x68, 0x09, 0x43, 0xcf, 0x56, 0xd9, 0xd1, 0x66,
+        };
+
+        static const uint8_t dnskey_blob[] = {
+                0x03, 0x01, 0x00, 0x01, 0x9b, 0x49, 0x9b, 0xc1, 0xf9, 0x9a, 0xe0, 0x4e, 0xcf, 0xcb, 0x14, 0x45,
+                0x2e, 0xc9, 0xf9, 0x74, 0xa7, 0x18, 0xb5, 0xf3, 0xde, 0x39, 0x49, 0xdf, 0x63, 0x33, 0x97, 0x52,
+                0xe0, 0x8e, 0xac, 0x50, 0x30, 0x8e, 0x09, 0xd5, 0x24, 0x3d, 0x26, 0xa4, 0x49, 0x37, 0x2b, 0xb0,
+                0x6b, 0x1b, 0xdf, 0xde, 0x85, 0x83, 0xcb, 0x22, 0x4e, 0x60, 0x0a, 0x91, 0x1a, 0x1f, 0xc5, 0x40,
+                0xb1, 0xc3, 0x15, 0xc1, 0x54, 0x77, 0x86, 0x65, 0x53, 0xec, 0x10, 0x90, 0x0c, 0x91, 0x00, 0x5e,
+                0x15, 0xdc, 0x08, 0x02, 0x4c, 0x8c, 0x0d, 0xc0, 0xac, 0x6e, 0xc4, 0x3e, 0x1b, 0x80, 0x19, 0xe4,
+                0xf7, 0x5f, 0x77, 0x51, 0x06, 0x87, 0x61, 0xde, 0xa2, 0x18, 0x0f, 0x40, 0x8b, 0x79, 0x72, 0xfa,
+                0x8d, 0x1a, 0x44, 0x47, 0x0d, 0x8e, 0x3a, 0x2d, 0xc7, 0x39, 0xbf, 0x56, 0x28, 0x97, 0xd9, 0x20,
+                0x4f, 0x00, 0x51, 0x3b,
+        };
+
+        _cleanup_(dns_resource_record_unrefp) DnsResourceRecord *a = NULL, *forged = NULL, *rrsig = NULL, *dnskey = NULL;
+        _cleanup_(dns_answer_unrefp) DnsAnswer *answer = NULL, *forged_answer = NULL, *keys = NULL;
+        _cleanup_(dnssec_signature_cache_flush) DnssecSignatureCache cache = {};
+        DnssecResult result;
+        unsigned i;
+
+        /* Same RRset as above, but verified through the signature cache */
+
+        a = dns_resource_record_new_full(DNS_CLASS_IN, DNS_TYPE_A, "nasa.gov");
+        assert_se(a);
+        a->a.in_addr.s_addr = inet_addr("52.0.14.116");
+
+        forged = dns_resource_record_new_full(DNS_CLASS_IN, DNS_TYPE_A, "nasa.gov");
+        assert_se(forged);
+        forged->a.in_addr.s_addr = inet_addr("52.0.14.117");
+
+        rrsig = dns_resource_record_new_full(DNS_CLASS_IN, DNS_TYPE_RRSIG, "nasa.gov");
+        assert_se(rrsig);
+
+        rrsig->rrsig.type_covered = DNS_TYPE_A;
+        rrsig->rrsig.algorithm = DNSSEC_ALGORITHM_RSASHA256;
+        rrsig->rrsig.labels = 2;
+        rrsig->rrsig.original_ttl = 600;
+        rrsig->rrsig.expiration = 0x5683135c;
+        rrsig->rrsig.inception = 0x565b7da8;
+        rrsig->rrsig.key_tag = 63876;
+        rrsig->rrsig.signer = strdup("nasa.gov");
+        assert_se(rrsig->rrsig.signer);
+        rrsig->rrsig.signature_size = sizeof(signature_blob);
+        rrsig->rrsig.signature = memdup(signature_blob, rrsig->rrsig.signature_size);
+        assert_se(rrsig->rrsig.signature);
+
+        dnskey = dns_resource_record_new_full(DNS_CLASS_IN, DNS_TYPE_DNSKEY, "nasa.gov");
+        assert_se(dnskey);
+
+        dnskey->dnskey.flags = 256;
+        dnskey->dnskey.protocol = 3;
+        dnskey->dnskey.algorithm = DNSSEC_ALGORITHM_RSASHA256;
+        dnskey->dnskey.key_size = sizeof(dnskey_blob);
+        dnskey->dnskey.key = memdup(dnskey_blob, sizeof(dnskey_blob));
+        assert_se(dnskey->dnskey.key);
+
+        assert_se(answer = dns_answer_new(2));
+        assert_se(dns_answer_add(answer, a, 0, 0) >= 0);
+        assert_se(dns_answer_add(answer, rrsig, 0, 0) >= 0);
+
+        assert_se(forged_answer = dns_answer_new(2));
+        assert_se(dns_answer_add(forged_answer, forged, 0, 0) >= 0);
+        assert_se(dns_answer_add(forged_answer, rrsig, 0, 0) >= 0);
+
+        assert_se(keys = dns_answer_new(1));
+        assert_se(dns_answer_add(keys, dnskey, 0, DNS_ANSWER_AUTHENTICATED) >= 0);
+
+        /* The first validation does the real work and is remembered, the following ones are answered from the
+         * cache */
+        for (i = 0; i < 3; i++) {
+                assert_se(dnssec_verify_rrset_search(answer, a->key, keys, 1449092754*USEC_PER_SEC, &cache, &result, NULL) >= 0);
+                assert_se(result == DNSSEC_VALIDATED);
+                assert_se(ordered_set_size(cache.digests) == 1);
+        }
+
+        /* A different RRset is not covered by the remembered signature */
+        assert_se(dnssec_verify_rrset_search(forged_answer, forged->key, keys, 1449092754*USEC_PER_SEC, &cache, &result, NULL) >= 0);
+        assert_se(result == DNSSEC_INVALID);
+        assert_se(ordered_set_size(cache.digests) == 1);
+
+        /* And the validity period is still enforced */
+        assert_se(dnssec_verify_rrset_search(answer, a->key, keys, 1459092754*USEC_PER_SEC, &cache, &result, NULL) >= 0);
+        assert_se(result == DNSSEC_SIGNATURE_EXPIRED);
+}
+
 static void test_dnssec_verify_rrset2(void) {
 
         static const uint8_t signature_blob[] = {
@@ -614,6 +710,7 @@ int main(int argc, char *argv[]) {
         test_dnssec_verify_rfc8080_ed25519_example1();
         test_dnssec_verify_rfc8080_ed25519_example2();
         test_dnssec_verify_rrset();
+        test_dnssec_signature_cache();
         test_dnssec_verify_rrset2();
         test_dnssec_verify_rrset3();
         test_dnssec_nsec3_hash();
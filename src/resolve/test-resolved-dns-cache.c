@@ -0,0 +1,255 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include "alloc-util.h"
+#include "fd-util.h"
+#include "fileio.h"
+#include "resolved-dns-cache.h"
+#include "resolved-dns-rr.h"
+#include "stdio-util.h"
+#include "tests.h"
+
+static void put_address_at(DnsCache *c, const char *name, uint32_t address, uint32_t ttl, usec_t timestamp) {
+        _cleanup_(dns_resource_record_unrefp) DnsResourceRecord *rr = NULL;
+        _cleanup_(dns_answer_unrefp) DnsAnswer *answer = NULL;
+        union in_addr_union a = { .in.s_addr = htobe32(address) };
+
+        assert_se(dns_resource_record_new_address(&rr, AF_INET, &a, name) >= 0);
+        rr->ttl = ttl;
+
+        assert_se(dns_answer_add_extend(&answer, rr, 1, DNS_ANSWER_CACHEABLE) >= 0);
+        assert_se(dns_cache_put(c, DNS_CACHE_MODE_YES, rr->key, DNS_RCODE_SUCCESS, answer, false, UINT32_MAX, timestamp, AF_INET, &a) >= 0);
+}
+
+static void put_address(DnsCache *c, const char *name, uint32_t address) {
+        put_address_at(c, name, address, 3600, now(clock_boottime_or_monotonic()));
+}
+
+static int lookup_address_full(DnsCache *c, const char *name, bool stale_ok, uint32_t *ret_ttl, bool *ret_refresh) {
+        _cleanup_(dns_resource_key_unrefp) DnsResourceKey *key = NULL;
+        _cleanup_(dns_answer_unrefp) DnsAnswer *answer = NULL;
+        bool authenticated;
+        int rcode, r;
+
+        assert_se(key = dns_resource_key_new(DNS_CLASS_IN, DNS_TYPE_A, name));
+
+        r = dns_cache_lookup(c, key, true, stale_ok, &rcode, &answer, &authenticated, ret_refresh);
+        assert_se(r >= 0);
+
+        if (r > 0 && ret_ttl) {
+                assert_se(dns_answer_size(answer) == 1);
+                *ret_ttl = answer->items[0].rr->ttl;
+        }
+
+        return r;
+}
+
+static bool lookup_address(DnsCache *c, const char *name) {
+        return lookup_address_full(c, name, false, NULL, NULL) > 0;
+}
+
+static void test_dns_cache_eviction(void) {
+        DnsCache c = {
+                .size_max = 32 * 1024,
+        };
+        char name[STRLEN("host-.example.com") + DECIMAL_STR_MAX(unsigned)];
+        unsigned n;
+
+        log_info("/* %s */", __func__);
+
+        put_address(&c, "popular.example.com", 0x7f000001);
+        put_address(&c, "unpopular.example.com", 0x7f000002);
+        assert_se(c.size > 0);
+        assert_se(c.n_evicted == 0);
+
+        /* Keep looking up one name while the cache fills up with names that are looked up only once */
+        for (n = 0; n < 1000; n++) {
+                assert_se(lookup_address(&c, "popular.example.com"));
+
+                xsprintf(name, "host-%u.example.com", n);
+                put_address(&c, name, 0x0a000000 + n);
+
+                assert_se(c.size <= c.size_max);
+        }
+
+        log_info("%u entries in %zu bytes, %u evicted", dns_cache_size(&c), c.size, c.n_evicted);
+
+        assert_se(c.n_evicted > 0);
+        assert_se(dns_cache_size(&c) < n);
+        assert_se(lookup_address(&c, "popular.example.com"));
+        assert_se(!lookup_address(&c, "unpopular.example.com"));
+
+        /* The most recently added names are still there, the oldest ones are gone */
+        assert_se(lookup_address(&c, name));
+        assert_se(!lookup_address(&c, "host-0.example.com"));
+
+        dns_cache_flush(&c);
+        assert_se(c.size == 0);
+        assert_se(dns_cache_is_empty(&c));
+}
+
+static void put_txt(DnsCache *c, const char *name, size_t length) {
+        _cleanup_(dns_resource_record_unrefp) DnsResourceRecord *rr = NULL;
+        _cleanup_(dns_answer_unrefp) DnsAnswer *answer = NULL;
+        union in_addr_union a = { .in.s_addr = htobe32(0x7f000001) };
+        DnsTxtItem *item;
+
+        assert_se(rr = dns_resource_record_new_full(DNS_CLASS_IN, DNS_TYPE_TXT, name));
+        rr->ttl = 3600;
+
+        assert_se(item = malloc0(offsetof(DnsTxtItem, data) + length + 1));
+        item->length = length;
+        memset(item->data, 'x', length);
+        LIST_PREPEND(items, rr->txt.items, item);
+
+        /* Like RRs parsed from a packet, this one carries no wire format */
+        assert_se(!rr->wire_format);
+        assert_se(dns_resource_record_memory_size(rr) > length);
+
+        assert_se(dns_answer_add_extend(&answer, rr, 1, DNS_ANSWER_CACHEABLE) >= 0);
+        assert_se(dns_cache_put(c, DNS_CACHE_MODE_YES, rr->key, DNS_RCODE_SUCCESS, answer, false, UINT32_MAX,
+                                now(clock_boottime_or_monotonic()), AF_INET, &a) >= 0);
+}
+
+static void test_dns_cache_size(void) {
+        DnsCache c = {
+                .size_max = 8 * 1024,
+        };
+
+        log_info("/* %s */", __func__);
+
+        /* The data of the records counts towards the limit, hence the second large record evicts the first */
+        put_txt(&c, "txt1.example.com", 4096);
+        assert_se(c.size > 4096);
+        assert_se(c.n_evicted == 0);
+
+        put_txt(&c, "txt2.example.com", 4096);
+        assert_se(c.n_evicted == 1);
+        assert_se(dns_cache_size(&c) == 1);
+        assert_se(c.size <= c.size_max);
+
+        dns_cache_flush(&c);
+        assert_se(c.size == 0);
+}
+
+static void test_dns_cache_refresh(void) {
+        DnsCache c = {};
+        usec_t n;
+        bool refresh;
+        uint32_t ttl;
+
+        log_info("/* %s */", __func__);
+
+        n = now(clock_boottime_or_monotonic());
+
+        /* A fresh entry doesn't need to be refreshed */
+        put_address_at(&c, "fresh.example.com", 0x7f000001, 100, n);
+        assert_se(lookup_address_full(&c, "fresh.example.com", false, &ttl, &refresh) > 0);
+        assert_se(!refresh);
+        assert_se(ttl > 90);
+
+        /* An entry that expires in less than a tenth of its TTL is to be refreshed, but that's suggested only once */
+        put_address_at(&c, "old.example.com", 0x7f000002, 100, n - 95 * USEC_PER_SEC);
+        assert_se(lookup_address_full(&c, "old.example.com", false, &ttl, &refresh) > 0);
+        assert_se(refresh);
+        assert_se(ttl <= 5);
+        assert_se(lookup_address_full(&c, "old.example.com", false, NULL, &refresh) > 0);
+        assert_se(!refresh);
+
+        /* Putting it again gives us a fresh entry */
+        put_address_at(&c, "old.example.com", 0x7f000002, 100, n);
+        assert_se(lookup_address_full(&c, "old.example.com", false, NULL, &refresh) > 0);
+        assert_se(!refresh);
+
+        dns_cache_flush(&c);
+}
+
+static void test_dns_cache_stale(void) {
+        DnsCache c = {
+                .stale_retention_usec = 120 * USEC_PER_SEC,
+        };
+        usec_t n;
+        bool refresh;
+        uint32_t ttl;
+
+        log_info("/* %s */", __func__);
+
+        n = now(clock_boottime_or_monotonic());
+
+        /* Expired a minute ago: kept around, but only handed out if stale data is OK */
+        put_address_at(&c, "stale.example.com", 0x7f000001, 100, n - 160 * USEC_PER_SEC);
+        dns_cache_prune(&c);
+        assert_se(!dns_cache_is_empty(&c));
+
+        assert_se(lookup_address_full(&c, "stale.example.com", false, NULL, NULL) == 0);
+        assert_se(lookup_address_full(&c, "stale.example.com", true, &ttl, &refresh) > 0);
+        assert_se(ttl == 30);
+        assert_se(refresh);
+
+        /* Expired longer ago than we keep stale data: that's gone */
+        put_address_at(&c, "gone.example.com", 0x7f000002, 100, n - 300 * USEC_PER_SEC);
+        dns_cache_prune(&c);
+        assert_se(lookup_address_full(&c, "gone.example.com", true, NULL, NULL) == 0);
+
+        dns_cache_flush(&c);
+        assert_se(dns_cache_is_empty(&c));
+}
+
+static void test_dns_cache_save_load(void) {
+        DnsCache c = {}, d = {};
+        _cleanup_fclose_ FILE *f = NULL;
+        uint32_t ttl;
+        unsigned n = 0;
+        int r;
+
+        log_info("/* %s */", __func__);
+
+        put_address(&c, "one.example.com", 0x7f000001);
+        put_address(&c, "two.example.com", 0x7f000002);
+        put_address_at(&c, "expired.example.com", 0x7f000003, 100, now(clock_boottime_or_monotonic()) - 200 * USEC_PER_SEC);
+
+        assert_se(f = tmpfile());
+        assert_se(dns_cache_save(&c, f, NULL) >= 0);
+        assert_se(fflush_and_check(f) >= 0);
+        rewind(f);
+
+        for (;;) {
+                _cleanup_free_ char *line = NULL;
+
+                assert_se((r = read_line(f, LONG_LINE_MAX, &line)) >= 0);
+                if (r == 0)
+                        break;
+
+                r = dns_cache_load_line(&d, line);
+                assert_se(r >= 0);
+                n += r > 0;
+
+                /* Loading the same entry again is a NOP */
+                assert_se(dns_cache_load_line(&d, line) == 0);
+        }
+
+        assert_se(n == 2);
+        assert_se(lookup_address_full(&d, "one.example.com", false, &ttl, NULL) > 0);
+        assert_se(ttl > 3500);
+        assert_se(lookup_address(&d, "two.example.com"));
+        assert_se(!lookup_address(&d, "expired.example.com"));
+
+        assert_se(dns_cache_load_line(&d, "0 0 no - garbage") < 0);
+
+        dns_cache_flush(&c);
+        dns_cache_flush(&d);
+}
+
+int main(int argc, char **argv) {
+        test_setup_logging(LOG_DEBUG);
+
+        test_dns_cache_eviction();
+        test_dns_cache_size();
+        test_dns_cache_refresh();
+        test_dns_cache_stale();
+        test_dns_cache_save_load();
+
+        return 0;
+}
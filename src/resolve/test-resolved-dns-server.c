@@ -0,0 +1,52 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include "resolved-dns-server.h"
+#include "resolved-link.h"
+#include "tests.h"
+
+static void test_dns_server_same(void) {
+        Link a = { .ifindex = 2 }, b = { .ifindex = 3 };
+        DnsServer global = {
+                .type = DNS_SERVER_SYSTEM,
+                .family = AF_INET6,
+                .address.in6 = { .s6_addr = { 0xfe, 0x80, [15] = 1 } },
+        }, global_scoped, link_a, link_a2, link_b, named;
+
+        log_info("/* %s */", __func__);
+
+        global_scoped = global;
+        global_scoped.ifindex = 2;
+
+        link_a = global;
+        link_a.type = DNS_SERVER_LINK;
+        link_a.link = &a;
+        link_a2 = link_a;
+
+        link_b = link_a;
+        link_b.link = &b;
+
+        named = link_a;
+        named.server_name = (char*) "dns.example.com";
+
+        assert_se(dns_server_same(&global, &global));
+        assert_se(dns_server_same(&link_a, &link_a2));
+
+        /* The same link-local address on two links are two different servers */
+        assert_se(!dns_server_same(&link_a, &link_b));
+        assert_se(!dns_server_same(&link_b, &link_a));
+
+        /* And neither is a global one the same as a link one, even if its ifindex matches the link */
+        assert_se(!dns_server_same(&global, &link_a));
+        assert_se(!dns_server_same(&global_scoped, &link_a));
+        assert_se(!dns_server_same(&global, &global_scoped));
+
+        assert_se(!dns_server_same(&link_a, &named));
+}
+
+int main(int argc, char **argv) {
+        test_setup_logging(LOG_DEBUG);
+
+        test_dns_server_same();
+
+        return 0;
+}
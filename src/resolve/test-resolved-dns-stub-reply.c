@@ -0,0 +1,198 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include "resolved-dns-stub-reply.h"
+#include "set.h"
+#include "tests.h"
+
+static DnsPacket *make_request(uint16_t id, const char *name, bool edns) {
+        _cleanup_(dns_question_unrefp) DnsQuestion *q = NULL;
+        DnsPacket *p;
+
+        assert_se(dns_packet_new_query(&p, DNS_PROTOCOL_DNS, 0, false) >= 0);
+        assert_se(dns_question_new_address(&q, AF_INET, name, false) >= 0);
+        assert_se(dns_packet_append_question(p, q) >= 0);
+        DNS_PACKET_HEADER(p)->qdcount = htobe16(dns_question_size(q));
+        DNS_PACKET_HEADER(p)->id = htobe16(id);
+
+        if (edns)
+                assert_se(dns_packet_append_opt(p, 4096, false, 0, NULL) >= 0);
+
+        assert_se(dns_packet_extract(p) >= 0);
+        return p;
+}
+
+static DnsPacket *make_reply(DnsPacket *request, int rcode, uint32_t ttl) {
+        _cleanup_(dns_resource_record_unrefp) DnsResourceRecord *rr = NULL;
+        union in_addr_union a = { .in.s_addr = htobe32(0x7f000001) };
+        DnsPacket *p;
+
+        /* Built the way the stub builds its replies */
+        assert_se(dns_packet_new(&p, DNS_PROTOCOL_DNS, 0, DNS_PACKET_SIZE_MAX) >= 0);
+        assert_se(dns_packet_append_question(p, request->question) >= 0);
+        DNS_PACKET_HEADER(p)->qdcount = htobe16(dns_question_size(request->question));
+
+        if (rcode == DNS_RCODE_SUCCESS) {
+                assert_se(dns_resource_record_new_address(&rr, AF_INET, &a, dns_resource_key_name(request->question->keys[0])) >= 0);
+                rr->ttl = ttl;
+                assert_se(dns_packet_append_rr(p, rr, 0, NULL, NULL) >= 0);
+                DNS_PACKET_HEADER(p)->ancount = htobe16(1);
+        }
+
+        if (request->opt)
+                assert_se(dns_packet_append_opt(p, 4096, false, rcode, NULL) >= 0);
+
+        DNS_PACKET_HEADER(p)->id = DNS_PACKET_ID(request);
+        DNS_PACKET_HEADER(p)->flags = htobe16(DNS_PACKET_MAKE_FLAGS(1, 0, 0, 0, 1, 1, 0, 0, rcode));
+
+        return p;
+}
+
+static void remember(Manager *m, const char *name, bool edns, int rcode, uint32_t ttl, usec_t timestamp) {
+        _cleanup_(dns_packet_unrefp) DnsPacket *request = NULL, *reply = NULL;
+
+        request = make_request(1, name, edns);
+        reply = make_reply(request, rcode, ttl);
+
+        assert_se(dns_stub_reply_remember(m, request, reply, timestamp) >= 0);
+}
+
+static int recall(Manager *m, uint16_t id, const char *name, bool edns, usec_t timestamp, uint32_t *ret_ttl) {
+        _cleanup_(dns_packet_unrefp) DnsPacket *request = NULL, *reply = NULL;
+        size_t question_end;
+        int r;
+
+        request = make_request(id, name, edns);
+
+        r = dns_stub_reply_recall(m, request, timestamp, &reply);
+        assert_se(r >= 0);
+        if (r == 0)
+                return 0;
+
+        /* The reply carries the ID and the exact question of the request, without touching the rest */
+        assert_se(DNS_PACKET_ID(reply) == DNS_PACKET_ID(request));
+        assert_se(DNS_PACKET_QR(reply));
+        assert_se(DNS_PACKET_RCODE(reply) == DNS_RCODE_SUCCESS);
+        question_end = request->opt ? request->opt_start : request->size;
+        assert_se(reply->size >= question_end);
+        assert_se(memcmp(DNS_PACKET_DATA(reply) + DNS_PACKET_HEADER_SIZE,
+                         DNS_PACKET_DATA(request) + DNS_PACKET_HEADER_SIZE,
+                         question_end - DNS_PACKET_HEADER_SIZE) == 0);
+
+        assert_se(dns_packet_extract(reply) >= 0);
+        assert_se(!!reply->opt == edns);
+        assert_se(dns_question_size(reply->question) == 1);
+        assert_se(dns_resource_key_equal(reply->question->keys[0], request->question->keys[0]) > 0);
+        assert_se(dns_answer_size(reply->answer) == 1);
+        assert_se(reply->answer->items[0].rr->key->type == DNS_TYPE_A);
+        assert_se(reply->answer->items[0].rr->a.in_addr.s_addr == htobe32(0x7f000001));
+
+        if (ret_ttl)
+                *ret_ttl = reply->answer->items[0].rr->ttl;
+
+        return 1;
+}
+
+static void test_recall(void) {
+        Manager m = {};
+        uint32_t ttl;
+        usec_t n;
+
+        log_info("/* %s */", __func__);
+
+        n = now(clock_boottime_or_monotonic());
+
+        /* Nothing remembered yet */
+        assert_se(recall(&m, 2, "www.example.com", false, n, NULL) == 0);
+
+        remember(&m, "www.example.com", false, DNS_RCODE_SUCCESS, 100, n);
+
+        /* The same question, asked with a different ID and case, gets the reply with the TTLs counted down */
+        assert_se(recall(&m, 2, "www.example.com", false, n, &ttl) > 0);
+        assert_se(ttl == 100);
+        assert_se(recall(&m, 3, "WWW.Example.COM", false, n + 10 * USEC_PER_SEC, &ttl) > 0);
+        assert_se(ttl == 90);
+        assert_se(recall(&m, 4, "www.example.com", false, n + 30 * USEC_PER_SEC + 1, &ttl) > 0);
+        assert_se(ttl == 70);
+
+        /* Other names and other EDNS modes are not answered from it */
+        assert_se(recall(&m, 5, "example.com", false, n, NULL) == 0);
+        assert_se(recall(&m, 6, "www.example.com", true, n, NULL) == 0);
+
+        remember(&m, "www.example.com", true, DNS_RCODE_SUCCESS, 50, n);
+        assert_se(recall(&m, 7, "www.example.com", true, n + USEC_PER_SEC, &ttl) > 0);
+        assert_se(ttl == 49);
+        assert_se(recall(&m, 8, "www.example.com", false, n + USEC_PER_SEC, &ttl) > 0);
+        assert_se(ttl == 99);
+        assert_se(set_size(m.dns_stub_replies) == 2);
+
+        /* Once the TTL ran out, the entry is dropped */
+        assert_se(recall(&m, 9, "www.example.com", true, n + 50 * USEC_PER_SEC, NULL) == 0);
+        assert_se(set_size(m.dns_stub_replies) == 1);
+
+        /* Remembering the same question again replaces the entry */
+        remember(&m, "www.example.com", false, DNS_RCODE_SUCCESS, 200, n + USEC_PER_SEC);
+        assert_se(set_size(m.dns_stub_replies) == 1);
+        assert_se(recall(&m, 10, "www.example.com", false, n + 150 * USEC_PER_SEC, &ttl) > 0);
+        assert_se(ttl == 51);
+
+        m.dns_stub_replies = set_free(m.dns_stub_replies);
+}
+
+static void test_generation(void) {
+        Manager m = {};
+        usec_t n;
+
+        log_info("/* %s */", __func__);
+
+        n = now(clock_boottime_or_monotonic());
+
+        remember(&m, "www.example.com", false, DNS_RCODE_SUCCESS, 100, n);
+        assert_se(recall(&m, 2, "www.example.com", false, n, NULL) > 0);
+
+        /* Flushing a cache or a change of the scopes invalidates everything remembered before, even if the
+         * generation goes back later */
+        m.dns_cache_generation++;
+        assert_se(recall(&m, 3, "www.example.com", false, n, NULL) == 0);
+        assert_se(set_isempty(m.dns_stub_replies));
+        m.dns_cache_generation--;
+        assert_se(recall(&m, 4, "www.example.com", false, n, NULL) == 0);
+
+        /* Replies remembered afterwards are valid again */
+        m.dns_cache_generation++;
+        remember(&m, "www.example.com", false, DNS_RCODE_SUCCESS, 100, n);
+        assert_se(recall(&m, 5, "www.example.com", false, n, NULL) > 0);
+
+        m.dns_stub_replies = set_free(m.dns_stub_replies);
+}
+
+static void test_not_remembered(void) {
+        Manager m = {};
+        usec_t n;
+
+        log_info("/* %s */", __func__);
+
+        n = now(clock_boottime_or_monotonic());
+
+        /* Errors, empty answers and answers that may not be cached are not remembered */
+        remember(&m, "nx.example.com", false, DNS_RCODE_NXDOMAIN, 100, n);
+        remember(&m, "zero.example.com", false, DNS_RCODE_SUCCESS, 0, n);
+        assert_se(set_isempty(m.dns_stub_replies));
+
+        assert_se(recall(&m, 2, "nx.example.com", false, n, NULL) == 0);
+        assert_se(recall(&m, 3, "zero.example.com", false, n, NULL) == 0);
+
+        m.dns_stub_replies = set_free(m.dns_stub_replies);
+}
+
+int main(int argc, char *argv[]) {
+        test_setup_logging(LOG_DEBUG);
+
+        test_recall();
+        test_generation();
+        test_not_remembered();
+
+        return 0;
+}
@@ -3,12 +3,14 @@
 #include <arpa/inet.h>
 #include <netinet/in.h>
 #include <sys/socket.h>
+#include <unistd.h>
 
 #include "fd-util.h"
 #include "fileio.h"
 #include "fs-util.h"
 #include "log.h"
 #include "resolved-etc-hosts.h"
+#include "stdio-util.h"
 #include "strv.h"
 #include "tests.h"
 #include "tmpfile-util.h"
@@ -127,6 +129,61 @@ static void test_parse_etc_hosts(void) {
         assert_se(!set_contains(hosts.no_address, "foobar.foo.foo"));
 }
 
+static void test_parse_etc_hosts_large(void) {
+        _cleanup_(etc_hosts_free) EtcHosts hosts = {};
+        _cleanup_fclose_ FILE *f = NULL;
+        char name[STRLEN("host-.example.com") + DECIMAL_STR_MAX(unsigned)];
+        unsigned n;
+
+        log_info("/* %s */", __func__);
+
+        /* Ad blocking lists put tens of thousands of entries into /etc/hosts, make sure all of them end up in
+         * both maps, and map back to each other */
+        assert_se(f = tmpfile());
+        for (n = 0; n < 20000; n++)
+                fprintf(f, "10.%u.%u.%u host-%u.example.com\n", n >> 16, (n >> 8) & 0xff, n & 0xff, n);
+        assert_se(fflush_and_check(f) >= 0);
+        rewind(f);
+
+        assert_se(etc_hosts_parse(&hosts, f) == 0);
+        assert_se(hashmap_size(hosts.by_name) == n);
+        assert_se(hashmap_size(hosts.by_address) == n);
+        assert_se(set_isempty(hosts.no_address));
+
+        for (n = 0; n < 20000; n++) {
+                struct in_addr_data a = {
+                        .family = AF_INET,
+                        .address.in.s_addr = htobe32(UINT32_C(10) << 24 | n),
+                };
+                EtcHostsItemByName *bn;
+                EtcHostsItem *item;
+
+                xsprintf(name, "host-%u.example.com", n);
+                assert_se(bn = hashmap_get(hosts.by_name, name));
+                assert_se(bn->n_addresses == 1);
+                assert_se(bn->addresses[0]->family == AF_INET);
+                assert_se(in_addr_equal(AF_INET, &bn->addresses[0]->address, &a.address) > 0);
+
+                assert_se(item = hashmap_get(hosts.by_address, &a));
+                assert_se(strv_equal(item->names, STRV_MAKE(name)));
+        }
+
+        assert_se(!hashmap_get(hosts.by_name, "host-20000.example.com"));
+
+        /* Parsing other contents replaces everything known before */
+        assert_se(ftruncate(fileno(f), 0) >= 0);
+        rewind(f);
+        fputs("10.0.0.1 other.example.com\n", f);
+        assert_se(fflush_and_check(f) >= 0);
+        rewind(f);
+
+        assert_se(etc_hosts_parse(&hosts, f) == 0);
+        assert_se(hashmap_size(hosts.by_name) == 1);
+        assert_se(hashmap_size(hosts.by_address) == 1);
+        assert_se(hashmap_get(hosts.by_name, "other.example.com"));
+        assert_se(!hashmap_get(hosts.by_name, "host-1.example.com"));
+}
+
 static void test_parse_file(const char *fname) {
         _cleanup_(etc_hosts_free) EtcHosts hosts = {};
         _cleanup_fclose_ FILE *f;
@@ -143,6 +200,7 @@ int main(int argc, char **argv) {
         if (argc == 1) {
                 test_parse_etc_hosts_system();
                 test_parse_etc_hosts();
+                test_parse_etc_hosts_large();
         } else
                 test_parse_file(argv[1]);
 
@@ -51,6 +51,40 @@ static BPFProgram *bpf_program_free(BPFProgram *p) {
 
 DEFINE_TRIVIAL_REF_UNREF_FUNC(BPFProgram, bpf_program, bpf_program_free);
 
+int bpf_program_clone(BPFProgram *p, BPFProgram **ret) {
+        _cleanup_(bpf_program_unrefp) BPFProgram *c = NULL;
+        int r;
+
+        assert(p);
+        assert(ret);
+
+        /* Creates a new program object for the same program. If the program is loaded into the kernel already, the
+         * new object refers to the very same kernel object, so that the kernel only needs to verify it once. The
+         * attachment is not copied, as every object tracks its own. */
+
+        r = bpf_program_new(p->prog_type, &c);
+        if (r < 0)
+                return r;
+
+        if (p->n_instructions > 0) {
+                c->instructions = newdup(struct bpf_insn, p->instructions, p->n_instructions);
+                if (!c->instructions)
+                        return -ENOMEM;
+
+                c->n_instructions = c->allocated = p->n_instructions;
+        }
+
+        if (p->kernel_fd >= 0) {
+                c->kernel_fd = fcntl(p->kernel_fd, F_DUPFD_CLOEXEC, 3);
+                if (c->kernel_fd < 0)
+                        return -errno;
+        }
+
+        *ret = TAKE_PTR(c);
+
+        return 0;
+}
+
 int bpf_program_add_instructions(BPFProgram *p, const struct bpf_insn *instructions, size_t count) {
 
         assert(p);
@@ -254,3 +288,62 @@ int bpf_map_lookup_element(int fd, const void *key, void *value) {
 
         return 0;
 }
+
+/* Our copy of linux/bpf.h predates the batch operations (kernel 5.6), hence define what we need here. The layout
+ * matches the "batch" member of union bpf_attr. */
+#define BPF_MAP_LOOKUP_BATCH_CMD 24
+
+struct bpf_attr_batch {
+        uint64_t in_batch;
+        uint64_t out_batch;
+        uint64_t keys;
+        uint64_t values;
+        uint32_t count;
+        uint32_t map_fd;
+        uint64_t elem_flags;
+        uint64_t flags;
+};
+
+int bpf_map_lookup_array(int fd, uint32_t n, size_t value_size, void *values) {
+        static bool batch_unsupported = false;
+        uint32_t i;
+
+        assert(fd >= 0);
+        assert(values || n == 0);
+
+        /* Reads the first n elements of an array map (with 32bit keys), in a single syscall if the kernel supports
+         * it, and one syscall per element otherwise. */
+
+        if (n == 0)
+                return 0;
+
+        if (!batch_unsupported) {
+                uint32_t out_batch = 0, *keys = newa(uint32_t, n);
+                struct bpf_attr_batch attr = {
+                        .out_batch = PTR_TO_UINT64(&out_batch),
+                        .keys = PTR_TO_UINT64(keys),
+                        .values = PTR_TO_UINT64(values),
+                        .count = n,
+                        .map_fd = fd,
+                };
+
+                if (bpf(BPF_MAP_LOOKUP_BATCH_CMD, (union bpf_attr*) &attr, sizeof(attr)) >= 0 ||
+                    (errno == ENOENT && attr.count == n)) /* ENOENT means we reached the end of the map */
+                        return 0;
+
+                /* Older kernels don't know the command at all, don't bother with it again. Otherwise let's
+                 * fall back for this call only. */
+                if (errno == EINVAL)
+                        batch_unsupported = true;
+        }
+
+        for (i = 0; i < n; i++) {
+                int r;
+
+                r = bpf_map_lookup_element(fd, &i, (uint8_t*) values + i * value_size);
+                if (r < 0)
+                        return r;
+        }
+
+        return 0;
+}
@@ -1171,25 +1171,50 @@ static int tm_within_bounds(struct tm *tm, bool utc) {
         return good;
 }
 
-static bool matches_weekday(int weekdays_bits, const struct tm *tm, bool utc) {
-        struct tm t;
-        int k;
+static int tm_within_bounds_fast(struct tm *tm, bool utc, bool normalized) {
+        assert(tm);
+
+        /* If none of the fields changed since the date was last normalized, it's within bounds, and we can
+         * skip the comparatively expensive mktime() call. */
+        if (normalized)
+                return tm->tm_year + 1900 > MAX_YEAR ? -ERANGE : true;
+
+        return tm_within_bounds(tm, utc);
+}
+
+static int weekday_skip_days(int weekdays_bits, const struct tm *tm) {
+        /* Offsets of the first day of each month (mod 7) in a year starting on a Sunday, with January and
+         * February counted as months of the previous year, see Sakamoto's algorithm */
+        static const int offset[] = { 0, 3, 2, 5, 0, 3, 5, 1, 4, 6, 2, 4 };
+        int y, k, n;
+
+        assert(tm);
+
+        /* Returns the number of days until a day whose weekday is in weekdays_bits, i.e. 0 if the day in tm
+         * matches. tm must be normalized. The weekday doesn't depend on the time zone, hence calculate it
+         * directly instead of calling mktime(). */
 
         if (weekdays_bits < 0 || weekdays_bits >= BITS_WEEKDAYS)
-                return true;
+                return 0;
 
-        t = *tm;
-        if (mktime_or_timegm(&t, utc) < 0)
-                return false;
+        y = tm->tm_year + 1900 - (tm->tm_mon < 2);
+        k = (y + y/4 - y/100 + y/400 + offset[tm->tm_mon] + tm->tm_mday) % 7;
+
+        /* Our bits start with Monday, tm_wday with Sunday */
+        k = k == 0 ? 6 : k - 1;
+
+        for (n = 0; n < 7; n++)
+                if (weekdays_bits & (1 << ((k + n) % 7)))
+                        return n;
 
-        k = t.tm_wday == 0 ? 6 : t.tm_wday - 1;
-        return (weekdays_bits & (1 << k));
+        return 1;
 }
 
 static int find_next(const CalendarSpec *spec, struct tm *tm, usec_t *usec) {
         struct tm c;
         int tm_usec;
-        int r;
+        bool normalized;
+        int r, n;
 
         /* Returns -ENOENT if the expression is not going to elapse anymore */
 
@@ -1204,6 +1229,10 @@ static int find_next(const CalendarSpec *spec, struct tm *tm, usec_t *usec) {
                 (void) mktime_or_timegm(&c, spec->utc);
                 c.tm_isdst = spec->dst;
 
+                /* Unless a specific DST setting is enforced, which might move the time, the date stays
+                 * normalized until one of the fields is changed below */
+                normalized = spec->dst < 0;
+
                 c.tm_year += 1900;
                 r = find_matching_component(spec, spec->year, &c, &c.tm_year);
                 c.tm_year -= 1900;
@@ -1212,10 +1241,11 @@ static int find_next(const CalendarSpec *spec, struct tm *tm, usec_t *usec) {
                         c.tm_mon = 0;
                         c.tm_mday = 1;
                         c.tm_hour = c.tm_min = c.tm_sec = tm_usec = 0;
+                        normalized = false;
                 }
                 if (r < 0)
                         return r;
-                if (tm_within_bounds(&c, spec->utc) <= 0)
+                if (tm_within_bounds_fast(&c, spec->utc, normalized) <= 0)
                         return -ENOENT;
 
                 c.tm_mon += 1;
@@ -1225,8 +1255,9 @@ static int find_next(const CalendarSpec *spec, struct tm *tm, usec_t *usec) {
                 if (r > 0) {
                         c.tm_mday = 1;
                         c.tm_hour = c.tm_min = c.tm_sec = tm_usec = 0;
+                        normalized = false;
                 }
-                if (r < 0 || (r = tm_within_bounds(&c, spec->utc)) < 0) {
+                if (r < 0 || (r = tm_within_bounds_fast(&c, spec->utc, normalized)) < 0) {
                         c.tm_year++;
                         c.tm_mon = 0;
                         c.tm_mday = 1;
@@ -1235,11 +1266,14 @@ static int find_next(const CalendarSpec *spec, struct tm *tm, usec_t *usec) {
                 }
                 if (r == 0)
                         continue;
+                normalized = true;
 
                 r = find_matching_component(spec, spec->day, &c, &c.tm_mday);
-                if (r > 0)
+                if (r > 0) {
                         c.tm_hour = c.tm_min = c.tm_sec = tm_usec = 0;
-                if (r < 0 || (r = tm_within_bounds(&c, spec->utc)) < 0) {
+                        normalized = false;
+                }
+                if (r < 0 || (r = tm_within_bounds_fast(&c, spec->utc, normalized)) < 0) {
                         c.tm_mon++;
                         c.tm_mday = 1;
                         c.tm_hour = c.tm_min = c.tm_sec = tm_usec = 0;
@@ -1247,17 +1281,22 @@ static int find_next(const CalendarSpec *spec, struct tm *tm, usec_t *usec) {
                 }
                 if (r == 0)
                         continue;
+                normalized = true;
 
-                if (!matches_weekday(spec->weekdays_bits, &c, spec->utc)) {
-                        c.tm_mday++;
+                /* Skip directly to the next day with a matching weekday, the days in between can't match */
+                n = weekday_skip_days(spec->weekdays_bits, &c);
+                if (n > 0) {
+                        c.tm_mday += n;
                         c.tm_hour = c.tm_min = c.tm_sec = tm_usec = 0;
                         continue;
                 }
 
                 r = find_matching_component(spec, spec->hour, &c, &c.tm_hour);
-                if (r > 0)
+                if (r > 0) {
                         c.tm_min = c.tm_sec = tm_usec = 0;
-                if (r < 0 || (r = tm_within_bounds(&c, spec->utc)) < 0) {
+                        normalized = false;
+                }
+                if (r < 0 || (r = tm_within_bounds_fast(&c, spec->utc, normalized)) < 0) {
                         c.tm_mday++;
                         c.tm_hour = c.tm_min = c.tm_sec = tm_usec = 0;
                         continue;
@@ -1267,24 +1306,28 @@ static int find_next(const CalendarSpec *spec, struct tm *tm, usec_t *usec) {
                          * are time zone changes. Let's try again starting at
                          * normalized time. */
                         continue;
+                normalized = true;
 
                 r = find_matching_component(spec, spec->minute, &c, &c.tm_min);
-                if (r > 0)
+                if (r > 0) {
                         c.tm_sec = tm_usec = 0;
-                if (r < 0 || (r = tm_within_bounds(&c, spec->utc)) < 0) {
+                        normalized = false;
+                }
+                if (r < 0 || (r = tm_within_bounds_fast(&c, spec->utc, normalized)) < 0) {
                         c.tm_hour++;
                         c.tm_min = c.tm_sec = tm_usec = 0;
                         continue;
                 }
                 if (r == 0)
                         continue;
+                normalized = true;
 
                 c.tm_sec = c.tm_sec * USEC_PER_SEC + tm_usec;
                 r = find_matching_component(spec, spec->microsecond, &c, &c.tm_sec);
                 tm_usec = c.tm_sec % USEC_PER_SEC;
                 c.tm_sec /= USEC_PER_SEC;
 
-                if (r < 0 || (r = tm_within_bounds(&c, spec->utc)) < 0) {
+                if (r < 0 || (r = tm_within_bounds_fast(&c, spec->utc, normalized && r == 0)) < 0) {
                         c.tm_min++;
                         c.tm_sec = tm_usec = 0;
                         continue;
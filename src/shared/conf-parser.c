@@ -25,6 +25,7 @@
 #include "rlimit-util.h"
 #include "signal-util.h"
 #include "socket-util.h"
+#include "stat-util.h"
 #include "string-util.h"
 #include "strv.h"
 #include "syslog-util.h"
@@ -280,47 +281,32 @@ static int parse_line(
                                userdata);
 }
 
-/* Go through the file and parse each line */
-int config_parse(const char *unit,
-                 const char *filename,
-                 FILE *f,
-                 const char *sections,
-                 ConfigItemLookup lookup,
-                 const void *table,
-                 ConfigParseFlags flags,
-                 void *userdata) {
-
-        _cleanup_free_ char *section = NULL, *continuation = NULL;
-        _cleanup_fclose_ FILE *ours = NULL;
-        unsigned line = 0, section_line = 0;
-        bool section_ignored = false, bom_seen = false;
-        int r, fd;
+typedef int (*config_line_callback_t)(unsigned line, char *l, void *userdata);
 
-        assert(filename);
-        assert(lookup);
+/* Go through the file and split it into logical lines */
+static int config_read_lines(
+                const char *filename,
+                FILE *f,
+                ConfigParseFlags flags,
+                config_line_callback_t callback,
+                void *userdata) {
 
-        if (!f) {
-                f = ours = fopen(filename, "re");
-                if (!f) {
-                        /* Only log on request, except for ENOENT,
-                         * since we return 0 to the caller. */
-                        if ((flags & CONFIG_PARSE_WARN) || errno == ENOENT)
-                                log_full_errno(errno == ENOENT ? LOG_DEBUG : LOG_ERR, errno,
-                                               "Failed to open configuration file '%s': %m", filename);
-                        return errno == ENOENT ? 0 : -errno;
-                }
-        }
+        _cleanup_(line_reader_done) LineReader reader = { .f = f };
+        _cleanup_free_ char *continuation = NULL;
+        unsigned line = 0;
+        bool bom_seen = false;
+        int r;
 
-        fd = fileno(f);
-        if (fd >= 0) /* stream might not have an fd, let's be careful hence */
-                fd_warn_permissions(filename, fd);
+        assert(filename);
+        assert(f);
+        assert(callback);
 
         for (;;) {
                 _cleanup_free_ char *buf = NULL;
                 bool escaped = false;
                 char *l, *p, *e;
 
-                r = read_line(f, LONG_LINE_MAX, &buf);
+                r = line_reader_read(&reader, LONG_LINE_MAX, 0, &buf);
                 if (r == 0)
                         break;
                 if (r == -ENOBUFS) {
@@ -392,18 +378,7 @@ int config_parse(const char *unit,
                         continue;
                 }
 
-                r = parse_line(unit,
-                               filename,
-                               line,
-                               sections,
-                               lookup,
-                               table,
-                               flags,
-                               &section,
-                               &section_line,
-                               &section_ignored,
-                               p,
-                               userdata);
+                r = callback(line, p, userdata);
                 if (r < 0) {
                         if (flags & CONFIG_PARSE_WARN)
                                 log_warning_errno(r, "%s:%u: Failed to parse file: %m", filename, line);
@@ -414,18 +389,7 @@ int config_parse(const char *unit,
         }
 
         if (continuation) {
-                r = parse_line(unit,
-                               filename,
-                               ++line,
-                               sections,
-                               lookup,
-                               table,
-                               flags,
-                               &section,
-                               &section_line,
-                               &section_ignored,
-                               continuation,
-                               userdata);
+                r = callback(++line, continuation, userdata);
                 if (r < 0) {
                         if (flags & CONFIG_PARSE_WARN)
                                 log_warning_errno(r, "%s:%u: Failed to parse file: %m", filename, line);
@@ -436,6 +400,196 @@ int config_parse(const char *unit,
         return 0;
 }
 
+typedef struct ConfigParseState {
+        const char *unit;
+        const char *filename;
+        const char *sections;
+        ConfigItemLookup lookup;
+        const void *table;
+        ConfigParseFlags flags;
+        char *section;
+        unsigned section_line;
+        bool section_ignored;
+        void *userdata;
+} ConfigParseState;
+
+static int config_parse_line(unsigned line, char *l, void *userdata) {
+        ConfigParseState *s = userdata;
+
+        return parse_line(s->unit,
+                          s->filename,
+                          line,
+                          s->sections,
+                          s->lookup,
+                          s->table,
+                          s->flags,
+                          &s->section,
+                          &s->section_line,
+                          &s->section_ignored,
+                          l,
+                          s->userdata);
+}
+
+/* Go through the file and parse each line */
+int config_parse(const char *unit,
+                 const char *filename,
+                 FILE *f,
+                 const char *sections,
+                 ConfigItemLookup lookup,
+                 const void *table,
+                 ConfigParseFlags flags,
+                 void *userdata) {
+
+        _cleanup_fclose_ FILE *ours = NULL;
+        ConfigParseState state = {
+                .unit = unit,
+                .filename = filename,
+                .sections = sections,
+                .lookup = lookup,
+                .table = table,
+                .flags = flags,
+                .userdata = userdata,
+        };
+        int r, fd;
+
+        assert(filename);
+        assert(lookup);
+
+        if (!f) {
+                f = ours = fopen(filename, "re");
+                if (!f) {
+                        /* Only log on request, except for ENOENT,
+                         * since we return 0 to the caller. */
+                        if ((flags & CONFIG_PARSE_WARN) || errno == ENOENT)
+                                log_full_errno(errno == ENOENT ? LOG_DEBUG : LOG_ERR, errno,
+                                               "Failed to open configuration file '%s': %m", filename);
+                        return errno == ENOENT ? 0 : -errno;
+                }
+        }
+
+        fd = fileno(f);
+        if (fd >= 0) /* stream might not have an fd, let's be careful hence */
+                fd_warn_permissions(filename, fd);
+
+        r = config_read_lines(filename, f, flags, config_parse_line, &state);
+        free(state.section);
+        return r;
+}
+
+static int config_file_add_line(unsigned line, char *l, void *userdata) {
+        ConfigFile *c = userdata;
+        char *text;
+
+        if (!GREEDY_REALLOC(c->lines, c->n_allocated, c->n_lines + 1))
+                return -ENOMEM;
+
+        text = arena_strdup(&c->arena, l);
+        if (!text)
+                return -ENOMEM;
+
+        c->lines[c->n_lines++] = (ConfigLine) {
+                .line = line,
+                .text = text,
+        };
+
+        return 0;
+}
+
+ConfigFile* config_file_free(ConfigFile *c) {
+        if (!c)
+                return NULL;
+
+        arena_done(&c->arena);
+        free(c->lines);
+        free(c->filename);
+        return mfree(c);
+}
+
+/* Read the file and split it into logical lines, to be passed to config_parse_file() later. Errors while
+ * reading the contents are recorded and returned by config_parse_file(), just like config_parse() would
+ * return them after parsing the lines read so far. Empty files are not read at all. */
+int config_file_read(const char *filename, ConfigParseFlags flags, ConfigFile **ret) {
+        _cleanup_(config_file_freep) ConfigFile *c = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+
+        assert(filename);
+        assert(ret);
+
+        f = fopen(filename, "re");
+        if (!f)
+                return -errno;
+
+        c = new0(ConfigFile, 1);
+        if (!c)
+                return -ENOMEM;
+
+        c->filename = strdup(filename);
+        if (!c->filename)
+                return -ENOMEM;
+
+        if (fstat(fileno(f), &c->st) < 0)
+                return -errno;
+
+        if (!null_or_empty(&c->st)) {
+                fd_warn_permissions(filename, fileno(f));
+
+                c->error = config_read_lines(filename, f, flags, config_file_add_line, c);
+                if (c->error == -ENOMEM)
+                        return -ENOMEM;
+        }
+
+        *ret = TAKE_PTR(c);
+        return 0;
+}
+
+/* Parse the lines of a file read by config_file_read(), equivalent to config_parse() on the file */
+int config_parse_file(
+                const char *unit,
+                const ConfigFile *c,
+                const char *sections,
+                ConfigItemLookup lookup,
+                const void *table,
+                ConfigParseFlags flags,
+                void *userdata) {
+
+        ConfigParseState state = {
+                .unit = unit,
+                .filename = c->filename,
+                .sections = sections,
+                .lookup = lookup,
+                .table = table,
+                .flags = flags,
+                .userdata = userdata,
+        };
+        _cleanup_(arena_done) Arena arena = {};
+        size_t i;
+        int r = 0;
+
+        assert(c);
+        assert(lookup);
+
+        for (i = 0; i < c->n_lines; i++) {
+                char *l;
+
+                /* The lines are modified while parsing, and the file may be parsed more than once */
+                l = arena_strdup(&arena, c->lines[i].text);
+                if (!l) {
+                        r = -ENOMEM;
+                        break;
+                }
+
+                r = config_parse_line(c->lines[i].line, l, &state);
+                if (r < 0) {
+                        if (flags & CONFIG_PARSE_WARN)
+                                log_warning_errno(r, "%s:%u: Failed to parse file: %m", c->filename, c->lines[i].line);
+                        break;
+                }
+        }
+
+        free(state.section);
+        return r < 0 ? r : c->error;
+}
+
 static int config_parse_many_files(
                 const char *conf_file,
                 char **files,
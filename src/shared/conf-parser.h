@@ -5,9 +5,11 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdio.h>
+#include <sys/stat.h>
 #include <syslog.h>
 
 #include "alloc-util.h"
+#include "arena.h"
 #include "log.h"
 #include "macro.h"
 
@@ -90,6 +92,35 @@ int config_parse(
                 ConfigParseFlags flags,
                 void *userdata);
 
+/* A configuration file that has been read and split into logical lines, but not parsed yet. This allows
+ * reading files ahead of time, possibly on a different thread, and parsing them later. */
+typedef struct ConfigLine {
+        unsigned line;
+        char *text;
+} ConfigLine;
+
+typedef struct ConfigFile {
+        char *filename;
+        struct stat st;
+        ConfigLine *lines;
+        size_t n_lines, n_allocated;
+        Arena arena; /* The texts of the lines above */
+        int error;  /* < 0 if reading the file failed after the lines above */
+} ConfigFile;
+
+int config_file_read(const char *filename, ConfigParseFlags flags, ConfigFile **ret);
+ConfigFile* config_file_free(ConfigFile *c);
+DEFINE_TRIVIAL_CLEANUP_FUNC(ConfigFile*, config_file_free);
+
+int config_parse_file(
+                const char *unit,
+                const ConfigFile *c,
+                const char *sections,  /* nulstr */
+                ConfigItemLookup lookup,
+                const void *table,
+                ConfigParseFlags flags,
+                void *userdata);
+
 int config_parse_many_nulstr(
                 const char *conf_file,      /* possibly NULL */
                 const char *conf_file_dirs, /* nulstr */
@@ -1,8 +1,18 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
 #if HAVE_LIBCRYPTSETUP
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
 #include "crypt-util.h"
+#include "env-file.h"
+#include "fileio.h"
+#include "hexdecoct.h"
 #include "log.h"
+#include "parse-util.h"
+#include "string-util.h"
 
 void cryptsetup_log_glue(int level, const char *msg, void *usrptr) {
         switch (level) {
@@ -25,4 +35,354 @@ void cryptsetup_log_glue(int level, const char *msg, void *usrptr) {
 
         log_full(level, "%s", msg);
 }
+
+/* Where we remember the parameters of verity hash devices, indexed by root hash, see crypt_activate_verity() */
+#define VERITY_CACHE_DIR "/run/systemd/verity-cache"
+
+/* The verity superblock takes up the first hash block of the hash device */
+#define VERITY_SUPERBLOCK_SIZE 512U
+
+void verity_cache_entry_done(VerityCacheEntry *e) {
+        assert(e);
+
+        e->hash_device = mfree(e->hash_device);
+        e->hash_name = mfree(e->hash_name);
+        e->salt = mfree(e->salt);
+        e->salt_size = 0;
+}
+
+int verity_cache_path(const void *root_hash, size_t root_hash_size, char **ret) {
+        _cleanup_free_ char *hex = NULL;
+        char *p;
+
+        assert(root_hash);
+        assert(ret);
+
+        hex = hexmem(root_hash, root_hash_size);
+        if (!hex)
+                return -ENOMEM;
+
+        p = strjoin(VERITY_CACHE_DIR "/", hex);
+        if (!p)
+                return -ENOMEM;
+
+        *ret = p;
+        return 0;
+}
+
+int verity_hash_device_id(const char *hash_device, char **ret) {
+        struct stat st;
+        char *id;
+        int r;
+
+        assert(hash_device);
+        assert(ret);
+
+        /* Identifies the hash device an entry was created from. The root hash alone doesn't say where the
+         * hash tree is: the same tree may be found behind a different superblock offset on another device. */
+
+        if (stat(hash_device, &st) < 0)
+                return -errno;
+
+        if (S_ISBLK(st.st_mode))
+                r = asprintf(&id, "b%u:%u", major(st.st_rdev), minor(st.st_rdev));
+        else if (S_ISREG(st.st_mode))
+                r = asprintf(&id, "f%u:%u:%" PRIu64, major(st.st_dev), minor(st.st_dev), (uint64_t) st.st_ino);
+        else
+                return -ENOTBLK;
+        if (r < 0)
+                return -ENOMEM;
+
+        *ret = id;
+        return 0;
+}
+
+int verity_cache_entry_save(const char *path, const VerityCacheEntry *e) {
+        _cleanup_free_ char *salt = NULL, *text = NULL;
+
+        assert(path);
+        assert(e);
+
+        if (!e->hash_device || !e->hash_name || e->hash_block_size == 0 || e->data_block_size == 0 || e->data_blocks == 0)
+                return -EINVAL;
+
+        salt = hexmem(e->salt, e->salt_size);
+        if (!salt)
+                return -ENOMEM;
+
+        if (asprintf(&text,
+                     "HASH_DEVICE=%s\n"
+                     "HASH=%s\n"
+                     "HASH_TYPE=%" PRIu32 "\n"
+                     "DATA_BLOCK_SIZE=%" PRIu32 "\n"
+                     "HASH_BLOCK_SIZE=%" PRIu32 "\n"
+                     "DATA_BLOCKS=%" PRIu64 "\n"
+                     "HASH_OFFSET=%" PRIu64 "\n"
+                     "SALT=%s\n",
+                     e->hash_device,
+                     e->hash_name,
+                     e->hash_type,
+                     e->data_block_size,
+                     e->hash_block_size,
+                     e->data_blocks,
+                     e->hash_offset,
+                     salt) < 0)
+                return -ENOMEM;
+
+        return write_string_file(path, text, WRITE_STRING_FILE_CREATE|WRITE_STRING_FILE_ATOMIC|WRITE_STRING_FILE_MKDIR_0755|WRITE_STRING_FILE_AVOID_NEWLINE);
+}
+
+int verity_cache_entry_load(const char *path, const char *hash_device_id, VerityCacheEntry *ret) {
+        _cleanup_free_ char *hash_type = NULL, *data_block_size = NULL, *hash_block_size = NULL,
+                *data_blocks = NULL, *hash_offset = NULL, *salt = NULL;
+        _cleanup_(verity_cache_entry_done) VerityCacheEntry e = {};
+        int r;
+
+        assert(path);
+        assert(hash_device_id);
+        assert(ret);
+
+        /* Returns 0 if there's nothing cached for this hash device, 1 if an entry was loaded */
+
+        r = parse_env_file(NULL, path,
+                           "HASH_DEVICE", &e.hash_device,
+                           "HASH", &e.hash_name,
+                           "HASH_TYPE", &hash_type,
+                           "DATA_BLOCK_SIZE", &data_block_size,
+                           "HASH_BLOCK_SIZE", &hash_block_size,
+                           "DATA_BLOCKS", &data_blocks,
+                           "HASH_OFFSET", &hash_offset,
+                           "SALT", &salt);
+        if (r == -ENOENT)
+                return 0;
+        if (r < 0)
+                return r;
+
+        if (!e.hash_device || !e.hash_name || !hash_type || !data_block_size || !hash_block_size || !data_blocks || !hash_offset)
+                return -EBADMSG;
+
+        if (!streq(e.hash_device, hash_device_id))
+                return 0;
+
+        r = safe_atou32(hash_type, &e.hash_type);
+        if (r < 0)
+                return r;
+        r = safe_atou32(data_block_size, &e.data_block_size);
+        if (r < 0)
+                return r;
+        r = safe_atou32(hash_block_size, &e.hash_block_size);
+        if (r < 0)
+                return r;
+        r = safe_atou64(data_blocks, &e.data_blocks);
+        if (r < 0)
+                return r;
+        r = safe_atou64(hash_offset, &e.hash_offset);
+        if (r < 0)
+                return r;
+
+        if (e.data_block_size == 0 || e.hash_block_size == 0 || e.data_blocks == 0)
+                return -EBADMSG;
+
+        /* Images may be set up without a salt */
+        if (!isempty(salt)) {
+                r = unhexmem(salt, strlen(salt), &e.salt, &e.salt_size);
+                if (r < 0)
+                        return r;
+                if (e.salt_size > UINT32_MAX)
+                        return -EBADMSG;
+        }
+
+        *ret = e;
+        e = (VerityCacheEntry) {};
+        return 1;
+}
+
+static int verity_cache_save(const char *path, const char *hash_device_id, struct crypt_device *cd) {
+        struct crypt_params_verity params = {};
+        int r;
+
+        assert(path);
+        assert(hash_device_id);
+        assert(cd);
+
+        r = crypt_get_verity_info(cd, &params);
+        if (r < 0)
+                return r;
+
+        /* We only cache what we learnt from a superblock. The hash tree proper starts at the next hash block
+         * after it, which is where it has to be pointed to when there's no superblock to read. */
+        if (FLAGS_SET(params.flags, CRYPT_VERITY_NO_HEADER) || params.hash_block_size == 0)
+                return -EINVAL;
+
+        return verity_cache_entry_save(path, &(VerityCacheEntry) {
+                        .hash_device = (char*) hash_device_id,
+                        .hash_name = (char*) params.hash_name,
+                        .hash_type = params.hash_type,
+                        .data_block_size = params.data_block_size,
+                        .hash_block_size = params.hash_block_size,
+                        .data_blocks = params.data_size,
+                        .hash_offset = DIV_ROUND_UP(params.hash_area_offset + VERITY_SUPERBLOCK_SIZE, params.hash_block_size) * params.hash_block_size,
+                        .salt = (void*) params.salt,
+                        .salt_size = params.salt_size,
+                });
+}
+
+static int verity_cache_format(const char *path, const char *hash_device_id, const char *data_device, struct crypt_device *cd) {
+        _cleanup_(verity_cache_entry_done) VerityCacheEntry e = {};
+        int r;
+
+        assert(path);
+        assert(hash_device_id);
+        assert(data_device);
+        assert(cd);
+
+        /* Returns 0 if there's nothing cached, 1 if the device was set up from the cached parameters */
+
+        r = verity_cache_entry_load(path, hash_device_id, &e);
+        if (r <= 0)
+                return r;
+
+        r = crypt_format(cd, CRYPT_VERITY, NULL, NULL, NULL, NULL, 0, &(struct crypt_params_verity) {
+                        .hash_name = e.hash_name,
+                        .data_device = data_device,
+                        .salt = e.salt,
+                        .salt_size = e.salt_size,
+                        .hash_type = e.hash_type,
+                        .data_block_size = e.data_block_size,
+                        .hash_block_size = e.hash_block_size,
+                        .data_size = e.data_blocks,
+                        .hash_area_offset = e.hash_offset,
+                        /* Never write a superblock, and don't look for one either */
+                        .flags = CRYPT_VERITY_NO_HEADER,
+                });
+        if (r < 0)
+                return r;
+
+        return 1;
+}
+
+static int crypt_init_verity(
+                const char *hash_device,
+                const char *hash_device_id,
+                const char *data_device,
+                const char *cache,
+                bool use_cache,
+                struct crypt_device **ret) {
+
+        _cleanup_(crypt_freep) struct crypt_device *cd = NULL;
+        int r;
+
+        assert(hash_device);
+        assert(hash_device_id);
+        assert(data_device);
+        assert(cache);
+        assert(ret);
+
+        /* Returns 1 if the cached parameters were used, 0 if the superblock was read. */
+
+        r = crypt_init(&cd, hash_device);
+        if (r < 0)
+                return r;
+
+        crypt_set_log_callback(cd, cryptsetup_log_glue, NULL);
+
+        if (use_cache) {
+                r = verity_cache_format(cache, hash_device_id, data_device, cd);
+                if (r > 0) {
+                        *ret = TAKE_PTR(cd);
+                        return 1;
+                }
+                if (r < 0) {
+                        log_debug_errno(r, "Failed to use cached verity parameters %s, reading superblock: %m", cache);
+                        (void) unlink(cache);
+
+                        /* Start over, crypt_format() might have left a half configured device around */
+                        crypt_free(cd);
+                        cd = NULL;
+
+                        return crypt_init_verity(hash_device, hash_device_id, data_device, cache, false, ret);
+                }
+        }
+
+        r = crypt_load(cd, CRYPT_VERITY, NULL);
+        if (r < 0)
+                return r;
+
+        r = crypt_set_data_device(cd, data_device);
+        if (r < 0)
+                return r;
+
+        r = verity_cache_save(cache, hash_device_id, cd);
+        if (r < 0)
+                log_debug_errno(r, "Failed to cache verity parameters, ignoring: %m");
+
+        *ret = TAKE_PTR(cd);
+        return 0;
+}
+
+int crypt_activate_verity(
+                const char *name,
+                const char *hash_device,
+                const char *data_device,
+                const void *root_hash,
+                size_t root_hash_size,
+                uint32_t flags,
+                struct crypt_device **ret) {
+
+        _cleanup_(crypt_freep) struct crypt_device *cd = NULL;
+        _cleanup_free_ char *cache = NULL, *id = NULL;
+        bool cached;
+        int r;
+
+        assert(name);
+        assert(hash_device);
+        assert(data_device);
+        assert(root_hash);
+
+        /* Activates a verity device. Reading and validating the superblock on the hash device is only done the
+         * first time we see a root hash on a hash device. The parameters are then remembered in /run, and used
+         * directly for any later activation of the same image, e.g. when many images are set up during
+         * boot. A stale or corrupted entry can't be used to subvert anything, as the kernel still checks every
+         * block against the root hash we pass. If the cached parameters don't work out, the entry is dropped
+         * and we try again with the superblock.
+         *
+         * Returns 1 if the cached parameters were used, 0 if the superblock was read. -EEXIST is passed
+         * through unchanged if a device of that name exists already. */
+
+        r = verity_cache_path(root_hash, root_hash_size, &cache);
+        if (r < 0)
+                return r;
+
+        r = verity_hash_device_id(hash_device, &id);
+        if (r < 0)
+                return r;
+
+        r = crypt_init_verity(hash_device, id, data_device, cache, true, &cd);
+        if (r < 0)
+                return r;
+        cached = r > 0;
+
+        r = crypt_activate_by_volume_key(cd, name, root_hash, root_hash_size, flags);
+        if (r < 0 && r != -EEXIST && cached) {
+                log_debug_errno(r, "Failed to activate verity device %s from cached parameters, reading superblock: %m", name);
+                (void) unlink(cache);
+
+                crypt_free(cd);
+                cd = NULL;
+                cached = false;
+
+                r = crypt_init_verity(hash_device, id, data_device, cache, false, &cd);
+                if (r < 0)
+                        return r;
+
+                r = crypt_activate_by_volume_key(cd, name, root_hash, root_hash_size, flags);
+        }
+        if (r < 0)
+                return r;
+
+        if (ret)
+                *ret = TAKE_PTR(cd);
+
+        return cached;
+}
 #endif
@@ -9,4 +9,32 @@
 DEFINE_TRIVIAL_CLEANUP_FUNC(struct crypt_device *, crypt_free);
 
 void cryptsetup_log_glue(int level, const char *msg, void *usrptr);
+
+typedef struct VerityCacheEntry {
+        char *hash_device;
+        char *hash_name;
+        uint32_t hash_type;
+        uint32_t data_block_size;
+        uint32_t hash_block_size;
+        uint64_t data_blocks;
+        uint64_t hash_offset;
+        void *salt;
+        size_t salt_size;
+} VerityCacheEntry;
+
+void verity_cache_entry_done(VerityCacheEntry *e);
+
+int verity_cache_path(const void *root_hash, size_t root_hash_size, char **ret);
+int verity_hash_device_id(const char *hash_device, char **ret);
+int verity_cache_entry_save(const char *path, const VerityCacheEntry *e);
+int verity_cache_entry_load(const char *path, const char *hash_device_id, VerityCacheEntry *ret);
+
+int crypt_activate_verity(
+                const char *name,
+                const char *hash_device,
+                const char *data_device,
+                const void *root_hash,
+                size_t root_hash_size,
+                uint32_t flags,
+                struct crypt_device **ret);
 #endif
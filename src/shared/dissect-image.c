@@ -22,9 +22,11 @@
 #include "def.h"
 #include "device-nodes.h"
 #include "device-util.h"
+#include "dirent-util.h"
 #include "dissect-image.h"
 #include "dm-util.h"
 #include "env-file.h"
+#include "extract-word.h"
 #include "fd-util.h"
 #include "fileio.h"
 #include "fs-util.h"
@@ -37,10 +39,12 @@
 #include "mountpoint-util.h"
 #include "nulstr-util.h"
 #include "os-util.h"
+#include "parse-util.h"
 #include "path-util.h"
 #include "process-util.h"
 #include "raw-clone.h"
 #include "signal-util.h"
+#include "sort-util.h"
 #include "stat-util.h"
 #include "stdio-util.h"
 #include "string-table.h"
@@ -48,6 +52,7 @@
 #include "strv.h"
 #include "tmpfile-util.h"
 #include "udev-util.h"
+#include "time-util.h"
 #include "user-util.h"
 #include "xattr-util.h"
 
@@ -302,8 +307,419 @@ static void check_partition_flags(
         }
 }
 
+static int dissect_cache_key(
+                int fd,
+                const struct stat *st,
+                const void *root_hash,
+                size_t root_hash_size,
+                DissectImageFlags flags,
+                char **ret) {
+
+        char p[SYS_BLOCK_PATH_MAX("/loop/backing_file")];
+        _cleanup_free_ char *backing = NULL, *hex = NULL;
+        struct loop_info64 info;
+        struct stat bst;
+        char *k;
+        int r;
+
+        assert(fd >= 0);
+        assert(st);
+        assert(ret);
+
+        /* The cache is keyed by the identity, size and modification time of the file behind the loop device, the
+         * root hash, and the flags that have an effect on which partitions we pick. Only loop devices are
+         * cached, as there's nothing to identify other block devices by. */
+
+        if (ioctl(fd, LOOP_GET_STATUS64, &info) < 0)
+                return -errno;
+
+#if HAVE_VALGRIND_MEMCHECK_H
+        /* Valgrind currently doesn't know LOOP_GET_STATUS64. Remove this once it does */
+        VALGRIND_MAKE_MEM_DEFINED(&info, sizeof(info));
+#endif
+
+        /* The loop device only knows the inode, look at the file to learn when it was modified. If it was
+         * removed or replaced in the meantime, we don't cache anything. */
+        xsprintf_sys_block_path(p, "/loop/backing_file", st->st_rdev);
+        r = read_one_line_file(p, &backing);
+        if (r < 0)
+                return r;
+
+        if (stat(backing, &bst) < 0)
+                return -errno;
+
+        if (!S_ISREG(bst.st_mode) ||
+            bst.st_dev != (dev_t) info.lo_device ||
+            bst.st_ino != (ino_t) info.lo_inode)
+                return -ESTALE;
+
+        if (root_hash) {
+                hex = hexmem(root_hash, root_hash_size);
+                if (!hex)
+                        return -ENOMEM;
+        }
+
+        if (asprintf(&k, "%" PRIx64 "-%" PRIx64 "-%" PRIx64 "-%" PRIx64 "-%" PRIx64 "-%" PRIx64 "-%x-%s",
+                     (uint64_t) bst.st_dev, (uint64_t) bst.st_ino,
+                     (uint64_t) timespec_load_nsec(&bst.st_mtim), (uint64_t) bst.st_size,
+                     (uint64_t) info.lo_offset, (uint64_t) info.lo_sizelimit,
+                     (unsigned) (flags & (DISSECT_IMAGE_GPT_ONLY|DISSECT_IMAGE_REQUIRE_ROOT|DISSECT_IMAGE_RELAX_VAR_CHECK)),
+                     strempty(hex)) < 0)
+                return -ENOMEM;
+
+        *ret = k;
+        return 0;
+}
+
+static int dissect_cache_partition_node(sd_device *d, const struct stat *st, int partno, char **ret) {
+        _cleanup_free_ char *node = NULL;
+        const char *devname;
+        struct stat pst;
+        dev_t whole;
+        int r;
+
+        assert(d);
+        assert(st);
+        assert(ret);
+
+        /* A file system directly on the device, see dissect_image() */
+        if (partno < 0)
+                return device_path_make_major_minor(st->st_mode, st->st_rdev, ret);
+
+        r = sd_device_get_devname(d, &devname);
+        if (r < 0)
+                return r;
+
+        /* That's how the kernel names partitions: "sda1", but "loop0p1" */
+        if (asprintf(&node, "%s%s%i", devname, strchr(DIGITS, devname[strlen(devname) - 1]) ? "p" : "", partno) < 0)
+                return -ENOMEM;
+
+        /* The kernel creates the partition devices synchronously when the loop device is set up, hence we don't
+         * have to wait for udev here. But make sure the node is what we think it is. */
+        if (stat(node, &pst) < 0)
+                return -errno;
+        if (!S_ISBLK(pst.st_mode))
+                return -ENOTBLK;
+
+        r = block_get_whole_disk(pst.st_rdev, &whole);
+        if (r < 0)
+                return r;
+        if (whole != st->st_rdev)
+                return -ENXIO;
+
+        *ret = TAKE_PTR(node);
+        return 0;
+}
+
+static int dissect_cache_load(const char *key, sd_device *d, const struct stat *st, DissectedImage **ret) {
+        _cleanup_(dissected_image_unrefp) DissectedImage *m = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+        const char *p;
+        unsigned i;
+        int r;
+
+        assert(key);
+        assert(d);
+        assert(st);
+        assert(ret);
+
+        /* Returns 0 if there's nothing cached, 1 if there is and everything checks out */
+
+        p = strjoina(DISSECT_CACHE_DIR "/", key);
+        f = fopen(p, "re");
+        if (!f)
+                return errno == ENOENT ? 0 : -errno;
+
+        r = dissect_cache_parse(f, &m);
+        if (r < 0)
+                return r;
+
+        for (i = 0; i < _PARTITION_DESIGNATOR_MAX; i++) {
+                DissectedPartition *dp = m->partitions + i;
+
+                if (!dp->found)
+                        continue;
+
+                r = dissect_cache_partition_node(d, st, dp->partno, &dp->node);
+                if (r < 0)
+                        return r;
+        }
+
+        *ret = TAKE_PTR(m);
+        return 1;
+}
+
+static int dissect_cache_save(const char *key, const DissectedImage *m) {
+        _cleanup_free_ char *text = NULL;
+        const char *p;
+        int r;
+
+        assert(key);
+        assert(m);
+
+        r = dissect_cache_serialize(m, &text);
+        if (r < 0)
+                return r;
+
+        p = strjoina(DISSECT_CACHE_DIR "/", key);
+        r = write_string_file(p, text, WRITE_STRING_FILE_CREATE|WRITE_STRING_FILE_ATOMIC|WRITE_STRING_FILE_MKDIR_0755|WRITE_STRING_FILE_AVOID_NEWLINE);
+        if (r < 0)
+                return r;
+
+        /* /run is memory, don't let it fill up with images we have long forgotten about */
+        r = dissect_cache_prune(DISSECT_CACHE_DIR, key, DISSECT_CACHE_MAX);
+        if (r < 0)
+                log_debug_errno(r, "Failed to prune image metadata cache, ignoring: %m");
+
+        return 0;
+}
+
 #endif
 
+int dissect_cache_serialize(const DissectedImage *m, char **ret) {
+        _cleanup_free_ char *text = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+        size_t size = 0;
+        unsigned i;
+        int r;
+
+        assert(m);
+        assert(ret);
+
+        f = open_memstream_unlocked(&text, &size);
+        if (!f)
+                return -ENOMEM;
+
+        fprintf(f,
+                "ENCRYPTED=%s\n"
+                "VERITY=%s\n"
+                "CAN_VERITY=%s\n",
+                yes_no(m->encrypted),
+                yes_no(m->verity),
+                yes_no(m->can_verity));
+
+        for (i = 0; i < _PARTITION_DESIGNATOR_MAX; i++) {
+                const DissectedPartition *dp = m->partitions + i;
+                char buf[ID128_UUID_STRING_MAX];
+
+                if (!dp->found)
+                        continue;
+
+                fprintf(f, "PARTITION=%s %i %s %s %s %s\n",
+                        partition_designator_to_string(i),
+                        dp->partno,
+                        yes_no(dp->rw),
+                        dp->architecture >= 0 ? architecture_to_string(dp->architecture) : "-",
+                        id128_to_uuid_string(dp->uuid, buf),
+                        dp->fstype ?: "-");
+        }
+
+        r = fflush_and_check(f);
+        if (r < 0)
+                return r;
+
+        f = safe_fclose(f);
+
+        *ret = TAKE_PTR(text);
+        return 0;
+}
+
+int dissect_cache_parse(FILE *f, DissectedImage **ret) {
+        _cleanup_(dissected_image_unrefp) DissectedImage *m = NULL;
+        int r;
+
+        assert(f);
+        assert(ret);
+
+        /* Parses what dissect_cache_serialize() generated. The partition nodes are not part of it, as they
+         * depend on the loop device the image is attached to. */
+
+        m = new0(DissectedImage, 1);
+        if (!m)
+                return -ENOMEM;
+
+        for (;;) {
+                _cleanup_free_ char *line = NULL, *designator = NULL, *partno = NULL, *rw = NULL,
+                        *architecture = NULL, *uuid = NULL, *fstype = NULL;
+                DissectedPartition *dp;
+                const char *q;
+                int i;
+
+                r = read_line(f, LONG_LINE_MAX, &line);
+                if (r < 0)
+                        return r;
+                if (r == 0)
+                        break;
+
+                if ((q = startswith(line, "ENCRYPTED="))) {
+                        r = parse_boolean(q);
+                        if (r < 0)
+                                return r;
+                        m->encrypted = r;
+                        continue;
+                }
+                if ((q = startswith(line, "VERITY="))) {
+                        r = parse_boolean(q);
+                        if (r < 0)
+                                return r;
+                        m->verity = r;
+                        continue;
+                }
+                if ((q = startswith(line, "CAN_VERITY="))) {
+                        r = parse_boolean(q);
+                        if (r < 0)
+                                return r;
+                        m->can_verity = r;
+                        continue;
+                }
+
+                q = startswith(line, "PARTITION=");
+                if (!q)
+                        return -EBADMSG;
+
+                r = extract_many_words(&q, NULL, 0, &designator, &partno, &rw, &architecture, &uuid, &fstype, NULL);
+                if (r < 0)
+                        return r;
+                if (r != 6)
+                        return -EBADMSG;
+
+                i = partition_designator_from_string(designator);
+                if (i < 0)
+                        return -EBADMSG;
+
+                dp = m->partitions + i;
+                if (dp->found)
+                        return -EBADMSG;
+
+                *dp = (DissectedPartition) {
+                        .found = true,
+                        .architecture = _ARCHITECTURE_INVALID,
+                };
+
+                r = safe_atoi(partno, &dp->partno);
+                if (r < 0)
+                        return r;
+
+                r = parse_boolean(rw);
+                if (r < 0)
+                        return r;
+                dp->rw = r;
+
+                if (!streq(architecture, "-")) {
+                        dp->architecture = architecture_from_string(architecture);
+                        if (dp->architecture < 0)
+                                return -EBADMSG;
+                }
+
+                r = sd_id128_from_string(uuid, &dp->uuid);
+                if (r < 0)
+                        return r;
+
+                if (!streq(fstype, "-"))
+                        dp->fstype = TAKE_PTR(fstype);
+        }
+
+        *ret = TAKE_PTR(m);
+        return 0;
+}
+
+typedef struct CacheEntry {
+        char *name;
+        usec_t mtime;
+} CacheEntry;
+
+static int cache_entry_compare(const CacheEntry *a, const CacheEntry *b) {
+        /* Oldest first */
+        return CMP(a->mtime, b->mtime);
+}
+
+int dissect_cache_prune(const char *path, const char *keep, size_t max) {
+        _cleanup_closedir_ DIR *d = NULL;
+        CacheEntry *entries = NULL;
+        size_t n_entries = 0, n_allocated = 0, i;
+        const char *prefix_end = NULL;
+        struct dirent *de;
+        int r = 0;
+
+        assert(path);
+
+        /* Removes the entries cached for earlier versions of the image "keep" was just saved for, as they
+         * are keyed by the same device and inode but can never match again. Then removes the least recently
+         * written entries until at most "max" remain. */
+
+        if (keep) {
+                /* The key starts with "<device>-<inode>-" */
+                prefix_end = strchr(keep, '-');
+                if (prefix_end)
+                        prefix_end = strchr(prefix_end + 1, '-');
+        }
+
+        d = opendir(path);
+        if (!d)
+                return errno == ENOENT ? 0 : -errno;
+
+        FOREACH_DIRENT(de, d, r = -errno; goto finish) {
+                struct stat st;
+                char *name;
+
+                if (streq_ptr(de->d_name, keep))
+                        continue;
+
+                if (prefix_end && strneq(de->d_name, keep, prefix_end - keep + 1)) {
+                        if (unlinkat(dirfd(d), de->d_name, 0) < 0 && errno != ENOENT)
+                                log_debug_errno(errno, "Failed to remove stale cache entry %s/%s, ignoring: %m", path, de->d_name);
+                        continue;
+                }
+
+                if (fstatat(dirfd(d), de->d_name, &st, AT_SYMLINK_NOFOLLOW) < 0) {
+                        if (errno == ENOENT)
+                                continue;
+
+                        r = -errno;
+                        goto finish;
+                }
+
+                if (!S_ISREG(st.st_mode))
+                        continue;
+
+                name = strdup(de->d_name);
+                if (!name) {
+                        r = -ENOMEM;
+                        goto finish;
+                }
+
+                if (!GREEDY_REALLOC(entries, n_allocated, n_entries + 1)) {
+                        free(name);
+                        r = -ENOMEM;
+                        goto finish;
+                }
+
+                entries[n_entries++] = (CacheEntry) {
+                        .name = name,
+                        .mtime = timespec_load(&st.st_mtim),
+                };
+        }
+
+        /* The entry just saved counts, too */
+        if (keep && max > 0)
+                max--;
+
+        if (n_entries > max) {
+                typesafe_qsort(entries, n_entries, cache_entry_compare);
+
+                for (i = 0; i < n_entries - max; i++)
+                        if (unlinkat(dirfd(d), entries[i].name, 0) < 0 && errno != ENOENT)
+                                log_debug_errno(errno, "Failed to remove cache entry %s/%s, ignoring: %m", path, entries[i].name);
+        }
+
+finish:
+        for (i = 0; i < n_entries; i++)
+                free(entries[i].name);
+        free(entries);
+
+        return r;
+}
+
 int dissect_image(
                 int fd,
                 const void *root_hash,
@@ -318,7 +734,7 @@ int dissect_image(
         _cleanup_(sd_device_unrefp) sd_device *d = NULL;
         _cleanup_(dissected_image_unrefp) DissectedImage *m = NULL;
         _cleanup_(blkid_free_probep) blkid_probe b = NULL;
-        _cleanup_free_ char *generic_node = NULL;
+        _cleanup_free_ char *generic_node = NULL, *cache_key = NULL;
         sd_id128_t generic_uuid = SD_ID128_NULL;
         const char *pttype = NULL;
         blkid_partlist pl;
@@ -359,6 +775,29 @@ int dissect_image(
         if (!S_ISBLK(st.st_mode))
                 return -ENOTBLK;
 
+        if (FLAGS_SET(flags, DISSECT_IMAGE_CACHE)) {
+                r = dissect_cache_key(fd, &st, root_hash, root_hash_size, flags, &cache_key);
+                if (r < 0)
+                        log_debug_errno(r, "Not caching what we find in the image: %m");
+                else {
+                        _cleanup_(sd_device_unrefp) sd_device *cd = NULL;
+
+                        r = sd_device_new_from_devnum(&cd, 'b', st.st_rdev);
+                        if (r < 0)
+                                return r;
+
+                        /* Seen this image before? Then skip probing and waiting for udev */
+                        r = dissect_cache_load(cache_key, cd, &st, &m);
+                        if (r < 0)
+                                log_debug_errno(r, "Failed to load cached image metadata, probing image: %m");
+                        if (r > 0) {
+                                log_debug("Using cached metadata of image.");
+                                *ret = TAKE_PTR(m);
+                                return 0;
+                        }
+                }
+        }
+
         b = blkid_new_probe();
         if (!b)
                 return -ENOMEM;
@@ -430,6 +869,13 @@ int dissect_image(
                                 if (r < 0)
                                         return r;
                         }
+
+                        if (cache_key) {
+                                r = dissect_cache_save(cache_key, m);
+                                if (r < 0)
+                                        log_debug_errno(r, "Failed to cache image metadata, ignoring: %m");
+                        }
+
                         *ret = TAKE_PTR(m);
 
                         return 0;
@@ -844,6 +1290,12 @@ int dissect_image(
                         p->rw = false;
         }
 
+        if (cache_key) {
+                r = dissect_cache_save(cache_key, m);
+                if (r < 0)
+                        log_debug_errno(r, "Failed to cache image metadata, ignoring: %m");
+        }
+
         *ret = TAKE_PTR(m);
 
         return 0;
@@ -1085,6 +1537,7 @@ typedef struct DecryptedPartition {
         struct crypt_device *device;
         char *name;
         bool relinquished;
+        bool shared; /* Possibly in use by others too, see verity_partition() */
 } DecryptedPartition;
 
 struct DecryptedImage {
@@ -1106,7 +1559,11 @@ DecryptedImage* decrypted_image_unref(DecryptedImage* d) {
                 DecryptedPartition *p = d->decrypted + i;
 
                 if (p->device && p->name && !p->relinquished) {
-                        r = crypt_deactivate(p->device, p->name);
+                        /* Others might still be using shared devices, let the last one remove it */
+                        if (p->shared)
+                                r = dm_deferred_remove(p->name);
+                        else
+                                r = crypt_deactivate(p->device, p->name);
                         if (r < 0)
                                 log_debug_errno(r, "Failed to deactivate encrypted partition %s", p->name);
                 }
@@ -1211,6 +1668,53 @@ static int decrypt_partition(
         return 0;
 }
 
+static int verity_reuse(
+                const char *name,
+                const void *root_hash,
+                size_t root_hash_size,
+                struct crypt_device **ret) {
+
+        _cleanup_(crypt_freep) struct crypt_device *cd = NULL;
+        _cleanup_free_ char *existing = NULL;
+        size_t existing_size;
+        int r;
+
+        assert(name);
+        assert(root_hash);
+        assert(ret);
+
+        /* Attaches to a verity device somebody else set up for the same image, after checking that it is really
+         * what the name suggests */
+
+        r = crypt_init_by_name(&cd, name);
+        if (r < 0)
+                return log_debug_errno(r, "Failed to open existing verity device %s: %m", name);
+
+        crypt_set_log_callback(cd, cryptsetup_log_glue, NULL);
+
+        if (!streq_ptr(crypt_get_type(cd), CRYPT_VERITY))
+                return log_debug_errno(SYNTHETIC_ERRNO(EEXIST), "Existing device %s is not a verity device.", name);
+
+        r = crypt_get_volume_key_size(cd);
+        if (r <= 0)
+                return log_debug_errno(r < 0 ? r : SYNTHETIC_ERRNO(EINVAL), "Failed to get root hash size of %s: %m", name);
+        existing_size = r;
+
+        existing = malloc(existing_size);
+        if (!existing)
+                return -ENOMEM;
+
+        r = crypt_volume_key_get(cd, CRYPT_ANY_SLOT, existing, &existing_size, NULL, 0);
+        if (r < 0)
+                return log_debug_errno(r, "Failed to get root hash of %s: %m", name);
+
+        if (memcmp_nn(existing, existing_size, root_hash, root_hash_size) != 0)
+                return log_debug_errno(SYNTHETIC_ERRNO(EEXIST), "Existing verity device %s has a different root hash.", name);
+
+        *ret = TAKE_PTR(cd);
+        return 0;
+}
+
 static int verity_partition(
                 DissectedPartition *m,
                 DissectedPartition *v,
@@ -1221,6 +1725,9 @@ static int verity_partition(
 
         _cleanup_free_ char *node = NULL, *name = NULL;
         _cleanup_(crypt_freep) struct crypt_device *cd = NULL;
+        char ts[FORMAT_TIMESPAN_MAX];
+        const char *how = "";
+        usec_t start;
         int r;
 
         assert(m);
@@ -1237,33 +1744,63 @@ static int verity_partition(
         if (!streq(v->fstype, "DM_verity_hash"))
                 return 0;
 
-        r = make_dm_name_and_node(m->node, "-verity", &name, &node);
-        if (r < 0)
-                return r;
+        if (FLAGS_SET(flags, DISSECT_IMAGE_VERITY_SHARE)) {
+                _cleanup_free_ char *hex = NULL;
+
+                /* Name the device after the root hash rather than the partition, so that everybody using the same
+                 * image ends up with the same device */
+                hex = hexmem(root_hash, root_hash_size);
+                if (!hex)
+                        return -ENOMEM;
+
+                name = strjoin(hex, "-verity");
+                if (!name)
+                        return -ENOMEM;
+                if (!filename_is_valid(name))
+                        return -EINVAL;
+
+                node = path_join(crypt_get_dir(), name);
+                if (!node)
+                        return -ENOMEM;
+        } else {
+                r = make_dm_name_and_node(m->node, "-verity", &name, &node);
+                if (r < 0)
+                        return r;
+        }
 
         if (!GREEDY_REALLOC0(d->decrypted, d->n_allocated, d->n_decrypted + 1))
                 return -ENOMEM;
 
-        r = crypt_init(&cd, v->node);
-        if (r < 0)
-                return r;
+        start = now(CLOCK_MONOTONIC);
 
-        crypt_set_log_callback(cd, cryptsetup_log_glue, NULL);
+        for (unsigned n_attempts = 0;; n_attempts++) {
+                r = crypt_activate_verity(name, v->node, m->node, root_hash, root_hash_size, CRYPT_ACTIVATE_READONLY, &cd);
+                if (r >= 0)
+                        how = r > 0 ? ", using cached parameters" : "";
+                if (r != -EEXIST || !FLAGS_SET(flags, DISSECT_IMAGE_VERITY_SHARE))
+                        break;
 
-        r = crypt_load(cd, CRYPT_VERITY, NULL);
-        if (r < 0)
-                return r;
+                /* Somebody else set it up already, use theirs */
+                r = verity_reuse(name, root_hash, root_hash_size, &cd);
+                if (r >= 0) {
+                        how = ", reusing existing device";
+                        break;
+                }
 
-        r = crypt_set_data_device(cd, m->node);
+                /* The device might have been removed by its last user just now, try again to set it up then */
+                if (!IN_SET(r, -ENODEV, -ENXIO, -ENOENT) || n_attempts >= 3)
+                        return r;
+        }
         if (r < 0)
                 return r;
 
-        r = crypt_activate_by_volume_key(cd, name, root_hash, root_hash_size, CRYPT_ACTIVATE_READONLY);
-        if (r < 0)
-                return r;
+        log_debug("Set up verity device %s in %s%s.", name,
+                  format_timespan(ts, sizeof(ts), now(CLOCK_MONOTONIC) - start, 1),
+                  how);
 
         d->decrypted[d->n_decrypted].name = TAKE_PTR(name);
         d->decrypted[d->n_decrypted].device = TAKE_PTR(cd);
+        d->decrypted[d->n_decrypted].shared = FLAGS_SET(flags, DISSECT_IMAGE_VERITY_SHARE);
         d->n_decrypted++;
 
         m->decrypted_node = TAKE_PTR(node);
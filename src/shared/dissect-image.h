@@ -2,6 +2,7 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stdio.h>
 
 #include "sd-id128.h"
 
@@ -63,6 +64,8 @@ typedef enum DissectImageFlags {
         DISSECT_IMAGE_NO_UDEV             = 1 << 9,  /* Don't wait for udev initializing things */
         DISSECT_IMAGE_RELAX_VAR_CHECK     = 1 << 10, /* Don't insist that the UUID of /var is hashed from /etc/machine-id */
         DISSECT_IMAGE_FSCK                = 1 << 11, /* File system check the partition before mounting (no effect when combined with DISSECT_IMAGE_READ_ONLY) */
+        DISSECT_IMAGE_CACHE               = 1 << 12, /* Remember what we found in /run, and use that next time the same image is dissected */
+        DISSECT_IMAGE_VERITY_SHARE        = 1 << 13, /* Name verity devices after the root hash, and use existing ones set up for the same image */
 } DissectImageFlags;
 
 struct DissectedImage {
@@ -99,3 +102,11 @@ const char* partition_designator_to_string(int i) _const_;
 int partition_designator_from_string(const char *name) _pure_;
 
 int root_hash_load(const char *image, void **ret, size_t *ret_size);
+
+/* Where dissect_image() remembers what it found in images with DISSECT_IMAGE_CACHE, and how many of them */
+#define DISSECT_CACHE_DIR "/run/systemd/dissect-cache"
+#define DISSECT_CACHE_MAX 64U
+
+int dissect_cache_serialize(const DissectedImage *m, char **ret);
+int dissect_cache_parse(FILE *f, DissectedImage **ret);
+int dissect_cache_prune(const char *path, const char *keep, size_t max);
@@ -4,6 +4,7 @@
 #include <errno.h>
 #include <sys/prctl.h>
 #include <sys/types.h>
+#include <sys/wait.h>
 #include <unistd.h>
 #include <stdio.h>
 
@@ -72,12 +73,55 @@ static int do_spawn(const char *path, char *argv[], int stdout_fd, pid_t *pid) {
         return 1;
 }
 
+typedef struct ExecDirChild {
+        usec_t start;
+        char path[];
+} ExecDirChild;
+
+static void record_timing(int timings_fd, const char *path, usec_t start, int status) {
+        if (timings_fd < 0)
+                return;
+
+        /* The file name goes last, so that it may contain whitespace */
+        if (dprintf(timings_fd, USEC_FMT " " USEC_FMT " %i %s\n",
+                    start, now(CLOCK_MONOTONIC), status, basename(path)) < 0)
+                log_debug_errno(errno, "Failed to record execution time of %s, ignoring: %m", path);
+}
+
+static int wait_for_any(Hashmap *pids, ExecDirChild **ret, pid_t *ret_pid) {
+        for (;;) {
+                siginfo_t si = {};
+                ExecDirChild *c;
+
+                /* Peek at whichever child finished first, and leave the reaping (and logging) to
+                 * wait_for_terminate_and_check(). */
+                if (waitid(P_ALL, 0, &si, WEXITED|WNOWAIT) < 0) {
+                        if (errno == EINTR)
+                                continue;
+
+                        return log_error_errno(errno, "Failed to wait for children: %m");
+                }
+
+                c = hashmap_remove(pids, PID_TO_PTR(si.si_pid));
+                if (!c) {
+                        /* Not one of ours, reap it and go on */
+                        (void) wait_for_terminate(si.si_pid, NULL);
+                        continue;
+                }
+
+                *ret = c;
+                *ret_pid = si.si_pid;
+                return 0;
+        }
+}
+
 static int do_execute(
                 char **directories,
                 usec_t timeout,
                 gather_stdout_callback_t const callbacks[_STDOUT_CONSUME_MAX],
                 void* const callback_args[_STDOUT_CONSUME_MAX],
                 int output_fd,
+                int timings_fd,
                 char *argv[],
                 char *envp[],
                 ExecDirFlags flags) {
@@ -117,13 +161,14 @@ static int do_execute(
                         return log_error_errno(errno, "Failed to set environment variable: %m");
 
         STRV_FOREACH(path, paths) {
-                _cleanup_free_ char *t = NULL;
+                _cleanup_free_ ExecDirChild *c = NULL;
                 _cleanup_close_ int fd = -1;
                 pid_t pid;
 
-                t = strdup(*path);
-                if (!t)
+                c = malloc(offsetof(ExecDirChild, path) + strlen(*path) + 1);
+                if (!c)
                         return log_oom();
+                strcpy(c->path, *path);
 
                 if (callbacks) {
                         fd = open_serialization_fd(basename(*path));
@@ -131,17 +176,20 @@ static int do_execute(
                                 return log_error_errno(fd, "Failed to open serialization file: %m");
                 }
 
-                r = do_spawn(t, argv, fd, &pid);
+                c->start = now(CLOCK_MONOTONIC);
+
+                r = do_spawn(c->path, argv, fd, &pid);
                 if (r <= 0)
                         continue;
 
                 if (parallel_execution) {
-                        r = hashmap_put(pids, PID_TO_PTR(pid), t);
+                        r = hashmap_put(pids, PID_TO_PTR(pid), c);
                         if (r < 0)
                                 return log_oom();
-                        t = NULL;
+                        c = NULL;
                 } else {
-                        r = wait_for_terminate_and_check(t, pid, WAIT_LOG);
+                        r = wait_for_terminate_and_check(c->path, pid, WAIT_LOG);
+                        record_timing(timings_fd, c->path, c->start, r);
                         if (FLAGS_SET(flags, EXEC_DIR_IGNORE_ERRORS)) {
                                 if (r < 0)
                                         continue;
@@ -166,17 +214,18 @@ static int do_execute(
                         return log_error_errno(r, "Callback two failed: %m");
         }
 
+        /* Collect the children in the order they finish, so that each one's execution time is
+         * recorded as precisely as possible, and a failure is reported as soon as it happens. */
         while (!hashmap_isempty(pids)) {
-                _cleanup_free_ char *t = NULL;
+                _cleanup_free_ ExecDirChild *c = NULL;
                 pid_t pid;
 
-                pid = PTR_TO_PID(hashmap_first_key(pids));
-                assert(pid > 0);
-
-                t = hashmap_remove(pids, PID_TO_PTR(pid));
-                assert(t);
+                r = wait_for_any(pids, &c, &pid);
+                if (r < 0)
+                        return r;
 
-                r = wait_for_terminate_and_check(t, pid, WAIT_LOG);
+                r = wait_for_terminate_and_check(c->path, pid, WAIT_LOG);
+                record_timing(timings_fd, c->path, c->start, r);
                 if (!FLAGS_SET(flags, EXEC_DIR_IGNORE_ERRORS) && r > 0)
                         return r;
         }
@@ -184,22 +233,91 @@ static int do_execute(
         return 0;
 }
 
-int execute_directories(
+ExecDirTiming* exec_dir_timings_free(ExecDirTiming *t, size_t n) {
+        size_t i;
+
+        for (i = 0; i < n; i++)
+                free(t[i].name);
+
+        return mfree(t);
+}
+
+static int read_timings(int fd, ExecDirTiming **ret, size_t *ret_n) {
+        _cleanup_fclose_ FILE *f = NULL;
+        ExecDirTiming *timings = NULL;
+        size_t n = 0, allocated = 0;
+        int r;
+
+        f = fdopen(fd, "r");
+        if (!f) {
+                safe_close(fd);
+                return -errno;
+        }
+
+        for (;;) {
+                _cleanup_free_ char *line = NULL;
+                usec_t start, finish;
+                int status, k = 0;
+
+                r = read_line(f, LONG_LINE_MAX, &line);
+                if (r < 0)
+                        goto fail;
+                if (r == 0)
+                        break;
+
+                if (sscanf(line, USEC_FMT " " USEC_FMT " %i %n", &start, &finish, &status, &k) != 3 ||
+                    k <= 0 || isempty(line + k)) {
+                        log_debug("Failed to parse execution time record, ignoring: %s", line);
+                        continue;
+                }
+
+                if (!GREEDY_REALLOC(timings, allocated, n + 1)) {
+                        r = -ENOMEM;
+                        goto fail;
+                }
+
+                timings[n] = (ExecDirTiming) {
+                        .name = strdup(line + k),
+                        .start = start,
+                        .finish = finish,
+                        .status = status,
+                };
+                if (!timings[n].name) {
+                        r = -ENOMEM;
+                        goto fail;
+                }
+
+                n++;
+        }
+
+        *ret = timings;
+        *ret_n = n;
+        return 0;
+
+fail:
+        exec_dir_timings_free(timings, n);
+        return r;
+}
+
+int execute_directories_full(
                 const char* const* directories,
                 usec_t timeout,
                 gather_stdout_callback_t const callbacks[_STDOUT_CONSUME_MAX],
                 void* const callback_args[_STDOUT_CONSUME_MAX],
                 char *argv[],
                 char *envp[],
-                ExecDirFlags flags) {
+                ExecDirFlags flags,
+                ExecDirTiming **ret_timings,
+                size_t *ret_n_timings) {
 
         char **dirs = (char**) directories;
-        _cleanup_close_ int fd = -1;
+        _cleanup_close_ int fd = -1, timings_fd = -1;
         char *name;
         int r;
         pid_t executor_pid;
 
         assert(!strv_isempty(dirs));
+        assert(!ret_timings == !ret_n_timings);
 
         name = basename(dirs[0]);
         assert(!isempty(name));
@@ -215,6 +333,15 @@ int execute_directories(
                         return log_error_errno(fd, "Failed to open serialization file: %m");
         }
 
+        if (ret_timings) {
+                /* The executor writes one record per executable as soon as it finished, so that the
+                 * records of those that finished in time survive the executor being killed by the
+                 * timeout. */
+                timings_fd = open_serialization_fd("timings");
+                if (timings_fd < 0)
+                        return log_error_errno(timings_fd, "Failed to open serialization file: %m");
+        }
+
         /* Executes all binaries in the directories serially or in parallel and waits for
          * them to finish. Optionally a timeout is applied. If a file with the same name
          * exists in more than one directory, the earliest one wins. */
@@ -223,11 +350,30 @@ int execute_directories(
         if (r < 0)
                 return r;
         if (r == 0) {
-                r = do_execute(dirs, timeout, callbacks, callback_args, fd, argv, envp, flags);
+                r = do_execute(dirs, timeout, callbacks, callback_args, fd, timings_fd, argv, envp, flags);
                 _exit(r < 0 ? EXIT_FAILURE : r);
         }
 
         r = wait_for_terminate_and_check("(sd-executor)", executor_pid, 0);
+
+        /* Read the records before looking at how the executor fared: if it was killed by the timeout
+         * (-EPROTO), the records of the executables that finished in time are all we learn about them. */
+        if (ret_timings) {
+                ExecDirTiming *timings = NULL;
+                size_t n_timings = 0;
+                int k;
+
+                if (lseek(timings_fd, 0, SEEK_SET) < 0)
+                        return log_error_errno(errno, "Failed to rewind serialization fd: %m");
+
+                k = read_timings(TAKE_FD(timings_fd), &timings, &n_timings);
+                if (k < 0)
+                        return log_error_errno(k, "Failed to read execution times: %m");
+
+                *ret_timings = timings;
+                *ret_n_timings = n_timings;
+        }
+
         if (r < 0)
                 return r;
         if (!FLAGS_SET(flags, EXEC_DIR_IGNORE_ERRORS) && r > 0)
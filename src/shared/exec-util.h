@@ -29,14 +29,39 @@ typedef enum ExecCommandFlags {
         _EXEC_COMMAND_FLAGS_INVALID   = -1,
 } ExecCommandFlags;
 
-int execute_directories(
+typedef struct ExecDirTiming {
+        char *name;     /* file name of the executable */
+        usec_t start;   /* CLOCK_MONOTONIC */
+        usec_t finish;  /* CLOCK_MONOTONIC */
+        int status;     /* exit status, or negative errno if the process did not exit normally */
+} ExecDirTiming;
+
+ExecDirTiming* exec_dir_timings_free(ExecDirTiming *t, size_t n);
+
+/* Once the executables were run, *ret_timings is set even if an error is returned, e.g. -EPROTO if they were
+ * killed by the timeout, and needs to be freed by the caller in either case. */
+int execute_directories_full(
+                const char* const* directories,
+                usec_t timeout,
+                gather_stdout_callback_t const callbacks[_STDOUT_CONSUME_MAX],
+                void* const callback_args[_STDOUT_CONSUME_MAX],
+                char *argv[],
+                char *envp[],
+                ExecDirFlags flags,
+                ExecDirTiming **ret_timings,
+                size_t *ret_n_timings);
+
+static inline int execute_directories(
                 const char* const* directories,
                 usec_t timeout,
                 gather_stdout_callback_t const callbacks[_STDOUT_CONSUME_MAX],
                 void* const callback_args[_STDOUT_CONSUME_MAX],
                 char *argv[],
                 char *envp[],
-                ExecDirFlags flags);
+                ExecDirFlags flags) {
+
+        return execute_directories_full(directories, timeout, callbacks, callback_args, argv, envp, flags, NULL, NULL);
+}
 
 int exec_command_flags_from_strv(char **ex_opts, ExecCommandFlags *flags);
 int exec_command_flags_to_strv(ExecCommandFlags flags, char ***ex_opts);
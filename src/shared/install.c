@@ -21,6 +21,7 @@
 #include "hashmap.h"
 #include "install-printf.h"
 #include "install.h"
+#include "list.h"
 #include "locale-util.h"
 #include "log.h"
 #include "macro.h"
@@ -55,6 +56,30 @@ typedef enum {
         PRESET_DISABLE,
 } PresetAction;
 
+/* A reverse index of the symlinks below the search paths, so that determining the enablement state of many
+ * units doesn't require reading all of the directories again for each unit, see unit_file_get_list(). */
+
+typedef struct SymlinkIndexEntry SymlinkIndexEntry;
+
+struct SymlinkIndexEntry {
+        char *path;   /* absolute path of the symlink */
+        char *dest;   /* absolute destination of the symlink, below the root directory */
+
+        LIST_FIELDS(SymlinkIndexEntry, by_name);
+        LIST_FIELDS(SymlinkIndexEntry, by_dest);
+};
+
+typedef struct {
+        Hashmap *by_name;   /* symlink name → list of SymlinkIndexEntry */
+        Hashmap *by_dest;   /* destination file name → list of SymlinkIndexEntry */
+        int error;          /* the first error seen while reading the directory tree */
+} SymlinkIndexDir;
+
+typedef struct {
+        SymlinkIndexDir *dirs;   /* one for each entry of LookupPaths.search_path */
+        size_t n_dirs;
+} SymlinkIndex;
+
 typedef struct {
         char *pattern;
         PresetAction action;
@@ -691,6 +716,69 @@ static int is_symlink_with_known_name(const UnitFileInstallInfo *i, const char *
         return false;
 }
 
+static int find_symlinks_match(
+                const UnitFileInstallInfo *i,
+                bool match_aliases,
+                bool ignore_same_name,
+                const char *name,
+                const char *path,
+                const char *dest,
+                const char *config_path,
+                bool *same_name_link) {
+
+        bool found_path = false, found_dest, b = false;
+        int q;
+
+        assert(i);
+        assert(name);
+        assert(path);
+        assert(dest);
+        assert(config_path);
+        assert(same_name_link);
+
+        /* Checks whether the symlink 'path' called 'name' pointing to 'dest' is one we are looking for. */
+
+        assert(unit_name_is_valid(i->name, UNIT_NAME_ANY));
+        if (!ignore_same_name)
+                /* Check if the symlink itself matches what we are looking for.
+                 *
+                 * If ignore_same_name is specified, we are in one of the directories which
+                 * have lower priority than the unit file, and even if a file or symlink with
+                 * this name was found, we should ignore it. */
+                 found_path = streq(name, i->name);
+
+        /* Check if what the symlink points to matches what we are looking for */
+        found_dest = streq(basename(dest), i->name);
+
+        if (found_path && found_dest) {
+                _cleanup_free_ char *t = NULL;
+
+                /* Filter out same name links in the main
+                 * config path */
+                t = path_make_absolute(i->name, config_path);
+                if (!t)
+                        return -ENOMEM;
+
+                b = path_equal(t, path);
+        }
+
+        if (b)
+                *same_name_link = true;
+        else if (found_path || found_dest) {
+                if (!match_aliases)
+                        return 1;
+
+                /* Check if symlink name is in the set of names used by [Install] */
+                q = is_symlink_with_known_name(i, name);
+                if (q < 0)
+                        return q;
+                if (q > 0)
+                        return 1;
+        }
+
+        return 0;
+}
+
 static int find_symlinks_fd(
                 const char *root_dir,
                 const UnitFileInstallInfo *i,
@@ -751,7 +839,6 @@ static int find_symlinks_fd(
 
                 } else if (de->d_type == DT_LNK) {
                         _cleanup_free_ char *p = NULL, *dest = NULL;
-                        bool found_path = false, found_dest, b = false;
                         int q;
 
                         /* Acquire symlink name */
@@ -780,43 +867,10 @@ static int find_symlinks_fd(
                                 free_and_replace(dest, x);
                         }
 
-                        assert(unit_name_is_valid(i->name, UNIT_NAME_ANY));
-                        if (!ignore_same_name)
-                                /* Check if the symlink itself matches what we are looking for.
-                                 *
-                                 * If ignore_same_name is specified, we are in one of the directories which
-                                 * have lower priority than the unit file, and even if a file or symlink with
-                                 * this name was found, we should ignore it. */
-                                 found_path = streq(de->d_name, i->name);
-
-                        /* Check if what the symlink points to matches what we are looking for */
-                        found_dest = streq(basename(dest), i->name);
-
-                        if (found_path && found_dest) {
-                                _cleanup_free_ char *t = NULL;
-
-                                /* Filter out same name links in the main
-                                 * config path */
-                                t = path_make_absolute(i->name, config_path);
-                                if (!t)
-                                        return -ENOMEM;
-
-                                b = path_equal(t, p);
-                        }
-
-                        if (b)
-                                *same_name_link = true;
-                        else if (found_path || found_dest) {
-                                if (!match_aliases)
-                                        return 1;
-
-                                /* Check if symlink name is in the set of names used by [Install] */
-                                q = is_symlink_with_known_name(i, de->d_name);
-                                if (q < 0)
-                                        return q;
-                                if (q > 0)
-                                        return 1;
-                        }
+                        q = find_symlinks_match(i, match_aliases, ignore_same_name, de->d_name, p, dest,
+                                                config_path, same_name_link);
+                        if (q != 0)
+                                return q;
                 }
         }
 
@@ -849,9 +903,250 @@ static int find_symlinks(
                                 config_path, config_path, same_name_link);
 }
 
+static SymlinkIndexEntry *symlink_index_entry_free(SymlinkIndexEntry *e) {
+        if (!e)
+                return NULL;
+
+        free(e->path);
+        free(e->dest);
+        return mfree(e);
+}
+
+static void symlink_index_done(SymlinkIndex *x) {
+        size_t k;
+
+        assert(x);
+
+        for (k = 0; k < x->n_dirs; k++) {
+                SymlinkIndexDir *d = x->dirs + k;
+                SymlinkIndexEntry *head;
+
+                /* Every entry is on exactly one of the by_name lists */
+                while ((head = hashmap_steal_first(d->by_name))) {
+                        SymlinkIndexEntry *e, *n;
+
+                        LIST_FOREACH_SAFE(by_name, e, n, head)
+                                symlink_index_entry_free(e);
+                }
+
+                hashmap_free(d->by_name);
+                hashmap_free(d->by_dest);
+        }
+
+        x->dirs = mfree(x->dirs);
+        x->n_dirs = 0;
+}
+
+static int symlink_index_add(SymlinkIndexDir *d, char *path, char *dest) {
+        SymlinkIndexEntry *e, *head;
+        int r;
+
+        assert(d);
+        assert(path);
+        assert(dest);
+
+        /* Takes ownership of 'path' and 'dest', also on failure */
+
+        e = new0(SymlinkIndexEntry, 1);
+        if (!e) {
+                free(path);
+                free(dest);
+                return -ENOMEM;
+        }
+
+        e->path = path;
+        e->dest = dest;
+
+        r = hashmap_ensure_allocated(&d->by_name, &string_hash_ops);
+        if (r < 0)
+                goto fail;
+
+        r = hashmap_ensure_allocated(&d->by_dest, &string_hash_ops);
+        if (r < 0)
+                goto fail;
+
+        /* Make sure both insertions will succeed before touching either of the lists */
+        r = hashmap_reserve(d->by_name, 1);
+        if (r < 0)
+                goto fail;
+
+        r = hashmap_reserve(d->by_dest, 1);
+        if (r < 0)
+                goto fail;
+
+        head = hashmap_get(d->by_name, basename(e->path));
+        LIST_PREPEND(by_name, head, e);
+        assert_se(hashmap_replace(d->by_name, basename(e->path), head) >= 0);
+
+        head = hashmap_get(d->by_dest, basename(e->dest));
+        LIST_PREPEND(by_dest, head, e);
+        assert_se(hashmap_replace(d->by_dest, basename(e->dest), head) >= 0);
+
+        return 0;
+
+fail:
+        symlink_index_entry_free(e);
+        return r;
+}
+
+static int symlink_index_dir_fill_fd(
+                SymlinkIndexDir *x,
+                const char *root_dir,
+                int fd,
+                const char *path) {
+
+        _cleanup_closedir_ DIR *d = NULL;
+        struct dirent *de;
+        int r;
+
+        assert(x);
+        assert(fd >= 0);
+        assert(path);
+
+        /* Collects the symlinks in the same way find_symlinks_fd() looks at them. Errors other than
+         * ENOMEM are recorded in the index, and are returned by lookups not finding a match, like
+         * find_symlinks_fd() does. */
+
+        d = fdopendir(fd);
+        if (!d) {
+                if (x->error == 0)
+                        x->error = -errno;
+                safe_close(fd);
+                return 0;
+        }
+
+        FOREACH_DIRENT(de, d, if (x->error == 0) x->error = -errno; return 0) {
+
+                dirent_ensure_type(d, de);
+
+                if (de->d_type == DT_DIR) {
+                        _cleanup_free_ char *p = NULL;
+                        int nfd;
+
+                        nfd = openat(fd, de->d_name, O_RDONLY|O_NONBLOCK|O_DIRECTORY|O_CLOEXEC|O_NOFOLLOW);
+                        if (nfd < 0) {
+                                if (errno != ENOENT && x->error == 0)
+                                        x->error = -errno;
+                                continue;
+                        }
+
+                        p = path_make_absolute(de->d_name, path);
+                        if (!p) {
+                                safe_close(nfd);
+                                return -ENOMEM;
+                        }
+
+                        /* This will close nfd, regardless whether it succeeds or not */
+                        r = symlink_index_dir_fill_fd(x, root_dir, nfd, p);
+                        if (r < 0)
+                                return r;
+
+                } else if (de->d_type == DT_LNK) {
+                        _cleanup_free_ char *p = NULL, *dest = NULL;
+
+                        p = path_make_absolute(de->d_name, path);
+                        if (!p)
+                                return -ENOMEM;
+
+                        r = readlink_malloc(p, &dest);
+                        if (r == -ENOENT)
+                                continue;
+                        if (r < 0) {
+                                if (x->error == 0)
+                                        x->error = r;
+                                continue;
+                        }
+
+                        if (!path_is_absolute(dest)) {
+                                char *j;
+
+                                j = path_join(root_dir, dest);
+                                if (!j)
+                                        return -ENOMEM;
+
+                                free_and_replace(dest, j);
+                        }
+
+                        r = symlink_index_add(x, TAKE_PTR(p), TAKE_PTR(dest));
+                        if (r < 0)
+                                return r;
+                }
+        }
+
+        return 0;
+}
+
+static int symlink_index_build(SymlinkIndex *x, const LookupPaths *paths) {
+        char **p;
+        int r;
+
+        assert(x);
+        assert(paths);
+
+        x->dirs = new0(SymlinkIndexDir, strv_length(paths->search_path));
+        if (!x->dirs)
+                return -ENOMEM;
+
+        STRV_FOREACH(p, paths->search_path) {
+                SymlinkIndexDir *d = x->dirs + x->n_dirs++;
+                int fd;
+
+                fd = open(*p, O_RDONLY|O_NONBLOCK|O_DIRECTORY|O_CLOEXEC);
+                if (fd < 0) {
+                        if (!IN_SET(errno, ENOENT, ENOTDIR, EACCES))
+                                d->error = -errno;
+                        continue;
+                }
+
+                /* This takes possession of fd and closes it */
+                r = symlink_index_dir_fill_fd(d, paths->root_dir, fd, *p);
+                if (r < 0)
+                        return r;
+        }
+
+        return 0;
+}
+
+static int find_symlinks_indexed(
+                const SymlinkIndexDir *d,
+                const UnitFileInstallInfo *i,
+                bool match_name,
+                bool ignore_same_name,
+                const char *config_path,
+                bool *same_name_link) {
+
+        SymlinkIndexEntry *e;
+        int r;
+
+        assert(d);
+        assert(i);
+        assert(config_path);
+        assert(same_name_link);
+
+        /* Same as find_symlinks(), but only looks at the symlinks that can match: the ones called like the
+         * unit, and the ones pointing to a file called like the unit. */
+
+        LIST_FOREACH(by_name, e, (SymlinkIndexEntry*) hashmap_get(d->by_name, i->name)) {
+                r = find_symlinks_match(i, match_name, ignore_same_name, basename(e->path), e->path, e->dest,
+                                        config_path, same_name_link);
+                if (r != 0)
+                        return r;
+        }
+
+        LIST_FOREACH(by_dest, e, (SymlinkIndexEntry*) hashmap_get(d->by_dest, i->name)) {
+                r = find_symlinks_match(i, match_name, ignore_same_name, basename(e->path), e->path, e->dest,
+                                        config_path, same_name_link);
+                if (r != 0)
+                        return r;
+        }
+
+        return d->error;
+}
+
 static int find_symlinks_in_scope(
                 UnitFileScope scope,
                 const LookupPaths *paths,
+                const SymlinkIndex *index,
                 const UnitFileInstallInfo *i,
                 bool match_name,
                 UnitFileState *state) {
@@ -864,6 +1159,7 @@ static int find_symlinks_in_scope(
 
         assert(paths);
         assert(i);
+        assert(!index || index->n_dirs == strv_length(paths->search_path));
 
         /* As we iterate over the list of search paths in paths->search_path, we may encounter "same name"
          * symlinks. The ones which are "below" (i.e. have lower priority) than the unit file itself are
@@ -872,7 +1168,11 @@ static int find_symlinks_in_scope(
         STRV_FOREACH(p, paths->search_path)  {
                 bool same_name_link = false;
 
-                r = find_symlinks(paths->root_dir, i, match_name, ignore_same_name, *p, &same_name_link);
+                if (index)
+                        r = find_symlinks_indexed(index->dirs + (p - paths->search_path), i, match_name,
+                                                  ignore_same_name, *p, &same_name_link);
+                else
+                        r = find_symlinks(paths->root_dir, i, match_name, ignore_same_name, *p, &same_name_link);
                 if (r < 0)
                         return r;
                 if (r > 0) {
@@ -2731,9 +3031,10 @@ int unit_file_get_default(
         return 0;
 }
 
-int unit_file_lookup_state(
+static int unit_file_lookup_state_full(
                 UnitFileScope scope,
                 const LookupPaths *paths,
+                const SymlinkIndex *index,
                 const char *name,
                 UnitFileState *ret) {
 
@@ -2791,7 +3092,7 @@ int unit_file_lookup_state(
                 /* Check if any of the Alias= symlinks have been created.
                  * We ignore other aliases, and only check those that would
                  * be created by systemctl enable for this unit. */
-                r = find_symlinks_in_scope(scope, paths, i, true, &state);
+                r = find_symlinks_in_scope(scope, paths, index, i, true, &state);
                 if (r < 0)
                         return r;
                 if (r > 0)
@@ -2799,7 +3100,7 @@ int unit_file_lookup_state(
 
                 /* Check if the file is known under other names. If it is,
                  * it might be in use. Report that as UNIT_FILE_INDIRECT. */
-                r = find_symlinks_in_scope(scope, paths, i, false, &state);
+                r = find_symlinks_in_scope(scope, paths, index, i, false, &state);
                 if (r < 0)
                         return r;
                 if (r > 0)
@@ -2823,6 +3124,15 @@ int unit_file_lookup_state(
         return 0;
 }
 
+int unit_file_lookup_state(
+                UnitFileScope scope,
+                const LookupPaths *paths,
+                const char *name,
+                UnitFileState *ret) {
+
+        return unit_file_lookup_state_full(scope, paths, NULL, name, ret);
+}
+
 int unit_file_get_state(
                 UnitFileScope scope,
                 const char *root_dir,
@@ -3343,6 +3653,7 @@ int unit_file_get_list(
                 char **states,
                 char **patterns) {
 
+        _cleanup_(symlink_index_done) SymlinkIndex index = {};
         _cleanup_(lookup_paths_free) LookupPaths paths = {};
         char **i;
         int r;
@@ -3355,6 +3666,11 @@ int unit_file_get_list(
         if (r < 0)
                 return r;
 
+        /* Read the symlinks in all search paths once, instead of once for each unit file */
+        r = symlink_index_build(&index, &paths);
+        if (r < 0)
+                return r;
+
         STRV_FOREACH(i, paths.search_path) {
                 _cleanup_closedir_ DIR *d = NULL;
                 struct dirent *de;
@@ -3396,7 +3712,7 @@ int unit_file_get_list(
                         if (!f->path)
                                 return -ENOMEM;
 
-                        r = unit_file_lookup_state(scope, &paths, de->d_name, &f->state);
+                        r = unit_file_lookup_state_full(scope, &paths, &index, de->d_name, &f->state);
                         if (r < 0)
                                 f->state = UNIT_FILE_BAD;
 
@@ -280,9 +280,114 @@ static int process_special_field(JournalImporter *imp, char *line) {
         return 0;
 }
 
+static int process_binary_entry(JournalImporter *imp) {
+        uint64_t realtime, monotonic;
+        uint8_t *p, *e;
+        void *data;
+        int r;
+
+        assert(imp);
+
+        if (imp->state == IMPORTER_STATE_LINE) {
+                assert(imp->data_size == 0);
+                imp->state = IMPORTER_STATE_DATA_START;
+        }
+
+        if (imp->state == IMPORTER_STATE_DATA_START) {
+                r = fill_fixed_size(imp, &data, sizeof(uint64_t));
+                if (r < 0)
+                        return r;
+                if (r == 0) {
+                        imp->state = IMPORTER_STATE_EOF;
+                        return 0;
+                }
+
+                imp->data_size = unaligned_read_le64(data);
+                if (imp->data_size > DATA_SIZE_MAX)
+                        return log_error_errno(SYNTHETIC_ERRNO(ENOBUFS),
+                                               "Entry is bigger than %u bytes.",
+                                               DATA_SIZE_MAX);
+                if (imp->data_size < JOURNAL_BINARY_ENTRY_HEADER_SIZE)
+                        return log_error_errno(SYNTHETIC_ERRNO(EBADMSG),
+                                               "Entry of %zu bytes is too short.", imp->data_size);
+
+                imp->state = IMPORTER_STATE_DATA;
+        }
+
+        assert(imp->state == IMPORTER_STATE_DATA);
+
+        /* Wait for the whole entry, so that the fields can simply point into the buffer */
+        r = fill_fixed_size(imp, &data, imp->data_size);
+        if (r < 0)
+                return r;
+        if (r == 0) {
+                imp->state = IMPORTER_STATE_EOF;
+                return 0;
+        }
+
+        p = data;
+        e = p + imp->data_size;
+
+        realtime = unaligned_read_le64(p);
+        monotonic = unaligned_read_le64(p + sizeof(uint64_t));
+
+        if (realtime != 0 && !VALID_REALTIME(realtime)) {
+                log_warning("__REALTIME_TIMESTAMP out of range, ignoring: %"PRIu64, realtime);
+                return -ERANGE;
+        }
+        if (monotonic != 0 && !VALID_MONOTONIC(monotonic)) {
+                log_warning("__MONOTONIC_TIMESTAMP out of range, ignoring: %"PRIu64, monotonic);
+                return -ERANGE;
+        }
+
+        imp->ts.realtime = realtime;
+        imp->ts.monotonic = monotonic;
+        memcpy(&imp->boot_id, p + 2 * sizeof(uint64_t), sizeof(sd_id128_t));
+
+        for (p += JOURNAL_BINARY_ENTRY_HEADER_SIZE; p < e;) {
+                uint8_t *sep;
+                uint32_t l;
+
+                if ((size_t) (e - p) < sizeof(uint32_t))
+                        return log_error_errno(SYNTHETIC_ERRNO(EBADMSG), "Truncated field size in entry.");
+
+                l = unaligned_read_le32(p);
+                p += sizeof(uint32_t);
+
+                if (l > (size_t) (e - p))
+                        return log_error_errno(SYNTHETIC_ERRNO(EBADMSG), "Field extends beyond the end of the entry.");
+
+                sep = memchr(p, '=', l);
+                if (!sep)
+                        return log_error_errno(SYNTHETIC_ERRNO(EBADMSG), "Field without '=' in entry.");
+
+                if (!journal_field_valid((const char*) p, sep - p, true)) {
+                        char buf[64], *t;
+
+                        t = strndupa((const char*) p, sep - p);
+                        log_debug("Ignoring invalid field: \"%s\"",
+                                  cellescape(buf, sizeof buf, t));
+                } else {
+                        r = iovw_put(&imp->iovw, p, l);
+                        if (r < 0)
+                                return r;
+                }
+
+                p += l;
+        }
+
+        imp->data_size = 0;
+        imp->state = IMPORTER_STATE_LINE;
+
+        return 1;
+}
+
 int journal_importer_process_data(JournalImporter *imp) {
         int r;
 
+        if (imp->binary)
+                return process_binary_entry(imp);
+
         switch(imp->state) {
         case IMPORTER_STATE_LINE: {
                 char *line, *sep;
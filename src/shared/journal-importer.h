@@ -25,9 +25,17 @@
 /* The maximum number of fields in an entry */
 #define ENTRY_FIELD_COUNT_MAX 1024
 
+/* A binary framing of entries that is cheaper to produce and to parse than the export format. Each entry is
+ * the little-endian 64bit size of the rest of the entry, followed by the little-endian 64bit realtime and
+ * monotonic timestamps (0 if unknown), and the 128bit boot ID. The fields follow, each as little-endian
+ * 32bit size followed by FIELD=VALUE, without any terminator. */
+#define JOURNAL_BINARY_CONTENT_TYPE "application/vnd.fdo.journal.binary"
+#define JOURNAL_BINARY_ENTRY_HEADER_SIZE (2 * sizeof(uint64_t) + sizeof(sd_id128_t))
+
 typedef struct JournalImporter {
         int fd;
         bool passive_fd;
+        bool binary;       /* input uses the binary framing instead of the export format */
         char *name;
 
         char *buf;
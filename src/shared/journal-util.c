@@ -1,11 +1,14 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
 #include "acl-util.h"
+#include "alloc-util.h"
+#include "fileio.h"
 #include "fs-util.h"
 #include "hashmap.h"
 #include "journal-internal.h"
 #include "journal-util.h"
 #include "log.h"
+#include "parse-util.h"
 #include "strv.h"
 #include "user-util.h"
 
@@ -176,3 +179,43 @@ bool journal_field_valid(const char *p, size_t l, bool allow_protected) {
 
         return true;
 }
+
+int journal_unit_index_check(const char *directory, const char *unit, usec_t since) {
+        _cleanup_free_ char *line = NULL;
+        const char *p;
+        usec_t valid;
+        int r;
+
+        assert(unit);
+
+        /* Checks the index of units that logged anything during this boot, which journald maintains for
+         * the default namespace. Returns 0 if the specified unit definitely didn't log anything since the
+         * specified CLOCK_MONOTONIC timestamp, > 0 if it might have, and < 0 if the index cannot be used
+         * for answering that. If no directory is specified, journald's own index is used. */
+
+        if (!directory)
+                directory = JOURNAL_UNIT_INDEX_DIR;
+
+        p = strjoina(directory, "/.since");
+        r = read_one_line_file(p, &line);
+        if (r < 0)
+                return r;
+
+        r = safe_atou64(line, &valid);
+        if (r < 0)
+                return r;
+
+        /* The index only knows about messages since it was created */
+        if (since < valid)
+                return -ESTALE;
+
+        p = strjoina(directory, "/", unit);
+        if (access(p, F_OK) < 0) {
+                if (errno == ENOENT)
+                        return 0;
+
+                return -errno;
+        }
+
+        return 1;
+}
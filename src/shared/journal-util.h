@@ -6,6 +6,12 @@
 
 #include "sd-journal.h"
 
+#include "time-util.h"
+
 bool journal_field_valid(const char *p, size_t l, bool allow_protected);
 int journal_access_blocked(sd_journal *j);
 int journal_access_check_and_warn(sd_journal *j, bool quiet, bool want_other_users);
+
+#define JOURNAL_UNIT_INDEX_DIR "/run/systemd/journal/units"
+
+int journal_unit_index_check(const char *directory, const char *unit, usec_t since);
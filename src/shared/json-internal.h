@@ -2,6 +2,7 @@
 
 #pragma once
 
+#include "arena.h"
 #include "json.h"
 
 /* This header should include all prototypes only the JSON parser itself and
@@ -73,4 +74,4 @@ enum { /* JSON tokens */
         _JSON_TOKEN_INVALID = -1,
 };
 
-int json_tokenize(const char **p, char **ret_string, JsonValue *ret_value, unsigned *ret_line, unsigned *ret_column, void **state, unsigned *line, unsigned *column);
+int json_tokenize(Arena *arena, const char **p, char **ret_string, JsonValue *ret_value, unsigned *ret_line, unsigned *ret_column, void **state, unsigned *line, unsigned *column);
@@ -19,6 +19,7 @@
 #include "json.h"
 #include "macro.h"
 #include "memory-util.h"
+#include "stdio-util.h"
 #include "string-table.h"
 #include "string-util.h"
 #include "strv.h"
@@ -1717,6 +1718,263 @@ static int json_format(FILE *f, JsonVariant *v, JsonFormatFlags flags, const cha
         return 0;
 }
 
+typedef struct JsonBuffer {
+        char *data;
+        size_t size, allocated;
+} JsonBuffer;
+
+static char* json_buffer_extend(JsonBuffer *b, size_t n) {
+        char *p;
+
+        if (!GREEDY_REALLOC(b->data, b->allocated, b->size + n))
+                return NULL;
+
+        p = b->data + b->size;
+        b->size += n;
+        return p;
+}
+
+static int json_buffer_put(JsonBuffer *b, const char *s, size_t n) {
+        char *p;
+
+        p = json_buffer_extend(b, n);
+        if (!p)
+                return -ENOMEM;
+
+        memcpy(p, s, n);
+        return 0;
+}
+
+static int json_buffer_putc(JsonBuffer *b, char c) {
+        return json_buffer_put(b, &c, 1);
+}
+
+static int json_buffer_put_string(JsonBuffer *b, const char *s) {
+        int r;
+
+        r = json_buffer_putc(b, '"');
+        if (r < 0)
+                return r;
+
+        for (;;) {
+                const char *q;
+                size_t n;
+
+                /* Copy everything that doesn't need escaping in one go */
+                for (q = s; *q && *q != '"' && *q != '\\' && ((signed char) *q < 0 || *q >= ' '); q++)
+                        ;
+
+                n = q - s;
+                r = json_buffer_put(b, s, n);
+                if (r < 0)
+                        return r;
+
+                if (*q == 0)
+                        break;
+
+                switch (*q) {
+
+                case '"':
+                        r = json_buffer_put(b, "\\\"", 2);
+                        break;
+
+                case '\\':
+                        r = json_buffer_put(b, "\\\\", 2);
+                        break;
+
+                case '\b':
+                        r = json_buffer_put(b, "\\b", 2);
+                        break;
+
+                case '\f':
+                        r = json_buffer_put(b, "\\f", 2);
+                        break;
+
+                case '\n':
+                        r = json_buffer_put(b, "\\n", 2);
+                        break;
+
+                case '\r':
+                        r = json_buffer_put(b, "\\r", 2);
+                        break;
+
+                case '\t':
+                        r = json_buffer_put(b, "\\t", 2);
+                        break;
+
+                default: {
+                        char *p;
+
+                        p = json_buffer_extend(b, 6);
+                        if (!p)
+                                return -ENOMEM;
+
+                        p[0] = '\\';
+                        p[1] = 'u';
+                        p[2] = '0';
+                        p[3] = '0';
+                        p[4] = hexchar(*q >> 4);
+                        p[5] = hexchar(*q);
+                        r = 0;
+                        break;
+                }}
+                if (r < 0)
+                        return r;
+
+                s = q + 1;
+        }
+
+        return json_buffer_putc(b, '"');
+}
+
+static int json_format_buffer(JsonBuffer *b, JsonVariant *v) {
+        char buf[MAX(DECIMAL_STR_MAX(intmax_t), DECIMAL_STR_MAX(uintmax_t))];
+        int r;
+
+        assert(b);
+        assert(v);
+
+        /* Like json_format(), but formats compactly, and writes straight into a memory buffer */
+
+        switch (json_variant_type(v)) {
+
+        case JSON_VARIANT_REAL: {
+                _cleanup_free_ char *t = NULL;
+
+                if (asprintf(&t, "%.*Le", DECIMAL_DIG, json_variant_real(v)) < 0)
+                        return -ENOMEM;
+
+                return json_buffer_put(b, t, strlen(t));
+        }
+
+        case JSON_VARIANT_INTEGER:
+                xsprintf(buf, "%" PRIdMAX, json_variant_integer(v));
+                return json_buffer_put(b, buf, strlen(buf));
+
+        case JSON_VARIANT_UNSIGNED:
+                xsprintf(buf, "%" PRIuMAX, json_variant_unsigned(v));
+                return json_buffer_put(b, buf, strlen(buf));
+
+        case JSON_VARIANT_BOOLEAN:
+                if (json_variant_boolean(v))
+                        return json_buffer_put(b, "true", 4);
+
+                return json_buffer_put(b, "false", 5);
+
+        case JSON_VARIANT_NULL:
+                return json_buffer_put(b, "null", 4);
+
+        case JSON_VARIANT_STRING:
+                return json_buffer_put_string(b, json_variant_string(v));
+
+        case JSON_VARIANT_ARRAY: {
+                size_t i, n;
+
+                n = json_variant_elements(v);
+
+                r = json_buffer_putc(b, '[');
+                if (r < 0)
+                        return r;
+
+                for (i = 0; i < n; i++) {
+                        if (i > 0) {
+                                r = json_buffer_putc(b, ',');
+                                if (r < 0)
+                                        return r;
+                        }
+
+                        r = json_format_buffer(b, json_variant_by_index(v, i));
+                        if (r < 0)
+                                return r;
+                }
+
+                return json_buffer_putc(b, ']');
+        }
+
+        case JSON_VARIANT_OBJECT: {
+                size_t i, n;
+
+                n = json_variant_elements(v);
+
+                r = json_buffer_putc(b, '{');
+                if (r < 0)
+                        return r;
+
+                for (i = 0; i < n; i += 2) {
+                        if (i > 0) {
+                                r = json_buffer_putc(b, ',');
+                                if (r < 0)
+                                        return r;
+                        }
+
+                        r = json_format_buffer(b, json_variant_by_index(v, i));
+                        if (r < 0)
+                                return r;
+
+                        r = json_buffer_putc(b, ':');
+                        if (r < 0)
+                                return r;
+
+                        r = json_format_buffer(b, json_variant_by_index(v, i+1));
+                        if (r < 0)
+                                return r;
+                }
+
+                return json_buffer_putc(b, '}');
+        }
+
+        default:
+                assert_not_reached("Unexpected variant type.");
+        }
+}
+
+static int json_variant_format_buffer(JsonVariant *v, JsonFormatFlags flags, char **ret) {
+        JsonBuffer b = {};
+        int r;
+
+        if (flags & JSON_FORMAT_SSE) {
+                r = json_buffer_put(&b, "data: ", 6);
+                if (r < 0)
+                        goto fail;
+        }
+        if (flags & JSON_FORMAT_SEQ) {
+                r = json_buffer_putc(&b, '\x1e'); /* ASCII Record Separator */
+                if (r < 0)
+                        goto fail;
+        }
+
+        r = json_format_buffer(&b, v);
+        if (r < 0)
+                goto fail;
+
+        if (flags & (JSON_FORMAT_SEQ|JSON_FORMAT_SSE|JSON_FORMAT_NEWLINE)) {
+                r = json_buffer_putc(&b, '\n');
+                if (r < 0)
+                        goto fail;
+        }
+        if (flags & JSON_FORMAT_SSE) {
+                r = json_buffer_putc(&b, '\n'); /* In case of SSE add a second newline */
+                if (r < 0)
+                        goto fail;
+        }
+
+        r = json_buffer_putc(&b, '\0');
+        if (r < 0)
+                goto fail;
+
+        if (b.size - 1 > INT_MAX) {
+                r = -ENOBUFS;
+                goto fail;
+        }
+
+        *ret = b.data;
+        return (int) b.size - 1;
+
+fail:
+        free(b.data);
+        return r;
+}
+
 int json_variant_format(JsonVariant *v, JsonFormatFlags flags, char **ret) {
         _cleanup_free_ char *s = NULL;
         size_t sz = 0;
@@ -1728,6 +1986,11 @@ int json_variant_format(JsonVariant *v, JsonFormatFlags flags, char **ret) {
         assert_return(v, -EINVAL);
         assert_return(ret, -EINVAL);
 
+        /* Compact output, as used for IPC, is put together directly in memory, the rest goes through
+         * json_variant_dump() */
+        if ((flags & (JSON_FORMAT_PRETTY|JSON_FORMAT_PRETTY_AUTO|JSON_FORMAT_COLOR|JSON_FORMAT_COLOR_AUTO)) == 0)
+                return json_variant_format_buffer(v, flags, ret);
+
         {
                 _cleanup_fclose_ FILE *f = NULL;
 
@@ -2335,11 +2598,12 @@ static int unhex_ucs2(const char *c, uint16_t *ret) {
         return 0;
 }
 
-static int json_parse_string(const char **p, char **ret) {
-        _cleanup_free_ char *s = NULL;
+static int json_parse_string(Arena *arena, const char **p, char **ret) {
+        char *s = NULL;
         size_t n = 0, allocated = 0;
         const char *c;
 
+        assert(arena);
         assert(p);
         assert(*p);
         assert(ret);
@@ -2368,7 +2632,7 @@ static int json_parse_string(const char **p, char **ret) {
 
                 if (*c == '"') {
                         if (!s) {
-                                s = strdup("");
+                                s = arena_strdup(arena, "");
                                 if (!s)
                                         return -ENOMEM;
                         } else
@@ -2376,7 +2640,7 @@ static int json_parse_string(const char **p, char **ret) {
 
                         *p = c + 1;
 
-                        *ret = TAKE_PTR(s);
+                        *ret = s;
                         return JSON_TOKEN_STRING;
                 }
 
@@ -2409,7 +2673,7 @@ static int json_parse_string(const char **p, char **ret) {
 
                                 c += 5;
 
-                                if (!GREEDY_REALLOC(s, allocated, n + 5))
+                                if (!ARENA_GREEDY_REALLOC(arena, s, allocated, n + 5))
                                         return -ENOMEM;
 
                                 if (!utf16_is_surrogate(x))
@@ -2438,7 +2702,7 @@ static int json_parse_string(const char **p, char **ret) {
                         } else
                                 return -EINVAL;
 
-                        if (!GREEDY_REALLOC(s, allocated, n + 2))
+                        if (!ARENA_GREEDY_REALLOC(arena, s, allocated, n + 2))
                                 return -ENOMEM;
 
                         s[n++] = ch;
@@ -2450,7 +2714,7 @@ static int json_parse_string(const char **p, char **ret) {
                 if (len < 0)
                         return len;
 
-                if (!GREEDY_REALLOC(s, allocated, n + len + 1))
+                if (!ARENA_GREEDY_REALLOC(arena, s, allocated, n + len + 1))
                         return -ENOMEM;
 
                 memcpy(s + n, c, len);
@@ -2565,6 +2829,7 @@ static int json_parse_number(const char **p, JsonValue *ret) {
 }
 
 int json_tokenize(
+                Arena *arena,         /* string tokens are allocated from here */
                 const char **p,
                 char **ret_string,
                 JsonValue *ret_value,
@@ -2649,7 +2914,7 @@ int json_tokenize(
 
                 } else if (*c == '"') {
 
-                        r = json_parse_string(&c, ret_string);
+                        r = json_parse_string(arena, &c, ret_string);
                         if (r < 0)
                                 return r;
 
@@ -2776,6 +3041,14 @@ static void json_stack_release(JsonStack *s) {
         s->elements = mfree(s->elements);
 }
 
+static void json_stack_release_parsed(JsonStack *s) {
+        assert(s);
+
+        /* The element arrays of the parser are allocated from its arena */
+        json_variant_unref_many(s->elements, s->n_elements);
+        s->elements = NULL;
+}
+
 static int json_parse_internal(
                 const char **input,
                 JsonSource *source,
@@ -2787,6 +3060,7 @@ static int json_parse_internal(
 
         size_t n_stack = 1, n_stack_allocated = 0, i;
         unsigned line_buffer = 0, column_buffer = 0;
+        _cleanup_(arena_done) Arena arena = {};
         void *tokenizer_state = NULL;
         JsonStack *stack = NULL;
         const char *p;
@@ -2811,7 +3085,7 @@ static int json_parse_internal(
 
         for (;;) {
                 _cleanup_(json_variant_unrefp) JsonVariant *add = NULL;
-                _cleanup_free_ char *string = NULL;
+                char *string = NULL;
                 unsigned line_token, column_token;
                 JsonStack *current;
                 JsonValue value;
@@ -2823,7 +3097,7 @@ static int json_parse_internal(
                 if (continue_end && current->expect == EXPECT_END)
                         goto done;
 
-                token = json_tokenize(&p, &string, &value, &line_token, &column_token, &tokenizer_state, line, column);
+                token = json_tokenize(&arena, &p, &string, &value, &line_token, &column_token, &tokenizer_state, line, column);
                 if (token < 0) {
                         r = token;
                         goto finish;
@@ -2911,7 +3185,7 @@ static int json_parse_internal(
                         line_token = current->line_before;
                         column_token = current->column_before;
 
-                        json_stack_release(current);
+                        json_stack_release_parsed(current);
                         n_stack--, current--;
 
                         break;
@@ -2961,7 +3235,7 @@ static int json_parse_internal(
                         line_token = current->line_before;
                         column_token = current->column_before;
 
-                        json_stack_release(current);
+                        json_stack_release_parsed(current);
                         n_stack--, current--;
                         break;
 
@@ -3106,7 +3380,7 @@ static int json_parse_internal(
 
                         (void) json_variant_set_source(&add, source, line_token, column_token);
 
-                        if (!GREEDY_REALLOC(current->elements, current->n_elements_allocated, current->n_elements + 1)) {
+                        if (!ARENA_GREEDY_REALLOC(&arena, current->elements, current->n_elements_allocated, current->n_elements + 1)) {
                                 r = -ENOMEM;
                                 goto finish;
                         }
@@ -3125,7 +3399,7 @@ done:
 
 finish:
         for (i = 0; i < n_stack; i++)
-                json_stack_release(stack + i);
+                json_stack_release_parsed(stack + i);
 
         free(stack);
 
@@ -16,6 +16,7 @@
 #include "fd-util.h"
 #include "format-util.h"
 #include "hashmap.h"
+#include "hexdecoct.h"
 #include "hostname-util.h"
 #include "id128-util.h"
 #include "io-util.h"
@@ -37,6 +38,7 @@
 #include "strv.h"
 #include "terminal-util.h"
 #include "time-util.h"
+#include "unaligned.h"
 #include "utf8.h"
 #include "util.h"
 
@@ -363,6 +365,22 @@ static int output_timestamp_realtime(FILE *f, sd_journal *j, OutputMode mode, Ou
         return (int) strlen(buf);
 }
 
+/* The fields output_short() looks at, keep in sync with the list there */
+static char **const short_output_fields = STRV_MAKE(
+                "_PID",
+                "_COMM",
+                "MESSAGE",
+                "PRIORITY",
+                "_TRANSPORT",
+                "_HOSTNAME",
+                "SYSLOG_PID",
+                "SYSLOG_IDENTIFIER",
+                "_SOURCE_REALTIME_TIMESTAMP",
+                "_SOURCE_MONOTONIC_TIMESTAMP",
+                "CONFIG_FILE",
+                "_SYSTEMD_UNIT",
+                "_SYSTEMD_USER_UNIT");
+
 static int output_short(
                 FILE *f,
                 sd_journal *j,
@@ -876,6 +894,361 @@ static int update_json_data_split(
         return update_json_data(h, flags, name, eq + 1, size - (eq - (const char*) data) - 1);
 }
 
+/* Entries with up to this many fields are formatted straight into a buffer, without building JSON variants
+ * and a hashmap first. Fields repeated within an entry are found by a linear search, which is cheaper than
+ * hashing for this few. Anything bigger takes the generic route. */
+#define JSON_FIELDS_FAST_MAX 64U
+
+typedef struct JsonField {
+        /* Offsets into the buffer: the field name formatted as JSON string, and the formatted value */
+        size_t name_offset, name_size;
+        size_t value_offset, value_size;
+
+        /* Links the fields of the same name, the first one of them also knows the last one */
+        size_t next, last;
+        bool first;
+} JsonField;
+
+typedef struct JsonFieldBuffer {
+        char *data;
+        size_t size, allocated;
+} JsonFieldBuffer;
+
+static void json_field_buffer_done(JsonFieldBuffer *b) {
+        free(b->data);
+}
+
+static char* json_field_buffer_extend(JsonFieldBuffer *b, size_t n) {
+        char *p;
+
+        if (!GREEDY_REALLOC(b->data, b->allocated, b->size + n))
+                return NULL;
+
+        p = b->data + b->size;
+        b->size += n;
+        return p;
+}
+
+static int json_field_buffer_put(JsonFieldBuffer *b, const void *p, size_t n) {
+        char *e;
+
+        e = json_field_buffer_extend(b, n);
+        if (!e)
+                return -ENOMEM;
+
+        memcpy_safe(e, p, n);
+        return 0;
+}
+
+static bool json_char_needs_escape(char c) {
+        return IN_SET(c, '"', '\\') || (uint8_t) c < ' ';
+}
+
+static bool json_word_needs_escape(uint64_t w) {
+        const uint64_t ones = UINT64_C(0x0101010101010101), highs = UINT64_C(0x8080808080808080);
+        uint64_t quote = w ^ (ones * '"'), backslash = w ^ (ones * '\\');
+
+        /* Whether any of the eight bytes is below ' ', or equal to '"' or '\\', all in one go */
+        return ((w - ones * ' ') & ~w & highs) ||
+                ((quote - ones) & ~quote & highs) ||
+                ((backslash - ones) & ~backslash & highs);
+}
+
+static int json_field_buffer_put_string(JsonFieldBuffer *b, const char *p, size_t l) {
+        size_t i = 0;
+        int r;
+
+        /* Escapes the same way as json_variant_dump() does */
+
+        r = json_field_buffer_put(b, "\"", 1);
+        if (r < 0)
+                return r;
+
+        while (i < l) {
+                char esc[6] = { '\\' };
+                size_t k = i, n = 2;
+
+                /* Find the end of the run that can be copied as is, eight bytes at a time first */
+                while (k + sizeof(uint64_t) <= l && !json_word_needs_escape(unaligned_read_ne64(p + k)))
+                        k += sizeof(uint64_t);
+                while (k < l && !json_char_needs_escape(p[k]))
+                        k++;
+
+                r = json_field_buffer_put(b, p + i, k - i);
+                if (r < 0)
+                        return r;
+                if (k >= l)
+                        break;
+
+                switch (p[k]) {
+
+                case '"':
+                case '\\':
+                        esc[1] = p[k];
+                        break;
+
+                case '\b':
+                        esc[1] = 'b';
+                        break;
+
+                case '\f':
+                        esc[1] = 'f';
+                        break;
+
+                case '\n':
+                        esc[1] = 'n';
+                        break;
+
+                case '\r':
+                        esc[1] = 'r';
+                        break;
+
+                case '\t':
+                        esc[1] = 't';
+                        break;
+
+                default:
+                        esc[1] = 'u';
+                        esc[2] = '0';
+                        esc[3] = '0';
+                        esc[4] = hexchar(p[k] >> 4);
+                        esc[5] = hexchar(p[k]);
+                        n = 6;
+                }
+
+                r = json_field_buffer_put(b, esc, n);
+                if (r < 0)
+                        return r;
+
+                i = k + 1;
+        }
+
+        return json_field_buffer_put(b, "\"", 1);
+}
+
+static int json_field_buffer_put_bytes(JsonFieldBuffer *b, const uint8_t *p, size_t l) {
+        size_t i;
+        char *e;
+
+        /* Up to three digits and a comma for each byte, plus the brackets */
+        if (!GREEDY_REALLOC(b->data, b->allocated, b->size + l * 4 + 2))
+                return -ENOMEM;
+
+        e = b->data + b->size;
+        *e++ = '[';
+
+        for (i = 0; i < l; i++) {
+                if (i > 0)
+                        *e++ = ',';
+                if (p[i] >= 100)
+                        *e++ = '0' + p[i] / 100;
+                if (p[i] >= 10)
+                        *e++ = '0' + p[i] / 10 % 10;
+                *e++ = '0' + p[i] % 10;
+        }
+
+        *e++ = ']';
+        b->size = e - b->data;
+
+        return 0;
+}
+
+static int json_fields_add(
+                JsonField *fields,
+                size_t *n_fields,
+                JsonFieldBuffer *b,
+                OutputFlags flags,
+                const char *name,
+                size_t name_size,
+                const void *value,
+                size_t size) {
+
+        JsonField *field;
+        size_t i;
+        int r;
+
+        assert(*n_fields < JSON_FIELDS_FAST_MAX);
+
+        /* Formats the field the same way as update_json_data() would */
+
+        field = fields + *n_fields;
+        *field = (JsonField) {
+                .name_offset = b->size,
+                .next = SIZE_MAX,
+                .last = *n_fields,
+                .first = true,
+        };
+
+        r = json_field_buffer_put_string(b, name, name_size);
+        if (r < 0)
+                return r;
+
+        field->name_size = b->size - field->name_offset;
+        field->value_offset = b->size;
+
+        if (!(flags & OUTPUT_SHOW_ALL) && name_size + 1 + size >= JSON_THRESHOLD)
+                r = json_field_buffer_put(b, "null", 4);
+        else if (utf8_is_printable(value, size))
+                r = json_field_buffer_put_string(b, value, size);
+        else
+                r = json_field_buffer_put_bytes(b, value, size);
+        if (r < 0)
+                return r;
+
+        field->value_size = b->size - field->value_offset;
+
+        for (i = 0; i < *n_fields; i++) {
+                JsonField *other = fields + i;
+
+                if (!other->first ||
+                    other->name_size != field->name_size ||
+                    memcmp(b->data + other->name_offset, b->data + field->name_offset, field->name_size) != 0)
+                        continue;
+
+                fields[other->last].next = *n_fields;
+                other->last = *n_fields;
+                field->first = false;
+                break;
+        }
+
+        (*n_fields)++;
+        return 0;
+}
+
+static int output_json_fast(
+                FILE *f,
+                sd_journal *j,
+                OutputMode mode,
+                OutputFlags flags,
+                Set *output_fields,
+                const char *cursor,
+                usec_t realtime,
+                usec_t monotonic,
+                sd_id128_t boot_id) {
+
+        char sid[SD_ID128_STRING_MAX], usecbuf[DECIMAL_STR_MAX(usec_t)];
+        _cleanup_(json_field_buffer_done) JsonFieldBuffer b = {};
+        JsonField fields[JSON_FIELDS_FAST_MAX];
+        size_t n = 0, start, i, k;
+        bool sep = false;
+        int r;
+
+        /* Like the rest of output_json(), but for compact, uncolored output only. Returns -E2BIG if the entry
+         * has too many fields for this, in which case nothing has been written yet. */
+
+        r = json_fields_add(fields, &n, &b, flags, "__CURSOR", STRLEN("__CURSOR"), cursor, strlen(cursor));
+        if (r < 0)
+                return log_oom();
+
+        xsprintf(usecbuf, USEC_FMT, realtime);
+        r = json_fields_add(fields, &n, &b, flags, "__REALTIME_TIMESTAMP", STRLEN("__REALTIME_TIMESTAMP"), usecbuf, strlen(usecbuf));
+        if (r < 0)
+                return log_oom();
+
+        xsprintf(usecbuf, USEC_FMT, monotonic);
+        r = json_fields_add(fields, &n, &b, flags, "__MONOTONIC_TIMESTAMP", STRLEN("__MONOTONIC_TIMESTAMP"), usecbuf, strlen(usecbuf));
+        if (r < 0)
+                return log_oom();
+
+        sd_id128_to_string(boot_id, sid);
+        r = json_fields_add(fields, &n, &b, flags, "_BOOT_ID", STRLEN("_BOOT_ID"), sid, strlen(sid));
+        if (r < 0)
+                return log_oom();
+
+        for (;;) {
+                const void *data;
+                const char *eq;
+                size_t size, name_size;
+
+                r = sd_journal_enumerate_data(j, &data, &size);
+                if (r == -EBADMSG) {
+                        log_debug_errno(r, "Skipping message we can't read: %m");
+                        return 0;
+                }
+                if (r < 0)
+                        return log_error_errno(r, "Failed to read journal: %m");
+                if (r == 0)
+                        break;
+
+                /* Same filtering as update_json_data_split() */
+                if (memory_startswith(data, size, "_BOOT_ID="))
+                        continue;
+
+                eq = memchr(data, '=', MIN(size, JSON_THRESHOLD));
+                if (!eq || eq == data)
+                        continue;
+
+                name_size = strnlen(data, eq - (const char*) data);
+                if (output_fields && !set_get(output_fields, strndupa(data, name_size)))
+                        continue;
+
+                if (n >= JSON_FIELDS_FAST_MAX)
+                        return -E2BIG;
+
+                r = json_fields_add(fields, &n, &b, flags, data, name_size, eq + 1, size - (eq - (const char*) data) - 1);
+                if (r < 0)
+                        return log_oom();
+        }
+
+        /* Put the whole line together behind the fields, and write it out in one go */
+        start = b.size;
+
+        if (mode == OUTPUT_JSON_SSE)
+                r = json_field_buffer_put(&b, "data: {", 7);
+        else if (mode == OUTPUT_JSON_SEQ)
+                r = json_field_buffer_put(&b, "\x1e{", 2);
+        else
+                r = json_field_buffer_put(&b, "{", 1);
+        if (r < 0)
+                return log_oom();
+
+        for (i = 0; i < n; i++) {
+                bool array;
+                char *e;
+
+                if (!fields[i].first)
+                        continue;
+
+                array = fields[i].next != SIZE_MAX;
+
+                /* The separator, the name, the colon and maybe the opening bracket */
+                e = json_field_buffer_extend(&b, sep + fields[i].name_size + 1 + array);
+                if (!e)
+                        return log_oom();
+
+                if (sep)
+                        *e++ = ',';
+                sep = true;
+                e = mempcpy(e, b.data + fields[i].name_offset, fields[i].name_size);
+                *e++ = ':';
+                if (array)
+                        *e = '[';
+
+                for (k = i; k != SIZE_MAX; k = fields[k].next) {
+                        e = json_field_buffer_extend(&b, (k != i) + fields[k].value_size);
+                        if (!e)
+                                return log_oom();
+
+                        if (k != i)
+                                *e++ = ',';
+                        memcpy(e, b.data + fields[k].value_offset, fields[k].value_size);
+                }
+
+                if (array) {
+                        r = json_field_buffer_put(&b, "]", 1);
+                        if (r < 0)
+                                return log_oom();
+                }
+        }
+
+        r = json_field_buffer_put(&b, "}\n\n", mode == OUTPUT_JSON_SSE ? 3 : 2);
+        if (r < 0)
+                return log_oom();
+
+        fwrite(b.data + start, b.size - start, 1, f);
+        return 0;
+}
+
 static int output_json(
                 FILE *f,
                 sd_journal *j,
@@ -913,6 +1286,14 @@ static int output_json(
         if (r < 0)
                 return log_error_errno(r, "Failed to get cursor: %m");
 
+        if (IN_SET(mode, OUTPUT_JSON, OUTPUT_JSON_SSE, OUTPUT_JSON_SEQ) && !FLAGS_SET(flags, OUTPUT_COLOR)) {
+                r = output_json_fast(f, j, mode, flags, output_fields, cursor, realtime, monotonic, boot_id);
+                if (r != -E2BIG)
+                        return r;
+
+                sd_journal_restart_data(j);
+        }
+
         h = hashmap_new(&string_hash_ops);
         if (!h)
                 return log_oom();
@@ -1109,12 +1490,26 @@ int show_journal_entry(
 
         int ret;
         _cleanup_set_free_free_ Set *fields = NULL;
+        char **projection;
         assert(mode >= 0);
         assert(mode < _OUTPUT_MODE_MAX);
 
         if (n_columns <= 0)
                 n_columns = columns();
 
+        /* Let sd-journal skip the fields we'd throw away anyway, so that they aren't read and decompressed
+         * in the first place */
+        if (output_funcs[mode] == output_short)
+                projection = short_output_fields;
+        else if (IN_SET(mode, OUTPUT_VERBOSE, OUTPUT_EXPORT, OUTPUT_JSON, OUTPUT_JSON_PRETTY, OUTPUT_JSON_SSE, OUTPUT_JSON_SEQ))
+                projection = output_fields;
+        else
+                projection = NULL;
+
+        ret = sd_journal_set_data_fields(j, projection);
+        if (ret < 0)
+                return log_error_errno(ret, "Failed to select journal fields: %m");
+
         if (output_fields) {
                 fields = set_new(&string_hash_ops);
                 if (!fields)
@@ -1454,7 +1849,7 @@ int add_match_this_boot(sd_journal *j, const char *machine) {
         return 0;
 }
 
-int show_journal_by_unit(
+int show_journal_by_unit_full(
                 FILE *f,
                 const char *unit,
                 const char *log_namespace,
@@ -1466,21 +1861,51 @@ int show_journal_by_unit(
                 OutputFlags flags,
                 int journal_open_flags,
                 bool system_unit,
-                bool *ellipsized) {
+                bool *ellipsized,
+                sd_journal **reuse) {
 
-        _cleanup_(sd_journal_closep) sd_journal *j = NULL;
+        _cleanup_(sd_journal_closep) sd_journal *opened = NULL;
+        sd_journal *j;
         int r;
 
         assert(mode >= 0);
         assert(mode < _OUTPUT_MODE_MAX);
         assert(unit);
 
+        /* If 'reuse' is specified, the journal is opened only once and kept open in it for the next
+         * invocation, which saves mapping all journal files again when showing the logs of many units in a
+         * row. The caller has to make sure to pass the same namespace and open flags each time. */
+
         if (how_many <= 0)
                 return 0;
 
-        r = sd_journal_open_namespace(&j, log_namespace, journal_open_flags | SD_JOURNAL_INCLUDE_DEFAULT_NAMESPACE);
-        if (r < 0)
-                return log_error_errno(r, "Failed to open journal: %m");
+        /* If journald tells us that the unit didn't log anything since it was started, don't bother
+         * searching through the journal. This is only known for system units in the default namespace,
+         * and not for slices, whose matches include all their members. */
+        if (!log_namespace && system_unit && not_before > 0 &&
+            FLAGS_SET(journal_open_flags, SD_JOURNAL_LOCAL_ONLY) &&
+            !endswith(unit, ".slice")) {
+                r = journal_unit_index_check(NULL, unit, not_before);
+                if (r == 0) {
+                        log_debug("Unit %s did not log anything since it was started, not searching the journal.", unit);
+                        return 0;
+                }
+                if (r < 0 && r != -ENOENT)
+                        log_debug_errno(r, "Failed to check journal unit index, ignoring: %m");
+        }
+
+        if (reuse && *reuse) {
+                j = *reuse;
+                sd_journal_flush_matches(j);
+        } else {
+                r = sd_journal_open_namespace(&opened, log_namespace, journal_open_flags | SD_JOURNAL_INCLUDE_DEFAULT_NAMESPACE);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to open journal: %m");
+
+                j = opened;
+                if (reuse)
+                        *reuse = TAKE_PTR(opened);
+        }
 
         r = add_match_this_boot(j, NULL);
         if (r < 0)
@@ -43,7 +43,7 @@ int add_matches_for_user_unit(
                 const char *unit,
                 uid_t uid);
 
-int show_journal_by_unit(
+int show_journal_by_unit_full(
                 FILE *f,
                 const char *unit,
                 const char *namespace,
@@ -55,7 +55,24 @@ int show_journal_by_unit(
                 OutputFlags flags,
                 int journal_open_flags,
                 bool system_unit,
-                bool *ellipsized);
+                bool *ellipsized,
+                sd_journal **reuse);
+static inline int show_journal_by_unit(
+                FILE *f,
+                const char *unit,
+                const char *namespace,
+                OutputMode mode,
+                unsigned n_columns,
+                usec_t not_before,
+                unsigned how_many,
+                uid_t uid,
+                OutputFlags flags,
+                int journal_open_flags,
+                bool system_unit,
+                bool *ellipsized) {
+        return show_journal_by_unit_full(f, unit, namespace, mode, n_columns, not_before, how_many, uid, flags,
+                                         journal_open_flags, system_unit, ellipsized, NULL);
+}
 
 void json_escape(
                 FILE *f,
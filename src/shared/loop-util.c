@@ -14,10 +14,12 @@
 #include <unistd.h>
 
 #include "alloc-util.h"
+#include "dirent-util.h"
 #include "errno-util.h"
 #include "fd-util.h"
 #include "fileio.h"
 #include "loop-util.h"
+#include "missing_loop.h"
 #include "parse-util.h"
 #include "stat-util.h"
 #include "stdio-util.h"
@@ -30,6 +32,162 @@ static void cleanup_clear_loop_close(int *fd) {
         }
 }
 
+/* How many released loop devices we keep around at most for reuse, see loop_device_pool_set_size() */
+#define LOOP_POOL_MAX 16U
+
+typedef struct LoopPoolEntry {
+        int fd;
+        int nr;
+        int open_flags;
+} LoopPoolEntry;
+
+static LoopPoolEntry loop_pool[LOOP_POOL_MAX];
+static unsigned loop_pool_n = 0, loop_pool_size = 0;
+
+static bool loop_configure_unsupported = false;
+
+static void loop_remove(int nr, const char *node) {
+        _cleanup_close_ int control = -1;
+
+        control = open("/dev/loop-control", O_RDWR|O_CLOEXEC|O_NOCTTY|O_NONBLOCK);
+        if (control < 0) {
+                log_warning_errno(errno,
+                                  "Failed to open loop control device, cannot remove loop device %s: %m",
+                                  strna(node));
+                return;
+        }
+
+        for (unsigned n_attempts = 0;;) {
+                if (ioctl(control, LOOP_CTL_REMOVE, nr) >= 0)
+                        break;
+                if (errno != EBUSY || ++n_attempts >= 64) {
+                        log_warning_errno(errno, "Failed to remove device %s: %m", strna(node));
+                        break;
+                }
+                usleep(50 * USEC_PER_MSEC);
+        }
+}
+
+static void loop_pool_entry_remove(LoopPoolEntry *e) {
+        char node[STRLEN("/dev/loop") + DECIMAL_STR_MAX(int)];
+
+        assert(e);
+
+        e->fd = safe_close(e->fd);
+
+        xsprintf(node, "/dev/loop%i", e->nr);
+        loop_remove(e->nr, node);
+}
+
+static int loop_configure(int fd, const struct loop_config *c) {
+        int r;
+
+        assert(fd >= 0);
+        assert(c);
+
+        /* Binds the backing file and applies the parameters in one step via LOOP_CONFIGURE, if the kernel knows it.
+         * Otherwise falls back to LOOP_SET_FD followed by LOOP_SET_STATUS64, which costs an additional ioctl and
+         * uevent, and briefly exposes the device with the wrong offset and size to udev. */
+
+        if (!loop_configure_unsupported) {
+                struct loop_info64 info;
+
+                if (ioctl(fd, LOOP_CONFIGURE, c) < 0) {
+                        /* Old kernels refuse unknown ioctls on loop devices with EINVAL. */
+                        if (!IN_SET(errno, EINVAL, ENOTTY))
+                                return -errno;
+
+                        log_debug_errno(errno, "LOOP_CONFIGURE not supported, falling back to LOOP_SET_FD: %m");
+                        loop_configure_unsupported = true;
+                } else {
+                        /* Some kernels accept LOOP_CONFIGURE but ignore LO_FLAGS_PARTSCAN, in which case the partitions
+                         * never show up. Verify the flag stuck, and set it again the old way if it didn't. */
+                        if (!FLAGS_SET(c->info.lo_flags, LO_FLAGS_PARTSCAN))
+                                return 0;
+
+                        if (ioctl(fd, LOOP_GET_STATUS64, &info) < 0) {
+                                r = -errno;
+                                goto fail;
+                        }
+
+#if HAVE_VALGRIND_MEMCHECK_H
+                        /* Valgrind currently doesn't know LOOP_GET_STATUS64. Remove this once it does */
+                        VALGRIND_MAKE_MEM_DEFINED(&info, sizeof(info));
+#endif
+
+                        if (FLAGS_SET(info.lo_flags, LO_FLAGS_PARTSCAN))
+                                return 0;
+
+                        if (ioctl(fd, LOOP_SET_STATUS64, &c->info) < 0) {
+                                r = -errno;
+                                goto fail;
+                        }
+
+                        return 0;
+                }
+        }
+
+        if (ioctl(fd, LOOP_SET_FD, c->fd) < 0)
+                return -errno;
+
+        if (ioctl(fd, LOOP_SET_STATUS64, &c->info) < 0) {
+                r = -errno;
+                goto fail;
+        }
+
+        return 0;
+
+fail:
+        (void) ioctl(fd, LOOP_CLR_FD);
+        return r;
+}
+
+static int probe_partition_table(int fd, uint64_t offset) {
+        uint8_t buf[4096 + 8];
+        ssize_t n;
+
+        assert(fd >= 0);
+
+        /* Checks whether there might be a partition table at the specified offset of the file: a GPT header on the
+         * second sector (for 512 byte and 4K sectors), or the boot signature of an MBR. The latter is also found in
+         * FAT boot sectors, but that's OK, we only want to rule out partition tables cheaply. */
+
+        n = pread(fd, buf, sizeof(buf), (off_t) offset);
+        if (n < 0)
+                return -errno;
+
+        if ((size_t) n >= 512 + 8 && memcmp(buf + 512, "EFI PART", 8) == 0)
+                return true;
+        if ((size_t) n >= 4096 + 8 && memcmp(buf + 4096, "EFI PART", 8) == 0)
+                return true;
+        if ((size_t) n >= 512 && buf[510] == 0x55 && buf[511] == 0xAA)
+                return true;
+
+        return false;
+}
+
+static uint32_t loop_flags_mangle(int fd, int open_flags, uint64_t offset, uint32_t loop_flags) {
+        int r;
+
+        /* Partition scanning on a device without a partition table is wasted effort, and makes us wait for the
+         * kernel and udev for nothing. If the device is read-only nobody can write a partition table to it
+         * later either, hence turn scanning off in that case. */
+
+        if (!FLAGS_SET(loop_flags, LO_FLAGS_PARTSCAN) || open_flags != O_RDONLY)
+                return loop_flags;
+
+        r = probe_partition_table(fd, offset);
+        if (r < 0) {
+                log_debug_errno(r, "Failed to probe for partition table, leaving partition scanning on: %m");
+                return loop_flags;
+        }
+        if (r > 0)
+                return loop_flags;
+
+        log_debug("No partition table found, turning off partition scanning.");
+        return loop_flags & ~LO_FLAGS_PARTSCAN;
+}
+
 int loop_device_make(
                 int fd,
                 int open_flags,
@@ -38,7 +196,10 @@ int loop_device_make(
                 uint32_t loop_flags,
                 LoopDevice **ret) {
 
+        _cleanup_(cleanup_clear_loop_close) int loop_with_fd = -1;
         _cleanup_free_ char *loopdev = NULL;
+        _cleanup_close_ int control = -1;
+        struct loop_config config;
         struct loop_info64 info;
         LoopDevice *d = NULL;
         struct stat st;
@@ -93,8 +254,41 @@ int loop_device_make(
                         return r;
         }
 
-        _cleanup_close_ int control = -1;
-        _cleanup_(cleanup_clear_loop_close) int loop_with_fd = -1;
+        config = (struct loop_config) {
+                .fd = fd,
+                .info = {
+                        /* Use the specified flags, but configure the read-only flag from the open flags, and force autoclear */
+                        .lo_flags = (loop_flags_mangle(fd, open_flags, offset, loop_flags) & ~LO_FLAGS_READ_ONLY) |
+                                    (open_flags == O_RDONLY ? LO_FLAGS_READ_ONLY : 0) | LO_FLAGS_AUTOCLEAR,
+                        .lo_offset = offset,
+                        .lo_sizelimit = size == UINT64_MAX ? 0 : size,
+                },
+        };
+
+        /* First try to recycle one of the devices we released earlier, that saves us the allocation of a new
+         * device, and the uevents that come with it */
+        while (loop_pool_n > 0) {
+                LoopPoolEntry e = loop_pool[--loop_pool_n];
+
+                if (e.open_flags == open_flags) {
+                        r = loop_configure(e.fd, &config);
+                        if (r >= 0) {
+                                loop_with_fd = e.fd;
+                                nr = e.nr;
+
+                                if (asprintf(&loopdev, "/dev/loop%i", nr) < 0)
+                                        return -ENOMEM;
+
+                                goto finish;
+                        }
+
+                        log_debug_errno(r, "Failed to reuse loop device %i, ignoring: %m", e.nr);
+                }
+
+                /* Don't bother removing it, the device might still be busy, and LOOP_CTL_GET_FREE will hand it
+                 * out again later anyway. */
+                safe_close(e.fd);
+        }
 
         control = open("/dev/loop-control", O_RDWR|O_CLOEXEC|O_NOCTTY|O_NONBLOCK);
         if (control < 0)
@@ -119,12 +313,13 @@ int loop_device_make(
                         if (errno != ENOENT)
                                 return -errno;
                 } else {
-                        if (ioctl(loop, LOOP_SET_FD, fd) >= 0) {
+                        r = loop_configure(loop, &config);
+                        if (r >= 0) {
                                 loop_with_fd = TAKE_FD(loop);
                                 break;
                         }
-                        if (errno != EBUSY)
-                                return -errno;
+                        if (r != -EBUSY)
+                                return r;
                 }
 
                 if (++n_attempts >= 64) /* Give up eventually */
@@ -133,16 +328,7 @@ int loop_device_make(
                 loopdev = mfree(loopdev);
         }
 
-        info = (struct loop_info64) {
-                /* Use the specified flags, but configure the read-only flag from the open flags, and force autoclear */
-                .lo_flags = (loop_flags & ~LO_FLAGS_READ_ONLY) | ((loop_flags & O_ACCMODE) == O_RDONLY ? LO_FLAGS_READ_ONLY : 0) | LO_FLAGS_AUTOCLEAR,
-                .lo_offset = offset,
-                .lo_sizelimit = size == UINT64_MAX ? 0 : size,
-        };
-
-        if (ioctl(loop_with_fd, LOOP_SET_STATUS64, &info) < 0)
-                return -errno;
-
+finish:
         d = new(LoopDevice, 1);
         if (!d)
                 return -ENOMEM;
@@ -150,6 +336,7 @@ int loop_device_make(
                 .fd = TAKE_FD(loop_with_fd),
                 .node = TAKE_PTR(loopdev),
                 .nr = nr,
+                .open_flags = open_flags,
         };
 
         *ret = d;
@@ -186,6 +373,113 @@ int loop_device_make_by_path(const char *path, int open_flags, uint32_t loop_fla
         return loop_device_make(fd, open_flags, 0, 0, loop_flags, ret);
 }
 
+static int loop_device_find(const struct stat *st, uint32_t loop_flags, LoopDevice **ret) {
+        _cleanup_closedir_ DIR *d = NULL;
+        struct dirent *de;
+
+        assert(st);
+        assert(ret);
+
+        /* Looks for a read-only loop device that is already bound to the specified file in its entirety, set up
+         * the way loop_device_make() would have done it. Returns 0 if there is none. */
+
+        d = opendir("/sys/block");
+        if (!d)
+                return errno == ENOENT ? 0 : -errno;
+
+        FOREACH_DIRENT(de, d, return -errno) {
+                _cleanup_free_ char *loopdev = NULL;
+                _cleanup_close_ int loop = -1;
+                struct loop_info64 info;
+                const char *e, *p;
+                LoopDevice *ld;
+                unsigned nr;
+
+                e = startswith(de->d_name, "loop");
+                if (!e || safe_atou(e, &nr) < 0)
+                        continue;
+
+                /* Only bound loop devices have this subdirectory, don't bother opening the others */
+                p = strjoina("/sys/block/", de->d_name, "/loop");
+                if (access(p, F_OK) < 0)
+                        continue;
+
+                if (asprintf(&loopdev, "/dev/loop%u", nr) < 0)
+                        return -ENOMEM;
+
+                loop = open(loopdev, O_RDONLY|O_CLOEXEC|O_NONBLOCK|O_NOCTTY);
+                if (loop < 0)
+                        continue;
+
+                /* Now that we have it open, the device won't go away anymore, even if it is set to auto-clear. But
+                 * it might have been detached or rebound to something else in the meantime, hence check only now. */
+                if (ioctl(loop, LOOP_GET_STATUS64, &info) < 0)
+                        continue;
+
+#if HAVE_VALGRIND_MEMCHECK_H
+                /* Valgrind currently doesn't know LOOP_GET_STATUS64. Remove this once it does */
+                VALGRIND_MAKE_MEM_DEFINED(&info, sizeof(info));
+#endif
+
+                if (info.lo_device != st->st_dev ||
+                    info.lo_inode != st->st_ino ||
+                    info.lo_offset != 0 ||
+                    info.lo_sizelimit != 0)
+                        continue;
+
+                if ((info.lo_flags & (LO_FLAGS_READ_ONLY|LO_FLAGS_AUTOCLEAR|LO_FLAGS_PARTSCAN)) !=
+                    (LO_FLAGS_READ_ONLY|LO_FLAGS_AUTOCLEAR|(loop_flags & LO_FLAGS_PARTSCAN)))
+                        continue;
+
+                ld = new(LoopDevice, 1);
+                if (!ld)
+                        return -ENOMEM;
+
+                *ld = (LoopDevice) {
+                        .fd = TAKE_FD(loop),
+                        .nr = info.lo_number,
+                        .node = TAKE_PTR(loopdev),
+                        .relinquished = true, /* Somebody else's, it goes away when the last user is gone */
+                };
+
+                *ret = ld;
+                return 1;
+        }
+
+        return 0;
+}
+
+int loop_device_make_by_path_shared(const char *path, uint32_t loop_flags, LoopDevice **ret) {
+        _cleanup_close_ int fd = -1;
+        struct stat st;
+        int r;
+
+        assert(path);
+        assert(ret);
+
+        /* Like loop_device_make_by_path() with O_RDONLY, but reuses an existing loop device for the same file, if
+         * there is one. Sharing is fine here, as nobody can write to it. */
+
+        fd = open(path, O_CLOEXEC|O_NONBLOCK|O_NOCTTY|O_RDONLY);
+        if (fd < 0)
+                return -errno;
+
+        if (fstat(fd, &st) < 0)
+                return -errno;
+
+        if (S_ISREG(st.st_mode)) {
+                r = loop_device_find(&st, loop_flags_mangle(fd, O_RDONLY, 0, loop_flags), ret);
+                if (r < 0)
+                        log_debug_errno(r, "Failed to look for existing loop device for %s, ignoring: %m", path);
+                if (r > 0) {
+                        log_debug("Reusing loop device %s for %s.", (*ret)->node, path);
+                        return 0;
+                }
+        }
+
+        return loop_device_make(fd, O_RDONLY, 0, 0, loop_flags, ret);
+}
+
 LoopDevice* loop_device_unref(LoopDevice *d) {
         if (!d)
                 return NULL;
@@ -195,35 +489,40 @@ LoopDevice* loop_device_unref(LoopDevice *d) {
                         if (ioctl(d->fd, LOOP_CLR_FD) < 0)
                                 log_debug_errno(errno, "Failed to clear loop device: %m");
 
+                        /* Keep the now unbound device around for the next loop_device_make() call, if asked to */
+                        if (loop_pool_n < loop_pool_size) {
+                                loop_pool[loop_pool_n++] = (LoopPoolEntry) {
+                                        .fd = TAKE_FD(d->fd),
+                                        .nr = d->nr,
+                                        .open_flags = d->open_flags,
+                                };
+
+                                free(d->node);
+                                return mfree(d);
+                        }
                 }
 
                 safe_close(d->fd);
         }
 
-        if (d->nr >= 0 && !d->relinquished) {
-                _cleanup_close_ int control = -1;
-
-                control = open("/dev/loop-control", O_RDWR|O_CLOEXEC|O_NOCTTY|O_NONBLOCK);
-                if (control < 0)
-                        log_warning_errno(errno,
-                                          "Failed to open loop control device, cannot remove loop device %s: %m",
-                                          strna(d->node));
-                else
-                        for (unsigned n_attempts = 0;;) {
-                                if (ioctl(control, LOOP_CTL_REMOVE, d->nr) >= 0)
-                                        break;
-                                if (errno != EBUSY || ++n_attempts >= 64) {
-                                        log_warning_errno(errno, "Failed to remove device %s: %m", strna(d->node));
-                                        break;
-                                }
-                                usleep(50 * USEC_PER_MSEC);
-                        }
-        }
+        if (d->nr >= 0 && !d->relinquished)
+                loop_remove(d->nr, d->node);
 
         free(d->node);
         return mfree(d);
 }
 
+void loop_device_pool_set_size(unsigned n) {
+
+        /* Long-running users that set up loop devices regularly may ask us to keep up to n released devices open
+         * for reuse, instead of removing them and allocating new ones each time. Set to 0 to flush the pool. */
+
+        loop_pool_size = MIN(n, LOOP_POOL_MAX);
+
+        while (loop_pool_n > loop_pool_size)
+                loop_pool_entry_remove(loop_pool + --loop_pool_n);
+}
+
 void loop_device_relinquish(LoopDevice *d) {
         assert(d);
 
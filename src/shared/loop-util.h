@@ -11,11 +11,13 @@ struct LoopDevice {
         int fd;
         int nr;
         char *node;
+        int open_flags;
         bool relinquished;
 };
 
 int loop_device_make(int fd, int open_flags, uint64_t offset, uint64_t size, uint32_t loop_flags, LoopDevice **ret);
 int loop_device_make_by_path(const char *path, int open_flags, uint32_t loop_flags, LoopDevice **ret);
+int loop_device_make_by_path_shared(const char *path, uint32_t loop_flags, LoopDevice **ret);
 int loop_device_open(const char *loop_path, int open_flags, LoopDevice **ret);
 
 LoopDevice* loop_device_unref(LoopDevice *d);
@@ -23,6 +25,11 @@ DEFINE_TRIVIAL_CLEANUP_FUNC(LoopDevice*, loop_device_unref);
 
 void loop_device_relinquish(LoopDevice *d);
 
+/* Pool size for long-running services that set up loop devices for images regularly */
+#define LOOP_DEVICE_POOL_SIZE_DEFAULT 4U
+
+void loop_device_pool_set_size(unsigned n);
+
 int loop_device_refresh_size(LoopDevice *d, uint64_t offset, uint64_t size);
 
 int loop_device_flock(LoopDevice *d, int operation);
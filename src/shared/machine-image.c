@@ -194,6 +194,7 @@ static int image_make(
                 const char *path,
                 const char *filename,
                 const struct stat *st,
+                ImageDiscoverFlags flags,
                 Image **ret) {
 
         _cleanup_free_ char *pretty_buffer = NULL, *parent = NULL;
@@ -274,7 +275,8 @@ static int image_make(
                                 if (r < 0)
                                         return r;
 
-                                if (btrfs_quota_scan_ongoing(fd) == 0) {
+                                if (!FLAGS_SET(flags, IMAGE_DISCOVER_SKIP_USAGE) &&
+                                    btrfs_quota_scan_ongoing(fd) == 0) {
                                         BtrfsQuotaInfo quota;
 
                                         r = btrfs_subvol_get_subtree_quota_fd(fd, 0, &quota);
@@ -455,13 +457,13 @@ int image_find(ImageClass class, const char *name, Image **ret) {
                         if (!S_ISREG(st.st_mode))
                                 continue;
 
-                        r = image_make(name, dirfd(d), path, raw, &st, ret);
+                        r = image_make(name, dirfd(d), path, raw, &st, 0, ret);
 
                 } else {
                         if (!S_ISDIR(st.st_mode) && !S_ISBLK(st.st_mode))
                                 continue;
 
-                        r = image_make(name, dirfd(d), path, name, &st, ret);
+                        r = image_make(name, dirfd(d), path, name, &st, 0, ret);
                 }
                 if (IN_SET(r, -ENOENT, -EMEDIUMTYPE))
                         continue;
@@ -475,7 +477,7 @@ int image_find(ImageClass class, const char *name, Image **ret) {
         }
 
         if (class == IMAGE_MACHINE && streq(name, ".host")) {
-                r = image_make(".host", AT_FDCWD, NULL, "/", NULL, ret);
+                r = image_make(".host", AT_FDCWD, NULL, "/", NULL, 0, ret);
                 if (r < 0)
                         return r;
 
@@ -495,9 +497,9 @@ int image_from_path(const char *path, Image **ret) {
          * overridden by another, different image earlier in the search path */
 
         if (path_equal(path, "/"))
-                return image_make(".host", AT_FDCWD, NULL, "/", NULL, ret);
+                return image_make(".host", AT_FDCWD, NULL, "/", NULL, 0, ret);
 
-        return image_make(NULL, AT_FDCWD, NULL, path, NULL, ret);
+        return image_make(NULL, AT_FDCWD, NULL, path, NULL, 0, ret);
 }
 
 int image_find_harder(ImageClass class, const char *name_or_path, Image **ret) {
@@ -507,7 +509,7 @@ int image_find_harder(ImageClass class, const char *name_or_path, Image **ret) {
         return image_from_path(name_or_path, ret);
 }
 
-int image_discover(ImageClass class, Hashmap *h) {
+int image_discover(ImageClass class, ImageDiscoverFlags flags, Hashmap *h) {
         const char *path;
         int r;
 
@@ -568,7 +570,7 @@ int image_discover(ImageClass class, Hashmap *h) {
                         if (hashmap_contains(h, pretty))
                                 continue;
 
-                        r = image_make(pretty, dirfd(d), path, de->d_name, &st, &image);
+                        r = image_make(pretty, dirfd(d), path, de->d_name, &st, flags, &image);
                         if (IN_SET(r, -ENOENT, -EMEDIUMTYPE))
                                 continue;
                         if (r < 0)
@@ -587,7 +589,7 @@ int image_discover(ImageClass class, Hashmap *h) {
         if (class == IMAGE_MACHINE && !hashmap_contains(h, ".host")) {
                 _cleanup_(image_unrefp) Image *image = NULL;
 
-                r = image_make(".host", AT_FDCWD, NULL, "/", NULL, &image);
+                r = image_make(".host", AT_FDCWD, NULL, "/", NULL, flags, &image);
                 if (r < 0)
                         return r;
 
@@ -1264,6 +1266,13 @@ bool image_in_search_path(ImageClass class, const char *image) {
         return false;
 }
 
+const char* image_search_path_nulstr(ImageClass class) {
+        assert(class >= 0);
+        assert(class < _IMAGE_CLASS_MAX);
+
+        return image_search_path[class];
+}
+
 static const char* const image_type_table[_IMAGE_TYPE_MAX] = {
         [IMAGE_DIRECTORY] = "directory",
         [IMAGE_SUBVOLUME] = "subvolume",
@@ -29,6 +29,10 @@ typedef enum ImageType {
         _IMAGE_TYPE_INVALID = -1
 } ImageType;
 
+typedef enum ImageDiscoverFlags {
+        IMAGE_DISCOVER_SKIP_USAGE = 1 << 0, /* Don't query disk usage and quota, which is slow for btrfs subvolumes */
+} ImageDiscoverFlags;
+
 typedef struct Image {
         unsigned n_ref;
 
@@ -64,7 +68,7 @@ DEFINE_TRIVIAL_CLEANUP_FUNC(Image*, image_unref);
 int image_find(ImageClass class, const char *name, Image **ret);
 int image_from_path(const char *path, Image **ret);
 int image_find_harder(ImageClass class, const char *name_or_path, Image **ret);
-int image_discover(ImageClass class, Hashmap *map);
+int image_discover(ImageClass class, ImageDiscoverFlags flags, Hashmap *map);
 
 int image_remove(Image *i);
 int image_rename(Image *i, const char *new_name);
@@ -84,6 +88,7 @@ int image_set_limit(Image *i, uint64_t referenced_max);
 int image_read_metadata(Image *i);
 
 bool image_in_search_path(ImageClass class, const char *image);
+const char* image_search_path_nulstr(ImageClass class) _const_;
 
 static inline bool IMAGE_IS_HIDDEN(const struct Image *i) {
         assert(i);
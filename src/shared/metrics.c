@@ -0,0 +1,132 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include "metrics.h"
+#include "string-table.h"
+
+static const char* const metric_type_table[_METRIC_TYPE_MAX] = {
+        [METRIC_COUNTER] = "counter",
+        [METRIC_GAUGE] = "gauge",
+        [METRIC_HISTOGRAM] = "histogram",
+};
+
+DEFINE_PRIVATE_STRING_TABLE_LOOKUP_TO_STRING(metric_type, MetricType);
+
+void metric_observe(Metric *m, uint64_t v) {
+        unsigned i;
+
+        assert(m);
+        assert(m->type == METRIC_HISTOGRAM);
+
+        /* Find the smallest i with v <= 2^i, i.e. the bucket this observation belongs in */
+        if (v <= 1)
+                i = 0;
+        else
+                i = 64 - __builtin_clzll(v - 1);
+
+        i = MIN(i, METRIC_HISTOGRAM_BUCKETS - 1);
+
+        (void) __atomic_add_fetch(m->buckets + i, 1, __ATOMIC_RELAXED);
+        (void) __atomic_add_fetch(&m->sum, v, __ATOMIC_RELAXED);
+        (void) __atomic_add_fetch(&m->value, 1, __ATOMIC_RELAXED);
+}
+
+static int metric_build_buckets_json(const Metric *m, JsonVariant **ret) {
+        _cleanup_(json_variant_unrefp) JsonVariant *v = NULL;
+        int r;
+
+        assert(m);
+        assert(ret);
+
+        for (unsigned i = 0; i < METRIC_HISTOGRAM_BUCKETS; i++) {
+                _cleanup_(json_variant_unrefp) JsonVariant *b = NULL;
+                uint64_t count;
+
+                count = __atomic_load_n(m->buckets + i, __ATOMIC_RELAXED);
+
+                /* The last bucket has no upper bound */
+                if (i < METRIC_HISTOGRAM_BUCKETS - 1)
+                        r = json_build(&b, JSON_BUILD_OBJECT(
+                                                       JSON_BUILD_PAIR("upperBound", JSON_BUILD_UNSIGNED(UINT64_C(1) << i)),
+                                                       JSON_BUILD_PAIR("count", JSON_BUILD_UNSIGNED(count))));
+                else
+                        r = json_build(&b, JSON_BUILD_OBJECT(
+                                                       JSON_BUILD_PAIR("count", JSON_BUILD_UNSIGNED(count))));
+                if (r < 0)
+                        return r;
+
+                r = json_variant_append_array(&v, b);
+                if (r < 0)
+                        return r;
+        }
+
+        *ret = TAKE_PTR(v);
+        return 0;
+}
+
+int metrics_build_json(const Metric *metrics, size_t n, JsonVariant **ret) {
+        _cleanup_(json_variant_unrefp) JsonVariant *v = NULL;
+        int r;
+
+        assert(metrics || n == 0);
+        assert(ret);
+
+        for (size_t i = 0; i < n; i++) {
+                _cleanup_(json_variant_unrefp) JsonVariant *e = NULL;
+                const Metric *m = metrics + i;
+                uint64_t value;
+
+                value = __atomic_load_n(&m->value, __ATOMIC_RELAXED);
+
+                if (m->type == METRIC_HISTOGRAM) {
+                        _cleanup_(json_variant_unrefp) JsonVariant *buckets = NULL;
+
+                        r = metric_build_buckets_json(m, &buckets);
+                        if (r < 0)
+                                return r;
+
+                        r = json_build(&e, JSON_BUILD_OBJECT(
+                                                       JSON_BUILD_PAIR("name", JSON_BUILD_STRING(m->name)),
+                                                       JSON_BUILD_PAIR("type", JSON_BUILD_STRING(metric_type_to_string(m->type))),
+                                                       JSON_BUILD_PAIR("description", JSON_BUILD_STRING(m->description)),
+                                                       JSON_BUILD_PAIR("count", JSON_BUILD_UNSIGNED(value)),
+                                                       JSON_BUILD_PAIR("sum", JSON_BUILD_UNSIGNED(__atomic_load_n(&m->sum, __ATOMIC_RELAXED))),
+                                                       JSON_BUILD_PAIR("buckets", JSON_BUILD_VARIANT(buckets))));
+                } else
+                        r = json_build(&e, JSON_BUILD_OBJECT(
+                                                       JSON_BUILD_PAIR("name", JSON_BUILD_STRING(m->name)),
+                                                       JSON_BUILD_PAIR("type", JSON_BUILD_STRING(metric_type_to_string(m->type))),
+                                                       JSON_BUILD_PAIR("description", JSON_BUILD_STRING(m->description)),
+                                                       JSON_BUILD_PAIR("value", JSON_BUILD_UNSIGNED(value))));
+                if (r < 0)
+                        return r;
+
+                r = json_variant_append_array(&v, e);
+                if (r < 0)
+                        return r;
+        }
+
+        if (!v) {
+                r = json_variant_new_array(&v, NULL, 0);
+                if (r < 0)
+                        return r;
+        }
+
+        *ret = TAKE_PTR(v);
+        return 0;
+}
+
+int varlink_reply_metrics(Varlink *link, JsonVariant *parameters, const Metric *metrics, size_t n) {
+        _cleanup_(json_variant_unrefp) JsonVariant *v = NULL;
+        int r;
+
+        assert(link);
+
+        if (json_variant_elements(parameters) > 0)
+                return varlink_error_invalid_parameter(link, parameters);
+
+        r = metrics_build_json(metrics, n, &v);
+        if (r < 0)
+                return r;
+
+        return varlink_replyb(link, JSON_BUILD_OBJECT(JSON_BUILD_PAIR("metrics", JSON_BUILD_VARIANT(v))));
+}
@@ -0,0 +1,65 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+#include <inttypes.h>
+#include <stddef.h>
+
+#include "json.h"
+#include "macro.h"
+#include "varlink.h"
+
+/* Simple counters, gauges and histograms for internal statistics of our daemons, exported via the
+ * io.systemd.Metrics.List varlink method. A daemon keeps a fixed array of these, indexed by an enum of its
+ * own, and initialized from a constant table. Updates are relaxed atomic operations, hence cheap enough for
+ * hot paths and safe to do from any thread without locking. */
+
+typedef enum MetricType {
+        METRIC_COUNTER,   /* monotonically increasing */
+        METRIC_GAUGE,     /* a current value, may go up and down */
+        METRIC_HISTOGRAM, /* distribution of observed values, in power-of-two buckets */
+        _METRIC_TYPE_MAX,
+        _METRIC_TYPE_INVALID = -1,
+} MetricType;
+
+/* Histogram bucket i counts observations <= 2^i, the last bucket counts everything larger than that */
+#define METRIC_HISTOGRAM_BUCKETS 16U
+
+typedef struct Metric {
+        const char *name;
+        const char *description;
+        MetricType type;
+        uint64_t value;                             /* for histograms: number of observations */
+        uint64_t sum;                               /* histograms only */
+        uint64_t buckets[METRIC_HISTOGRAM_BUCKETS]; /* histograms only */
+} Metric;
+
+#define METRIC_INIT(t, n, d)                                            \
+        {                                                               \
+                .name = (n),                                            \
+                .description = (d),                                     \
+                .type = (t),                                            \
+        }
+
+static inline void metric_add(Metric *m, uint64_t n) {
+        assert(m);
+        assert(m->type != METRIC_HISTOGRAM);
+
+        (void) __atomic_add_fetch(&m->value, n, __ATOMIC_RELAXED);
+}
+
+static inline void metric_inc(Metric *m) {
+        metric_add(m, 1);
+}
+
+/* For gauges, and for counters that are maintained elsewhere and only mirrored here */
+static inline void metric_set(Metric *m, uint64_t v) {
+        assert(m);
+        assert(m->type != METRIC_HISTOGRAM);
+
+        __atomic_store_n(&m->value, v, __ATOMIC_RELAXED);
+}
+
+void metric_observe(Metric *m, uint64_t v);
+
+int metrics_build_json(const Metric *metrics, size_t n, JsonVariant **ret);
+int varlink_reply_metrics(Varlink *link, JsonVariant *parameters, const Metric *metrics, size_t n);
@@ -8,12 +8,14 @@
 #include <unistd.h>
 
 #include "alloc-util.h"
+#include "errno-util.h"
 #include "extract-word.h"
 #include "fd-util.h"
 #include "fileio.h"
 #include "fs-util.h"
 #include "hashmap.h"
 #include "libmount-util.h"
+#include "missing_syscall.h"
 #include "mount-util.h"
 #include "mountpoint-util.h"
 #include "parse-util.h"
@@ -130,6 +132,70 @@ fallback:
         return 0;
 }
 
+static bool blacklist_below(char **blacklist, const char *prefix) {
+        char **i;
+
+        STRV_FOREACH(i, blacklist)
+                if (!path_equal(*i, prefix) && path_startswith(*i, prefix))
+                        return true;
+
+        return false;
+}
+
+static int bind_remount_recursive_setattr(const char *path, unsigned long new_flags, unsigned long flags_mask) {
+        static const struct {
+                unsigned long ms;
+                uint64_t attr;
+        } table[] = {
+                { MS_RDONLY, MOUNT_ATTR_RDONLY },
+                { MS_NOSUID, MOUNT_ATTR_NOSUID },
+                { MS_NODEV,  MOUNT_ATTR_NODEV  },
+                { MS_NOEXEC, MOUNT_ATTR_NOEXEC },
+        };
+        struct mount_attr attr = {};
+        unsigned long left = flags_mask;
+        size_t i;
+        int r;
+
+        assert(path);
+
+        /* Uses mount_setattr() with AT_RECURSIVE to change the per-mount flags of the mount at 'path' and all
+         * mounts below it in one atomic operation. Returns -EOPNOTSUPP for flags that can't be changed that
+         * way, and whatever the kernel says if it doesn't know mount_setattr() or refuses it. */
+
+        for (i = 0; i < ELEMENTSOF(table); i++) {
+                if (!(flags_mask & table[i].ms))
+                        continue;
+
+                if (new_flags & table[i].ms)
+                        attr.attr_set |= table[i].attr;
+                else
+                        attr.attr_clr |= table[i].attr;
+
+                left &= ~table[i].ms;
+        }
+
+        if (left != 0)
+                return -EOPNOTSUPP;
+
+        r = path_is_mount_point(path, NULL, 0);
+        if (r < 0)
+                return r;
+        if (r == 0) {
+                /* The prefix directory itself is not yet a mount, make it one. */
+                if (mount(path, path, NULL, MS_BIND|MS_REC, NULL) < 0)
+                        return -errno;
+
+                log_debug("Made top-level directory %s a mount point.", path);
+        }
+
+        if (mount_setattr(AT_FDCWD, path, AT_RECURSIVE|AT_NO_AUTOMOUNT, &attr, sizeof(attr)) < 0)
+                return -errno;
+
+        log_debug("Changed mount attributes of %s and its submounts.", path);
+        return 0;
+}
+
 /* Use this function only if you do not have direct access to /proc/self/mountinfo but the caller can open it
  * for you. This is the case when /proc is masked or not mounted. Otherwise, use bind_remount_recursive. */
 int bind_remount_recursive_with_mountinfo(
@@ -163,6 +229,18 @@ int bind_remount_recursive_with_mountinfo(
 
         path_simplify(simplified, false);
 
+        /* If nothing below is excluded, change the whole subtree at once, without walking mountinfo */
+        if (!blacklist_below(blacklist, simplified)) {
+                r = bind_remount_recursive_setattr(simplified, new_flags, flags_mask);
+                if (r >= 0)
+                        return 0;
+                if (!ERRNO_IS_NOT_SUPPORTED(r) && !ERRNO_IS_PRIVILEGE(r) && r != -EINVAL)
+                        return r;
+
+                log_debug_errno(r, "Failed to change mount attributes of %s recursively, remounting submounts one by one: %m",
+                                simplified);
+        }
+
         done = set_new(&path_hash_ops);
         if (!done)
                 return -ENOMEM;
@@ -0,0 +1,242 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "alloc-util.h"
+#include "cpu-set-util.h"
+#include "dirent-util.h"
+#include "fd-util.h"
+#include "label.h"
+#include "log.h"
+#include "path-util.h"
+#include "pthread-util.h"
+#include "relabel.h"
+#include "selinux-util.h"
+#include "smack-util.h"
+#include "strv.h"
+
+/* The directory tree is walked by the calling thread, which collects the paths to relabel in batches. Each
+ * batch is then processed by a number of threads, as determining the label (i.e. matching the path against
+ * the file context regular expressions of the SELinux policy) and applying it is where the time goes. The
+ * SELinux label handle is safe to use from multiple threads, but the policy reload callbacks replace it,
+ * hence we only check for policy reloads between batches, while no other threads are running. */
+
+typedef struct Relabel {
+        char **paths;
+        size_t n_paths, n_allocated;
+        size_t next_path;
+
+        int error;  /* first error of the threads, set atomically */
+
+        RelabelFlags flags;
+        char **prune;
+        dev_t dev;
+        unsigned n_threads;
+} Relabel;
+
+static void relabel_done(Relabel *c) {
+        size_t i;
+
+        assert(c);
+
+        for (i = 0; i < c->n_paths; i++)
+                free(c->paths[i]);
+
+        c->paths = mfree(c->paths);
+        c->n_paths = c->n_allocated = 0;
+}
+
+static void *relabel_thread(void *userdata) {
+        Relabel *c = userdata;
+
+        for (;;) {
+                _cleanup_close_ int fd = -1;
+                const char *p;
+                size_t i;
+                int r;
+
+                i = __sync_fetch_and_add(&c->next_path, 1);
+                if (i >= c->n_paths)
+                        break;
+
+                p = c->paths[i];
+
+                fd = open(p, O_NOFOLLOW|O_CLOEXEC|O_PATH);
+                if (fd < 0) {
+                        if (errno == ENOENT) /* Removed in the meantime, that's fine */
+                                continue;
+
+                        r = -errno;
+                } else
+                        r = label_fix_fd(fd, p, p, 0);
+                if (r < 0)
+                        (void) __sync_bool_compare_and_swap(&c->error, 0, r);
+        }
+
+        return NULL;
+}
+
+static int relabel_flush(Relabel *c) {
+        unsigned i;
+
+        assert(c);
+
+        if (c->n_paths == 0)
+                return 0;
+
+        /* Only the main thread is running, so this is a good time to pick up policy reloads */
+        mac_selinux_check_policy_reload();
+
+        c->next_path = 0;
+
+        run_parallel(MIN(c->n_threads, c->n_paths), relabel_thread, c);
+
+        for (i = 0; i < c->n_paths; i++)
+                c->paths[i] = mfree(c->paths[i]);
+        c->n_paths = 0;
+
+        return c->error;
+}
+
+static int relabel_queue(Relabel *c, char *p) {
+        assert(c);
+        assert(p);
+
+        /* Takes ownership of 'p', also on failure */
+
+        if (!GREEDY_REALLOC(c->paths, c->n_allocated, c->n_paths + 1)) {
+                free(p);
+                return log_oom();
+        }
+
+        c->paths[c->n_paths++] = p;
+
+        if (c->n_paths >= RELABEL_BATCH_MAX)
+                (void) relabel_flush(c);
+
+        return 0;
+}
+
+static int relabel_dir(Relabel *c, int fd, const char *path) {
+        _cleanup_closedir_ DIR *d = NULL;
+        struct dirent *de;
+        int r = 0, q;
+
+        assert(c);
+        assert(path);
+
+        /* Takes ownership of 'fd' */
+
+        d = fdopendir(fd);
+        if (!d) {
+                q = log_error_errno(errno, "Failed to open directory %s: %m", path);
+                safe_close(fd);
+                return q;
+        }
+
+        FOREACH_DIRENT_ALL(de, d, return log_error_errno(errno, "Failed to read directory %s: %m", path)) {
+                _cleanup_free_ char *p = NULL;
+                struct stat st;
+
+                if (dot_or_dot_dot(de->d_name))
+                        continue;
+
+                if (fstatat(dirfd(d), de->d_name, &st, AT_SYMLINK_NOFOLLOW) < 0) {
+                        if (errno == ENOENT)
+                                continue;
+
+                        q = log_error_errno(errno, "Failed to stat %s/%s: %m", path, de->d_name);
+                        if (r == 0)
+                                r = q;
+                        continue;
+                }
+
+                if ((c->flags & RELABEL_SAME_MOUNT) && st.st_dev != c->dev)
+                        continue;
+
+                p = path_join(path, de->d_name);
+                if (!p)
+                        return log_oom();
+
+                if (S_ISDIR(st.st_mode) && !path_strv_contains(c->prune, p)) {
+                        int subdir_fd;
+
+                        subdir_fd = openat(dirfd(d), de->d_name, O_RDONLY|O_DIRECTORY|O_NOFOLLOW|O_CLOEXEC);
+                        if (subdir_fd < 0) {
+                                if (errno != ENOENT) {
+                                        q = log_error_errno(errno, "Failed to open directory %s: %m", p);
+                                        if (r == 0)
+                                                r = q;
+                                }
+                        } else {
+                                q = relabel_dir(c, subdir_fd, p);
+                                if (q < 0 && r == 0)
+                                        r = q;
+                        }
+                }
+
+                q = relabel_queue(c, TAKE_PTR(p));
+                if (q < 0)
+                        return q;
+        }
+
+        return r;
+}
+
+int relabel_tree(const char *path, char **prune, RelabelFlags flags) {
+        _cleanup_(relabel_done) Relabel c = {
+                .flags = flags,
+                .prune = prune,
+        };
+        struct stat st;
+        int r = 0, q, n;
+
+        assert(path);
+
+        /* Relabels 'path' and everything below it, except for what's below the directories listed in
+         * 'prune'. Returns the first error encountered, but tries to relabel everything nonetheless. */
+
+        if (!mac_selinux_use() && !mac_smack_use())
+                return 0;
+
+        if (lstat(path, &st) < 0) {
+                if (errno == ENOENT)
+                        return 0;
+
+                return log_error_errno(errno, "Failed to stat %s: %m", path);
+        }
+
+        c.dev = st.st_dev;
+
+        n = cpus_in_affinity_mask();
+        c.n_threads = n > 0 ? MIN((unsigned) n, RELABEL_THREADS_MAX) : 1;
+
+        if (S_ISDIR(st.st_mode) && !path_strv_contains(prune, path)) {
+                int fd;
+
+                fd = open(path, O_RDONLY|O_DIRECTORY|O_NOFOLLOW|O_CLOEXEC);
+                if (fd < 0)
+                        r = log_error_errno(errno, "Failed to open directory %s: %m", path);
+                else
+                        r = relabel_dir(&c, fd, path);
+        }
+
+        if (!FLAGS_SET(flags, RELABEL_SKIP_TOP)) {
+                char *p;
+
+                p = strdup(path);
+                if (!p)
+                        return log_oom();
+
+                q = relabel_queue(&c, p);
+                if (q < 0)
+                        return q;
+        }
+
+        q = relabel_flush(&c);
+        if (q < 0 && r == 0)
+                r = q;
+
+        return r;
+}
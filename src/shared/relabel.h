@@ -0,0 +1,15 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+/* Upper limit on the threads relabelling files in parallel, the main thread included */
+#define RELABEL_THREADS_MAX 16U
+
+/* Number of paths collected before they are handed to the threads */
+#define RELABEL_BATCH_MAX 1024U
+
+typedef enum RelabelFlags {
+        RELABEL_SKIP_TOP   = 1 << 0, /* Only relabel what's below the specified path, not the path itself */
+        RELABEL_SAME_MOUNT = 1 << 1, /* Don't cross into other file systems, like nftw()'s FTW_MOUNT */
+} RelabelFlags;
+
+int relabel_tree(const char *path, char **prune, RelabelFlags flags);
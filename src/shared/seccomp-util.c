@@ -2,6 +2,7 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <linux/filter.h>
 #include <linux/seccomp.h>
 #include <seccomp.h>
 #include <stddef.h>
@@ -9,16 +10,21 @@
 #include <sys/prctl.h>
 #include <sys/shm.h>
 #include <sys/stat.h>
+#include <unistd.h>
 
 #include "af-list.h"
 #include "alloc-util.h"
 #include "errno-list.h"
+#include "fd-util.h"
 #include "macro.h"
+#include "memfd-util.h"
 #include "nsflags.h"
 #include "nulstr-util.h"
 #include "process-util.h"
 #include "seccomp-util.h"
 #include "set.h"
+#include "siphash24.h"
+#include "sort-util.h"
 #include "string-util.h"
 #include "strv.h"
 
@@ -1003,6 +1009,31 @@ int seccomp_load_syscall_filter_set(uint32_t default_action, const SyscallFilter
         return 0;
 }
 
+static int seccomp_add_raw_rule(scmp_filter_ctx seccomp, uint32_t action, int id, int error, bool log_missing) {
+        uint32_t a = action;
+        int r;
+
+        if (action != SCMP_ACT_ALLOW && error >= 0)
+                a = SCMP_ACT_ERRNO(error);
+
+        r = seccomp_rule_add_exact(seccomp, a, id, 0);
+        if (r < 0) {
+                /* If the system call is not known on this architecture, then that's fine, let's ignore it */
+                _cleanup_free_ char *n = NULL;
+                bool ignore;
+
+                n = seccomp_syscall_resolve_num_arch(SCMP_ARCH_NATIVE, id);
+                ignore = r == -EDOM;
+                if (!ignore || log_missing)
+                        log_debug_errno(r, "Failed to add rule for system call %s() / %d%s: %m",
+                                        strna(n), id, ignore ? ", ignoring" : "");
+                if (!ignore)
+                        return r;
+        }
+
+        return 0;
+}
+
 int seccomp_load_syscall_filter_set_raw(uint32_t default_action, Hashmap* set, uint32_t action, bool log_missing) {
         uint32_t arch;
         int r;
@@ -1025,27 +1056,9 @@ int seccomp_load_syscall_filter_set_raw(uint32_t default_action, Hashmap* set, u
                         return r;
 
                 HASHMAP_FOREACH_KEY(val, syscall_id, set, i) {
-                        uint32_t a = action;
-                        int id = PTR_TO_INT(syscall_id) - 1;
-                        int error = PTR_TO_INT(val);
-
-                        if (action != SCMP_ACT_ALLOW && error >= 0)
-                                a = SCMP_ACT_ERRNO(error);
-
-                        r = seccomp_rule_add_exact(seccomp, a, id, 0);
-                        if (r < 0) {
-                                /* If the system call is not known on this architecture, then that's fine, let's ignore it */
-                                _cleanup_free_ char *n = NULL;
-                                bool ignore;
-
-                                n = seccomp_syscall_resolve_num_arch(SCMP_ARCH_NATIVE, id);
-                                ignore = r == -EDOM;
-                                if (!ignore || log_missing)
-                                        log_debug_errno(r, "Failed to add rule for system call %s() / %d%s: %m",
-                                                        strna(n), id, ignore ? ", ignoring" : "");
-                                if (!ignore)
-                                        return r;
-                        }
+                        r = seccomp_add_raw_rule(seccomp, action, PTR_TO_INT(syscall_id) - 1, PTR_TO_INT(val), log_missing);
+                        if (r < 0)
+                                return r;
                 }
 
                 r = seccomp_load(seccomp);
@@ -1058,6 +1071,229 @@ int seccomp_load_syscall_filter_set_raw(uint32_t default_action, Hashmap* set, u
         return 0;
 }
 
+typedef struct SeccompRawRule {
+        int id;
+        int error;
+} SeccompRawRule;
+
+typedef struct SeccompFilter {
+        uint32_t arch;
+        struct sock_fprog prog;
+} SeccompFilter;
+
+struct SeccompProgram {
+        /* What the program was compiled from, this identifies the program */
+        uint32_t default_action;
+        uint32_t action;
+        SeccompRawRule *rules;
+        size_t n_rules;
+
+        /* The compiled BPF, one filter per local architecture */
+        SeccompFilter *filters;
+        size_t n_filters;
+        bool compiled;
+};
+
+static int seccomp_raw_rule_compare(const SeccompRawRule *a, const SeccompRawRule *b) {
+        int r;
+
+        r = CMP(a->id, b->id);
+        if (r != 0)
+                return r;
+
+        return CMP(a->error, b->error);
+}
+
+int seccomp_program_new(uint32_t default_action, Hashmap *set, uint32_t action, SeccompProgram **ret) {
+        _cleanup_(seccomp_program_freep) SeccompProgram *p = NULL;
+        void *syscall_id, *val;
+        Iterator i;
+
+        assert(ret);
+
+        /* Takes the same arguments as seccomp_load_syscall_filter_set_raw(), and returns a program object that
+         * may be compiled with seccomp_program_compile() and loaded with seccomp_program_load(). The rules are
+         * sorted, so that two programs compiled from the same rules compare equal, and may be shared via
+         * seccomp_program_hash_ops. */
+
+        p = new(SeccompProgram, 1);
+        if (!p)
+                return -ENOMEM;
+
+        *p = (SeccompProgram) {
+                .default_action = default_action,
+                .action = action,
+        };
+
+        p->rules = new(SeccompRawRule, MAX(hashmap_size(set), 1U));
+        if (!p->rules)
+                return -ENOMEM;
+
+        HASHMAP_FOREACH_KEY(val, syscall_id, set, i)
+                p->rules[p->n_rules++] = (SeccompRawRule) {
+                        .id = PTR_TO_INT(syscall_id) - 1,
+                        .error = PTR_TO_INT(val),
+                };
+
+        typesafe_qsort(p->rules, p->n_rules, seccomp_raw_rule_compare);
+
+        *ret = TAKE_PTR(p);
+        return 0;
+}
+
+SeccompProgram *seccomp_program_free(SeccompProgram *p) {
+        size_t i;
+
+        if (!p)
+                return NULL;
+
+        for (i = 0; i < p->n_filters; i++)
+                free(p->filters[i].prog.filter);
+
+        free(p->filters);
+        free(p->rules);
+
+        return mfree(p);
+}
+
+static void seccomp_program_hash_func(const SeccompProgram *p, struct siphash *state) {
+        siphash24_compress(&p->default_action, sizeof(p->default_action), state);
+        siphash24_compress(&p->action, sizeof(p->action), state);
+        siphash24_compress(&p->n_rules, sizeof(p->n_rules), state);
+        siphash24_compress(p->rules, p->n_rules * sizeof(SeccompRawRule), state);
+}
+
+static int seccomp_program_compare_func(const SeccompProgram *a, const SeccompProgram *b) {
+        int r;
+
+        r = CMP(a->default_action, b->default_action);
+        if (r != 0)
+                return r;
+
+        r = CMP(a->action, b->action);
+        if (r != 0)
+                return r;
+
+        r = CMP(a->n_rules, b->n_rules);
+        if (r != 0)
+                return r;
+
+        return memcmp(a->rules, b->rules, a->n_rules * sizeof(SeccompRawRule));
+}
+
+DEFINE_HASH_OPS_WITH_KEY_DESTRUCTOR(seccomp_program_hash_ops, SeccompProgram, seccomp_program_hash_func, seccomp_program_compare_func,
+                                    seccomp_program_free);
+
+static int seccomp_export_filter(scmp_filter_ctx seccomp, struct sock_fprog *ret) {
+        _cleanup_free_ struct sock_filter *filter = NULL;
+        _cleanup_close_ int fd = -1;
+        ssize_t n;
+        off_t sz;
+        int r;
+
+        assert(seccomp);
+        assert(ret);
+
+        fd = memfd_new("seccomp-bpf");
+        if (fd < 0)
+                return fd;
+
+        r = seccomp_export_bpf(seccomp, fd);
+        if (r < 0)
+                return r;
+
+        sz = lseek(fd, 0, SEEK_END);
+        if (sz < 0)
+                return -errno;
+        if (sz == 0 || sz % sizeof(struct sock_filter) != 0 || sz / sizeof(struct sock_filter) > USHRT_MAX)
+                return -EBADMSG;
+
+        filter = malloc(sz);
+        if (!filter)
+                return -ENOMEM;
+
+        n = pread(fd, filter, sz, 0);
+        if (n < 0)
+                return -errno;
+        if (n != sz)
+                return -EIO;
+
+        *ret = (struct sock_fprog) {
+                .len = sz / sizeof(struct sock_filter),
+                .filter = TAKE_PTR(filter),
+        };
+        return 0;
+}
+
+int seccomp_program_compile(SeccompProgram *p, bool log_missing) {
+        uint32_t arch;
+        size_t i;
+        int r;
+
+        assert(p);
+        assert(!p->compiled);
+
+        /* Builds the same filters as seccomp_load_syscall_filter_set_raw() would, but instead of loading them,
+         * exports the resulting BPF, so that it can be loaded later, possibly many times, in other processes. */
+
+        if (p->n_rules == 0 && p->default_action == SCMP_ACT_ALLOW) {
+                p->compiled = true;
+                return 0;
+        }
+
+        p->filters = new0(SeccompFilter, ELEMENTSOF(seccomp_local_archs) - 1);
+        if (!p->filters)
+                return -ENOMEM;
+
+        SECCOMP_FOREACH_LOCAL_ARCH(arch) {
+                _cleanup_(seccomp_releasep) scmp_filter_ctx seccomp = NULL;
+
+                r = seccomp_init_for_arch(&seccomp, arch, p->default_action);
+                if (r < 0)
+                        return r;
+
+                for (i = 0; i < p->n_rules; i++) {
+                        r = seccomp_add_raw_rule(seccomp, p->action, p->rules[i].id, p->rules[i].error, log_missing);
+                        if (r < 0)
+                                return r;
+                }
+
+                r = seccomp_export_filter(seccomp, &p->filters[p->n_filters].prog);
+                if (r < 0)
+                        return log_debug_errno(r, "Failed to export filter for architecture %s: %m", seccomp_arch_to_string(arch));
+
+                p->filters[p->n_filters++].arch = arch;
+        }
+
+        p->compiled = true;
+        return 0;
+}
+
+int seccomp_program_load(const SeccompProgram *p) {
+        size_t i;
+        int r;
+
+        assert(p);
+        assert(p->compiled);
+
+        /* Loads a program compiled with seccomp_program_compile(), with one prctl() per architecture and no
+         * further work. Behaves like seccomp_load_syscall_filter_set_raw() otherwise. */
+
+        for (i = 0; i < p->n_filters; i++) {
+                if (prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &p->filters[i].prog, 0, 0) >= 0)
+                        continue;
+
+                r = -errno;
+                if (ERRNO_IS_SECCOMP_FATAL(r))
+                        return r;
+
+                log_debug_errno(r, "Failed to install filter set for architecture %s, skipping: %m",
+                                seccomp_arch_to_string(p->filters[i].arch));
+        }
+
+        return 0;
+}
+
 int seccomp_parse_syscall_filter(
                 const char *name,
                 int errno_num,
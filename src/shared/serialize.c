@@ -4,17 +4,64 @@
 
 #include "alloc-util.h"
 #include "env-util.h"
+#include "errno-util.h"
 #include "escape.h"
 #include "fileio.h"
 #include "missing_mman.h"
 #include "missing_syscall.h"
 #include "parse-util.h"
 #include "process-util.h"
+#include "sparse-endian.h"
 #include "serialize.h"
 #include "strv.h"
 #include "tmpfile-util.h"
 
+/* In binary mode every item is written as a record: SERIALIZE_RECORD_MARK, the length of the payload as 32bit
+ * little-endian integer, and the payload itself, i.e. the same "key=value" string the text format would write,
+ * minus the trailing newline. The mark is a control character no text line starts with, hence readers can tell
+ * both formats apart record by record, and a serialization written in text format by an older version can still be
+ * read. */
+#define SERIALIZE_RECORD_MARK '\x1e'
+
+static bool serialize_binary = false;
+
+bool serialize_set_binary(bool b) {
+        bool old = serialize_binary;
+
+        serialize_binary = b;
+        return old;
+}
+
+static void serialize_record(FILE *f, const char *key, size_t key_len, const char *value, size_t value_len) {
+        assert(f);
+        assert(key || key_len == 0);
+        assert(value || value_len == 0);
+
+        if (serialize_binary) {
+                le32_t n;
+
+                n = htole32(key_len + !!value + value_len);
+
+                fputc(SERIALIZE_RECORD_MARK, f);
+                fwrite(&n, sizeof(n), 1, f);
+                fwrite(key, 1, key_len, f);
+                if (value) {
+                        fputc('=', f);
+                        fwrite(value, 1, value_len, f);
+                }
+        } else {
+                fwrite(key, 1, key_len, f);
+                if (value) {
+                        fputc('=', f);
+                        fwrite(value, 1, value_len, f);
+                }
+                fputc('\n', f);
+        }
+}
+
 int serialize_item(FILE *f, const char *key, const char *value) {
+        size_t key_len, value_len;
+
         assert(f);
         assert(key);
 
@@ -23,15 +70,33 @@ int serialize_item(FILE *f, const char *key, const char *value) {
 
         /* Make sure that anything we serialize we can also read back again with read_line() with a maximum line size
          * of LONG_LINE_MAX. This is a safety net only. All code calling us should filter this out earlier anyway. */
-        if (strlen(key) + 1 + strlen(value) + 1 > LONG_LINE_MAX) {
+        key_len = strlen(key);
+        value_len = strlen(value);
+        if (key_len + 1 + value_len + 1 > LONG_LINE_MAX) {
                 log_warning("Attempted to serialize overly long item '%s', refusing.", key);
                 return -EINVAL;
         }
 
-        fputs(key, f);
-        fputc('=', f);
-        fputs(value, f);
-        fputc('\n', f);
+        serialize_record(f, key, key_len, value, value_len);
+
+        return 1;
+}
+
+int serialize_marker(FILE *f, const char *marker) {
+        size_t n;
+
+        assert(f);
+        assert(marker);
+
+        /* Writes a bare line without value, as used for unit names and end markers, the latter being empty. */
+
+        n = strlen(marker);
+        if (n + 1 > LONG_LINE_MAX) {
+                log_warning("Attempted to serialize overly long marker '%s', refusing.", marker);
+                return -EINVAL;
+        }
+
+        serialize_record(f, marker, n, NULL, 0);
 
         return 1;
 }
@@ -70,10 +135,7 @@ int serialize_item_format(FILE *f, const char *key, const char *format, ...) {
                 return -EINVAL;
         }
 
-        fputs(key, f);
-        fputc('=', f);
-        fputs(buf, f);
-        fputc('\n', f);
+        serialize_record(f, key, strlen(key), buf, k);
 
         return 1;
 }
@@ -131,6 +193,48 @@ int serialize_strv(FILE *f, const char *key, char **l) {
         return ret;
 }
 
+int deserialize_read_line(FILE *f, char **ret) {
+        _cleanup_free_ char *buf = NULL;
+        le32_t n;
+        size_t k;
+        int c;
+
+        assert(f);
+        assert(ret);
+
+        /* Reads the next item or marker, in either format. Returns 0 on EOF, > 0 otherwise. */
+
+        c = fgetc(f);
+        if (c == EOF)
+                return ferror(f) ? errno_or_else(EIO) : 0;
+        if (c != SERIALIZE_RECORD_MARK) {
+                if (ungetc(c, f) == EOF)
+                        return -EIO;
+
+                return read_line(f, LONG_LINE_MAX, ret);
+        }
+
+        if (fread(&n, sizeof(n), 1, f) != 1)
+                return ferror(f) ? errno_or_else(EIO) : -EBADMSG;
+
+        k = le32toh(n);
+        if (k + 1 > LONG_LINE_MAX)
+                return -EBADMSG;
+
+        buf = new(char, k + 1);
+        if (!buf)
+                return -ENOMEM;
+
+        if (k > 0 && fread(buf, 1, k, f) != k)
+                return ferror(f) ? errno_or_else(EIO) : -EBADMSG;
+        if (memchr(buf, 0, k))
+                return -EBADMSG;
+        buf[k] = 0;
+
+        *ret = TAKE_PTR(buf);
+        return 1;
+}
+
 int deserialize_usec(const char *value, usec_t *ret) {
         int r;
 
@@ -8,6 +8,11 @@
 #include "string-util.h"
 #include "time-util.h"
 
+bool serialize_set_binary(bool b);
+static inline void serialize_set_binaryp(bool *b) {
+        (void) serialize_set_binary(*b);
+}
+
 int serialize_item(FILE *f, const char *key, const char *value);
 int serialize_item_escaped(FILE *f, const char *key, const char *value);
 int serialize_item_format(FILE *f, const char *key, const char *value, ...) _printf_(3,4);
@@ -15,11 +20,13 @@ int serialize_fd(FILE *f, FDSet *fds, const char *key, int fd);
 int serialize_usec(FILE *f, const char *key, usec_t usec);
 int serialize_dual_timestamp(FILE *f, const char *key, const dual_timestamp *t);
 int serialize_strv(FILE *f, const char *key, char **l);
+int serialize_marker(FILE *f, const char *marker);
 
 static inline int serialize_bool(FILE *f, const char *key, bool b) {
         return serialize_item(f, key, yes_no(b));
 }
 
+int deserialize_read_line(FILE *f, char **ret);
 int deserialize_usec(const char *value, usec_t *timestamp);
 int deserialize_dual_timestamp(const char *value, dual_timestamp *t);
 int deserialize_environment(const char *value, char ***environment);
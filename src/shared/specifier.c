@@ -29,7 +29,89 @@
  * and "%" used for escaping. */
 #define POSSIBLE_SPECIFIERS ALPHANUMERICAL "%"
 
-int specifier_printf(const char *text, const Specifier table[], const void *userdata, char **_ret) {
+/* The lookups whose results don't depend on the data or userdata passed in, i.e. that resolve to the same
+ * value for all strings expanded by this process in one go */
+static const SpecifierCallback cacheable_lookups[] = {
+        specifier_machine_id,
+        specifier_boot_id,
+        specifier_host_name,
+        specifier_kernel_release,
+        specifier_architecture,
+        specifier_os_id,
+        specifier_os_version_id,
+        specifier_os_build_id,
+        specifier_os_variant_id,
+        specifier_group_name,
+        specifier_group_id,
+        specifier_user_name,
+        specifier_user_id,
+        specifier_user_home,
+        specifier_user_shell,
+};
+
+SpecifierCache *specifier_cache_free(SpecifierCache *c) {
+        size_t i;
+
+        if (!c)
+                return NULL;
+
+        for (i = 0; i < ELEMENTSOF(c->values); i++)
+                free(c->values[i]);
+
+        return mfree(c);
+}
+
+static bool specifier_is_cacheable(const Specifier *i) {
+        size_t k;
+
+        assert(i);
+
+        if ((unsigned char) i->specifier >= ELEMENTSOF(((SpecifierCache*) NULL)->values))
+                return false;
+
+        for (k = 0; k < ELEMENTSOF(cacheable_lookups); k++)
+                if (i->lookup == cacheable_lookups[k])
+                        return true;
+
+        return false;
+}
+
+static int specifier_lookup(
+                const Specifier *i,
+                const void *userdata,
+                SpecifierCache *cache,
+                char **buffer,
+                const char **ret) {
+
+        char **v;
+        int r;
+
+        assert(i);
+        assert(buffer);
+        assert(ret);
+
+        if (!cache || !specifier_is_cacheable(i)) {
+                r = i->lookup(i->specifier, i->data, userdata, buffer);
+                if (r < 0)
+                        return r;
+
+                *ret = *buffer;
+                return 0;
+        }
+
+        /* Failures aren't cached, so that they are reported for every string, as before */
+        v = cache->values + (unsigned char) i->specifier;
+        if (!*v) {
+                r = i->lookup(i->specifier, i->data, userdata, v);
+                if (r < 0)
+                        return r;
+        }
+
+        *ret = *v;
+        return 0;
+}
+
+int specifier_printf_full(const char *text, const Specifier table[], const void *userdata, SpecifierCache *cache, char **_ret) {
         size_t l, allocated = 0;
         _cleanup_free_ char *ret = NULL;
         char *t;
@@ -58,18 +140,19 @@ int specifier_printf(const char *text, const Specifier table[], const void *user
 
                                 if (i->lookup) {
                                         _cleanup_free_ char *w = NULL;
+                                        const char *v;
                                         size_t k, j;
 
-                                        r = i->lookup(i->specifier, i->data, userdata, &w);
+                                        r = specifier_lookup(i, userdata, cache, &w, &v);
                                         if (r < 0)
                                                 return r;
 
                                         j = t - ret;
-                                        k = strlen(w);
+                                        k = strlen(v);
 
                                         if (!GREEDY_REALLOC(ret, allocated, j + k + l + 1))
                                                 return -ENOMEM;
-                                        memcpy(ret + j, w, k);
+                                        memcpy(ret + j, v, k);
                                         t = ret + j + k;
                                 } else if (strchr(POSSIBLE_SPECIFIERS, *f))
                                         /* Oops, an unknown specifier. */
@@ -1,6 +1,7 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 #pragma once
 
+#include "macro.h"
 #include "string-util.h"
 
 typedef int (*SpecifierCallback)(char specifier, const void *data, const void *userdata, char **ret);
@@ -11,7 +12,20 @@ typedef struct Specifier {
         const void *data;
 } Specifier;
 
-int specifier_printf(const char *text, const Specifier table[], const void *userdata, char **ret);
+/* Remembers the values of the specifiers which resolve the same way for every string expanded (machine ID,
+ * host name, OS release fields, user name, …), so that expanding many strings in one go doesn't look them
+ * up again and again. Values are never invalidated, hence keep a cache only for one batch of expansions. */
+typedef struct SpecifierCache {
+        char *values[128]; /* indexed by specifier character */
+} SpecifierCache;
+
+SpecifierCache *specifier_cache_free(SpecifierCache *c);
+DEFINE_TRIVIAL_CLEANUP_FUNC(SpecifierCache*, specifier_cache_free);
+
+int specifier_printf_full(const char *text, const Specifier table[], const void *userdata, SpecifierCache *cache, char **ret);
+static inline int specifier_printf(const char *text, const Specifier table[], const void *userdata, char **ret) {
+        return specifier_printf_full(text, table, userdata, NULL, ret);
+}
 
 int specifier_string(char specifier, const void *data, const void *userdata, char **ret);
 
@@ -19,10 +19,14 @@
 #include "cgroup-util.h"
 #include "env-file.h"
 #include "env-util.h"
+#include "fd-util.h"
 #include "fs-util.h"
 #include "log.h"
+#include "parse-util.h"
 #include "path-util.h"
 #include "random-util.h"
+#include "stdio-util.h"
+#include "string-util.h"
 #include "strv.h"
 #include "tests.h"
 
@@ -125,6 +129,80 @@ int log_tests_skipped_errno(int r, const char *message) {
         return EXIT_TEST_SKIP;
 }
 
+usec_t benchmark_duration(void) {
+        static usec_t cached = USEC_INFINITY;
+        const char *e;
+
+        if (cached != USEC_INFINITY)
+                return cached;
+
+        cached = 100 * USEC_PER_MSEC;
+
+        e = getenv("SYSTEMD_BENCHMARK_USEC");
+        if (e) {
+                usec_t u;
+
+                if (parse_sec(e, &u) < 0 || u <= 0 || u == USEC_INFINITY)
+                        log_warning("Cannot parse $SYSTEMD_BENCHMARK_USEC, ignoring: %s", e);
+                else
+                        cached = u;
+        }
+
+        return cached;
+}
+
+void benchmark_report(const char *name, uint64_t n_ops, usec_t elapsed) {
+        char line[LINE_MAX];
+        const char *e;
+
+        assert(name);
+        assert(in_charset(name, ALPHANUMERICAL "-_.:"));
+
+        xsprintf(line, "{\"benchmark\":\"%s\",\"program\":\"%s\",\"ops\":%" PRIu64 ",\"usec\":" USEC_FMT ",\"nsec_per_op\":%.1f}\n",
+                 name, program_invocation_short_name, n_ops, elapsed,
+                 n_ops > 0 ? (double) elapsed * NSEC_PER_USEC / n_ops : 0.0);
+
+        fputs(line, stdout);
+        fflush(stdout);
+
+        e = getenv("SYSTEMD_BENCHMARK_OUTPUT");
+        if (e) {
+                _cleanup_fclose_ FILE *f = NULL;
+
+                f = fopen(e, "ae");
+                if (!f) {
+                        log_warning_errno(errno, "Failed to open %s, ignoring: %m", e);
+                        return;
+                }
+
+                fputs(line, f);
+        }
+}
+
+void benchmark_run(const char *name, benchmark_func_t func, void *userdata, uint64_t ops_per_call) {
+        usec_t start, elapsed, duration;
+        uint64_t n_ops = 0;
+
+        assert(name);
+        assert(func);
+        assert(ops_per_call > 0);
+
+        /* Calls the function until the configured duration passed, at least once. Only the wall clock time
+         * is measured, hence set-up work should be done beforehand, and its state passed in 'userdata'. */
+
+        duration = benchmark_duration();
+
+        start = now(CLOCK_MONOTONIC);
+        do {
+                func(userdata);
+                n_ops += ops_per_call;
+
+                elapsed = now(CLOCK_MONOTONIC) - start;
+        } while (elapsed < duration);
+
+        benchmark_report(name, n_ops, elapsed);
+}
+
 bool have_namespaces(void) {
         siginfo_t si = {};
         pid_t pid;
@@ -6,6 +6,7 @@
 #include "sd-daemon.h"
 
 #include "macro.h"
+#include "time-util.h"
 
 static inline bool manager_errno_skip_test(int r) {
         return IN_SET(abs(r),
@@ -29,6 +30,17 @@ int log_tests_skipped_errno(int r, const char *message);
 
 bool have_namespaces(void);
 
+/* Benchmarks are registered in the "benchmark" suite if configured with -Dbenchmark-tests=true, and then
+ * run with "meson test --suite=benchmark". They are still built, and may be run directly. Each
+ * case is called repeatedly for $SYSTEMD_BENCHMARK_USEC (by default 100ms), and then reported as one JSON
+ * object per line on stdout, and appended to $SYSTEMD_BENCHMARK_OUTPUT if set, so that the results of
+ * different runs can be diffed easily. */
+typedef void (*benchmark_func_t)(void *userdata);
+
+usec_t benchmark_duration(void);
+void benchmark_report(const char *name, uint64_t n_ops, usec_t elapsed);
+void benchmark_run(const char *name, benchmark_func_t func, void *userdata, uint64_t ops_per_call);
+
 /* We use the small but non-trivial limit here */
 #define CAN_MEMLOCK_SIZE (512 * 1024U)
 bool can_memlock(void);
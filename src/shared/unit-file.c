@@ -1,5 +1,6 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
+#include "alloc-util.h"
 #include "dirent-util.h"
 #include "fd-util.h"
 #include "fs-util.h"
@@ -226,12 +227,308 @@ static bool lookup_paths_mtime_good(const LookupPaths *lp, usec_t mtime) {
         return true;
 }
 
+/* The contents of one lookup directory, as far as relevant for the name map. Directories only change their
+ * mtime when entries are added, removed or renamed, and symlinks cannot be changed in place, hence as long
+ * as the directory is the same inode with the same mtime, the entries are still valid. */
+typedef struct UnitFileEntry {
+        char *name;
+        unsigned char d_type;
+        bool unit:1;      /* a valid unit name, rather than a .wants/.requires/.d directory */
+        bool resolved:1;  /* dst has been determined, symlinks are only resolved when needed */
+        char *dst;        /* the fragment path or alias target, NULL if the entry is ignored */
+} UnitFileEntry;
+
+typedef struct UnitFileDirectory {
+        char *path;
+        dev_t dev;
+        ino_t ino;
+        usec_t mtime;
+        UnitFileEntry *entries;
+        size_t n_entries;
+} UnitFileDirectory;
+
+struct UnitFileCache {
+        /* Symlinks are resolved relative to the search path and root directory, if either changes, the
+         * entries need to be resolved again. */
+        char **search_path;
+        char *root_dir;
+        Hashmap *directories;
+};
+
+static UnitFileDirectory* unit_file_directory_free(UnitFileDirectory *d) {
+        size_t i;
+
+        if (!d)
+                return NULL;
+
+        for (i = 0; i < d->n_entries; i++) {
+                free(d->entries[i].name);
+                free(d->entries[i].dst);
+        }
+
+        free(d->entries);
+        free(d->path);
+        return mfree(d);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(UnitFileDirectory*, unit_file_directory_free);
+
+DEFINE_PRIVATE_HASH_OPS_WITH_VALUE_DESTRUCTOR(unit_file_directory_hash_ops, char, path_hash_func, path_compare,
+                                              UnitFileDirectory, unit_file_directory_free);
+
+UnitFileCache* unit_file_cache_free(UnitFileCache *c) {
+        if (!c)
+                return NULL;
+
+        strv_free(c->search_path);
+        free(c->root_dir);
+        hashmap_free(c->directories);
+        return mfree(c);
+}
+
+static int unit_file_cache_prepare(const LookupPaths *lp, UnitFileCache **cache) {
+        _cleanup_(unit_file_cache_freep) UnitFileCache *c = NULL;
+
+        assert(lp);
+        assert(cache);
+
+        if (*cache &&
+            strv_equal((*cache)->search_path, lp->search_path) &&
+            streq_ptr((*cache)->root_dir, lp->root_dir))
+                return 0;
+
+        c = new0(UnitFileCache, 1);
+        if (!c)
+                return log_oom();
+
+        c->search_path = strv_copy(lp->search_path);
+        if (!c->search_path && lp->search_path)
+                return log_oom();
+
+        if (lp->root_dir) {
+                c->root_dir = strdup(lp->root_dir);
+                if (!c->root_dir)
+                        return log_oom();
+        }
+
+        c->directories = hashmap_new(&unit_file_directory_hash_ops);
+        if (!c->directories)
+                return log_oom();
+
+        unit_file_cache_free(*cache);
+        *cache = TAKE_PTR(c);
+        return 1;
+}
+
+static int unit_file_directory_read(DIR *d, const char *path, const struct stat *st, UnitFileDirectory **ret) {
+        _cleanup_(unit_file_directory_freep) UnitFileDirectory *ud = NULL;
+        size_t allocated = 0;
+        struct dirent *de;
+
+        assert(d);
+        assert(path);
+        assert(st);
+        assert(ret);
+
+        ud = new(UnitFileDirectory, 1);
+        if (!ud)
+                return log_oom();
+
+        *ud = (UnitFileDirectory) {
+                .path = strdup(path),
+                .dev = st->st_dev,
+                .ino = st->st_ino,
+                .mtime = timespec_load(&st->st_mtim),
+        };
+        if (!ud->path)
+                return log_oom();
+
+        FOREACH_DIRENT_ALL(de, d, log_warning_errno(errno, "Failed to read \"%s\", ignoring: %m", path)) {
+                bool valid_unit_name;
+                char *name;
+
+                valid_unit_name = unit_name_is_valid(de->d_name, UNIT_NAME_ANY);
+
+                /* We only care about valid units and dirs with certain suffixes, let's ignore the
+                 * rest. */
+                if (!valid_unit_name &&
+                    !ENDSWITH_SET(de->d_name, ".wants", ".requires", ".d"))
+                        continue;
+
+                if (valid_unit_name)
+                        dirent_ensure_type(d, de);
+
+                name = strdup(de->d_name);
+                if (!name)
+                        return log_oom();
+
+                if (!GREEDY_REALLOC(ud->entries, allocated, ud->n_entries + 1)) {
+                        free(name);
+                        return log_oom();
+                }
+
+                ud->entries[ud->n_entries++] = (UnitFileEntry) {
+                        .name = name,
+                        .d_type = de->d_type,
+                        .unit = valid_unit_name,
+                };
+        }
+
+        *ret = TAKE_PTR(ud);
+        return 0;
+}
+
+static int unit_file_directory_get(UnitFileCache *cache, const char *path, UnitFileDirectory **ret) {
+        _cleanup_(unit_file_directory_freep) UnitFileDirectory *ud = NULL;
+        _cleanup_closedir_ DIR *d = NULL;
+        UnitFileDirectory *cached;
+        struct stat st;
+        int r;
+
+        assert(cache);
+        assert(path);
+        assert(ret);
+
+        /* Returns the (possibly cached) contents of the directory, or NULL if it does not exist or cannot be
+         * read. */
+
+        cached = hashmap_get(cache->directories, path);
+        if (cached) {
+                if (stat(path, &st) >= 0 &&
+                    st.st_dev == cached->dev &&
+                    st.st_ino == cached->ino &&
+                    timespec_load(&st.st_mtim) == cached->mtime) {
+                        *ret = cached;
+                        return 0;
+                }
+
+                log_debug("Unit dir %s has changed, reading it again.", path);
+                unit_file_directory_free(hashmap_remove(cache->directories, path));
+        }
+
+        *ret = NULL;
+
+        d = opendir(path);
+        if (!d) {
+                if (errno != ENOENT)
+                        log_warning_errno(errno, "Failed to open \"%s\", ignoring: %m", path);
+                return 0;
+        }
+
+        if (fstat(dirfd(d), &st) < 0)
+                return log_error_errno(errno, "Failed to fstat %s: %m", path);
+
+        r = unit_file_directory_read(d, path, &st, &ud);
+        if (r < 0)
+                return r;
+
+        r = hashmap_put(cache->directories, ud->path, ud);
+        if (r < 0)
+                return log_oom();
+
+        *ret = TAKE_PTR(ud);
+        return 0;
+}
+
+static int unit_file_entry_resolve(const LookupPaths *lp, const char *dir, const char *filename, UnitFileEntry *e) {
+        _cleanup_free_ char *target = NULL, *target_abs = NULL, *simplified = NULL;
+        const char *dst;
+        int r;
+
+        assert(lp);
+        assert(dir);
+        assert(filename);
+        assert(e);
+        assert(!e->resolved);
+
+        /* Determines what the entry maps to. Returns < 0 only on OOM, entries that shall be ignored are
+         * marked resolved with a NULL destination. */
+
+        if (e->d_type != DT_LNK) {
+                log_debug("%s: normal unit file: %s", __func__, filename);
+
+                e->dst = strdup(filename);
+                if (!e->dst)
+                        return log_oom();
+
+                e->resolved = true;
+                return 0;
+        }
+
+        /* We don't explicitly check for alias loops here. unit_ids_map_get() which
+         * limits the number of hops should be used to access the map. */
+
+        e->resolved = true;
+
+        r = readlink_malloc(filename, &target);
+        if (r < 0) {
+                log_warning_errno(r, "Failed to read symlink %s, ignoring: %m", filename);
+                return 0;
+        }
+
+        if (!path_is_absolute(target)) {
+                target_abs = path_join(dir, target);
+                if (!target_abs)
+                        return log_oom();
+
+                free_and_replace(target, target_abs);
+        }
+
+        /* Get rid of "." and ".." components in target path */
+        r = chase_symlinks(target, lp->root_dir, CHASE_NOFOLLOW | CHASE_NONEXISTENT, &simplified, NULL);
+        if (r < 0) {
+                log_warning_errno(r, "Failed to resolve symlink %s pointing to %s, ignoring: %m",
+                                  filename, target);
+                return 0;
+        }
+
+        /* Check if the symlink goes outside of our search path.
+         * If yes, it's a linked unit file or mask, and we don't care about the target name.
+         * Let's just store the link destination directly.
+         * If not, let's verify that it's a good symlink. */
+        char *tail = path_startswith_strv(simplified, lp->search_path);
+        if (tail) {
+                bool self_alias;
+
+                dst = basename(simplified);
+                self_alias = streq(dst, e->name);
+
+                if (is_path(tail))
+                        log_full(self_alias ? LOG_DEBUG : LOG_WARNING,
+                                 "Suspicious symlink %s→%s, treating as alias.",
+                                 filename, simplified);
+
+                r = unit_validate_alias_symlink_and_warn(filename, simplified);
+                if (r < 0)
+                        return 0;
+
+                if (self_alias) {
+                        /* A self-alias that has no effect */
+                        log_debug("%s: self-alias: %s → %s, ignoring.", __func__, filename, dst);
+                        return 0;
+                }
+
+                log_debug("%s: alias: %s → %s", __func__, filename, dst);
+        } else {
+                dst = simplified;
+
+                log_debug("%s: linked unit file: %s → %s", __func__, filename, dst);
+        }
+
+        e->dst = strdup(dst);
+        if (!e->dst)
+                return log_oom();
+
+        return 0;
+}
+
 int unit_file_build_name_map(
                 const LookupPaths *lp,
                 usec_t *cache_mtime,
                 Hashmap **ret_unit_ids_map,
                 Hashmap **ret_unit_names_map,
-                Set **ret_path_cache) {
+                Set **ret_path_cache,
+                UnitFileCache **cache) {
 
         /* Build two mappings: any name → main unit (i.e. the end result of symlink resolution), unit name →
          * all aliases (i.e. the entry for a given key is a a list of all names which point to this key). The
@@ -240,8 +537,12 @@ int unit_file_build_name_map(
          * the unit itself is not loadable.
          *
          * At the same, build a cache of paths where to find units.
+         *
+         * If cache is non-NULL, the contents of the lookup directories are kept there, and directories
+         * which have not changed since the previous call are not read again.
          */
 
+        _cleanup_(unit_file_cache_freep) UnitFileCache *tmp = NULL;
         _cleanup_hashmap_free_ Hashmap *ids = NULL, *names = NULL;
         _cleanup_set_free_free_ Set *paths = NULL;
         char **dir;
@@ -253,6 +554,13 @@ int unit_file_build_name_map(
         if (cache_mtime && *cache_mtime > 0 && lookup_paths_mtime_good(lp, *cache_mtime))
                 return 0;
 
+        if (!cache)
+                cache = &tmp;
+
+        r = unit_file_cache_prepare(lp, cache);
+        if (r < 0)
+                return r;
+
         if (ret_path_cache) {
                 paths = set_new(&path_hash_ops);
                 if (!paths)
@@ -260,39 +568,43 @@ int unit_file_build_name_map(
         }
 
         STRV_FOREACH(dir, (char**) lp->search_path) {
-                struct dirent *de;
-                _cleanup_closedir_ DIR *d = NULL;
-                struct stat st;
+                UnitFileDirectory *ud;
+                size_t i;
 
-                d = opendir(*dir);
-                if (!d) {
-                        if (errno != ENOENT)
-                                log_warning_errno(errno, "Failed to open \"%s\", ignoring: %m", *dir);
+                r = unit_file_directory_get(*cache, *dir, &ud);
+                if (r < 0)
+                        return r;
+                if (!ud)
                         continue;
-                }
 
                 /* Determine the latest lookup path modification time */
-                if (fstat(dirfd(d), &st) < 0)
-                        return log_error_errno(errno, "Failed to fstat %s: %m", *dir);
-
                 if (!lookup_paths_mtime_exclude(lp, *dir))
-                        mtime = MAX(mtime, timespec_load(&st.st_mtim));
+                        mtime = MAX(mtime, ud->mtime);
 
-                FOREACH_DIRENT_ALL(de, d, log_warning_errno(errno, "Failed to read \"%s\", ignoring: %m", *dir)) {
-                        char *filename;
-                        _cleanup_free_ char *_filename_free = NULL, *simplified = NULL;
-                        const char *suffix, *dst = NULL;
-                        bool valid_unit_name;
+                /* Size the maps for all entries of the directory at once, instead of growing them entry
+                 * by entry. */
+                if (ud->n_entries > 0) {
+                        if (paths) {
+                                r = set_reserve(paths, ud->n_entries);
+                                if (r < 0)
+                                        return log_oom();
+                        }
 
-                        valid_unit_name = unit_name_is_valid(de->d_name, UNIT_NAME_ANY);
+                        r = hashmap_ensure_allocated(&ids, &string_hash_ops_free_free);
+                        if (r < 0)
+                                return log_oom();
 
-                        /* We only care about valid units and dirs with certain suffixes, let's ignore the
-                         * rest. */
-                        if (!valid_unit_name &&
-                            !ENDSWITH_SET(de->d_name, ".wants", ".requires", ".d"))
-                                continue;
+                        r = hashmap_reserve(ids, ud->n_entries);
+                        if (r < 0)
+                                return log_oom();
+                }
+
+                for (i = 0; i < ud->n_entries; i++) {
+                        UnitFileEntry *e = ud->entries + i;
+                        _cleanup_free_ char *_filename_free = NULL;
+                        char *filename;
 
-                        filename = path_join(*dir, de->d_name);
+                        filename = path_join(*dir, e->name);
                         if (!filename)
                                 return log_oom();
 
@@ -305,89 +617,28 @@ int unit_file_build_name_map(
                         } else
                                 _filename_free = filename; /* Make sure we free the filename. */
 
-                        if (!valid_unit_name)
+                        if (!e->unit)
                                 continue;
-                        assert_se(suffix = strrchr(de->d_name, '.'));
 
                         /* search_path is ordered by priority (highest first). If the name is already mapped
                          * to something (incl. itself), it means that we have already seen it, and we should
                          * ignore it here. */
-                        if (hashmap_contains(ids, de->d_name))
+                        if (hashmap_contains(ids, e->name))
                                 continue;
 
-                        dirent_ensure_type(d, de);
-                        if (de->d_type == DT_LNK) {
-                                /* We don't explicitly check for alias loops here. unit_ids_map_get() which
-                                 * limits the number of hops should be used to access the map. */
-
-                                _cleanup_free_ char *target = NULL, *target_abs = NULL;
-
-                                r = readlinkat_malloc(dirfd(d), de->d_name, &target);
-                                if (r < 0) {
-                                        log_warning_errno(r, "Failed to read symlink %s/%s, ignoring: %m",
-                                                          *dir, de->d_name);
-                                        continue;
-                                }
-
-                                if (!path_is_absolute(target)) {
-                                        target_abs = path_join(*dir, target);
-                                        if (!target_abs)
-                                                return log_oom();
-
-                                        free_and_replace(target, target_abs);
-                                }
-
-                                /* Get rid of "." and ".." components in target path */
-                                r = chase_symlinks(target, lp->root_dir, CHASE_NOFOLLOW | CHASE_NONEXISTENT, &simplified, NULL);
-                                if (r < 0) {
-                                        log_warning_errno(r, "Failed to resolve symlink %s pointing to %s, ignoring: %m",
-                                                          filename, target);
-                                        continue;
-                                }
-
-                                /* Check if the symlink goes outside of our search path.
-                                 * If yes, it's a linked unit file or mask, and we don't care about the target name.
-                                 * Let's just store the link destination directly.
-                                 * If not, let's verify that it's a good symlink. */
-                                char *tail = path_startswith_strv(simplified, lp->search_path);
-                                if (tail) {
-                                        bool self_alias;
-
-                                        dst = basename(simplified);
-                                        self_alias = streq(dst, de->d_name);
-
-                                        if (is_path(tail))
-                                                log_full(self_alias ? LOG_DEBUG : LOG_WARNING,
-                                                         "Suspicious symlink %s→%s, treating as alias.",
-                                                         filename, simplified);
-
-                                        r = unit_validate_alias_symlink_and_warn(filename, simplified);
-                                        if (r < 0)
-                                                continue;
-
-                                        if (self_alias) {
-                                                /* A self-alias that has no effect */
-                                                log_debug("%s: self-alias: %s/%s → %s, ignoring.",
-                                                          __func__, *dir, de->d_name, dst);
-                                                continue;
-                                        }
-
-                                        log_debug("%s: alias: %s/%s → %s", __func__, *dir, de->d_name, dst);
-                                } else {
-                                        dst  = simplified;
-
-                                        log_debug("%s: linked unit file: %s/%s → %s", __func__, *dir, de->d_name, dst);
-                                }
-
-                        } else {
-                                dst = filename;
-                                log_debug("%s: normal unit file: %s", __func__, dst);
+                        if (!e->resolved) {
+                                r = unit_file_entry_resolve(lp, *dir, filename, e);
+                                if (r < 0)
+                                        return r;
                         }
 
-                        r = hashmap_put_strdup(&ids, de->d_name, dst);
+                        if (!e->dst)
+                                continue;
+
+                        r = hashmap_put_strdup(&ids, e->name, e->dst);
                         if (r < 0)
                                 return log_warning_errno(r, "Failed to add entry to hashmap (%s→%s): %m",
-                                                         de->d_name, dst);
+                                                         e->name, e->dst);
                 }
         }
 
@@ -486,7 +737,7 @@ int unit_file_find_fragment(
                                 if (!streq(unit_name, inst))
                                         log_debug("%s: %s has alias %s", __func__, unit_name, inst);
 
-                                log_info("%s: %s+%s → %s", __func__, *t, instance, inst);
+                                log_debug("%s: %s+%s → %s", __func__, *t, instance, inst);
                                 r = set_consume(names, inst);
                         } else {
                                 if (!streq(unit_name, *t))
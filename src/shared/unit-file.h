@@ -10,6 +10,7 @@
 typedef enum UnitFileState UnitFileState;
 typedef enum UnitFileScope UnitFileScope;
 typedef struct LookupPaths LookupPaths;
+typedef struct UnitFileCache UnitFileCache;
 
 enum UnitFileState {
         UNIT_FILE_ENABLED,
@@ -42,12 +43,16 @@ bool unit_type_may_template(UnitType type) _const_;
 int unit_symlink_name_compatible(const char *symlink, const char *target, bool instance_propagation);
 int unit_validate_alias_symlink_and_warn(const char *filename, const char *target);
 
+UnitFileCache* unit_file_cache_free(UnitFileCache *c);
+DEFINE_TRIVIAL_CLEANUP_FUNC(UnitFileCache*, unit_file_cache_free);
+
 int unit_file_build_name_map(
                 const LookupPaths *lp,
                 usec_t *ret_time,
                 Hashmap **ret_unit_ids_map,
                 Hashmap **ret_unit_names_map,
-                Set **ret_path_cache);
+                Set **ret_path_cache,
+                UnitFileCache **cache);
 
 int unit_file_find_fragment(
                 Hashmap *unit_ids_map,
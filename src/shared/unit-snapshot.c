@@ -0,0 +1,292 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "fd-util.h"
+#include "fs-util.h"
+#include "memory-util.h"
+#include "tmpfile-util.h"
+#include "unit-snapshot.h"
+
+/* Number of entries we grow the file by at least */
+#define UNIT_SNAPSHOT_GROW_MIN 256U
+
+/* How often a reader retries if the writer keeps modifying the file under its feet */
+#define UNIT_SNAPSHOT_READ_TRIES 64U
+
+struct UnitSnapshotWriter {
+        int fd;
+        void *map;
+        size_t map_size;
+        size_t n_entries;
+
+        size_t *free_slots;
+        size_t n_free_slots;
+        size_t n_allocated_free_slots;
+};
+
+static size_t snapshot_size(size_t n_entries) {
+        return sizeof(UnitSnapshotHeader) + n_entries * sizeof(UnitSnapshotEntry);
+}
+
+static UnitSnapshotHeader *writer_header(UnitSnapshotWriter *w) {
+        return w->map;
+}
+
+static UnitSnapshotEntry *writer_entry(UnitSnapshotWriter *w, size_t index) {
+        assert(index < w->n_entries);
+        return (UnitSnapshotEntry*) ((uint8_t*) w->map + sizeof(UnitSnapshotHeader)) + index;
+}
+
+static void writer_begin(UnitSnapshotWriter *w) {
+        UnitSnapshotHeader *h = writer_header(w);
+
+        assert(h->seqnum % 2 == 0);
+
+        h->seqnum++;
+        __sync_synchronize();
+}
+
+static void writer_end(UnitSnapshotWriter *w) {
+        UnitSnapshotHeader *h = writer_header(w);
+
+        assert(h->seqnum % 2 == 1);
+
+        __sync_synchronize();
+        h->seqnum++;
+}
+
+static int writer_grow(UnitSnapshotWriter *w) {
+        size_t n, sz, k;
+        void *p;
+
+        assert(w);
+
+        n = MAX(w->n_entries * 2, w->n_entries + UNIT_SNAPSHOT_GROW_MIN);
+        sz = snapshot_size(n);
+
+        /* Make room for all entries to be free at once, so that removing never needs to allocate */
+        if (!GREEDY_REALLOC(w->free_slots, w->n_allocated_free_slots, n))
+                return -ENOMEM;
+
+        /* New space in the file reads as zeroes, i.e. as unused entries. Readers that have the old, smaller
+         * mapping only look at as many entries as fit into it. */
+        if (ftruncate(w->fd, sz) < 0)
+                return -errno;
+
+        if (w->map) {
+                p = mremap(w->map, w->map_size, sz, MREMAP_MAYMOVE);
+                if (p == MAP_FAILED)
+                        return -errno;
+        } else {
+                p = mmap(NULL, sz, PROT_READ|PROT_WRITE, MAP_SHARED, w->fd, 0);
+                if (p == MAP_FAILED)
+                        return -errno;
+        }
+
+        w->map = p;
+        w->map_size = sz;
+
+        writer_begin(w);
+        writer_header(w)->n_entries = n;
+        writer_end(w);
+
+        /* Hand out the lower indexes first, so that the used entries stay close together */
+        for (k = n; k > w->n_entries; k--)
+                w->free_slots[w->n_free_slots++] = k - 1;
+
+        w->n_entries = n;
+        return 0;
+}
+
+int unit_snapshot_writer_new(const char *path, UnitSnapshotWriter **ret) {
+        _cleanup_(unit_snapshot_writer_freep) UnitSnapshotWriter *w = NULL;
+        _cleanup_(unlink_and_freep) char *t = NULL;
+        UnitSnapshotHeader *h;
+        int r;
+
+        assert(path);
+        assert(ret);
+
+        w = new0(UnitSnapshotWriter, 1);
+        if (!w)
+                return -ENOMEM;
+
+        w->fd = -1;
+
+        /* We always start with a new file, and atomically replace any previous one, so that readers never
+         * see a file that is only partially initialized, and readers of the old file are not confused by us
+         * starting from scratch. */
+        r = tempfn_random(path, NULL, &t);
+        if (r < 0)
+                return r;
+
+        w->fd = open(t, O_RDWR|O_CREAT|O_EXCL|O_NOFOLLOW|O_NOCTTY|O_CLOEXEC, 0644);
+        if (w->fd < 0)
+                return -errno;
+
+        r = writer_grow(w);
+        if (r < 0)
+                return r;
+
+        h = writer_header(w);
+        h->header_size = sizeof(UnitSnapshotHeader);
+        h->entry_size = sizeof(UnitSnapshotEntry);
+        __sync_synchronize();
+        memcpy(h->signature, UNIT_SNAPSHOT_SIGNATURE, sizeof(h->signature));
+
+        if (rename(t, path) < 0)
+                return -errno;
+
+        t = mfree(t);
+
+        *ret = TAKE_PTR(w);
+        return 0;
+}
+
+UnitSnapshotWriter *unit_snapshot_writer_free(UnitSnapshotWriter *w) {
+        if (!w)
+                return NULL;
+
+        if (w->map)
+                (void) munmap(w->map, w->map_size);
+
+        safe_close(w->fd);
+        free(w->free_slots);
+
+        return mfree(w);
+}
+
+int unit_snapshot_writer_add(UnitSnapshotWriter *w, size_t *ret_index) {
+        int r;
+
+        assert(w);
+        assert(ret_index);
+
+        if (w->n_free_slots == 0) {
+                r = writer_grow(w);
+                if (r < 0)
+                        return r;
+        }
+
+        *ret_index = w->free_slots[--w->n_free_slots];
+        return 0;
+}
+
+void unit_snapshot_writer_update(UnitSnapshotWriter *w, size_t index, const UnitSnapshotEntry *e) {
+        UnitSnapshotEntry *d;
+
+        assert(w);
+        assert(e);
+
+        d = writer_entry(w, index);
+
+        /* Skip the seqnum dance if nothing changed, which is common since we are called for every property
+         * change signal, not only for the ones that alter the fields we carry */
+        if (memcmp(d, e, sizeof(*e)) == 0)
+                return;
+
+        writer_begin(w);
+        memcpy(d, e, sizeof(*e));
+        writer_end(w);
+}
+
+void unit_snapshot_writer_remove(UnitSnapshotWriter *w, size_t index) {
+        assert(w);
+
+        assert(w->n_free_slots < w->n_entries);
+
+        writer_begin(w);
+        zero(*writer_entry(w, index));
+        writer_end(w);
+
+        w->free_slots[w->n_free_slots++] = index;
+}
+
+int unit_snapshot_read(const char *path, UnitSnapshotEntry **ret, size_t *ret_n) {
+        _cleanup_close_ int fd = -1;
+        UnitSnapshotHeader *h;
+        struct stat st;
+        void *map;
+        int r = -EBUSY;
+
+        assert(path);
+        assert(ret);
+        assert(ret_n);
+
+        fd = open(path, O_RDONLY|O_CLOEXEC|O_NOCTTY);
+        if (fd < 0)
+                return -errno;
+
+        if (fstat(fd, &st) < 0)
+                return -errno;
+
+        if ((uint64_t) st.st_size < sizeof(UnitSnapshotHeader))
+                return -EBADMSG;
+
+        /* The file never shrinks, hence mapping what is there now is safe even if the writer grows it */
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (map == MAP_FAILED)
+                return -errno;
+
+        h = map;
+
+        if (memcmp(h->signature, UNIT_SNAPSHOT_SIGNATURE, sizeof(h->signature)) != 0 ||
+            h->header_size != sizeof(UnitSnapshotHeader) ||
+            h->entry_size != sizeof(UnitSnapshotEntry)) {
+                r = -EBADMSG;
+                goto finish;
+        }
+
+        for (unsigned try = 0; try < UNIT_SNAPSHOT_READ_TRIES; try++) {
+                _cleanup_free_ UnitSnapshotEntry *entries = NULL;
+                const UnitSnapshotEntry *e;
+                uint64_t seqnum, n_max;
+                size_t n = 0;
+
+                seqnum = h->seqnum;
+                __sync_synchronize();
+
+                if (seqnum % 2 != 0)
+                        continue;
+
+                n_max = MIN(h->n_entries, (st.st_size - sizeof(UnitSnapshotHeader)) / sizeof(UnitSnapshotEntry));
+
+                entries = new(UnitSnapshotEntry, MAX(n_max, 1U));
+                if (!entries) {
+                        r = -ENOMEM;
+                        goto finish;
+                }
+
+                e = (const UnitSnapshotEntry*) ((const uint8_t*) map + sizeof(UnitSnapshotHeader));
+                for (uint64_t k = 0; k < n_max; k++)
+                        if (e[k].id[0] != 0)
+                                entries[n++] = e[k];
+
+                __sync_synchronize();
+                if (h->seqnum != seqnum)
+                        continue;
+
+                /* The writer might have been in the middle of things when we copied, but then the seqnum
+                 * would have changed. Still, let's make sure the strings are terminated. */
+                for (size_t k = 0; k < n; k++) {
+                        entries[k].id[sizeof(entries[k].id) - 1] = 0;
+                        entries[k].load_state[sizeof(entries[k].load_state) - 1] = 0;
+                        entries[k].active_state[sizeof(entries[k].active_state) - 1] = 0;
+                        entries[k].sub_state[sizeof(entries[k].sub_state) - 1] = 0;
+                }
+
+                *ret = TAKE_PTR(entries);
+                *ret_n = n;
+                r = 0;
+                break;
+        }
+
+finish:
+        (void) munmap(map, st.st_size);
+        return r;
+}
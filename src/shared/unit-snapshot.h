@@ -0,0 +1,52 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+#include <inttypes.h>
+#include <sys/types.h>
+
+#include "macro.h"
+#include "unit-name.h"
+
+/* A memory-mapped, read-only (for everybody but the service manager) snapshot of the state of all loaded
+ * units, so that monitoring tools can poll it without any IPC. The file consists of a header followed by an
+ * array of fixed-size entries, all in native endianness. Entries with an empty id are unused.
+ *
+ * The writer follows the seqlock protocol: before modifying anything the sequence number in the header is
+ * increased to an odd value, and afterwards to the next even one. Readers copy what they need, and retry if
+ * the sequence number was odd or changed in the meantime. The file only grows while it is in use; if the
+ * manager starts over it replaces the file instead, hence readers should open it afresh each time. */
+
+/* Relative to the runtime directory of the manager. Note that <runtime>/systemd/units/ is a directory already. */
+#define UNIT_SNAPSHOT_FILE "systemd/unit-snapshot"
+
+#define UNIT_SNAPSHOT_SIGNATURE ((const uint8_t[8]) { 'S', 'D', 'U', 'S', 'N', 'A', 'P', '1' })
+
+typedef struct UnitSnapshotHeader {
+        uint8_t signature[8];
+        uint64_t header_size;
+        uint64_t entry_size;
+        uint64_t n_entries;    /* number of entries, including unused ones */
+        uint64_t seqnum;       /* odd while the writer is modifying the file */
+} UnitSnapshotHeader;
+
+typedef struct UnitSnapshotEntry {
+        char id[UNIT_NAME_MAX + 1];
+        char load_state[16];
+        char active_state[16];
+        char sub_state[32];
+        uint32_t main_pid;
+        uint32_t reserved;
+        uint64_t state_change_timestamp; /* CLOCK_REALTIME */
+} UnitSnapshotEntry;
+
+typedef struct UnitSnapshotWriter UnitSnapshotWriter;
+
+int unit_snapshot_writer_new(const char *path, UnitSnapshotWriter **ret);
+UnitSnapshotWriter *unit_snapshot_writer_free(UnitSnapshotWriter *w);
+DEFINE_TRIVIAL_CLEANUP_FUNC(UnitSnapshotWriter*, unit_snapshot_writer_free);
+
+int unit_snapshot_writer_add(UnitSnapshotWriter *w, size_t *ret_index);
+void unit_snapshot_writer_update(UnitSnapshotWriter *w, size_t index, const UnitSnapshotEntry *e);
+void unit_snapshot_writer_remove(UnitSnapshotWriter *w, size_t index);
+
+int unit_snapshot_read(const char *path, UnitSnapshotEntry **ret, size_t *ret_n);
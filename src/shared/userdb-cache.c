@@ -0,0 +1,773 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "sd-id128.h"
+
+#include "alloc-util.h"
+#include "fd-util.h"
+#include "fileio.h"
+#include "format-util.h"
+#include "fs-util.h"
+#include "hashmap.h"
+#include "json.h"
+#include "set.h"
+#include "siphash24.h"
+#include "sparse-endian.h"
+#include "stdio-util.h"
+#include "string-util.h"
+#include "strv.h"
+#include "tmpfile-util.h"
+#include "user-util.h"
+#include "userdb-cache.h"
+#include "userdb.h"
+
+/* The file starts with the header, followed by the records and the key entries pointing to them, followed by
+ * the hash table. The keys are "user:<name>", "uid:<uid>", "group:<name>", "gid:<gid>" and "members:<group>",
+ * the entries of each hash bucket are chained. All offsets are relative to the beginning of the file, all
+ * integers are little endian. */
+
+typedef struct UserDBCacheHeader {
+        uint8_t signature[8];
+        le64_t header_size;
+        le64_t file_size;
+        le64_t valid_until;       /* CLOCK_MONOTONIC */
+        sd_id128_t hash_key;
+        le64_t n_buckets;
+        le64_t buckets_offset;
+} _packed_ UserDBCacheHeader;
+
+typedef struct UserDBCacheEntry {
+        le64_t next;              /* Next entry in the same bucket, or 0 */
+        le64_t record_offset;
+        le64_t key_size;
+        char key[];
+} _packed_ UserDBCacheEntry;
+
+typedef struct UserDBCacheRecord {
+        le64_t flags;
+        le64_t json_size;         /* Including the trailing NUL byte */
+        char json[];
+} _packed_ UserDBCacheRecord;
+
+#define USERDB_CACHE_SIGNATURE ((const uint8_t[8]) { 'U', 'D', 'B', 'C', 'A', 'C', 'H', 'E' })
+
+#define USERDB_CACHE_RECORD_INCOMPLETE (UINT64_C(1) << 0)
+
+/* Don't make the file larger than makes sense for something every NSS lookup maps */
+#define USERDB_CACHE_SIZE_MAX (64U * 1024U * 1024U)
+
+typedef struct CacheKey {
+        char *key;
+        uint64_t record_offset;
+} CacheKey;
+
+struct UserDBCacheBuilder {
+        uint8_t *data;
+        size_t size, allocated;
+
+        CacheKey *keys;
+        size_t n_keys, n_allocated_keys;
+
+        Set *seen;
+
+        Hashmap *members; /* group name → strv of member names */
+};
+
+DEFINE_PRIVATE_HASH_OPS_FULL(members_hash_ops, char, string_hash_func, string_compare_func, free, char*, strv_free);
+
+static void* cache_builder_reserve(UserDBCacheBuilder *b, size_t n, uint64_t *ret_offset) {
+        size_t offset;
+
+        assert(b);
+        assert(ret_offset);
+
+        offset = ALIGN8(b->size);
+        if (offset + n > USERDB_CACHE_SIZE_MAX)
+                return NULL;
+
+        if (!GREEDY_REALLOC0(b->data, b->allocated, offset + n))
+                return NULL;
+
+        b->size = offset + n;
+        *ret_offset = offset;
+        return b->data + offset;
+}
+
+static int cache_builder_add(UserDBCacheBuilder *b, JsonVariant *v, uint64_t flags, char **keys) {
+        _cleanup_free_ char *text = NULL;
+        UserDBCacheRecord *record;
+        bool any = false;
+        uint64_t offset;
+        size_t n;
+        char **k;
+        int r;
+
+        assert(b);
+        assert(v);
+
+        /* If several services know the same name or ID, only the first one is reachable, like with a regular
+         * lookup that returns the first answer. */
+        STRV_FOREACH(k, keys)
+                if (!set_contains(b->seen, *k)) {
+                        any = true;
+                        break;
+                }
+        if (!any)
+                return 0;
+
+        r = json_variant_format(v, 0, &text);
+        if (r < 0)
+                return r;
+
+        n = strlen(text) + 1;
+        record = cache_builder_reserve(b, offsetof(UserDBCacheRecord, json) + n, &offset);
+        if (!record)
+                return -ENOMEM;
+
+        record->flags = htole64(flags);
+        record->json_size = htole64(n);
+        memcpy(record->json, text, n);
+
+        STRV_FOREACH(k, keys) {
+                _cleanup_free_ char *copy = NULL;
+
+                if (set_contains(b->seen, *k))
+                        continue;
+
+                copy = strdup(*k);
+                if (!copy)
+                        return -ENOMEM;
+
+                if (!GREEDY_REALLOC(b->keys, b->n_allocated_keys, b->n_keys + 1))
+                        return -ENOMEM;
+
+                r = set_ensure_allocated(&b->seen, &string_hash_ops);
+                if (r < 0)
+                        return r;
+
+                r = set_put(b->seen, copy);
+                if (r < 0)
+                        return r;
+
+                b->keys[b->n_keys++] = (CacheKey) {
+                        .key = TAKE_PTR(copy),
+                        .record_offset = offset,
+                };
+        }
+
+        return 1;
+}
+
+static int cache_builder_finish(UserDBCacheBuilder *b, usec_t until) {
+        _cleanup_free_ uint64_t *buckets = NULL;
+        UserDBCacheHeader *h;
+        uint64_t offset;
+        sd_id128_t key;
+        size_t n_buckets;
+        int r;
+
+        assert(b);
+        assert(b->size >= sizeof(UserDBCacheHeader));
+
+        r = sd_id128_randomize(&key);
+        if (r < 0)
+                return r;
+
+        n_buckets = MAX(b->n_keys, 1U);
+        buckets = new0(uint64_t, n_buckets);
+        if (!buckets)
+                return -ENOMEM;
+
+        for (size_t i = 0; i < b->n_keys; i++) {
+                UserDBCacheEntry *e;
+                size_t l, bucket;
+
+                l = strlen(b->keys[i].key);
+                bucket = siphash24(b->keys[i].key, l, key.bytes) % n_buckets;
+
+                e = cache_builder_reserve(b, offsetof(UserDBCacheEntry, key) + l, &offset);
+                if (!e)
+                        return -ENOMEM;
+
+                e->next = htole64(buckets[bucket]);
+                e->record_offset = htole64(b->keys[i].record_offset);
+                e->key_size = htole64(l);
+                memcpy(e->key, b->keys[i].key, l);
+
+                buckets[bucket] = offset;
+        }
+
+        for (size_t i = 0; i < n_buckets; i++)
+                buckets[i] = htole64(buckets[i]);
+
+        if (!cache_builder_reserve(b, n_buckets * sizeof(uint64_t), &offset))
+                return -ENOMEM;
+        memcpy(b->data + offset, buckets, n_buckets * sizeof(uint64_t));
+
+        h = (UserDBCacheHeader*) b->data;
+        memcpy(h->signature, USERDB_CACHE_SIGNATURE, sizeof(h->signature));
+        h->header_size = htole64(sizeof(UserDBCacheHeader));
+        h->file_size = htole64(b->size);
+        h->valid_until = htole64(until);
+        h->hash_key = key;
+        h->n_buckets = htole64(n_buckets);
+        h->buckets_offset = htole64(offset);
+
+        return 0;
+}
+
+UserDBCacheBuilder* userdb_cache_builder_free(UserDBCacheBuilder *b) {
+        if (!b)
+                return NULL;
+
+        free(b->data);
+
+        for (size_t i = 0; i < b->n_keys; i++)
+                free(b->keys[i].key);
+        free(b->keys);
+
+        set_free(b->seen);
+        hashmap_free(b->members);
+
+        return mfree(b);
+}
+
+int userdb_cache_builder_new(UserDBCacheBuilder **ret) {
+        _cleanup_(userdb_cache_builder_freep) UserDBCacheBuilder *b = NULL;
+        uint64_t offset;
+
+        assert(ret);
+
+        b = new0(UserDBCacheBuilder, 1);
+        if (!b)
+                return -ENOMEM;
+
+        if (!cache_builder_reserve(b, sizeof(UserDBCacheHeader), &offset))
+                return -ENOMEM;
+
+        *ret = TAKE_PTR(b);
+        return 0;
+}
+
+int userdb_cache_builder_add_user(UserDBCacheBuilder *b, UserRecord *ur) {
+        _cleanup_(user_record_unrefp) UserRecord *stripped = NULL;
+        char uid_key[STRLEN("uid:") + DECIMAL_STR_MAX(uid_t)];
+        _cleanup_free_ char *name_key = NULL;
+        bool incomplete;
+        int r;
+
+        assert(b);
+        assert(ur);
+
+        /* The file is readable by everybody, hence strip the privileged section, like the multiplexer does
+         * it for unprivileged clients */
+        r = user_record_clone(ur, USER_RECORD_REQUIRE_REGULAR|USER_RECORD_ALLOW_PER_MACHINE|USER_RECORD_ALLOW_BINDING|USER_RECORD_STRIP_SECRET|USER_RECORD_ALLOW_STATUS|USER_RECORD_ALLOW_SIGNATURE|USER_RECORD_STRIP_PRIVILEGED, &stripped);
+        if (r < 0)
+                return r;
+
+        incomplete = ur->incomplete ||
+                (FLAGS_SET(ur->mask, USER_RECORD_PRIVILEGED) && !FLAGS_SET(stripped->mask, USER_RECORD_PRIVILEGED));
+
+        xsprintf(uid_key, "uid:" UID_FMT, ur->uid);
+
+        name_key = strjoin("user:", ur->user_name);
+        if (!name_key)
+                return -ENOMEM;
+
+        return cache_builder_add(b, stripped->json, incomplete ? USERDB_CACHE_RECORD_INCOMPLETE : 0,
+                                 STRV_MAKE(name_key, uid_key));
+}
+
+int userdb_cache_builder_add_group(UserDBCacheBuilder *b, GroupRecord *gr) {
+        _cleanup_(group_record_unrefp) GroupRecord *stripped = NULL;
+        char gid_key[STRLEN("gid:") + DECIMAL_STR_MAX(gid_t)];
+        _cleanup_free_ char *name_key = NULL;
+        bool incomplete;
+        int r;
+
+        assert(b);
+        assert(gr);
+
+        r = group_record_clone(gr, USER_RECORD_REQUIRE_REGULAR|USER_RECORD_ALLOW_PER_MACHINE|USER_RECORD_ALLOW_BINDING|USER_RECORD_STRIP_SECRET|USER_RECORD_ALLOW_STATUS|USER_RECORD_ALLOW_SIGNATURE|USER_RECORD_STRIP_PRIVILEGED, &stripped);
+        if (r < 0)
+                return r;
+
+        incomplete = gr->incomplete ||
+                (FLAGS_SET(gr->mask, USER_RECORD_PRIVILEGED) && !FLAGS_SET(stripped->mask, USER_RECORD_PRIVILEGED));
+
+        xsprintf(gid_key, "gid:" GID_FMT, gr->gid);
+
+        name_key = strjoin("group:", gr->group_name);
+        if (!name_key)
+                return -ENOMEM;
+
+        r = cache_builder_add(b, stripped->json, incomplete ? USERDB_CACHE_RECORD_INCOMPLETE : 0,
+                              STRV_MAKE(name_key, gid_key));
+        if (r < 0)
+                return r;
+
+        /* Also store the (possibly empty) member list of every group, so that a group lookup is answered
+         * completely from the cache */
+        if (!hashmap_contains(b->members, gr->group_name)) {
+                _cleanup_free_ char *n = NULL;
+
+                n = strdup(gr->group_name);
+                if (!n)
+                        return -ENOMEM;
+
+                r = hashmap_ensure_allocated(&b->members, &members_hash_ops);
+                if (r < 0)
+                        return r;
+
+                r = hashmap_put(b->members, n, NULL);
+                if (r < 0)
+                        return r;
+
+                TAKE_PTR(n);
+        }
+
+        return 0;
+}
+
+int userdb_cache_builder_add_membership(UserDBCacheBuilder *b, const char *user, const char *group) {
+        _cleanup_free_ char *u = NULL, *g = NULL;
+        char **l;
+        int r;
+
+        assert(b);
+        assert(user);
+        assert(group);
+
+        u = strdup(user);
+        if (!u)
+                return -ENOMEM;
+
+        r = hashmap_ensure_allocated(&b->members, &members_hash_ops);
+        if (r < 0)
+                return r;
+
+        l = hashmap_get(b->members, group);
+
+        r = strv_consume(&l, TAKE_PTR(u));
+        if (r < 0)
+                return r;
+
+        if (hashmap_contains(b->members, group)) {
+                assert_se(hashmap_update(b->members, group, l) >= 0);
+                return 0;
+        }
+
+        g = strdup(group);
+        if (!g) {
+                strv_free(l);
+                return -ENOMEM;
+        }
+
+        r = hashmap_put(b->members, g, l);
+        if (r < 0) {
+                strv_free(l);
+                return r;
+        }
+
+        TAKE_PTR(g);
+        return 0;
+}
+
+int userdb_cache_builder_write(UserDBCacheBuilder *b, const char *path, usec_t until) {
+        _cleanup_(unlink_and_freep) char *temp = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+        Iterator i;
+        char *name;
+        char **l;
+        int r;
+
+        assert(b);
+        assert(path);
+
+        /* Returns 0 if there is nothing to cache, in which case the snapshot is removed, and > 0 if it was
+         * written. Readers fall back to querying the services for anything not in the snapshot. */
+
+        HASHMAP_FOREACH_KEY(l, name, b->members, i) {
+                _cleanup_(json_variant_unrefp) JsonVariant *v = NULL;
+                _cleanup_free_ char *key = NULL;
+
+                strv_sort(l);
+                strv_uniq(l);
+
+                r = json_variant_new_array_strv(&v, l);
+                if (r < 0)
+                        return r;
+
+                key = strjoin("members:", name);
+                if (!key)
+                        return -ENOMEM;
+
+                r = cache_builder_add(b, v, 0, STRV_MAKE(key));
+                if (r < 0)
+                        return r;
+        }
+
+        b->members = hashmap_free(b->members);
+
+        if (b->n_keys == 0) {
+                if (unlink(path) < 0 && errno != ENOENT)
+                        return -errno;
+
+                return 0;
+        }
+
+        r = cache_builder_finish(b, until);
+        if (r < 0)
+                return r;
+
+        r = fopen_temporary(path, &f, &temp);
+        if (r < 0)
+                return r;
+
+        if (fchmod(fileno(f), 0644) < 0)
+                return -errno;
+
+        fwrite(b->data, 1, b->size, f);
+
+        r = fflush_and_check(f);
+        if (r < 0)
+                return r;
+
+        if (rename(temp, path) < 0)
+                return -errno;
+
+        temp = mfree(temp);
+
+        log_debug("Wrote %zu keys, %zu bytes to %s.", b->n_keys, b->size, path);
+        return 1;
+}
+
+int userdb_cache_generate(const char *path, usec_t until) {
+        /* Cache exactly what nss-systemd would see: all services but NSS itself, nothing synthesized. Dynamic
+         * users come and go with the units that use them, hence they are always looked up directly. */
+        const UserDBFlags flags = USERDB_AVOID_NSS|USERDB_AVOID_MULTIPLEXER|USERDB_DONT_SYNTHESIZE|USERDB_AVOID_DYNAMIC_USER;
+
+        _cleanup_(userdb_cache_builder_freep) UserDBCacheBuilder *b = NULL;
+        _cleanup_(userdb_iterator_freep) UserDBIterator *iterator = NULL;
+        int r;
+
+        assert(path);
+
+        r = userdb_cache_builder_new(&b);
+        if (r < 0)
+                return r;
+
+        r = userdb_all(flags, &iterator);
+        if (r < 0 && r != -ESRCH)
+                return r;
+        while (r >= 0) {
+                _cleanup_(user_record_unrefp) UserRecord *ur = NULL;
+
+                r = userdb_iterator_get(iterator, &ur);
+                if (r == -ESRCH)
+                        break;
+                if (r < 0)
+                        return r;
+
+                r = userdb_cache_builder_add_user(b, ur);
+                if (r == -ENOMEM)
+                        return r;
+                if (r < 0)
+                        log_debug_errno(r, "Failed to add user record of %s to cache, ignoring: %m", ur->user_name);
+        }
+
+        iterator = userdb_iterator_free(iterator);
+
+        r = membershipdb_all(flags, &iterator);
+        if (r < 0 && r != -ESRCH)
+                return r;
+        while (r >= 0) {
+                _cleanup_free_ char *user_name = NULL, *group_name = NULL;
+
+                r = membershipdb_iterator_get(iterator, &user_name, &group_name);
+                if (r == -ESRCH)
+                        break;
+                if (r < 0)
+                        return r;
+
+                r = userdb_cache_builder_add_membership(b, user_name, group_name);
+                if (r < 0)
+                        return r;
+        }
+
+        iterator = userdb_iterator_free(iterator);
+
+        r = groupdb_all(flags, &iterator);
+        if (r < 0 && r != -ESRCH)
+                return r;
+        while (r >= 0) {
+                _cleanup_(group_record_unrefp) GroupRecord *gr = NULL;
+
+                r = groupdb_iterator_get(iterator, &gr);
+                if (r == -ESRCH)
+                        break;
+                if (r < 0)
+                        return r;
+
+                r = userdb_cache_builder_add_group(b, gr);
+                if (r == -ENOMEM)
+                        return r;
+                if (r < 0)
+                        log_debug_errno(r, "Failed to add group record of %s to cache, ignoring: %m", gr->group_name);
+        }
+
+        return userdb_cache_builder_write(b, path, until);
+}
+
+static int cache_find(const uint8_t *p, size_t size, const char *key, JsonVariant **ret, bool *ret_incomplete) {
+        const UserDBCacheHeader *h = (const UserDBCacheHeader*) p;
+        const UserDBCacheRecord *record;
+        uint64_t n_buckets, offset, n;
+        size_t l;
+        int r;
+
+        assert(p);
+        assert(key);
+
+        if (size < sizeof(UserDBCacheHeader) ||
+            memcmp(h->signature, USERDB_CACHE_SIGNATURE, sizeof(h->signature)) != 0 ||
+            le64toh(h->header_size) != sizeof(UserDBCacheHeader) ||
+            le64toh(h->file_size) != size)
+                return -EBADMSG;
+
+        if (le64toh(h->valid_until) <= now(CLOCK_MONOTONIC))
+                return -ESTALE;
+
+        n_buckets = le64toh(h->n_buckets);
+        offset = le64toh(h->buckets_offset);
+        if (n_buckets == 0 ||
+            offset < sizeof(UserDBCacheHeader) ||
+            offset > size ||
+            n_buckets > (size - offset) / sizeof(uint64_t))
+                return -EBADMSG;
+
+        l = strlen(key);
+        memcpy(&offset, p + offset + (siphash24(key, l, h->hash_key.bytes) % n_buckets) * sizeof(uint64_t), sizeof(offset));
+        offset = le64toh(offset);
+
+        /* Every entry is at least this large, hence a chain can't be longer than this, unless it loops */
+        for (n = size / sizeof(UserDBCacheEntry);; n--) {
+                const UserDBCacheEntry *e;
+
+                if (offset == 0 || n == 0)
+                        return -ESRCH;
+
+                if (offset < sizeof(UserDBCacheHeader) || offset > size - sizeof(UserDBCacheEntry))
+                        return -EBADMSG;
+
+                e = (const UserDBCacheEntry*) (p + offset);
+                if (le64toh(e->key_size) > size - offset - sizeof(UserDBCacheEntry))
+                        return -EBADMSG;
+
+                if (le64toh(e->key_size) == l && memcmp(e->key, key, l) == 0) {
+                        offset = le64toh(e->record_offset);
+                        break;
+                }
+
+                offset = le64toh(e->next);
+        }
+
+        if (offset < sizeof(UserDBCacheHeader) || offset > size - sizeof(UserDBCacheRecord))
+                return -EBADMSG;
+
+        record = (const UserDBCacheRecord*) (p + offset);
+        n = le64toh(record->json_size);
+        if (n == 0 || n > size - offset - sizeof(UserDBCacheRecord) || record->json[n - 1] != 0)
+                return -EBADMSG;
+
+        r = json_parse(record->json, 0, ret, NULL, NULL);
+        if (r < 0)
+                return r;
+
+        if (ret_incomplete)
+                *ret_incomplete = FLAGS_SET(le64toh(record->flags), USERDB_CACHE_RECORD_INCOMPLETE);
+
+        return 0;
+}
+
+static int cache_lookup(const char *path, const char *key, JsonVariant **ret, bool *ret_incomplete) {
+        _cleanup_close_ int fd = -1;
+        struct stat st;
+        void *p;
+        int r;
+
+        assert(path);
+        assert(key);
+        assert(ret);
+
+        fd = open(path, O_RDONLY|O_CLOEXEC|O_NOCTTY);
+        if (fd < 0)
+                return errno == ENOENT ? -ESRCH : -errno;
+
+        if (fstat(fd, &st) < 0)
+                return -errno;
+
+        /* Only trust what systemd-userdbd (or we ourselves) wrote */
+        if (!S_ISREG(st.st_mode) || (st.st_uid != 0 && st.st_uid != geteuid()) || (st.st_mode & 0022) != 0)
+                return -EPERM;
+
+        if (st.st_size < (off_t) sizeof(UserDBCacheHeader) || st.st_size > USERDB_CACHE_SIZE_MAX)
+                return -EBADMSG;
+
+        /* The file is replaced atomically, never modified in place, hence the mapping stays consistent */
+        p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED)
+                return -errno;
+
+        r = cache_find(p, st.st_size, key, ret, ret_incomplete);
+        (void) munmap(p, st.st_size);
+
+        return r;
+}
+
+static int cache_user(const char *path, const char *key, UserRecord **ret) {
+        _cleanup_(json_variant_unrefp) JsonVariant *v = NULL;
+        _cleanup_(user_record_unrefp) UserRecord *hr = NULL;
+        bool incomplete;
+        int r;
+
+        r = cache_lookup(path, key, &v, &incomplete);
+        if (r < 0)
+                return r;
+
+        hr = user_record_new();
+        if (!hr)
+                return -ENOMEM;
+
+        r = user_record_load(hr, v, USER_RECORD_LOAD_REFUSE_SECRET|USER_RECORD_PERMISSIVE);
+        if (r < 0)
+                return r;
+
+        if (!hr->service)
+                return -EBADMSG;
+
+        hr->incomplete = incomplete;
+
+        if (ret)
+                *ret = TAKE_PTR(hr);
+        return 0;
+}
+
+int userdb_cache_user_by_name(const char *path, const char *name, UserRecord **ret) {
+        _cleanup_(user_record_unrefp) UserRecord *hr = NULL;
+        int r;
+
+        assert(name);
+
+        r = cache_user(path, strjoina("user:", name), &hr);
+        if (r < 0)
+                return r;
+
+        if (!streq_ptr(hr->user_name, name))
+                return -EBADMSG;
+
+        if (ret)
+                *ret = TAKE_PTR(hr);
+        return 0;
+}
+
+int userdb_cache_user_by_uid(const char *path, uid_t uid, UserRecord **ret) {
+        char key[STRLEN("uid:") + DECIMAL_STR_MAX(uid_t)];
+        _cleanup_(user_record_unrefp) UserRecord *hr = NULL;
+        int r;
+
+        xsprintf(key, "uid:" UID_FMT, uid);
+
+        r = cache_user(path, key, &hr);
+        if (r < 0)
+                return r;
+
+        if (hr->uid != uid)
+                return -EBADMSG;
+
+        if (ret)
+                *ret = TAKE_PTR(hr);
+        return 0;
+}
+
+static int cache_group(const char *path, const char *key, GroupRecord **ret) {
+        _cleanup_(json_variant_unrefp) JsonVariant *v = NULL;
+        _cleanup_(group_record_unrefp) GroupRecord *g = NULL;
+        bool incomplete;
+        int r;
+
+        r = cache_lookup(path, key, &v, &incomplete);
+        if (r < 0)
+                return r;
+
+        g = group_record_new();
+        if (!g)
+                return -ENOMEM;
+
+        r = group_record_load(g, v, USER_RECORD_LOAD_REFUSE_SECRET|USER_RECORD_PERMISSIVE);
+        if (r < 0)
+                return r;
+
+        if (!g->service)
+                return -EBADMSG;
+
+        g->incomplete = incomplete;
+
+        if (ret)
+                *ret = TAKE_PTR(g);
+        return 0;
+}
+
+int userdb_cache_group_by_name(const char *path, const char *name, GroupRecord **ret) {
+        _cleanup_(group_record_unrefp) GroupRecord *g = NULL;
+        int r;
+
+        assert(name);
+
+        r = cache_group(path, strjoina("group:", name), &g);
+        if (r < 0)
+                return r;
+
+        if (!streq_ptr(g->group_name, name))
+                return -EBADMSG;
+
+        if (ret)
+                *ret = TAKE_PTR(g);
+        return 0;
+}
+
+int userdb_cache_group_by_gid(const char *path, gid_t gid, GroupRecord **ret) {
+        char key[STRLEN("gid:") + DECIMAL_STR_MAX(gid_t)];
+        _cleanup_(group_record_unrefp) GroupRecord *g = NULL;
+        int r;
+
+        xsprintf(key, "gid:" GID_FMT, gid);
+
+        r = cache_group(path, key, &g);
+        if (r < 0)
+                return r;
+
+        if (g->gid != gid)
+                return -EBADMSG;
+
+        if (ret)
+                *ret = TAKE_PTR(g);
+        return 0;
+}
+
+int userdb_cache_members_by_group(const char *path, const char *name, char ***ret) {
+        _cleanup_(json_variant_unrefp) JsonVariant *v = NULL;
+        int r;
+
+        assert(name);
+        assert(ret);
+
+        r = cache_lookup(path, strjoina("members:", name), &v, NULL);
+        if (r < 0)
+                return r;
+
+        return json_variant_strv(v, ret);
+}
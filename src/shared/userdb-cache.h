@@ -0,0 +1,31 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+#include "group-record.h"
+#include "time-util.h"
+#include "user-record.h"
+
+/* A read-only snapshot of the user/group records and memberships the userdb services provide, written
+ * periodically by systemd-userdbd, so that NSS lookups can be answered without any IPC. The snapshot is
+ * replaced atomically, and is ignored by readers once it expired. */
+
+#define USERDB_CACHE_PATH "/run/systemd/userdb-cache"
+
+typedef struct UserDBCacheBuilder UserDBCacheBuilder;
+
+int userdb_cache_builder_new(UserDBCacheBuilder **ret);
+UserDBCacheBuilder* userdb_cache_builder_free(UserDBCacheBuilder *b);
+DEFINE_TRIVIAL_CLEANUP_FUNC(UserDBCacheBuilder*, userdb_cache_builder_free);
+
+int userdb_cache_builder_add_user(UserDBCacheBuilder *b, UserRecord *ur);
+int userdb_cache_builder_add_group(UserDBCacheBuilder *b, GroupRecord *gr);
+int userdb_cache_builder_add_membership(UserDBCacheBuilder *b, const char *user, const char *group);
+int userdb_cache_builder_write(UserDBCacheBuilder *b, const char *path, usec_t until);
+
+int userdb_cache_generate(const char *path, usec_t until);
+
+int userdb_cache_user_by_name(const char *path, const char *name, UserRecord **ret);
+int userdb_cache_user_by_uid(const char *path, uid_t uid, UserRecord **ret);
+int userdb_cache_group_by_name(const char *path, const char *name, GroupRecord **ret);
+int userdb_cache_group_by_gid(const char *path, gid_t gid, GroupRecord **ret);
+int userdb_cache_members_by_group(const char *path, const char *name, char ***ret);
@@ -13,10 +13,12 @@
 #include "strv.h"
 #include "user-record-nss.h"
 #include "user-util.h"
+#include "userdb-cache.h"
 #include "userdb.h"
 #include "varlink.h"
 
 DEFINE_PRIVATE_HASH_OPS_WITH_VALUE_DESTRUCTOR(link_hash_ops, void, trivial_hash_func, trivial_compare_func, Varlink, varlink_unref);
+DEFINE_PRIVATE_HASH_OPS_WITH_VALUE_DESTRUCTOR(idle_link_hash_ops, void, trivial_hash_func, trivial_compare_func, Varlink, varlink_release_pooled);
 
 typedef enum LookupWhat {
         LOOKUP_USER,
@@ -28,6 +30,7 @@ typedef enum LookupWhat {
 struct UserDBIterator {
         LookupWhat what;
         Set *links;
+        Set *idle_links;                          /* connections that got their final reply, returned to the pool when we are done */
         bool nss_covered:1;
         bool nss_iterating:1;
         bool synthesize_root:1;
@@ -50,6 +53,7 @@ UserDBIterator* userdb_iterator_free(UserDBIterator *iterator) {
                 return NULL;
 
         set_free(iterator->links);
+        set_free(iterator->idle_links);
 
         switch (iterator->what) {
 
@@ -312,7 +316,13 @@ finish:
                 iterator->error = -r;
 
         assert_se(set_remove(iterator->links, link) == link);
-        link = varlink_unref(link);
+
+        /* We are called from within the reply dispatching, hence the connection isn't idle yet. Keep it
+         * around until the iterator is freed, so that it can be reused by the next lookup then. */
+        if (set_ensure_allocated(&iterator->idle_links, &idle_link_hash_ops) < 0 ||
+            set_put(iterator->idle_links, link) < 0)
+                link = varlink_unref(link);
+
         return 0;
 }
 
@@ -321,7 +331,8 @@ static int userdb_connect(
                 const char *path,
                 const char *method,
                 bool more,
-                JsonVariant *query) {
+                JsonVariant *query,
+                UserDBFlags flags) {
 
         _cleanup_(varlink_unrefp) Varlink *vl = NULL;
         int r;
@@ -330,7 +341,19 @@ static int userdb_connect(
         assert(path);
         assert(method);
 
-        r = varlink_connect_address(&vl, path);
+        /* Pooled connections stay open after the lookup, which is only appropriate in our own long-running
+         * daemons, which ask for this explicitly. Everybody else, in particular NSS modules loaded into
+         * arbitrary processes, shall not keep fds open behind the back of the program. The multiplexer and
+         * NSS services are implemented by worker processes of systemd-userdbd that serve one connection at a
+         * time, hence don't keep idle connections to them around either, to not tie up a worker for
+         * nothing. */
+        if (FLAGS_SET(flags, USERDB_POOL_CONNECTIONS) &&
+            !STR_IN_SET(path,
+                        "/run/systemd/userdb/io.systemd.Multiplexer",
+                        "/run/systemd/userdb/io.systemd.NameServiceSwitch"))
+                r = varlink_connect_pooled(&vl, path);
+        else
+                r = varlink_connect_address(&vl, path);
         if (r < 0)
                 return log_debug_errno(r, "Unable to connect to %s: %m", path);
 
@@ -416,7 +439,7 @@ static int userdb_start_query(
                 if (r < 0)
                         return log_debug_errno(r, "Unable to set service JSON field: %m");
 
-                r = userdb_connect(iterator, "/run/systemd/userdb/io.systemd.Multiplexer", method, more, patched_query);
+                r = userdb_connect(iterator, "/run/systemd/userdb/io.systemd.Multiplexer", method, more, patched_query, flags);
                 if (r >= 0) {
                         iterator->nss_covered = true; /* The multiplexer does NSS */
                         return 0;
@@ -466,7 +489,7 @@ static int userdb_start_query(
                 if (r < 0)
                         return log_debug_errno(r, "Unable to set service JSON field: %m");
 
-                r = userdb_connect(iterator, p, method, more, patched_query);
+                r = userdb_connect(iterator, p, method, more, patched_query, flags);
                 if (is_nss && r >= 0) /* Turn off fallback NSS if we found the NSS service and could connect
                                        * to it */
                         iterator->nss_covered = true;
@@ -561,6 +584,25 @@ static int userdb_process(
         }
 }
 
+static bool userdb_cache_usable(UserDBFlags flags) {
+        /* The cache contains the answers of all services, don't use it if the caller asked for a subset */
+        return FLAGS_SET(flags, USERDB_USE_CACHE) &&
+                !getenv("SYSTEMD_BYPASS_USERDB") &&
+                !getenv("SYSTEMD_ONLY_USERDB");
+}
+
+static bool userdb_cache_hit(int r) {
+        /* Dynamic users are never cached, hence a hit is valid no matter whether the caller wants them */
+        if (IN_SET(r, -ESRCH, -ESTALE))
+                return false;
+        if (r < 0) {
+                log_debug_errno(r, "Failed to look up record in cache, ignoring: %m");
+                return false;
+        }
+
+        return true;
+}
+
 static int synthetic_root_user_build(UserRecord **ret) {
         return user_record_build(
                         ret,
@@ -590,6 +632,17 @@ int userdb_by_name(const char *name, UserDBFlags flags, UserRecord **ret) {
         if (!valid_user_group_name(name, VALID_USER_RELAX))
                 return -EINVAL;
 
+        if (userdb_cache_usable(flags)) {
+                _cleanup_(user_record_unrefp) UserRecord *hr = NULL;
+
+                r = userdb_cache_user_by_name(USERDB_CACHE_PATH, name, &hr);
+                if (userdb_cache_hit(r)) {
+                        if (ret)
+                                *ret = TAKE_PTR(hr);
+                        return 0;
+                }
+        }
+
         r = json_build(&query, JSON_BUILD_OBJECT(
                                        JSON_BUILD_PAIR("userName", JSON_BUILD_STRING(name))));
         if (r < 0)
@@ -639,6 +692,17 @@ int userdb_by_uid(uid_t uid, UserDBFlags flags, UserRecord **ret) {
         if (!uid_is_valid(uid))
                 return -EINVAL;
 
+        if (userdb_cache_usable(flags)) {
+                _cleanup_(user_record_unrefp) UserRecord *hr = NULL;
+
+                r = userdb_cache_user_by_uid(USERDB_CACHE_PATH, uid, &hr);
+                if (userdb_cache_hit(r)) {
+                        if (ret)
+                                *ret = TAKE_PTR(hr);
+                        return 0;
+                }
+        }
+
         r = json_build(&query, JSON_BUILD_OBJECT(
                                        JSON_BUILD_PAIR("uid", JSON_BUILD_UNSIGNED(uid))));
         if (r < 0)
@@ -798,6 +862,17 @@ int groupdb_by_name(const char *name, UserDBFlags flags, GroupRecord **ret) {
         if (!valid_user_group_name(name, VALID_USER_RELAX))
                 return -EINVAL;
 
+        if (userdb_cache_usable(flags)) {
+                _cleanup_(group_record_unrefp) GroupRecord *g = NULL;
+
+                r = userdb_cache_group_by_name(USERDB_CACHE_PATH, name, &g);
+                if (userdb_cache_hit(r)) {
+                        if (ret)
+                                *ret = TAKE_PTR(g);
+                        return 0;
+                }
+        }
+
         r = json_build(&query, JSON_BUILD_OBJECT(
                                        JSON_BUILD_PAIR("groupName", JSON_BUILD_STRING(name))));
         if (r < 0)
@@ -844,6 +919,17 @@ int groupdb_by_gid(gid_t gid, UserDBFlags flags, GroupRecord **ret) {
         if (!gid_is_valid(gid))
                 return -EINVAL;
 
+        if (userdb_cache_usable(flags)) {
+                _cleanup_(group_record_unrefp) GroupRecord *g = NULL;
+
+                r = userdb_cache_group_by_gid(USERDB_CACHE_PATH, gid, &g);
+                if (userdb_cache_hit(r)) {
+                        if (ret)
+                                *ret = TAKE_PTR(g);
+                        return 0;
+                }
+        }
+
         r = json_build(&query, JSON_BUILD_OBJECT(
                                        JSON_BUILD_PAIR("gid", JSON_BUILD_UNSIGNED(gid))));
         if (r < 0)
@@ -1196,6 +1282,14 @@ int membershipdb_by_group_strv(const char *name, UserDBFlags flags, char ***ret)
         assert(name);
         assert(ret);
 
+        if (userdb_cache_usable(flags)) {
+                r = userdb_cache_members_by_group(USERDB_CACHE_PATH, name, &members);
+                if (userdb_cache_hit(r)) {
+                        *ret = TAKE_PTR(members);
+                        return 0;
+                }
+        }
+
         r = membershipdb_by_group(name, flags, &iterator);
         if (r < 0)
                 return r;
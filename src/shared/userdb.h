@@ -20,6 +20,8 @@ typedef enum UserDBFlags {
         USERDB_AVOID_DYNAMIC_USER = 1 << 2,  /* exclude looking up in io.systemd.DynamicUser */
         USERDB_AVOID_MULTIPLEXER  = 1 << 3,  /* exclude looking up via io.systemd.Multiplexer */
         USERDB_DONT_SYNTHESIZE    = 1 << 4,  /* don't synthesize root/nobody */
+        USERDB_USE_CACHE          = 1 << 5,  /* answer from the snapshot systemd-userdbd maintains, if possible */
+        USERDB_POOL_CONNECTIONS   = 1 << 6,  /* keep connections to services open for later lookups, for our own daemons only */
 } UserDBFlags;
 
 int userdb_by_name(const char *name, UserDBFlags flags, UserRecord **ret);
@@ -1,11 +1,14 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
+#include <pthread.h>
+#include <sys/eventfd.h>
 #include <sys/poll.h>
 
 #include "alloc-util.h"
 #include "errno-util.h"
 #include "fd-util.h"
 #include "hashmap.h"
+#include "io-util.h"
 #include "list.h"
 #include "process-util.h"
 #include "set.h"
@@ -25,6 +28,12 @@
 #define VARLINK_BUFFER_MAX (16U*1024U*1024U)
 #define VARLINK_READ_SIZE (64U*1024U)
 
+/* How many idle client connections to keep around for reuse, and for how long */
+#define VARLINK_POOL_MAX 16U
+#define VARLINK_POOL_IDLE_USEC (5U*USEC_PER_SEC)
+
+#define VARLINK_SERVER_THREADS_MAX 4U
+
 typedef enum VarlinkState {
         /* Client side states */
         VARLINK_IDLE_CLIENT,
@@ -75,6 +84,41 @@ typedef enum VarlinkState {
                VARLINK_PENDING_METHOD,                  \
                VARLINK_PENDING_METHOD_MORE)
 
+/* A method call we sent and still await the (final) reply for. Replies are matched up with the calls in the
+ * order the calls were enqueued, as the protocol requires servers to process calls on a connection in
+ * order. */
+typedef struct VarlinkCall {
+        bool more;
+        void *userdata;
+} VarlinkCall;
+
+typedef struct VarlinkServerMethod {
+        VarlinkMethod callback;
+        VarlinkBindFlags flags;
+
+        /* Statistics, logged when the server is freed */
+        uint64_t n_calls;
+        usec_t total_usec;
+        usec_t max_usec;
+} VarlinkServerMethod;
+
+/* A method call dispatched to a worker thread. While it is queued or running the connection is off limits to
+ * the event loop thread. */
+typedef struct VarlinkJob VarlinkJob;
+
+struct VarlinkJob {
+        Varlink *link;
+        const char *method_name; /* points into the message, which is kept around until the job is completed */
+        VarlinkServerMethod *method;
+        JsonVariant *parameters;
+        VarlinkMethodFlags flags;
+        usec_t start_usec;
+        int result;
+        bool done;
+
+        LIST_FIELDS(VarlinkJob, jobs);
+};
+
 struct Varlink {
         unsigned n_ref;
 
@@ -108,6 +152,10 @@ struct Varlink {
                           * at most. */
         unsigned n_pending;
 
+        VarlinkCall *calls; /* valid entries start at calls_index, there are n_pending of them */
+        size_t calls_allocated;
+        size_t calls_index;
+
         int fd;
 
         char *input_buffer; /* valid data starts at input_buffer_index, ends at input_buffer_index+input_buffer_size */
@@ -140,6 +188,10 @@ struct Varlink {
         void *userdata;
         char *description;
 
+        char *pool_address; /* set if acquired via varlink_connect_pooled() */
+
+        VarlinkJob *job; /* set while a method callback is queued on or running in a worker thread */
+
         sd_event *event;
         sd_event_source *io_event_source;
         sd_event_source *time_event_source;
@@ -181,6 +233,20 @@ struct VarlinkServer {
 
         unsigned connections_max;
         unsigned connections_per_uid_max;
+
+        /* Worker threads for methods bound with VARLINK_BIND_THREADED, started on demand. The job lists are
+         * protected by the mutex, the threads signal the eventfd after completing a job. */
+        pthread_t threads[VARLINK_SERVER_THREADS_MAX];
+        size_t n_threads;
+        pthread_mutex_t mutex;
+        pthread_cond_t work_cond;
+        pthread_cond_t done_cond;
+        LIST_HEAD(VarlinkJob, queued_jobs);
+        LIST_HEAD(VarlinkJob, done_jobs);
+        unsigned n_jobs;
+        bool threads_exit;
+        int thread_fd;
+        sd_event_source *thread_event_source;
 };
 
 static const char* const varlink_state_table[_VARLINK_STATE_MAX] = {
@@ -313,6 +379,111 @@ int varlink_connect_address(Varlink **ret, const char *address) {
         return r;
 }
 
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static Hashmap *pool = NULL;
+static pid_t pool_pid = 0;
+
+DEFINE_PRIVATE_HASH_OPS_WITH_VALUE_DESTRUCTOR(pool_hash_ops, char, string_hash_func, string_compare_func, Varlink, varlink_unref);
+
+static void pool_check_pid(void) {
+        /* If we forked since the connections were pooled, they are shared with the parent, and we must not
+         * use them anymore. */
+        if (pool_pid == getpid_cached())
+                return;
+
+        pool = hashmap_free(pool);
+        pool_pid = getpid_cached();
+}
+
+int varlink_connect_pooled(Varlink **ret, const char *address) {
+        _cleanup_(varlink_unrefp) Varlink *v = NULL;
+        int r;
+
+        assert_return(ret, -EINVAL);
+        assert_return(address, -EINVAL);
+
+        /* Like varlink_connect_address(), but reuses an idle connection to the same address that was
+         * previously returned with varlink_release_pooled(), if there is one. This is useful for clients
+         * that issue a lot of short calls to the same service, as it saves the connection setup for each of
+         * them. */
+
+        assert_se(pthread_mutex_lock(&pool_mutex) == 0);
+        pool_check_pid();
+        v = hashmap_remove(pool, address);
+        assert_se(pthread_mutex_unlock(&pool_mutex) == 0);
+
+        if (v) {
+                /* Make sure the connection didn't go stale while it was pooled: if the peer closed it (or
+                 * sent us something unexpected) the socket is readable, hence don't reuse it then. */
+                if (v->timestamp + VARLINK_POOL_IDLE_USEC < now(CLOCK_MONOTONIC))
+                        log_debug("Pooled connection to %s has been idle for too long, not reusing.", address);
+                else if (fd_wait_for_event(v->fd, POLLIN, 0) != 0)
+                        log_debug("Pooled connection to %s has been closed by the peer, not reusing.", address);
+                else {
+                        *ret = TAKE_PTR(v);
+                        return 0;
+                }
+
+                v = varlink_unref(v);
+        }
+
+        r = varlink_connect_address(&v, address);
+        if (r < 0)
+                return r;
+
+        v->pool_address = strdup(address);
+        if (!v->pool_address)
+                return -ENOMEM;
+
+        *ret = TAKE_PTR(v);
+        return 0;
+}
+
+Varlink* varlink_release_pooled(Varlink *v) {
+        int r;
+
+        if (!v)
+                return NULL;
+
+        /* Returns a connection acquired with varlink_connect_pooled() to the pool, so that it may be reused
+         * later on. This is only done if nobody else holds a reference to it, and it is idle and fully
+         * flushed. Otherwise it's simply unreffed. Note that only a single connection is pooled per
+         * address. */
+
+        if (!v->pool_address ||
+            v->n_ref > 1 ||
+            v->state != VARLINK_IDLE_CLIENT ||
+            v->connecting ||
+            v->input_buffer_size > 0 ||
+            v->output_buffer_size > 0 ||
+            v->read_disconnected ||
+            v->write_disconnected ||
+            v->got_pollhup)
+                return varlink_unref(v);
+
+        varlink_detach_event(v);
+        v->reply_callback = NULL;
+        v->userdata = NULL;
+        v->timeout = VARLINK_DEFAULT_TIMEOUT_USEC;
+        v->reply = json_variant_unref(v->reply);
+        v->timestamp = now(CLOCK_MONOTONIC);
+
+        assert_se(pthread_mutex_lock(&pool_mutex) == 0);
+        pool_check_pid();
+        if (hashmap_size(pool) >= VARLINK_POOL_MAX)
+                r = -ENOBUFS;
+        else {
+                r = hashmap_ensure_allocated(&pool, &pool_hash_ops);
+                if (r >= 0)
+                        r = hashmap_put(pool, v->pool_address, v);
+        }
+        assert_se(pthread_mutex_unlock(&pool_mutex) == 0);
+        if (r < 0)
+                return varlink_unref(v);
+
+        return NULL;
+}
+
 int varlink_connect_fd(Varlink **ret, int fd) {
         Varlink *v;
         int r;
@@ -364,6 +535,10 @@ static void varlink_clear(Varlink *v) {
         v->current = json_variant_unref(v->current);
         v->reply = json_variant_unref(v->reply);
 
+        v->calls = mfree(v->calls);
+        v->calls_allocated = v->calls_index = 0;
+        v->n_pending = 0;
+
         v->event = sd_event_unref(v->event);
 }
 
@@ -378,6 +553,7 @@ static Varlink* varlink_destroy(Varlink *v) {
         varlink_clear(v);
 
         free(v->description);
+        free(v->pool_address);
         return mfree(v);
 }
 
@@ -627,6 +803,70 @@ static int varlink_dispatch_local_error(Varlink *v, const char *error) {
         return 1;
 }
 
+static VarlinkCall* varlink_current_call(Varlink *v) {
+        assert(v);
+
+        if (v->n_pending == 0)
+                return NULL;
+
+        return v->calls + v->calls_index;
+}
+
+static int varlink_reserve_call(Varlink *v) {
+        assert(v);
+
+        /* Makes sure there's room for one more entry in the call queue, so that varlink_push_call() can't
+         * fail anymore once we enqueued the message. */
+
+        if (v->calls_index > 0 && v->calls_index >= v->n_pending) {
+                /* Move the queue back to the front, if that's cheap */
+                memmove(v->calls, v->calls + v->calls_index, v->n_pending * sizeof(VarlinkCall));
+                v->calls_index = 0;
+        }
+
+        if (!GREEDY_REALLOC(v->calls, v->calls_allocated, v->calls_index + v->n_pending + 1))
+                return -ENOMEM;
+
+        return 0;
+}
+
+static void varlink_push_call(Varlink *v, bool more, void *userdata) {
+        assert(v);
+        assert(v->calls_index + v->n_pending < v->calls_allocated);
+
+        v->calls[v->calls_index + v->n_pending++] = (VarlinkCall) {
+                .more = more,
+                .userdata = userdata,
+        };
+}
+
+static void varlink_pop_call(Varlink *v) {
+        assert(v);
+        assert(v->n_pending > 0);
+
+        v->n_pending--;
+
+        if (v->n_pending == 0)
+                v->calls_index = 0;
+        else
+                v->calls_index++;
+}
+
+static VarlinkState varlink_client_state(Varlink *v) {
+        VarlinkCall *c;
+
+        assert(v);
+
+        /* Determines the client state from the call at the head of the queue, i.e. the one the next reply
+         * is for */
+
+        c = varlink_current_call(v);
+        if (!c)
+                return VARLINK_IDLE_CLIENT;
+
+        return c->more ? VARLINK_AWAITING_REPLY_MORE : VARLINK_AWAITING_REPLY;
+}
+
 static int varlink_dispatch_timeout(Varlink *v) {
         assert(v);
 
@@ -718,7 +958,7 @@ static int varlink_dispatch_reply(Varlink *v) {
         }
 
         /* Replies with 'continue' set are only OK if we set 'more' when the method call was initiated */
-        if (v->state != VARLINK_AWAITING_REPLY_MORE && FLAGS_SET(flags, VARLINK_REPLY_CONTINUES))
+        if (!varlink_current_call(v)->more && FLAGS_SET(flags, VARLINK_REPLY_CONTINUES))
                 goto invalid;
 
         /* An error is final */
@@ -742,14 +982,10 @@ static int varlink_dispatch_reply(Varlink *v) {
 
                 if (v->state == VARLINK_PROCESSING_REPLY) {
 
-                        assert(v->n_pending > 0);
-
                         if (!FLAGS_SET(flags, VARLINK_REPLY_CONTINUES))
-                                v->n_pending--;
+                                varlink_pop_call(v);
 
-                        varlink_set_state(v,
-                                          FLAGS_SET(flags, VARLINK_REPLY_CONTINUES) ? VARLINK_AWAITING_REPLY_MORE :
-                                          v->n_pending == 0 ? VARLINK_IDLE_CLIENT : VARLINK_AWAITING_REPLY);
+                        varlink_set_state(v, varlink_client_state(v));
                 }
         } else {
                 assert(v->state == VARLINK_CALLING);
@@ -766,12 +1002,302 @@ invalid:
         return 1;
 }
 
+static int varlink_invoke_method(Varlink *v, const char *method, VarlinkServerMethod *m, JsonVariant *parameters, VarlinkMethodFlags flags) {
+        int r;
+
+        assert(v);
+        assert(m);
+
+        /* Note that this is invoked from worker threads too, hence must only touch the connection itself */
+
+        r = m->callback(v, parameters, flags, v->userdata);
+        if (r < 0) {
+                log_debug_errno(r, "Callback for %s returned error: %m", method);
+
+                /* We got an error back from the callback. Propagate it to the client if the method call remains unanswered. */
+                if (!FLAGS_SET(flags, VARLINK_METHOD_ONEWAY)) {
+                        r = varlink_errorb(v, VARLINK_ERROR_SYSTEM, JSON_BUILD_OBJECT(JSON_BUILD_PAIR("errno", JSON_BUILD_INTEGER(-r))));
+                        if (r < 0)
+                                return r;
+                }
+        }
+
+        return 0;
+}
+
+static void varlink_server_method_account(VarlinkServerMethod *m, usec_t start_usec) {
+        usec_t d;
+
+        assert(m);
+
+        d = usec_sub_unsigned(now(CLOCK_MONOTONIC), start_usec);
+
+        m->n_calls++;
+        m->total_usec = usec_add(m->total_usec, d);
+        m->max_usec = MAX(m->max_usec, d);
+}
+
+static void varlink_finish_method(Varlink *v) {
+        assert(v);
+
+        switch (v->state) {
+
+        case VARLINK_PROCESSED_METHOD: /* Method call is fully processed */
+        case VARLINK_PROCESSING_METHOD_ONEWAY: /* ditto */
+                v->current = json_variant_unref(v->current);
+                varlink_set_state(v, VARLINK_IDLE_SERVER);
+                break;
+
+        case VARLINK_PROCESSING_METHOD: /* Method call wasn't replied to, will be replied to later */
+                varlink_set_state(v, VARLINK_PENDING_METHOD);
+                break;
+
+        case VARLINK_PROCESSING_METHOD_MORE: /* No reply for a "more" message was sent, more to come */
+                varlink_set_state(v, VARLINK_PENDING_METHOD_MORE);
+                break;
+
+        default:
+                assert_not_reached("Unexpected state");
+
+        }
+}
+
+static void varlink_set_sources_enabled(Varlink *v, int enabled) {
+        assert(v);
+
+        /* Note that the time event source is enabled/disabled as needed by prepare_callback(), hence we only
+         * turn it off here, but leave it to that to turn it on again. */
+
+        if (v->io_event_source)
+                (void) sd_event_source_set_enabled(v->io_event_source, enabled);
+        if (v->defer_event_source)
+                (void) sd_event_source_set_enabled(v->defer_event_source, enabled);
+        if (v->time_event_source && enabled == SD_EVENT_OFF)
+                (void) sd_event_source_set_enabled(v->time_event_source, SD_EVENT_OFF);
+}
+
+static VarlinkJob* varlink_job_free(VarlinkJob *j) {
+        if (!j)
+                return NULL;
+
+        json_variant_unref(j->parameters);
+        varlink_unref(j->link);
+
+        return mfree(j);
+}
+
+static void varlink_job_complete(VarlinkServer *s, VarlinkJob *j) {
+        Varlink *v;
+
+        assert(s);
+        assert(j);
+        assert(j->done);
+
+        /* Called in the event loop thread once a worker thread is done with a job: hands the connection back
+         * to the event loop. */
+
+        v = j->link;
+        assert(v->job == j);
+        v->job = NULL;
+
+        assert(s->n_jobs > 0);
+        s->n_jobs--;
+
+        varlink_server_method_account(j->method, j->start_usec);
+
+        if (j->result < 0) {
+                log_debug_errno(j->result, "Failed to process method call on worker thread, disconnecting: %m");
+                if (VARLINK_STATE_IS_ALIVE(v->state))
+                        varlink_set_state(v, VARLINK_PENDING_DISCONNECT);
+        } else
+                varlink_finish_method(v);
+
+        varlink_set_sources_enabled(v, SD_EVENT_ON);
+
+        varlink_job_free(j);
+}
+
+static void varlink_wait_job(Varlink *v) {
+        VarlinkServer *s;
+        VarlinkJob *j;
+
+        assert(v);
+
+        /* If a method callback is queued on or running in a worker thread, waits until it is done, and
+         * hands the connection back to the event loop thread. */
+
+        j = v->job;
+        if (!j)
+                return;
+
+        s = v->server;
+        assert(s);
+
+        assert_se(pthread_mutex_lock(&s->mutex) == 0);
+        while (!j->done)
+                assert_se(pthread_cond_wait(&s->done_cond, &s->mutex) == 0);
+        LIST_REMOVE(jobs, s->done_jobs, j);
+        assert_se(pthread_mutex_unlock(&s->mutex) == 0);
+
+        varlink_job_complete(s, j);
+}
+
+static void *varlink_server_thread(void *userdata) {
+        VarlinkServer *s = userdata;
+
+        (void) pthread_setname_np(pthread_self(), "varlink-worker");
+
+        assert_se(pthread_mutex_lock(&s->mutex) == 0);
+
+        for (;;) {
+                VarlinkJob *j;
+
+                while (!s->queued_jobs && !s->threads_exit)
+                        assert_se(pthread_cond_wait(&s->work_cond, &s->mutex) == 0);
+
+                j = s->queued_jobs;
+                if (!j)
+                        break;
+
+                LIST_REMOVE(jobs, s->queued_jobs, j);
+                assert_se(pthread_mutex_unlock(&s->mutex) == 0);
+
+                j->result = varlink_invoke_method(j->link, j->method_name, j->method, j->parameters, j->flags);
+
+                assert_se(pthread_mutex_lock(&s->mutex) == 0);
+                j->done = true;
+                LIST_PREPEND(jobs, s->done_jobs, j);
+                assert_se(pthread_cond_broadcast(&s->done_cond) == 0);
+
+                (void) eventfd_write(s->thread_fd, 1);
+        }
+
+        assert_se(pthread_mutex_unlock(&s->mutex) == 0);
+
+        return NULL;
+}
+
+static int thread_callback(sd_event_source *es, int fd, uint32_t revents, void *userdata) {
+        _cleanup_(varlink_server_unrefp) VarlinkServer *s = varlink_server_ref(userdata);
+        LIST_HEAD(VarlinkJob, done);
+        eventfd_t x;
+
+        (void) eventfd_read(fd, &x);
+
+        assert_se(pthread_mutex_lock(&s->mutex) == 0);
+        done = TAKE_PTR(s->done_jobs);
+        assert_se(pthread_mutex_unlock(&s->mutex) == 0);
+
+        while (done) {
+                VarlinkJob *j = done;
+
+                LIST_REMOVE(jobs, done, j);
+                varlink_job_complete(s, j);
+        }
+
+        return 0;
+}
+
+static int varlink_server_start_thread(VarlinkServer *s) {
+        sigset_t ss, saved_ss;
+        int r, k;
+
+        assert(s);
+        assert(s->event);
+
+        if (s->n_threads >= MIN(s->n_jobs + 1, VARLINK_SERVER_THREADS_MAX))
+                return 0;
+
+        if (s->thread_fd < 0) {
+                s->thread_fd = eventfd(0, EFD_CLOEXEC|EFD_NONBLOCK);
+                if (s->thread_fd < 0)
+                        return -errno;
+        }
+
+        if (!s->thread_event_source) {
+                r = sd_event_add_io(s->event, &s->thread_event_source, s->thread_fd, EPOLLIN, thread_callback, s);
+                if (r < 0)
+                        return r;
+
+                r = sd_event_source_set_priority(s->thread_event_source, s->event_priority);
+                if (r < 0)
+                        return r;
+
+                (void) sd_event_source_set_description(s->thread_event_source, "varlink-server-thread");
+        }
+
+        assert_se(sigfillset(&ss) >= 0);
+
+        r = pthread_sigmask(SIG_BLOCK, &ss, &saved_ss);
+        if (r > 0)
+                return -r;
+
+        r = pthread_create(s->threads + s->n_threads, NULL, varlink_server_thread, s);
+
+        k = pthread_sigmask(SIG_SETMASK, &saved_ss, NULL);
+        if (r > 0)
+                return -r;
+
+        s->n_threads++;
+
+        if (k > 0)
+                return -k;
+
+        return 1;
+}
+
+static int varlink_queue_job(Varlink *v, const char *method, VarlinkServerMethod *m, JsonVariant *parameters, VarlinkMethodFlags flags) {
+        VarlinkServer *s;
+        VarlinkJob *j;
+        int r;
+
+        assert(v);
+        assert(m);
+        assert(!v->job);
+
+        s = v->server;
+        assert(s);
+
+        r = varlink_server_start_thread(s);
+        if (r < 0) {
+                if (s->n_threads == 0)
+                        return r;
+
+                log_debug_errno(r, "Failed to start additional worker thread, ignoring: %m");
+        }
+
+        j = new(VarlinkJob, 1);
+        if (!j)
+                return -ENOMEM;
+
+        *j = (VarlinkJob) {
+                .link = varlink_ref(v),
+                .method_name = method,
+                .method = m,
+                .parameters = json_variant_ref(parameters),
+                .flags = flags,
+                .start_usec = now(CLOCK_MONOTONIC),
+        };
+
+        /* From now on the connection belongs to the worker thread, until it hands it back */
+        varlink_set_sources_enabled(v, SD_EVENT_OFF);
+        v->job = j;
+        s->n_jobs++;
+
+        assert_se(pthread_mutex_lock(&s->mutex) == 0);
+        LIST_APPEND(jobs, s->queued_jobs, j);
+        assert_se(pthread_cond_signal(&s->work_cond) == 0);
+        assert_se(pthread_mutex_unlock(&s->mutex) == 0);
+
+        return 0;
+}
+
 static int varlink_dispatch_method(Varlink *v) {
         _cleanup_(json_variant_unrefp) JsonVariant *parameters = NULL;
         VarlinkMethodFlags flags = 0;
         const char *method = NULL, *error;
+        VarlinkServerMethod *m;
         JsonVariant *e;
-        VarlinkMethod callback;
         const char *k;
         int r;
 
@@ -844,28 +1370,32 @@ static int varlink_dispatch_method(Varlink *v) {
 
         if (STR_IN_SET(method, "org.varlink.service.GetInfo", "org.varlink.service.GetInterface")) {
                 /* For now, we don't implement a single of varlink's own methods */
-                callback = NULL;
+                m = NULL;
                 error = VARLINK_ERROR_METHOD_NOT_IMPLEMENTED;
         } else if (startswith(method, "org.varlink.service.")) {
-                callback = NULL;
+                m = NULL;
                 error = VARLINK_ERROR_METHOD_NOT_FOUND;
         } else {
-                callback = hashmap_get(v->server->methods, method);
+                m = hashmap_get(v->server->methods, method);
                 error = VARLINK_ERROR_METHOD_NOT_FOUND;
         }
 
-        if (callback) {
-                r = callback(v, parameters, flags, v->userdata);
-                if (r < 0) {
-                        log_debug_errno(r, "Callback for %s returned error: %m", method);
-
-                        /* We got an error back from the callback. Propagate it to the client if the method call remains unanswered. */
-                        if (!FLAGS_SET(flags, VARLINK_METHOD_ONEWAY)) {
-                                r = varlink_errorb(v, VARLINK_ERROR_SYSTEM, JSON_BUILD_OBJECT(JSON_BUILD_PAIR("errno", JSON_BUILD_INTEGER(-r))));
-                                if (r < 0)
-                                        return r;
-                        }
-                }
+        if (m && FLAGS_SET(m->flags, VARLINK_BIND_THREADED) && v->event && v->server->event) {
+                r = varlink_queue_job(v, method, m, parameters, flags);
+                if (r >= 0)
+                        return 1; /* The rest is done once the worker thread is done */
+
+                log_debug_errno(r, "Failed to dispatch %s to worker thread, invoking callback directly: %m", method);
+        }
+
+        if (m) {
+                usec_t start_usec;
+
+                start_usec = now(CLOCK_MONOTONIC);
+                r = varlink_invoke_method(v, method, m, parameters, flags);
+                varlink_server_method_account(m, start_usec);
+                if (r < 0)
+                        return r;
         } else if (!FLAGS_SET(flags, VARLINK_METHOD_ONEWAY)) {
                 assert(error);
 
@@ -874,26 +1404,7 @@ static int varlink_dispatch_method(Varlink *v) {
                         return r;
         }
 
-        switch (v->state) {
-
-        case VARLINK_PROCESSED_METHOD: /* Method call is fully processed */
-        case VARLINK_PROCESSING_METHOD_ONEWAY: /* ditto */
-                v->current = json_variant_unref(v->current);
-                varlink_set_state(v, VARLINK_IDLE_SERVER);
-                break;
-
-        case VARLINK_PROCESSING_METHOD: /* Method call wasn't replied to, will be replied to later */
-                varlink_set_state(v, VARLINK_PENDING_METHOD);
-                break;
-
-        case VARLINK_PROCESSING_METHOD_MORE: /* No reply for a "more" message was sent, more to come */
-                varlink_set_state(v, VARLINK_PENDING_METHOD_MORE);
-                break;
-
-        default:
-                assert_not_reached("Unexpected state");
-
-        }
+        varlink_finish_method(v);
 
         return r;
 
@@ -916,6 +1427,10 @@ int varlink_process(Varlink *v) {
         if (v->state == VARLINK_DISCONNECTED)
                 return -ENOTCONN;
 
+        /* While a worker thread processes a method call on this connection we must not touch it */
+        if (v->job)
+                return 0;
+
         varlink_ref(v);
 
         r = varlink_write(v);
@@ -955,7 +1470,7 @@ int varlink_process(Varlink *v) {
                 goto finish;
 
 finish:
-        if (r >= 0 && v->defer_event_source) {
+        if (r >= 0 && v->defer_event_source && !v->job) {
                 int q;
 
                 /* If we did some processing, make sure we are called again soon */
@@ -1118,6 +1633,8 @@ int varlink_flush(Varlink *v) {
         if (v->state == VARLINK_DISCONNECTED)
                 return -ENOTCONN;
 
+        varlink_wait_job(v);
+
         for (;;) {
                 struct pollfd pfd;
 
@@ -1192,11 +1709,14 @@ int varlink_close(Varlink *v) {
         if (v->state == VARLINK_DISCONNECTED)
                 return 0;
 
-        varlink_set_state(v, VARLINK_DISCONNECTED);
-
         /* Let's take a reference first, since varlink_detach_server() might drop the final (dangling) ref
          * which would destroy us before we can call varlink_clear() */
         varlink_ref(v);
+
+        /* A worker thread might still operate on the connection, let's wait for it to finish first */
+        varlink_wait_job(v);
+
+        varlink_set_state(v, VARLINK_DISCONNECTED);
         varlink_detach_server(v);
         varlink_clear(v);
         varlink_unref(v);
@@ -1324,7 +1844,7 @@ int varlink_sendb(Varlink *v, const char *method, ...) {
         return varlink_send(v, method, parameters);
 }
 
-int varlink_invoke(Varlink *v, const char *method, JsonVariant *parameters) {
+int varlink_invoke_full(Varlink *v, const char *method, JsonVariant *parameters, bool more, void *call_userdata) {
         _cleanup_(json_variant_unrefp) JsonVariant *m = NULL;
         int r;
 
@@ -1334,8 +1854,9 @@ int varlink_invoke(Varlink *v, const char *method, JsonVariant *parameters) {
         if (v->state == VARLINK_DISCONNECTED)
                 return -ENOTCONN;
 
-        /* We allow enqueuing multiple method calls at once! */
-        if (!IN_SET(v->state, VARLINK_IDLE_CLIENT, VARLINK_AWAITING_REPLY))
+        /* We allow enqueuing multiple method calls at once, including ones in more/continues mode! The
+         * replies are matched up with the calls in order. */
+        if (!IN_SET(v->state, VARLINK_IDLE_CLIENT, VARLINK_AWAITING_REPLY, VARLINK_AWAITING_REPLY_MORE))
                 return -EBUSY;
 
         r = varlink_sanitize_parameters(&parameters);
@@ -1344,7 +1865,12 @@ int varlink_invoke(Varlink *v, const char *method, JsonVariant *parameters) {
 
         r = json_build(&m, JSON_BUILD_OBJECT(
                                        JSON_BUILD_PAIR("method", JSON_BUILD_STRING(method)),
-                                       JSON_BUILD_PAIR("parameters", JSON_BUILD_VARIANT(parameters))));
+                                       JSON_BUILD_PAIR("parameters", JSON_BUILD_VARIANT(parameters)),
+                                       JSON_BUILD_PAIR_CONDITION(more, "more", JSON_BUILD_BOOLEAN(true))));
+        if (r < 0)
+                return r;
+
+        r = varlink_reserve_call(v);
         if (r < 0)
                 return r;
 
@@ -1352,13 +1878,17 @@ int varlink_invoke(Varlink *v, const char *method, JsonVariant *parameters) {
         if (r < 0)
                 return r;
 
-        varlink_set_state(v, VARLINK_AWAITING_REPLY);
-        v->n_pending++;
+        varlink_push_call(v, more, call_userdata);
+        varlink_set_state(v, varlink_client_state(v));
         v->timestamp = now(CLOCK_MONOTONIC);
 
         return 0;
 }
 
+int varlink_invoke(Varlink *v, const char *method, JsonVariant *parameters) {
+        return varlink_invoke_full(v, method, parameters, false, NULL);
+}
+
 int varlink_invokeb(Varlink *v, const char *method, ...) {
         _cleanup_(json_variant_unrefp) JsonVariant *parameters = NULL;
         va_list ap;
@@ -1377,40 +1907,7 @@ int varlink_invokeb(Varlink *v, const char *method, ...) {
 }
 
 int varlink_observe(Varlink *v, const char *method, JsonVariant *parameters) {
-        _cleanup_(json_variant_unrefp) JsonVariant *m = NULL;
-        int r;
-
-        assert_return(v, -EINVAL);
-        assert_return(method, -EINVAL);
-
-        if (v->state == VARLINK_DISCONNECTED)
-                return -ENOTCONN;
-        /* Note that we don't allow enqueuing multiple method calls when we are in more/continues mode! We
-         * thus insist on an idle client here. */
-        if (v->state != VARLINK_IDLE_CLIENT)
-                return -EBUSY;
-
-        r = varlink_sanitize_parameters(&parameters);
-        if (r < 0)
-                return r;
-
-        r = json_build(&m, JSON_BUILD_OBJECT(
-                                       JSON_BUILD_PAIR("method", JSON_BUILD_STRING(method)),
-                                       JSON_BUILD_PAIR("parameters", JSON_BUILD_VARIANT(parameters)),
-                                       JSON_BUILD_PAIR("more", JSON_BUILD_BOOLEAN(true))));
-        if (r < 0)
-                return r;
-
-        r = varlink_enqueue_json(v, m);
-        if (r < 0)
-                return r;
-
-
-        varlink_set_state(v, VARLINK_AWAITING_REPLY_MORE);
-        v->n_pending++;
-        v->timestamp = now(CLOCK_MONOTONIC);
-
-        return 0;
+        return varlink_invoke_full(v, method, parameters, true, NULL);
 }
 
 int varlink_observeb(Varlink *v, const char *method, ...) {
@@ -1461,12 +1958,16 @@ int varlink_call(
         if (r < 0)
                 return r;
 
+        r = varlink_reserve_call(v);
+        if (r < 0)
+                return r;
+
         r = varlink_enqueue_json(v, m);
         if (r < 0)
                 return r;
 
+        varlink_push_call(v, false, NULL);
         varlink_set_state(v, VARLINK_CALLING);
-        v->n_pending++;
         v->timestamp = now(CLOCK_MONOTONIC);
 
         while (v->state == VARLINK_CALLING) {
@@ -1490,9 +1991,9 @@ int varlink_call(
                 json_variant_unref(v->reply);
                 v->reply = TAKE_PTR(v->current);
 
-                varlink_set_state(v, VARLINK_IDLE_CLIENT);
                 assert(v->n_pending == 1);
-                v->n_pending--;
+                varlink_pop_call(v);
+                varlink_set_state(v, VARLINK_IDLE_CLIENT);
 
                 if (ret_parameters)
                         *ret_parameters = json_variant_by_key(v->reply, "parameters");
@@ -1744,6 +2245,18 @@ void* varlink_get_userdata(Varlink *v) {
         return v->userdata;
 }
 
+void* varlink_get_call_userdata(Varlink *v) {
+        VarlinkCall *c;
+
+        assert_return(v, NULL);
+
+        c = varlink_current_call(v);
+        if (!c)
+                return NULL;
+
+        return c->userdata;
+}
+
 static int varlink_acquire_ucred(Varlink *v) {
         int r;
 
@@ -1988,24 +2501,63 @@ int varlink_server_new(VarlinkServer **ret, VarlinkServerFlags flags) {
                 .flags = flags,
                 .connections_max = varlink_server_connections_max(NULL),
                 .connections_per_uid_max = varlink_server_connections_per_uid_max(NULL),
+                .mutex = PTHREAD_MUTEX_INITIALIZER,
+                .work_cond = PTHREAD_COND_INITIALIZER,
+                .done_cond = PTHREAD_COND_INITIALIZER,
+                .thread_fd = -1,
         };
 
         *ret = s;
         return 0;
 }
 
+static void varlink_server_stop_threads(VarlinkServer *s) {
+        size_t i;
+
+        assert(s);
+
+        /* Jobs keep a reference to their connection, which keeps a reference to us, hence there can't be
+         * any left at this point */
+        assert(s->n_jobs == 0);
+
+        assert_se(pthread_mutex_lock(&s->mutex) == 0);
+        s->threads_exit = true;
+        assert_se(pthread_cond_broadcast(&s->work_cond) == 0);
+        assert_se(pthread_mutex_unlock(&s->mutex) == 0);
+
+        for (i = 0; i < s->n_threads; i++)
+                assert_se(pthread_join(s->threads[i], NULL) == 0);
+        s->n_threads = 0;
+
+        s->thread_event_source = sd_event_source_unref(s->thread_event_source);
+        s->thread_fd = safe_close(s->thread_fd);
+}
+
 static VarlinkServer* varlink_server_destroy(VarlinkServer *s) {
-        char *m;
+        VarlinkServerMethod *m;
+        Iterator i;
+        char *k;
 
         if (!s)
                 return NULL;
 
         varlink_server_shutdown(s);
+        varlink_server_stop_threads(s);
+
+        HASHMAP_FOREACH_KEY(m, k, s->methods, i) {
+                char a[FORMAT_TIMESPAN_MAX], b[FORMAT_TIMESPAN_MAX];
 
-        while ((m = hashmap_steal_first_key(s->methods)))
-                free(m);
+                if (m->n_calls == 0)
+                        continue;
 
-        hashmap_free(s->methods);
+                log_debug("%s: %s: %" PRIu64 " calls, %s average, %s maximum%s",
+                          strna(s->description), k, m->n_calls,
+                          format_timespan(a, sizeof(a), m->total_usec / m->n_calls, 1),
+                          format_timespan(b, sizeof(b), m->max_usec, 1),
+                          FLAGS_SET(m->flags, VARLINK_BIND_THREADED) ? " (threaded)" : "");
+        }
+
+        hashmap_free_free_free(s->methods);
         hashmap_free(s->by_uid);
 
         sd_event_unref(s->event);
@@ -2352,6 +2904,8 @@ int varlink_server_detach_event(VarlinkServer *s) {
                 ss->event_source = sd_event_source_unref(ss->event_source);
         }
 
+        s->thread_event_source = sd_event_source_unref(s->thread_event_source);
+
         sd_event_unref(s->event);
         return 0;
 }
@@ -2362,13 +2916,15 @@ sd_event *varlink_server_get_event(VarlinkServer *s) {
         return s->event;
 }
 
-int varlink_server_bind_method(VarlinkServer *s, const char *method, VarlinkMethod callback) {
-        char *m;
+int varlink_server_bind_method_full(VarlinkServer *s, const char *method, VarlinkMethod callback, VarlinkBindFlags flags) {
+        _cleanup_free_ VarlinkServerMethod *m = NULL;
+        _cleanup_free_ char *k = NULL;
         int r;
 
         assert_return(s, -EINVAL);
         assert_return(method, -EINVAL);
         assert_return(callback, -EINVAL);
+        assert_return((flags & ~_VARLINK_BIND_FLAGS_ALL) == 0, -EINVAL);
 
         if (startswith(method, "org.varlink.service."))
                 return -EEXIST;
@@ -2377,19 +2933,33 @@ int varlink_server_bind_method(VarlinkServer *s, const char *method, VarlinkMeth
         if (r < 0)
                 return r;
 
-        m = strdup(method);
+        k = strdup(method);
+        if (!k)
+                return -ENOMEM;
+
+        m = new(VarlinkServerMethod, 1);
         if (!m)
                 return -ENOMEM;
 
-        r = hashmap_put(s->methods, m, callback);
-        if (r < 0) {
-                free(m);
+        *m = (VarlinkServerMethod) {
+                .callback = callback,
+                .flags = flags,
+        };
+
+        r = hashmap_put(s->methods, k, m);
+        if (r < 0)
                 return r;
-        }
+
+        TAKE_PTR(k);
+        TAKE_PTR(m);
 
         return 0;
 }
 
+int varlink_server_bind_method(VarlinkServer *s, const char *method, VarlinkMethod callback) {
+        return varlink_server_bind_method_full(s, method, callback, 0);
+}
+
 int varlink_server_bind_method_many_internal(VarlinkServer *s, ...) {
         va_list ap;
         int r = 0;
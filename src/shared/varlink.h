@@ -48,6 +48,12 @@ typedef enum VarlinkServerFlags {
         _VARLINK_SERVER_FLAGS_ALL = (1 << 3) - 1,
 } VarlinkServerFlags;
 
+typedef enum VarlinkBindFlags {
+        VARLINK_BIND_THREADED = 1 << 0, /* Invoke the method callback on a worker thread */
+
+        _VARLINK_BIND_FLAGS_ALL = (1 << 1) - 1,
+} VarlinkBindFlags;
+
 typedef int (*VarlinkMethod)(Varlink *link, JsonVariant *parameters, VarlinkMethodFlags flags, void *userdata);
 typedef int (*VarlinkReply)(Varlink *link, JsonVariant *parameters, const char *error_id, VarlinkReplyFlags flags, void *userdata);
 typedef int (*VarlinkConnect)(VarlinkServer *server, Varlink *link, void *userdata);
@@ -56,6 +62,10 @@ typedef void (*VarlinkDisconnect)(VarlinkServer *server, Varlink *link, void *us
 int varlink_connect_address(Varlink **ret, const char *address);
 int varlink_connect_fd(Varlink **ret, int fd);
 
+/* Connect to an address, reusing an idle connection released earlier by the same process, if there is one */
+int varlink_connect_pooled(Varlink **ret, const char *address);
+Varlink* varlink_release_pooled(Varlink *v);
+
 Varlink* varlink_ref(Varlink *link);
 Varlink* varlink_unref(Varlink *v);
 
@@ -92,6 +102,11 @@ int varlink_invokeb(Varlink *v, const char *method, ...);
 int varlink_observe(Varlink *v, const char *method, JsonVariant *parameters);
 int varlink_observeb(Varlink *v, const char *method, ...);
 
+/* Same as the above two, but attaches userdata to the specific call, which may be queried with
+ * varlink_get_call_userdata() while its replies are delivered. Multiple calls may be in flight on the same
+ * connection at the same time, their replies are delivered in the order the calls were enqueued. */
+int varlink_invoke_full(Varlink *v, const char *method, JsonVariant *parameters, bool more, void *call_userdata);
+
 /* Enqueue a final reply */
 int varlink_reply(Varlink *v, JsonVariant *parameters);
 int varlink_replyb(Varlink *v, ...);
@@ -110,6 +125,7 @@ int varlink_bind_reply(Varlink *v, VarlinkReply reply);
 
 void* varlink_set_userdata(Varlink *v, void *userdata);
 void* varlink_get_userdata(Varlink *v);
+void* varlink_get_call_userdata(Varlink *v);
 
 int varlink_get_peer_uid(Varlink *v, uid_t *ret);
 int varlink_get_peer_pid(Varlink *v, pid_t *ret);
@@ -132,6 +148,12 @@ int varlink_server_add_connection(VarlinkServer *s, int fd, Varlink **ret);
 
 /* Bind callbacks */
 int varlink_server_bind_method(VarlinkServer *s, const char *method, VarlinkMethod callback);
+
+/* With VARLINK_BIND_THREADED the callback is invoked on a worker thread rather than the event loop thread, if
+ * the server is attached to an event loop, so that CPU-heavy methods don't hold up all other clients. The
+ * callback has exclusive access to the connection while it runs and may reply on it, but must not close it,
+ * and must not touch any state the event loop thread might access concurrently. */
+int varlink_server_bind_method_full(VarlinkServer *s, const char *method, VarlinkMethod callback, VarlinkBindFlags flags);
 int varlink_server_bind_method_many_internal(VarlinkServer *s, ...);
 #define varlink_server_bind_method_many(s, ...) varlink_server_bind_method_many_internal(s, __VA_ARGS__, NULL)
 int varlink_server_bind_connect(VarlinkServer *s, VarlinkConnect connect);
@@ -159,6 +181,7 @@ int varlink_server_set_description(VarlinkServer *s, const char *description);
 DEFINE_TRIVIAL_CLEANUP_FUNC(Varlink *, varlink_unref);
 DEFINE_TRIVIAL_CLEANUP_FUNC(Varlink *, varlink_close_unref);
 DEFINE_TRIVIAL_CLEANUP_FUNC(Varlink *, varlink_flush_close_unref);
+DEFINE_TRIVIAL_CLEANUP_FUNC(Varlink *, varlink_release_pooled);
 DEFINE_TRIVIAL_CLEANUP_FUNC(VarlinkServer *, varlink_server_unref);
 
 #define VARLINK_ERROR_DISCONNECTED "io.systemd.Disconnected"
@@ -28,13 +28,52 @@
 #include "mountpoint-util.h"
 #include "path-util.h"
 #include "process-util.h"
+#include "set.h"
 #include "signal-util.h"
 #include "string-util.h"
 #include "strv.h"
+#include "time-util.h"
 #include "umount.h"
 #include "util.h"
 #include "virt.h"
 
+/* Upper limit on the number of unmount processes we run at the same time */
+#define UMOUNT_PARALLEL_MAX 64U
+
+/* Exit status of the unmount process if the file system had to be detached lazily */
+#define UMOUNT_CHILD_DETACHED 2
+
+typedef struct UmountStats {
+        usec_t begin;
+        unsigned n_parallel;
+        unsigned n_serial;
+        unsigned n_detached;
+        usec_t slowest_usec;
+        char *slowest_path;
+} UmountStats;
+
+static void umount_stats_done(UmountStats *stats) {
+        assert(stats);
+
+        stats->slowest_path = mfree(stats->slowest_path);
+}
+
+static void umount_stats_note(UmountStats *stats, const char *path, usec_t begin) {
+        usec_t t;
+
+        assert(stats);
+        assert(path);
+
+        t = usec_sub_unsigned(now(CLOCK_MONOTONIC), begin);
+        if (t <= stats->slowest_usec)
+                return;
+
+        if (free_and_strdup(&stats->slowest_path, path) < 0)
+                return;
+
+        stats->slowest_usec = t;
+}
+
 static void mount_point_free(MountPoint **head, MountPoint *m) {
         assert(head);
         assert(m);
@@ -502,16 +541,226 @@ static int umount_with_timeout(MountPoint *m, int umount_log_level) {
         return r;
 }
 
+static int umount_leaf_child(MountPoint *m, int umount_log_level) {
+        int r;
+
+        assert(m);
+
+        /* Runs in the child process forked for each leaf mount point, see umount_leaves(). Does what
+         * mount_points_list_umount() does for one mount point, but in one process. */
+
+        if (m->try_remount_ro) {
+                log_info("Remounting '%s' read-only in with options '%s'.", m->path, m->remount_options);
+
+                if (mount(NULL, m->path, NULL, m->remount_flags, m->remount_options) < 0)
+                        log_full_errno(umount_log_level, errno, "Failed to remount '%s' read-only: %m", m->path);
+        }
+
+        log_info("Unmounting '%s'.", m->path);
+
+        r = umount2(m->path, MNT_FORCE);
+        if (r < 0 && errno == EBUSY && !m->try_remount_ro) {
+                /* Nothing local could be written to this file system anyway, so there's nothing to lose by
+                 * lazily detaching it, but maybe something to gain: the mount point below it might become
+                 * unmountable. File systems we'd remount read-only are left in place, so that they are
+                 * remounted read-only once they are the last thing left. */
+                log_info("Unmounting '%s' failed, file system is busy, detaching it lazily instead.", m->path);
+
+                r = umount2(m->path, MNT_DETACH);
+                if (r >= 0)
+                        return UMOUNT_CHILD_DETACHED;
+        }
+        if (r < 0) {
+                log_full_errno(umount_log_level, errno, "Failed to unmount %s: %m", m->path);
+                return EXIT_FAILURE;
+        }
+
+        return EXIT_SUCCESS;
+}
+
+static int umount_leaves(MountPoint **leaves, size_t n_leaves, Set **failed, int umount_log_level, UmountStats *stats) {
+        pid_t pids[UMOUNT_PARALLEL_MAX] = {};
+        usec_t begin, deadline;
+        unsigned n_umounted = 0;
+        size_t i, n_pending = 0;
+        sigset_t mask;
+        int r;
+
+        assert(leaves);
+        assert(n_leaves <= UMOUNT_PARALLEL_MAX);
+        assert(failed);
+        assert(stats);
+
+        BLOCK_SIGNALS(SIGCHLD);
+
+        assert_se(sigemptyset(&mask) == 0);
+        assert_se(sigaddset(&mask, SIGCHLD) == 0);
+
+        /* Unmounts the specified leaf mount points in parallel, each in a child process of its own, so that
+         * a hanging one doesn't hold up the others. They all share the same timeout. Returns the number of
+         * mount points that were unmounted. Those that weren't are added to the 'failed' set. */
+
+        begin = now(CLOCK_MONOTONIC);
+        deadline = usec_add(begin, DEFAULT_TIMEOUT_USEC);
+
+        for (i = 0; i < n_leaves; i++) {
+                r = safe_fork("(sd-umount)", FORK_RESET_SIGNALS|FORK_CLOSE_ALL_FDS|FORK_LOG|FORK_REOPEN_LOG, pids + i);
+                if (r < 0) {
+                        pids[i] = 0;
+                        (void) set_put_strdup(*failed, leaves[i]->path);
+                        continue;
+                }
+                if (r == 0)
+                        _exit(umount_leaf_child(leaves[i], umount_log_level));
+
+                n_pending++;
+        }
+
+        while (n_pending > 0) {
+                struct timespec ts;
+                usec_t n;
+
+                for (i = 0; i < n_leaves; i++) {
+                        siginfo_t status = {};
+
+                        if (pids[i] <= 0)
+                                continue;
+
+                        if (waitid(P_PID, pids[i], &status, WEXITED|WNOHANG) < 0) {
+                                log_error_errno(errno, "Unmounting '%s' failed unexpectedly, couldn't wait for child process " PID_FMT ": %m", leaves[i]->path, pids[i]);
+                                (void) set_put_strdup(*failed, leaves[i]->path);
+                                pids[i] = 0;
+                                n_pending--;
+                                continue;
+                        }
+                        if (status.si_pid != pids[i])
+                                continue;
+
+                        pids[i] = 0;
+                        n_pending--;
+
+                        if (status.si_code != CLD_EXITED || !IN_SET(status.si_status, EXIT_SUCCESS, UMOUNT_CHILD_DETACHED)) {
+                                log_debug("Unmounting '%s' failed abnormally, child process " PID_FMT " aborted or exited non-zero.", leaves[i]->path, status.si_pid);
+                                (void) set_put_strdup(*failed, leaves[i]->path);
+                                continue;
+                        }
+
+                        n_umounted++;
+                        stats->n_parallel++;
+                        if (status.si_status == UMOUNT_CHILD_DETACHED)
+                                stats->n_detached++;
+                        umount_stats_note(stats, leaves[i]->path, begin);
+                }
+
+                if (n_pending == 0)
+                        break;
+
+                n = now(CLOCK_MONOTONIC);
+                if (n >= deadline)
+                        break;
+
+                if (sigtimedwait(&mask, NULL, timespec_store(&ts, deadline - n)) < 0 && !IN_SET(errno, EAGAIN, EINTR)) {
+                        log_error_errno(errno, "Failed to wait for unmount processes: %m");
+                        break;
+                }
+        }
+
+        for (i = 0; i < n_leaves; i++) {
+                if (pids[i] <= 0)
+                        continue;
+
+                log_error("Unmounting '%s' timed out, issuing SIGKILL to PID " PID_FMT ".", leaves[i]->path, pids[i]);
+                (void) kill(pids[i], SIGKILL);
+                (void) set_put_strdup(*failed, leaves[i]->path);
+        }
+
+        return n_umounted;
+}
+
+static int mount_points_list_umount_leaves(MountPoint **head, Set **failed, int umount_log_level, UmountStats *stats) {
+        _cleanup_set_free_free_ Set *parents = NULL, *seen = NULL;
+        MountPoint *leaves[UMOUNT_PARALLEL_MAX], *m;
+        size_t n_leaves = 0;
+        int r, n_umounted = 0;
+
+        assert(head);
+        assert(failed);
+        assert(stats);
+
+        /* Unmounts all mount points that nothing else is mounted on or below at the same time. Mount points
+         * that failed to unmount this way before are skipped, mount_points_list_umount() will try again in
+         * order once there is nothing else left we can unmount in parallel. Returns the number of unmounted
+         * mount points. */
+
+        r = set_ensure_allocated(failed, &path_hash_ops);
+        if (r < 0)
+                return r;
+
+        parents = set_new(&path_hash_ops);
+        seen = set_new(&path_hash_ops);
+        if (!parents || !seen)
+                return -ENOMEM;
+
+        LIST_FOREACH(mount_point, m, *head) {
+                _cleanup_free_ char *p = NULL;
+                char *e;
+
+                p = strdup(m->path);
+                if (!p)
+                        return -ENOMEM;
+
+                while ((e = strrchr(p, '/'))) {
+                        e[e == p] = 0;
+
+                        r = set_put_strdup(parents, p);
+                        if (r < 0)
+                                return r;
+                        if (r == 0 || e == p) /* the rest has been added before */
+                                break;
+                }
+        }
+
+        /* The list is ordered newest first, hence a mount point is over-mounted if its path has been seen
+         * before. */
+        LIST_FOREACH(mount_point, m, *head) {
+                r = set_put_strdup(seen, m->path);
+                if (r < 0)
+                        return r;
+                if (r == 0)
+                        continue;
+
+                if (set_contains(parents, m->path) ||
+                    set_contains(*failed, m->path) ||
+                    nonunmountable_path(m->path))
+                        continue;
+
+                leaves[n_leaves++] = m;
+                if (n_leaves < UMOUNT_PARALLEL_MAX)
+                        continue;
+
+                n_umounted += umount_leaves(leaves, n_leaves, failed, umount_log_level, stats);
+                n_leaves = 0;
+        }
+
+        if (n_leaves > 0)
+                n_umounted += umount_leaves(leaves, n_leaves, failed, umount_log_level, stats);
+
+        return n_umounted;
+}
+
 /* This includes remounting readonly, which changes the kernel mount options.  Therefore the list passed to
  * this function is invalidated, and should not be reused. */
-static int mount_points_list_umount(MountPoint **head, bool *changed, int umount_log_level) {
+static int mount_points_list_umount(MountPoint **head, bool *changed, int umount_log_level, UmountStats *stats) {
         MountPoint *m;
         int n_failed = 0;
 
         assert(head);
         assert(changed);
+        assert(stats);
 
         LIST_FOREACH(mount_point, m, *head) {
+                usec_t begin;
+
                 if (m->try_remount_ro) {
                         /* We always try to remount directories read-only first, before we go on and umount
                          * them.
@@ -541,10 +790,14 @@ static int mount_points_list_umount(MountPoint **head, bool *changed, int umount
                         continue;
 
                 /* Trying to umount */
+                begin = now(CLOCK_MONOTONIC);
                 if (umount_with_timeout(m, umount_log_level) < 0)
                         n_failed++;
-                else
+                else {
                         *changed = true;
+                        stats->n_serial++;
+                        umount_stats_note(stats, m->path, begin);
+                }
         }
 
         return n_failed;
@@ -635,7 +888,7 @@ static int dm_points_list_detach(MountPoint **head, bool *changed, int umount_lo
         return n_failed;
 }
 
-static int umount_all_once(bool *changed, int umount_log_level) {
+static int umount_all_once(bool *changed, Set **failed, int umount_log_level, UmountStats *stats) {
         _cleanup_(mount_points_list_free) LIST_HEAD(MountPoint, mp_list_head);
         int r;
 
@@ -646,10 +899,25 @@ static int umount_all_once(bool *changed, int umount_log_level) {
         if (r < 0)
                 return r;
 
-        return mount_points_list_umount(&mp_list_head, changed, umount_log_level);
+        /* First take down everything we can in parallel, and only if that doesn't get us anywhere anymore
+         * go through the remaining mount points one by one. */
+        r = mount_points_list_umount_leaves(&mp_list_head, failed, umount_log_level, stats);
+        if (r < 0)
+                log_warning_errno(r, "Failed to unmount file systems in parallel, ignoring: %m");
+        else if (r > 0) {
+                *changed = true;
+                return 0;
+        }
+
+        return mount_points_list_umount(&mp_list_head, changed, umount_log_level, stats);
 }
 
 int umount_all(bool *changed, int umount_log_level) {
+        _cleanup_set_free_free_ Set *failed = NULL;
+        _cleanup_(umount_stats_done) UmountStats stats = {
+                .begin = now(CLOCK_MONOTONIC),
+        };
+        char buf[FORMAT_TIMESPAN_MAX], buf2[FORMAT_TIMESPAN_MAX];
         bool umount_changed;
         int r;
 
@@ -661,11 +929,18 @@ int umount_all(bool *changed, int umount_log_level) {
         do {
                 umount_changed = false;
 
-                r = umount_all_once(&umount_changed, umount_log_level);
+                r = umount_all_once(&umount_changed, &failed, umount_log_level, &stats);
                 if (umount_changed)
                         *changed = true;
         } while (umount_changed);
 
+        if (stats.n_parallel + stats.n_serial > 0)
+                log_info("Unmounted %u file systems (%u in parallel, %u of them lazily, %u one by one) in %s, slowest was '%s' with %s.",
+                         stats.n_parallel + stats.n_serial, stats.n_parallel, stats.n_detached, stats.n_serial,
+                         format_timespan(buf, sizeof(buf), usec_sub_unsigned(now(CLOCK_MONOTONIC), stats.begin), USEC_PER_MSEC),
+                         strna(stats.slowest_path),
+                         format_timespan(buf2, sizeof(buf2), stats.slowest_usec, USEC_PER_MSEC));
+
         return r;
 }
 
@@ -639,6 +639,10 @@ static int run(int argc, char *argv[]) {
         if (r < 0)
                 return log_error_errno(r, "Failed to attach resolver: %m");
 
+        /* Every incoming connection resolves the same remote host, hence let bursts of connections share
+         * the result of a single lookup */
+        (void) resolve_set_cache_usec(context.resolve, 5 * USEC_PER_SEC);
+
         sd_event_set_watchdog(context.event, true);
 
         r = sd_listen_fds(1);
@@ -20,6 +20,7 @@
 #include "bootspec.h"
 #include "bus-common-errors.h"
 #include "bus-error.h"
+#include "bus-internal.h"
 #include "bus-message.h"
 #include "bus-unit-procs.h"
 #include "bus-unit-util.h"
@@ -196,6 +197,9 @@ typedef enum BusFocus {
 
 static sd_bus *buses[_BUS_FOCUS_MAX] = {};
 
+/* Kept open while showing the status of multiple units, see print_status_info() */
+static sd_journal *status_journal = NULL;
+
 static UnitFileFlags args_to_flags(void) {
         return (arg_runtime ? UNIT_FILE_RUNTIME : 0) |
                (arg_force   ? UNIT_FILE_FORCE   : 0);
@@ -520,6 +524,7 @@ static int get_unit_list(
         _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
         _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
         _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+        _cleanup_strv_free_ char **type_patterns = NULL;
         size_t size = c;
         int r;
         UnitInfo u;
@@ -529,6 +534,16 @@ static int get_unit_list(
         assert(unit_infos);
         assert(_reply);
 
+        /* If no patterns are specified but a type filter is, turn the latter into patterns, so that the
+         * manager filters by type already, and we don't have to transfer the data of all units. */
+        if (strv_isempty(patterns) && !strv_isempty(arg_types)) {
+                char **t;
+
+                STRV_FOREACH(t, arg_types)
+                        if (strv_extendf(&type_patterns, "*.%s", *t) < 0)
+                                return log_oom();
+        }
+
         r = sd_bus_message_new_method_call(
                         bus,
                         &m,
@@ -543,7 +558,7 @@ static int get_unit_list(
         if (r < 0)
                 return bus_log_create_error(r);
 
-        r = sd_bus_message_append_strv(m, patterns);
+        r = sd_bus_message_append_strv(m, type_patterns ?: patterns);
         if (r < 0)
                 return bus_log_create_error(r);
 
@@ -2507,6 +2522,73 @@ static void warn_unit_file_changed(const char *name) {
                     arg_scope == UNIT_FILE_SYSTEM ? "" : " --user");
 }
 
+static void warn_unit_files_changed_many(sd_bus *bus, char **names) {
+        _cleanup_free_ BusCall *calls = NULL;
+        size_t n, k;
+
+        /* Like need_daemon_reload() followed by warn_unit_file_changed() for each of the units, but takes
+         * two round trips in total, instead of two for each unit. Again, we ignore all errors. */
+
+        n = strv_length(names);
+        if (n == 0)
+                return;
+
+        calls = new0(BusCall, n);
+        if (!calls)
+                return;
+
+        for (k = 0; k < n; k++)
+                if (sd_bus_message_new_method_call(
+                                    bus,
+                                    &calls[k].call,
+                                    "org.freedesktop.systemd1",
+                                    "/org/freedesktop/systemd1",
+                                    "org.freedesktop.systemd1.Manager",
+                                    "GetUnit") < 0 ||
+                    sd_bus_message_append(calls[k].call, "s", names[k]) < 0)
+                        goto finish;
+
+        if (bus_call_many(bus, calls, n, 0) < 0)
+                goto finish;
+
+        /* Reuse the entries for querying the units which are loaded */
+        for (k = 0; k < n; k++) {
+                _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = TAKE_PTR(calls[k].reply);
+                const char *path;
+
+                calls[k].call = sd_bus_message_unref(calls[k].call);
+                sd_bus_error_free(&calls[k].error);
+
+                if (!reply || sd_bus_message_read(reply, "o", &path) < 0)
+                        continue;
+
+                if (sd_bus_message_new_method_call(
+                                    bus,
+                                    &calls[k].call,
+                                    "org.freedesktop.systemd1",
+                                    path,
+                                    "org.freedesktop.DBus.Properties",
+                                    "Get") < 0 ||
+                    sd_bus_message_append(calls[k].call, "ss", "org.freedesktop.systemd1.Unit", "NeedDaemonReload") < 0)
+                        goto finish;
+        }
+
+        if (bus_call_many(bus, calls, n, 0) < 0)
+                goto finish;
+
+        for (k = 0; k < n; k++) {
+                int b;
+
+                if (calls[k].reply &&
+                    sd_bus_message_read(calls[k].reply, "v", "b", &b) > 0 &&
+                    b)
+                        warn_unit_file_changed(names[k]);
+        }
+
+finish:
+        bus_call_done_many(calls, n);
+}
+
 static int unit_file_find_path(LookupPaths *lp, const char *unit_name, char **ret_unit_path) {
         char **p;
 
@@ -2671,7 +2753,7 @@ static int unit_find_paths(
                 _cleanup_set_free_free_ Set *names = NULL;
 
                 if (!cached_name_map) {
-                        r = unit_file_build_name_map(lp, NULL, &cached_id_map, &cached_name_map, NULL);
+                        r = unit_file_build_name_map(lp, NULL, &cached_id_map, &cached_name_map, NULL, NULL);
                         if (r < 0)
                                 return r;
                 }
@@ -2868,6 +2950,50 @@ static const char *verb_to_job_type(const char *verb) {
        return "start";
 }
 
+static int start_unit_watch(const char *name, const char *path, BusWaitForJobs *w, BusWaitForUnits *wu) {
+        int r;
+
+        assert(name);
+        assert(path);
+
+        if (w) {
+                log_debug("Adding %s to the set", path);
+                r = bus_wait_for_jobs_add(w, path);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to watch job for %s: %m", name);
+        }
+
+        if (wu) {
+                r = bus_wait_for_units_add_unit(wu, name, BUS_WAIT_FOR_INACTIVE|BUS_WAIT_NO_JOB, NULL, NULL);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to watch unit %s: %m", name);
+        }
+
+        return 0;
+}
+
+static int start_unit_log_error(const char *job_type, const char *name, const sd_bus_error *error, int r) {
+        assert(job_type);
+        assert(name);
+
+        /* There's always a fallback possible for legacy actions. */
+        if (arg_action != ACTION_SYSTEMCTL)
+                return r;
+
+        log_error_errno(r, "Failed to %s %s: %s", job_type, name, bus_error_message(error, r));
+
+        if (!sd_bus_error_has_name(error, BUS_ERROR_NO_SUCH_UNIT) &&
+            !sd_bus_error_has_name(error, BUS_ERROR_UNIT_MASKED) &&
+            !sd_bus_error_has_name(error, BUS_ERROR_JOB_TYPE_NOT_APPLICABLE))
+                log_error("See %s logs and 'systemctl%s status%s %s' for details.",
+                          arg_scope == UNIT_FILE_SYSTEM ? "system" : "user",
+                          arg_scope == UNIT_FILE_SYSTEM ? "" : " --user",
+                          name[0] == '-' ? " --" : "",
+                          name);
+
+        return r;
+}
+
 static int start_unit_one(
                 sd_bus *bus,
                 const char *method,    /* When using classic per-job bus methods */
@@ -2969,38 +3095,108 @@ static int start_unit_one(
         if (need_daemon_reload(bus, name) > 0)
                 warn_unit_file_changed(name);
 
-        if (w) {
-                log_debug("Adding %s to the set", path);
-                r = bus_wait_for_jobs_add(w, path);
-                if (r < 0)
-                        return log_error_errno(r, "Failed to watch job for %s: %m", name);
-        }
+        return start_unit_watch(name, path, w, wu);
 
-        if (wu) {
-                r = bus_wait_for_units_add_unit(wu, name, BUS_WAIT_FOR_INACTIVE|BUS_WAIT_NO_JOB, NULL, NULL);
-                if (r < 0)
-                        return log_error_errno(r, "Failed to watch unit %s: %m", name);
+fail:
+        return start_unit_log_error(job_type, name, error, r);
+}
+
+static bool may_need_interactive_auth(void) {
+        /* Only the system manager asks polkit, and never for root on the local system */
+        return arg_ask_password &&
+                arg_scope == UNIT_FILE_SYSTEM &&
+                (arg_transport != BUS_TRANSPORT_LOCAL || geteuid() != 0);
+}
+
+static int start_units_many(
+                sd_bus *bus,
+                const char *method,
+                const char *job_type,
+                char **names,
+                const char *mode,
+                BusWaitForJobs *w,
+                BusWaitForUnits *wu,
+                char ***stopped_units) {
+
+        _cleanup_free_ char **enqueued = NULL; /* Do not use _cleanup_strv_free_ */
+        _cleanup_free_ BusCall *calls = NULL;
+        int r, ret = EXIT_SUCCESS;
+        size_t n, k;
+
+        assert(method);
+        assert(job_type);
+        assert(mode);
+        assert(stopped_units);
+
+        /* Like start_unit_one() for each of the units, but enqueues all jobs in a single round trip. Returns
+         * the exit status. */
+
+        n = strv_length(names);
+        calls = new0(BusCall, n);
+        if (!calls)
+                return log_oom();
+
+        for (k = 0; k < n; k++) {
+                log_debug("Executing dbus call org.freedesktop.systemd1.Manager %s(%s, %s)",
+                          method, names[k], mode);
+
+                r = sd_bus_message_new_method_call(
+                                bus,
+                                &calls[k].call,
+                                "org.freedesktop.systemd1",
+                                "/org/freedesktop/systemd1",
+                                "org.freedesktop.systemd1.Manager",
+                                method);
+                if (r < 0) {
+                        ret = bus_log_create_error(r);
+                        goto finish;
+                }
+
+                r = sd_bus_message_append(calls[k].call, "ss", names[k], mode);
+                if (r < 0) {
+                        ret = bus_log_create_error(r);
+                        goto finish;
+                }
         }
 
-        return 0;
+        /* Failures are recorded for each call, and handled below one by one */
+        (void) bus_call_many(bus, calls, n, 0);
 
-fail:
-        /* There's always a fallback possible for legacy actions. */
-        if (arg_action != ACTION_SYSTEMCTL)
-                return r;
+        for (k = 0; k < n; k++) {
+                const char *path;
 
-        log_error_errno(r, "Failed to %s %s: %s", job_type, name, bus_error_message(error, r));
+                if (calls[k].reply) {
+                        if (strv_push(&enqueued, names[k]) < 0) {
+                                ret = log_oom();
+                                goto finish;
+                        }
 
-        if (!sd_bus_error_has_name(error, BUS_ERROR_NO_SUCH_UNIT) &&
-            !sd_bus_error_has_name(error, BUS_ERROR_UNIT_MASKED) &&
-            !sd_bus_error_has_name(error, BUS_ERROR_JOB_TYPE_NOT_APPLICABLE))
-                log_error("See %s logs and 'systemctl%s status%s %s' for details.",
-                          arg_scope == UNIT_FILE_SYSTEM ? "system" : "user",
-                          arg_scope == UNIT_FILE_SYSTEM ? "" : " --user",
-                          name[0] == '-' ? " --" : "",
-                          name);
+                        r = sd_bus_message_read(calls[k].reply, "o", &path);
+                        if (r < 0)
+                                r = bus_log_parse_error(r);
+                        else
+                                r = start_unit_watch(names[k], path, w, wu);
+                } else
+                        r = start_unit_log_error(job_type, names[k], &calls[k].error,
+                                                 -sd_bus_error_get_errno(&calls[k].error));
 
-        return r;
+                if (ret == EXIT_SUCCESS && r < 0)
+                        ret = translate_bus_error_to_exit_status(r, &calls[k].error);
+
+                if (r >= 0 && streq(method, "StopUnit")) {
+                        r = strv_push(stopped_units, names[k]);
+                        if (r < 0) {
+                                ret = log_oom();
+                                goto finish;
+                        }
+                }
+        }
+
+        warn_unit_files_changed_many(bus, enqueued);
+
+finish:
+        bus_call_done_many(calls, n);
+        return ret;
 }
 
 static const struct {
@@ -3163,19 +3359,28 @@ static int start_unit(int argc, char *argv[], void *userdata) {
                         return log_error_errno(r, "Failed to allocate unit watch context: %m");
         }
 
-        STRV_FOREACH(name, names) {
-                _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+        if (strv_length(names) > 1 && !arg_dry_run && !arg_show_transaction && !may_need_interactive_auth()) {
+                /* Pipeline the calls if there are several units, so that we don't need a round trip for each.
+                 * If polkit might ask for a password, issue the calls one by one though, so that the user is
+                 * asked once and not for all units at the same time, and the authorization can be retained for
+                 * the following calls. */
+                ret = start_units_many(bus, method, job_type, names, mode, w, wu, &stopped_units);
+                if (ret < 0)
+                        return ret;
+        } else
+                STRV_FOREACH(name, names) {
+                        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
 
-                r = start_unit_one(bus, method, job_type, *name, mode, &error, w, wu);
-                if (ret == EXIT_SUCCESS && r < 0)
-                        ret = translate_bus_error_to_exit_status(r, &error);
+                        r = start_unit_one(bus, method, job_type, *name, mode, &error, w, wu);
+                        if (ret == EXIT_SUCCESS && r < 0)
+                                ret = translate_bus_error_to_exit_status(r, &error);
 
-                if (r >= 0 && streq(method, "StopUnit")) {
-                        r = strv_push(&stopped_units, *name);
-                        if (r < 0)
-                                return log_oom();
+                        if (r >= 0 && streq(method, "StopUnit")) {
+                                r = strv_push(&stopped_units, *name);
+                                if (r < 0)
+                                        return log_oom();
+                        }
                 }
-        }
 
         if (!arg_no_block) {
                 const char* extra_args[4];
@@ -4641,7 +4846,8 @@ static void print_status_info(
         }
 
         if (i->id && arg_transport == BUS_TRANSPORT_LOCAL)
-                show_journal_by_unit(
+                /* Units in the default namespace share one journal instance, others get their own */
+                show_journal_by_unit_full(
                                 stdout,
                                 i->id,
                                 i->log_namespace,
@@ -4653,7 +4859,8 @@ static void print_status_info(
                                 get_output_flags() | OUTPUT_BEGIN_NEWLINE,
                                 SD_JOURNAL_LOCAL_ONLY,
                                 arg_scope == UNIT_FILE_SYSTEM,
-                                ellipsized);
+                                ellipsized,
+                                i->log_namespace ? NULL : &status_journal);
 
         if (i->need_daemon_reload)
                 warn_unit_file_changed(i->id);
@@ -5548,6 +5755,7 @@ static int show_one(
                 const char *path,
                 const char *unit,
                 SystemctlShowMode show_mode,
+                sd_bus_message *prefetched,
                 bool *new_line,
                 bool *ellipsized) {
 
@@ -5669,15 +5877,29 @@ static int show_one(
 
         log_debug("Showing one %s", path);
 
-        r = bus_map_all_properties(
-                        bus,
-                        "org.freedesktop.systemd1",
-                        path,
-                        show_mode == SYSTEMCTL_SHOW_STATUS ? status_map : property_map,
-                        BUS_MAP_BOOLEAN_AS_BOOL,
-                        &error,
-                        &reply,
-                        &info);
+        if (prefetched) {
+                /* The reply to GetAll() was already requested by show_units() */
+                if (sd_bus_message_is_method_error(prefetched, NULL))
+                        r = sd_bus_error_copy(&error, sd_bus_message_get_error(prefetched));
+                else {
+                        reply = sd_bus_message_ref(prefetched);
+                        r = bus_message_map_all_properties(
+                                        reply,
+                                        show_mode == SYSTEMCTL_SHOW_STATUS ? status_map : property_map,
+                                        BUS_MAP_BOOLEAN_AS_BOOL,
+                                        &error,
+                                        &info);
+                }
+        } else
+                r = bus_map_all_properties(
+                                bus,
+                                "org.freedesktop.systemd1",
+                                path,
+                                show_mode == SYSTEMCTL_SHOW_STATUS ? status_map : property_map,
+                                BUS_MAP_BOOLEAN_AS_BOOL,
+                                &error,
+                                &reply,
+                                &info);
         if (r < 0)
                 return log_error_errno(r, "Failed to get properties: %s", bus_error_message(&error, r));
 
@@ -5758,6 +5980,120 @@ static int get_unit_dbus_path_by_pid(
         return 0;
 }
 
+/* How many units to request the properties of at once, when showing multiple units */
+#define SHOW_PREFETCH_MAX 64U
+
+typedef struct PropertiesPrefetch {
+        char *path;
+        sd_bus_slot *slot;
+        sd_bus_message *reply;
+        size_t *n_pending;
+} PropertiesPrefetch;
+
+static void properties_prefetch_done(PropertiesPrefetch *p) {
+        assert(p);
+
+        p->path = mfree(p->path);
+        p->slot = sd_bus_slot_unref(p->slot);
+        p->reply = sd_bus_message_unref(p->reply);
+}
+
+static int on_properties_reply(sd_bus_message *m, void *userdata, sd_bus_error *ret_error) {
+        PropertiesPrefetch *p = userdata;
+
+        assert(m);
+        assert(p);
+
+        p->reply = sd_bus_message_ref(m);
+        (*p->n_pending)--;
+
+        return 0;
+}
+
+static int show_units(
+                sd_bus *bus,
+                char **names,
+                SystemctlShowMode show_mode,
+                bool *new_line,
+                bool *ellipsized) {
+
+        PropertiesPrefetch prefetch[SHOW_PREFETCH_MAX] = {};
+        size_t n, i, k, m;
+        int r = 0, ret = 0;
+
+        assert(bus);
+
+        /* Shows the specified units. Instead of doing one round trip per unit, the properties of up to
+         * SHOW_PREFETCH_MAX units are requested at once, and are then shown one by one. The window is
+         * limited in order to keep the memory needed for the replies bounded even with many thousands of
+         * units. If the properties of a unit cannot be requested ahead of time, show_one() falls back to
+         * requesting them itself. */
+
+        n = strv_length(names);
+
+        for (i = 0; i < n; i += m) {
+                size_t n_pending = 0;
+
+                m = MIN(n - i, SHOW_PREFETCH_MAX);
+
+                for (k = 0; k < m; k++) {
+                        prefetch[k].path = unit_dbus_path_from_name(names[i + k]);
+                        if (!prefetch[k].path) {
+                                r = log_oom();
+                                goto finish;
+                        }
+
+                        prefetch[k].n_pending = &n_pending;
+
+                        if (sd_bus_call_method_async(
+                                            bus,
+                                            &prefetch[k].slot,
+                                            "org.freedesktop.systemd1",
+                                            prefetch[k].path,
+                                            "org.freedesktop.DBus.Properties",
+                                            "GetAll",
+                                            on_properties_reply,
+                                            prefetch + k,
+                                            "s", "") >= 0)
+                                n_pending++;
+                }
+
+                while (n_pending > 0) {
+                        r = sd_bus_process(bus, NULL);
+                        if (r < 0) {
+                                log_error_errno(r, "Failed to process bus: %m");
+                                goto finish;
+                        }
+                        if (r > 0)
+                                continue;
+
+                        r = sd_bus_wait(bus, (uint64_t) -1);
+                        if (r < 0) {
+                                log_error_errno(r, "Failed to wait for bus: %m");
+                                goto finish;
+                        }
+                }
+
+                for (k = 0; k < m; k++) {
+                        r = show_one(bus, prefetch[k].path, names[i + k], show_mode, prefetch[k].reply, new_line, ellipsized);
+                        if (r < 0)
+                                goto finish;
+                        if (r > 0 && ret == 0)
+                                ret = r;
+
+                        properties_prefetch_done(prefetch + k);
+                }
+        }
+
+        r = ret;
+
+finish:
+        for (k = 0; k < ELEMENTSOF(prefetch); k++)
+                properties_prefetch_done(prefetch + k);
+
+        return r;
+}
+
 static int show_all(
                 sd_bus *bus,
                 bool *new_line,
@@ -5765,9 +6101,9 @@ static int show_all(
 
         _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
         _cleanup_free_ UnitInfo *unit_infos = NULL;
-        const UnitInfo *u;
-        unsigned c;
-        int r, ret = 0;
+        _cleanup_free_ char **names = NULL;
+        unsigned c, k;
+        int r;
 
         r = get_unit_list(bus, NULL, NULL, &unit_infos, 0, &reply);
         if (r < 0)
@@ -5779,21 +6115,15 @@ static int show_all(
 
         typesafe_qsort(unit_infos, c, compare_unit_info);
 
-        for (u = unit_infos; u < unit_infos + c; u++) {
-                _cleanup_free_ char *p = NULL;
-
-                p = unit_dbus_path_from_name(u->id);
-                if (!p)
-                        return log_oom();
+        names = new(char*, c + 1);
+        if (!names)
+                return log_oom();
 
-                r = show_one(bus, p, u->id, SYSTEMCTL_SHOW_STATUS, new_line, ellipsized);
-                if (r < 0)
-                        return r;
-                else if (r > 0 && ret == 0)
-                        ret = r;
-        }
+        for (k = 0; k < c; k++)
+                names[k] = (char*) unit_infos[k].id;
+        names[c] = NULL;
 
-        return ret;
+        return show_units(bus, names, SYSTEMCTL_SHOW_STATUS, new_line, ellipsized);
 }
 
 static int show_system_status(sd_bus *bus) {
@@ -5887,7 +6217,7 @@ static int show(int argc, char *argv[], void *userdata) {
 
         /* If no argument is specified inspect the manager itself */
         if (show_mode == SYSTEMCTL_SHOW_PROPERTIES && argc <= 1)
-                return show_one(bus, "/org/freedesktop/systemd1", NULL, show_mode, &new_line, &ellipsized);
+                return show_one(bus, "/org/freedesktop/systemd1", NULL, show_mode, NULL, &new_line, &ellipsized);
 
         if (show_mode == SYSTEMCTL_SHOW_STATUS && argc <= 1) {
 
@@ -5927,7 +6257,7 @@ static int show(int argc, char *argv[], void *userdata) {
                                         return log_oom();
                         }
 
-                        r = show_one(bus, path, unit, show_mode, &new_line, &ellipsized);
+                        r = show_one(bus, path, unit, show_mode, NULL, &new_line, &ellipsized);
                         if (r < 0)
                                 return r;
                         else if (r > 0 && ret == 0)
@@ -5945,19 +6275,11 @@ static int show(int argc, char *argv[], void *userdata) {
                         if (r < 0)
                                 return r;
 
-                        STRV_FOREACH(name, names) {
-                                _cleanup_free_ char *path;
-
-                                path = unit_dbus_path_from_name(*name);
-                                if (!path)
-                                        return log_oom();
-
-                                r = show_one(bus, path, *name, show_mode, &new_line, &ellipsized);
-                                if (r < 0)
-                                        return r;
-                                if (r > 0 && ret == 0)
-                                        ret = r;
-                        }
+                        r = show_units(bus, names, show_mode, &new_line, &ellipsized);
+                        if (r < 0)
+                                return r;
+                        if (r > 0 && ret == 0)
+                                ret = r;
                 }
         }
 
@@ -9557,6 +9879,7 @@ static int run(int argc, char *argv[]) {
 
 finish:
         release_busses();
+        sd_journal_close(status_journal);
 
         /* Note that we return r here, not 0, so that we can implement the LSB-like return codes */
         return r;
@@ -226,6 +226,11 @@ sd_login_monitor* sd_login_monitor_unref(sd_login_monitor *m);
 /* Flushes the monitor */
 int sd_login_monitor_flush(sd_login_monitor *m);
 
+/* Flushes the monitor, and returns the objects that changed since the last flush as a NULL-terminated
+ * array of strings of the form "<category>:<name>", e.g. "session:c1" or "uid:1000". Returns the number of
+ * changed objects, or -ENOBUFS if events were lost and everything needs to be reread. */
+int sd_login_monitor_flush_changes(sd_login_monitor *m, char ***ret);
+
 /* Get FD from monitor */
 int sd_login_monitor_get_fd(sd_login_monitor *m);
 
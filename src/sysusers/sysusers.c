@@ -75,6 +75,7 @@ static OrderedHashmap *members = NULL;
 static Hashmap *database_by_uid = NULL, *database_by_username = NULL;
 static Hashmap *database_by_gid = NULL, *database_by_groupname = NULL;
 static Set *database_users = NULL, *database_groups = NULL;
+static bool database_users_nis = false, database_groups_nis = false;
 
 static uid_t search_uid = UID_INVALID;
 static UidRange *uid_range = NULL;
@@ -127,6 +128,9 @@ static int load_user_database(void) {
                 char *n;
                 int k, q;
 
+                if (IN_SET(pw->pw_name[0], '+', '-'))
+                        database_users_nis = true;
+
                 n = strdup(pw->pw_name);
                 if (!n)
                         return -ENOMEM;
@@ -175,6 +179,9 @@ static int load_group_database(void) {
                 char *n;
                 int k, q;
 
+                if (IN_SET(gr->gr_name[0], '+', '-'))
+                        database_groups_nis = true;
+
                 n = strdup(gr->gr_name);
                 if (!n)
                         return -ENOMEM;
@@ -371,6 +378,38 @@ static const char* default_shell(uid_t uid) {
         return uid == 0 ? "/bin/sh" : NOLOGIN;
 }
 
+static int copy_original(FILE *original, FILE *f) {
+        struct stat st;
+        ssize_t n;
+        char c;
+        int r;
+
+        assert(original);
+        assert(f);
+
+        /* Copies the original file as it is, and makes sure it ends in a newline so that new entries can be
+         * appended. This is much cheaper than parsing and formatting every single entry again, and is used
+         * when existing entries don't need to be changed or moved. Collisions with the new entries have been
+         * ruled out already, based on the databases loaded earlier, while holding the lock. */
+
+        r = copy_bytes(fileno(original), fileno(f), (uint64_t) -1, COPY_REFLINK);
+        if (r < 0)
+                return r;
+
+        if (fstat(fileno(original), &st) < 0)
+                return -errno;
+        if (st.st_size == 0)
+                return 0;
+
+        n = pread(fileno(original), &c, 1, st.st_size - 1);
+        if (n < 0)
+                return -errno;
+        if (n == 1 && c != '\n')
+                fputc('\n', f);
+
+        return 0;
+}
+
 static int write_temporary_passwd(const char *passwd_path, FILE **tmpfile, char **tmpfile_path) {
         _cleanup_fclose_ FILE *original = NULL, *passwd = NULL;
         _cleanup_(unlink_and_freep) char *passwd_tmp = NULL;
@@ -393,7 +432,14 @@ static int write_temporary_passwd(const char *passwd_path, FILE **tmpfile, char
                 if (r < 0)
                         return r;
 
-                while ((r = fgetpwent_sane(original, &pw)) > 0) {
+                /* Without NIS entries, which have to remain at the end, we can simply append */
+                if (!database_users_nis) {
+                        r = copy_original(original, passwd);
+                        if (r < 0)
+                                return r;
+                }
+
+                while (database_users_nis && (r = fgetpwent_sane(original, &pw)) > 0) {
 
                         i = ordered_hashmap_get(users, pw->pw_name);
                         if (i && i->todo_user)
@@ -572,7 +618,7 @@ static int write_temporary_shadow(const char *shadow_path, FILE **tmpfile, char
 static int write_temporary_group(const char *group_path, FILE **tmpfile, char **tmpfile_path) {
         _cleanup_fclose_ FILE *original = NULL, *group = NULL;
         _cleanup_(unlink_and_freep) char *group_tmp = NULL;
-        bool group_changed = false;
+        bool group_changed = false, append_only;
         struct group *gr = NULL;
         Iterator iterator;
         Item *i;
@@ -592,7 +638,16 @@ static int write_temporary_group(const char *group_path, FILE **tmpfile, char **
                 if (r < 0)
                         return r;
 
-                while ((r = fgetgrent_sane(original, &gr)) > 0) {
+                /* Without NIS entries, which have to remain at the end, and without members to add to
+                 * existing groups, we can simply append */
+                append_only = !database_groups_nis && ordered_hashmap_size(members) == 0;
+                if (append_only) {
+                        r = copy_original(original, group);
+                        if (r < 0)
+                                return r;
+                }
+
+                while (!append_only && (r = fgetgrent_sane(original, &gr)) > 0) {
                         /* Safety checks against name and GID collisions. Normally,
                          * this should be unnecessary, but given that we look at the
                          * entries anyway here, let's make an extra verification
@@ -0,0 +1,87 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <stdint.h>
+
+#include "arena.h"
+#include "memory-util.h"
+#include "string-util.h"
+#include "tests.h"
+
+static void test_arena_alloc(void) {
+        _cleanup_(arena_done) Arena a = {};
+        char *p[1000];
+        uint8_t *q;
+        size_t i;
+
+        log_info("/* %s */", __func__);
+
+        /* Many small allocations, which must stay intact while more are made */
+        for (i = 0; i < ELEMENTSOF(p); i++) {
+                assert_se(p[i] = arena_alloc(&a, i % 37));
+                assert_se(((uintptr_t) p[i] & (sizeof(void*) - 1)) == 0);
+                memset(p[i], (int) (i & 0xff), i % 37);
+        }
+
+        for (i = 0; i < ELEMENTSOF(p); i++) {
+                size_t j;
+
+                for (j = 0; j < i % 37; j++)
+                        assert_se((uint8_t) p[i][j] == (i & 0xff));
+        }
+
+        /* A large allocation doesn't take the place of the current chunk */
+        assert_se(q = arena_alloc0(&a, 1024 * 1024));
+        assert_se(q[0] == 0 && q[1024 * 1024 - 1] == 0);
+        assert_se(arena_size(&a) >= 1024 * 1024);
+
+        assert_se(streq(arena_strdup(&a, "foo"), "foo"));
+        assert_se(streq(arena_strndup(&a, "foobar", 3), "foo"));
+        assert_se(streq(arena_strndup(&a, "fo", 3), "fo"));
+        assert_se(memcmp(arena_memdup(&a, "bar", 3), "bar", 3) == 0);
+
+        arena_done(&a);
+        assert_se(arena_size(&a) == 0);
+
+        /* The arena can be used again after being emptied */
+        assert_se(streq(arena_strdup(&a, "again"), "again"));
+}
+
+static void test_arena_realloc(void) {
+        _cleanup_(arena_done) Arena a = {};
+        size_t n_allocated = 0, i;
+        char *s = NULL, *first, *other;
+
+        log_info("/* %s */", __func__);
+
+        /* The most recent allocation grows in place as long as the chunk has room */
+        assert_se(ARENA_GREEDY_REALLOC(&a, s, n_allocated, 1));
+        first = s;
+        for (i = 0; i < 1000; i++) {
+                assert_se(ARENA_GREEDY_REALLOC(&a, s, n_allocated, i + 2));
+                s[i] = 'a' + i % 26;
+                s[i + 1] = 0;
+        }
+        assert_se(s == first);
+        assert_se(strlen(s) == 1000);
+
+        /* Another allocation in between means the next growth copies */
+        assert_se(other = arena_strdup(&a, "other"));
+        assert_se(ARENA_GREEDY_REALLOC(&a, s, n_allocated, n_allocated + 1));
+        assert_se(s != first);
+        assert_se(strlen(s) == 1000);
+        assert_se(streq(other, "other"));
+
+        /* Beyond the chunk, the buffer moves to a new one */
+        assert_se(s = arena_realloc(&a, s, 1001, 100000));
+        assert_se(strlen(s) == 1000);
+        assert_se(s[999] == 'a' + 999 % 26);
+}
+
+int main(int argc, char *argv[]) {
+        test_setup_logging(LOG_INFO);
+
+        test_arena_alloc();
+        test_arena_realloc();
+
+        return 0;
+}
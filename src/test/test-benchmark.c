@@ -0,0 +1,335 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "sd-bus.h"
+#include "sd-event.h"
+
+#include "alloc-util.h"
+#include "bus-internal.h"
+#include "bus-message.h"
+#include "fd-util.h"
+#include "hashmap.h"
+#include "json.h"
+#include "prioq.h"
+#include "set.h"
+#include "stdio-util.h"
+#include "string-util.h"
+#include "tests.h"
+
+/* Benchmarks for the basic data structures and libraries used everywhere: hashmaps, sets and priority
+ * queues, JSON, sd-event and sd-bus. */
+
+#define N_ENTRIES 1000U
+
+typedef struct Strings {
+        char *strings[N_ENTRIES];
+} Strings;
+
+static void strings_done(Strings *s) {
+        for (size_t i = 0; i < N_ENTRIES; i++)
+                free(s->strings[i]);
+}
+
+static void strings_init(Strings *s, const char *format) {
+        for (size_t i = 0; i < N_ENTRIES; i++)
+                assert_se(asprintf(&s->strings[i], format, i) >= 0);
+}
+
+static void hashmap_put_remove(void *userdata) {
+        _cleanup_hashmap_free_ Hashmap *h = NULL;
+        Strings *s = userdata;
+
+        assert_se(h = hashmap_new(&string_hash_ops));
+
+        for (size_t i = 0; i < N_ENTRIES; i++)
+                assert_se(hashmap_put(h, s->strings[i], s->strings[i]) > 0);
+        for (size_t i = 0; i < N_ENTRIES; i++)
+                assert_se(hashmap_remove(h, s->strings[i]));
+}
+
+typedef struct HashmapLookup {
+        Hashmap *hashmap;
+        Strings *strings;
+} HashmapLookup;
+
+static void hashmap_lookup(void *userdata) {
+        HashmapLookup *l = userdata;
+
+        for (size_t i = 0; i < N_ENTRIES; i++)
+                assert_se(hashmap_get(l->hashmap, l->strings->strings[i]));
+}
+
+static void set_put_contains(void *userdata) {
+        _cleanup_set_free_ Set *set = NULL;
+        Strings *s = userdata;
+
+        assert_se(set = set_new(&string_hash_ops));
+
+        for (size_t i = 0; i < N_ENTRIES; i++)
+                assert_se(set_put(set, s->strings[i]) > 0);
+        for (size_t i = 0; i < N_ENTRIES; i++)
+                assert_se(set_contains(set, s->strings[i]));
+}
+
+static int compare_uint(const void *a, const void *b) {
+        return CMP(PTR_TO_UINT(a), PTR_TO_UINT(b));
+}
+
+static void prioq_put_pop(void *userdata) {
+        _cleanup_(prioq_freep) Prioq *q = NULL;
+        unsigned prev = 0;
+
+        assert_se(q = prioq_new(compare_uint));
+
+        /* Insert in an order that is neither sorted nor reverse sorted */
+        for (unsigned i = 0; i < N_ENTRIES; i++)
+                assert_se(prioq_put(q, UINT_TO_PTR(1 + (i * 7919U) % N_ENTRIES), NULL) >= 0);
+
+        for (unsigned i = 0; i < N_ENTRIES; i++) {
+                unsigned u;
+
+                u = PTR_TO_UINT(prioq_pop(q));
+                assert_se(u >= prev);
+                prev = u;
+        }
+}
+
+static void bench_data_structures(void) {
+        _cleanup_hashmap_free_ Hashmap *h = NULL;
+        Strings s = {};
+        HashmapLookup l;
+
+        strings_init(&s, "user-runtime-dir@%zu.service");
+
+        benchmark_run("hashmap-put-remove", hashmap_put_remove, &s, 2 * N_ENTRIES);
+
+        assert_se(h = hashmap_new(&string_hash_ops));
+        for (size_t i = 0; i < N_ENTRIES; i++)
+                assert_se(hashmap_put(h, s.strings[i], s.strings[i]) > 0);
+        l = (HashmapLookup) {
+                .hashmap = h,
+                .strings = &s,
+        };
+        benchmark_run("hashmap-lookup", hashmap_lookup, &l, N_ENTRIES);
+
+        benchmark_run("set-put-contains", set_put_contains, &s, 2 * N_ENTRIES);
+        benchmark_run("prioq-put-pop", prioq_put_pop, NULL, 2 * N_ENTRIES);
+
+        strings_done(&s);
+}
+
+/* Roughly what varlink and the user record logic pass around */
+static const char json_document[] =
+        "{\"userName\":\"benchmark\",\"uid\":60123,\"gid\":60123,\"realName\":\"Benchmark User\","
+        "\"homeDirectory\":\"/home/benchmark\",\"shell\":\"/bin/bash\",\"disposition\":\"regular\","
+        "\"memberOf\":[\"wheel\",\"audio\",\"video\",\"input\"],\"locked\":false,\"diskSize\":17179869184,"
+        "\"privileged\":{\"hashedPassword\":[\"$6$abcdefgh$ijklmnopqrstuvwxyz0123456789\"]},"
+        "\"perMachine\":[{\"matchMachineId\":[\"0123456789abcdef0123456789abcdef\"],\"cpuWeight\":100,"
+        "\"ioWeight\":100,\"tasksMax\":4096,\"environment\":[\"FOO=bar\",\"WALDO=quux\"]}],"
+        "\"binding\":{\"0123456789abcdef0123456789abcdef\":{\"imagePath\":\"/home/benchmark.home\","
+        "\"storage\":\"luks\",\"fileSystemType\":\"ext4\",\"partitionUuid\":\"0a1b2c3d-4e5f-6071-8293-a4b5c6d7e8f9\"}},"
+        "\"status\":{\"0123456789abcdef0123456789abcdef\":{\"diskUsage\":1234567,\"diskFree\":7654321,"
+        "\"state\":\"active\",\"service\":\"io.systemd.Home\",\"signedLocally\":true}}}";
+
+static void json_parse_one(void *userdata) {
+        _cleanup_(json_variant_unrefp) JsonVariant *v = NULL;
+
+        assert_se(json_parse(json_document, 0, &v, NULL, NULL) >= 0);
+}
+
+static void json_format_one(void *userdata) {
+        _cleanup_free_ char *s = NULL;
+
+        assert_se(json_variant_format(userdata, 0, &s) >= 0);
+}
+
+static void bench_json(void) {
+        _cleanup_(json_variant_unrefp) JsonVariant *v = NULL;
+
+        benchmark_run("json-parse", json_parse_one, NULL, 1);
+
+        assert_se(json_parse(json_document, 0, &v, NULL, NULL) >= 0);
+        benchmark_run("json-format", json_format_one, v, 1);
+}
+
+static int on_defer(sd_event_source *s, void *userdata) {
+        return 0;
+}
+
+static int on_io(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
+        return 0;
+}
+
+static void event_run_one(void *userdata) {
+        assert_se(sd_event_run(userdata, 0) > 0);
+}
+
+static void bench_event(void) {
+        _cleanup_close_pair_ int pipe_fds[2] = { -1, -1 };
+        _cleanup_(sd_event_unrefp) sd_event *e = NULL;
+        _cleanup_(sd_event_source_unrefp) sd_event_source *defer = NULL, *io = NULL;
+
+        assert_se(sd_event_new(&e) >= 0);
+
+        /* An always pending defer event source, i.e. the dispatching without any epoll involvement */
+        assert_se(sd_event_add_defer(e, &defer, on_defer, NULL) >= 0);
+        assert_se(sd_event_source_set_enabled(defer, SD_EVENT_ON) >= 0);
+        benchmark_run("sd-event-dispatch-defer", event_run_one, e, 1);
+        assert_se(sd_event_source_set_enabled(defer, SD_EVENT_OFF) >= 0);
+
+        /* A pipe that is always readable, as we never read from it, hence dispatched on each iteration */
+        assert_se(pipe2(pipe_fds, O_CLOEXEC|O_NONBLOCK) >= 0);
+        assert_se(write(pipe_fds[1], "x", 1) == 1);
+        assert_se(sd_event_add_io(e, &io, pipe_fds[0], EPOLLIN, on_io, NULL) >= 0);
+        benchmark_run("sd-event-dispatch-io", event_run_one, e, 1);
+}
+
+static sd_bus_message *bus_message_new_benchmark(sd_bus *bus) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+
+        /* Looks like a typical PID 1 method call, i.e. StartTransientUnit() */
+        assert_se(sd_bus_message_new_method_call(bus, &m, "org.freedesktop.systemd1", "/org/freedesktop/systemd1",
+                                                 "org.freedesktop.systemd1.Manager", "StartTransientUnit") >= 0);
+        assert_se(sd_bus_message_append(m, "ss", "run-u4711.service", "fail") >= 0);
+        assert_se(sd_bus_message_append(m, "a(sv)", 5,
+                                        "Description", "s", "Benchmark",
+                                        "RemainAfterExit", "b", true,
+                                        "MemoryMax", "t", UINT64_C(1073741824),
+                                        "Environment", "as", 2, "FOO=bar", "WALDO=quux",
+                                        "ExecStart", "a(sasb)", 1, "/bin/true", 1, "/bin/true", false) >= 0);
+        assert_se(sd_bus_message_append(m, "a(sa(sv))", 0) >= 0);
+
+        return TAKE_PTR(m);
+}
+
+static void bus_marshal_one(void *userdata) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+
+        m = bus_message_new_benchmark(userdata);
+        assert_se(sd_bus_message_seal(m, 1, 0) >= 0);
+}
+
+typedef struct BusDemarshal {
+        sd_bus *bus;
+        void *blob;
+        size_t size;
+} BusDemarshal;
+
+static void bus_demarshal_one(void *userdata) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+        BusDemarshal *d = userdata;
+        void *copy;
+
+        assert_se(copy = memdup(d->blob, d->size));
+        assert_se(bus_message_from_malloc(d->bus, copy, d->size, NULL, 0, NULL, &m) >= 0);
+        assert_se(sd_bus_message_skip(m, "ssa(sv)a(sa(sv))") >= 0);
+}
+
+static void *bus_server(void *p) {
+        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
+        int fd = PTR_TO_FD(p);
+        sd_id128_t id;
+
+        assert_se(sd_id128_randomize(&id) >= 0);
+        assert_se(sd_bus_new(&bus) >= 0);
+        assert_se(sd_bus_set_fd(bus, fd, fd) >= 0);
+        assert_se(sd_bus_set_server(bus, true, id) >= 0);
+        assert_se(sd_bus_start(bus) >= 0);
+
+        for (;;) {
+                _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+                int r;
+
+                r = sd_bus_process(bus, &m);
+                if (r < 0)
+                        break;
+                if (r == 0) {
+                        assert_se(sd_bus_wait(bus, UINT64_MAX) >= 0);
+                        continue;
+                }
+                if (!m)
+                        continue;
+
+                if (sd_bus_message_is_method_call(m, "org.freedesktop.systemd1.Manager", "Exit")) {
+                        assert_se(sd_bus_reply_method_return(m, NULL) >= 0);
+                        break;
+                }
+
+                if (sd_bus_message_is_method_call(m, NULL, NULL))
+                        assert_se(sd_bus_reply_method_return(m, "o", "/org/freedesktop/systemd1/job/4711") >= 0);
+        }
+
+        return NULL;
+}
+
+static void bus_round_trip_one(void *userdata) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL, *reply = NULL;
+
+        m = bus_message_new_benchmark(userdata);
+        assert_se(sd_bus_call(userdata, m, 0, NULL, &reply) >= 0);
+}
+
+static void bench_bus(void) {
+        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *client = NULL;
+        _cleanup_(sd_bus_unrefp) sd_bus *bus = NULL;
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+        _cleanup_close_pair_ int pair[2] = { -1, -1 };
+        _cleanup_free_ void *blob = NULL;
+        BusDemarshal d;
+        pthread_t server;
+        size_t size;
+
+        /* Marshalling doesn't need a peer, hence use a direct connection that never gets connected */
+        assert_se(socketpair(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0, pair) >= 0);
+        assert_se(sd_bus_new(&bus) >= 0);
+        assert_se(sd_bus_set_fd(bus, pair[0], pair[0]) >= 0);
+        TAKE_FD(pair[0]);
+        assert_se(sd_bus_set_server(bus, true, SD_ID128_NULL) >= 0);
+        assert_se(sd_bus_start(bus) >= 0);
+
+        benchmark_run("sd-bus-marshal", bus_marshal_one, bus, 1);
+
+        m = bus_message_new_benchmark(bus);
+        assert_se(sd_bus_message_seal(m, 1, 0) >= 0);
+        assert_se(bus_message_get_blob(m, &blob, &size) >= 0);
+        d = (BusDemarshal) {
+                .bus = bus,
+                .blob = blob,
+                .size = size,
+        };
+        benchmark_run("sd-bus-demarshal", bus_demarshal_one, &d, 1);
+
+        bus = sd_bus_unref(bus);
+        pair[1] = safe_close(pair[1]);
+
+        /* Method call round trips to a server running in a thread */
+        assert_se(socketpair(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0, pair) >= 0);
+        assert_se(pthread_create(&server, NULL, bus_server, FD_TO_PTR(TAKE_FD(pair[0]))) == 0);
+
+        assert_se(sd_bus_new(&client) >= 0);
+        assert_se(sd_bus_set_fd(client, pair[1], pair[1]) >= 0);
+        TAKE_FD(pair[1]);
+        assert_se(sd_bus_start(client) >= 0);
+
+        benchmark_run("sd-bus-round-trip", bus_round_trip_one, client, 1);
+
+        assert_se(sd_bus_call_method(client, "org.freedesktop.systemd1", "/org/freedesktop/systemd1",
+                                     "org.freedesktop.systemd1.Manager", "Exit", NULL, NULL, NULL) >= 0);
+        assert_se(pthread_join(server, NULL) == 0);
+}
+
+int main(int argc, char *argv[]) {
+        test_setup_logging(LOG_INFO);
+
+        bench_data_structures();
+        bench_json();
+        bench_event();
+        bench_bus();
+
+        return 0;
+}
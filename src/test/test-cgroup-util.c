@@ -429,6 +429,60 @@ static void test_cg_get_keyed_attribute(void) {
         }
 }
 
+static void test_cg_parse_keyed_attribute_buffer(void) {
+        const char *vals3[3];
+        char buf[] = "populated_extra 7\n"
+                     "populated 1\n"
+                     "frozen 0\n"
+                     "last 42";
+        char empty[] = "";
+
+        log_info("/* %s */", __func__);
+
+        /* Keys must match the whole first word, missing keys are NULL, and the last line doesn't need a
+         * trailing newline */
+        assert_se(cg_parse_keyed_attribute_buffer(buf, STRV_MAKE("last", "no_such_attr", "populated"), vals3) == 2);
+        assert_se(streq(vals3[0], "42"));
+        assert_se(!vals3[1]);
+        assert_se(streq(vals3[2], "1"));
+
+        assert_se(cg_parse_keyed_attribute_buffer(empty, STRV_MAKE("populated"), vals3) == 0);
+        assert_se(!vals3[0]);
+}
+
+static void test_cg_get_keyed_attribute_buffer(void) {
+        const char *vals3[3];
+        char buf[4096], small[2];
+        int r;
+
+        log_info("/* %s */", __func__);
+
+        r = cg_get_keyed_attribute_buffer("cpu", "/init.scope", "no_such_file", STRV_MAKE("no_such_attr"), buf, sizeof(buf), vals3);
+        if (r == -ENOMEDIUM || ERRNO_IS_PRIVILEGE(r)) {
+                log_info_errno(r, "Skipping most of %s, /sys/fs/cgroup not accessible: %m", __func__);
+                return;
+        }
+
+        assert_se(r == -ENOENT);
+
+        if (access("/sys/fs/cgroup/init.scope/cpu.stat", R_OK) < 0) {
+                log_info_errno(errno, "Skipping most of %s, /init.scope/cpu.stat not accessible: %m", __func__);
+                return;
+        }
+
+        assert_se(cg_get_keyed_attribute_buffer("cpu", "/init.scope", "cpu.stat", STRV_MAKE("no_such_attr"), buf, sizeof(buf), vals3) == 0);
+        assert_se(!vals3[0]);
+
+        assert_se(cg_get_keyed_attribute_buffer("cpu", "/init.scope", "cpu.stat",
+                                                STRV_MAKE("usage_usec", "no_such_attr", "system_usec"), buf, sizeof(buf), vals3) == 2);
+        assert_se(vals3[0] && !vals3[1] && vals3[2]);
+        log_info("cpu /init.scope cpu.stat [usage_usec no_such_attr system_usec] → \"%s\", NULL, \"%s\"",
+                 vals3[0], vals3[2]);
+
+        /* The file has to fit into the buffer as a whole */
+        assert_se(cg_get_keyed_attribute_buffer("cpu", "/init.scope", "cpu.stat", STRV_MAKE("usage_usec"), small, sizeof(small), vals3) == -E2BIG);
+}
+
 int main(void) {
         test_setup_logging(LOG_DEBUG);
 
@@ -450,6 +504,8 @@ int main(void) {
         TEST_REQ_RUNNING_SYSTEMD(test_fd_is_cgroup_fs());
         test_cg_tests();
         test_cg_get_keyed_attribute();
+        test_cg_parse_keyed_attribute_buffer();
+        test_cg_get_keyed_attribute_buffer();
 
         return 0;
 }
@@ -3,8 +3,10 @@
   Copyright © 2014 Michael Marineau
 ***/
 
+#include <fcntl.h>
 #include <stdarg.h>
 #include <stdio.h>
+#include <sys/stat.h>
 
 #include "alloc-util.h"
 #include "conf-files.h"
@@ -90,6 +92,69 @@ static void test_conf_files_list(bool use_root) {
         assert_se(rm_rf(tmp_dir, REMOVE_ROOT|REMOVE_PHYSICAL) == 0);
 }
 
+static void test_conf_files_cache(void) {
+        char tmp_dir[] = "/tmp/test-conf-files-XXXXXX";
+        _cleanup_strv_free_ char **l = NULL;
+        const char *dir, *a, *b;
+        struct timespec ts[2] = {
+                { .tv_sec = 1000000000 },
+                { .tv_sec = 1000000000 },
+        };
+
+        log_info("/* %s */", __func__);
+
+        setup_test_dir(tmp_dir,
+                       "/dir/a.conf",
+                       NULL);
+
+        dir = strjoina(tmp_dir, "/dir");
+        a = strjoina(tmp_dir, "/dir/a.conf");
+        b = strjoina(tmp_dir, "/dir/b.conf");
+
+        conf_files_cache_set_enabled(true);
+
+        /* Directories modified recently are not cached, hence move the timestamp into the past */
+        assert_se(utimensat(AT_FDCWD, dir, ts, 0) >= 0);
+
+        assert_se(conf_files_list(&l, ".conf", NULL, 0, dir) == 0);
+        assert_se(strv_equal(l, STRV_MAKE(a)));
+        l = strv_free(l);
+
+        /* A modification that leaves the timestamp in place is not noticed, which shows the cache is used */
+        assert_se(write_string_file(b, "foobar", WRITE_STRING_FILE_CREATE) >= 0);
+        assert_se(utimensat(AT_FDCWD, dir, ts, 0) >= 0);
+
+        assert_se(conf_files_list(&l, ".conf", NULL, 0, dir) == 0);
+        assert_se(strv_equal(l, STRV_MAKE(a)));
+        l = strv_free(l);
+
+        /* But any change of the timestamp is */
+        ts[1].tv_nsec = 1;
+        assert_se(utimensat(AT_FDCWD, dir, ts, 0) >= 0);
+
+        assert_se(conf_files_list(&l, ".conf", NULL, 0, dir) == 0);
+        assert_se(strv_equal(l, STRV_MAKE(a, b)));
+        l = strv_free(l);
+
+        /* Flushing the cache makes us read the directory again, timestamp or not */
+        assert_se(unlink(b) >= 0);
+        assert_se(utimensat(AT_FDCWD, dir, ts, 0) >= 0);
+
+        assert_se(conf_files_list(&l, ".conf", NULL, 0, dir) == 0);
+        assert_se(strv_equal(l, STRV_MAKE(a, b)));
+        l = strv_free(l);
+
+        conf_files_cache_flush();
+
+        assert_se(conf_files_list(&l, ".conf", NULL, 0, dir) == 0);
+        assert_se(strv_equal(l, STRV_MAKE(a)));
+        l = strv_free(l);
+
+        conf_files_cache_set_enabled(false);
+
+        assert_se(rm_rf(tmp_dir, REMOVE_ROOT|REMOVE_PHYSICAL) == 0);
+}
+
 static void test_conf_files_insert(const char *root) {
         _cleanup_strv_free_ char **s = NULL;
 
@@ -149,6 +214,7 @@ int main(int argc, char **argv) {
 
         test_conf_files_list(false);
         test_conf_files_list(true);
+        test_conf_files_cache();
         test_conf_files_insert(NULL);
         test_conf_files_insert("/root");
         test_conf_files_insert("/root/");
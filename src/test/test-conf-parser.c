@@ -310,8 +310,9 @@ static const char* const config_file[] = {
         "setting1=3\n",
 };
 
-static void test_config_parse(unsigned i, const char *s) {
+static void test_config_parse(unsigned i, const char *s, bool read_ahead) {
         _cleanup_(unlink_tempfilep) char name[] = "/tmp/test-conf-parser.XXXXXX";
+        _cleanup_(config_file_freep) ConfigFile *c = NULL;
         _cleanup_fclose_ FILE *f = NULL;
         _cleanup_free_ char *setting1 = NULL;
         int r;
@@ -321,11 +322,12 @@ static void test_config_parse(unsigned i, const char *s) {
                 {}
         };
 
-        log_info("== %s[%i] ==", __func__, i);
+        log_info("== %s[%i]%s ==", __func__, i, read_ahead ? " (read ahead)" : "");
 
         assert_se(fmkostemp_safe(name, "r+", &f) == 0);
         assert_se(fwrite(s, strlen(s), 1, f) == 1);
         rewind(f);
+        fflush(f);
 
         /*
         int config_parse(const char *unit,
@@ -338,10 +340,17 @@ static void test_config_parse(unsigned i, const char *s) {
                          void *userdata)
         */
 
-        r = config_parse(NULL, name, f,
-                         "Section\0-NoWarnSection\0",
-                         config_item_table_lookup, items,
-                         CONFIG_PARSE_WARN, NULL);
+        if (read_ahead) {
+                assert_se(config_file_read(name, CONFIG_PARSE_WARN, &c) >= 0);
+                r = config_parse_file(NULL, c,
+                                      "Section\0-NoWarnSection\0",
+                                      config_item_table_lookup, items,
+                                      CONFIG_PARSE_WARN, NULL);
+        } else
+                r = config_parse(NULL, name, f,
+                                 "Section\0-NoWarnSection\0",
+                                 config_item_table_lookup, items,
+                                 CONFIG_PARSE_WARN, NULL);
 
         switch (i) {
         case 0 ... 4:
@@ -400,8 +409,10 @@ int main(int argc, char **argv) {
         test_config_parse_nsec();
         test_config_parse_iec_uint64();
 
-        for (i = 0; i < ELEMENTSOF(config_file); i++)
-                test_config_parse(i, config_file[i]);
+        for (i = 0; i < ELEMENTSOF(config_file); i++) {
+                test_config_parse(i, config_file[i], false);
+                test_config_parse(i, config_file[i], true);
+        }
 
         return 0;
 }
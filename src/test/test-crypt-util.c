@@ -0,0 +1,117 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "crypt-util.h"
+#include "fileio.h"
+#include "path-util.h"
+#include "rm-rf.h"
+#include "string-util.h"
+#include "tests.h"
+#include "tmpfile-util.h"
+
+static void test_verity_cache(const char *dir) {
+        _cleanup_(verity_cache_entry_done) VerityCacheEntry e = {}, f = {};
+        _cleanup_free_ char *path = NULL, *hash_device = NULL, *other_device = NULL, *id = NULL, *other_id = NULL;
+        static const uint8_t salt[] = { 0xde, 0xad, 0xbe, 0xef };
+
+        log_info("/* %s */", __func__);
+
+        assert_se(path = path_join(dir, "cache/entry"));
+        assert_se(hash_device = path_join(dir, "hash"));
+        assert_se(other_device = path_join(dir, "other"));
+        assert_se(write_string_file(hash_device, "", WRITE_STRING_FILE_CREATE) >= 0);
+        assert_se(write_string_file(other_device, "", WRITE_STRING_FILE_CREATE) >= 0);
+
+        assert_se(verity_hash_device_id(hash_device, &id) >= 0);
+        assert_se(verity_hash_device_id(other_device, &other_id) >= 0);
+        assert_se(!streq(id, other_id));
+        assert_se(verity_hash_device_id(dir, &f.hash_device) == -ENOTBLK);
+
+        /* Nothing cached yet */
+        assert_se(verity_cache_entry_load(path, id, &f) == 0);
+
+        e = (VerityCacheEntry) {
+                .hash_device = strdup(id),
+                .hash_name = strdup("sha256"),
+                .hash_type = 1,
+                .data_block_size = 4096,
+                .hash_block_size = 4096,
+                .data_blocks = 12345,
+                .hash_offset = 4096,
+                .salt = memdup(salt, sizeof(salt)),
+                .salt_size = sizeof(salt),
+        };
+        assert_se(e.hash_device && e.hash_name && e.salt);
+
+        /* Everything survives a round trip, and the directory is created on the way */
+        assert_se(verity_cache_entry_save(path, &e) >= 0);
+        assert_se(verity_cache_entry_load(path, id, &f) == 1);
+        assert_se(streq(f.hash_device, id));
+        assert_se(streq(f.hash_name, "sha256"));
+        assert_se(f.hash_type == 1);
+        assert_se(f.data_block_size == 4096);
+        assert_se(f.hash_block_size == 4096);
+        assert_se(f.data_blocks == 12345);
+        assert_se(f.hash_offset == 4096);
+        assert_se(f.salt_size == sizeof(salt));
+        assert_se(memcmp(f.salt, salt, sizeof(salt)) == 0);
+        verity_cache_entry_done(&f);
+
+        /* The same root hash on another hash device is not the same entry */
+        assert_se(verity_cache_entry_load(path, other_id, &f) == 0);
+
+        /* No salt at all */
+        e.salt = mfree(e.salt);
+        e.salt_size = 0;
+        assert_se(verity_cache_entry_save(path, &e) >= 0);
+        assert_se(verity_cache_entry_load(path, id, &f) == 1);
+        assert_se(!f.salt);
+        assert_se(f.salt_size == 0);
+        verity_cache_entry_done(&f);
+
+        /* Incomplete entries are refused */
+        e.data_blocks = 0;
+        assert_se(verity_cache_entry_save(path, &e) == -EINVAL);
+
+        assert_se(write_string_file(path, "HASH_DEVICE=", WRITE_STRING_FILE_CREATE|WRITE_STRING_FILE_ATOMIC) >= 0);
+        assert_se(verity_cache_entry_load(path, id, &f) == -EBADMSG);
+
+        assert_se(write_string_file(path,
+                                    strjoina("HASH_DEVICE=", id, "\n"
+                                             "HASH=sha256\n"
+                                             "HASH_TYPE=1\n"
+                                             "DATA_BLOCK_SIZE=4096\n"
+                                             "HASH_BLOCK_SIZE=foo\n"
+                                             "DATA_BLOCKS=1\n"
+                                             "HASH_OFFSET=4096\n"),
+                                    WRITE_STRING_FILE_CREATE|WRITE_STRING_FILE_ATOMIC) >= 0);
+        assert_se(verity_cache_entry_load(path, id, &f) < 0);
+
+        assert_se(unlink(path) >= 0);
+        assert_se(verity_cache_entry_load(path, id, &f) == 0);
+}
+
+static void test_verity_cache_path(void) {
+        static const uint8_t root_hash[] = { 0x01, 0x23, 0xab, 0xcd };
+        _cleanup_free_ char *p = NULL;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(verity_cache_path(root_hash, sizeof(root_hash), &p) >= 0);
+        assert_se(streq(p, "/run/systemd/verity-cache/0123abcd"));
+}
+
+int main(int argc, char *argv[]) {
+        _cleanup_(rm_rf_physical_and_freep) char *dir = NULL;
+
+        test_setup_logging(LOG_DEBUG);
+
+        assert_se(mkdtemp_malloc("/tmp/test-crypt-util.XXXXXX", &dir) >= 0);
+
+        test_verity_cache_path();
+        test_verity_cache(dir);
+
+        return 0;
+}
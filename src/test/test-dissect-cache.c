@@ -0,0 +1,186 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "architecture.h"
+#include "dissect-image.h"
+#include "fd-util.h"
+#include "fileio.h"
+#include "path-util.h"
+#include "rm-rf.h"
+#include "string-util.h"
+#include "tests.h"
+#include "tmpfile-util.h"
+
+static int parse_string(const char *text, DissectedImage **ret) {
+        _cleanup_fclose_ FILE *f = NULL;
+
+        assert_se(f = fmemopen_unlocked((void*) text, strlen(text), "r"));
+
+        return dissect_cache_parse(f, ret);
+}
+
+static void test_serialize_parse(void) {
+        _cleanup_(dissected_image_unrefp) DissectedImage *m = NULL, *n = NULL;
+        _cleanup_free_ char *text = NULL, *text2 = NULL;
+        sd_id128_t id;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(m = new0(DissectedImage, 1));
+        assert_se(sd_id128_randomize(&id) >= 0);
+
+        m->can_verity = true;
+        m->partitions[PARTITION_ROOT] = (DissectedPartition) {
+                .found = true,
+                .rw = true,
+                .partno = 2,
+                .architecture = native_architecture(),
+                .uuid = id,
+                .fstype = strdup("ext4"),
+                .node = strdup("/dev/loop7p2"),
+        };
+        m->partitions[PARTITION_HOME] = (DissectedPartition) {
+                .found = true,
+                .partno = 3,
+                .architecture = _ARCHITECTURE_INVALID,
+        };
+        assert_se(m->partitions[PARTITION_ROOT].fstype && m->partitions[PARTITION_ROOT].node);
+
+        assert_se(dissect_cache_serialize(m, &text) >= 0);
+        log_debug("%s", text);
+
+        assert_se(parse_string(text, &n) >= 0);
+        assert_se(!n->encrypted);
+        assert_se(!n->verity);
+        assert_se(n->can_verity);
+
+        assert_se(n->partitions[PARTITION_ROOT].found);
+        assert_se(n->partitions[PARTITION_ROOT].rw);
+        assert_se(n->partitions[PARTITION_ROOT].partno == 2);
+        assert_se(n->partitions[PARTITION_ROOT].architecture == native_architecture());
+        assert_se(sd_id128_equal(n->partitions[PARTITION_ROOT].uuid, id));
+        assert_se(streq(n->partitions[PARTITION_ROOT].fstype, "ext4"));
+
+        /* The node depends on the loop device, hence isn't cached */
+        assert_se(!n->partitions[PARTITION_ROOT].node);
+
+        assert_se(n->partitions[PARTITION_HOME].found);
+        assert_se(!n->partitions[PARTITION_HOME].rw);
+        assert_se(n->partitions[PARTITION_HOME].architecture == _ARCHITECTURE_INVALID);
+        assert_se(sd_id128_is_null(n->partitions[PARTITION_HOME].uuid));
+        assert_se(!n->partitions[PARTITION_HOME].fstype);
+
+        assert_se(!n->partitions[PARTITION_SRV].found);
+
+        /* And once more, to make sure nothing got lost */
+        assert_se(dissect_cache_serialize(n, &text2) >= 0);
+        assert_se(streq(text, text2));
+}
+
+static void test_parse_invalid(void) {
+        _cleanup_fclose_ FILE *f = NULL;
+        DissectedImage *m = NULL;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(parse_string("FOO=bar\n", &m) == -EBADMSG);
+        assert_se(parse_string("VERITY=maybe\n", &m) < 0);
+        assert_se(parse_string("PARTITION=root 1 yes - 00000000-0000-0000-0000-000000000000\n", &m) == -EBADMSG);
+        assert_se(parse_string("PARTITION=root 1 yes - 00000000-0000-0000-0000-000000000000 ext4 foo\n", &m) == -EBADMSG);
+        assert_se(parse_string("PARTITION=foo 1 yes - 00000000-0000-0000-0000-000000000000 ext4\n", &m) == -EBADMSG);
+        assert_se(parse_string("PARTITION=root 1 yes foo 00000000-0000-0000-0000-000000000000 ext4\n", &m) == -EBADMSG);
+        assert_se(parse_string("PARTITION=root x yes - 00000000-0000-0000-0000-000000000000 ext4\n", &m) < 0);
+        assert_se(parse_string("PARTITION=root 1 yes - foo ext4\n", &m) < 0);
+
+        /* Each partition is listed only once */
+        assert_se(parse_string("PARTITION=root 1 yes - 00000000-0000-0000-0000-000000000000 ext4\n"
+                               "PARTITION=root 2 yes - 00000000-0000-0000-0000-000000000000 ext4\n", &m) == -EBADMSG);
+
+        assert_se(!m);
+
+        /* An empty file is a valid image without anything on it */
+        f = fopen("/dev/null", "re");
+        assert_se(f);
+        assert_se(dissect_cache_parse(f, &m) >= 0);
+        assert_se(m);
+        assert_se(!m->partitions[PARTITION_ROOT].found);
+        dissected_image_unref(m);
+}
+
+static void make_entry(const char *dir, const char *name, time_t mtime) {
+        struct timespec ts[2] = {
+                { .tv_sec = mtime },
+                { .tv_sec = mtime },
+        };
+        const char *p;
+
+        p = prefix_roota(dir, name);
+        assert_se(write_string_file(p, "", WRITE_STRING_FILE_CREATE) >= 0);
+        assert_se(utimensat(AT_FDCWD, p, ts, 0) >= 0);
+}
+
+static bool has_entry(const char *dir, const char *name) {
+        return access(prefix_roota(dir, name), F_OK) >= 0;
+}
+
+static void test_prune(void) {
+        _cleanup_(rm_rf_physical_and_freep) char *dir = NULL;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(mkdtemp_malloc("/tmp/test-dissect-cache.XXXXXX", &dir) >= 0);
+
+        /* A missing directory has nothing to prune */
+        assert_se(dissect_cache_prune(prefix_roota(dir, "missing"), NULL, 1) == 0);
+
+        /* Older versions of the same image can never match again, and go right away, even if there's
+         * plenty of room. Other images with the same inode on another device stay. */
+        make_entry(dir, "801-c-1000-100-0-0-0-", 1000);
+        make_entry(dir, "801-c-2000-100-0-0-0-", 2000);
+        make_entry(dir, "801-c-3000-100-0-0-0-", 3000);
+        make_entry(dir, "802-c-1000-100-0-0-0-", 1000);
+        make_entry(dir, "801-cc-1000-100-0-0-0-", 1000);
+        make_entry(dir, ".#801-c-0-100-0-0-0-tmp", 1000);
+
+        assert_se(dissect_cache_prune(dir, "801-c-3000-100-0-0-0-", 64) >= 0);
+        assert_se(!has_entry(dir, "801-c-1000-100-0-0-0-"));
+        assert_se(!has_entry(dir, "801-c-2000-100-0-0-0-"));
+        assert_se(has_entry(dir, "801-c-3000-100-0-0-0-"));
+        assert_se(has_entry(dir, "802-c-1000-100-0-0-0-"));
+        assert_se(has_entry(dir, "801-cc-1000-100-0-0-0-"));
+
+        /* Files in the middle of being written are left alone */
+        assert_se(has_entry(dir, ".#801-c-0-100-0-0-0-tmp"));
+
+        /* Beyond the limit the entries written longest ago go, but never the one just saved, even if it is
+         * older than the rest */
+        make_entry(dir, "803-1-1000-100-0-0-0-", 4000);
+        make_entry(dir, "804-1-1000-100-0-0-0-", 5000);
+
+        assert_se(dissect_cache_prune(dir, "801-c-3000-100-0-0-0-", 3) >= 0);
+        assert_se(has_entry(dir, "801-c-3000-100-0-0-0-"));
+        assert_se(!has_entry(dir, "802-c-1000-100-0-0-0-"));
+        assert_se(!has_entry(dir, "801-cc-1000-100-0-0-0-"));
+        assert_se(has_entry(dir, "803-1-1000-100-0-0-0-"));
+        assert_se(has_entry(dir, "804-1-1000-100-0-0-0-"));
+
+        /* Without anything to keep only the limit applies */
+        assert_se(dissect_cache_prune(dir, NULL, 1) >= 0);
+        assert_se(!has_entry(dir, "801-c-3000-100-0-0-0-"));
+        assert_se(!has_entry(dir, "803-1-1000-100-0-0-0-"));
+        assert_se(has_entry(dir, "804-1-1000-100-0-0-0-"));
+}
+
+int main(int argc, char *argv[]) {
+        test_setup_logging(LOG_DEBUG);
+
+        test_serialize_parse();
+        test_parse_invalid();
+        test_prune();
+
+        return 0;
+}
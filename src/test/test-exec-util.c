@@ -416,6 +416,110 @@ static void test_error_catching(void) {
         assert_se(r == 42);
 }
 
+static void test_execution_times(void) {
+        char template[] = "/tmp/test-exec-util.XXXXXXX";
+        const char *dirs[] = {template, NULL};
+        const char *name, *name2, *name3;
+        ExecDirTiming *timings = NULL;
+        size_t n_timings = 0, i;
+        char buf[FORMAT_TIMESPAN_MAX];
+        int r;
+
+        assert_se(mkdtemp(template));
+
+        log_info("/* %s */", __func__);
+
+        name = strjoina(template, "/10-slow");
+        name2 = strjoina(template, "/20-fail");
+        name3 = strjoina(template, "/30 with space");
+
+        assert_se(write_string_file(name,
+                                    "#!/bin/sh\nsleep 0.5\n",
+                                    WRITE_STRING_FILE_CREATE) == 0);
+        assert_se(write_string_file(name2,
+                                    "#!/bin/sh\nexit 3\n",
+                                    WRITE_STRING_FILE_CREATE) == 0);
+        assert_se(write_string_file(name3,
+                                    "#!/bin/sh\nexit 0\n",
+                                    WRITE_STRING_FILE_CREATE) == 0);
+
+        assert_se(chmod(name, 0755) == 0);
+        assert_se(chmod(name2, 0755) == 0);
+        assert_se(chmod(name3, 0755) == 0);
+
+        if (access(name, X_OK) < 0 && ERRNO_IS_PRIVILEGE(errno))
+                return;
+
+        r = execute_directories_full(dirs, DEFAULT_TIMEOUT_USEC, NULL, NULL, NULL, NULL,
+                                     EXEC_DIR_PARALLEL | EXEC_DIR_IGNORE_ERRORS, &timings, &n_timings);
+        assert_se(r == 0);
+        assert_se(n_timings == 3);
+
+        for (i = 0; i < n_timings; i++) {
+                log_info("%s: %s, status %i", timings[i].name,
+                         format_timespan(buf, sizeof(buf), timings[i].finish - timings[i].start, 1), timings[i].status);
+                assert_se(timings[i].start <= timings[i].finish);
+        }
+
+        /* Records are written in the order the executables finish */
+        assert_se(streq(timings[2].name, "10-slow"));
+        assert_se(timings[2].status == 0);
+        assert_se(timings[2].finish - timings[2].start >= 500 * USEC_PER_MSEC);
+
+        for (i = 0; i < 2; i++)
+                if (streq(timings[i].name, "20-fail"))
+                        assert_se(timings[i].status == 3);
+                else {
+                        assert_se(streq(timings[i].name, "30 with space"));
+                        assert_se(timings[i].status == 0);
+                }
+
+        exec_dir_timings_free(timings, n_timings);
+
+        (void) rm_rf(template, REMOVE_ROOT|REMOVE_PHYSICAL);
+}
+
+static void test_execution_times_timeout(void) {
+        char template[] = "/tmp/test-exec-util.XXXXXXX";
+        const char *dirs[] = {template, NULL};
+        const char *name, *name2;
+        ExecDirTiming *timings = NULL;
+        size_t n_timings = 0;
+        int r;
+
+        assert_se(mkdtemp(template));
+
+        log_info("/* %s */", __func__);
+
+        name = strjoina(template, "/10-fast");
+        name2 = strjoina(template, "/20-hang");
+
+        assert_se(write_string_file(name,
+                                    "#!/bin/sh\nexit 0\n",
+                                    WRITE_STRING_FILE_CREATE) == 0);
+        assert_se(write_string_file(name2,
+                                    "#!/bin/sh\nsleep 10\n",
+                                    WRITE_STRING_FILE_CREATE) == 0);
+
+        assert_se(chmod(name, 0755) == 0);
+        assert_se(chmod(name2, 0755) == 0);
+
+        if (access(name, X_OK) < 0 && ERRNO_IS_PRIVILEGE(errno))
+                return;
+
+        /* The executor is killed by the timeout, but what finished before that is still reported */
+        r = execute_directories_full(dirs, USEC_PER_SEC, NULL, NULL, NULL, NULL,
+                                     EXEC_DIR_PARALLEL | EXEC_DIR_IGNORE_ERRORS, &timings, &n_timings);
+        assert_se(r == -EPROTO);
+        assert_se(n_timings == 1);
+        assert_se(streq(timings[0].name, "10-fast"));
+        assert_se(timings[0].status == 0);
+
+        exec_dir_timings_free(timings, n_timings);
+
+        (void) rm_rf(template, REMOVE_ROOT|REMOVE_PHYSICAL);
+}
+
 static void test_exec_command_flags_from_strv(void) {
         ExecCommandFlags flags = 0;
         char **valid_strv = STRV_MAKE("no-env-expand", "no-setuid", "ignore-failure");
@@ -469,6 +573,8 @@ int main(int argc, char *argv[]) {
         test_stdout_gathering();
         test_environment_gathering();
         test_error_catching();
+        test_execution_times();
+        test_execution_times_timeout();
         test_exec_command_flags_from_strv();
         test_exec_command_flags_to_strv();
 
@@ -809,6 +809,49 @@ static void test_read_line4(void) {
         }
 }
 
+static void test_line_reader_one(const char *data, size_t size, size_t limit, ReadLineFlags flags) {
+        _cleanup_fclose_ FILE *f = NULL, *g = NULL;
+        _cleanup_(line_reader_done) LineReader reader = {};
+        int r, q;
+
+        assert_se(f = fmemopen_unlocked((void*) data, size, "r"));
+        assert_se(g = fmemopen_unlocked((void*) data, size, "r"));
+        reader.f = g;
+
+        /* Both ways of reading lines must give the same results, also where limits are hit */
+        do {
+                _cleanup_free_ char *a = NULL, *b = NULL;
+
+                r = read_line_full(f, limit, flags, &a);
+                q = line_reader_read(&reader, limit, flags, &b);
+                assert_se(r == q);
+                assert_se(r < 0 || streq(a, b));
+        } while (r != 0);
+}
+
+static void test_line_reader(void) {
+        _cleanup_free_ char *data = NULL;
+        size_t i, k;
+
+        log_info("/* %s */", __func__);
+
+        test_line_reader_one(buffer, sizeof(buffer), (size_t) -1, 0);
+        test_line_reader_one(buffer, sizeof(buffer), 16, 0);
+        test_line_reader_one(buffer, sizeof(buffer), (size_t) -1, READ_LINE_ONLY_NUL);
+
+        /* Put line endings right at the end of the blocks read ahead */
+        assert_se(data = new(char, LINE_READER_BUFFER_SIZE + sizeof(buffer)));
+        for (k = 0; k < 24; k++) {
+                for (i = 0; i < LINE_READER_BUFFER_SIZE - k; i++)
+                        data[i] = i % 80 == 79 ? '\n' : 'a' + i % 26;
+                memcpy(data + i, buffer, sizeof(buffer));
+
+                test_line_reader_one(data, i + sizeof(buffer), (size_t) -1, 0);
+                test_line_reader_one(data, i + sizeof(buffer), LINE_MAX, 0);
+                test_line_reader_one(data, i + sizeof(buffer), (size_t) -1, READ_LINE_ONLY_NUL);
+        }
+}
+
 static void test_read_nul_string(void) {
         static const char test[] = "string nr. 1\0"
                 "string nr. 2\n\0"
@@ -867,6 +910,7 @@ int main(int argc, char *argv[]) {
         test_read_line2();
         test_read_line3();
         test_read_line4();
+        test_line_reader();
         test_read_nul_string();
 
         return 0;
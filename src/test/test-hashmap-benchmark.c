@@ -0,0 +1,140 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <stdio.h>
+
+#include "alloc-util.h"
+#include "hashmap.h"
+#include "parse-util.h"
+#include "stdio-util.h"
+#include "string-util.h"
+#include "tests.h"
+#include "time-util.h"
+
+/* Looks up keys in hashmaps over and over, the way PID 1 looks up units by name, journal clients look up
+ * field names, or udevd and journald look up their workers and clients by PID. Both hits and misses are
+ * measured, since the latter have to probe until the end of the run of entries. Optionally, the number of
+ * entries may be passed. */
+
+static usec_t arg_duration = 2 * USEC_PER_SEC;
+
+static void run(const char *what, Hashmap *h, void **keys, size_t n_keys) {
+        char buf[FORMAT_TIMESPAN_MAX];
+        size_t n_lookups = 0, n_found = 0;
+        usec_t start, elapsed;
+
+        start = now(CLOCK_MONOTONIC);
+        do {
+                size_t i;
+
+                for (i = 0; i < n_keys; i++)
+                        n_found += !!hashmap_get(h, keys[i]);
+
+                n_lookups += n_keys;
+                elapsed = now(CLOCK_MONOTONIC) - start;
+        } while (elapsed < arg_duration);
+
+        log_info("%-34s %zu lookups, %zu found, in %s, %.1f ns per lookup",
+                 what, n_lookups, n_found, format_timespan(buf, sizeof(buf), elapsed, USEC_PER_MSEC),
+                 (double) elapsed * NSEC_PER_USEC / n_lookups);
+}
+
+static void bench_strings(const char *what, const struct hash_ops *ops, unsigned n) {
+        _cleanup_hashmap_free_free_ Hashmap *h = NULL;
+        _cleanup_free_ char **present = NULL, **missing = NULL;
+        char buf[FORMAT_TIMESPAN_MAX], title[64];
+        usec_t start;
+        unsigned i;
+
+        assert_se(present = new(char*, n));
+        assert_se(missing = new(char*, n));
+
+        for (i = 0; i < n; i++) {
+                assert_se(asprintf(&present[i], "user-runtime-dir@%u.service", i) >= 0);
+                assert_se(asprintf(&missing[i], "user@%u.service", i) >= 0);
+        }
+
+        /* Filling the hashmap includes all the resizes on the way */
+        start = now(CLOCK_MONOTONIC);
+        assert_se(h = hashmap_new(ops));
+        for (i = 0; i < n; i++)
+                assert_se(hashmap_put(h, present[i], present[i]) > 0);
+        log_info("%-34s %u entries put in %s", strjoina(what, ":"), n,
+                 format_timespan(buf, sizeof(buf), now(CLOCK_MONOTONIC) - start, 1));
+
+        xsprintf(title, "%s, present:", what);
+        run(title, h, (void**) present, n);
+        xsprintf(title, "%s, missing:", what);
+        run(title, h, (void**) missing, n);
+
+        for (i = 0; i < n; i++)
+                free(missing[i]);
+}
+
+static void bench_fields(const char *what, const struct hash_ops *ops) {
+        static const char* const fields[] = {
+                "MESSAGE", "MESSAGE_ID", "PRIORITY", "CODE_FILE", "CODE_LINE", "CODE_FUNC", "ERRNO",
+                "INVOCATION_ID", "USER_INVOCATION_ID", "SYSLOG_FACILITY", "SYSLOG_IDENTIFIER", "SYSLOG_PID",
+                "SYSLOG_TIMESTAMP", "SYSLOG_RAW", "DOCUMENTATION", "TID", "_PID", "_UID", "_GID", "_COMM",
+                "_EXE", "_CMDLINE", "_CAP_EFFECTIVE", "_AUDIT_SESSION", "_AUDIT_LOGINUID", "_SYSTEMD_CGROUP",
+                "_SYSTEMD_SLICE", "_SYSTEMD_UNIT", "_SYSTEMD_USER_UNIT", "_SYSTEMD_USER_SLICE",
+                "_SYSTEMD_SESSION", "_SYSTEMD_OWNER_UID", "_SELINUX_CONTEXT", "_SOURCE_REALTIME_TIMESTAMP",
+                "_BOOT_ID", "_MACHINE_ID", "_SYSTEMD_INVOCATION_ID", "_HOSTNAME", "_TRANSPORT",
+                "_STREAM_ID", "_LINE_BREAK", "_NAMESPACE",
+        };
+        static const char* const missing[] = {
+                "MESSAGE_", "PRIORITY_", "CODE_FILENAME", "_PPID", "_SYSTEMD_UNIT_", "FOO", "BAR",
+                "_HOSTNAMES", "SYSLOG", "_BOOT",
+        };
+        _cleanup_hashmap_free_ Hashmap *h = NULL;
+        char title[64];
+        size_t i;
+
+        assert_se(h = hashmap_new(ops));
+        for (i = 0; i < ELEMENTSOF(fields); i++)
+                assert_se(hashmap_put(h, fields[i], (void*) fields[i]) > 0);
+
+        xsprintf(title, "%s, present:", what);
+        run(title, h, (void**) fields, ELEMENTSOF(fields));
+        xsprintf(title, "%s, missing:", what);
+        run(title, h, (void**) missing, ELEMENTSOF(missing));
+}
+
+static void bench_pids(unsigned n) {
+        _cleanup_hashmap_free_ Hashmap *h = NULL;
+        _cleanup_free_ void **present = NULL, **missing = NULL;
+        unsigned i;
+
+        assert_se(h = hashmap_new(NULL));
+        assert_se(present = new(void*, n));
+        assert_se(missing = new(void*, n));
+
+        /* PIDs handed out by the kernel are mostly sequential */
+        for (i = 0; i < n; i++) {
+                present[i] = UINT_TO_PTR(1000 + 2 * i);
+                missing[i] = UINT_TO_PTR(1000 + 2 * i + 1);
+                assert_se(hashmap_put(h, present[i], present[i]) > 0);
+        }
+
+        run("pointers, present:", h, present, n);
+        run("pointers, missing:", h, missing, n);
+}
+
+int main(int argc, char *argv[]) {
+        unsigned n = 10000;
+
+        test_setup_logging(LOG_INFO);
+
+        if (argc > 1)
+                assert_se(safe_atou(argv[1], &n) >= 0 && n > 0);
+
+        log_info("Looking up keys in hashmaps with %u entries...", n);
+
+        bench_strings("strings", &string_hash_ops, n);
+        bench_strings("strings, cached hashes", &string_hash_ops_cached, n);
+        bench_strings("strings, trusted hash", &string_hash_ops_trusted, n);
+        bench_fields("fields", &string_hash_ops);
+        bench_fields("fields, trusted hash", &string_hash_ops_trusted);
+        bench_pids(n);
+
+        return 0;
+}
@@ -1,6 +1,7 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
 #include "alloc-util.h"
+#include "fast-hash.h"
 #include "hashmap.h"
 #include "log.h"
 #include "nulstr-util.h"
@@ -735,6 +736,18 @@ static const struct hash_ops crippled_hashmap_ops = {
         .compare = trivial_compare_func,
 };
 
+static const struct hash_ops cached_hashmap_ops = {
+        .hash = trivial_hash_func,
+        .compare = trivial_compare_func,
+        .cache_hash = true,
+};
+
+static const struct hash_ops cached_crippled_hashmap_ops = {
+        .hash = crippled_hashmap_func,
+        .compare = trivial_compare_func,
+        .cache_hash = true,
+};
+
 static void test_hashmap_many(void) {
         Hashmap *h;
         unsigned i, j;
@@ -745,8 +758,10 @@ static void test_hashmap_many(void) {
                 const struct hash_ops *ops;
                 unsigned n_entries;
         } tests[] = {
-                { "trivial_hashmap_ops",  NULL,                  slow ? 1 << 20 : 240 },
-                { "crippled_hashmap_ops", &crippled_hashmap_ops, slow ? 1 << 14 : 140 },
+                { "trivial_hashmap_ops",         NULL,                         slow ? 1 << 20 : 240 },
+                { "crippled_hashmap_ops",        &crippled_hashmap_ops,        slow ? 1 << 14 : 140 },
+                { "cached_hashmap_ops",          &cached_hashmap_ops,          slow ? 1 << 20 : 240 },
+                { "cached_crippled_hashmap_ops", &cached_crippled_hashmap_ops, slow ? 1 << 14 : 140 },
         };
 
         log_info("/* %s (%s) */", __func__, slow ? "slow" : "fast");
@@ -784,6 +799,108 @@ static void test_hashmap_many(void) {
         }
 }
 
+static void test_hashmap_cached_hash(void) {
+        _cleanup_hashmap_free_free_ Hashmap *h = NULL;
+        char key[STRLEN("unit-.service") + DECIMAL_STR_MAX(unsigned)];
+        unsigned i;
+        char *k;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(h = hashmap_new(&string_hash_ops_cached));
+
+        /* Grow through many resizes, and check that everything is still found afterwards */
+        for (i = 0; i < 2000; i++) {
+                assert_se(asprintf(&k, "unit-%u.service", i) >= 0);
+                assert_se(hashmap_put(h, k, k) == 1);
+        }
+
+        for (i = 0; i < 2000; i++) {
+                xsprintf(key, "unit-%u.service", i);
+                assert_se(streq_ptr(hashmap_get(h, key), key));
+
+                xsprintf(key, "unit-%u.socket", i);
+                assert_se(!hashmap_get(h, key));
+        }
+
+        /* Removal moves entries around, and rekeying puts them elsewhere */
+        for (i = 0; i < 2000; i += 2) {
+                xsprintf(key, "unit-%u.service", i);
+                free(hashmap_remove(h, key));
+        }
+
+        for (i = 1; i < 2000; i += 4) {
+                char *old;
+
+                xsprintf(key, "unit-%u.service", i);
+                assert_se(old = hashmap_get(h, key));
+                assert_se(asprintf(&k, "unit-%u.target", i) >= 0);
+                assert_se(hashmap_remove_and_put(h, key, k, k) == 0);
+                free(old);
+        }
+
+        assert_se(hashmap_size(h) == 1000);
+
+        for (i = 0; i < 2000; i++) {
+                xsprintf(key, "unit-%u.service", i);
+                assert_se(!!hashmap_get(h, key) == (i % 4 == 3));
+
+                xsprintf(key, "unit-%u.target", i);
+                assert_se(!!hashmap_get(h, key) == (i % 4 == 1));
+        }
+
+        assert_se(hashmap_reserve(h, 10000) >= 0);
+        xsprintf(key, "unit-%u.service", 1999);
+        assert_se(streq_ptr(hashmap_get(h, key), key));
+}
+
+static void test_hashmap_trusted_hash(void) {
+        _cleanup_hashmap_free_free_ Hashmap *h = NULL;
+        char key[STRLEN("_FIELD_") + DECIMAL_STR_MAX(unsigned)];
+        unsigned i;
+        char *k;
+
+        log_info("/* %s */", __func__);
+
+        /* Every length up to and beyond the 48 byte block size, every seed gives different values */
+        for (i = 0; i <= 100; i++) {
+                const char *s = "0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ"
+                                "0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ";
+
+                assert_se(fast_hash(s, i, 0) == fast_hash(s, i, 0));
+                assert_se(fast_hash(s, i, 0) != fast_hash(s, i, 1));
+                if (i > 0)
+                        assert_se(fast_hash(s, i, 0) != fast_hash(s, i - 1, 0));
+        }
+
+        assert_se(h = hashmap_new(&string_hash_ops_trusted));
+
+        for (i = 0; i < 2000; i++) {
+                assert_se(asprintf(&k, "_FIELD_%u", i) >= 0);
+                assert_se(hashmap_put(h, k, k) == 1);
+        }
+
+        for (i = 0; i < 2000; i++) {
+                xsprintf(key, "_FIELD_%u", i);
+                assert_se(streq_ptr(hashmap_get(h, key), key));
+
+                xsprintf(key, "FIELD_%u", i);
+                assert_se(!hashmap_get(h, key));
+        }
+
+        for (i = 0; i < 2000; i += 2) {
+                xsprintf(key, "_FIELD_%u", i);
+                free(hashmap_remove(h, key));
+        }
+
+        assert_se(hashmap_size(h) == 1000);
+
+        for (i = 0; i < 2000; i++) {
+                xsprintf(key, "_FIELD_%u", i);
+                assert_se(!!hashmap_get(h, key) == (i % 2 == 1));
+        }
+}
+
 extern unsigned custom_counter;
 extern const struct hash_ops boring_hash_ops, custom_hash_ops;
 
@@ -1003,6 +1120,47 @@ static void test_hashmap_reserve(void) {
         assert_se(hashmap_reserve(m, UINT_MAX - 1) == -ENOMEM);
 }
 
+static void test_hashmap_put_many(void) {
+        _cleanup_hashmap_free_ Hashmap *m = NULL, *n = NULL;
+        void *keys[2000], *values[2000];
+        unsigned i;
+
+        log_info("/* %s */", __func__);
+
+        /* Sorted keys into an empty hashmap take the fast path */
+        for (i = 0; i < ELEMENTSOF(keys); i++) {
+                keys[i] = UINT_TO_PTR(i + 1);
+                values[i] = UINT_TO_PTR(i * 2);
+        }
+
+        assert_se(hashmap_ensure_put_many(&m, NULL, keys, values, ELEMENTSOF(keys)) == (int) ELEMENTSOF(keys));
+        assert_se(hashmap_size(m) == ELEMENTSOF(keys));
+        for (i = 0; i < ELEMENTSOF(keys); i++)
+                assert_se(hashmap_get(m, keys[i]) == values[i]);
+        assert_se(!hashmap_get(m, UINT_TO_PTR(ELEMENTSOF(keys) + 1)));
+
+        /* Putting them again is a NOP, a different value for a key already present is refused */
+        assert_se(hashmap_put_many(m, keys, values, ELEMENTSOF(keys)) == 0);
+        values[10] = UINT_TO_PTR(1);
+        assert_se(hashmap_put_many(m, keys, values, ELEMENTSOF(keys)) == -EEXIST);
+        assert_se(hashmap_size(m) == ELEMENTSOF(keys));
+
+        /* Unsorted keys with duplicates */
+        for (i = 0; i < ELEMENTSOF(keys); i++) {
+                keys[i] = UINT_TO_PTR((i * 7919) % 1000 + 1);
+                values[i] = keys[i];
+        }
+
+        assert_se(n = hashmap_new(NULL));
+        assert_se(hashmap_put(n, UINT_TO_PTR(1), UINT_TO_PTR(1)) == 1);
+        assert_se(hashmap_put_many(n, keys, values, ELEMENTSOF(keys)) == 999);
+        assert_se(hashmap_size(n) == 1000);
+        for (i = 1; i <= 1000; i++)
+                assert_se(hashmap_get(n, UINT_TO_PTR(i)) == UINT_TO_PTR(i));
+
+        assert_se(hashmap_put_many(n, NULL, NULL, 0) == 0);
+}
+
 static void test_path_hashmap(void) {
         _cleanup_hashmap_free_ Hashmap *h = NULL;
 
@@ -1085,6 +1243,8 @@ void test_hashmap_funcs(void) {
         test_hashmap_get2();
         test_hashmap_size();
         test_hashmap_many();
+        test_hashmap_cached_hash();
+        test_hashmap_trusted_hash();
         test_hashmap_free();
         test_hashmap_free_with_destructor();
         test_hashmap_first();
@@ -1094,6 +1254,7 @@ void test_hashmap_funcs(void) {
         test_hashmap_clear_free_free();
         test_hashmap_clear_free_with_destructor();
         test_hashmap_reserve();
+        test_hashmap_put_many();
         test_path_hashmap();
         test_string_strv_hashmap();
 }
@@ -0,0 +1,135 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <stdio.h>
+
+#include "sd-device.h"
+#include "sd-hwdb.h"
+
+#include "alloc-util.h"
+#include "device-util.h"
+#include "fd-util.h"
+#include "fileio.h"
+#include "string-util.h"
+#include "strv.h"
+#include "tests.h"
+#include "time-util.h"
+
+/* Looks up a set of modalias strings in the installed hwdb.bin over and over, the way udevd does for every
+ * uevent. By default, the modaliases of all devices of the running system are used. Alternatively, files with
+ * one modalias per line may be passed. */
+
+static usec_t arg_duration = 5 * USEC_PER_SEC;
+
+static int collect_system_modaliases(char ***ret) {
+        _cleanup_(sd_device_enumerator_unrefp) sd_device_enumerator *e = NULL;
+        _cleanup_strv_free_ char **l = NULL;
+        sd_device *d;
+        int r;
+
+        r = sd_device_enumerator_new(&e);
+        if (r < 0)
+                return r;
+
+        r = sd_device_enumerator_allow_uninitialized(e);
+        if (r < 0)
+                return r;
+
+        FOREACH_DEVICE(e, d) {
+                const char *modalias;
+
+                if (sd_device_get_property_value(d, "MODALIAS", &modalias) < 0 &&
+                    sd_device_get_sysattr_value(d, "modalias", &modalias) < 0)
+                        continue;
+
+                r = strv_extend(&l, modalias);
+                if (r < 0)
+                        return r;
+        }
+
+        *ret = TAKE_PTR(l);
+        return 0;
+}
+
+static int collect_file_modaliases(char **files, char ***ret) {
+        _cleanup_strv_free_ char **l = NULL;
+        char **f;
+        int r;
+
+        STRV_FOREACH(f, files) {
+                _cleanup_fclose_ FILE *file = NULL;
+
+                file = fopen(*f, "re");
+                if (!file)
+                        return log_error_errno(errno, "Failed to open %s: %m", *f);
+
+                for (;;) {
+                        _cleanup_free_ char *line = NULL;
+
+                        r = read_line(file, LONG_LINE_MAX, &line);
+                        if (r < 0)
+                                return log_error_errno(r, "Failed to read %s: %m", *f);
+                        if (r == 0)
+                                break;
+
+                        if (isempty(line))
+                                continue;
+
+                        r = strv_consume(&l, TAKE_PTR(line));
+                        if (r < 0)
+                                return r;
+                }
+        }
+
+        *ret = TAKE_PTR(l);
+        return 0;
+}
+
+int main(int argc, char *argv[]) {
+        _cleanup_(sd_hwdb_unrefp) sd_hwdb *hwdb = NULL;
+        _cleanup_strv_free_ char **modaliases = NULL;
+        size_t n_modaliases, n_lookups = 0, n_properties = 0;
+        char buf[FORMAT_TIMESPAN_MAX];
+        usec_t start, elapsed;
+        char **m;
+        int r;
+
+        test_setup_logging(LOG_INFO);
+
+        r = sd_hwdb_new(&hwdb);
+        if (r < 0)
+                return log_tests_skipped_errno(r, "cannot open hwdb");
+
+        if (argc > 1)
+                r = collect_file_modaliases(argv + 1, &modaliases);
+        else
+                r = collect_system_modaliases(&modaliases);
+        if (r < 0)
+                return log_error_errno(r, "Failed to collect modaliases: %m");
+
+        n_modaliases = strv_length(modaliases);
+        if (n_modaliases == 0)
+                return log_tests_skipped("no modaliases found");
+
+        log_info("Looking up %zu modaliases for %s...", n_modaliases, format_timespan(buf, sizeof(buf), arg_duration, 0));
+
+        start = now(CLOCK_MONOTONIC);
+        do {
+                STRV_FOREACH(m, modaliases) {
+                        const char *key, *value;
+
+                        SD_HWDB_FOREACH_PROPERTY(hwdb, *m, key, value)
+                                n_properties++;
+
+                        n_lookups++;
+                }
+
+                elapsed = now(CLOCK_MONOTONIC) - start;
+        } while (elapsed < arg_duration);
+
+        log_info("%zu lookups, %zu properties found, %.1f lookups/s, %.2f µs per lookup",
+                 n_lookups, n_properties,
+                 (double) n_lookups * USEC_PER_SEC / elapsed,
+                 (double) elapsed / n_lookups);
+
+        return 0;
+}
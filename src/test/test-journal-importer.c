@@ -5,11 +5,15 @@
 #include <fcntl.h>
 
 #include "alloc-util.h"
+#include "fd-util.h"
+#include "io-util.h"
 #include "log.h"
 #include "journal-importer.h"
 #include "path-util.h"
 #include "string-util.h"
 #include "tests.h"
+#include "tmpfile-util.h"
+#include "unaligned.h"
 
 static void assert_iovec_entry(const struct iovec *iovec, const char* content) {
         assert_se(strlen(content) == iovec->iov_len);
@@ -68,11 +72,103 @@ static void test_bad_input(void) {
         assert_se(journal_importer_eof(&imp));
 }
 
+static size_t append_binary_field(uint8_t *buf, size_t n, const char *field) {
+        unaligned_write_le32(buf + n, strlen(field));
+        memcpy(buf + n + sizeof(uint32_t), field, strlen(field));
+        return n + sizeof(uint32_t) + strlen(field);
+}
+
+static int binary_importer_for(const uint8_t *buf, size_t n) {
+        int fd;
+
+        fd = open_tmpfile_unlinkable(NULL, O_RDWR|O_CLOEXEC);
+        assert_se(fd >= 0);
+        assert_se(loop_write(fd, buf, n, false) >= 0);
+        assert_se(lseek(fd, 0, SEEK_SET) == 0);
+
+        return fd;
+}
+
+static void test_binary_parsing(void) {
+        _cleanup_(journal_importer_cleanup) JournalImporter imp = JOURNAL_IMPORTER_INIT(-1);
+        const sd_id128_t boot_id = SD_ID128_MAKE(15,31,fd,22,ec,84,42,9e,85,ae,88,8b,12,fa,db,91);
+        uint8_t buf[512];
+        size_t n;
+        int r;
+
+        log_info("/* %s */", __func__);
+
+        n = sizeof(uint64_t);
+        unaligned_write_le64(buf + n, 1478389147837945);
+        unaligned_write_le64(buf + n + sizeof(uint64_t), 0);
+        memcpy(buf + n + 2 * sizeof(uint64_t), &boot_id, sizeof(boot_id));
+        n += JOURNAL_BINARY_ENTRY_HEADER_SIZE;
+
+        n = append_binary_field(buf, n, "_BOOT_ID=1531fd22ec84429e85ae888b12fadb91");
+        n = append_binary_field(buf, n, COREDUMP_PROC_GROUP);
+        n = append_binary_field(buf, n, "lowercase=ignored");
+        n = append_binary_field(buf, n, "EMPTY=");
+        unaligned_write_le64(buf, n - sizeof(uint64_t));
+
+        imp.fd = binary_importer_for(buf, n);
+        imp.binary = true;
+
+        do
+                r = journal_importer_process_data(&imp);
+        while (r == 0 && !journal_importer_eof(&imp));
+        assert_se(r == 1);
+
+        assert_se(imp.ts.realtime == 1478389147837945);
+        assert_se(imp.ts.monotonic == 0);
+        assert_se(sd_id128_equal(imp.boot_id, boot_id));
+
+        assert_se(imp.iovw.count == 3);
+        assert_iovec_entry(&imp.iovw.iovec[0], "_BOOT_ID=1531fd22ec84429e85ae888b12fadb91");
+        assert_iovec_entry(&imp.iovw.iovec[1], COREDUMP_PROC_GROUP);
+        assert_iovec_entry(&imp.iovw.iovec[2], "EMPTY=");
+
+        journal_importer_drop_iovw(&imp);
+
+        assert_se(journal_importer_process_data(&imp) == 0);
+        assert_se(journal_importer_eof(&imp));
+}
+
+static void test_binary_bad_input(void) {
+        _cleanup_(journal_importer_cleanup) JournalImporter imp = JOURNAL_IMPORTER_INIT(-1);
+        uint8_t buf[512] = {};
+        size_t n;
+
+        log_info("/* %s */", __func__);
+
+        /* A field that extends beyond the end of the entry */
+        n = sizeof(uint64_t) + JOURNAL_BINARY_ENTRY_HEADER_SIZE;
+        n = append_binary_field(buf, n, "MESSAGE=foo");
+        unaligned_write_le64(buf, n - sizeof(uint64_t) - 1);
+
+        imp.fd = binary_importer_for(buf, n);
+        imp.binary = true;
+
+        assert_se(journal_importer_process_data(&imp) == -EBADMSG);
+
+        /* An entry that is too short to hold the header */
+        journal_importer_cleanup(&imp);
+        imp = JOURNAL_IMPORTER_MAKE(-1);
+
+        unaligned_write_le64(buf, JOURNAL_BINARY_ENTRY_HEADER_SIZE - 1);
+
+        imp.fd = binary_importer_for(buf, n);
+        imp.binary = true;
+
+        assert_se(journal_importer_process_data(&imp) == -EBADMSG);
+}
+
 int main(int argc, char **argv) {
         test_setup_logging(LOG_DEBUG);
 
         test_basic_parsing();
         test_bad_input();
+        test_binary_parsing();
+        test_binary_bad_input();
 
         return 0;
 }
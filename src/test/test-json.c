@@ -13,6 +13,7 @@
 #include "util.h"
 
 static void test_tokenizer(const char *data, ...) {
+        _cleanup_(arena_done) Arena arena = {};
         unsigned line = 0, column = 0;
         void *state = NULL;
         va_list ap;
@@ -21,11 +22,11 @@ static void test_tokenizer(const char *data, ...) {
 
         for (;;) {
                 unsigned token_line, token_column;
-                _cleanup_free_ char *str = NULL;
                 JsonValue v = JSON_VALUE_NULL;
+                char *str = NULL;
                 int t, tt;
 
-                t = json_tokenize(&data, &str, &v, &token_line, &token_column, &state, &line, &column);
+                t = json_tokenize(&arena, &data, &str, &v, &token_line, &token_column, &state, &line, &column);
                 tt = va_arg(ap, int);
 
                 assert_se(t == tt);
@@ -93,6 +94,19 @@ static void test_variant(const char *data, Test test) {
 
         log_info("formatted normally: %s\n", s);
 
+        /* The compact output is put together in memory directly, make sure it matches what's written to streams */
+        {
+                _cleanup_free_ char *d = NULL;
+                size_t sz = 0;
+                FILE *f;
+
+                assert_se(f = open_memstream_unlocked(&d, &sz));
+                json_variant_dump(v, 0, f, NULL);
+                assert_se(fflush_and_check(f) >= 0);
+                fclose(f);
+                assert_se(streq(s, d));
+        }
+
         r = json_parse(data, JSON_PARSE_SENSITIVE, &w, NULL, NULL);
         assert_se(r == 0);
         assert_se(w);
@@ -546,6 +560,8 @@ int main(int argc, char *argv[]) {
         test_variant("{\"mutant\": [1, null, \"1\", {\"1\": [1, \"1\"]}], \"thisisaverylongproperty\": 1.27}", test_2);
         test_variant("{\"foo\" : \"\\uDBFF\\uDFFF\\\"\\uD9FF\\uDFFFFFF\\\"\\uDBFF\\uDFFF\\\"\\uD9FF\\uDFFF\\uDBFF\\uDFFFF\\uDBFF\\uDFFF\\uDBFF\\uDFFF\\uDBFF\\uDFFF\\uDBFF\\uDFFF\\\"\\uD9FF\\uDFFFFF\\\"\\uDBFF\\uDFFF\\\"\\uD9FF\\uDFFF\\uDBFF\\uDFFF\"}", NULL);
 
+        test_variant("[ \"a\\u0001b\\t\\\\\\\"\\n\\u001f\", 1e3, -5, 18446744073709551615, true, false, null, [], {} ]", NULL);
+
         test_variant("[ 0, -0, 0.0, -0.0, 0.000, -0.000, 0e0, -0e0, 0e+0, -0e-0, 0e-0, -0e000, 0e+000 ]", test_zeroes);
 
         test_build();
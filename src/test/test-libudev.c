@@ -431,6 +431,27 @@ static void test_util_resolve_subsys_kernel(void) {
         test_util_resolve_subsys_kernel_one("[net/lo]/address", true, 0, "00:00:00:00:00:00");
 }
 
+static void test_util_resolve_subsys_kernel_cached(void) {
+        _cleanup_hashmap_free_ Hashmap *devices = NULL;
+        char result[UTIL_PATH_SIZE] = "";
+
+        log_info("/* %s */", __func__);
+
+        assert_se(util_resolve_subsys_kernel_full("[hoge/]", &devices, result, sizeof(result), false) == -ENODEV);
+        assert_se(hashmap_isempty(devices));
+
+        assert_se(util_resolve_subsys_kernel_full("[net/lo]address", &devices, result, sizeof(result), true) == 0);
+        assert_se(streq(result, "00:00:00:00:00:00"));
+        assert_se(hashmap_size(devices) == 1);
+
+        assert_se(util_resolve_subsys_kernel_full("[net/lo]hoge", &devices, result, sizeof(result), true) == 0);
+        assert_se(streq(result, ""));
+        assert_se(util_resolve_subsys_kernel_full("[net/lo]", &devices, result, sizeof(result), false) == 0);
+        assert_se(streq(result, "/sys/devices/virtual/net/lo"));
+        assert_se(hashmap_size(devices) == 1);
+        assert_se(hashmap_get(devices, "net/lo"));
+}
+
 static void test_list(void) {
         _cleanup_(udev_list_freep) struct udev_list *list = NULL;
         struct udev_list_entry *e;
@@ -575,6 +596,7 @@ static int run(int argc, char *argv[]) {
 
         test_util_replace_whitespace();
         test_util_resolve_subsys_kernel();
+        test_util_resolve_subsys_kernel_cached();
 
         test_list();
 
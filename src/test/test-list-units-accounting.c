@@ -0,0 +1,111 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <sys/socket.h>
+
+#include "sd-bus.h"
+
+#include "cgroup.h"
+#include "dbus-manager.h"
+#include "fd-util.h"
+#include "manager.h"
+#include "rm-rf.h"
+#include "string-util.h"
+#include "tests.h"
+#include "unit.h"
+
+static int test_list_units_accounting(void) {
+        _cleanup_(rm_rf_physical_and_freep) char *runtime_dir = NULL;
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+        _cleanup_(manager_freep) Manager *m = NULL;
+        _cleanup_(sd_bus_unrefp) sd_bus *bus = NULL;
+        _cleanup_close_pair_ int pair[2] = { -1, -1 };
+        _cleanup_free_ char *unit_dir = NULL;
+        uint64_t memory, cpu, tasks, io_read, io_write, ip_ingress, ip_egress;
+        unsigned n_a = 0, n_b = 0;
+        Unit *a, *b, *c;
+        const char *id;
+        int r;
+
+        log_info("/* %s */", __func__);
+
+        r = enter_cgroup_subroot(NULL);
+        if (r == -ENOMEDIUM)
+                return log_tests_skipped("cgroupfs not available");
+
+        assert_se(get_testdata_dir("units", &unit_dir) >= 0);
+        assert_se(set_unit_path(unit_dir) >= 0);
+        assert_se(runtime_dir = setup_fake_runtime_dir());
+
+        r = manager_new(UNIT_FILE_USER, MANAGER_TEST_RUN_BASIC, &m);
+        if (manager_errno_skip_test(r))
+                return log_tests_skipped_errno(r, "manager_new");
+        assert_se(r >= 0);
+        assert_se(manager_startup(m, NULL, NULL) >= 0);
+
+        assert_se(manager_load_startable_unit_or_warn(m, "a.service", NULL, &a) >= 0);
+        assert_se(manager_load_startable_unit_or_warn(m, "b.service", NULL, &b) >= 0);
+        assert_se(manager_load_startable_unit_or_warn(m, "c.service", NULL, &c) >= 0);
+
+        /* Only units with a cgroup are listed. None of them is realized, hence no counter can be read from the
+         * kernel, but a CPU usage remembered from before is still reported. */
+        assert_se(unit_set_cgroup_path(a, "/test-list-units-accounting-a.service") >= 0);
+        assert_se(unit_set_cgroup_path(b, "/test-list-units-accounting-b.service") >= 0);
+        assert_se(!c->cgroup_path);
+
+        unit_get_cgroup_context(a)->cpu_accounting = true;
+        a->cpu_usage_base = 0;
+        a->cpu_usage_last = 4711;
+
+        unit_get_cgroup_context(b)->cpu_accounting = false;
+        unit_get_cgroup_context(b)->memory_accounting = true;
+        unit_get_cgroup_context(b)->tasks_accounting = true;
+
+        /* The reply is only marshalled and read back, it doesn't need to go anywhere */
+        assert_se(socketpair(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0, pair) >= 0);
+        assert_se(sd_bus_new(&bus) >= 0);
+        assert_se(sd_bus_set_fd(bus, pair[0], pair[0]) >= 0);
+        TAKE_FD(pair[0]);
+        assert_se(sd_bus_start(bus) >= 0);
+
+        assert_se(sd_bus_message_new_signal(bus, &reply, "/org/freedesktop/systemd1", "org.freedesktop.systemd1.Manager", "Test") >= 0);
+        assert_se(bus_manager_append_units_accounting(m, reply) >= 0);
+        assert_se(sd_bus_message_seal(reply, 1, 0) >= 0);
+        assert_se(sd_bus_message_rewind(reply, true) >= 0);
+
+        assert_se(sd_bus_message_enter_container(reply, 'a', "(sttttttt)") > 0);
+        while ((r = sd_bus_message_read(reply, "(sttttttt)", &id, &memory, &cpu, &tasks, &io_read, &io_write, &ip_ingress, &ip_egress)) > 0) {
+                log_debug("%s: memory=%" PRIu64 " cpu=%" PRIu64 " tasks=%" PRIu64 " io=%" PRIu64 "/%" PRIu64 " ip=%" PRIu64 "/%" PRIu64,
+                          id, memory, cpu, tasks, io_read, io_write, ip_ingress, ip_egress);
+
+                assert_se(!streq(id, "c.service"));
+
+                if (streq(id, "a.service")) {
+                        n_a++;
+                        assert_se(cpu == 4711);
+                } else if (streq(id, "b.service")) {
+                        n_b++;
+                        assert_se(cpu == UINT64_MAX);
+                } else
+                        continue;
+
+                assert_se(memory == UINT64_MAX);
+                assert_se(tasks == UINT64_MAX);
+                assert_se(io_read == UINT64_MAX);
+                assert_se(io_write == UINT64_MAX);
+                assert_se(ip_ingress == UINT64_MAX);
+                assert_se(ip_egress == UINT64_MAX);
+        }
+        assert_se(r == 0);
+        assert_se(sd_bus_message_exit_container(reply) >= 0);
+
+        assert_se(n_a == 1);
+        assert_se(n_b == 1);
+
+        return 0;
+}
+
+int main(int argc, char *argv[]) {
+        test_setup_logging(LOG_DEBUG);
+
+        return test_list_units_accounting();
+}
@@ -10,6 +10,7 @@
 #include "capability-util.h"
 #include "conf-parser.h"
 #include "fd-util.h"
+#include "fileio.h"
 #include "format-util.h"
 #include "fs-util.h"
 #include "hashmap.h"
@@ -769,6 +770,75 @@ static void test_config_parse_pass_environ(void) {
 
 }
 
+static void test_unit_load_queue_prefetch(void) {
+        _cleanup_(rm_rf_physical_and_freep) char *dir = NULL;
+        _cleanup_(manager_freep) Manager *m = NULL;
+        Unit *a, *b, *c, *d;
+        const char *p;
+        int r;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(mkdtemp_malloc("/tmp/test-load-fragment.XXXXXX", &dir) >= 0);
+
+        FOREACH_STRING(p, "a", "b", "c", "d") {
+                _cleanup_free_ char *path = NULL, *text = NULL;
+
+                assert_se(path = strjoin(dir, "/", p, ".service"));
+                assert_se(text = strjoin("[Service]\nExecStart=/bin/true\n[Unit]\nDescription=", p, "\n"));
+                assert_se(write_string_file(path, text, WRITE_STRING_FILE_CREATE) >= 0);
+        }
+
+        p = strjoina(dir, "/c.service.d/override.conf");
+        assert_se(write_string_file(p, "[Unit]\nDescription=c from drop-in\n", WRITE_STRING_FILE_CREATE|WRITE_STRING_FILE_MKDIR_0755) >= 0);
+
+        assert_se(set_unit_path(dir) >= 0);
+
+        r = manager_new(UNIT_FILE_USER, MANAGER_TEST_RUN_MINIMAL, &m);
+        if (manager_errno_skip_test(r)) {
+                log_notice_errno(r, "Skipping test: manager_new: %m");
+                goto finish;
+        }
+
+        assert_se(r >= 0);
+        assert_se(manager_startup(m, NULL, NULL) >= 0);
+
+        m->n_unit_load_threads = 2;
+
+        assert_se(manager_load_unit_prepare(m, "a.service", NULL, NULL, &a) >= 0);
+        assert_se(manager_load_unit_prepare(m, "b.service", NULL, NULL, &b) >= 0);
+        assert_se(unit_load_queue_prefetch(m) >= 0);
+        assert_se(hashmap_contains(m->prefetched_config, strjoina(dir, "/a.service")));
+        assert_se(hashmap_contains(m->prefetched_config, strjoina(dir, "/b.service")));
+
+        /* Units queued later are read ahead in another round, which must not drop what was read for the
+         * units that are still waiting in the queue */
+        assert_se(manager_load_unit_prepare(m, "c.service", NULL, NULL, &c) >= 0);
+        assert_se(manager_load_unit_prepare(m, "d.service", NULL, NULL, &d) >= 0);
+        assert_se(unit_load_queue_prefetch(m) >= 0);
+        assert_se(hashmap_contains(m->prefetched_config, strjoina(dir, "/a.service")));
+        assert_se(hashmap_contains(m->prefetched_config, strjoina(dir, "/b.service")));
+        assert_se(hashmap_contains(m->prefetched_config, strjoina(dir, "/c.service")));
+        assert_se(hashmap_contains(m->prefetched_config, strjoina(dir, "/c.service.d/override.conf")));
+        assert_se(hashmap_contains(m->prefetched_config, strjoina(dir, "/d.service")));
+
+        /* Loading uses what was read ahead, and gives the same result as reading the files directly */
+        manager_dispatch_load_queue(m);
+        assert_se(!m->prefetched_config);
+
+        assert_se(a->load_state == UNIT_LOADED);
+        assert_se(streq(a->description, "a"));
+        assert_se(b->load_state == UNIT_LOADED);
+        assert_se(streq(b->description, "b"));
+        assert_se(c->load_state == UNIT_LOADED);
+        assert_se(streq(c->description, "c from drop-in"));
+        assert_se(d->load_state == UNIT_LOADED);
+        assert_se(streq(d->description, "d"));
+
+finish:
+        assert_se(unsetenv("SYSTEMD_UNIT_PATH") >= 0);
+}
+
 static void test_unit_dump_config_items(void) {
         unit_dump_config_items(stdout);
 }
@@ -793,6 +863,7 @@ int main(int argc, char *argv[]) {
         test_config_parse_pass_environ();
         TEST_REQ_RUNNING_SYSTEMD(test_install_printf());
         test_unit_dump_config_items();
+        test_unit_load_queue_prefetch();
 
         return r;
 }
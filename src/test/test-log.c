@@ -3,7 +3,10 @@
 #include <stddef.h>
 #include <unistd.h>
 
+#include "fd-util.h"
+#include "fileio.h"
 #include "format-util.h"
+#include "log-ring.h"
 #include "log.h"
 #include "process-util.h"
 #include "string-util.h"
@@ -74,10 +77,58 @@ static void test_log_syntax(void) {
         assert_se(log_syntax("unit", LOG_ERR, "filename", 10, SYNTHETIC_ERRNO(ENOTTY), "ENOTTY: %s: %m", "hogehoge") == -ENOTTY);
 }
 
+static void count_record(const LogRingRecord *r, void *userdata) {
+        unsigned *n = userdata;
+
+        assert_se(r->level == (LOG_DEBUG|LOG_DAEMON));
+        assert_se(streq(r->func, "test_log_ring"));
+        assert_se(startswith(r->message, "ring record "));
+        (*n)++;
+}
+
+static void test_log_ring(void) {
+        _cleanup_free_ char *dump = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+        unsigned i, n = 0;
+        size_t sz;
+
+        log_set_target(LOG_TARGET_RING);
+        log_set_max_level(LOG_DEBUG);
+
+        for (i = 0; i < LOG_RING_RECORDS + 100; i++)
+                log_debug("ring record %u", i);
+
+        assert_se(log_ring_pending());
+
+        assert_se(f = open_memstream_unlocked(&dump, &sz));
+        log_ring_dump(f, NULL);
+        assert_se(fflush_and_check(f) >= 0);
+        assert_se(strstr(dump, "(4096 records, 100 overwritten)"));
+        assert_se(strstr(dump, "test_log_ring(): ring record 4195\n"));
+        assert_se(!strstr(dump, "ring record 99\n"));
+
+        /* The oldest ones were overwritten, all others are handed out exactly once */
+        assert_se(log_ring_drain(count_record, &n) == 100);
+        assert_se(n == LOG_RING_RECORDS);
+        assert_se(!log_ring_pending());
+        assert_se(log_ring_drain(count_record, &n) == 0);
+        assert_se(n == LOG_RING_RECORDS);
+
+        /* Switching to another target writes out anything logged to the ring first */
+        log_debug("ring record once more");
+        log_set_target(LOG_TARGET_CONSOLE);
+        assert_se(log_ring_pending());
+        log_info("flushing the ring");
+        assert_se(!log_ring_pending());
+
+        log_set_max_level(LOG_INFO);
+}
+
 int main(int argc, char* argv[]) {
         int target;
 
         test_file();
+        test_log_ring();
 
         for (target = 0; target < _LOG_TARGET_MAX; target++) {
                 log_set_target(target);
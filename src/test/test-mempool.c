@@ -0,0 +1,107 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <pthread.h>
+
+#include "mempool.h"
+#include "tests.h"
+
+#define NUM 100
+
+struct tile {
+        unsigned long data[6];
+};
+
+DEFINE_MEMPOOL(test_pool, struct tile, 8);
+
+static void* thread_free(void *p) {
+        struct tile **tiles = p;
+        unsigned i;
+
+        for (i = 0; i < NUM; i++)
+                mempool_free_tile(&test_pool, tiles[i]);
+
+        return NULL;
+}
+
+static void* thread_alloc(void *p) {
+        struct tile **tiles = p;
+        unsigned i;
+
+        for (i = 0; i < NUM; i++) {
+                assert_se(tiles[i] = mempool_alloc0_tile(&test_pool));
+                tiles[i]->data[0] = i;
+        }
+
+        return NULL;
+}
+
+static bool in_set(struct tile **tiles, struct tile *t) {
+        unsigned i;
+
+        for (i = 0; i < NUM; i++)
+                if (tiles[i] == t)
+                        return true;
+
+        return false;
+}
+
+static void test_remote_free(void) {
+        struct tile *tiles[NUM], *t;
+        pthread_t thread;
+        unsigned i;
+
+        log_info("/* %s */", __func__);
+
+        for (i = 0; i < NUM; i++)
+                assert_se(tiles[i] = mempool_alloc0_tile(&test_pool));
+
+        /* Tiles released by another thread come back to us once our own freelist is used up */
+        assert_se(pthread_create(&thread, NULL, thread_free, tiles) == 0);
+        assert_se(pthread_join(thread, NULL) == 0);
+
+        for (i = 0; i < NUM; i++) {
+                assert_se(t = mempool_alloc_tile(&test_pool));
+                assert_se(in_set(tiles, t));
+        }
+
+        for (i = 0; i < NUM; i++)
+                mempool_free_tile(&test_pool, tiles[i]);
+}
+
+static void test_orphan(void) {
+        struct tile *tiles[NUM], *more[NUM];
+        pthread_t thread;
+        unsigned i;
+
+        log_info("/* %s */", __func__);
+
+        /* Tiles allocated by a thread that exited stay valid and may be released by anyone */
+        assert_se(pthread_create(&thread, NULL, thread_alloc, tiles) == 0);
+        assert_se(pthread_join(thread, NULL) == 0);
+
+        for (i = 0; i < NUM; i++) {
+                assert_se(tiles[i]->data[0] == i);
+                mempool_free_tile(&test_pool, tiles[i]);
+        }
+
+        /* The next thread adopts the state left behind and gets them back */
+        assert_se(pthread_create(&thread, NULL, thread_alloc, more) == 0);
+        assert_se(pthread_join(thread, NULL) == 0);
+
+        for (i = 0; i < NUM; i++) {
+                assert_se(in_set(tiles, more[i]));
+                mempool_free_tile(&test_pool, more[i]);
+        }
+}
+
+int main(int argc, char *argv[]) {
+        test_setup_logging(LOG_DEBUG);
+
+        if (!mempool_enabled())
+                return log_tests_skipped("mempool disabled");
+
+        test_remote_free();
+        test_orphan();
+
+        return 0;
+}
@@ -0,0 +1,90 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include "metrics.h"
+#include "tests.h"
+
+enum {
+        TEST_METRIC_COUNTER,
+        TEST_METRIC_GAUGE,
+        TEST_METRIC_HISTOGRAM,
+        _TEST_METRIC_MAX,
+};
+
+static const Metric test_metrics[_TEST_METRIC_MAX] = {
+        [TEST_METRIC_COUNTER]   = METRIC_INIT(METRIC_COUNTER,   "counter",   "A counter"),
+        [TEST_METRIC_GAUGE]     = METRIC_INIT(METRIC_GAUGE,     "gauge",     "A gauge"),
+        [TEST_METRIC_HISTOGRAM] = METRIC_INIT(METRIC_HISTOGRAM, "histogram", "A histogram"),
+};
+
+static void test_metrics_update(void) {
+        Metric metrics[_TEST_METRIC_MAX];
+        Metric *h = metrics + TEST_METRIC_HISTOGRAM;
+
+        log_info("/* %s */", __func__);
+
+        memcpy(metrics, test_metrics, sizeof(metrics));
+
+        metric_inc(metrics + TEST_METRIC_COUNTER);
+        metric_add(metrics + TEST_METRIC_COUNTER, 41);
+        assert_se(metrics[TEST_METRIC_COUNTER].value == 42);
+
+        metric_set(metrics + TEST_METRIC_GAUGE, 7);
+        metric_set(metrics + TEST_METRIC_GAUGE, 5);
+        assert_se(metrics[TEST_METRIC_GAUGE].value == 5);
+
+        metric_observe(h, 0);
+        metric_observe(h, 1);
+        metric_observe(h, 2);
+        metric_observe(h, 3);
+        metric_observe(h, 4);
+        metric_observe(h, 5);
+        metric_observe(h, UINT64_MAX);
+
+        assert_se(h->value == 7);
+        assert_se(h->buckets[0] == 2);
+        assert_se(h->buckets[1] == 1);
+        assert_se(h->buckets[2] == 2);
+        assert_se(h->buckets[3] == 1);
+        assert_se(h->buckets[METRIC_HISTOGRAM_BUCKETS - 1] == 1);
+}
+
+static void test_metrics_build_json(void) {
+        _cleanup_(json_variant_unrefp) JsonVariant *v = NULL;
+        Metric metrics[_TEST_METRIC_MAX];
+        JsonVariant *e;
+
+        log_info("/* %s */", __func__);
+
+        memcpy(metrics, test_metrics, sizeof(metrics));
+        metric_add(metrics + TEST_METRIC_COUNTER, 3);
+        metric_observe(metrics + TEST_METRIC_HISTOGRAM, 100);
+
+        assert_se(metrics_build_json(metrics, ELEMENTSOF(metrics), &v) >= 0);
+        json_variant_dump(v, JSON_FORMAT_NEWLINE, stdout, NULL);
+
+        assert_se(json_variant_elements(v) == _TEST_METRIC_MAX);
+
+        e = json_variant_by_index(v, TEST_METRIC_COUNTER);
+        assert_se(streq(json_variant_string(json_variant_by_key(e, "type")), "counter"));
+        assert_se(json_variant_unsigned(json_variant_by_key(e, "value")) == 3);
+
+        e = json_variant_by_index(v, TEST_METRIC_HISTOGRAM);
+        assert_se(streq(json_variant_string(json_variant_by_key(e, "type")), "histogram"));
+        assert_se(json_variant_unsigned(json_variant_by_key(e, "count")) == 1);
+        assert_se(json_variant_unsigned(json_variant_by_key(e, "sum")) == 100);
+        assert_se(json_variant_elements(json_variant_by_key(e, "buckets")) == METRIC_HISTOGRAM_BUCKETS);
+
+        v = json_variant_unref(v);
+        assert_se(metrics_build_json(NULL, 0, &v) >= 0);
+        assert_se(json_variant_is_array(v));
+        assert_se(json_variant_elements(v) == 0);
+}
+
+int main(int argc, char *argv[]) {
+        test_setup_logging(LOG_DEBUG);
+
+        test_metrics_update();
+        test_metrics_build_json();
+
+        return 0;
+}
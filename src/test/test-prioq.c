@@ -119,10 +119,52 @@ static void test_struct(void) {
         assert_se(set_isempty(s));
 }
 
+static uint64_t test_key(const void *a) {
+        const struct test *x = a;
+
+        return x->value;
+}
+
+static void test_keyed(void) {
+        _cleanup_(prioq_freep) Prioq *q = NULL;
+        struct test *t, items[SET_SIZE];
+        unsigned previous = 0, i;
+
+        srand(0);
+
+        assert_se(prioq_ensure_allocated_keyed(&q, test_key) >= 0);
+
+        for (i = 0; i < SET_SIZE; i++) {
+                items[i].value = (unsigned) rand();
+                assert_se(prioq_put(q, items + i, &items[i].idx) >= 0);
+        }
+
+        /* The cached keys are updated when reshuffling */
+        for (i = 0; i < SET_SIZE; i += 3) {
+                items[i].value = (unsigned) rand();
+                assert_se(prioq_reshuffle(q, items + i, &items[i].idx) == 1);
+        }
+
+        for (i = 0; i < SET_SIZE; i += 5)
+                assert_se(prioq_remove(q, items + i, &items[i].idx) == 1);
+
+        for (i = 0; i < SET_SIZE; i++)
+                if (i % 5 != 0)
+                        assert_se(prioq_peek_by_index(q, items[i].idx) == items + i);
+
+        while ((t = prioq_pop(q))) {
+                assert_se(previous <= t->value);
+                previous = t->value;
+        }
+
+        assert_se(prioq_isempty(q));
+}
+
 int main(int argc, char* argv[]) {
 
         test_unsigned();
         test_struct();
+        test_keyed();
 
         return 0;
 }
@@ -1,6 +1,7 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
 #include <fcntl.h>
+#include <pthread.h>
 #include <sys/mount.h>
 #include <sys/personality.h>
 #include <sys/prctl.h>
@@ -154,6 +155,29 @@ static void test_pid_is_alive(void) {
         assert_se(!pid_is_alive(-1));
 }
 
+static void test_get_process_start_time(void) {
+        uint64_t a, b, c;
+        pid_t pid;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(get_process_start_time(getpid_cached(), &a) >= 0);
+        assert_se(get_process_start_time(getpid_cached(), &b) >= 0);
+        assert_se(a == b);
+
+        pid = fork();
+        assert_se(pid >= 0);
+        if (pid == 0)
+                _exit(EXIT_SUCCESS);
+
+        /* The child cannot have been started before us */
+        assert_se(get_process_start_time(pid, &c) >= 0);
+        assert_se(c >= a);
+
+        assert_se(wait_for_terminate(pid, NULL) >= 0);
+        assert_se(get_process_start_time(pid, &c) == -ESRCH);
+}
+
 static void test_personality(void) {
 
         assert_se(personality_to_string(PER_LINUX));
@@ -688,6 +712,34 @@ static void test_setpriority_closest(void) {
         }
 }
 
+static void *wait_for_eof(void *p) {
+        int *fd = p;
+        char c;
+
+        (void) read(*fd, &c, 1);
+        return NULL;
+}
+
+static void test_get_process_threads(void) {
+        _cleanup_close_pair_ int pipe_fds[2] = { -1, -1 };
+        pthread_t t;
+        int n;
+
+        log_info("/* %s */", __func__);
+
+        n = get_process_threads(0);
+        assert_se(n >= 1);
+        assert_se(get_process_threads(getpid_cached()) == n);
+
+        assert_se(pipe2(pipe_fds, O_CLOEXEC) >= 0);
+        assert_se(pthread_create(&t, NULL, wait_for_eof, pipe_fds) == 0);
+
+        assert_se(get_process_threads(0) == n + 1);
+
+        pipe_fds[1] = safe_close(pipe_fds[1]);
+        assert_se(pthread_join(t, NULL) == 0);
+}
+
 int main(int argc, char *argv[]) {
         test_setup_logging(LOG_DEBUG);
 
@@ -706,6 +758,7 @@ int main(int argc, char *argv[]) {
         test_get_process_comm_escape();
         test_pid_is_unwaited();
         test_pid_is_alive();
+        test_get_process_start_time();
         test_personality();
         test_get_process_cmdline_harder();
         test_rename_process();
@@ -715,6 +768,7 @@ int main(int argc, char *argv[]) {
         test_pid_to_ptr();
         test_ioprio_class_from_to_string();
         test_setpriority_closest();
+        test_get_process_threads();
 
         return 0;
 }
@@ -0,0 +1,65 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include "macro.h"
+#include "pthread-util.h"
+#include "tests.h"
+
+#define N_ITEMS 1000U
+
+typedef struct Context {
+        pthread_mutex_t mutex;
+        unsigned next_item;
+        unsigned done[N_ITEMS];
+        unsigned n_calls;
+} Context;
+
+static void* work_thread(void *userdata) {
+        Context *c = userdata;
+
+        assert_se(pthread_mutex_lock(&c->mutex) == 0);
+        c->n_calls++;
+
+        while (c->next_item < N_ITEMS) {
+                unsigned i = c->next_item++;
+
+                assert_se(pthread_mutex_unlock(&c->mutex) == 0);
+                c->done[i]++;
+                assert_se(pthread_mutex_lock(&c->mutex) == 0);
+        }
+
+        assert_se(pthread_mutex_unlock(&c->mutex) == 0);
+        return NULL;
+}
+
+static void test_run_parallel_one(unsigned n_threads) {
+        Context c = {
+                .mutex = PTHREAD_MUTEX_INITIALIZER,
+        };
+        unsigned i, n;
+
+        log_info("/* %s(%u) */", __func__, n_threads);
+
+        n = run_parallel(n_threads, work_thread, &c);
+
+        /* Every item was processed exactly once, and all threads have finished */
+        for (i = 0; i < N_ITEMS; i++)
+                assert_se(c.done[i] == 1);
+        assert_se(n >= 1);
+        assert_se(n <= MAX(n_threads, 1U));
+        assert_se(c.n_calls == n);
+}
+
+static void test_run_parallel(void) {
+        test_run_parallel_one(0);
+        test_run_parallel_one(1);
+        test_run_parallel_one(2);
+        test_run_parallel_one(8);
+}
+
+int main(int argc, char *argv[]) {
+        test_setup_logging(LOG_DEBUG);
+
+        test_run_parallel();
+
+        return 0;
+}
@@ -1,6 +1,11 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "fd-util.h"
 #include "hexdecoct.h"
+#include "process-util.h"
 #include "random-util.h"
 #include "log.h"
 #include "tests.h"
@@ -35,6 +40,30 @@ static void test_pseudo_random_bytes(void) {
         }
 }
 
+static void test_random_buffer_fork(void) {
+        _cleanup_close_pair_ int pipefd[2] = { -1, -1 };
+        uint64_t a, b;
+        int r;
+
+        log_info("/* %s */", __func__);
+
+        /* Prime the buffer, then check that the child doesn't hand out the same bytes as the parent */
+        assert_se(genuine_random_bytes(&a, sizeof a, RANDOM_ALLOW_POOL) == 0);
+        assert_se(pipe2(pipefd, O_CLOEXEC) >= 0);
+
+        r = safe_fork("(test-random)", FORK_WAIT|FORK_LOG, NULL);
+        assert_se(r >= 0);
+        if (r == 0) {
+                assert_se(genuine_random_bytes(&b, sizeof b, RANDOM_ALLOW_POOL) == 0);
+                assert_se(write(pipefd[1], &b, sizeof b) == sizeof b);
+                _exit(EXIT_SUCCESS);
+        }
+
+        assert_se(read(pipefd[0], &b, sizeof b) == sizeof b);
+        assert_se(genuine_random_bytes(&a, sizeof a, RANDOM_ALLOW_POOL) == 0);
+        assert_se(a != b);
+}
+
 static void test_rdrand(void) {
         int r, i;
 
@@ -58,6 +87,9 @@ int main(int argc, char **argv) {
         test_genuine_random_bytes(0);
         test_genuine_random_bytes(RANDOM_BLOCK);
         test_genuine_random_bytes(RANDOM_ALLOW_RDRAND);
+        test_genuine_random_bytes(RANDOM_ALLOW_POOL);
+
+        test_random_buffer_fork();
 
         test_pseudo_random_bytes();
 
@@ -1,9 +1,20 @@
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include "sd-hwdb.h"
 
 #include "alloc-util.h"
 #include "errno-util.h"
 #include "errno.h"
+#include "fileio.h"
+#include "hwdb-util.h"
+#include "mkdir.h"
+#include "path-util.h"
+#include "rm-rf.h"
 #include "tests.h"
+#include "time-util.h"
+#include "tmpfile-util.h"
 
 static int test_failed_enumerate(void) {
         _cleanup_(sd_hwdb_unrefp) sd_hwdb *hwdb = NULL;
@@ -60,11 +71,80 @@ static void test_basic_enumerate(void) {
         assert_se(len1 == len2);
 }
 
+static void set_mtime(const char *path, usec_t t) {
+        struct timespec ts[2];
+
+        timespec_store(&ts[0], t);
+        ts[1] = ts[0];
+        assert_se(utimensat(AT_FDCWD, path, ts, 0) >= 0);
+}
+
+/* Runs an update and returns whether the database was rebuilt. If so, its modification time is set to the
+ * specified time, so that the outcome doesn't depend on the timestamp granularity of the file system. */
+static bool hwdb_update_rebuilt(const char *root, usec_t mtime) {
+        _cleanup_free_ char *p = NULL;
+        struct stat st, st2;
+
+        assert_se(p = path_join(root, "/etc/udev/hwdb.bin"));
+        if (stat(p, &st) < 0) {
+                assert_se(errno == ENOENT);
+                st = (struct stat) {};
+        }
+
+        assert_se(hwdb_update(root, NULL, false, false) >= 0);
+        assert_se(stat(p, &st2) >= 0);
+
+        /* The database is replaced by renaming a new file over it */
+        if (st.st_ino == st2.st_ino &&
+            timespec_load_nsec(&st.st_mtim) == timespec_load_nsec(&st2.st_mtim))
+                return false;
+
+        set_mtime(p, mtime);
+        return true;
+}
+
+static void test_update_incremental(void) {
+        _cleanup_(rm_rf_physical_and_freep) char *root = NULL;
+        _cleanup_free_ char *a = NULL, *b = NULL;
+        usec_t t;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(mkdtemp_malloc("/tmp/test-sd-hwdb.XXXXXX", &root) >= 0);
+        assert_se(a = path_join(root, "/etc/udev/hwdb.d/10-a.hwdb"));
+        assert_se(b = path_join(root, UDEVLIBEXECDIR "/hwdb.d/20-b.hwdb"));
+        assert_se(mkdir_parents(a, 0755) >= 0);
+        assert_se(mkdir_parents(b, 0755) >= 0);
+
+        assert_se(write_string_file(a, "usb:v1234*\n A=1\n", WRITE_STRING_FILE_CREATE) >= 0);
+        assert_se(write_string_file(b, "usb:v5678*\n B=2\n", WRITE_STRING_FILE_CREATE) >= 0);
+
+        /* Database builds are dated ahead of whatever happens to the files and directories in between,
+         * source changes that shall be noticed are dated ahead of the last build */
+        t = usec_add(now(CLOCK_REALTIME), USEC_PER_HOUR);
+
+        assert_se(hwdb_update_rebuilt(root, t));
+        assert_se(!hwdb_update_rebuilt(root, t));
+
+        /* A changed file triggers a rebuild */
+        assert_se(write_string_file(a, "usb:v1234*\n A=3\n", 0) >= 0);
+        set_mtime(a, t + USEC_PER_SEC);
+        assert_se(hwdb_update_rebuilt(root, t + 2 * USEC_PER_SEC));
+        assert_se(!hwdb_update_rebuilt(root, t + 2 * USEC_PER_SEC));
+
+        /* As does a removed one */
+        assert_se(unlink(b) >= 0);
+        assert_se(hwdb_update_rebuilt(root, t + 3 * USEC_PER_SEC));
+        assert_se(!hwdb_update_rebuilt(root, t + 3 * USEC_PER_SEC));
+}
+
 int main(int argc, char *argv[]) {
         int r;
 
         test_setup_logging(LOG_DEBUG);
 
+        test_update_incremental();
+
         r = test_failed_enumerate();
         if (r < 0)
                 return log_tests_skipped_errno(r, "cannot open hwdb");
@@ -759,6 +759,65 @@ static void test_load_syscall_filter_set_raw(void) {
         assert_se(wait_for_terminate_and_check("syscallrawseccomp", pid, WAIT_LOG) == EXIT_SUCCESS);
 }
 
+static void test_seccomp_program(void) {
+        _cleanup_(seccomp_program_freep) SeccompProgram *p = NULL, *q = NULL;
+        _cleanup_hashmap_free_ Hashmap *s = NULL;
+        pid_t pid;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(s = hashmap_new(NULL));
+#if defined __NR_access && __NR_access >= 0
+        assert_se(hashmap_put(s, UINT32_TO_PTR(__NR_access + 1), INT_TO_PTR(EILSEQ)) >= 0);
+#else
+        assert_se(hashmap_put(s, UINT32_TO_PTR(__NR_faccessat + 1), INT_TO_PTR(EILSEQ)) >= 0);
+#endif
+#if defined __NR_poll && __NR_poll >= 0
+        assert_se(hashmap_put(s, UINT32_TO_PTR(__NR_poll + 1), INT_TO_PTR(-1)) >= 0);
+#else
+        assert_se(hashmap_put(s, UINT32_TO_PTR(__NR_ppoll + 1), INT_TO_PTR(-1)) >= 0);
+#endif
+
+        /* Programs built from the same rules are identified as the same */
+        assert_se(seccomp_program_new(SCMP_ACT_ALLOW, s, SCMP_ACT_ERRNO(EUNATCH), &p) >= 0);
+        assert_se(seccomp_program_new(SCMP_ACT_ALLOW, s, SCMP_ACT_ERRNO(EUNATCH), &q) >= 0);
+        assert_se(seccomp_program_hash_ops.compare(p, q) == 0);
+        q = seccomp_program_free(q);
+        assert_se(seccomp_program_new(SCMP_ACT_ALLOW, s, SCMP_ACT_ERRNO(EUCLEAN), &q) >= 0);
+        assert_se(seccomp_program_hash_ops.compare(p, q) != 0);
+
+        if (!is_seccomp_available()) {
+                log_notice("Seccomp not available, skipping remaining tests in %s", __func__);
+                return;
+        }
+        if (geteuid() != 0) {
+                log_notice("Not root, skipping remaining tests in %s", __func__);
+                return;
+        }
+
+        assert_se(seccomp_program_compile(p, true) >= 0);
+
+        pid = fork();
+        assert_se(pid >= 0);
+
+        if (pid == 0) {
+                assert_se(access("/", F_OK) >= 0);
+                assert_se(poll(NULL, 0, 0) == 0);
+
+                assert_se(seccomp_program_load(p) >= 0);
+
+                assert_se(access("/", F_OK) < 0);
+                assert_se(errno == EILSEQ);
+
+                assert_se(poll(NULL, 0, 0) < 0);
+                assert_se(errno == EUNATCH);
+
+                _exit(EXIT_SUCCESS);
+        }
+
+        assert_se(wait_for_terminate_and_check("programseccomp", pid, WAIT_LOG) == EXIT_SUCCESS);
+}
+
 static void test_lock_personality(void) {
         unsigned long current;
         pid_t pid;
@@ -1039,6 +1098,7 @@ int main(int argc, char *argv[]) {
         test_memory_deny_write_execute_shmat();
         test_restrict_archs();
         test_load_syscall_filter_set_raw();
+        test_seccomp_program();
         test_lock_personality();
         test_restrict_suid_sgid();
 
@@ -191,6 +191,64 @@ static void test_serialize_environment(void) {
         assert_se(strv_equal(env, env2));
 }
 
+static void test_serialize_binary(void) {
+        _cleanup_(unlink_tempfilep) char fn[] = "/tmp/test-serialize.XXXXXX";
+        _cleanup_fclose_ FILE *f = NULL;
+        int fd;
+
+        assert_se(fmkostemp_safe(fn, "r+", &f) == 0);
+        log_info("/* %s (%s) */", __func__, fn);
+
+        /* Text and binary records may be mixed, the reader tells them apart one by one */
+        assert_se(serialize_item(f, "a", "text") == 1);
+
+        assert_se(!serialize_set_binary(true));
+        assert_se(serialize_item(f, "a", "bbb") == 1);
+        assert_se(serialize_item(f, "a", "") == 1);
+        assert_se(serialize_item(f, "a", long_string) == -EINVAL);
+        assert_se(serialize_item_format(f, "b", "%i-%s", 7, "x") == 1);
+        assert_se(serialize_marker(f, "foo.service") == 1);
+        assert_se(serialize_marker(f, "") == 1);
+        assert_se(serialize_set_binary(false));
+
+        assert_se(serialize_marker(f, "") == 1);
+
+        rewind(f);
+
+        _cleanup_free_ char *line1 = NULL, *line2 = NULL, *line3 = NULL, *line4 = NULL, *line5 = NULL,
+                *line6 = NULL, *line7 = NULL, *line8 = NULL;
+        assert_se(deserialize_read_line(f, &line1) > 0);
+        assert_se(streq(line1, "a=text"));
+        assert_se(deserialize_read_line(f, &line2) > 0);
+        assert_se(streq(line2, "a=bbb"));
+        assert_se(deserialize_read_line(f, &line3) > 0);
+        assert_se(streq(line3, "a="));
+        assert_se(deserialize_read_line(f, &line4) > 0);
+        assert_se(streq(line4, "b=7-x"));
+        assert_se(deserialize_read_line(f, &line5) > 0);
+        assert_se(streq(line5, "foo.service"));
+        assert_se(deserialize_read_line(f, &line6) > 0);
+        assert_se(streq(line6, ""));
+        assert_se(deserialize_read_line(f, &line7) > 0);
+        assert_se(streq(line7, ""));
+        assert_se(deserialize_read_line(f, &line8) == 0);
+
+        /* A truncated record is refused */
+        fd = fileno(f);
+        assert_se(fd >= 0);
+        assert_se(ftruncate(fd, 0) == 0);
+        rewind(f);
+        assert_se(!serialize_set_binary(true));
+        assert_se(serialize_item(f, "a", "bbb") == 1);
+        assert_se(serialize_set_binary(false));
+        assert_se(fflush(f) == 0);
+        assert_se(ftruncate(fd, 5) == 0);
+        rewind(f);
+
+        _cleanup_free_ char *line9 = NULL;
+        assert_se(deserialize_read_line(f, &line9) == -EBADMSG);
+}
+
 int main(int argc, char *argv[]) {
         test_setup_logging(LOG_INFO);
 
@@ -203,6 +261,7 @@ int main(int argc, char *argv[]) {
         test_serialize_strv();
         test_deserialize_environment();
         test_serialize_environment();
+        test_serialize_binary();
 
         return EXIT_SUCCESS;
 }
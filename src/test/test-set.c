@@ -86,11 +86,28 @@ static void test_set_put(void) {
         assert_se(strv_length(t) == 3);
 }
 
+static void test_set_put_many(void) {
+        _cleanup_set_free_ Set *m = NULL;
+        char *sorted[] = { (char*) "a", (char*) "b", (char*) "c", (char*) "d" };
+        char *unsorted[] = { (char*) "x", (char*) "b", (char*) "y", (char*) "x" };
+
+        assert_se(set_ensure_put_many(&m, &string_hash_ops, (void**) sorted, ELEMENTSOF(sorted)) == 4);
+        assert_se(set_size(m) == 4);
+        assert_se(set_contains(m, "c"));
+
+        assert_se(set_put_many(m, (void**) unsorted, ELEMENTSOF(unsorted)) == 2);
+        assert_se(set_size(m) == 6);
+        assert_se(set_contains(m, "x"));
+        assert_se(set_contains(m, "y"));
+        assert_se(!set_contains(m, "z"));
+}
+
 int main(int argc, const char *argv[]) {
         test_set_steal_first();
         test_set_free_with_destructor();
         test_set_free_with_hash_ops();
         test_set_put();
+        test_set_put_many();
 
         return 0;
 }
@@ -39,11 +39,38 @@ static void test_specifier_escape_strv(void) {
         test_specifier_escape_strv_one(STRV_MAKE("foo", "%", "foo%", "%foo", "foo%foo", "quux", "%%%"), STRV_MAKE("foo", "%%", "foo%%", "%%foo", "foo%%foo", "quux", "%%%%%%"));
 }
 
+static void test_specifier_printf_cache(void) {
+        _cleanup_(specifier_cache_freep) SpecifierCache *cache = NULL;
+        _cleanup_free_ char *x = NULL, *y = NULL, *z = NULL;
+
+        static const Specifier table[] = {
+                { 'X', specifier_string,        (char*) "AAAA" },
+                { 'a', specifier_architecture,  NULL },
+                { 'U', specifier_user_id,       NULL },
+                {}
+        };
+
+        assert_se(cache = new0(SpecifierCache, 1));
+
+        assert_se(specifier_printf("xxx a=%a U=%U X=%X yyy", table, NULL, &x) >= 0);
+        assert_se(specifier_printf_full("xxx a=%a U=%U X=%X yyy", table, NULL, cache, &y) >= 0);
+        assert_se(specifier_printf_full("xxx a=%a U=%U X=%X yyy", table, NULL, cache, &z) >= 0);
+        log_info("<%s>", x);
+
+        assert_se(streq(x, y));
+        assert_se(streq(x, z));
+
+        assert_se(cache->values['a']);
+        assert_se(cache->values['U']);
+        assert_se(!cache->values['X']);
+}
+
 int main(int argc, char *argv[]) {
         test_setup_logging(LOG_DEBUG);
 
         test_specifier_escape();
         test_specifier_escape_strv();
+        test_specifier_printf_cache();
 
         return 0;
 }
@@ -0,0 +1,54 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include "alloc-util.h"
+#include "string-pool.h"
+#include "string-util.h"
+#include "tests.h"
+
+static void test_string_pool(void) {
+        _cleanup_(string_pool_freep) StringPool *p = NULL;
+        const char *a, *b, *c, *d;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(string_pool_size(p) == 0);
+
+        assert_se(string_pool_intern(&p, "system.slice", &a) == 1);
+        assert_se(p);
+        assert_se(streq(a, "system.slice"));
+
+        /* Same string, same pointer */
+        assert_se(string_pool_intern(&p, "system.slice", &b) == 0);
+        assert_se(a == b);
+
+        assert_se(string_pool_intern(&p, "user.slice", &c) == 1);
+        assert_se(a != c);
+        assert_se(string_pool_size(p) == 2);
+
+        assert_se(string_pool_intern_consume(&p, strdup("system.slice"), &d) == 0);
+        assert_se(d == a);
+
+        /* Three references to "system.slice" now */
+        assert_se(!string_pool_release(p, a));
+        assert_se(!string_pool_release(p, b));
+        assert_se(string_pool_size(p) == 2);
+        assert_se(!string_pool_release(p, d));
+        assert_se(string_pool_size(p) == 1);
+
+        assert_se(!string_pool_release(p, c));
+        assert_se(string_pool_size(p) == 0);
+
+        assert_se(!string_pool_release(p, NULL));
+
+        /* Released strings are added anew */
+        assert_se(string_pool_intern_consume(&p, strdup("system.slice"), &a) == 1);
+        assert_se(!string_pool_release(p, a));
+}
+
+int main(int argc, char *argv[]) {
+        test_setup_logging(LOG_DEBUG);
+
+        test_string_pool();
+
+        return 0;
+}
@@ -0,0 +1,78 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <stdio.h>
+
+#include "bus-error.h"
+#include "manager.h"
+#include "rm-rf.h"
+#include "tests.h"
+#include "time-util.h"
+
+/* Builds the transaction for starting a unit over and over, the way PID 1 does when e.g. multi-user.target is
+ * started. By default, the test units shipped with the sources are used. Alternatively, a directory with a saved
+ * unit graph (e.g. a copy of /usr/lib/systemd/system/) and the unit to start may be passed. */
+
+static usec_t arg_duration = 5 * USEC_PER_SEC;
+
+int main(int argc, char *argv[]) {
+        _cleanup_(rm_rf_physical_and_freep) char *runtime_dir = NULL;
+        _cleanup_(manager_freep) Manager *m = NULL;
+        _cleanup_free_ char *unit_dir = NULL;
+        const char *unit_name;
+        size_t n_transactions = 0, n_jobs = 0;
+        char buf[FORMAT_TIMESPAN_MAX];
+        usec_t start, elapsed;
+        Unit *u;
+        int r;
+
+        test_setup_logging(LOG_INFO);
+
+        r = enter_cgroup_subroot(NULL);
+        if (r == -ENOMEDIUM)
+                return log_tests_skipped("cgroupfs not available");
+
+        if (argc > 1) {
+                unit_dir = strdup(argv[1]);
+                if (!unit_dir)
+                        return log_oom();
+        } else
+                assert_se(get_testdata_dir("units", &unit_dir) >= 0);
+        unit_name = argc > 2 ? argv[2] : "a.service";
+
+        assert_se(set_unit_path(unit_dir) >= 0);
+        assert_se(runtime_dir = setup_fake_runtime_dir());
+
+        r = manager_new(UNIT_FILE_USER, MANAGER_TEST_RUN_BASIC, &m);
+        if (manager_errno_skip_test(r))
+                return log_tests_skipped_errno(r, "manager_new");
+        assert_se(r >= 0);
+        assert_se(manager_startup(m, NULL, NULL) >= 0);
+
+        r = manager_load_startable_unit_or_warn(m, unit_name, NULL, &u);
+        if (r < 0)
+                return r;
+
+        start = now(CLOCK_MONOTONIC);
+        do {
+                _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+
+                r = manager_add_job(m, JOB_START, u, JOB_REPLACE, NULL, &error, NULL);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to build transaction for %s: %s", unit_name, bus_error_message(&error, r));
+
+                if (n_transactions == 0)
+                        n_jobs = hashmap_size(m->jobs);
+
+                manager_clear_jobs(m);
+                n_transactions++;
+
+                elapsed = now(CLOCK_MONOTONIC) - start;
+        } while (elapsed < arg_duration);
+
+        log_info("%zu transactions for %s with %zu jobs in %s, %.2f µs per transaction",
+                 n_transactions, unit_name, n_jobs,
+                 format_timespan(buf, sizeof(buf), elapsed, USEC_PER_MSEC),
+                 (double) elapsed / n_transactions);
+
+        return 0;
+}
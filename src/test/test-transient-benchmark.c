@@ -0,0 +1,353 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include "sd-bus.h"
+
+#include "alloc-util.h"
+#include "bus-error.h"
+#include "bus-unit-util.h"
+#include "bus-util.h"
+#include "parse-util.h"
+#include "process-util.h"
+#include "sort-util.h"
+#include "stdio-util.h"
+#include "string-util.h"
+#include "strv.h"
+#include "tests.h"
+#include "time-util.h"
+#include "unit-def.h"
+
+/* Creates, starts and stops transient services one after the other, the way systemd-run does, against a running
+ * manager: the user's own one by default, or the system manager if --system is passed as first argument. The
+ * number of units (100 by default) and additional unit properties in the usual Property=Value syntax may be
+ * passed, too. Each unit stays active until all units have been started, so that the later ones show how the
+ * manager copes with a growing number of units.
+ *
+ * The manager doesn't expose timestamps for loading the unit, installing the job or realizing the cgroup, hence
+ * the phases that can be told apart from the outside are reported instead:
+ *
+ *     call:   the StartTransientUnit() round trip, which covers loading the unit and installing its job
+ *     exec:   from the reply until the main process was forked off, i.e. running the job and realizing the cgroup
+ *     signal: from the fork until the JobRemoved signal of the start job was received
+ *     stop:   from StopUnit() until the JobRemoved signal of the stop job was received
+ *
+ * Both sides use CLOCK_MONOTONIC, so the manager's timestamps can be compared with ours. */
+
+typedef enum Phase {
+        PHASE_CALL,
+        PHASE_EXEC,
+        PHASE_SIGNAL,
+        PHASE_STOP,
+        _PHASE_MAX,
+} Phase;
+
+static const char* const phase_table[_PHASE_MAX] = {
+        [PHASE_CALL]   = "call",
+        [PHASE_EXEC]   = "exec",
+        [PHASE_SIGNAL] = "signal",
+        [PHASE_STOP]   = "stop",
+};
+
+typedef struct JobWait {
+        const char *path;
+        usec_t timestamp;
+        char *result;
+} JobWait;
+
+static int match_job_removed(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        JobWait *w = userdata;
+        const char *path, *unit, *result;
+        uint32_t id;
+        int r;
+
+        assert(w);
+
+        r = sd_bus_message_read(m, "uoss", &id, &path, &unit, &result);
+        if (r < 0)
+                return bus_log_parse_error(r);
+
+        if (!w->path || !streq(w->path, path))
+                return 0;
+
+        w->timestamp = now(CLOCK_MONOTONIC);
+        return free_and_strdup(&w->result, result);
+}
+
+static int wait_for_job(sd_bus *bus, JobWait *w, const char *path) {
+        int r;
+
+        assert(w);
+
+        /* The signal might already have been received while we were waiting for the reply of the method call */
+        while (w->timestamp == USEC_INFINITY) {
+                r = sd_bus_process(bus, NULL);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to process bus: %m");
+                if (r > 0)
+                        continue;
+
+                r = sd_bus_wait(bus, USEC_INFINITY);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to wait for bus: %m");
+        }
+
+        if (!streq(w->result, "done"))
+                return log_error_errno(SYNTHETIC_ERRNO(EIO), "Job %s finished with result '%s'.", path, w->result);
+
+        return 0;
+}
+
+static int start_unit(sd_bus *bus, JobWait *w, const char *name, char **properties, usec_t *phases) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL, *reply = NULL;
+        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+        _cleanup_free_ char *unit_path = NULL;
+        usec_t start, replied, forked;
+        const char *job;
+        int r;
+
+        r = sd_bus_message_new_method_call(
+                        bus,
+                        &m,
+                        "org.freedesktop.systemd1",
+                        "/org/freedesktop/systemd1",
+                        "org.freedesktop.systemd1.Manager",
+                        "StartTransientUnit");
+        if (r < 0)
+                return bus_log_create_error(r);
+
+        r = sd_bus_message_append(m, "ss", name, "fail");
+        if (r < 0)
+                return bus_log_create_error(r);
+
+        r = sd_bus_message_open_container(m, 'a', "(sv)");
+        if (r < 0)
+                return bus_log_create_error(r);
+
+        r = bus_append_unit_property_assignment_many(m, UNIT_SERVICE, properties);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_close_container(m);
+        if (r < 0)
+                return bus_log_create_error(r);
+
+        r = sd_bus_message_append(m, "a(sa(sv))", 0);
+        if (r < 0)
+                return bus_log_create_error(r);
+
+        w->timestamp = USEC_INFINITY;
+
+        start = now(CLOCK_MONOTONIC);
+        r = sd_bus_call(bus, m, 0, &error, &reply);
+        if (r < 0)
+                return log_error_errno(r, "Failed to start %s: %s", name, bus_error_message(&error, r));
+        replied = now(CLOCK_MONOTONIC);
+
+        r = sd_bus_message_read(reply, "o", &job);
+        if (r < 0)
+                return bus_log_parse_error(r);
+
+        w->path = job;
+        r = wait_for_job(bus, w, job);
+        w->path = NULL;
+        if (r < 0)
+                return r;
+
+        unit_path = unit_dbus_path_from_name(name);
+        if (!unit_path)
+                return log_oom();
+
+        r = sd_bus_get_property_trivial(
+                        bus,
+                        "org.freedesktop.systemd1",
+                        unit_path,
+                        "org.freedesktop.systemd1.Service",
+                        "ExecMainStartTimestampMonotonic",
+                        &error,
+                        't', &forked);
+        if (r < 0)
+                return log_error_errno(r, "Failed to get start timestamp of %s: %s", name, bus_error_message(&error, r));
+
+        phases[PHASE_CALL] = replied - start;
+        phases[PHASE_EXEC] = usec_sub_unsigned(forked, replied);
+        phases[PHASE_SIGNAL] = usec_sub_unsigned(w->timestamp, forked);
+
+        return 0;
+}
+
+static int stop_unit(sd_bus *bus, JobWait *w, const char *name, usec_t *phases) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+        const char *job;
+        usec_t start;
+        int r;
+
+        w->timestamp = USEC_INFINITY;
+
+        start = now(CLOCK_MONOTONIC);
+        r = sd_bus_call_method(
+                        bus,
+                        "org.freedesktop.systemd1",
+                        "/org/freedesktop/systemd1",
+                        "org.freedesktop.systemd1.Manager",
+                        "StopUnit",
+                        &error,
+                        &reply,
+                        "ss", name, "fail");
+        if (r < 0)
+                return log_error_errno(r, "Failed to stop %s: %s", name, bus_error_message(&error, r));
+
+        r = sd_bus_message_read(reply, "o", &job);
+        if (r < 0)
+                return bus_log_parse_error(r);
+
+        w->path = job;
+        r = wait_for_job(bus, w, job);
+        w->path = NULL;
+        if (r < 0)
+                return r;
+
+        phases[PHASE_STOP] = w->timestamp - start;
+        return 0;
+}
+
+static int usec_compare(const usec_t *a, const usec_t *b) {
+        return CMP(*a, *b);
+}
+
+static void report_phase(Phase p, usec_t *samples, size_t n) {
+        char buf[3][FORMAT_TIMESPAN_MAX];
+
+        if (n == 0)
+                return;
+
+        typesafe_qsort(samples, n, usec_compare);
+
+        log_info("%-6s p50 %-10s p99 %-10s max %s",
+                 phase_table[p],
+                 format_timespan(buf[0], sizeof(buf[0]), samples[n / 2], 1),
+                 format_timespan(buf[1], sizeof(buf[1]), samples[MIN(n - 1, n * 99 / 100)], 1),
+                 format_timespan(buf[2], sizeof(buf[2]), samples[n - 1], 1));
+}
+
+int main(int argc, char *argv[]) {
+        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *bus = NULL;
+        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+        _cleanup_strv_free_ char **properties = NULL;
+        _cleanup_free_ usec_t *samples = NULL;
+        size_t n_units = 100, n_started = 0, n_stopped = 0;
+        char buf[FORMAT_TIMESPAN_MAX];
+        bool user = true;
+        usec_t start, elapsed;
+        JobWait w = {};
+        int r, k;
+
+        test_setup_logging(LOG_INFO);
+
+        if (argc > 1 && streq(argv[1], "--system")) {
+                user = false;
+                argc--, argv++;
+        }
+
+        if (argc > 1) {
+                r = safe_atozu(argv[1], &n_units);
+                if (r < 0 || n_units == 0)
+                        return log_error_errno(r < 0 ? r : SYNTHETIC_ERRNO(EINVAL), "Invalid number of units: %s", argv[1]);
+        }
+
+        properties = strv_copy(argc > 2 ? argv + 2 : STRV_MAKE_EMPTY);
+        if (!properties)
+                return log_oom();
+
+        if (!strv_find_startswith(properties, "ExecStart=")) {
+                r = strv_extend(&properties, "ExecStart=/bin/sleep infinity");
+                if (r < 0)
+                        return log_oom();
+        }
+
+        r = bus_connect_transport_systemd(BUS_TRANSPORT_LOCAL, NULL, user, &bus);
+        if (r < 0)
+                return log_tests_skipped_errno(r, "cannot connect to the service manager");
+
+        r = sd_bus_match_signal(
+                        bus,
+                        NULL,
+                        "org.freedesktop.systemd1",
+                        "/org/freedesktop/systemd1",
+                        "org.freedesktop.systemd1.Manager",
+                        "JobRemoved",
+                        match_job_removed, &w);
+        if (r < 0)
+                return log_error_errno(r, "Failed to add match for JobRemoved: %m");
+
+        r = sd_bus_call_method(
+                        bus,
+                        "org.freedesktop.systemd1",
+                        "/org/freedesktop/systemd1",
+                        "org.freedesktop.systemd1.Manager",
+                        "Subscribe",
+                        &error,
+                        NULL, NULL);
+        if (r < 0)
+                return log_error_errno(r, "Failed to subscribe to manager signals: %s", bus_error_message(&error, r));
+
+        samples = new(usec_t, n_units * _PHASE_MAX);
+        if (!samples)
+                return log_oom();
+
+        log_info("Starting %zu transient services...", n_units);
+
+        start = now(CLOCK_MONOTONIC);
+        for (; n_started < n_units; n_started++) {
+                usec_t phases[_PHASE_MAX];
+                char name[STRLEN("benchmark--.service") + DECIMAL_STR_MAX(pid_t) + DECIMAL_STR_MAX(size_t)];
+
+                xsprintf(name, "benchmark-" PID_FMT "-%zu.service", getpid_cached(), n_started);
+
+                r = start_unit(bus, &w, name, properties, phases);
+                if (r < 0)
+                        break;
+
+                for (Phase p = PHASE_CALL; p <= PHASE_SIGNAL; p++)
+                        samples[p * n_units + n_started] = phases[p];
+        }
+        elapsed = now(CLOCK_MONOTONIC) - start;
+
+        if (n_started > 0)
+                log_info("Started %zu units in %s, %.1f units/s",
+                         n_started, format_timespan(buf, sizeof(buf), elapsed, USEC_PER_MSEC),
+                         (double) n_started * USEC_PER_SEC / elapsed);
+
+        /* Also stop whatever we managed to start if something failed on the way */
+        start = now(CLOCK_MONOTONIC);
+        for (size_t i = 0; i < n_started; i++) {
+                usec_t phases[_PHASE_MAX];
+                char name[STRLEN("benchmark--.service") + DECIMAL_STR_MAX(pid_t) + DECIMAL_STR_MAX(size_t)];
+
+                xsprintf(name, "benchmark-" PID_FMT "-%zu.service", getpid_cached(), i);
+
+                k = stop_unit(bus, &w, name, phases);
+                if (k < 0) {
+                        if (r >= 0)
+                                r = k;
+                        continue;
+                }
+
+                samples[PHASE_STOP * n_units + n_stopped++] = phases[PHASE_STOP];
+        }
+        elapsed = now(CLOCK_MONOTONIC) - start;
+
+        if (n_stopped > 0)
+                log_info("Stopped %zu units in %s, %.1f units/s",
+                         n_stopped, format_timespan(buf, sizeof(buf), elapsed, USEC_PER_MSEC),
+                         (double) n_stopped * USEC_PER_SEC / elapsed);
+
+        for (Phase p = 0; p < _PHASE_MAX; p++)
+                report_phase(p, samples + p * n_units, p == PHASE_STOP ? n_stopped : n_started);
+
+        free(w.result);
+
+        return r < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,62 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "fd-util.h"
+#include "tests.h"
+#include "time-util.h"
+#include "udev-ctrl.h"
+
+static void test_settled(void) {
+        _cleanup_close_pair_ int pair[2] = { -1, -1 };
+
+        log_info("/* %s */", __func__);
+
+        /* The daemon replies before it closes the connection */
+        assert_se(socketpair(AF_UNIX, SOCK_SEQPACKET|SOCK_CLOEXEC|SOCK_NONBLOCK, 0, pair) >= 0);
+        assert_se(udev_ctrl_send_settled(pair[1]) >= 0);
+        pair[1] = safe_close(pair[1]);
+        assert_se(udev_ctrl_read_settled(pair[0], 5 * USEC_PER_SEC) == 1);
+        safe_close_pair(pair);
+
+        /* The reply counts even if the connection stays open */
+        assert_se(socketpair(AF_UNIX, SOCK_SEQPACKET|SOCK_CLOEXEC|SOCK_NONBLOCK, 0, pair) >= 0);
+        assert_se(udev_ctrl_send_settled(pair[1]) >= 0);
+        assert_se(udev_ctrl_read_settled(pair[0], 5 * USEC_PER_SEC) == 1);
+        safe_close_pair(pair);
+
+        /* Anything else is skipped */
+        assert_se(socketpair(AF_UNIX, SOCK_SEQPACKET|SOCK_CLOEXEC|SOCK_NONBLOCK, 0, pair) >= 0);
+        assert_se(write(pair[1], "foobar", 6) == 6);
+        assert_se(udev_ctrl_send_settled(pair[1]) >= 0);
+        assert_se(udev_ctrl_read_settled(pair[0], 5 * USEC_PER_SEC) == 1);
+        safe_close_pair(pair);
+}
+
+static void test_not_settled(void) {
+        _cleanup_close_pair_ int pair[2] = { -1, -1 };
+
+        log_info("/* %s */", __func__);
+
+        /* A daemon that doesn't know about settling closes the connection right away, without a reply */
+        assert_se(socketpair(AF_UNIX, SOCK_SEQPACKET|SOCK_CLOEXEC|SOCK_NONBLOCK, 0, pair) >= 0);
+        assert_se(write(pair[1], "foobar", 6) == 6);
+        pair[1] = safe_close(pair[1]);
+        assert_se(udev_ctrl_read_settled(pair[0], 5 * USEC_PER_SEC) == 0);
+        safe_close_pair(pair);
+
+        /* And a daemon that is still busy lets us time out */
+        assert_se(socketpair(AF_UNIX, SOCK_SEQPACKET|SOCK_CLOEXEC|SOCK_NONBLOCK, 0, pair) >= 0);
+        assert_se(udev_ctrl_read_settled(pair[0], 10 * USEC_PER_MSEC) == -ETIMEDOUT);
+        assert_se(udev_ctrl_read_settled(pair[0], 0) == -ETIMEDOUT);
+}
+
+int main(int argc, char *argv[]) {
+        test_setup_logging(LOG_DEBUG);
+
+        test_settled();
+        test_not_settled();
+
+        return 0;
+}
@@ -0,0 +1,55 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <unistd.h>
+
+#include "sd-device.h"
+
+#include "device-private.h"
+#include "log.h"
+#include "tests.h"
+#include "udev-builtin.h"
+#include "udev-event.h"
+#include "udev-rules.h"
+
+/* Benchmarks loading the installed udev rules, and evaluating them for a "change" event of a simple device,
+ * without executing anything queued via RUN=, and without touching the device node or the udev database. */
+
+#define SYSPATH "/sys/devices/virtual/mem/null"
+
+static void load_rules(void *userdata) {
+        _cleanup_(udev_rules_freep) UdevRules *rules = NULL;
+
+        assert_se(udev_rules_new(&rules, RESOLVE_NAME_NEVER) >= 0);
+}
+
+static void apply_rules(void *userdata) {
+        _cleanup_(sd_device_unrefp) sd_device *dev = NULL;
+        _cleanup_(udev_event_freep) UdevEvent *event = NULL;
+
+        assert_se(device_new_from_synthetic_event(&dev, SYSPATH, "change") >= 0);
+
+        /* Don't read info from the db */
+        device_seal(dev);
+
+        assert_se(event = udev_event_new(dev, 0, NULL));
+        assert_se(udev_rules_apply_to_event(userdata, event, 60 * USEC_PER_SEC, NULL) >= 0);
+}
+
+int main(int argc, char *argv[]) {
+        _cleanup_(udev_rules_freep) UdevRules *rules = NULL;
+
+        test_setup_logging(LOG_INFO);
+
+        if (access(SYSPATH, F_OK) < 0)
+                return log_tests_skipped_errno(errno, "Cannot access " SYSPATH);
+
+        udev_builtin_init();
+
+        benchmark_run("udev-rules-load", load_rules, NULL, 1);
+
+        assert_se(udev_rules_new(&rules, RESOLVE_NAME_NEVER) >= 0);
+        benchmark_run("udev-rules-apply", apply_rules, rules, 1);
+
+        udev_builtin_exit();
+        return 0;
+}
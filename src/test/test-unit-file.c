@@ -1,10 +1,17 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "fs-util.h"
 #include "path-lookup.h"
+#include "rm-rf.h"
 #include "set.h"
 #include "special.h"
 #include "strv.h"
 #include "tests.h"
+#include "tmpfile-util.h"
 #include "unit-file.h"
 
 static void test_unit_validate_alias_symlink_and_warn(void) {
@@ -38,7 +45,7 @@ static void test_unit_file_build_name_map(char **ids) {
 
         assert_se(lookup_paths_init(&lp, UNIT_FILE_SYSTEM, 0, NULL) >= 0);
 
-        assert_se(unit_file_build_name_map(&lp, &mtime, &unit_ids, &unit_names, NULL) == 1);
+        assert_se(unit_file_build_name_map(&lp, &mtime, &unit_ids, &unit_names, NULL, NULL) == 1);
 
         HASHMAP_FOREACH_KEY(dst, k, unit_ids, i)
                 log_info("ids: %s → %s", k, dst);
@@ -51,7 +58,7 @@ static void test_unit_file_build_name_map(char **ids) {
         char buf[FORMAT_TIMESTAMP_MAX];
         log_debug("Last modification time: %s", format_timestamp(buf, sizeof buf, mtime));
 
-        r = unit_file_build_name_map(&lp, &mtime, &unit_ids, &unit_names, NULL);
+        r = unit_file_build_name_map(&lp, &mtime, &unit_ids, &unit_names, NULL, NULL);
         assert_se(IN_SET(r, 0, 1));
         if (r == 0)
                 log_debug("Cache rebuild skipped based on mtime.");
@@ -75,6 +82,74 @@ static void test_unit_file_build_name_map(char **ids) {
         }
 }
 
+static void test_unit_file_build_name_map_cached(void) {
+        _cleanup_(rm_rf_physical_and_freep) char *t = NULL;
+        _cleanup_(unit_file_cache_freep) UnitFileCache *cache = NULL;
+        _cleanup_(lookup_paths_free) LookupPaths lp = {};
+        _cleanup_hashmap_free_ Hashmap *unit_ids = NULL, *unit_names = NULL;
+        const char *a, *b, *p;
+        struct stat st;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(mkdtemp_malloc("/tmp/test-unit-file.XXXXXX", &t) >= 0);
+        a = strjoina(t, "/a");
+        b = strjoina(t, "/b");
+        assert_se(mkdir(a, 0755) >= 0);
+        assert_se(mkdir(b, 0755) >= 0);
+
+        p = strjoina(a, "/one.service");
+        assert_se(touch(p) >= 0);
+        p = strjoina(a, "/alias.service");
+        assert_se(symlink("one.service", p) >= 0);
+        p = strjoina(b, "/two.service");
+        assert_se(touch(p) >= 0);
+        p = strjoina(b, "/one.service");
+        assert_se(touch(p) >= 0);
+
+        assert_se(lp.search_path = strv_new(a, b));
+
+        assert_se(unit_file_build_name_map(&lp, NULL, &unit_ids, &unit_names, NULL, &cache) == 1);
+        assert_se(hashmap_size(unit_ids) == 3);
+        assert_se(streq(hashmap_get(unit_ids, "one.service"), strjoina(a, "/one.service")));
+        assert_se(streq(hashmap_get(unit_ids, "alias.service"), "one.service"));
+        assert_se(streq(hashmap_get(unit_ids, "two.service"), strjoina(b, "/two.service")));
+        unit_ids = hashmap_free(unit_ids);
+        unit_names = hashmap_free(unit_names);
+
+        /* Add an entry to a, but restore its mtime, hence the cached contents are used */
+        assert_se(stat(a, &st) >= 0);
+        p = strjoina(a, "/three.service");
+        assert_se(touch(p) >= 0);
+        assert_se(utimensat(AT_FDCWD, a, (const struct timespec[2]) { st.st_atim, st.st_mtim }, 0) >= 0);
+
+        /* A changed directory is read again */
+        p = strjoina(b, "/four.service");
+        assert_se(touch(p) >= 0);
+
+        assert_se(unit_file_build_name_map(&lp, NULL, &unit_ids, &unit_names, NULL, &cache) == 1);
+        assert_se(hashmap_size(unit_ids) == 4);
+        assert_se(!hashmap_contains(unit_ids, "three.service"));
+        assert_se(streq(hashmap_get(unit_ids, "four.service"), strjoina(b, "/four.service")));
+        unit_ids = hashmap_free(unit_ids);
+        unit_names = hashmap_free(unit_names);
+
+        /* Without the cache, everything is read */
+        assert_se(unit_file_build_name_map(&lp, NULL, &unit_ids, &unit_names, NULL, NULL) == 1);
+        assert_se(hashmap_size(unit_ids) == 5);
+        assert_se(hashmap_contains(unit_ids, "three.service"));
+        unit_ids = hashmap_free(unit_ids);
+        unit_names = hashmap_free(unit_names);
+
+        /* A different search path invalidates the cache */
+        strv_free(lp.search_path);
+        assert_se(lp.search_path = strv_new(b, a));
+
+        assert_se(unit_file_build_name_map(&lp, NULL, &unit_ids, &unit_names, NULL, &cache) == 1);
+        assert_se(hashmap_size(unit_ids) == 5);
+        assert_se(streq(hashmap_get(unit_ids, "one.service"), strjoina(b, "/one.service")));
+}
+
 static void test_runlevel_to_target(void) {
         log_info("/* %s */", __func__);
 
@@ -98,6 +173,7 @@ int main(int argc, char **argv) {
 
         test_unit_validate_alias_symlink_and_warn();
         test_unit_file_build_name_map(strv_skip(argv, 1));
+        test_unit_file_build_name_map_cached();
         test_runlevel_to_target();
 
         return 0;
@@ -0,0 +1,53 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include "manager.h"
+#include "rm-rf.h"
+#include "tests.h"
+
+/* Benchmarks setting up a manager and loading all unit files in the unit path, i.e. the test units shipped
+ * with the sources. */
+
+static unsigned load_units(void) {
+        _cleanup_(manager_freep) Manager *m = NULL;
+
+        assert_se(manager_new(UNIT_FILE_USER, MANAGER_TEST_RUN_BASIC, &m) >= 0);
+        assert_se(manager_startup(m, NULL, NULL) >= 0);
+
+        return hashmap_size(m->units);
+}
+
+static void load_units_one(void *userdata) {
+        (void) load_units();
+}
+
+int main(int argc, char *argv[]) {
+        _cleanup_(rm_rf_physical_and_freep) char *runtime_dir = NULL;
+        _cleanup_(manager_freep) Manager *m = NULL;
+        _cleanup_free_ char *unit_dir = NULL;
+        unsigned n_units;
+        int r;
+
+        test_setup_logging(LOG_WARNING);
+
+        r = enter_cgroup_subroot(NULL);
+        if (r == -ENOMEDIUM)
+                return log_tests_skipped("cgroupfs not available");
+
+        assert_se(get_testdata_dir("units", &unit_dir) >= 0);
+        assert_se(set_unit_path(unit_dir) >= 0);
+        assert_se(runtime_dir = setup_fake_runtime_dir());
+
+        r = manager_new(UNIT_FILE_USER, MANAGER_TEST_RUN_BASIC, &m);
+        if (manager_errno_skip_test(r))
+                return log_tests_skipped_errno(r, "manager_new");
+        assert_se(r >= 0);
+        m = manager_free(m);
+
+        /* The number of units is what we report as operations, so that the result is per unit */
+        n_units = load_units();
+        assert_se(n_units > 0);
+
+        benchmark_run("unit-load", load_units_one, NULL, n_units);
+
+        return 0;
+}
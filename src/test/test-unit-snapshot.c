@@ -0,0 +1,104 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include "alloc-util.h"
+#include "memory-util.h"
+#include "mkdir.h"
+#include "path-util.h"
+#include "rm-rf.h"
+#include "stdio-util.h"
+#include "string-util.h"
+#include "tests.h"
+#include "tmpfile-util.h"
+#include "unit-snapshot.h"
+
+static void fill_entry(UnitSnapshotEntry *e, const char *id, const char *active, uint32_t pid) {
+        zero(*e);
+        strncpy(e->id, id, sizeof(e->id) - 1);
+        strncpy(e->load_state, "loaded", sizeof(e->load_state) - 1);
+        strncpy(e->active_state, active, sizeof(e->active_state) - 1);
+        strncpy(e->sub_state, "running", sizeof(e->sub_state) - 1);
+        e->main_pid = pid;
+}
+
+static void test_unit_snapshot(void) {
+        _cleanup_(rm_rf_physical_and_freep) char *d = NULL;
+        _cleanup_(unit_snapshot_writer_freep) UnitSnapshotWriter *w = NULL;
+        _cleanup_free_ UnitSnapshotEntry *entries = NULL;
+        _cleanup_free_ char *path = NULL, *units = NULL;
+        UnitSnapshotEntry e;
+        size_t a, b, c, n;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(mkdtemp_malloc("/tmp/test-unit-snapshot-XXXXXX", &d) >= 0);
+
+        /* The manager keeps per-unit symlinks in <runtime>/systemd/units/, make sure the snapshot does not
+         * collide with that directory. */
+        assert_se(units = path_join(d, "systemd/units"));
+        assert_se(mkdir_p(units, 0755) >= 0);
+        assert_se(unit_snapshot_writer_new(units, &w) == -EISDIR);
+
+        assert_se(path = path_join(d, UNIT_SNAPSHOT_FILE));
+        assert_se(unit_snapshot_writer_new(path, &w) >= 0);
+
+        assert_se(unit_snapshot_read(path, &entries, &n) >= 0);
+        assert_se(n == 0);
+        entries = mfree(entries);
+
+        assert_se(unit_snapshot_writer_add(w, &a) >= 0);
+        assert_se(unit_snapshot_writer_add(w, &b) >= 0);
+        assert_se(a != b);
+
+        fill_entry(&e, "foo.service", "active", 4711);
+        unit_snapshot_writer_update(w, a, &e);
+        fill_entry(&e, "bar.socket", "activating", 0);
+        unit_snapshot_writer_update(w, b, &e);
+
+        assert_se(unit_snapshot_read(path, &entries, &n) >= 0);
+        assert_se(n == 2);
+        assert_se(streq(entries[0].id, "foo.service"));
+        assert_se(streq(entries[0].active_state, "active"));
+        assert_se(entries[0].main_pid == 4711);
+        assert_se(streq(entries[1].id, "bar.socket"));
+        assert_se(streq(entries[1].active_state, "activating"));
+        entries = mfree(entries);
+
+        /* Removed slots are reused */
+        unit_snapshot_writer_remove(w, a);
+        assert_se(unit_snapshot_read(path, &entries, &n) >= 0);
+        assert_se(n == 1);
+        assert_se(streq(entries[0].id, "bar.socket"));
+        entries = mfree(entries);
+
+        assert_se(unit_snapshot_writer_add(w, &c) >= 0);
+        assert_se(c == a);
+
+        /* Grow the file beyond its initial size */
+        for (unsigned i = 0; i < 1000; i++) {
+                char id[UNIT_NAME_MAX + 1];
+                size_t k;
+
+                assert_se(unit_snapshot_writer_add(w, &k) >= 0);
+                xsprintf(id, "test%u.service", i);
+                fill_entry(&e, id, "inactive", i);
+                unit_snapshot_writer_update(w, k, &e);
+        }
+
+        assert_se(unit_snapshot_read(path, &entries, &n) >= 0);
+        assert_se(n == 1001);
+        entries = mfree(entries);
+
+        /* A new writer replaces the file */
+        w = unit_snapshot_writer_free(w);
+        assert_se(unit_snapshot_writer_new(path, &w) >= 0);
+        assert_se(unit_snapshot_read(path, &entries, &n) >= 0);
+        assert_se(n == 0);
+}
+
+int main(int argc, char *argv[]) {
+        test_setup_logging(LOG_DEBUG);
+
+        test_unit_snapshot();
+
+        return 0;
+}
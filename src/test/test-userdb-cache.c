@@ -0,0 +1,195 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "fd-util.h"
+#include "io-util.h"
+#include "rm-rf.h"
+#include "string-util.h"
+#include "strv.h"
+#include "tests.h"
+#include "tmpfile-util.h"
+#include "userdb-cache.h"
+
+static void add_user(UserDBCacheBuilder *b, const char *name, uid_t uid, const char *service, bool privileged) {
+        _cleanup_(user_record_unrefp) UserRecord *ur = NULL;
+        char **hashed_password = STRV_MAKE("$6$xx$yy");
+
+        assert_se(user_record_build(
+                        &ur,
+                        JSON_BUILD_OBJECT(JSON_BUILD_PAIR("userName", JSON_BUILD_STRING(name)),
+                                          JSON_BUILD_PAIR("uid", JSON_BUILD_UNSIGNED(uid)),
+                                          JSON_BUILD_PAIR("service", JSON_BUILD_STRING(service)),
+                                          JSON_BUILD_PAIR_CONDITION(privileged, "privileged",
+                                                                    JSON_BUILD_OBJECT(JSON_BUILD_PAIR("hashedPassword", JSON_BUILD_STRV(hashed_password))))) ) >= 0);
+
+        assert_se(userdb_cache_builder_add_user(b, ur) >= 0);
+}
+
+static void add_group(UserDBCacheBuilder *b, const char *name, gid_t gid) {
+        _cleanup_(group_record_unrefp) GroupRecord *gr = NULL;
+
+        assert_se(group_record_build(
+                        &gr,
+                        JSON_BUILD_OBJECT(JSON_BUILD_PAIR("groupName", JSON_BUILD_STRING(name)),
+                                          JSON_BUILD_PAIR("gid", JSON_BUILD_UNSIGNED(gid)),
+                                          JSON_BUILD_PAIR("service", JSON_BUILD_STRING("io.systemd.Test")))) >= 0);
+
+        assert_se(userdb_cache_builder_add_group(b, gr) >= 0);
+}
+
+static void write_cache(const char *path, usec_t until) {
+        _cleanup_(userdb_cache_builder_freep) UserDBCacheBuilder *b = NULL;
+
+        assert_se(userdb_cache_builder_new(&b) >= 0);
+
+        add_user(b, "alice", 1000, "io.systemd.Test", true);
+        add_user(b, "bob", 1001, "io.systemd.Test", false);
+
+        /* The first service wins, the rest of the record is only reachable by what is not taken yet */
+        add_user(b, "alice", 1002, "io.systemd.Other", false);
+
+        assert_se(userdb_cache_builder_add_membership(b, "alice", "users") >= 0);
+        assert_se(userdb_cache_builder_add_membership(b, "bob", "users") >= 0);
+        assert_se(userdb_cache_builder_add_membership(b, "alice", "users") >= 0);
+        assert_se(userdb_cache_builder_add_membership(b, "bob", "nogroup-record") >= 0);
+
+        add_group(b, "users", 100);
+        add_group(b, "empty", 101);
+
+        assert_se(userdb_cache_builder_write(b, path, until) > 0);
+}
+
+static void test_lookup(const char *path) {
+        _cleanup_(user_record_unrefp) UserRecord *ur = NULL;
+        _cleanup_(group_record_unrefp) GroupRecord *gr = NULL;
+        _cleanup_strv_free_ char **members = NULL;
+
+        log_info("/* %s */", __func__);
+
+        write_cache(path, usec_add(now(CLOCK_MONOTONIC), USEC_PER_MINUTE));
+
+        /* The privileged section is stripped, hence the record is marked incomplete */
+        assert_se(userdb_cache_user_by_name(path, "alice", &ur) >= 0);
+        assert_se(ur->uid == 1000);
+        assert_se(streq(ur->service, "io.systemd.Test"));
+        assert_se(ur->incomplete);
+        assert_se(strv_isempty(ur->hashed_password));
+        ur = user_record_unref(ur);
+
+        assert_se(userdb_cache_user_by_uid(path, 1001, &ur) >= 0);
+        assert_se(streq(ur->user_name, "bob"));
+        assert_se(!ur->incomplete);
+        ur = user_record_unref(ur);
+
+        assert_se(userdb_cache_user_by_uid(path, 1002, &ur) >= 0);
+        assert_se(streq(ur->user_name, "alice"));
+        assert_se(streq(ur->service, "io.systemd.Other"));
+        ur = user_record_unref(ur);
+
+        assert_se(userdb_cache_user_by_name(path, "carol", NULL) == -ESRCH);
+        assert_se(userdb_cache_user_by_uid(path, 1003, NULL) == -ESRCH);
+
+        assert_se(userdb_cache_group_by_name(path, "users", &gr) >= 0);
+        assert_se(gr->gid == 100);
+        gr = group_record_unref(gr);
+
+        assert_se(userdb_cache_group_by_gid(path, 101, &gr) >= 0);
+        assert_se(streq(gr->group_name, "empty"));
+        gr = group_record_unref(gr);
+
+        assert_se(userdb_cache_group_by_name(path, "wheel", NULL) == -ESRCH);
+        assert_se(userdb_cache_group_by_gid(path, 102, NULL) == -ESRCH);
+
+        /* Member lists are sorted and without duplicates, and exist for every group */
+        assert_se(userdb_cache_members_by_group(path, "users", &members) >= 0);
+        assert_se(strv_equal(members, STRV_MAKE("alice", "bob")));
+        members = strv_free(members);
+
+        assert_se(userdb_cache_members_by_group(path, "empty", &members) >= 0);
+        assert_se(strv_isempty(members));
+        members = strv_free(members);
+
+        assert_se(userdb_cache_members_by_group(path, "nogroup-record", &members) >= 0);
+        assert_se(strv_equal(members, STRV_MAKE("bob")));
+        members = strv_free(members);
+
+        assert_se(userdb_cache_members_by_group(path, "wheel", &members) == -ESRCH);
+        assert_se(userdb_cache_members_by_group(path, "alice", &members) == -ESRCH);
+
+        /* Keys of one kind don't match another */
+        assert_se(userdb_cache_group_by_name(path, "alice", NULL) == -ESRCH);
+        assert_se(userdb_cache_user_by_name(path, "users", NULL) == -ESRCH);
+}
+
+static void test_expired(const char *path) {
+        log_info("/* %s */", __func__);
+
+        write_cache(path, 1);
+
+        assert_se(userdb_cache_user_by_name(path, "alice", NULL) == -ESTALE);
+        assert_se(userdb_cache_group_by_gid(path, 100, NULL) == -ESTALE);
+}
+
+static void test_corrupt(const char *path) {
+        _cleanup_close_ int fd = -1;
+
+        log_info("/* %s */", __func__);
+
+        write_cache(path, usec_add(now(CLOCK_MONOTONIC), USEC_PER_MINUTE));
+
+        /* The size doesn't match the header */
+        assert_se((fd = open(path, O_WRONLY|O_APPEND|O_CLOEXEC)) >= 0);
+        assert_se(loop_write(fd, "x", 1, false) >= 0);
+        fd = safe_close(fd);
+        assert_se(userdb_cache_user_by_name(path, "alice", NULL) == -EBADMSG);
+
+        /* Bad signature */
+        write_cache(path, usec_add(now(CLOCK_MONOTONIC), USEC_PER_MINUTE));
+        assert_se((fd = open(path, O_WRONLY|O_CLOEXEC)) >= 0);
+        assert_se(loop_write(fd, "X", 1, false) >= 0);
+        fd = safe_close(fd);
+        assert_se(userdb_cache_user_by_name(path, "alice", NULL) == -EBADMSG);
+
+        /* Too short */
+        assert_se(truncate(path, 16) >= 0);
+        assert_se(userdb_cache_user_by_name(path, "alice", NULL) == -EBADMSG);
+
+        /* Writable by others */
+        write_cache(path, usec_add(now(CLOCK_MONOTONIC), USEC_PER_MINUTE));
+        assert_se(chmod(path, 0666) >= 0);
+        assert_se(userdb_cache_user_by_name(path, "alice", NULL) == -EPERM);
+}
+
+static void test_empty(const char *path) {
+        _cleanup_(userdb_cache_builder_freep) UserDBCacheBuilder *b = NULL;
+
+        log_info("/* %s */", __func__);
+
+        write_cache(path, usec_add(now(CLOCK_MONOTONIC), USEC_PER_MINUTE));
+
+        /* Nothing to cache removes the old snapshot */
+        assert_se(userdb_cache_builder_new(&b) >= 0);
+        assert_se(userdb_cache_builder_write(b, path, usec_add(now(CLOCK_MONOTONIC), USEC_PER_MINUTE)) == 0);
+        assert_se(access(path, F_OK) < 0 && errno == ENOENT);
+
+        assert_se(userdb_cache_user_by_name(path, "alice", NULL) == -ESRCH);
+}
+
+int main(int argc, char *argv[]) {
+        _cleanup_(rm_rf_physical_and_freep) char *dir = NULL;
+        const char *path;
+
+        test_setup_logging(LOG_DEBUG);
+
+        assert_se(mkdtemp_malloc("/tmp/test-userdb-cache.XXXXXX", &dir) >= 0);
+        path = strjoina(dir, "/userdb-cache");
+
+        test_lookup(path);
+        test_expired(path);
+        test_corrupt(path);
+        test_empty(path);
+
+        return 0;
+}
@@ -1,9 +1,12 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
 #include <errno.h>
+#include <fcntl.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
+#include "cgroup-util.h"
+#include "fd-util.h"
 #include "fileio.h"
 #include "fs-util.h"
 #include "limits-util.h"
@@ -319,6 +322,40 @@ static void test_raw_clone(void) {
         assert_se(errno == EINVAL);
 }
 
+static void test_raw_clone_into_cgroup(void) {
+        _cleanup_free_ char *cgroup = NULL, *path = NULL, *child_cgroup = NULL;
+        _cleanup_close_ int fd = -1;
+        int status;
+        pid_t pid;
+
+        log_info("/* %s */", __func__);
+
+        if (cg_all_unified() <= 0) {
+                log_info("Skipping %s: not running on the unified cgroup hierarchy", __func__);
+                return;
+        }
+
+        assert_se(cg_pid_get_path(SYSTEMD_CGROUP_CONTROLLER, 0, &cgroup) >= 0);
+        assert_se(cg_get_path(SYSTEMD_CGROUP_CONTROLLER, cgroup, NULL, &path) >= 0);
+        assert_se((fd = open(path, O_RDONLY|O_DIRECTORY|O_CLOEXEC)) >= 0);
+
+        pid = raw_clone_into_cgroup(fd);
+        if (pid < 0 && IN_SET(errno, ENOSYS, E2BIG, EINVAL, EPERM)) {
+                log_info_errno(errno, "Skipping %s: clone3() with CLONE_INTO_CGROUP not available: %m", __func__);
+                return;
+        }
+        assert_se(pid >= 0);
+
+        if (pid == 0) {
+                assert_se(getpid_cached() == raw_getpid());
+                assert_se(cg_pid_get_path(SYSTEMD_CGROUP_CONTROLLER, 0, &child_cgroup) >= 0);
+                _exit(streq(child_cgroup, cgroup) ? EXIT_SUCCESS : EXIT_FAILURE);
+        }
+
+        assert_se(waitpid(pid, &status, 0) == pid);
+        assert_se(WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS);
+}
+
 static void test_physical_memory(void) {
         uint64_t p;
         char buf[FORMAT_BYTES_MAX];
@@ -424,6 +461,7 @@ int main(int argc, char *argv[]) {
         test_log2i();
         test_eqzero();
         test_raw_clone();
+        test_raw_clone_into_cgroup();
         test_physical_memory();
         test_physical_memory_scale();
         test_system_tasks_max();
@@ -140,6 +140,49 @@ static void flood_test(const char *address) {
                 connections[k] = varlink_unref(connections[k]);
 }
 
+static void pool_test(const char *address) {
+        _cleanup_(json_variant_unrefp) JsonVariant *i = NULL;
+        Varlink *c, *d;
+        JsonVariant *o = NULL;
+        const char *e;
+
+        log_debug("Testing connection pool.");
+
+        assert_se(json_build(&i, JSON_BUILD_OBJECT(JSON_BUILD_PAIR("a", JSON_BUILD_INTEGER(1)),
+                                                   JSON_BUILD_PAIR("b", JSON_BUILD_INTEGER(2)))) >= 0);
+
+        assert_se(varlink_connect_pooled(&c, address) >= 0);
+        assert_se(varlink_call(c, "io.test.DoSomething", i, &o, &e, NULL) >= 0);
+        assert_se(json_variant_integer(json_variant_by_key(o, "sum")) == 1 + 2);
+        assert_se(!varlink_release_pooled(c));
+
+        /* The idle connection is handed out again, and still works */
+        assert_se(varlink_connect_pooled(&d, address) >= 0);
+        assert_se(d == c);
+        assert_se(varlink_call(d, "io.test.DoSomething", i, &o, &e, NULL) >= 0);
+        assert_se(json_variant_integer(json_variant_by_key(o, "sum")) == 1 + 2);
+
+        /* While it's in use, a second one is set up */
+        assert_se(varlink_connect_pooled(&c, address) >= 0);
+        assert_se(c != d);
+
+        /* Connections with unflushed output are not pooled */
+        assert_se(varlink_send(c, "io.test.DoSomething", i) >= 0);
+        assert_se(!varlink_release_pooled(c));
+
+        assert_se(!varlink_release_pooled(d));
+
+        /* Neither are connections that were not acquired from the pool, they don't replace the pooled one */
+        assert_se(varlink_connect_address(&c, address) >= 0);
+        assert_se(!varlink_release_pooled(c));
+
+        assert_se(varlink_connect_pooled(&c, address) >= 0);
+        assert_se(c == d);
+        assert_se(varlink_call(c, "io.test.DoSomething", i, &o, &e, NULL) >= 0);
+        assert_se(json_variant_integer(json_variant_by_key(o, "sum")) == 1 + 2);
+        c = varlink_flush_close_unref(c);
+}
+
 static void *thread(void *arg) {
         _cleanup_(varlink_flush_close_unrefp) Varlink *c = NULL;
         _cleanup_(json_variant_unrefp) JsonVariant *i = NULL;
@@ -156,10 +199,15 @@ static void *thread(void *arg) {
         assert_se(json_variant_integer(json_variant_by_key(o, "sum")) == 88 + 99);
         assert_se(!e);
 
+        assert_se(varlink_call(c, "io.test.DoSomethingThreaded", i, &o, &e, NULL) >= 0);
+        assert_se(json_variant_integer(json_variant_by_key(o, "sum")) == 88 + 99);
+        assert_se(!e);
+
         assert_se(varlink_callb(c, "io.test.IDontExist", &o, &e, NULL, JSON_BUILD_OBJECT(JSON_BUILD_PAIR("x", JSON_BUILD_REAL(5.5)))) >= 0);
         assert_se(streq_ptr(json_variant_string(json_variant_by_key(o, "method")), "io.test.IDontExist"));
         assert_se(streq(e, VARLINK_ERROR_METHOD_NOT_FOUND));
 
+        pool_test(arg);
         flood_test(arg);
 
         assert_se(varlink_send(c, "io.test.Done", NULL) >= 0);
@@ -212,6 +260,7 @@ int main(int argc, char *argv[]) {
         assert_se(varlink_server_set_description(s, "our-server") >= 0);
 
         assert_se(varlink_server_bind_method(s, "io.test.DoSomething", method_something) >= 0);
+        assert_se(varlink_server_bind_method_full(s, "io.test.DoSomethingThreaded", method_something, VARLINK_BIND_THREADED) >= 0);
         assert_se(varlink_server_bind_method(s, "io.test.Done", method_done) >= 0);
         assert_se(varlink_server_bind_connect(s, on_connect) >= 0);
         assert_se(varlink_server_listen_address(s, sp, 0600) >= 0);
@@ -50,6 +50,14 @@
 /* Maximum number of missed replies before selecting another source. */
 #define NTP_MAX_MISSED_REPLIES          2
 
+/*
+ * Number of samples, and the interval between them, requested in quick
+ * succession after connecting to a server. Only the sample with the lowest
+ * round-trip delay of those is used, like the NTP clock filter does.
+ */
+#define NTP_BURST_SAMPLES               4U
+#define NTP_BURST_INTERVAL_USEC         (2 * USEC_PER_SEC)
+
 #define RETRY_USEC (30*USEC_PER_SEC)
 #define RATELIMIT_INTERVAL_USEC (10*USEC_PER_SEC)
 #define RATELIMIT_BURST 10
@@ -369,6 +377,40 @@ static bool manager_sample_spike_detection(Manager *m, double offset, double del
         return fabs(offset - m->samples[idx_cur].offset) > 3 * jitter;
 }
 
+static int manager_burst_sample(Manager *m, const struct ntp_msg *ntpmsg, const struct timespec *recv_time) {
+        double delay;
+        int r;
+
+        assert(m);
+        assert(ntpmsg);
+        assert(recv_time);
+        assert(m->burst_left > 0);
+
+        /* d = (T4 - T1) - (T3 - T2), see below */
+        delay = (ts_to_d(recv_time) - ts_to_d(&m->trans_time)) -
+                (ntp_ts_to_d(&ntpmsg->trans_time) - ntp_ts_to_d(&ntpmsg->recv_time));
+
+        if (m->burst_left == NTP_BURST_SAMPLES || delay < m->burst.delay)
+                m->burst = (typeof(m->burst)) {
+                        .delay = delay,
+                        .ntpmsg = *ntpmsg,
+                        .origin_time = m->trans_time,
+                        .dest_time = *recv_time,
+                };
+
+        m->burst_left--;
+        if (m->burst_left == 0)
+                return 1;
+
+        log_debug("Burst sample with delay %.3f sec, %u more to go.", delay, m->burst_left);
+
+        r = manager_arm_timer(m, NTP_BURST_INTERVAL_USEC);
+        if (r < 0)
+                return log_error_errno(r, "Failed to rearm timer: %m");
+
+        return 0;
+}
+
 static void manager_adjust_poll(Manager *m, double offset, bool spike) {
         assert(m);
 
@@ -524,6 +566,18 @@ static int manager_receive_response(sd_event_source *source, int fd, uint32_t re
         /* Stop listening */
         manager_listen_stop(m);
 
+        /* While the initial burst is running, only collect the samples, and continue with the best one of
+         * them once it's complete. */
+        if (m->burst_left > 0) {
+                r = manager_burst_sample(m, &ntpmsg, recv_time);
+                if (r <= 0)
+                        return r;
+
+                ntpmsg = m->burst.ntpmsg;
+                m->trans_time = m->burst.origin_time;
+                recv_time = &m->burst.dest_time;
+        }
+
         /* announce leap seconds */
         if (NTP_FIELD_LEAP(ntpmsg.field) & NTP_LEAP_PLUSSEC)
                 leap_sec = 1;
@@ -673,6 +727,7 @@ static int manager_begin(Manager *m) {
 
         m->good = false;
         m->missed_replies = NTP_MAX_MISSED_REPLIES;
+        m->burst_left = NTP_BURST_SAMPLES;
         if (m->poll_interval_usec == 0)
                 m->poll_interval_usec = m->poll_interval_min_usec;
 
@@ -75,6 +75,14 @@ struct Manager {
         double samples_jitter;
         usec_t max_root_distance_usec;
 
+        /* initial burst, and its sample with the lowest delay so far */
+        unsigned burst_left;
+        struct {
+                double delay;
+                struct ntp_msg ntpmsg;
+                struct timespec origin_time, dest_time;
+        } burst;
+
         /* last change */
         bool jumped;
         bool sync;
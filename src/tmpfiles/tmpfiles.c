@@ -10,6 +10,7 @@
 #include <stddef.h>
 #include <stdlib.h>
 #include <sys/file.h>
+#include <sys/socket.h>
 #include <sys/xattr.h>
 #include <sysexits.h>
 #include <time.h>
@@ -23,6 +24,7 @@
 #include "capability-util.h"
 #include "chattr-util.h"
 #include "conf-files.h"
+#include "cpu-set-util.h"
 #include "copy.h"
 #include "def.h"
 #include "dirent-util.h"
@@ -44,10 +46,14 @@
 #include "path-lookup.h"
 #include "path-util.h"
 #include "pretty-print.h"
+#include "process-util.h"
+#include "relabel.h"
 #include "rlimit-util.h"
 #include "rm-rf.h"
 #include "selinux-util.h"
 #include "set.h"
+#include "signal-util.h"
+#include "siphash24.h"
 #include "sort-util.h"
 #include "specifier.h"
 #include "stat-util.h"
@@ -55,6 +61,7 @@
 #include "string-table.h"
 #include "string-util.h"
 #include "strv.h"
+#include "tmpfile-util.h"
 #include "umask-util.h"
 #include "user-util.h"
 
@@ -146,6 +153,13 @@ typedef struct ItemArray {
         Set *children;
 } ItemArray;
 
+/* Per directory, when the oldest entry below it that wasn't removed was last touched */
+typedef struct CleanState {
+        dev_t dev;
+        ino_t ino;
+        usec_t oldest;
+} CleanState;
+
 typedef enum DirectoryType {
         DIRECTORY_RUNTIME,
         DIRECTORY_STATE,
@@ -167,12 +181,17 @@ static char *arg_replace = NULL;
 
 #define MAX_DEPTH 256
 
+#define CLEAN_STATE_FILE "/var/lib/systemd/tmpfiles/clean-state"
+
 static OrderedHashmap *items = NULL, *globs = NULL;
 static Set *unix_sockets = NULL;
+static Set *clean_state = NULL, *clean_state_new = NULL;
 
 STATIC_DESTRUCTOR_REGISTER(items, ordered_hashmap_freep);
 STATIC_DESTRUCTOR_REGISTER(globs, ordered_hashmap_freep);
 STATIC_DESTRUCTOR_REGISTER(unix_sockets, set_free_freep);
+STATIC_DESTRUCTOR_REGISTER(clean_state, set_freep);
+STATIC_DESTRUCTOR_REGISTER(clean_state_new, set_freep);
 STATIC_DESTRUCTOR_REGISTER(arg_include_prefixes, freep);
 STATIC_DESTRUCTOR_REGISTER(arg_exclude_prefixes, freep);
 STATIC_DESTRUCTOR_REGISTER(arg_root, freep);
@@ -484,6 +503,162 @@ static DIR* opendir_nomod(const char *path) {
         return xopendirat_nomod(AT_FDCWD, path);
 }
 
+static void clean_state_hash_func(const CleanState *s, struct siphash *state) {
+        siphash24_compress(&s->dev, sizeof(s->dev), state);
+        siphash24_compress(&s->ino, sizeof(s->ino), state);
+}
+
+static int clean_state_compare_func(const CleanState *a, const CleanState *b) {
+        int r;
+
+        r = CMP(a->dev, b->dev);
+        if (r != 0)
+                return r;
+
+        return CMP(a->ino, b->ino);
+}
+
+DEFINE_PRIVATE_HASH_OPS_WITH_KEY_DESTRUCTOR(clean_state_hash_ops, CleanState, clean_state_hash_func, clean_state_compare_func, free);
+
+static usec_t clean_state_get(const struct stat *st) {
+        CleanState *s;
+
+        assert(st);
+
+        s = set_get(clean_state, &(CleanState) { .dev = st->st_dev, .ino = st->st_ino });
+        return s ? s->oldest : 0;
+}
+
+static void clean_state_put(const struct stat *st, usec_t oldest) {
+        _cleanup_free_ CleanState *s = NULL;
+        int r;
+
+        assert(st);
+
+        /* This is just an optimization, hence don't bother with errors */
+
+        if (oldest == 0 || oldest == USEC_INFINITY)
+                return;
+
+        s = new(CleanState, 1);
+        if (!s)
+                return;
+
+        *s = (CleanState) {
+                .dev = st->st_dev,
+                .ino = st->st_ino,
+                .oldest = oldest,
+        };
+
+        r = set_ensure_allocated(&clean_state_new, &clean_state_hash_ops);
+        if (r < 0)
+                return;
+
+        free(set_remove(clean_state_new, s));
+
+        if (set_put(clean_state_new, s) > 0)
+                TAKE_PTR(s);
+}
+
+static int clean_state_load(void) {
+        _cleanup_fclose_ FILE *f = NULL;
+        const char *fn;
+        int r;
+
+        fn = prefix_roota(arg_root, CLEAN_STATE_FILE);
+
+        f = fopen(fn, "re");
+        if (!f) {
+                if (errno != ENOENT)
+                        log_debug_errno(errno, "Failed to open %s, ignoring: %m", fn);
+                return 0;
+        }
+
+        for (;;) {
+                _cleanup_free_ char *line = NULL;
+                _cleanup_free_ CleanState *s = NULL;
+                uint64_t dev, ino, oldest;
+
+                r = read_line(f, LONG_LINE_MAX, &line);
+                if (r < 0)
+                        return log_debug_errno(r, "Failed to read %s, ignoring: %m", fn);
+                if (r == 0)
+                        break;
+
+                if (sscanf(line, "%" SCNu64 " %" SCNu64 " %" SCNu64, &dev, &ino, &oldest) != 3 ||
+                    !timestamp_is_set(oldest))
+                        continue;
+
+                s = new(CleanState, 1);
+                if (!s)
+                        return log_oom();
+
+                *s = (CleanState) {
+                        .dev = (dev_t) dev,
+                        .ino = (ino_t) ino,
+                        .oldest = oldest,
+                };
+
+                r = set_ensure_allocated(&clean_state, &clean_state_hash_ops);
+                if (r < 0)
+                        return log_oom();
+
+                r = set_put(clean_state, s);
+                if (r < 0)
+                        return log_oom();
+                if (r > 0)
+                        TAKE_PTR(s);
+        }
+
+        log_debug("Loaded cleanup state of %u directories.", set_size(clean_state));
+        return 0;
+}
+
+static int clean_state_save(void) {
+        _cleanup_(unlink_and_freep) char *t = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+        const char *fn;
+        CleanState *s;
+        Iterator i;
+        int r;
+
+        fn = prefix_roota(arg_root, CLEAN_STATE_FILE);
+
+        r = mkdir_parents(fn, 0755);
+        if (r < 0)
+                return log_debug_errno(r, "Failed to create parent directories of %s, ignoring: %m", fn);
+
+        r = fopen_temporary(fn, &f, &t);
+        if (r < 0)
+                return log_debug_errno(r, "Failed to write %s, ignoring: %m", fn);
+
+        (void) fchmod(fileno(f), 0644);
+
+        SET_FOREACH(s, clean_state_new, i)
+                fprintf(f, "%" PRIu64 " %" PRIu64 " %" PRIu64 "\n", (uint64_t) s->dev, (uint64_t) s->ino, s->oldest);
+
+        r = fflush_and_check(f);
+        if (r < 0)
+                return log_debug_errno(r, "Failed to write %s, ignoring: %m", fn);
+
+        if (rename(t, fn) < 0)
+                return log_debug_errno(errno, "Failed to rename %s to %s, ignoring: %m", t, fn);
+
+        t = mfree(t);
+
+        log_debug("Saved cleanup state of %u directories.", set_size(clean_state_new));
+        return 0;
+}
+
+static usec_t entry_age(const struct stat *st) {
+        /* When the entry was last touched, i.e. the earliest time it may be removed, see below. Directories
+         * are removed regardless of their ctime, since we change it ourselves when restoring timestamps. */
+        if (S_ISDIR(st->st_mode))
+                return MAX(timespec_load(&st->st_mtim), timespec_load(&st->st_atim));
+
+        return MAX3(timespec_load(&st->st_mtim), timespec_load(&st->st_atim), timespec_load(&st->st_ctim));
+}
+
 static int dir_cleanup(
                 Item *i,
                 const char *p,
@@ -493,13 +668,24 @@ static int dir_cleanup(
                 dev_t rootdev,
                 bool mountpoint,
                 int maxdepth,
-                bool keep_this_level) {
+                bool keep_this_level,
+                usec_t *ret_oldest) {
 
         struct dirent *dent;
         bool deleted = false;
+        usec_t start, oldest = USEC_INFINITY;
         int r = 0;
 
-        FOREACH_DIRENT_ALL(dent, d, break) {
+        assert(ret_oldest);
+
+        /* Besides cleaning up, this figures out when the oldest entry that is left below this directory was
+         * last touched, so that we can skip the whole tree next time, as long as the cutoff is before that.
+         * Entries that show up later have a ctime after we started looking: timestamps may be set to the
+         * past, but that bumps the ctime. 0 means we don't know, e.g. because something couldn't be looked
+         * at. Whatever goes wrong here only makes us keep things longer than necessary, never shorter. */
+        start = now(CLOCK_REALTIME);
+
+        FOREACH_DIRENT_ALL(dent, d, oldest = 0; break) {
                 struct stat s;
                 usec_t age;
                 _cleanup_free_ char *sub_path = NULL;
@@ -507,6 +693,15 @@ static int dir_cleanup(
                 if (dot_or_dot_dot(dent->d_name))
                         continue;
 
+                /* Device nodes are never removed, and files on this level are kept if requested, don't bother
+                 * to look at them any closer */
+                if (IN_SET(dent->d_type, DT_CHR, DT_BLK))
+                        continue;
+                if (keep_this_level && !IN_SET(dent->d_type, DT_DIR, DT_UNKNOWN)) {
+                        oldest = 0;
+                        continue;
+                }
+
                 if (fstatat(dirfd(d), dent->d_name, &s, AT_SYMLINK_NOFOLLOW) < 0) {
                         if (errno == ENOENT)
                                 continue;
@@ -514,12 +709,14 @@ static int dir_cleanup(
                         /* FUSE, NFS mounts, SELinux might return EACCES */
                         r = log_full_errno(errno == EACCES ? LOG_DEBUG : LOG_ERR, errno,
                                            "stat(%s/%s) failed: %m", p, dent->d_name);
+                        oldest = 0;
                         continue;
                 }
 
                 /* Stay on the same filesystem */
                 if (s.st_dev != rootdev) {
                         log_debug("Ignoring \"%s/%s\": different filesystem.", p, dent->d_name);
+                        oldest = 0;
                         continue;
                 }
 
@@ -534,6 +731,7 @@ static int dir_cleanup(
                                 log_debug_errno(q, "Failed to determine whether \"%s/%s\" is a mount point, ignoring: %m", p, dent->d_name);
                         else if (q > 0) {
                                 log_debug("Ignoring \"%s/%s\": different mount of the same filesystem.", p, dent->d_name);
+                                oldest = 0;
                                 continue;
                         }
                 }
@@ -541,51 +739,72 @@ static int dir_cleanup(
                 sub_path = path_join(p, dent->d_name);
                 if (!sub_path) {
                         r = log_oom();
+                        oldest = 0;
                         goto finish;
                 }
 
                 /* Is there an item configured for this path? */
                 if (ordered_hashmap_get(items, sub_path)) {
                         log_debug("Ignoring \"%s\": a separate entry exists.", sub_path);
+                        oldest = MIN(oldest, entry_age(&s));
                         continue;
                 }
 
                 if (find_glob(globs, sub_path)) {
                         log_debug("Ignoring \"%s\": a separate glob exists.", sub_path);
+                        oldest = MIN(oldest, entry_age(&s));
                         continue;
                 }
 
                 if (S_ISDIR(s.st_mode)) {
                         _cleanup_closedir_ DIR *sub_dir = NULL;
+                        usec_t sub_oldest;
 
                         if (mountpoint &&
                             streq(dent->d_name, "lost+found") &&
                             s.st_uid == 0) {
                                 log_debug("Ignoring directory \"%s\".", sub_path);
+                                oldest = MIN(oldest, entry_age(&s));
                                 continue;
                         }
 
-                        if (maxdepth <= 0)
+                        if (maxdepth <= 0) {
                                 log_warning("Reached max depth on \"%s\".", sub_path);
-                        else {
+                                oldest = 0;
+                        } else if ((sub_oldest = clean_state_get(&s)) >= cutoff) {
+                                char a[FORMAT_TIMESTAMP_MAX];
+
+                                log_debug("Directory \"%s\": nothing below was touched before %s, skipping.",
+                                          sub_path,
+                                          format_timestamp_us(a, sizeof(a), sub_oldest));
+
+                                clean_state_put(&s, sub_oldest);
+                                oldest = MIN(oldest, sub_oldest);
+                        } else {
                                 int q;
 
                                 sub_dir = xopendirat_nomod(dirfd(d), dent->d_name);
                                 if (!sub_dir) {
-                                        if (errno != ENOENT)
+                                        if (errno != ENOENT) {
                                                 r = log_warning_errno(errno, "Opening directory \"%s\" failed, ignoring: %m", sub_path);
+                                                oldest = 0;
+                                        }
 
                                         continue;
                                 }
 
                                 if (flock(dirfd(sub_dir), LOCK_EX|LOCK_NB) < 0) {
                                         log_debug_errno(errno, "Couldn't acquire shared BSD lock on directory \"%s\", skipping: %m", p);
+                                        oldest = 0;
                                         continue;
                                 }
 
-                                q = dir_cleanup(i, sub_path, sub_dir, &s, cutoff, rootdev, false, maxdepth-1, false);
+                                q = dir_cleanup(i, sub_path, sub_dir, &s, cutoff, rootdev, false, maxdepth-1, false, &sub_oldest);
                                 if (q < 0)
                                         r = q;
+
+                                clean_state_put(&s, sub_oldest);
+                                oldest = MIN(oldest, sub_oldest);
                         }
 
                         /* Note: if you are wondering why we don't support the sticky bit for excluding
@@ -595,6 +814,7 @@ static int dir_cleanup(
 
                         if (keep_this_level) {
                                 log_debug("Keeping directory \"%s\".", sub_path);
+                                oldest = 0;
                                 continue;
                         }
 
@@ -606,6 +826,7 @@ static int dir_cleanup(
                                 log_debug("Directory \"%s\": modify time %s is too new.",
                                           sub_path,
                                           format_timestamp_us(a, sizeof(a), age));
+                                oldest = MIN(oldest, entry_age(&s));
                                 continue;
                         }
 
@@ -615,13 +836,17 @@ static int dir_cleanup(
                                 log_debug("Directory \"%s\": access time %s is too new.",
                                           sub_path,
                                           format_timestamp_us(a, sizeof(a), age));
+                                oldest = MIN(oldest, entry_age(&s));
                                 continue;
                         }
 
                         log_debug("Removing directory \"%s\".", sub_path);
-                        if (unlinkat(dirfd(d), dent->d_name, AT_REMOVEDIR) < 0)
+                        if (unlinkat(dirfd(d), dent->d_name, AT_REMOVEDIR) < 0) {
                                 if (!IN_SET(errno, ENOENT, ENOTEMPTY))
                                         r = log_warning_errno(errno, "Failed to remove directory \"%s\", ignoring: %m", sub_path);
+                                if (errno != ENOENT)
+                                        oldest = MIN(oldest, entry_age(&s));
+                        }
 
                 } else {
                         /* Skip files for which the sticky bit is set. These are semantics we define, and are
@@ -645,6 +870,7 @@ static int dir_cleanup(
                         /* Ignore sockets that are listed in /proc/net/unix */
                         if (S_ISSOCK(s.st_mode) && unix_socket_alive(sub_path)) {
                                 log_debug("Skipping \"%s\": live socket.", sub_path);
+                                oldest = MIN(oldest, entry_age(&s));
                                 continue;
                         }
 
@@ -657,6 +883,7 @@ static int dir_cleanup(
                         /* Keep files on this level around if this is requested */
                         if (keep_this_level) {
                                 log_debug("Keeping \"%s\".", sub_path);
+                                oldest = 0;
                                 continue;
                         }
 
@@ -667,6 +894,7 @@ static int dir_cleanup(
                                 log_debug("File \"%s\": modify time %s is too new.",
                                           sub_path,
                                           format_timestamp_us(a, sizeof(a), age));
+                                oldest = MIN(oldest, entry_age(&s));
                                 continue;
                         }
 
@@ -676,6 +904,7 @@ static int dir_cleanup(
                                 log_debug("File \"%s\": access time %s is too new.",
                                           sub_path,
                                           format_timestamp_us(a, sizeof(a), age));
+                                oldest = MIN(oldest, entry_age(&s));
                                 continue;
                         }
 
@@ -685,13 +914,16 @@ static int dir_cleanup(
                                 log_debug("File \"%s\": change time %s is too new.",
                                           sub_path,
                                           format_timestamp_us(a, sizeof(a), age));
+                                oldest = MIN(oldest, entry_age(&s));
                                 continue;
                         }
 
                         log_debug("Removing \"%s\".", sub_path);
                         if (unlinkat(dirfd(d), dent->d_name, 0) < 0)
-                                if (errno != ENOENT)
+                                if (errno != ENOENT) {
                                         r = log_warning_errno(errno, "Failed to remove \"%s\", ignoring: %m", sub_path);
+                                        oldest = MIN(oldest, entry_age(&s));
+                                }
 
                         deleted = true;
                 }
@@ -717,6 +949,7 @@ finish:
                         log_warning_errno(errno, "Failed to revert timestamps of '%s', ignoring: %m", p);
         }
 
+        *ret_oldest = MIN(oldest, start);
         return r;
 }
 
@@ -1917,6 +2150,26 @@ static int glob_item_recursively(Item *i, fdaction_t action) {
         return r;
 }
 
+static int glob_item_relabel_recursively(Item *i) {
+        _cleanup_globfree_ glob_t g = {
+                .gl_opendir = (void *(*)(const char *)) opendir_nomod,
+        };
+        int r = 0, k;
+        char **fn;
+
+        k = safe_glob(i->path, GLOB_NOSORT|GLOB_BRACE, &g);
+        if (k < 0 && k != -ENOENT)
+                return log_error_errno(k, "glob(%s) failed: %m", i->path);
+
+        STRV_FOREACH(fn, g.gl_pathv) {
+                k = relabel_tree(*fn, NULL, 0);
+                if (k < 0 && r == 0)
+                        r = k;
+        }
+
+        return r;
+}
+
 static int create_item(Item *i) {
         CreationMode creation;
         int r = 0;
@@ -2074,7 +2327,11 @@ static int create_item(Item *i) {
                 break;
 
         case RECURSIVE_RELABEL_PATH:
-                r = glob_item_recursively(i, fd_set_perms);
+                /* If there's nothing to do but relabelling, use the parallel walker */
+                if (!i->mode_set && !i->uid_set && !i->gid_set)
+                        r = glob_item_relabel_recursively(i);
+                else
+                        r = glob_item_recursively(i, fd_set_perms);
                 if (r < 0)
                         return r;
                 break;
@@ -2179,8 +2436,9 @@ static int clean_item_instance(Item *i, const char* instance) {
         _cleanup_closedir_ DIR *d = NULL;
         struct stat s, ps;
         bool mountpoint;
-        usec_t cutoff, n;
+        usec_t cutoff, n, oldest;
         char timestamp[FORMAT_TIMESTAMP_MAX];
+        int r;
 
         assert(i);
 
@@ -2220,8 +2478,21 @@ static int clean_item_instance(Item *i, const char* instance) {
                   instance,
                   format_timestamp_us(timestamp, sizeof(timestamp), cutoff));
 
-        return dir_cleanup(i, instance, d, &s, cutoff, s.st_dev, mountpoint,
-                           MAX_DEPTH, i->keep_first_level);
+        oldest = clean_state_get(&s);
+        if (oldest >= cutoff) {
+                log_debug("Directory \"%s\": nothing below was touched before %s, skipping.",
+                          instance,
+                          format_timestamp_us(timestamp, sizeof(timestamp), oldest));
+
+                clean_state_put(&s, oldest);
+                return 0;
+        }
+
+        r = dir_cleanup(i, instance, d, &s, cutoff, s.st_dev, mountpoint,
+                        MAX_DEPTH, i->keep_first_level, &oldest);
+        clean_state_put(&s, oldest);
+
+        return r;
 }
 
 static int clean_item(Item *i) {
@@ -2315,6 +2586,239 @@ static int process_item_array(ItemArray *array, OperationMask operation) {
         return r;
 }
 
+typedef struct GlobJob {
+        ItemArray *array;
+        char *prefix;
+        bool independent;
+} GlobJob;
+
+static int glob_job_compare(const GlobJob *a, const GlobJob *b) {
+        int r;
+
+        r = CMP(!!a->prefix, !!b->prefix);
+        if (r != 0)
+                return r;
+
+        return a->prefix ? path_compare(a->prefix, b->prefix) : 0;
+}
+
+static int glob_prefix(const char *path, char **ret) {
+        _cleanup_free_ char *p = NULL;
+        char *e;
+        int r;
+
+        assert(path);
+        assert(ret);
+
+        /* Returns the part of the path before the first component with a glob in it: everything this item
+         * can touch is below that. Symlinks are resolved, so that /var/run/foo and /run/foo are recognized
+         * as the same thing. */
+
+        p = strndup(path, strcspn(path, GLOB_CHARS "{"));
+        if (!p)
+                return -ENOMEM;
+
+        if (path[strlen(p)] != 0) {
+                /* Drop the partial component, but keep the root directory */
+                e = strrchr(p, '/');
+                if (e == p)
+                        e[1] = 0;
+                else if (e)
+                        *e = 0;
+        }
+
+        r = chase_symlinks(p, arg_root, CHASE_NONEXISTENT, ret, NULL);
+        if (r < 0) {
+                log_debug_errno(r, "Failed to resolve '%s', using it as is: %m", p);
+                *ret = TAKE_PTR(p);
+        }
+
+        return 0;
+}
+
+static int process_item_arrays_wait(pid_t pid) {
+        siginfo_t si;
+        int r;
+
+        r = wait_for_terminate(pid, &si);
+        if (r < 0)
+                return log_error_errno(r, "Failed to wait for worker process: %m");
+
+        /* The worker exits with the negated error of the first failing item, which already logged about it */
+        if (si.si_code == CLD_EXITED)
+                return -si.si_status;
+
+        return log_error_errno(SYNTHETIC_ERRNO(EPROTO), "Worker process died of signal %s.", signal_to_string(si.si_status));
+}
+
+static int process_item_arrays_parallel(ItemArray **arrays, size_t n, OperationMask operation) {
+        _cleanup_close_pair_ int pair[2] = { -1, -1 };
+        _cleanup_free_ pid_t *pids = NULL;
+        size_t n_workers, n_pids = 0, i;
+        int r = 0, k;
+
+        assert(arrays || n == 0);
+
+        /* Processes the item arrays that don't overlap with anything else in worker processes, one per CPU.
+         * The workers pick up the next array from a SOCK_SEQPACKET socket as soon as they are done with
+         * the previous one, so that a few large recursive items don't hold up the rest. */
+
+        k = cpus_in_affinity_mask();
+        n_workers = MIN((size_t) MAX(k, 1), n);
+        if (n_workers > 1) {
+                pids = new(pid_t, n_workers);
+                if (!pids)
+                        return log_oom();
+
+                if (socketpair(AF_UNIX, SOCK_SEQPACKET|SOCK_CLOEXEC, 0, pair) < 0)
+                        return log_error_errno(errno, "Failed to create socket pair: %m");
+        } else
+                n_workers = 0;
+
+        for (i = 0; i < n_workers; i++) {
+                pid_t pid;
+
+                k = safe_fork("(sd-tmpfiles)", FORK_DEATHSIG|FORK_LOG, &pid);
+                if (k < 0)
+                        break;
+                if (k == 0) {
+                        size_t idx;
+
+                        pair[1] = safe_close(pair[1]);
+
+                        r = 0;
+                        while (recv(pair[0], &idx, sizeof(idx), 0) == sizeof(idx)) {
+                                assert(idx < n);
+
+                                k = process_item_array(arrays[idx], operation);
+                                if (k < 0 && r == 0)
+                                        r = k;
+                        }
+
+                        _exit(r < 0 ? MIN(-r, 255) : EXIT_SUCCESS);
+                }
+
+                pids[n_pids++] = pid;
+        }
+
+        if (n_pids == 0) {
+                /* Just one CPU, or we couldn't fork at all. Do it ourselves. */
+                for (i = 0; i < n; i++) {
+                        k = process_item_array(arrays[i], operation);
+                        if (k < 0 && r == 0)
+                                r = k;
+                }
+
+                return r;
+        }
+
+        pair[0] = safe_close(pair[0]);
+
+        for (i = 0; i < n; i++)
+                if (send(pair[1], &i, sizeof(i), MSG_NOSIGNAL) < 0) {
+                        r = log_error_errno(errno, "Failed to pass item to worker process: %m");
+                        break;
+                }
+
+        /* Tell the workers there's nothing left */
+        pair[1] = safe_close(pair[1]);
+
+        for (i = 0; i < n_pids; i++) {
+                k = process_item_arrays_wait(pids[i]);
+                if (k < 0 && r == 0)
+                        r = k;
+        }
+
+        return r;
+}
+
+static int glob_job_compare_ptr(GlobJob * const *a, GlobJob * const *b) {
+        return glob_job_compare(*a, *b);
+}
+
+static int process_globs(OperationMask operation) {
+        _cleanup_free_ GlobJob **sorted = NULL;
+        _cleanup_free_ ItemArray **independent = NULL;
+        GlobJob *jobs = NULL;
+        size_t n_jobs = 0, n_independent = 0, i, root = 0;
+        Iterator iterator;
+        ItemArray *a;
+        int r = 0, k;
+
+        /* Figure out which of the globbing items can run on their own: those which neither have a parent
+         * that still needs processing, nor children, nor a prefix that overlaps with another one of them.
+         * Those are processed in parallel, since the recursive ones walk large trees, and the rest in order
+         * afterwards. They don't overlap with anything, hence their relative order doesn't matter. */
+
+        if (ordered_hashmap_isempty(globs))
+                return 0;
+
+        jobs = new0(GlobJob, ordered_hashmap_size(globs));
+        sorted = new(GlobJob*, ordered_hashmap_size(globs));
+        independent = new(ItemArray*, ordered_hashmap_size(globs));
+        if (!jobs || !sorted || !independent) {
+                r = log_oom();
+                goto finish;
+        }
+
+        ORDERED_HASHMAP_FOREACH(a, globs, iterator) {
+                GlobJob *j = jobs + n_jobs;
+
+                j->array = a;
+
+                if (a->n_items > 0) {
+                        r = glob_prefix(a->items[0].path, &j->prefix);
+                        if (r < 0) {
+                                log_oom();
+                                goto finish;
+                        }
+
+                        j->independent =
+                                set_isempty(a->children) &&
+                                (!a->parent || ordered_hashmap_get(items, a->parent->items[0].path) == a->parent);
+                }
+
+                sorted[n_jobs++] = j;
+        }
+
+        typesafe_qsort(sorted, n_jobs, glob_job_compare_ptr);
+
+        /* Sorted like that, everything below a prefix directly follows it */
+        for (i = 1; i < n_jobs; i++) {
+                if (sorted[root]->prefix && sorted[i]->prefix && path_startswith(sorted[i]->prefix, sorted[root]->prefix)) {
+                        sorted[root]->independent = sorted[i]->independent = false;
+                        continue;
+                }
+
+                root = i;
+        }
+
+        for (i = 0; i < n_jobs; i++)
+                if (jobs[i].independent)
+                        independent[n_independent++] = jobs[i].array;
+
+        if (n_independent > 0)
+                log_debug("Processing %zu of %zu globbing items in parallel.", n_independent, n_jobs);
+
+        r = process_item_arrays_parallel(independent, n_independent, operation);
+
+        for (i = 0; i < n_jobs; i++) {
+                if (jobs[i].independent)
+                        continue;
+
+                k = process_item_array(jobs[i].array, operation);
+                if (k < 0 && r == 0)
+                        r = k;
+        }
+
+finish:
+        for (i = 0; i < n_jobs; i++)
+                free(jobs[i].prefix);
+        free(jobs);
+
+        return r;
+}
+
 static void item_free_contents(Item *i) {
         assert(i);
         free(i->path);
@@ -3233,6 +3737,11 @@ static int run(int argc, char *argv[]) {
                         return r;
         }
 
+        /* Remember which trees can't have anything old in them yet, across runs. Not for --user, there's no
+         * place for the state we could rely on. */
+        if (FLAGS_SET(arg_operation, OPERATION_CLEAN) && !arg_user)
+                (void) clean_state_load();
+
         /* If multiple operations are requested, let's first run the remove/clean operations, and only then the create
          * operations. i.e. that we first clean out the platform we then build on. */
         for (phase = 0; phase < _PHASE_MAX; phase++) {
@@ -3256,13 +3765,14 @@ static int run(int argc, char *argv[]) {
                 }
 
                 /* The globbing ones usually alter things, hence we apply them second. */
-                ORDERED_HASHMAP_FOREACH(a, globs, iterator) {
-                        k = process_item_array(a, op);
-                        if (k < 0 && r >= 0)
-                                r = k;
-                }
+                k = process_globs(op);
+                if (k < 0 && r >= 0)
+                        r = k;
         }
 
+        if (FLAGS_SET(arg_operation, OPERATION_CLEAN) && !arg_user)
+                (void) clean_state_save();
+
         if (ERRNO_IS_RESOURCE(-r))
                 return r;
         if (invalid_config)
@@ -14,6 +14,7 @@
 #include <scsi/scsi.h>
 #include <scsi/scsi_ioctl.h>
 #include <scsi/sg.h>
+#include <stdarg.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -23,6 +24,8 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include "alloc-util.h"
+#include "ata_id.h"
 #include "fd-util.h"
 #include "libudev-util.h"
 #include "log.h"
@@ -387,7 +390,55 @@ out:
         return ret;
 }
 
-int main(int argc, char *argv[]) {
+typedef struct PropertySink {
+        ata_id_property_handler_t handler;
+        void *userdata;
+        int error;
+} PropertySink;
+
+/* Prints the property, or passes it to the handler. The first failure is remembered in the sink, and all
+ * further properties are skipped after it. */
+static void emit_property(PropertySink *sink, const char *key, const char *format, ...) _printf_(3, 4);
+
+static void emit_property(PropertySink *sink, const char *key, const char *format, ...) {
+        _cleanup_free_ char *value = NULL;
+        va_list ap;
+        int r;
+
+        assert(sink);
+
+        if (sink->error < 0)
+                return;
+
+        if (!sink->handler) {
+                va_start(ap, format);
+                printf("%s=", key);
+                vprintf(format, ap);
+                printf("\n");
+                va_end(ap);
+                return;
+        }
+
+        va_start(ap, format);
+        r = vasprintf(&value, format, ap);
+        va_end(ap);
+        if (r < 0) {
+                sink->error = log_oom();
+                return;
+        }
+
+        r = sink->handler(key, value, sink->userdata);
+        if (r < 0)
+                sink->error = r;
+}
+
+/* If a handler is passed, the properties are handed to it instead of being printed, as if --export was
+ * specified. Returns a value suitable for exit(), or a negative errno if the handler failed. */
+int ata_id_run(int argc, char *argv[], ata_id_property_handler_t handler, void *userdata) {
+        PropertySink sink = {
+                .handler = handler,
+                .userdata = userdata,
+        };
         struct hd_driveid id;
         union {
                 uint8_t  byte[512];
@@ -408,11 +459,6 @@ int main(int argc, char *argv[]) {
                 {}
         };
 
-        log_set_target(LOG_TARGET_AUTO);
-        udev_parse_config();
-        log_parse_environment();
-        log_open();
-
         for (;;) {
                 int option;
 
@@ -433,6 +479,9 @@ int main(int argc, char *argv[]) {
                 }
         }
 
+        if (handler)
+                export = 1;
+
         node = argv[optind];
         if (!node) {
                 log_error("no node specified");
@@ -493,46 +542,46 @@ int main(int argc, char *argv[]) {
 
         if (export) {
                 /* Set this to convey the disk speaks the ATA protocol */
-                printf("ID_ATA=1\n");
+                emit_property(&sink, "ID_ATA", "1");
 
                 if ((id.config >> 8) & 0x80) {
                         /* This is an ATAPI device */
                         switch ((id.config >> 8) & 0x1f) {
                         case 0:
-                                printf("ID_TYPE=cd\n");
+                                emit_property(&sink, "ID_TYPE", "cd");
                                 break;
                         case 1:
-                                printf("ID_TYPE=tape\n");
+                                emit_property(&sink, "ID_TYPE", "tape");
                                 break;
                         case 5:
-                                printf("ID_TYPE=cd\n");
+                                emit_property(&sink, "ID_TYPE", "cd");
                                 break;
                         case 7:
-                                printf("ID_TYPE=optical\n");
+                                emit_property(&sink, "ID_TYPE", "optical");
                                 break;
                         default:
-                                printf("ID_TYPE=generic\n");
+                                emit_property(&sink, "ID_TYPE", "generic");
                                 break;
                         }
                 } else
-                        printf("ID_TYPE=disk\n");
-                printf("ID_BUS=ata\n");
-                printf("ID_MODEL=%s\n", model);
-                printf("ID_MODEL_ENC=%s\n", model_enc);
-                printf("ID_REVISION=%s\n", revision);
+                        emit_property(&sink, "ID_TYPE", "disk");
+                emit_property(&sink, "ID_BUS", "ata");
+                emit_property(&sink, "ID_MODEL", "%s", model);
+                emit_property(&sink, "ID_MODEL_ENC", "%s", model_enc);
+                emit_property(&sink, "ID_REVISION", "%s", revision);
                 if (serial[0] != '\0') {
-                        printf("ID_SERIAL=%s_%s\n", model, serial);
-                        printf("ID_SERIAL_SHORT=%s\n", serial);
+                        emit_property(&sink, "ID_SERIAL", "%s_%s", model, serial);
+                        emit_property(&sink, "ID_SERIAL_SHORT", "%s", serial);
                 } else
-                        printf("ID_SERIAL=%s\n", model);
+                        emit_property(&sink, "ID_SERIAL", "%s", model);
 
                 if (id.command_set_1 & (1<<5)) {
-                        printf("ID_ATA_WRITE_CACHE=1\n");
-                        printf("ID_ATA_WRITE_CACHE_ENABLED=%d\n", (id.cfs_enable_1 & (1<<5)) ? 1 : 0);
+                        emit_property(&sink, "ID_ATA_WRITE_CACHE", "1");
+                        emit_property(&sink, "ID_ATA_WRITE_CACHE_ENABLED", "%d", (id.cfs_enable_1 & (1<<5)) ? 1 : 0);
                 }
                 if (id.command_set_1 & (1<<10)) {
-                        printf("ID_ATA_FEATURE_SET_HPA=1\n");
-                        printf("ID_ATA_FEATURE_SET_HPA_ENABLED=%d\n", (id.cfs_enable_1 & (1<<10)) ? 1 : 0);
+                        emit_property(&sink, "ID_ATA_FEATURE_SET_HPA", "1");
+                        emit_property(&sink, "ID_ATA_FEATURE_SET_HPA_ENABLED", "%d", (id.cfs_enable_1 & (1<<10)) ? 1 : 0);
 
                         /*
                          * TODO: use the READ NATIVE MAX ADDRESS command to get the native max address
@@ -540,50 +589,50 @@ int main(int argc, char *argv[]) {
                          */
                 }
                 if (id.command_set_1 & (1<<3)) {
-                        printf("ID_ATA_FEATURE_SET_PM=1\n");
-                        printf("ID_ATA_FEATURE_SET_PM_ENABLED=%d\n", (id.cfs_enable_1 & (1<<3)) ? 1 : 0);
+                        emit_property(&sink, "ID_ATA_FEATURE_SET_PM", "1");
+                        emit_property(&sink, "ID_ATA_FEATURE_SET_PM_ENABLED", "%d", (id.cfs_enable_1 & (1<<3)) ? 1 : 0);
                 }
                 if (id.command_set_1 & (1<<1)) {
-                        printf("ID_ATA_FEATURE_SET_SECURITY=1\n");
-                        printf("ID_ATA_FEATURE_SET_SECURITY_ENABLED=%d\n", (id.cfs_enable_1 & (1<<1)) ? 1 : 0);
-                        printf("ID_ATA_FEATURE_SET_SECURITY_ERASE_UNIT_MIN=%d\n", id.trseuc * 2);
+                        emit_property(&sink, "ID_ATA_FEATURE_SET_SECURITY", "1");
+                        emit_property(&sink, "ID_ATA_FEATURE_SET_SECURITY_ENABLED", "%d", (id.cfs_enable_1 & (1<<1)) ? 1 : 0);
+                        emit_property(&sink, "ID_ATA_FEATURE_SET_SECURITY_ERASE_UNIT_MIN", "%d", id.trseuc * 2);
                         if ((id.cfs_enable_1 & (1<<1))) /* enabled */ {
                                 if (id.dlf & (1<<8))
-                                        printf("ID_ATA_FEATURE_SET_SECURITY_LEVEL=maximum\n");
+                                        emit_property(&sink, "ID_ATA_FEATURE_SET_SECURITY_LEVEL", "maximum");
                                 else
-                                        printf("ID_ATA_FEATURE_SET_SECURITY_LEVEL=high\n");
+                                        emit_property(&sink, "ID_ATA_FEATURE_SET_SECURITY_LEVEL", "high");
                         }
                         if (id.dlf & (1<<5))
-                                printf("ID_ATA_FEATURE_SET_SECURITY_ENHANCED_ERASE_UNIT_MIN=%d\n", id.trsEuc * 2);
+                                emit_property(&sink, "ID_ATA_FEATURE_SET_SECURITY_ENHANCED_ERASE_UNIT_MIN", "%d", id.trsEuc * 2);
                         if (id.dlf & (1<<4))
-                                printf("ID_ATA_FEATURE_SET_SECURITY_EXPIRE=1\n");
+                                emit_property(&sink, "ID_ATA_FEATURE_SET_SECURITY_EXPIRE", "1");
                         if (id.dlf & (1<<3))
-                                printf("ID_ATA_FEATURE_SET_SECURITY_FROZEN=1\n");
+                                emit_property(&sink, "ID_ATA_FEATURE_SET_SECURITY_FROZEN", "1");
                         if (id.dlf & (1<<2))
-                                printf("ID_ATA_FEATURE_SET_SECURITY_LOCKED=1\n");
+                                emit_property(&sink, "ID_ATA_FEATURE_SET_SECURITY_LOCKED", "1");
                 }
                 if (id.command_set_1 & (1<<0)) {
-                        printf("ID_ATA_FEATURE_SET_SMART=1\n");
-                        printf("ID_ATA_FEATURE_SET_SMART_ENABLED=%d\n", (id.cfs_enable_1 & (1<<0)) ? 1 : 0);
+                        emit_property(&sink, "ID_ATA_FEATURE_SET_SMART", "1");
+                        emit_property(&sink, "ID_ATA_FEATURE_SET_SMART_ENABLED", "%d", (id.cfs_enable_1 & (1<<0)) ? 1 : 0);
                 }
                 if (id.command_set_2 & (1<<9)) {
-                        printf("ID_ATA_FEATURE_SET_AAM=1\n");
-                        printf("ID_ATA_FEATURE_SET_AAM_ENABLED=%d\n", (id.cfs_enable_2 & (1<<9)) ? 1 : 0);
-                        printf("ID_ATA_FEATURE_SET_AAM_VENDOR_RECOMMENDED_VALUE=%d\n", id.acoustic >> 8);
-                        printf("ID_ATA_FEATURE_SET_AAM_CURRENT_VALUE=%d\n", id.acoustic & 0xff);
+                        emit_property(&sink, "ID_ATA_FEATURE_SET_AAM", "1");
+                        emit_property(&sink, "ID_ATA_FEATURE_SET_AAM_ENABLED", "%d", (id.cfs_enable_2 & (1<<9)) ? 1 : 0);
+                        emit_property(&sink, "ID_ATA_FEATURE_SET_AAM_VENDOR_RECOMMENDED_VALUE", "%d", id.acoustic >> 8);
+                        emit_property(&sink, "ID_ATA_FEATURE_SET_AAM_CURRENT_VALUE", "%d", id.acoustic & 0xff);
                 }
                 if (id.command_set_2 & (1<<5)) {
-                        printf("ID_ATA_FEATURE_SET_PUIS=1\n");
-                        printf("ID_ATA_FEATURE_SET_PUIS_ENABLED=%d\n", (id.cfs_enable_2 & (1<<5)) ? 1 : 0);
+                        emit_property(&sink, "ID_ATA_FEATURE_SET_PUIS", "1");
+                        emit_property(&sink, "ID_ATA_FEATURE_SET_PUIS_ENABLED", "%d", (id.cfs_enable_2 & (1<<5)) ? 1 : 0);
                 }
                 if (id.command_set_2 & (1<<3)) {
-                        printf("ID_ATA_FEATURE_SET_APM=1\n");
-                        printf("ID_ATA_FEATURE_SET_APM_ENABLED=%d\n", (id.cfs_enable_2 & (1<<3)) ? 1 : 0);
+                        emit_property(&sink, "ID_ATA_FEATURE_SET_APM", "1");
+                        emit_property(&sink, "ID_ATA_FEATURE_SET_APM_ENABLED", "%d", (id.cfs_enable_2 & (1<<3)) ? 1 : 0);
                         if ((id.cfs_enable_2 & (1<<3)))
-                                printf("ID_ATA_FEATURE_SET_APM_CURRENT_VALUE=%d\n", id.CurAPMvalues & 0xff);
+                                emit_property(&sink, "ID_ATA_FEATURE_SET_APM_CURRENT_VALUE", "%d", id.CurAPMvalues & 0xff);
                 }
                 if (id.command_set_2 & (1<<0))
-                        printf("ID_ATA_DOWNLOAD_MICROCODE=1\n");
+                        emit_property(&sink, "ID_ATA_DOWNLOAD_MICROCODE", "1");
 
                 /*
                  * Word 76 indicates the capabilities of a SATA device. A PATA device shall set
@@ -594,7 +643,7 @@ int main(int argc, char *argv[]) {
 
                 word = identify.wyde[76];
                 if (!IN_SET(word, 0x0000, 0xffff)) {
-                        printf("ID_ATA_SATA=1\n");
+                        emit_property(&sink, "ID_ATA_SATA", "1");
                         /*
                          * If bit 2 of word 76 is set to one, then the device supports the Gen2
                          * signaling rate of 3.0 Gb/s (see SATA 2.6).
@@ -603,17 +652,17 @@ int main(int argc, char *argv[]) {
                          * signaling rate of 1.5 Gb/s (see SATA 2.6).
                          */
                         if (word & (1<<2))
-                                printf("ID_ATA_SATA_SIGNAL_RATE_GEN2=1\n");
+                                emit_property(&sink, "ID_ATA_SATA_SIGNAL_RATE_GEN2", "1");
                         if (word & (1<<1))
-                                printf("ID_ATA_SATA_SIGNAL_RATE_GEN1=1\n");
+                                emit_property(&sink, "ID_ATA_SATA_SIGNAL_RATE_GEN1", "1");
                 }
 
                 /* Word 217 indicates the nominal media rotation rate of the device */
                 word = identify.wyde[217];
                 if (word == 0x0001)
-                        printf ("ID_ATA_ROTATION_RATE_RPM=0\n"); /* non-rotating e.g. SSD */
+                        emit_property(&sink, "ID_ATA_ROTATION_RATE_RPM", "0"); /* non-rotating e.g. SSD */
                 else if (word >= 0x0401 && word <= 0xfffe)
-                        printf ("ID_ATA_ROTATION_RATE_RPM=%d\n", word);
+                        emit_property(&sink, "ID_ATA_ROTATION_RATE_RPM", "%d", word);
 
                 /*
                  * Words 108-111 contain a mandatory World Wide Name (WWN) in the NAA IEEE Registered identifier
@@ -631,15 +680,14 @@ int main(int argc, char *argv[]) {
                         wwwn  |= identify.wyde[110];
                         wwwn <<= 16;
                         wwwn  |= identify.wyde[111];
-                        printf("ID_WWN=0x%1$" PRIx64 "\n"
-                               "ID_WWN_WITH_EXTENSION=0x%1$" PRIx64 "\n",
-                               wwwn);
+                        emit_property(&sink, "ID_WWN", "0x%" PRIx64, wwwn);
+                        emit_property(&sink, "ID_WWN_WITH_EXTENSION", "0x%" PRIx64, wwwn);
                 }
 
                 /* from Linux's include/linux/ata.h */
                 if (IN_SET(identify.wyde[0], 0x848a, 0x844a) ||
                     (identify.wyde[83] & 0xc004) == 0x4004)
-                        printf("ID_ATA_CFA=1\n");
+                        emit_property(&sink, "ID_ATA_CFA", "1");
         } else {
                 if (serial[0] != '\0')
                         printf("%s_%s\n", model, serial);
@@ -647,5 +695,5 @@ int main(int argc, char *argv[]) {
                         printf("%s\n", model);
         }
 
-        return 0;
+        return sink.error;
 }
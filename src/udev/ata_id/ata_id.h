@@ -0,0 +1,7 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+#pragma once
+
+/* Called for each property found, if a handler is passed to ata_id_run() */
+typedef int (*ata_id_property_handler_t)(const char *key, const char *value, void *userdata);
+
+int ata_id_run(int argc, char *argv[], ata_id_property_handler_t handler, void *userdata);
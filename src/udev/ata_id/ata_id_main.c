@@ -0,0 +1,24 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+/*
+ * ata_id - reads product/serial number from ATA drives
+ *
+ * Copyright © 2009-2010 David Zeuthen <zeuthen@gmail.com>
+ */
+
+#include <stdlib.h>
+
+#include "ata_id.h"
+#include "log.h"
+#include "udev-util.h"
+
+int main(int argc, char *argv[]) {
+        int r;
+
+        log_set_target(LOG_TARGET_AUTO);
+        udev_parse_config();
+        log_parse_environment();
+        log_open();
+
+        r = ata_id_run(argc, argv, NULL, NULL);
+        return r < 0 ? EXIT_FAILURE : r;
+}
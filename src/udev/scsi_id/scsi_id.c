@@ -53,6 +53,56 @@ static char vendor_enc_str[256];
 static char model_enc_str[256];
 static char revision_str[16];
 static char type_str[16];
+static scsi_id_property_handler_t property_handler = NULL;
+static void *property_userdata = NULL;
+static int property_error = 0;
+
+static void reset_options(void) {
+        /* We might be called more than once in the same process, when run as udev builtin */
+        all_good = false;
+        dev_specified = false;
+        strscpy(config_file, sizeof(config_file), "/etc/scsi_id.config");
+        default_page_code = PAGE_UNSPECIFIED;
+        sg_version = 4;
+        reformat_serial = false;
+        export = false;
+        property_error = 0;
+        vendor_str[0] = model_str[0] = vendor_enc_str[0] = model_enc_str[0] = revision_str[0] = type_str[0] = '\0';
+}
+
+/* Prints the property, or passes it to the handler. The first failure is remembered in property_error, and
+ * all further properties are skipped after it. */
+static void emit_property(const char *key, const char *format, ...) _printf_(2, 3);
+
+static void emit_property(const char *key, const char *format, ...) {
+        _cleanup_free_ char *value = NULL;
+        va_list ap;
+        int r;
+
+        if (property_error < 0)
+                return;
+
+        if (!property_handler) {
+                va_start(ap, format);
+                printf("%s=", key);
+                vprintf(format, ap);
+                printf("\n");
+                va_end(ap);
+                return;
+        }
+
+        va_start(ap, format);
+        r = vasprintf(&value, format, ap);
+        va_end(ap);
+        if (r < 0) {
+                property_error = log_oom();
+                return;
+        }
+
+        r = property_handler(key, value, property_userdata);
+        if (r < 0)
+                property_error = r;
+}
 
 static void set_type(const char *from, char *to, size_t len) {
         int type_num;
@@ -304,6 +354,7 @@ static void help(void) {
 
 }
 
+/* Returns > 0 if there is nothing left to do, i.e. --help or --version was specified */
 static int set_options(int argc, char **argv,
                        char *maj_min_dev) {
         int option;
@@ -335,7 +386,7 @@ static int set_options(int argc, char **argv,
 
                 case 'h':
                         help();
-                        exit(EXIT_SUCCESS);
+                        return 1;
 
                 case 'p':
                         if (streq(optarg, "0x80"))
@@ -363,6 +414,10 @@ static int set_options(int argc, char **argv,
                         break;
 
                 case 'v':
+                        /* When run as builtin, logging is up to udevd */
+                        if (property_handler)
+                                break;
+
                         log_set_target(LOG_TARGET_CONSOLE);
                         log_set_max_level(LOG_DEBUG);
                         log_open();
@@ -370,7 +425,7 @@ static int set_options(int argc, char **argv,
 
                 case 'V':
                         printf("%s\n", GIT_VERSION);
-                        exit(EXIT_SUCCESS);
+                        return 1;
 
                 case 'x':
                         export = true;
@@ -468,7 +523,8 @@ static int set_inq_values(struct scsi_id_device *dev_scsi, const char *path) {
 
 /*
  * scsi_id: try to get an id, if one is found, printf it to stdout.
- * returns a value passed to exit() - 0 if printed an id, else 1.
+ * returns a value passed to exit() - 0 if printed an id, else 1 - or a
+ * negative errno if the property handler failed.
  */
 static int scsi_id(char *maj_min_dev) {
         struct scsi_id_device dev_scsi = {};
@@ -494,33 +550,34 @@ static int scsi_id(char *maj_min_dev) {
         if (export) {
                 char serial_str[MAX_SERIAL_LEN];
 
-                printf("ID_SCSI=1\n");
-                printf("ID_VENDOR=%s\n", vendor_str);
-                printf("ID_VENDOR_ENC=%s\n", vendor_enc_str);
-                printf("ID_MODEL=%s\n", model_str);
-                printf("ID_MODEL_ENC=%s\n", model_enc_str);
-                printf("ID_REVISION=%s\n", revision_str);
-                printf("ID_TYPE=%s\n", type_str);
+                emit_property("ID_SCSI", "1");
+                emit_property("ID_VENDOR", "%s", vendor_str);
+                emit_property("ID_VENDOR_ENC", "%s", vendor_enc_str);
+                emit_property("ID_MODEL", "%s", model_str);
+                emit_property("ID_MODEL_ENC", "%s", model_enc_str);
+                emit_property("ID_REVISION", "%s", revision_str);
+                emit_property("ID_TYPE", "%s", type_str);
                 if (dev_scsi.serial[0] != '\0') {
                         util_replace_whitespace(dev_scsi.serial, serial_str, sizeof(serial_str)-1);
                         util_replace_chars(serial_str, NULL);
-                        printf("ID_SERIAL=%s\n", serial_str);
+                        emit_property("ID_SERIAL", "%s", serial_str);
                         util_replace_whitespace(dev_scsi.serial_short, serial_str, sizeof(serial_str)-1);
                         util_replace_chars(serial_str, NULL);
-                        printf("ID_SERIAL_SHORT=%s\n", serial_str);
+                        emit_property("ID_SERIAL_SHORT", "%s", serial_str);
                 }
                 if (dev_scsi.wwn[0] != '\0') {
-                        printf("ID_WWN=0x%s\n", dev_scsi.wwn);
+                        emit_property("ID_WWN", "0x%s", dev_scsi.wwn);
                         if (dev_scsi.wwn_vendor_extension[0] != '\0') {
-                                printf("ID_WWN_VENDOR_EXTENSION=0x%s\n", dev_scsi.wwn_vendor_extension);
-                                printf("ID_WWN_WITH_EXTENSION=0x%s%s\n", dev_scsi.wwn, dev_scsi.wwn_vendor_extension);
+                                emit_property("ID_WWN_VENDOR_EXTENSION", "0x%s", dev_scsi.wwn_vendor_extension);
+                                emit_property("ID_WWN_WITH_EXTENSION", "0x%s%s", dev_scsi.wwn, dev_scsi.wwn_vendor_extension);
                         } else
-                                printf("ID_WWN_WITH_EXTENSION=0x%s\n", dev_scsi.wwn);
+                                emit_property("ID_WWN_WITH_EXTENSION", "0x%s", dev_scsi.wwn);
                 }
                 if (dev_scsi.tgpt_group[0] != '\0')
-                        printf("ID_TARGET_PORT=%s\n", dev_scsi.tgpt_group);
+                        emit_property("ID_TARGET_PORT", "%s", dev_scsi.tgpt_group);
                 if (dev_scsi.unit_serial_number[0] != '\0')
-                        printf("ID_SCSI_SERIAL=%s\n", dev_scsi.unit_serial_number);
+                        emit_property("ID_SCSI_SERIAL", "%s", dev_scsi.unit_serial_number);
+                retval = property_error;
                 goto out;
         }
 
@@ -543,16 +600,20 @@ out:
         return retval;
 }
 
-int main(int argc, char **argv) {
+/*
+ * scsi_id_run: the whole tool, minus the logging setup. If a handler is passed, the
+ * properties are handed to it instead of being printed, as if --export was specified.
+ * Returns a value suitable for exit(), or a negative errno if the handler failed.
+ */
+int scsi_id_run(int argc, char **argv, scsi_id_property_handler_t handler, void *userdata) {
         int retval = 0;
         char maj_min_dev[MAX_PATH_LEN];
         int newargc;
         char **newargv = NULL;
 
-        log_set_target(LOG_TARGET_AUTO);
-        udev_parse_config();
-        log_parse_environment();
-        log_open();
+        reset_options();
+        property_handler = handler;
+        property_userdata = userdata;
 
         /*
          * Get config file options.
@@ -574,8 +635,11 @@ int main(int argc, char **argv) {
         /*
          * Get command line options (overriding any config file settings).
          */
-        if (set_options(argc, argv, maj_min_dev) < 0)
-                exit(EXIT_FAILURE);
+        retval = set_options(argc, argv, maj_min_dev);
+        if (retval != 0) {
+                retval = retval < 0 ? 1 : 0;
+                goto exit;
+        }
 
         if (!dev_specified) {
                 log_error("No device specified.");
@@ -583,6 +647,9 @@ int main(int argc, char **argv) {
                 goto exit;
         }
 
+        if (property_handler)
+                export = true;
+
         retval = scsi_id(maj_min_dev);
 
 exit:
@@ -590,6 +657,7 @@ exit:
                 free(newargv[0]);
                 free(newargv);
         }
-        log_close();
+        property_handler = NULL;
+        property_userdata = NULL;
         return retval;
 }
@@ -48,6 +48,11 @@ struct scsi_id_device {
         char tgpt_group[8];
 };
 
+/* Called for each property found, if a handler is passed to scsi_id_run() */
+typedef int (*scsi_id_property_handler_t)(const char *key, const char *value, void *userdata);
+
+int scsi_id_run(int argc, char **argv, scsi_id_property_handler_t handler, void *userdata);
+
 int scsi_std_inquiry(struct scsi_id_device *dev_scsi, const char *devname);
 int scsi_get_serial(struct scsi_id_device *dev_scsi, const char *devname,
                     int page_code, int len);
@@ -0,0 +1,25 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+/*
+ * Copyright © IBM Corp. 2003
+ * Copyright © SUSE Linux Products GmbH, 2006
+ */
+
+#include <stdlib.h>
+
+#include "log.h"
+#include "scsi_id.h"
+#include "udev-util.h"
+
+int main(int argc, char **argv) {
+        int r;
+
+        log_set_target(LOG_TARGET_AUTO);
+        udev_parse_config();
+        log_parse_environment();
+        log_open();
+
+        r = scsi_id_run(argc, argv, NULL, NULL);
+
+        log_close();
+        return r < 0 ? EXIT_FAILURE : r;
+}
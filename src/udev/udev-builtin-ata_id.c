@@ -0,0 +1,60 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+/*
+ * ata_id, run inside the udev worker instead of being forked for each device
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include "alloc-util.h"
+#include "ata_id/ata_id.h"
+#include "device-util.h"
+#include "udev-builtin.h"
+
+typedef struct BuiltinContext {
+        sd_device *dev;
+        bool test;
+} BuiltinContext;
+
+static int add_property(const char *key, const char *value, void *userdata) {
+        BuiltinContext *c = userdata;
+
+        return udev_builtin_add_property(c->dev, c->test, key, value);
+}
+
+static int builtin_ata_id(sd_device *dev, int argc, char *argv[], bool test) {
+        BuiltinContext c = {
+                .dev = dev,
+                .test = test,
+        };
+        _cleanup_free_ char **args = NULL;
+        const char *devnode;
+        int r;
+
+        r = sd_device_get_devname(dev, &devnode);
+        if (r < 0)
+                return log_device_debug_errno(dev, r, "Failed to get device name: %m");
+
+        /* The device node goes last, so that a device specified explicitly still takes precedence */
+        args = new(char*, argc + 2);
+        if (!args)
+                return log_oom();
+
+        memcpy(args, argv, sizeof(char*) * argc);
+        args[argc] = (char*) devnode;
+        args[argc + 1] = NULL;
+
+        r = ata_id_run(argc + 1, args, add_property, &c);
+        if (r < 0)
+                return r;
+        if (r > 0)
+                return log_device_debug_errno(dev, SYNTHETIC_ERRNO(EIO), "Failed to identify device (exit code %i)", r);
+
+        return 0;
+}
+
+const UdevBuiltin udev_builtin_ata_id = {
+        .name = "ata_id",
+        .cmd = builtin_ata_id,
+        .help = "ATA device identification (same as the ata_id tool)",
+};
@@ -12,6 +12,7 @@
 static bool initialized;
 
 static const UdevBuiltin *const builtins[_UDEV_BUILTIN_MAX] = {
+        [UDEV_BUILTIN_ATA_ID] = &udev_builtin_ata_id,
 #if HAVE_BLKID
         [UDEV_BUILTIN_BLKID] = &udev_builtin_blkid,
 #endif
@@ -25,6 +26,7 @@ static const UdevBuiltin *const builtins[_UDEV_BUILTIN_MAX] = {
         [UDEV_BUILTIN_NET_ID] = &udev_builtin_net_id,
         [UDEV_BUILTIN_NET_LINK] = &udev_builtin_net_setup_link,
         [UDEV_BUILTIN_PATH_ID] = &udev_builtin_path_id,
+        [UDEV_BUILTIN_SCSI_ID] = &udev_builtin_scsi_id,
         [UDEV_BUILTIN_USB_ID] = &udev_builtin_usb_id,
 #if HAVE_ACL
         [UDEV_BUILTIN_UACCESS] = &udev_builtin_uaccess,
@@ -6,6 +6,7 @@
 #include "sd-device.h"
 
 typedef enum {
+        UDEV_BUILTIN_ATA_ID,
 #if HAVE_BLKID
         UDEV_BUILTIN_BLKID,
 #endif
@@ -19,6 +20,7 @@ typedef enum {
         UDEV_BUILTIN_NET_ID,
         UDEV_BUILTIN_NET_LINK,
         UDEV_BUILTIN_PATH_ID,
+        UDEV_BUILTIN_SCSI_ID,
         UDEV_BUILTIN_USB_ID,
 #if HAVE_ACL
         UDEV_BUILTIN_UACCESS,
@@ -40,6 +42,7 @@ typedef struct UdevBuiltin {
 #define PTR_TO_UDEV_BUILTIN_CMD(p) ((UdevBuiltinCommand) ((intptr_t) (p)-1))
 #define UDEV_BUILTIN_CMD_TO_PTR(u) ((void *)             ((intptr_t) (u)+1))
 
+extern const UdevBuiltin udev_builtin_ata_id;
 #if HAVE_BLKID
 extern const UdevBuiltin udev_builtin_blkid;
 #endif
@@ -53,6 +56,7 @@ extern const UdevBuiltin udev_builtin_kmod;
 extern const UdevBuiltin udev_builtin_net_id;
 extern const UdevBuiltin udev_builtin_net_setup_link;
 extern const UdevBuiltin udev_builtin_path_id;
+extern const UdevBuiltin udev_builtin_scsi_id;
 extern const UdevBuiltin udev_builtin_usb_id;
 #if HAVE_ACL
 extern const UdevBuiltin udev_builtin_uaccess;
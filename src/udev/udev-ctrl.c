@@ -177,6 +177,19 @@ sd_event_source *udev_ctrl_get_event_source(struct udev_ctrl *uctrl) {
         return uctrl->event_source;
 }
 
+int udev_ctrl_take_connection(struct udev_ctrl *uctrl) {
+        assert(uctrl);
+
+        /* Hands the current connection over to the caller. Clients wait for the connection to be closed
+         * after sending their messages, hence this allows replying to them later. We keep listening for
+         * new connections in the meantime. */
+
+        if (uctrl->sock_connect < 0)
+                return -ENOTCONN;
+
+        return TAKE_FD(uctrl->sock_connect);
+}
+
 static void udev_ctrl_disconnect_and_listen_again(struct udev_ctrl *uctrl) {
         udev_ctrl_disconnect(uctrl);
         udev_ctrl_unref(uctrl);
@@ -239,12 +252,14 @@ static int udev_ctrl_connection_event_handler(sd_event_source *s, int fd, uint32
                 return 0;
         }
 
-        if (msg_wire.type == _UDEV_CTRL_END_MESSAGES)
-                return 0;
-
+        /* The end of the messages is passed on too, so that the callback may take over the connection and
+         * close it only later, see udev_ctrl_take_connection(). */
         if (uctrl->callback)
                 (void) uctrl->callback(uctrl, msg_wire.type, &msg_wire.value, uctrl->userdata);
 
+        if (msg_wire.type == _UDEV_CTRL_END_MESSAGES)
+                return 0;
+
         /* Do not disconnect and wait for next message. */
         uctrl = udev_ctrl_unref(uctrl);
         return 0;
@@ -403,3 +418,84 @@ int udev_ctrl_wait(struct udev_ctrl *uctrl, usec_t timeout) {
 
         return sd_event_loop(uctrl->event);
 }
+
+int udev_ctrl_send_settled(int fd) {
+        struct udev_ctrl_msg_wire ctrl_msg_wire = {
+                .version = "udev-" STRINGIFY(PROJECT_VERSION),
+                .magic = UDEV_CTRL_MAGIC,
+                .type = UDEV_CTRL_SETTLE,
+        };
+
+        assert(fd >= 0);
+
+        /* Tells a client that sent UDEV_CTRL_SETTLE messages that the events it waited for are processed,
+         * before its connection is closed. */
+
+        if (send(fd, &ctrl_msg_wire, sizeof(ctrl_msg_wire), MSG_DONTWAIT|MSG_NOSIGNAL) < 0)
+                return -errno;
+
+        return 0;
+}
+
+int udev_ctrl_read_settled(int fd, usec_t timeout) {
+        usec_t deadline;
+        int r;
+
+        assert(fd >= 0);
+
+        /* Waits for the reply sent by udev_ctrl_send_settled(). Returns 1 if it was received, and 0 if the
+         * connection was closed without it, i.e. by a daemon that doesn't know UDEV_CTRL_SETTLE and thus
+         * didn't wait for anything. */
+
+        deadline = usec_add(now(CLOCK_MONOTONIC), timeout);
+
+        for (;;) {
+                struct udev_ctrl_msg_wire msg_wire;
+                usec_t n;
+                ssize_t l;
+
+                n = now(CLOCK_MONOTONIC);
+                if (n >= deadline)
+                        return -ETIMEDOUT;
+
+                r = fd_wait_for_event(fd, POLLIN, deadline == USEC_INFINITY ? USEC_INFINITY : deadline - n);
+                if (r == -EINTR)
+                        continue;
+                if (r < 0)
+                        return r;
+                if (r == 0)
+                        return -ETIMEDOUT;
+
+                l = recv(fd, &msg_wire, sizeof(msg_wire), MSG_DONTWAIT);
+                if (l < 0) {
+                        if (IN_SET(errno, EAGAIN, EINTR))
+                                continue;
+
+                        return -errno;
+                }
+                if (l == 0)
+                        return 0;
+
+                if ((size_t) l == sizeof(msg_wire) &&
+                    msg_wire.magic == UDEV_CTRL_MAGIC &&
+                    msg_wire.type == UDEV_CTRL_SETTLE)
+                        return 1;
+
+                /* Ignore anything else */
+        }
+}
+
+int udev_ctrl_wait_settled(struct udev_ctrl *uctrl, usec_t timeout) {
+        int r;
+
+        assert(uctrl);
+
+        if (uctrl->sock < 0 || !uctrl->connected)
+                return 0;
+
+        r = udev_ctrl_send(uctrl, _UDEV_CTRL_END_MESSAGES, 0, NULL);
+        if (r < 0)
+                return r;
+
+        return udev_ctrl_read_settled(uctrl->sock, timeout);
+}
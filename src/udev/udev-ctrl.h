@@ -18,6 +18,8 @@ enum udev_ctrl_msg_type {
         UDEV_CTRL_SET_CHILDREN_MAX,
         UDEV_CTRL_PING,
         UDEV_CTRL_EXIT,
+        UDEV_CTRL_LOG_STATISTICS,
+        UDEV_CTRL_SETTLE,
 };
 
 union udev_ctrl_msg_value {
@@ -40,9 +42,14 @@ int udev_ctrl_cleanup(struct udev_ctrl *uctrl);
 int udev_ctrl_attach_event(struct udev_ctrl *uctrl, sd_event *event);
 int udev_ctrl_start(struct udev_ctrl *uctrl, udev_ctrl_handler_t callback, void *userdata);
 sd_event_source *udev_ctrl_get_event_source(struct udev_ctrl *uctrl);
+int udev_ctrl_take_connection(struct udev_ctrl *uctrl);
 
 int udev_ctrl_wait(struct udev_ctrl *uctrl, usec_t timeout);
 
+int udev_ctrl_send_settled(int fd);
+int udev_ctrl_read_settled(int fd, usec_t timeout);
+int udev_ctrl_wait_settled(struct udev_ctrl *uctrl, usec_t timeout);
+
 int udev_ctrl_send(struct udev_ctrl *uctrl, enum udev_ctrl_msg_type type, int intval, const char *buf);
 static inline int udev_ctrl_send_set_log_level(struct udev_ctrl *uctrl, int priority) {
         return udev_ctrl_send(uctrl, UDEV_CTRL_SET_LOG_LEVEL, priority, NULL);
@@ -76,4 +83,13 @@ static inline int udev_ctrl_send_exit(struct udev_ctrl *uctrl) {
         return udev_ctrl_send(uctrl, UDEV_CTRL_EXIT, 0, NULL);
 }
 
+static inline int udev_ctrl_send_log_statistics(struct udev_ctrl *uctrl) {
+        return udev_ctrl_send(uctrl, UDEV_CTRL_LOG_STATISTICS, 0, NULL);
+}
+
+/* The match is either "subsystem=PATTERN" or "sysname=PATTERN" */
+static inline int udev_ctrl_send_settle(struct udev_ctrl *uctrl, const char *match) {
+        return udev_ctrl_send(uctrl, UDEV_CTRL_SETTLE, 0, match);
+}
+
 DEFINE_TRIVIAL_CLEANUP_FUNC(struct udev_ctrl*, udev_ctrl_unref);
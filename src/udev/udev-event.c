@@ -78,6 +78,7 @@ UdevEvent *udev_event_free(UdevEvent *event) {
 
         sd_device_unref(event->dev);
         sd_device_unref(event->dev_db_clone);
+        hashmap_free(event->subsys_kernel_devices);
         sd_netlink_unref(event->rtnl);
         ordered_hashmap_free_free_key(event->run_list);
         ordered_hashmap_free_free_free(event->seclabel_list);
@@ -343,7 +344,7 @@ static ssize_t udev_event_subst_format(
                         return -EINVAL;
 
                 /* try to read the value specified by "[dmi/id]product_name" */
-                if (util_resolve_subsys_kernel(attr, vbuf, sizeof(vbuf), true) == 0)
+                if (util_resolve_subsys_kernel_full(attr, &event->subsys_kernel_devices, vbuf, sizeof(vbuf), true) == 0)
                         val = vbuf;
 
                 /* try to read the attribute the device */
@@ -1016,6 +1017,36 @@ int udev_event_execute_rules(UdevEvent *event,
         return 0;
 }
 
+void udev_event_get_sysattr_statistics(UdevEvent *event, unsigned *ret_reads, unsigned *ret_cache_hits) {
+        unsigned reads = 0, cache_hits = 0, r, h;
+        sd_device *d;
+        Iterator i;
+
+        assert(event);
+
+        /* The parents are owned by their children, hence the whole chain shares one attribute cache across
+         * all rules and builtins processing the event. Sum up the counters of all devices involved. */
+        for (d = event->dev; d; ) {
+                device_get_sysattr_statistics(d, &r, &h);
+                reads += r;
+                cache_hits += h;
+
+                if (sd_device_get_parent(d, &d) < 0)
+                        break;
+        }
+
+        HASHMAP_FOREACH(d, event->subsys_kernel_devices, i) {
+                device_get_sysattr_statistics(d, &r, &h);
+                reads += r;
+                cache_hits += h;
+        }
+
+        if (ret_reads)
+                *ret_reads = reads;
+        if (ret_cache_hits)
+                *ret_cache_hits = cache_hits;
+}
+
 void udev_event_execute_run(UdevEvent *event, usec_t timeout_usec) {
         const char *command;
         void *val;
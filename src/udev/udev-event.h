@@ -21,6 +21,7 @@ typedef struct UdevEvent {
         sd_device *dev;
         sd_device *dev_parent;
         sd_device *dev_db_clone;
+        Hashmap *subsys_kernel_devices; /* devices referenced by "[<SUBSYSTEM>/<KERNEL>]", by that string */
         char *name;
         char *program_result;
         mode_t mode;
@@ -61,6 +62,7 @@ int udev_event_execute_rules(UdevEvent *event,
                              Hashmap *properties_list,
                              UdevRules *rules);
 void udev_event_execute_run(UdevEvent *event, usec_t timeout_usec);
+void udev_event_get_sysattr_statistics(UdevEvent *event, unsigned *ret_reads, unsigned *ret_cache_hits);
 
 static inline usec_t udev_warn_timeout(usec_t timeout_usec) {
         return DIV_ROUND_UP(timeout_usec, 3);
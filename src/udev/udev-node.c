@@ -5,6 +5,7 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <sys/stat.h>
+#include <sys/sysmacros.h>
 #include <unistd.h>
 
 #include "alloc-util.h"
@@ -17,6 +18,7 @@
 #include "fs-util.h"
 #include "libudev-util.h"
 #include "mkdir.h"
+#include "parse-util.h"
 #include "path-util.h"
 #include "selinux-util.h"
 #include "smack-util.h"
@@ -104,17 +106,110 @@ static int node_symlink(sd_device *dev, const char *node, const char *slink) {
         return r;
 }
 
+static int stack_entry_device_exists(const char *id) {
+        _cleanup_(sd_device_unrefp) sd_device *dev = NULL;
+        dev_t devnum;
+        int r;
+
+        assert(id);
+
+        /* Stack entries are named after the device ID, i.e. "b8:0" or "c189:1", since only devices with a
+         * device node get links. Checking sysfs for these is cheaper than creating a device object. */
+        if (IN_SET(id[0], 'b', 'c') && parse_dev(id + 1, &devnum) >= 0) {
+                char path[STRLEN("/sys/dev/block/") + DECIMAL_STR_MAX(unsigned) * 2 + 2];
+
+                xsprintf(path, "/sys/dev/%s/%u:%u", id[0] == 'b' ? "block" : "char", major(devnum), minor(devnum));
+                if (access(path, F_OK) < 0)
+                        return errno == ENOENT ? false : -errno;
+
+                return true;
+        }
+
+        r = sd_device_new_from_device_id(&dev, id);
+        if (IN_SET(r, -ENODEV, -ENOENT))
+                return false;
+        if (r < 0)
+                return r;
+
+        return true;
+}
+
+static int stack_entry_read(int dirfd, const char *name, int *ret_priority, char **ret_devnode) {
+        _cleanup_(sd_device_unrefp) sd_device *dev_db = NULL;
+        _cleanup_free_ char *buf = NULL;
+        const char *devnode, *colon;
+        int r, priority;
+
+        assert(dirfd >= 0);
+        assert(name);
+        assert(ret_priority);
+        assert(ret_devnode);
+
+        /* Stack entries are symlinks with "PRIORITY:DEVNODE" as target, so that the claims on a link can
+         * be compared without loading the database of every contender. */
+        r = readlinkat_malloc(dirfd, name, &buf);
+        if (r >= 0) {
+                colon = strchr(buf, ':');
+                if (!colon)
+                        return -EINVAL;
+
+                r = safe_atoi(strndupa(buf, colon - buf), &priority);
+                if (r < 0)
+                        return r;
+
+                if (!path_startswith(colon + 1, "/dev"))
+                        return -EINVAL;
+
+                devnode = colon + 1;
+
+                /* The entry of a device that is gone may be left behind, e.g. if the remove event was
+                 * never processed. Don't let such a device claim the link. */
+                r = stack_entry_device_exists(name);
+                if (r < 0)
+                        return r;
+                if (r == 0)
+                        return -ENODEV;
+        } else if (r == -EINVAL) {
+                /* An empty file, as created by older versions. Let's look the priority up in the
+                 * database. */
+                r = sd_device_new_from_device_id(&dev_db, name);
+                if (r < 0)
+                        return r;
+
+                r = sd_device_get_devname(dev_db, &devnode);
+                if (r < 0)
+                        return r;
+
+                r = device_get_devlink_priority(dev_db, &priority);
+                if (r < 0)
+                        return r;
+        } else
+                return r;
+
+        *ret_devnode = strdup(devnode);
+        if (!*ret_devnode)
+                return -ENOMEM;
+
+        *ret_priority = priority;
+        return 0;
+}
+
 /* find device node of device with highest priority */
 static int link_find_prioritized(sd_device *dev, bool add, const char *stackdir, char **ret) {
         _cleanup_closedir_ DIR *dir = NULL;
         _cleanup_free_ char *target = NULL;
+        const char *id_filename;
         struct dirent *dent;
         int r, priority = 0;
 
-        assert(!add || dev);
+        assert(dev);
         assert(stackdir);
         assert(ret);
 
+        r = device_get_id_filename(dev, &id_filename);
+        if (r < 0)
+                return r;
+
         if (add) {
                 const char *devnode;
 
@@ -142,9 +237,8 @@ static int link_find_prioritized(sd_device *dev, bool add, const char *stackdir,
         }
 
         FOREACH_DIRENT_ALL(dent, dir, break) {
-                _cleanup_(sd_device_unrefp) sd_device *dev_db = NULL;
-                const char *devnode, *id_filename;
-                int db_prio = 0;
+                _cleanup_free_ char *devnode = NULL;
+                int db_prio;
 
                 if (dent->d_name[0] == '\0')
                         break;
@@ -153,30 +247,22 @@ static int link_find_prioritized(sd_device *dev, bool add, const char *stackdir,
 
                 log_device_debug(dev, "Found '%s' claiming '%s'", dent->d_name, stackdir);
 
-                if (device_get_id_filename(dev, &id_filename) < 0)
-                        continue;
-
                 /* did we find ourself? */
                 if (streq(dent->d_name, id_filename))
                         continue;
 
-                if (sd_device_new_from_device_id(&dev_db, dent->d_name) < 0)
-                        continue;
-
-                if (sd_device_get_devname(dev_db, &devnode) < 0)
-                        continue;
-
-                if (device_get_devlink_priority(dev_db, &db_prio) < 0)
+                r = stack_entry_read(dirfd(dir), dent->d_name, &db_prio, &devnode);
+                if (r < 0) {
+                        log_device_debug_errno(dev, r, "Failed to read stack entry '%s', ignoring: %m", dent->d_name);
                         continue;
+                }
 
                 if (target && db_prio <= priority)
                         continue;
 
-                log_device_debug(dev_db, "Device claims priority %i for '%s'", db_prio, stackdir);
+                log_device_debug(dev, "Device '%s' claims priority %i for '%s'", dent->d_name, db_prio, stackdir);
 
-                r = free_and_strdup(&target, devnode);
-                if (r < 0)
-                        return r;
+                free_and_replace(target, devnode);
                 priority = db_prio;
         }
 
@@ -190,7 +276,7 @@ static int link_find_prioritized(sd_device *dev, bool add, const char *stackdir,
 /* manage "stack of names" with possibly specified device priorities */
 static int link_update(sd_device *dev, const char *slink, bool add) {
         _cleanup_free_ char *target = NULL, *filename = NULL, *dirname = NULL;
-        char name_enc[PATH_MAX];
+        char name_enc[PATH_MAX], entry[DECIMAL_STR_MAX(int) + 1 + PATH_MAX];
         const char *id_filename;
         int r;
 
@@ -220,17 +306,27 @@ static int link_update(sd_device *dev, const char *slink, bool add) {
         } else
                 (void) node_symlink(dev, target, slink);
 
-        if (add)
-                do {
-                        _cleanup_close_ int fd = -1;
+        if (add) {
+                const char *devnode;
+                int priority;
+
+                r = sd_device_get_devname(dev, &devnode);
+                if (r < 0)
+                        return log_device_debug_errno(dev, r, "Failed to get devname: %m");
+
+                r = device_get_devlink_priority(dev, &priority);
+                if (r < 0)
+                        return log_device_debug_errno(dev, r, "Failed to get devlink priority: %m");
 
+                xsprintf(entry, "%i:%s", priority, devnode);
+
+                do {
                         r = mkdir_parents(filename, 0755);
                         if (!IN_SET(r, 0, -ENOENT))
                                 break;
-                        fd = open(filename, O_WRONLY|O_CREAT|O_CLOEXEC|O_TRUNC|O_NOFOLLOW, 0444);
-                        if (fd < 0)
-                                r = -errno;
+                        r = symlink_atomic(entry, filename);
                 } while (r == -ENOENT);
+        }
 
         return r;
 }
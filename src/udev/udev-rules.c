@@ -146,7 +146,6 @@ struct UdevRuleToken {
         bool attr_match_remove_trailing_whitespace:1;
         const char *value;
         void *data;
-        LIST_FIELDS(UdevRuleToken, tokens);
 };
 
 struct UdevRuleLine {
@@ -160,7 +159,23 @@ struct UdevRuleLine {
 
         UdevRuleFile *rule_file;
         UdevRuleToken *current_token;
-        LIST_HEAD(UdevRuleToken, tokens);
+
+        /* The tokens of a line are evaluated in order for every event, hence keep them in one contiguous
+         * array rather than in individually allocated list entries. */
+        UdevRuleToken *tokens;
+        size_t n_tokens;
+        size_t n_allocated_tokens;
+
+        /* Necessary conditions for the line to match an event, derived from its ACTION==, SUBSYSTEM== and
+         * KERNEL== tokens, which allow skipping lines without evaluating their tokens. See
+         * rule_line_build_prefilter(). */
+        bool filter_action;
+        unsigned action_mask;           /* bit (1 << DeviceAction) set for each acceptable action */
+        const char **subsystems;        /* interned in UdevRules.subsystems, NULL if unfiltered */
+        size_t n_subsystems;
+        const char *kernel_prefix;      /* the sysname has to start with this, NULL if unfiltered */
+        size_t kernel_prefix_len;
+
         LIST_FIELDS(UdevRuleLine, rule_lines);
 };
 
@@ -176,6 +191,7 @@ struct UdevRules {
         ResolveNameTiming resolve_name_timing;
         Hashmap *known_users;
         Hashmap *known_groups;
+        Set *subsystems;
         UdevRuleFile *current_file;
         LIST_HEAD(UdevRuleFile, rule_files);
 };
@@ -245,19 +261,12 @@ static void log_unknown_owner(sd_device *dev, UdevRules *rules, int error, const
 
 /*** Other functions ***/
 
-static void udev_rule_token_free(UdevRuleToken *token) {
-        free(token);
-}
-
 static void udev_rule_line_clear_tokens(UdevRuleLine *rule_line) {
-        UdevRuleToken *i, *next;
-
         assert(rule_line);
 
-        LIST_FOREACH_SAFE(tokens, i, next, rule_line->tokens)
-                udev_rule_token_free(i);
-
-        rule_line->tokens = NULL;
+        rule_line->tokens = mfree(rule_line->tokens);
+        rule_line->n_tokens = rule_line->n_allocated_tokens = 0;
+        rule_line->current_token = NULL;
 }
 
 static void udev_rule_line_free(UdevRuleLine *rule_line) {
@@ -265,6 +274,7 @@ static void udev_rule_line_free(UdevRuleLine *rule_line) {
                 return;
 
         udev_rule_line_clear_tokens(rule_line);
+        free(rule_line->subsystems);
 
         if (rule_line->rule_file) {
                 if (rule_line->rule_file->current_line == rule_line)
@@ -303,6 +313,7 @@ UdevRules *udev_rules_free(UdevRules *rules) {
 
         hashmap_free_free_key(rules->known_users);
         hashmap_free_free_key(rules->known_groups);
+        set_free_free(rules->subsystems);
         return mfree(rules);
 }
 
@@ -394,16 +405,14 @@ static UdevRuleSubstituteType rule_get_substitution_type(const char *str) {
         return SUBST_TYPE_PLAIN;
 }
 
-static void rule_line_append_token(UdevRuleLine *rule_line, UdevRuleToken *token) {
+static UdevRuleToken *rule_line_append_token(UdevRuleLine *rule_line) {
         assert(rule_line);
-        assert(token);
 
-        if (rule_line->current_token)
-                LIST_APPEND(tokens, rule_line->current_token, token);
-        else
-                LIST_APPEND(tokens, rule_line->tokens, token);
+        if (!GREEDY_REALLOC(rule_line->tokens, rule_line->n_allocated_tokens, rule_line->n_tokens + 1))
+                return NULL;
 
-        rule_line->current_token = token;
+        rule_line->current_token = rule_line->tokens + rule_line->n_tokens++;
+        return rule_line->current_token;
 }
 
 static int rule_line_add_token(UdevRuleLine *rule_line, UdevRuleTokenType type, UdevRuleOperatorType op, char *value, void *data) {
@@ -475,7 +484,7 @@ static int rule_line_add_token(UdevRuleLine *rule_line, UdevRuleTokenType type,
                 subst_type = rule_get_substitution_type((const char*) data);
         }
 
-        token = new(UdevRuleToken, 1);
+        token = rule_line_append_token(rule_line);
         if (!token)
                 return -ENOMEM;
 
@@ -489,8 +498,6 @@ static int rule_line_add_token(UdevRuleLine *rule_line, UdevRuleTokenType type,
                 .attr_match_remove_trailing_whitespace = remove_trailing_whitespace,
         };
 
-        rule_line_append_token(rule_line, token);
-
         if (token->type == TK_A_NAME)
                 SET_FLAG(rule_line->type, LINE_HAS_NAME, true);
 
@@ -1057,23 +1064,124 @@ static int parse_line(char **line, char **ret_key, char **ret_attr, UdevRuleOper
 }
 
 static void sort_tokens(UdevRuleLine *rule_line) {
-        UdevRuleToken *head_old;
-
         assert(rule_line);
 
-        head_old = TAKE_PTR(rule_line->tokens);
+        /* Lines only have a handful of tokens, and tokens of the same type need to stay in the order they
+         * were specified in, hence a simple insertion sort suits well. */
+        for (size_t i = 1; i < rule_line->n_tokens; i++) {
+                UdevRuleToken t = rule_line->tokens[i];
+                size_t j;
+
+                for (j = i; j > 0 && rule_line->tokens[j - 1].type > t.type; j--)
+                        rule_line->tokens[j] = rule_line->tokens[j - 1];
+
+                rule_line->tokens[j] = t;
+        }
+
         rule_line->current_token = NULL;
+}
+
+static int rule_line_build_prefilter(UdevRules *rules, UdevRuleLine *rule_line) {
+        int r;
+
+        assert(rules);
+        assert(rule_line);
+
+        /* Most lines start with ACTION==, SUBSYSTEM== or KERNEL== guards, and most events fail them. Lines
+         * that fail are no-ops, hence it is safe to skip any line of which we know it cannot match. We only
+         * look at the first usable token of each kind, as each is a necessary condition on its own. */
+
+        for (size_t i = 0; i < rule_line->n_tokens; i++) {
+                UdevRuleToken *token = rule_line->tokens + i;
+                const char *v;
+
+                if (token->type == TK_M_ACTION && !rule_line->filter_action &&
+                    IN_SET(token->match_type, MATCH_TYPE_PLAIN, MATCH_TYPE_EMPTY)) {
+                        unsigned mask = 0;
 
-        while (!LIST_IS_EMPTY(head_old)) {
-                UdevRuleToken *t, *min_token = NULL;
+                        if (token->match_type == MATCH_TYPE_PLAIN)
+                                NULSTR_FOREACH(v, token->value) {
+                                        DeviceAction a;
 
-                LIST_FOREACH(tokens, t, head_old)
-                        if (!min_token || min_token->type > t->type)
-                                min_token = t;
+                                        a = device_action_from_string(v);
+                                        if (a >= 0)
+                                                mask |= 1U << a;
+                                }
+
+                        /* Every event has an action, hence ACTION=="" never matches */
+                        rule_line->action_mask = token->op == OP_MATCH ? mask : ~mask;
+                        rule_line->filter_action = true;
+
+                } else if (token->type == TK_M_SUBSYSTEM && !rule_line->subsystems &&
+                           token->op == OP_MATCH && token->match_type == MATCH_TYPE_PLAIN) {
+                        _cleanup_free_ const char **l = NULL;
+                        size_t n = 0;
+
+                        NULSTR_FOREACH(v, token->value)
+                                n++;
+
+                        l = new(const char*, n);
+                        if (!l)
+                                return log_oom();
+
+                        r = set_ensure_allocated(&rules->subsystems, &string_hash_ops);
+                        if (r < 0)
+                                return log_oom();
+
+                        n = 0;
+                        NULSTR_FOREACH(v, token->value) {
+                                r = set_put_strdup(rules->subsystems, v);
+                                if (r < 0)
+                                        return log_oom();
+
+                                l[n++] = set_get(rules->subsystems, (char*) v);
+                        }
 
-                LIST_REMOVE(tokens, head_old, min_token);
-                rule_line_append_token(rule_line, min_token);
+                        rule_line->subsystems = TAKE_PTR(l);
+                        rule_line->n_subsystems = n;
+
+                } else if (token->type == TK_M_KERNEL && !rule_line->kernel_prefix &&
+                           token->op == OP_MATCH && IN_SET(token->match_type, MATCH_TYPE_PLAIN, MATCH_TYPE_GLOB)) {
+                        size_t n = 0;
+
+                        NULSTR_FOREACH(v, token->value)
+                                n++;
+
+                        /* Only with a single alternative everything up to the first glob character is a
+                         * necessary prefix */
+                        if (n != 1)
+                                continue;
+
+                        rule_line->kernel_prefix = token->value;
+                        rule_line->kernel_prefix_len = strcspn(token->value, GLOB_CHARS "\\");
+                }
         }
+
+        return 0;
+}
+
+static bool rule_line_may_match(UdevRuleLine *rule_line, DeviceAction action, const char *subsystem, const char *sysname) {
+        assert(rule_line);
+
+        if (rule_line->filter_action && !FLAGS_SET(rule_line->action_mask, 1U << action))
+                return false;
+
+        if (rule_line->subsystems) {
+                size_t i;
+
+                /* Subsystems are interned, hence we can compare pointers */
+                for (i = 0; i < rule_line->n_subsystems; i++)
+                        if (rule_line->subsystems[i] == subsystem)
+                                break;
+                if (i >= rule_line->n_subsystems)
+                        return false;
+        }
+
+        if (rule_line->kernel_prefix && sysname &&
+            strncmp(sysname, rule_line->kernel_prefix, rule_line->kernel_prefix_len) != 0)
+                return false;
+
+        return true;
 }
 
 static int rule_add_line(UdevRules *rules, const char *line_str, unsigned line_nr) {
@@ -1136,6 +1244,11 @@ static int rule_add_line(UdevRules *rules, const char *line_str, unsigned line_n
         }
 
         sort_tokens(rule_line);
+
+        r = rule_line_build_prefilter(rules, rule_line);
+        if (r < 0)
+                return r;
+
         TAKE_PTR(rule_line);
         return 0;
 }
@@ -1385,7 +1498,7 @@ static bool token_match_attr(UdevRuleToken *token, sd_device *dev, UdevEvent *ev
                         return false;
                 break;
         case SUBST_TYPE_SUBSYS:
-                if (util_resolve_subsys_kernel(name, vbuf, sizeof(vbuf), true) < 0)
+                if (util_resolve_subsys_kernel_full(name, &event->subsys_kernel_devices, vbuf, sizeof(vbuf), true) < 0)
                         return false;
                 value = vbuf;
                 break;
@@ -1629,7 +1742,7 @@ static int udev_rule_apply_token_to_event(
 
                 (void) udev_event_apply_format(event, token->value, buf, sizeof(buf), false);
                 if (!path_is_absolute(buf) &&
-                    util_resolve_subsys_kernel(buf, buf, sizeof(buf), false) < 0) {
+                    util_resolve_subsys_kernel_full(buf, &event->subsys_kernel_devices, buf, sizeof(buf), false) < 0) {
                         char tmp[UTIL_PATH_SIZE];
 
                         r = sd_device_get_syspath(dev, &val);
@@ -2086,8 +2199,10 @@ static int udev_rule_apply_token_to_event(
                 const char *key_name = (const char*) token->data;
                 char value[UTIL_NAME_SIZE];
 
-                if (util_resolve_subsys_kernel(key_name, buf, sizeof(buf), false) < 0 &&
-                    sd_device_get_syspath(dev, &val) >= 0)
+                if (util_resolve_subsys_kernel_full(key_name, &event->subsys_kernel_devices, buf, sizeof(buf), false) >= 0)
+                        /* The cached attribute values of that device will be out of date after the write below */
+                        event->subsys_kernel_devices = hashmap_free(event->subsys_kernel_devices);
+                else if (sd_device_get_syspath(dev, &val) >= 0)
                         strscpyl(buf, sizeof(buf), val, "/", key_name, NULL);
 
                 r = attr_subst_subdir(buf);
@@ -2165,14 +2280,15 @@ static int udev_rule_apply_parent_token_to_event(
                 UdevEvent *event) {
 
         UdevRuleLine *line;
-        UdevRuleToken *head;
+        UdevRuleToken *head, *end;
         int r;
 
         line = rules->current_file->current_line;
         head = rules->current_file->current_line->current_token;
+        end = line->tokens + line->n_tokens;
         event->dev_parent = event->dev;
         for (;;) {
-                LIST_FOREACH(tokens, line->current_token, head) {
+                for (line->current_token = head; line->current_token < end; line->current_token++) {
                         if (!token_is_for_parents(line->current_token))
                                 return true; /* All parent tokens match. */
                         r = udev_rule_apply_token_to_event(rules, event->dev_parent, event, 0, NULL);
@@ -2181,7 +2297,7 @@ static int udev_rule_apply_parent_token_to_event(
                         if (r == 0)
                                 break;
                 }
-                if (!line->current_token)
+                if (line->current_token >= end)
                         /* All parent tokens match. But no assign tokens in the line. Hmm... */
                         return true;
 
@@ -2197,32 +2313,20 @@ static int udev_rule_apply_line_to_event(
                 UdevEvent *event,
                 usec_t timeout_usec,
                 Hashmap *properties_list,
+                UdevRuleLineType mask,
                 UdevRuleLine **next_line) {
 
         UdevRuleLine *line = rules->current_file->current_line;
-        UdevRuleLineType mask = LINE_HAS_GOTO | LINE_UPDATE_SOMETHING;
-        UdevRuleToken *token, *next_token;
         bool parents_done = false;
-        DeviceAction action;
         int r;
 
-        r = device_get_action(event->dev, &action);
-        if (r < 0)
-                return r;
-
-        if (action != DEVICE_ACTION_REMOVE) {
-                if (sd_device_get_devnum(event->dev, NULL) >= 0)
-                        mask |= LINE_HAS_DEVLINK;
-
-                if (sd_device_get_ifindex(event->dev, NULL) >= 0)
-                        mask |= LINE_HAS_NAME;
-        }
-
         if ((line->type & mask) == 0)
                 return 0;
 
         event->esc = ESCAPE_UNSET;
-        LIST_FOREACH_SAFE(tokens, token, next_token, line->tokens) {
+        for (size_t i = 0; i < line->n_tokens; i++) {
+                UdevRuleToken *token = line->tokens + i;
+
                 line->current_token = token;
 
                 if (token_is_for_parents(token)) {
@@ -2254,17 +2358,43 @@ int udev_rules_apply_to_event(
                 usec_t timeout_usec,
                 Hashmap *properties_list) {
 
+        UdevRuleLineType mask = LINE_HAS_GOTO | LINE_UPDATE_SOMETHING;
+        const char *subsystem = NULL, *sysname = NULL, *val;
         UdevRuleFile *file;
         UdevRuleLine *next_line;
+        DeviceAction action;
         int r;
 
         assert(rules);
         assert(event);
 
+        /* Which kinds of lines may apply to the event does not change while processing it, hence figure it
+         * out once, instead of for each line. */
+        r = device_get_action(event->dev, &action);
+        if (r < 0)
+                return r;
+
+        if (action != DEVICE_ACTION_REMOVE) {
+                if (sd_device_get_devnum(event->dev, NULL) >= 0)
+                        mask |= LINE_HAS_DEVLINK;
+
+                if (sd_device_get_ifindex(event->dev, NULL) >= 0)
+                        mask |= LINE_HAS_NAME;
+        }
+
+        /* If the subsystem is not interned, no line filtering on subsystems can match, same as if the
+         * device has none. If the sysname cannot be determined, let the KERNEL== tokens report that. */
+        if (rules->subsystems && sd_device_get_subsystem(event->dev, &val) >= 0)
+                subsystem = set_get(rules->subsystems, (char*) val);
+        (void) sd_device_get_sysname(event->dev, &sysname);
+
         LIST_FOREACH(rule_files, file, rules->rule_files) {
                 rules->current_file = file;
                 LIST_FOREACH_SAFE(rule_lines, file->current_line, next_line, file->rule_lines) {
-                        r = udev_rule_apply_line_to_event(rules, event, timeout_usec, properties_list, &next_line);
+                        if (!rule_line_may_match(file->current_line, action, subsystem, sysname))
+                                continue;
+
+                        r = udev_rule_apply_line_to_event(rules, event, timeout_usec, properties_list, mask, &next_line);
                         if (r < 0)
                                 return r;
                 }
@@ -2341,7 +2471,6 @@ static int apply_static_dev_perms(const char *devnode, uid_t uid, gid_t gid, mod
 }
 
 static int udev_rule_line_apply_static_dev_perms(UdevRuleLine *rule_line) {
-        UdevRuleToken *token;
         _cleanup_strv_free_ char **tags = NULL;
         uid_t uid = UID_INVALID;
         gid_t gid = GID_INVALID;
@@ -2353,7 +2482,9 @@ static int udev_rule_line_apply_static_dev_perms(UdevRuleLine *rule_line) {
         if (!FLAGS_SET(rule_line->type, LINE_HAS_STATIC_NODE))
                 return 0;
 
-        LIST_FOREACH(tokens, token, rule_line->tokens)
+        for (size_t i = 0; i < rule_line->n_tokens; i++) {
+                UdevRuleToken *token = rule_line->tokens + i;
+
                 if (token->type == TK_A_OWNER_ID)
                         uid = PTR_TO_UID(token->data);
                 else if (token->type == TK_A_GROUP_ID)
@@ -2369,6 +2500,7 @@ static int udev_rule_line_apply_static_dev_perms(UdevRuleLine *rule_line) {
                         if (r < 0)
                                 return r;
                 }
+        }
 
         return 0;
 }
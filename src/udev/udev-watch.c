@@ -145,12 +145,11 @@ int udev_watch_end(sd_device *dev) {
         return 0;
 }
 
-int udev_watch_lookup(int wd, sd_device **ret) {
+int udev_watch_lookup(int wd, char **ret_device_id) {
         char filename[STRLEN("/run/udev/watch/") + DECIMAL_STR_MAX(int)];
-        _cleanup_free_ char *device = NULL;
         int r;
 
-        assert(ret);
+        assert(ret_device_id);
 
         if (inotify_fd < 0)
                 return log_debug_errno(SYNTHETIC_ERRNO(EINVAL),
@@ -161,17 +160,11 @@ int udev_watch_lookup(int wd, sd_device **ret) {
                                        "Invalid watch handle.");
 
         xsprintf(filename, "/run/udev/watch/%d", wd);
-        r = readlink_malloc(filename, &device);
+        r = readlink_malloc(filename, ret_device_id);
         if (r == -ENOENT)
                 return 0;
         if (r < 0)
                 return log_debug_errno(r, "Failed to read link '%s': %m", filename);
 
-        r = sd_device_new_from_device_id(ret, device);
-        if (r == -ENODEV)
-                return 0;
-        if (r < 0)
-                return log_debug_errno(r, "Failed to create sd_device object for '%s': %m", device);
-
         return 1;
 }
@@ -7,4 +7,4 @@ int udev_watch_init(void);
 int udev_watch_restore(void);
 int udev_watch_begin(sd_device *dev);
 int udev_watch_end(sd_device *dev);
-int udev_watch_lookup(int wd, sd_device **ret);
+int udev_watch_lookup(int wd, char **ret_device_id);
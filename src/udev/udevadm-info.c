@@ -12,6 +12,7 @@
 #include "sd-device.h"
 
 #include "alloc-util.h"
+#include "device-database.h"
 #include "device-enumerator-private.h"
 #include "device-private.h"
 #include "device-util.h"
@@ -225,6 +226,7 @@ static void cleanup_db(void) {
         _cleanup_closedir_ DIR *dir1 = NULL, *dir2 = NULL, *dir3 = NULL, *dir4 = NULL, *dir5 = NULL;
 
         (void) unlink("/run/udev/queue.bin");
+        (void) unlink(DEVICE_DATABASE_PATH);
 
         dir1 = opendir("/run/udev/data");
         if (dir1)
@@ -16,6 +16,7 @@
 #include "sd-login.h"
 
 #include "libudev-util.h"
+#include "static-destruct.h"
 #include "string-util.h"
 #include "strv.h"
 #include "time-util.h"
@@ -27,6 +28,9 @@
 
 static usec_t arg_timeout = 120 * USEC_PER_SEC;
 static const char *arg_exists = NULL;
+static char **arg_matches = NULL;
+
+STATIC_DESTRUCTOR_REGISTER(arg_matches, strv_freep);
 
 static int help(void) {
         printf("%s settle [OPTIONS]\n\n"
@@ -35,15 +39,44 @@ static int help(void) {
                "  -V --version              Show package version\n"
                "  -t --timeout=SEC          Maximum time to wait for events\n"
                "  -E --exit-if-exists=FILE  Stop waiting if file exists\n"
+               "     --subsystem-match=SUBSYSTEM\n"
+               "                            Only wait for events of devices from a matching\n"
+               "                            subsystem\n"
+               "     --sysname-match=NAME   Only wait for events of devices with a matching\n"
+               "                            name\n"
                , program_invocation_short_name);
 
         return 0;
 }
 
+static int add_match(const char *key, const char *pattern) {
+        union udev_ctrl_msg_value value;
+        char *m;
+
+        m = strjoin(key, "=", pattern);
+        if (!m)
+                return log_oom();
+
+        if (strlen(m) >= sizeof(value.buf)) {
+                log_error("Match '%s' too long.", m);
+                free(m);
+                return -EINVAL;
+        }
+
+        return strv_consume(&arg_matches, m);
+}
+
 static int parse_argv(int argc, char *argv[]) {
+        enum {
+                ARG_SUBSYSTEM_MATCH = 0x100,
+                ARG_SYSNAME_MATCH,
+        };
+
         static const struct option options[] = {
-                { "timeout",        required_argument, NULL, 't' },
-                { "exit-if-exists", required_argument, NULL, 'E' },
+                { "timeout",         required_argument, NULL, 't'                 },
+                { "exit-if-exists",  required_argument, NULL, 'E'                 },
+                { "subsystem-match", required_argument, NULL, ARG_SUBSYSTEM_MATCH },
+                { "sysname-match",   required_argument, NULL, ARG_SYSNAME_MATCH   },
                 { "version",        no_argument,       NULL, 'V' },
                 { "help",           no_argument,       NULL, 'h' },
                 { "seq-start",      required_argument, NULL, 's' }, /* removed */
@@ -64,6 +97,16 @@ static int parse_argv(int argc, char *argv[]) {
                 case 'E':
                         arg_exists = optarg;
                         break;
+                case ARG_SUBSYSTEM_MATCH:
+                        r = add_match("subsystem", optarg);
+                        if (r < 0)
+                                return r;
+                        break;
+                case ARG_SYSNAME_MATCH:
+                        r = add_match("sysname", optarg);
+                        if (r < 0)
+                                return r;
+                        break;
                 case 'V':
                         return print_version();
                 case 'h':
@@ -139,6 +182,43 @@ static int emit_deprecation_warning(void) {
         return 0;
 }
 
+static int settle_matching(usec_t deadline) {
+        _cleanup_(udev_ctrl_unrefp) struct udev_ctrl *uctrl = NULL;
+        usec_t n;
+        char **m;
+        int r;
+
+        /* Ask the daemon to reply once the events for the matching devices are processed, instead of
+         * waiting for the whole queue to become empty. Like the ping, this also guarantees that the daemon
+         * isn't pre-processing anymore. Returns 0 if the daemon couldn't be reached, or if it closed the
+         * connection without replying, as daemons do that don't know about this yet, e.g. during an
+         * upgrade. The caller then falls back to watching the queue. */
+
+        r = udev_ctrl_new(&uctrl);
+        if (r < 0)
+                return 0;
+
+        STRV_FOREACH(m, arg_matches) {
+                r = udev_ctrl_send_settle(uctrl, *m);
+                if (r < 0) {
+                        log_debug_errno(r, "Failed to connect to udev daemon: %m");
+                        return 0;
+                }
+        }
+
+        n = now(CLOCK_MONOTONIC);
+        if (n >= deadline)
+                return -ETIMEDOUT;
+
+        r = udev_ctrl_wait_settled(uctrl, deadline - n);
+        if (r < 0)
+                return log_error_errno(r, "Failed to wait for events of matching devices: %m");
+        if (r == 0)
+                log_debug("udev daemon doesn't support waiting for matching devices, waiting for all events.");
+
+        return r;
+}
+
 int settle_main(int argc, char *argv[], void *userdata) {
         _cleanup_(udev_queue_unrefp) struct udev_queue *queue = NULL;
         struct pollfd pfd;
@@ -156,6 +236,17 @@ int settle_main(int argc, char *argv[], void *userdata) {
 
         deadline = now(CLOCK_MONOTONIC) + arg_timeout;
 
+        if (arg_exists && access(arg_exists, F_OK) >= 0)
+                return 0;
+
+        /* The daemon only tells root about the state of individual devices, everybody else has to wait for
+         * the whole queue. */
+        if (!strv_isempty(arg_matches) && arg_timeout > 0 && getuid() == 0) {
+                r = settle_matching(deadline);
+                if (r != 0)
+                        return r < 0 ? r : 0;
+        }
+
         /* guarantee that the udev daemon isn't pre-processing */
         if (getuid() == 0) {
                 _cleanup_(udev_ctrl_unrefp) struct udev_ctrl *uctrl = NULL;
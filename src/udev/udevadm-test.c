@@ -103,6 +103,7 @@ int test_main(int argc, char *argv[], void *userdata) {
         _cleanup_(udev_event_freep) UdevEvent *event = NULL;
         _cleanup_(sd_device_unrefp) sd_device *dev = NULL;
         const char *cmd, *key, *value;
+        unsigned reads, cache_hits;
         sigset_t mask, sigmask_orig;
         Iterator i;
         void *val;
@@ -155,6 +156,9 @@ int test_main(int argc, char *argv[], void *userdata) {
                 printf("run: '%s'\n", program);
         }
 
+        udev_event_get_sysattr_statistics(event, &reads, &cache_hits);
+        printf("sysfs attribute reads: %u, served from cache: %u\n", reads, cache_hits);
+
         r = 0;
 out:
         udev_builtin_exit();
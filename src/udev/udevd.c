@@ -30,8 +30,10 @@
 #include "alloc-util.h"
 #include "build.h"
 #include "cgroup-util.h"
+#include "conf-files.h"
 #include "cpu-set-util.h"
 #include "dev-setup.h"
+#include "device-database.h"
 #include "device-monitor-private.h"
 #include "device-private.h"
 #include "device-util.h"
@@ -55,6 +57,7 @@
 #include "selinux-util.h"
 #include "signal-util.h"
 #include "socket-util.h"
+#include "stdio-util.h"
 #include "string-util.h"
 #include "strv.h"
 #include "strxcpyx.h"
@@ -68,6 +71,16 @@
 
 #define WORKER_NUM_MAX 2048U
 
+/* We size the worker pool so that the currently queued events would be processed within this time, based on
+ * how long events took on average recently. At most arg_children_max workers are used in any case. */
+#define EVENT_LATENCY_TARGET_USEC (100 * USEC_PER_MSEC)
+
+/* Maximum number of idle workers we fork ahead of time while events wait for others to finish */
+#define WORKER_SPARE_MAX 4U
+
+/* Repeated close-after-write events of a watched device within this time result in one synthetic change */
+#define WATCH_DEBOUNCE_USEC (500 * USEC_PER_MSEC)
+
 static bool arg_debug = false;
 static int arg_daemonize = false;
 static ResolveNameTiming arg_resolve_name_timing = RESOLVE_NAME_EARLY;
@@ -75,6 +88,9 @@ static unsigned arg_children_max = 0;
 static usec_t arg_exec_delay_usec = 0;
 static usec_t arg_event_timeout_usec = 180 * USEC_PER_SEC;
 
+typedef struct SettleWaiter SettleWaiter;
+typedef struct Watch Watch;
+
 typedef struct Manager {
         sd_event *event;
         Hashmap *workers;
@@ -95,8 +111,34 @@ typedef struct Manager {
         sd_event_source *inotify_event;
         sd_event_source *kill_workers_event;
 
+        Hashmap *watches;               /* inotify watch descriptor → Watch */
+
+        /* Indexes of the queued and running events, so that we can tell whether an event has to wait for
+         * another one without comparing it to every other event in the queue. The lists they point to are
+         * in queue order. */
+        Hashmap *events_by_devpath;
+        Hashmap *events_by_devnum;
+        Hashmap *events_by_ifindex;
+        Hashmap *devpath_subtree_size;  /* devpath → number of events for devices below it */
+        uint64_t event_index;
+        unsigned n_events;
+        unsigned n_events_queued;
+
+        /* Statistics about processed events */
+        uint64_t n_events_processed;
+        usec_t queue_wait_usec_total;
+        usec_t exec_usec_total;
+        usec_t exec_usec_avg;           /* exponential moving average */
+        uint64_t n_events_processed_at_vacuum;
+
         usec_t last_usec;
 
+        /* "udevadm settle" clients waiting for the events of some devices only, and the matches received
+         * on the current control connection */
+        LIST_HEAD(SettleWaiter, settle_waiters);
+        char **settle_subsystems;
+        char **settle_sysnames;
+
         bool stop_exec_queue:1;
         bool exit:1;
 } Manager;
@@ -116,12 +158,55 @@ struct event {
         sd_device *dev_kernel; /* clone of originally received device */
 
         uint64_t seqnum;
-        uint64_t delaying_seqnum;
+
+        /* Position in the queue, and the device properties we are indexed by */
+        uint64_t index;
+        const char *devpath;
+        const char *devpath_old;
+        char devnum_id[2 + DECIMAL_STR_MAX(unsigned) * 2]; /* e.g. "b8:0", empty if there's no devnum */
+        int ifindex;
+
+        /* Number of events queued earlier than us for devices below ours */
+        unsigned n_blocking_children;
+
+        usec_t queued_usec;
+        usec_t started_usec;
+
+        bool in_devpath_index:1;
+        bool in_devnum_index:1;
+        bool in_ifindex_index:1;
+        size_t subtree_indexed; /* length of the devpath prefix up to which subtree sizes were counted */
 
         sd_event_source *timeout_warning_event;
         sd_event_source *timeout_event;
 
         LIST_FIELDS(struct event, event);
+        LIST_FIELDS(struct event, same_devpath);
+        LIST_FIELDS(struct event, same_devnum);
+        LIST_FIELDS(struct event, same_ifindex);
+};
+
+/* A "udevadm settle" client waiting for the events of the devices matching all of the given lists of
+ * patterns. Such clients wait for the control connection to be closed, hence we keep it open as long as
+ * there are matching events in the queue. */
+struct SettleWaiter {
+        Manager *manager;
+        int fd;
+        char **subsystems;
+        char **sysnames;
+        unsigned n_pending;     /* number of queued and running events that match */
+
+        LIST_FIELDS(SettleWaiter, settle_waiters);
+};
+
+/* A device watched with OPTIONS+="watch". Watches are added by the workers, hence we learn about them from
+ * the symlinks in /run/udev/watch/ on the first inotify event, and forget them when the watch is removed. */
+struct Watch {
+        Manager *manager;
+        int wd;
+        char *device_id;
+        usec_t last_change_usec;        /* when we last synthesized a change event for the device */
+        sd_event_source *debounce_event;
 };
 
 static void event_queue_cleanup(Manager *manager, enum event_state type);
@@ -145,13 +230,394 @@ struct worker {
 struct worker_message {
 };
 
+#define EVENT_DEVPATH_KEY(e) ((e)->devpath)
+#define EVENT_DEVNUM_KEY(e)  ((e)->devnum_id)
+#define EVENT_IFINDEX_KEY(e) INT_TO_PTR((e)->ifindex)
+
+/* Appends the event to the list of events with the same key. As events are indexed when they are queued,
+ * the lists are in queue order, and the head of each list is the event all others have to wait for. The
+ * hashmap key is always owned by the head. */
+#define event_index_add(h, name, event, KEY)                            \
+        ({                                                              \
+                struct event *_first = hashmap_get((h), KEY(event));    \
+                int _r = 0;                                             \
+                                                                        \
+                LIST_INIT(name, (event));                               \
+                if (_first)                                             \
+                        LIST_APPEND(name, _first, (event));             \
+                else                                                    \
+                        _r = hashmap_put((h), KEY(event), (event));     \
+                _r;                                                     \
+        })
+
+#define event_index_remove(h, name, event, KEY)                         \
+        do {                                                            \
+                struct event *_first = hashmap_get((h), KEY(event));    \
+                                                                        \
+                if (_first != (event))                                  \
+                        LIST_REMOVE(name, _first, (event));             \
+                else {                                                  \
+                        LIST_REMOVE(name, _first, (event));             \
+                        if (_first)                                     \
+                                assert_se(hashmap_remove_and_replace((h), KEY(event), KEY(_first), _first) >= 0); \
+                        else                                            \
+                                assert_se(hashmap_remove((h), KEY(event)) == (event)); \
+                }                                                       \
+        } while (false)
+
+static void event_unindex_subtree(Manager *manager, struct event *event) {
+        char *p, *s;
+
+        assert(manager);
+        assert(event);
+
+        if (event->subtree_indexed == 0)
+                return;
+
+        /* Undo what event_index_subtree() did, and let all events for parent devices that were queued after
+         * us know that they do not need to wait for us anymore. */
+        p = strndupa(event->devpath, event->subtree_indexed);
+
+        for (s = strchr(p + 1, '/'); s; s = strchr(s + 1, '/')) {
+                struct event *e;
+                unsigned n;
+                void *k;
+
+                *s = '\0';
+
+                n = PTR_TO_UINT(hashmap_get(manager->devpath_subtree_size, p));
+                assert(n > 0);
+                if (n > 1)
+                        assert_se(hashmap_update(manager->devpath_subtree_size, p, UINT_TO_PTR(n - 1)) >= 0);
+                else {
+                        (void) hashmap_remove2(manager->devpath_subtree_size, p, &k);
+                        free(k);
+                }
+
+                LIST_FOREACH(same_devpath, e, hashmap_get(manager->events_by_devpath, p))
+                        if (e->index > event->index) {
+                                assert(e->n_blocking_children > 0);
+                                e->n_blocking_children--;
+                        }
+
+                *s = '/';
+        }
+
+        event->subtree_indexed = 0;
+}
+
+static int event_index_subtree(Manager *manager, struct event *event) {
+        _cleanup_free_ char *p = NULL;
+        char *s;
+        int r;
+
+        assert(manager);
+        assert(event);
+
+        r = hashmap_ensure_allocated(&manager->devpath_subtree_size, &string_hash_ops);
+        if (r < 0)
+                return r;
+
+        p = strdup(event->devpath);
+        if (!p)
+                return -ENOMEM;
+
+        /* Count the event for every parent device path, and wait for all events below our own device */
+        for (s = strchr(p + 1, '/'); s; s = strchr(s + 1, '/')) {
+                unsigned n;
+
+                *s = '\0';
+
+                n = PTR_TO_UINT(hashmap_get(manager->devpath_subtree_size, p));
+                if (n > 0)
+                        r = hashmap_update(manager->devpath_subtree_size, p, UINT_TO_PTR(n + 1));
+                else {
+                        _cleanup_free_ char *k = NULL;
+
+                        k = strdup(p);
+                        if (!k)
+                                return -ENOMEM;
+
+                        r = hashmap_put(manager->devpath_subtree_size, k, UINT_TO_PTR(1));
+                        if (r >= 0)
+                                TAKE_PTR(k);
+                }
+                if (r < 0)
+                        return r;
+
+                *s = '/';
+                event->subtree_indexed = s - p + 1;
+        }
+
+        event->subtree_indexed = strlen(event->devpath);
+        event->n_blocking_children = PTR_TO_UINT(hashmap_get(manager->devpath_subtree_size, event->devpath));
+        return 0;
+}
+
+static void event_unindex(Manager *manager, struct event *event) {
+        assert(manager);
+        assert(event);
+
+        event_unindex_subtree(manager, event);
+
+        if (event->in_devpath_index)
+                event_index_remove(manager->events_by_devpath, same_devpath, event, EVENT_DEVPATH_KEY);
+        if (event->in_devnum_index)
+                event_index_remove(manager->events_by_devnum, same_devnum, event, EVENT_DEVNUM_KEY);
+        if (event->in_ifindex_index)
+                event_index_remove(manager->events_by_ifindex, same_ifindex, event, EVENT_IFINDEX_KEY);
+
+        event->in_devpath_index = event->in_devnum_index = event->in_ifindex_index = false;
+}
+
+static int event_index(Manager *manager, struct event *event) {
+        const char *subsystem;
+        dev_t devnum;
+        int r;
+
+        assert(manager);
+        assert(event);
+
+        r = sd_device_get_devpath(event->dev, &event->devpath);
+        if (r < 0)
+                return r;
+
+        r = sd_device_get_property_value(event->dev, "DEVPATH_OLD", &event->devpath_old);
+        if (r < 0 && r != -ENOENT)
+                return r;
+
+        r = sd_device_get_devnum(event->dev, &devnum);
+        if (r < 0 && r != -ENOENT)
+                return r;
+        if (r >= 0 && major(devnum) != 0)
+                xsprintf(event->devnum_id, "%c%u:%u",
+                         sd_device_get_subsystem(event->dev, &subsystem) >= 0 && streq(subsystem, "block") ? 'b' : 'c',
+                         major(devnum), minor(devnum));
+
+        r = sd_device_get_ifindex(event->dev, &event->ifindex);
+        if (r < 0 && r != -ENOENT)
+                return r;
+
+        event->index = manager->event_index++;
+
+        r = hashmap_ensure_allocated(&manager->events_by_devpath, &string_hash_ops);
+        if (r < 0)
+                return r;
+
+        r = event_index_add(manager->events_by_devpath, same_devpath, event, EVENT_DEVPATH_KEY);
+        if (r < 0)
+                return r;
+        event->in_devpath_index = true;
+
+        if (!isempty(event->devnum_id)) {
+                r = hashmap_ensure_allocated(&manager->events_by_devnum, &string_hash_ops);
+                if (r < 0)
+                        goto fail;
+
+                r = event_index_add(manager->events_by_devnum, same_devnum, event, EVENT_DEVNUM_KEY);
+                if (r < 0)
+                        goto fail;
+                event->in_devnum_index = true;
+        }
+
+        if (event->ifindex > 0) {
+                r = hashmap_ensure_allocated(&manager->events_by_ifindex, NULL);
+                if (r < 0)
+                        goto fail;
+
+                r = event_index_add(manager->events_by_ifindex, same_ifindex, event, EVENT_IFINDEX_KEY);
+                if (r < 0)
+                        goto fail;
+                event->in_ifindex_index = true;
+        }
+
+        r = event_index_subtree(manager, event);
+        if (r < 0)
+                goto fail;
+
+        return 0;
+
+fail:
+        event_unindex(manager, event);
+        return r;
+}
+
+static SettleWaiter *settle_waiter_free(SettleWaiter *w) {
+        if (!w)
+                return NULL;
+
+        if (w->manager)
+                LIST_REMOVE(settle_waiters, w->manager->settle_waiters, w);
+
+        /* This tells the client we are done */
+        safe_close(w->fd);
+
+        strv_free(w->subsystems);
+        strv_free(w->sysnames);
+
+        return mfree(w);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(SettleWaiter*, settle_waiter_free);
+
+static void settle_waiter_release(SettleWaiter *w) {
+        int r;
+
+        assert(w);
+
+        /* Unlike a plain close, the reply tells the client that we actually waited for its devices. Without
+         * it, the client assumes it talks to a daemon that doesn't know about this, and watches the queue. */
+        r = udev_ctrl_send_settled(w->fd);
+        if (r < 0)
+                log_debug_errno(r, "Failed to notify settle client (fd=%i), ignoring: %m", w->fd);
+
+        settle_waiter_free(w);
+}
+
+static bool settle_waiter_match(SettleWaiter *w, struct event *event) {
+        const char *s;
+
+        assert(w);
+        assert(event);
+
+        if (!strv_isempty(w->subsystems) &&
+            (sd_device_get_subsystem(event->dev, &s) < 0 || !strv_fnmatch(w->subsystems, s)))
+                return false;
+
+        if (!strv_isempty(w->sysnames) &&
+            (sd_device_get_sysname(event->dev, &s) < 0 || !strv_fnmatch(w->sysnames, s)))
+                return false;
+
+        return true;
+}
+
+static void manager_settle_event_done(Manager *manager, struct event *event) {
+        SettleWaiter *w, *next;
+
+        assert(manager);
+        assert(event);
+
+        /* Called whenever an event is removed from the queue, after it was processed or discarded */
+
+        LIST_FOREACH_SAFE(settle_waiters, w, next, manager->settle_waiters) {
+                if (!LIST_IS_EMPTY(manager->events)) {
+                        if (!settle_waiter_match(w, event))
+                                continue;
+
+                        assert(w->n_pending > 0);
+                        if (--w->n_pending > 0)
+                                continue;
+                }
+
+                log_debug("All events of settle client (fd=%i) processed, releasing it.", w->fd);
+                settle_waiter_release(w);
+        }
+}
+
+static void manager_settle_event_queued(Manager *manager, struct event *event) {
+        SettleWaiter *w;
+
+        assert(manager);
+        assert(event);
+
+        LIST_FOREACH(settle_waiters, w, manager->settle_waiters)
+                if (settle_waiter_match(w, event))
+                        w->n_pending++;
+}
+
+static int manager_add_settle_match(Manager *manager, const char *match) {
+        const char *p;
+
+        assert(manager);
+        assert(match);
+
+        if ((p = startswith(match, "subsystem=")))
+                return strv_extend(&manager->settle_subsystems, p);
+        if ((p = startswith(match, "sysname=")))
+                return strv_extend(&manager->settle_sysnames, p);
+
+        return -EINVAL;
+}
+
+static void manager_settle_start(Manager *manager, struct udev_ctrl *uctrl) {
+        _cleanup_(settle_waiter_freep) SettleWaiter *w = NULL;
+        struct event *event;
+        int fd;
+
+        assert(manager);
+        assert(uctrl);
+
+        /* Called at the end of the messages on a control connection. If the client asked to wait for some
+         * devices, take over the connection, and reply and close it once the last of the events queued for
+         * them is processed, or right away if there are none. */
+
+        if (strv_isempty(manager->settle_subsystems) && strv_isempty(manager->settle_sysnames))
+                return;
+
+        w = new(SettleWaiter, 1);
+        if (!w) {
+                manager->settle_subsystems = strv_free(manager->settle_subsystems);
+                manager->settle_sysnames = strv_free(manager->settle_sysnames);
+                log_oom();
+                return;
+        }
+
+        *w = (SettleWaiter) {
+                .fd = -1,
+                .subsystems = TAKE_PTR(manager->settle_subsystems),
+                .sysnames = TAKE_PTR(manager->settle_sysnames),
+        };
+
+        LIST_FOREACH(event, event, manager->events)
+                if (settle_waiter_match(w, event))
+                        w->n_pending++;
+
+        fd = udev_ctrl_take_connection(uctrl);
+        if (fd < 0) {
+                log_warning_errno(fd, "Failed to take over control connection of settle client, ignoring: %m");
+                return;
+        }
+
+        w->fd = fd;
+
+        if (w->n_pending == 0) {
+                settle_waiter_release(TAKE_PTR(w));
+                return;
+        }
+
+        log_debug("Settle client (fd=%i) waits for %u events.", fd, w->n_pending);
+
+        w->manager = manager;
+        LIST_PREPEND(settle_waiters, manager->settle_waiters, w);
+        TAKE_PTR(w);
+}
+
+static void manager_settle_clear(Manager *manager) {
+        assert(manager);
+
+        while (manager->settle_waiters)
+                settle_waiter_free(manager->settle_waiters);
+
+        manager->settle_subsystems = strv_free(manager->settle_subsystems);
+        manager->settle_sysnames = strv_free(manager->settle_sysnames);
+}
+
 static void event_free(struct event *event) {
         if (!event)
                 return;
 
         assert(event->manager);
 
+        event_unindex(event->manager, event);
         LIST_REMOVE(event, event->manager->events, event);
+        event->manager->n_events--;
+
+        manager_settle_event_done(event->manager, event);
+
+        if (event->state == EVENT_QUEUED) {
+                assert(event->manager->n_events_queued > 0);
+                event->manager->n_events_queued--;
+        }
         sd_device_unref(event->dev);
         sd_device_unref(event->dev_kernel);
 
@@ -256,14 +722,19 @@ static void worker_attach_event(struct worker *worker, struct event *event) {
         assert(!event->worker);
         assert(!worker->event);
 
+        assert(event->state == EVENT_QUEUED);
+        assert(worker->manager->n_events_queued > 0);
+
         worker->state = WORKER_RUNNING;
         worker->event = event;
         event->state = EVENT_RUNNING;
         event->worker = worker;
+        worker->manager->n_events_queued--;
 
         e = worker->manager->event;
 
         assert_se(sd_event_now(e, CLOCK_MONOTONIC, &usec) >= 0);
+        event->started_usec = usec;
 
         (void) sd_event_add_time(e, &event->timeout_warning_event, CLOCK_MONOTONIC,
                                  usec + udev_warn_timeout(arg_event_timeout_usec), USEC_PER_SEC, on_event_timeout_warning, event);
@@ -277,12 +748,21 @@ static void manager_clear_for_worker(Manager *manager) {
 
         manager->inotify_event = sd_event_source_unref(manager->inotify_event);
         manager->kill_workers_event = sd_event_source_unref(manager->kill_workers_event);
+        manager->watches = hashmap_free(manager->watches);
 
         manager->event = sd_event_unref(manager->event);
 
         manager->workers = hashmap_free(manager->workers);
+
+        /* Workers must not keep the connections of settle clients open */
+        manager_settle_clear(manager);
         event_queue_cleanup(manager, EVENT_UNDEF);
 
+        manager->events_by_devpath = hashmap_free(manager->events_by_devpath);
+        manager->events_by_devnum = hashmap_free(manager->events_by_devnum);
+        manager->events_by_ifindex = hashmap_free(manager->events_by_ifindex);
+        manager->devpath_subtree_size = hashmap_free_free_key(manager->devpath_subtree_size);
+
         manager->monitor = sd_device_monitor_unref(manager->monitor);
         manager->ctrl = udev_ctrl_unref(manager->ctrl);
 
@@ -298,6 +778,9 @@ static void manager_free(Manager *manager) {
         if (manager->pid == getpid_cached())
                 udev_ctrl_cleanup(manager->ctrl);
 
+        /* Settle clients that are still waiting see the connection closed without a reply, and fall back to
+         * watching the queue */
+        manager_settle_clear(manager);
         manager_clear_for_worker(manager);
 
         sd_netlink_unref(manager->rtnl);
@@ -466,7 +949,6 @@ static int worker_main(Manager *_manager, sd_device_monitor *monitor, sd_device
 
         assert(manager);
         assert(monitor);
-        assert(dev);
 
         unsetenv("NOTIFY_SOCKET");
 
@@ -498,8 +980,9 @@ static int worker_main(Manager *_manager, sd_device_monitor *monitor, sd_device
 
         (void) sd_event_source_set_description(sd_device_monitor_get_event_source(monitor), "worker-device-monitor");
 
-        /* Process first device */
-        (void) worker_device_monitor_handler(monitor, dev, manager);
+        /* Process first device, unless we were forked ahead of time */
+        if (dev)
+                (void) worker_device_monitor_handler(monitor, dev, manager);
 
         r = sd_event_loop(manager->event);
         if (r < 0)
@@ -529,13 +1012,11 @@ static int worker_spawn(Manager *manager, struct event *event) {
                 return log_error_errno(r, "Worker: Failed to enable receiving of device: %m");
 
         r = safe_fork(NULL, FORK_DEATHSIG, &pid);
-        if (r < 0) {
-                event->state = EVENT_QUEUED;
+        if (r < 0)
                 return log_error_errno(r, "Failed to fork() worker: %m");
-        }
         if (r == 0) {
                 /* Worker process */
-                r = worker_main(manager, worker_monitor, sd_device_ref(event->dev));
+                r = worker_main(manager, worker_monitor, event ? sd_device_ref(event->dev) : NULL);
                 log_close();
                 _exit(r < 0 ? EXIT_FAILURE : EXIT_SUCCESS);
         }
@@ -544,12 +1025,77 @@ static int worker_spawn(Manager *manager, struct event *event) {
         if (r < 0)
                 return log_error_errno(r, "Failed to create worker object: %m");
 
+        if (!event) {
+                /* Forked ahead of time, waits for the first device to be sent to it */
+                worker->state = WORKER_IDLE;
+                log_debug("Worker ["PID_FMT"] is forked ahead of time.", pid);
+                return 0;
+        }
+
         worker_attach_event(worker, event);
 
         log_device_debug(event->dev, "Worker ["PID_FMT"] is forked for processing SEQNUM=%"PRIu64".", pid, event->seqnum);
         return 0;
 }
 
+static unsigned manager_workers_target(Manager *manager) {
+        uint64_t n;
+
+        assert(manager);
+
+        /* Until we know how long events take, use as many workers as we may */
+        if (manager->exec_usec_avg == 0)
+                return arg_children_max;
+
+        /* One worker for each running event, plus enough to process the queued events within the latency
+         * target. Cheap events are thus handled by a few workers, rather than forking one for each. */
+        n = manager->n_events - manager->n_events_queued +
+                DIV_ROUND_UP((uint64_t) manager->n_events_queued * manager->exec_usec_avg, EVENT_LATENCY_TARGET_USEC);
+
+        return (unsigned) CLAMP(n, 1U, (uint64_t) arg_children_max);
+}
+
+static void manager_account_event(Manager *manager, struct event *event) {
+        usec_t exec_usec;
+
+        assert(manager);
+        assert(event);
+
+        if (event->started_usec == 0)
+                return;
+
+        exec_usec = usec_sub_unsigned(now(CLOCK_MONOTONIC), event->started_usec);
+
+        manager->n_events_processed++;
+        manager->queue_wait_usec_total += usec_sub_unsigned(event->started_usec, event->queued_usec);
+        manager->exec_usec_total += exec_usec;
+
+        /* Weigh the latest event with 1/8, so that we follow changes quickly, without jumping around */
+        if (manager->exec_usec_avg == 0)
+                manager->exec_usec_avg = MAX(exec_usec, 1U);
+        else
+                manager->exec_usec_avg = MAX((manager->exec_usec_avg * 7 + exec_usec) / 8, 1U);
+}
+
+static void manager_log_statistics(Manager *manager) {
+        char buf[3][FORMAT_TIMESPAN_MAX];
+        uint64_t n;
+
+        assert(manager);
+
+        n = MAX(manager->n_events_processed, UINT64_C(1));
+
+        log_info("Processed %" PRIu64 " events, "
+                 "average time queued %s, average time processing %s (recently %s), "
+                 "%u events queued, %u workers (target %u, at most %u).",
+                 manager->n_events_processed,
+                 format_timespan(buf[0], sizeof(buf[0]), manager->queue_wait_usec_total / n, USEC_PER_MSEC / 10),
+                 format_timespan(buf[1], sizeof(buf[1]), manager->exec_usec_total / n, USEC_PER_MSEC / 10),
+                 format_timespan(buf[2], sizeof(buf[2]), manager->exec_usec_avg, USEC_PER_MSEC / 10),
+                 manager->n_events_queued, hashmap_size(manager->workers),
+                 manager_workers_target(manager), arg_children_max);
+}
+
 static void event_run(Manager *manager, struct event *event) {
         static bool log_children_max_reached = true;
         struct worker *worker;
@@ -583,7 +1129,7 @@ static void event_run(Manager *manager, struct event *event) {
                 return;
         }
 
-        if (hashmap_size(manager->workers) >= arg_children_max) {
+        if (hashmap_size(manager->workers) >= manager_workers_target(manager)) {
 
                 /* Avoid spamming the debug logs if the limit is already reached and
                  * many events still need to be processed */
@@ -643,8 +1189,17 @@ static int event_queue_insert(Manager *manager, sd_device *dev) {
                 .dev_kernel = TAKE_PTR(clone),
                 .seqnum = seqnum,
                 .state = EVENT_QUEUED,
+                .queued_usec = now(CLOCK_MONOTONIC),
         };
 
+        r = event_index(manager, event);
+        if (r < 0) {
+                sd_device_unref(event->dev);
+                sd_device_unref(event->dev_kernel);
+                free(event);
+                return log_device_error_errno(dev, r, "Failed to index event: %m");
+        }
+
         if (LIST_IS_EMPTY(manager->events)) {
                 r = touch("/run/udev/queue");
                 if (r < 0)
@@ -652,6 +1207,10 @@ static int event_queue_insert(Manager *manager, sd_device *dev) {
         }
 
         LIST_APPEND(event, manager->events, event);
+        manager->n_events++;
+        manager->n_events_queued++;
+
+        manager_settle_event_queued(manager, event);
 
         log_device_debug(dev, "Device (SEQNUM=%"PRIu64", ACTION=%s) is queued",
                          seqnum, device_action_to_string(action));
@@ -674,114 +1233,60 @@ static void manager_kill_workers(Manager *manager) {
         }
 }
 
-/* lookup event for identical, parent, child device */
-static int is_device_busy(Manager *manager, struct event *event) {
-        const char *subsystem, *devpath, *devpath_old = NULL;
-        dev_t devnum = makedev(0, 0);
-        struct event *loop_event;
-        size_t devpath_len;
-        int r, ifindex = 0;
-        bool is_block;
-
-        r = sd_device_get_subsystem(event->dev, &subsystem);
-        if (r < 0)
-                return r;
-
-        is_block = streq(subsystem, "block");
-
-        r = sd_device_get_devpath(event->dev, &devpath);
-        if (r < 0)
-                return r;
-
-        devpath_len = strlen(devpath);
-
-        r = sd_device_get_property_value(event->dev, "DEVPATH_OLD", &devpath_old);
-        if (r < 0 && r != -ENOENT)
-                return r;
-
-        r = sd_device_get_devnum(event->dev, &devnum);
-        if (r < 0 && r != -ENOENT)
-                return r;
+/* lookup earlier event for identical, parent, child device */
+static bool event_is_blocked(Manager *manager, struct event *event) {
+        struct event *e;
+        char *p, *s;
 
-        r = sd_device_get_ifindex(event->dev, &ifindex);
-        if (r < 0 && r != -ENOENT)
-                return r;
-
-        /* check if queue contains events we depend on */
-        LIST_FOREACH(event, loop_event, manager->events) {
-                size_t loop_devpath_len, common;
-                const char *loop_devpath;
-
-                /* we already found a later event, earlier cannot block us, no need to check again */
-                if (loop_event->seqnum < event->delaying_seqnum)
-                        continue;
-
-                /* event we checked earlier still exists, no need to check again */
-                if (loop_event->seqnum == event->delaying_seqnum)
-                        return true;
-
-                /* found ourself, no later event can block us */
-                if (loop_event->seqnum >= event->seqnum)
-                        break;
-
-                /* check major/minor */
-                if (major(devnum) != 0) {
-                        const char *s;
-                        dev_t d;
-
-                        if (sd_device_get_subsystem(loop_event->dev, &s) < 0)
-                                continue;
-
-                        if (sd_device_get_devnum(loop_event->dev, &d) >= 0 &&
-                            devnum == d && is_block == streq(s, "block"))
-                                goto set_delaying_seqnum;
-                }
-
-                /* check network device ifindex */
-                if (ifindex > 0) {
-                        int i;
-
-                        if (sd_device_get_ifindex(loop_event->dev, &i) >= 0 &&
-                            ifindex == i)
-                                goto set_delaying_seqnum;
-                }
-
-                if (sd_device_get_devpath(loop_event->dev, &loop_devpath) < 0)
-                        continue;
+        assert(manager);
+        assert(event);
 
-                /* check our old name */
-                if (devpath_old && streq(devpath_old, loop_devpath))
-                        goto set_delaying_seqnum;
+        if (event->n_blocking_children > 0) {
+                log_device_debug(event->dev, "SEQNUM=%" PRIu64 " blocked by %u events for child devices",
+                                 event->seqnum, event->n_blocking_children);
+                return true;
+        }
 
-                loop_devpath_len = strlen(loop_devpath);
+        /* The index lists are in queue order, hence if we are not at the head, an earlier event is */
+        e = hashmap_get(manager->events_by_devpath, event->devpath);
+        if (e != event)
+                goto blocked;
 
-                /* compare devpath */
-                common = MIN(devpath_len, loop_devpath_len);
+        if (event->in_devnum_index) {
+                e = hashmap_get(manager->events_by_devnum, event->devnum_id);
+                if (e != event)
+                        goto blocked;
+        }
 
-                /* one devpath is contained in the other? */
-                if (!strneq(devpath, loop_devpath, common))
-                        continue;
+        if (event->in_ifindex_index) {
+                e = hashmap_get(manager->events_by_ifindex, INT_TO_PTR(event->ifindex));
+                if (e != event)
+                        goto blocked;
+        }
 
-                /* identical device event found */
-                if (devpath_len == loop_devpath_len)
-                        goto set_delaying_seqnum;
+        /* check our old name */
+        if (event->devpath_old) {
+                e = hashmap_get(manager->events_by_devpath, event->devpath_old);
+                if (e && e->index < event->index)
+                        goto blocked;
+        }
 
-                /* parent device event found */
-                if (devpath[common] == '/')
-                        goto set_delaying_seqnum;
+        /* check all parent devices */
+        p = strdupa(event->devpath);
+        for (s = strchr(p + 1, '/'); s; s = strchr(s + 1, '/')) {
+                *s = '\0';
+                e = hashmap_get(manager->events_by_devpath, p);
+                *s = '/';
 
-                /* child device event found */
-                if (loop_devpath[common] == '/')
-                        goto set_delaying_seqnum;
+                if (e && e->index < event->index)
+                        goto blocked;
         }
 
         return false;
 
-set_delaying_seqnum:
+blocked:
         log_device_debug(event->dev, "SEQNUM=%" PRIu64 " blocked by SEQNUM=%" PRIu64,
-                         event->seqnum, loop_event->seqnum);
-
-        event->delaying_seqnum = loop_event->seqnum;
+                         event->seqnum, e->seqnum);
         return true;
 }
 
@@ -877,11 +1382,30 @@ static void event_queue_start(Manager *manager) {
                         continue;
 
                 /* do not start event if parent or child event is still running */
-                if (is_device_busy(manager, event) != 0)
+                if (event_is_blocked(manager, event))
                         continue;
 
                 event_run(manager, event);
         }
+
+        /* Events that are still queued wait for others to finish, or for workers. In the former case, fork
+         * a few workers ahead of time, so that they are ready when the events get unblocked. */
+        if (manager->n_events_queued > 0) {
+                struct worker *worker;
+                unsigned n_idle = 0;
+                Iterator i;
+
+                HASHMAP_FOREACH(worker, manager->workers, i)
+                        if (worker->state == WORKER_IDLE)
+                                n_idle++;
+
+                while (n_idle < MIN(manager->n_events_queued, WORKER_SPARE_MAX) &&
+                       hashmap_size(manager->workers) < manager_workers_target(manager)) {
+                        if (worker_spawn(manager, NULL) < 0)
+                                break;
+                        n_idle++;
+                }
+        }
 }
 
 static void event_queue_cleanup(Manager *manager, enum event_state match_type) {
@@ -953,6 +1477,8 @@ static int on_worker(sd_event_source *s, int fd, uint32_t revents, void *userdat
                         worker->state = WORKER_IDLE;
 
                 /* worker returned */
+                if (worker->event)
+                        manager_account_event(manager, worker->event);
                 event_free(worker->event);
         }
 
@@ -1083,6 +1609,21 @@ static int on_ctrl_msg(struct udev_ctrl *uctrl, enum udev_ctrl_msg_type type, co
                 log_debug("Received udev control message (EXIT)");
                 manager_exit(manager);
                 break;
+        case UDEV_CTRL_LOG_STATISTICS:
+                log_debug("Received udev control message (LOG_STATISTICS)");
+                manager_log_statistics(manager);
+                break;
+        case UDEV_CTRL_SETTLE:
+                log_debug("Received udev control message (SETTLE), waiting for '%s'", value->buf);
+                r = manager_add_settle_match(manager, value->buf);
+                if (r == -ENOMEM)
+                        log_oom();
+                else if (r < 0)
+                        log_debug("Received invalid settle match '%s', ignoring.", value->buf);
+                break;
+        case _UDEV_CTRL_END_MESSAGES:
+                manager_settle_start(manager, uctrl);
+                break;
         default:
                 log_debug("Received unknown udev control message, ignoring");
         }
@@ -1213,6 +1754,117 @@ static int synthesize_change(sd_device *dev) {
         return 0;
 }
 
+static Watch *watch_free(Watch *w) {
+        if (!w)
+                return NULL;
+
+        sd_event_source_unref(w->debounce_event);
+        free(w->device_id);
+        return mfree(w);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(Watch*, watch_free);
+DEFINE_PRIVATE_HASH_OPS_WITH_VALUE_DESTRUCTOR(watch_hash_ops, void, trivial_hash_func, trivial_compare_func, Watch, watch_free);
+
+static int manager_get_watch(Manager *manager, int wd, Watch **ret) {
+        _cleanup_(watch_freep) Watch *w = NULL;
+        _cleanup_free_ char *device_id = NULL;
+        Watch *existing;
+        int r;
+
+        assert(manager);
+        assert(ret);
+
+        existing = hashmap_get(manager->watches, INT_TO_PTR(wd));
+        if (existing) {
+                *ret = existing;
+                return 1;
+        }
+
+        r = udev_watch_lookup(wd, &device_id);
+        if (r <= 0)
+                return r;
+
+        r = hashmap_ensure_allocated(&manager->watches, &watch_hash_ops);
+        if (r < 0)
+                return log_oom();
+
+        w = new(Watch, 1);
+        if (!w)
+                return log_oom();
+
+        *w = (Watch) {
+                .manager = manager,
+                .wd = wd,
+                .device_id = TAKE_PTR(device_id),
+        };
+
+        r = hashmap_put(manager->watches, INT_TO_PTR(wd), w);
+        if (r < 0)
+                return log_oom();
+
+        *ret = TAKE_PTR(w);
+        return 1;
+}
+
+static void watch_synthesize_change(Watch *w) {
+        _cleanup_(sd_device_unrefp) sd_device *dev = NULL;
+        int r;
+
+        assert(w);
+
+        w->last_change_usec = now(CLOCK_MONOTONIC);
+
+        r = sd_device_new_from_device_id(&dev, w->device_id);
+        if (r < 0) {
+                log_debug_errno(r, "Failed to create sd_device object for '%s', ignoring: %m", w->device_id);
+                return;
+        }
+
+        (void) synthesize_change(dev);
+}
+
+static int on_watch_debounce(sd_event_source *s, uint64_t usec, void *userdata) {
+        Watch *w = userdata;
+
+        assert(w);
+
+        w->debounce_event = sd_event_source_unref(w->debounce_event);
+        watch_synthesize_change(w);
+
+        return 1;
+}
+
+static void watch_close_write(Watch *w) {
+        usec_t n;
+        int r;
+
+        assert(w);
+
+        /* A change event is already scheduled, which will cover this write too */
+        if (w->debounce_event)
+                return;
+
+        n = now(CLOCK_MONOTONIC);
+        if (w->last_change_usec == 0 || n >= usec_add(w->last_change_usec, WATCH_DEBOUNCE_USEC)) {
+                watch_synthesize_change(w);
+                return;
+        }
+
+        /* We synthesized a change event for the device only just now. Delay the next one, so that programs
+         * writing to the device repeatedly don't flood the queue with events. */
+        r = sd_event_add_time(w->manager->event, &w->debounce_event, CLOCK_MONOTONIC,
+                              usec_add(w->last_change_usec, WATCH_DEBOUNCE_USEC), USEC_PER_MSEC,
+                              on_watch_debounce, w);
+        if (r < 0) {
+                log_warning_errno(r, "Failed to delay change event for '%s', synthesizing it right away: %m", w->device_id);
+                watch_synthesize_change(w);
+                return;
+        }
+
+        (void) sd_event_source_set_description(w->debounce_event, "watch-debounce");
+}
+
 static int on_inotify(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
         Manager *manager = userdata;
         union inotify_event_buffer buffer;
@@ -1235,20 +1887,23 @@ static int on_inotify(sd_event_source *s, int fd, uint32_t revents, void *userda
         }
 
         FOREACH_INOTIFY_EVENT(e, buffer, l) {
-                _cleanup_(sd_device_unrefp) sd_device *dev = NULL;
-                const char *devnode;
+                Watch *w;
 
-                if (udev_watch_lookup(e->wd, &dev) <= 0)
+                if (manager_get_watch(manager, e->wd, &w) <= 0)
                         continue;
 
-                if (sd_device_get_devname(dev, &devnode) < 0)
-                        continue;
-
-                log_device_debug(dev, "Inotify event: %x for %s", e->mask, devnode);
+                log_debug("Inotify event: %x for %s", e->mask, w->device_id);
                 if (e->mask & IN_CLOSE_WRITE)
-                        synthesize_change(dev);
-                else if (e->mask & IN_IGNORED)
-                        udev_watch_end(dev);
+                        watch_close_write(w);
+                else if (e->mask & IN_IGNORED) {
+                        _cleanup_(sd_device_unrefp) sd_device *dev = NULL;
+
+                        if (sd_device_new_from_device_id(&dev, w->device_id) >= 0)
+                                (void) udev_watch_end(dev);
+
+                        /* The watch descriptor may be reused for another device from now on */
+                        watch_free(hashmap_remove(manager->watches, INT_TO_PTR(e->wd)));
+                }
         }
 
         return 1;
@@ -1344,13 +1999,23 @@ static int on_sigchld(sd_event_source *s, const struct signalfd_siginfo *si, voi
 
 static int on_post(sd_event_source *s, void *userdata) {
         Manager *manager = userdata;
+        int r;
 
         assert(manager);
 
         if (!LIST_IS_EMPTY(manager->events))
                 return 1;
 
-        /* There are no pending events. Let's cleanup idle process. */
+        /* There are no pending events. Let's cleanup idle process, and compact the database if events
+         * were processed since we last looked at it. */
+
+        if (manager->n_events_processed != manager->n_events_processed_at_vacuum) {
+                manager->n_events_processed_at_vacuum = manager->n_events_processed;
+
+                r = device_database_vacuum(DEVICE_DATABASE_PATH);
+                if (r < 0)
+                        log_debug_errno(r, "Failed to compact %s, ignoring: %m", DEVICE_DATABASE_PATH);
+        }
 
         if (!hashmap_isempty(manager->workers)) {
                 /* There are idle workers */
@@ -1622,6 +2287,12 @@ static int main_loop(Manager *manager) {
 
         udev_watch_restore();
 
+        /* Whatever is left in /run/udev/data/ (e.g. from the initrd) is the baseline the combined database
+         * is kept in sync with from now on */
+        r = device_database_rebuild(DEVICE_DATABASE_PATH, "/run/udev/data");
+        if (r < 0)
+                log_warning_errno(r, "Failed to build %s, ignoring: %m", DEVICE_DATABASE_PATH);
+
         /* block and listen to all signals on signalfd */
         assert_se(sigprocmask_many(SIG_BLOCK, NULL, SIGTERM, SIGINT, SIGHUP, SIGCHLD, -1) >= 0);
 
@@ -1766,6 +2437,9 @@ static int run(int argc, char *argv[]) {
 
         umask(022);
 
+        /* Rules and link files are listed again on each reload, usually without anything having changed */
+        conf_files_cache_set_enabled(true);
+
         r = mac_selinux_init();
         if (r < 0)
                 return log_error_errno(r, "Could not initialize labelling: %m");
@@ -1,5 +1,6 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
+#include <sys/inotify.h>
 #include <sys/wait.h>
 
 #include "sd-daemon.h"
@@ -13,10 +14,14 @@
 #include "socket-util.h"
 #include "stdio-util.h"
 #include "umask-util.h"
+#include "userdb-cache.h"
 #include "userdbd-manager.h"
 
 #define LISTEN_TIMEOUT_USEC (25 * USEC_PER_SEC)
 
+/* Exit status of the cache generator if there was nothing to cache */
+#define CACHE_EXIT_EMPTY 2
+
 static int start_workers(Manager *m, bool explicit_request);
 
 static int on_sigchld(sd_event_source *s, const struct signalfd_siginfo *si, void *userdata) {
@@ -39,6 +44,21 @@ static int on_sigchld(sd_event_source *s, const struct signalfd_siginfo *si, voi
                 if (siginfo.si_pid == 0)
                         break;
 
+                if (siginfo.si_pid == m->cache_pid) {
+                        if (siginfo.si_code == CLD_EXITED && siginfo.si_status == CACHE_EXIT_EMPTY) {
+                                /* Nothing to cache, stop waking up until something might have changed */
+                                if (!m->cache_rearm) {
+                                        log_debug("No records to cache, stopping cache refresh.");
+                                        (void) sd_event_source_set_enabled(m->cache_event_source, SD_EVENT_OFF);
+                                }
+                        } else if (siginfo.si_code != CLD_EXITED || siginfo.si_status != EXIT_SUCCESS)
+                                log_debug("Cache generator " PID_FMT " failed, ignoring.", siginfo.si_pid);
+
+                        m->cache_pid = 0;
+                        m->cache_rearm = false;
+                        continue;
+                }
+
                 if (set_remove(m->workers_dynamic, PID_TO_PTR(siginfo.si_pid)))
                         removed = true;
                 if (set_remove(m->workers_fixed, PID_TO_PTR(siginfo.si_pid)))
@@ -66,6 +86,29 @@ static int on_sigchld(sd_event_source *s, const struct signalfd_siginfo *si, voi
         return 0;
 }
 
+static void manager_arm_cache_refresh(Manager *m) {
+        int enabled = SD_EVENT_OFF, r;
+
+        assert(m);
+
+        if (!m->cache_event_source)
+                return;
+
+        /* The running generator might not see the change anymore, don't let it turn off the refresh */
+        if (m->cache_pid > 0)
+                m->cache_rearm = true;
+
+        (void) sd_event_source_get_enabled(m->cache_event_source, &enabled);
+        if (enabled != SD_EVENT_OFF)
+                return;
+
+        r = sd_event_source_set_time(m->cache_event_source, 0);
+        if (r >= 0)
+                r = sd_event_source_set_enabled(m->cache_event_source, SD_EVENT_ONESHOT);
+        if (r < 0)
+                log_warning_errno(r, "Failed to arm cache refresh, ignoring: %m");
+}
+
 static int on_sigusr2(sd_event_source *s, const struct signalfd_siginfo *si, void *userdata) {
         Manager *m = userdata;
 
@@ -73,6 +116,58 @@ static int on_sigusr2(sd_event_source *s, const struct signalfd_siginfo *si, voi
         assert(m);
 
         (void) start_workers(m, true); /* Workers told us there's more work, let's add one more worker as long as we are below the high watermark */
+
+        /* Lots of lookups are going on, maybe there's something to cache now */
+        manager_arm_cache_refresh(m);
+        return 0;
+}
+
+static int on_userdb_dir_change(sd_event_source *s, const struct inotify_event *event, void *userdata) {
+        Manager *m = userdata;
+
+        assert(m);
+
+        /* A service came or went, the records we could cache might have changed */
+        manager_arm_cache_refresh(m);
+        return 0;
+}
+
+static int on_cache_refresh(sd_event_source *s, uint64_t usec, void *userdata) {
+        Manager *m = userdata;
+        pid_t pid;
+        int r;
+
+        assert(s);
+        assert(m);
+
+        r = sd_event_source_set_time(s, usec_add(usec, USERDB_CACHE_REFRESH_USEC));
+        if (r < 0)
+                return log_error_errno(r, "Failed to reschedule cache refresh: %m");
+
+        r = sd_event_source_set_enabled(s, SD_EVENT_ONESHOT);
+        if (r < 0)
+                return log_error_errno(r, "Failed to reenable cache refresh: %m");
+
+        /* Still busy with the last one? */
+        if (m->cache_pid > 0)
+                return 0;
+
+        /* Enumerating all services might take a while, do it in a child process, to not delay the workers */
+        r = safe_fork("(sd-cache)", FORK_RESET_SIGNALS|FORK_DEATHSIG|FORK_LOG, &pid);
+        if (r < 0)
+                return log_warning_errno(r, "Failed to fork cache generator, ignoring: %m");
+        if (r == 0) {
+                /* Child */
+                r = userdb_cache_generate(USERDB_CACHE_PATH, usec_add(now(CLOCK_MONOTONIC), USERDB_CACHE_TTL_USEC));
+                if (r < 0) {
+                        log_debug_errno(r, "Failed to generate userdb cache: %m");
+                        _exit(EXIT_FAILURE);
+                }
+
+                _exit(r > 0 ? EXIT_SUCCESS : CACHE_EXIT_EMPTY);
+        }
+
+        m->cache_pid = pid;
         return 0;
 }
 
@@ -133,6 +228,11 @@ Manager* manager_free(Manager *m) {
 
         sd_event_source_disable_unref(m->sigusr2_event_source);
         sd_event_source_disable_unref(m->sigchld_event_source);
+        sd_event_source_disable_unref(m->cache_event_source);
+        sd_event_source_disable_unref(m->userdb_dir_event_source);
+
+        /* Don't leave a cache around nobody refreshes anymore */
+        (void) unlink(USERDB_CACHE_PATH);
 
         sd_event_unref(m->event);
 
@@ -297,5 +397,15 @@ int manager_startup(Manager *m) {
         if (setsockopt(m->listen_fd, SOL_SOCKET, SO_RCVTIMEO, timeval_store(&ts, LISTEN_TIMEOUT_USEC), sizeof(ts)) < 0)
                 return log_error_errno(errno, "Failed to se SO_RCVTIMEO: %m");
 
+        r = sd_event_add_time(m->event, &m->cache_event_source, CLOCK_MONOTONIC, 0, 0, on_cache_refresh, m);
+        if (r < 0)
+                return log_error_errno(r, "Failed to allocate cache refresh timer: %m");
+
+        r = sd_event_add_inotify(m->event, &m->userdb_dir_event_source, "/run/systemd/userdb",
+                                 IN_CREATE|IN_MOVED_TO|IN_DELETE|IN_MOVED_FROM|IN_ONLYDIR,
+                                 on_userdb_dir_change, m);
+        if (r < 0)
+                log_warning_errno(r, "Failed to watch /run/systemd/userdb, ignoring: %m");
+
         return start_workers(m, false);
 }
@@ -13,6 +13,10 @@ typedef struct Manager Manager;
 #define USERDB_WORKERS_MIN 3
 #define USERDB_WORKERS_MAX 4096
 
+/* How often to regenerate the record cache for NSS, and how long readers may use it */
+#define USERDB_CACHE_REFRESH_USEC (20 * USEC_PER_SEC)
+#define USERDB_CACHE_TTL_USEC (30 * USEC_PER_SEC)
+
 struct Manager {
         sd_event *event;
 
@@ -22,6 +26,11 @@ struct Manager {
         sd_event_source *sigusr2_event_source;
         sd_event_source *sigchld_event_source;
 
+        sd_event_source *cache_event_source;
+        sd_event_source *userdb_dir_event_source;
+        pid_t cache_pid;
+        bool cache_rearm;
+
         int listen_fd;
 
         RateLimit worker_ratelimit;
@@ -198,14 +198,14 @@ static int vl_method_get_user_record(Varlink *link, JsonVariant *parameters, Var
         } else if (streq_ptr(p.service, "io.systemd.Multiplexer")) {
 
                 if (uid_is_valid(p.uid))
-                        r = userdb_by_uid(p.uid, USERDB_AVOID_MULTIPLEXER, &hr);
+                        r = userdb_by_uid(p.uid, USERDB_AVOID_MULTIPLEXER|USERDB_POOL_CONNECTIONS, &hr);
                 else if (p.user_name)
-                        r = userdb_by_name(p.user_name, USERDB_AVOID_MULTIPLEXER, &hr);
+                        r = userdb_by_name(p.user_name, USERDB_AVOID_MULTIPLEXER|USERDB_POOL_CONNECTIONS, &hr);
                 else {
                         _cleanup_(userdb_iterator_freep) UserDBIterator *iterator = NULL;
                         _cleanup_(json_variant_unrefp) JsonVariant *last = NULL;
 
-                        r = userdb_all(USERDB_AVOID_MULTIPLEXER, &iterator);
+                        r = userdb_all(USERDB_AVOID_MULTIPLEXER|USERDB_POOL_CONNECTIONS, &iterator);
                         if (r < 0)
                                 return r;
 
@@ -385,14 +385,14 @@ static int vl_method_get_group_record(Varlink *link, JsonVariant *parameters, Va
         } else if (streq_ptr(p.service, "io.systemd.Multiplexer")) {
 
                 if (gid_is_valid(p.gid))
-                        r = groupdb_by_gid(p.gid, USERDB_AVOID_MULTIPLEXER, &g);
+                        r = groupdb_by_gid(p.gid, USERDB_AVOID_MULTIPLEXER|USERDB_POOL_CONNECTIONS, &g);
                 else if (p.group_name)
-                        r = groupdb_by_name(p.group_name, USERDB_AVOID_MULTIPLEXER, &g);
+                        r = groupdb_by_name(p.group_name, USERDB_AVOID_MULTIPLEXER|USERDB_POOL_CONNECTIONS, &g);
                 else {
                         _cleanup_(userdb_iterator_freep) UserDBIterator *iterator = NULL;
                         _cleanup_(json_variant_unrefp) JsonVariant *last = NULL;
 
-                        r = groupdb_all(USERDB_AVOID_MULTIPLEXER, &iterator);
+                        r = groupdb_all(USERDB_AVOID_MULTIPLEXER|USERDB_POOL_CONNECTIONS, &iterator);
                         if (r < 0)
                                 return r;
 
@@ -570,11 +570,11 @@ static int vl_method_get_memberships(Varlink *link, JsonVariant *parameters, Var
                 _cleanup_(userdb_iterator_freep) UserDBIterator *iterator = NULL;
 
                 if (p.group_name)
-                        r = membershipdb_by_group(p.group_name, USERDB_AVOID_MULTIPLEXER, &iterator);
+                        r = membershipdb_by_group(p.group_name, USERDB_AVOID_MULTIPLEXER|USERDB_POOL_CONNECTIONS, &iterator);
                 else if (p.user_name)
-                        r = membershipdb_by_user(p.user_name, USERDB_AVOID_MULTIPLEXER, &iterator);
+                        r = membershipdb_by_user(p.user_name, USERDB_AVOID_MULTIPLEXER|USERDB_POOL_CONNECTIONS, &iterator);
                 else
-                        r = membershipdb_all(USERDB_AVOID_MULTIPLEXER, &iterator);
+                        r = membershipdb_all(USERDB_AVOID_MULTIPLEXER|USERDB_POOL_CONNECTIONS, &iterator);
                 if (r < 0)
                         return r;
 
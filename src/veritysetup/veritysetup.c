@@ -12,6 +12,7 @@
 #include "pretty-print.h"
 #include "string-util.h"
 #include "terminal-util.h"
+#include "time-util.h"
 
 static char *arg_root_hash = NULL;
 static char *arg_data_what = NULL;
@@ -57,7 +58,10 @@ static int run(int argc, char *argv[]) {
 
         if (streq(argv[1], "attach")) {
                 _cleanup_free_ void *m = NULL;
+                char ts[FORMAT_TIMESPAN_MAX];
                 crypt_status_info status;
+                bool cached;
+                usec_t start;
                 size_t l;
 
                 if (argc < 6)
@@ -67,29 +71,22 @@ static int run(int argc, char *argv[]) {
                 if (r < 0)
                         return log_error_errno(r, "Failed to parse root hash: %m");
 
-                r = crypt_init(&cd, argv[4]);
-                if (r < 0)
-                        return log_error_errno(r, "Failed to open verity device %s: %m", argv[4]);
-
-                crypt_set_log_callback(cd, cryptsetup_log_glue, NULL);
-
-                status = crypt_status(cd, argv[2]);
+                status = crypt_status(NULL, argv[2]);
                 if (IN_SET(status, CRYPT_ACTIVE, CRYPT_BUSY)) {
                         log_info("Volume %s already active.", argv[2]);
                         return 0;
                 }
 
-                r = crypt_load(cd, CRYPT_VERITY, NULL);
-                if (r < 0)
-                        return log_error_errno(r, "Failed to load verity superblock: %m");
-
-                r = crypt_set_data_device(cd, argv[3]);
-                if (r < 0)
-                        return log_error_errno(r, "Failed to configure data device: %m");
+                start = now(CLOCK_MONOTONIC);
 
-                r = crypt_activate_by_volume_key(cd, argv[2], m, l, CRYPT_ACTIVATE_READONLY);
+                r = crypt_activate_verity(argv[2], argv[4], argv[3], m, l, CRYPT_ACTIVATE_READONLY, NULL);
                 if (r < 0)
                         return log_error_errno(r, "Failed to set up verity device: %m");
+                cached = r > 0;
+
+                log_debug("Set up verity device %s in %s%s.", argv[2],
+                          format_timespan(ts, sizeof(ts), now(CLOCK_MONOTONIC) - start, 1),
+                          cached ? ", using cached parameters" : "");
 
         } else if (streq(argv[1], "detach")) {
 
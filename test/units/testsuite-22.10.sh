@@ -0,0 +1,47 @@
+#! /bin/bash
+#
+# Verify that the state remembered by --clean skips trees with nothing old enough in them, and only ever
+# delays the removal of entries.
+#
+
+set -e
+set -x
+
+rm -fr /tmp/clean-state /var/lib/systemd/tmpfiles/clean-state
+mkdir -p /tmp/clean-state/sub
+touch /tmp/clean-state/f /tmp/clean-state/sub/f
+
+clean() {
+        SYSTEMD_LOG_LEVEL=debug systemd-tmpfiles --clean - 2>&1 <<EOF
+d /tmp/clean-state - - - $1
+EOF
+}
+
+# Nothing is old enough yet, but the tree is looked at, and the state is saved
+(! clean 1h | grep -q 'Directory "/tmp/clean-state": nothing below was touched before')
+test -f /tmp/clean-state/f
+test -f /tmp/clean-state/sub/f
+test -s /var/lib/systemd/tmpfiles/clean-state
+
+# The second run skips the whole tree
+clean 1h | grep -q 'Directory "/tmp/clean-state": nothing below was touched before'
+test -f /tmp/clean-state/f
+test -f /tmp/clean-state/sub/f
+
+# Without the state everything is looked at again
+rm /var/lib/systemd/tmpfiles/clean-state
+(! clean 1h | grep -q 'nothing below was touched before')
+
+# New entries don't make anything go away earlier than it would without the state
+touch /tmp/clean-state/sub/g
+clean 1h | grep -q 'Directory "/tmp/clean-state": nothing below was touched before'
+test -f /tmp/clean-state/sub/g
+
+# Once the entries are old enough, the state doesn't keep them around
+sleep 3
+(! clean 2s | grep -q 'Directory "/tmp/clean-state": nothing below was touched before')
+test ! -e /tmp/clean-state/f
+test ! -e /tmp/clean-state/sub/f
+test ! -e /tmp/clean-state/sub/g
+
+rm -fr /tmp/clean-state